@@ -0,0 +1,370 @@
+/* -----------------------------------------------------------------------------
+ *                 OpenMM(tm) Benchmark program in C++
+ * -----------------------------------------------------------------------------
+ * This program measures the performance of the standard benchmark systems on
+ * every available Platform, and writes the results as JSON so they can be
+ * compared across hardware and tracked over time.  Unlike benchmark.py it does
+ * not need the Python wrappers or the OpenMM application layer.
+ *
+ * The simulations are read from XML files created by running
+ *
+ *     python benchmark.py --platform Reference --serialize <directory>
+ *
+ * which writes <test>_system.xml, <test>_integrator.xml, and <test>_state.xml
+ * for each test.  Run "Benchmark --help" for the list of options.
+ *
+ * For each test and Platform the results include the number of ns/day, the
+ * percentiles of the wall clock time per step, the time to evaluate each force
+ * group, and the peak memory used by the process.  Step latencies are measured
+ * over blocks of steps, each one ending by retrieving the positions, so they
+ * include the time to synchronize with the device.  If every force is in the
+ * same group and the integrator evaluates all groups together, each force is
+ * placed in its own group so it can be timed separately.
+ * -------------------------------------------------------------------------- */
+
+#include "OpenMM.h"
+#include "openmm/serialization/SerializationProxy.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <typeinfo>
+#include <vector>
+#ifndef _WIN32
+    #include <sys/resource.h>
+#endif
+
+using namespace OpenMM;
+using namespace std;
+
+static const char* DefaultTests[] = {"gbsa", "rf", "pme", "apoa1pme", "apoa1ljpme", "amoebapme"};
+
+struct Options {
+    Options() : dataDirectory("."), precision("single"), seconds(60.0), sampleSteps(10) {
+    }
+    string dataDirectory, outputFile, precision, device;
+    vector<string> platforms, tests;
+    map<string, string> properties;
+    double seconds;
+    int sampleSteps;
+};
+
+struct GroupTiming {
+    int group;
+    vector<string> forces;
+    double milliseconds;
+};
+
+struct Result {
+    string test, platform, error;
+    int numParticles, steps;
+    double stepSize, elapsedSeconds, nsPerDay, peakMemoryMB;
+    map<string, string> properties;
+    vector<double> stepLatencies;
+    vector<GroupTiming> groupTimings;
+};
+
+static double currentSeconds() {
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double peakMemoryMB() {
+#ifdef _WIN32
+    return 0.0;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss/(1024.0*1024.0);
+#else
+    return usage.ru_maxrss/1024.0;
+#endif
+#endif
+}
+
+template <class T>
+static T* loadObject(const string& filename) {
+    ifstream file(filename.c_str());
+    if (!file.is_open())
+        throw OpenMMException("Unable to open file "+filename);
+    return XmlSerializer::deserialize<T>(file);
+}
+
+static string forceTypeName(const Force& force) {
+    try {
+        return SerializationProxy::getProxy(typeid(force)).getTypeName();
+    }
+    catch (const OpenMMException&) {
+        return "Force";
+    }
+}
+
+/**
+ * If every force is in group 0 and the integrator does not treat groups specially,
+ * give each force its own group.  This does not change the dynamics.
+ */
+static void splitForceGroups(System& system, const Integrator& integrator) {
+    if (system.getNumForces() > 32 || (unsigned int) integrator.getIntegrationForceGroups() != 0xFFFFFFFF)
+        return;
+    if (dynamic_cast<const CustomIntegrator*>(&integrator) != NULL || dynamic_cast<const MTSLangevinIntegrator*>(&integrator) != NULL)
+        return;
+    for (int i = 0; i < system.getNumForces(); i++)
+        if (system.getForce(i).getForceGroup() != 0)
+            return;
+    for (int i = 0; i < system.getNumForces(); i++)
+        system.getForce(i).setForceGroup(i);
+}
+
+static double percentile(const vector<double>& sorted, double fraction) {
+    if (sorted.size() == 0)
+        return 0.0;
+    int index = (int) (fraction*(sorted.size()-1)+0.5);
+    return sorted[index];
+}
+
+static void runTest(const string& test, Platform& platform, const Options& options, Result& result) {
+    string base = options.dataDirectory+"/"+test;
+    System* system = loadObject<System>(base+"_system.xml");
+    Integrator* integrator = loadObject<Integrator>(base+"_integrator.xml");
+    State* state = loadObject<State>(base+"_state.xml");
+    splitForceGroups(*system, *integrator);
+    result.numParticles = system->getNumParticles();
+    result.stepSize = integrator->getStepSize();
+    string name = platform.getName();
+    const vector<string>& propertyNames = platform.getPropertyNames();
+    for (auto& prop : options.properties)
+        if (find(propertyNames.begin(), propertyNames.end(), prop.first) != propertyNames.end())
+            result.properties[prop.first] = prop.second;
+    if (name == "CUDA" || name == "OpenCL") {
+        result.properties["Precision"] = options.precision;
+        if (options.device.size() > 0)
+            result.properties["DeviceIndex"] = options.device;
+    }
+    Context* context = NULL;
+    try {
+        context = new Context(*system, *integrator, platform, result.properties);
+        context->setState(*state);
+
+        // Take a few steps to make sure everything is fully initialized.
+
+        int initialSteps = (options.device.find_first_of(", ") == string::npos ? 5 : 250);
+        integrator->step(initialSteps);
+        context->getState(State::Energy);
+
+        // Time blocks of steps until the target time has elapsed.
+
+        double startTime = currentSeconds();
+        double endTime = startTime;
+        result.steps = 0;
+        do {
+            double blockStart = currentSeconds();
+            integrator->step(options.sampleSteps);
+            context->getState(State::Positions);
+            endTime = currentSeconds();
+            result.steps += options.sampleSteps;
+            result.stepLatencies.push_back((endTime-blockStart)/options.sampleSteps);
+        } while (endTime-startTime < options.seconds);
+        result.elapsedSeconds = endTime-startTime;
+        result.nsPerDay = result.stepSize*result.steps*86400/(1000*result.elapsedSeconds);
+        sort(result.stepLatencies.begin(), result.stepLatencies.end());
+
+        // Time the evaluation of each force group.
+
+        map<int, vector<string> > groups;
+        for (int i = 0; i < system->getNumForces(); i++)
+            groups[system->getForce(i).getForceGroup()].push_back(forceTypeName(system->getForce(i)));
+        const int repeats = 10;
+        for (auto& group : groups) {
+            GroupTiming timing;
+            timing.group = group.first;
+            timing.forces = group.second;
+            context->getState(State::Forces, false, 1<<group.first);
+            double groupStart = currentSeconds();
+            for (int i = 0; i < repeats; i++)
+                context->getState(State::Forces, false, 1<<group.first);
+            timing.milliseconds = 1000*(currentSeconds()-groupStart)/repeats;
+            result.groupTimings.push_back(timing);
+        }
+        result.peakMemoryMB = peakMemoryMB();
+    }
+    catch (...) {
+        delete context;
+        delete state;
+        delete integrator;
+        delete system;
+        throw;
+    }
+    delete context;
+    delete state;
+    delete integrator;
+    delete system;
+}
+
+static string quote(const string& str) {
+    string result = "\"";
+    for (char c : str) {
+        if (c == '"' || c == '\\')
+            result += '\\';
+        if (c == '\n')
+            result += "\\n";
+        else if (c >= 0 && c < 32)
+            result += ' ';
+        else
+            result += c;
+    }
+    return result+"\"";
+}
+
+static void writeResults(ostream& out, const vector<Result>& results) {
+    out << "{\n  \"openmmVersion\": " << quote(Platform::getOpenMMVersion()) << ",\n  \"results\": [";
+    for (int i = 0; i < (int) results.size(); i++) {
+        const Result& r = results[i];
+        out << (i == 0 ? "\n" : ",\n") << "    {\n";
+        out << "      \"test\": " << quote(r.test) << ",\n";
+        out << "      \"platform\": " << quote(r.platform) << ",\n";
+        out << "      \"properties\": {";
+        bool first = true;
+        for (auto& prop : r.properties) {
+            out << (first ? "" : ", ") << quote(prop.first) << ": " << quote(prop.second);
+            first = false;
+        }
+        out << "},\n";
+        if (r.error.size() > 0) {
+            out << "      \"error\": " << quote(r.error) << "\n    }";
+            continue;
+        }
+        const vector<double>& lat = r.stepLatencies;
+        out << "      \"numParticles\": " << r.numParticles << ",\n";
+        out << "      \"stepSizePs\": " << r.stepSize << ",\n";
+        out << "      \"steps\": " << r.steps << ",\n";
+        out << "      \"elapsedSeconds\": " << r.elapsedSeconds << ",\n";
+        out << "      \"nsPerDay\": " << r.nsPerDay << ",\n";
+        out << "      \"stepLatencyMs\": {\"min\": " << 1000*lat.front() << ", \"p50\": " << 1000*percentile(lat, 0.5) <<
+                ", \"p90\": " << 1000*percentile(lat, 0.9) << ", \"p99\": " << 1000*percentile(lat, 0.99) << ", \"max\": " << 1000*lat.back() << "},\n";
+        out << "      \"forceGroups\": [";
+        for (int j = 0; j < (int) r.groupTimings.size(); j++) {
+            const GroupTiming& timing = r.groupTimings[j];
+            out << (j == 0 ? "\n" : ",\n") << "        {\"group\": " << timing.group << ", \"forces\": [";
+            for (int k = 0; k < (int) timing.forces.size(); k++)
+                out << (k == 0 ? "" : ", ") << quote(timing.forces[k]);
+            out << "], \"milliseconds\": " << timing.milliseconds << "}";
+        }
+        out << "\n      ],\n";
+        out << "      \"peakMemoryMB\": " << r.peakMemoryMB << "\n    }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+static vector<string> splitList(const string& list) {
+    vector<string> items;
+    stringstream stream(list);
+    string item;
+    while (getline(stream, item, ','))
+        if (item.size() > 0)
+            items.push_back(item);
+    return items;
+}
+
+static void printUsage() {
+    printf("Usage: Benchmark [options]\n\n");
+    printf("  --data DIR          directory containing the files written by benchmark.py --serialize [default: .]\n");
+    printf("  --platform LIST     comma separated list of platforms to benchmark [default: all]\n");
+    printf("  --test LIST         comma separated list of tests [default: gbsa,rf,pme,apoa1pme,apoa1ljpme,amoebapme]\n");
+    printf("  --seconds S         how long to run each test in seconds [default: 60]\n");
+    printf("  --sample-steps N    number of steps in each block used to measure step latency [default: 10]\n");
+    printf("  --precision P       precision mode for CUDA or OpenCL: single, mixed, or double [default: single]\n");
+    printf("  --device D          device index for CUDA or OpenCL\n");
+    printf("  --property N=V      set a platform property, such as HugePages=true.  May be repeated.  It is\n");
+    printf("                      only passed to platforms that support it.\n");
+    printf("  --output FILE       write the JSON results to this file instead of stdout\n");
+}
+
+static bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--help" || arg == "-h")
+            return false;
+        if (i+1 == argc)
+            throw OpenMMException("Missing value for option "+arg);
+        string value = argv[++i];
+        if (arg == "--data")
+            options.dataDirectory = value;
+        else if (arg == "--platform")
+            options.platforms = splitList(value);
+        else if (arg == "--test")
+            options.tests = splitList(value);
+        else if (arg == "--seconds")
+            options.seconds = atof(value.c_str());
+        else if (arg == "--sample-steps")
+            options.sampleSteps = max(1, atoi(value.c_str()));
+        else if (arg == "--precision")
+            options.precision = value;
+        else if (arg == "--device")
+            options.device = value;
+        else if (arg == "--output")
+            options.outputFile = value;
+        else if (arg == "--property") {
+            size_t split = value.find('=');
+            if (split == string::npos)
+                throw OpenMMException("Properties must have the form NAME=VALUE: "+value);
+            options.properties[value.substr(0, split)] = value.substr(split+1);
+        }
+        else
+            throw OpenMMException("Unknown option: "+arg);
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        Options options;
+        if (!parseOptions(argc, argv, options)) {
+            printUsage();
+            return 0;
+        }
+        Platform::loadPluginsFromDirectory(Platform::getDefaultPluginsDirectory());
+        if (options.platforms.size() == 0)
+            for (int i = 0; i < Platform::getNumPlatforms(); i++)
+                options.platforms.push_back(Platform::getPlatform(i).getName());
+        if (options.tests.size() == 0)
+            options.tests = vector<string>(DefaultTests, DefaultTests+sizeof(DefaultTests)/sizeof(DefaultTests[0]));
+        vector<Result> results;
+        for (const string& test : options.tests)
+            for (const string& platformName : options.platforms) {
+                Result result;
+                result.test = test;
+                result.platform = platformName;
+                fprintf(stderr, "Running %s on %s\n", test.c_str(), platformName.c_str());
+                try {
+                    runTest(test, Platform::getPlatformByName(platformName), options, result);
+                }
+                catch (const exception& e) {
+                    result.error = e.what();
+                    fprintf(stderr, "Test failed: %s\n", e.what());
+                }
+                results.push_back(result);
+            }
+        if (options.outputFile.size() > 0) {
+            ofstream out(options.outputFile.c_str());
+            if (!out.is_open())
+                throw OpenMMException("Unable to open file "+options.outputFile);
+            writeResults(out, results);
+        }
+        else
+            writeResults(cout, results);
+        for (const Result& result : results)
+            if (result.error.size() > 0)
+                return 1;
+        return 0;
+    }
+    catch (const exception& e) {
+        fprintf(stderr, "EXCEPTION: %s\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,174 @@
+/* -----------------------------------------------------------------------------
+ *             OpenMM(tm) kernel precompilation program in C++
+ * -----------------------------------------------------------------------------
+ * The CUDA and OpenCL platforms compile their kernels at runtime, and cache the
+ * compiled kernels in the directory given by the OPENMM_CACHE_DIR environment
+ * variable.  This program fills that cache ahead of time, so the first
+ * simulation on a new machine (for example, a container image deployed to many
+ * nodes) does not need to wait for the compiler.
+ *
+ * It reads a System (and optionally an Integrator and State) from XML files
+ * written by XmlSerializer, creates a Context with the requested Platform and
+ * properties, and then does everything that causes kernels to be compiled:
+ * computing forces and energies for all force groups and for each group on its
+ * own, with and without energy, and taking a time step.  The cache entries
+ * depend on the System, the Platform properties, and the device, so run it
+ * with the same inputs and on the same type of GPU that will be used in
+ * production.  Run "PrecompileKernels --help" for the list of options.
+ * -------------------------------------------------------------------------- */
+
+#include "OpenMM.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+struct Options {
+    string systemFile, integratorFile, stateFile, platform, cacheDirectory;
+    map<string, string> properties;
+};
+
+template <class T>
+static T* loadObject(const string& filename) {
+    ifstream file(filename.c_str());
+    if (!file.is_open())
+        throw OpenMMException("Unable to open file "+filename);
+    return XmlSerializer::deserialize<T>(file);
+}
+
+/**
+ * Place the particles on a cubic lattice, with the spacing of atoms in a liquid.  This is only
+ * used when no State is given.  The energies are meaningless, but the same kernels get compiled.
+ */
+static vector<Vec3> createLatticePositions(int numParticles) {
+    const double spacing = 0.3;
+    int gridSize = (int) ceil(pow((double) numParticles, 1.0/3.0));
+    vector<Vec3> positions;
+    for (int i = 0; i < numParticles; i++)
+        positions.push_back(Vec3(i%gridSize, (i/gridSize)%gridSize, i/(gridSize*gridSize))*spacing);
+    return positions;
+}
+
+static void setCacheDirectory(const string& directory) {
+#ifdef _WIN32
+    _putenv_s("OPENMM_CACHE_DIR", directory.c_str());
+#else
+    setenv("OPENMM_CACHE_DIR", directory.c_str(), 1);
+#endif
+}
+
+static void precompile(const Options& options) {
+    System* system = loadObject<System>(options.systemFile);
+    Integrator* integrator = (options.integratorFile.size() > 0 ? loadObject<Integrator>(options.integratorFile) : new LangevinMiddleIntegrator(300.0, 1.0, 0.002));
+    State* state = (options.stateFile.size() > 0 ? loadObject<State>(options.stateFile) : NULL);
+    Context* context = NULL;
+    try {
+        Platform& platform = Platform::getPlatformByName(options.platform);
+        context = new Context(*system, *integrator, platform, options.properties);
+        if (state != NULL)
+            context->setState(*state);
+        else {
+            context->setPositions(createLatticePositions(system->getNumParticles()));
+            context->setVelocitiesToTemperature(300.0);
+        }
+
+        // Many kernels are only compiled the first time they are needed, and there are separate
+        // versions depending on whether forces and energies are computed and for which groups.
+
+        set<int> groups;
+        for (int i = 0; i < system->getNumForces(); i++)
+            groups.insert(system->getForce(i).getForceGroup());
+        context->getState(State::Forces | State::Energy);
+        context->getState(State::Forces);
+        context->getState(State::Energy);
+        if (groups.size() > 1)
+            for (int group : groups) {
+                context->getState(State::Forces | State::Energy, false, 1<<group);
+                context->getState(State::Forces, false, 1<<group);
+                context->getState(State::Energy, false, 1<<group);
+            }
+        integrator->step(1);
+        context->getState(State::Positions | State::Velocities | State::Energy);
+        printf("Compiled kernels for %s on the %s platform\n", options.systemFile.c_str(), platform.getName().c_str());
+        for (auto& property : platform.getPropertyNames())
+            printf("  %s: %s\n", property.c_str(), platform.getPropertyValue(*context, property).c_str());
+    }
+    catch (...) {
+        delete context;
+        delete state;
+        delete integrator;
+        delete system;
+        throw;
+    }
+    delete context;
+    delete state;
+    delete integrator;
+    delete system;
+}
+
+static void printUsage() {
+    printf("Usage: PrecompileKernels --system FILE --platform NAME [options]\n\n");
+    printf("  --system FILE       XML file containing the serialized System\n");
+    printf("  --platform NAME     the platform to compile kernels for, such as CUDA or OpenCL\n");
+    printf("  --integrator FILE   XML file containing the serialized Integrator [default: LangevinMiddleIntegrator]\n");
+    printf("  --state FILE        XML file containing a serialized State to take positions from [default: a lattice]\n");
+    printf("  --property N=V      set a platform property, such as Precision=mixed.  May be repeated.\n");
+    printf("  --cache-dir DIR     directory to write the compiled kernels to [default: $OPENMM_CACHE_DIR]\n");
+}
+
+static bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--help" || arg == "-h")
+            return false;
+        if (i+1 == argc)
+            throw OpenMMException("Missing value for option "+arg);
+        string value = argv[++i];
+        if (arg == "--system")
+            options.systemFile = value;
+        else if (arg == "--platform")
+            options.platform = value;
+        else if (arg == "--integrator")
+            options.integratorFile = value;
+        else if (arg == "--state")
+            options.stateFile = value;
+        else if (arg == "--cache-dir")
+            options.cacheDirectory = value;
+        else if (arg == "--property") {
+            size_t split = value.find('=');
+            if (split == string::npos)
+                throw OpenMMException("Properties must have the form NAME=VALUE: "+value);
+            options.properties[value.substr(0, split)] = value.substr(split+1);
+        }
+        else
+            throw OpenMMException("Unknown option: "+arg);
+    }
+    return (options.systemFile.size() > 0 && options.platform.size() > 0);
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        Options options;
+        if (!parseOptions(argc, argv, options)) {
+            printUsage();
+            return 0;
+        }
+        if (options.cacheDirectory.size() > 0)
+            setCacheDirectory(options.cacheDirectory);
+        Platform::loadPluginsFromDirectory(Platform::getDefaultPluginsDirectory());
+        precompile(options);
+        return 0;
+    }
+    catch (const exception& e) {
+        fprintf(stderr, "EXCEPTION: %s\n", e.what());
+        return 1;
+    }
+}
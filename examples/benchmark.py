@@ -3,6 +3,7 @@ import simtk.openmm.app as app
 import simtk.openmm as mm
 import simtk.unit as unit
 import sys
+import os
 from datetime import datetime
 from argparse import ArgumentParser
 
@@ -114,6 +115,15 @@ def runOneTest(testName, options):
         context = mm.Context(system, integ, platform)
     context.setPositions(pdb.positions)
     context.setVelocitiesToTemperature(300*unit.kelvin)
+    if options.serialize is not None:
+        # Save the simulation so it can be run by the C++ Benchmark program.
+
+        state = context.getState(getPositions=True, getVelocities=True, getParameters=True)
+        for suffix, obj in (('system', system), ('integrator', integ), ('state', state)):
+            with open(os.path.join(options.serialize, '%s_%s.xml' % (testName, suffix)), 'w') as f:
+                f.write(mm.XmlSerializer.serialize(obj))
+        print('Saved to %s' % options.serialize)
+        return
     steps = 20
     while True:
         time = timeIntegration(context, steps, initialSteps)
@@ -139,6 +149,7 @@ parser.add_argument('--mutual-epsilon', default=1e-5, dest='epsilon', type=float
 parser.add_argument('--heavy-hydrogens', action='store_true', default=False, dest='heavy', help='repartition mass to allow a larger time step')
 parser.add_argument('--device', default=None, dest='device', help='device index for CUDA or OpenCL')
 parser.add_argument('--precision', default='single', dest='precision', choices=('single', 'mixed', 'double'), help='precision mode for CUDA or OpenCL: single, mixed, or double [default: single]')
+parser.add_argument('--serialize', default=None, dest='serialize', help='instead of running the tests, save each one as XML files in this directory for use by the C++ Benchmark program')
 args = parser.parse_args()
 if args.platform is None:
     parser.error('No platform specified')
@@ -62,6 +62,13 @@ class ParsedExpression;
 class LEPTON_EXPORT CompiledExpression {
 public:
     CompiledExpression();
+    /**
+     * Create a CompiledExpression that evaluates several expressions at once.  Any subexpression that appears
+     * in more than one of them, such as a distance or an exponential shared by an energy and its derivatives,
+     * is only computed once.  evaluate() returns the value of the first expression, and the values of all
+     * of them can be retrieved with getResult() after it has been called.
+     */
+    CompiledExpression(const std::vector<ParsedExpression>& expressions);
     CompiledExpression(const CompiledExpression& expression);
     ~CompiledExpression();
     CompiledExpression& operator=(const CompiledExpression& expression);
@@ -84,20 +91,35 @@ public:
      * Evaluate the expression.  The values of all variables should have been set before calling this.
      */
     double evaluate() const;
+    /**
+     * Get the number of expressions that are evaluated by this object.
+     */
+    int getNumResults() const;
+    /**
+     * Get the value of one of the expressions computed by the most recent call to evaluate().
+     *
+     * @param index    the index of the expression, in the order they were passed to the constructor
+     */
+    double getResult(int index) const;
 private:
     friend class ParsedExpression;
     CompiledExpression(const ParsedExpression& expression);
+    void compileExpressions(const std::vector<ParsedExpression>& expressions);
     void compileExpression(const ExpressionTreeNode& node, std::vector<std::pair<ExpressionTreeNode, int> >& temps);
     int findTempIndex(const ExpressionTreeNode& node, std::vector<std::pair<ExpressionTreeNode, int> >& temps);
     std::map<std::string, double*> variablePointers;
     std::vector<std::pair<double*, double*> > variablesToCopy;
     std::vector<std::vector<int> > arguments;
     std::vector<int> target;
+    std::vector<int> resultIndex;
     std::vector<Operation*> operation;
+    std::vector<int> operationId;
+    std::vector<double> operationValue;
     std::map<std::string, int> variableIndices;
     std::set<std::string> variableNames;
     mutable std::vector<double> workspace;
     mutable std::vector<double> argValues;
+    mutable std::vector<double> results;
     std::map<std::string, double> dummyVariables;
     double (*jitCode)();
 #ifdef LEPTON_USE_JIT
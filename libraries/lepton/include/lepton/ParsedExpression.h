@@ -40,6 +40,7 @@
 namespace Lepton {
 
 class CompiledExpression;
+class CompiledVectorExpression;
 class ExpressionProgram;
 
 /**
@@ -102,6 +103,13 @@ public:
      * Create a CompiledExpression that represents the same calculation as this expression.
      */
     CompiledExpression createCompiledExpression() const;
+    /**
+     * Create a CompiledVectorExpression that represents the same calculation as this expression.
+     *
+     * @param width    the width of the vectors to evaluate it on.  The allowed values can be found
+     *                 by calling CompiledVectorExpression::getAllowedWidths().
+     */
+    CompiledVectorExpression createCompiledVectorExpression(int width) const;
     /**
      * Create a new ParsedExpression which is identical to this one, except that the names of some
      * variables have been changed.
@@ -119,6 +127,13 @@ private:
     static bool isConstant(const ExpressionTreeNode& node);
     static double getConstantValue(const ExpressionTreeNode& node);
     static ExpressionTreeNode renameNodeVariables(const ExpressionTreeNode& node, const std::map<std::string, std::string>& replacements);
+    struct ResultCache;
+    static ResultCache& getResultCache();
+    static void appendCacheKey(const std::string& text, std::string& key);
+    static void appendCacheKey(double value, std::string& key);
+    static bool appendCacheKey(const ExpressionTreeNode& node, std::string& key);
+    static bool findCachedResult(const std::string& key, ExpressionTreeNode& result);
+    static void cacheResult(const std::string& key, const ExpressionTreeNode& result);
     ExpressionTreeNode rootNode;
 };
 
@@ -40,13 +40,48 @@ using namespace std;
     using namespace asmjit;
 #endif
 
+/**
+ * Get the constant value stored in an Operation, or 0 if it does not have one.  This lets evaluate()
+ * handle the most common operations without virtual function calls when JIT compilation is not available.
+ */
+static double getOperationValue(const Operation& op) {
+    if (op.getId() == Operation::CONSTANT)
+        return dynamic_cast<const Operation::Constant&>(op).getValue();
+    if (op.getId() == Operation::ADD_CONSTANT)
+        return dynamic_cast<const Operation::AddConstant&>(op).getValue();
+    if (op.getId() == Operation::MULTIPLY_CONSTANT)
+        return dynamic_cast<const Operation::MultiplyConstant&>(op).getValue();
+    return 0.0;
+}
+
 CompiledExpression::CompiledExpression() : jitCode(NULL) {
 }
 
 CompiledExpression::CompiledExpression(const ParsedExpression& expression) : jitCode(NULL) {
-    ParsedExpression expr = expression.optimize(); // Just in case it wasn't already optimized.
+    compileExpressions(vector<ParsedExpression>(1, expression));
+}
+
+CompiledExpression::CompiledExpression(const vector<ParsedExpression>& expressions) : jitCode(NULL) {
+    if (expressions.size() == 0)
+        throw Exception("CompiledExpression: At least one expression must be specified");
+    compileExpressions(expressions);
+}
+
+void CompiledExpression::compileExpressions(const vector<ParsedExpression>& expressions) {
+    // All the expressions share one list of temporaries, so a subexpression that has already been
+    // compiled for an earlier expression is reused rather than being evaluated again.
+
     vector<pair<ExpressionTreeNode, int> > temps;
-    compileExpression(expr.getRootNode(), temps);
+    for (int i = 0; i < (int) expressions.size(); i++) {
+        ParsedExpression expr = expressions[i].optimize(); // Just in case it wasn't already optimized.
+        compileExpression(expr.getRootNode(), temps);
+        resultIndex.push_back(temps[findTempIndex(expr.getRootNode(), temps)].second);
+    }
+    results.resize(resultIndex.size());
+    for (int i = 0; i < (int) operation.size(); i++) {
+        operationId.push_back(operation[i]->getId());
+        operationValue.push_back(getOperationValue(*operation[i]));
+    }
     int maxArguments = 1;
     for (int i = 0; i < (int) operation.size(); i++)
         if (operation[i]->getNumArguments() > maxArguments)
@@ -70,6 +105,8 @@ CompiledExpression::CompiledExpression(const CompiledExpression& expression) : j
 CompiledExpression& CompiledExpression::operator=(const CompiledExpression& expression) {
     arguments = expression.arguments;
     target = expression.target;
+    resultIndex = expression.resultIndex;
+    results.resize(expression.results.size());
     variableIndices = expression.variableIndices;
     variableNames = expression.variableNames;
     workspace.resize(expression.workspace.size());
@@ -77,6 +114,8 @@ CompiledExpression& CompiledExpression::operator=(const CompiledExpression& expr
     operation.resize(expression.operation.size());
     for (int i = 0; i < (int) operation.size(); i++)
         operation[i] = expression.operation[i]->clone();
+    operationId = expression.operationId;
+    operationValue = expression.operationValue;
     setVariableLocations(variablePointers);
     return *this;
 }
@@ -170,22 +209,82 @@ double CompiledExpression::evaluate() const {
     for (int i = 0; i < variablesToCopy.size(); i++)
         *variablesToCopy[i].first = *variablesToCopy[i].second;
 
-    // Loop over the operations and evaluate each one.
+    // Loop over the operations and evaluate each one.  The most common ones are handled directly,
+    // and anything else is passed to the Operation.
     
     for (int step = 0; step < operation.size(); step++) {
         const vector<int>& args = arguments[step];
-        if (args.size() == 1)
-            workspace[target[step]] = operation[step]->evaluate(&workspace[args[0]], dummyVariables);
-        else {
+        double* x = &workspace[args[0]];
+        if (args.size() > 1) {
             for (int i = 0; i < args.size(); i++)
                 argValues[i] = workspace[args[i]];
-            workspace[target[step]] = operation[step]->evaluate(&argValues[0], dummyVariables);
+            x = &argValues[0];
+        }
+        double& result = workspace[target[step]];
+        switch (operationId[step]) {
+            case Operation::CONSTANT:
+                result = operationValue[step];
+                break;
+            case Operation::ADD:
+                result = x[0]+x[1];
+                break;
+            case Operation::SUBTRACT:
+                result = x[0]-x[1];
+                break;
+            case Operation::MULTIPLY:
+                result = x[0]*x[1];
+                break;
+            case Operation::DIVIDE:
+                result = x[0]/x[1];
+                break;
+            case Operation::NEGATE:
+                result = -x[0];
+                break;
+            case Operation::SQRT:
+                result = sqrt(x[0]);
+                break;
+            case Operation::EXP:
+                result = exp(x[0]);
+                break;
+            case Operation::LOG:
+                result = log(x[0]);
+                break;
+            case Operation::SQUARE:
+                result = x[0]*x[0];
+                break;
+            case Operation::CUBE:
+                result = x[0]*x[0]*x[0];
+                break;
+            case Operation::RECIPROCAL:
+                result = 1.0/x[0];
+                break;
+            case Operation::ADD_CONSTANT:
+                result = x[0]+operationValue[step];
+                break;
+            case Operation::MULTIPLY_CONSTANT:
+                result = x[0]*operationValue[step];
+                break;
+            case Operation::ABS:
+                result = fabs(x[0]);
+                break;
+            default:
+                result = operation[step]->evaluate(x, dummyVariables);
         }
     }
-    return workspace[workspace.size()-1];
+    for (int i = 0; i < resultIndex.size(); i++)
+        results[i] = workspace[resultIndex[i]];
+    return results[0];
 #endif
 }
 
+int CompiledExpression::getNumResults() const {
+    return resultIndex.size();
+}
+
+double CompiledExpression::getResult(int index) const {
+    return results[index];
+}
+
 #ifdef LEPTON_USE_JIT
 static double evaluateOperation(Operation* op, double* args) {
     static map<string, double> dummyVariables;
@@ -393,7 +492,11 @@ void CompiledExpression::generateJitCode() {
                 call->setRet(0, workspaceVar[target[step]]);
         }
     }
-    c.ret(workspaceVar[workspace.size()-1]);
+    X86Gp resultsPointer = c.newIntPtr();
+    c.mov(resultsPointer, imm_ptr(&results[0]));
+    for (int i = 0; i < (int) resultIndex.size(); i++)
+        c.movsd(x86::ptr(resultsPointer, 8*i, 0), workspaceVar[resultIndex[i]]);
+    c.ret(workspaceVar[resultIndex[0]]);
     c.endFunc();
     c.finalize();
     runtime.add(&jitCode, &code);
@@ -0,0 +1,595 @@
+/* -------------------------------------------------------------------------- *
+ *                                   Lepton                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the Lepton expression parser originating from              *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013-2020 Stanford University and the Authors.      *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "lepton/CompiledVectorExpression.h"
+#include "lepton/Operation.h"
+#include "lepton/ParsedExpression.h"
+#include <algorithm>
+#include <sstream>
+#include <utility>
+
+using namespace Lepton;
+using namespace std;
+#ifdef LEPTON_USE_JIT
+    using namespace asmjit;
+#endif
+
+static vector<int> findAllowedWidths() {
+    vector<int> widths;
+    widths.push_back(4);
+#ifdef LEPTON_USE_JIT
+    if (CpuInfo::getHost().hasFeature(CpuInfo::kX86FeatureAVX))
+        widths.push_back(8);
+#else
+    widths.push_back(8);
+#endif
+    return widths;
+}
+
+/**
+ * Get the constant value stored in an Operation, or 0 if it does not have one.  This lets evaluate()
+ * handle the most common operations without virtual function calls when JIT compilation is not available.
+ */
+static float getOperationValue(const Operation& op) {
+    if (op.getId() == Operation::CONSTANT)
+        return dynamic_cast<const Operation::Constant&>(op).getValue();
+    if (op.getId() == Operation::ADD_CONSTANT)
+        return dynamic_cast<const Operation::AddConstant&>(op).getValue();
+    if (op.getId() == Operation::MULTIPLY_CONSTANT)
+        return dynamic_cast<const Operation::MultiplyConstant&>(op).getValue();
+    return 0.0f;
+}
+
+CompiledVectorExpression::CompiledVectorExpression() : width(1), jitCode(NULL) {
+}
+
+CompiledVectorExpression::CompiledVectorExpression(const ParsedExpression& expression, int width) : width(width), jitCode(NULL) {
+    const vector<int>& allowedWidths = getAllowedWidths();
+    if (find(allowedWidths.begin(), allowedWidths.end(), width) == allowedWidths.end()) {
+        stringstream message;
+        message << "Unsupported width for vector expression: " << width;
+        throw Exception(message.str());
+    }
+    ParsedExpression expr = expression.optimize(); // Just in case it wasn't already optimized.
+    vector<pair<ExpressionTreeNode, int> > temps;
+    compileExpression(expr.getRootNode(), temps);
+    for (int i = 0; i < (int) operation.size(); i++) {
+        operationId.push_back(operation[i]->getId());
+        operationValue.push_back(getOperationValue(*operation[i]));
+    }
+    int maxArguments = 1;
+    for (int i = 0; i < (int) operation.size(); i++)
+        if (operation[i]->getNumArguments() > maxArguments)
+            maxArguments = operation[i]->getNumArguments();
+    argValues.resize((maxArguments+1)*width);
+    scalarArgValues.resize(maxArguments);
+    setVariableLocations(variablePointers);
+}
+
+CompiledVectorExpression::~CompiledVectorExpression() {
+    for (int i = 0; i < (int) operation.size(); i++)
+        if (operation[i] != NULL)
+            delete operation[i];
+}
+
+CompiledVectorExpression::CompiledVectorExpression(const CompiledVectorExpression& expression) : width(1), jitCode(NULL) {
+    *this = expression;
+}
+
+CompiledVectorExpression& CompiledVectorExpression::operator=(const CompiledVectorExpression& expression) {
+    for (int i = 0; i < (int) operation.size(); i++)
+        if (operation[i] != NULL)
+            delete operation[i];
+    width = expression.width;
+    arguments = expression.arguments;
+    target = expression.target;
+    variableIndices = expression.variableIndices;
+    variableNames = expression.variableNames;
+    workspace.resize(expression.workspace.size());
+    argValues.resize(expression.argValues.size());
+    scalarArgValues.resize(expression.scalarArgValues.size());
+    operation.resize(expression.operation.size());
+    for (int i = 0; i < (int) operation.size(); i++)
+        operation[i] = expression.operation[i]->clone();
+    operationId = expression.operationId;
+    operationValue = expression.operationValue;
+    variablePointers.clear();
+    setVariableLocations(variablePointers);
+    return *this;
+}
+
+void CompiledVectorExpression::compileExpression(const ExpressionTreeNode& node, vector<pair<ExpressionTreeNode, int> >& temps) {
+    if (findTempIndex(node, temps) != -1)
+        return; // We have already processed a node identical to this one.
+    
+    // Process the child nodes.
+    
+    vector<int> args;
+    for (int i = 0; i < node.getChildren().size(); i++) {
+        compileExpression(node.getChildren()[i], temps);
+        args.push_back(findTempIndex(node.getChildren()[i], temps));
+    }
+    
+    // Process this node.  Each temporary value occupies width consecutive elements of the workspace.
+    
+    int index = (int) workspace.size()/width;
+    if (node.getOperation().getId() == Operation::VARIABLE) {
+        variableIndices[node.getOperation().getName()] = index;
+        variableNames.insert(node.getOperation().getName());
+    }
+    else {
+        int stepIndex = (int) arguments.size();
+        arguments.push_back(vector<int>());
+        target.push_back(index);
+        operation.push_back(node.getOperation().clone());
+        if (args.size() == 0)
+            arguments[stepIndex].push_back(0); // The value won't actually be used.  We just need something there.
+        else {
+            // If the arguments are sequential, we can just pass a pointer to the first one.
+            
+            bool sequential = true;
+            for (int i = 1; i < args.size(); i++)
+                if (args[i] != args[i-1]+1)
+                    sequential = false;
+            if (sequential)
+                arguments[stepIndex].push_back(args[0]);
+            else
+                arguments[stepIndex] = args;
+        }
+    }
+    temps.push_back(make_pair(node, index));
+    workspace.resize(workspace.size()+width, 0.0f);
+}
+
+int CompiledVectorExpression::findTempIndex(const ExpressionTreeNode& node, vector<pair<ExpressionTreeNode, int> >& temps) {
+    for (int i = 0; i < (int) temps.size(); i++)
+        if (temps[i].first == node)
+            return i;
+    return -1;
+}
+
+int CompiledVectorExpression::getWidth() const {
+    return width;
+}
+
+const set<string>& CompiledVectorExpression::getVariables() const {
+    return variableNames;
+}
+
+float* CompiledVectorExpression::getVariablePointer(const string& name) {
+    map<string, float*>::iterator pointer = variablePointers.find(name);
+    if (pointer != variablePointers.end())
+        return pointer->second;
+    map<string, int>::iterator index = variableIndices.find(name);
+    if (index == variableIndices.end())
+        throw Exception("getVariablePointer: Unknown variable '"+name+"'");
+    return &workspace[index->second*width];
+}
+
+void CompiledVectorExpression::setVariableLocations(map<string, float*>& variableLocations) {
+    variablePointers = variableLocations;
+
+    // Make a list of all variables we will need to copy before evaluating the expression.  This is
+    // only used when the expression cannot be compiled to machine code.
+
+    variablesToCopy.clear();
+    for (map<string, int>::const_iterator iter = variableIndices.begin(); iter != variableIndices.end(); ++iter) {
+        map<string, float*>::iterator pointer = variablePointers.find(iter->first);
+        if (pointer != variablePointers.end())
+            variablesToCopy.push_back(make_pair(&workspace[iter->second*width], pointer->second));
+    }
+#ifdef LEPTON_USE_JIT
+    // Rebuild the JIT code.
+    
+    if (workspace.size() > 0)
+        generateJitCode();
+#endif
+}
+
+const float* CompiledVectorExpression::evaluate() const {
+    if (jitCode != NULL) {
+        jitCode();
+        return &workspace[workspace.size()-width];
+    }
+    for (int i = 0; i < variablesToCopy.size(); i++)
+        for (int j = 0; j < width; j++)
+            variablesToCopy[i].first[j] = variablesToCopy[i].second[j];
+
+    // Loop over the operations and evaluate each one.  The most common ones are written as simple loops
+    // over the elements, which the compiler can vectorize (for example with NEON on ARM).  Anything else
+    // is passed to the Operation one element at a time.
+    
+    for (int step = 0; step < operation.size(); step++) {
+        const vector<int>& args = arguments[step];
+        int numArgs = operation[step]->getNumArguments();
+        float* result = &workspace[target[step]*width];
+        const float* x = &workspace[args[0]*width];
+        const float* y = (numArgs < 2 ? x : &workspace[(args.size() == 1 ? args[0]+1 : args[1])*width]);
+        float value = operationValue[step];
+        bool handled = true;
+        switch (operationId[step]) {
+            case Operation::CONSTANT:
+                for (int i = 0; i < width; i++)
+                    result[i] = value;
+                break;
+            case Operation::ADD:
+                for (int i = 0; i < width; i++)
+                    result[i] = x[i]+y[i];
+                break;
+            case Operation::SUBTRACT:
+                for (int i = 0; i < width; i++)
+                    result[i] = x[i]-y[i];
+                break;
+            case Operation::MULTIPLY:
+                for (int i = 0; i < width; i++)
+                    result[i] = x[i]*y[i];
+                break;
+            case Operation::DIVIDE:
+                for (int i = 0; i < width; i++)
+                    result[i] = x[i]/y[i];
+                break;
+            case Operation::NEGATE:
+                for (int i = 0; i < width; i++)
+                    result[i] = -x[i];
+                break;
+            case Operation::SQRT:
+                for (int i = 0; i < width; i++)
+                    result[i] = sqrtf(x[i]);
+                break;
+            case Operation::SQUARE:
+                for (int i = 0; i < width; i++)
+                    result[i] = x[i]*x[i];
+                break;
+            case Operation::CUBE:
+                for (int i = 0; i < width; i++)
+                    result[i] = x[i]*x[i]*x[i];
+                break;
+            case Operation::RECIPROCAL:
+                for (int i = 0; i < width; i++)
+                    result[i] = 1.0f/x[i];
+                break;
+            case Operation::ADD_CONSTANT:
+                for (int i = 0; i < width; i++)
+                    result[i] = x[i]+value;
+                break;
+            case Operation::MULTIPLY_CONSTANT:
+                for (int i = 0; i < width; i++)
+                    result[i] = x[i]*value;
+                break;
+            case Operation::ABS:
+                for (int i = 0; i < width; i++)
+                    result[i] = fabsf(x[i]);
+                break;
+            default:
+                handled = false;
+        }
+        if (handled)
+            continue;
+        for (int element = 0; element < width; element++) {
+            for (int i = 0; i < numArgs; i++) {
+                int index = (args.size() == 1 ? args[0]+i : args[i]);
+                scalarArgValues[i] = workspace[index*width+element];
+            }
+            result[element] = (float) operation[step]->evaluate(&scalarArgValues[0], dummyVariables);
+        }
+    }
+    return &workspace[workspace.size()-width];
+}
+
+void CompiledVectorExpression::evaluate(int numPoints, const map<string, const float*>& inputs, float* results) {
+    vector<pair<float*, const float*> > inputsToCopy;
+    for (auto& input : inputs)
+        if (variableNames.find(input.first) != variableNames.end())
+            inputsToCopy.push_back(make_pair(getVariablePointer(input.first), input.second));
+    for (int start = 0; start < numPoints; start += width) {
+        // If the final block is only partly filled, pad it by repeating the last point so every
+        // element holds valid values.
+
+        int count = min(width, numPoints-start);
+        for (auto& input : inputsToCopy) {
+            for (int i = 0; i < count; i++)
+                input.first[i] = input.second[start+i];
+            for (int i = count; i < width; i++)
+                input.first[i] = input.second[start+count-1];
+        }
+        const float* values = evaluate();
+        for (int i = 0; i < count; i++)
+            results[start+i] = values[i];
+    }
+}
+
+const vector<int>& CompiledVectorExpression::getAllowedWidths() {
+    static const vector<int> widths = findAllowedWidths();
+    return widths;
+}
+
+#ifdef LEPTON_USE_JIT
+template <int WIDTH>
+static void evaluateVectorOperation(Operation* op, float* args, float* result) {
+    static const map<string, double> dummyVariables;
+    int numArgs = op->getNumArguments();
+    double localArgs[8];
+    vector<double> allocatedArgs;
+    double* scalarArgs = localArgs;
+    if (numArgs > 8) {
+        allocatedArgs.resize(numArgs);
+        scalarArgs = &allocatedArgs[0];
+    }
+    for (int element = 0; element < WIDTH; element++) {
+        for (int i = 0; i < numArgs; i++)
+            scalarArgs[i] = args[i*WIDTH+element];
+        result[element] = (float) op->evaluate(scalarArgs, dummyVariables);
+    }
+}
+
+static void createVectorRegister(X86Compiler& c, X86Xmm& reg) {
+    reg = c.newXmmPs();
+}
+
+static void createVectorRegister(X86Compiler& c, X86Ymm& reg) {
+    reg = c.newYmmPs();
+}
+
+void CompiledVectorExpression::generateJitCode() {
+    // The generated code uses AVX instructions.  On processors without them, evaluate() falls
+    // back to interpreting the expression.
+
+    static const bool hasAvx = CpuInfo::getHost().hasFeature(CpuInfo::kX86FeatureAVX);
+    jitCode = NULL;
+    if (!hasAvx)
+        return;
+    if (width == 4)
+        generateJitCodeForWidth<X86Xmm>();
+    else
+        generateJitCodeForWidth<X86Ymm>();
+}
+
+template <class REG>
+void CompiledVectorExpression::generateJitCodeForWidth() {
+    CodeHolder code;
+    code.init(runtime.getCodeInfo());
+    X86Compiler c(&code);
+    c.addFunc(FuncSignature0<void>());
+    int numTemps = workspace.size()/width;
+    vector<REG> workspaceVar(numTemps);
+    for (int i = 0; i < numTemps; i++)
+        createVectorRegister(c, workspaceVar[i]);
+    
+    // Load the arguments into variables.
+    
+    for (set<string>::const_iterator iter = variableNames.begin(); iter != variableNames.end(); ++iter) {
+        map<string, int>::iterator index = variableIndices.find(*iter);
+        X86Gp variablePointer = c.newIntPtr();
+        c.mov(variablePointer, imm_ptr(getVariablePointer(index->first)));
+        c.vmovups(workspaceVar[index->second], x86::ptr(variablePointer, 0, 0));
+    }
+
+    // Make a list of all constants that will be needed for evaluation.
+    
+    constants.clear();
+    vector<int> operationConstantIndex(operation.size(), -1);
+    for (int step = 0; step < (int) operation.size(); step++) {
+        // Find the constant value (if any) used by this operation.
+        
+        Operation& op = *operation[step];
+        float value;
+        if (op.getId() == Operation::CONSTANT)
+            value = (float) dynamic_cast<Operation::Constant&>(op).getValue();
+        else if (op.getId() == Operation::ADD_CONSTANT)
+            value = (float) dynamic_cast<Operation::AddConstant&>(op).getValue();
+        else if (op.getId() == Operation::MULTIPLY_CONSTANT)
+            value = (float) dynamic_cast<Operation::MultiplyConstant&>(op).getValue();
+        else if (op.getId() == Operation::RECIPROCAL || op.getId() == Operation::POWER_CONSTANT)
+            value = 1.0f;
+        else if (op.getId() == Operation::STEP)
+            value = 1.0f;
+        else if (op.getId() == Operation::DELTA)
+            value = 1.0f;
+        else
+            continue;
+        
+        // See if we already have a variable for this constant.
+        
+        for (int i = 0; i < (int) constants.size(); i++)
+            if (value == constants[i]) {
+                operationConstantIndex[step] = i;
+                break;
+            }
+        if (operationConstantIndex[step] == -1) {
+            operationConstantIndex[step] = constants.size();
+            constants.push_back(value);
+        }
+    }
+    
+    // Load constants into variables, broadcasting each one to every element.
+    
+    vector<REG> constantVar(constants.size());
+    if (constants.size() > 0) {
+        X86Gp constantsPointer = c.newIntPtr();
+        c.mov(constantsPointer, imm_ptr(&constants[0]));
+        for (int i = 0; i < (int) constants.size(); i++) {
+            createVectorRegister(c, constantVar[i]);
+            c.vbroadcastss(constantVar[i], x86::dword_ptr(constantsPointer, 4*i));
+        }
+    }
+    
+    // Evaluate the operations.
+    
+    X86Gp argsPointer = c.newIntPtr();
+    c.mov(argsPointer, imm_ptr(&argValues[0]));
+    int maxArguments = argValues.size()/width-1;
+    for (int step = 0; step < (int) operation.size(); step++) {
+        Operation& op = *operation[step];
+        vector<int> args = arguments[step];
+        if (args.size() == 1) {
+            // One or more sequential arguments.  Fill out the list.
+            
+            for (int i = 1; i < op.getNumArguments(); i++)
+                args.push_back(args[0]+i);
+        }
+        REG& dest = workspaceVar[target[step]];
+        
+        // Generate instructions to execute this operation.
+        
+        bool useGenericCall = false;
+        switch (op.getId()) {
+            case Operation::CONSTANT:
+                c.vmovaps(dest, constantVar[operationConstantIndex[step]]);
+                break;
+            case Operation::ADD:
+                c.vaddps(dest, workspaceVar[args[0]], workspaceVar[args[1]]);
+                break;
+            case Operation::SUBTRACT:
+                c.vsubps(dest, workspaceVar[args[0]], workspaceVar[args[1]]);
+                break;
+            case Operation::MULTIPLY:
+                c.vmulps(dest, workspaceVar[args[0]], workspaceVar[args[1]]);
+                break;
+            case Operation::DIVIDE:
+                c.vdivps(dest, workspaceVar[args[0]], workspaceVar[args[1]]);
+                break;
+            case Operation::NEGATE:
+                c.vxorps(dest, dest, dest);
+                c.vsubps(dest, dest, workspaceVar[args[0]]);
+                break;
+            case Operation::SQRT:
+                c.vsqrtps(dest, workspaceVar[args[0]]);
+                break;
+            case Operation::STEP:
+                c.vxorps(dest, dest, dest);
+                c.vcmpps(dest, dest, workspaceVar[args[0]], imm(18)); // Comparison mode is _CMP_LE_OQ = 18
+                c.vandps(dest, dest, constantVar[operationConstantIndex[step]]);
+                break;
+            case Operation::DELTA:
+                c.vxorps(dest, dest, dest);
+                c.vcmpps(dest, dest, workspaceVar[args[0]], imm(16)); // Comparison mode is _CMP_EQ_OS = 16
+                c.vandps(dest, dest, constantVar[operationConstantIndex[step]]);
+                break;
+            case Operation::SQUARE:
+                c.vmulps(dest, workspaceVar[args[0]], workspaceVar[args[0]]);
+                break;
+            case Operation::CUBE:
+                c.vmulps(dest, workspaceVar[args[0]], workspaceVar[args[0]]);
+                c.vmulps(dest, dest, workspaceVar[args[0]]);
+                break;
+            case Operation::RECIPROCAL:
+                c.vdivps(dest, constantVar[operationConstantIndex[step]], workspaceVar[args[0]]);
+                break;
+            case Operation::ADD_CONSTANT:
+                c.vaddps(dest, workspaceVar[args[0]], constantVar[operationConstantIndex[step]]);
+                break;
+            case Operation::MULTIPLY_CONSTANT:
+                c.vmulps(dest, workspaceVar[args[0]], constantVar[operationConstantIndex[step]]);
+                break;
+            case Operation::POWER_CONSTANT: {
+                // Integer powers can be computed much more quickly by repeated multiplication.
+
+                double exponentValue = dynamic_cast<Operation::PowerConstant&>(op).getValue();
+                int exponent = (int) exponentValue;
+                if (exponent != exponentValue || exponent > 64 || exponent < -64) {
+                    useGenericCall = true;
+                    break;
+                }
+                REG& one = constantVar[operationConstantIndex[step]];
+                REG base;
+                createVectorRegister(c, base);
+                if (exponent < 0) {
+                    exponent = -exponent;
+                    c.vdivps(base, one, workspaceVar[args[0]]);
+                }
+                else
+                    c.vmovaps(base, workspaceVar[args[0]]);
+                c.vmovaps(dest, one);
+                while (exponent != 0) {
+                    if ((exponent&1) == 1)
+                        c.vmulps(dest, dest, base);
+                    exponent = exponent>>1;
+                    if (exponent != 0)
+                        c.vmulps(base, base, base);
+                }
+                break;
+            }
+            case Operation::MIN:
+                c.vminps(dest, workspaceVar[args[0]], workspaceVar[args[1]]);
+                break;
+            case Operation::MAX:
+                c.vmaxps(dest, workspaceVar[args[0]], workspaceVar[args[1]]);
+                break;
+            case Operation::ABS:
+                c.vxorps(dest, dest, dest);
+                c.vsubps(dest, dest, workspaceVar[args[0]]);
+                c.vmaxps(dest, dest, workspaceVar[args[0]]);
+                break;
+            case Operation::FLOOR:
+                c.vroundps(dest, workspaceVar[args[0]], imm(9)); // Round down, suppressing exceptions
+                break;
+            case Operation::CEIL:
+                c.vroundps(dest, workspaceVar[args[0]], imm(10)); // Round up, suppressing exceptions
+                break;
+            case Operation::SELECT: {
+                REG mask;
+                createVectorRegister(c, mask);
+                c.vxorps(mask, mask, mask);
+                c.vcmpps(mask, workspaceVar[args[0]], mask, imm(4)); // Comparison mode is _CMP_NEQ_UQ = 4
+                c.vblendvps(dest, workspaceVar[args[2]], workspaceVar[args[1]], mask);
+                break;
+            }
+            default:
+                useGenericCall = true;
+        }
+        if (useGenericCall) {
+            // Store the arguments to memory and invoke evaluateVectorOperation(), which evaluates
+            // the operation one element at a time.
+            
+            for (int i = 0; i < (int) args.size(); i++)
+                c.vmovups(x86::ptr(argsPointer, 4*width*i, 0), workspaceVar[args[i]]);
+            X86Gp fn = c.newIntPtr();
+            c.mov(fn, imm_ptr((void*) (width == 4 ? evaluateVectorOperation<4> : evaluateVectorOperation<8>)));
+            CCFuncCall* call = c.call(fn, FuncSignature3<void, Operation*, float*, float*>());
+            call->setArg(0, imm_ptr(&op));
+            call->setArg(1, imm_ptr(&argValues[0]));
+            call->setArg(2, imm_ptr(&argValues[maxArguments*width]));
+            c.vmovups(dest, x86::ptr(argsPointer, 4*width*maxArguments, 0));
+        }
+    }
+    
+    // Store the result.
+    
+    X86Gp resultPointer = c.newIntPtr();
+    c.mov(resultPointer, imm_ptr(&workspace[(numTemps-1)*width]));
+    c.vmovups(x86::ptr(resultPointer, 0, 0), workspaceVar[numTemps-1]);
+    c.vzeroupper();
+    c.ret();
+    c.endFunc();
+    c.finalize();
+    runtime.add(&jitCode, &code);
+}
+#endif
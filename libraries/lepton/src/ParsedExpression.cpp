@@ -31,9 +31,11 @@
 
 #include "lepton/ParsedExpression.h"
 #include "lepton/CompiledExpression.h"
+#include "lepton/CompiledVectorExpression.h"
 #include "lepton/ExpressionProgram.h"
 #include "lepton/Operation.h"
 #include <limits>
+#include <mutex>
 #include <vector>
 
 using namespace Lepton;
@@ -68,18 +70,34 @@ double ParsedExpression::evaluate(const ExpressionTreeNode& node, const map<stri
 }
 
 ParsedExpression ParsedExpression::optimize() const {
-    ExpressionTreeNode result = precalculateConstantSubexpressions(getRootNode());
+    string key = "o";
+    bool cacheable = appendCacheKey(getRootNode(), key);
+    ExpressionTreeNode result;
+    if (cacheable && findCachedResult(key, result))
+        return ParsedExpression(result);
+    result = precalculateConstantSubexpressions(getRootNode());
     while (true) {
         ExpressionTreeNode simplified = substituteSimplerExpression(result);
         if (simplified == result)
             break;
         result = simplified;
     }
+    if (cacheable)
+        cacheResult(key, result);
     return ParsedExpression(result);
 }
 
 ParsedExpression ParsedExpression::optimize(const map<string, double>& variables) const {
-    ExpressionTreeNode result = preevaluateVariables(getRootNode(), variables);
+    string key = "v";
+    for (auto& variable : variables) {
+        appendCacheKey(variable.first, key);
+        appendCacheKey(variable.second, key);
+    }
+    bool cacheable = appendCacheKey(getRootNode(), key);
+    ExpressionTreeNode result;
+    if (cacheable && findCachedResult(key, result))
+        return ParsedExpression(result);
+    result = preevaluateVariables(getRootNode(), variables);
     result = precalculateConstantSubexpressions(result);
     while (true) {
         ExpressionTreeNode simplified = substituteSimplerExpression(result);
@@ -87,6 +105,8 @@ ParsedExpression ParsedExpression::optimize(const map<string, double>& variables
             break;
         result = simplified;
     }
+    if (cacheable)
+        cacheResult(key, result);
     return ParsedExpression(result);
 }
 
@@ -306,7 +326,16 @@ ExpressionTreeNode ParsedExpression::substituteSimplerExpression(const Expressio
 }
 
 ParsedExpression ParsedExpression::differentiate(const string& variable) const {
-    return differentiate(getRootNode(), variable);
+    string key = "d";
+    appendCacheKey(variable, key);
+    bool cacheable = appendCacheKey(getRootNode(), key);
+    ExpressionTreeNode result;
+    if (cacheable && findCachedResult(key, result))
+        return ParsedExpression(result);
+    result = differentiate(getRootNode(), variable);
+    if (cacheable)
+        cacheResult(key, result);
+    return ParsedExpression(result);
 }
 
 ExpressionTreeNode ParsedExpression::differentiate(const ExpressionTreeNode& node, const string& variable) {
@@ -335,6 +364,10 @@ CompiledExpression ParsedExpression::createCompiledExpression() const {
     return CompiledExpression(*this);
 }
 
+CompiledVectorExpression ParsedExpression::createCompiledVectorExpression(int width) const {
+    return CompiledVectorExpression(*this, width);
+}
+
 ParsedExpression ParsedExpression::renameVariables(const map<string, string>& replacements) const {
     return ParsedExpression(renameNodeVariables(getRootNode(), replacements));
 }
@@ -351,6 +384,85 @@ ExpressionTreeNode ParsedExpression::renameNodeVariables(const ExpressionTreeNod
     return ExpressionTreeNode(node.getOperation().clone(), children);
 }
 
+/**
+ * Results of optimize() and differentiate() are cached, since the same expressions tend to be
+ * processed over and over, for example every time a Context is created for a System with custom
+ * forces.  The key encodes the exact structure of the input tree, so a cached result is always
+ * identical to what would have been computed.
+ */
+struct ParsedExpression::ResultCache {
+    mutex lock;
+    map<string, ExpressionTreeNode> results;
+};
+
+ParsedExpression::ResultCache& ParsedExpression::getResultCache() {
+    static ResultCache cache;
+    return cache;
+}
+
+void ParsedExpression::appendCacheKey(const string& text, string& key) {
+    appendCacheKey((double) text.size(), key);
+    key += text;
+}
+
+void ParsedExpression::appendCacheKey(double value, string& key) {
+    key.append((const char*) &value, sizeof(value));
+}
+
+bool ParsedExpression::appendCacheKey(const ExpressionTreeNode& node, string& key) {
+    const Operation& op = node.getOperation();
+    key += (char) op.getId();
+    switch (op.getId()) {
+        case Operation::CUSTOM:
+            // A custom function is identified only by a pointer that could later be reused for a
+            // different function, so expressions containing one are never cached.
+            return false;
+        case Operation::CONSTANT:
+            appendCacheKey(dynamic_cast<const Operation::Constant&>(op).getValue(), key);
+            break;
+        case Operation::VARIABLE:
+            appendCacheKey(op.getName(), key);
+            break;
+        case Operation::ADD_CONSTANT:
+            appendCacheKey(dynamic_cast<const Operation::AddConstant&>(op).getValue(), key);
+            break;
+        case Operation::MULTIPLY_CONSTANT:
+            appendCacheKey(dynamic_cast<const Operation::MultiplyConstant&>(op).getValue(), key);
+            break;
+        case Operation::POWER_CONSTANT:
+            appendCacheKey(dynamic_cast<const Operation::PowerConstant&>(op).getValue(), key);
+            break;
+        default:
+            break;
+    }
+    for (auto& child : node.getChildren())
+        if (!appendCacheKey(child, key))
+            return false;
+    return true;
+}
+
+bool ParsedExpression::findCachedResult(const string& key, ExpressionTreeNode& result) {
+    ResultCache& cache = getResultCache();
+    lock_guard<mutex> guard(cache.lock);
+    auto entry = cache.results.find(key);
+    if (entry == cache.results.end())
+        return false;
+    result = entry->second;
+    return true;
+}
+
+void ParsedExpression::cacheResult(const string& key, const ExpressionTreeNode& result) {
+    // Bound the memory used by the cache.  Discarding everything when it fills up is crude, but
+    // programs rarely work with more than a few hundred distinct expressions.
+
+    const int maxCacheSize = 1000;
+    ResultCache& cache = getResultCache();
+    lock_guard<mutex> guard(cache.lock);
+    if (cache.results.size() >= maxCacheSize)
+        cache.results.clear();
+    cache.results[key] = result;
+}
+
 ostream& Lepton::operator<<(ostream& out, const ExpressionTreeNode& node) {
     if (node.getOperation().isInfixOperator() && node.getChildren().size() == 2) {
         out << "(" << node.getChildren()[0] << ")" << node.getOperation().getName() << "(" << node.getChildren()[1] << ")";
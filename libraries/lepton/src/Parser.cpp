@@ -297,40 +297,47 @@ Operation* Parser::getOperatorOperation(const std::string& name) {
     }
 }
 
+/**
+ * Create the table of standard functions.  This is used to initialize a static variable, which C++
+ * guarantees happens exactly once even if multiple threads parse expressions at the same time.
+ */
+static map<string, Operation::Id> createFunctionMap() {
+    map<string, Operation::Id> opMap;
+    opMap["sqrt"] = Operation::SQRT;
+    opMap["exp"] = Operation::EXP;
+    opMap["log"] = Operation::LOG;
+    opMap["sin"] = Operation::SIN;
+    opMap["cos"] = Operation::COS;
+    opMap["sec"] = Operation::SEC;
+    opMap["csc"] = Operation::CSC;
+    opMap["tan"] = Operation::TAN;
+    opMap["cot"] = Operation::COT;
+    opMap["asin"] = Operation::ASIN;
+    opMap["acos"] = Operation::ACOS;
+    opMap["atan"] = Operation::ATAN;
+    opMap["atan2"] = Operation::ATAN2;
+    opMap["sinh"] = Operation::SINH;
+    opMap["cosh"] = Operation::COSH;
+    opMap["tanh"] = Operation::TANH;
+    opMap["erf"] = Operation::ERF;
+    opMap["erfc"] = Operation::ERFC;
+    opMap["step"] = Operation::STEP;
+    opMap["delta"] = Operation::DELTA;
+    opMap["square"] = Operation::SQUARE;
+    opMap["cube"] = Operation::CUBE;
+    opMap["recip"] = Operation::RECIPROCAL;
+    opMap["min"] = Operation::MIN;
+    opMap["max"] = Operation::MAX;
+    opMap["abs"] = Operation::ABS;
+    opMap["floor"] = Operation::FLOOR;
+    opMap["ceil"] = Operation::CEIL;
+    opMap["select"] = Operation::SELECT;
+    return opMap;
+}
+
 Operation* Parser::getFunctionOperation(const std::string& name, const map<string, CustomFunction*>& customFunctions) {
 
-    static map<string, Operation::Id> opMap;
-    if (opMap.size() == 0) {
-        opMap["sqrt"] = Operation::SQRT;
-        opMap["exp"] = Operation::EXP;
-        opMap["log"] = Operation::LOG;
-        opMap["sin"] = Operation::SIN;
-        opMap["cos"] = Operation::COS;
-        opMap["sec"] = Operation::SEC;
-        opMap["csc"] = Operation::CSC;
-        opMap["tan"] = Operation::TAN;
-        opMap["cot"] = Operation::COT;
-        opMap["asin"] = Operation::ASIN;
-        opMap["acos"] = Operation::ACOS;
-        opMap["atan"] = Operation::ATAN;
-        opMap["atan2"] = Operation::ATAN2;
-        opMap["sinh"] = Operation::SINH;
-        opMap["cosh"] = Operation::COSH;
-        opMap["tanh"] = Operation::TANH;
-        opMap["erf"] = Operation::ERF;
-        opMap["erfc"] = Operation::ERFC;
-        opMap["step"] = Operation::STEP;
-        opMap["delta"] = Operation::DELTA;
-        opMap["square"] = Operation::SQUARE;
-        opMap["cube"] = Operation::CUBE;
-        opMap["recip"] = Operation::RECIPROCAL;
-        opMap["min"] = Operation::MIN;
-        opMap["max"] = Operation::MAX;
-        opMap["abs"] = Operation::ABS;
-        opMap["floor"] = Operation::FLOOR;
-        opMap["ceil"] = Operation::CEIL;
-        opMap["select"] = Operation::SELECT;
-    }
+    static const map<string, Operation::Id> opMap = createFunctionMap();
     string trimmed = name.substr(0, name.size()-1);
 
     // First check custom functions.
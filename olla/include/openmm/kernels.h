@@ -56,6 +56,7 @@
 #include "openmm/KernelImpl.h"
 #include "openmm/LangevinIntegrator.h"
 #include "openmm/MonteCarloBarostat.h"
+#include "openmm/MTSLangevinIntegrator.h"
 #include "openmm/PeriodicTorsionForce.h"
 #include "openmm/RBTorsionForce.h"
 #include "openmm/RMSDForce.h"
@@ -172,6 +173,52 @@ public:
      * @param velocities  a vector containing the particle velocities
      */
     virtual void setVelocities(ContextImpl& context, const std::vector<Vec3>& velocities) = 0;
+    /**
+     * Get the positions of all particles in single precision.  The default implementation converts the
+     * result of getPositions().  Platforms that store positions in single precision can override it to
+     * avoid converting them to double precision and back.
+     *
+     * @param positions  on exit, this contains the x, y, and z coordinates of each particle in turn
+     */
+    virtual void getPositionsFloat(ContextImpl& context, std::vector<float>& positions) {
+        std::vector<Vec3> pos;
+        getPositions(context, pos);
+        positions.resize(3*pos.size());
+        for (int i = 0; i < (int) pos.size(); i++)
+            for (int j = 0; j < 3; j++)
+                positions[3*i+j] = (float) pos[i][j];
+    }
+    /**
+     * Get the velocities of all particles in single precision.  The default implementation converts the
+     * result of getVelocities().  Platforms that store velocities in single precision can override it to
+     * avoid converting them to double precision and back.
+     *
+     * @param velocities  on exit, this contains the x, y, and z components of each particle's velocity in turn
+     */
+    virtual void getVelocitiesFloat(ContextImpl& context, std::vector<float>& velocities) {
+        std::vector<Vec3> vel;
+        getVelocities(context, vel);
+        velocities.resize(3*vel.size());
+        for (int i = 0; i < (int) vel.size(); i++)
+            for (int j = 0; j < 3; j++)
+                velocities[3*i+j] = (float) vel[i][j];
+    }
+    /**
+     * Begin copying the positions and/or velocities of all particles so they can be retrieved later
+     * by finishStateCopy().  Platforms may return before the copy is complete, so that the simulation
+     * can continue while the data is transferred.
+     *
+     * @param positions   whether to copy the positions
+     * @param velocities  whether to copy the velocities
+     */
+    virtual void beginStateCopy(ContextImpl& context, bool positions, bool velocities) = 0;
+    /**
+     * Wait for the copy started by beginStateCopy() to complete and retrieve the data.
+     *
+     * @param positions   on exit, this contains the particle positions, or is empty if they were not copied
+     * @param velocities  on exit, this contains the particle velocities, or is empty if they were not copied
+     */
+    virtual void finishStateCopy(ContextImpl& context, std::vector<Vec3>& positions, std::vector<Vec3>& velocities) = 0;
     /**
      * Get the current forces on all particles.
      *
@@ -593,6 +640,20 @@ public:
      * @param force      the NonbondedForce to copy the parameters from
      */
     virtual void copyParametersToContext(ContextImpl& context, const NonbondedForce& force) = 0;
+    /**
+     * Copy changed parameters over to a context, when only a range of particles and exceptions
+     * may have changed.  The default implementation copies all parameters.
+     *
+     * @param context         the context to copy parameters to
+     * @param force           the NonbondedForce to copy the parameters from
+     * @param firstParticle   the index of the first particle whose parameters might have changed
+     * @param lastParticle    the index of the last particle whose parameters might have changed
+     * @param firstException  the index of the first exception whose parameters might have changed
+     * @param lastException   the index of the last exception whose parameters might have changed
+     */
+    virtual void copyParameterRangeToContext(ContextImpl& context, const NonbondedForce& force, int firstParticle, int lastParticle, int firstException, int lastException) {
+        copyParametersToContext(context, force);
+    }
     /**
      * Get the parameters being used for PME.
      *
@@ -651,6 +712,18 @@ public:
      * @param force      the CustomNonbondedForce to copy the parameters from
      */
     virtual void copyParametersToContext(ContextImpl& context, const CustomNonbondedForce& force) = 0;
+    /**
+     * Copy changed parameters over to a context, when only a range of particles may have changed.
+     * The default implementation copies all parameters.
+     *
+     * @param context         the context to copy parameters to
+     * @param force           the CustomNonbondedForce to copy the parameters from
+     * @param firstParticle   the index of the first particle whose parameters might have changed
+     * @param lastParticle    the index of the last particle whose parameters might have changed
+     */
+    virtual void copyParameterRangeToContext(ContextImpl& context, const CustomNonbondedForce& force, int firstParticle, int lastParticle) {
+        copyParametersToContext(context, force);
+    }
 };
 
 /**
@@ -966,6 +1039,14 @@ public:
      * @param innerContext   the context created by the CustomCVForce for computing collective variables
      */
     virtual void initialize(const System& system, const CustomCVForce& force, ContextImpl& innerContext) = 0;
+    /**
+     * Initialize the kernel for a force whose collective variables are evaluated directly in the
+     * context it belongs to, rather than in an inner context.
+     *
+     * @param system     the System this kernel will be applied to
+     * @param force      the CustomCVForce this kernel will be used for
+     */
+    virtual void initialize(const System& system, const CustomCVForce& force) = 0;
     /**
      * Execute the kernel to calculate the forces and/or energy.
      *
@@ -976,6 +1057,26 @@ public:
      * @return the potential energy due to the force
      */
     virtual double execute(ContextImpl& context, ContextImpl& innerContext, bool includeForces, bool includeEnergy) = 0;
+    /**
+     * Execute the kernel to calculate the forces and/or energy, given collective variables that were
+     * evaluated directly in the context.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param values         the values of the collective variables
+     * @param paramDerivs    the derivatives of each collective variable with respect to global parameters
+     * @param includeForces  true if forces should be calculated
+     * @param includeEnergy  true if the energy should be calculated
+     * @return the potential energy due to the force
+     */
+    virtual double execute(ContextImpl& context, const std::vector<double>& values, const std::vector<std::map<std::string, double> >& paramDerivs, bool includeForces, bool includeEnergy) = 0;
+    /**
+     * Save the forces currently stored in the context as the forces for one collective variable.  This
+     * is called just after the variable's force group has been evaluated on its own.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param index          the index of the collective variable
+     */
+    virtual void copyVariableForces(ContextImpl& context, int index) = 0;
     /**
      * Copy state information to the inner context.
      *
@@ -1220,6 +1321,61 @@ public:
     virtual double computeKineticEnergy(ContextImpl& context, const LangevinMiddleIntegrator& integrator) = 0;
 };
 
+/**
+ * This kernel is invoked by MTSLangevinIntegrator to take one time step.  The integrator
+ * decides which force groups to evaluate when, and invokes the kernel to perform the
+ * individual operations of each substep.
+ */
+class IntegrateMTSLangevinStepKernel : public KernelImpl {
+public:
+    static std::string Name() {
+        return "IntegrateMTSLangevinStep";
+    }
+    IntegrateMTSLangevinStepKernel(std::string name, const Platform& platform) : KernelImpl(name, platform) {
+    }
+    /**
+     * Initialize the kernel.
+     * 
+     * @param system     the System this kernel will be applied to
+     * @param integrator the MTSLangevinIntegrator this kernel will be used for
+     */
+    virtual void initialize(const System& system, const MTSLangevinIntegrator& integrator) = 0;
+    /**
+     * Update the velocities based on the forces currently stored in the context, then apply
+     * velocity constraints.
+     * 
+     * @param context    the context in which to execute this kernel
+     * @param integrator the MTSLangevinIntegrator this kernel is being used for
+     * @param dt         the time interval over which to apply the forces
+     */
+    virtual void kick(ContextImpl& context, const MTSLangevinIntegrator& integrator, double dt) = 0;
+    /**
+     * Perform the innermost substep: a position half step, interaction with the heat bath,
+     * and another position half step, followed by applying constraints.
+     * 
+     * @param context    the context in which to execute this kernel
+     * @param integrator the MTSLangevinIntegrator this kernel is being used for
+     * @param dt         the size of the innermost substep
+     */
+    virtual void drift(ContextImpl& context, const MTSLangevinIntegrator& integrator, double dt) = 0;
+    /**
+     * Finish a time step after all substeps have been performed.
+     * 
+     * @param context        the context in which to execute this kernel
+     * @param integrator     the MTSLangevinIntegrator this kernel is being used for
+     * @param forcesAreValid this will be set to false if the forces currently stored in the
+     *                       context can no longer be used
+     */
+    virtual void finishStep(ContextImpl& context, const MTSLangevinIntegrator& integrator, bool& forcesAreValid) = 0;
+    /**
+     * Compute the kinetic energy.
+     * 
+     * @param context    the context in which to execute this kernel
+     * @param integrator the MTSLangevinIntegrator this kernel is being used for
+     */
+    virtual double computeKineticEnergy(ContextImpl& context, const MTSLangevinIntegrator& integrator) = 0;
+};
+
 /**
  * This kernel is invoked by BrownianIntegrator to take one time step.
  */
@@ -1279,6 +1435,36 @@ public:
      * @return the size of the step that was taken
      */
     virtual double execute(ContextImpl& context, const VariableLangevinIntegrator& integrator, double maxTime) = 0;
+    /**
+     * Get whether this kernel supports executeAsync() and synchronizeSteps().  If it does, the integrator
+     * may take several steps in a row without waiting for the step size of each one to be known.
+     */
+    virtual bool supportsAsyncSteps() const {
+        return false;
+    }
+    /**
+     * Take a step without waiting for it to complete or reporting the size of the step.  Once maxTime has
+     * been reached, further calls do not advance the simulation until synchronizeSteps() is called.  This
+     * is only called if supportsAsyncSteps() returns true.
+     *
+     * @param context    the context in which to execute this kernel
+     * @param integrator the VariableLangevinIntegrator this kernel is being used for
+     * @param maxTime    the maximum time beyond which the simulation should not be advanced
+     */
+    virtual void executeAsync(ContextImpl& context, const VariableLangevinIntegrator& integrator, double maxTime) {
+        execute(context, integrator, maxTime);
+    }
+    /**
+     * Wait for all steps started by executeAsync() to complete and update the time and step count
+     * of the context to reflect them.
+     *
+     * @param context    the context in which to execute this kernel
+     * @param integrator the VariableLangevinIntegrator this kernel is being used for
+     * @return the size of the most recent step that was taken
+     */
+    virtual double synchronizeSteps(ContextImpl& context, const VariableLangevinIntegrator& integrator) {
+        return integrator.getStepSize();
+    }
     /**
      * Compute the kinetic energy.
      * 
@@ -1314,6 +1500,36 @@ public:
      * @return the size of the step that was taken
      */
     virtual double execute(ContextImpl& context, const VariableVerletIntegrator& integrator, double maxTime) = 0;
+    /**
+     * Get whether this kernel supports executeAsync() and synchronizeSteps().  If it does, the integrator
+     * may take several steps in a row without waiting for the step size of each one to be known.
+     */
+    virtual bool supportsAsyncSteps() const {
+        return false;
+    }
+    /**
+     * Take a step without waiting for it to complete or reporting the size of the step.  Once maxTime has
+     * been reached, further calls do not advance the simulation until synchronizeSteps() is called.  This
+     * is only called if supportsAsyncSteps() returns true.
+     *
+     * @param context    the context in which to execute this kernel
+     * @param integrator the VariableVerletIntegrator this kernel is being used for
+     * @param maxTime    the maximum time beyond which the simulation should not be advanced
+     */
+    virtual void executeAsync(ContextImpl& context, const VariableVerletIntegrator& integrator, double maxTime) {
+        execute(context, integrator, maxTime);
+    }
+    /**
+     * Wait for all steps started by executeAsync() to complete and update the time and step count
+     * of the context to reflect them.
+     *
+     * @param context    the context in which to execute this kernel
+     * @param integrator the VariableVerletIntegrator this kernel is being used for
+     * @return the size of the most recent step that was taken
+     */
+    virtual double synchronizeSteps(ContextImpl& context, const VariableVerletIntegrator& integrator) {
+        return integrator.getStepSize();
+    }
     /**
      * Compute the kinetic energy.
      * 
@@ -1483,6 +1699,228 @@ public:
     virtual void execute(ContextImpl& context) = 0;
 };
 
+/**
+ * This kernel is invoked by LocalEnergyMinimizer to minimize the potential energy of the system.
+ * Platforms only need to provide it when they can do the minimization more efficiently than
+ * LocalEnergyMinimizer's generic implementation.
+ */
+class MinimizeKernel : public KernelImpl {
+public:
+    static std::string Name() {
+        return "Minimize";
+    }
+    MinimizeKernel(std::string name, const Platform& platform) : KernelImpl(name, platform) {
+    }
+    /**
+     * Initialize the kernel.
+     * 
+     * @param system     the System this kernel will be applied to
+     */
+    virtual void initialize(const System& system) = 0;
+    /**
+     * Minimize the energy, starting from the current positions.  This has the same meaning
+     * as LocalEnergyMinimizer::minimize().
+     * 
+     * @param context        the context in which to execute this kernel
+     * @param tolerance      the convergence tolerance, measured in kJ/mol/nm
+     * @param maxIterations  the maximum number of iterations to perform.  If this is 0, minimization
+     *                       is continued until the results converge.
+     * @return true if the minimization was performed, or false if it could not be done by this kernel,
+     * in which case the positions are unchanged
+     */
+    virtual bool execute(ContextImpl& context, double tolerance, int maxIterations) = 0;
+};
+
+/**
+ * This kernel is invoked by ReplicaExchange to exchange the configurations of two Contexts.
+ * Platforms only need to provide it when they can do the exchange without copying the data
+ * through the host.
+ */
+class SwapStateKernel : public KernelImpl {
+public:
+    static std::string Name() {
+        return "SwapState";
+    }
+    SwapStateKernel(std::string name, const Platform& platform) : KernelImpl(name, platform) {
+    }
+    /**
+     * Initialize the kernel.
+     * 
+     * @param system     the System this kernel will be applied to
+     */
+    virtual void initialize(const System& system) = 0;
+    /**
+     * Exchange the positions and velocities of the particles in two Contexts.  Periodic box
+     * vectors are exchanged separately by the caller.
+     * 
+     * @param context        the context in which to execute this kernel
+     * @param other          the context to exchange positions and velocities with
+     * @param velocityScale  the velocities moved into context are multiplied by this, and the
+     *                       velocities moved into other are divided by it
+     * @return true if the exchange was performed, or false if it could not be done by this kernel
+     * (for example because the two contexts are on different devices), in which case nothing is changed
+     */
+    virtual bool execute(ContextImpl& context, ContextImpl& other, double velocityScale) = 0;
+};
+
+/**
+ * This kernel is invoked by Context to get or set the positions of a subset of the particles without
+ * transferring data for the whole System.  Platforms only need to provide it when that is faster than
+ * copying every particle.
+ */
+class ParticleSubsetKernel : public KernelImpl {
+public:
+    static std::string Name() {
+        return "ParticleSubset";
+    }
+    ParticleSubsetKernel(std::string name, const Platform& platform) : KernelImpl(name, platform) {
+    }
+    /**
+     * Initialize the kernel.
+     * 
+     * @param system     the System this kernel will be applied to
+     */
+    virtual void initialize(const System& system) = 0;
+    /**
+     * Add a subset of particles.  Subsets are identified by the order in which they are added, starting from 0.
+     * 
+     * @param context     the context in which to execute this kernel
+     * @param particles   the indices of the particles in the subset
+     */
+    virtual void addSubset(ContextImpl& context, const std::vector<int>& particles) = 0;
+    /**
+     * Get the positions of the particles in a subset.
+     * 
+     * @param context     the context in which to execute this kernel
+     * @param subset      the index of the subset
+     * @param positions   on exit, this contains the position of each particle in the subset
+     */
+    virtual void getPositions(ContextImpl& context, int subset, std::vector<Vec3>& positions) = 0;
+    /**
+     * Set the positions of the particles in a subset.  All other particles are left unchanged.
+     * 
+     * @param context     the context in which to execute this kernel
+     * @param subset      the index of the subset
+     * @param positions   the position of each particle in the subset
+     */
+    virtual void setPositions(ContextImpl& context, int subset, const std::vector<Vec3>& positions) = 0;
+};
+
+/**
+ * This kernel is invoked by Context to save the positions and velocities of all particles into a
+ * numbered slot and later restore them, without copying the data through the host.  Platforms only
+ * need to provide it when that is faster than downloading and uploading every particle.
+ */
+class StateSnapshotKernel : public KernelImpl {
+public:
+    static std::string Name() {
+        return "StateSnapshot";
+    }
+    StateSnapshotKernel(std::string name, const Platform& platform) : KernelImpl(name, platform) {
+    }
+    /**
+     * Initialize the kernel.
+     * 
+     * @param system     the System this kernel will be applied to
+     */
+    virtual void initialize(const System& system) = 0;
+    /**
+     * Save the current positions and velocities into a slot, replacing anything that was saved there before.
+     * 
+     * @param context     the context in which to execute this kernel
+     * @param slot        the index of the slot to save to
+     */
+    virtual void save(ContextImpl& context, int slot) = 0;
+    /**
+     * Restore the positions and velocities that were saved in a slot.  The caller guarantees that save()
+     * has been called for the slot.
+     * 
+     * @param context     the context in which to execute this kernel
+     * @param slot        the index of the slot to restore from
+     */
+    virtual void restore(ContextImpl& context, int slot) = 0;
+};
+
+/**
+ * This kernel is invoked by Context to multiply the velocities of all particles by a constant factor
+ * without copying them through the host.  Platforms only need to provide it when that is faster than
+ * downloading and uploading every velocity.
+ */
+class ScaleVelocitiesKernel : public KernelImpl {
+public:
+    static std::string Name() {
+        return "ScaleVelocities";
+    }
+    ScaleVelocitiesKernel(std::string name, const Platform& platform) : KernelImpl(name, platform) {
+    }
+    /**
+     * Initialize the kernel.
+     * 
+     * @param system     the System this kernel will be applied to
+     */
+    virtual void initialize(const System& system) = 0;
+    /**
+     * Multiply the velocities of all particles by a constant factor.
+     * 
+     * @param context     the context in which to execute this kernel
+     * @param scale       the factor to multiply every velocity by
+     */
+    virtual void execute(ContextImpl& context, double scale) = 0;
+};
+
+/**
+ * This kernel is invoked by Context to record the time spent executing kernels and to collect other
+ * statistics about a Context's performance.  Platforms that do not provide it produce an empty
+ * performance report.
+ */
+class ProfileKernel : public KernelImpl {
+public:
+    static std::string Name() {
+        return "Profile";
+    }
+    ProfileKernel(std::string name, const Platform& platform) : KernelImpl(name, platform) {
+    }
+    /**
+     * Initialize the kernel.
+     * 
+     * @param system     the System this kernel will be applied to
+     */
+    virtual void initialize(const System& system) = 0;
+    /**
+     * Set whether to record the time spent executing each kernel.  Enabling profiling discards any
+     * times that were previously recorded.
+     *
+     * @param context    the context in which to execute this kernel
+     * @param enabled    whether profiling should be enabled
+     */
+    virtual void setProfilingEnabled(ContextImpl& context, bool enabled) = 0;
+    /**
+     * Set which force groups subsequently launched kernels should be attributed to while profiling.
+     *
+     * @param context    the context in which to execute this kernel
+     * @param groups     a set of bit flags for the force groups being computed, or 0 if the work does
+     *                   not belong to any force group
+     */
+    virtual void setProfiledForceGroups(ContextImpl& context, int groups) = 0;
+    /**
+     * Set the owner that device memory allocated from now on should be attributed to in the performance
+     * report.
+     *
+     * @param context    the context in which to execute this kernel
+     * @param owner      the owner to attribute memory to, such as "force2" or "integrator"
+     */
+    virtual void setMemoryOwner(ContextImpl& context, const std::string& owner) = 0;
+    /**
+     * Get the times that have been recorded since profiling was enabled.
+     *
+     * @param context    the context in which to execute this kernel
+     * @param report     on exit, this maps each kernel and force group to the total time spent on it in milliseconds,
+     *                   and may also contain platform specific statistics such as ones describing the neighbor list
+     *                   or the device memory in use
+     */
+    virtual void getPerformanceReport(ContextImpl& context, std::map<std::string, double>& report) = 0;
+};
+
 /**
  * This kernel performs the reciprocal space calculation for PME.  In most cases, this
  * calculation is done directly by CalcNonbondedForceKernel so this kernel is unneeded.
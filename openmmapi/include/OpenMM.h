@@ -49,11 +49,13 @@
 #include "openmm/CustomIntegrator.h"
 #include "openmm/CustomManyParticleForce.h"
 #include "openmm/CustomNonbondedForce.h"
+#include "openmm/DCDReporter.h"
 #include "openmm/Force.h"
 #include "openmm/GayBerneForce.h"
 #include "openmm/GBSAOBCForce.h"
 #include "openmm/HarmonicAngleForce.h"
 #include "openmm/HarmonicBondForce.h"
+#include "openmm/HydrogenMassRepartitioning.h"
 #include "openmm/Integrator.h"
 #include "openmm/LangevinIntegrator.h"
 #include "openmm/LangevinMiddleIntegrator.h"
@@ -61,12 +63,15 @@
 #include "openmm/MonteCarloAnisotropicBarostat.h"
 #include "openmm/MonteCarloBarostat.h"
 #include "openmm/MonteCarloMembraneBarostat.h"
+#include "openmm/MTSLangevinIntegrator.h"
 #include "openmm/NonbondedForce.h"
 #include "openmm/Context.h"
 #include "openmm/OpenMMException.h"
 #include "openmm/PeriodicTorsionForce.h"
 #include "openmm/RBTorsionForce.h"
 #include "openmm/RMSDForce.h"
+#include "openmm/ReplicaExchange.h"
+#include "openmm/SharedMemoryReporter.h"
 #include "openmm/State.h"
 #include "openmm/System.h"
 #include "openmm/TabulatedFunction.h"
@@ -79,6 +84,7 @@
 #include "openmm/NoseHooverChain.h"
 #include "openmm/VirtualSite.h"
 #include "openmm/Platform.h"
+#include "openmm/serialization/BinarySerializer.h"
 #include "openmm/serialization/XmlSerializer.h"
 
 #endif /*OPENMM_H_*/
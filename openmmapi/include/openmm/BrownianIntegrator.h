@@ -137,6 +137,10 @@ protected:
      * Computing kinetic energy for this integrator does not require forces.
      */
     bool kineticEnergyRequiresForce() const;
+    /**
+     * This integrator reuses forces that are still valid at the start of a step.
+     */
+    bool reusesForces() const;
 private:
     double temperature, friction;
     int randomNumberSeed;
@@ -187,6 +187,12 @@ protected:
      * The implementation calls computeKineticEnergy() on whichever Integrator has been set as current.
      */
     double computeKineticEnergy();
+    /**
+     * Get whether step() reuses forces that are still valid in the Context.
+     * 
+     * The implementation calls reusesForces() on whichever Integrator has been set as current.
+     */
+    bool reusesForces() const;
     /**
      * Get the time interval by which velocities are offset from positions.  This is used to
      * adjust velocities when setVelocitiesToTemperature() is called on a Context.
@@ -62,6 +62,10 @@ class Platform;
  * allows you to record the state of the simulation at various points, either for analysis
  * or for checkpointing.  getState() can also be used to retrieve the current forces on each
  * particle and the current energy of the System.
+ *
+ * Different threads may create, use, and delete different Contexts at the same time, including Contexts
+ * that simulate the same System.  Any plugins should be loaded before doing this, since loading them
+ * modifies the global list of Platforms.  A single Context must only be used by one thread at a time.
  */
 
 class OPENMM_EXPORT Context {
@@ -125,6 +129,104 @@ public:
      * and energies.  Group i will be included if (groups&(1<<i)) != 0.  The default value includes all groups.
      */
     State getState(int types, bool enforcePeriodicBox=false, int groups=0xFFFFFFFF) const;
+    /**
+     * Compute the potential energy of the current state.  This is equivalent to
+     * getState(State::Energy, false, groups).getPotentialEnergy(), but is faster: it does
+     * not compute the kinetic energy, and it never computes forces, even for integrators
+     * whose kinetic energy depends on them.  Platforms skip work that is only needed for
+     * forces.
+     *
+     * @param groups a set of bit flags for which force groups to include.  Group i will be
+     * included if (groups&(1<<i)) != 0.  The default value includes all groups.
+     */
+    double computePotentialEnergy(int groups=0xFFFFFFFF) const;
+    /**
+     * Compute the potential energy of each of a series of conformations.  This gives the same results
+     * as calling setPositions() and getState(State::Energy) for each conformation in turn, but avoids
+     * much of the overhead, which makes it useful for rescoring the frames of a trajectory.  When it
+     * returns, the positions stored in the Context are the same as before it was called.
+     *
+     * @param positions  the particle positions for all the conformations, stored one after another.
+     *                   Its length must be a multiple of the number of particles in the System.
+     * @param groups     a set of bit flags for which force groups to include when computing energies.
+     *                   Group i will be included if (groups&(1<<i)) != 0.  The default value includes all groups.
+     * @return the potential energy of each conformation (in kJ/mol)
+     */
+    std::vector<double> computePotentialEnergies(const std::vector<Vec3>& positions, int groups=0xFFFFFFFF);
+    /**
+     * Compute the potential energy of each of a series of conformations, decomposed by force group.
+     * This is identical to computePotentialEnergies(), except that the energy of each force group is
+     * reported separately.
+     *
+     * @param positions  the particle positions for all the conformations, stored one after another.
+     *                   Its length must be a multiple of the number of particles in the System.
+     * @param groups     a set of bit flags for which force groups to include when computing energies.
+     *                   Group i will be included if (groups&(1<<i)) != 0.  The default value includes all groups.
+     * @return element [i][j] is the potential energy (in kJ/mol) of force group j in conformation i.
+     * Each element of the result has length 32.  Groups that are not included, or that contain no
+     * forces, have an energy of 0.
+     */
+    std::vector<std::vector<double> > computePotentialEnergiesByGroup(const std::vector<Vec3>& positions, int groups=0xFFFFFFFF);
+    /**
+     * Compute the potential energy of the current conformation for each of a series of sets of
+     * parameter values.  This is useful for free energy methods such as MBAR, which need the energy
+     * of every thermodynamic state (for example, every value of lambda) at each sample.  It gives the
+     * same results as calling setParameter() and getState(State::Energy) for each set of values in turn.
+     * Force groups that do not contain any Force that depends on one of the listed parameters are
+     * only evaluated once.  When it returns, the parameters stored in the Context are the same as before
+     * it was called.
+     *
+     * @param parameterValues  each element specifies a set of values for adjustable parameters.  Parameters
+     *                         that are not listed in an element keep their current values.
+     * @param groups           a set of bit flags for which force groups to include when computing energies.
+     *                         Group i will be included if (groups&(1<<i)) != 0.  The default value includes all groups.
+     * @return the potential energy (in kJ/mol) for each set of parameter values
+     */
+    std::vector<double> computePotentialEnergiesAtParameters(const std::vector<std::map<std::string, double> >& parameterValues, int groups=0xFFFFFFFF);
+    /**
+     * Begin retrieving a State without waiting for the data to be transferred.  This records the current
+     * positions and/or velocities, then returns as soon as possible so you can continue to advance the
+     * simulation while the data is copied.  Call getRequestedState() to wait for the copy to complete
+     * and retrieve the State.  This is useful for writing trajectories, since it lets the next steps run
+     * while the previous frame is being transferred.
+     *
+     * Only one request can be pending at a time.  Calling this while a previous request has not been
+     * retrieved discards the previous request.
+     *
+     * @param types the set of data types which should be stored in the State object.  This may only
+     * include State::Positions and State::Velocities.
+     * @param enforcePeriodicBox if false, the position of each particle will be whatever position
+     * is stored in the Context, regardless of periodic boundary conditions.  If true, particle
+     * positions will be translated so the center of every molecule lies in the same periodic box.
+     */
+    void requestStateAsync(int types, bool enforcePeriodicBox=false);
+    /**
+     * Retrieve the State that was requested by the most recent call to requestStateAsync().  This blocks
+     * until the data has been copied.  The State reflects the Context at the moment it was requested,
+     * not its current contents.
+     */
+    State getRequestedState();
+    /**
+     * Get the positions of all particles in single precision.  This is useful when positions are needed
+     * frequently, such as for writing a compressed trajectory, and single precision is sufficient.  Platforms
+     * that store positions in single precision can return them without converting them to double precision,
+     * and the result takes half as much memory as a State.
+     *
+     * As with getState(), the positions are whatever positions are stored in the Context, regardless of
+     * periodic boundary conditions.
+     *
+     * @param positions   on exit, this contains 3*N elements giving the x, y, and z coordinates of each
+     *                    particle in turn, measured in nm
+     */
+    void getPositionsFloat(std::vector<float>& positions);
+    /**
+     * Get the velocities of all particles in single precision.  This is useful when velocities are needed
+     * frequently and single precision is sufficient.
+     *
+     * @param velocities  on exit, this contains 3*N elements giving the x, y, and z components of each
+     *                    particle's velocity in turn, measured in nm/ps
+     */
+    void getVelocitiesFloat(std::vector<float>& velocities);
     /**
      * Copy information from a State object into this Context.  This restores the Context to
      * approximately the same state it was in when the State was created.  If the State does not include
@@ -165,6 +267,16 @@ public:
      * @param randomSeed     the random number seed to use when selecting velocities
      */
     void setVelocitiesToTemperature(double temperature, int randomSeed=osrngseed());
+    /**
+     * Multiply the velocities of all particles by a constant factor.  This is equivalent to calling
+     * getState() to retrieve the velocities, scaling them, and passing them to setVelocities(), but
+     * on platforms that support it the velocities are scaled on the device, so no per-particle data
+     * is transferred to or from the host.  A typical use is changing the temperature in simulated
+     * tempering, where the velocities are scaled by sqrt(newTemperature/oldTemperature).
+     *
+     * @param scale    the factor to multiply every velocity by
+     */
+    void scaleVelocities(double scale);
     /**
      * Get all adjustable parameters that have been defined by Force objects in the System, along
      * with their current values.
@@ -234,6 +346,14 @@ public:
      * loading the checkpoint.  Be aware that if the System has changed in a way that prevents
      * the checkpoint from being loaded (such as changing the number of particles), this will
      * throw an exception and the state information will be lost.
+     *
+     * When preserveState is true, the Context also keeps a record of the System so that later calls can
+     * avoid rebuilding everything.  If the only changes since the previous call are to per-particle,
+     * per-exception, or per-bond parameters of the standard Force classes that support
+     * updateParametersInContext() (NonbondedForce, CustomNonbondedForce, the harmonic bonded forces,
+     * PeriodicTorsionForce, CustomBondForce, CustomAngleForce, CustomTorsionForce, and CustomExternalForce),
+     * those changes are applied in place and the rest of the Context is left untouched.  Any other change
+     * causes a full reinitialization.
      */
     void reinitialize(bool preserveState=false);
     /**
@@ -243,6 +363,71 @@ public:
      * @param stream    an output stream the checkpoint data should be written to
      */
     void createCheckpoint(std::ostream& stream);
+    /**
+     * Define a subset of particles whose positions can be retrieved and modified with getSubsetPositions()
+     * and setSubsetPositions().  This is useful when you frequently need data for only a small part of a
+     * large System, such as the solute for on-the-fly analysis or the QM region in a QM/MM simulation.
+     * On platforms that support it, only the data for the particles in the subset is transferred.
+     *
+     * @param particles   the indices of the particles in the subset.  A particle may not appear more than once.
+     * @return the index of the newly created subset, which should be passed to getSubsetPositions() and
+     * setSubsetPositions()
+     */
+    int createParticleSubset(const std::vector<int>& particles);
+    /**
+     * Get the positions of the particles in a subset.  As with getState(), these are the positions stored
+     * in the Context, which are not translated into any particular periodic box.
+     *
+     * @param subset      the index of the subset, as returned by createParticleSubset()
+     * @param positions   on exit, element i contains the position of the i'th particle in the subset
+     */
+    void getSubsetPositions(int subset, std::vector<Vec3>& positions);
+    /**
+     * Set the positions of the particles in a subset.  The positions of all other particles are unchanged.
+     *
+     * @param subset      the index of the subset, as returned by createParticleSubset()
+     * @param positions   element i is the position of the i'th particle in the subset
+     */
+    void setSubsetPositions(int subset, const std::vector<Vec3>& positions);
+    /**
+     * Save the current state of the Context into a numbered slot, so it can later be restored with
+     * restoreSnapshot().  This is intended for Monte Carlo moves that must be undone when they are
+     * rejected.  A snapshot records the positions, velocities, periodic box vectors, parameters, and
+     * time.  On platforms that support it, the positions and velocities are copied on the device, so
+     * saving and restoring a snapshot does not transfer any per-particle data to or from the host.
+     *
+     * A snapshot does not include the internal state of the Integrator, such as the state of random
+     * number generators or the values of a CustomIntegrator's variables.  Saving into a slot that is
+     * already in use replaces its contents.  Snapshots are discarded when the Context is reinitialized.
+     *
+     * @param slot    the index of the slot to save the state in.  Any non-negative value may be used.
+     */
+    void saveSnapshot(int slot);
+    /**
+     * Restore the state of the Context to what it was when saveSnapshot() was called for a slot.  The
+     * snapshot remains in the slot, so it can be restored again.
+     *
+     * @param slot    the index of the slot to restore the state from
+     */
+    void restoreSnapshot(int slot);
+    /**
+     * Begin creating a checkpoint without waiting for it to be written.  The state of the Context is
+     * recorded before this returns, so the simulation can continue immediately while the data is written
+     * to the stream on a background thread.  The result is identical to what createCheckpoint() would
+     * produce.
+     *
+     * The stream must not be accessed or destroyed until waitForCheckpoint() has been called.  Only one
+     * checkpoint can be written at a time.  Calling this while a previous checkpoint is still being
+     * written first waits for it to finish.
+     *
+     * @param stream    an output stream the checkpoint data should be written to
+     */
+    void createCheckpointAsync(std::ostream& stream);
+    /**
+     * Wait until the checkpoint started by createCheckpointAsync() has been completely written to its stream.
+     * If an error occurred while writing it, an exception is thrown.
+     */
+    void waitForCheckpoint();
     /**
      * Load a checkpoint that was written by createCheckpoint().
      * 
@@ -272,16 +457,50 @@ public:
      * belong to exactly one molecule.
      */
     const std::vector<std::vector<int> >& getMolecules() const;
+    /**
+     * Set whether the Context should record how much time the device spends executing each kernel.
+     * Enabling profiling discards any times that were previously recorded.  Profiling is only supported
+     * by the CUDA and OpenCL platforms.  On other platforms it has no effect.
+     *
+     * Recording the times adds overhead to every kernel launch (and on the CUDA platform it also disables
+     * CUDA graphs), so it should only be enabled while investigating performance.
+     */
+    void setProfilingEnabled(bool enabled);
+    /**
+     * Get the times that have been recorded since profiling was enabled.  The keys are of the form
+     * "kernel:<name>", giving the total time spent in each kernel, and "group:<list>", giving the time
+     * spent in kernels launched while computing particular force groups.  Kernels that are shared by
+     * several forces (such as the combined bonded and nonbonded kernels) are attributed to the list of
+     * all groups being computed, for example "group:0,2".  All times are in milliseconds.
+     *
+     * On platforms that provide them, the report also contains statistics about the neighbor list with
+     * keys of the form "neighborList:<name>", such as how many times it has been built and how full its
+     * arrays are.  These are collected whether or not profiling is enabled.
+     *
+     * On platforms that allocate device memory, the report also gives the number of bytes currently
+     * allocated for arrays.  "memory:total" is the total over all arrays.  "memory:<owner>" is the
+     * total for arrays created by one owner, which is "force<i>" for the i'th Force in the System,
+     * "integrator" for the Integrator, or "context" for anything else.  "memory:<owner>:<array>" is
+     * the memory used by arrays with a particular name, which helps to identify which buffers are
+     * responsible when a large system does not fit on the device.
+     */
+    std::map<std::string, double> getPerformanceReport();
 private:
     friend class ContextImpl;
     friend class Force;
     friend class ForceImpl;
+    friend class LocalEnergyMinimizer;
+    friend class ReplicaExchange;
     friend class Platform;
     Context(const System& system, Integrator& integrator, ContextImpl& linked);
     ContextImpl& getImpl();
     const ContextImpl& getImpl() const;
     ContextImpl* impl;
     std::map<std::string, std::string> properties;
+    bool hasRequestedState, requestedStateEnforcePeriodicBox;
+    int requestedStateTypes;
+    double requestedStateTime;
+    Vec3 requestedStateBoxVectors[3];
 };
 
 } // namespace OpenMM
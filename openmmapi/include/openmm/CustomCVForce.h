@@ -69,6 +69,11 @@ namespace OpenMM {
  *
  * In addition, you can call addTabulatedFunction() to define a new function based on tabulated values.  You specify the function by
  * creating a TabulatedFunction object.  That function can then appear in the expression.
+ *
+ * By default the collective variables are evaluated in a separate inner Context.  Alternatively you can call
+ * setUseInnerContext(false) to have them evaluated directly by the Context containing this force.  That avoids
+ * duplicating the particle data and copying positions on every evaluation, but places some restrictions on what
+ * collective variables may be used.  See setUseInnerContext() for details.
  */
 
 class OPENMM_EXPORT CustomCVForce : public Force {
@@ -255,6 +260,25 @@ public:
      * @return the inner Context used to evaluate the collective variables
      */
     Context& getInnerContext(Context& context);
+    /**
+     * Get whether the collective variables are evaluated in a separate inner Context.  If this is false,
+     * they are evaluated directly by the Context this force is added to.
+     */
+    bool getUseInnerContext() const;
+    /**
+     * Set whether the collective variables are evaluated in a separate inner Context.
+     *
+     * When this is false, the Forces defining the collective variables are added to the Context containing
+     * this force, each in a force group that is not used by any other Force in the System.  Those groups are
+     * reserved for this force: they are not evaluated when you compute forces or energies for the Context, and
+     * they do not count toward the 32 groups available to you.  This avoids the memory and the per-evaluation
+     * copying needed by an inner Context, which can be significant when there are many collective variables.
+     * On the other hand, it requires that the System have at least one unused force group for every collective
+     * variable, the collective variables must be compatible with the other Forces in the System (for example, all
+     * nonbonded forces must agree on whether they use periodic boundary conditions), and getInnerContext() cannot
+     * be used.  The default value is true.
+     */
+    void setUseInnerContext(bool use);
     /**
      * Update the tabulated function parameters in a Context to match those stored in this Force object.  This method
      * provides an efficient method to update certain parameters in an existing Context without needing to reinitialize it.
@@ -284,6 +308,7 @@ private:
     std::vector<VariableInfo> variables;
     std::vector<FunctionInfo> functions;
     std::vector<int> energyParameterDerivatives;
+    bool useInnerContext;
 };
 
 /**
@@ -98,6 +98,10 @@ namespace OpenMM {
  * sometimes useful, but be aware of it so you do not accidentally create unwanted duplicate interactions.</li>
  * <li>If you do not add any interaction groups to a CustomNonbondedForce, it operates in the default mode where every
  * particle interacts with every other particle.</li>
+ * <li>On the CUDA and OpenCL platforms, a force in the default mode is evaluated in the same pass over the neighbor list
+ * as NonbondedForce and any other such CustomNonbondedForces.  A force with interaction groups needs its own pass, so
+ * only use them when they really exclude some pairs.  (A single group containing every particle in both sets is treated
+ * as the default mode.)</li>
  * </ul>
  *
  * When using a cutoff, by default the interaction is sharply truncated at the cutoff distance.
@@ -493,6 +497,17 @@ public:
      * the parameters of existing ones.
      */
     void updateParametersInContext(Context& context);
+    /**
+     * Update the per-particle parameters of a range of particles in a Context to match those stored in this
+     * Force object.  This is like updateParametersInContext(Context&), and has the same limitations, but it only
+     * examines and transfers the parameters of particles firstParticle through lastParticle (inclusive).  When
+     * only a few particles have changed in a large System, this can be much faster.
+     *
+     * @param context         the Context to update
+     * @param firstParticle   the index of the first particle whose parameters have changed
+     * @param lastParticle    the index of the last particle whose parameters have changed
+     */
+    void updateParametersInContext(Context& context, int firstParticle, int lastParticle);
     /**
      * Returns whether or not this force makes use of periodic boundary
      * conditions.
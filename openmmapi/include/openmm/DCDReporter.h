@@ -0,0 +1,123 @@
+#ifndef OPENMM_DCDREPORTER_H_
+#define OPENMM_DCDREPORTER_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2008-2020 Stanford University and the Authors.      *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "Context.h"
+#include "Vec3.h"
+#include "internal/windowsExport.h"
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace OpenMM {
+
+/**
+ * A DCDReporter writes a trajectory to a DCD file (in the CHARMM variant of the format, with
+ * little-endian byte ordering, the same as the DCDFile class in the Python application layer).
+ *
+ * To use it, create a DCDReporter, then call step() to advance the simulation instead of calling
+ * step() on the Integrator directly.  A frame is written every reportInterval steps.  The positions
+ * are retrieved with Context::requestStateAsync(), so the simulation continues running while each
+ * frame is transferred, and the frames are converted and written to disk on a separate thread.
+ * You also can call report() to write the current state immediately.
+ *
+ * The file is closed when the DCDReporter is deleted, after all pending frames have been written.
+ */
+
+class OPENMM_EXPORT DCDReporter {
+public:
+    /**
+     * Create a DCDReporter.
+     *
+     * @param file                 the path of the file to write.  Any existing file is overwritten.
+     * @param context              the Context whose trajectory should be written
+     * @param reportInterval       the interval (in time steps) at which to write frames
+     * @param enforcePeriodicBox   if true, particle positions are translated so the center of every molecule
+     *                             lies in the same periodic box
+     */
+    DCDReporter(const std::string& file, Context& context, int reportInterval, bool enforcePeriodicBox=false);
+    ~DCDReporter();
+    /**
+     * Get the interval (in time steps) at which frames are written.
+     */
+    int getReportInterval() const {
+        return reportInterval;
+    }
+    /**
+     * Get the number of frames that have been written to the file, or are waiting to be written.
+     */
+    int getNumFrames() const {
+        return numFrames;
+    }
+    /**
+     * Advance the simulation by calling step() on the Context's Integrator, writing a frame every
+     * reportInterval steps.
+     *
+     * @param steps   the number of time steps to take
+     */
+    void step(int steps);
+    /**
+     * Write a frame containing the current positions, regardless of the report interval.
+     */
+    void report();
+    /**
+     * Block until all pending frames have been written to the file.
+     */
+    void flush();
+private:
+    struct Frame {
+        std::vector<Vec3> positions;
+        Vec3 boxVectors[3];
+    };
+    void writerThreadBody();
+    void enqueueFrame(const State& state);
+    void writeFrame(const Frame& frame);
+    Context& context;
+    int reportInterval, numParticles, numFrames, numFramesWritten, currentStep;
+    bool enforcePeriodicBox, usePeriodic, isDeleted;
+    FILE* file;
+    std::string errorMessage;
+    std::deque<Frame> frames;
+    bool writingFrame;
+    std::thread writerThread;
+    std::mutex lock;
+    std::condition_variable frameAvailable, frameFinished;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_DCDREPORTER_H_*/
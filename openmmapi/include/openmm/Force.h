@@ -88,6 +88,7 @@ public:
     virtual bool usesPeriodicBoundaryConditions() const;
 protected:
     friend class ContextImpl;
+    friend class CustomCVForceImpl;
     /**
      * When a Context is created, it invokes this method on each Force in the System.
      * It should create a new ForceImpl object which can be used by the context for calculating forces.
@@ -95,7 +96,8 @@ protected:
      */
     virtual ForceImpl* createImpl() const = 0;
     /**
-     * Get the ForceImpl corresponding to this Force in a Context.
+     * Get the ForceImpl corresponding to this Force in a Context.  Because the caller may modify it,
+     * this marks any forces stored in the Context as no longer valid.
      */
     ForceImpl& getImplInContext(Context& context);
     /**
@@ -0,0 +1,108 @@
+#ifndef OPENMM_HYDROGENMASSREPARTITIONING_H_
+#define OPENMM_HYDROGENMASSREPARTITIONING_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2020 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "System.h"
+#include "internal/windowsExport.h"
+
+namespace OpenMM {
+
+/**
+ * This class provides utilities for increasing the step size that can be used to simulate a System
+ * by making its fastest motions slower.
+ *
+ * repartitionHydrogenMass() increases the mass of every hydrogen atom and subtracts the same amount
+ * from the heavy atom it is bonded to, so the total mass of each molecule is unchanged.  This slows
+ * down the motions involving hydrogens without changing the equilibrium distribution.
+ * constrainHydrogenAngles() adds a distance constraint across each H-X-H angle whose bonds are
+ * already constrained, which removes the fastest bending modes.  The new constraints are enforced
+ * along with all others, so platforms can use SETTLE, CCMA, or whatever else they normally would.
+ * Finally, findMaxStepSize() estimates the largest step size that can be used safely with the
+ * resulting System.
+ *
+ * These methods modify the System, so call them before creating a Context for it.  Hydrogens are
+ * identified by their mass, so call constrainHydrogenAngles() before repartitionHydrogenMass().
+ * A typical use is
+ *
+ * <pre>
+ * HydrogenMassRepartitioning::constrainHydrogenAngles(system);
+ * HydrogenMassRepartitioning::repartitionHydrogenMass(system, 4.0);
+ * double stepSize = HydrogenMassRepartitioning::findMaxStepSize(system);
+ * LangevinMiddleIntegrator integrator(300.0, 1.0, stepSize);
+ * </pre>
+ *
+ * Bonds are taken from the System's constraints and from every HarmonicBondForce, and angles from
+ * every HarmonicAngleForce.  Other kinds of forces are ignored.
+ */
+
+class OPENMM_EXPORT HydrogenMassRepartitioning {
+public:
+    /**
+     * Set the mass of every hydrogen atom to a new value, transferring the difference from the
+     * heavy atom it is bonded to.  A particle is treated as hydrogen if its mass is greater than 0
+     * and less than 1.5 amu.  Hydrogens bonded to other hydrogens (as in H2) are left unchanged.
+     *
+     * @param system         the System to modify
+     * @param hydrogenMass   the mass to give each hydrogen atom, measured in amu
+     * @return the number of hydrogen atoms whose mass was changed
+     */
+    static int repartitionHydrogenMass(System& system, double hydrogenMass);
+    /**
+     * Add a distance constraint between the two hydrogens of every H-X-H angle in a HarmonicAngleForce,
+     * provided both X-H bonds are already constrained.  This makes the angle rigid at its equilibrium
+     * value.  Angles whose hydrogens are already constrained to each other (such as rigid water) are
+     * skipped.
+     *
+     * @param system         the System to modify
+     * @return the number of constraints that were added
+     */
+    static int constrainHydrogenAngles(System& system);
+    /**
+     * Estimate the largest step size that can safely be used to simulate a System.  This finds the
+     * highest frequency harmonic vibration that is not removed by constraints, considering bond
+     * stretching and angle bending separately, and returns the step size that takes stepsPerPeriod
+     * steps per period of that vibration.  Leapfrog and Langevin integrators become unstable at
+     * about pi steps per period, and the default of 5 leaves a margin for the anharmonicity and
+     * coupling the estimate ignores.
+     *
+     * @param system          the System to analyze
+     * @param stepsPerPeriod  the number of steps to take per period of the fastest vibration
+     * @return the maximum step size, measured in ps.  If the System has no unconstrained harmonic
+     *         bonds or angles, this is infinite.
+     */
+    static double findMaxStepSize(const System& system, double stepsPerPeriod=5.0);
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_HYDROGENMASSREPARTITIONING_H_*/
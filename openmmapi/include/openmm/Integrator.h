@@ -148,6 +148,14 @@ protected:
     virtual bool kineticEnergyRequiresForce() const {
         return true;
     }
+    /**
+     * Get whether step() reuses forces that are still valid in the Context instead of computing
+     * them again.  When this returns true, getState() computes forces along with the energy so the
+     * next step can use them.  The default implementation returns false.
+     */
+    virtual bool reusesForces() const {
+        return false;
+    }
     /**
      * Return a list of velocities normally distributed around a target temperature.  This may be
      * overridden by Drude integrators to ensure that Drude pairs have their center of mass velocity
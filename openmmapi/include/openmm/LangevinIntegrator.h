@@ -133,6 +133,10 @@ protected:
      * Compute the kinetic energy of the system at the current time.
      */
     double computeKineticEnergy();
+    /**
+     * This integrator reuses forces that are still valid at the start of a step.
+     */
+    bool reusesForces() const;
     /**
      * Get the time interval by which velocities are offset from positions.  This is used to
      * adjust velocities when setVelocitiesToTemperature() is called on a Context.
@@ -146,6 +146,10 @@ protected:
      * Computing kinetic energy for this integrator does not require forces.
      */
     bool kineticEnergyRequiresForce() const;
+    /**
+     * This integrator reuses forces that are still valid at the start of a step.
+     */
+    bool reusesForces() const;
     /**
      * Get the time interval by which velocities are offset from positions.  This is used to
      * adjust velocities when setVelocitiesToTemperature() is called on a Context.
@@ -0,0 +1,192 @@
+#ifndef OPENMM_MTSLANGEVININTEGRATOR_H_
+#define OPENMM_MTSLANGEVININTEGRATOR_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2008-2020 Stanford University and the Authors.      *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "Integrator.h"
+#include "openmm/Kernel.h"
+#include "internal/windowsExport.h"
+#include <utility>
+#include <vector>
+
+namespace OpenMM {
+
+/**
+ * This is an Integrator which simulates a System using the BAOAB-RESPA multiple
+ * time step algorithm for Langevin dynamics (Lagardere et al., J. Phys. Chem. Lett.
+ * 10(10) pp. 2593-2599 (2019)).
+ *
+ * This integrator allows different forces to be evaluated at different frequencies,
+ * for example to evaluate the expensive, slowly changing forces less frequently than
+ * the inexpensive, quickly changing forces.
+ *
+ * To use it, you must first divide your forces into two or more groups (by calling
+ * setForceGroup() on them) that should be evaluated at different frequencies.  When
+ * you create the integrator, you provide a pair for each group specifying the index
+ * of the force group and the number of times it should be evaluated in one time
+ * step.  For example, the groups [(0,1), (1,2), (2,8)] specify that force group 0
+ * is evaluated once per time step, force group 1 twice per time step, and force
+ * group 2 eight times per time step.  The number of substeps for each group must
+ * be a multiple of the number for the next slower group.
+ *
+ * A common use of this algorithm is to evaluate reciprocal space nonbonded interactions
+ * less often than the bonded and direct space nonbonded interactions.  To do this, call
+ * setReciprocalSpaceForceGroup() on the NonbondedForce to place reciprocal space in
+ * its own force group, then list that group with a substep count of 1 and all other
+ * groups with a larger count.
+ */
+
+class OPENMM_EXPORT MTSLangevinIntegrator : public Integrator {
+public:
+    /**
+     * Create a MTSLangevinIntegrator.
+     *
+     * @param temperature    the temperature of the heat bath (in Kelvin)
+     * @param frictionCoeff  the friction coefficient which couples the system to the heat bath (in inverse picoseconds)
+     * @param stepSize       the largest (outermost) step size with which to integrate the system (in picoseconds)
+     * @param groups         a list of pairs defining the force groups.  The first element of each pair is
+     *                       the force group index, and the second element is the number of times that force
+     *                       group should be evaluated in one time step.
+     */
+    MTSLangevinIntegrator(double temperature, double frictionCoeff, double stepSize, const std::vector<std::pair<int, int> >& groups);
+    /**
+     * Get the temperature of the heat bath (in Kelvin).
+     *
+     * @return the temperature of the heat bath, measured in Kelvin
+     */
+    double getTemperature() const {
+        return temperature;
+    }
+    /**
+     * Set the temperature of the heat bath (in Kelvin).
+     *
+     * @param temp    the temperature of the heat bath, measured in Kelvin
+     */
+    void setTemperature(double temp) {
+        temperature = temp;
+    }
+    /**
+     * Get the friction coefficient which determines how strongly the system is coupled to
+     * the heat bath (in inverse ps).
+     *
+     * @return the friction coefficient, measured in 1/ps
+     */
+    double getFriction() const {
+        return friction;
+    }
+    /**
+     * Set the friction coefficient which determines how strongly the system is coupled to
+     * the heat bath (in inverse ps).
+     *
+     * @param coeff    the friction coefficient, measured in 1/ps
+     */
+    void setFriction(double coeff) {
+        friction = coeff;
+    }
+    /**
+     * Get the force groups and the number of substeps for each one, sorted from
+     * the slowest group to the fastest.
+     */
+    const std::vector<std::pair<int, int> >& getGroups() const {
+        return groups;
+    }
+    /**
+     * Get the random number seed.  See setRandomNumberSeed() for details.
+     */
+    int getRandomNumberSeed() const {
+        return randomNumberSeed;
+    }
+    /**
+     * Set the random number seed.  The precise meaning of this parameter is undefined, and is left up
+     * to each Platform to interpret in an appropriate way.  It is guaranteed that if two simulations
+     * are run with different random number seeds, the sequence of random forces will be different.  On
+     * the other hand, no guarantees are made about the behavior of simulations that use the same seed.
+     * In particular, Platforms are permitted to use non-deterministic algorithms which produce different
+     * results on successive runs, even if those runs were initialized identically.
+     *
+     * If seed is set to 0 (which is the default value assigned), a unique seed is chosen when a Context
+     * is created from this Integrator. This is done to ensure that each Context receives unique random seeds
+     * without you needing to set them explicitly.
+     */
+    void setRandomNumberSeed(int seed) {
+        randomNumberSeed = seed;
+    }
+    /**
+     * Advance a simulation through time by taking a series of time steps.
+     *
+     * @param steps   the number of time steps to take
+     */
+    void step(int steps);
+protected:
+    /**
+     * This will be called by the Context when it is created.  It informs the Integrator
+     * of what context it will be integrating, and gives it a chance to do any necessary initialization.
+     * It will also get called again if the application calls reinitialize() on the Context.
+     */
+    void initialize(ContextImpl& context);
+    /**
+     * This will be called by the Context when it is destroyed to let the Integrator do any necessary
+     * cleanup.  It will also get called again if the application calls reinitialize() on the Context.
+     */
+    void cleanup();
+    /**
+     * Get the names of all Kernels used by this Integrator.
+     */
+    std::vector<std::string> getKernelNames();
+    /**
+     * This will be called by the Context when the user modifies aspects of the context state, such
+     * as positions, velocities, or parameters.
+     *
+     * @param changed     this specifies what aspect of the Context was changed
+     */
+    void stateChanged(State::DataType changed);
+    /**
+     * Compute the kinetic energy of the system at the current time.
+     */
+    double computeKineticEnergy();
+    /**
+     * Computing kinetic energy for this integrator does not require forces.
+     */
+    bool kineticEnergyRequiresForce() const;
+private:
+    void computeSubsteps(int level, int parentSubsteps);
+    void applyKick(int group, double dt);
+    double temperature, friction;
+    int randomNumberSeed, lastForceGroup;
+    bool forcesAreValid;
+    std::vector<std::pair<int, int> > groups;
+    Kernel kernel;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_MTSLANGEVININTEGRATOR_H_*/
@@ -287,6 +287,19 @@ public:
      * @param nz      the number of grid points along the Z axis
      */
     void setLJPMEParameters(double alpha, int nx, int ny, int nz);
+    /**
+     * Get the order of the B-spline interpolation used to spread charges onto the PME grid.  The default
+     * value is 5.  The same order is used for the dispersion term in LJPME calculations.
+     */
+    int getPMEInterpolationOrder() const;
+    /**
+     * Set the order of the B-spline interpolation used to spread charges onto the PME grid.  This must be
+     * between 4 and 6.  A lower order is cheaper to compute but requires a finer grid to reach the same
+     * accuracy, and a higher order allows a coarser grid.  When the grid dimensions are chosen based on
+     * the Ewald error tolerance, this is taken into account.  The same order is used for the dispersion
+     * term in LJPME calculations.
+     */
+    void setPMEInterpolationOrder(int order);
     /**
      * Get the parameters being used for PME in a particular Context.  Because some platforms have restrictions
      * on the allowed grid sizes, the values that are actually used may be slightly different from those
@@ -556,6 +569,21 @@ public:
      * to add new particles or exceptions, only to change the parameters of existing ones.
      */
     void updateParametersInContext(Context& context);
+    /**
+     * Update the parameters of a range of particles and exceptions in a Context to match those stored in this
+     * Force object.  This is like updateParametersInContext(Context&), and has the same limitations, but it only
+     * examines and transfers the parameters of particles firstParticle through lastParticle and exceptions
+     * firstException through lastException (inclusive).  When only a few particles have changed in a large
+     * System, this can be much faster.  To update no particles (or no exceptions), pass a last index that is
+     * less than the first one.
+     *
+     * @param context         the Context to update
+     * @param firstParticle   the index of the first particle whose parameters have changed
+     * @param lastParticle    the index of the last particle whose parameters have changed
+     * @param firstException  the index of the first exception whose parameters have changed
+     * @param lastException   the index of the last exception whose parameters have changed
+     */
+    void updateParametersInContext(Context& context, int firstParticle, int lastParticle, int firstException=0, int lastException=-1);
     /**
      * Returns whether or not this force makes use of periodic boundary
      * conditions.
@@ -605,7 +633,7 @@ private:
     NonbondedMethod nonbondedMethod;
     double cutoffDistance, switchingDistance, rfDielectric, ewaldErrorTol, alpha, dalpha;
     bool useSwitchingFunction, useDispersionCorrection, exceptionsUsePeriodic;
-    int recipForceGroup, nx, ny, nz, dnx, dny, dnz;
+    int recipForceGroup, nx, ny, nz, dnx, dny, dnz, pmeOrder;
     void addExclusionsToSet(const std::vector<std::set<int> >& bonded12, std::set<int>& exclusions, int baseParticle, int fromParticle, int currentLevel) const;
     int getGlobalParameterIndex(const std::string& parameter) const;
     std::vector<ParticleInfo> particles;
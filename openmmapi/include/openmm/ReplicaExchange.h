@@ -0,0 +1,116 @@
+#ifndef OPENMM_REPLICAEXCHANGE_H_
+#define OPENMM_REPLICAEXCHANGE_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2008-2020 Stanford University and the Authors.      *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "Context.h"
+#include "internal/OSRngSeed.h"
+#include "internal/windowsExport.h"
+#include <vector>
+
+namespace OpenMM_SFMT {
+    class SFMT;
+}
+
+namespace OpenMM {
+
+/**
+ * A ReplicaExchange performs replica exchange (parallel tempering) between a set of Contexts.
+ * Each Context represents one thermodynamic state, defined by its temperature and by the values
+ * of its parameters (or even its System), so it can be used for temperature replica exchange,
+ * Hamiltonian replica exchange (such as REST2), or a combination of them.  The Contexts must
+ * all have the same number of particles.
+ *
+ * Simulate each Context for a while, then call attemptExchanges().  This tries to exchange
+ * configurations between neighboring states, accepting each exchange with the Metropolis
+ * criterion.  When an exchange is accepted, the positions, velocities and periodic box vectors
+ * of the two Contexts are swapped, and the velocities are rescaled to the new temperatures.  If
+ * the Platform supports it and the Contexts share a device, the data is exchanged with device to
+ * device copies and never passes through the host.
+ */
+
+class OPENMM_EXPORT ReplicaExchange {
+public:
+    /**
+     * Create a ReplicaExchange.
+     *
+     * @param contexts       the Contexts to exchange configurations between, in order of their
+     *                       thermodynamic states.  Exchanges are attempted between neighbors in this list.
+     * @param temperatures   the temperature (in Kelvin) of each Context
+     * @param randomSeed     the seed for the random numbers used to accept or reject exchanges
+     */
+    ReplicaExchange(const std::vector<Context*>& contexts, const std::vector<double>& temperatures, int randomSeed=osrngseed());
+    ~ReplicaExchange();
+    /**
+     * Get the number of replicas.
+     */
+    int getNumReplicas() const {
+        return contexts.size();
+    }
+    /**
+     * Attempt exchanges between neighboring states.  Successive calls alternate between attempting
+     * exchanges of states (0, 1), (2, 3), etc. and (1, 2), (3, 4), etc.
+     *
+     * @return the number of exchanges that were accepted
+     */
+    int attemptExchanges();
+    /**
+     * Get the index of the replica (the configuration that was originally in that state) that is
+     * currently in a state.
+     *
+     * @param state    the index of the state (the Context)
+     */
+    int getReplicaInState(int state) const;
+    /**
+     * Get the number of exchanges that have been attempted between a state and the next one.
+     *
+     * @param state    the index of the lower of the two states
+     */
+    int getNumAttempted(int state) const;
+    /**
+     * Get the number of exchanges that have been accepted between a state and the next one.
+     *
+     * @param state    the index of the lower of the two states
+     */
+    int getNumAccepted(int state) const;
+private:
+    bool attemptExchange(int state1, int state2);
+    std::vector<Context*> contexts;
+    std::vector<double> temperatures;
+    std::vector<int> replicaInState, numAttempted, numAccepted;
+    int numCalls;
+    OpenMM_SFMT::SFMT* sfmt;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_REPLICAEXCHANGE_H_*/
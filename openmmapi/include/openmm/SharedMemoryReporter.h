@@ -0,0 +1,184 @@
+#ifndef OPENMM_SHAREDMEMORYREPORTER_H_
+#define OPENMM_SHAREDMEMORYREPORTER_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2020 Stanford University and the Authors.      *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "Context.h"
+#include "Vec3.h"
+#include "internal/windowsExport.h"
+#include <string>
+#include <vector>
+
+namespace OpenMM {
+
+/**
+ * A SharedMemoryReporter publishes particle positions to a POSIX shared memory object, where they can
+ * be read by other processes (for example, to perform analysis or visualization while a simulation is
+ * running) with a SharedMemoryReader.
+ *
+ * The shared memory holds a ring buffer with a fixed number of slots.  Each frame is written into the
+ * next slot, overwriting the oldest frame.  The reporter never waits for readers: a reader that falls
+ * behind simply misses frames, and a frame that is overwritten while being read is detected and
+ * reported as unavailable.
+ *
+ * To use it, create a SharedMemoryReporter, then call step() to advance the simulation instead of
+ * calling step() on the Integrator directly.  A frame is published every reportInterval steps.  When
+ * all particles are published, the positions are retrieved with Context::requestStateAsync() so the
+ * simulation continues running while each frame is transferred.  When only a subset of particles is
+ * published, they are retrieved with Context::getSubsetPositions(), which avoids downloading the
+ * positions of all other particles.
+ *
+ * The shared memory object is removed when the SharedMemoryReporter is deleted.  Processes that
+ * have already opened it can continue reading the frames it contains.
+ */
+
+class OPENMM_EXPORT SharedMemoryReporter {
+public:
+    /**
+     * Create a SharedMemoryReporter.
+     *
+     * @param name             the name of the shared memory object to create.  It should begin with "/" and
+     *                         contain no other slashes.  Any existing object with the same name is replaced.
+     * @param context          the Context whose positions should be published
+     * @param reportInterval   the interval (in time steps) at which to publish frames
+     * @param numSlots         the number of frames the ring buffer can hold
+     * @param particles        the indices of the particles to publish.  If this is empty, all particles
+     *                         are published.
+     */
+    SharedMemoryReporter(const std::string& name, Context& context, int reportInterval, int numSlots=4,
+                         const std::vector<int>& particles=std::vector<int>());
+    ~SharedMemoryReporter();
+    /**
+     * Get the name of the shared memory object.
+     */
+    const std::string& getName() const {
+        return name;
+    }
+    /**
+     * Get the interval (in time steps) at which frames are published.
+     */
+    int getReportInterval() const {
+        return reportInterval;
+    }
+    /**
+     * Get the number of particles included in each frame.
+     */
+    int getNumParticles() const {
+        return numParticles;
+    }
+    /**
+     * Get the total number of frames that have been published.
+     */
+    long long getNumFrames() const {
+        return numFrames;
+    }
+    /**
+     * Advance the simulation by calling step() on the Context's Integrator, publishing a frame every
+     * reportInterval steps.
+     *
+     * @param steps   the number of time steps to take
+     */
+    void step(int steps);
+    /**
+     * Publish a frame containing the current positions, regardless of the report interval.
+     */
+    void report();
+private:
+    void publishFrame(const std::vector<Vec3>& positions, const Vec3* boxVectors, long long step, double time);
+    void publishSubset();
+    Context& context;
+    std::string name;
+    int reportInterval, numParticles, numSlots, subset, currentStep;
+    long long numFrames;
+    size_t size, slotSize;
+    char* data;
+};
+
+/**
+ * A SharedMemoryReader reads frames that were published by a SharedMemoryReporter, possibly in a
+ * different process.  Reading never blocks or slows down the writer.
+ */
+
+class OPENMM_EXPORT SharedMemoryReader {
+public:
+    /**
+     * Open a shared memory object that was created by a SharedMemoryReporter.
+     *
+     * @param name    the name of the shared memory object
+     */
+    SharedMemoryReader(const std::string& name);
+    ~SharedMemoryReader();
+    /**
+     * Get the number of particles included in each frame.
+     */
+    int getNumParticles() const {
+        return numParticles;
+    }
+    /**
+     * Get the number of frames the ring buffer can hold.
+     */
+    int getNumSlots() const {
+        return numSlots;
+    }
+    /**
+     * Get the total number of frames that have been published so far.  Frame i is still available
+     * if i >= getNumFrames()-getNumSlots().
+     */
+    long long getNumFrames() const;
+    /**
+     * Read a frame.
+     *
+     * @param frame        the index of the frame to read
+     * @param positions    on exit, contains the particle positions
+     * @param boxVectors   on exit, contains the three periodic box vectors.  This must point to an array of length 3.
+     * @param step         on exit, contains the number of steps the SharedMemoryReporter had taken when the
+     *                     frame was recorded
+     * @param time         on exit, contains the simulation time (in ps) at which the frame was recorded
+     * @return true if the frame was read, or false if it has not been published yet or has already
+     * been overwritten
+     */
+    bool readFrame(long long frame, std::vector<Vec3>& positions, Vec3* boxVectors, long long& step, double& time) const;
+    /**
+     * Read the most recently published frame.  The arguments are the same as for readFrame().
+     *
+     * @return the index of the frame that was read, or -1 if no frame has been published yet
+     */
+    long long readLatestFrame(std::vector<Vec3>& positions, Vec3* boxVectors, long long& step, double& time) const;
+private:
+    int numParticles, numSlots;
+    size_t size, slotSize;
+    char* data;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_SHAREDMEMORYREPORTER_H_*/
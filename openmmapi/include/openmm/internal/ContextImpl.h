@@ -37,13 +37,18 @@
 #include "openmm/Vec3.h"
 #include <iosfwd>
 #include <map>
+#include <utility>
+#include <string>
+#include <thread>
 #include <vector>
 
 namespace OpenMM {
 
+class Force;
 class ForceImpl;
 class Integrator;
 class Context;
+class SerializationNode;
 class System;
 
 /**
@@ -108,12 +113,42 @@ public:
      * @param velocities  on exit, this contains the particle velocities
      */
     void getVelocities(std::vector<Vec3>& velocities);
+    /**
+     * Begin copying the positions and/or velocities of all particles so they can be retrieved later
+     * by finishStateCopy().  This may return before the copy is complete.
+     *
+     * @param positions   whether to copy the positions
+     * @param velocities  whether to copy the velocities
+     */
+    void beginStateCopy(bool positions, bool velocities);
+    /**
+     * Get the positions of all particles in single precision, stored as x, y, and z for each particle in turn.
+     */
+    void getPositionsFloat(std::vector<float>& positions);
+    /**
+     * Get the velocities of all particles in single precision, stored as x, y, and z for each particle in turn.
+     */
+    void getVelocitiesFloat(std::vector<float>& velocities);
+    /**
+     * Wait for the copy started by beginStateCopy() to complete and retrieve the data.
+     *
+     * @param positions   on exit, this contains the particle positions, or is empty if they were not copied
+     * @param velocities  on exit, this contains the particle velocities, or is empty if they were not copied
+     */
+    void finishStateCopy(std::vector<Vec3>& positions, std::vector<Vec3>& velocities);
     /**
      * Set the velocities of all particles.
      *
      * @param velocities  a vector containg the particle velocities
      */
     void setVelocities(const std::vector<Vec3>& velocities);
+    /**
+     * Multiply the velocities of all particles by a constant factor.  If the Platform provides a
+     * ScaleVelocitiesKernel, this is done on the device.
+     *
+     * @param scale  the factor to multiply every velocity by
+     */
+    void scaleVelocities(double scale);
     /**
      * Get the current forces on all particles.
      *
@@ -185,6 +220,83 @@ public:
      * constraints.
      */
     void computeVirtualSites();
+    /**
+     * Minimize the potential energy with a minimizer provided by the Platform.  This is used
+     * by LocalEnergyMinimizer, which falls back to its own implementation when this returns false.
+     *
+     * @param tolerance      the convergence tolerance, measured in kJ/mol/nm
+     * @param maxIterations  the maximum number of iterations to perform.  If this is 0, minimization
+     *                       is continued until the results converge.
+     * @return true if the minimization was performed, or false if the Platform does not provide
+     * a minimizer or it could not be used
+     */
+    bool minimize(double tolerance, int maxIterations);
+    /**
+     * Exchange the positions, velocities and periodic box vectors of this context with those of another
+     * one.  This is used by ReplicaExchange.  If the Platform provides a SwapStateKernel and it can be used
+     * for the two contexts, the data is exchanged without being copied through the host.
+     *
+     * @param other          the context to exchange with.  It must have the same number of particles.
+     * @param velocityScale  the velocities moved into this context are multiplied by this, and the
+     *                       velocities moved into other are divided by it
+     */
+    void swapState(ContextImpl& other, double velocityScale=1.0);
+    /**
+     * Define a subset of particles whose positions can be retrieved and set by getSubsetPositions()
+     * and setSubsetPositions().  If the Platform provides a ParticleSubsetKernel, only the data for
+     * those particles is transferred.
+     *
+     * @param particles   the indices of the particles in the subset
+     * @return the index of the newly created subset
+     */
+    int createParticleSubset(const std::vector<int>& particles);
+    /**
+     * Get the lists of particles in all subsets that have been created by createParticleSubset().
+     */
+    const std::vector<std::vector<int> >& getParticleSubsets() const {
+        return particleSubsets;
+    }
+    /**
+     * Get the positions of the particles in a subset.
+     *
+     * @param subset      the index of the subset, as returned by createParticleSubset()
+     * @param positions   on exit, this contains the position of each particle in the subset
+     */
+    void getSubsetPositions(int subset, std::vector<Vec3>& positions);
+    /**
+     * Set the positions of the particles in a subset.
+     *
+     * @param subset      the index of the subset, as returned by createParticleSubset()
+     * @param positions   the position of each particle in the subset
+     */
+    void setSubsetPositions(int subset, const std::vector<Vec3>& positions);
+    /**
+     * Save the current positions, velocities, periodic box vectors, parameters, and time into a slot.
+     * If the Platform provides a StateSnapshotKernel, the particle data is copied on the device.
+     *
+     * @param slot    the index of the slot to save to
+     */
+    void saveSnapshot(int slot);
+    /**
+     * Restore the state that was saved by saveSnapshot().
+     *
+     * @param slot    the index of the slot to restore from
+     */
+    void restoreSnapshot(int slot);
+    /**
+     * Try to bring this context up to date with changes to its System without rebuilding it.  This is
+     * used by Context::reinitialize().  The System is compared to the snapshot recorded by the last call to
+     * recordSystemSnapshot() or updateFromSystem().  If the only differences are in per-particle or per-bond
+     * parameters of Forces whose updateParametersInContext() method can apply them, they are applied that way.
+     *
+     * @return true if the context now matches the System, or false if it must be fully reinitialized.  This
+     * is always false if no snapshot has been recorded.
+     */
+    bool updateFromSystem();
+    /**
+     * Record a snapshot of the System for updateFromSystem() to compare against.
+     */
+    void recordSystemSnapshot();
     /**
      * Recalculate all of the forces in the system and/or the potential energy of the system (in kJ/mol).
      * After calling this, use getForces() to retrieve the forces that were calculated.
@@ -196,6 +308,26 @@ public:
      * @return the potential energy of the system, or 0 if includeEnergy is false
      */
     double calcForcesAndEnergy(bool includeForces, bool includeEnergy, int groups=0xFFFFFFFF);
+    /**
+     * Reserve a force group that is not used by any Force in the System.  This is used by ForceImpls
+     * that add forces of their own to the context and need to evaluate them separately from everything
+     * else.  Reserved groups are never included by calcForcesAndEnergy(), even if they are requested;
+     * they can only be evaluated with calcReservedForcesAndEnergy().
+     *
+     * @return the index of the group that was reserved
+     */
+    int reserveForceGroup();
+    /**
+     * Calculate the forces and/or energy for a set of reserved force groups, ignoring all other groups.
+     * This overwrites any forces stored in the context.
+     *
+     * @param includeForces  true if forces should be calculated
+     * @param includeEnergy  true if the energy should be calculated
+     * @param groups         a set of bit flags for which force groups to include.  Every group must have
+     *                       been reserved with reserveForceGroup().
+     * @return the potential energy of the groups, or 0 if includeEnergy is false
+     */
+    double calcReservedForcesAndEnergy(bool includeForces, bool includeEnergy, int groups);
     /**
      * Get the set of force group flags that were passed to the most recent call to calcForcesAndEnergy().
      * 
@@ -203,6 +335,24 @@ public:
      * doing that!  Only do it if you're also modifying forces stored inside the context.
      */
     int& getLastForceGroups();
+    /**
+     * Get whether the forces stored in the context are still valid for a set of force groups.  This is true
+     * if the most recent call to calcForcesAndEnergy() computed forces for exactly those groups, and nothing
+     * that could change the forces has happened since then.  Integrators can use this to avoid recomputing
+     * forces at the start of a step when they were already computed, for example by getState() on a
+     * reporting step.
+     *
+     * This only knows about changes made through the ContextImpl.  An Integrator that calls it must also
+     * call invalidateForces() every time it modifies particle positions.
+     *
+     * @param groups   a set of bit flags for the force groups the forces are needed for
+     */
+    bool hasValidForces(int groups) const;
+    /**
+     * Mark the forces stored in the context as no longer valid, so that hasValidForces() returns false
+     * until forces are next computed.
+     */
+    void invalidateForces();
     /**
      * Calculate the kinetic energy of the system (in kJ/mol).
      */
@@ -215,6 +365,12 @@ public:
      * to change, false otherwise
      */
     bool updateContextState();
+    /**
+     * Get whether any ForceImpl in the system needs updateContextState() to be called.  If this returns
+     * false, updateContextState() does nothing and integrators are free to take many steps without
+     * returning control to the host between them.
+     */
+    bool hasContextStateUpdates() const;
     /**
      * Get the list of ForceImpls belonging to this ContextImpl.
      */
@@ -246,6 +402,19 @@ public:
      * @param stream    an output stream the checkpoint data should be written to
      */
     void createCheckpoint(std::ostream& stream);
+    /**
+     * Begin creating a checkpoint.  The state of the Context is captured before this returns, but the
+     * data is written to the stream on a background thread.  The stream must not be accessed until
+     * waitForCheckpoint() has been called.
+     * 
+     * @param stream    an output stream the checkpoint data should be written to
+     */
+    void createCheckpointAsync(std::ostream& stream);
+    /**
+     * Wait until the checkpoint started by createCheckpointAsync() has been completely written.  If
+     * no checkpoint is being written, this returns immediately.
+     */
+    void waitForCheckpoint();
     /**
      * Load a checkpoint that was written by createCheckpoint().
      * 
@@ -268,6 +437,12 @@ public:
      * you should never call it.  It is exposed here because the same logic is useful to other classes too.
      */
     static std::vector<std::vector<int> > findMolecules(int numParticles, std::vector<std::vector<int> >& particleBonds);
+    /**
+     * This is equivalent to the other version of findMolecules(), but takes a list of bonds instead of a list of
+     * the particles each particle is bonded to.  Each bond is a pair of particle indices.  It is much faster and
+     * uses much less memory for large systems.
+     */
+    static std::vector<std::vector<int> > findMolecules(int numParticles, const std::vector<std::pair<int, int> >& bonds);
     /**
      * Create a new Context based on this one.  The new context will use the same Platform, device, and property
      * values as this one.  With the CUDA and OpenCL platforms, it also shares the same GPU context, allowing data
@@ -277,20 +452,52 @@ public:
      * means you shouldn't.
      */
     Context* createLinkedContext(const System& system, Integrator& integrator);
+    /**
+     * Set whether the time spent executing each kernel should be recorded.
+     */
+    void setProfilingEnabled(bool enabled);
+    /**
+     * Get the times that have been recorded since profiling was enabled.
+     */
+    void getPerformanceReport(std::map<std::string, double>& report);
 private:
     friend class Context;
+    /**
+     * The data recorded by saveSnapshot().  The positions and velocities are only stored here when
+     * the Platform does not provide a StateSnapshotKernel.
+     */
+    struct StateSnapshot {
+        Vec3 periodicBoxVectors[3];
+        std::map<std::string, double> parameters;
+        double time;
+        std::vector<Vec3> positions, velocities;
+    };
     void initialize();
+    double computeForceGroups(bool includeForces, bool includeEnergy, int groups);
+    /**
+     * Get the force groups a Force's kernels should be attributed to while profiling.
+     */
+    static int getProfiledForceGroups(const Force& force);
+    void checkpointThreadBody();
     Context& owner;
     const System& system;
     Integrator& integrator;
-    std::vector<ForceImpl*> forceImpls;
+    std::vector<ForceImpl*> forceImpls, stateUpdateForceImpls;
     std::map<std::string, double> parameters;
     mutable std::vector<std::vector<int> > molecules;
-    bool hasInitializedForces, hasSetPositions, integratorIsDeleted;
-    int lastForceGroups;
+    bool hasInitializedForces, hasSetPositions, integratorIsDeleted, hasCreatedMinimizeKernel, hasCreatedSwapStateKernel, hasCreatedParticleSubsetKernel, hasCreatedStateSnapshotKernel, hasCreatedScaleVelocitiesKernel, hasCreatedProfileKernel;
+    bool forcesValid;
+    int lastForceGroups, reservedForceGroups;
     Platform* platform;
-    Kernel initializeForcesKernel, updateStateDataKernel, applyConstraintsKernel, virtualSitesKernel;
+    Kernel initializeForcesKernel, updateStateDataKernel, applyConstraintsKernel, virtualSitesKernel, minimizeKernel, swapStateKernel, particleSubsetKernel, stateSnapshotKernel, scaleVelocitiesKernel, profileKernel;
     void* platformData;
+    SerializationNode* systemSnapshot;
+    std::vector<std::vector<int> > particleSubsets;
+    std::map<int, StateSnapshot> stateSnapshots;
+    bool isWritingCheckpoint, profilingEnabled;
+    std::thread checkpointThread;
+    std::ostream* checkpointStream;
+    std::string checkpointData, checkpointError;
 };
 
 } // namespace OpenMM
@@ -56,12 +56,12 @@ public:
     const CustomCVForce& getOwner() const {
         return owner;
     }
-    void updateContextState(ContextImpl& context, bool& forcesInvalid) {
-        // This force field doesn't update the state directly.
-    }
+    void updateContextState(ContextImpl& context, bool& forcesInvalid);
     double calcForcesAndEnergy(ContextImpl& context, bool includeForces, bool includeEnergy, int groups);
+    void prepareForcesAndEnergy(ContextImpl& context, bool includeForces, bool includeEnergy, int groups);
     std::map<std::string, double> getDefaultParameters();
     std::vector<std::string> getKernelNames();
+    std::vector<std::pair<int, int> > getBondedParticles() const;
     void getCollectiveVariableValues(ContextImpl& context, std::vector<double>& values);
     Context& getInnerContext();
     void updateParametersInContext(ContextImpl& context);
@@ -71,6 +71,12 @@ private:
     System innerSystem;
     VerletIntegrator innerIntegrator;
     Context* innerContext;
+    // These are used only when the collective variables are evaluated in the main context.
+    std::vector<Force*> variableForces;
+    std::vector<ForceImpl*> variableImpls;
+    std::vector<int> variableGroups;
+    std::vector<double> variableValues;
+    std::vector<std::map<std::string, double> > variableParamDerivs;
 };
 
 } // namespace OpenMM
@@ -38,16 +38,20 @@
 #include "lepton/CompiledExpression.h"
 #include <utility>
 #include <map>
+#include <set>
 #include <string>
 
 namespace OpenMM {
 
+class ThreadPool;
+
 /**
  * This is the internal implementation of CustomNonbondedForce.
  */
 
 class OPENMM_EXPORT CustomNonbondedForceImpl : public ForceImpl {
 public:
+    class LongRangeCorrectionData;
     CustomNonbondedForceImpl(const CustomNonbondedForce& owner);
     ~CustomNonbondedForceImpl();
     void initialize(ContextImpl& context);
@@ -57,16 +61,37 @@ public:
     void updateContextState(ContextImpl& context, bool& forcesInvalid) {
         // This force field doesn't update the state directly.
     }
+    bool updatesContextState() const {
+        return false;
+    }
     double calcForcesAndEnergy(ContextImpl& context, bool includeForces, bool includeEnergy, int groups);
     std::map<std::string, double> getDefaultParameters();
     std::vector<std::string> getKernelNames();
     void updateParametersInContext(ContextImpl& context);
+    void updateParametersInContext(ContextImpl& context, int firstParticle, int lastParticle);
     /**
      * Compute the coefficient which, when divided by the periodic box volume, gives the
      * long range correction to the energy.  If the Force computes parameter derivatives,
      * also compute the corresponding derivatives of the correction.
      */
     static void calcLongRangeCorrection(const CustomNonbondedForce& force, const Context& context, double& coefficient, std::vector<double>& derivatives);
+    /**
+     * Analyze the particles of a CustomNonbondedForce to prepare for computing the long range correction.
+     * This identifies the classes of particles and counts the interactions between them, which depend only
+     * on the per-particle parameters.  Call it again whenever they change.
+     */
+    static LongRangeCorrectionData prepareLongRangeCorrection(const CustomNonbondedForce& force);
+    /**
+     * Compute the long range correction coefficient (and its derivatives) using data previously computed
+     * by prepareLongRangeCorrection().  Results are cached based on the values of the global parameters, so
+     * returning to a previous set of values (such as a lambda value used earlier) does not require the
+     * integrals to be recomputed.
+     *
+     * @param threads   if not NULL, the integrals for different pairs of classes are computed in parallel
+     *                  on this ThreadPool
+     */
+    static void calcLongRangeCorrection(const CustomNonbondedForce& force, LongRangeCorrectionData& data, const Context& context,
+            double& coefficient, std::vector<double>& derivatives, ThreadPool* threads=NULL);
 private:
     static double integrateInteraction(Lepton::CompiledExpression& expression, const std::vector<double>& params1, const std::vector<double>& params2,
             const CustomNonbondedForce& force, const Context& context, const std::vector<std::string>& paramNames);
@@ -74,6 +99,20 @@ private:
     Kernel kernel;
 };
 
+/**
+ * This class stores the information computed by prepareLongRangeCorrection().
+ */
+class CustomNonbondedForceImpl::LongRangeCorrectionData {
+public:
+    LongRangeCorrectionData() : numParticles(0) {
+    }
+    int numParticles;
+    std::vector<std::vector<double> > classes;
+    std::vector<std::pair<int, int> > classPairs;
+    std::vector<long long int> classPairCounts;
+    std::map<std::vector<double>, std::pair<double, std::vector<double> > > cache;
+};
+
 } // namespace OpenMM
 
 #endif /*OPENMM_CUSTOMNONBONDEDFORCEIMPL_H_*/
@@ -83,6 +83,13 @@ public:
      * @deprecated This version exists for backward compatibility.  Subclasses should implement the other version instead.
      */
     virtual void updateContextState(ContextImpl& context);
+    /**
+     * Get whether updateContextState() ever needs to be called.  ForceImpls whose updateContextState()
+     * does nothing should override this to return false, so ContextImpl can skip them at every time step.
+     */
+    virtual bool updatesContextState() const {
+        return true;
+    }
     /**
      * Calculate the force on each particle generated by this ForceImpl and/or this ForceImpl's
      * contribution to the potential energy of the system.
@@ -96,6 +103,19 @@ public:
      * force does not contribute to potential energy (or if includeEnergy is false)
      */
     virtual double calcForcesAndEnergy(ContextImpl& context, bool includeForces, bool includeEnergy, int groups) = 0;
+    /**
+     * This is called by ContextImpl::calcForcesAndEnergy() before it begins computing forces.  A ForceImpl
+     * that needs to evaluate force groups it has reserved (see ContextImpl::reserveForceGroup()) should do it
+     * here, since that cannot be done while the main computation is in progress.  The default implementation
+     * does nothing.
+     *
+     * @param context        the context in which the system is being simulated
+     * @param includeForces  true if forces will be calculated
+     * @param includeEnergy  true if the energy will be calculated
+     * @param groups         a set of bit flags for which force groups will be included
+     */
+    virtual void prepareForcesAndEnergy(ContextImpl& context, bool includeForces, bool includeEnergy, int groups) {
+    }
     /**
      * Get a map containing the default values for all adjustable parameters defined by this ForceImpl.  These
      * parameters and their default values will automatically be added to the Context.
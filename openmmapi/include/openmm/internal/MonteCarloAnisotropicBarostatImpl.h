@@ -50,7 +50,7 @@ public:
     const MonteCarloAnisotropicBarostat& getOwner() const {
         return owner;
     }
-    void updateContextState(ContextImpl& context);
+    void updateContextState(ContextImpl& context, bool& forcesInvalid);
     double calcForcesAndEnergy(ContextImpl& context, bool includeForces, bool includeEnergy, int groups) {
         // This force doesn't apply forces to particles.
         return 0.0;
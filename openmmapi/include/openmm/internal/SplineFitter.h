@@ -37,6 +37,8 @@
 
 namespace OpenMM {
 
+class ThreadPool;
+
 /**
  * SplineFitter provides routines for performing cubic spline interpolation.
  */
@@ -216,7 +218,24 @@ public:
      */
     static void evaluate3DSplineDerivatives(const std::vector<double>& x, const std::vector<double>& y, const std::vector<double>& z, const std::vector<double>& values, const std::vector<std::vector<double> >& c, double u, double v, double w, double& dx, double& dy, double &dz);
 private:
+    /**
+     * Evaluate the first derivative of a natural or periodic spline at one of its data points.
+     *
+     * @param x      the values of the independent variable at the data points
+     * @param y      the values of the dependent variable at the data points
+     * @param deriv  the vector of second derivatives that was calculated by createSpline()
+     * @param k      the index of the data point at which to evaluate the derivative
+     */
+    static double evaluateDerivativeAtKnot(const std::vector<double>& x, const std::vector<double>& y, const std::vector<double>& deriv, int k);
     static void solveTridiagonalMatrix(const std::vector<double>& a, const std::vector<double>& b, const std::vector<double>& c, const std::vector<double>& rhs, std::vector<double>& sol);
+    /**
+     * Fit a 1D spline along every line of a grid that runs parallel to one axis, and store the first
+     * derivative at each grid point.  Line (a, b) starts at element a*stride1+b*stride2, and consecutive
+     * points along it are separated by stride.  If threads is not NULL, the lines are divided between
+     * its threads.
+     */
+    static void computeAxisDerivatives(ThreadPool* threads, const std::vector<double>& knots, bool periodic, const std::vector<double>& input,
+            std::vector<double>& output, int stride, int count1, int stride1, int count2, int stride2);
 };
 
 } // namespace OpenMM
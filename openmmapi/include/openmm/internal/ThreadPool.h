@@ -34,6 +34,7 @@
 
 #define NOMINMAX
 #include "windowsExport.h"
+#include <atomic>
 #include <functional>
 #include <pthread.h>
 #include <vector>
@@ -74,6 +75,30 @@ public:
      * Execute a function in parallel on the worker threads.
      */
     void execute(std::function<void (ThreadPool&, int)> task);
+    /**
+     * Execute a function in parallel over the range of indices [0, numIndices).  Rather than dividing
+     * the range evenly between threads in advance, each thread repeatedly claims the next block of
+     * chunkSize indices from a shared counter until none are left.  Threads that finish early therefore
+     * keep taking work, which balances the load when the cost varies between indices or some cores are
+     * slower than others.  As with the other forms of execute(), call waitForThreads() to block until
+     * the work is done.
+     *
+     * @param numIndices  the number of indices to process
+     * @param chunkSize   the number of consecutive indices a thread claims at once
+     * @param task        the function to invoke on each block.  It is passed the ThreadPool, the index of
+     *                    the thread, and the first and last+1 indices of the block.
+     */
+    void execute(int numIndices, int chunkSize, std::function<void (ThreadPool&, int, int, int)> task);
+    /**
+     * Bind each worker thread to a single logical CPU core, so the operating system does not migrate
+     * it between cores or sockets.  Thread i is assigned to the i'th core the process is allowed to run
+     * on, wrapping around if there are more threads than cores.  Memory that a thread touches first is
+     * then allocated on its own NUMA node and stays local for the life of the pool.  This is only
+     * supported on Linux.
+     *
+     * @return true if every thread was pinned successfully, false otherwise
+     */
+    bool pinThreadsToCores();
     /**
      * This is called by the worker threads to block until all threads have reached the same point
      * and the master thread instructs them to continue by calling resumeThreads().
@@ -97,6 +122,7 @@ private:
     pthread_mutex_t lock;
     Task* currentTask;
     std::function<void (ThreadPool& pool, int)> currentFunction;
+    std::atomic<int> nextIndex;
 };
 
 /**
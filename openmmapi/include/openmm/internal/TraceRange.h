@@ -0,0 +1,98 @@
+#ifndef OPENMM_TRACERANGE_H_
+#define OPENMM_TRACERANGE_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2026 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+/**
+ * This header defines the OPENMM_TRACE_RANGE macro for marking a region of code so that it appears as
+ * a named range in profiler timelines.  The range begins where the macro appears and ends when the
+ * enclosing scope exits.  For example,
+ *
+ *     void ComputeContext::reorderAtoms() {
+ *         OPENMM_TRACE_RANGE("reorderAtoms");
+ *         ...
+ *
+ * Annotations are only compiled in when OpenMM is built with OPENMM_USE_NVTX (for Nsight Systems) or
+ * OPENMM_USE_ITT (for VTune).  Otherwise the macro expands to nothing and has no cost.
+ */
+
+#if defined(OPENMM_USE_NVTX) || defined(OPENMM_USE_ITT)
+
+#ifdef OPENMM_USE_NVTX
+    #include <nvtx3/nvToolsExt.h>
+#endif
+#ifdef OPENMM_USE_ITT
+    #include <ittnotify.h>
+#endif
+
+namespace OpenMM {
+
+class TraceRange {
+public:
+    explicit TraceRange(const char* name) {
+#ifdef OPENMM_USE_NVTX
+        nvtxRangePushA(name);
+#endif
+#ifdef OPENMM_USE_ITT
+        __itt_task_begin(getDomain(), __itt_null, __itt_null, __itt_string_handle_create(name));
+#endif
+    }
+    ~TraceRange() {
+#ifdef OPENMM_USE_NVTX
+        nvtxRangePop();
+#endif
+#ifdef OPENMM_USE_ITT
+        __itt_task_end(getDomain());
+#endif
+    }
+private:
+#ifdef OPENMM_USE_ITT
+    static __itt_domain* getDomain() {
+        static __itt_domain* domain = __itt_domain_create("OpenMM");
+        return domain;
+    }
+#endif
+};
+
+} // namespace OpenMM
+
+#define OPENMM_TRACE_RANGE_NAME2(line) openmmTraceRange##line
+#define OPENMM_TRACE_RANGE_NAME(line) OPENMM_TRACE_RANGE_NAME2(line)
+#define OPENMM_TRACE_RANGE(name) OpenMM::TraceRange OPENMM_TRACE_RANGE_NAME(__LINE__)(name)
+
+#else
+
+#define OPENMM_TRACE_RANGE(name)
+
+#endif
+
+#endif /*OPENMM_TRACERANGE_H_*/
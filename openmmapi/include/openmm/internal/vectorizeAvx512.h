@@ -0,0 +1,395 @@
+#ifndef OPENMM_VECTORIZE_AVX512_H_
+#define OPENMM_VECTORIZE_AVX512_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2021 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "vectorize.h"
+#include <immintrin.h>
+
+// This file defines classes and functions to simplify vectorizing code with AVX-512.
+
+bool isAvx512Supported() {
+    // Provide our own implementation of CPUID, for the same reasons as in isAvx2Supported().
+#if !(defined(_WIN32) || defined(WIN32))
+    auto cpuid = [](int output[4], int functionnumber) {
+        int a, b, c, d;
+        __asm("cpuid" : "=a"(a),"=b"(b),"=c"(c),"=d"(d) : "a"(functionnumber), "c"(0) : );
+        output[0] = a;
+        output[1] = b;
+        output[2] = c;
+        output[3] = d;
+    };
+    auto xgetbv = []() {
+        unsigned int a, d;
+        __asm("xgetbv" : "=a"(a),"=d"(d) : "c"(0) : );
+        return (long long) a | ((long long) d << 32);
+    };
+#else
+    auto xgetbv = []() {
+        return (long long) _xgetbv(0);
+    };
+#endif
+
+    // The CPU must support AVX512F, and the operating system must save the
+    // opmask and ZMM registers on context switches.
+
+    int cpuInfo[4];
+    cpuid(cpuInfo, 0);
+    if (cpuInfo[0] < 7)
+        return false;
+    cpuid(cpuInfo, 1);
+    if ((cpuInfo[2] & ((int) 1 << 27)) == 0)
+        return false;
+    if ((xgetbv() & 0xE6) != 0xE6)
+        return false;
+    cpuInfo[2] = 0;
+    cpuid(cpuInfo, 7);
+    return ((cpuInfo[1] & ((int) 1 << 16)) != 0);
+}
+
+class ivec16;
+
+/**
+ * A sixteen element vector of floats.  Masks produced by comparisons are stored as
+ * vectors with all bits set in the selected elements, the same as for fvec8, so the
+ * same code can be used with both.  Only AVX512F instructions are used.
+ */
+class fvec16 {
+public:
+    __m512 val;
+
+    fvec16() = default;
+    fvec16(float v) : val(_mm512_set1_ps(v)) {}
+    fvec16(__m512 v) : val(v) {}
+    fvec16(const float* v) : val(_mm512_loadu_ps(v)) {}
+
+    /** Create a vector by gathering individual indexes of data from a table. Element i of the vector will
+     * be loaded from table[idx[i]].
+     * @param table The table from which to do a lookup.
+     * @param indexes The indexes to gather.
+     */
+    fvec16(const float* table, const int32_t idx[16])
+        : val(_mm512_i32gather_ps(_mm512_loadu_si512(idx), table, 4)) {}
+
+    operator __m512() const {
+        return val;
+    }
+    void store(float* v) const {
+        _mm512_storeu_ps(v, val);
+    }
+    fvec16 operator+(fvec16 other) const {
+        return _mm512_add_ps(val, other);
+    }
+    fvec16 operator-(fvec16 other) const {
+        return _mm512_sub_ps(val, other);
+    }
+    fvec16 operator*(fvec16 other) const {
+        return _mm512_mul_ps(val, other);
+    }
+    fvec16 operator/(fvec16 other) const {
+        return _mm512_div_ps(val, other);
+    }
+    void operator+=(fvec16 other) {
+        val = _mm512_add_ps(val, other);
+    }
+    void operator-=(fvec16 other) {
+        val = _mm512_sub_ps(val, other);
+    }
+    void operator*=(fvec16 other) {
+        val = _mm512_mul_ps(val, other);
+    }
+    void operator/=(fvec16 other) {
+        val = _mm512_div_ps(val, other);
+    }
+    fvec16 operator-() const {
+        return _mm512_sub_ps(_mm512_set1_ps(0.0f), val);
+    }
+    fvec16 operator&(fvec16 other) const {
+        return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(val), _mm512_castps_si512(other)));
+    }
+    fvec16 operator|(fvec16 other) const {
+        return _mm512_castsi512_ps(_mm512_or_si512(_mm512_castps_si512(val), _mm512_castps_si512(other)));
+    }
+    fvec16 operator==(fvec16 other) const {
+        return fromMask(_mm512_cmp_ps_mask(val, other, _CMP_EQ_OQ));
+    }
+    fvec16 operator!=(fvec16 other) const {
+        return fromMask(_mm512_cmp_ps_mask(val, other, _CMP_NEQ_OQ));
+    }
+    fvec16 operator>(fvec16 other) const {
+        return fromMask(_mm512_cmp_ps_mask(val, other, _CMP_GT_OQ));
+    }
+    fvec16 operator<(fvec16 other) const {
+        return fromMask(_mm512_cmp_ps_mask(val, other, _CMP_LT_OQ));
+    }
+    fvec16 operator>=(fvec16 other) const {
+        return fromMask(_mm512_cmp_ps_mask(val, other, _CMP_GE_OQ));
+    }
+    fvec16 operator<=(fvec16 other) const {
+        return fromMask(_mm512_cmp_ps_mask(val, other, _CMP_LE_OQ));
+    }
+    operator ivec16() const;
+
+    /**
+     * Get the 128 bit lane with the specified index (0 to 3) as an fvec4.
+     */
+    template <int LANE>
+    fvec4 lane() const {
+        return _mm512_extractf32x4_ps(val, LANE);
+    }
+
+    /**
+     * Convert an AVX-512 mask register into a vector that has all bits set in the
+     * selected elements.
+     */
+    static fvec16 fromMask(__mmask16 mask) {
+        return _mm512_castsi512_ps(_mm512_maskz_mov_epi32(mask, _mm512_set1_epi32(-1)));
+    }
+
+    /**
+     * Convert a vector produced by a comparison into an AVX-512 mask register.
+     */
+    __mmask16 toMask() const {
+        return _mm512_test_epi32_mask(_mm512_castps_si512(val), _mm512_castps_si512(val));
+    }
+
+    /**
+     * Convert an integer bitmask into a full vector of elements which can be used
+     * by the blend function.
+     */
+    static fvec16 expandBitsToMask(int bitmask) {
+        return fromMask((__mmask16) bitmask);
+    }
+};
+
+/**
+ * A sixteen element vector of ints.
+ */
+class ivec16 {
+public:
+    __m512i val;
+
+    ivec16() {}
+    ivec16(int v) : val(_mm512_set1_epi32(v)) {}
+    ivec16(__m512i v) : val(v) {}
+    ivec16(const int* v) : val(_mm512_loadu_si512(v)) {}
+    operator __m512i() const {
+        return val;
+    }
+    void store(int* v) const {
+        _mm512_storeu_si512(v, val);
+    }
+    ivec16 operator&(ivec16 other) const {
+        return _mm512_and_si512(val, other.val);
+    }
+    ivec16 operator|(ivec16 other) const {
+        return _mm512_or_si512(val, other.val);
+    }
+    operator fvec16() const;
+};
+
+// Conversion operators.
+
+inline fvec16::operator ivec16() const {
+    return _mm512_cvttps_epi32(val);
+}
+
+inline ivec16::operator fvec16() const {
+    return _mm512_cvtepi32_ps(val);
+}
+
+// Functions that operate on fvec16s.
+
+static inline fvec16 floor(fvec16 v) {
+    return fvec16(_mm512_roundscale_ps(v.val, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC));
+}
+
+static inline fvec16 ceil(fvec16 v) {
+    return fvec16(_mm512_roundscale_ps(v.val, _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC));
+}
+
+static inline fvec16 round(fvec16 v) {
+    return fvec16(_mm512_roundscale_ps(v.val, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+}
+
+static inline fvec16 min(fvec16 v1, fvec16 v2) {
+    return fvec16(_mm512_min_ps(v1.val, v2.val));
+}
+
+static inline fvec16 max(fvec16 v1, fvec16 v2) {
+    return fvec16(_mm512_max_ps(v1.val, v2.val));
+}
+
+static inline fvec16 abs(fvec16 v) {
+    return fvec16(_mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(v.val), _mm512_set1_epi32(0x7FFFFFFF))));
+}
+
+static inline fvec16 sqrt(fvec16 v) {
+    return fvec16(_mm512_sqrt_ps(v.val));
+}
+
+static inline fvec16 rsqrt(fvec16 v) {
+    // Initial estimate of rsqrt().
+
+    fvec16 y(_mm512_rsqrt14_ps(v.val));
+
+    // Perform an iteration of Newton refinement.
+
+    fvec16 x2 = v*0.5f;
+    y *= fvec16(1.5f)-x2*y*y;
+    return y;
+}
+
+static inline float reduceAdd(fvec16 v) {
+    fvec4 sum = (v.lane<0>()+v.lane<1>())+(v.lane<2>()+v.lane<3>());
+    return dot4(sum, fvec4(1.0f));
+}
+
+/**
+ * Given a vec4[16] input array, generate 4 vec16 outputs. The first output contains all the first elements
+ * the second output the second elements, and so on.
+ */
+static inline void transpose(const fvec4 in[16], fvec16& out1, fvec16& out2, fvec16& out3, fvec16& out4) {
+    fvec4 t[16];
+    for (int i = 0; i < 16; i++)
+        t[i] = in[i];
+    for (int i = 0; i < 16; i += 4)
+        _MM_TRANSPOSE4_PS(t[i].val, t[i+1].val, t[i+2].val, t[i+3].val);
+    __m512 o[4];
+    for (int i = 0; i < 4; i++) {
+        __m512 v = _mm512_castps128_ps512(t[i]);
+        v = _mm512_insertf32x4(v, t[i+4], 1);
+        v = _mm512_insertf32x4(v, t[i+8], 2);
+        o[i] = _mm512_insertf32x4(v, t[i+12], 3);
+    }
+    out1 = o[0];
+    out2 = o[1];
+    out3 = o[2];
+    out4 = o[3];
+}
+
+/**
+ * Given 4 input vectors of 16 elements, transpose them to form 16 output vectors of 4 elements.
+ */
+static inline void transpose(fvec16 in1, fvec16 in2, fvec16 in3, fvec16 in4, fvec4 out[16]) {
+    out[0] = in1.lane<0>();
+    out[1] = in2.lane<0>();
+    out[2] = in3.lane<0>();
+    out[3] = in4.lane<0>();
+    out[4] = in1.lane<1>();
+    out[5] = in2.lane<1>();
+    out[6] = in3.lane<1>();
+    out[7] = in4.lane<1>();
+    out[8] = in1.lane<2>();
+    out[9] = in2.lane<2>();
+    out[10] = in3.lane<2>();
+    out[11] = in4.lane<2>();
+    out[12] = in1.lane<3>();
+    out[13] = in2.lane<3>();
+    out[14] = in3.lane<3>();
+    out[15] = in4.lane<3>();
+    for (int i = 0; i < 16; i += 4)
+        _MM_TRANSPOSE4_PS(out[i].val, out[i+1].val, out[i+2].val, out[i+3].val);
+}
+
+static inline bool any(fvec16 v) {
+    return (v.toMask() != 0);
+}
+
+// Functions that operate on ivec16s.
+
+static inline bool any(ivec16 v) {
+    return (_mm512_test_epi32_mask(v, v) != 0);
+}
+
+// Mathematical operators involving a scalar and a vector.
+
+static inline fvec16 operator+(float v1, fvec16 v2) {
+    return fvec16(v1)+v2;
+}
+
+static inline fvec16 operator-(float v1, fvec16 v2) {
+    return fvec16(v1)-v2;
+}
+
+static inline fvec16 operator*(float v1, fvec16 v2) {
+    return fvec16(v1)*v2;
+}
+
+static inline fvec16 operator/(float v1, fvec16 v2) {
+    return fvec16(v1)/v2;
+}
+
+// Operation for blending fvec16 from a full bitmask.
+static inline fvec16 blend(fvec16 v1, fvec16 v2, fvec16 mask) {
+    return fvec16(_mm512_mask_blend_ps(mask.toMask(), v1.val, v2.val));
+}
+
+static inline fvec16 blendZero(fvec16 v, fvec16 mask) {
+    return fvec16(_mm512_maskz_mov_ps(mask.toMask(), v.val));
+}
+
+/**
+ * Given a table of floating-point values and a set of indexes, perform a gather read into a pair
+ * of vectors. The first result vector contains the values at the given indexes, and the second
+ * result vector contains the values from each respective index+1.
+ */
+static inline void gatherVecPair(const float* table, ivec16 index, fvec16& out0, fvec16& out1) {
+    // Load each pair of values as a single 64 bit element, then separate the first and
+    // second values of every pair.
+
+    const double* tableAsDbl = (const double*) table;
+    const __m256i lowerIdx = _mm512_castsi512_si256(index);
+    const __m256i upperIdx = _mm256_castpd_si256(_mm512_extractf64x4_pd(_mm512_castsi512_pd(index), 1));
+    const __m512 lowerGather = _mm512_castpd_ps(_mm512_i32gather_pd(lowerIdx, tableAsDbl, 4));
+    const __m512 upperGather = _mm512_castpd_ps(_mm512_i32gather_pd(upperIdx, tableAsDbl, 4));
+    const __m512i evenIdx = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+    const __m512i oddIdx = _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31);
+    out0 = _mm512_permutex2var_ps(lowerGather, evenIdx, upperGather);
+    out1 = _mm512_permutex2var_ps(lowerGather, oddIdx, upperGather);
+}
+
+/**
+ * Given 3 vectors of floating-point data, reduce them to a single 3-element position
+ * value by adding all the elements in each vector.  The fourth element of the result
+ * is undefined.
+ */
+static inline fvec4 reduceToVec3(fvec16 x, fvec16 y, fvec16 z) {
+    fvec4 sx = (x.lane<0>()+x.lane<1>())+(x.lane<2>()+x.lane<3>());
+    fvec4 sy = (y.lane<0>()+y.lane<1>())+(y.lane<2>()+y.lane<3>());
+    fvec4 sz = (z.lane<0>()+z.lane<1>())+(z.lane<2>()+z.lane<3>());
+    fvec4 sw(0.0f);
+    _MM_TRANSPOSE4_PS(sx.val, sy.val, sz.val, sw.val);
+    return (sx+sy)+(sz+sw);
+}
+
+#endif /*OPENMM_VECTORIZE_AVX512_H_*/
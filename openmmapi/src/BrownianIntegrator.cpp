@@ -75,12 +75,18 @@ bool BrownianIntegrator::kineticEnergyRequiresForce() const {
     return false;
 }
 
+bool BrownianIntegrator::reusesForces() const {
+    return true;
+}
+
 void BrownianIntegrator::step(int steps) {
     if (context == NULL)
         throw OpenMMException("This Integrator is not bound to a context!");  
     for (int i = 0; i < steps; ++i) {
         context->updateContextState();
-        context->calcForcesAndEnergy(true, false, getIntegrationForceGroups());
+        if (!context->hasValidForces(getIntegrationForceGroups()))
+            context->calcForcesAndEnergy(true, false, getIntegrationForceGroups());
         kernel.getAs<IntegrateBrownianStepKernel>().execute(*context, *this);
+        context->invalidateForces();
     }
 }
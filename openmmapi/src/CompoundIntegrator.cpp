@@ -77,6 +77,11 @@ void CompoundIntegrator::setCurrentIntegrator(int index) {
     if (index < 0 || index >= integrators.size())
         throw OpenMMException("Illegal index for setCurrentIntegrator()");
     currentIntegrator = index;
+
+    // The previous integrator may have moved particles without marking the forces as invalid.
+
+    if (context != NULL)
+        context->invalidateForces();
 }
 
 double CompoundIntegrator::getStepSize() const {
@@ -104,6 +109,7 @@ void CompoundIntegrator::initialize(ContextImpl& context) {
         throw OpenMMException("CompoundIntegrator must contain at least one Integrator");
     for (int i = 0; i < integrators.size(); i++)
         integrators[i]->initialize(context);
+    this->context = &context;
 }
 
 void CompoundIntegrator::cleanup() {
@@ -129,6 +135,10 @@ double CompoundIntegrator::computeKineticEnergy() {
     return integrators[currentIntegrator]->computeKineticEnergy();
 }
 
+bool CompoundIntegrator::reusesForces() const {
+    return integrators[currentIntegrator]->reusesForces();
+}
+
 void CompoundIntegrator::createCheckpoint(std::ostream& stream) const {
     stream.write((char*) &currentIntegrator, sizeof(int));
     for (int i = 0; i < integrators.size(); i++)
@@ -30,33 +30,38 @@
  * -------------------------------------------------------------------------- */
 
 #include "openmm/Context.h"
+#include "openmm/Force.h"
 #include "openmm/internal/ContextImpl.h"
 #include "openmm/OpenMMException.h"
 #include "openmm/internal/ForceImpl.h"
+#include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <set>
 #include <sstream>
 
 using namespace OpenMM;
 using namespace std;
 
-Context::Context(const System& system, Integrator& integrator, ContextImpl& linked) : properties(linked.getOwner().properties) {
+Context::Context(const System& system, Integrator& integrator, ContextImpl& linked) : properties(linked.getOwner().properties),
+        hasRequestedState(false) {
     // This is used by ContextImpl::createLinkedContext().
     impl = new ContextImpl(*this, system, integrator, &linked.getPlatform(), properties, &linked);
     impl->initialize();
 }
 
-Context::Context(const System& system, Integrator& integrator) : properties(map<string, string>()) {
+Context::Context(const System& system, Integrator& integrator) : properties(map<string, string>()), hasRequestedState(false) {
     impl = new ContextImpl(*this, system, integrator, 0, properties);
     impl->initialize();
 }
 
-Context::Context(const System& system, Integrator& integrator, Platform& platform) : properties(map<string, string>()) {
+Context::Context(const System& system, Integrator& integrator, Platform& platform) : properties(map<string, string>()), hasRequestedState(false) {
     impl = new ContextImpl(*this, system, integrator, &platform, properties);
     impl->initialize();
 }
 
-Context::Context(const System& system, Integrator& integrator, Platform& platform, const map<string, string>& properties) : properties(properties) {
+Context::Context(const System& system, Integrator& integrator, Platform& platform, const map<string, string>& properties) : properties(properties),
+        hasRequestedState(false) {
     impl = new ContextImpl(*this, system, integrator, &platform, properties);
     impl->initialize();
 }
@@ -86,6 +91,30 @@ Platform& Context::getPlatform() {
     return impl->getPlatform();
 }
 
+/**
+ * Translate each molecule so its center lies in the first periodic box.
+ */
+static void enforcePeriodicBoxOnMolecules(vector<Vec3>& positions, const vector<vector<int> >& molecules, const Vec3* periodicBoxSize) {
+    for (auto& mol : molecules) {
+        // Find the molecule center.
+
+        Vec3 center;
+        for (int j : mol)
+            center += positions[j];
+        center *= 1.0/mol.size();
+
+        // Find the displacement to move it into the first periodic box.
+        Vec3 diff;
+        diff += periodicBoxSize[2]*floor(center[2]/periodicBoxSize[2][2]);
+        diff += periodicBoxSize[1]*floor((center[1]-diff[1])/periodicBoxSize[1][1]);
+        diff += periodicBoxSize[0]*floor((center[0]-diff[0])/periodicBoxSize[0][0]);
+
+        // Translate all the particles in the molecule.
+        for (int j : mol)
+            positions[j] -= diff;
+    }
+}
+
 State Context::getState(int types, bool enforcePeriodicBox, int groups) const {
     State::StateBuilder builder(impl->getTime());
     Vec3 periodicBoxSize[3];
@@ -95,6 +124,12 @@ State Context::getState(int types, bool enforcePeriodicBox, int groups) const {
     bool includeEnergy = types&State::Energy;
     bool includeParameterDerivs = types&State::ParameterDerivatives;
     bool needForcesForEnergy = (includeEnergy && getIntegrator().kineticEnergyRequiresForce());
+
+    // Computing forces along with the energy costs little extra.  If they are for the integration force groups
+    // and the integrator reuses them, the next time step does not need to compute them again.
+
+    if (includeEnergy && groups == getIntegrator().getIntegrationForceGroups() && getIntegrator().reusesForces())
+        needForcesForEnergy = true;
     if (includeForces || includeEnergy || includeParameterDerivs) {
         double energy = impl->calcForcesAndEnergy(includeForces || needForcesForEnergy || includeParameterDerivs, includeEnergy, groups);
         if (includeEnergy)
@@ -119,27 +154,8 @@ State Context::getState(int types, bool enforcePeriodicBox, int groups) const {
     if (types&State::Positions) {
         vector<Vec3> positions;
         impl->getPositions(positions);
-        if (enforcePeriodicBox) {
-            const vector<vector<int> >& molecules = impl->getMolecules();
-            for (auto& mol : molecules) {
-                // Find the molecule center.
-
-                Vec3 center;
-                for (int j : mol)
-                    center += positions[j];
-                center *= 1.0/mol.size();
-
-                // Find the displacement to move it into the first periodic box.
-                Vec3 diff;
-                diff += periodicBoxSize[2]*floor(center[2]/periodicBoxSize[2][2]);
-                diff += periodicBoxSize[1]*floor((center[1]-diff[1])/periodicBoxSize[1][1]);
-                diff += periodicBoxSize[0]*floor((center[0]-diff[0])/periodicBoxSize[0][0]);
-
-                // Translate all the particles in the molecule.
-                for (int j : mol)
-                    positions[j] -= diff;
-            }
-        }
+        if (enforcePeriodicBox)
+            enforcePeriodicBoxOnMolecules(positions, impl->getMolecules(), periodicBoxSize);
         builder.setPositions(positions);
     }
     if (types&State::Velocities) {
@@ -153,6 +169,152 @@ State Context::getState(int types, bool enforcePeriodicBox, int groups) const {
     return builder.getState();
 }
 
+double Context::computePotentialEnergy(int groups) const {
+    return impl->calcForcesAndEnergy(false, true, groups);
+}
+
+static int getNumConformations(const System& system, const vector<Vec3>& positions) {
+    int numParticles = system.getNumParticles();
+    if (positions.size()%numParticles != 0)
+        throw OpenMMException("computePotentialEnergies: The number of positions must be a multiple of the number of particles");
+    return positions.size()/numParticles;
+}
+
+vector<double> Context::computePotentialEnergies(const vector<Vec3>& positions, int groups) {
+    int numParticles = getSystem().getNumParticles();
+    int numConformations = getNumConformations(getSystem(), positions);
+    vector<Vec3> originalPositions, conformation(numParticles);
+    bool restorePositions = impl->hasSetPositions;
+    if (restorePositions)
+        impl->getPositions(originalPositions);
+    vector<double> energies(numConformations);
+    for (int i = 0; i < numConformations; i++) {
+        copy(positions.begin()+i*numParticles, positions.begin()+(i+1)*numParticles, conformation.begin());
+        impl->setPositions(conformation);
+        energies[i] = impl->calcForcesAndEnergy(false, true, groups);
+    }
+    if (restorePositions)
+        impl->setPositions(originalPositions);
+    else
+        impl->hasSetPositions = false;
+    return energies;
+}
+
+vector<vector<double> > Context::computePotentialEnergiesByGroup(const vector<Vec3>& positions, int groups) {
+    int numParticles = getSystem().getNumParticles();
+    int numConformations = getNumConformations(getSystem(), positions);
+
+    // Only evaluate the groups that actually contain forces.
+
+    int usedGroups = 0;
+    for (int i = 0; i < getSystem().getNumForces(); i++)
+        usedGroups |= 1<<getSystem().getForce(i).getForceGroup();
+    usedGroups &= groups;
+    vector<Vec3> originalPositions, conformation(numParticles);
+    bool restorePositions = impl->hasSetPositions;
+    if (restorePositions)
+        impl->getPositions(originalPositions);
+    vector<vector<double> > energies(numConformations, vector<double>(32, 0.0));
+    for (int i = 0; i < numConformations; i++) {
+        copy(positions.begin()+i*numParticles, positions.begin()+(i+1)*numParticles, conformation.begin());
+        impl->setPositions(conformation);
+        for (int j = 0; j < 32; j++)
+            if ((usedGroups&(1<<j)) != 0)
+                energies[i][j] = impl->calcForcesAndEnergy(false, true, 1<<j);
+    }
+    if (restorePositions)
+        impl->setPositions(originalPositions);
+    else
+        impl->hasSetPositions = false;
+    return energies;
+}
+
+vector<double> Context::computePotentialEnergiesAtParameters(const vector<map<string, double> >& parameterValues, int groups) {
+    // Find which groups contain forces that depend on the parameters being varied.
+
+    const map<string, double>& currentParameters = impl->getParameters();
+    set<string> varied;
+    for (auto& values : parameterValues)
+        for (auto& param : values) {
+            if (currentParameters.find(param.first) == currentParameters.end())
+                throw OpenMMException("computePotentialEnergiesAtParameters: Invalid parameter name: "+param.first);
+            varied.insert(param.first);
+        }
+    int dependentGroups = 0;
+    for (ForceImpl* force : impl->getForceImpls())
+        for (auto& param : force->getDefaultParameters())
+            if (varied.find(param.first) != varied.end())
+                dependentGroups |= 1<<force->getOwner().getForceGroup();
+    dependentGroups &= groups;
+    int independentGroups = groups & ~dependentGroups;
+
+    // The energy of the independent groups is the same for every set of values.
+
+    double independentEnergy = 0.0;
+    if (independentGroups != 0)
+        independentEnergy = impl->calcForcesAndEnergy(false, true, independentGroups);
+    vector<double> energies(parameterValues.size(), independentEnergy);
+    if (dependentGroups == 0)
+        return energies;
+    map<string, double> originalValues;
+    for (auto& name : varied)
+        originalValues[name] = currentParameters.at(name);
+    for (int i = 0; i < parameterValues.size(); i++) {
+        for (auto& name : varied) {
+            auto value = parameterValues[i].find(name);
+            impl->setParameter(name, value == parameterValues[i].end() ? originalValues[name] : value->second);
+        }
+        energies[i] += impl->calcForcesAndEnergy(false, true, dependentGroups);
+    }
+    for (auto& param : originalValues)
+        impl->setParameter(param.first, param.second);
+    return energies;
+}
+
+void Context::requestStateAsync(int types, bool enforcePeriodicBox) {
+    if ((types & ~(State::Positions | State::Velocities)) != 0)
+        throw OpenMMException("requestStateAsync: Only positions and velocities can be retrieved asynchronously");
+    if (hasRequestedState) {
+        // Discard the previous request.
+
+        vector<Vec3> positions, velocities;
+        impl->finishStateCopy(positions, velocities);
+        hasRequestedState = false;
+    }
+    requestedStateTypes = types;
+    requestedStateEnforcePeriodicBox = enforcePeriodicBox;
+    requestedStateTime = impl->getTime();
+    impl->getPeriodicBoxVectors(requestedStateBoxVectors[0], requestedStateBoxVectors[1], requestedStateBoxVectors[2]);
+    impl->beginStateCopy((types&State::Positions) != 0, (types&State::Velocities) != 0);
+    hasRequestedState = true;
+}
+
+State Context::getRequestedState() {
+    if (!hasRequestedState)
+        throw OpenMMException("getRequestedState: No State has been requested");
+    vector<Vec3> positions, velocities;
+    impl->finishStateCopy(positions, velocities);
+    hasRequestedState = false;
+    State::StateBuilder builder(requestedStateTime);
+    builder.setPeriodicBoxVectors(requestedStateBoxVectors[0], requestedStateBoxVectors[1], requestedStateBoxVectors[2]);
+    if (requestedStateTypes&State::Positions) {
+        if (requestedStateEnforcePeriodicBox)
+            enforcePeriodicBoxOnMolecules(positions, impl->getMolecules(), requestedStateBoxVectors);
+        builder.setPositions(positions);
+    }
+    if (requestedStateTypes&State::Velocities)
+        builder.setVelocities(velocities);
+    return builder.getState();
+}
+
+void Context::getPositionsFloat(vector<float>& positions) {
+    impl->getPositionsFloat(positions);
+}
+
+void Context::getVelocitiesFloat(vector<float>& velocities) {
+    impl->getVelocitiesFloat(velocities);
+}
+
 void Context::setState(const State& state) {
     setTime(state.getTime());
     Vec3 a, b, c;
@@ -204,6 +366,10 @@ void Context::setVelocitiesToTemperature(double temperature, int randomSeed) {
     impl->applyVelocityConstraints(1e-5);
 }
 
+void Context::scaleVelocities(double scale) {
+    impl->scaleVelocities(scale);
+}
+
 const map<string, double>& Context::getParameters() const {
     return impl->getParameters();
 }
@@ -233,24 +399,59 @@ void Context::computeVirtualSites() {
 }
 
 void Context::reinitialize(bool preserveState) {
+    if (preserveState && impl->updateFromSystem())
+        return;
     const System& system = impl->getSystem();
     Integrator& integrator = impl->getIntegrator();
     Platform& platform = impl->getPlatform();
     stringstream checkpoint(ios_base::out | ios_base::in | ios_base::binary);
     if (preserveState)
         createCheckpoint(checkpoint);
+    vector<vector<int> > particleSubsets = impl->getParticleSubsets();
     integrator.cleanup();
     delete impl;
     impl = new ContextImpl(*this, system, integrator, &platform, properties);
     impl->initialize();
-    if (preserveState)
+    for (auto& particles : particleSubsets)
+        impl->createParticleSubset(particles);
+    if (preserveState) {
         loadCheckpoint(checkpoint);
+        impl->recordSystemSnapshot();
+    }
 }
 
 void Context::createCheckpoint(ostream& stream) {
     impl->createCheckpoint(stream);
 }
 
+int Context::createParticleSubset(const vector<int>& particles) {
+    return impl->createParticleSubset(particles);
+}
+
+void Context::getSubsetPositions(int subset, vector<Vec3>& positions) {
+    impl->getSubsetPositions(subset, positions);
+}
+
+void Context::setSubsetPositions(int subset, const vector<Vec3>& positions) {
+    impl->setSubsetPositions(subset, positions);
+}
+
+void Context::saveSnapshot(int slot) {
+    impl->saveSnapshot(slot);
+}
+
+void Context::restoreSnapshot(int slot) {
+    impl->restoreSnapshot(slot);
+}
+
+void Context::createCheckpointAsync(ostream& stream) {
+    impl->createCheckpointAsync(stream);
+}
+
+void Context::waitForCheckpoint() {
+    impl->waitForCheckpoint();
+}
+
 void Context::loadCheckpoint(istream& stream) {
     impl->loadCheckpoint(stream);
 }
@@ -266,3 +467,13 @@ const ContextImpl& Context::getImpl() const {
 const vector<vector<int> >& Context::getMolecules() const {
     return impl->getMolecules();
 }
+
+void Context::setProfilingEnabled(bool enabled) {
+    impl->setProfilingEnabled(enabled);
+}
+
+map<string, double> Context::getPerformanceReport() {
+    map<string, double> report;
+    impl->getPerformanceReport(report);
+    return report;
+}
@@ -36,14 +36,28 @@
 #include "openmm/kernels.h"
 #include "openmm/internal/ForceImpl.h"
 #include "openmm/internal/ContextImpl.h"
+#include "openmm/internal/TraceRange.h"
 #include "openmm/State.h"
 #include "openmm/VirtualSite.h"
 #include "openmm/Context.h"
+#include "openmm/CustomAngleForce.h"
+#include "openmm/CustomBondForce.h"
+#include "openmm/CustomExternalForce.h"
+#include "openmm/CustomNonbondedForce.h"
+#include "openmm/CustomTorsionForce.h"
+#include "openmm/HarmonicAngleForce.h"
+#include "openmm/HarmonicBondForce.h"
+#include "openmm/NonbondedForce.h"
+#include "openmm/PeriodicTorsionForce.h"
+#include "openmm/serialization/SerializationNode.h"
+#include "openmm/serialization/SerializationProxy.h"
 #include <algorithm>
 #include <cmath>
 #include <cstdlib>
 #include <iostream>
 #include <map>
+#include <sstream>
+#include <system_error>
 #include <utility>
 #include <vector>
 #include <string.h>
@@ -55,7 +69,9 @@ const static char CHECKPOINT_MAGIC_BYTES[] = "OpenMM Binary Checkpoint\n";
 
 ContextImpl::ContextImpl(Context& owner, const System& system, Integrator& integrator, Platform* platform, const map<string, string>& properties, ContextImpl* originalContext) :
         owner(owner), system(system), integrator(integrator), hasInitializedForces(false), hasSetPositions(false), integratorIsDeleted(false),
-        lastForceGroups(-1), platform(platform), platformData(NULL) {
+        hasCreatedMinimizeKernel(false), hasCreatedSwapStateKernel(false),
+        hasCreatedParticleSubsetKernel(false), hasCreatedStateSnapshotKernel(false), hasCreatedScaleVelocitiesKernel(false), hasCreatedProfileKernel(false), forcesValid(false), lastForceGroups(-1), reservedForceGroups(0), platform(platform), platformData(NULL), systemSnapshot(NULL),
+        isWritingCheckpoint(false), profilingEnabled(false) {
     int numParticles = system.getNumParticles();
     if (numParticles == 0)
         throw OpenMMException("Cannot create a Context for a System with no particles");
@@ -91,25 +107,6 @@ ContextImpl::ContextImpl(Context& owner, const System& system, Integrator& integ
         constraintAtoms.insert(atoms);
     }
     
-    // Validate the list of properties.
-
-    const vector<string>& platformProperties = platform->getPropertyNames();
-    map<string, string> validatedProperties;
-    for (auto& prop : properties) {
-        string property = prop.first;
-        if (platform->deprecatedPropertyReplacements.find(property) != platform->deprecatedPropertyReplacements.end())
-            property = platform->deprecatedPropertyReplacements[property];
-        bool valid = false;
-        for (auto& p : platformProperties)
-            if (p == property) {
-                valid = true;
-                break;
-            }
-        if (!valid)
-            throw OpenMMException("Illegal property name: "+prop.first);
-        validatedProperties[property] = prop.second;
-    }
-    
     // Find the list of kernels required.
     
     vector<string> kernelNames;
@@ -152,6 +149,26 @@ ContextImpl::ContextImpl(Context& owner, const System& system, Integrator& integ
     for (int i = candidatePlatforms.size()-1; i >= 0; i--) {
         try {
             this->platform = platform = candidatePlatforms[i].second;
+
+            // Validate the list of properties.
+
+            const vector<string>& platformProperties = platform->getPropertyNames();
+            map<string, string> validatedProperties;
+            for (auto& prop : properties) {
+                string property = prop.first;
+                if (platform->deprecatedPropertyReplacements.find(property) != platform->deprecatedPropertyReplacements.end())
+                    property = platform->deprecatedPropertyReplacements[property];
+                bool valid = false;
+                for (auto& p : platformProperties)
+                    if (p == property) {
+                        valid = true;
+                        break;
+                    }
+                if (!valid)
+                    throw OpenMMException("Illegal property name: "+prop.first);
+                validatedProperties[property] = prop.second;
+            }
+
             if (originalContext == NULL)
                 platform->contextCreated(*this, validatedProperties);
             else
@@ -180,18 +197,35 @@ void ContextImpl::initialize() {
     Vec3 periodicBoxVectors[3];
     system.getDefaultPeriodicBoxVectors(periodicBoxVectors[0], periodicBoxVectors[1], periodicBoxVectors[2]);
     updateStateDataKernel.getAs<UpdateStateDataKernel>().setPeriodicBoxVectors(*this, periodicBoxVectors[0], periodicBoxVectors[1], periodicBoxVectors[2]);
+    hasCreatedProfileKernel = platform->supportsKernels(vector<string>(1, ProfileKernel::Name()));
+    if (hasCreatedProfileKernel) {
+        profileKernel = platform->createKernel(ProfileKernel::Name(), *this);
+        profileKernel.getAs<ProfileKernel>().initialize(system);
+    }
     for (size_t i = 0; i < forceImpls.size(); ++i) {
+        if (hasCreatedProfileKernel)
+            profileKernel.getAs<ProfileKernel>().setMemoryOwner(*this, "force"+to_string(i));
         forceImpls[i]->initialize(*this);
         map<string, double> forceParameters = forceImpls[i]->getDefaultParameters();
         parameters.insert(forceParameters.begin(), forceParameters.end());
+        if (forceImpls[i]->updatesContextState())
+            stateUpdateForceImpls.push_back(forceImpls[i]);
     }
+    if (hasCreatedProfileKernel)
+        profileKernel.getAs<ProfileKernel>().setMemoryOwner(*this, "integrator");
     integrator.initialize(*this);
+    if (hasCreatedProfileKernel)
+        profileKernel.getAs<ProfileKernel>().setMemoryOwner(*this, "context");
     updateStateDataKernel.getAs<UpdateStateDataKernel>().setVelocities(*this, vector<Vec3>(system.getNumParticles()));
 }
 
 ContextImpl::~ContextImpl() {
+    if (isWritingCheckpoint)
+        checkpointThread.join();
     for (auto force : forceImpls)
         delete force;
+    if (systemSnapshot != NULL)
+        delete systemSnapshot;
     
     // Make sure all kernels get properly deleted before contextDestroyed() is called.
     
@@ -199,6 +233,12 @@ ContextImpl::~ContextImpl() {
     updateStateDataKernel = Kernel();
     applyConstraintsKernel = Kernel();
     virtualSitesKernel = Kernel();
+    minimizeKernel = Kernel();
+    swapStateKernel = Kernel();
+    particleSubsetKernel = Kernel();
+    stateSnapshotKernel = Kernel();
+    scaleVelocitiesKernel = Kernel();
+    profileKernel = Kernel();
     if (!integratorIsDeleted) {
         // The Context is being deleted before the Integrator, so call cleanup() on it now.
         
@@ -223,6 +263,7 @@ void ContextImpl::getPositions(std::vector<Vec3>& positions) {
 void ContextImpl::setPositions(const std::vector<Vec3>& positions) {
     hasSetPositions = true;
     updateStateDataKernel.getAs<UpdateStateDataKernel>().setPositions(*this, positions);
+    forcesValid = false;
     integrator.stateChanged(State::Positions);
 }
 
@@ -230,11 +271,45 @@ void ContextImpl::getVelocities(std::vector<Vec3>& velocities) {
     updateStateDataKernel.getAs<UpdateStateDataKernel>().getVelocities(*this, velocities);
 }
 
+void ContextImpl::getPositionsFloat(vector<float>& positions) {
+    updateStateDataKernel.getAs<UpdateStateDataKernel>().getPositionsFloat(*this, positions);
+}
+
+void ContextImpl::getVelocitiesFloat(vector<float>& velocities) {
+    updateStateDataKernel.getAs<UpdateStateDataKernel>().getVelocitiesFloat(*this, velocities);
+}
+
+void ContextImpl::beginStateCopy(bool positions, bool velocities) {
+    updateStateDataKernel.getAs<UpdateStateDataKernel>().beginStateCopy(*this, positions, velocities);
+}
+
+void ContextImpl::finishStateCopy(std::vector<Vec3>& positions, std::vector<Vec3>& velocities) {
+    updateStateDataKernel.getAs<UpdateStateDataKernel>().finishStateCopy(*this, positions, velocities);
+}
+
 void ContextImpl::setVelocities(const std::vector<Vec3>& velocities) {
     updateStateDataKernel.getAs<UpdateStateDataKernel>().setVelocities(*this, velocities);
     integrator.stateChanged(State::Velocities);
 }
 
+void ContextImpl::scaleVelocities(double scale) {
+    if (!hasCreatedScaleVelocitiesKernel && platform->supportsKernels(vector<string>(1, ScaleVelocitiesKernel::Name()))) {
+        scaleVelocitiesKernel = platform->createKernel(ScaleVelocitiesKernel::Name(), *this);
+        scaleVelocitiesKernel.getAs<ScaleVelocitiesKernel>().initialize(system);
+        hasCreatedScaleVelocitiesKernel = true;
+    }
+    if (hasCreatedScaleVelocitiesKernel)
+        scaleVelocitiesKernel.getAs<ScaleVelocitiesKernel>().execute(*this, scale);
+    else {
+        vector<Vec3> velocities;
+        updateStateDataKernel.getAs<UpdateStateDataKernel>().getVelocities(*this, velocities);
+        for (Vec3& v : velocities)
+            v *= scale;
+        updateStateDataKernel.getAs<UpdateStateDataKernel>().setVelocities(*this, velocities);
+    }
+    integrator.stateChanged(State::Velocities);
+}
+
 void ContextImpl::getForces(std::vector<Vec3>& forces) {
     updateStateDataKernel.getAs<UpdateStateDataKernel>().getForces(*this, forces);
 }
@@ -253,6 +328,7 @@ void ContextImpl::setParameter(std::string name, double value) {
     if (parameters.find(name) == parameters.end())
         throw OpenMMException("Called setParameter() with invalid parameter name: "+name);
     parameters[name] = value;
+    forcesValid = false;
     integrator.stateChanged(State::Parameters);
 }
 
@@ -272,12 +348,14 @@ void ContextImpl::setPeriodicBoxVectors(const Vec3& a, const Vec3& b, const Vec3
     if (a[0] <= 0.0 || b[1] <= 0.0 || c[2] <= 0.0 || a[0] < 2*fabs(b[0]) || a[0] < 2*fabs(c[0]) || b[1] < 2*fabs(c[1]))
         throw OpenMMException("Periodic box vectors must be in reduced form.");
     updateStateDataKernel.getAs<UpdateStateDataKernel>().setPeriodicBoxVectors(*this, a, b, c);
+    forcesValid = false;
 }
 
 void ContextImpl::applyConstraints(double tol) {
     if (!hasSetPositions)
         throw OpenMMException("Particle positions have not been set");
     applyConstraintsKernel.getAs<ApplyConstraintsKernel>().apply(*this, tol);
+    forcesValid = false;
 }
 
 void ContextImpl::applyVelocityConstraints(double tol) {
@@ -288,40 +366,527 @@ void ContextImpl::applyVelocityConstraints(double tol) {
 
 void ContextImpl::computeVirtualSites() {
     virtualSitesKernel.getAs<VirtualSitesKernel>().computePositions(*this);
+    forcesValid = false;
+}
+
+bool ContextImpl::minimize(double tolerance, int maxIterations) {
+    if (!hasCreatedMinimizeKernel) {
+        if (!platform->supportsKernels(vector<string>(1, MinimizeKernel::Name())))
+            return false;
+        minimizeKernel = platform->createKernel(MinimizeKernel::Name(), *this);
+        minimizeKernel.getAs<MinimizeKernel>().initialize(system);
+        hasCreatedMinimizeKernel = true;
+    }
+    bool minimized = minimizeKernel.getAs<MinimizeKernel>().execute(*this, tolerance, maxIterations);
+
+    // The kernel may have restored positions other than the ones its last force evaluation was for,
+    // for example after a failed line search.
+
+    forcesValid = false;
+    return minimized;
+}
+
+void ContextImpl::swapState(ContextImpl& other, double velocityScale) {
+    if (other.getSystem().getNumParticles() != system.getNumParticles())
+        throw OpenMMException("swapState: The two Contexts must have the same number of particles");
+    if (!hasSetPositions || !other.hasSetPositions)
+        throw OpenMMException("Particle positions have not been set");
+    Vec3 box1[3], box2[3];
+    getPeriodicBoxVectors(box1[0], box1[1], box1[2]);
+    other.getPeriodicBoxVectors(box2[0], box2[1], box2[2]);
+    if (!hasCreatedSwapStateKernel && &other.getPlatform() == platform && platform->supportsKernels(vector<string>(1, SwapStateKernel::Name()))) {
+        swapStateKernel = platform->createKernel(SwapStateKernel::Name(), *this);
+        swapStateKernel.getAs<SwapStateKernel>().initialize(system);
+        hasCreatedSwapStateKernel = true;
+    }
+    bool swapped = false;
+    if (hasCreatedSwapStateKernel && &other.getPlatform() == platform)
+        swapped = swapStateKernel.getAs<SwapStateKernel>().execute(*this, other, velocityScale);
+    if (!swapped) {
+        // Copy the data through the host.
+
+        vector<Vec3> pos1, pos2, vel1, vel2;
+        getPositions(pos1);
+        getVelocities(vel1);
+        other.getPositions(pos2);
+        other.getVelocities(vel2);
+        for (Vec3& v : vel1)
+            v /= velocityScale;
+        for (Vec3& v : vel2)
+            v *= velocityScale;
+        updateStateDataKernel.getAs<UpdateStateDataKernel>().setPositions(*this, pos2);
+        updateStateDataKernel.getAs<UpdateStateDataKernel>().setVelocities(*this, vel2);
+        other.updateStateDataKernel.getAs<UpdateStateDataKernel>().setPositions(other, pos1);
+        other.updateStateDataKernel.getAs<UpdateStateDataKernel>().setVelocities(other, vel1);
+    }
+    setPeriodicBoxVectors(box2[0], box2[1], box2[2]);
+    other.setPeriodicBoxVectors(box1[0], box1[1], box1[2]);
+    integrator.stateChanged(State::Positions);
+    integrator.stateChanged(State::Velocities);
+    other.integrator.stateChanged(State::Positions);
+    other.integrator.stateChanged(State::Velocities);
+}
+
+int ContextImpl::createParticleSubset(const vector<int>& particles) {
+    int numParticles = system.getNumParticles();
+    vector<bool> inSubset(numParticles, false);
+    for (int particle : particles) {
+        if (particle < 0 || particle >= numParticles)
+            throw OpenMMException("createParticleSubset: Illegal particle index: "+to_string(particle));
+        if (inSubset[particle])
+            throw OpenMMException("createParticleSubset: A particle appears in the subset more than once: "+to_string(particle));
+        inSubset[particle] = true;
+    }
+    particleSubsets.push_back(particles);
+    if (!hasCreatedParticleSubsetKernel && platform->supportsKernels(vector<string>(1, ParticleSubsetKernel::Name()))) {
+        particleSubsetKernel = platform->createKernel(ParticleSubsetKernel::Name(), *this);
+        particleSubsetKernel.getAs<ParticleSubsetKernel>().initialize(system);
+        hasCreatedParticleSubsetKernel = true;
+    }
+    if (hasCreatedParticleSubsetKernel)
+        particleSubsetKernel.getAs<ParticleSubsetKernel>().addSubset(*this, particles);
+    return particleSubsets.size()-1;
+}
+
+void ContextImpl::getSubsetPositions(int subset, vector<Vec3>& positions) {
+    if (subset < 0 || subset >= particleSubsets.size())
+        throw OpenMMException("getSubsetPositions: Illegal subset index");
+    if (hasCreatedParticleSubsetKernel) {
+        particleSubsetKernel.getAs<ParticleSubsetKernel>().getPositions(*this, subset, positions);
+        return;
+    }
+
+    // Copy all positions and select the ones in the subset.
+
+    const vector<int>& particles = particleSubsets[subset];
+    vector<Vec3> allPositions;
+    getPositions(allPositions);
+    positions.resize(particles.size());
+    for (int i = 0; i < particles.size(); i++)
+        positions[i] = allPositions[particles[i]];
+}
+
+void ContextImpl::setSubsetPositions(int subset, const vector<Vec3>& positions) {
+    if (subset < 0 || subset >= particleSubsets.size())
+        throw OpenMMException("setSubsetPositions: Illegal subset index");
+    const vector<int>& particles = particleSubsets[subset];
+    if (positions.size() != particles.size())
+        throw OpenMMException("setSubsetPositions: Wrong number of positions");
+    if (hasCreatedParticleSubsetKernel)
+        particleSubsetKernel.getAs<ParticleSubsetKernel>().setPositions(*this, subset, positions);
+    else {
+        // Copy all positions, modify the ones in the subset, and copy them back.
+
+        vector<Vec3> allPositions;
+        getPositions(allPositions);
+        for (int i = 0; i < particles.size(); i++)
+            allPositions[particles[i]] = positions[i];
+        updateStateDataKernel.getAs<UpdateStateDataKernel>().setPositions(*this, allPositions);
+    }
+    forcesValid = false;
+    integrator.stateChanged(State::Positions);
+}
+
+void ContextImpl::saveSnapshot(int slot) {
+    if (slot < 0)
+        throw OpenMMException("saveSnapshot: Illegal slot index");
+    if (!hasSetPositions)
+        throw OpenMMException("Particle positions have not been set");
+    if (!hasCreatedStateSnapshotKernel && platform->supportsKernels(vector<string>(1, StateSnapshotKernel::Name()))) {
+        stateSnapshotKernel = platform->createKernel(StateSnapshotKernel::Name(), *this);
+        stateSnapshotKernel.getAs<StateSnapshotKernel>().initialize(system);
+        hasCreatedStateSnapshotKernel = true;
+    }
+    StateSnapshot& snapshot = stateSnapshots[slot];
+    getPeriodicBoxVectors(snapshot.periodicBoxVectors[0], snapshot.periodicBoxVectors[1], snapshot.periodicBoxVectors[2]);
+    snapshot.parameters = parameters;
+    snapshot.time = getTime();
+    if (hasCreatedStateSnapshotKernel)
+        stateSnapshotKernel.getAs<StateSnapshotKernel>().save(*this, slot);
+    else {
+        getPositions(snapshot.positions);
+        getVelocities(snapshot.velocities);
+    }
+}
+
+void ContextImpl::restoreSnapshot(int slot) {
+    auto snapshot = stateSnapshots.find(slot);
+    if (snapshot == stateSnapshots.end())
+        throw OpenMMException("restoreSnapshot: No snapshot has been saved in slot "+to_string(slot));
+    const Vec3* box = snapshot->second.periodicBoxVectors;
+    setPeriodicBoxVectors(box[0], box[1], box[2]);
+    setTime(snapshot->second.time);
+    if (hasCreatedStateSnapshotKernel)
+        stateSnapshotKernel.getAs<StateSnapshotKernel>().restore(*this, slot);
+    else {
+        updateStateDataKernel.getAs<UpdateStateDataKernel>().setPositions(*this, snapshot->second.positions);
+        updateStateDataKernel.getAs<UpdateStateDataKernel>().setVelocities(*this, snapshot->second.velocities);
+    }
+    if (parameters != snapshot->second.parameters) {
+        parameters = snapshot->second.parameters;
+        integrator.stateChanged(State::Parameters);
+    }
+    forcesValid = false;
+    integrator.stateChanged(State::Positions);
+    integrator.stateChanged(State::Velocities);
+}
+
+/**
+ * Determine whether two serialized objects are identical.
+ */
+static bool nodesAreEqual(const SerializationNode& node1, const SerializationNode& node2) {
+    if (node1.getName() != node2.getName() || node1.getProperties() != node2.getProperties())
+        return false;
+    const vector<SerializationNode>& children1 = node1.getChildren();
+    const vector<SerializationNode>& children2 = node2.getChildren();
+    if (children1.size() != children2.size())
+        return false;
+    for (int i = 0; i < children1.size(); i++)
+        if (!nodesAreEqual(children1[i], children2[i]))
+            return false;
+    return true;
+}
+
+/**
+ * Copy the values that updateParametersInContext() is able to change from one Force to another
+ * of the same class.  This returns false if the class is not one it knows about, or if the two
+ * Forces have different numbers of particles or bonds.
+ */
+static bool copyUpdatableParameters(const Force& from, Force& to) {
+    int p1, p2, p3, p4, periodicity;
+    double a, b, c;
+    vector<double> params;
+    if (dynamic_cast<const NonbondedForce*>(&from) != NULL) {
+        const NonbondedForce& f1 = dynamic_cast<const NonbondedForce&>(from);
+        NonbondedForce& f2 = dynamic_cast<NonbondedForce&>(to);
+        if (f1.getNumParticles() != f2.getNumParticles() || f1.getNumExceptions() != f2.getNumExceptions())
+            return false;
+        for (int i = 0; i < f1.getNumParticles(); i++) {
+            f1.getParticleParameters(i, a, b, c);
+            f2.setParticleParameters(i, a, b, c);
+        }
+        for (int i = 0; i < f1.getNumExceptions(); i++) {
+            f1.getExceptionParameters(i, p1, p2, a, b, c);
+            f2.setExceptionParameters(i, p1, p2, a, b, c);
+        }
+        return true;
+    }
+    if (dynamic_cast<const CustomNonbondedForce*>(&from) != NULL) {
+        const CustomNonbondedForce& f1 = dynamic_cast<const CustomNonbondedForce&>(from);
+        CustomNonbondedForce& f2 = dynamic_cast<CustomNonbondedForce&>(to);
+        if (f1.getNumParticles() != f2.getNumParticles())
+            return false;
+        for (int i = 0; i < f1.getNumParticles(); i++) {
+            f1.getParticleParameters(i, params);
+            f2.setParticleParameters(i, params);
+        }
+        return true;
+    }
+    if (dynamic_cast<const HarmonicBondForce*>(&from) != NULL) {
+        const HarmonicBondForce& f1 = dynamic_cast<const HarmonicBondForce&>(from);
+        HarmonicBondForce& f2 = dynamic_cast<HarmonicBondForce&>(to);
+        if (f1.getNumBonds() != f2.getNumBonds())
+            return false;
+        for (int i = 0; i < f1.getNumBonds(); i++) {
+            f1.getBondParameters(i, p1, p2, a, b);
+            f2.setBondParameters(i, p1, p2, a, b);
+        }
+        return true;
+    }
+    if (dynamic_cast<const HarmonicAngleForce*>(&from) != NULL) {
+        const HarmonicAngleForce& f1 = dynamic_cast<const HarmonicAngleForce&>(from);
+        HarmonicAngleForce& f2 = dynamic_cast<HarmonicAngleForce&>(to);
+        if (f1.getNumAngles() != f2.getNumAngles())
+            return false;
+        for (int i = 0; i < f1.getNumAngles(); i++) {
+            f1.getAngleParameters(i, p1, p2, p3, a, b);
+            f2.setAngleParameters(i, p1, p2, p3, a, b);
+        }
+        return true;
+    }
+    if (dynamic_cast<const PeriodicTorsionForce*>(&from) != NULL) {
+        const PeriodicTorsionForce& f1 = dynamic_cast<const PeriodicTorsionForce&>(from);
+        PeriodicTorsionForce& f2 = dynamic_cast<PeriodicTorsionForce&>(to);
+        if (f1.getNumTorsions() != f2.getNumTorsions())
+            return false;
+        for (int i = 0; i < f1.getNumTorsions(); i++) {
+            f1.getTorsionParameters(i, p1, p2, p3, p4, periodicity, a, b);
+            f2.setTorsionParameters(i, p1, p2, p3, p4, periodicity, a, b);
+        }
+        return true;
+    }
+    if (dynamic_cast<const CustomBondForce*>(&from) != NULL) {
+        const CustomBondForce& f1 = dynamic_cast<const CustomBondForce&>(from);
+        CustomBondForce& f2 = dynamic_cast<CustomBondForce&>(to);
+        if (f1.getNumBonds() != f2.getNumBonds())
+            return false;
+        for (int i = 0; i < f1.getNumBonds(); i++) {
+            f1.getBondParameters(i, p1, p2, params);
+            f2.setBondParameters(i, p1, p2, params);
+        }
+        return true;
+    }
+    if (dynamic_cast<const CustomAngleForce*>(&from) != NULL) {
+        const CustomAngleForce& f1 = dynamic_cast<const CustomAngleForce&>(from);
+        CustomAngleForce& f2 = dynamic_cast<CustomAngleForce&>(to);
+        if (f1.getNumAngles() != f2.getNumAngles())
+            return false;
+        for (int i = 0; i < f1.getNumAngles(); i++) {
+            f1.getAngleParameters(i, p1, p2, p3, params);
+            f2.setAngleParameters(i, p1, p2, p3, params);
+        }
+        return true;
+    }
+    if (dynamic_cast<const CustomTorsionForce*>(&from) != NULL) {
+        const CustomTorsionForce& f1 = dynamic_cast<const CustomTorsionForce&>(from);
+        CustomTorsionForce& f2 = dynamic_cast<CustomTorsionForce&>(to);
+        if (f1.getNumTorsions() != f2.getNumTorsions())
+            return false;
+        for (int i = 0; i < f1.getNumTorsions(); i++) {
+            f1.getTorsionParameters(i, p1, p2, p3, p4, params);
+            f2.setTorsionParameters(i, p1, p2, p3, p4, params);
+        }
+        return true;
+    }
+    if (dynamic_cast<const CustomExternalForce*>(&from) != NULL) {
+        const CustomExternalForce& f1 = dynamic_cast<const CustomExternalForce&>(from);
+        CustomExternalForce& f2 = dynamic_cast<CustomExternalForce&>(to);
+        if (f1.getNumParticles() != f2.getNumParticles())
+            return false;
+        for (int i = 0; i < f1.getNumParticles(); i++) {
+            f1.getParticleParameters(i, p1, params);
+            f2.setParticleParameters(i, p1, params);
+        }
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Call updateParametersInContext() on a Force of one of the classes handled by copyUpdatableParameters().
+ */
+static void updateForceInContext(Force& force, Context& context) {
+    if (dynamic_cast<NonbondedForce*>(&force) != NULL)
+        dynamic_cast<NonbondedForce&>(force).updateParametersInContext(context);
+    else if (dynamic_cast<CustomNonbondedForce*>(&force) != NULL)
+        dynamic_cast<CustomNonbondedForce&>(force).updateParametersInContext(context);
+    else if (dynamic_cast<HarmonicBondForce*>(&force) != NULL)
+        dynamic_cast<HarmonicBondForce&>(force).updateParametersInContext(context);
+    else if (dynamic_cast<HarmonicAngleForce*>(&force) != NULL)
+        dynamic_cast<HarmonicAngleForce&>(force).updateParametersInContext(context);
+    else if (dynamic_cast<PeriodicTorsionForce*>(&force) != NULL)
+        dynamic_cast<PeriodicTorsionForce&>(force).updateParametersInContext(context);
+    else if (dynamic_cast<CustomBondForce*>(&force) != NULL)
+        dynamic_cast<CustomBondForce&>(force).updateParametersInContext(context);
+    else if (dynamic_cast<CustomAngleForce*>(&force) != NULL)
+        dynamic_cast<CustomAngleForce&>(force).updateParametersInContext(context);
+    else if (dynamic_cast<CustomTorsionForce*>(&force) != NULL)
+        dynamic_cast<CustomTorsionForce&>(force).updateParametersInContext(context);
+    else if (dynamic_cast<CustomExternalForce*>(&force) != NULL)
+        dynamic_cast<CustomExternalForce&>(force).updateParametersInContext(context);
+    else
+        throw OpenMMException("updateFromSystem: unsupported Force class");
+}
+
+bool ContextImpl::updateFromSystem() {
+    if (systemSnapshot == NULL)
+        return false;
+    SerializationNode* snapshot = new SerializationNode();
+    SerializationProxy::getProxy(typeid(system)).serialize(&system, *snapshot);
+
+    // Everything other than the Forces must be identical.
+
+    vector<int> changedForces;
+    bool canUpdate = (snapshot->getProperties() == systemSnapshot->getProperties() &&
+            snapshot->getChildren().size() == systemSnapshot->getChildren().size());
+    for (int i = 0; canUpdate && i < snapshot->getChildren().size(); i++) {
+        const SerializationNode& child = snapshot->getChildren()[i];
+        const SerializationNode& oldChild = systemSnapshot->getChildren()[i];
+        if (child.getName() != "Forces" || oldChild.getName() != "Forces") {
+            canUpdate = nodesAreEqual(child, oldChild);
+            continue;
+        }
+
+        // Find which Forces have changed, and make sure updateParametersInContext() can apply the changes.
+        // To check that, copy the updatable parameters into a copy of the old Force and see whether that
+        // makes it identical to the new one.
+
+        const vector<SerializationNode>& forces = child.getChildren();
+        const vector<SerializationNode>& oldForces = oldChild.getChildren();
+        if (forces.size() != oldForces.size()) {
+            canUpdate = false;
+            continue;
+        }
+        for (int j = 0; canUpdate && j < forces.size(); j++) {
+            if (nodesAreEqual(forces[j], oldForces[j]))
+                continue;
+            const string& type = forces[j].getStringProperty("type");
+            if (oldForces[j].getStringProperty("type") != type) {
+                canUpdate = false;
+                continue;
+            }
+            Force* oldForce = reinterpret_cast<Force*>(SerializationProxy::getProxy(type).deserialize(oldForces[j]));
+            if (copyUpdatableParameters(system.getForce(j), *oldForce)) {
+                SerializationNode parent;
+                SerializationNode& updated = parent.createChildNode(forces[j].getName(), oldForce);
+                canUpdate = nodesAreEqual(forces[j], updated);
+            }
+            else
+                canUpdate = false;
+            delete oldForce;
+            changedForces.push_back(j);
+        }
+    }
+    if (!canUpdate) {
+        delete snapshot;
+        return false;
+    }
+
+    // Apply the changes.  If any of them fails (for example, because the Platform does not allow a
+    // particular parameter to change), the caller will fall back to a full reinitialization.
+
+    try {
+        for (int index : changedForces)
+            updateForceInContext(const_cast<Force&>(system.getForce(index)), owner);
+    }
+    catch (OpenMMException&) {
+        delete snapshot;
+        return false;
+    }
+    delete systemSnapshot;
+    systemSnapshot = snapshot;
+    return true;
+}
+
+void ContextImpl::recordSystemSnapshot() {
+    if (systemSnapshot != NULL)
+        delete systemSnapshot;
+    systemSnapshot = new SerializationNode();
+    try {
+        SerializationProxy::getProxy(typeid(system)).serialize(&system, *systemSnapshot);
+    }
+    catch (OpenMMException&) {
+        // Some object in the System cannot be serialized, so future changes will always require a full
+        // reinitialization.
+
+        delete systemSnapshot;
+        systemSnapshot = NULL;
+    }
 }
 
 double ContextImpl::calcForcesAndEnergy(bool includeForces, bool includeEnergy, int groups) {
+    OPENMM_TRACE_RANGE("calcForcesAndEnergy");
+    if (!hasSetPositions)
+        throw OpenMMException("Particle positions have not been set");
+    int requestedGroups = groups;
+    groups &= ~reservedForceGroups;
+    for (auto force : forceImpls)
+        force->prepareForcesAndEnergy(*this, includeForces, includeEnergy, groups);
+    lastForceGroups = requestedGroups;
+    forcesValid = false;
+    double energy = computeForceGroups(includeForces, includeEnergy, groups);
+    forcesValid = includeForces;
+    return energy;
+}
+
+int ContextImpl::reserveForceGroup() {
+    int usedGroups = reservedForceGroups;
+    for (int i = 0; i < system.getNumForces(); i++) {
+        const Force& force = system.getForce(i);
+        usedGroups |= 1<<force.getForceGroup();
+        const NonbondedForce* nonbonded = dynamic_cast<const NonbondedForce*>(&force);
+        if (nonbonded != NULL && nonbonded->getReciprocalSpaceForceGroup() >= 0)
+            usedGroups |= 1<<nonbonded->getReciprocalSpaceForceGroup();
+    }
+    for (int i = 31; i >= 0; i--)
+        if ((usedGroups&(1<<i)) == 0) {
+            reservedForceGroups |= 1<<i;
+            return i;
+        }
+    throw OpenMMException("There are no unused force groups left to reserve");
+}
+
+double ContextImpl::calcReservedForcesAndEnergy(bool includeForces, bool includeEnergy, int groups) {
     if (!hasSetPositions)
         throw OpenMMException("Particle positions have not been set");
-    lastForceGroups = groups;
+    if ((groups&~reservedForceGroups) != 0)
+        throw OpenMMException("calcReservedForcesAndEnergy() was called for a force group that has not been reserved");
+    lastForceGroups = -1;
+    forcesValid = false;
+    return computeForceGroups(includeForces, includeEnergy, groups);
+}
+
+double ContextImpl::computeForceGroups(bool includeForces, bool includeEnergy, int groups) {
     CalcForcesAndEnergyKernel& kernel = initializeForcesKernel.getAs<CalcForcesAndEnergyKernel>();
+    ProfileKernel* profiler = NULL;
+    int sharedGroups = 0;
+    if (profilingEnabled) {
+        // Tell the platform which force groups the kernels it launches belong to.  Kernels launched
+        // outside any particular Force are attributed to all the groups being computed.
+
+        profiler = &profileKernel.getAs<ProfileKernel>();
+        for (auto force : forceImpls)
+            sharedGroups |= getProfiledForceGroups(force->getOwner());
+        sharedGroups &= groups;
+    }
     while (true) {
         double energy = 0.0;
+        if (profiler != NULL)
+            profiler->setProfiledForceGroups(*this, sharedGroups);
         kernel.beginComputation(*this, includeForces, includeEnergy, groups);
-        for (auto force : forceImpls)
+        for (auto force : forceImpls) {
+            if (profiler != NULL)
+                profiler->setProfiledForceGroups(*this, getProfiledForceGroups(force->getOwner())&groups);
             energy += force->calcForcesAndEnergy(*this, includeForces, includeEnergy, groups);
+        }
         bool valid = true;
+        if (profiler != NULL)
+            profiler->setProfiledForceGroups(*this, sharedGroups);
         energy += kernel.finishComputation(*this, includeForces, includeEnergy, groups, valid);
+        if (profiler != NULL)
+            profiler->setProfiledForceGroups(*this, 0);
         if (valid)
             return energy;
     }
 }
 
+int ContextImpl::getProfiledForceGroups(const Force& force) {
+    int forceGroups = 1<<force.getForceGroup();
+    const NonbondedForce* nonbonded = dynamic_cast<const NonbondedForce*>(&force);
+    if (nonbonded != NULL && nonbonded->getReciprocalSpaceForceGroup() >= 0)
+        forceGroups |= 1<<nonbonded->getReciprocalSpaceForceGroup();
+    return forceGroups;
+}
+
 int& ContextImpl::getLastForceGroups() {
     return lastForceGroups;
 }
 
+bool ContextImpl::hasValidForces(int groups) const {
+    return forcesValid && lastForceGroups == groups;
+}
+
+void ContextImpl::invalidateForces() {
+    forcesValid = false;
+}
+
 double ContextImpl::calcKineticEnergy() {
     return integrator.computeKineticEnergy();
 }
 
 bool ContextImpl::updateContextState() {
     bool forcesInvalid = false;
-    for (auto force : forceImpls)
+    for (auto force : stateUpdateForceImpls)
         force->updateContextState(*this, forcesInvalid);
+    if (forcesInvalid)
+        forcesValid = false;
     return forcesInvalid;
 }
 
+bool ContextImpl::hasContextStateUpdates() const {
+    return !stateUpdateForceImpls.empty();
+}
+
 const vector<ForceImpl*>& ContextImpl::getForceImpls() const {
     return forceImpls;
 }
@@ -369,60 +934,67 @@ const vector<vector<int> >& ContextImpl::getMolecules() const {
         }
     }
 
-    // Make a list of every other particle to which each particle is connected
-
-    int numParticles = system.getNumParticles();
-    vector<vector<int> > particleBonds(numParticles);
-    for (auto& bond : bonds) {
-        particleBonds[bond.first].push_back(bond.second);
-        particleBonds[bond.second].push_back(bond.first);
-    }
-
     // Now identify particles by which molecule they belong to.
 
-    molecules = findMolecules(numParticles, particleBonds);
+    molecules = findMolecules(system.getNumParticles(), bonds);
     return molecules;
 }
 
 vector<vector<int> > ContextImpl::findMolecules(int numParticles, vector<vector<int> >& particleBonds) {
-    // This is essentially a recursive algorithm, but it is reformulated as a loop to avoid
-    // stack overflows.  It selects a particle, marks it as a new molecule, then recursively
-    // marks every particle bonded to it as also being in that molecule.
-    
-    vector<int> particleMolecule(numParticles, -1);
-    int numMolecules = 0;
+    vector<pair<int, int> > bonds;
     for (int i = 0; i < numParticles; i++)
-        if (particleMolecule[i] == -1) {
-            // Start a new molecule.
-            
-            vector<int> particleStack;
-            vector<int> neighborStack;
-            particleStack.push_back(i);
-            neighborStack.push_back(0);
-            int molecule = numMolecules++;
-            
-            // Recursively tag all the bonded particles.
-            
-            while (particleStack.size() > 0) {
-                int particle = particleStack.back();
-                particleMolecule[particle] = molecule;
-                int& neighbor = neighborStack.back();
-                while (neighbor < particleBonds[particle].size() && particleMolecule[particleBonds[particle][neighbor]] != -1)
-                    neighbor++;
-                if (neighbor < particleBonds[particle].size()) {
-                    particleStack.push_back(particleBonds[particle][neighbor]);
-                    neighborStack.push_back(0);
-                }
-                else {
-                    particleStack.pop_back();
-                    neighborStack.pop_back();
-                }
-            }
+        for (int j : particleBonds[i])
+            if (j > i)
+                bonds.push_back(make_pair(i, j));
+    return findMolecules(numParticles, bonds);
+}
+
+vector<vector<int> > ContextImpl::findMolecules(int numParticles, const vector<pair<int, int> >& bonds) {
+    // Use a union-find structure to merge the sets of particles connected by each bond.  Every set is
+    // represented by a tree whose root is its lowest numbered particle, and paths are halved as they
+    // are traversed, so the total cost is nearly linear in the number of particles and bonds.
+
+    vector<int> parent(numParticles);
+    for (int i = 0; i < numParticles; i++)
+        parent[i] = i;
+    auto findRoot = [&parent] (int particle) {
+        while (parent[particle] != particle) {
+            parent[particle] = parent[parent[particle]];
+            particle = parent[particle];
         }
-    
+        return particle;
+    };
+    for (auto& bond : bonds) {
+        int root1 = findRoot(bond.first);
+        int root2 = findRoot(bond.second);
+        if (root1 < root2)
+            parent[root2] = root1;
+        else if (root2 < root1)
+            parent[root1] = root2;
+    }
+
+    // Number the molecules in order of their lowest particle index, and find how many particles
+    // each one contains.  Since every root is lower than all other particles in its set, a single
+    // pass in increasing order sees each root before any other member.
+
+    vector<int> particleMolecule(numParticles);
+    vector<int> moleculeSize;
+    for (int i = 0; i < numParticles; i++) {
+        int root = findRoot(i);
+        if (root == i) {
+            particleMolecule[i] = moleculeSize.size();
+            moleculeSize.push_back(0);
+        }
+        else
+            particleMolecule[i] = particleMolecule[root];
+        moleculeSize[particleMolecule[i]]++;
+    }
+
     // Build the final output vector.
-    
-    vector<vector<int> > molecules(numMolecules);
+
+    vector<vector<int> > molecules(moleculeSize.size());
+    for (int i = 0; i < (int) molecules.size(); i++)
+        molecules[i].reserve(moleculeSize[i]);
     for (int i = 0; i < numParticles; i++)
         molecules[particleMolecule[i]].push_back(i);
     return molecules;
@@ -458,6 +1030,45 @@ void ContextImpl::createCheckpoint(ostream& stream) {
     stream.flush();
 }
 
+void ContextImpl::createCheckpointAsync(ostream& stream) {
+    // Capturing the state into memory is fast.  Only writing it out is left to the background thread.
+
+    waitForCheckpoint();
+    stringstream buffer(ios_base::out | ios_base::binary);
+    createCheckpoint(buffer);
+    checkpointData = buffer.str();
+    checkpointStream = &stream;
+    try {
+        checkpointThread = thread(&ContextImpl::checkpointThreadBody, this);
+    }
+    catch (const system_error&) {
+        checkpointData.clear();
+        throw OpenMMException("createCheckpointAsync: Unable to create thread");
+    }
+    isWritingCheckpoint = true;
+}
+
+void ContextImpl::waitForCheckpoint() {
+    if (!isWritingCheckpoint)
+        return;
+    checkpointThread.join();
+    isWritingCheckpoint = false;
+    checkpointData.clear();
+    checkpointData.shrink_to_fit();
+    if (checkpointError.size() > 0) {
+        string error = checkpointError;
+        checkpointError.clear();
+        throw OpenMMException(error);
+    }
+}
+
+void ContextImpl::checkpointThreadBody() {
+    checkpointStream->write(checkpointData.data(), checkpointData.size());
+    checkpointStream->flush();
+    if (checkpointStream->fail())
+        checkpointError = "createCheckpointAsync: Error writing checkpoint";
+}
+
 void ContextImpl::loadCheckpoint(istream& stream) {
     static const int magiclength = sizeof(CHECKPOINT_MAGIC_BYTES)/sizeof(CHECKPOINT_MAGIC_BYTES[0]);
     char magicbytes[magiclength];
@@ -483,13 +1094,27 @@ void ContextImpl::loadCheckpoint(istream& stream) {
     updateStateDataKernel.getAs<UpdateStateDataKernel>().loadCheckpoint(*this, stream);
     integrator.loadCheckpoint(stream);
     hasSetPositions = true;
+    forcesValid = false;
     integrator.stateChanged(State::Positions);
     integrator.stateChanged(State::Velocities);
     integrator.stateChanged(State::Parameters);
     integrator.stateChanged(State::Energy);
 }
 
+void ContextImpl::setProfilingEnabled(bool enabled) {
+    profilingEnabled = enabled && hasCreatedProfileKernel;
+    if (hasCreatedProfileKernel)
+        profileKernel.getAs<ProfileKernel>().setProfilingEnabled(*this, enabled);
+}
+
+void ContextImpl::getPerformanceReport(map<string, double>& report) {
+    report.clear();
+    if (hasCreatedProfileKernel)
+        profileKernel.getAs<ProfileKernel>().getPerformanceReport(*this, report);
+}
+
 void ContextImpl::systemChanged() {
+    forcesValid = false;
     integrator.stateChanged(State::Energy);
 }
 
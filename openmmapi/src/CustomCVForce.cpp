@@ -41,7 +41,7 @@
 using namespace OpenMM;
 using namespace std;
 
-CustomCVForce::CustomCVForce(const string& energy) : energyExpression(energy) {
+CustomCVForce::CustomCVForce(const string& energy) : energyExpression(energy), useInnerContext(true) {
 }
 
 CustomCVForce::~CustomCVForce() {
@@ -152,6 +152,14 @@ Context& CustomCVForce::getInnerContext(Context& context) {
     return dynamic_cast<CustomCVForceImpl&>(getImplInContext(context)).getInnerContext();
 }
 
+bool CustomCVForce::getUseInnerContext() const {
+    return useInnerContext;
+}
+
+void CustomCVForce::setUseInnerContext(bool use) {
+    useInnerContext = use;
+}
+
 void CustomCVForce::updateParametersInContext(Context& context) {
     dynamic_cast<CustomCVForceImpl&>(getImplInContext(context)).updateParametersInContext(getContextImpl(context));
 }
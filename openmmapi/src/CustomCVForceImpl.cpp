@@ -42,14 +42,47 @@ using namespace std;
 
 CustomCVForceImpl::CustomCVForceImpl(const CustomCVForce& owner) : owner(owner), innerIntegrator(1.0),
         innerContext(NULL) {
+    if (!owner.getUseInnerContext()) {
+        // The ForceImpls must be created now, so the context knows what kernels they need.
+
+        for (int i = 0; i < owner.getNumCollectiveVariables(); i++) {
+            Force* variable = XmlSerializer::clone<Force>(owner.getCollectiveVariable(i));
+            NonbondedForce* nonbonded = dynamic_cast<NonbondedForce*>(variable);
+            if (nonbonded != NULL)
+                nonbonded->setReciprocalSpaceForceGroup(-1);
+            variableForces.push_back(variable);
+            variableImpls.push_back(variable->createImpl());
+        }
+    }
 }
 
 CustomCVForceImpl::~CustomCVForceImpl() {
     if (innerContext != NULL)
         delete innerContext;
+    for (auto impl : variableImpls)
+        delete impl;
+    for (auto variable : variableForces)
+        delete variable;
 }
 
 void CustomCVForceImpl::initialize(ContextImpl& context) {
+    if (!owner.getUseInnerContext()) {
+        // Add the collective variables to this context, each in a force group of its own.
+
+        int numCVs = variableImpls.size();
+        for (int i = 0; i < numCVs; i++) {
+            variableGroups.push_back(context.reserveForceGroup());
+            variableForces[i]->setForceGroup(variableGroups[i]);
+        }
+        for (auto impl : variableImpls)
+            impl->initialize(context);
+        variableValues.resize(numCVs, 0.0);
+        variableParamDerivs.resize(numCVs);
+        kernel = context.getPlatform().createKernel(CalcCustomCVForceKernel::Name(), context);
+        kernel.getAs<CalcCustomCVForceKernel>().initialize(context.getSystem(), owner);
+        return;
+    }
+
     // Construct the inner system used to evaluate collective variables.
     
     const System& system = context.getSystem();
@@ -79,36 +112,95 @@ void CustomCVForceImpl::initialize(ContextImpl& context) {
     kernel.getAs<CalcCustomCVForceKernel>().initialize(context.getSystem(), owner, getContextImpl(*innerContext));
 }
 
+void CustomCVForceImpl::updateContextState(ContextImpl& context, bool& forcesInvalid) {
+    for (auto impl : variableImpls)
+        impl->updateContextState(context, forcesInvalid);
+}
+
 double CustomCVForceImpl::calcForcesAndEnergy(ContextImpl& context, bool includeForces, bool includeEnergy, int groups) {
+    if (innerContext == NULL) {
+        // The collective variables are evaluated in this context.  This is called once for each reserved
+        // group by prepareForcesAndEnergy(), then once more to apply the chain rule.
+
+        double energy = 0.0;
+        for (int i = 0; i < variableImpls.size(); i++)
+            if ((groups&(1<<variableGroups[i])) != 0)
+                energy += variableImpls[i]->calcForcesAndEnergy(context, includeForces, includeEnergy, groups);
+        if ((groups&(1<<owner.getForceGroup())) != 0)
+            energy += kernel.getAs<CalcCustomCVForceKernel>().execute(context, variableValues, variableParamDerivs, includeForces, includeEnergy);
+        return energy;
+    }
     if ((groups&(1<<owner.getForceGroup())) != 0)
         return kernel.getAs<CalcCustomCVForceKernel>().execute(context, getContextImpl(*innerContext), includeForces, includeEnergy);
     return 0.0;
 }
 
+void CustomCVForceImpl::prepareForcesAndEnergy(ContextImpl& context, bool includeForces, bool includeEnergy, int groups) {
+    if (innerContext != NULL || (groups&(1<<owner.getForceGroup())) == 0)
+        return;
+
+    // Evaluate each collective variable on its own.  The energy is always needed, since the chain rule
+    // factors depend on it.
+
+    CalcCustomCVForceKernel& cvKernel = kernel.getAs<CalcCustomCVForceKernel>();
+    for (int i = 0; i < variableImpls.size(); i++) {
+        variableValues[i] = context.calcReservedForcesAndEnergy(includeForces, true, 1<<variableGroups[i]);
+        context.getEnergyParameterDerivatives(variableParamDerivs[i]);
+        if (includeForces)
+            cvKernel.copyVariableForces(context, i);
+    }
+}
+
 vector<string> CustomCVForceImpl::getKernelNames() {
     vector<string> names;
     names.push_back(CalcCustomCVForceKernel::Name());
+    for (auto impl : variableImpls) {
+        vector<string> variableNames = impl->getKernelNames();
+        names.insert(names.end(), variableNames.begin(), variableNames.end());
+    }
     return names;
 }
 
+vector<pair<int, int> > CustomCVForceImpl::getBondedParticles() const {
+    vector<pair<int, int> > bonds;
+    for (auto impl : variableImpls) {
+        vector<pair<int, int> > variableBonds = impl->getBondedParticles();
+        bonds.insert(bonds.end(), variableBonds.begin(), variableBonds.end());
+    }
+    return bonds;
+}
+
 map<string, double> CustomCVForceImpl::getDefaultParameters() {
     map<string, double> parameters;
-    parameters.insert(innerContext->getParameters().begin(), innerContext->getParameters().end());
+    if (innerContext != NULL)
+        parameters.insert(innerContext->getParameters().begin(), innerContext->getParameters().end());
+    for (auto impl : variableImpls) {
+        map<string, double> variableParameters = impl->getDefaultParameters();
+        parameters.insert(variableParameters.begin(), variableParameters.end());
+    }
     for (int i = 0; i < owner.getNumGlobalParameters(); i++)
         parameters[owner.getGlobalParameterName(i)] = owner.getGlobalParameterDefaultValue(i);
     return parameters;
 }
 
 void CustomCVForceImpl::getCollectiveVariableValues(ContextImpl& context, vector<double>& values) {
+    if (innerContext == NULL) {
+        values.clear();
+        for (int group : variableGroups)
+            values.push_back(context.calcReservedForcesAndEnergy(false, true, 1<<group));
+        return;
+    }
     kernel.getAs<CalcCustomCVForceKernel>().copyState(context, getContextImpl(*innerContext));
     values.clear();
     for (int i = 0; i < innerSystem.getNumForces(); i++) {
-        double value = innerContext->getState(State::Energy, false, 1<<i).getPotentialEnergy();
+        double value = innerContext->computePotentialEnergy(1<<i);
         values.push_back(value);
     }
 }
 
 Context& CustomCVForceImpl::getInnerContext() {
+    if (innerContext == NULL)
+        throw OpenMMException("getInnerContext: This CustomCVForce evaluates its collective variables without an inner Context");
     return *innerContext;
 }
 
@@ -312,3 +312,7 @@ ForceImpl* CustomNonbondedForce::createImpl() const {
 void CustomNonbondedForce::updateParametersInContext(Context& context) {
     dynamic_cast<CustomNonbondedForceImpl&>(getImplInContext(context)).updateParametersInContext(getContextImpl(context));
 }
+
+void CustomNonbondedForce::updateParametersInContext(Context& context, int firstParticle, int lastParticle) {
+    dynamic_cast<CustomNonbondedForceImpl&>(getImplInContext(context)).updateParametersInContext(getContextImpl(context), firstParticle, lastParticle);
+}
@@ -36,6 +36,7 @@
 #include "openmm/internal/ContextImpl.h"
 #include "openmm/internal/CustomNonbondedForceImpl.h"
 #include "openmm/internal/SplineFitter.h"
+#include "openmm/internal/ThreadPool.h"
 #include "openmm/kernels.h"
 #include "ReferenceTabulatedFunction.h"
 #include "lepton/ParsedExpression.h"
@@ -158,16 +159,29 @@ void CustomNonbondedForceImpl::updateParametersInContext(ContextImpl& context) {
     context.systemChanged();
 }
 
-void CustomNonbondedForceImpl::calcLongRangeCorrection(const CustomNonbondedForce& force, const Context& context, double& coefficient, vector<double>& derivatives) {
-    if (force.getNonbondedMethod() == CustomNonbondedForce::NoCutoff || force.getNonbondedMethod() == CustomNonbondedForce::CutoffNonPeriodic) {
-        coefficient = 0.0;
+void CustomNonbondedForceImpl::updateParametersInContext(ContextImpl& context, int firstParticle, int lastParticle) {
+    if (firstParticle < 0 || lastParticle >= owner.getNumParticles())
+        throw OpenMMException("updateParametersInContext: Index out of range");
+    if (lastParticle < firstParticle)
         return;
-    }
+    kernel.getAs<CalcCustomNonbondedForceKernel>().copyParameterRangeToContext(context, owner, firstParticle, lastParticle);
+    context.systemChanged();
+}
+
+void CustomNonbondedForceImpl::calcLongRangeCorrection(const CustomNonbondedForce& force, const Context& context, double& coefficient, vector<double>& derivatives) {
+    LongRangeCorrectionData data = prepareLongRangeCorrection(force);
+    calcLongRangeCorrection(force, data, context, coefficient, derivatives);
+}
+
+CustomNonbondedForceImpl::LongRangeCorrectionData CustomNonbondedForceImpl::prepareLongRangeCorrection(const CustomNonbondedForce& force) {
+    LongRangeCorrectionData data;
+    if (force.getNonbondedMethod() == CustomNonbondedForce::NoCutoff || force.getNonbondedMethod() == CustomNonbondedForce::CutoffNonPeriodic)
+        return data;
     
     // Identify all particle classes (defined by parameters), and record the class of each particle.
     
     int numParticles = force.getNumParticles();
-    vector<vector<double> > classes;
+    vector<vector<double> >& classes = data.classes;
     map<vector<double>, int> classIndex;
     vector<int> atomClass(numParticles);
     vector<double> parameters;
@@ -200,13 +214,6 @@ void CustomNonbondedForceImpl::calcLongRangeCorrection(const CustomNonbondedForc
         }
     }
     else {
-        // Initialize the counts to 0.
-        
-        for (int i = 0; i < numClasses; i++) {
-            for (int j = i; j < numClasses; j++)
-                interactionCount[make_pair(i, j)] = 0;
-        }
-        
         // Loop over interaction groups and count the interactions in each one.
         
         for (int group = 0; group < force.getNumInteractionGroups(); group++) {
@@ -223,14 +230,43 @@ void CustomNonbondedForceImpl::calcLongRangeCorrection(const CustomNonbondedForc
         }
     }
     
+    // Record only the class pairs that actually interact, since only they need integrals.
+    
+    for (auto& count : interactionCount)
+        if (count.second != 0) {
+            data.classPairs.push_back(count.first);
+            data.classPairCounts.push_back(count.second);
+        }
+    data.numParticles = numParticles;
+    return data;
+}
+
+void CustomNonbondedForceImpl::calcLongRangeCorrection(const CustomNonbondedForce& force, LongRangeCorrectionData& data, const Context& context,
+            double& coefficient, vector<double>& derivatives, ThreadPool* threads) {
+    if (force.getNonbondedMethod() == CustomNonbondedForce::NoCutoff || force.getNonbondedMethod() == CustomNonbondedForce::CutoffNonPeriodic) {
+        coefficient = 0.0;
+        return;
+    }
+    
+    // If we have already computed the correction for the current global parameters, reuse it.
+    
+    vector<double> globalValues;
+    for (int i = 0; i < force.getNumGlobalParameters(); i++)
+        globalValues.push_back(context.getParameter(force.getGlobalParameterName(i)));
+    auto cached = data.cache.find(globalValues);
+    if (cached != data.cache.end()) {
+        coefficient = cached->second.first;
+        derivatives = cached->second.second;
+        return;
+    }
+    
     // Compute the coefficient.
     
     map<string, Lepton::CustomFunction*> functions;
     for (int i = 0; i < force.getNumFunctions(); i++)
         functions[force.getTabulatedFunctionName(i)] = createReferenceTabulatedFunction(force.getTabulatedFunction(i));
-    double nPart = (double) numParticles;
+    double nPart = (double) data.numParticles;
     double numInteractions = (nPart*(nPart+1))/2;
-    Lepton::CompiledExpression expression = Lepton::Parser::parse(force.getEnergyFunction(), functions).createCompiledExpression();
     vector<string> paramNames;
     for (int i = 0; i < force.getNumPerParticleParameters(); i++) {
         stringstream name1, name2;
@@ -239,26 +275,58 @@ void CustomNonbondedForceImpl::calcLongRangeCorrection(const CustomNonbondedForc
         paramNames.push_back(name1.str());
         paramNames.push_back(name2.str());
     }
-    double sum = 0;
-    for (int i = 0; i < numClasses; i++)
-        for (int j = i; j < numClasses; j++)
-            sum += interactionCount[make_pair(i, j)]*integrateInteraction(expression, classes[i], classes[j], force, context, paramNames);
-    sum /= numInteractions;
-    coefficient = 2*M_PI*nPart*nPart*sum;
-    
-    // Now do the same for parameter derivatives.
-    
+    Lepton::ParsedExpression energyExpression = Lepton::Parser::parse(force.getEnergyFunction(), functions);
+    for (auto& function : functions)
+        delete function.second;
     int numDerivs = force.getNumEnergyParameterDerivatives();
-    derivatives.resize(numDerivs);
-    for (int k = 0; k < numDerivs; k++) {
-        expression = Lepton::Parser::parse(force.getEnergyFunction(), functions).differentiate(force.getEnergyParameterDerivativeName(k)).createCompiledExpression();
-        sum = 0;
-        for (int i = 0; i < numClasses; i++)
-            for (int j = i; j < numClasses; j++)
-                sum += interactionCount[make_pair(i, j)]*integrateInteraction(expression, classes[i], classes[j], force, context, paramNames);
+    vector<Lepton::ParsedExpression> expressions(1, energyExpression);
+    for (int k = 0; k < numDerivs; k++)
+        expressions.push_back(energyExpression.differentiate(force.getEnergyParameterDerivativeName(k)));
+    vector<double> sums(expressions.size());
+    int numPairs = data.classPairs.size();
+    vector<double> integrals(numPairs);
+    for (int k = 0; k < (int) expressions.size(); k++) {
+        // Evaluate the integral for each pair of classes.  Each thread needs its own CompiledExpression,
+        // since they store the values of variables.
+
+        if (threads == NULL || numPairs < 2) {
+            Lepton::CompiledExpression expression = expressions[k].createCompiledExpression();
+            for (int i = 0; i < numPairs; i++)
+                integrals[i] = integrateInteraction(expression, data.classes[data.classPairs[i].first], data.classes[data.classPairs[i].second], force, context, paramNames);
+        }
+        else {
+            vector<Lepton::CompiledExpression> threadExpressions(threads->getNumThreads());
+            for (auto& expression : threadExpressions)
+                expression = expressions[k].createCompiledExpression();
+            vector<string> errors(threads->getNumThreads());
+            threads->execute(numPairs, 1, [&] (ThreadPool& pool, int threadIndex, int start, int end) {
+                try {
+                    for (int i = start; i < end; i++)
+                        integrals[i] = integrateInteraction(threadExpressions[threadIndex], data.classes[data.classPairs[i].first],
+                                data.classes[data.classPairs[i].second], force, context, paramNames);
+                }
+                catch (exception& ex) {
+                    errors[threadIndex] = ex.what();
+                }
+            });
+            threads->waitForThreads();
+            for (auto& error : errors)
+                if (error.size() > 0)
+                    throw OpenMMException(error);
+        }
+        double sum = 0;
+        for (int i = 0; i < numPairs; i++)
+            sum += data.classPairCounts[i]*integrals[i];
         sum /= numInteractions;
-        derivatives[k] = 2*M_PI*nPart*nPart*sum;
+        sums[k] = 2*M_PI*nPart*nPart*sum;
     }
+    coefficient = sums[0];
+    derivatives.resize(numDerivs);
+    for (int k = 0; k < numDerivs; k++)
+        derivatives[k] = sums[k+1];
+    if (data.cache.size() >= 1000)
+        data.cache.clear(); // The global parameters are being varied continuously, so there is little to gain from caching.
+    data.cache[globalValues] = make_pair(coefficient, derivatives);
 }
 
 double CustomNonbondedForceImpl::integrateInteraction(Lepton::CompiledExpression& expression, const vector<double>& params1, const vector<double>& params2,
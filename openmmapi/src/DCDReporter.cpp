@@ -0,0 +1,215 @@
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2008-2020 Stanford University and the Authors.      *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "openmm/DCDReporter.h"
+#include "openmm/Integrator.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/System.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <system_error>
+
+using namespace OpenMM;
+using namespace std;
+
+template <class T>
+static void writeValue(FILE* file, T value) {
+    fwrite(&value, sizeof(T), 1, file);
+}
+
+DCDReporter::DCDReporter(const string& filename, Context& context, int reportInterval, bool enforcePeriodicBox) :
+        context(context), reportInterval(reportInterval), numFrames(0), numFramesWritten(0), currentStep(0),
+        enforcePeriodicBox(enforcePeriodicBox), isDeleted(false), writingFrame(false) {
+    if (reportInterval < 1)
+        throw OpenMMException("DCDReporter: reportInterval must be positive");
+    const System& system = context.getSystem();
+    numParticles = system.getNumParticles();
+    usePeriodic = system.usesPeriodicBoundaryConditions();
+    file = fopen(filename.c_str(), "wb");
+    if (file == NULL)
+        throw OpenMMException("DCDReporter: Unable to open file "+filename);
+
+    // Write the header.  The time step is given in AKMA units.
+
+    writeValue<int>(file, 84);
+    fwrite("CORD", 1, 4, file);
+    int counts[9] = {0, 0, reportInterval, 0, 0, 0, 0, 0, 0};
+    fwrite(counts, sizeof(int), 9, file);
+    writeValue<float>(file, (float) (context.getIntegrator().getStepSize()/0.04888821));
+    int flags[13] = {usePeriodic ? 1 : 0, 0, 0, 0, 0, 0, 0, 0, 0, 24, 84, 164, 2};
+    fwrite(flags, sizeof(int), 13, file);
+    char title[160];
+    memset(title, 0, sizeof(title));
+    strncpy(title, "Created by OpenMM", 80);
+    time_t now = time(NULL);
+    strftime(title+80, 80, "Created %a %b %d %H:%M:%S %Y", localtime(&now));
+    fwrite(title, 1, 160, file);
+    int atoms[4] = {164, 4, numParticles, 4};
+    fwrite(atoms, sizeof(int), 4, file);
+    if (ferror(file)) {
+        fclose(file);
+        throw OpenMMException("DCDReporter: Error writing to file "+filename);
+    }
+
+    // Start the thread that writes frames to the file.
+
+    try {
+        writerThread = thread(&DCDReporter::writerThreadBody, this);
+    }
+    catch (const system_error&) {
+        fclose(file);
+        throw OpenMMException("DCDReporter: Unable to create writer thread");
+    }
+}
+
+DCDReporter::~DCDReporter() {
+    {
+        lock_guard<mutex> guard(lock);
+        isDeleted = true;
+        frameAvailable.notify_one();
+    }
+    writerThread.join();
+    fclose(file);
+}
+
+void DCDReporter::step(int steps) {
+    // Each frame is requested asynchronously, and only retrieved after the next block
+    // of steps has been taken.
+
+    Integrator& integrator = context.getIntegrator();
+    bool hasRequestedState = false;
+    while (steps > 0) {
+        int stepsToTake = min(steps, reportInterval-currentStep%reportInterval);
+        integrator.step(stepsToTake);
+        steps -= stepsToTake;
+        currentStep += stepsToTake;
+        if (hasRequestedState) {
+            enqueueFrame(context.getRequestedState());
+            hasRequestedState = false;
+        }
+        if (currentStep%reportInterval == 0) {
+            context.requestStateAsync(State::Positions, enforcePeriodicBox);
+            hasRequestedState = true;
+        }
+    }
+    if (hasRequestedState)
+        enqueueFrame(context.getRequestedState());
+}
+
+void DCDReporter::report() {
+    enqueueFrame(context.getState(State::Positions, enforcePeriodicBox));
+}
+
+void DCDReporter::flush() {
+    unique_lock<mutex> guard(lock);
+    while (!frames.empty() || writingFrame)
+        frameFinished.wait(guard);
+    string error = errorMessage;
+    guard.unlock();
+    if (error.size() > 0)
+        throw OpenMMException(error);
+}
+
+void DCDReporter::enqueueFrame(const State& state) {
+    const vector<Vec3>& positions = state.getPositions();
+    for (const Vec3& pos : positions)
+        if (!isfinite(pos[0]) || !isfinite(pos[1]) || !isfinite(pos[2]))
+            throw OpenMMException("DCDReporter: Particle position is NaN or infinite");
+    lock_guard<mutex> guard(lock);
+    if (errorMessage.size() > 0)
+        throw OpenMMException(errorMessage);
+    frames.push_back(Frame());
+    Frame& frame = frames.back();
+    frame.positions = positions;
+    state.getPeriodicBoxVectors(frame.boxVectors[0], frame.boxVectors[1], frame.boxVectors[2]);
+    numFrames++;
+    frameAvailable.notify_one();
+}
+
+void DCDReporter::writerThreadBody() {
+    unique_lock<mutex> guard(lock);
+    while (true) {
+        while (frames.empty() && !isDeleted)
+            frameAvailable.wait(guard);
+        if (frames.empty())
+            break;
+        Frame frame;
+        swap(frame, frames.front());
+        frames.pop_front();
+        writingFrame = true;
+        guard.unlock();
+        writeFrame(frame);
+        guard.lock();
+        writingFrame = false;
+        if (ferror(file) && errorMessage.size() == 0)
+            errorMessage = "DCDReporter: Error writing to file";
+        frameFinished.notify_all();
+    }
+}
+
+void DCDReporter::writeFrame(const Frame& frame) {
+    // Update the header with the number of frames and the index of the last step.
+
+    numFramesWritten++;
+    fseek(file, 8, SEEK_SET);
+    writeValue<int>(file, numFramesWritten);
+    fseek(file, 20, SEEK_SET);
+    writeValue<int>(file, numFramesWritten*reportInterval);
+    fseek(file, 0, SEEK_END);
+
+    // Write the periodic box as lengths (in Angstroms) and the cosines of the angles between them.
+
+    if (usePeriodic) {
+        const Vec3* box = frame.boxVectors;
+        double a = sqrt(box[0].dot(box[0]));
+        double b = sqrt(box[1].dot(box[1]));
+        double c = sqrt(box[2].dot(box[2]));
+        double cell[6] = {10*a, box[0].dot(box[1])/(a*b), 10*b, box[0].dot(box[2])/(a*c), box[1].dot(box[2])/(b*c), 10*c};
+        writeValue<int>(file, 48);
+        fwrite(cell, sizeof(double), 6, file);
+        writeValue<int>(file, 48);
+    }
+
+    // Write the coordinates in Angstroms, one record per axis.
+
+    vector<float> coords(numParticles);
+    for (int axis = 0; axis < 3; axis++) {
+        for (int i = 0; i < numParticles; i++)
+            coords[i] = (float) (10*frame.positions[i][axis]);
+        writeValue<int>(file, 4*numParticles);
+        fwrite(coords.data(), sizeof(float), numParticles, file);
+        writeValue<int>(file, 4*numParticles);
+    }
+    fflush(file);
+}
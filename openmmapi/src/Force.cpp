@@ -54,9 +54,14 @@ bool Force::usesPeriodicBoundaryConditions() const {
 }
 
 ForceImpl& Force::getImplInContext(Context& context) {
+    // The caller may modify the ForceImpl, for example in updateParametersInContext(), so forces
+    // the Context computed earlier can no longer be reused.
+
     for (auto impl : context.getImpl().getForceImpls())
-        if (&impl->getOwner() == this)
+        if (&impl->getOwner() == this) {
+            context.getImpl().invalidateForces();
             return *impl;
+        }
     throw OpenMMException("getImplInContext: This Force is not present in the Context");
 }
 
@@ -0,0 +1,202 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2020 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#ifdef WIN32
+  #define _USE_MATH_DEFINES // Needed to get M_PI
+#endif
+#include "openmm/HydrogenMassRepartitioning.h"
+#include "openmm/HarmonicAngleForce.h"
+#include "openmm/HarmonicBondForce.h"
+#include "openmm/OpenMMException.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <utility>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+static const double MaxHydrogenMass = 1.5;
+
+static pair<int, int> makeKey(int p1, int p2) {
+    return make_pair(min(p1, p2), max(p1, p2));
+}
+
+static bool isHydrogen(const System& system, int particle) {
+    double mass = system.getParticleMass(particle);
+    return (mass > 0.0 && mass < MaxHydrogenMass);
+}
+
+/**
+ * Find the length of every constraint in the System.
+ */
+static map<pair<int, int>, double> findConstraints(const System& system) {
+    map<pair<int, int>, double> constraints;
+    for (int i = 0; i < system.getNumConstraints(); i++) {
+        int p1, p2;
+        double distance;
+        system.getConstraintParameters(i, p1, p2, distance);
+        constraints[makeKey(p1, p2)] = distance;
+    }
+    return constraints;
+}
+
+/**
+ * Find the equilibrium length of every bond in the System, including constraints.
+ */
+static map<pair<int, int>, double> findBondLengths(const System& system) {
+    map<pair<int, int>, double> bonds = findConstraints(system);
+    for (int i = 0; i < system.getNumForces(); i++) {
+        const HarmonicBondForce* force = dynamic_cast<const HarmonicBondForce*>(&system.getForce(i));
+        if (force == NULL)
+            continue;
+        for (int j = 0; j < force->getNumBonds(); j++) {
+            int p1, p2;
+            double length, k;
+            force->getBondParameters(j, p1, p2, length, k);
+            if (bonds.find(makeKey(p1, p2)) == bonds.end())
+                bonds[makeKey(p1, p2)] = length;
+        }
+    }
+    return bonds;
+}
+
+int HydrogenMassRepartitioning::repartitionHydrogenMass(System& system, double hydrogenMass) {
+    if (hydrogenMass <= 0.0)
+        throw OpenMMException("HydrogenMassRepartitioning: hydrogenMass must be positive");
+    vector<double> masses(system.getNumParticles());
+    for (int i = 0; i < system.getNumParticles(); i++)
+        masses[i] = system.getParticleMass(i);
+    vector<bool> changed(system.getNumParticles(), false);
+    int numChanged = 0;
+    for (auto& bond : findBondLengths(system)) {
+        int hydrogen = bond.first.first, heavy = bond.first.second;
+        if (!isHydrogen(system, hydrogen))
+            swap(hydrogen, heavy);
+        if (!isHydrogen(system, hydrogen) || isHydrogen(system, heavy) || system.getParticleMass(heavy) == 0.0 || changed[hydrogen])
+            continue;
+        changed[hydrogen] = true;
+        double transfer = hydrogenMass-system.getParticleMass(hydrogen);
+        masses[hydrogen] += transfer;
+        masses[heavy] -= transfer;
+        numChanged++;
+    }
+    for (int i = 0; i < system.getNumParticles(); i++)
+        if (masses[i] <= 0.0 && system.getParticleMass(i) > 0.0)
+            throw OpenMMException("HydrogenMassRepartitioning: hydrogenMass is too large.  A heavy atom would be left with a mass of zero or less.");
+    for (int i = 0; i < system.getNumParticles(); i++)
+        system.setParticleMass(i, masses[i]);
+    return numChanged;
+}
+
+int HydrogenMassRepartitioning::constrainHydrogenAngles(System& system) {
+    map<pair<int, int>, double> constraints = findConstraints(system);
+    int numAdded = 0;
+    for (int i = 0; i < system.getNumForces(); i++) {
+        const HarmonicAngleForce* force = dynamic_cast<const HarmonicAngleForce*>(&system.getForce(i));
+        if (force == NULL)
+            continue;
+        for (int j = 0; j < force->getNumAngles(); j++) {
+            int p1, p2, p3;
+            double angle, k;
+            force->getAngleParameters(j, p1, p2, p3, angle, k);
+            if (!isHydrogen(system, p1) || !isHydrogen(system, p3) || isHydrogen(system, p2))
+                continue;
+            if (constraints.find(makeKey(p1, p3)) != constraints.end())
+                continue;
+            auto bond1 = constraints.find(makeKey(p1, p2));
+            auto bond2 = constraints.find(makeKey(p2, p3));
+            if (bond1 == constraints.end() || bond2 == constraints.end())
+                continue;
+            double r1 = bond1->second, r2 = bond2->second;
+            double distance = sqrt(r1*r1 + r2*r2 - 2*r1*r2*cos(angle));
+            system.addConstraint(p1, p3, distance);
+            constraints[makeKey(p1, p3)] = distance;
+            numAdded++;
+        }
+    }
+    return numAdded;
+}
+
+double HydrogenMassRepartitioning::findMaxStepSize(const System& system, double stepsPerPeriod) {
+    if (stepsPerPeriod <= 0.0)
+        throw OpenMMException("HydrogenMassRepartitioning: stepsPerPeriod must be positive");
+    vector<double> invMass(system.getNumParticles());
+    for (int i = 0; i < system.getNumParticles(); i++) {
+        double mass = system.getParticleMass(i);
+        invMass[i] = (mass == 0.0 ? 0.0 : 1.0/mass);
+    }
+    map<pair<int, int>, double> constraints = findConstraints(system);
+    map<pair<int, int>, double> bondLengths = findBondLengths(system);
+
+    // The units of force constants divided by masses are ps^-2, so frequencies come out in rad/ps.
+
+    double maxFrequency2 = 0.0;
+    for (int i = 0; i < system.getNumForces(); i++) {
+        const HarmonicBondForce* bonds = dynamic_cast<const HarmonicBondForce*>(&system.getForce(i));
+        if (bonds != NULL) {
+            // A bond stretch has frequency sqrt(k/mu), where mu is the reduced mass.
+
+            for (int j = 0; j < bonds->getNumBonds(); j++) {
+                int p1, p2;
+                double length, k;
+                bonds->getBondParameters(j, p1, p2, length, k);
+                if (constraints.find(makeKey(p1, p2)) == constraints.end())
+                    maxFrequency2 = max(maxFrequency2, k*(invMass[p1]+invMass[p2]));
+            }
+        }
+        const HarmonicAngleForce* angles = dynamic_cast<const HarmonicAngleForce*>(&system.getForce(i));
+        if (angles != NULL) {
+            // An angle bend has frequency sqrt(k*G), where G is the Wilson G matrix element for
+            // the angle.  If all three distances are constrained, the angle cannot move.
+
+            for (int j = 0; j < angles->getNumAngles(); j++) {
+                int p1, p2, p3;
+                double angle, k;
+                angles->getAngleParameters(j, p1, p2, p3, angle, k);
+                pair<int, int> key1 = makeKey(p1, p2), key2 = makeKey(p2, p3), key3 = makeKey(p1, p3);
+                if (constraints.find(key1) != constraints.end() && constraints.find(key2) != constraints.end() && constraints.find(key3) != constraints.end())
+                    continue;
+                if (bondLengths.find(key1) == bondLengths.end() || bondLengths.find(key2) == bondLengths.end())
+                    continue;
+                double r1 = bondLengths[key1], r2 = bondLengths[key2];
+                double g = invMass[p1]/(r1*r1) + invMass[p3]/(r2*r2) + invMass[p2]*(1/(r1*r1) + 1/(r2*r2) - 2*cos(angle)/(r1*r2));
+                maxFrequency2 = max(maxFrequency2, k*g);
+            }
+        }
+    }
+    if (maxFrequency2 == 0.0)
+        return numeric_limits<double>::infinity();
+    double period = 2*M_PI/sqrt(maxFrequency2);
+    return period/stepsPerPeriod;
+}
@@ -71,12 +71,18 @@ double LangevinIntegrator::computeKineticEnergy() {
     return kernel.getAs<IntegrateLangevinStepKernel>().computeKineticEnergy(*context, *this);
 }
 
+bool LangevinIntegrator::reusesForces() const {
+    return true;
+}
+
 void LangevinIntegrator::step(int steps) {
     if (context == NULL)
         throw OpenMMException("This Integrator is not bound to a context!");  
     for (int i = 0; i < steps; ++i) {
         context->updateContextState();
-        context->calcForcesAndEnergy(true, false, getIntegrationForceGroups());
+        if (!context->hasValidForces(getIntegrationForceGroups()))
+            context->calcForcesAndEnergy(true, false, getIntegrationForceGroups());
         kernel.getAs<IntegrateLangevinStepKernel>().execute(*context, *this);
+        context->invalidateForces();
     }
 }
@@ -75,12 +75,18 @@ bool LangevinMiddleIntegrator::kineticEnergyRequiresForce() const {
     return false;
 }
 
+bool LangevinMiddleIntegrator::reusesForces() const {
+    return true;
+}
+
 void LangevinMiddleIntegrator::step(int steps) {
     if (context == NULL)
         throw OpenMMException("This Integrator is not bound to a context!");  
     for (int i = 0; i < steps; ++i) {
         context->updateContextState();
-        context->calcForcesAndEnergy(true, false, getIntegrationForceGroups());
+        if (!context->hasValidForces(getIntegrationForceGroups()))
+            context->calcForcesAndEnergy(true, false, getIntegrationForceGroups());
         kernel.getAs<IntegrateLangevinMiddleStepKernel>().execute(*context, *this);
+        context->invalidateForces();
     }
 }
@@ -33,6 +33,7 @@
 #include "openmm/OpenMMException.h"
 #include "openmm/Platform.h"
 #include "openmm/VerletIntegrator.h"
+#include "openmm/internal/ContextImpl.h"
 #include "lbfgs.h"
 #include <cmath>
 #include <sstream>
@@ -148,6 +149,10 @@ static lbfgsfloatval_t evaluate(void *instance, const lbfgsfloatval_t *x, lbfgsf
 }
 
 void LocalEnergyMinimizer::minimize(Context& context, double tolerance, int maxIterations) {
+    // If the Platform provides its own minimizer, use it.
+
+    if (context.getImpl().minimize(tolerance, maxIterations))
+        return;
     const System& system = context.getSystem();
     int numParticles = system.getNumParticles();
     double constraintTol = context.getIntegrator().getConstraintTolerance();
@@ -0,0 +1,142 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2008-2020 Stanford University and the Authors.      *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+
+#include "openmm/MTSLangevinIntegrator.h"
+#include "openmm/Context.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/internal/ContextImpl.h"
+#include "openmm/kernels.h"
+#include <algorithm>
+#include <string>
+
+using namespace OpenMM;
+using std::pair;
+using std::string;
+using std::vector;
+
+static bool compareSubsteps(const pair<int, int>& a, const pair<int, int>& b) {
+    return a.second < b.second;
+}
+
+MTSLangevinIntegrator::MTSLangevinIntegrator(double temperature, double frictionCoeff, double stepSize, const vector<pair<int, int> >& groups) :
+        lastForceGroup(-1), forcesAreValid(false), groups(groups) {
+    if (groups.size() == 0)
+        throw OpenMMException("MTSLangevinIntegrator: No force groups specified");
+    std::stable_sort(this->groups.begin(), this->groups.end(), compareSubsteps);
+    int parentSubsteps = 1;
+    for (auto& group : this->groups) {
+        if (group.first < 0 || group.first > 31)
+            throw OpenMMException("MTSLangevinIntegrator: Force group must be between 0 and 31");
+        if (group.second < parentSubsteps || group.second%parentSubsteps != 0)
+            throw OpenMMException("MTSLangevinIntegrator: The number for substeps for each group must be a multiple of the number for the previous group");
+        parentSubsteps = group.second;
+    }
+    setTemperature(temperature);
+    setFriction(frictionCoeff);
+    setStepSize(stepSize);
+    setConstraintTolerance(1e-5);
+    setRandomNumberSeed(0);
+}
+
+void MTSLangevinIntegrator::initialize(ContextImpl& contextRef) {
+    if (owner != NULL && &contextRef.getOwner() != owner)
+        throw OpenMMException("This Integrator is already bound to a context");
+    context = &contextRef;
+    owner = &contextRef.getOwner();
+    kernel = context->getPlatform().createKernel(IntegrateMTSLangevinStepKernel::Name(), contextRef);
+    kernel.getAs<IntegrateMTSLangevinStepKernel>().initialize(contextRef.getSystem(), *this);
+    forcesAreValid = false;
+}
+
+void MTSLangevinIntegrator::cleanup() {
+    kernel = Kernel();
+}
+
+vector<string> MTSLangevinIntegrator::getKernelNames() {
+    std::vector<std::string> names;
+    names.push_back(IntegrateMTSLangevinStepKernel::Name());
+    return names;
+}
+
+void MTSLangevinIntegrator::stateChanged(State::DataType changed) {
+    forcesAreValid = false;
+}
+
+double MTSLangevinIntegrator::computeKineticEnergy() {
+    return kernel.getAs<IntegrateMTSLangevinStepKernel>().computeKineticEnergy(*context, *this);
+}
+
+bool MTSLangevinIntegrator::kineticEnergyRequiresForce() const {
+    return false;
+}
+
+void MTSLangevinIntegrator::step(int steps) {
+    if (context == NULL)
+        throw OpenMMException("This Integrator is not bound to a context!");  
+    for (int i = 0; i < steps; ++i) {
+        if (context->updateContextState())
+            forcesAreValid = false;
+        computeSubsteps(0, 1);
+        kernel.getAs<IntegrateMTSLangevinStepKernel>().finishStep(*context, *this, forcesAreValid);
+    }
+}
+
+void MTSLangevinIntegrator::computeSubsteps(int level, int parentSubsteps) {
+    int group = groups[level].first;
+    int substeps = groups[level].second;
+    double dt = getStepSize()/substeps;
+    IntegrateMTSLangevinStepKernel& stepKernel = kernel.getAs<IntegrateMTSLangevinStepKernel>();
+    for (int i = 0; i < substeps/parentSubsteps; i++) {
+        applyKick(group, 0.5*dt);
+        if (level == groups.size()-1) {
+            stepKernel.drift(*context, *this, dt);
+            forcesAreValid = false;
+        }
+        else
+            computeSubsteps(level+1, substeps);
+        applyKick(group, 0.5*dt);
+    }
+}
+
+void MTSLangevinIntegrator::applyKick(int group, double dt) {
+    // The force buffer only holds one group at a time.  Consecutive kicks for the
+    // same group without an intervening drift (in particular the last kick of one
+    // step and the first kick of the next) can reuse it.
+
+    int groupFlags = 1<<group;
+    if (!forcesAreValid || lastForceGroup != group || context->getLastForceGroups() != groupFlags) {
+        context->calcForcesAndEnergy(true, false, groupFlags);
+        lastForceGroup = group;
+        forcesAreValid = true;
+    }
+    kernel.getAs<IntegrateMTSLangevinStepKernel>().kick(*context, *this, dt);
+}
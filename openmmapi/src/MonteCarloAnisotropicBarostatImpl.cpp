@@ -63,7 +63,7 @@ void MonteCarloAnisotropicBarostatImpl::initialize(ContextImpl& context) {
     SimTKOpenMMUtilities::setRandomNumberSeed(owner.getRandomNumberSeed());
 }
 
-void MonteCarloAnisotropicBarostatImpl::updateContextState(ContextImpl& context) {
+void MonteCarloAnisotropicBarostatImpl::updateContextState(ContextImpl& context, bool& forcesInvalid) {
     if (++step < owner.getFrequency() || owner.getFrequency() == 0)
         return;
     if (!owner.getScaleX() && !owner.getScaleY() && !owner.getScaleZ())
@@ -73,7 +73,7 @@ void MonteCarloAnisotropicBarostatImpl::updateContextState(ContextImpl& context)
     // Compute the current potential energy.
     
     int groups = context.getIntegrator().getIntegrationForceGroups();
-    double initialEnergy = context.getOwner().getState(State::Energy, false, groups).getPotentialEnergy();
+    double initialEnergy = context.calcForcesAndEnergy(false, true, groups);
     double pressure;
     
     // Choose which axis to modify at random.
@@ -115,7 +115,7 @@ void MonteCarloAnisotropicBarostatImpl::updateContextState(ContextImpl& context)
     
     // Compute the energy of the modified system.
     
-    double finalEnergy = context.getOwner().getState(State::Energy, false, groups).getPotentialEnergy();
+    double finalEnergy = context.calcForcesAndEnergy(false, true, groups);
     double kT = BOLTZ*context.getParameter(MonteCarloAnisotropicBarostat::Temperature());
     double w = finalEnergy-initialEnergy + pressure*deltaVolume - context.getMolecules().size()*kT*std::log(newVolume/volume);
     if (w > 0 && SimTKOpenMMUtilities::getUniformlyDistributedRandomNumber() > std::exp(-w/kT)) {
@@ -125,8 +125,10 @@ void MonteCarloAnisotropicBarostatImpl::updateContextState(ContextImpl& context)
         context.getOwner().setPeriodicBoxVectors(box[0], box[1], box[2]);
         volume = newVolume;
     }
-    else
+    else {
         numAccepted[axis]++;
+        forcesInvalid = true;
+    }
     numAttempted[axis]++;
     if (numAttempted[axis] >= 10) {
         if (numAccepted[axis] < 0.25*numAttempted[axis]) {
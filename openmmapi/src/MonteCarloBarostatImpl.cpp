@@ -69,7 +69,7 @@ void MonteCarloBarostatImpl::updateContextState(ContextImpl& context, bool& forc
     // Compute the current potential energy.
 
     int groups = context.getIntegrator().getIntegrationForceGroups();
-    double initialEnergy = context.getOwner().getState(State::Energy, false, groups).getPotentialEnergy();
+    double initialEnergy = context.calcForcesAndEnergy(false, true, groups);
 
     // Modify the periodic box size.
 
@@ -84,7 +84,7 @@ void MonteCarloBarostatImpl::updateContextState(ContextImpl& context, bool& forc
 
     // Compute the energy of the modified system.
     
-    double finalEnergy = context.getOwner().getState(State::Energy, false, groups).getPotentialEnergy();
+    double finalEnergy = context.calcForcesAndEnergy(false, true, groups);
     double pressure = context.getParameter(MonteCarloBarostat::Pressure())*(AVOGADRO*1e-25);
     double kT = BOLTZ*context.getParameter(MonteCarloBarostat::Temperature());
     double w = finalEnergy-initialEnergy + pressure*deltaVolume - context.getMolecules().size()*kT*std::log(newVolume/volume);
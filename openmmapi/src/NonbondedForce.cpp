@@ -49,7 +49,7 @@ using std::vector;
 
 NonbondedForce::NonbondedForce() : nonbondedMethod(NoCutoff), cutoffDistance(1.0), switchingDistance(-1.0), rfDielectric(78.3),
         ewaldErrorTol(5e-4), alpha(0.0), dalpha(0.0), useSwitchingFunction(false), useDispersionCorrection(true), exceptionsUsePeriodic(false), recipForceGroup(-1),
-        nx(0), ny(0), nz(0), dnx(0), dny(0), dnz(0) {
+        nx(0), ny(0), nz(0), dnx(0), dny(0), dnz(0), pmeOrder(5) {
 }
 
 NonbondedForce::NonbondedMethod NonbondedForce::getNonbondedMethod() const {
@@ -130,6 +130,16 @@ void NonbondedForce::setLJPMEParameters(double alpha, int nx, int ny, int nz) {
     this->dnz = nz;
 }
 
+int NonbondedForce::getPMEInterpolationOrder() const {
+    return pmeOrder;
+}
+
+void NonbondedForce::setPMEInterpolationOrder(int order) {
+    if (order < 4 || order > 6)
+        throw OpenMMException("NonbondedForce: PME interpolation order must be between 4 and 6");
+    pmeOrder = order;
+}
+
 void NonbondedForce::getPMEParametersInContext(const Context& context, double& alpha, int& nx, int& ny, int& nz) const {
     dynamic_cast<const NonbondedForceImpl&>(getImplInContext(context)).getPMEParameters(alpha, nx, ny, nz);
 }
@@ -348,6 +358,10 @@ void NonbondedForce::updateParametersInContext(Context& context) {
     dynamic_cast<NonbondedForceImpl&>(getImplInContext(context)).updateParametersInContext(getContextImpl(context));
 }
 
+void NonbondedForce::updateParametersInContext(Context& context, int firstParticle, int lastParticle, int firstException, int lastException) {
+    dynamic_cast<NonbondedForceImpl&>(getImplInContext(context)).updateParametersInContext(getContextImpl(context), firstParticle, lastParticle, firstException, lastException);
+}
+
 bool NonbondedForce::getExceptionsUsePeriodicBoundaryConditions() const {
     return exceptionsUsePeriodic;
 }
@@ -166,15 +166,19 @@ void NonbondedForceImpl::calcPMEParameters(const System& system, const Nonbonded
         system.getDefaultPeriodicBoxVectors(boxVectors[0], boxVectors[1], boxVectors[2]);
         double tol = force.getEwaldErrorTolerance();
         alpha = (1.0/force.getCutoffDistance())*std::sqrt(-log(2.0*tol));
+
+        // The interpolation error scales as the grid spacing raised to the interpolation order.
+
+        double scale = 3*pow(tol, 1.0/force.getPMEInterpolationOrder());
         if (lj) {
-            xsize = (int) ceil(alpha*boxVectors[0][0]/(3*pow(tol, 0.2)));
-            ysize = (int) ceil(alpha*boxVectors[1][1]/(3*pow(tol, 0.2)));
-            zsize = (int) ceil(alpha*boxVectors[2][2]/(3*pow(tol, 0.2)));
+            xsize = (int) ceil(alpha*boxVectors[0][0]/scale);
+            ysize = (int) ceil(alpha*boxVectors[1][1]/scale);
+            zsize = (int) ceil(alpha*boxVectors[2][2]/scale);
         }
         else {
-            xsize = (int) ceil(2*alpha*boxVectors[0][0]/(3*pow(tol, 0.2)));
-            ysize = (int) ceil(2*alpha*boxVectors[1][1]/(3*pow(tol, 0.2)));
-            zsize = (int) ceil(2*alpha*boxVectors[2][2]/(3*pow(tol, 0.2)));
+            xsize = (int) ceil(2*alpha*boxVectors[0][0]/scale);
+            ysize = (int) ceil(2*alpha*boxVectors[1][1]/scale);
+            zsize = (int) ceil(2*alpha*boxVectors[2][2]/scale);
         }
         xsize = max(xsize, 6);
         ysize = max(ysize, 6);
@@ -313,6 +317,15 @@ void NonbondedForceImpl::updateParametersInContext(ContextImpl& context) {
     context.systemChanged();
 }
 
+void NonbondedForceImpl::updateParametersInContext(ContextImpl& context, int firstParticle, int lastParticle, int firstException, int lastException) {
+    if (firstParticle < 0 || lastParticle >= owner.getNumParticles() || firstException < 0 || lastException >= owner.getNumExceptions())
+        throw OpenMMException("updateParametersInContext: Index out of range");
+    if (lastParticle < firstParticle && lastException < firstException)
+        return;
+    kernel.getAs<CalcNonbondedForceKernel>().copyParameterRangeToContext(context, owner, firstParticle, lastParticle, firstException, lastException);
+    context.systemChanged();
+}
+
 void NonbondedForceImpl::getPMEParameters(double& alpha, int& nx, int& ny, int& nz) const {
     kernel.getAs<CalcNonbondedForceKernel>().getPMEParameters(alpha, nx, ny, nz);
 }
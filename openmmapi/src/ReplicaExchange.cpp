@@ -0,0 +1,118 @@
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2008-2020 Stanford University and the Authors.      *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "openmm/ReplicaExchange.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/System.h"
+#include "openmm/internal/ContextImpl.h"
+#include "SimTKOpenMMRealType.h"
+#include "sfmt/SFMT.h"
+#include <cmath>
+
+using namespace OpenMM;
+using namespace OpenMM_SFMT;
+using namespace std;
+
+ReplicaExchange::ReplicaExchange(const vector<Context*>& contexts, const vector<double>& temperatures, int randomSeed) :
+        contexts(contexts), temperatures(temperatures), numCalls(0) {
+    int numReplicas = contexts.size();
+    if (numReplicas < 2)
+        throw OpenMMException("ReplicaExchange: At least two Contexts are required");
+    if (temperatures.size() != numReplicas)
+        throw OpenMMException("ReplicaExchange: The number of temperatures must equal the number of Contexts");
+    for (int i = 0; i < numReplicas; i++) {
+        if (contexts[i]->getSystem().getNumParticles() != contexts[0]->getSystem().getNumParticles())
+            throw OpenMMException("ReplicaExchange: All Contexts must have the same number of particles");
+        if (temperatures[i] <= 0)
+            throw OpenMMException("ReplicaExchange: Temperatures must be positive");
+        replicaInState.push_back(i);
+    }
+    numAttempted.resize(numReplicas-1, 0);
+    numAccepted.resize(numReplicas-1, 0);
+    sfmt = new SFMT();
+    init_gen_rand(randomSeed, *sfmt);
+}
+
+ReplicaExchange::~ReplicaExchange() {
+    delete sfmt;
+}
+
+int ReplicaExchange::attemptExchanges() {
+    int accepted = 0;
+    for (int i = numCalls%2; i+1 < contexts.size(); i += 2)
+        if (attemptExchange(i, i+1))
+            accepted++;
+    numCalls++;
+    return accepted;
+}
+
+bool ReplicaExchange::attemptExchange(int state1, int state2) {
+    // The states may differ in their Hamiltonians as well as their temperatures, so compute the
+    // energy of each configuration in the other state by exchanging them and evaluating the energy
+    // again.  If the exchange is rejected, it is reversed.
+
+    ContextImpl& context1 = contexts[state1]->getImpl();
+    ContextImpl& context2 = contexts[state2]->getImpl();
+    double beta1 = 1.0/(BOLTZ*temperatures[state1]);
+    double beta2 = 1.0/(BOLTZ*temperatures[state2]);
+    double velocityScale = sqrt(temperatures[state1]/temperatures[state2]);
+    double initialEnergy = beta1*context1.calcForcesAndEnergy(false, true) + beta2*context2.calcForcesAndEnergy(false, true);
+    context1.swapState(context2, velocityScale);
+    double finalEnergy = beta1*context1.calcForcesAndEnergy(false, true) + beta2*context2.calcForcesAndEnergy(false, true);
+    double delta = finalEnergy-initialEnergy;
+    numAttempted[state1]++;
+    if (delta > 0 && genrand_real2(*sfmt) > exp(-delta)) {
+        context1.swapState(context2, velocityScale);
+        return false;
+    }
+    numAccepted[state1]++;
+    swap(replicaInState[state1], replicaInState[state2]);
+    return true;
+}
+
+int ReplicaExchange::getReplicaInState(int state) const {
+    if (state < 0 || state >= replicaInState.size())
+        throw OpenMMException("ReplicaExchange: Illegal state index");
+    return replicaInState[state];
+}
+
+int ReplicaExchange::getNumAttempted(int state) const {
+    if (state < 0 || state >= numAttempted.size())
+        throw OpenMMException("ReplicaExchange: Illegal state index");
+    return numAttempted[state];
+}
+
+int ReplicaExchange::getNumAccepted(int state) const {
+    if (state < 0 || state >= numAccepted.size())
+        throw OpenMMException("ReplicaExchange: Illegal state index");
+    return numAccepted[state];
+}
@@ -0,0 +1,305 @@
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2020 Stanford University and the Authors.      *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "openmm/SharedMemoryReporter.h"
+#include "openmm/Integrator.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/System.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+using namespace OpenMM;
+using namespace std;
+
+/**
+ * The shared memory begins with a header describing its layout, followed by numSlots slots.  Each slot
+ * holds a SlotHeader followed by the positions as 3*numParticles doubles.
+ *
+ * Each slot is protected by a sequence lock.  While frame i is being written its sequence number is 2*i+1,
+ * and once it is complete the sequence number is 2*i+2.  A reader checks the sequence number before and
+ * after copying the data, and discards the copy if it changed.
+ */
+
+static const char MAGIC[8] = {'O', 'M', 'M', 'S', 'H', 'M', 'E', 'M'};
+static const int VERSION = 1;
+
+struct SharedMemoryHeader {
+    char magic[8];
+    int version, numParticles, numSlots, padding;
+    atomic<long long> numFrames;
+};
+
+struct SlotHeader {
+    atomic<long long> sequence;
+    long long step;
+    double time;
+    double boxVectors[9];
+};
+
+static size_t getHeaderSize() {
+    return (sizeof(SharedMemoryHeader)+63)/64*64;
+}
+
+static size_t getSlotSize(int numParticles) {
+    return (sizeof(SlotHeader)+3*sizeof(double)*numParticles+63)/64*64;
+}
+
+SharedMemoryReporter::SharedMemoryReporter(const string& name, Context& context, int reportInterval, int numSlots, const vector<int>& particles) :
+        context(context), name(name), reportInterval(reportInterval), numSlots(numSlots), subset(-1), currentStep(0), numFrames(0), data(NULL) {
+#ifdef _WIN32
+    throw OpenMMException("SharedMemoryReporter: Shared memory is not supported on this operating system");
+#else
+    if (reportInterval < 1)
+        throw OpenMMException("SharedMemoryReporter: reportInterval must be positive");
+    if (numSlots < 1)
+        throw OpenMMException("SharedMemoryReporter: numSlots must be positive");
+    if (!atomic<long long>().is_lock_free())
+        throw OpenMMException("SharedMemoryReporter: Lock-free atomic operations are not supported on this platform");
+    if (particles.size() == 0)
+        numParticles = context.getSystem().getNumParticles();
+    else {
+        numParticles = particles.size();
+        subset = context.createParticleSubset(particles);
+    }
+    slotSize = getSlotSize(numParticles);
+    size = getHeaderSize()+numSlots*slotSize;
+
+    // Create the shared memory object and map it into memory.
+
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd == -1) {
+        if (errno == EEXIST)
+            throw OpenMMException("SharedMemoryReporter: A shared memory object named "+name+" already exists");
+        throw OpenMMException("SharedMemoryReporter: Unable to create shared memory object "+name+": "+strerror(errno));
+    }
+    if (ftruncate(fd, size) != 0) {
+        close(fd);
+        shm_unlink(name.c_str());
+        throw OpenMMException("SharedMemoryReporter: Unable to allocate shared memory for "+name);
+    }
+    void* address = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        throw OpenMMException("SharedMemoryReporter: Unable to map shared memory for "+name);
+    }
+    data = (char*) address;
+
+    // Initialize the header and slots.  The magic number is written last so a reader never sees a
+    // partially initialized header.
+
+    SharedMemoryHeader* header = new(data) SharedMemoryHeader();
+    header->version = VERSION;
+    header->numParticles = numParticles;
+    header->numSlots = numSlots;
+    header->numFrames.store(0);
+    for (int i = 0; i < numSlots; i++)
+        new(data+getHeaderSize()+i*slotSize) SlotHeader();
+    atomic_thread_fence(memory_order_release);
+    memcpy(header->magic, MAGIC, sizeof(MAGIC));
+#endif
+}
+
+SharedMemoryReporter::~SharedMemoryReporter() {
+#ifndef _WIN32
+    munmap(data, size);
+    shm_unlink(name.c_str());
+#endif
+}
+
+void SharedMemoryReporter::step(int steps) {
+    // When publishing all particles, each frame is requested asynchronously and only retrieved after
+    // the next block of steps has been taken.
+
+    Integrator& integrator = context.getIntegrator();
+    bool hasRequestedState = false;
+    int requestedStep = 0;
+    while (steps > 0) {
+        int stepsToTake = min(steps, reportInterval-currentStep%reportInterval);
+        integrator.step(stepsToTake);
+        steps -= stepsToTake;
+        currentStep += stepsToTake;
+        if (hasRequestedState) {
+            State state = context.getRequestedState();
+            Vec3 boxVectors[3];
+            state.getPeriodicBoxVectors(boxVectors[0], boxVectors[1], boxVectors[2]);
+            publishFrame(state.getPositions(), boxVectors, requestedStep, state.getTime());
+            hasRequestedState = false;
+        }
+        if (currentStep%reportInterval == 0) {
+            if (subset == -1) {
+                context.requestStateAsync(State::Positions);
+                requestedStep = currentStep;
+                hasRequestedState = true;
+            }
+            else
+                publishSubset();
+        }
+    }
+    if (hasRequestedState) {
+        State state = context.getRequestedState();
+        Vec3 boxVectors[3];
+        state.getPeriodicBoxVectors(boxVectors[0], boxVectors[1], boxVectors[2]);
+        publishFrame(state.getPositions(), boxVectors, requestedStep, state.getTime());
+    }
+}
+
+void SharedMemoryReporter::report() {
+    if (subset == -1) {
+        State state = context.getState(State::Positions);
+        Vec3 boxVectors[3];
+        state.getPeriodicBoxVectors(boxVectors[0], boxVectors[1], boxVectors[2]);
+        publishFrame(state.getPositions(), boxVectors, currentStep, state.getTime());
+    }
+    else
+        publishSubset();
+}
+
+void SharedMemoryReporter::publishSubset() {
+    vector<Vec3> positions;
+    context.getSubsetPositions(subset, positions);
+    State state = context.getState(0);
+    Vec3 boxVectors[3];
+    state.getPeriodicBoxVectors(boxVectors[0], boxVectors[1], boxVectors[2]);
+    publishFrame(positions, boxVectors, currentStep, state.getTime());
+}
+
+void SharedMemoryReporter::publishFrame(const vector<Vec3>& positions, const Vec3* boxVectors, long long step, double time) {
+    SharedMemoryHeader* header = (SharedMemoryHeader*) data;
+    SlotHeader* slot = (SlotHeader*) (data+getHeaderSize()+(numFrames%numSlots)*slotSize);
+    slot->sequence.store(2*numFrames+1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->step = step;
+    slot->time = time;
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            slot->boxVectors[3*i+j] = boxVectors[i][j];
+    memcpy(slot+1, positions.data(), 3*sizeof(double)*numParticles);
+    slot->sequence.store(2*numFrames+2, memory_order_release);
+    numFrames++;
+    header->numFrames.store(numFrames, memory_order_release);
+}
+
+SharedMemoryReader::SharedMemoryReader(const string& name) : data(NULL) {
+#ifdef _WIN32
+    throw OpenMMException("SharedMemoryReader: Shared memory is not supported on this operating system");
+#else
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd == -1)
+        throw OpenMMException("SharedMemoryReader: Unable to open shared memory object "+name+": "+strerror(errno));
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t) getHeaderSize()) {
+        close(fd);
+        throw OpenMMException("SharedMemoryReader: Shared memory object "+name+" is not a SharedMemoryReporter buffer");
+    }
+    size = info.st_size;
+    void* address = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED)
+        throw OpenMMException("SharedMemoryReader: Unable to map shared memory for "+name);
+    data = (char*) address;
+    const SharedMemoryHeader* header = (const SharedMemoryHeader*) data;
+    bool valid = (memcmp(header->magic, MAGIC, sizeof(MAGIC)) == 0);
+    atomic_thread_fence(memory_order_acquire);
+    if (valid && header->version != VERSION) {
+        munmap(data, size);
+        throw OpenMMException("SharedMemoryReader: Shared memory object "+name+" has an unsupported version");
+    }
+    if (valid) {
+        numParticles = header->numParticles;
+        numSlots = header->numSlots;
+        slotSize = getSlotSize(numParticles);
+        valid = (numParticles >= 0 && numSlots > 0 && getHeaderSize()+numSlots*slotSize <= size);
+    }
+    if (!valid) {
+        munmap(data, size);
+        throw OpenMMException("SharedMemoryReader: Shared memory object "+name+" is not a SharedMemoryReporter buffer");
+    }
+#endif
+}
+
+SharedMemoryReader::~SharedMemoryReader() {
+#ifndef _WIN32
+    munmap(data, size);
+#endif
+}
+
+long long SharedMemoryReader::getNumFrames() const {
+    return ((const SharedMemoryHeader*) data)->numFrames.load(memory_order_acquire);
+}
+
+bool SharedMemoryReader::readFrame(long long frame, vector<Vec3>& positions, Vec3* boxVectors, long long& step, double& time) const {
+    if (frame < 0 || frame >= getNumFrames())
+        return false;
+    const SlotHeader* slot = (const SlotHeader*) (data+getHeaderSize()+(frame%numSlots)*slotSize);
+    long long sequence = slot->sequence.load(memory_order_acquire);
+    if (sequence != 2*frame+2)
+        return false;
+    positions.resize(numParticles);
+    long long frameStep = slot->step;
+    double frameTime = slot->time;
+    double box[9];
+    memcpy(box, slot->boxVectors, sizeof(box));
+    memcpy(positions.data(), slot+1, 3*sizeof(double)*numParticles);
+
+    // If the writer started overwriting the slot while we were copying it, the data may be inconsistent.
+
+    atomic_thread_fence(memory_order_acquire);
+    if (slot->sequence.load(memory_order_relaxed) != sequence)
+        return false;
+    step = frameStep;
+    time = frameTime;
+    for (int i = 0; i < 3; i++)
+        boxVectors[i] = Vec3(box[3*i], box[3*i+1], box[3*i+2]);
+    return true;
+}
+
+long long SharedMemoryReader::readLatestFrame(vector<Vec3>& positions, Vec3* boxVectors, long long& step, double& time) const {
+    // If the latest frame gets overwritten while reading it, a newer one is available, so try again.
+
+    while (true) {
+        long long frame = getNumFrames()-1;
+        if (frame < 0)
+            return -1;
+        if (readFrame(frame, positions, boxVectors, step, time))
+            return frame;
+    }
+}
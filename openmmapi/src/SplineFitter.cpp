@@ -29,10 +29,15 @@
  * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
  * -------------------------------------------------------------------------- */
 
+#include <exception>
+#include <functional>
+#include <mutex>
 #include <vector>
 #include <math.h>
 
+#include "openmm/internal/hardware.h"
 #include "openmm/internal/SplineFitter.h"
+#include "openmm/internal/ThreadPool.h"
 #include "openmm/OpenMMException.h"
 
 using namespace OpenMM;
@@ -42,6 +47,80 @@ static bool notEqual(double a, double b) {
   return (fabs(a-b) > 1e-15 + 1e-15*fabs(b));
 }
 
+/**
+ * Multidimensional splines with fewer values than this are fit on a single thread, since handing out
+ * work to the threads would take longer than the fit.
+ */
+static const int MIN_VALUES_FOR_THREADS = 32768;
+
+/**
+ * Get whether a multidimensional spline with the specified number of values is large enough to
+ * benefit from being fit on multiple threads.
+ */
+static bool useSplineThreads(int numValues) {
+    return (numValues >= MIN_VALUES_FOR_THREADS && getNumProcessors() > 1);
+}
+
+/**
+ * Get the ThreadPool used for fitting multidimensional splines.  It is created the first time it is needed
+ * and then reused, since some Forces refit their splines often.  The caller must hold the lock returned by
+ * getSplineThreadsLock() while using it.
+ */
+static ThreadPool& getSplineThreads() {
+    static ThreadPool threads;
+    return threads;
+}
+
+static mutex& getSplineThreadsLock() {
+    static mutex lock;
+    return lock;
+}
+
+/**
+ * Invoke task(start, end) to process the indices [0, count), in parallel if threads is not NULL.
+ * Every index is processed exactly once and independently of the others, so the results do not
+ * depend on the number of threads.  If the task throws an exception on a worker thread, it is
+ * rethrown on the calling thread.
+ */
+static void executeInParallel(ThreadPool* threads, int count, function<void (int, int)> task) {
+    if (threads == NULL) {
+        task(0, count);
+        return;
+    }
+    exception_ptr error;
+    mutex errorLock;
+    threads->execute(count, 1, [&] (ThreadPool& pool, int threadIndex, int start, int end) {
+        try {
+            task(start, end);
+        }
+        catch (...) {
+            lock_guard<mutex> lock(errorLock);
+            if (!error)
+                error = current_exception();
+        }
+    });
+    threads->waitForThreads();
+    if (error)
+        rethrow_exception(error);
+}
+
+void SplineFitter::computeAxisDerivatives(ThreadPool* threads, const vector<double>& knots, bool periodic, const vector<double>& input,
+        vector<double>& output, int stride, int count1, int stride1, int count2, int stride2) {
+    int n = knots.size();
+    executeInParallel(threads, count2, [&] (int start, int end) {
+        vector<double> t(n), deriv(n);
+        for (int b = start; b < end; b++)
+            for (int a = 0; a < count1; a++) {
+                int base = a*stride1+b*stride2;
+                for (int k = 0; k < n; k++)
+                    t[k] = input[base+k*stride];
+                createSpline(knots, t, periodic, deriv);
+                for (int k = 0; k < n; k++)
+                    output[base+k*stride] = evaluateDerivativeAtKnot(knots, t, deriv, k);
+            }
+    });
+}
+
 void SplineFitter::createSpline(const vector<double>& x, const vector<double>& y, bool periodic, vector<double>& deriv) {
     if (periodic)
         SplineFitter::createPeriodicSpline(x, y, deriv);
@@ -181,6 +260,18 @@ double SplineFitter::evaluateSplineDerivative(const vector<double>& x, const vec
     return dadx*y[lower]-dadx*y[upper]+((1.0-3.0*a*a)*deriv[lower] + (3.0*b*b-1.0)*deriv[upper])*dx/6.0;
 }
 
+double SplineFitter::evaluateDerivativeAtKnot(const vector<double>& x, const vector<double>& y, const vector<double>& deriv, int k) {
+    // This is the same as evaluateSplineDerivative() with t=x[k], but it does not need to search for the interval.
+
+    int n = x.size();
+    if (k < n-1) {
+        double dx = x[k+1]-x[k];
+        return (y[k+1]-y[k])/dx - (2.0*deriv[k]+deriv[k+1])*dx/6.0;
+    }
+    double dx = x[k]-x[k-1];
+    return (y[k]-y[k-1])/dx + (deriv[k-1]+2.0*deriv[k])*dx/6.0;
+}
+
 void SplineFitter::solveTridiagonalMatrix(const vector<double>& a, const vector<double>& b, const vector<double>& c, const vector<double>& rhs, vector<double>& sol) {
     int n = a.size();
     vector<double> gamma(n);
@@ -212,41 +303,18 @@ void SplineFitter::create2DSpline(const vector<double>& x, const vector<double>&
     if (values.size() != xsize*ysize)
         throw OpenMMException("create2DNaturalSpline: incorrect number of values");
     vector<double> d1(xsize*ysize), d2(xsize*ysize), d12(xsize*ysize);
-    vector<double> t(xsize), deriv(xsize);
-
-    // Compute derivatives with respect to x.
-
-    for (int i = 0; i < ysize; i++) {
-        for (int j = 0; j < xsize; j++)
-            t[j] = values[j+xsize*i];
-        SplineFitter::createSpline(x, t, periodic, deriv);
-        for (int j = 0; j < xsize; j++)
-            d1[j+xsize*i] = SplineFitter::evaluateSplineDerivative(x, t, deriv, x[j]);
-    }
-
-    // Compute derivatives with respect to y.
-
-    t.resize(ysize);
-    deriv.resize(ysize);
-    for (int i = 0; i < xsize; i++) {
-        for (int j = 0; j < ysize; j++)
-            t[j] = values[i+xsize*j];
-        SplineFitter::createSpline(y, t, periodic, deriv);
-        for (int j = 0; j < ysize; j++)
-            d2[i+xsize*j] = SplineFitter::evaluateSplineDerivative(y, t, deriv, y[j]);
+    ThreadPool* threads = NULL;
+    unique_lock<mutex> lock;
+    if (useSplineThreads(xsize*ysize)) {
+        lock = unique_lock<mutex>(getSplineThreadsLock());
+        threads = &getSplineThreads();
     }
 
-    // Compute cross derivatives.
+    // Compute derivatives with respect to x and y, then cross derivatives.
 
-    t.resize(xsize);
-    deriv.resize(xsize);
-    for (int i = 0; i < ysize; i++) {
-        for (int j = 0; j < xsize; j++)
-            t[j] = d2[j+xsize*i];
-        SplineFitter::createSpline(x, t, periodic, deriv);
-        for (int j = 0; j < xsize; j++)
-            d12[j+xsize*i] = SplineFitter::evaluateSplineDerivative(x, t, deriv, x[j]);
-    }
+    computeAxisDerivatives(threads, x, periodic, values, d1, 1, 1, 0, ysize, xsize);
+    computeAxisDerivatives(threads, y, periodic, values, d2, xsize, 1, 0, xsize, 1);
+    computeAxisDerivatives(threads, x, periodic, d2, d12, 1, 1, 0, ysize, xsize);
 
     // Now compute the coefficients.
 
@@ -268,37 +336,39 @@ void SplineFitter::create2DSpline(const vector<double>& x, const vector<double>&
         0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, -1, 0, 0, -1, 1,
         0, 0, 0, 0, 0, 0, -1, 1, 0, 0, 2, -2, 0, 0, -1, 1
     };
-    vector<double> rhs(16);
     c.resize((xsize-1)*(ysize-1));
-    for (int i = 0; i < xsize-1; i++) {
-        for (int j = 0; j < ysize-1; j++) {
-            // Compute the 16 coefficients for patch (i, j).
-
-            int nexti = i+1;
-            int nextj = j+1;
-            double deltax = x[nexti]-x[i];
-            double deltay = y[nextj]-y[j];
-            double e[] = {values[i+j*xsize], values[nexti+j*xsize], values[nexti+nextj*xsize], values[i+nextj*xsize]};
-            double e1[] = {d1[i+j*xsize], d1[nexti+j*xsize], d1[nexti+nextj*xsize], d1[i+nextj*xsize]};
-            double e2[] = {d2[i+j*xsize], d2[nexti+j*xsize], d2[nexti+nextj*xsize], d2[i+nextj*xsize]};
-            double e12[] = {d12[i+j*xsize], d12[nexti+j*xsize], d12[nexti+nextj*xsize], d12[i+nextj*xsize]};
-
-            for (int k = 0; k < 4; k++) {
-                rhs[k] = e[k];
-                rhs[k+4] = e1[k]*deltax;
-                rhs[k+8] = e2[k]*deltay;
-                rhs[k+12] = e12[k]*deltax*deltay;
-            }
-            vector<double>& coeff = c[i+j*(xsize-1)];
-            coeff.resize(16);
-            for (int k = 0; k < 16; k++) {
-                double sum = 0.0;
-                for (int m = 0; m < 16; m++)
-                    sum += wt[k+16*m]*rhs[m];
-                coeff[k] = sum;
+    executeInParallel(threads, ysize-1, [&] (int start, int end) {
+        vector<double> rhs(16);
+        for (int j = start; j < end; j++) {
+            for (int i = 0; i < xsize-1; i++) {
+                // Compute the 16 coefficients for patch (i, j).
+
+                int nexti = i+1;
+                int nextj = j+1;
+                double deltax = x[nexti]-x[i];
+                double deltay = y[nextj]-y[j];
+                double e[] = {values[i+j*xsize], values[nexti+j*xsize], values[nexti+nextj*xsize], values[i+nextj*xsize]};
+                double e1[] = {d1[i+j*xsize], d1[nexti+j*xsize], d1[nexti+nextj*xsize], d1[i+nextj*xsize]};
+                double e2[] = {d2[i+j*xsize], d2[nexti+j*xsize], d2[nexti+nextj*xsize], d2[i+nextj*xsize]};
+                double e12[] = {d12[i+j*xsize], d12[nexti+j*xsize], d12[nexti+nextj*xsize], d12[i+nextj*xsize]};
+
+                for (int k = 0; k < 4; k++) {
+                    rhs[k] = e[k];
+                    rhs[k+4] = e1[k]*deltax;
+                    rhs[k+8] = e2[k]*deltay;
+                    rhs[k+12] = e12[k]*deltax*deltay;
+                }
+                vector<double>& coeff = c[i+j*(xsize-1)];
+                coeff.resize(16);
+                for (int k = 0; k < 16; k++) {
+                    double sum = 0.0;
+                    for (int m = 0; m < 16; m++)
+                        sum += wt[k+16*m]*rhs[m];
+                    coeff[k] = sum;
+                }
             }
         }
-    }
+    });
 }
 
 void SplineFitter::create2DNaturalSpline(const vector<double>& x, const vector<double>& y, const vector<double>& values, vector<vector<double> >& c) {
@@ -402,103 +472,28 @@ void SplineFitter::create3DSpline(const vector<double>& x, const vector<double>&
         throw OpenMMException("create2DNaturalSpline: incorrect number of values");
     vector<double> d1(xsize*ysize*zsize), d2(xsize*ysize*zsize), d3(xsize*ysize*zsize);
     vector<double> d12(xsize*ysize*zsize), d13(xsize*ysize*zsize), d23(xsize*ysize*zsize), d123(xsize*ysize*zsize);
-    vector<double> t(xsize), deriv(xsize);
-
-    // Compute derivatives with respect to x.
-
-    for (int i = 0; i < ysize; i++) {
-        for (int j = 0; j < zsize; j++) {
-            for (int k = 0; k < xsize; k++)
-                t[k] = values[k+xsize*i+xysize*j];
-            SplineFitter::createSpline(x, t, periodic, deriv);
-            for (int k = 0; k < xsize; k++)
-                d1[k+xsize*i+xysize*j] = SplineFitter::evaluateSplineDerivative(x, t, deriv, x[k]);
-        }
+    ThreadPool* threads = NULL;
+    unique_lock<mutex> lock;
+    if (useSplineThreads(xsize*ysize*zsize)) {
+        lock = unique_lock<mutex>(getSplineThreadsLock());
+        threads = &getSplineThreads();
     }
 
-    // Compute derivatives with respect to y.
-
-    t.resize(ysize);
-    deriv.resize(ysize);
-    for (int i = 0; i < xsize; i++) {
-        for (int j = 0; j < zsize; j++) {
-            for (int k = 0; k < ysize; k++)
-                t[k] = values[i+xsize*k+xysize*j];
-            SplineFitter::createSpline(y, t, periodic, deriv);
-            for (int k = 0; k < ysize; k++)
-                d2[i+xsize*k+xysize*j] = SplineFitter::evaluateSplineDerivative(y, t, deriv, y[k]);
-        }
-    }
+    // Compute derivatives with respect to x, y, and z.
 
-    // Compute derivatives with respect to z.
-
-    t.resize(zsize);
-    deriv.resize(zsize);
-    for (int i = 0; i < xsize; i++) {
-        for (int j = 0; j < ysize; j++) {
-            for (int k = 0; k < zsize; k++)
-                t[k] = values[i+xsize*j+xysize*k];
-            SplineFitter::createSpline(z, t, periodic, deriv);
-            for (int k = 0; k < zsize; k++)
-                d3[i+xsize*j+xysize*k] = SplineFitter::evaluateSplineDerivative(z, t, deriv, z[k]);
-        }
-    }
+    computeAxisDerivatives(threads, x, periodic, values, d1, 1, ysize, xsize, zsize, xysize);
+    computeAxisDerivatives(threads, y, periodic, values, d2, xsize, xsize, 1, zsize, xysize);
+    computeAxisDerivatives(threads, z, periodic, values, d3, xysize, xsize, 1, ysize, xsize);
 
-    // Compute second derivatives with respect to x and y.
-
-    t.resize(xsize);
-    deriv.resize(xsize);
-    for (int i = 0; i < ysize; i++) {
-        for (int j = 0; j < zsize; j++) {
-            for (int k = 0; k < xsize; k++)
-                t[k] = d2[k+xsize*i+xysize*j];
-            SplineFitter::createSpline(x, t, periodic, deriv);
-            for (int k = 0; k < xsize; k++)
-                d12[k+xsize*i+xysize*j] = SplineFitter::evaluateSplineDerivative(x, t, deriv, x[k]);
-        }
-    }
+    // Compute second derivatives with respect to x and y, y and z, and x and z.
 
-    // Compute second derivatives with respect to y and z.
-
-    t.resize(ysize);
-    deriv.resize(ysize);
-    for (int i = 0; i < zsize; i++) {
-        for (int j = 0; j < xsize; j++) {
-            for (int k = 0; k < ysize; k++)
-                t[k] = d3[j+xsize*k+xysize*i];
-            SplineFitter::createSpline(y, t, periodic, deriv);
-            for (int k = 0; k < ysize; k++)
-                d23[j+xsize*k+xysize*i] = SplineFitter::evaluateSplineDerivative(y, t, deriv, y[k]);
-        }
-    }
-
-    // Compute second derivatives with respect to x and z.
-
-    t.resize(zsize);
-    deriv.resize(zsize);
-    for (int i = 0; i < xsize; i++) {
-        for (int j = 0; j < ysize; j++) {
-            for (int k = 0; k < zsize; k++)
-                t[k] = d1[i+xsize*j+xysize*k];
-            SplineFitter::createSpline(z, t, periodic, deriv);
-            for (int k = 0; k < zsize; k++)
-                d13[i+xsize*j+xysize*k] = SplineFitter::evaluateSplineDerivative(z, t, deriv, z[k]);
-        }
-    }
+    computeAxisDerivatives(threads, x, periodic, d2, d12, 1, ysize, xsize, zsize, xysize);
+    computeAxisDerivatives(threads, y, periodic, d3, d23, xsize, xsize, 1, zsize, xysize);
+    computeAxisDerivatives(threads, z, periodic, d1, d13, xysize, xsize, 1, ysize, xsize);
 
     // Compute third derivatives with respect to x, y, and z.
 
-    t.resize(xsize);
-    deriv.resize(xsize);
-    for (int i = 0; i < ysize; i++) {
-        for (int j = 0; j < zsize; j++) {
-            for (int k = 0; k < xsize; k++)
-                t[k] = d23[k+xsize*i+xysize*j];
-            SplineFitter::createSpline(x, t, periodic, deriv);
-            for (int k = 0; k < xsize; k++)
-                d123[k+xsize*i+xysize*j] = SplineFitter::evaluateSplineDerivative(x, t, deriv, x[k]);
-        }
-    }
+    computeAxisDerivatives(threads, x, periodic, d23, d123, 1, ysize, xsize, zsize, xysize);
 
     // Now compute the coefficients.  This involves multiplying by a sparse 64x64 matrix, given
     // here in packed form.
@@ -578,49 +573,51 @@ void SplineFitter::create3DSpline(const vector<double>& x, const vector<double>&
             weight[i].push_back(wt[index++]);
         }
     }
-    vector<double> rhs(64);
     c.resize((xsize-1)*(ysize-1)*(zsize-1));
-    for (int i = 0; i < xsize-1; i++) {
-        for (int j = 0; j < ysize-1; j++) {
-            for (int k = 0; k < zsize-1; k++) {
-                // Compute the 64 coefficients for patch (i, j, k).
-
-                int nexti = i+1;
-                int nextj = j+1;
-                int nextk = k+1;
-                double deltax = x[nexti]-x[i];
-                double deltay = y[nextj]-y[j];
-                double deltaz = z[nextk]-z[k];
-                double e[] = {values[i+j*xsize+k*xysize], values[nexti+j*xsize+k*xysize], values[i+nextj*xsize+k*xysize], values[nexti+nextj*xsize+k*xysize], values[i+j*xsize+nextk*xysize], values[nexti+j*xsize+nextk*xysize], values[i+nextj*xsize+nextk*xysize], values[nexti+nextj*xsize+nextk*xysize]};
-                double e1[] = {d1[i+j*xsize+k*xysize], d1[nexti+j*xsize+k*xysize], d1[i+nextj*xsize+k*xysize], d1[nexti+nextj*xsize+k*xysize], d1[i+j*xsize+nextk*xysize], d1[nexti+j*xsize+nextk*xysize], d1[i+nextj*xsize+nextk*xysize], d1[nexti+nextj*xsize+nextk*xysize]};
-                double e2[] = {d2[i+j*xsize+k*xysize], d2[nexti+j*xsize+k*xysize], d2[i+nextj*xsize+k*xysize], d2[nexti+nextj*xsize+k*xysize], d2[i+j*xsize+nextk*xysize], d2[nexti+j*xsize+nextk*xysize], d2[i+nextj*xsize+nextk*xysize], d2[nexti+nextj*xsize+nextk*xysize]};
-                double e3[] = {d3[i+j*xsize+k*xysize], d3[nexti+j*xsize+k*xysize], d3[i+nextj*xsize+k*xysize], d3[nexti+nextj*xsize+k*xysize], d3[i+j*xsize+nextk*xysize], d3[nexti+j*xsize+nextk*xysize], d3[i+nextj*xsize+nextk*xysize], d3[nexti+nextj*xsize+nextk*xysize]};
-                double e12[] = {d12[i+j*xsize+k*xysize], d12[nexti+j*xsize+k*xysize], d12[i+nextj*xsize+k*xysize], d12[nexti+nextj*xsize+k*xysize], d12[i+j*xsize+nextk*xysize], d12[nexti+j*xsize+nextk*xysize], d12[i+nextj*xsize+nextk*xysize], d12[nexti+nextj*xsize+nextk*xysize]};
-                double e13[] = {d13[i+j*xsize+k*xysize], d13[nexti+j*xsize+k*xysize], d13[i+nextj*xsize+k*xysize], d13[nexti+nextj*xsize+k*xysize], d13[i+j*xsize+nextk*xysize], d13[nexti+j*xsize+nextk*xysize], d13[i+nextj*xsize+nextk*xysize], d13[nexti+nextj*xsize+nextk*xysize]};
-                double e23[] = {d23[i+j*xsize+k*xysize], d23[nexti+j*xsize+k*xysize], d23[i+nextj*xsize+k*xysize], d23[nexti+nextj*xsize+k*xysize], d23[i+j*xsize+nextk*xysize], d23[nexti+j*xsize+nextk*xysize], d23[i+nextj*xsize+nextk*xysize], d23[nexti+nextj*xsize+nextk*xysize]};
-                double e123[] = {d123[i+j*xsize+k*xysize], d123[nexti+j*xsize+k*xysize], d123[i+nextj*xsize+k*xysize], d123[nexti+nextj*xsize+k*xysize], d123[i+j*xsize+nextk*xysize], d123[nexti+j*xsize+nextk*xysize], d123[i+nextj*xsize+nextk*xysize], d123[nexti+nextj*xsize+nextk*xysize]};
-                for (int m = 0; m < 8; m++) {
-                    rhs[m] = e[m];
-                    rhs[m+8] = e1[m]*deltax;
-                    rhs[m+16] = e2[m]*deltay;
-                    rhs[m+24] = e3[m]*deltaz;
-                    rhs[m+32] = e12[m]*deltax*deltay;
-                    rhs[m+40] = e13[m]*deltax*deltaz;
-                    rhs[m+48] = e23[m]*deltay*deltaz;
-                    rhs[m+56] = e123[m]*deltax*deltay*deltaz;
-                }
-                vector<double>& coeff = c[i+j*(xsize-1)+k*(xsize-1)*(ysize-1)];
-                coeff.resize(64);
-                for (int m = 0; m < 64; m++) {
-                    double sum = 0.0;
-                    int numElements = weight[m].size();
-                    for (int n = 0; n < numElements; n += 2)
-                        sum += weight[m][n+1]*rhs[weight[m][n]];
-                    coeff[m] = sum;
+    executeInParallel(threads, zsize-1, [&] (int start, int end) {
+        vector<double> rhs(64);
+        for (int k = start; k < end; k++) {
+            for (int j = 0; j < ysize-1; j++) {
+                for (int i = 0; i < xsize-1; i++) {
+                    // Compute the 64 coefficients for patch (i, j, k).
+
+                    int nexti = i+1;
+                    int nextj = j+1;
+                    int nextk = k+1;
+                    double deltax = x[nexti]-x[i];
+                    double deltay = y[nextj]-y[j];
+                    double deltaz = z[nextk]-z[k];
+                    double e[] = {values[i+j*xsize+k*xysize], values[nexti+j*xsize+k*xysize], values[i+nextj*xsize+k*xysize], values[nexti+nextj*xsize+k*xysize], values[i+j*xsize+nextk*xysize], values[nexti+j*xsize+nextk*xysize], values[i+nextj*xsize+nextk*xysize], values[nexti+nextj*xsize+nextk*xysize]};
+                    double e1[] = {d1[i+j*xsize+k*xysize], d1[nexti+j*xsize+k*xysize], d1[i+nextj*xsize+k*xysize], d1[nexti+nextj*xsize+k*xysize], d1[i+j*xsize+nextk*xysize], d1[nexti+j*xsize+nextk*xysize], d1[i+nextj*xsize+nextk*xysize], d1[nexti+nextj*xsize+nextk*xysize]};
+                    double e2[] = {d2[i+j*xsize+k*xysize], d2[nexti+j*xsize+k*xysize], d2[i+nextj*xsize+k*xysize], d2[nexti+nextj*xsize+k*xysize], d2[i+j*xsize+nextk*xysize], d2[nexti+j*xsize+nextk*xysize], d2[i+nextj*xsize+nextk*xysize], d2[nexti+nextj*xsize+nextk*xysize]};
+                    double e3[] = {d3[i+j*xsize+k*xysize], d3[nexti+j*xsize+k*xysize], d3[i+nextj*xsize+k*xysize], d3[nexti+nextj*xsize+k*xysize], d3[i+j*xsize+nextk*xysize], d3[nexti+j*xsize+nextk*xysize], d3[i+nextj*xsize+nextk*xysize], d3[nexti+nextj*xsize+nextk*xysize]};
+                    double e12[] = {d12[i+j*xsize+k*xysize], d12[nexti+j*xsize+k*xysize], d12[i+nextj*xsize+k*xysize], d12[nexti+nextj*xsize+k*xysize], d12[i+j*xsize+nextk*xysize], d12[nexti+j*xsize+nextk*xysize], d12[i+nextj*xsize+nextk*xysize], d12[nexti+nextj*xsize+nextk*xysize]};
+                    double e13[] = {d13[i+j*xsize+k*xysize], d13[nexti+j*xsize+k*xysize], d13[i+nextj*xsize+k*xysize], d13[nexti+nextj*xsize+k*xysize], d13[i+j*xsize+nextk*xysize], d13[nexti+j*xsize+nextk*xysize], d13[i+nextj*xsize+nextk*xysize], d13[nexti+nextj*xsize+nextk*xysize]};
+                    double e23[] = {d23[i+j*xsize+k*xysize], d23[nexti+j*xsize+k*xysize], d23[i+nextj*xsize+k*xysize], d23[nexti+nextj*xsize+k*xysize], d23[i+j*xsize+nextk*xysize], d23[nexti+j*xsize+nextk*xysize], d23[i+nextj*xsize+nextk*xysize], d23[nexti+nextj*xsize+nextk*xysize]};
+                    double e123[] = {d123[i+j*xsize+k*xysize], d123[nexti+j*xsize+k*xysize], d123[i+nextj*xsize+k*xysize], d123[nexti+nextj*xsize+k*xysize], d123[i+j*xsize+nextk*xysize], d123[nexti+j*xsize+nextk*xysize], d123[i+nextj*xsize+nextk*xysize], d123[nexti+nextj*xsize+nextk*xysize]};
+                    for (int m = 0; m < 8; m++) {
+                        rhs[m] = e[m];
+                        rhs[m+8] = e1[m]*deltax;
+                        rhs[m+16] = e2[m]*deltay;
+                        rhs[m+24] = e3[m]*deltaz;
+                        rhs[m+32] = e12[m]*deltax*deltay;
+                        rhs[m+40] = e13[m]*deltax*deltaz;
+                        rhs[m+48] = e23[m]*deltay*deltaz;
+                        rhs[m+56] = e123[m]*deltax*deltay*deltaz;
+                    }
+                    vector<double>& coeff = c[i+j*(xsize-1)+k*(xsize-1)*(ysize-1)];
+                    coeff.resize(64);
+                    for (int m = 0; m < 64; m++) {
+                        double sum = 0.0;
+                        int numElements = weight[m].size();
+                        for (int n = 0; n < numElements; n += 2)
+                            sum += weight[m][n+1]*rhs[weight[m][n]];
+                        coeff[m] = sum;
+                    }
                 }
             }
         }
-    }
+    });
 }
 
 void SplineFitter::create3DNaturalSpline(const vector<double>& x, const vector<double>& y, const vector<double>& z, const vector<double>& values, vector<vector<double> >& c) {
@@ -30,7 +30,12 @@
  * -------------------------------------------------------------------------- */
 
 #include "openmm/internal/ThreadPool.h"
+#include "openmm/internal/TraceRange.h"
 #include "openmm/internal/hardware.h"
+#include <algorithm>
+#ifdef __linux__
+#include <sched.h>
+#endif
 
 using namespace std;
 
@@ -41,6 +46,7 @@ public:
     ThreadData(ThreadPool& owner, int index) : owner(owner), index(index), isDeleted(false) {
     }
     void executeTask() {
+        OPENMM_TRACE_RANGE("ThreadPool task");
         if (owner.currentTask != NULL)
             owner.currentTask->execute(owner, index);
         else
@@ -116,6 +122,46 @@ void ThreadPool::execute(function<void (ThreadPool&, int)> task) {
     resumeThreads();
 }
 
+void ThreadPool::execute(int numIndices, int chunkSize, function<void (ThreadPool&, int, int, int)> task) {
+    if (chunkSize < 1)
+        chunkSize = 1;
+    nextIndex = 0;
+    execute([this, numIndices, chunkSize, task] (ThreadPool& pool, int threadIndex) {
+        while (true) {
+            int start = nextIndex.fetch_add(chunkSize);
+            if (start >= numIndices)
+                break;
+            task(pool, threadIndex, start, min(start+chunkSize, numIndices));
+        }
+    });
+}
+
+bool ThreadPool::pinThreadsToCores() {
+#ifdef __linux__
+    cpu_set_t available;
+    if (sched_getaffinity(0, sizeof(available), &available) != 0)
+        return false;
+    vector<int> cores;
+    for (int i = 0; i < CPU_SETSIZE; i++)
+        if (CPU_ISSET(i, &available))
+            cores.push_back(i);
+    if (cores.size() == 0)
+        return false;
+    atomic<bool> success(true);
+    execute([&] (ThreadPool& pool, int threadIndex) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cores[threadIndex%cores.size()], &cpus);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0)
+            success = false;
+    });
+    waitForThreads();
+    return success;
+#else
+    return false;
+#endif
+}
+
 void ThreadPool::syncThreads() {
     pthread_mutex_lock(&lock);
     waitCount++;
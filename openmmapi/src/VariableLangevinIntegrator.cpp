@@ -34,6 +34,8 @@
 #include "openmm/OpenMMException.h"
 #include "openmm/internal/ContextImpl.h"
 #include "openmm/kernels.h"
+#include <algorithm>
+#include <cmath>
 #include <limits>
 #include <string>
 
@@ -77,20 +79,54 @@ double VariableLangevinIntegrator::computeKineticEnergy() {
 
 void VariableLangevinIntegrator::step(int steps) {
     if (context == NULL)
-        throw OpenMMException("This Integrator is not bound to a context!");  
+        throw OpenMMException("This Integrator is not bound to a context!");
+    IntegrateVariableLangevinStepKernel& stepKernel = kernel.getAs<IntegrateVariableLangevinStepKernel>();
+    if (stepKernel.supportsAsyncSteps()) {
+        // The step size is chosen on the device, so there is no need to wait for each step to finish.
+
+        if (steps < 1)
+            return;
+        for (int i = 0; i < steps; ++i) {
+            context->updateContextState();
+            context->calcForcesAndEnergy(true, false, getIntegrationForceGroups());
+            stepKernel.executeAsync(*context, *this, std::numeric_limits<double>::infinity());
+        }
+        setStepSize(stepKernel.synchronizeSteps(*context, *this));
+        return;
+    }
     for (int i = 0; i < steps; ++i) {
         context->updateContextState();
         context->calcForcesAndEnergy(true, false, getIntegrationForceGroups());
-        setStepSize(kernel.getAs<IntegrateVariableLangevinStepKernel>().execute(*context, *this, std::numeric_limits<double>::infinity()));
+        setStepSize(stepKernel.execute(*context, *this, std::numeric_limits<double>::infinity()));
     }
 }
 
 void VariableLangevinIntegrator::stepTo(double time) {
     if (context == NULL)
-        throw OpenMMException("This Integrator is not bound to a context!");
+        throw OpenMMException("This Integrator is not bound to a context!");  
+    IntegrateVariableLangevinStepKernel& stepKernel = kernel.getAs<IntegrateVariableLangevinStepKernel>();
+    if (stepKernel.supportsAsyncSteps()) {
+        // Estimate how many steps remain from the most recent step size, and take them in batches
+        // that are only checked once at the end.  Steps requested after the target time has been
+        // reached do nothing.
+
+        const int maxBatchSize = 100;
+        while (time > context->getTime()) {
+            int batchSize = 1;
+            if (getStepSize() > 0)
+                batchSize = (int) std::max(1.0, std::min((double) maxBatchSize, std::floor((time-context->getTime())/getStepSize())));
+            for (int i = 0; i < batchSize; ++i) {
+                context->updateContextState();
+                context->calcForcesAndEnergy(true, false, getIntegrationForceGroups());
+                stepKernel.executeAsync(*context, *this, time);
+            }
+            setStepSize(stepKernel.synchronizeSteps(*context, *this));
+        }
+        return;
+    }
     while (time > context->getTime()) {
         context->updateContextState();
         context->calcForcesAndEnergy(true, false, getIntegrationForceGroups());
-        setStepSize(kernel.getAs<IntegrateVariableLangevinStepKernel>().execute(*context, *this, time));
+        setStepSize(stepKernel.execute(*context, *this, time));
     }
 }
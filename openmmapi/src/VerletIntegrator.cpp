@@ -68,12 +68,18 @@ double VerletIntegrator::computeKineticEnergy() {
     return kernel.getAs<IntegrateVerletStepKernel>().computeKineticEnergy(*context, *this);
 }
 
+bool VerletIntegrator::reusesForces() const {
+    return true;
+}
+
 void VerletIntegrator::step(int steps) {
     if (context == NULL)
         throw OpenMMException("This Integrator is not bound to a context!");
     for (int i = 0; i < steps; ++i) {
         context->updateContextState();
-        context->calcForcesAndEnergy(true, false, getIntegrationForceGroups());
+        if (!context->hasValidForces(getIntegrationForceGroups()))
+            context->calcForcesAndEnergy(true, false, getIntegrationForceGroups());
         kernel.getAs<IntegrateVerletStepKernel>().execute(*context, *this);
+        context->invalidateForces();
     }
 }
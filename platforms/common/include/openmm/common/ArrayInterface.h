@@ -120,6 +120,16 @@ public:
             throw OpenMMException("Error uploading array "+getName()+": The specified vector does not match the size of the array");
         upload(&data[0], true);
     }
+    /**
+     * Copy the values in a vector to the device memory, and allow the memory to be shared with other
+     * arrays holding identical contents.  See uploadShared(const void*) for details.
+     */
+    template <class T>
+    void uploadShared(const std::vector<T>& data) {
+        if (sizeof(T) != getElementSize() || data.size() != getSize())
+            throw OpenMMException("Error uploading array "+getName()+": The specified vector does not match the size of the array");
+        uploadShared(&data[0]);
+    }
     /**
      * Copy the values in the array to a vector.
      */
@@ -140,6 +150,29 @@ public:
      *                 in page-locked memory.
      */
     virtual void upload(const void* data, bool blocking=true) = 0;
+    /**
+     * Copy values from host memory to a contiguous range of elements in the array.
+     * 
+     * @param data     the data to copy
+     * @param offset   the index of the first element to copy to
+     * @param elements the number of elements to copy
+     * @param blocking if true, this call will block until the transfer is complete.  Subclasses often
+     *                 have restrictions on non-blocking copies, such as that the source data must be
+     *                 in page-locked memory.
+     */
+    virtual void uploadSubArray(const void* data, int offset, int elements, bool blocking=true) = 0;
+    /**
+     * Copy values from host memory to the array, and allow the device memory to be shared with other
+     * arrays that hold identical contents, such as the same array in another Context created from the
+     * same System.  This should only be used for arrays that kernels never write to.  If the array is
+     * later modified with upload(), uploadSubArray(), or copyTo(), it first gets its own copy of the
+     * memory, so other arrays are not affected.  The default implementation simply calls upload().
+     *
+     * @param data     the data to copy
+     */
+    virtual void uploadShared(const void* data) {
+        upload(data, true);
+    }
     /**
      * Copy the values in the array to host memory.
      * 
@@ -97,7 +97,9 @@ public:
      * Add an argument that should be passed to the interaction kernel.
      * 
      * @param data    the array containing the data to pass
-     * @param type    the data type contained in the memory (e.g. "float4")
+     * @param type    the data type contained in the memory (e.g. "float4").  If it begins with "const "
+     *                (e.g. "const float4"), the data is only read by the kernel, and the argument is declared
+     *                restrict so the compiler can load it through the read-only cache.
      * @return the name that will be used for the argument.  Any code you pass to addInteraction() should
      * refer to it by this name.
      */
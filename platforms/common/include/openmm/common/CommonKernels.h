@@ -33,6 +33,7 @@
 #include "openmm/Platform.h"
 #include "openmm/kernels.h"
 #include "openmm/internal/CompiledExpressionSet.h"
+#include "openmm/internal/CustomNonbondedForceImpl.h"
 #include "openmm/internal/CustomIntegratorUtilities.h"
 #include "lepton/CompiledExpression.h"
 
@@ -249,7 +250,9 @@ private:
     ComputeContext& cc;
     ForceInfo* info;
     const System& system;
+    std::vector<int> termOrder;
     ComputeArray params;
+    ComputeArray termRanges;
 };
 
 /**
@@ -378,9 +381,9 @@ private:
     ForceInfo* info;
     const System& system;
     std::vector<mm_int2> mapPositionsVec;
+    std::vector<int> torsionOrder;
     ComputeArray coefficients;
-    ComputeArray mapPositions;
-    ComputeArray torsionMaps;
+    ComputeArray torsionMapPositions;
 };
 
 /**
@@ -509,18 +512,18 @@ public:
 
 private:
     class ForceInfo;
-    int numGroups, numBonds;
+    int numGroups, numSegments, numBonds;
     bool needEnergyParamDerivs;
     ComputeContext& cc;
     ForceInfo* info;
     ComputeParameterSet* params;
-    ComputeArray globals, groupParticles, groupWeights, groupOffsets;
-    ComputeArray groupForces, bondGroups, centerPositions;
+    ComputeArray globals, groupParticles, groupWeights, segmentOffsets, segmentGroups, groupSegmentOffsets;
+    ComputeArray groupForces, bondGroups, centerPositions, segmentCenters;
     std::vector<std::string> globalParamNames;
     std::vector<float> globalParamValues;
     std::vector<ComputeArray> tabulatedFunctions;
     std::vector<void*> groupForcesArgs;
-    ComputeKernel computeCentersKernel, groupForcesKernel, applyForcesKernel;
+    ComputeKernel computeCentersKernel, sumCentersKernel, groupForcesKernel, applyForcesKernel;
     const System& system;
 };
 
@@ -556,6 +559,15 @@ public:
      * @param force      the CustomNonbondedForce to copy the parameters from
      */
     void copyParametersToContext(ContextImpl& context, const CustomNonbondedForce& force);
+    /**
+     * Copy changed parameters over to a context, when only a range of particles may have changed.
+     *
+     * @param context         the context to copy parameters to
+     * @param force           the CustomNonbondedForce to copy the parameters from
+     * @param firstParticle   the index of the first particle whose parameters might have changed
+     * @param lastParticle    the index of the last particle whose parameters might have changed
+     */
+    void copyParameterRangeToContext(ContextImpl& context, const CustomNonbondedForce& force, int firstParticle, int lastParticle);
 private:
     class ForceInfo;
     void initInteractionGroups(const CustomNonbondedForce& force, const std::string& interactionSource, const std::vector<std::string>& tableTypes);
@@ -573,6 +585,7 @@ private:
     bool hasInitializedLongRangeCorrection, hasInitializedKernel, hasParamDerivs, useNeighborList;
     int numGroupThreadBlocks;
     CustomNonbondedForce* forceCopy;
+    CustomNonbondedForceImpl::LongRangeCorrectionData longRangeCorrectionData;
     const System& system;
 };
 
@@ -654,7 +667,7 @@ private:
     class ForceInfo;
     double cutoff;
     bool hasInitializedKernels, needParameterGradient, needEnergyParamDerivs;
-    int maxTiles, numComputedValues;
+    int maxTiles, maxSinglePairs, numComputedValues;
     ComputeContext& cc;
     ForceInfo* info;
     ComputeParameterSet* params;
@@ -708,6 +721,11 @@ public:
     void copyParametersToContext(ContextImpl& context, const CustomHbondForce& force);
 private:
     class ForceInfo;
+    /**
+     * Compile the kernels from the generated source.  If global parameters are being specialized,
+     * their current values are compiled in as constants.
+     */
+    void compileKernels();
     int numDonors, numAcceptors;
     bool hasInitializedKernel;
     ComputeContext& cc;
@@ -721,11 +739,17 @@ private:
     ComputeArray acceptorBufferIndices;
     ComputeArray donorExclusions;
     ComputeArray acceptorExclusions;
+    ComputeArray donorBlockCenter;
+    ComputeArray donorBlockBoundingBox;
+    ComputeArray acceptorBlockCenter;
+    ComputeArray acceptorBlockBoundingBox;
     std::vector<std::string> globalParamNames;
     std::vector<float> globalParamValues;
     std::vector<ComputeArray> tabulatedFunctions;
     const System& system;
-    ComputeKernel donorKernel, acceptorKernel;
+    std::string kernelSource;
+    std::map<std::string, std::string> kernelDefines;
+    ComputeKernel donorKernel, acceptorKernel, donorBoundsKernel, acceptorBoundsKernel;
 };
 
 /**
@@ -769,7 +793,7 @@ private:
     NonbondedMethod nonbondedMethod;
     int maxNeighborPairs, forceWorkgroupSize, findNeighborsWorkgroupSize;
     ComputeParameterSet* params;
-    ComputeArray globals, particleTypes,  orderIndex, particleOrder;
+    ComputeArray globals, particleTypes,  orderIndex, particleOrder, typePairAllowed;
     ComputeArray exclusions, exclusionStartIndex, blockCenter, blockBoundingBox;
     ComputeArray neighborPairs, numNeighborPairs, neighborStartIndex, numNeighborsForAtom, neighbors;
     std::vector<std::string> globalParamNames;
@@ -824,11 +848,12 @@ private:
     ComputeArray aMatrix, bMatrix, gMatrix;
     ComputeArray exclusions, exclusionStartIndex, blockCenter, blockBoundingBox;
     ComputeArray neighbors, neighborIndex, neighborBlockCount;
-    ComputeArray sortedPos, torque;
+    ComputeArray sortedPos, torque, oldPositions, rebuildNeighborList;
+    Vec3 lastBoxVectors[3];
     std::vector<bool> isRealParticle;
     std::vector<std::pair<int, int> > exceptionAtoms;
     std::vector<std::pair<int, int> > excludedPairs;
-    ComputeKernel framesKernel, blockBoundsKernel, neighborsKernel, forceKernel, torqueKernel;
+    ComputeKernel framesKernel, blockBoundsKernel, prepareNeighborsKernel, neighborsKernel, forceKernel, torqueKernel;
     ComputeEvent event;
 };
 
@@ -863,7 +888,7 @@ public:
     double computeKineticEnergy(ContextImpl& context, const VerletIntegrator& integrator);
 private:
     ComputeContext& cc;
-    bool hasInitializedKernels;
+    bool hasInitializedKernels, fuseSettle;
     ComputeKernel kernel1, kernel2;
 };
 
@@ -933,14 +958,78 @@ public:
      * @param integrator the LangevinMiddleIntegrator this kernel is being used for
      */
     double computeKineticEnergy(ContextImpl& context, const LangevinMiddleIntegrator& integrator);
-private:
+protected:
+    /**
+     * Launch the sequence of kernels that advances the system by one time step.  Platforms
+     * may override this to change how the kernels are launched.
+     *
+     * @param tolerance    the constraint tolerance
+     */
+    virtual void integrate(double tolerance);
     ComputeContext& cc;
     double prevTemp, prevFriction, prevStepSize;
-    bool hasInitializedKernels;
+    bool hasInitializedKernels, fuseSettle;
     ComputeArray params, oldDelta;
     ComputeKernel kernel1, kernel2, kernel3;
 };
 
+/**
+ * This kernel is invoked by MTSLangevinIntegrator to take one time step.
+ */
+class CommonIntegrateMTSLangevinStepKernel : public IntegrateMTSLangevinStepKernel {
+public:
+    CommonIntegrateMTSLangevinStepKernel(std::string name, const Platform& platform, ComputeContext& cc) : IntegrateMTSLangevinStepKernel(name, platform), cc(cc),
+            hasInitializedKernels(false) {
+    }
+    /**
+     * Initialize the kernel, setting up the particle masses.
+     * 
+     * @param system     the System this kernel will be applied to
+     * @param integrator the MTSLangevinIntegrator this kernel will be used for
+     */
+    void initialize(const System& system, const MTSLangevinIntegrator& integrator);
+    /**
+     * Update the velocities based on the forces currently stored in the context, then apply
+     * velocity constraints.
+     * 
+     * @param context    the context in which to execute this kernel
+     * @param integrator the MTSLangevinIntegrator this kernel is being used for
+     * @param dt         the time interval over which to apply the forces
+     */
+    void kick(ContextImpl& context, const MTSLangevinIntegrator& integrator, double dt);
+    /**
+     * Perform the innermost substep: a position half step, interaction with the heat bath,
+     * and another position half step, followed by applying constraints.
+     * 
+     * @param context    the context in which to execute this kernel
+     * @param integrator the MTSLangevinIntegrator this kernel is being used for
+     * @param dt         the size of the innermost substep
+     */
+    void drift(ContextImpl& context, const MTSLangevinIntegrator& integrator, double dt);
+    /**
+     * Finish a time step after all substeps have been performed.
+     * 
+     * @param context        the context in which to execute this kernel
+     * @param integrator     the MTSLangevinIntegrator this kernel is being used for
+     * @param forcesAreValid this will be set to false if the forces currently stored in the
+     *                       context can no longer be used
+     */
+    void finishStep(ContextImpl& context, const MTSLangevinIntegrator& integrator, bool& forcesAreValid);
+    /**
+     * Compute the kinetic energy.
+     * 
+     * @param context    the context in which to execute this kernel
+     * @param integrator the MTSLangevinIntegrator this kernel is being used for
+     */
+    double computeKineticEnergy(ContextImpl& context, const MTSLangevinIntegrator& integrator);
+private:
+    void initializeKernels();
+    ComputeContext& cc;
+    bool hasInitializedKernels;
+    ComputeArray oldDelta;
+    ComputeKernel kickKernel, driftKernel, positionsKernel;
+};
+
 /*
  * This kernel is invoked by NoseHooverIntegrator to take one time step.
  */
@@ -949,7 +1038,8 @@ public:
     CommonIntegrateNoseHooverStepKernel(std::string name, const Platform& platform, ComputeContext& cc) :
                                   IntegrateNoseHooverStepKernel(name, platform), cc(cc), hasInitializedKernels(false),
                                   hasInitializedKineticEnergyKernel(false), hasInitializedHeatBathEnergyKernel(false),
-                                  hasInitializedScaleVelocitiesKernel(false), hasInitializedPropagateKernel(false) {}
+                                  hasInitializedScaleVelocitiesKernel(false), hasInitializedPropagateKernel(false),
+                                  hasInitializedChainKernels(false) {}
     ~CommonIntegrateNoseHooverStepKernel() {}
     /**
      * Initialize the kernel.
@@ -1034,10 +1124,29 @@ public:
      */
     void setChainStates(ContextImpl& context, const std::vector<std::vector<double> >& positions, const std::vector<std::vector<double> >& velocities);
 private:
+    /**
+     * Get the offset of a chain's state within chainStates, allocating it (initialized to zero) if
+     * it does not already exist with the specified length.  The key is 2*chainID for the absolute
+     * chain and 2*chainID+1 for the relative one.
+     */
+    int getChainStateOffset(int key, int chainLength);
+    /**
+     * Download the states of all chains, indexed by key.
+     */
+    void downloadChainStates(std::map<int, std::vector<mm_double2> >& states) const;
+    /**
+     * Replace the states of all chains and rebuild the layout of chainStates.
+     */
+    void uploadChainStates(const std::map<int, std::vector<mm_double2> >& states);
+    /**
+     * Apply all thermostats with a fixed number of kernel launches, independent of the number of chains.
+     */
+    void applyThermostats(const NoseHooverIntegrator& integrator, double timeStep);
     ComputeContext& cc;
     float prevMaxPairDistance;
     ComputeArray maxPairDistanceBuffer, pairListBuffer, atomListBuffer, pairTemperatureBuffer, oldDelta;
-    std::map<int, ComputeArray> chainState;
+    ComputeArray chainStates;
+    std::map<int, std::pair<int, int> > chainStateRange;
     ComputeKernel kernel1, kernel2, kernel3, kernel4, kernelHardWall;
     bool hasInitializedKernels;
     ComputeKernel reduceEnergyKernel;
@@ -1046,13 +1155,20 @@ private:
     ComputeKernel computePairsKineticEnergyKernel;
     ComputeKernel scaleAtomsVelocitiesKernel;
     ComputeKernel scalePairsVelocitiesKernel;
-    ComputeArray energyBuffer, scaleFactorBuffer, kineticEnergyBuffer, chainMasses, chainForces, heatBathEnergy;
+    ComputeArray energyBuffer, scaleFactorBuffer, kineticEnergyBuffer, chainForces, heatBathEnergy;
     std::map<int, ComputeArray> atomlists, pairlists;
-    std::map<int, ComputeKernel> propagateKernels;
+    ComputeKernel propagateKernel;
+    ComputeKernel computeChainKineticEnergiesKernel, propagateChainsKernel, scaleChainVelocitiesKernel;
+    ComputeArray chainAtoms, chainAtomStart, chainAtomIndex, chainPairs, chainPairStart, chainPairIndex;
+    ComputeArray chainInfo, chainDOFs, chainParams, chainScaleFactors, chainEnergyBuffer;
+    std::vector<int> lastChainInfo;
+    std::vector<double> lastChainParams;
+    int groupsPerChain;
     bool hasInitializedPropagateKernel;
     bool hasInitializedKineticEnergyKernel;
     bool hasInitializedHeatBathEnergyKernel;
     bool hasInitializedScaleVelocitiesKernel;
+    bool hasInitializedChainKernels;
 };
 
 /**
@@ -1088,7 +1204,8 @@ private:
     ComputeContext& cc;
     double prevTemp, prevFriction, prevStepSize;
     bool hasInitializedKernels;
-    ComputeKernel kernel1, kernel2;
+    bool useFusedKernel;
+    ComputeKernel kernel1, kernel2, fusedKernel;
 };
 
 /**
@@ -1115,6 +1232,29 @@ public:
      * @return the size of the step that was taken
      */
     double execute(ContextImpl& context, const VariableVerletIntegrator& integrator, double maxTime);
+    /**
+     * Get whether this kernel supports executeAsync() and synchronizeSteps().
+     */
+    bool supportsAsyncSteps() const {
+        return true;
+    }
+    /**
+     * Take a step without waiting for it to complete.  The step size is selected on the device, and
+     * once maxTime has been reached further steps do nothing until synchronizeSteps() is called.
+     *
+     * @param context    the context in which to execute this kernel
+     * @param integrator the VariableVerletIntegrator this kernel is being used for
+     * @param maxTime    the maximum time beyond which the simulation should not be advanced
+     */
+    void executeAsync(ContextImpl& context, const VariableVerletIntegrator& integrator, double maxTime);
+    /**
+     * Wait for all steps started by executeAsync() to complete and update the time and step count.
+     *
+     * @param context    the context in which to execute this kernel
+     * @param integrator the VariableVerletIntegrator this kernel is being used for
+     * @return the size of the most recent step that was taken
+     */
+    double synchronizeSteps(ContextImpl& context, const VariableVerletIntegrator& integrator);
     /**
      * Compute the kinetic energy.
      * 
@@ -1126,6 +1266,8 @@ private:
     ComputeContext& cc;
     bool hasInitializedKernels;
     int blockSize;
+    double asyncMaxTime;
+    ComputeArray stepState;
     ComputeKernel kernel1, kernel2, selectSizeKernel;
 };
 
@@ -1153,6 +1295,29 @@ public:
      * @return the size of the step that was taken
      */
     double execute(ContextImpl& context, const VariableLangevinIntegrator& integrator, double maxTime);
+    /**
+     * Get whether this kernel supports executeAsync() and synchronizeSteps().
+     */
+    bool supportsAsyncSteps() const {
+        return true;
+    }
+    /**
+     * Take a step without waiting for it to complete.  The step size is selected on the device, and
+     * once maxTime has been reached further steps do nothing until synchronizeSteps() is called.
+     *
+     * @param context    the context in which to execute this kernel
+     * @param integrator the VariableLangevinIntegrator this kernel is being used for
+     * @param maxTime    the maximum time beyond which the simulation should not be advanced
+     */
+    void executeAsync(ContextImpl& context, const VariableLangevinIntegrator& integrator, double maxTime);
+    /**
+     * Wait for all steps started by executeAsync() to complete and update the time and step count.
+     *
+     * @param context    the context in which to execute this kernel
+     * @param integrator the VariableLangevinIntegrator this kernel is being used for
+     * @return the size of the most recent step that was taken
+     */
+    double synchronizeSteps(ContextImpl& context, const VariableLangevinIntegrator& integrator);
     /**
      * Compute the kinetic energy.
      * 
@@ -1164,7 +1329,8 @@ private:
     ComputeContext& cc;
     bool hasInitializedKernels;
     int blockSize;
-    ComputeArray params;
+    double asyncMaxTime;
+    ComputeArray params, stepState;
     ComputeKernel kernel1, kernel2, selectSizeKernel;
     double prevTemp, prevFriction, prevErrorTol;
 };
@@ -1176,7 +1342,7 @@ class CommonIntegrateCustomStepKernel : public IntegrateCustomStepKernel {
 public:
     enum GlobalTargetType {DT, VARIABLE, PARAMETER};
     CommonIntegrateCustomStepKernel(std::string name, const Platform& platform, ComputeContext& cc) : IntegrateCustomStepKernel(name, platform), cc(cc),
-            hasInitializedKernels(false), needsEnergyParamDerivs(false) {
+            hasInitializedKernels(false), needsEnergyParamDerivs(false), hostGlobalsAreCurrent(true) {
     }
     /**
      * Initialize the kernel.
@@ -1250,11 +1416,12 @@ private:
     void recordGlobalValue(double value, GlobalTarget target, CustomIntegrator& integrator);
     void recordChangedParameters(ContextImpl& context);
     bool evaluateCondition(int step);
+    void downloadGlobalValues();
     ComputeContext& cc;
     double energy;
     float energyFloat;
     int numGlobalVariables, sumWorkGroupSize;
-    bool hasInitializedKernels, deviceGlobalsAreCurrent, modifiesParameters, hasAnyConstraints, needsEnergyParamDerivs;
+    bool hasInitializedKernels, deviceGlobalsAreCurrent, modifiesParameters, hasAnyConstraints, needsEnergyParamDerivs, hostGlobalsAreCurrent;
     std::vector<bool> deviceValuesAreCurrent;
     mutable std::vector<bool> localValuesAreCurrent;
     ComputeArray globalValues, sumBuffer, summedValue;
@@ -1277,7 +1444,7 @@ private:
     std::vector<std::vector<Lepton::CompiledExpression> > globalExpressions;
     CompiledExpressionSet expressionSet;
     std::vector<bool> needsGlobals, needsForces, needsEnergy;
-    std::vector<bool> computeBothForceAndEnergy, invalidatesForces, merged;
+    std::vector<bool> computeBothForceAndEnergy, invalidatesForces, merged, globalOnDevice;
     std::vector<int> forceGroupFlags, blockEnd, requiredGaussian, requiredUniform;
     std::vector<int> stepEnergyVariableIndex, globalVariableIndex, parameterVariableIndex;
     int gaussianVariableIndex, uniformVariableIndex, dtVariableIndex;
@@ -1300,7 +1467,8 @@ public:
  */
 class CommonRemoveCMMotionKernel : public RemoveCMMotionKernel {
 public:
-    CommonRemoveCMMotionKernel(std::string name, const Platform& platform, ComputeContext& cc) : RemoveCMMotionKernel(name, platform), cc(cc) {
+    CommonRemoveCMMotionKernel(std::string name, const Platform& platform, ComputeContext& cc) : RemoveCMMotionKernel(name, platform), cc(cc),
+            hasMeasuredMomentum(false), currentMomentum(0) {
     }
     /**
      * Initialize the kernel, setting up the particle masses.
@@ -1318,8 +1486,10 @@ public:
 private:
     ComputeContext& cc;
     int frequency;
-    ComputeArray cmMomentum;
-    ComputeKernel kernel1, kernel2;
+    ComputeArray cmMomentum[2];
+    ComputeKernel kernel1, removeKernel[2];
+    bool hasMeasuredMomentum;
+    int currentMomentum;
 };
 
 /**
@@ -1349,12 +1519,6 @@ public:
      * @return the potential energy due to the force
      */
     double execute(ContextImpl& context, bool includeForces, bool includeEnergy);
-    /**
-     * This is the internal implementation of execute(), templatized on whether we're
-     * using single or double precision.
-     */
-    template <class REAL>
-    double executeImpl(ContextImpl& context);
     /**
      * Copy changed parameters over to a context.
      *
@@ -1399,6 +1563,197 @@ private:
     ComputeKernel kernel;
 };
 
+/**
+ * This kernel is invoked by LocalEnergyMinimizer to minimize the energy of the system.  It performs
+ * L-BFGS minimization with all vectors kept on the device, so only scalars need to be transferred
+ * to the host during the minimization.
+ */
+class CommonMinimizeKernel : public MinimizeKernel {
+public:
+    CommonMinimizeKernel(std::string name, const Platform& platform, ComputeContext& cc) : MinimizeKernel(name, platform), cc(cc) {
+    }
+    /**
+     * Initialize the kernel.
+     * 
+     * @param system     the System this kernel will be applied to
+     */
+    void initialize(const System& system);
+    /**
+     * Minimize the energy, starting from the current positions.
+     * 
+     * @param context        the context in which to execute this kernel
+     * @param tolerance      the convergence tolerance, measured in kJ/mol/nm
+     * @param maxIterations  the maximum number of iterations to perform.  If this is 0, minimization
+     *                       is continued until the results converge.
+     * @return true if the minimization was performed, or false if it could not be done by this kernel
+     */
+    bool execute(ContextImpl& context, double tolerance, int maxIterations);
+private:
+    void updateConstraints();
+    bool minimizeWithRestraints(ContextImpl& context, double k, double epsilon, int maxIterations);
+    bool evaluate(ContextImpl& context, double& energy);
+    void computeSearchDirection(int slot, int numHistory);
+    double computeMaxConstraintError();
+    void setPositions(ComputeArray& base, double step);
+    void downloadValues(const ComputeArray& array, std::vector<double>& values);
+    ComputeContext& cc;
+    const System* system;
+    bool useDouble;
+    int blockSize, numBlocks;
+    std::vector<int> atomOrder;
+    std::vector<double> results;
+    ComputeArray pos, grad, basePos, baseGrad, initialPos, dir, s, y;
+    ComputeArray dotMatrix, coefficients, resultsArray, partialSums, dotPartialSums;
+    ComputeArray constraintStart, constraintPartner, constraintDistance, constraintAtoms, constraintAtomDistance;
+    ComputeKernel recordPositionsKernel, updatePositionsKernel, gradientKernel, constraintErrorKernel, acceptStepKernel;
+    ComputeKernel dotProductsKernel, searchDirectionKernel, updateDirectionKernel;
+};
+
+/**
+ * This kernel is invoked by ReplicaExchange to exchange the positions and velocities of two contexts
+ * with device to device copies.  It can only be used when both contexts' arrays are accessible to
+ * the same device context, so subclasses decide which contexts are compatible.
+ */
+class CommonSwapStateKernel : public SwapStateKernel {
+public:
+    CommonSwapStateKernel(std::string name, const Platform& platform, ComputeContext& cc) : SwapStateKernel(name, platform), cc(cc) {
+    }
+    /**
+     * Initialize the kernel.
+     * 
+     * @param system     the System this kernel will be applied to
+     */
+    void initialize(const System& system);
+    /**
+     * Exchange the positions and velocities of the particles in two Contexts.
+     * 
+     * @param context        the context in which to execute this kernel
+     * @param other          the context to exchange positions and velocities with
+     * @param velocityScale  the velocities moved into context are multiplied by this, and the
+     *                       velocities moved into other are divided by it
+     * @return true if the exchange was performed, or false if it could not be done by this kernel
+     */
+    bool execute(ContextImpl& context, ContextImpl& other, double velocityScale);
+protected:
+    /**
+     * Get the ComputeContext for another context, or NULL if its arrays cannot be used in kernels
+     * launched by this one.
+     */
+    virtual ComputeContext* getComputeContext(ContextImpl& other) = 0;
+private:
+    ComputeContext& cc;
+    ComputeArray invAtomOrder;
+    ComputeKernel inverseOrderKernel, swapKernel;
+};
+
+/**
+ * This kernel is invoked by Context to get or set the positions of a subset of the particles.  The
+ * particles are gathered into (or scattered from) a compact array on the device, so only the data for
+ * the subset needs to be transferred.
+ */
+class CommonParticleSubsetKernel : public ParticleSubsetKernel {
+public:
+    CommonParticleSubsetKernel(std::string name, const Platform& platform, ComputeContext& cc) : ParticleSubsetKernel(name, platform), cc(cc) {
+    }
+    ~CommonParticleSubsetKernel();
+    /**
+     * Initialize the kernel.
+     * 
+     * @param system     the System this kernel will be applied to
+     */
+    void initialize(const System& system);
+    /**
+     * Add a subset of particles.  Subsets are identified by the order in which they are added, starting from 0.
+     * 
+     * @param context     the context in which to execute this kernel
+     * @param particles   the indices of the particles in the subset
+     */
+    void addSubset(ContextImpl& context, const std::vector<int>& particles);
+    /**
+     * Get the positions of the particles in a subset.
+     * 
+     * @param context     the context in which to execute this kernel
+     * @param subset      the index of the subset
+     * @param positions   on exit, this contains the position of each particle in the subset
+     */
+    void getPositions(ContextImpl& context, int subset, std::vector<Vec3>& positions);
+    /**
+     * Set the positions of the particles in a subset.  All other particles are left unchanged.
+     * 
+     * @param context     the context in which to execute this kernel
+     * @param subset      the index of the subset
+     * @param positions   the position of each particle in the subset
+     */
+    void setPositions(ContextImpl& context, int subset, const std::vector<Vec3>& positions);
+private:
+    struct SubsetInfo;
+    ComputeContext& cc;
+    std::vector<SubsetInfo*> subsets;
+    ComputeArray invAtomOrder;
+    ComputeKernel inverseOrderKernel, gatherKernel, scatterKernel;
+};
+
+/**
+ * This kernel is invoked by Context to save and restore snapshots of the positions and velocities.  Each
+ * snapshot is held in device arrays, so saving or restoring one is a device to device copy.
+ */
+class CommonStateSnapshotKernel : public StateSnapshotKernel {
+public:
+    CommonStateSnapshotKernel(std::string name, const Platform& platform, ComputeContext& cc) : StateSnapshotKernel(name, platform), cc(cc) {
+    }
+    ~CommonStateSnapshotKernel();
+    /**
+     * Initialize the kernel.
+     * 
+     * @param system     the System this kernel will be applied to
+     */
+    void initialize(const System& system);
+    /**
+     * Save the current positions and velocities into a slot, replacing anything that was saved there before.
+     * 
+     * @param context     the context in which to execute this kernel
+     * @param slot        the index of the slot to save to
+     */
+    void save(ContextImpl& context, int slot);
+    /**
+     * Restore the positions and velocities that were saved in a slot.
+     * 
+     * @param context     the context in which to execute this kernel
+     * @param slot        the index of the slot to restore from
+     */
+    void restore(ContextImpl& context, int slot);
+private:
+    struct SnapshotInfo;
+    ComputeContext& cc;
+    std::map<int, SnapshotInfo*> snapshots;
+    ComputeKernel inverseOrderKernel, restoreKernel;
+};
+
+/**
+ * This kernel is invoked by Context to multiply all velocities by a constant factor on the device.
+ */
+class CommonScaleVelocitiesKernel : public ScaleVelocitiesKernel {
+public:
+    CommonScaleVelocitiesKernel(std::string name, const Platform& platform, ComputeContext& cc) : ScaleVelocitiesKernel(name, platform), cc(cc) {
+    }
+    /**
+     * Initialize the kernel.
+     * 
+     * @param system     the System this kernel will be applied to
+     */
+    void initialize(const System& system);
+    /**
+     * Multiply the velocities of all particles by a constant factor.
+     * 
+     * @param context     the context in which to execute this kernel
+     * @param scale       the factor to multiply every velocity by
+     */
+    void execute(ContextImpl& context, double scale);
+private:
+    ComputeContext& cc;
+    ComputeKernel kernel;
+};
+
 } // namespace OpenMM
 
 #endif /*OPENMM_COMMONKERNELS_H_*/
@@ -103,6 +103,14 @@ public:
     void upload(const std::vector<T>& data, bool convert=false) {
         ArrayInterface::upload(data, convert);
     }
+    /**
+     * Copy the values in a vector to the Buffer, and allow the memory to be shared with other arrays
+     * holding identical contents.
+     */
+    template <class T>
+    void uploadShared(const std::vector<T>& data) {
+        ArrayInterface::uploadShared(data);
+    }
     /**
      * Copy the values in the Buffer to a vector.
      */
@@ -119,6 +127,24 @@ public:
      *                 in page-locked memory.
      */
     void upload(const void* data, bool blocking=true);
+    /**
+     * Copy values from host memory to a contiguous range of elements in the array.
+     * 
+     * @param data     the data to copy
+     * @param offset   the index of the first element to copy to
+     * @param elements the number of elements to copy
+     * @param blocking if true, this call will block until the transfer is complete.  Subclasses often
+     *                 have restrictions on non-blocking copies, such as that the source data must be
+     *                 in page-locked memory.
+     */
+    void uploadSubArray(const void* data, int offset, int elements, bool blocking=true);
+    /**
+     * Copy values from host memory to the array, and allow the memory to be shared with other arrays
+     * holding identical contents.  This should only be used for arrays that kernels never write to.
+     *
+     * @param data     the data to copy
+     */
+    void uploadShared(const void* data);
     /**
      * Copy the values in the array to host memory.
      * 
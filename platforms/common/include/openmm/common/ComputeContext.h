@@ -32,6 +32,7 @@
     #define NOMINMAX
 #endif
 #include "openmm/common/ArrayInterface.h"
+#include "openmm/common/ComputeArray.h"
 #include "openmm/common/BondedUtilities.h"
 #include "openmm/common/ComputeEvent.h"
 #include "openmm/common/ComputeForceInfo.h"
@@ -444,7 +445,77 @@ public:
      * expense of reduced simulation performance.
      */
     virtual void flushQueue() = 0;
+    /**
+     * Get whether the time spent executing each kernel is being recorded.
+     */
+    bool getProfilingEnabled() const {
+        return profilingEnabled;
+    }
+    /**
+     * Set whether to record the time spent executing each kernel.  Enabling profiling discards any
+     * times that were previously recorded.
+     */
+    virtual void setProfilingEnabled(bool enabled);
+    /**
+     * Get whether kernels should be specialized on the current values of global parameters.  When this
+     * is true, forces that support it compile each global parameter's value into their kernels as a
+     * constant, and recompile them whenever a value changes.
+     */
+    bool getSpecializeGlobalParameters() const {
+        return specializeGlobalParameters;
+    }
+    /**
+     * Set whether kernels should be specialized on the current values of global parameters.  This must
+     * be called before any kernels are created.
+     */
+    void setSpecializeGlobalParameters(bool specialize) {
+        specializeGlobalParameters = specialize;
+    }
+    /**
+     * Set which force groups kernels launched from now on should be attributed to while profiling.
+     *
+     * @param groups    a set of bit flags for the force groups, or 0 if the work does not belong to any force group
+     */
+    void setProfiledForceGroups(int groups) {
+        profiledForceGroups = groups;
+    }
+    /**
+     * Get the times that have been recorded since profiling was enabled.  See Context::getPerformanceReport()
+     * for a description of the contents.
+     */
+    virtual void getPerformanceReport(std::map<std::string, double>& report);
+    /**
+     * Set the owner that arrays allocated from now on should be attributed to in the memory usage
+     * report.  An array keeps the owner it was first allocated with, even if it is later resized.
+     */
+    void setMemoryOwner(const std::string& owner) {
+        memoryOwner = owner;
+    }
+    /**
+     * Record that device memory has been allocated for an array.  Array implementations call this every
+     * time they allocate memory, including when an array is resized.
+     *
+     * @param array     the array the memory was allocated for
+     * @param name      the name of the array
+     * @param bytes     the number of bytes that were allocated
+     */
+    void recordArrayAllocation(const ArrayInterface* array, const std::string& name, long long bytes);
+    /**
+     * Record that the device memory allocated for an array has been freed.
+     */
+    void recordArrayRelease(const ArrayInterface* array);
+    /**
+     * Add the device memory currently allocated for arrays on this context to a map.  The keys are
+     * "memory:<owner>" for the total bytes used by each owner, "memory:<owner>:<name>" for the bytes
+     * used by all arrays with a given name, and "memory:total" for the total over all arrays.  Values
+     * are added to any that are already present, so this can be used to sum over several contexts.
+     */
+    void getMemoryUsage(std::map<std::string, double>& usage) const;
 protected:
+    struct ArrayAllocation {
+        std::string owner, name;
+        long long bytes;
+    };
     struct Molecule;
     struct MoleculeGroup;
     class VirtualSiteInfo;
@@ -454,10 +525,24 @@ protected:
      */
     template <class Real, class Real4, class Mixed, class Mixed4>
     void reorderAtomsImpl();
+    /**
+     * Record the time spent executing a kernel.  Subclasses call this for every kernel they execute
+     * while profiling is enabled.
+     *
+     * @param kernel    the name of the kernel
+     * @param groups    the force groups the kernel was attributed to when it was launched
+     * @param time      the execution time in milliseconds
+     */
+    void recordKernelTime(const std::string& kernel, int groups, double time);
     const System& system;
     double time;
     int numAtoms, paddedNumAtoms, stepCount, computeForceCount, stepsSinceReorder;
-    bool atomsWereReordered, forcesValid;
+    bool atomsWereReordered, forcesValid, moleculesChanged, profilingEnabled, specializeGlobalParameters;
+    int profiledForceGroups;
+    std::map<std::string, double> profiledKernelTimes;
+    std::map<int, double> profiledGroupTimes;
+    std::string memoryOwner;
+    std::map<const ArrayInterface*, ArrayAllocation> arrayAllocations;
     std::vector<ComputeForceInfo*> forces;
     std::vector<Molecule> molecules;
     std::vector<MoleculeGroup> moleculeGroups;
@@ -466,6 +551,9 @@ protected:
     std::vector<ReorderListener*> reorderListeners;
     std::vector<ForcePreComputation*> preComputations;
     std::vector<ForcePostComputation*> postComputations;
+    ComputeArray reorderMoleculeStart, reorderMoleculeAtoms, reorderAtomMolecule, reorderSourceMolecule;
+    ComputeArray reorderMoleculeCenters, reorderMoleculeCellShifts, reorderPosq, reorderPosqCorrection, reorderVelm;
+    ComputeKernel reorderCentersKernel, reorderAtomsKernel;
     WorkThread* thread;
 };
 
@@ -45,7 +45,15 @@ class ComputeContext;
 
 class OPENMM_EXPORT_COMMON IntegrationUtilities {
 public:
-    IntegrationUtilities(ComputeContext& context, const System& system);
+    /**
+     * Create an IntegrationUtilities.
+     *
+     * @param context     the context in which the simulation is being performed
+     * @param system      the System being simulated
+     * @param useLincs    if true, constraints that are not handled by SETTLE or SHAKE are enforced with
+     *                    P-LINCS instead of CCMA
+     */
+    IntegrationUtilities(ComputeContext& context, const System& system, bool useLincs=false);
     virtual ~IntegrationUtilities() {
     }
     /**
@@ -61,6 +69,14 @@ public:
      * accessing this array.
      */
     virtual ArrayInterface& getRandom() = 0;
+    /**
+     * Get the array which contains the counter for the counter-based random number generator.
+     * It holds a single 64 bit integer.  Kernels that generate random numbers with philoxGaussian()
+     * (defined in CommonKernelSources::philox) should pass it the value stored in this array,
+     * and the last kernel to use it in a step should increment it.  Be sure to call
+     * initRandomNumberGenerator() before accessing this array.
+     */
+    virtual ArrayInterface& getRandomCounter() = 0;
     /**
      * Get the array which contains the current step size.
      */
@@ -81,8 +97,10 @@ public:
      * once they are added to the positions, constraints will be satisfied.
      *
      * @param tol             the constraint tolerance
+     * @param includeSettle   if false, clusters that are constrained with SETTLE are skipped.  This is
+     *                        used by integrators that apply SETTLE themselves while computing the deltas.
      */
-    void applyConstraints(double tol);
+    void applyConstraints(double tol, bool includeSettle=true);
     /**
      * Apply constraints to the atom velocities.
      *
@@ -103,10 +121,21 @@ public:
      * @return the index in the array at which to start reading
      */
     int prepareRandomNumbers(int numValues);
+    /**
+     * Get the key for the counter-based random number generator.  This is derived from the
+     * random number seed, so initRandomNumberGenerator() must be called first.
+     */
+    mm_int2 getRandomKey() const {
+        return randomKey;
+    }
     /**
      * Compute the positions of virtual sites.
+     *
+     * @param includeSettleSites   if false, sites whose parent particles all belong to one SETTLE cluster
+     *                             are skipped.  This is used by integrators that compute them while updating
+     *                             the positions of the clusters.
      */
-    void computeVirtualSites();
+    void computeVirtualSites(bool includeSettleSites=true);
     /**
      * Distribute forces from virtual sites to the atoms they are based on.
      */
@@ -130,23 +159,117 @@ public:
      * @param timeShift   the amount by which to shift the velocities in time
      */
     double computeKineticEnergy(double timeShift);
+    /**
+     * Get the number of clusters that are constrained with SETTLE.
+     */
+    int getNumSettleClusters() const {
+        return (settleAtoms.isInitialized() ? settleAtoms.getSize() : 0);
+    }
+    /**
+     * Get the array containing the atoms in each SETTLE cluster.  Each element is an int4 whose x
+     * component is the central atom.  This is only initialized if getNumSettleClusters() is nonzero.
+     */
+    ComputeArray& getSettleAtoms() {
+        return settleAtoms;
+    }
+    /**
+     * Get the array containing the distances for each SETTLE cluster.  Each element is a float2
+     * containing the distances from the central atom to the others, and between the other two atoms.
+     */
+    ComputeArray& getSettleParams() {
+        return settleParams;
+    }
+    /**
+     * Get an array containing one int per atom, which is 1 for atoms that are part of a SETTLE cluster
+     * and 0 for all others.  Integrators can use this together with getSettleAtoms() to apply SETTLE to
+     * the position deltas as they compute them, then call applyConstraints() with includeSettle=false.
+     */
+    ComputeArray& getSettleAtomFlags() {
+        return settleAtomFlags;
+    }
+    /**
+     * Get the number of virtual sites whose parent particles all belong to one SETTLE cluster.
+     */
+    int getNumSettleVirtualSites() const {
+        return numSettleVsites;
+    }
+    /**
+     * Get the array with the index of the first virtual site belonging to each SETTLE cluster in
+     * getSettleVirtualSiteAtoms().  It has one more element than the number of clusters.  This and
+     * the other virtual site arrays are only initialized if getNumSettleVirtualSites() is nonzero.
+     */
+    ComputeArray& getSettleVirtualSiteStart() {
+        return settleVsiteStart;
+    }
+    /**
+     * Get the array describing the virtual sites that belong to SETTLE clusters.  Each element is an
+     * int4 containing the site's index, the positions of its parents within the cluster packed two bits
+     * each, and its type (0 for an average, 1 for an out of plane site).
+     */
+    ComputeArray& getSettleVirtualSiteAtoms() {
+        return settleVsiteAtoms;
+    }
+    /**
+     * Get the array containing the weights of the virtual sites that belong to SETTLE clusters.
+     */
+    ComputeArray& getSettleVirtualSiteWeights() {
+        return settleVsiteWeights;
+    }
+    /**
+     * Get whether constraints that are not handled by SETTLE or SHAKE are enforced with P-LINCS
+     * instead of CCMA.
+     */
+    bool getUseLincs() const {
+        return useLincs;
+    }
 protected:
-    virtual void applyConstraintsImpl(bool constrainVelocities, double tol) = 0;
+    virtual void applyConstraintsImpl(bool constrainVelocities, double tol, bool includeSettle) = 0;
+    void initRandomArrays();
+    /**
+     * Apply the constraints that are not handled by SETTLE or SHAKE with P-LINCS.  This takes a fixed
+     * number of kernel launches and never needs to check for convergence, so it does not require
+     * synchronizing with the host.
+     */
+    void applyLincs(bool constrainVelocities);
+    /**
+     * Get the number of iterations to launch for the multi-kernel version of CCMA.  Once the iteration
+     * has converged, the remaining kernels return immediately, so the host never needs to wait to find
+     * out when to stop.  The number is based on how many iterations recent steps took to converge.
+     *
+     * @param constrainVelocities   whether velocity or position constraints are being applied
+     * @param tol                   the constraint tolerance
+     */
+    int getCCMAIterationBudget(bool constrainVelocities, double tol);
+    /**
+     * Record how many iterations the multi-kernel version of CCMA took to converge, once the device
+     * has reported it.  This is used to adjust the value returned by getCCMAIterationBudget().
+     *
+     * @param constrainVelocities   whether velocity or position constraints were applied
+     * @param iterations            the iteration at which convergence was detected, or 0 if it did not
+     *                              converge within the budget
+     */
+    void recordCCMAIterations(bool constrainVelocities, int iterations);
+    static const int MaxCCMAIterations;
+    static const int StepSizeTableSize;
     ComputeContext& context;
     ComputeKernel settlePosKernel, settleVelKernel;
     ComputeKernel shakePosKernel, shakeVelKernel;
     ComputeKernel ccmaDirectionsKernel, ccmaPosForceKernel, ccmaVelForceKernel;
     ComputeKernel ccmaMultiplyKernel, ccmaUpdateKernel, ccmaFullKernel;
+    ComputeKernel lincsDirectionsKernel, lincsCouplingKernel, lincsMultiplyKernel, lincsUpdateKernel, lincsRotationKernel;
     ComputeKernel vsitePositionKernel, vsiteForceKernel, vsiteSaveForcesKernel;
-    ComputeKernel randomKernel, timeShiftKernel;
+    ComputeKernel randomKernel, timeShiftKernel, selectStepSizeKernel;
     ComputeArray posDelta;
     ComputeArray settleAtoms;
     ComputeArray settleParams;
+    ComputeArray settleAtomFlags;
     ComputeArray shakeAtoms;
     ComputeArray shakeParams;
     ComputeArray random;
     ComputeArray randomSeed;
+    ComputeArray randomCounter;
     ComputeArray stepSize;
+    ComputeArray stepSizeTable;
     ComputeArray ccmaAtoms;
     ComputeArray ccmaConstraintAtoms;
     ComputeArray ccmaDistance;
@@ -158,6 +281,9 @@ protected:
     ComputeArray ccmaDelta1;
     ComputeArray ccmaDelta2;
     ComputeArray ccmaConverged;
+    ComputeArray lincsSMatrix;
+    ComputeArray lincsCoupling;
+    ComputeArray lincsSolution;
     ComputeArray vsite2AvgAtoms;
     ComputeArray vsite2AvgWeights;
     ComputeArray vsite3AvgAtoms;
@@ -169,9 +295,16 @@ protected:
     ComputeArray vsiteLocalCoordsWeights;
     ComputeArray vsiteLocalCoordsPos;
     ComputeArray vsiteLocalCoordsStartIndex;
-    int randomPos, lastSeed, numVsites;
-    bool hasOverlappingVsites;
+    ComputeArray settleVsiteStart;
+    ComputeArray settleVsiteAtoms;
+    ComputeArray settleVsiteWeights;
+    int randomPos, lastSeed, numVsites, numSettleVsites;
+    int ccmaIterationBudget[2];
+    double ccmaLastTolerance[2];
+    mm_int2 randomKey;
+    bool hasOverlappingVsites, useLincs;
     mm_double2 lastStepSize;
+    std::map<double, int> stepSizeTableIndex;
     struct ShakeCluster;
     struct ConstraintOrderer;
 };
@@ -29,6 +29,7 @@
 
 #include "openmm/common/ArrayInterface.h"
 #include "openmm/common/ComputeParameterInfo.h"
+#include <map>
 #include <string>
 #include <vector>
 
@@ -71,6 +72,19 @@ public:
      * @param forceGroup     the force group in which the interaction should be calculated
      */
     virtual void addInteraction(bool usesCutoff, bool usesPeriodic, bool usesExclusions, double cutoffDistance, const std::vector<std::vector<int> >& exclusionList, const std::string& kernel, int forceGroup) = 0;
+    /**
+     * Add a nonbonded interaction to be evaluated by the default interaction kernel.
+     *
+     * @param usesCutoff       specifies whether a cutoff should be applied to this interaction
+     * @param usesPeriodic     specifies whether periodic boundary conditions should be applied to this interaction
+     * @param usesExclusions   specifies whether this interaction uses exclusions.  If this is true, it must have identical exclusions to every other interaction.
+     * @param cutoffDistance   the cutoff distance for this interaction (ignored if usesCutoff is false)
+     * @param exclusionList    for each atom, specifies the list of other atoms whose interactions should be excluded
+     * @param kernel           the code to evaluate the interaction
+     * @param forceGroup       the force group in which the interaction should be calculated
+     * @param supportsPairList specifies whether this interaction can work with a neighbor list that uses a separate pair list
+     */
+    virtual void addInteraction(bool usesCutoff, bool usesPeriodic, bool usesExclusions, double cutoffDistance, const std::vector<std::vector<int> >& exclusionList, const std::string& kernel, int forceGroup, bool supportsPairList) = 0;
     /**
      * Add a per-atom parameter that the default interaction kernel may depend on.
      */
@@ -137,6 +151,18 @@ public:
      * Get the array containing the atoms in each tile with interactions.
      */
     virtual ArrayInterface& getInteractingAtoms() = 0;
+    /**
+     * Get whether the neighbor list stores some interactions as a separate list of single atom pairs
+     * instead of as tiles.  If so, they are returned by getSinglePairs(), and the second element of
+     * getInteractionCount() contains the number of them.  This is only valid after the context has
+     * been initialized.
+     */
+    virtual bool getUsePairList() = 0;
+    /**
+     * Get the array containing single pairs in the neighbor list.  This may only be called if
+     * getUsePairList() returns true.
+     */
+    virtual ArrayInterface& getSinglePairs() = 0;
     /**
      * Get the array containing exclusion flags.
      */
@@ -158,6 +184,12 @@ public:
      * on the most recent call to prepareInteractions().
      */
     virtual ArrayInterface& getRebuildNeighborList() = 0;
+    /**
+     * Add statistics describing the neighbor list to a map, with keys of the form "neighborList:<name>".
+     * The default implementation adds nothing.
+     */
+    virtual void getNeighborListStatistics(std::map<std::string, double>& statistics) {
+    }
 };
 
 } // namespace OpenMM
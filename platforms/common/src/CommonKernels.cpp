@@ -35,6 +35,7 @@
 #include "openmm/internal/CustomHbondForceImpl.h"
 #include "openmm/internal/CustomManyParticleForceImpl.h"
 #include "openmm/internal/CustomNonbondedForceImpl.h"
+#include "openmm/internal/TraceRange.h"
 #include "CommonKernelSources.h"
 #include "lepton/CustomFunction.h"
 #include "lepton/ExpressionTreeNode.h"
@@ -44,10 +45,10 @@
 #include "ReferenceTabulatedFunction.h"
 #include "SimTKOpenMMRealType.h"
 #include "SimTKOpenMMUtilities.h"
-#include "jama_eig.h"
 #include <algorithm>
 #include <cmath>
 #include <iterator>
+#include <limits>
 #include <set>
 
 using namespace OpenMM;
@@ -73,6 +74,17 @@ static void setPeriodicBoxArgs(ComputeContext& cc, ComputeKernel kernel, int ind
     }
 }
 
+/**
+ * Add the arguments used by integration kernels that compute the virtual sites attached to SETTLE clusters.
+ */
+static void addSettleVirtualSiteArgs(ComputeKernel kernel, IntegrationUtilities& integration) {
+    kernel->addArg(integration.getSettleAtomFlags());
+    kernel->addArg(integration.getSettleAtoms());
+    kernel->addArg(integration.getSettleVirtualSiteStart());
+    kernel->addArg(integration.getSettleVirtualSiteAtoms());
+    kernel->addArg(integration.getSettleVirtualSiteWeights());
+}
+
 static bool isZeroExpression(const Lepton::ParsedExpression& expression) {
     const Lepton::Operation& op = expression.getRootNode().getOperation();
     if (op.getId() != Lepton::Operation::CONSTANT)
@@ -94,6 +106,18 @@ static bool usesVariable(const Lepton::ParsedExpression& expression, const strin
     return usesVariable(expression.getRootNode(), variable);
 }
 
+static bool usesOnlyVariables(const Lepton::ExpressionTreeNode& node, const map<string, string>& variables) {
+    const Lepton::Operation& op = node.getOperation();
+    if (op.getId() == Lepton::Operation::CUSTOM)
+        return false;
+    if (op.getId() == Lepton::Operation::VARIABLE && variables.find(op.getName()) == variables.end())
+        return false;
+    for (auto& child : node.getChildren())
+        if (!usesOnlyVariables(child, variables))
+            return false;
+    return true;
+}
+
 static pair<ExpressionTreeNode, string> makeVariable(const string& name, const string& value) {
     return make_pair(ExpressionTreeNode(new Operation::Variable(name)), value);
 }
@@ -606,20 +630,50 @@ void CommonCalcPeriodicTorsionForceKernel::initialize(const System& system, cons
     numTorsions = endIndex-startIndex;
     if (numTorsions == 0)
         return;
-    vector<vector<int> > atoms(numTorsions, vector<int>(4));
+    vector<vector<int> > torsionAtoms(numTorsions, vector<int>(4));
+    for (int i = 0; i < numTorsions; i++) {
+        int periodicity;
+        double phase, k;
+        force.getTorsionParameters(startIndex+i, torsionAtoms[i][0], torsionAtoms[i][1], torsionAtoms[i][2], torsionAtoms[i][3], periodicity, phase, k);
+    }
+
+    // Force fields often apply several terms with different periodicities to the same four atoms.
+    // Combine them into a single interaction, so the dihedral angle and the forces on the atoms are
+    // only computed once.  The terms for each interaction are stored contiguously in the parameter array.
+
+    map<vector<int>, int> interactionIndex;
+    vector<vector<int> > interactionTerms;
+    for (int i = 0; i < numTorsions; i++) {
+        auto inserted = interactionIndex.insert(make_pair(torsionAtoms[i], (int) interactionTerms.size()));
+        if (inserted.second)
+            interactionTerms.push_back(vector<int>());
+        interactionTerms[inserted.first->second].push_back(i);
+    }
+    int numInteractions = interactionTerms.size();
+    vector<vector<int> > atoms(numInteractions);
+    vector<mm_int2> termRangeVector(numInteractions);
+    termOrder.clear();
+    for (int i = 0; i < numInteractions; i++) {
+        atoms[i] = torsionAtoms[interactionTerms[i][0]];
+        termRangeVector[i] = mm_int2(termOrder.size(), termOrder.size()+interactionTerms[i].size());
+        termOrder.insert(termOrder.end(), interactionTerms[i].begin(), interactionTerms[i].end());
+    }
     params.initialize<mm_float4>(cc, numTorsions, "periodicTorsionParams");
+    termRanges.initialize<mm_int2>(cc, numInteractions, "periodicTorsionTermRanges");
     vector<mm_float4> paramVector(numTorsions);
     for (int i = 0; i < numTorsions; i++) {
-        int periodicity;
+        int atom1, atom2, atom3, atom4, periodicity;
         double phase, k;
-        force.getTorsionParameters(startIndex+i, atoms[i][0], atoms[i][1], atoms[i][2], atoms[i][3], periodicity, phase, k);
+        force.getTorsionParameters(startIndex+termOrder[i], atom1, atom2, atom3, atom4, periodicity, phase, k);
         paramVector[i] = mm_float4((float) k, (float) phase, (float) periodicity, 0.0f);
     }
     params.upload(paramVector);
+    termRanges.upload(termRangeVector);
     map<string, string> replacements;
     replacements["APPLY_PERIODIC"] = (force.usesPeriodicBoundaryConditions() ? "1" : "0");
     replacements["COMPUTE_FORCE"] = CommonKernelSources::periodicTorsionForce;
-    replacements["PARAMS"] = cc.getBondedUtilities().addArgument(params, "float4");
+    replacements["PARAMS"] = cc.getBondedUtilities().addArgument(params, "const float4");
+    replacements["TERMS"] = cc.getBondedUtilities().addArgument(termRanges, "const int2");
     cc.getBondedUtilities().addInteraction(atoms, cc.replaceStrings(CommonKernelSources::torsionForce, replacements), force.getForceGroup());
     info = new ForceInfo(force);
     cc.addForce(info);
@@ -645,7 +699,7 @@ void CommonCalcPeriodicTorsionForceKernel::copyParametersToContext(ContextImpl&
     for (int i = 0; i < numTorsions; i++) {
         int atom1, atom2, atom3, atom4, periodicity;
         double phase, k;
-        force.getTorsionParameters(startIndex+i, atom1, atom2, atom3, atom4, periodicity, phase, k);
+        force.getTorsionParameters(startIndex+termOrder[i], atom1, atom2, atom3, atom4, periodicity, phase, k);
         paramVector[i] = mm_float4((float) k, (float) phase, (float) periodicity, 0.0f);
     }
     params.upload(paramVector);
@@ -963,18 +1017,30 @@ void CommonCalcCMAPTorsionForceKernel::initialize(const System& system, const CM
     vector<int> torsionMapsVec(numTorsions);
     for (int i = 0; i < numTorsions; i++)
         force.getTorsionParameters(startIndex+i, torsionMapsVec[i], atoms[i][0], atoms[i][1], atoms[i][2], atoms[i][3], atoms[i][4], atoms[i][5], atoms[i][6], atoms[i][7]);
+
+    // Group the torsions by map, so neighboring threads usually read coefficients from the same map.
+    // Each torsion records the position and size of its map directly, so finding the coefficients
+    // does not require a second dependent load.
+
+    torsionOrder.resize(numTorsions);
+    for (int i = 0; i < numTorsions; i++)
+        torsionOrder[i] = i;
+    stable_sort(torsionOrder.begin(), torsionOrder.end(), [&] (int a, int b) { return torsionMapsVec[a] < torsionMapsVec[b]; });
+    vector<vector<int> > sortedAtoms(numTorsions);
+    vector<mm_int2> torsionMapPositionsVec(numTorsions);
+    for (int i = 0; i < numTorsions; i++) {
+        sortedAtoms[i] = atoms[torsionOrder[i]];
+        torsionMapPositionsVec[i] = mapPositionsVec[torsionMapsVec[torsionOrder[i]]];
+    }
     coefficients.initialize<mm_float4>(cc, coeffVec.size(), "cmapTorsionCoefficients");
-    mapPositions.initialize<mm_int2>(cc, numMaps, "cmapTorsionMapPositions");
-    torsionMaps.initialize<int>(cc, numTorsions, "cmapTorsionMaps");
+    torsionMapPositions.initialize<mm_int2>(cc, numTorsions, "cmapTorsionMapPositions");
     coefficients.upload(coeffVec);
-    mapPositions.upload(mapPositionsVec);
-    torsionMaps.upload(torsionMapsVec);
+    torsionMapPositions.upload(torsionMapPositionsVec);
     map<string, string> replacements;
     replacements["APPLY_PERIODIC"] = (force.usesPeriodicBoundaryConditions() ? "1" : "0");
-    replacements["COEFF"] = cc.getBondedUtilities().addArgument(coefficients, "float4");
-    replacements["MAP_POS"] = cc.getBondedUtilities().addArgument(mapPositions, "int2");
-    replacements["MAPS"] = cc.getBondedUtilities().addArgument(torsionMaps, "int");
-    cc.getBondedUtilities().addInteraction(atoms, cc.replaceStrings(CommonKernelSources::cmapTorsionForce, replacements), force.getForceGroup());
+    replacements["COEFF"] = cc.getBondedUtilities().addArgument(coefficients, "const float4");
+    replacements["MAP_POS"] = cc.getBondedUtilities().addArgument(torsionMapPositions, "const int2");
+    cc.getBondedUtilities().addInteraction(sortedAtoms, cc.replaceStrings(CommonKernelSources::cmapTorsionForce, replacements), force.getForceGroup());
     info = new ForceInfo(force);
     cc.addForce(info);
 }
@@ -988,11 +1054,12 @@ void CommonCalcCMAPTorsionForceKernel::copyParametersToContext(ContextImpl& cont
     int numContexts = cc.getNumContexts();
     int startIndex = cc.getContextIndex()*force.getNumTorsions()/numContexts;
     int endIndex = (cc.getContextIndex()+1)*force.getNumTorsions()/numContexts;
-    numTorsions = endIndex-startIndex;
-    if (mapPositions.getSize() != numMaps)
+    if (mapPositionsVec.size() != numMaps)
         throw OpenMMException("updateParametersInContext: The number of maps has changed");
-    if (torsionMaps.getSize() != numTorsions)
+    if (endIndex-startIndex != numTorsions)
         throw OpenMMException("updateParametersInContext: The number of CMAP torsions has changed");
+    if (numTorsions == 0)
+        return;
 
     // Update the maps.
 
@@ -1016,15 +1083,17 @@ void CommonCalcCMAPTorsionForceKernel::copyParametersToContext(ContextImpl& cont
     }
     coefficients.upload(coeffVec);
 
-    // Update the indices.
+    // Update the map used by each torsion.  The torsions keep the order they were given in initialize().
 
-    vector<int> torsionMapsVec(numTorsions);
+    vector<mm_int2> torsionMapPositionsVec(numTorsions);
     for (int i = 0; i < numTorsions; i++) {
-        int index[8];
-        force.getTorsionParameters(i, torsionMapsVec[i], index[0], index[1], index[2], index[3], index[4], index[5], index[6], index[7]);
+        int map, index[8];
+        force.getTorsionParameters(startIndex+torsionOrder[i], map, index[0], index[1], index[2], index[3], index[4], index[5], index[6], index[7]);
+        torsionMapPositionsVec[i] = mapPositionsVec[map];
     }
-    torsionMaps.upload(torsionMapsVec);
+    torsionMapPositions.upload(torsionMapPositionsVec);
 }
+
 class CommonCalcCustomExternalForceKernel::ForceInfo : public ComputeForceInfo {
 public:
     ForceInfo(const CustomExternalForce& force, int numParticles) : force(force), indices(numParticles, -1) {
@@ -1249,7 +1318,7 @@ void CommonCalcCustomCompoundBondForceKernel::initialize(const System& system, c
         int width;
         vector<float> f = cc.getExpressionUtilities().computeFunctionCoefficients(force.getTabulatedFunction(i), width);
         tabulatedFunctions[i].initialize<float>(cc, f.size(), "TabulatedFunction");
-        tabulatedFunctions[i].upload(f);
+        tabulatedFunctions[i].uploadShared(f);
         string arrayName = cc.getBondedUtilities().addArgument(tabulatedFunctions[i], width == 1 ? "float" : "float"+cc.intToString(width));
         functionDefinitions.push_back(make_pair(name, arrayName));
     }
@@ -1565,15 +1634,30 @@ void CommonCalcCustomCentroidBondForceKernel::initialize(const System& system, c
     numGroups = force.getNumGroups();
     vector<int> groupParticleVec;
     vector<double> groupWeightVec;
-    vector<int> groupOffsetVec;
-    groupOffsetVec.push_back(0);
+    vector<int> segmentOffsetVec, segmentGroupVec, groupSegmentOffsetVec;
+    segmentOffsetVec.push_back(0);
+    groupSegmentOffsetVec.push_back(0);
     for (int i = 0; i < numGroups; i++) {
         vector<int> particles;
         vector<double> weights;
         force.getGroupParameters(i, particles, weights);
+        
+        // Large groups are divided into segments, so each one can be processed by several thread blocks.
+        
+        const int maxSegmentSize = 512;
+        int groupStart = groupParticleVec.size();
+        for (int start = 0; start < particles.size(); start += maxSegmentSize) {
+            segmentOffsetVec.push_back(groupStart+min(start+maxSegmentSize, (int) particles.size()));
+            segmentGroupVec.push_back(i);
+        }
+        if (particles.size() == 0) {
+            segmentOffsetVec.push_back(groupStart);
+            segmentGroupVec.push_back(i);
+        }
         groupParticleVec.insert(groupParticleVec.end(), particles.begin(), particles.end());
-        groupOffsetVec.push_back(groupParticleVec.size());
+        groupSegmentOffsetVec.push_back(segmentGroupVec.size());
     }
+    numSegments = segmentGroupVec.size();
     vector<vector<double> > normalizedWeights;
     CustomCentroidBondForceImpl::computeNormalizedWeights(force, system, normalizedWeights);
     for (int i = 0; i < numGroups; i++)
@@ -1589,8 +1673,15 @@ void CommonCalcCustomCentroidBondForceKernel::initialize(const System& system, c
         centerPositions.initialize<mm_float4>(cc, numGroups, "centerPositions");
     }
     groupWeights.upload(groupWeightVec, true);
-    groupOffsets.initialize<int>(cc, groupOffsetVec.size(), "groupOffsets");
-    groupOffsets.upload(groupOffsetVec);
+    segmentOffsets.initialize<int>(cc, segmentOffsetVec.size(), "segmentOffsets");
+    segmentOffsets.upload(segmentOffsetVec);
+    segmentGroups.initialize<int>(cc, segmentGroupVec.size(), "segmentGroups");
+    segmentGroups.upload(segmentGroupVec);
+    if (numSegments > numGroups) {
+        groupSegmentOffsets.initialize<int>(cc, groupSegmentOffsetVec.size(), "groupSegmentOffsets");
+        groupSegmentOffsets.upload(groupSegmentOffsetVec);
+        segmentCenters.initialize(cc, numSegments, centerPositions.getElementSize(), "segmentCenters");
+    }
     groupForces.initialize<long long>(cc, numGroups*3, "groupForces");
     cc.addAutoclearBuffer(groupForces);
     
@@ -1630,7 +1721,7 @@ void CommonCalcCustomCentroidBondForceKernel::initialize(const System& system, c
         int width;
         vector<float> f = cc.getExpressionUtilities().computeFunctionCoefficients(force.getTabulatedFunction(i), width);
         tabulatedFunctions[i].initialize<float>(cc, f.size(), "TabulatedFunction");
-        tabulatedFunctions[i].upload(f);
+        tabulatedFunctions[i].uploadShared(f);
         extraArgs << ", GLOBAL const float";
         if (width > 1)
             extraArgs << width;
@@ -1870,12 +1961,21 @@ void CommonCalcCustomCentroidBondForceKernel::initialize(const System& system, c
     replacements["SAVE_PARAM_DERIVS"] = saveParamDerivs.str();
     ComputeProgram program = cc.compileProgram(cc.replaceStrings(CommonKernelSources::customCentroidBond, replacements));
     computeCentersKernel = program->createKernel("computeGroupCenters");
-    computeCentersKernel->addArg(numGroups);
+    computeCentersKernel->addArg(numSegments);
     computeCentersKernel->addArg(cc.getPosq());
     computeCentersKernel->addArg(groupParticles);
     computeCentersKernel->addArg(groupWeights);
-    computeCentersKernel->addArg(groupOffsets);
-    computeCentersKernel->addArg(centerPositions);
+    computeCentersKernel->addArg(segmentOffsets);
+    if (segmentCenters.isInitialized()) {
+        computeCentersKernel->addArg(segmentCenters);
+        sumCentersKernel = program->createKernel("sumSegmentCenters");
+        sumCentersKernel->addArg(numGroups);
+        sumCentersKernel->addArg(groupSegmentOffsets);
+        sumCentersKernel->addArg(segmentCenters);
+        sumCentersKernel->addArg(centerPositions);
+    }
+    else
+        computeCentersKernel->addArg(centerPositions);
     groupForcesKernel = program->createKernel("computeGroupForces");
     groupForcesKernel->addArg(numGroups);
     groupForcesKernel->addArg(groupForces);
@@ -1894,9 +1994,11 @@ void CommonCalcCustomCentroidBondForceKernel::initialize(const System& system, c
         groupForcesKernel->addArg(parameter.getArray());
     applyForcesKernel = program->createKernel("applyForcesToAtoms");
     applyForcesKernel->addArg(numGroups);
+    applyForcesKernel->addArg(numSegments);
     applyForcesKernel->addArg(groupParticles);
     applyForcesKernel->addArg(groupWeights);
-    applyForcesKernel->addArg(groupOffsets);
+    applyForcesKernel->addArg(segmentOffsets);
+    applyForcesKernel->addArg(segmentGroups);
     applyForcesKernel->addArg(groupForces);
     applyForcesKernel->addArg();
 }
@@ -1915,14 +2017,18 @@ double CommonCalcCustomCentroidBondForceKernel::execute(ContextImpl& context, bo
         if (changed)
             globals.upload(globalParamValues);
     }
-    computeCentersKernel->execute(32*numGroups);
+    computeCentersKernel->execute(32*numSegments);
+    if (segmentCenters.isInitialized())
+        sumCentersKernel->execute(numGroups);
     groupForcesKernel->setArg(2, cc.getEnergyBuffer());
     setPeriodicBoxArgs(cc, groupForcesKernel, 5);
     if (needEnergyParamDerivs)
         groupForcesKernel->setArg(10, cc.getEnergyParamDerivBuffer());
     groupForcesKernel->execute(numBonds);
-    applyForcesKernel->setArg(5, cc.getLongForceBuffer());
-    applyForcesKernel->execute(32*numGroups);
+    if (includeForces) {
+        applyForcesKernel->setArg(7, cc.getLongForceBuffer());
+        applyForcesKernel->execute(32*numSegments);
+    }
     return 0.0;
 }
 
@@ -2004,12 +2110,28 @@ CommonCalcCustomNonbondedForceKernel::~CommonCalcCustomNonbondedForceKernel() {
         delete forceCopy;
 }
 
+/**
+ * Determine whether the interaction groups of a CustomNonbondedForce actually restrict which pairs interact.
+ * A single group with every particle in both sets is equivalent to having no groups, so the force can still be
+ * evaluated by the default nonbonded kernel in the same pass as all other nonbonded interactions.
+ */
+static bool hasRestrictiveInteractionGroups(const CustomNonbondedForce& force) {
+    if (force.getNumInteractionGroups() == 0)
+        return false;
+    if (force.getNumInteractionGroups() > 1)
+        return true;
+    set<int> set1, set2;
+    force.getInteractionGroupParameters(0, set1, set2);
+    return ((int) set1.size() != force.getNumParticles() || (int) set2.size() != force.getNumParticles());
+}
+
 void CommonCalcCustomNonbondedForceKernel::initialize(const System& system, const CustomNonbondedForce& force) {
     cc.setAsCurrent();
     int forceIndex;
     for (forceIndex = 0; forceIndex < system.getNumForces() && &system.getForce(forceIndex) != &force; ++forceIndex)
         ;
-    string prefix = (force.getNumInteractionGroups() == 0 ? "custom"+cc.intToString(forceIndex)+"_" : "");
+    bool useInteractionGroups = hasRestrictiveInteractionGroups(force);
+    string prefix = (useInteractionGroups ? "" : "custom"+cc.intToString(forceIndex)+"_");
 
     // Record parameters and exclusions.
 
@@ -2053,7 +2175,7 @@ void CommonCalcCustomNonbondedForceKernel::initialize(const System& system, cons
         int width;
         vector<float> f = cc.getExpressionUtilities().computeFunctionCoefficients(force.getTabulatedFunction(i), width);
         tabulatedFunctions[i].initialize<float>(cc, f.size(), "TabulatedFunction");
-        tabulatedFunctions[i].upload(f);
+        tabulatedFunctions[i].uploadShared(f);
         cc.getNonbondedUtilities().addArgument(ComputeParameterInfo(tabulatedFunctions[i], arrayName, "float", width));
         if (width == 1)
             tableTypes.push_back("float");
@@ -2116,7 +2238,7 @@ void CommonCalcCustomNonbondedForceKernel::initialize(const System& system, cons
         replacements["SWITCH_C5"] = cc.doubleToString(6/pow(force.getSwitchingDistance()-force.getCutoffDistance(), 5.0));
     }
     string source = cc.replaceStrings(CommonKernelSources::customNonbonded, replacements);
-    if (force.getNumInteractionGroups() > 0)
+    if (useInteractionGroups)
         initInteractionGroups(force, source, tableTypes);
     else {
         cc.getNonbondedUtilities().addInteraction(useCutoff, usePeriodic, true, force.getCutoffDistance(), exclusionList, source, force.getForceGroup());
@@ -2137,6 +2259,7 @@ void CommonCalcCustomNonbondedForceKernel::initialize(const System& system, cons
     
     if (force.getNonbondedMethod() == CustomNonbondedForce::CutoffPeriodic && force.getUseLongRangeCorrection() && cc.getContextIndex() == 0) {
         forceCopy = new CustomNonbondedForce(force);
+        longRangeCorrectionData = CustomNonbondedForceImpl::prepareLongRangeCorrection(force);
         hasInitializedLongRangeCorrection = false;
     }
     else {
@@ -2435,13 +2558,13 @@ double CommonCalcCustomNonbondedForceKernel::execute(ContextImpl& context, bool
         if (changed) {
             globals.upload(globalParamValues);
             if (forceCopy != NULL) {
-                CustomNonbondedForceImpl::calcLongRangeCorrection(*forceCopy, context.getOwner(), longRangeCoefficient, longRangeCoefficientDerivs);
+                CustomNonbondedForceImpl::calcLongRangeCorrection(*forceCopy, longRangeCorrectionData, context.getOwner(), longRangeCoefficient, longRangeCoefficientDerivs, &cc.getThreadPool());
                 hasInitializedLongRangeCorrection = true;
             }
         }
     }
     if (!hasInitializedLongRangeCorrection) {
-        CustomNonbondedForceImpl::calcLongRangeCorrection(*forceCopy, context.getOwner(), longRangeCoefficient, longRangeCoefficientDerivs);
+        CustomNonbondedForceImpl::calcLongRangeCorrection(*forceCopy, longRangeCorrectionData, context.getOwner(), longRangeCoefficient, longRangeCoefficientDerivs, &cc.getThreadPool());
         hasInitializedLongRangeCorrection = true;
     }
     if (interactionGroupData.isInitialized()) {
@@ -2521,7 +2644,40 @@ void CommonCalcCustomNonbondedForceKernel::copyParametersToContext(ContextImpl&
     // If necessary, recompute the long range correction.
     
     if (forceCopy != NULL) {
-        CustomNonbondedForceImpl::calcLongRangeCorrection(force, context.getOwner(), longRangeCoefficient, longRangeCoefficientDerivs);
+        longRangeCorrectionData = CustomNonbondedForceImpl::prepareLongRangeCorrection(force);
+        CustomNonbondedForceImpl::calcLongRangeCorrection(force, longRangeCorrectionData, context.getOwner(), longRangeCoefficient, longRangeCoefficientDerivs, &cc.getThreadPool());
+        hasInitializedLongRangeCorrection = true;
+        *forceCopy = force;
+    }
+    
+    // Mark that the current reordering may be invalid.
+    
+    cc.invalidateMolecules(info);
+}
+
+void CommonCalcCustomNonbondedForceKernel::copyParameterRangeToContext(ContextImpl& context, const CustomNonbondedForce& force, int firstParticle, int lastParticle) {
+    cc.setAsCurrent();
+    if (force.getNumParticles() != cc.getNumAtoms())
+        throw OpenMMException("updateParametersInContext: The number of particles has changed");
+
+    // Record the per-particle parameters.  Only the changed range is uploaded.
+
+    int numParams = force.getNumPerParticleParameters();
+    vector<vector<float> > paramVector(lastParticle-firstParticle+1, vector<float>(numParams, 0));
+    vector<double> parameters;
+    for (int i = firstParticle; i <= lastParticle; i++) {
+        force.getParticleParameters(i, parameters);
+        paramVector[i-firstParticle].resize(parameters.size());
+        for (int j = 0; j < (int) parameters.size(); j++)
+            paramVector[i-firstParticle][j] = (float) parameters[j];
+    }
+    params->setParameterValuesSubset(firstParticle, paramVector);
+    
+    // If necessary, recompute the long range correction.  This depends on all particles.
+    
+    if (forceCopy != NULL) {
+        longRangeCorrectionData = CustomNonbondedForceImpl::prepareLongRangeCorrection(force);
+        CustomNonbondedForceImpl::calcLongRangeCorrection(force, longRangeCorrectionData, context.getOwner(), longRangeCoefficient, longRangeCoefficientDerivs, &cc.getThreadPool());
         hasInitializedLongRangeCorrection = true;
         *forceCopy = force;
     }
@@ -2862,7 +3018,7 @@ void CommonCalcCustomGBForceKernel::initialize(const System& system, const Custo
         int width;
         vector<float> f = cc.getExpressionUtilities().computeFunctionCoefficients(force.getTabulatedFunction(i), width);
         tabulatedFunctions[i].initialize<float>(cc, f.size(), "TabulatedFunction");
-        tabulatedFunctions[i].upload(f);
+        tabulatedFunctions[i].uploadShared(f);
         nb.addArgument(ComputeParameterInfo(tabulatedFunctions[i], arrayName, "float", width));
         tableArgs << ", GLOBAL const float";
         if (width > 1)
@@ -3596,7 +3752,7 @@ void CommonCalcCustomGBForceKernel::initialize(const System& system, const Custo
             globals.upload(globalParamValues);
             arguments.push_back(ComputeParameterInfo(globals, prefix+"globals", "float", 1));
         }
-        nb.addInteraction(useCutoff, usePeriodic, force.getNumExclusions() > 0, cutoff, exclusionList, source, force.getForceGroup());
+        nb.addInteraction(useCutoff, usePeriodic, force.getNumExclusions() > 0, cutoff, exclusionList, source, force.getForceGroup(), true);
         for (auto param : parameters)
             nb.addParameter(param);
         for (auto arg : arguments)
@@ -3631,6 +3787,8 @@ double CommonCalcCustomGBForceKernel::execute(ContextImpl& context, bool include
             pairValueDefines["FIRST_EXCLUSION_TILE"] = cc.intToString(startExclusionIndex);
             pairValueDefines["LAST_EXCLUSION_TILE"] = cc.intToString(endExclusionIndex);
             pairValueDefines["CUTOFF"] = cc.doubleToString(cutoff);
+            if (nb.getUsePairList())
+                pairValueDefines["USE_PAIR_LIST"] = "1";
             ComputeProgram program = cc.compileProgram(pairValueSrc, pairValueDefines);
             pairValueKernel = program->createKernel("computeN2Value");
             pairValueSrc = "";
@@ -3645,6 +3803,8 @@ double CommonCalcCustomGBForceKernel::execute(ContextImpl& context, bool include
             pairEnergyDefines["FIRST_EXCLUSION_TILE"] = cc.intToString(startExclusionIndex);
             pairEnergyDefines["LAST_EXCLUSION_TILE"] = cc.intToString(endExclusionIndex);
             pairEnergyDefines["CUTOFF"] = cc.doubleToString(cutoff);
+            if (nb.getUsePairList())
+                pairEnergyDefines["USE_PAIR_LIST"] = "1";
             ComputeProgram program = cc.compileProgram(pairEnergySrc, pairEnergyDefines);
             pairEnergyKernel = program->createKernel("computeN2Energy");
             pairEnergySrc = "";
@@ -3654,6 +3814,7 @@ double CommonCalcCustomGBForceKernel::execute(ContextImpl& context, bool include
         // Set arguments for kernels.
         
         maxTiles = (nb.getUseCutoff() ? nb.getInteractingTiles().getSize() : 0);
+        maxSinglePairs = (nb.getUsePairList() ? nb.getSinglePairs().getSize() : 0);
         int numAtomBlocks = cc.getPaddedNumAtoms()/32;
         bool useLong = cc.getSupports64BitGlobalAtomics();
         pairValueKernel->addArg(cc.getPosq());
@@ -3669,6 +3830,10 @@ double CommonCalcCustomGBForceKernel::execute(ContextImpl& context, bool include
             pairValueKernel->addArg(nb.getBlockCenters());
             pairValueKernel->addArg(nb.getBlockBoundingBoxes());
             pairValueKernel->addArg(nb.getInteractingAtoms());
+            if (nb.getUsePairList()) {
+                pairValueKernel->addArg(maxSinglePairs);
+                pairValueKernel->addArg(nb.getSinglePairs());
+            }
         }
         else
             pairValueKernel->addArg(numAtomBlocks*(numAtomBlocks+1)/2);
@@ -3718,6 +3883,10 @@ double CommonCalcCustomGBForceKernel::execute(ContextImpl& context, bool include
             pairEnergyKernel->addArg(nb.getBlockCenters());
             pairEnergyKernel->addArg(nb.getBlockBoundingBoxes());
             pairEnergyKernel->addArg(nb.getInteractingAtoms());
+            if (nb.getUsePairList()) {
+                pairEnergyKernel->addArg(maxSinglePairs);
+                pairEnergyKernel->addArg(nb.getSinglePairs());
+            }
         }
         else
             pairEnergyKernel->addArg(numAtomBlocks*(numAtomBlocks+1)/2);
@@ -3810,6 +3979,11 @@ double CommonCalcCustomGBForceKernel::execute(ContextImpl& context, bool include
             pairValueKernel->setArg(11, maxTiles);
             pairEnergyKernel->setArg(13, maxTiles);
         }
+        if (nb.getUsePairList() && maxSinglePairs < nb.getSinglePairs().getSize()) {
+            maxSinglePairs = nb.getSinglePairs().getSize();
+            pairValueKernel->setArg(15, maxSinglePairs);
+            pairEnergyKernel->setArg(17, maxSinglePairs);
+        }
     }
     pairValueKernel->execute(nb.getNumForceThreadBlocks()*nb.getForceThreadBlockSize(), nb.getForceThreadBlockSize());
     perParticleValueKernel->execute(cc.getPaddedNumAtoms());
@@ -4062,7 +4236,7 @@ void CommonCalcCustomHbondForceKernel::initialize(const System& system, const Cu
         int width;
         vector<float> f = cc.getExpressionUtilities().computeFunctionCoefficients(force.getTabulatedFunction(i), width);
         tabulatedFunctions[i].initialize<float>(cc, f.size(), "TabulatedFunction");
-        tabulatedFunctions[i].upload(f);
+        tabulatedFunctions[i].uploadShared(f);
         tableArgs << ", GLOBAL const float";
         if (width > 1)
             tableArgs << width;
@@ -4090,7 +4264,10 @@ void CommonCalcCustomHbondForceKernel::initialize(const System& system, const Cu
     }
     for (int i = 0; i < force.getNumGlobalParameters(); i++) {
         const string& name = force.getGlobalParameterName(i);
-        variables[name] = "globals["+cc.intToString(i)+"]";
+        if (cc.getSpecializeGlobalParameters())
+            variables[name] = "GLOBAL_PARAM"+cc.intToString(i);
+        else
+            variables[name] = "globals["+cc.intToString(i)+"]";
     }
 
     // Now to generate the kernel.  First, it needs to calculate all distances, angles,
@@ -4249,23 +4426,52 @@ void CommonCalcCustomHbondForceKernel::initialize(const System& system, const Cu
     replacements["COMPUTE_DONOR_FORCE"] = computeDonor.str();
     replacements["COMPUTE_ACCEPTOR_FORCE"] = computeAcceptor.str();
     replacements["PARAMETER_ARGUMENTS"] = extraArgs.str()+tableArgs.str();
-    map<string, string> defines;
-    defines["PADDED_NUM_ATOMS"] = cc.intToString(cc.getPaddedNumAtoms());
-    defines["NUM_DONORS"] = cc.intToString(numDonors);
-    defines["NUM_ACCEPTORS"] = cc.intToString(numAcceptors);
-    defines["M_PI"] = cc.doubleToString(M_PI);
-    defines["THREAD_BLOCK_SIZE"] = "64";
+    kernelDefines["PADDED_NUM_ATOMS"] = cc.intToString(cc.getPaddedNumAtoms());
+    kernelDefines["NUM_DONORS"] = cc.intToString(numDonors);
+    kernelDefines["NUM_ACCEPTORS"] = cc.intToString(numAcceptors);
+    kernelDefines["M_PI"] = cc.doubleToString(M_PI);
+    kernelDefines["THREAD_BLOCK_SIZE"] = "64";
     if (force.getNonbondedMethod() != CustomHbondForce::NoCutoff) {
-        defines["USE_CUTOFF"] = "1";
-        defines["CUTOFF_SQUARED"] = cc.doubleToString(force.getCutoffDistance()*force.getCutoffDistance());
+        kernelDefines["USE_CUTOFF"] = "1";
+        kernelDefines["CUTOFF_SQUARED"] = cc.doubleToString(force.getCutoffDistance()*force.getCutoffDistance());
+        kernelDefines["NUM_DONOR_BLOCKS"] = cc.intToString((numDonors+63)/64);
+        kernelDefines["NUM_ACCEPTOR_BLOCKS"] = cc.intToString((numAcceptors+63)/64);
     }
     if (force.getNonbondedMethod() != CustomHbondForce::NoCutoff && force.getNonbondedMethod() != CustomHbondForce::CutoffNonPeriodic)
-        defines["USE_PERIODIC"] = "1";
+        kernelDefines["USE_PERIODIC"] = "1";
     if (force.getNumExclusions() > 0)
-        defines["USE_EXCLUSIONS"] = "1";
-    ComputeProgram program = cc.compileProgram(cc.replaceStrings(CommonKernelSources::customHbondForce, replacements), defines);
+        kernelDefines["USE_EXCLUSIONS"] = "1";
+    kernelSource = cc.replaceStrings(CommonKernelSources::customHbondForce, replacements);
+    if (force.getNonbondedMethod() != CustomHbondForce::NoCutoff) {
+        // When using a cutoff, the donors and acceptors are divided into blocks, and we compute a bounding box
+        // for each one so the force kernels can skip blocks that are too far apart to interact.
+
+        int elementSize = (cc.getUseDoublePrecision() ? sizeof(double) : sizeof(float));
+        donorBlockCenter.initialize(cc, (numDonors+63)/64, 4*elementSize, "customHbondDonorBlockCenter");
+        donorBlockBoundingBox.initialize(cc, (numDonors+63)/64, 4*elementSize, "customHbondDonorBlockBoundingBox");
+        acceptorBlockCenter.initialize(cc, (numAcceptors+63)/64, 4*elementSize, "customHbondAcceptorBlockCenter");
+        acceptorBlockBoundingBox.initialize(cc, (numAcceptors+63)/64, 4*elementSize, "customHbondAcceptorBlockBoundingBox");
+    }
+    compileKernels();
+}
+
+void CommonCalcCustomHbondForceKernel::compileKernels() {
+    // The globals array is still passed to the kernels when parameters are specialized, so the
+    // argument lists are the same either way.  The kernel cache means that returning to a value
+    // that has been used before does not require invoking the compiler again.
+
+    map<string, string> defines = kernelDefines;
+    if (cc.getSpecializeGlobalParameters())
+        for (int i = 0; i < (int) globalParamValues.size(); i++)
+            defines["GLOBAL_PARAM"+cc.intToString(i)] = "((float) "+cc.doubleToString(globalParamValues[i])+")";
+    ComputeProgram program = cc.compileProgram(kernelSource, defines);
     donorKernel = program->createKernel("computeDonorForces");
     acceptorKernel = program->createKernel("computeAcceptorForces");
+    if (donorBlockCenter.isInitialized()) {
+        donorBoundsKernel = program->createKernel("findBlockBounds");
+        acceptorBoundsKernel = program->createKernel("findBlockBounds");
+    }
+    hasInitializedKernel = false;
 }
 
 double CommonCalcCustomHbondForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
@@ -4279,8 +4485,11 @@ double CommonCalcCustomHbondForceKernel::execute(ContextImpl& context, bool incl
                 changed = true;
             globalParamValues[i] = value;
         }
-        if (changed)
+        if (changed) {
             globals.upload(globalParamValues);
+            if (cc.getSpecializeGlobalParameters())
+                compileKernels();
+        }
     }
     if (!hasInitializedKernel) {
         hasInitializedKernel = true;
@@ -4297,6 +4506,12 @@ double CommonCalcCustomHbondForceKernel::execute(ContextImpl& context, bool incl
         donorKernel->addArg(acceptors);
         for (int i = 0; i < 5; i++)
             donorKernel->addArg(); // Periodic box size arguments are set when the kernel is executed.
+        if (donorBlockCenter.isInitialized()) {
+            donorKernel->addArg(donorBlockCenter);
+            donorKernel->addArg(donorBlockBoundingBox);
+            donorKernel->addArg(acceptorBlockCenter);
+            donorKernel->addArg(acceptorBlockBoundingBox);
+        }
         if (globals.isInitialized())
             donorKernel->addArg(globals);
         for (auto& parameter : donorParams->getParameterInfos())
@@ -4318,6 +4533,12 @@ double CommonCalcCustomHbondForceKernel::execute(ContextImpl& context, bool incl
         acceptorKernel->addArg(acceptors);
         for (int i = 0; i < 5; i++)
             acceptorKernel->addArg(); // Periodic box size arguments are set when the kernel is executed.
+        if (donorBlockCenter.isInitialized()) {
+            acceptorKernel->addArg(donorBlockCenter);
+            acceptorKernel->addArg(donorBlockBoundingBox);
+            acceptorKernel->addArg(acceptorBlockCenter);
+            acceptorKernel->addArg(acceptorBlockBoundingBox);
+        }
         if (globals.isInitialized())
             acceptorKernel->addArg(globals);
         for (auto& parameter : donorParams->getParameterInfos())
@@ -4326,6 +4547,28 @@ double CommonCalcCustomHbondForceKernel::execute(ContextImpl& context, bool incl
             acceptorKernel->addArg(parameter.getArray());
         for (auto& function : tabulatedFunctions)
             acceptorKernel->addArg(function);
+        if (donorBlockCenter.isInitialized()) {
+            donorBoundsKernel->addArg(numDonors);
+            donorBoundsKernel->addArg(donors);
+            donorBoundsKernel->addArg(cc.getPosq());
+            donorBoundsKernel->addArg(donorBlockCenter);
+            donorBoundsKernel->addArg(donorBlockBoundingBox);
+            for (int i = 0; i < 5; i++)
+                donorBoundsKernel->addArg(); // Periodic box size arguments are set when the kernel is executed.
+            acceptorBoundsKernel->addArg(numAcceptors);
+            acceptorBoundsKernel->addArg(acceptors);
+            acceptorBoundsKernel->addArg(cc.getPosq());
+            acceptorBoundsKernel->addArg(acceptorBlockCenter);
+            acceptorBoundsKernel->addArg(acceptorBlockBoundingBox);
+            for (int i = 0; i < 5; i++)
+                acceptorBoundsKernel->addArg(); // Periodic box size arguments are set when the kernel is executed.
+        }
+    }
+    if (donorBlockCenter.isInitialized()) {
+        setPeriodicBoxArgs(cc, donorBoundsKernel, 5);
+        donorBoundsKernel->execute(donorBlockCenter.getSize());
+        setPeriodicBoxArgs(cc, acceptorBoundsKernel, 5);
+        acceptorBoundsKernel->execute(acceptorBlockCenter.getSize());
     }
     setPeriodicBoxArgs(cc, donorKernel, cc.getSupports64BitGlobalAtomics() ? 6 : 7);
     donorKernel->execute(max(numDonors, numAcceptors), 64);
@@ -4461,7 +4704,7 @@ void CommonCalcCustomManyParticleForceKernel::initialize(const System& system, c
         int width;
         vector<float> f = cc.getExpressionUtilities().computeFunctionCoefficients(force.getTabulatedFunction(i), width);
         tabulatedFunctions[i].initialize<float>(cc, f.size(), "TabulatedFunction");
-        tabulatedFunctions[i].upload(f);
+        tabulatedFunctions[i].uploadShared(f);
         tableArgs << ", GLOBAL const float";
         if (width > 1)
             tableArgs << width;
@@ -4519,6 +4762,23 @@ void CommonCalcCustomManyParticleForceKernel::initialize(const System& system, c
             for (int j = 0; j < particlesPerSet; j++)
                 flattenedOrder[i*particlesPerSet+j] = particleOrderVec[i][j];
         particleOrder.upload(flattenedOrder);
+
+        // Record which pairs of types can ever appear in the same set, with the first one in the
+        // first position.  The neighbor list uses this to skip pairs that can never interact.
+
+        vector<int> typePairAllowedVec(numTypes*numTypes, 0);
+        for (int i = 0; i < (int) orderIndexVec.size(); i++) {
+            if (orderIndexVec[i] == -1)
+                continue;
+            int type1 = i%numTypes;
+            int temp = i/numTypes;
+            for (int j = 1; j < particlesPerSet; j++) {
+                typePairAllowedVec[type1*numTypes+temp%numTypes] = 1;
+                temp /= numTypes;
+            }
+        }
+        typePairAllowed.initialize<int>(cc, typePairAllowedVec.size(), "customManyParticleTypePairAllowed");
+        typePairAllowed.upload(typePairAllowedVec);
     }
     
     // Build data structures for exclusions.
@@ -4848,8 +5108,10 @@ void CommonCalcCustomManyParticleForceKernel::initialize(const System& system, c
         defines["USE_PERIODIC"] = "1";
     if (centralParticleMode)
         defines["USE_CENTRAL_PARTICLE"] = "1";
-    if (hasTypeFilters)
+    if (hasTypeFilters) {
         defines["USE_FILTERS"] = "1";
+        defines["NUM_TYPES"] = cc.intToString(numTypes);
+    }
     if (force.getNumExclusions() > 0)
         defines["USE_EXCLUSIONS"] = "1";
     defines["NUM_ATOMS"] = cc.intToString(cc.getNumAtoms());
@@ -4925,6 +5187,10 @@ double CommonCalcCustomManyParticleForceKernel::execute(ContextImpl& context, bo
                 neighborsKernel->addArg(exclusions);
                 neighborsKernel->addArg(exclusionStartIndex);
             }
+            if (particleTypes.isInitialized()) {
+                neighborsKernel->addArg(particleTypes);
+                neighborsKernel->addArg(typePairAllowed);
+            }
             
             // Set arguments for the kernel to find neighbor list start indices.
             
@@ -5151,6 +5417,8 @@ void CommonCalcGayBerneForceKernel::initialize(const System& system, const GayBe
     blockCenter.initialize(cc, numAtomBlocks, 4*elementSize, "blockCenter");
     blockBoundingBox.initialize(cc, numAtomBlocks, 4*elementSize, "blockBoundingBox");
     sortedPos.initialize(cc, numRealParticles, 4*elementSize, "sortedPos");
+    oldPositions.initialize(cc, max(1, numRealParticles), 4*elementSize, "oldPositions");
+    rebuildNeighborList.initialize<int>(cc, 1, "rebuildNeighborList");
     maxNeighborBlocks = numRealParticles*2;
     neighbors.initialize<int>(cc, maxNeighborBlocks*32, "neighbors");
     neighborIndex.initialize<int>(cc, maxNeighborBlocks, "neighborIndex");
@@ -5171,6 +5439,13 @@ void CommonCalcGayBerneForceKernel::initialize(const System& system, const GayBe
     defines["USE_SWITCH"] = (useCutoff && force.getUseSwitchingFunction() ? "1" : "0");
     double cutoff = force.getCutoffDistance();
     defines["CUTOFF_SQUARED"] = cc.doubleToString(cutoff*cutoff);
+
+    // The neighbor list is built with a padded cutoff, and only rebuilt once some particle has moved
+    // more than half the padding.
+
+    double padding = 0.1*cutoff;
+    defines["PADDED_CUTOFF_SQUARED"] = cc.doubleToString((cutoff+padding)*(cutoff+padding));
+    defines["MAX_DISPLACEMENT_SQUARED"] = cc.doubleToString(0.25*padding*padding);
     if (useCutoff) {
         defines["USE_CUTOFF"] = 1;
         if (usePeriodic)
@@ -5189,6 +5464,7 @@ void CommonCalcGayBerneForceKernel::initialize(const System& system, const GayBe
     ComputeProgram program = cc.compileProgram(CommonKernelSources::gayBerne, defines);
     framesKernel = program->createKernel("computeEllipsoidFrames");
     blockBoundsKernel = program->createKernel("findBlockBounds");
+    prepareNeighborsKernel = program->createKernel("prepareNeighborList");
     neighborsKernel = program->createKernel("findNeighbors");
     forceKernel = program->createKernel("computeForce");
     torqueKernel = program->createKernel("applyTorques");
@@ -5218,7 +5494,10 @@ double CommonCalcGayBerneForceKernel::execute(ContextImpl& context, bool include
         blockBoundsKernel->addArg(sortedPos);
         blockBoundsKernel->addArg(blockCenter);
         blockBoundsKernel->addArg(blockBoundingBox);
-        blockBoundsKernel->addArg(neighborBlockCount);
+        blockBoundsKernel->addArg(oldPositions);
+        blockBoundsKernel->addArg(rebuildNeighborList);
+        prepareNeighborsKernel->addArg(rebuildNeighborList);
+        prepareNeighborsKernel->addArg(neighborBlockCount);
         neighborsKernel->addArg(numRealParticles);
         neighborsKernel->addArg(maxNeighborBlocks);
         for (int i = 0; i < 5; i++)
@@ -5231,6 +5510,8 @@ double CommonCalcGayBerneForceKernel::execute(ContextImpl& context, bool include
         neighborsKernel->addArg(neighborBlockCount);
         neighborsKernel->addArg(exclusions);
         neighborsKernel->addArg(exclusionStartIndex);
+        neighborsKernel->addArg(oldPositions);
+        neighborsKernel->addArg(rebuildNeighborList);
         forceKernel->addArg(cc.getLongForceBuffer());
         forceKernel->addArg(torque);
         forceKernel->addArg(numRealParticles);
@@ -5252,6 +5533,7 @@ double CommonCalcGayBerneForceKernel::execute(ContextImpl& context, bool include
             forceKernel->addArg(neighbors);
             forceKernel->addArg(neighborIndex);
             forceKernel->addArg(neighborBlockCount);
+            forceKernel->addArg(rebuildNeighborList);
             for (int i = 0; i < 5; i++)
                 forceKernel->addArg(); // Periodic box information will be set just before it is executed.
         }
@@ -5268,13 +5550,27 @@ double CommonCalcGayBerneForceKernel::execute(ContextImpl& context, bool include
     if (nonbondedMethod == GayBerneForce::NoCutoff)
         forceKernel->execute(cc.getNonbondedUtilities().getNumForceThreadBlocks()*cc.getNonbondedUtilities().getForceThreadBlockSize());
     else {
+        // If the periodic box has changed, the neighbor list must be rebuilt.
+
+        if (nonbondedMethod == GayBerneForce::CutoffPeriodic) {
+            Vec3 a, b, c;
+            cc.getPeriodicBoxVectors(a, b, c);
+            if (a != lastBoxVectors[0] || b != lastBoxVectors[1] || c != lastBoxVectors[2]) {
+                int rebuild = 1;
+                rebuildNeighborList.upload(&rebuild);
+                lastBoxVectors[0] = a;
+                lastBoxVectors[1] = b;
+                lastBoxVectors[2] = c;
+            }
+        }
         while (true) {
+            prepareNeighborsKernel->execute(1);
             setPeriodicBoxArgs(cc, neighborsKernel, 2);
             neighborsKernel->execute(numRealParticles);
             int* count = (int*) cc.getPinnedBuffer();
             neighborBlockCount.download(count, false);
             event->enqueue();
-            setPeriodicBoxArgs(cc, forceKernel, 20);
+            setPeriodicBoxArgs(cc, forceKernel, 21);
             forceKernel->execute(cc.getNonbondedUtilities().getNumForceThreadBlocks()*cc.getNonbondedUtilities().getForceThreadBlockSize());
             event->wait();
             if (*count <= maxNeighborBlocks)
@@ -5393,17 +5689,36 @@ void CommonCalcGayBerneForceKernel::sortAtoms() {
     startIndexVec[numRealParticles] = index;
     exclusions.upload(exclusionVec);
     exclusionStartIndex.upload(startIndexVec);
+
+    // The neighbor list refers to sorted indices, so it must be rebuilt.
+
+    int rebuild = 1;
+    rebuildNeighborList.upload(&rebuild);
 }
 
 void CommonIntegrateVerletStepKernel::initialize(const System& system, const VerletIntegrator& integrator) {
     cc.initializeContexts();
     cc.setAsCurrent();
-    ComputeProgram program = cc.compileProgram(CommonKernelSources::verlet);
+
+    // If there are SETTLE clusters (usually water), apply SETTLE while computing the position deltas
+    // instead of in a separate kernel, and compute any virtual sites attached to them while updating
+    // the positions.
+
+    map<string, string> defines;
+    fuseSettle = (cc.getIntegrationUtilities().getNumSettleClusters() > 0);
+    if (fuseSettle) {
+        defines["FUSE_SETTLE"] = "1";
+        defines["NUM_SETTLE_CLUSTERS"] = cc.intToString(cc.getIntegrationUtilities().getNumSettleClusters());
+        if (cc.getIntegrationUtilities().getNumSettleVirtualSites() > 0)
+            defines["FUSE_VIRTUAL_SITES"] = "1";
+    }
+    ComputeProgram program = cc.compileProgram(CommonKernelSources::settle+CommonKernelSources::verlet, defines);
     kernel1 = program->createKernel("integrateVerletPart1");
     kernel2 = program->createKernel("integrateVerletPart2");
 }
 
 void CommonIntegrateVerletStepKernel::execute(ContextImpl& context, const VerletIntegrator& integrator) {
+    OPENMM_TRACE_RANGE("Integrate Verlet");
     cc.setAsCurrent();
     IntegrationUtilities& integration = cc.getIntegrationUtilities();
     int numAtoms = cc.getNumAtoms();
@@ -5420,6 +5735,11 @@ void CommonIntegrateVerletStepKernel::execute(ContextImpl& context, const Verlet
         kernel1->addArg(integration.getPosDelta());
         if (cc.getUseMixedPrecision())
             kernel1->addArg(cc.getPosqCorrection());
+        if (fuseSettle) {
+            kernel1->addArg(integration.getSettleAtomFlags());
+            kernel1->addArg(integration.getSettleAtoms());
+            kernel1->addArg(integration.getSettleParams());
+        }
         kernel2->addArg(numAtoms);
         kernel2->addArg(integration.getStepSize());
         kernel2->addArg(cc.getPosq());
@@ -5427,6 +5747,8 @@ void CommonIntegrateVerletStepKernel::execute(ContextImpl& context, const Verlet
         kernel2->addArg(integration.getPosDelta());
         if (cc.getUseMixedPrecision())
             kernel2->addArg(cc.getPosqCorrection());
+        if (fuseSettle && integration.getNumSettleVirtualSites() > 0)
+            addSettleVirtualSiteArgs(kernel2, integration);
     }
     integration.setNextStepSize(dt);
 
@@ -5434,14 +5756,14 @@ void CommonIntegrateVerletStepKernel::execute(ContextImpl& context, const Verlet
 
     kernel1->execute(numAtoms);
 
-    // Apply constraints.
+    // Apply constraints.  SETTLE was already applied by the first kernel if possible.
 
-    integration.applyConstraints(integrator.getConstraintTolerance());
+    integration.applyConstraints(integrator.getConstraintTolerance(), !fuseSettle);
 
-    // Call the second integration kernel.
+    // Call the second integration kernel.  It also computes the virtual sites attached to SETTLE clusters.
 
     kernel2->execute(numAtoms);
-    integration.computeVirtualSites();
+    integration.computeVirtualSites(!fuseSettle);
 
     // Update the time and step count.
 
@@ -5472,6 +5794,7 @@ void CommonIntegrateLangevinStepKernel::initialize(const System& system, const L
 }
 
 void CommonIntegrateLangevinStepKernel::execute(ContextImpl& context, const LangevinIntegrator& integrator) {
+    OPENMM_TRACE_RANGE("Integrate Langevin");
     cc.setAsCurrent();
     IntegrationUtilities& integration = cc.getIntegrationUtilities();
     int numAtoms = cc.getNumAtoms();
@@ -5551,7 +5874,20 @@ void CommonIntegrateLangevinMiddleStepKernel::initialize(const System& system, c
     cc.initializeContexts();
     cc.setAsCurrent();
     cc.getIntegrationUtilities().initRandomNumberGenerator(integrator.getRandomNumberSeed());
-    ComputeProgram program = cc.compileProgram(CommonKernelSources::langevinMiddle);
+
+    // If there are SETTLE clusters (usually water), apply SETTLE while computing the position deltas
+    // instead of in a separate kernel, and compute any virtual sites attached to them while updating
+    // the positions.
+
+    map<string, string> defines;
+    fuseSettle = (cc.getIntegrationUtilities().getNumSettleClusters() > 0);
+    if (fuseSettle) {
+        defines["FUSE_SETTLE"] = "1";
+        defines["NUM_SETTLE_CLUSTERS"] = cc.intToString(cc.getIntegrationUtilities().getNumSettleClusters());
+        if (cc.getIntegrationUtilities().getNumSettleVirtualSites() > 0)
+            defines["FUSE_VIRTUAL_SITES"] = "1";
+    }
+    ComputeProgram program = cc.compileProgram(CommonKernelSources::philox+CommonKernelSources::settle+CommonKernelSources::langevinMiddle, defines);
     kernel1 = program->createKernel("integrateLangevinMiddlePart1");
     kernel2 = program->createKernel("integrateLangevinMiddlePart2");
     kernel3 = program->createKernel("integrateLangevinMiddlePart3");
@@ -5567,6 +5903,7 @@ void CommonIntegrateLangevinMiddleStepKernel::initialize(const System& system, c
 }
 
 void CommonIntegrateLangevinMiddleStepKernel::execute(ContextImpl& context, const LangevinMiddleIntegrator& integrator) {
+    OPENMM_TRACE_RANGE("Integrate LangevinMiddle");
     IntegrationUtilities& integration = cc.getIntegrationUtilities();
     int numAtoms = cc.getNumAtoms();
     int paddedNumAtoms = cc.getPaddedNumAtoms();
@@ -5583,16 +5920,28 @@ void CommonIntegrateLangevinMiddleStepKernel::execute(ContextImpl& context, cons
         kernel2->addArg(oldDelta);
         kernel2->addArg(params);
         kernel2->addArg(integration.getStepSize());
-        kernel2->addArg(integration.getRandom());
-        kernel2->addArg(); // Random index will be set just before it is executed.
+        kernel2->addArg(cc.getAtomIndexArray());
+        kernel2->addArg(integration.getRandomKey());
+        kernel2->addArg(integration.getRandomCounter());
+        if (fuseSettle) {
+            kernel2->addArg(cc.getPosq());
+            kernel2->addArg(integration.getSettleAtomFlags());
+            kernel2->addArg(integration.getSettleAtoms());
+            kernel2->addArg(integration.getSettleParams());
+            if (cc.getUseMixedPrecision())
+                kernel2->addArg(cc.getPosqCorrection());
+        }
         kernel3->addArg(numAtoms);
         kernel3->addArg(cc.getPosq());
         kernel3->addArg(cc.getVelm());
         kernel3->addArg(integration.getPosDelta());
         kernel3->addArg(oldDelta);
         kernel3->addArg(integration.getStepSize());
+        kernel3->addArg(integration.getRandomCounter());
         if (cc.getUseMixedPrecision())
             kernel3->addArg(cc.getPosqCorrection());
+        if (fuseSettle && integration.getNumSettleVirtualSites() > 0)
+            addSettleVirtualSiteArgs(kernel3, integration);
     }
     double temperature = integrator.getTemperature();
     double friction = integrator.getFriction();
@@ -5615,13 +5964,7 @@ void CommonIntegrateLangevinMiddleStepKernel::execute(ContextImpl& context, cons
 
     // Perform the integration.
 
-    kernel2->setArg(7, integration.prepareRandomNumbers(cc.getPaddedNumAtoms()));
-    kernel1->execute(numAtoms);
-    integration.applyVelocityConstraints(integrator.getConstraintTolerance());
-    kernel2->execute(numAtoms);
-    integration.applyConstraints(integrator.getConstraintTolerance());
-    kernel3->execute(numAtoms);
-    integration.computeVirtualSites();
+    integrate(integrator.getConstraintTolerance());
 
     // Update the time and step count.
 
@@ -5636,10 +5979,123 @@ void CommonIntegrateLangevinMiddleStepKernel::execute(ContextImpl& context, cons
 #endif
 }
 
+void CommonIntegrateLangevinMiddleStepKernel::integrate(double tolerance) {
+    IntegrationUtilities& integration = cc.getIntegrationUtilities();
+    int numAtoms = cc.getNumAtoms();
+    kernel1->execute(numAtoms);
+    integration.applyVelocityConstraints(tolerance);
+    kernel2->execute(numAtoms);
+    integration.applyConstraints(tolerance, !fuseSettle);
+    kernel3->execute(numAtoms);
+    integration.computeVirtualSites(!fuseSettle);
+}
+
 double CommonIntegrateLangevinMiddleStepKernel::computeKineticEnergy(ContextImpl& context, const LangevinMiddleIntegrator& integrator) {
     return cc.getIntegrationUtilities().computeKineticEnergy(0.0);
 }
 
+void CommonIntegrateMTSLangevinStepKernel::initialize(const System& system, const MTSLangevinIntegrator& integrator) {
+    cc.initializeContexts();
+    cc.setAsCurrent();
+    cc.getIntegrationUtilities().initRandomNumberGenerator(integrator.getRandomNumberSeed());
+    ComputeProgram program = cc.compileProgram(CommonKernelSources::mtsLangevin);
+    kickKernel = program->createKernel("integrateMTSLangevinKick");
+    driftKernel = program->createKernel("integrateMTSLangevinDrift");
+    positionsKernel = program->createKernel("integrateMTSLangevinPositions");
+    if (cc.getUseDoublePrecision() || cc.getUseMixedPrecision())
+        oldDelta.initialize<mm_double4>(cc, cc.getPaddedNumAtoms(), "oldDelta");
+    else
+        oldDelta.initialize<mm_float4>(cc, cc.getPaddedNumAtoms(), "oldDelta");
+}
+
+void CommonIntegrateMTSLangevinStepKernel::initializeKernels() {
+    IntegrationUtilities& integration = cc.getIntegrationUtilities();
+    int numAtoms = cc.getNumAtoms();
+    hasInitializedKernels = true;
+    kickKernel->addArg(numAtoms);
+    kickKernel->addArg(cc.getPaddedNumAtoms());
+    kickKernel->addArg(cc.getVelm());
+    kickKernel->addArg(cc.getLongForceBuffer());
+    kickKernel->addArg(); // dt will be set just before it is executed.
+    driftKernel->addArg(numAtoms);
+    driftKernel->addArg(cc.getVelm());
+    driftKernel->addArg(integration.getPosDelta());
+    driftKernel->addArg(oldDelta);
+    driftKernel->addArg(); // vscale
+    driftKernel->addArg(); // noisescale
+    driftKernel->addArg(); // halfdt
+    driftKernel->addArg(integration.getRandom());
+    driftKernel->addArg(); // Random index will be set just before it is executed.
+    positionsKernel->addArg(numAtoms);
+    positionsKernel->addArg(cc.getPosq());
+    positionsKernel->addArg(cc.getVelm());
+    positionsKernel->addArg(integration.getPosDelta());
+    positionsKernel->addArg(oldDelta);
+    positionsKernel->addArg(); // invDt
+    if (cc.getUseMixedPrecision())
+        positionsKernel->addArg(cc.getPosqCorrection());
+}
+
+void CommonIntegrateMTSLangevinStepKernel::kick(ContextImpl& context, const MTSLangevinIntegrator& integrator, double dt) {
+    cc.setAsCurrent();
+    if (!hasInitializedKernels)
+        initializeKernels();
+    if (cc.getUseDoublePrecision() || cc.getUseMixedPrecision())
+        kickKernel->setArg(4, dt);
+    else
+        kickKernel->setArg(4, (float) dt);
+    kickKernel->execute(cc.getNumAtoms());
+    cc.getIntegrationUtilities().applyVelocityConstraints(integrator.getConstraintTolerance());
+}
+
+void CommonIntegrateMTSLangevinStepKernel::drift(ContextImpl& context, const MTSLangevinIntegrator& integrator, double dt) {
+    cc.setAsCurrent();
+    IntegrationUtilities& integration = cc.getIntegrationUtilities();
+    if (!hasInitializedKernels)
+        initializeKernels();
+    double kT = BOLTZ*integrator.getTemperature();
+    double vscale = exp(-dt*integrator.getFriction());
+    double noisescale = sqrt(kT*(1-vscale*vscale));
+    if (cc.getUseDoublePrecision() || cc.getUseMixedPrecision()) {
+        driftKernel->setArg(4, vscale);
+        driftKernel->setArg(5, noisescale);
+        driftKernel->setArg(6, 0.5*dt);
+        positionsKernel->setArg(5, 1.0/dt);
+    }
+    else {
+        driftKernel->setArg(4, (float) vscale);
+        driftKernel->setArg(5, (float) noisescale);
+        driftKernel->setArg(6, (float) (0.5*dt));
+        positionsKernel->setArg(5, (float) (1.0/dt));
+    }
+    driftKernel->setArg(8, integration.prepareRandomNumbers(cc.getPaddedNumAtoms()));
+    driftKernel->execute(cc.getNumAtoms());
+    integration.applyConstraints(integrator.getConstraintTolerance());
+    positionsKernel->execute(cc.getNumAtoms());
+    integration.computeVirtualSites();
+}
+
+void CommonIntegrateMTSLangevinStepKernel::finishStep(ContextImpl& context, const MTSLangevinIntegrator& integrator, bool& forcesAreValid) {
+    cc.setTime(cc.getTime()+integrator.getStepSize());
+    cc.setStepCount(cc.getStepCount()+1);
+    cc.reorderAtoms();
+
+    // If the atoms were reordered, the forces from the last kick are permuted and must be recomputed.
+
+    if (cc.getAtomsWereReordered())
+        forcesAreValid = false;
+    
+    // Reduce UI lag.
+    
+#ifdef WIN32
+    cc.flushQueue();
+#endif
+}
+
+double CommonIntegrateMTSLangevinStepKernel::computeKineticEnergy(ContextImpl& context, const MTSLangevinIntegrator& integrator) {
+    return cc.getIntegrationUtilities().computeKineticEnergy(0.0);
+}
+
 void CommonIntegrateNoseHooverStepKernel::initialize(const System& system, const NoseHooverIntegrator& integrator) {
     cc.initializeContexts();
     bool useDouble = cc.getUseDoublePrecision() || cc.getUseMixedPrecision();
@@ -5662,38 +6118,17 @@ void CommonIntegrateNoseHooverStepKernel::initialize(const System& system, const
     int workGroupSize = std::min(cc.getMaxThreadBlockSize(), 512);
     defines["WORK_GROUP_SIZE"] = std::to_string(workGroupSize);
 
-    defines["BEGIN_YS_LOOP"] = "const real arr[1] = {1.0};"
-                               "for(int i=0;i<1;++i) {"
-                               "const real ys = arr[i];";
-    defines["END_YS_LOOP"] = "}";
-    program = cc.compileProgram(CommonKernelSources::noseHooverChain, defines);
-    propagateKernels[1] = program->createKernel("propagateNoseHooverChain");
-
-    defines["BEGIN_YS_LOOP"] = "const real arr[3] = {0.828981543588751, -0.657963087177502, 0.828981543588751};"
-                               "for(int i=0;i<3;++i) {"
-                               "const real ys = arr[i];";
-    program = cc.compileProgram(CommonKernelSources::noseHooverChain, defines);
-    propagateKernels[3] = program->createKernel("propagateNoseHooverChain");
-
-    defines["BEGIN_YS_LOOP"] = "const real arr[5] = {0.2967324292201065, 0.2967324292201065, -0.186929716880426, 0.2967324292201065, 0.2967324292201065};"
-                               "for(int i=0;i<5;++i) {"
-                               "const real ys = arr[i];";
-    program = cc.compileProgram(CommonKernelSources::noseHooverChain, defines);
-    propagateKernels[5] = program->createKernel("propagateNoseHooverChain");
-
-    defines["BEGIN_YS_LOOP"] = "const real arr[7] = {0.784513610477560, 0.235573213359357, -1.17767998417887, 1.31518632068391,-1.17767998417887, 0.235573213359357, 0.784513610477560};"
-                               "for(int i=0;i<7;++i) {"
-                               "const real ys = arr[i];";
-    program = cc.compileProgram(CommonKernelSources::noseHooverChain, defines);
-    propagateKernels[7] = program->createKernel("propagateNoseHooverChain");
     program = cc.compileProgram(CommonKernelSources::noseHooverChain, defines);
+    propagateKernel = program->createKernel("propagateNoseHooverChain");
     reduceEnergyKernel = program->createKernel("reduceEnergyPair");
-
     computeHeatBathEnergyKernel = program->createKernel("computeHeatBathEnergy");
     computeAtomsKineticEnergyKernel = program->createKernel("computeAtomsKineticEnergy");
     computePairsKineticEnergyKernel = program->createKernel("computePairsKineticEnergy");
     scaleAtomsVelocitiesKernel = program->createKernel("scaleAtomsVelocities");
     scalePairsVelocitiesKernel = program->createKernel("scalePairsVelocities");
+    computeChainKineticEnergiesKernel = program->createKernel("computeChainKineticEnergies");
+    propagateChainsKernel = program->createKernel("propagateNoseHooverChains");
+    scaleChainVelocitiesKernel = program->createKernel("scaleChainVelocities");
     int energyBufferSize = cc.getEnergyBuffer().getSize();
     if (cc.getUseDoublePrecision() || cc.getUseMixedPrecision())
         energyBuffer.initialize<mm_double2>(cc, energyBufferSize, "energyBuffer");
@@ -5702,6 +6137,7 @@ void CommonIntegrateNoseHooverStepKernel::initialize(const System& system, const
 }
 
 void CommonIntegrateNoseHooverStepKernel::execute(ContextImpl& context, const NoseHooverIntegrator& integrator, bool &forcesAreValid) {
+    OPENMM_TRACE_RANGE("Integrate NoseHoover");
     IntegrationUtilities& integration = cc.getIntegrationUtilities();
     int paddedNumAtoms = cc.getPaddedNumAtoms();
     double dt = integrator.getStepSize();
@@ -5799,13 +6235,7 @@ void CommonIntegrateNoseHooverStepKernel::execute(ContextImpl& context, const No
     // Position update
     kernel2->execute(numParticles);
     // Apply the thermostat
-    int numChains = integrator.getNumThermostats();
-    for(int chain = 0; chain < numChains; ++chain) {
-        const auto &thermostatChain = integrator.getThermostat(chain);
-        auto KEs = computeMaskedKineticEnergy(context, thermostatChain, false);
-        auto scaleFactors = propagateChain(context, thermostatChain, KEs, dt);
-        scaleVelocities(context, thermostatChain, scaleFactors);
-    }
+    applyThermostats(integrator, dt);
     // Position update
     kernel3->execute(numParticles);
     integration.applyConstraints(integrator.getConstraintTolerance());
@@ -5831,6 +6261,161 @@ double CommonIntegrateNoseHooverStepKernel::computeKineticEnergy(ContextImpl& co
 }
 
 
+void CommonIntegrateNoseHooverStepKernel::applyThermostats(const NoseHooverIntegrator& integrator, double timeStep) {
+    bool useDouble = cc.getUseDoublePrecision() || cc.getUseMixedPrecision();
+    int numChains = integrator.getNumThermostats();
+    if (numChains == 0)
+        return;
+
+    // Make sure every chain has its state allocated.  This is done before looking up any offsets,
+    // since allocating a new chain can move the existing ones.
+
+    for (int i = 0; i < numChains; i++) {
+        const NoseHooverChain& nhc = integrator.getThermostat(i);
+        int numYS = nhc.getNumYoshidaSuzukiTimeSteps();
+        if (numYS != 1 && numYS != 3 && numYS != 5 && numYS != 7)
+            throw OpenMMException("Number of Yoshida Suzuki time steps has to be 1, 3, 5, or 7.");
+        if (nhc.getThermostatedAtoms().size() > 0)
+            getChainStateOffset(2*nhc.getChainID(), nhc.getChainLength());
+        if (nhc.getThermostatedPairs().size() > 0)
+            getChainStateOffset(2*nhc.getChainID()+1, nhc.getChainLength());
+    }
+    if (!chainStates.isInitialized())
+        return;
+
+    // Build the description of every chain, and upload it if anything has changed.
+
+    vector<int> info(8*numChains), dofs(2*numChains);
+    vector<double> params(4*numChains);
+    for (int i = 0; i < numChains; i++) {
+        const NoseHooverChain& nhc = integrator.getThermostat(i);
+        int nPairs = nhc.getThermostatedPairs().size();
+        for (int type = 0; type < 2; type++) {
+            int key = 2*nhc.getChainID()+type;
+            bool active = (type == 0 ? nhc.getThermostatedAtoms().size() > 0 : nPairs > 0);
+            info[8*i+4*type] = (active ? chainStateRange[key].first : -1);
+            info[8*i+4*type+1] = nhc.getChainLength();
+            info[8*i+4*type+2] = nhc.getNumMultiTimeSteps();
+            info[8*i+4*type+3] = nhc.getNumYoshidaSuzukiTimeSteps();
+        }
+        dofs[2*i] = nhc.getNumDegreesOfFreedom();
+        dofs[2*i+1] = 3*nPairs;
+        params[4*i] = BOLTZ*nhc.getTemperature();
+        params[4*i+1] = nhc.getCollisionFrequency();
+        params[4*i+2] = BOLTZ*nhc.getRelativeTemperature();
+        params[4*i+3] = nhc.getRelativeCollisionFrequency();
+    }
+    if (!hasInitializedChainKernels) {
+        hasInitializedChainKernels = true;
+
+        // Concatenate the atoms and pairs of all chains, so each kernel can process every chain at once.
+
+        vector<int> atoms, atomStart(1, 0), atomIndex, pairStart(1, 0), pairIndex;
+        vector<mm_int2> pairs;
+        int maxElements = 0;
+        for (int i = 0; i < numChains; i++) {
+            const NoseHooverChain& nhc = integrator.getThermostat(i);
+            for (int atom : nhc.getThermostatedAtoms()) {
+                atoms.push_back(atom);
+                atomIndex.push_back(i);
+            }
+            for (auto& pair : nhc.getThermostatedPairs()) {
+                pairs.push_back(mm_int2(pair.first, pair.second));
+                pairIndex.push_back(i);
+            }
+            atomStart.push_back(atoms.size());
+            pairStart.push_back(pairs.size());
+            maxElements = max(maxElements, atomStart[i+1]-atomStart[i]+pairStart[i+1]-pairStart[i]);
+        }
+        int numAtoms = atoms.size();
+        int numPairs = pairs.size();
+        if (numAtoms == 0) {
+            atoms.push_back(0);
+            atomIndex.push_back(0);
+        }
+        if (numPairs == 0) {
+            pairs.push_back(mm_int2(0, 0));
+            pairIndex.push_back(0);
+        }
+        chainAtoms.initialize<int>(cc, atoms.size(), "chainAtoms");
+        chainAtomStart.initialize<int>(cc, atomStart.size(), "chainAtomStart");
+        chainAtomIndex.initialize<int>(cc, atomIndex.size(), "chainAtomIndex");
+        chainPairs.initialize<mm_int2>(cc, pairs.size(), "chainPairs");
+        chainPairStart.initialize<int>(cc, pairStart.size(), "chainPairStart");
+        chainPairIndex.initialize<int>(cc, pairIndex.size(), "chainPairIndex");
+        chainAtoms.upload(atoms);
+        chainAtomStart.upload(atomStart);
+        chainAtomIndex.upload(atomIndex);
+        chainPairs.upload(pairs);
+        chainPairStart.upload(pairStart);
+        chainPairIndex.upload(pairIndex);
+
+        // Large chains are split between several work groups, so a single thermostat can still use the whole device.
+
+        int workGroupSize = std::min(cc.getMaxThreadBlockSize(), 512);
+        groupsPerChain = max(1, min(cc.getNumThreadBlocks()/numChains, (maxElements+workGroupSize-1)/workGroupSize));
+        chainInfo.initialize<mm_int4>(cc, 2*numChains, "chainInfo");
+        chainDOFs.initialize<int>(cc, 2*numChains, "chainDOFs");
+        if (useDouble) {
+            chainParams.initialize<mm_double2>(cc, 2*numChains, "chainParams");
+            chainScaleFactors.initialize<double>(cc, 2*numChains, "chainScaleFactors");
+            chainEnergyBuffer.initialize<mm_double2>(cc, numChains*groupsPerChain, "chainEnergyBuffer");
+        }
+        else {
+            chainParams.initialize<mm_float2>(cc, 2*numChains, "chainParams");
+            chainScaleFactors.initialize<float>(cc, 2*numChains, "chainScaleFactors");
+            chainEnergyBuffer.initialize<mm_float2>(cc, numChains*groupsPerChain, "chainEnergyBuffer");
+        }
+        computeChainKineticEnergiesKernel->addArg(chainEnergyBuffer);
+        computeChainKineticEnergiesKernel->addArg(groupsPerChain);
+        computeChainKineticEnergiesKernel->addArg(cc.getVelm());
+        computeChainKineticEnergiesKernel->addArg(chainAtoms);
+        computeChainKineticEnergiesKernel->addArg(chainAtomStart);
+        computeChainKineticEnergiesKernel->addArg(chainPairs);
+        computeChainKineticEnergiesKernel->addArg(chainPairStart);
+        propagateChainsKernel->addArg(chainStates);
+        propagateChainsKernel->addArg(chainForces);
+        propagateChainsKernel->addArg(chainEnergyBuffer);
+        propagateChainsKernel->addArg(chainScaleFactors);
+        propagateChainsKernel->addArg(chainInfo);
+        propagateChainsKernel->addArg(chainDOFs);
+        propagateChainsKernel->addArg(chainParams);
+        propagateChainsKernel->addArg(2*numChains);
+        propagateChainsKernel->addArg(groupsPerChain);
+        propagateChainsKernel->addArg(); // timeStep
+        scaleChainVelocitiesKernel->addArg(chainScaleFactors);
+        scaleChainVelocitiesKernel->addArg(cc.getVelm());
+        scaleChainVelocitiesKernel->addArg(chainAtoms);
+        scaleChainVelocitiesKernel->addArg(chainAtomIndex);
+        scaleChainVelocitiesKernel->addArg(numAtoms);
+        scaleChainVelocitiesKernel->addArg(chainPairs);
+        scaleChainVelocitiesKernel->addArg(chainPairIndex);
+        scaleChainVelocitiesKernel->addArg(numPairs);
+    }
+    if (info != lastChainInfo) {
+        chainInfo.upload(info.data());
+        chainDOFs.upload(dofs);
+        lastChainInfo = info;
+    }
+    if (params != lastChainParams) {
+        if (useDouble)
+            chainParams.upload(params.data());
+        else {
+            vector<float> floatParams(params.begin(), params.end());
+            chainParams.upload(floatParams.data());
+        }
+        lastChainParams = params;
+    }
+
+    // Compute the kinetic energies, propagate the chains, and scale the velocities.
+
+    int workGroupSize = std::min(cc.getMaxThreadBlockSize(), 512);
+    computeChainKineticEnergiesKernel->execute(numChains*groupsPerChain*workGroupSize, workGroupSize);
+    propagateChainsKernel->setArg(9, (float) timeStep);
+    propagateChainsKernel->execute(2*numChains);
+    scaleChainVelocitiesKernel->execute(chainAtoms.getSize()+chainPairs.getSize());
+}
+
 std::pair<double, double> CommonIntegrateNoseHooverStepKernel::propagateChain(ContextImpl& context, const NoseHooverChain &nhc, std::pair<double, double> kineticEnergies, double timeStep) {
     bool useDouble = cc.getUseDoublePrecision() || cc.getUseMixedPrecision();
     int chainID = nhc.getChainID();
@@ -5843,6 +6428,8 @@ std::pair<double, double> CommonIntegrateNoseHooverStepKernel::propagateChain(Co
     if (numYS != 1 && numYS != 3 && numYS != 5 && numYS != 7) {
         throw OpenMMException("Number of Yoshida Suzuki time steps has to be 1, 3, 5, or 7.");
     }
+    if (nAtoms == 0 && nPairs == 0)
+        return {0, 0};
 
     if (!scaleFactorBuffer.isInitialized() || scaleFactorBuffer.getSize() == 0) {
         if (useDouble) {
@@ -5862,104 +6449,34 @@ std::pair<double, double> CommonIntegrateNoseHooverStepKernel::propagateChain(Co
             scaleFactorBuffer.upload(zeros);
         }
     }
-    if (!chainForces.isInitialized() || !chainMasses.isInitialized()) {
-        if (useDouble) {
-            std::vector<double> zeros(chainLength,0);
-            if (chainForces.isInitialized()) {
-                chainMasses.resize(chainLength);
-                chainForces.resize(chainLength);
-            }
-            else {
-                chainMasses.initialize<double>(cc, chainLength, "chainMasses");
-                chainForces.initialize<double>(cc, chainLength, "chainForces");
-            }
-            chainMasses.upload(zeros);
-            chainForces.upload(zeros);
-        }
-        else {
-            std::vector<float> zeros(chainLength,0);
-            if (chainForces.isInitialized()) {
-                chainMasses.resize(chainLength);
-                chainForces.resize(chainLength);
-            }
-            else {
-                chainMasses.initialize<float>(cc, chainLength, "chainMasses");
-                chainForces.initialize<float>(cc, chainLength, "chainForces");
-            }
-            chainMasses.upload(zeros);
-            chainForces.upload(zeros);
-        }
-    }
-    if (chainForces.getSize() < chainLength)
-        chainForces.resize(chainLength);
-    if (chainMasses.getSize() < chainLength)
-        chainMasses.resize(chainLength);
 
+    // Allocate both chains before looking up their offsets, since allocating one can move the other.
+    if (nAtoms)
+        getChainStateOffset(2*chainID, chainLength);
+    if (nPairs)
+        getChainStateOffset(2*chainID+1, chainLength);
 
     // N.B. We ignore the incoming kineticEnergy and grab it from the device buffer instead
-    if (nAtoms) {
-        if (!chainState.count(2*chainID))
-            chainState[2*chainID] = ComputeArray();
-        if (!chainState.at(2*chainID).isInitialized() || chainState.at(2*chainID).getSize() != chainLength) {
-            // We need to upload the Common array
-            if (useDouble) {
-                if (chainState.at(2*chainID).isInitialized())
-                    chainState.at(2*chainID).resize(chainLength);
-                else
-                    chainState.at(2*chainID).initialize<mm_double2>(cc, chainLength, "chainState" + std::to_string(2*chainID));
-                std::vector<mm_double2> zeros(chainLength, mm_double2(0.0, 0.0));
-                chainState.at(2*chainID).upload(zeros.data());
-            }
-            else {
-                if (chainState.at(2*chainID).isInitialized())
-                    chainState.at(2*chainID).resize(chainLength);
-                else
-                    chainState.at(2*chainID).initialize<mm_float2>(cc, chainLength, "chainState" + std::to_string(2*chainID));
-                std::vector<mm_float2> zeros(chainLength, mm_float2(0.0f, 0.0f));
-                chainState.at(2*chainID).upload(zeros.data());
-            }
-        }
-    }
-
-    if (nPairs) {
-        if (!chainState.count(2*chainID+1))
-            chainState[2*chainID+1] = ComputeArray();
-        if (!chainState.at(2*chainID+1).isInitialized() || chainState.at(2*chainID+1).getSize() != chainLength) {
-            // We need to upload the Common array
-            if (useDouble) {
-                if (chainState.at(2*chainID+1).isInitialized())
-                    chainState.at(2*chainID+1).resize(chainLength);
-                else
-                    chainState.at(2*chainID+1).initialize<mm_double2>(cc, chainLength, "chainState" + std::to_string(2*chainID+1));
-                std::vector<mm_double2> zeros(chainLength, mm_double2(0.0, 0.0));
-                chainState.at(2*chainID+1).upload(zeros.data());
-            }
-            else {
-                if (chainState.at(2*chainID+1).isInitialized())
-                    chainState.at(2*chainID+1).resize(chainLength);
-                else
-                    chainState.at(2*chainID+1).initialize<mm_float2>(cc, chainLength, "chainState" + std::to_string(2*chainID+1));
-                std::vector<mm_float2> zeros(chainLength, mm_float2(0.0f, 0.0f));
-                chainState.at(2*chainID+1).upload(zeros.data());
-            }
-        }
-    }
-
     if (!hasInitializedPropagateKernel) {
         hasInitializedPropagateKernel = true;
-        propagateKernels[numYS]->addArg(); // ChainState
-        propagateKernels[numYS]->addArg(kineticEnergyBuffer);
-        propagateKernels[numYS]->addArg(scaleFactorBuffer);
-        propagateKernels[numYS]->addArg(chainMasses);
-        propagateKernels[numYS]->addArg(chainForces);
-        propagateKernels[numYS]->addArg(); // ChainType
-        propagateKernels[numYS]->addArg(chainLength);
-        propagateKernels[numYS]->addArg(numMTS);
-        propagateKernels[numYS]->addArg(); // numDoFs
-        propagateKernels[numYS]->addArg((float)timeStep);
-        propagateKernels[numYS]->addArg(); // kT
-        propagateKernels[numYS]->addArg(); // frequency
-    }
+        propagateKernel->addArg(chainStates);
+        propagateKernel->addArg(kineticEnergyBuffer);
+        propagateKernel->addArg(scaleFactorBuffer);
+        propagateKernel->addArg(chainForces);
+        propagateKernel->addArg(); // ChainType
+        propagateKernel->addArg(); // chainLength
+        propagateKernel->addArg(); // numMTS
+        propagateKernel->addArg(); // numYS
+        propagateKernel->addArg(); // numDoFs
+        propagateKernel->addArg(); // timeStep
+        propagateKernel->addArg(); // kT
+        propagateKernel->addArg(); // frequency
+        propagateKernel->addArg(); // stateOffset
+    }
+    propagateKernel->setArg(5, chainLength);
+    propagateKernel->setArg(6, numMTS);
+    propagateKernel->setArg(7, numYS);
+    propagateKernel->setArg(9, (float) timeStep);
 
     if (nAtoms) {
         int chainType = 0;
@@ -5967,16 +6484,16 @@ std::pair<double, double> CommonIntegrateNoseHooverStepKernel::propagateChain(Co
         float frequency = nhc.getCollisionFrequency();
         double kT = BOLTZ * temperature;
         int numDOFs = nhc.getNumDegreesOfFreedom();
-        propagateKernels[numYS]->setArg(0, chainState[2*chainID]);
-        propagateKernels[numYS]->setArg(5, chainType);
-        propagateKernels[numYS]->setArg(8, numDOFs);
+        propagateKernel->setArg(4, chainType);
+        propagateKernel->setArg(8, numDOFs);
         if (useDouble) {
-            propagateKernels[numYS]->setArg(10, kT);
+            propagateKernel->setArg(10, kT);
         } else {
-            propagateKernels[numYS]->setArg(10, (float)kT);
+            propagateKernel->setArg(10, (float)kT);
         }
-        propagateKernels[numYS]->setArg(11, frequency);
-        propagateKernels[numYS]->execute(1, 1);
+        propagateKernel->setArg(11, frequency);
+        propagateKernel->setArg(12, chainStateRange[2*chainID].first);
+        propagateKernel->execute(1, 1);
     }
     if (nPairs) {
         int chainType = 1;
@@ -5984,16 +6501,16 @@ std::pair<double, double> CommonIntegrateNoseHooverStepKernel::propagateChain(Co
         float relativeFrequency = nhc.getRelativeCollisionFrequency();
         double kT = BOLTZ * relativeTemperature;
         int ndf = 3*nPairs;
-        propagateKernels[numYS]->setArg(0, chainState[2*chainID+1]);
-        propagateKernels[numYS]->setArg(5, chainType);
-        propagateKernels[numYS]->setArg(8, ndf);
+        propagateKernel->setArg(4, chainType);
+        propagateKernel->setArg(8, ndf);
         if (useDouble) {
-            propagateKernels[numYS]->setArg(10, kT);
+            propagateKernel->setArg(10, kT);
         } else {
-            propagateKernels[numYS]->setArg(10, (float)kT);
+            propagateKernel->setArg(10, (float)kT);
         }
-        propagateKernels[numYS]->setArg(11, relativeFrequency);
-        propagateKernels[numYS]->execute(1, 1);
+        propagateKernel->setArg(11, relativeFrequency);
+        propagateKernel->setArg(12, chainStateRange[2*chainID+1].first);
+        propagateKernel->execute(1, 1);
     }
     return {0, 0};
 }
@@ -6005,12 +6522,10 @@ double CommonIntegrateNoseHooverStepKernel::computeHeatBathEnergy(ContextImpl& c
     int chainID = nhc.getChainID();
     int chainLength = nhc.getChainLength();
 
-    bool absChainIsValid = chainState.count(2*chainID) != 0 &&
-                           chainState[2*chainID].isInitialized() &&
-                           chainState[2*chainID].getSize() == chainLength;
-    bool relChainIsValid = chainState.count(2*chainID+1) != 0 &&
-                           chainState[2*chainID+1].isInitialized() &&
-                           chainState[2*chainID+1].getSize() == chainLength;
+    bool absChainIsValid = chainStateRange.count(2*chainID) != 0 &&
+                           chainStateRange[2*chainID].second == chainLength;
+    bool relChainIsValid = chainStateRange.count(2*chainID+1) != 0 &&
+                           chainStateRange[2*chainID+1].second == chainLength;
 
     if (!absChainIsValid && !relChainIsValid) return 0.0;
 
@@ -6032,12 +6547,14 @@ double CommonIntegrateNoseHooverStepKernel::computeHeatBathEnergy(ContextImpl& c
     if(!hasInitializedHeatBathEnergyKernel) {
         hasInitializedHeatBathEnergyKernel = true;
         computeHeatBathEnergyKernel->addArg(heatBathEnergy);
-        computeHeatBathEnergyKernel->addArg(chainLength);
+        computeHeatBathEnergyKernel->addArg(); // chainLength
         computeHeatBathEnergyKernel->addArg(); // numDOFs
         computeHeatBathEnergyKernel->addArg(); // kT
         computeHeatBathEnergyKernel->addArg(); // frequency
-        computeHeatBathEnergyKernel->addArg(); // chainstate
+        computeHeatBathEnergyKernel->addArg(chainStates);
+        computeHeatBathEnergyKernel->addArg(); // stateOffset
     }
+    computeHeatBathEnergyKernel->setArg(1, chainLength);
 
     if (absChainIsValid) {
         int numDOFs = nhc.getNumDegreesOfFreedom();
@@ -6052,7 +6569,7 @@ double CommonIntegrateNoseHooverStepKernel::computeHeatBathEnergy(ContextImpl& c
             computeHeatBathEnergyKernel->setArg(3, (float)kT);
         }
         computeHeatBathEnergyKernel->setArg(4, frequency);
-        computeHeatBathEnergyKernel->setArg(5, chainState[2*chainID]);
+        computeHeatBathEnergyKernel->setArg(6, chainStateRange[2*chainID].first);
         computeHeatBathEnergyKernel->execute(1, 1);
     }
     if (relChainIsValid) {
@@ -6068,7 +6585,7 @@ double CommonIntegrateNoseHooverStepKernel::computeHeatBathEnergy(ContextImpl& c
             computeHeatBathEnergyKernel->setArg(3, (float)kT);
         }
         computeHeatBathEnergyKernel->setArg(4, frequency);
-        computeHeatBathEnergyKernel->setArg(5, chainState[2*chainID+1]);
+        computeHeatBathEnergyKernel->setArg(6, chainStateRange[2*chainID+1].first);
         computeHeatBathEnergyKernel->execute(1, 1);
     }
 
@@ -6208,22 +6725,23 @@ void CommonIntegrateNoseHooverStepKernel::scaleVelocities(ContextImpl& context,
 }
 
 void CommonIntegrateNoseHooverStepKernel::createCheckpoint(ContextImpl& context, ostream& stream) const {
-    int numChains = chainState.size();
+    map<int, vector<mm_double2> > states;
+    downloadChainStates(states);
+    int numChains = states.size();
     bool useDouble = cc.getUseDoublePrecision() || cc.getUseMixedPrecision();
     stream.write((char*) &numChains, sizeof(int));
-    for (auto& state : chainState){
+    for (auto& state : states){
         int chainID = state.first;
-        int chainLength = state.second.getSize();
+        int chainLength = state.second.size();
         stream.write((char*) &chainID, sizeof(int));
         stream.write((char*) &chainLength, sizeof(int));
         if (useDouble) {
-            vector<mm_double2> stateVec;
-            state.second.download(stateVec);
-            stream.write((char*) stateVec.data(), sizeof(mm_double2)*chainLength);
+            stream.write((char*) state.second.data(), sizeof(mm_double2)*chainLength);
         }
         else {
             vector<mm_float2> stateVec;
-            state.second.download(stateVec);
+            for (const mm_double2& s : state.second)
+                stateVec.push_back(mm_float2((float) s.x, (float) s.y));
             stream.write((char*) stateVec.data(), sizeof(mm_float2)*chainLength);
         }
     }
@@ -6233,91 +6751,131 @@ void CommonIntegrateNoseHooverStepKernel::loadCheckpoint(ContextImpl& context, i
     int numChains;
     bool useDouble = cc.getUseDoublePrecision() || cc.getUseMixedPrecision();
     stream.read((char*) &numChains, sizeof(int));
-    chainState.clear();
+    map<int, vector<mm_double2> > states;
     for (int i = 0; i < numChains; i++) {
         int chainID, chainLength;
         stream.read((char*) &chainID, sizeof(int));
         stream.read((char*) &chainLength, sizeof(int));
         if (useDouble) {
-            chainState[chainID] = ComputeArray();
-            chainState[chainID].initialize<mm_double2>(cc, chainLength, "chainState" + to_string(chainID));
             vector<mm_double2> stateVec(chainLength);
             stream.read((char*) &stateVec[0], sizeof(mm_double2)*chainLength);
-            chainState[chainID].upload(stateVec);
+            states[chainID] = stateVec;
         }
         else {
-            chainState[chainID] = ComputeArray();
-            chainState[chainID].initialize<mm_float2>(cc, chainLength, "chainState" + to_string(chainID));
             vector<mm_float2> stateVec(chainLength);
             stream.read((char*) &stateVec[0], sizeof(mm_float2)*chainLength);
-            chainState[chainID].upload(stateVec);
+            for (const mm_float2& s : stateVec)
+                states[chainID].push_back(mm_double2(s.x, s.y));
         }
     }
+    uploadChainStates(states);
 }
 
 void CommonIntegrateNoseHooverStepKernel::getChainStates(ContextImpl& context, vector<vector<double> >& positions, vector<vector<double> >& velocities) const {
-    int numChains = chainState.size();
-    bool useDouble = cc.getUseDoublePrecision() || cc.getUseMixedPrecision();
+    map<int, vector<mm_double2> > states;
+    downloadChainStates(states);
+    int numChains = states.size();
     positions.clear();
     velocities.clear();
     positions.resize(numChains);
     velocities.resize(numChains);
     for (int i = 0; i < numChains; i++) {
-        const ComputeArray& state = chainState.at(i);
-        if (useDouble) {
-            vector<mm_double2> stateVec;
-            state.download(stateVec);
-            for (int j = 0; j < stateVec.size(); j++) {
-                positions[i].push_back(stateVec[j].x);
-                velocities[i].push_back(stateVec[j].y);
-            }
-        }
-        else {
-            vector<mm_float2> stateVec;
-            state.download(stateVec);
-            for (int j = 0; j < stateVec.size(); j++) {
-                positions[i].push_back((float) stateVec[j].x);
-                velocities[i].push_back((float) stateVec[j].y);
-            }
+        for (const mm_double2& s : states.at(i)) {
+            positions[i].push_back(s.x);
+            velocities[i].push_back(s.y);
         }
     }
 }
 
 void CommonIntegrateNoseHooverStepKernel::setChainStates(ContextImpl& context, const vector<vector<double> >& positions, const vector<vector<double> >& velocities) {
     int numChains = positions.size();
-    bool useDouble = cc.getUseDoublePrecision() || cc.getUseMixedPrecision();
-    chainState.clear();
+    map<int, vector<mm_double2> > states;
     for (int i = 0; i < numChains; i++) {
         int chainLength = positions[i].size();
-        chainState[i] = ComputeArray();
-        if (useDouble) {
-            chainState[i].initialize<mm_double2>(cc, chainLength, "chainState"+cc.intToString(i));
-            vector<mm_double2> stateVec;
-            for (int j = 0; j < chainLength; j++)
-                stateVec.push_back(mm_double2(positions[i][j], velocities[i][j]));
-            chainState[i].upload(stateVec);
-        }
-        else {
-            chainState[i].initialize<mm_float2>(cc, chainLength, "chainState"+cc.intToString(i));
-            vector<mm_float2> stateVec;
-            for (int j = 0; j < chainLength; j++)
-                stateVec.push_back(mm_float2((float) positions[i][j], (float) velocities[i][j]));
-            chainState[i].upload(stateVec);
-        }
+        for (int j = 0; j < chainLength; j++)
+            states[i].push_back(mm_double2(positions[i][j], velocities[i][j]));
     }
+    uploadChainStates(states);
 }
 
-void CommonIntegrateBrownianStepKernel::initialize(const System& system, const BrownianIntegrator& integrator) {
+int CommonIntegrateNoseHooverStepKernel::getChainStateOffset(int key, int chainLength) {
+    auto range = chainStateRange.find(key);
+    if (range != chainStateRange.end() && range->second.second == chainLength)
+        return range->second.first;
+    map<int, vector<mm_double2> > states;
+    downloadChainStates(states);
+    states[key] = vector<mm_double2>(chainLength, mm_double2(0.0, 0.0));
+    uploadChainStates(states);
+    return chainStateRange[key].first;
+}
+
+void CommonIntegrateNoseHooverStepKernel::downloadChainStates(map<int, vector<mm_double2> >& states) const {
+    states.clear();
+    if (chainStateRange.size() == 0)
+        return;
+    vector<mm_double2> data;
+    if (cc.getUseDoublePrecision() || cc.getUseMixedPrecision())
+        chainStates.download(data);
+    else {
+        vector<mm_float2> floatData;
+        chainStates.download(floatData);
+        for (const mm_float2& s : floatData)
+            data.push_back(mm_double2(s.x, s.y));
+    }
+    for (auto& range : chainStateRange)
+        states[range.first] = vector<mm_double2>(data.begin()+range.second.first, data.begin()+range.second.first+range.second.second);
+}
+
+void CommonIntegrateNoseHooverStepKernel::uploadChainStates(const map<int, vector<mm_double2> >& states) {
+    bool useDouble = cc.getUseDoublePrecision() || cc.getUseMixedPrecision();
+    chainStateRange.clear();
+    vector<mm_double2> data;
+    for (auto& state : states) {
+        chainStateRange[state.first] = make_pair((int) data.size(), (int) state.second.size());
+        data.insert(data.end(), state.second.begin(), state.second.end());
+    }
+    if (data.size() == 0)
+        return;
+
+    // All chains are stored in a single array so they can be propagated together.  chainForces
+    // is scratch space with the same layout.
+
+    if (chainStates.isInitialized()) {
+        chainStates.resize(data.size());
+        chainForces.resize(data.size());
+    }
+    else if (useDouble) {
+        chainStates.initialize<mm_double2>(cc, data.size(), "chainStates");
+        chainForces.initialize<double>(cc, data.size(), "chainForces");
+    }
+    else {
+        chainStates.initialize<mm_float2>(cc, data.size(), "chainStates");
+        chainForces.initialize<float>(cc, data.size(), "chainForces");
+    }
+    if (useDouble)
+        chainStates.upload(data);
+    else {
+        vector<mm_float2> floatData;
+        for (const mm_double2& s : data)
+            floatData.push_back(mm_float2((float) s.x, (float) s.y));
+        chainStates.upload(floatData);
+    }
+}
+
+void CommonIntegrateBrownianStepKernel::initialize(const System& system, const BrownianIntegrator& integrator) {
     cc.initializeContexts();
     cc.setAsCurrent();
     cc.getIntegrationUtilities().initRandomNumberGenerator(integrator.getRandomNumberSeed());
-    ComputeProgram program = cc.compileProgram(CommonKernelSources::brownian);
+    ComputeProgram program = cc.compileProgram(CommonKernelSources::philox+CommonKernelSources::brownian);
     kernel1 = program->createKernel("integrateBrownianPart1");
     kernel2 = program->createKernel("integrateBrownianPart2");
+    fusedKernel = program->createKernel("integrateBrownianFused");
+    useFusedKernel = (system.getNumConstraints() == 0);
     prevStepSize = -1.0;
 }
 
 void CommonIntegrateBrownianStepKernel::execute(ContextImpl& context, const BrownianIntegrator& integrator) {
+    OPENMM_TRACE_RANGE("Integrate Brownian");
     cc.setAsCurrent();
     IntegrationUtilities& integration = cc.getIntegrationUtilities();
     int numAtoms = cc.getNumAtoms();
@@ -6331,8 +6889,9 @@ void CommonIntegrateBrownianStepKernel::execute(ContextImpl& context, const Brow
         kernel1->addArg(cc.getLongForceBuffer());
         kernel1->addArg(integration.getPosDelta());
         kernel1->addArg(cc.getVelm());
-        kernel1->addArg(integration.getRandom());
-        kernel1->addArg(); // Random index will be set just before it is executed.
+        kernel1->addArg(cc.getAtomIndexArray());
+        kernel1->addArg(integration.getRandomKey());
+        kernel1->addArg(); // Random counter will be set just before it is executed.
         kernel2->addArg(numAtoms);
         kernel2->addArg(); // oneOverDeltaT
         kernel2->addArg(cc.getPosq());
@@ -6340,6 +6899,19 @@ void CommonIntegrateBrownianStepKernel::execute(ContextImpl& context, const Brow
         kernel2->addArg(integration.getPosDelta());
         if (cc.getUseMixedPrecision())
             kernel2->addArg(cc.getPosqCorrection());
+        fusedKernel->addArg(numAtoms);
+        fusedKernel->addArg(paddedNumAtoms);
+        fusedKernel->addArg(); // tauDeltaT
+        fusedKernel->addArg(); // noiseAmplitude
+        fusedKernel->addArg(); // oneOverDeltaT
+        fusedKernel->addArg(cc.getLongForceBuffer());
+        fusedKernel->addArg(cc.getPosq());
+        fusedKernel->addArg(cc.getVelm());
+        fusedKernel->addArg(cc.getAtomIndexArray());
+        fusedKernel->addArg(integration.getRandomKey());
+        fusedKernel->addArg(); // Random counter will be set just before it is executed.
+        if (cc.getUseMixedPrecision())
+            fusedKernel->addArg(cc.getPosqCorrection());
     }
     double temperature = integrator.getTemperature();
     double friction = integrator.getFriction();
@@ -6350,29 +6922,48 @@ void CommonIntegrateBrownianStepKernel::execute(ContextImpl& context, const Brow
             kernel1->setArg(2, tau*stepSize);
             kernel1->setArg(3, sqrt(2.0f*BOLTZ*temperature*stepSize*tau));
             kernel2->setArg(1, 1.0/stepSize);
+            fusedKernel->setArg(2, tau*stepSize);
+            fusedKernel->setArg(3, sqrt(2.0f*BOLTZ*temperature*stepSize*tau));
+            fusedKernel->setArg(4, 1.0/stepSize);
         }
         else {
             kernel1->setArg(2, (float) (tau*stepSize));
             kernel1->setArg(3, (float) (sqrt(2.0f*BOLTZ*temperature*stepSize*tau)));
             kernel2->setArg(1, (float) (1.0/stepSize));
+            fusedKernel->setArg(2, (float) (tau*stepSize));
+            fusedKernel->setArg(3, (float) (sqrt(2.0f*BOLTZ*temperature*stepSize*tau)));
+            fusedKernel->setArg(4, (float) (1.0/stepSize));
         }
         prevTemp = temperature;
         prevFriction = friction;
         prevStepSize = stepSize;
     }
 
-    // Call the first integration kernel.
+    // The noise is generated on the fly with a counter based generator.  The counter is derived from
+    // the step count so it is restored by checkpoints, and offset to keep it distinct from the ones
+    // used by other integrators and the Andersen thermostat.
 
-    kernel1->setArg(8, integration.prepareRandomNumbers(cc.getPaddedNumAtoms()));
-    kernel1->execute(numAtoms);
+    long long counter = (1LL<<61)+cc.getStepCount();
+    if (useFusedKernel) {
+        // With no constraints, the whole step is done in a single pass.
 
-    // Apply constraints.
+        fusedKernel->setArg(10, counter);
+        fusedKernel->execute(numAtoms);
+    }
+    else {
+        // Call the first integration kernel.
 
-    integration.applyConstraints(integrator.getConstraintTolerance());
+        kernel1->setArg(9, counter);
+        kernel1->execute(numAtoms);
 
-    // Call the second integration kernel.
+        // Apply constraints.
 
-    kernel2->execute(numAtoms);
+        integration.applyConstraints(integrator.getConstraintTolerance());
+
+        // Call the second integration kernel.
+
+        kernel2->execute(numAtoms);
+    }
     integration.computeVirtualSites();
 
     // Update the time and step count.
@@ -6392,6 +6983,46 @@ double CommonIntegrateBrownianStepKernel::computeKineticEnergy(ContextImpl& cont
     return cc.getIntegrationUtilities().computeKineticEnergy(0);
 }
 
+/**
+ * Create the array that the step size selection kernels for the variable step size integrators use to
+ * record the steps they have taken since the host last checked.
+ */
+static void initializeVariableStepState(ComputeContext& cc, ComputeArray& stepState) {
+    if (cc.getUseDoublePrecision() || cc.getUseMixedPrecision()) {
+        stepState.initialize<mm_double4>(cc, 1, "stepState");
+        stepState.upload(vector<mm_double4>(1, mm_double4(0, 0, 0, 0)));
+    }
+    else {
+        stepState.initialize<mm_float4>(cc, 1, "stepState");
+        stepState.upload(vector<mm_float4>(1, mm_float4(0, 0, 0, 0)));
+    }
+}
+
+/**
+ * Wait for the steps taken by a variable step size integrator to complete, update the time and step
+ * count, and reset the record of steps taken.  Returns the size of the last step, or defaultStepSize
+ * if no step was taken.
+ */
+static double synchronizeVariableSteps(ComputeContext& cc, ComputeArray& stepState, double maxTime, double defaultStepSize) {
+    mm_double4 state;
+    if (cc.getUseDoublePrecision() || cc.getUseMixedPrecision()) {
+        stepState.download(&state);
+        stepState.upload(vector<mm_double4>(1, mm_double4(0, 0, 0, state.w)));
+    }
+    else {
+        mm_float4 stateFloat;
+        stepState.download(&stateFloat);
+        stepState.upload(vector<mm_float4>(1, mm_float4(0, 0, 0, stateFloat.w)));
+        state = mm_double4(stateFloat.x, stateFloat.y, stateFloat.z, stateFloat.w);
+    }
+    if (state.z != 0)
+        cc.setTime(maxTime); // Avoid round-off error
+    else
+        cc.setTime(cc.getTime()+state.x);
+    cc.setStepCount(cc.getStepCount()+(int) state.y);
+    return (state.w > 0 ? state.w : defaultStepSize);
+}
+
 void CommonIntegrateVariableVerletStepKernel::initialize(const System& system, const VariableVerletIntegrator& integrator) {
     cc.initializeContexts();
     cc.setAsCurrent();
@@ -6399,10 +7030,17 @@ void CommonIntegrateVariableVerletStepKernel::initialize(const System& system, c
     kernel1 = program->createKernel("integrateVerletPart1");
     kernel2 = program->createKernel("integrateVerletPart2");
     selectSizeKernel = program->createKernel("selectVerletStepSize");
+    initializeVariableStepState(cc, stepState);
     blockSize = min(256, system.getNumParticles());
 }
 
 double CommonIntegrateVariableVerletStepKernel::execute(ContextImpl& context, const VariableVerletIntegrator& integrator, double maxTime) {
+    executeAsync(context, integrator, maxTime);
+    return synchronizeSteps(context, integrator);
+}
+
+void CommonIntegrateVariableVerletStepKernel::executeAsync(ContextImpl& context, const VariableVerletIntegrator& integrator, double maxTime) {
+    OPENMM_TRACE_RANGE("Integrate VariableVerlet");
     cc.setAsCurrent();
     IntegrationUtilities& integration = cc.getIntegrationUtilities();
     int numAtoms = cc.getNumAtoms();
@@ -6427,27 +7065,29 @@ double CommonIntegrateVariableVerletStepKernel::execute(ContextImpl& context, co
             kernel2->addArg(cc.getPosqCorrection());
         selectSizeKernel->addArg(numAtoms);
         selectSizeKernel->addArg(paddedNumAtoms);
-        selectSizeKernel->addArg();
-        selectSizeKernel->addArg();
+        for (int i = 0; i < 3; i++)
+            selectSizeKernel->addArg();
         selectSizeKernel->addArg(cc.getIntegrationUtilities().getStepSize());
         selectSizeKernel->addArg(cc.getVelm());
         selectSizeKernel->addArg(cc.getLongForceBuffer());
+        selectSizeKernel->addArg(stepState);
     }
 
     // Select the step size to use.
 
     bool useDouble = cc.getUseDoublePrecision() || cc.getUseMixedPrecision();
-    double maxStepSize = maxTime-cc.getTime();
-    if (integrator.getMaximumStepSize() > 0)
-        maxStepSize = min(integrator.getMaximumStepSize(), maxStepSize);
-    float maxStepSizeFloat = (float) maxStepSize;
+    double maxStepSize = (integrator.getMaximumStepSize() > 0 ? integrator.getMaximumStepSize() : numeric_limits<double>::infinity());
+    double remainingTime = maxTime-cc.getTime();
+    asyncMaxTime = maxTime;
     if (useDouble) {
         selectSizeKernel->setArg(2, maxStepSize);
-        selectSizeKernel->setArg(3, integrator.getErrorTolerance());
+        selectSizeKernel->setArg(3, remainingTime);
+        selectSizeKernel->setArg(4, integrator.getErrorTolerance());
     }
     else {
-        selectSizeKernel->setArg(2, maxStepSizeFloat);
-        selectSizeKernel->setArg(3, (float) integrator.getErrorTolerance());
+        selectSizeKernel->setArg(2, (float) maxStepSize);
+        selectSizeKernel->setArg(3, (float) remainingTime);
+        selectSizeKernel->setArg(4, (float) integrator.getErrorTolerance());
     }
     selectSizeKernel->execute(blockSize, blockSize);
 
@@ -6470,24 +7110,14 @@ double CommonIntegrateVariableVerletStepKernel::execute(ContextImpl& context, co
     cc.flushQueue();
 #endif
 
-    // Update the time and step count.
-
-    double dt = cc.getIntegrationUtilities().getLastStepSize();
-    double time = cc.getTime()+dt;
-    if (useDouble) {
-        if (dt == maxStepSize)
-            time = maxTime; // Avoid round-off error
-    }
-    else {
-        if (dt == maxStepSizeFloat)
-            time = maxTime; // Avoid round-off error
-    }
-    cc.setTime(time);
-    cc.setStepCount(cc.getStepCount()+1);
     cc.reorderAtoms();
-    return dt;
 }
 
+double CommonIntegrateVariableVerletStepKernel::synchronizeSteps(ContextImpl& context, const VariableVerletIntegrator& integrator) {
+    return synchronizeVariableSteps(cc, stepState, asyncMaxTime, integrator.getStepSize());
+}
+
+
 double CommonIntegrateVariableVerletStepKernel::computeKineticEnergy(ContextImpl& context, const VariableVerletIntegrator& integrator) {
     return cc.getIntegrationUtilities().computeKineticEnergy(0.5*integrator.getStepSize());
 }
@@ -6501,11 +7131,18 @@ void CommonIntegrateVariableLangevinStepKernel::initialize(const System& system,
     kernel2 = program->createKernel("integrateLangevinPart2");
     selectSizeKernel = program->createKernel("selectLangevinStepSize");
     params.initialize(cc, 3, cc.getUseDoublePrecision() || cc.getUseMixedPrecision() ? sizeof(double) : sizeof(float), "langevinParams");
+    initializeVariableStepState(cc, stepState);
     blockSize = min(256, system.getNumParticles());
     blockSize = max(blockSize, params.getSize());
 }
 
 double CommonIntegrateVariableLangevinStepKernel::execute(ContextImpl& context, const VariableLangevinIntegrator& integrator, double maxTime) {
+    executeAsync(context, integrator, maxTime);
+    return synchronizeSteps(context, integrator);
+}
+
+void CommonIntegrateVariableLangevinStepKernel::executeAsync(ContextImpl& context, const VariableLangevinIntegrator& integrator, double maxTime) {
+    OPENMM_TRACE_RANGE("Integrate VariableLangevin");
     cc.setAsCurrent();
     IntegrationUtilities& integration = cc.getIntegrationUtilities();
     int numAtoms = cc.getNumAtoms();
@@ -6531,31 +7168,33 @@ double CommonIntegrateVariableLangevinStepKernel::execute(ContextImpl& context,
             kernel2->addArg(cc.getPosqCorrection());
         selectSizeKernel->addArg(numAtoms);
         selectSizeKernel->addArg(paddedNumAtoms);
-        for (int i = 0; i < 4; i++)
+        for (int i = 0; i < 5; i++)
             selectSizeKernel->addArg();
         selectSizeKernel->addArg(integration.getStepSize());
         selectSizeKernel->addArg(cc.getVelm());
         selectSizeKernel->addArg(cc.getLongForceBuffer());
         selectSizeKernel->addArg(params);
+        selectSizeKernel->addArg(stepState);
     }
 
     // Select the step size to use.
 
-    double maxStepSize = maxTime-cc.getTime();
-    if (integrator.getMaximumStepSize() > 0)
-        maxStepSize = min(integrator.getMaximumStepSize(), maxStepSize);
-    float maxStepSizeFloat = (float) maxStepSize;
+    double maxStepSize = (integrator.getMaximumStepSize() > 0 ? integrator.getMaximumStepSize() : numeric_limits<double>::infinity());
+    double remainingTime = maxTime-cc.getTime();
+    asyncMaxTime = maxTime;
     if (useDouble) {
         selectSizeKernel->setArg(2, maxStepSize);
-        selectSizeKernel->setArg(3, integrator.getErrorTolerance());
-        selectSizeKernel->setArg(4, integrator.getFriction());
-        selectSizeKernel->setArg(5, BOLTZ*integrator.getTemperature());
+        selectSizeKernel->setArg(3, remainingTime);
+        selectSizeKernel->setArg(4, integrator.getErrorTolerance());
+        selectSizeKernel->setArg(5, integrator.getFriction());
+        selectSizeKernel->setArg(6, BOLTZ*integrator.getTemperature());
     }
     else {
-        selectSizeKernel->setArg(2, maxStepSizeFloat);
-        selectSizeKernel->setArg(3, (float) integrator.getErrorTolerance());
-        selectSizeKernel->setArg(4, (float) integrator.getFriction());
-        selectSizeKernel->setArg(5, (float) (BOLTZ*integrator.getTemperature()));
+        selectSizeKernel->setArg(2, (float) maxStepSize);
+        selectSizeKernel->setArg(3, (float) remainingTime);
+        selectSizeKernel->setArg(4, (float) integrator.getErrorTolerance());
+        selectSizeKernel->setArg(5, (float) integrator.getFriction());
+        selectSizeKernel->setArg(6, (float) (BOLTZ*integrator.getTemperature()));
     }
     selectSizeKernel->execute(blockSize, blockSize);
 
@@ -6579,24 +7218,14 @@ double CommonIntegrateVariableLangevinStepKernel::execute(ContextImpl& context,
     cc.flushQueue();
 #endif
 
-    // Update the time and step count.
-
-    double dt = cc.getIntegrationUtilities().getLastStepSize();
-    double time = cc.getTime()+dt;
-    if (useDouble) {
-        if (dt == maxStepSize)
-            time = maxTime; // Avoid round-off error
-    }
-    else {
-        if (dt == maxStepSizeFloat)
-            time = maxTime; // Avoid round-off error
-    }
-    cc.setTime(time);
-    cc.setStepCount(cc.getStepCount()+1);
     cc.reorderAtoms();
-    return dt;
 }
 
+double CommonIntegrateVariableLangevinStepKernel::synchronizeSteps(ContextImpl& context, const VariableLangevinIntegrator& integrator) {
+    return synchronizeVariableSteps(cc, stepState, asyncMaxTime, integrator.getStepSize());
+}
+
+
 double CommonIntegrateVariableLangevinStepKernel::computeKineticEnergy(ContextImpl& context, const VariableLangevinIntegrator& integrator) {
     return cc.getIntegrationUtilities().computeKineticEnergy(0.5*integrator.getStepSize());
 }
@@ -6783,7 +7412,7 @@ void CommonIntegrateCustomStepKernel::prepareForComputation(ContextImpl& context
             int width;
             vector<float> f = cc.getExpressionUtilities().computeFunctionCoefficients(integrator.getTabulatedFunction(i), width);
             tabulatedFunctions[i].initialize<float>(cc, f.size(), "TabulatedFunction");
-            tabulatedFunctions[i].upload(f);
+            tabulatedFunctions[i].uploadShared(f);
             if (width == 1)
                 tableTypes.push_back("float");
             else
@@ -6902,6 +7531,30 @@ void CommonIntegrateCustomStepKernel::prepareForComputation(ContextImpl& context
             }
         }
         
+        // Identify global steps that can be evaluated on the device, so the host never needs to see
+        // their values.  They must store the result in a global variable, and may only depend on values
+        // that are available on the device.
+
+        globalOnDevice.resize(numSteps, false);
+        for (int step = 0; step < numSteps; step++) {
+            if ((stepType[step] != CustomIntegrator::ComputeGlobal && stepType[step] != CustomIntegrator::ComputeSum) || stepTarget[step].type != VARIABLE)
+                continue;
+            if (stepType[step] == CustomIntegrator::ComputeSum)
+                globalOnDevice[step] = true;
+            else if (stepType[step] == CustomIntegrator::ComputeGlobal) {
+                map<string, string> available;
+                for (int i = 0; i < integrator.getNumGlobalVariables(); i++)
+                    available[integrator.getGlobalVariableName(i)] = "";
+                for (auto& name : parameterNames)
+                    available[name] = "";
+                available["dt"] = "";
+                available["uniform"] = "";
+                available["gaussian"] = "";
+                available[energyName[step]] = "";
+                globalOnDevice[step] = usesOnlyVariables(expression[step][0].getRootNode(), available);
+            }
+        }
+
         // Determine how each step will represent the position (as just a value, or a value plus a delta).
         
         hasAnyConstraints = (context.getSystem().getNumConstraints() > 0);
@@ -6925,13 +7578,23 @@ void CommonIntegrateCustomStepKernel::prepareForComputation(ContextImpl& context
             }
         }
         
-        // Identify steps that can be merged into a single kernel.
+        // Identify steps that can be merged into a single kernel.  A step that uses forces or energy can
+        // only be merged if they are still valid and for the same force groups as at the start of the
+        // kernel, but steps that do not use them can always be merged.
         
+        int firstMergedStep = 0;
+        bool invalidatedSinceFirst = false;
         for (int step = 1; step < numSteps; step++) {
-            if (invalidatesForces[step-1] || forceGroupFlags[step] != forceGroupFlags[step-1])
-                continue;
-            if (stepType[step-1] == CustomIntegrator::ComputePerDof && stepType[step] == CustomIntegrator::ComputePerDof)
-                merged[step] = true;
+            if (stepType[step-1] == CustomIntegrator::ComputePerDof && stepType[step] == CustomIntegrator::ComputePerDof) {
+                invalidatedSinceFirst |= invalidatesForces[step-1];
+                bool usesForces = (needsForces[step] || needsEnergy[step]);
+                if (!usesForces || (!invalidatedSinceFirst && forceGroupFlags[step] == forceGroupFlags[firstMergedStep]))
+                    merged[step] = true;
+            }
+            if (!merged[step]) {
+                firstMergedStep = step;
+                invalidatedSinceFirst = false;
+            }
         }
         for (int step = numSteps-1; step > 0; step--)
             if (merged[step]) {
@@ -6950,8 +7613,18 @@ void CommonIntegrateCustomStepKernel::prepareForComputation(ContextImpl& context
                 stringstream compute;
                 for (int i = 0; i < perDofValues.size(); i++)
                     compute << tempType<<" perDof"<<cc.intToString(i)<<" = convertToTempType3(perDofValues"<<cc.intToString(i)<<"[index]);\n";
+                int lastMergedStep = step;
+                while (lastMergedStep+1 < numSteps && merged[lastMergedStep+1])
+                    lastMergedStep++;
                 int numGaussian = 0, numUniform = 0;
-                for (int j = step; j < numSteps && (j == step || merged[j]); j++) {
+                for (int j = step; j <= lastMergedStep; j++) {
+                    // The values are kept in registers between merged steps, so each one only needs to be
+                    // written to global memory by the last step that modifies it.
+
+                    bool isLastWrite = true;
+                    for (int k = j+1; k <= lastMergedStep; k++)
+                        if (variable[k] == variable[j] || (variable[j] != "x" && variable[j] != "v" && variable[k] != "x" && variable[k] != "v"))
+                            isLastWrite = false;
                     numGaussian += numAtoms*usesVariable(expression[j][0], "gaussian");
                     numUniform += numAtoms*usesVariable(expression[j][0], "uniform");
                     compute << "{\n";
@@ -6960,7 +7633,10 @@ void CommonIntegrateCustomStepKernel::prepareForComputation(ContextImpl& context
                     if (numUniform > 0)
                         compute << "float4 uniform = uniformValues[uniformIndex+index];\n";
                     compute << createPerDofComputation(stepType[j] == CustomIntegrator::ComputePerDof ? variable[j] : "", expression[j][0], integrator, forceName[j], energyName[j], functionList, functionNames);
-                    if (variable[j] == "x") {
+                    if (stepType[j] == CustomIntegrator::ComputePerDof && !isLastWrite) {
+                        // Nothing needs to be stored yet.
+                    }
+                    else if (variable[j] == "x") {
                         if (storePosAsDelta[j]) {
                             if (cc.getSupportsDoublePrecision())
                                 compute << "posDelta[index] = convertFromDouble4(position-loadPos(posq, posqCorrection, index));\n";
@@ -7030,10 +7706,41 @@ void CommonIntegrateCustomStepKernel::prepareForComputation(ContextImpl& context
                     kernel = program->createKernel(useDouble ? "computeDoubleSum" : "computeFloatSum");
                     kernels[step].push_back(kernel);
                     kernel->addArg(sumBuffer);
-                    kernel->addArg(summedValue);
-                    kernel->addArg(numAtoms);
+                    if (globalOnDevice[step]) {
+                        kernel->addArg(globalValues);
+                        kernel->addArg(numAtoms);
+                        kernel->addArg(stepTarget[step].variableIndex);
+                    }
+                    else {
+                        kernel->addArg(summedValue);
+                        kernel->addArg(numAtoms);
+                        kernel->addArg(0);
+                    }
                 }
             }
+            else if (stepType[step] == CustomIntegrator::ComputeGlobal && globalOnDevice[step]) {
+                // Evaluate a global value on the device.
+
+                map<string, string> variables;
+                for (int i = 0; i < integrator.getNumGlobalVariables(); i++)
+                    variables[integrator.getGlobalVariableName(i)] = "globals["+cc.intToString(globalVariableIndex[i])+"]";
+                for (int i = 0; i < (int) parameterNames.size(); i++)
+                    variables[parameterNames[i]] = "globals["+cc.intToString(parameterVariableIndex[i])+"]";
+                variables["dt"] = "globals["+cc.intToString(dtVariableIndex)+"]";
+                variables["uniform"] = "uniform";
+                variables["gaussian"] = "gaussian";
+                variables[energyName[step]] = "energy";
+                map<string, Lepton::ParsedExpression> expressions;
+                expressions["globals["+cc.intToString(stepTarget[step].variableIndex)+"] = "] = expression[step][0];
+                map<string, string> replacements;
+                replacements["COMPUTE_STEP"] = cc.getExpressionUtilities().createExpressions(expressions, variables, functionList, functionNames, "temp", "mixed");
+                ComputeProgram program = cc.compileProgram(cc.replaceStrings(CommonKernelSources::customIntegratorGlobal, replacements), defines);
+                ComputeKernel kernel = program->createKernel("computeGlobal");
+                kernels[step].push_back(kernel);
+                kernel->addArg(globalValues);
+                for (int i = 0; i < 3; i++)
+                    kernel->addArg();
+            }
             else if (stepType[step] == CustomIntegrator::ConstrainPositions) {
                 // Apply position constraints.
 
@@ -7127,6 +7834,7 @@ void CommonIntegrateCustomStepKernel::prepareForComputation(ContextImpl& context
         sumKineticEnergyKernel->addArg(sumBuffer);
         sumKineticEnergyKernel->addArg(summedValue);
         sumKineticEnergyKernel->addArg(numAtoms);
+        sumKineticEnergyKernel->addArg(0);
 
         // Delete the custom functions.
 
@@ -7151,6 +7859,8 @@ void CommonIntegrateCustomStepKernel::prepareForComputation(ContextImpl& context
     for (int i = 0; i < (int) parameterNames.size(); i++) {
         double value = context.getParameter(parameterNames[i]);
         if (value != localGlobalValues[parameterVariableIndex[i]]) {
+            if (!hostGlobalsAreCurrent)
+                downloadGlobalValues();
             localGlobalValues[parameterVariableIndex[i]] = value;
             deviceGlobalsAreCurrent = false;
         }
@@ -7200,6 +7910,7 @@ void CommonIntegrateCustomStepKernel::findExpressionsForDerivs(const ExpressionT
 }
 
 void CommonIntegrateCustomStepKernel::execute(ContextImpl& context, CustomIntegrator& integrator, bool& forcesAreValid) {
+    OPENMM_TRACE_RANGE("Integrate Custom");
     prepareForComputation(context, integrator, forcesAreValid);
     IntegrationUtilities& integration = cc.getIntegrationUtilities();
     int numAtoms = cc.getNumAtoms();
@@ -7276,10 +7987,34 @@ void CommonIntegrateCustomStepKernel::execute(ContextImpl& context, CustomIntegr
             kernels[step][0]->execute(numAtoms, 128);
         }
         else if (stepType[step] == CustomIntegrator::ComputeGlobal) {
-            expressionSet.setVariable(uniformVariableIndex, SimTKOpenMMUtilities::getUniformlyDistributedRandomNumber());
-            expressionSet.setVariable(gaussianVariableIndex, SimTKOpenMMUtilities::getNormallyDistributedRandomNumber());
-            expressionSet.setVariable(stepEnergyVariableIndex[step], energy);
-            recordGlobalValue(globalExpressions[step][0].evaluate(), stepTarget[step], integrator);
+            double uniform = SimTKOpenMMUtilities::getUniformlyDistributedRandomNumber();
+            double gaussian = SimTKOpenMMUtilities::getNormallyDistributedRandomNumber();
+            if (globalOnDevice[step]) {
+                if (!deviceGlobalsAreCurrent) {
+                    globalValues.upload(localGlobalValues, true);
+                    deviceGlobalsAreCurrent = true;
+                }
+                if (cc.getUseDoublePrecision() || cc.getUseMixedPrecision()) {
+                    kernels[step][0]->setArg(1, uniform);
+                    kernels[step][0]->setArg(2, gaussian);
+                    kernels[step][0]->setArg(3, energy);
+                }
+                else {
+                    kernels[step][0]->setArg(1, (float) uniform);
+                    kernels[step][0]->setArg(2, (float) gaussian);
+                    kernels[step][0]->setArg(3, (float) energy);
+                }
+                kernels[step][0]->execute(1, 1);
+                hostGlobalsAreCurrent = false;
+            }
+            else {
+                if (!hostGlobalsAreCurrent)
+                    downloadGlobalValues();
+                expressionSet.setVariable(uniformVariableIndex, uniform);
+                expressionSet.setVariable(gaussianVariableIndex, gaussian);
+                expressionSet.setVariable(stepEnergyVariableIndex[step], energy);
+                recordGlobalValue(globalExpressions[step][0].evaluate(), stepTarget[step], integrator);
+            }
         }
         else if (stepType[step] == CustomIntegrator::ComputeSum) {
             kernels[step][0]->setArg(9, integration.prepareRandomNumbers(requiredGaussian[step]));
@@ -7293,13 +8028,24 @@ void CommonIntegrateCustomStepKernel::execute(ContextImpl& context, CustomIntegr
                 randomKernel->execute(numAtoms, 64);
             cc.clearBuffer(sumBuffer);
             kernels[step][0]->execute(numAtoms, 128);
-            kernels[step][1]->execute(sumWorkGroupSize, sumWorkGroupSize);
-            if (cc.getUseDoublePrecision() || cc.getUseMixedPrecision()) {
+            if (globalOnDevice[step]) {
+                // The sum is written directly into the global values on the device.
+
+                if (!deviceGlobalsAreCurrent) {
+                    globalValues.upload(localGlobalValues, true);
+                    deviceGlobalsAreCurrent = true;
+                }
+                kernels[step][1]->execute(sumWorkGroupSize, sumWorkGroupSize);
+                hostGlobalsAreCurrent = false;
+            }
+            else if (cc.getUseDoublePrecision() || cc.getUseMixedPrecision()) {
+                kernels[step][1]->execute(sumWorkGroupSize, sumWorkGroupSize);
                 double value;
                 summedValue.download(&value);
                 recordGlobalValue(value, stepTarget[step], integrator);
             }
             else {
+                kernels[step][1]->execute(sumWorkGroupSize, sumWorkGroupSize);
                 float value;
                 summedValue.download(&value);
                 recordGlobalValue(value, stepTarget[step], integrator);
@@ -7357,6 +8103,8 @@ void CommonIntegrateCustomStepKernel::execute(ContextImpl& context, CustomIntegr
 }
 
 bool CommonIntegrateCustomStepKernel::evaluateCondition(int step) {
+    if (!hostGlobalsAreCurrent)
+        downloadGlobalValues();
     expressionSet.setVariable(uniformVariableIndex, SimTKOpenMMUtilities::getUniformlyDistributedRandomNumber());
     expressionSet.setVariable(gaussianVariableIndex, SimTKOpenMMUtilities::getNormallyDistributedRandomNumber());
     expressionSet.setVariable(stepEnergyVariableIndex[step], energy);
@@ -7401,8 +8149,11 @@ double CommonIntegrateCustomStepKernel::computeKineticEnergy(ContextImpl& contex
 void CommonIntegrateCustomStepKernel::recordGlobalValue(double value, GlobalTarget target, CustomIntegrator& integrator) {
     switch (target.type) {
         case DT:
-            if (value != localGlobalValues[dtVariableIndex])
+            if (value != localGlobalValues[dtVariableIndex]) {
+                if (!hostGlobalsAreCurrent)
+                    downloadGlobalValues();
                 deviceGlobalsAreCurrent = false;
+            }
             expressionSet.setVariable(dtVariableIndex, value);
             localGlobalValues[dtVariableIndex] = value;
             cc.getIntegrationUtilities().setNextStepSize(value);
@@ -7410,6 +8161,8 @@ void CommonIntegrateCustomStepKernel::recordGlobalValue(double value, GlobalTarg
             break;
         case VARIABLE:
         case PARAMETER:
+            if (!hostGlobalsAreCurrent)
+                downloadGlobalValues();
             expressionSet.setVariable(target.variableIndex, value);
             localGlobalValues[target.variableIndex] = value;
             deviceGlobalsAreCurrent = false;
@@ -7435,6 +8188,21 @@ void CommonIntegrateCustomStepKernel::getGlobalVariables(ContextImpl& context, v
         return;
     }
     values.resize(numGlobalVariables);
+    if (!hostGlobalsAreCurrent) {
+        // Some values were computed on the device and have not been downloaded yet.
+
+        vector<double> deviceValues;
+        if (globalValues.getElementSize() == sizeof(double))
+            globalValues.download(deviceValues);
+        else {
+            vector<float> deviceValuesFloat;
+            globalValues.download(deviceValuesFloat);
+            deviceValues.assign(deviceValuesFloat.begin(), deviceValuesFloat.end());
+        }
+        for (int i = 0; i < numGlobalVariables; i++)
+            values[i] = deviceValues[globalVariableIndex[i]];
+        return;
+    }
     for (int i = 0; i < numGlobalVariables; i++)
         values[i] = localGlobalValues[globalVariableIndex[i]];
 }
@@ -7453,6 +8221,20 @@ void CommonIntegrateCustomStepKernel::setGlobalVariables(ContextImpl& context, c
         expressionSet.setVariable(globalVariableIndex[i], values[i]);
     }
     deviceGlobalsAreCurrent = false;
+    hostGlobalsAreCurrent = true; // The device only ever modifies global variables, and all of them were just set.
+}
+
+void CommonIntegrateCustomStepKernel::downloadGlobalValues() {
+    if (globalValues.getElementSize() == sizeof(double))
+        globalValues.download(localGlobalValues);
+    else {
+        vector<float> values;
+        globalValues.download(values);
+        localGlobalValues.assign(values.begin(), values.end());
+    }
+    for (int i = 0; i < numGlobalVariables; i++)
+        expressionSet.setVariable(globalVariableIndex[i], localGlobalValues[globalVariableIndex[i]]);
+    hostGlobalsAreCurrent = true;
 }
 
 void CommonIntegrateCustomStepKernel::getPerDofVariable(ContextImpl& context, int variable, vector<Vec3>& values) const {
@@ -7502,7 +8284,8 @@ void CommonRemoveCMMotionKernel::initialize(const System& system, const CMMotion
     cc.setAsCurrent();
     frequency = force.getFrequency();
     int numAtoms = cc.getNumAtoms();
-    cmMomentum.initialize<mm_float3>(cc, cc.getPaddedNumAtoms(), "cmMomentum");
+    cmMomentum[0].initialize<mm_float3>(cc, cc.getPaddedNumAtoms(), "cmMomentum");
+    cmMomentum[1].initialize<mm_float3>(cc, cc.getPaddedNumAtoms(), "remainingMomentum");
     double totalMass = 0.0;
     for (int i = 0; i < numAtoms; i++)
         totalMass += system.getParticleMass(i);
@@ -7512,17 +8295,29 @@ void CommonRemoveCMMotionKernel::initialize(const System& system, const CMMotion
     kernel1 = program->createKernel("calcCenterOfMassMomentum");
     kernel1->addArg(numAtoms);
     kernel1->addArg(cc.getVelm());
-    kernel1->addArg(cmMomentum);
-    kernel2 = program->createKernel("removeCenterOfMassMomentum");
-    kernel2->addArg(numAtoms);
-    kernel2->addArg(cc.getVelm());
-    kernel2->addArg(cmMomentum);
+    kernel1->addArg(cmMomentum[0]);
+    for (int i = 0; i < 2; i++) {
+        removeKernel[i] = program->createKernel("removeCenterOfMassMomentum");
+        removeKernel[i]->addArg(numAtoms);
+        removeKernel[i]->addArg(cc.getVelm());
+        removeKernel[i]->addArg(cmMomentum[i]);
+        removeKernel[i]->addArg(cmMomentum[1-i]);
+    }
 }
 
 void CommonRemoveCMMotionKernel::execute(ContextImpl& context) {
     cc.setAsCurrent();
-    kernel1->execute(cc.getNumAtoms(), 64);
-    kernel2->execute(cc.getNumAtoms(), 64);
+
+    // Each launch removes the momentum measured by the previous one, which is whatever accumulated
+    // during the steps since then.  Only the first call needs a separate pass to measure it.
+
+    if (!hasMeasuredMomentum) {
+        kernel1->execute(cc.getNumAtoms(), 64);
+        currentMomentum = 0;
+        hasMeasuredMomentum = true;
+    }
+    removeKernel[currentMomentum]->execute(cc.getNumAtoms(), 64);
+    currentMomentum = 1-currentMomentum;
 }
 
 class CommonCalcRMSDForceKernel::ForceInfo : public ComputeForceInfo {
@@ -7573,6 +8368,8 @@ void CommonCalcRMSDForceKernel::initialize(const System& system, const RMSDForce
     kernel1->addArg(referencePos);
     kernel1->addArg(particles);
     kernel1->addArg(buffer);
+    kernel1->addArg();
+    kernel1->addArg(cc.getEnergyBuffer());
     kernel2->addArg();
     kernel2->addArg(cc.getPaddedNumAtoms());
     kernel2->addArg(cc.getPosq());
@@ -7615,81 +8412,19 @@ void CommonCalcRMSDForceKernel::recordParameters(const RMSDForce& force) {
 }
 
 double CommonCalcRMSDForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
-    if (cc.getUseDoublePrecision())
-        return executeImpl<double>(context);
-    return executeImpl<float>(context);
-}
-
-template <class REAL>
-double CommonCalcRMSDForceKernel::executeImpl(ContextImpl& context) {
-    // Execute the first kernel.
+    // The first kernel finds the optimal rotation and adds the RMSD to the energy buffer, and the second
+    // one applies forces.  Nothing needs to be downloaded.
 
     int numParticles = particles.getSize();
     kernel1->setArg(0, numParticles);
+    if (cc.getUseDoublePrecision())
+        kernel1->setArg(5, sumNormRef);
+    else
+        kernel1->setArg(5, (float) sumNormRef);
     kernel1->execute(blockSize, blockSize);
-    
-    // Download the results, build the F matrix, and find the maximum eigenvalue
-    // and eigenvector.
-
-    vector<REAL> b;
-    buffer.download(b);
-    Array2D<double> F(4, 4);
-    F[0][0] =  b[0*3+0] + b[1*3+1] + b[2*3+2];
-    F[1][0] =  b[1*3+2] - b[2*3+1];
-    F[2][0] =  b[2*3+0] - b[0*3+2];
-    F[3][0] =  b[0*3+1] - b[1*3+0];
-    F[0][1] =  b[1*3+2] - b[2*3+1];
-    F[1][1] =  b[0*3+0] - b[1*3+1] - b[2*3+2];
-    F[2][1] =  b[0*3+1] + b[1*3+0];
-    F[3][1] =  b[0*3+2] + b[2*3+0];
-    F[0][2] =  b[2*3+0] - b[0*3+2];
-    F[1][2] =  b[0*3+1] + b[1*3+0];
-    F[2][2] = -b[0*3+0] + b[1*3+1] - b[2*3+2];
-    F[3][2] =  b[1*3+2] + b[2*3+1];
-    F[0][3] =  b[0*3+1] - b[1*3+0];
-    F[1][3] =  b[0*3+2] + b[2*3+0];
-    F[2][3] =  b[1*3+2] + b[2*3+1];
-    F[3][3] = -b[0*3+0] - b[1*3+1] + b[2*3+2];
-    JAMA::Eigenvalue<double> eigen(F);
-    Array1D<double> values;
-    eigen.getRealEigenvalues(values);
-    Array2D<double> vectors;
-    eigen.getV(vectors);
-
-    // Compute the RMSD.
-
-    double msd = (sumNormRef+b[9]-2*values[3])/numParticles;
-    if (msd < 1e-20) {
-        // The particles are perfectly aligned, so all the forces should be zero.
-        // Numerical error can lead to NaNs, so just return 0 now.
-        return 0.0;
-    }
-    double rmsd = sqrt(msd);
-    b[9] = rmsd;
-
-    // Compute the rotation matrix.
-
-    double q[] = {vectors[0][3], vectors[1][3], vectors[2][3], vectors[3][3]};
-    double q00 = q[0]*q[0], q01 = q[0]*q[1], q02 = q[0]*q[2], q03 = q[0]*q[3];
-    double q11 = q[1]*q[1], q12 = q[1]*q[2], q13 = q[1]*q[3];
-    double q22 = q[2]*q[2], q23 = q[2]*q[3];
-    double q33 = q[3]*q[3];
-    b[0] = q00+q11-q22-q33;
-    b[1] = 2*(q12-q03);
-    b[2] = 2*(q13+q02);
-    b[3] = 2*(q12+q03);
-    b[4] = q00-q11+q22-q33;
-    b[5] = 2*(q23-q01);
-    b[6] = 2*(q13-q02);
-    b[7] = 2*(q23+q01);
-    b[8] = q00-q11-q22+q33;
-
-    // Upload it to the device and invoke the kernel to apply forces.
-    
-    buffer.upload(b);
     kernel2->setArg(0, numParticles);
     kernel2->execute(numParticles);
-    return rmsd;
+    return 0.0;
 }
 
 void CommonCalcRMSDForceKernel::copyParametersToContext(ContextImpl& context, const RMSDForce& force) {
@@ -7711,7 +8446,7 @@ void CommonCalcRMSDForceKernel::copyParametersToContext(ContextImpl& context, co
 void CommonApplyAndersenThermostatKernel::initialize(const System& system, const AndersenThermostat& thermostat) {
     cc.setAsCurrent();
     randomSeed = thermostat.getRandomNumberSeed();
-    ComputeProgram program = cc.compileProgram(CommonKernelSources::andersenThermostat);
+    ComputeProgram program = cc.compileProgram(CommonKernelSources::philox+CommonKernelSources::andersenThermostat);
     kernel = program->createKernel("applyAndersenThermostat");
     cc.getIntegrationUtilities().initRandomNumberGenerator(randomSeed);
 
@@ -7730,7 +8465,7 @@ void CommonApplyAndersenThermostatKernel::initialize(const System& system, const
     kernel->addArg();
     kernel->addArg(cc.getVelm());
     kernel->addArg();
-    kernel->addArg(cc.getIntegrationUtilities().getRandom());
+    kernel->addArg(cc.getIntegrationUtilities().getRandomKey());
     kernel->addArg();
     kernel->addArg(atomGroups);
 }
@@ -7744,6 +8479,705 @@ void CommonApplyAndersenThermostatKernel::execute(ContextImpl& context) {
         kernel->setArg(4, stepSize);
     else
         kernel->setArg(4, (float) stepSize);
-    kernel->setArg(6, cc.getIntegrationUtilities().prepareRandomNumbers(cc.getPaddedNumAtoms()));
+
+    // The counter is derived from the step count, so it is restored along with the rest of the
+    // state by checkpoints.  It is offset to keep it distinct from the counters used by integrators.
+
+    kernel->setArg(6, (long long) ((1LL<<62)+cc.getStepCount()));
+    kernel->execute(cc.getNumAtoms());
+}
+
+void CommonMinimizeKernel::initialize(const System& system) {
+    cc.setAsCurrent();
+    this->system = &system;
+    useDouble = cc.getUseDoublePrecision() || cc.getUseMixedPrecision();
+    int elementSize = (useDouble ? sizeof(double) : sizeof(float));
+    int numAtoms = cc.getNumAtoms();
+    const int numHistory = 10;
+    const int numVectors = 2*numHistory+1;
+    blockSize = min(256, cc.getMaxThreadBlockSize());
+    numBlocks = min(cc.getNumThreadBlocks(), (numAtoms+blockSize-1)/blockSize);
+    pos.initialize(cc, numAtoms, 4*elementSize, "minimizerPos");
+    grad.initialize(cc, numAtoms, 4*elementSize, "minimizerGrad");
+    basePos.initialize(cc, numAtoms, 4*elementSize, "minimizerBasePos");
+    baseGrad.initialize(cc, numAtoms, 4*elementSize, "minimizerBaseGrad");
+    initialPos.initialize(cc, numAtoms, 4*elementSize, "minimizerInitialPos");
+    dir.initialize(cc, numAtoms, 4*elementSize, "minimizerDir");
+    s.initialize(cc, numHistory*numAtoms, 4*elementSize, "minimizerS");
+    y.initialize(cc, numHistory*numAtoms, 4*elementSize, "minimizerY");
+    dotMatrix.initialize(cc, numVectors*numVectors, elementSize, "minimizerDotMatrix");
+    coefficients.initialize(cc, numVectors, elementSize, "minimizerCoefficients");
+    resultsArray.initialize(cc, 4, elementSize, "minimizerResults");
+    partialSums.initialize(cc, 2*numBlocks, elementSize, "minimizerPartialSums");
+    dotPartialSums.initialize(cc, numBlocks*(3*numVectors+1), elementSize, "minimizerDotPartialSums");
+    int numConstraints = system.getNumConstraints();
+    constraintStart.initialize<int>(cc, numAtoms+1, "minimizerConstraintStart");
+    constraintPartner.initialize<int>(cc, max(1, 2*numConstraints), "minimizerConstraintPartner");
+    constraintDistance.initialize(cc, max(1, 2*numConstraints), elementSize, "minimizerConstraintDistance");
+    constraintAtoms.initialize<mm_int2>(cc, max(1, numConstraints), "minimizerConstraintAtoms");
+    constraintAtomDistance.initialize(cc, max(1, numConstraints), elementSize, "minimizerConstraintAtomDistance");
+
+    // Create the kernels.
+
+    map<string, string> defines;
+    defines["NUM_ATOMS"] = cc.intToString(numAtoms);
+    defines["PADDED_NUM_ATOMS"] = cc.intToString(cc.getPaddedNumAtoms());
+    defines["NUM_HISTORY"] = cc.intToString(numHistory);
+    defines["THREAD_BLOCK_SIZE"] = cc.intToString(blockSize);
+    ComputeProgram program = cc.compileProgram(CommonKernelSources::minimize, defines);
+    recordPositionsKernel = program->createKernel("recordPositions");
+    recordPositionsKernel->addArg(cc.getPosq());
+    if (cc.getUseMixedPrecision())
+        recordPositionsKernel->addArg(cc.getPosqCorrection());
+    else
+        recordPositionsKernel->addArg(nullptr);
+    recordPositionsKernel->addArg(basePos);
+    updatePositionsKernel = program->createKernel("updatePositions");
+    updatePositionsKernel->addArg(cc.getPosq());
+    if (cc.getUseMixedPrecision())
+        updatePositionsKernel->addArg(cc.getPosqCorrection());
+    else
+        updatePositionsKernel->addArg(nullptr);
+    updatePositionsKernel->addArg(pos);
+    updatePositionsKernel->addArg(basePos);
+    updatePositionsKernel->addArg(dir);
+    updatePositionsKernel->addArg();
+    gradientKernel = program->createKernel("computeGradient");
+    gradientKernel->addArg(cc.getLongForceBuffer());
+    gradientKernel->addArg(cc.getVelm());
+    gradientKernel->addArg(pos);
+    gradientKernel->addArg(grad);
+    gradientKernel->addArg(constraintStart);
+    gradientKernel->addArg(constraintPartner);
+    gradientKernel->addArg(constraintDistance);
+    gradientKernel->addArg();
+    gradientKernel->addArg(partialSums);
+    constraintErrorKernel = program->createKernel("computeConstraintErrors");
+    constraintErrorKernel->addArg(pos);
+    constraintErrorKernel->addArg(constraintAtoms);
+    constraintErrorKernel->addArg(constraintAtomDistance);
+    constraintErrorKernel->addArg(numConstraints);
+    constraintErrorKernel->addArg(partialSums);
+    acceptStepKernel = program->createKernel("acceptStep");
+    acceptStepKernel->addArg(pos);
+    acceptStepKernel->addArg(grad);
+    acceptStepKernel->addArg(basePos);
+    acceptStepKernel->addArg(baseGrad);
+    acceptStepKernel->addArg(s);
+    acceptStepKernel->addArg(y);
+    acceptStepKernel->addArg();
+    dotProductsKernel = program->createKernel("computeDotProducts");
+    dotProductsKernel->addArg(basePos);
+    dotProductsKernel->addArg(baseGrad);
+    dotProductsKernel->addArg(s);
+    dotProductsKernel->addArg(y);
+    dotProductsKernel->addArg();
+    dotProductsKernel->addArg(dotPartialSums);
+    searchDirectionKernel = program->createKernel("computeSearchDirection");
+    searchDirectionKernel->addArg(dotPartialSums);
+    searchDirectionKernel->addArg(numBlocks);
+    searchDirectionKernel->addArg(dotMatrix);
+    searchDirectionKernel->addArg(coefficients);
+    searchDirectionKernel->addArg(resultsArray);
+    searchDirectionKernel->addArg();
+    searchDirectionKernel->addArg();
+    updateDirectionKernel = program->createKernel("updateSearchDirection");
+    updateDirectionKernel->addArg(baseGrad);
+    updateDirectionKernel->addArg(s);
+    updateDirectionKernel->addArg(y);
+    updateDirectionKernel->addArg(coefficients);
+    updateDirectionKernel->addArg(dir);
+}
+
+void CommonMinimizeKernel::updateConstraints() {
+    // The constraint data is indexed by the current order of atoms on the device, so it
+    // needs to be rebuilt whenever the atoms have been reordered.
+
+    if (atomOrder == cc.getAtomIndex())
+        return;
+    atomOrder = cc.getAtomIndex();
+    int numAtoms = cc.getNumAtoms();
+    int numConstraints = system->getNumConstraints();
+    vector<int> deviceIndex(numAtoms);
+    for (int i = 0; i < numAtoms; i++)
+        deviceIndex[atomOrder[i]] = i;
+    vector<vector<pair<int, double> > > atomConstraints(numAtoms);
+    vector<mm_int2> atomsVec(max(1, numConstraints));
+    vector<double> distanceVec(max(1, numConstraints));
+    for (int i = 0; i < numConstraints; i++) {
+        int particle1, particle2;
+        double distance;
+        system->getConstraintParameters(i, particle1, particle2, distance);
+        int atom1 = deviceIndex[particle1], atom2 = deviceIndex[particle2];
+        atomConstraints[atom1].push_back(make_pair(atom2, distance));
+        atomConstraints[atom2].push_back(make_pair(atom1, distance));
+        atomsVec[i] = mm_int2(atom1, atom2);
+        distanceVec[i] = distance;
+    }
+    vector<int> startVec(numAtoms+1, 0), partnerVec(max(1, 2*numConstraints));
+    vector<double> partnerDistanceVec(max(1, 2*numConstraints));
+    for (int i = 0; i < numAtoms; i++) {
+        startVec[i+1] = startVec[i]+atomConstraints[i].size();
+        for (int j = 0; j < atomConstraints[i].size(); j++) {
+            partnerVec[startVec[i]+j] = atomConstraints[i][j].first;
+            partnerDistanceVec[startVec[i]+j] = atomConstraints[i][j].second;
+        }
+    }
+    constraintStart.upload(startVec);
+    constraintPartner.upload(partnerVec);
+    constraintDistance.upload(partnerDistanceVec, true);
+    constraintAtoms.upload(atomsVec);
+    constraintAtomDistance.upload(distanceVec, true);
+}
+
+void CommonMinimizeKernel::downloadValues(const ComputeArray& array, vector<double>& values) {
+    if (useDouble)
+        array.download(values);
+    else {
+        vector<float> floatValues;
+        array.download(floatValues);
+        values.assign(floatValues.begin(), floatValues.end());
+    }
+}
+
+void CommonMinimizeKernel::setPositions(ComputeArray& base, double step) {
+    updatePositionsKernel->setArg(3, base);
+    if (useDouble)
+        updatePositionsKernel->setArg(5, step);
+    else
+        updatePositionsKernel->setArg(5, (float) step);
+    updatePositionsKernel->execute(cc.getNumAtoms());
+}
+
+bool CommonMinimizeKernel::evaluate(ContextImpl& context, double& energy) {
+    // Compute the energy and gradient at the positions stored in pos, and report
+    // whether the forces were valid.
+
+    context.computeVirtualSites();
+    energy = context.calcForcesAndEnergy(true, true, context.getIntegrator().getIntegrationForceGroups());
+    gradientKernel->execute(numBlocks*blockSize, blockSize);
+    vector<double> sums;
+    downloadValues(partialSums, sums);
+    bool valid = true;
+    for (int i = 0; i < numBlocks; i++) {
+        energy += sums[2*i];
+        if (sums[2*i+1] != 0)
+            valid = false;
+    }
+    return valid;
+}
+
+void CommonMinimizeKernel::computeSearchDirection(int slot, int numHistory) {
+    searchDirectionKernel->setArg(5, slot);
+    searchDirectionKernel->setArg(6, numHistory);
+    searchDirectionKernel->execute(blockSize, blockSize);
+    updateDirectionKernel->execute(cc.getNumAtoms());
+    downloadValues(resultsArray, results);
+}
+
+double CommonMinimizeKernel::computeMaxConstraintError() {
+    if (system->getNumConstraints() == 0)
+        return 0.0;
+    constraintErrorKernel->execute(numBlocks*blockSize, blockSize);
+    vector<double> sums;
+    downloadValues(partialSums, sums);
+    double maxError = 0.0;
+    for (int i = 0; i < numBlocks; i++)
+        maxError = max(maxError, sums[i]);
+    return maxError;
+}
+
+bool CommonMinimizeKernel::minimizeWithRestraints(ContextImpl& context, double k, double epsilon, int maxIterations) {
+    // Evaluate the starting point.  If the forces are too large for the device to compute,
+    // report failure so the caller can use a different implementation.
+
+    const int numHistory = 10;
+    const int maxLineSearchSteps = 40;
+    if (useDouble)
+        gradientKernel->setArg(7, k);
+    else
+        gradientKernel->setArg(7, (float) k);
+    setPositions(basePos, 0.0);
+    double energy;
+    if (!evaluate(context, energy))
+        return false;
+    cc.clearBuffer(s);
+    cc.clearBuffer(y);
+    cc.clearBuffer(dotMatrix);
+    acceptStepKernel->setArg(6, -1);
+    acceptStepKernel->execute(cc.getNumAtoms());
+    dotProductsKernel->setArg(4, 0);
+    dotProductsKernel->execute(numBlocks*blockSize, blockSize);
+    int slot = 0, historySize = 0;
+    computeSearchDirection(slot, historySize);
+    for (int iteration = 0; maxIterations == 0 || iteration < maxIterations; ) {
+        // Check for convergence.
+
+        if (sqrt(results[0])/max(1.0, sqrt(results[1])) <= epsilon)
+            break;
+
+        // If this is not a descent direction, discard the history and use steepest descent.
+
+        if (!(results[2] < 0)) {
+            if (historySize == 0)
+                break;
+            historySize = 0;
+            computeSearchDirection(slot, historySize);
+            continue;
+        }
+
+        // Perform a backtracking line search.
+
+        double gd = results[2];
+        double step = (results[3] != 0 ? 1.0 : 1.0/sqrt(results[0]));
+        bool accepted = false;
+        double trialEnergy;
+        for (int i = 0; i < maxLineSearchSteps && !accepted; i++) {
+            setPositions(basePos, step);
+            bool valid = evaluate(context, trialEnergy);
+            if (valid && trialEnergy <= energy+1e-4*step*gd)
+                accepted = true;
+            else {
+                double newStep = 0.5*step;
+                if (valid && trialEnergy == trialEnergy) {
+                    double interpolated = -gd*step*step/(2*(trialEnergy-energy-gd*step));
+                    newStep = max(0.1*step, min(0.5*step, interpolated));
+                }
+                step = newStep;
+            }
+        }
+        if (!accepted) {
+            // Restore the positions from before the line search.  If we were using the
+            // history, try again with steepest descent.
+
+            setPositions(basePos, 0.0);
+            if (historySize == 0)
+                break;
+            historySize = 0;
+            computeSearchDirection(slot, historySize);
+            continue;
+        }
+
+        // Record the step and compute the next search direction.
+
+        energy = trialEnergy;
+        slot = (historySize == 0 ? 0 : (slot+1)%numHistory);
+        historySize = min(historySize+1, numHistory);
+        acceptStepKernel->setArg(6, slot);
+        acceptStepKernel->execute(cc.getNumAtoms());
+        dotProductsKernel->setArg(4, slot);
+        dotProductsKernel->execute(numBlocks*blockSize, blockSize);
+        computeSearchDirection(slot, historySize);
+        iteration++;
+    }
+    return true;
+}
+
+bool CommonMinimizeKernel::execute(ContextImpl& context, double tolerance, int maxIterations) {
+    cc.setAsCurrent();
+    double constraintTol = context.getIntegrator().getConstraintTolerance();
+    double workingConstraintTol = std::max(1e-4, constraintTol);
+    double k = 100/workingConstraintTol;
+
+    // Make sure the initial configuration satisfies all constraints.
+
+    context.applyConstraints(workingConstraintTol);
+    updateConstraints();
+
+    // Record the initial positions and determine a normalization constant for scaling the tolerance.
+
+    recordPositionsKernel->execute(cc.getNumAtoms());
+    basePos.copyTo(initialPos);
+    cc.clearBuffer(baseGrad);
+    cc.clearBuffer(s);
+    cc.clearBuffer(y);
+    cc.clearBuffer(dotMatrix);
+    dotProductsKernel->setArg(4, 0);
+    dotProductsKernel->execute(numBlocks*blockSize, blockSize);
+    computeSearchDirection(0, 0);
+    double norm = results[1]/cc.getNumAtoms();
+    norm = (norm < 1 ? 1 : sqrt(norm));
+    double epsilon = tolerance/norm;
+
+    // Repeatedly minimize, steadily increasing the strength of the springs until all constraints are satisfied.
+
+    double prevMaxError = 1e10;
+    bool firstPass = true;
+    while (true) {
+        if (!minimizeWithRestraints(context, k, epsilon, maxIterations)) {
+            setPositions(initialPos, 0.0);
+            context.computeVirtualSites();
+            if (firstPass)
+                return false;
+            break;
+        }
+        firstPass = false;
+        double maxError = computeMaxConstraintError();
+        if (maxError <= workingConstraintTol)
+            break; // All constraints are satisfied.
+        if (maxError >= prevMaxError) {
+            // Further tightening the springs doesn't seem to be helping, so just give up.
+
+            setPositions(initialPos, 0.0);
+            context.computeVirtualSites();
+            break;
+        }
+        prevMaxError = maxError;
+        k *= 10;
+        if (maxError > 100*workingConstraintTol) {
+            // We've gotten far enough from a valid state that we might have trouble getting
+            // back, so reset to the original positions.
+
+            initialPos.copyTo(basePos);
+        }
+    }
+
+    // If necessary, do a final constraint projection to make sure they are satisfied
+    // to the full precision requested by the user.
+
+    if (constraintTol < workingConstraintTol)
+        context.applyConstraints(workingConstraintTol);
+    return true;
+}
+
+void CommonSwapStateKernel::initialize(const System& system) {
+    cc.setAsCurrent();
+    invAtomOrder.initialize<int>(cc, cc.getNumAtoms(), "swapInvAtomOrder");
+    map<string, string> defines;
+    defines["NUM_ATOMS"] = cc.intToString(cc.getNumAtoms());
+    ComputeProgram program = cc.compileProgram(CommonKernelSources::swapState, defines);
+    inverseOrderKernel = program->createKernel("computeInverseOrder");
+    inverseOrderKernel->addArg();
+    inverseOrderKernel->addArg(invAtomOrder);
+    swapKernel = program->createKernel("swapState");
+    for (int i = 0; i < 8; i++)
+        swapKernel->addArg();
+    if (cc.getUseDoublePrecision() || cc.getUseMixedPrecision())
+        swapKernel->addArg(1.0);
+    else
+        swapKernel->addArg(1.0f);
+}
+
+bool CommonSwapStateKernel::execute(ContextImpl& context, ContextImpl& other, double velocityScale) {
+    ComputeContext* cc2 = getComputeContext(other);
+    if (cc2 == NULL || cc2 == &cc || cc2->getNumAtoms() != cc.getNumAtoms() || cc2->getPaddedNumAtoms() != cc.getPaddedNumAtoms() ||
+            cc2->getUseDoublePrecision() != cc.getUseDoublePrecision() || cc2->getUseMixedPrecision() != cc.getUseMixedPrecision())
+        return false;
+    cc.setAsCurrent();
+
+    // Make sure the other context has finished any work that uses its arrays.
+
+    ComputeEvent otherEvent = cc2->createEvent();
+    otherEvent->enqueue();
+    otherEvent->wait();
+
+    // Exchange the data on the device.
+
+    int numAtoms = cc.getNumAtoms();
+    inverseOrderKernel->setArg(0, cc2->getAtomIndexArray());
+    inverseOrderKernel->execute(numAtoms);
+    swapKernel->setArg(0, cc.getPosq());
+    if (cc.getUseMixedPrecision())
+        swapKernel->setArg(1, cc.getPosqCorrection());
+    else
+        swapKernel->setArg(1, nullptr);
+    swapKernel->setArg(2, cc.getVelm());
+    swapKernel->setArg(3, cc.getAtomIndexArray());
+    swapKernel->setArg(4, cc2->getPosq());
+    if (cc.getUseMixedPrecision())
+        swapKernel->setArg(5, cc2->getPosqCorrection());
+    else
+        swapKernel->setArg(5, nullptr);
+    swapKernel->setArg(6, cc2->getVelm());
+    swapKernel->setArg(7, invAtomOrder);
+    if (cc.getUseDoublePrecision() || cc.getUseMixedPrecision())
+        swapKernel->setArg(8, velocityScale);
+    else
+        swapKernel->setArg(8, (float) velocityScale);
+    swapKernel->execute(numAtoms);
+
+    // The offsets of the periodic cells travel with the positions.  They only exist on the host,
+    // so permute them there.
+
+    const vector<int>& order1 = cc.getAtomIndex();
+    const vector<int>& order2 = cc2->getAtomIndex();
+    vector<int> invOrder2(numAtoms);
+    for (int i = 0; i < numAtoms; i++)
+        invOrder2[order2[i]] = i;
+    vector<mm_int4>& offsets1 = cc.getPosCellOffsets();
+    vector<mm_int4>& offsets2 = cc2->getPosCellOffsets();
+    vector<mm_int4> originalOffsets1 = offsets1;
+    for (int i = 0; i < numAtoms; i++) {
+        int j = invOrder2[order1[i]];
+        offsets1[i] = offsets2[j];
+        offsets2[j] = originalOffsets1[i];
+    }
+
+    // Make sure the exchange is finished before the other context uses its arrays again.
+
+    ComputeEvent event = cc.createEvent();
+    event->enqueue();
+    event->wait();
+    return true;
+}
+
+struct CommonParticleSubsetKernel::SubsetInfo {
+    int numParticles;
+    ComputeArray particles, posq, posqCorrection, atoms;
+};
+
+CommonParticleSubsetKernel::~CommonParticleSubsetKernel() {
+    cc.setAsCurrent();
+    for (SubsetInfo* subset : subsets)
+        delete subset;
+}
+
+void CommonParticleSubsetKernel::initialize(const System& system) {
+    cc.setAsCurrent();
+    invAtomOrder.initialize<int>(cc, cc.getNumAtoms(), "subsetInvAtomOrder");
+    map<string, string> defines;
+    defines["NUM_ATOMS"] = cc.intToString(cc.getNumAtoms());
+    ComputeProgram program = cc.compileProgram(CommonKernelSources::particleSubset, defines);
+    inverseOrderKernel = program->createKernel("computeInverseOrder");
+    inverseOrderKernel->addArg(cc.getAtomIndexArray());
+    inverseOrderKernel->addArg(invAtomOrder);
+    gatherKernel = program->createKernel("gatherPositions");
+    scatterKernel = program->createKernel("scatterPositions");
+    for (int i = 0; i < 8; i++) {
+        gatherKernel->addArg();
+        scatterKernel->addArg();
+    }
+}
+
+void CommonParticleSubsetKernel::addSubset(ContextImpl& context, const vector<int>& particles) {
+    cc.setAsCurrent();
+    SubsetInfo* subset = new SubsetInfo();
+    subsets.push_back(subset);
+    subset->numParticles = particles.size();
+    if (particles.size() == 0)
+        return;
+    int elementSize = (cc.getUseDoublePrecision() ? sizeof(mm_double4) : sizeof(mm_float4));
+    subset->particles.initialize<int>(cc, particles.size(), "subsetParticles");
+    subset->particles.upload(particles);
+    subset->posq.initialize(cc, particles.size(), elementSize, "subsetPosq");
+    if (cc.getUseMixedPrecision())
+        subset->posqCorrection.initialize<mm_float4>(cc, particles.size(), "subsetPosqCorrection");
+    subset->atoms.initialize<int>(cc, particles.size(), "subsetAtoms");
+}
+
+void CommonParticleSubsetKernel::getPositions(ContextImpl& context, int subset, vector<Vec3>& positions) {
+    cc.setAsCurrent();
+    SubsetInfo& info = *subsets[subset];
+    int numParticles = info.numParticles;
+    positions.resize(numParticles);
+    if (numParticles == 0)
+        return;
+
+    // Gather the positions on the device and download only the subset.
+
+    inverseOrderKernel->execute(cc.getNumAtoms());
+    gatherKernel->setArg(0, numParticles);
+    gatherKernel->setArg(1, info.particles);
+    gatherKernel->setArg(2, invAtomOrder);
+    gatherKernel->setArg(3, cc.getPosq());
+    if (cc.getUseMixedPrecision()) {
+        gatherKernel->setArg(4, cc.getPosqCorrection());
+        gatherKernel->setArg(6, info.posqCorrection);
+    }
+    else {
+        gatherKernel->setArg(4, nullptr);
+        gatherKernel->setArg(6, nullptr);
+    }
+    gatherKernel->setArg(5, info.posq);
+    gatherKernel->setArg(7, info.atoms);
+    gatherKernel->execute(numParticles);
+    vector<int> atoms;
+    info.atoms.download(atoms);
+
+    // Remove the periodic cell offsets, which only exist on the host.
+
+    Vec3 boxVectors[3];
+    cc.getPeriodicBoxVectors(boxVectors[0], boxVectors[1], boxVectors[2]);
+    const vector<mm_int4>& offsets = cc.getPosCellOffsets();
+    if (cc.getUseDoublePrecision()) {
+        vector<mm_double4> posq;
+        info.posq.download(posq);
+        for (int i = 0; i < numParticles; i++)
+            positions[i] = Vec3(posq[i].x, posq[i].y, posq[i].z);
+    }
+    else if (cc.getUseMixedPrecision()) {
+        vector<mm_float4> posq, correction;
+        info.posq.download(posq);
+        info.posqCorrection.download(correction);
+        for (int i = 0; i < numParticles; i++)
+            positions[i] = Vec3((double) posq[i].x+(double) correction[i].x, (double) posq[i].y+(double) correction[i].y, (double) posq[i].z+(double) correction[i].z);
+    }
+    else {
+        vector<mm_float4> posq;
+        info.posq.download(posq);
+        for (int i = 0; i < numParticles; i++)
+            positions[i] = Vec3(posq[i].x, posq[i].y, posq[i].z);
+    }
+    for (int i = 0; i < numParticles; i++) {
+        mm_int4 offset = offsets[atoms[i]];
+        positions[i] -= boxVectors[0]*offset.x + boxVectors[1]*offset.y + boxVectors[2]*offset.z;
+    }
+}
+
+void CommonParticleSubsetKernel::setPositions(ContextImpl& context, int subset, const vector<Vec3>& positions) {
+    cc.setAsCurrent();
+    SubsetInfo& info = *subsets[subset];
+    int numParticles = info.numParticles;
+    if (numParticles == 0)
+        return;
+
+    // Upload only the new positions, then scatter them on the device.
+
+    if (cc.getUseDoublePrecision()) {
+        vector<mm_double4> posq(numParticles);
+        for (int i = 0; i < numParticles; i++)
+            posq[i] = mm_double4(positions[i][0], positions[i][1], positions[i][2], 0);
+        info.posq.upload(posq);
+    }
+    else {
+        vector<mm_float4> posq(numParticles);
+        for (int i = 0; i < numParticles; i++)
+            posq[i] = mm_float4((float) positions[i][0], (float) positions[i][1], (float) positions[i][2], 0);
+        info.posq.upload(posq);
+        if (cc.getUseMixedPrecision()) {
+            vector<mm_float4> correction(numParticles);
+            for (int i = 0; i < numParticles; i++)
+                correction[i] = mm_float4((float) (positions[i][0]-posq[i].x), (float) (positions[i][1]-posq[i].y), (float) (positions[i][2]-posq[i].z), 0);
+            info.posqCorrection.upload(correction);
+        }
+    }
+    inverseOrderKernel->execute(cc.getNumAtoms());
+    scatterKernel->setArg(0, numParticles);
+    scatterKernel->setArg(1, info.particles);
+    scatterKernel->setArg(2, invAtomOrder);
+    scatterKernel->setArg(3, cc.getPosq());
+    if (cc.getUseMixedPrecision()) {
+        scatterKernel->setArg(4, cc.getPosqCorrection());
+        scatterKernel->setArg(6, info.posqCorrection);
+    }
+    else {
+        scatterKernel->setArg(4, nullptr);
+        scatterKernel->setArg(6, nullptr);
+    }
+    scatterKernel->setArg(5, info.posq);
+    scatterKernel->setArg(7, info.atoms);
+    scatterKernel->execute(numParticles);
+
+    // The new positions are not offset into any periodic cell.
+
+    vector<int> atoms;
+    info.atoms.download(atoms);
+    vector<mm_int4>& offsets = cc.getPosCellOffsets();
+    for (int atom : atoms)
+        offsets[atom] = mm_int4(0, 0, 0, 0);
+}
+
+struct CommonStateSnapshotKernel::SnapshotInfo {
+    ComputeArray posq, posqCorrection, velm, invAtomOrder;
+    vector<int> atomIndex;
+    vector<mm_int4> cellOffsets;
+};
+
+CommonStateSnapshotKernel::~CommonStateSnapshotKernel() {
+    cc.setAsCurrent();
+    for (auto& snapshot : snapshots)
+        delete snapshot.second;
+}
+
+void CommonStateSnapshotKernel::initialize(const System& system) {
+    cc.setAsCurrent();
+    map<string, string> defines;
+    defines["NUM_ATOMS"] = cc.intToString(cc.getNumAtoms());
+    ComputeProgram program = cc.compileProgram(CommonKernelSources::stateSnapshot, defines);
+    inverseOrderKernel = program->createKernel("computeInverseOrder");
+    inverseOrderKernel->addArg(cc.getAtomIndexArray());
+    inverseOrderKernel->addArg();
+    restoreKernel = program->createKernel("restoreSnapshot");
+    for (int i = 0; i < 8; i++)
+        restoreKernel->addArg();
+}
+
+void CommonStateSnapshotKernel::save(ContextImpl& context, int slot) {
+    cc.setAsCurrent();
+    SnapshotInfo*& info = snapshots[slot];
+    if (info == NULL) {
+        info = new SnapshotInfo();
+        info->posq.initialize(cc, cc.getPosq().getSize(), cc.getPosq().getElementSize(), "snapshotPosq");
+        if (cc.getUseMixedPrecision())
+            info->posqCorrection.initialize(cc, cc.getPosqCorrection().getSize(), cc.getPosqCorrection().getElementSize(), "snapshotPosqCorrection");
+        info->velm.initialize(cc, cc.getVelm().getSize(), cc.getVelm().getElementSize(), "snapshotVelm");
+        info->invAtomOrder.initialize<int>(cc, cc.getNumAtoms(), "snapshotInvAtomOrder");
+    }
+    cc.getPosq().copyTo(info->posq);
+    if (cc.getUseMixedPrecision())
+        cc.getPosqCorrection().copyTo(info->posqCorrection);
+    cc.getVelm().copyTo(info->velm);
+    inverseOrderKernel->setArg(1, info->invAtomOrder);
+    inverseOrderKernel->execute(cc.getNumAtoms());
+
+    // The atom order and periodic cell offsets are also kept on the host, so they can be recorded
+    // without any transfer.
+
+    info->atomIndex = cc.getAtomIndex();
+    info->cellOffsets = cc.getPosCellOffsets();
+}
+
+void CommonStateSnapshotKernel::restore(ContextImpl& context, int slot) {
+    cc.setAsCurrent();
+    SnapshotInfo& info = *snapshots[slot];
+    int numAtoms = cc.getNumAtoms();
+    restoreKernel->setArg(0, cc.getPosq());
+    if (cc.getUseMixedPrecision()) {
+        restoreKernel->setArg(1, cc.getPosqCorrection());
+        restoreKernel->setArg(5, info.posqCorrection);
+    }
+    else {
+        restoreKernel->setArg(1, nullptr);
+        restoreKernel->setArg(5, nullptr);
+    }
+    restoreKernel->setArg(2, cc.getVelm());
+    restoreKernel->setArg(3, cc.getAtomIndexArray());
+    restoreKernel->setArg(4, info.posq);
+    restoreKernel->setArg(6, info.velm);
+    restoreKernel->setArg(7, info.invAtomOrder);
+    restoreKernel->execute(numAtoms);
+
+    // The periodic cell offsets travel with the positions.  If the atoms have been reordered since the
+    // snapshot was saved, permute them the same way.
+
+    const vector<int>& order = cc.getAtomIndex();
+    vector<mm_int4>& offsets = cc.getPosCellOffsets();
+    if (order == info.atomIndex)
+        offsets = info.cellOffsets;
+    else {
+        vector<int> savedInvOrder(numAtoms);
+        for (int i = 0; i < numAtoms; i++)
+            savedInvOrder[info.atomIndex[i]] = i;
+        for (int i = 0; i < numAtoms; i++)
+            offsets[i] = info.cellOffsets[savedInvOrder[order[i]]];
+    }
+}
+
+void CommonScaleVelocitiesKernel::initialize(const System& system) {
+    cc.setAsCurrent();
+    map<string, string> defines;
+    defines["NUM_ATOMS"] = cc.intToString(cc.getNumAtoms());
+    ComputeProgram program = cc.compileProgram(CommonKernelSources::scaleVelocities, defines);
+    kernel = program->createKernel("scaleVelocities");
+    kernel->addArg(cc.getVelm());
+    kernel->addArg();
+}
+
+void CommonScaleVelocitiesKernel::execute(ContextImpl& context, double scale) {
+    cc.setAsCurrent();
+    if (cc.getUseDoublePrecision() || cc.getUseMixedPrecision())
+        kernel->setArg(1, scale);
+    else
+        kernel->setArg(1, (float) scale);
     kernel->execute(cc.getNumAtoms());
 }
@@ -90,6 +90,18 @@ void ComputeArray::upload(const void* data, bool blocking) {
     impl->upload(data, blocking);
 }
 
+void ComputeArray::uploadSubArray(const void* data, int offset, int elements, bool blocking) {
+    if (impl == NULL)
+        throw OpenMMException("ComputeArray has not been initialized");
+    impl->uploadSubArray(data, offset, elements, blocking);
+}
+
+void ComputeArray::uploadShared(const void* data) {
+    if (impl == NULL)
+        throw OpenMMException("ComputeArray has not been initialized");
+    impl->uploadShared(data);
+}
+
 void ComputeArray::download(void* data, bool blocking) const {
     if (impl == NULL)
         throw OpenMMException("ComputeArray has not been initialized");
@@ -29,6 +29,8 @@
 #include "openmm/VirtualSite.h"
 #include "openmm/internal/ContextImpl.h"
 #include "openmm/internal/ThreadPool.h"
+#include "openmm/internal/TraceRange.h"
+#include "CommonKernelSources.h"
 #include "hilbert.h"
 #include <algorithm>
 #include <cmath>
@@ -40,7 +42,7 @@ using namespace OpenMM;
 using namespace std;
 
 ComputeContext::ComputeContext(const System& system) : system(system), time(0.0), stepCount(0), computeForceCount(0), stepsSinceReorder(99999),
-        atomsWereReordered(false), forcesValid(false), thread(NULL) {
+        atomsWereReordered(false), forcesValid(false), moleculesChanged(true), profilingEnabled(false), specializeGlobalParameters(false), profiledForceGroups(0), memoryOwner("context"), thread(NULL) {
     thread = new WorkThread();
 }
 
@@ -53,17 +55,24 @@ void ComputeContext::addForce(ComputeForceInfo* force) {
     forces.push_back(force);
 }
 
+/**
+ * Create the set of characters that may appear in a symbol.  This is used to initialize a static variable,
+ * which C++ guarantees happens exactly once even if multiple Contexts are created at the same time.
+ */
+static set<char> createSymbolChars() {
+    set<char> symbolChars;
+    symbolChars.insert('_');
+    for (char c = 'a'; c <= 'z'; c++)
+        symbolChars.insert(c);
+    for (char c = 'A'; c <= 'Z'; c++)
+        symbolChars.insert(c);
+    for (char c = '0'; c <= '9'; c++)
+        symbolChars.insert(c);
+    return symbolChars;
+}
+
 string ComputeContext::replaceStrings(const string& input, const std::map<std::string, std::string>& replacements) const {
-    static set<char> symbolChars;
-    if (symbolChars.size() == 0) {
-        symbolChars.insert('_');
-        for (char c = 'a'; c <= 'z'; c++)
-            symbolChars.insert(c);
-        for (char c = 'A'; c <= 'Z'; c++)
-            symbolChars.insert(c);
-        for (char c = '0'; c <= '9'; c++)
-            symbolChars.insert(c);
-    }
+    static const set<char> symbolChars = createSymbolChars();
     string result = input;
     for (auto& pair : replacements) {
         int index = 0;
@@ -174,24 +183,22 @@ void ComputeContext::findMoleculeGroups() {
 
         addForce(new VirtualSiteInfo(system));
 
-        // First make a list of every other atom to which each atom is connect by a constraint or force group.
+        // First make a list of pairs of atoms that are connected by a constraint or force group.  Connecting
+        // every atom in a group to the first one is enough to put them all in the same molecule.
 
-        vector<vector<int> > atomBonds(system.getNumParticles());
+        vector<pair<int, int> > atomBonds;
         for (int i = 0; i < system.getNumConstraints(); i++) {
             int particle1, particle2;
             double distance;
             system.getConstraintParameters(i, particle1, particle2, distance);
-            atomBonds[particle1].push_back(particle2);
-            atomBonds[particle2].push_back(particle1);
+            atomBonds.push_back(make_pair(particle1, particle2));
         }
         for (auto force : forces) {
             for (int j = 0; j < force->getNumParticleGroups(); j++) {
                 vector<int> particles;
                 force->getParticlesInGroup(j, particles);
-                for (int k = 0; k < (int) particles.size(); k++)
-                    for (int m = 0; m < (int) particles.size(); m++)
-                        if (k != m)
-                            atomBonds[particles[k]].push_back(particles[m]);
+                for (int k = 1; k < (int) particles.size(); k++)
+                    atomBonds.push_back(make_pair(particles[0], particles[k]));
             }
         }
 
@@ -303,6 +310,7 @@ void ComputeContext::findMoleculeGroups() {
         for (int j = 0; j < (int) atoms.size(); j++)
             moleculeGroups[i].atoms[j] = atoms[j]-atoms[0];
     }
+    moleculesChanged = true;
 }
 
 void ComputeContext::invalidateMolecules() {
@@ -432,6 +440,7 @@ void ComputeContext::reorderAtoms() {
     }
     atomsWereReordered = true;
     stepsSinceReorder = 0;
+    OPENMM_TRACE_RANGE("reorderAtoms");
     if (getUseDoublePrecision())
         reorderAtomsImpl<double, mm_double4, double, mm_double4>();
     else if (getUseMixedPrecision())
@@ -442,108 +451,121 @@ void ComputeContext::reorderAtoms() {
 
 template <class Real, class Real4, class Mixed, class Mixed4>
 void ComputeContext::reorderAtomsImpl() {
+    // The atoms of every molecule are stored on the device as a flattened list, ordered by molecule group.
+    // Upload it if the molecule groups have changed since the last call.
+
+    int totalMolecules = 0;
+    for (auto& mol : moleculeGroups)
+        totalMolecules += mol.offsets.size();
+    if (!reorderMoleculeStart.isInitialized()) {
+        reorderMoleculeStart.initialize<int>(*this, totalMolecules+1, "reorderMoleculeStart");
+        reorderMoleculeAtoms.initialize<int>(*this, numAtoms, "reorderMoleculeAtoms");
+        reorderAtomMolecule.initialize<int>(*this, numAtoms, "reorderAtomMolecule");
+        reorderSourceMolecule.initialize<int>(*this, totalMolecules, "reorderSourceMolecule");
+        reorderMoleculeCenters.initialize<Real4>(*this, totalMolecules, "reorderMoleculeCenters");
+        reorderMoleculeCellShifts.initialize<mm_int4>(*this, totalMolecules, "reorderMoleculeCellShifts");
+        reorderPosq.initialize<Real4>(*this, paddedNumAtoms, "reorderPosq");
+        reorderVelm.initialize<Mixed4>(*this, paddedNumAtoms, "reorderVelm");
+        if (getUseMixedPrecision())
+            reorderPosqCorrection.initialize<Real4>(*this, paddedNumAtoms, "reorderPosqCorrection");
+        ComputeProgram program = compileProgram(CommonKernelSources::reorderAtoms);
+        reorderCentersKernel = program->createKernel("computeMoleculeCenters");
+        reorderCentersKernel->addArg(totalMolecules);
+        reorderCentersKernel->addArg(getPosq());
+        reorderCentersKernel->addArg(reorderMoleculeStart);
+        reorderCentersKernel->addArg(reorderMoleculeAtoms);
+        reorderCentersKernel->addArg(reorderMoleculeCenters);
+        reorderCentersKernel->addArg(reorderMoleculeCellShifts);
+        reorderCentersKernel->addArg((int) getNonbondedUtilities().getUsePeriodic());
+        for (int i = 0; i < 4; i++)
+            reorderCentersKernel->addArg(); // Periodic box information will be set just before it is executed.
+        reorderAtomsKernel = program->createKernel("applyAtomReordering");
+        reorderAtomsKernel->addArg(numAtoms);
+        reorderAtomsKernel->addArg(paddedNumAtoms);
+        reorderAtomsKernel->addArg(reorderMoleculeStart);
+        reorderAtomsKernel->addArg(reorderMoleculeAtoms);
+        reorderAtomsKernel->addArg(reorderAtomMolecule);
+        reorderAtomsKernel->addArg(reorderSourceMolecule);
+        reorderAtomsKernel->addArg(reorderMoleculeCellShifts);
+        reorderAtomsKernel->addArg(getPosq());
+        reorderAtomsKernel->addArg(reorderPosq);
+        reorderAtomsKernel->addArg(getVelm());
+        reorderAtomsKernel->addArg(reorderVelm);
+        for (int i = 0; i < 3; i++)
+            reorderAtomsKernel->addArg(); // Periodic box information will be set just before it is executed.
+        if (getUseMixedPrecision()) {
+            reorderAtomsKernel->addArg(getPosqCorrection());
+            reorderAtomsKernel->addArg(reorderPosqCorrection);
+        }
+    }
+    if (moleculesChanged) {
+        vector<int> moleculeStart, moleculeAtoms, atomMolecule;
+        for (auto& mol : moleculeGroups)
+            for (int offset : mol.offsets) {
+                moleculeStart.push_back(moleculeAtoms.size());
+                for (int atom : mol.atoms) {
+                    moleculeAtoms.push_back(atom+offset);
+                    atomMolecule.push_back(moleculeStart.size()-1);
+                }
+            }
+        moleculeStart.push_back(moleculeAtoms.size());
+        reorderMoleculeStart.upload(moleculeStart);
+        reorderMoleculeAtoms.upload(moleculeAtoms);
+        reorderAtomMolecule.upload(atomMolecule);
+        moleculesChanged = false;
+    }
 
-    // Find the range of positions and the number of bins along each axis.
+    // Compute the center of each molecule on the device, wrapping it into the periodic box.  Only the
+    // centers and cell shifts are downloaded, not the per-atom data.
 
-    vector<Real4> oldPosq(paddedNumAtoms);
-    vector<Real4> oldPosqCorrection(paddedNumAtoms);
-    vector<Mixed4> oldVelm(paddedNumAtoms);
-    getPosq().download(oldPosq);
-    getVelm().download(oldVelm);
-    if (getUseMixedPrecision())
-        getPosqCorrection().download(oldPosqCorrection);
-    Real minx = oldPosq[0].x, maxx = oldPosq[0].x;
-    Real miny = oldPosq[0].y, maxy = oldPosq[0].y;
-    Real minz = oldPosq[0].z, maxz = oldPosq[0].z;
     Vec3 periodicBoxX, periodicBoxY, periodicBoxZ;
     getPeriodicBoxVectors(periodicBoxX, periodicBoxY, periodicBoxZ);
-    Vec3 invPeriodicBoxSize(1.0/periodicBoxX[0], 1.0/periodicBoxY[1], 1.0/periodicBoxZ[2]);
+    Real4 boxVecX((Real) periodicBoxX[0], (Real) periodicBoxX[1], (Real) periodicBoxX[2], 0);
+    Real4 boxVecY((Real) periodicBoxY[0], (Real) periodicBoxY[1], (Real) periodicBoxY[2], 0);
+    Real4 boxVecZ((Real) periodicBoxZ[0], (Real) periodicBoxZ[1], (Real) periodicBoxZ[2], 0);
+    reorderCentersKernel->setArg(7, Real4((Real) (1.0/periodicBoxX[0]), (Real) (1.0/periodicBoxY[1]), (Real) (1.0/periodicBoxZ[2]), 0));
+    reorderCentersKernel->setArg(8, boxVecX);
+    reorderCentersKernel->setArg(9, boxVecY);
+    reorderCentersKernel->setArg(10, boxVecZ);
+    reorderCentersKernel->execute(totalMolecules);
+    vector<Real4> molPos;
+    vector<mm_int4> molShift;
+    reorderMoleculeCenters.download(molPos);
+    reorderMoleculeCellShifts.download(molShift);
+
+    // Find the range of positions and the number of bins along each axis.
+
+    Real minx = molPos[0].x, maxx = molPos[0].x;
+    Real miny = molPos[0].y, maxy = molPos[0].y;
+    Real minz = molPos[0].z, maxz = molPos[0].z;
+    for (int i = 0; i < totalMolecules; i++) {
+        if (molPos[i].x != molPos[i].x)
+            throw OpenMMException("Particle coordinate is nan");
+        minx = min(minx, molPos[i].x);
+        maxx = max(maxx, molPos[i].x);
+        miny = min(miny, molPos[i].y);
+        maxy = max(maxy, molPos[i].y);
+        minz = min(minz, molPos[i].z);
+        maxz = max(maxz, molPos[i].z);
+    }
     if (getNonbondedUtilities().getUsePeriodic()) {
         minx = miny = minz = 0.0;
         maxx = periodicBoxX[0];
         maxy = periodicBoxY[1];
         maxz = periodicBoxZ[2];
     }
-    else {
-        for (int i = 1; i < numAtoms; i++) {
-            const Real4& pos = oldPosq[i];
-            minx = min(minx, pos.x);
-            maxx = max(maxx, pos.x);
-            miny = min(miny, pos.y);
-            maxy = max(maxy, pos.y);
-            minz = min(minz, pos.z);
-            maxz = max(maxz, pos.z);
-        }
-    }
 
-    // Loop over each group of identical molecules and reorder them.
+    // Loop over each group of identical molecules and sort them.
 
-    
+    vector<int> sourceMolecule(totalMolecules);
     vector<int> originalIndex(numAtoms);
-    vector<Real4> newPosq(paddedNumAtoms, Real4(0,0,0,0));
-    vector<Real4> newPosqCorrection(paddedNumAtoms, Real4(0,0,0,0));
-    vector<Mixed4> newVelm(paddedNumAtoms, Mixed4(0,0,0,0));
     vector<mm_int4> newCellOffsets(numAtoms);
+    int firstMolecule = 0;
     for (auto& mol : moleculeGroups) {
-        // Find the center of each molecule.
+        // Select a bin for each molecule, then sort them by bin.
 
         int numMolecules = mol.offsets.size();
         vector<int>& atoms = mol.atoms;
-        vector<Real4> molPos(numMolecules);
-        Real invNumAtoms = (Real) (1.0/atoms.size());
-        for (int i = 0; i < numMolecules; i++) {
-            molPos[i].x = 0.0f;
-            molPos[i].y = 0.0f;
-            molPos[i].z = 0.0f;
-            for (int j = 0; j < (int)atoms.size(); j++) {
-                int atom = atoms[j]+mol.offsets[i];
-                const Real4& pos = oldPosq[atom];
-                molPos[i].x += pos.x;
-                molPos[i].y += pos.y;
-                molPos[i].z += pos.z;
-            }
-            molPos[i].x *= invNumAtoms;
-            molPos[i].y *= invNumAtoms;
-            molPos[i].z *= invNumAtoms;
-            if (molPos[i].x != molPos[i].x)
-                throw OpenMMException("Particle coordinate is nan");
-        }
-        if (getNonbondedUtilities().getUsePeriodic()) {
-            // Move each molecule position into the same box.
-
-            for (int i = 0; i < numMolecules; i++) {
-                Real4 center = molPos[i];
-                int zcell = (int) floor(center.z*invPeriodicBoxSize[2]);
-                center.x -= zcell*periodicBoxZ[0];
-                center.y -= zcell*periodicBoxZ[1];
-                center.z -= zcell*periodicBoxZ[2];
-                int ycell = (int) floor(center.y*invPeriodicBoxSize[1]);
-                center.x -= ycell*periodicBoxY[0];
-                center.y -= ycell*periodicBoxY[1];
-                int xcell = (int) floor(center.x*invPeriodicBoxSize[0]);
-                center.x -= xcell*periodicBoxX[0];
-                if (xcell != 0 || ycell != 0 || zcell != 0) {
-                    Real dx = molPos[i].x-center.x;
-                    Real dy = molPos[i].y-center.y;
-                    Real dz = molPos[i].z-center.z;
-                    molPos[i] = center;
-                    for (int j = 0; j < (int) atoms.size(); j++) {
-                        int atom = atoms[j]+mol.offsets[i];
-                        Real4 p = oldPosq[atom];
-                        p.x -= dx;
-                        p.y -= dy;
-                        p.z -= dz;
-                        oldPosq[atom] = p;
-                        posCellOffsets[atom].x -= xcell;
-                        posCellOffsets[atom].y -= ycell;
-                        posCellOffsets[atom].z -= zcell;
-                    }
-                }
-            }
-        }
-
-        // Select a bin for each molecule, then sort them by bin.
-
         bool useHilbert = (numMolecules > 5000 || atoms.size() > 8); // For small systems, a simple zigzag curve works better than a Hilbert curve.
         Real binWidth;
         if (useHilbert)
@@ -556,9 +578,10 @@ void ComputeContext::reorderAtomsImpl() {
         vector<pair<int, int> > molBins(numMolecules);
         bitmask_t coords[3];
         for (int i = 0; i < numMolecules; i++) {
-            int x = (int) ((molPos[i].x-minx)*invBinWidth);
-            int y = (int) ((molPos[i].y-miny)*invBinWidth);
-            int z = (int) ((molPos[i].z-minz)*invBinWidth);
+            const Real4& center = molPos[firstMolecule+i];
+            int x = (int) ((center.x-minx)*invBinWidth);
+            int y = (int) ((center.y-miny)*invBinWidth);
+            int z = (int) ((center.z-minz)*invBinWidth);
             int bin;
             if (useHilbert) {
                 coords[0] = x;
@@ -577,37 +600,101 @@ void ComputeContext::reorderAtomsImpl() {
         }
         sort(molBins.begin(), molBins.end());
 
-        // Reorder the atoms.
+        // Record the new order.  The per-atom data is permuted on the device, so only the
+        // host-side index arrays need to be updated here.
 
         for (int i = 0; i < numMolecules; i++) {
+            int source = molBins[i].second;
+            sourceMolecule[firstMolecule+i] = firstMolecule+source;
+            const mm_int4& shift = molShift[firstMolecule+source];
             for (int atom : atoms) {
-                int oldIndex = mol.offsets[molBins[i].second]+atom;
+                int oldIndex = mol.offsets[source]+atom;
                 int newIndex = mol.offsets[i]+atom;
                 originalIndex[newIndex] = atomIndex[oldIndex];
-                newPosq[newIndex] = oldPosq[oldIndex];
-                if (getUseMixedPrecision())
-                    newPosqCorrection[newIndex] = oldPosqCorrection[oldIndex];
-                newVelm[newIndex] = oldVelm[oldIndex];
-                newCellOffsets[newIndex] = posCellOffsets[oldIndex];
+                newCellOffsets[newIndex] = mm_int4(posCellOffsets[oldIndex].x-shift.x, posCellOffsets[oldIndex].y-shift.y,
+                        posCellOffsets[oldIndex].z-shift.z, posCellOffsets[oldIndex].w);
             }
         }
+        firstMolecule += numMolecules;
     }
 
-    // Update the arrays.
+    // Permute the atoms on the device and update the arrays.
 
+    reorderSourceMolecule.upload(sourceMolecule);
+    reorderAtomsKernel->setArg(11, boxVecX);
+    reorderAtomsKernel->setArg(12, boxVecY);
+    reorderAtomsKernel->setArg(13, boxVecZ);
+    reorderAtomsKernel->execute(paddedNumAtoms);
+    reorderPosq.copyTo(getPosq());
+    reorderVelm.copyTo(getVelm());
+    if (getUseMixedPrecision())
+        reorderPosqCorrection.copyTo(getPosqCorrection());
     for (int i = 0; i < numAtoms; i++) {
         atomIndex[i] = originalIndex[i];
         posCellOffsets[i] = newCellOffsets[i];
     }
-    getPosq().upload(newPosq);
-    if (getUseMixedPrecision())
-        getPosqCorrection().upload(newPosqCorrection);
-    getVelm().upload(newVelm);
     getAtomIndexArray().upload(atomIndex);
     for (auto listener : reorderListeners)
         listener->execute();
 }
 
+void ComputeContext::setProfilingEnabled(bool enabled) {
+    if (enabled) {
+        profiledKernelTimes.clear();
+        profiledGroupTimes.clear();
+    }
+    profilingEnabled = enabled;
+    profiledForceGroups = 0;
+}
+
+void ComputeContext::getPerformanceReport(map<string, double>& report) {
+    report.clear();
+    for (auto& kernel : profiledKernelTimes)
+        report["kernel:"+kernel.first] = kernel.second;
+    for (auto& groups : profiledGroupTimes) {
+        stringstream key;
+        key<<"group:";
+        bool first = true;
+        for (int i = 0; i < 32; i++)
+            if ((groups.first&(1<<i)) != 0) {
+                if (!first)
+                    key<<",";
+                key<<i;
+                first = false;
+            }
+        report[key.str()] += groups.second;
+    }
+    getNonbondedUtilities().getNeighborListStatistics(report);
+    getMemoryUsage(report);
+}
+
+void ComputeContext::recordArrayAllocation(const ArrayInterface* array, const string& name, long long bytes) {
+    auto existing = arrayAllocations.find(array);
+    if (existing == arrayAllocations.end())
+        arrayAllocations[array] = {memoryOwner, name, bytes};
+    else
+        existing->second.bytes = bytes;
+}
+
+void ComputeContext::recordArrayRelease(const ArrayInterface* array) {
+    arrayAllocations.erase(array);
+}
+
+void ComputeContext::getMemoryUsage(map<string, double>& usage) const {
+    for (auto& allocation : arrayAllocations) {
+        const ArrayAllocation& info = allocation.second;
+        usage["memory:"+info.owner] += info.bytes;
+        usage["memory:"+info.owner+":"+info.name] += info.bytes;
+        usage["memory:total"] += info.bytes;
+    }
+}
+
+void ComputeContext::recordKernelTime(const string& kernel, int groups, double time) {
+    profiledKernelTimes[kernel] += time;
+    if (groups != 0)
+        profiledGroupTimes[groups] += time;
+}
+
 void ComputeContext::addReorderListener(ReorderListener* listener) {
     reorderListeners.push_back(listener);
 }
@@ -157,6 +157,53 @@ void ComputeParameterSet::setParameterValues(const vector<vector<T> >& values) {
     }
 }
 
+template <class T>
+void ComputeParameterSet::setParameterValuesSubset(int first, const vector<vector<T> >& values) {
+    if (sizeof(T) != elementSize)
+        throw OpenMMException("Called setParameterValuesSubset() with vector of wrong type");
+    int count = values.size();
+    if (first < 0 || first+count > numObjects)
+        throw OpenMMException("Called setParameterValuesSubset() with an invalid range");
+    if (count == 0)
+        return;
+    int base = 0;
+    for (int i = 0; i < (int) arrays.size(); i++) {
+        if (arrays[i]->getElementSize() == 4*elementSize) {
+            vector<T> data(4*count, 0);
+            for (int j = 0; j < count; j++) {
+                data[4*j] = values[j][base];
+                if (base+1 < numParameters)
+                    data[4*j+1] = values[j][base+1];
+                if (base+2 < numParameters)
+                    data[4*j+2] = values[j][base+2];
+                if (base+3 < numParameters)
+                    data[4*j+3] = values[j][base+3];
+            }
+            arrays[i]->uploadSubArray(data.data(), first, count);
+            base += 4;
+        }
+        else if (arrays[i]->getElementSize() == 2*elementSize) {
+            vector<T> data(2*count, 0);
+            for (int j = 0; j < count; j++) {
+                data[2*j] = values[j][base];
+                if (base+1 < numParameters)
+                    data[2*j+1] = values[j][base+1];
+            }
+            arrays[i]->uploadSubArray(data.data(), first, count);
+            base += 2;
+        }
+        else if (arrays[i]->getElementSize() == elementSize) {
+            vector<T> data(count);
+            for (int j = 0; j < count; j++)
+                data[j] = values[j][base];
+            arrays[i]->uploadSubArray(data.data(), first, count);
+            base++;
+        }
+        else
+            throw OpenMMException("Internal error: Unknown buffer type in ComputeParameterSet");
+    }
+}
+
 string ComputeParameterSet::getParameterSuffix(int index, const std::string& extraSuffix) const {
     const string suffixes[] = {".x", ".y", ".z", ".w"};
     int buffer = -1;
@@ -183,4 +230,6 @@ template void ComputeParameterSet::getParameterValues<float>(vector<vector<float
 template void ComputeParameterSet::setParameterValues<float>(const vector<vector<float> >& values);
 template void ComputeParameterSet::getParameterValues<double>(vector<vector<double> >& values);
 template void ComputeParameterSet::setParameterValues<double>(const vector<vector<double> >& values);
+template void ComputeParameterSet::setParameterValuesSubset<float>(int first, const vector<vector<float> >& values);
+template void ComputeParameterSet::setParameterValuesSubset<double>(int first, const vector<vector<double> >& values);
 }
\ No newline at end of file
@@ -28,10 +28,12 @@
 #include "openmm/common/ComputeContext.h"
 #include "CommonKernelSources.h"
 #include "openmm/internal/OSRngSeed.h"
+#include "openmm/internal/TraceRange.h"
 #include "openmm/HarmonicAngleForce.h"
 #include "openmm/VirtualSite.h"
 #include "quern.h"
 #include "ReferenceCCMAAlgorithm.h"
+#include "ReferenceLincsAlgorithm.h"
 #include <algorithm>
 #include <cmath>
 #include <cstdlib>
@@ -89,8 +91,48 @@ struct IntegrationUtilities::ConstraintOrderer : public binary_function<int, int
     }
 };
 
-IntegrationUtilities::IntegrationUtilities(ComputeContext& context, const System& system) : context(context),
-        randomPos(0), hasOverlappingVsites(false) {
+static double getInverseMass(const System& system, int atom) {
+    double mass = system.getParticleMass(atom);
+    return (mass == 0.0 ? 0.0 : 1.0/mass);
+}
+
+/**
+ * The number of terms in the series expansion of the inverse constraint matrix used by LINCS.
+ */
+/**
+ * Reorder a list of virtual sites so the ones in isSettleSite come last, and return how many of them there are.
+ */
+template <class T>
+static int moveSettleSitesToEnd(vector<mm_int4>& atoms, vector<T>& weights, const vector<bool>& isSettleSite) {
+    vector<mm_int4> sortedAtoms;
+    vector<T> sortedWeights;
+    for (int pass = 0; pass < 2; pass++)
+        for (int i = 0; i < (int) atoms.size(); i++)
+            if (isSettleSite[atoms[i].x] == (pass == 1)) {
+                sortedAtoms.push_back(atoms[i]);
+                sortedWeights.push_back(weights[i]);
+            }
+    atoms = sortedAtoms;
+    weights = sortedWeights;
+    int count = 0;
+    for (mm_int4 site : atoms)
+        if (isSettleSite[site.x])
+            count++;
+    return count;
+}
+
+static const int LINCS_EXPANSION_ORDER = 4;
+
+const int IntegrationUtilities::MaxCCMAIterations = 150;
+const int IntegrationUtilities::StepSizeTableSize = 16;
+
+IntegrationUtilities::IntegrationUtilities(ComputeContext& context, const System& system, bool useLincs) : context(context),
+        randomPos(0), numSettleVsites(0), hasOverlappingVsites(false), useLincs(useLincs) {
+    for (int i = 0; i < 2; i++) {
+        ccmaIterationBudget[i] = MaxCCMAIterations;
+        ccmaLastTolerance[i] = -1.0;
+    }
+
     // Create workspace arrays.
 
     lastStepSize = mm_double2(0.0, 0.0);
@@ -100,6 +142,7 @@ IntegrationUtilities::IntegrationUtilities(ComputeContext& context, const System
         posDelta.upload(deltas);
         stepSize.initialize<mm_double2>(context, 1, "stepSize");
         stepSize.upload(&lastStepSize);
+        stepSizeTable.initialize<mm_double2>(context, StepSizeTableSize, "stepSizeTable");
     }
     else {
         posDelta.initialize<mm_float4>(context, context.getPaddedNumAtoms(), "posDelta");
@@ -108,6 +151,7 @@ IntegrationUtilities::IntegrationUtilities(ComputeContext& context, const System
         stepSize.initialize<mm_float2>(context, 1, "stepSize");
         mm_float2 lastStepSizeFloat = mm_float2(0.0f, 0.0f);
         stepSize.upload(&lastStepSizeFloat);
+        stepSizeTable.initialize<mm_float2>(context, StepSizeTableSize, "stepSizeTable");
     }
 
     // Record the set of constraints and how many constraints each atom is involved in.
@@ -162,6 +206,7 @@ IntegrationUtilities::IntegrationUtilities(ComputeContext& context, const System
     // Record the SETTLE clusters.
 
     vector<bool> isShakeAtom(numAtoms, false);
+    vector<mm_int4> settleAtomVec;
     if (settleClusters.size() > 0) {
         vector<mm_int4> atoms;
         vector<mm_float2> params;
@@ -198,6 +243,12 @@ IntegrationUtilities::IntegrationUtilities(ComputeContext& context, const System
             settleParams.initialize<mm_float2>(context, params.size(), "settleParams");
             settleAtoms.upload(atoms);
             settleParams.upload(params);
+            vector<int> flags(numAtoms, 0);
+            for (mm_int4 cluster : atoms)
+                flags[cluster.x] = flags[cluster.y] = flags[cluster.z] = 1;
+            settleAtomFlags.initialize<int>(context, numAtoms, "settleAtomFlags");
+            settleAtomFlags.upload(flags);
+            settleAtomVec = atoms;
         }
     }
 
@@ -304,29 +355,58 @@ IntegrationUtilities::IntegrationUtilities(ComputeContext& context, const System
             refIndices[i] = make_pair(atom1[index], atom2[index]);
             refDistance[i] = distance[index];
         }
-        vector<double> refMasses(numAtoms);
-        for (int i = 0; i < numAtoms; ++i)
-            refMasses[i] = system.getParticleMass(i);
+        vector<vector<pair<int, double> > > matrix;
+        if (useLincs) {
+            // LINCS couples each constraint to every other constraint that shares an atom with it.  The
+            // coupling coefficients are the product of a constant factor, which is computed here, and the
+            // dot product of the two constraint directions, which changes every step.
+
+            vector<vector<int> > linkedConstraints = ReferenceLincsAlgorithm::findLinkedConstraints(numAtoms, refIndices);
+            vector<double> sMatrix(numCCMA);
+            for (int i = 0; i < numCCMA; i++)
+                sMatrix[i] = 1.0/sqrt(getInverseMass(system, refIndices[i].first)+getInverseMass(system, refIndices[i].second));
+            matrix.resize(numCCMA);
+            for (int i = 0; i < numCCMA; i++)
+                for (int j : linkedConstraints[i]) {
+                    int sharedAtom;
+                    bool samePosition;
+                    if (refIndices[i].first == refIndices[j].first || refIndices[i].second == refIndices[j].second) {
+                        sharedAtom = (refIndices[i].first == refIndices[j].first ? refIndices[i].first : refIndices[i].second);
+                        samePosition = true;
+                    }
+                    else {
+                        sharedAtom = (refIndices[i].first == refIndices[j].second ? refIndices[i].first : refIndices[i].second);
+                        samePosition = false;
+                    }
+                    double coefficient = getInverseMass(system, sharedAtom)*sMatrix[i]*sMatrix[j];
+                    matrix[i].push_back(make_pair(j, samePosition ? -coefficient : coefficient));
+                }
+        }
+        else {
+            vector<double> refMasses(numAtoms);
+            for (int i = 0; i < numAtoms; ++i)
+                refMasses[i] = system.getParticleMass(i);
 
-        // Look up angles for CCMA.
+            // Look up angles for CCMA.
         
-        vector<ReferenceCCMAAlgorithm::AngleInfo> angles;
-        for (int i = 0; i < system.getNumForces(); i++) {
-            const HarmonicAngleForce* force = dynamic_cast<const HarmonicAngleForce*>(&system.getForce(i));
-            if (force != NULL) {
-                for (int j = 0; j < force->getNumAngles(); j++) {
-                    int atom1, atom2, atom3;
-                    double angle, k;
-                    force->getAngleParameters(j, atom1, atom2, atom3, angle, k);
-                    angles.push_back(ReferenceCCMAAlgorithm::AngleInfo(atom1, atom2, atom3, angle));
+            vector<ReferenceCCMAAlgorithm::AngleInfo> angles;
+            for (int i = 0; i < system.getNumForces(); i++) {
+                const HarmonicAngleForce* force = dynamic_cast<const HarmonicAngleForce*>(&system.getForce(i));
+                if (force != NULL) {
+                    for (int j = 0; j < force->getNumAngles(); j++) {
+                        int atom1, atom2, atom3;
+                        double angle, k;
+                        force->getAngleParameters(j, atom1, atom2, atom3, angle, k);
+                        angles.push_back(ReferenceCCMAAlgorithm::AngleInfo(atom1, atom2, atom3, angle));
+                    }
                 }
             }
-        }
         
-        // Create a ReferenceCCMAAlgorithm.  It will build and invert the constraint matrix for us.
+            // Create a ReferenceCCMAAlgorithm.  It will build and invert the constraint matrix for us.
         
-        ReferenceCCMAAlgorithm ccma(numAtoms, numCCMA, refIndices, refDistance, refMasses, angles, 0.1);
-        vector<vector<pair<int, double> > > matrix = ccma.getMatrix();
+            ReferenceCCMAAlgorithm ccma(numAtoms, numCCMA, refIndices, refDistance, refMasses, angles, 0.1);
+            matrix = ccma.getMatrix();
+        }
         int maxRowElements = 0;
         for (unsigned i = 0; i < matrix.size(); i++)
             maxRowElements = max(maxRowElements, (int) matrix[i].size());
@@ -404,6 +484,20 @@ IntegrationUtilities::IntegrationUtilities(ComputeContext& context, const System
         ccmaDistance.upload(distanceVec, true);
         ccmaReducedMass.upload(reducedMassVec, true);
         ccmaConstraintMatrixValue.upload(constraintMatrixValueVec, true);
+        if (useLincs) {
+            // LINCS uses the same constraint and atom lists as CCMA.  The constraint matrix holds the constant
+            // part of each coupling coefficient.
+
+            lincsSMatrix.initialize(context, numCCMA, elementSize, "lincsSMatrix");
+            lincsCoupling.initialize(context, numCCMA*maxRowElements, elementSize, "lincsCoupling");
+            lincsSolution.initialize(context, numCCMA, elementSize, "lincsSolution");
+            vector<double> sMatrixVec(numCCMA);
+            for (int i = 0; i < numCCMA; i++) {
+                int c = ccmaConstraints[constraintOrder[i]];
+                sMatrixVec[i] = 1.0/sqrt(getInverseMass(system, atom1[c])+getInverseMass(system, atom2[c]));
+            }
+            lincsSMatrix.upload(sMatrixVec, true);
+        }
         for (unsigned int i = 0; i < atomConstraints.size(); i++) {
             numAtomConstraintsVec[i] = atomConstraints[i].size();
             for (unsigned int j = 0; j < atomConstraints[i].size(); j++) {
@@ -482,6 +576,81 @@ IntegrationUtilities::IntegrationUtilities(ComputeContext& context, const System
     int numOutOfPlane = vsiteOutOfPlaneAtomVec.size();
     int numLocalCoords = vsiteLocalCoordsPosVec.size();
     numVsites = num2Avg+num3Avg+numOutOfPlane+numLocalCoords;
+
+    // Find virtual sites whose parent particles all belong to a single SETTLE cluster (such as the
+    // extra sites in TIP4P and TIP5P water).  An integrator that updates each SETTLE cluster in a
+    // single thread can compute them at the same time, so move them to the end of each list where
+    // computeVirtualSites() can skip them.
+
+    vector<int> atomSettleCluster(numAtoms, -1);
+    for (int i = 0; i < (int) settleAtomVec.size(); i++)
+        atomSettleCluster[settleAtomVec[i].x] = atomSettleCluster[settleAtomVec[i].y] = atomSettleCluster[settleAtomVec[i].z] = i;
+    vector<vector<mm_int4> > clusterSiteAtoms(settleAtomVec.size());
+    vector<vector<mm_double4> > clusterSiteWeights(settleAtomVec.size());
+    vector<bool> isSettleSite(numAtoms, false);
+    for (int i = 0; i < numAtoms; i++) {
+        if (!system.isVirtualSite(i))
+            continue;
+        const VirtualSite& site = system.getVirtualSite(i);
+        int type;
+        mm_double4 weights;
+        if (dynamic_cast<const TwoParticleAverageSite*>(&site) != NULL) {
+            const TwoParticleAverageSite& s = dynamic_cast<const TwoParticleAverageSite&>(site);
+            type = 0;
+            weights = mm_double4(s.getWeight(0), s.getWeight(1), 0.0, 0.0);
+        }
+        else if (dynamic_cast<const ThreeParticleAverageSite*>(&site) != NULL) {
+            const ThreeParticleAverageSite& s = dynamic_cast<const ThreeParticleAverageSite&>(site);
+            type = 0;
+            weights = mm_double4(s.getWeight(0), s.getWeight(1), s.getWeight(2), 0.0);
+        }
+        else if (dynamic_cast<const OutOfPlaneSite*>(&site) != NULL) {
+            const OutOfPlaneSite& s = dynamic_cast<const OutOfPlaneSite&>(site);
+            type = 1;
+            weights = mm_double4(s.getWeight12(), s.getWeight13(), s.getWeightCross(), 0.0);
+        }
+        else
+            continue;
+        int cluster = atomSettleCluster[site.getParticle(0)];
+        if (cluster == -1)
+            continue;
+        mm_int4 clusterAtoms = settleAtomVec[cluster];
+        int slots = 0;
+        bool inCluster = true;
+        for (int j = 0; j < site.getNumParticles() && inCluster; j++) {
+            int particle = site.getParticle(j);
+            inCluster = (atomSettleCluster[particle] == cluster);
+            int slot = (particle == clusterAtoms.x ? 0 : (particle == clusterAtoms.y ? 1 : 2));
+            slots |= slot<<(2*j);
+        }
+        if (!inCluster)
+            continue;
+        isSettleSite[i] = true;
+        clusterSiteAtoms[cluster].push_back(mm_int4(i, slots, type, 0));
+        clusterSiteWeights[cluster].push_back(weights);
+    }
+    int numSettle2Avg = moveSettleSitesToEnd(vsite2AvgAtomVec, vsite2AvgWeightVec, isSettleSite);
+    int numSettle3Avg = moveSettleSitesToEnd(vsite3AvgAtomVec, vsite3AvgWeightVec, isSettleSite);
+    int numSettleOutOfPlane = moveSettleSitesToEnd(vsiteOutOfPlaneAtomVec, vsiteOutOfPlaneWeightVec, isSettleSite);
+    numSettleVsites = numSettle2Avg+numSettle3Avg+numSettleOutOfPlane;
+    if (numSettleVsites > 0) {
+        vector<int> startVec;
+        vector<mm_int4> atomVec;
+        vector<mm_double4> weightVec;
+        for (int i = 0; i < (int) settleAtomVec.size(); i++) {
+            startVec.push_back(atomVec.size());
+            atomVec.insert(atomVec.end(), clusterSiteAtoms[i].begin(), clusterSiteAtoms[i].end());
+            weightVec.insert(weightVec.end(), clusterSiteWeights[i].begin(), clusterSiteWeights[i].end());
+        }
+        startVec.push_back(atomVec.size());
+        int elementSize = (context.getUseDoublePrecision() ? sizeof(double) : sizeof(float));
+        settleVsiteStart.initialize<int>(context, startVec.size(), "settleVsiteStart");
+        settleVsiteAtoms.initialize<mm_int4>(context, atomVec.size(), "settleVsiteAtoms");
+        settleVsiteWeights.initialize(context, weightVec.size(), 4*elementSize, "settleVsiteWeights");
+        settleVsiteStart.upload(startVec);
+        settleVsiteAtoms.upload(atomVec);
+        settleVsiteWeights.upload(weightVec, true);
+    }
     vsite2AvgAtoms.initialize<mm_int4>(context, max(1, num2Avg), "vsite2AvgAtoms");
     vsite3AvgAtoms.initialize<mm_int4>(context, max(1, num3Avg), "vsite3AvgAtoms");
     vsiteOutOfPlaneAtoms.initialize<mm_int4>(context, max(1, numOutOfPlane), "vsiteOutOfPlaneAtoms");
@@ -540,10 +709,13 @@ IntegrationUtilities::IntegrationUtilities(ComputeContext& context, const System
     defines["NUM_3_AVERAGE"] = context.intToString(num3Avg);
     defines["NUM_OUT_OF_PLANE"] = context.intToString(numOutOfPlane);
     defines["NUM_LOCAL_COORDS"] = context.intToString(numLocalCoords);
+    defines["NUM_SETTLE_2_AVERAGE"] = context.intToString(numSettle2Avg);
+    defines["NUM_SETTLE_3_AVERAGE"] = context.intToString(numSettle3Avg);
+    defines["NUM_SETTLE_OUT_OF_PLANE"] = context.intToString(numSettleOutOfPlane);
     defines["PADDED_NUM_ATOMS"] = context.intToString(context.getPaddedNumAtoms());
     if (hasOverlappingVsites)
         defines["HAS_OVERLAPPING_VSITES"] = "1";
-    ComputeProgram program = context.compileProgram(CommonKernelSources::integrationUtilities, defines);
+    ComputeProgram program = context.compileProgram(CommonKernelSources::settle+CommonKernelSources::integrationUtilities, defines);
     settlePosKernel = program->createKernel("applySettleToPositions");
     settleVelKernel = program->createKernel("applySettleToVelocities");
     shakePosKernel = program->createKernel("applyShakeToPositions");
@@ -554,11 +726,22 @@ IntegrationUtilities::IntegrationUtilities(ComputeContext& context, const System
     ccmaMultiplyKernel = program->createKernel("multiplyByCCMAConstraintMatrixKernel");
     ccmaUpdateKernel = program->createKernel("updateCCMAAtomPositionsKernel");
     ccmaFullKernel = program->createKernel("runCCMA");
+    if (useLincs) {
+        lincsDirectionsKernel = program->createKernel("computeLincsDirections");
+        lincsCouplingKernel = program->createKernel("computeLincsCoupling");
+        lincsMultiplyKernel = program->createKernel("multiplyByLincsMatrix");
+        lincsUpdateKernel = program->createKernel("updateLincsAtomPositions");
+        lincsRotationKernel = program->createKernel("computeLincsRotationCorrection");
+    }
     vsitePositionKernel = program->createKernel("computeVirtualSites");
     vsiteForceKernel = program->createKernel("distributeVirtualSiteForces");
     vsiteSaveForcesKernel = program->createKernel("saveDistributedForces");
     randomKernel = program->createKernel("generateRandomNumbers");
     timeShiftKernel = program->createKernel("timeShiftVelocities");
+    selectStepSizeKernel = program->createKernel("selectStepSize");
+    selectStepSizeKernel->addArg(stepSizeTable);
+    selectStepSizeKernel->addArg();
+    selectStepSizeKernel->addArg(stepSize);
 
     // Set arguments for virtual site kernels.
 
@@ -578,6 +761,7 @@ IntegrationUtilities::IntegrationUtilities(ComputeContext& context, const System
     vsitePositionKernel->addArg(vsiteLocalCoordsWeights);
     vsitePositionKernel->addArg(vsiteLocalCoordsPos);
     vsitePositionKernel->addArg(vsiteLocalCoordsStartIndex);
+    vsitePositionKernel->addArg(0);
     vsiteForceKernel->addArg(context.getPosq());
     if (context.getUseMixedPrecision())
         vsiteForceKernel->addArg(context.getPosqCorrection());
@@ -595,6 +779,7 @@ IntegrationUtilities::IntegrationUtilities(ComputeContext& context, const System
     vsiteForceKernel->addArg(vsiteLocalCoordsWeights);
     vsiteForceKernel->addArg(vsiteLocalCoordsPos);
     vsiteForceKernel->addArg(vsiteLocalCoordsStartIndex);
+    vsiteForceKernel->addArg(nullptr); // Platforms that keep a floating point copy of the forces may set this.
     for (int i = 0; i < 3; i++)
         vsiteSaveForcesKernel->addArg();
 
@@ -697,6 +882,45 @@ IntegrationUtilities::IntegrationUtilities(ComputeContext& context, const System
         if (context.getUseMixedPrecision())
             ccmaFullKernel->addArg(context.getPosqCorrection());
     }
+    if (useLincs && ccmaConstraintAtoms.isInitialized()) {
+        lincsDirectionsKernel->addArg();
+        lincsDirectionsKernel->addArg(ccmaConstraintAtoms);
+        lincsDirectionsKernel->addArg(ccmaDistance);
+        lincsDirectionsKernel->addArg(context.getPosq());
+        lincsDirectionsKernel->addArg(posDelta);
+        lincsDirectionsKernel->addArg(context.getVelm());
+        lincsDirectionsKernel->addArg(lincsSMatrix);
+        lincsDirectionsKernel->addArg(ccmaDelta1);
+        lincsDirectionsKernel->addArg(lincsSolution);
+        if (context.getUseMixedPrecision())
+            lincsDirectionsKernel->addArg(context.getPosqCorrection());
+        lincsCouplingKernel->addArg(ccmaDistance);
+        lincsCouplingKernel->addArg(ccmaConstraintMatrixColumn);
+        lincsCouplingKernel->addArg(ccmaConstraintMatrixValue);
+        lincsCouplingKernel->addArg(lincsCoupling);
+        lincsMultiplyKernel->addArg();
+        lincsMultiplyKernel->addArg();
+        lincsMultiplyKernel->addArg(lincsSolution);
+        lincsMultiplyKernel->addArg(ccmaConstraintMatrixColumn);
+        lincsMultiplyKernel->addArg(lincsCoupling);
+        lincsUpdateKernel->addArg(ccmaAtoms);
+        lincsUpdateKernel->addArg(ccmaNumAtomConstraints);
+        lincsUpdateKernel->addArg(ccmaAtomConstraints);
+        lincsUpdateKernel->addArg(ccmaDistance);
+        lincsUpdateKernel->addArg();
+        lincsUpdateKernel->addArg(context.getVelm());
+        lincsUpdateKernel->addArg(lincsSMatrix);
+        lincsUpdateKernel->addArg(lincsSolution);
+        lincsRotationKernel->addArg(ccmaConstraintAtoms);
+        lincsRotationKernel->addArg(ccmaDistance);
+        lincsRotationKernel->addArg(context.getPosq());
+        lincsRotationKernel->addArg(posDelta);
+        lincsRotationKernel->addArg(lincsSMatrix);
+        lincsRotationKernel->addArg(ccmaDelta1);
+        lincsRotationKernel->addArg(lincsSolution);
+        if (context.getUseMixedPrecision())
+            lincsRotationKernel->addArg(context.getPosqCorrection());
+    }
 
     // Arguments for time shift kernel will be set later.
     
@@ -707,12 +931,33 @@ IntegrationUtilities::IntegrationUtilities(ComputeContext& context, const System
 void IntegrationUtilities::setNextStepSize(double size) {
     if (size != lastStepSize.x || size != lastStepSize.y) {
         lastStepSize = mm_double2(size, size);
-        if (context.getUseDoublePrecision() || context.getUseMixedPrecision())
-            stepSize.upload(&lastStepSize);
-        else {
-            mm_float2 lastStepSizeFloat = mm_float2((float) size, (float) size);
-            stepSize.upload(&lastStepSizeFloat);
+
+        // Every step size that has been used is kept in a table on the device.  Switching back to one
+        // (for example when a CompoundIntegrator alternates between integrators) just copies it on the
+        // device, instead of doing a blocking upload that would stall the queue.
+
+        auto entry = stepSizeTableIndex.find(size);
+        if (entry == stepSizeTableIndex.end()) {
+            if ((int) stepSizeTableIndex.size() == StepSizeTableSize) {
+                if (context.getUseDoublePrecision() || context.getUseMixedPrecision())
+                    stepSize.upload(&lastStepSize);
+                else {
+                    mm_float2 lastStepSizeFloat = mm_float2((float) size, (float) size);
+                    stepSize.upload(&lastStepSizeFloat);
+                }
+                return;
+            }
+            int index = stepSizeTableIndex.size();
+            if (context.getUseDoublePrecision() || context.getUseMixedPrecision())
+                stepSizeTable.uploadSubArray(&lastStepSize, index, 1);
+            else {
+                mm_float2 lastStepSizeFloat = mm_float2((float) size, (float) size);
+                stepSizeTable.uploadSubArray(&lastStepSizeFloat, index, 1);
+            }
+            entry = stepSizeTableIndex.insert(make_pair(size, index)).first;
         }
+        selectStepSizeKernel->setArg(1, entry->second);
+        selectStepSizeKernel->execute(1);
     }
 }
 
@@ -727,29 +972,94 @@ double IntegrationUtilities::getLastStepSize() {
     return lastStepSize.y;
 }
 
-void IntegrationUtilities::applyConstraints(double tol) {
-    applyConstraintsImpl(false, tol);
+void IntegrationUtilities::applyConstraints(double tol, bool includeSettle) {
+    OPENMM_TRACE_RANGE("Constraints");
+    applyConstraintsImpl(false, tol, includeSettle);
 }
 
 void IntegrationUtilities::applyVelocityConstraints(double tol) {
-    applyConstraintsImpl(true, tol);
+    OPENMM_TRACE_RANGE("Velocity constraints");
+    applyConstraintsImpl(true, tol, true);
+}
+
+void IntegrationUtilities::applyLincs(bool constrainVelocities) {
+    // Compute the constraint directions and the initial right hand side, then solve the matrix equation
+    // with a fixed number of terms of the series expansion and update the atoms.  For positions, a second
+    // pass corrects for the lengthening of constraints caused by rotation.
+
+    int numConstraints = ccmaConstraintAtoms.getSize();
+    lincsDirectionsKernel->setArg(0, (int) constrainVelocities);
+    lincsDirectionsKernel->execute(numConstraints);
+    lincsCouplingKernel->execute(numConstraints);
+    lincsUpdateKernel->setArg(4, constrainVelocities ? context.getVelm() : posDelta);
+    int numPasses = (constrainVelocities ? 1 : 2);
+    for (int pass = 0; pass < numPasses; pass++) {
+        if (pass > 0)
+            lincsRotationKernel->execute(numConstraints);
+        for (int i = 0; i < LINCS_EXPANSION_ORDER; i++) {
+            lincsMultiplyKernel->setArg(0, i%2 == 0 ? ccmaDelta1 : ccmaDelta2);
+            lincsMultiplyKernel->setArg(1, i%2 == 0 ? ccmaDelta2 : ccmaDelta1);
+            lincsMultiplyKernel->execute(numConstraints);
+        }
+        lincsUpdateKernel->execute(context.getNumAtoms());
+    }
 }
 
-void IntegrationUtilities::computeVirtualSites() {
-    if (numVsites > 0)
-        vsitePositionKernel->execute(numVsites);
+int IntegrationUtilities::getCCMAIterationBudget(bool constrainVelocities, double tol) {
+    // A tighter tolerance than before may need more iterations than recent steps did, so start
+    // over from the maximum.
+
+    int kind = (constrainVelocities ? 1 : 0);
+    if (tol < ccmaLastTolerance[kind])
+        ccmaIterationBudget[kind] = MaxCCMAIterations;
+    ccmaLastTolerance[kind] = tol;
+    return ccmaIterationBudget[kind];
+}
+
+void IntegrationUtilities::recordCCMAIterations(bool constrainVelocities, int iterations) {
+    // Leave a generous margin, since the extra iterations are very cheap once the kernels have
+    // detected convergence.  If it failed to converge, go back to the maximum.
+
+    int kind = (constrainVelocities ? 1 : 0);
+    if (iterations == 0)
+        ccmaIterationBudget[kind] = MaxCCMAIterations;
+    else
+        ccmaIterationBudget[kind] = min(MaxCCMAIterations, max(2*iterations, iterations+8));
+}
+
+void IntegrationUtilities::computeVirtualSites(bool includeSettleSites) {
+    OPENMM_TRACE_RANGE("Virtual sites");
+    int numToCompute = (includeSettleSites ? numVsites : numVsites-numSettleVsites);
+    if (numToCompute > 0) {
+        vsitePositionKernel->setArg(13, includeSettleSites ? 0 : 1);
+        vsitePositionKernel->execute(numToCompute);
+    }
 }
 
 void IntegrationUtilities::initRandomNumberGenerator(unsigned int randomNumberSeed) {
-    if (random.isInitialized()) {
+    if (randomCounter.isInitialized()) {
         if (randomNumberSeed != lastSeed)
            throw OpenMMException("IntegrationUtilities::initRandomNumberGenerator(): Requested two different values for the random number seed");
         return;
     }
 
-    // Create the random number arrays.
+    // Use a quick and dirty RNG to pick the key for the counter-based generator.  The arrays
+    // used by prepareRandomNumbers() are only created if something asks for them.
 
     lastSeed = randomNumberSeed;
+    unsigned int r = randomNumberSeed;
+    if (r == 0)
+        r = (unsigned int) osrngseed(); // A seed of 0 means use a unique one
+    randomKey.x = r = (1664525*r + 1013904223) & 0xFFFFFFFF;
+    randomKey.y = r = (1664525*r + 1013904223) & 0xFFFFFFFF;
+    randomCounter.initialize<long long>(context, 1, "randomCounter");
+    vector<long long> counter(1, 0);
+    randomCounter.upload(counter);
+}
+
+void IntegrationUtilities::initRandomArrays() {
+    if (random.isInitialized() || !randomCounter.isInitialized())
+        return;
     random.initialize<mm_float4>(context, 4*context.getPaddedNumAtoms(), "random");
     randomSeed.initialize<mm_int4>(context, context.getNumThreadBlocks()*64, "randomSeed");
     randomPos = random.getSize();
@@ -757,12 +1067,10 @@ void IntegrationUtilities::initRandomNumberGenerator(unsigned int randomNumberSe
     randomKernel->addArg(random);
     randomKernel->addArg(randomSeed);
 
-    // Use a quick and dirty RNG to pick seeds for the real random number generator.
+    // Pick seeds for the real random number generator, continuing the sequence used for the key.
 
     vector<mm_int4> seed(randomSeed.getSize());
-    unsigned int r = randomNumberSeed;
-    if (r == 0)
-        r = (unsigned int) osrngseed(); // A seed of 0 means use a unique one
+    unsigned int r = randomKey.y;
     for (int i = 0; i < randomSeed.getSize(); i++) {
         seed[i].x = r = (1664525*r + 1013904223) & 0xFFFFFFFF;
         seed[i].y = r = (1664525*r + 1013904223) & 0xFFFFFFFF;
@@ -773,6 +1081,7 @@ void IntegrationUtilities::initRandomNumberGenerator(unsigned int randomNumberSe
 }
 
 int IntegrationUtilities::prepareRandomNumbers(int numValues) {
+    initRandomArrays();
     if (randomPos+numValues <= random.getSize()) {
         int oldPos = randomPos;
         randomPos += numValues;
@@ -788,7 +1097,14 @@ int IntegrationUtilities::prepareRandomNumbers(int numValues) {
 }
 
 void IntegrationUtilities::createCheckpoint(ostream& stream) {
-    if (!random.isInitialized())
+    if (!randomCounter.isInitialized())
+        return;
+    vector<long long> counter;
+    randomCounter.download(counter);
+    stream.write((char*) &counter[0], sizeof(long long));
+    bool hasArrays = random.isInitialized();
+    stream.write((char*) &hasArrays, sizeof(bool));
+    if (!hasArrays)
         return;
     stream.write((char*) &randomPos, sizeof(int));
     vector<mm_float4> randomVec;
@@ -800,8 +1116,16 @@ void IntegrationUtilities::createCheckpoint(ostream& stream) {
 }
 
 void IntegrationUtilities::loadCheckpoint(istream& stream) {
-    if (!random.isInitialized())
+    if (!randomCounter.isInitialized())
+        return;
+    vector<long long> counter(1);
+    stream.read((char*) &counter[0], sizeof(long long));
+    randomCounter.upload(counter);
+    bool hasArrays;
+    stream.read((char*) &hasArrays, sizeof(bool));
+    if (!hasArrays)
         return;
+    initRandomArrays();
     stream.read((char*) &randomPos, sizeof(int));
     vector<mm_float4> randomVec(random.getSize());
     stream.read((char*) &randomVec[0], sizeof(mm_float4)*random.getSize());
@@ -827,7 +1151,7 @@ double IntegrationUtilities::computeKineticEnergy(double timeShift) {
         else
             timeShiftKernel->setArg(2, (float) timeShift);
         timeShiftKernel->execute(numParticles);
-        applyConstraintsImpl(true, 1e-4);
+        applyConstraintsImpl(true, 1e-4, true);
     }
     
     // Compute the kinetic energy.
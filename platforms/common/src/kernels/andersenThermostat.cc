@@ -1,20 +1,23 @@
 /**
- * Apply the Andersen thermostat to adjust particle velocities.
+ * Apply the Andersen thermostat to adjust particle velocities.  Random numbers are generated on the fly
+ * with philoxGaussian(): the value for an atom's group decides whether it collides, and the value for the
+ * atom itself supplies its new velocity.
  */
 
-KERNEL void applyAndersenThermostat(int numAtoms, float collisionFrequency, float kT, GLOBAL mixed4* velm, real stepSize, GLOBAL const float4* RESTRICT random,
-        unsigned int randomIndex, GLOBAL const int* RESTRICT atomGroups) {
+KERNEL void applyAndersenThermostat(int numAtoms, float collisionFrequency, float kT, GLOBAL mixed4* velm, real stepSize, int2 randomKey,
+        mm_long counter, GLOBAL const int* RESTRICT atomGroups) {
     float collisionProbability = (float) (1-EXP(-collisionFrequency*stepSize));
     float randomRange = (float) erf(collisionProbability/SQRT(2.0f));
     for (int index = GLOBAL_ID; index < numAtoms; index += GLOBAL_SIZE) {
-        mixed4 velocity = velm[index];
-        float4 selectRand = random[randomIndex+atomGroups[index]];
-        float4 velRand = random[randomIndex+index];
-        real scale = (selectRand.w > -randomRange && selectRand.w < randomRange ? 0 : 1);
-        real add = (1-scale)*SQRT(kT*velocity.w);
-        velocity.x = scale*velocity.x + add*velRand.x;
-        velocity.y = scale*velocity.y + add*velRand.y;
-        velocity.z = scale*velocity.z + add*velRand.z;
-        velm[index] = velocity;
+        float4 selectRand = philoxGaussian(randomKey, counter, atomGroups[index]);
+        if (selectRand.w > -randomRange && selectRand.w < randomRange) {
+            mixed4 velocity = velm[index];
+            float4 velRand = philoxGaussian(randomKey, counter, index);
+            real add = SQRT(kT*velocity.w);
+            velocity.x = add*velRand.x;
+            velocity.y = add*velRand.y;
+            velocity.z = add*velRand.z;
+            velm[index] = velocity;
+        }
     }
 }
@@ -1,19 +1,57 @@
+/**
+ * Compute the change in position of one atom.
+ */
+
+DEVICE mixed4 computeBrownianDelta(int index, int paddedNumAtoms, mixed fscale, mixed noiseAmplitude, mixed invMass, GLOBAL const mm_long* RESTRICT force,
+        GLOBAL const int* RESTRICT atomIndex, int2 randomKey, mm_long counter) {
+    float4 random = philoxGaussian(randomKey, counter, atomIndex[index]);
+    mixed noiseScale = noiseAmplitude*SQRT(invMass);
+    return make_mixed4(fscale*invMass*force[index] + noiseScale*random.x,
+                       fscale*invMass*force[index+paddedNumAtoms] + noiseScale*random.y,
+                       fscale*invMass*force[index+paddedNumAtoms*2] + noiseScale*random.z, 0);
+}
+
+/**
+ * Move one atom by a position delta, and set its velocity to match.
+ */
+
+DEVICE void applyBrownianDelta(int index, mixed4 delta, mixed oneOverDeltaT, GLOBAL real4* RESTRICT posq, GLOBAL mixed4* RESTRICT velm
+#ifdef USE_MIXED_PRECISION
+        , GLOBAL real4* RESTRICT posqCorrection
+#endif
+        ) {
+    velm[index].x = oneOverDeltaT*delta.x;
+    velm[index].y = oneOverDeltaT*delta.y;
+    velm[index].z = oneOverDeltaT*delta.z;
+#ifdef USE_MIXED_PRECISION
+    real4 pos1 = posq[index];
+    real4 pos2 = posqCorrection[index];
+    mixed4 pos = make_mixed4(pos1.x+(mixed)pos2.x, pos1.y+(mixed)pos2.y, pos1.z+(mixed)pos2.z, pos1.w);
+#else
+    real4 pos = posq[index];
+#endif
+    pos.x += delta.x;
+    pos.y += delta.y;
+    pos.z += delta.z;
+#ifdef USE_MIXED_PRECISION
+    posq[index] = make_real4((real) pos.x, (real) pos.y, (real) pos.z, (real) pos.w);
+    posqCorrection[index] = make_real4(pos.x-(real) pos.x, pos.y-(real) pos.y, pos.z-(real) pos.z, 0);
+#else
+    posq[index] = pos;
+#endif
+}
+
 /**
  * Perform the first step of Brownian integration.
  */
 
 KERNEL void integrateBrownianPart1(int numAtoms, int paddedNumAtoms, mixed tauDeltaT, mixed noiseAmplitude, GLOBAL const mm_long* RESTRICT force,
-        GLOBAL mixed4* RESTRICT posDelta, GLOBAL const mixed4* RESTRICT velm, GLOBAL const float4* RESTRICT random, unsigned int randomIndex) {
-    randomIndex += GLOBAL_ID;
+        GLOBAL mixed4* RESTRICT posDelta, GLOBAL const mixed4* RESTRICT velm, GLOBAL const int* RESTRICT atomIndex, int2 randomKey, mm_long counter) {
     const mixed fscale = tauDeltaT/(mixed) 0x100000000;
     for (int index = GLOBAL_ID; index < numAtoms; index += GLOBAL_SIZE) {
         mixed invMass = velm[index].w;
-        if (invMass != 0) {
-            posDelta[index].x = fscale*invMass*force[index] + noiseAmplitude*SQRT(invMass)*random[randomIndex].x;
-            posDelta[index].y = fscale*invMass*force[index+paddedNumAtoms] + noiseAmplitude*SQRT(invMass)*random[randomIndex].y;
-            posDelta[index].z = fscale*invMass*force[index+paddedNumAtoms*2] + noiseAmplitude*SQRT(invMass)*random[randomIndex].z;
-        }
-        randomIndex += GLOBAL_SIZE;
+        if (invMass != 0)
+            posDelta[index] = computeBrownianDelta(index, paddedNumAtoms, fscale, noiseAmplitude, invMass, force, atomIndex, randomKey, counter);
     }
 }
 
@@ -28,25 +66,36 @@ KERNEL void integrateBrownianPart2(int numAtoms, mixed oneOverDeltaT, GLOBAL rea
         ) {
     for (int index = GLOBAL_ID; index < numAtoms; index += GLOBAL_SIZE) {
         if (velm[index].w != 0) {
-            mixed4 delta = posDelta[index];
-            velm[index].x = oneOverDeltaT*delta.x;
-            velm[index].y = oneOverDeltaT*delta.y;
-            velm[index].z = oneOverDeltaT*delta.z;
 #ifdef USE_MIXED_PRECISION
-            real4 pos1 = posq[index];
-            real4 pos2 = posqCorrection[index];
-            mixed4 pos = make_mixed4(pos1.x+(mixed)pos2.x, pos1.y+(mixed)pos2.y, pos1.z+(mixed)pos2.z, pos1.w);
+            applyBrownianDelta(index, posDelta[index], oneOverDeltaT, posq, velm, posqCorrection);
 #else
-            real4 pos = posq[index];
+            applyBrownianDelta(index, posDelta[index], oneOverDeltaT, posq, velm);
+#endif
+        }
+    }
+}
+
+/**
+ * Perform a complete step of Brownian integration in a single pass.  This is used when there are no
+ * constraints, so positions can be updated directly without going through posDelta.
+ */
+
+KERNEL void integrateBrownianFused(int numAtoms, int paddedNumAtoms, mixed tauDeltaT, mixed noiseAmplitude, mixed oneOverDeltaT,
+        GLOBAL const mm_long* RESTRICT force, GLOBAL real4* RESTRICT posq, GLOBAL mixed4* RESTRICT velm, GLOBAL const int* RESTRICT atomIndex,
+        int2 randomKey, mm_long counter
+#ifdef USE_MIXED_PRECISION
+        , GLOBAL real4* RESTRICT posqCorrection
 #endif
-            pos.x += delta.x;
-            pos.y += delta.y;
-            pos.z += delta.z;
+        ) {
+    const mixed fscale = tauDeltaT/(mixed) 0x100000000;
+    for (int index = GLOBAL_ID; index < numAtoms; index += GLOBAL_SIZE) {
+        mixed invMass = velm[index].w;
+        if (invMass != 0) {
+            mixed4 delta = computeBrownianDelta(index, paddedNumAtoms, fscale, noiseAmplitude, invMass, force, atomIndex, randomKey, counter);
 #ifdef USE_MIXED_PRECISION
-            posq[index] = make_real4((real) pos.x, (real) pos.y, (real) pos.z, (real) pos.w);
-            posqCorrection[index] = make_real4(pos.x-(real) pos.x, pos.y-(real) pos.y, pos.z-(real) pos.z, 0);
+            applyBrownianDelta(index, delta, oneOverDeltaT, posq, velm, posqCorrection);
 #else
-            posq[index] = pos;
+            applyBrownianDelta(index, delta, oneOverDeltaT, posq, velm);
 #endif
         }
     }
@@ -58,7 +58,7 @@ angleB = fmod(angleB+2.0f*PI, 2.0f*PI);
 
 // Identify which patch this is in.
 
-int2 pos = MAP_POS[MAPS[index]];
+int2 pos = MAP_POS[index];
 int size = pos.y;
 real delta = 2*PI/size;
 int s = (int) fmin(angleA/delta, (real) (size-1));
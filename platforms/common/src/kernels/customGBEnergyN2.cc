@@ -22,6 +22,9 @@ KERNEL void computeN2Energy(
         GLOBAL const int* RESTRICT tiles, GLOBAL const unsigned int* RESTRICT interactionCount, real4 periodicBoxSize, real4 invPeriodicBoxSize,
         real4 periodicBoxVecX, real4 periodicBoxVecY, real4 periodicBoxVecZ, unsigned int maxTiles, GLOBAL const real4* RESTRICT blockCenter,
         GLOBAL const real4* RESTRICT blockSize, GLOBAL const int* RESTRICT interactingAtoms
+#ifdef USE_PAIR_LIST
+        , unsigned int maxSinglePairs, GLOBAL const int2* RESTRICT singlePairs
+#endif
 #else
         unsigned int numTiles
 #endif
@@ -258,7 +261,7 @@ KERNEL void computeN2Energy(
             LOAD_ATOM1_PARAMETERS
             const unsigned int localAtomIndex = LOCAL_ID;
 #ifdef USE_CUTOFF
-            unsigned int j = interactingAtoms[pos*TILE_SIZE+tgx];
+            unsigned int j = interactingAtoms[(mm_long) pos*TILE_SIZE+tgx];
 #else
             unsigned int j = y*TILE_SIZE + tgx;
 #endif
@@ -391,6 +394,64 @@ KERNEL void computeN2Energy(
         }
         pos++;
     }
+
+    // Third loop: single pairs that aren't part of a tile.
+
+#ifdef USE_PAIR_LIST
+    const unsigned int numPairs = interactionCount[1];
+    if (numPairs > maxSinglePairs)
+        return; // There wasn't enough memory for the neighbor list.
+    for (int i = GLOBAL_ID; i < numPairs; i += GLOBAL_SIZE) {
+        int2 pair = singlePairs[i];
+        unsigned int atom1 = pair.x;
+        real3 pos1 = trimTo3(posq[atom1]);
+        real3 pos2 = trimTo3(posq[pair.y]);
+        real3 delta = make_real3(pos2.x-pos1.x, pos2.y-pos1.y, pos2.z-pos1.z);
+#ifdef USE_PERIODIC
+        APPLY_PERIODIC_TO_DELTA(delta)
+#endif
+        real r2 = delta.x*delta.x + delta.y*delta.y + delta.z*delta.z;
+        if (r2 < CUTOFF_SQUARED) {
+            real invR = RSQRT(r2);
+            real r = r2*invR;
+            real3 force = make_real3(0);
+            DECLARE_ATOM1_DERIVATIVES
+            LOAD_ATOM1_PARAMETERS
+            const unsigned int localAtomIndex = LOCAL_ID;
+            unsigned int j = pair.y;
+            LOAD_LOCAL_PARAMETERS_FROM_GLOBAL
+            CLEAR_LOCAL_DERIVATIVES
+            int atom2 = LOCAL_ID;
+            LOAD_ATOM2_PARAMETERS
+            atom2 = pair.y;
+            real dEdR = 0;
+            real tempEnergy = 0;
+            const real interactionScale = 1;
+            const bool isExcluded = false;
+            COMPUTE_INTERACTION
+            dEdR /= -r;
+            if (needEnergy)
+                energy += tempEnergy;
+            delta *= dEdR;
+            force.x -= delta.x;
+            force.y -= delta.y;
+            force.z -= delta.z;
+            atom2 = LOCAL_ID;
+            RECORD_DERIVATIVE_2
+            atom2 = pair.y;
+            ATOMIC_ADD(&forceBuffers[atom1], (mm_ulong) ((mm_long) (force.x*0x100000000)));
+            ATOMIC_ADD(&forceBuffers[atom1+PADDED_NUM_ATOMS], (mm_ulong) ((mm_long) (force.y*0x100000000)));
+            ATOMIC_ADD(&forceBuffers[atom1+2*PADDED_NUM_ATOMS], (mm_ulong) ((mm_long) (force.z*0x100000000)));
+            ATOMIC_ADD(&forceBuffers[atom2], (mm_ulong) ((mm_long) (delta.x*0x100000000)));
+            ATOMIC_ADD(&forceBuffers[atom2+PADDED_NUM_ATOMS], (mm_ulong) ((mm_long) (delta.y*0x100000000)));
+            ATOMIC_ADD(&forceBuffers[atom2+2*PADDED_NUM_ATOMS], (mm_ulong) ((mm_long) (delta.z*0x100000000)));
+            unsigned int offset = atom1;
+            STORE_DERIVATIVES_1
+            offset = atom2;
+            STORE_DERIVATIVES_2
+        }
+    }
+#endif
     energyBuffer[GLOBAL_ID] += energy;
     SAVE_PARAM_DERIVS
 }
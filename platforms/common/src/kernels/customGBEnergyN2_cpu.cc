@@ -261,7 +261,7 @@ KERNEL void computeN2Energy(
 
             for (int localAtomIndex = 0; localAtomIndex < TILE_SIZE; localAtomIndex++) {
 #ifdef USE_CUTOFF
-                unsigned int j = interactingAtoms[pos*TILE_SIZE+localAtomIndex];
+                unsigned int j = interactingAtoms[(mm_long) pos*TILE_SIZE+localAtomIndex];
 #else
                 unsigned int j = y*TILE_SIZE+localAtomIndex;
 #endif
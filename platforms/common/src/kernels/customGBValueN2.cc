@@ -12,6 +12,9 @@ KERNEL void computeN2Value(GLOBAL const real4* RESTRICT posq, GLOBAL const unsig
         GLOBAL const int* RESTRICT tiles, GLOBAL const unsigned int* RESTRICT interactionCount, real4 periodicBoxSize, real4 invPeriodicBoxSize,
         real4 periodicBoxVecX, real4 periodicBoxVecY, real4 periodicBoxVecZ, unsigned int maxTiles, GLOBAL const real4* RESTRICT blockCenter,
         GLOBAL const real4* RESTRICT blockSize, GLOBAL const int* RESTRICT interactingAtoms
+#ifdef USE_PAIR_LIST
+        , unsigned int maxSinglePairs, GLOBAL const int2* RESTRICT singlePairs
+#endif
 #else
         unsigned int numTiles
 #endif
@@ -227,7 +230,7 @@ KERNEL void computeN2Value(GLOBAL const real4* RESTRICT posq, GLOBAL const unsig
             LOAD_ATOM1_PARAMETERS
             const unsigned int localAtomIndex = LOCAL_ID;
 #ifdef USE_CUTOFF
-            unsigned int j = interactingAtoms[pos*TILE_SIZE+tgx];
+            unsigned int j = interactingAtoms[(mm_long) pos*TILE_SIZE+tgx];
 #else
             unsigned int j = y*TILE_SIZE + tgx;
 #endif
@@ -339,4 +342,46 @@ KERNEL void computeN2Value(GLOBAL const real4* RESTRICT posq, GLOBAL const unsig
         }
         pos++;
     }
+
+    // Third loop: single pairs that aren't part of a tile.
+
+#ifdef USE_PAIR_LIST
+    const unsigned int numPairs = interactionCount[1];
+    if (numPairs > maxSinglePairs)
+        return; // There wasn't enough memory for the neighbor list.
+    for (int i = GLOBAL_ID; i < numPairs; i += GLOBAL_SIZE) {
+        int2 pair = singlePairs[i];
+        unsigned int atom1 = pair.x;
+        real3 pos1 = trimTo3(posq[atom1]);
+        real3 pos2 = trimTo3(posq[pair.y]);
+        real3 delta = make_real3(pos2.x-pos1.x, pos2.y-pos1.y, pos2.z-pos1.z);
+#ifdef USE_PERIODIC
+        APPLY_PERIODIC_TO_DELTA(delta)
+#endif
+        real r2 = delta.x*delta.x + delta.y*delta.y + delta.z*delta.z;
+        if (r2 < CUTOFF_SQUARED) {
+            real invR = RSQRT(r2);
+            real r = r2*invR;
+            LOAD_ATOM1_PARAMETERS
+            const unsigned int localAtomIndex = LOCAL_ID;
+            unsigned int j = pair.y;
+            LOAD_LOCAL_PARAMETERS_FROM_GLOBAL
+            unsigned int tj = tgx;
+            int atom2 = LOCAL_ID;
+            LOAD_ATOM2_PARAMETERS
+            atom2 = pair.y;
+            real tempValue1 = 0;
+            real tempValue2 = 0;
+            COMPUTE_VALUE
+            ADD_TEMP_DERIVS1
+            ADD_TEMP_DERIVS2
+            unsigned int offset1 = atom1;
+            unsigned int offset2 = atom2;
+            ATOMIC_ADD(&global_value[offset1], (mm_ulong) ((mm_long) (tempValue1*0x100000000)));
+            ATOMIC_ADD(&global_value[offset2], (mm_ulong) ((mm_long) (tempValue2*0x100000000)));
+            STORE_PARAM_DERIVS1
+            STORE_PARAM_DERIVS2
+        }
+    }
+#endif
 }
@@ -40,6 +40,54 @@ inline DEVICE real4 computeCross(real4 vec1, real4 vec2) {
     return make_real4(cp.x, cp.y, cp.z, cp.x*cp.x+cp.y*cp.y+cp.z*cp.z);
 }
 
+/**
+ * Compute the bounding box of each block of donors or acceptors, based on the position of the first
+ * atom of each one.  This is used to skip blocks that cannot be within the cutoff of each other.
+ */
+KERNEL void findBlockBounds(int numItems, GLOBAL const int4* RESTRICT atoms, GLOBAL const real4* RESTRICT posq,
+        GLOBAL real4* RESTRICT blockCenter, GLOBAL real4* RESTRICT blockBoundingBox, real4 periodicBoxSize,
+        real4 invPeriodicBoxSize, real4 periodicBoxVecX, real4 periodicBoxVecY, real4 periodicBoxVecZ) {
+    int index = GLOBAL_ID;
+    int base = index*THREAD_BLOCK_SIZE;
+    while (base < numItems) {
+        real4 pos = posq[atoms[base].x];
+#ifdef USE_PERIODIC
+        APPLY_PERIODIC_TO_POS(pos)
+#endif
+        real4 minPos = pos;
+        real4 maxPos = pos;
+        int last = min(base+THREAD_BLOCK_SIZE, numItems);
+        for (int i = base+1; i < last; i++) {
+            pos = posq[atoms[i].x];
+#ifdef USE_PERIODIC
+            real4 center = 0.5f*(maxPos+minPos);
+            APPLY_PERIODIC_TO_POS_WITH_CENTER(pos, center)
+#endif
+            minPos = make_real4(min(minPos.x,pos.x), min(minPos.y,pos.y), min(minPos.z,pos.z), 0);
+            maxPos = make_real4(max(maxPos.x,pos.x), max(maxPos.y,pos.y), max(maxPos.z,pos.z), 0);
+        }
+        blockBoundingBox[index] = 0.5f*(maxPos-minPos);
+        blockCenter[index] = 0.5f*(maxPos+minPos);
+        index += GLOBAL_SIZE;
+        base = index*THREAD_BLOCK_SIZE;
+    }
+}
+
+/**
+ * Determine whether any point in one bounding box might be within the cutoff distance of any point in another one.
+ */
+inline DEVICE bool blocksMayInteract(real4 center1, real4 size1, real4 center2, real4 size2, real4 periodicBoxSize, real4 invPeriodicBoxSize,
+        real4 periodicBoxVecX, real4 periodicBoxVecY, real4 periodicBoxVecZ) {
+    real4 blockDelta = center1-center2;
+#ifdef USE_PERIODIC
+    APPLY_PERIODIC_TO_DELTA(blockDelta)
+#endif
+    blockDelta.x = max((real) 0, fabs(blockDelta.x)-size1.x-size2.x);
+    blockDelta.y = max((real) 0, fabs(blockDelta.y)-size1.y-size2.y);
+    blockDelta.z = max((real) 0, fabs(blockDelta.z)-size1.z-size2.z);
+    return (blockDelta.x*blockDelta.x + blockDelta.y*blockDelta.y + blockDelta.z*blockDelta.z < CUTOFF_SQUARED);
+}
+
 /**
  * Compute forces on donors.
  */
@@ -52,6 +100,10 @@ KERNEL void computeDonorForces(
 	GLOBAL mixed* RESTRICT energyBuffer, GLOBAL const real4* RESTRICT posq, GLOBAL const int4* RESTRICT exclusions,
         GLOBAL const int4* RESTRICT donorAtoms, GLOBAL const int4* RESTRICT acceptorAtoms, real4 periodicBoxSize, real4 invPeriodicBoxSize,
         real4 periodicBoxVecX, real4 periodicBoxVecY, real4 periodicBoxVecZ
+#ifdef USE_CUTOFF
+        , GLOBAL const real4* RESTRICT donorBlockCenter, GLOBAL const real4* RESTRICT donorBlockBoundingBox,
+        GLOBAL const real4* RESTRICT acceptorBlockCenter, GLOBAL const real4* RESTRICT acceptorBlockBoundingBox
+#endif
         PARAMETER_ARGUMENTS) {
     LOCAL real4 posBuffer[3*THREAD_BLOCK_SIZE];
     mixed energy = 0;
@@ -75,7 +127,25 @@ KERNEL void computeDonorForces(
         }
         else
             atoms = make_int4(-1, -1, -1, -1);
+#ifdef USE_CUTOFF
+        int block1 = donorStart/THREAD_BLOCK_SIZE+GROUP_ID;
+        real4 blockCenter1, blockSize1;
+        if (block1 < NUM_DONOR_BLOCKS) {
+            blockCenter1 = donorBlockCenter[block1];
+            blockSize1 = donorBlockBoundingBox[block1];
+        }
+#endif
         for (int acceptorStart = 0; acceptorStart < NUM_ACCEPTORS; acceptorStart += LOCAL_SIZE) {
+#ifdef USE_CUTOFF
+            // Skip this block of acceptors if none of them can be within the cutoff of any donor in this
+            // thread block.  The condition is the same for every thread in the block.
+
+            int block2 = acceptorStart/THREAD_BLOCK_SIZE;
+            if (block1 >= NUM_DONOR_BLOCKS || !blocksMayInteract(blockCenter1, blockSize1, acceptorBlockCenter[block2], acceptorBlockBoundingBox[block2],
+                    periodicBoxSize, invPeriodicBoxSize, periodicBoxVecX, periodicBoxVecY, periodicBoxVecZ))
+                continue;
+#endif
+
             // Load the next block of acceptors into local memory.
 
             SYNC_THREADS;
@@ -170,6 +240,10 @@ KERNEL void computeAcceptorForces(
         GLOBAL mixed* RESTRICT energyBuffer, GLOBAL const real4* RESTRICT posq, GLOBAL const int4* RESTRICT exclusions,
         GLOBAL const int4* RESTRICT donorAtoms, GLOBAL const int4* RESTRICT acceptorAtoms, real4 periodicBoxSize, real4 invPeriodicBoxSize,
         real4 periodicBoxVecX, real4 periodicBoxVecY, real4 periodicBoxVecZ
+#ifdef USE_CUTOFF
+        , GLOBAL const real4* RESTRICT donorBlockCenter, GLOBAL const real4* RESTRICT donorBlockBoundingBox,
+        GLOBAL const real4* RESTRICT acceptorBlockCenter, GLOBAL const real4* RESTRICT acceptorBlockBoundingBox
+#endif
         PARAMETER_ARGUMENTS) {
     LOCAL real4 posBuffer[3*THREAD_BLOCK_SIZE];
     real3 f1 = make_real3(0);
@@ -192,7 +266,25 @@ KERNEL void computeAcceptorForces(
         }
         else
             atoms = make_int4(-1, -1, -1, -1);
+#ifdef USE_CUTOFF
+        int block1 = acceptorStart/THREAD_BLOCK_SIZE+GROUP_ID;
+        real4 blockCenter1, blockSize1;
+        if (block1 < NUM_ACCEPTOR_BLOCKS) {
+            blockCenter1 = acceptorBlockCenter[block1];
+            blockSize1 = acceptorBlockBoundingBox[block1];
+        }
+#endif
         for (int donorStart = 0; donorStart < NUM_DONORS; donorStart += LOCAL_SIZE) {
+#ifdef USE_CUTOFF
+            // Skip this block of donors if none of them can be within the cutoff of any acceptor in this
+            // thread block.  The condition is the same for every thread in the block.
+
+            int block2 = donorStart/THREAD_BLOCK_SIZE;
+            if (block1 >= NUM_ACCEPTOR_BLOCKS || !blocksMayInteract(blockCenter1, blockSize1, donorBlockCenter[block2], donorBlockBoundingBox[block2],
+                    periodicBoxSize, invPeriodicBoxSize, periodicBoxVecX, periodicBoxVecY, periodicBoxVecZ))
+                continue;
+#endif
+
             // Load the next block of donors into local memory.
 
             SYNC_THREADS;
@@ -1,4 +1,4 @@
-KERNEL void computeFloatSum(GLOBAL const float* RESTRICT sumBuffer, GLOBAL float* result, int bufferSize) {
+KERNEL void computeFloatSum(GLOBAL const float* RESTRICT sumBuffer, GLOBAL float* result, int bufferSize, int resultIndex) {
     LOCAL float tempBuffer[WORK_GROUP_SIZE];
     const unsigned int thread = LOCAL_ID;
     float sum = 0;
@@ -11,11 +11,11 @@ KERNEL void computeFloatSum(GLOBAL const float* RESTRICT sumBuffer, GLOBAL float
             tempBuffer[thread] += tempBuffer[thread+i];
     }
     if (thread == 0)
-        *result = tempBuffer[0];
+        result[resultIndex] = tempBuffer[0];
 }
 
 #ifdef SUPPORTS_DOUBLE_PRECISION
-KERNEL void computeDoubleSum(GLOBAL const double* RESTRICT sumBuffer, GLOBAL double* result, int bufferSize) {
+KERNEL void computeDoubleSum(GLOBAL const double* RESTRICT sumBuffer, GLOBAL double* result, int bufferSize, int resultIndex) {
     LOCAL double tempBuffer[WORK_GROUP_SIZE];
     const unsigned int thread = LOCAL_ID;
     double sum = 0;
@@ -28,7 +28,7 @@ KERNEL void computeDoubleSum(GLOBAL const double* RESTRICT sumBuffer, GLOBAL dou
             tempBuffer[thread] += tempBuffer[thread+i];
     }
     if (thread == 0)
-        *result = tempBuffer[0];
+        result[resultIndex] = tempBuffer[0];
 }
 #endif
 
@@ -0,0 +1,9 @@
+/**
+ * Evaluate a global computation step of a CustomIntegrator.  This is executed by a single thread, so
+ * the values can be updated without copying them back to the host.
+ */
+KERNEL void computeGlobal(GLOBAL mixed* RESTRICT globals, mixed uniform, mixed gaussian, mixed energy) {
+    if (GLOBAL_ID == 0) {
+        COMPUTE_STEP
+    }
+}
@@ -110,16 +110,18 @@ KERNEL void computeInteraction(
         for (int index = LOCAL_ID; index < numCombinations; index += LOCAL_SIZE) {
             FIND_ATOMS_FOR_COMBINATION_INDEX;
             bool includeInteraction = IS_VALID_COMBINATION;
+#ifdef USE_FILTERS
+            // Check the type filter first, since it is cheaper than checking the cutoff.
+
+            int order = (includeInteraction ? orderIndex[COMPUTE_TYPE_INDEX] : -1);
+            if (order == -1)
+                includeInteraction = false;
+#endif
 #ifdef USE_CUTOFF
             if (includeInteraction) {
                 VERIFY_CUTOFF;
             }
 #endif
-#ifdef USE_FILTERS
-            int order = orderIndex[COMPUTE_TYPE_INDEX];
-            if (order == -1)
-                includeInteraction = false;
-#endif
 #ifdef USE_EXCLUSIONS
             if (includeInteraction) {
                 VERIFY_EXCLUSIONS;
@@ -177,6 +179,9 @@ KERNEL void findNeighbors(real4 periodicBoxSize, real4 invPeriodicBoxSize, real4
         GLOBAL int* RESTRICT numNeighborPairs, GLOBAL int* RESTRICT numNeighborsForAtom, int maxNeighborPairs
 #ifdef USE_EXCLUSIONS
         , GLOBAL const int* RESTRICT exclusions, GLOBAL const int* RESTRICT exclusionStartIndex
+#endif
+#ifdef USE_FILTERS
+        , GLOBAL const int* RESTRICT particleTypes, GLOBAL const int* RESTRICT typePairAllowed
 #endif
         ) {
     LOCAL real3 positionCache[FIND_NEIGHBORS_WORKGROUP_SIZE];
@@ -190,6 +195,9 @@ KERNEL void findNeighbors(real4 periodicBoxSize, real4 invPeriodicBoxSize, real4
         
         real3 pos1 = trimTo3(posq[atom1]);
         int block1 = atom1/TILE_SIZE;
+#ifdef USE_FILTERS
+        int typeOffset1 = (atom1 < NUM_ATOMS ? NUM_TYPES*particleTypes[atom1] : 0);
+#endif
         real4 blockCenter1 = blockCenter[block1];
         real4 blockSize1 = blockBoundingBox[block1];
         int totalNeighborsForAtom1 = 0;
@@ -255,6 +263,12 @@ KERNEL void findNeighbors(real4 periodicBoxSize, real4 invPeriodicBoxSize, real4
 #else
                             bool includeAtom = (atom2 > atom1 && atom2 < NUM_ATOMS && atomDelta.w < CUTOFF_SQUARED);
 #endif
+#ifdef USE_FILTERS
+                            // Skip atoms whose types can never appear in a set together with this one.
+
+                            if (includeAtom)
+                                includeAtom &= (typePairAllowed[typeOffset1+particleTypes[atom2]] != 0);
+#endif
 #ifdef USE_EXCLUSIONS
                             if (includeAtom)
                                 includeAtom &= !isInteractionExcluded(atom1, atom2, exclusions, exclusionStartIndex);
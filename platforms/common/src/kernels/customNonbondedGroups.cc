@@ -185,7 +185,9 @@ KERNEL void buildNeighborList(GLOBAL int* RESTRICT rebuildNeighborList, GLOBAL i
     const unsigned int tgx = LOCAL_ID & (TILE_SIZE-1); // index within the warp
     const unsigned int tbx = LOCAL_ID - tgx;           // block warpIndex
     LOCAL real4 localPos[LOCAL_MEMORY_SIZE];
+    LOCAL real4 localPos1[LOCAL_MEMORY_SIZE];
     LOCAL volatile bool anyInteraction[WARPS_IN_BLOCK];
+    LOCAL volatile bool skipTile[WARPS_IN_BLOCK];
     LOCAL volatile int tileIndex[WARPS_IN_BLOCK];
     LOCAL int reductionBuffer[LOCAL_MEMORY_SIZE];
 
@@ -200,11 +202,47 @@ KERNEL void buildNeighborList(GLOBAL int* RESTRICT rebuildNeighborList, GLOBAL i
         const int exclusions = atomData.w;
         real4 posq1 = posq[atom1];
         localPos[LOCAL_ID] = posq[atom2];
+        localPos1[LOCAL_ID] = posq1;
         if (tgx == 0)
             anyInteraction[local_warp] = false;
         int tj = tgx;
         int rangeStop = rangeStart + reduceMax(rangeEnd-rangeStart, reductionBuffer);
         SYNC_WARPS;
+
+        // Compare the bounding boxes of the two sets of atoms in the tile.  If they are farther apart
+        // than the cutoff, we can skip checking individual pairs.
+
+        if (tgx == 0) {
+            real4 pos1 = localPos1[tbx];
+            real4 pos2 = localPos[tbx];
+            real3 min1 = make_real3(pos1.x, pos1.y, pos1.z), max1 = min1;
+            real3 min2 = make_real3(pos2.x, pos2.y, pos2.z), max2 = min2;
+            for (int k = 1; k < TILE_SIZE; k++) {
+                pos1 = localPos1[tbx+k];
+                pos2 = localPos[tbx+k];
+                min1 = make_real3(min(min1.x, pos1.x), min(min1.y, pos1.y), min(min1.z, pos1.z));
+                max1 = make_real3(max(max1.x, pos1.x), max(max1.y, pos1.y), max(max1.z, pos1.z));
+                min2 = make_real3(min(min2.x, pos2.x), min(min2.y, pos2.y), min(min2.z, pos2.z));
+                max2 = make_real3(max(max2.x, pos2.x), max(max2.y, pos2.y), max(max2.z, pos2.z));
+            }
+            real3 size = make_real3(0.5f*(max1.x-min1.x+max2.x-min2.x), 0.5f*(max1.y-min1.y+max2.y-min2.y), 0.5f*(max1.z-min1.z+max2.z-min2.z));
+            real3 delta = make_real3(0.5f*(min2.x+max2.x-min1.x-max1.x), 0.5f*(min2.y+max2.y-min1.y-max1.y), 0.5f*(min2.z+max2.z-min1.z-max1.z));
+#ifdef USE_PERIODIC
+            // Only trust the minimum image of the box centers if the boxes are small compared to the periodic box.
+
+            bool canSkip = (size.x < 0.5f*periodicBoxSize.x && size.y < 0.5f*periodicBoxSize.y && size.z < 0.5f*periodicBoxSize.z);
+            APPLY_PERIODIC_TO_DELTA(delta)
+#else
+            bool canSkip = true;
+#endif
+            delta.x = max((real) 0, fabs(delta.x)-size.x);
+            delta.y = max((real) 0, fabs(delta.y)-size.y);
+            delta.z = max((real) 0, fabs(delta.z)-size.z);
+            skipTile[local_warp] = (canSkip && delta.x*delta.x + delta.y*delta.y + delta.z*delta.z >= PADDED_CUTOFF_SQUARED);
+        }
+        SYNC_WARPS;
+        if (skipTile[local_warp])
+            continue;
         for (int j = rangeStart; j < rangeStop && !anyInteraction[local_warp]; j++) {
             SYNC_WARPS;
             if (j < rangeEnd && tj < rangeEnd) {
@@ -60,16 +60,20 @@ KERNEL void computeEllipsoidFrames(int numParticles, GLOBAL const real4* RESTRIC
 }
 
 /**
- * Find a bounding box for the atoms in each block.
+ * Find a bounding box for the atoms in each block, and check whether any atom has moved far enough
+ * since the neighbor list was built that it needs to be rebuilt.
  */
 KERNEL void findBlockBounds(int numAtoms, real4 periodicBoxSize, real4 invPeriodicBoxSize, real4 periodicBoxVecX, real4 periodicBoxVecY, real4 periodicBoxVecZ,
         GLOBAL const int* sortedAtoms, GLOBAL const real4* RESTRICT posq, GLOBAL real4* RESTRICT sortedPos, GLOBAL real4* RESTRICT blockCenter,
-        GLOBAL real4* RESTRICT blockBoundingBox, GLOBAL int* RESTRICT neighborBlockCount) {
+        GLOBAL real4* RESTRICT blockBoundingBox, GLOBAL const real4* RESTRICT oldPositions, GLOBAL int* RESTRICT rebuildNeighborList) {
     int index = GLOBAL_ID;
     int base = index*TILE_SIZE;
+    bool rebuild = false;
     while (base < numAtoms) {
         real4 pos = posq[sortedAtoms[base]];
         sortedPos[base] = pos;
+        real4 moved = pos-oldPositions[base];
+        rebuild |= (moved.x*moved.x + moved.y*moved.y + moved.z*moved.z > MAX_DISPLACEMENT_SQUARED);
 #ifdef USE_PERIODIC
         APPLY_PERIODIC_TO_POS(pos)
 #endif
@@ -79,6 +83,8 @@ KERNEL void findBlockBounds(int numAtoms, real4 periodicBoxSize, real4 invPeriod
         for (int i = base+1; i < last; i++) {
             pos = posq[sortedAtoms[i]];
             sortedPos[i] = pos;
+            moved = pos-oldPositions[i];
+            rebuild |= (moved.x*moved.x + moved.y*moved.y + moved.z*moved.z > MAX_DISPLACEMENT_SQUARED);
 #ifdef USE_PERIODIC
             real4 center = 0.5f*(maxPos+minPos);
             APPLY_PERIODIC_TO_POS_WITH_CENTER(pos, center)
@@ -92,7 +98,15 @@ KERNEL void findBlockBounds(int numAtoms, real4 periodicBoxSize, real4 invPeriod
         index += GLOBAL_SIZE;
         base = index*TILE_SIZE;
     }
-    if (GLOBAL_ID == 0)
+    if (rebuild)
+        *rebuildNeighborList = 1;
+}
+
+/**
+ * Clear the neighbor list if it is about to be rebuilt.
+ */
+KERNEL void prepareNeighborList(GLOBAL const int* RESTRICT rebuildNeighborList, GLOBAL int* RESTRICT neighborBlockCount) {
+    if (GLOBAL_ID == 0 && *rebuildNeighborList)
         *neighborBlockCount = 0;
 }
 
@@ -113,17 +127,22 @@ DEVICE void storeNeighbors(int atom1, int* neighborBuffer, int numAtomsInBuffer,
 }
 
 /**
- * Build a list of neighbors for each atom.
+ * Build a list of neighbors for each atom.  The list includes all pairs within the padded cutoff, so it
+ * only needs to be rebuilt once some atom has moved more than half the padding.
  */
 KERNEL void findNeighbors(int numAtoms, int maxNeighborBlocks, real4 periodicBoxSize, real4 invPeriodicBoxSize, real4 periodicBoxVecX, real4 periodicBoxVecY, real4 periodicBoxVecZ,
         GLOBAL real4* RESTRICT sortedPos, GLOBAL real4* RESTRICT blockCenter, GLOBAL real4* RESTRICT blockBoundingBox, GLOBAL int* RESTRICT neighbors,
-        GLOBAL int* RESTRICT neighborIndex, GLOBAL int* RESTRICT neighborBlockCount, GLOBAL const int* RESTRICT exclusions, GLOBAL const int* RESTRICT exclusionStartIndex) {
+        GLOBAL int* RESTRICT neighborIndex, GLOBAL int* RESTRICT neighborBlockCount, GLOBAL const int* RESTRICT exclusions, GLOBAL const int* RESTRICT exclusionStartIndex,
+        GLOBAL real4* RESTRICT oldPositions, GLOBAL const int* RESTRICT rebuildNeighborList) {
+    if (*rebuildNeighborList == 0)
+        return;
     const int numBlocks = (numAtoms+TILE_SIZE-1)/TILE_SIZE;
     int neighborBuffer[NEIGHBOR_BLOCK_SIZE];
     for (int atom1 = GLOBAL_ID; atom1 < numAtoms; atom1 += GLOBAL_SIZE) {
         int nextExclusion = exclusionStartIndex[atom1];
         int lastExclusion = exclusionStartIndex[atom1+1];
         real4 pos = sortedPos[atom1];
+        oldPositions[atom1] = pos;
         int nextBufferIndex = 0;
         
         // Loop over atom blocks and compute the distance of this atom from each one's bounding box.
@@ -138,7 +157,7 @@ KERNEL void findNeighbors(int numAtoms, int maxNeighborBlocks, real4 periodicBox
             blockDelta.x = max((real) 0, fabs(blockDelta.x)-blockSize.x);
             blockDelta.y = max((real) 0, fabs(blockDelta.y)-blockSize.y);
             blockDelta.z = max((real) 0, fabs(blockDelta.z)-blockSize.z);
-            if (blockDelta.x*blockDelta.x+blockDelta.y*blockDelta.y+blockDelta.z*blockDelta.z >= CUTOFF_SQUARED)
+            if (blockDelta.x*blockDelta.x+blockDelta.y*blockDelta.y+blockDelta.z*blockDelta.z >= PADDED_CUTOFF_SQUARED)
                 continue;
             
             // Loop over atoms within this block.
@@ -157,7 +176,7 @@ KERNEL void findNeighbors(int numAtoms, int maxNeighborBlocks, real4 periodicBox
                 APPLY_PERIODIC_TO_DELTA(delta)
 #endif
                 real r2 = delta.x*delta.x + delta.y*delta.y + delta.z*delta.z;
-                if (r2 < CUTOFF_SQUARED) {
+                if (r2 < PADDED_CUTOFF_SQUARED) {
                     neighborBuffer[nextBufferIndex++] = atom2;
                     if (nextBufferIndex == NEIGHBOR_BLOCK_SIZE) {
                         storeNeighbors(atom1, neighborBuffer, nextBufferIndex, maxNeighborBlocks, neighbors, neighborIndex, neighborBlockCount);
@@ -344,7 +363,7 @@ KERNEL void computeForce(
         GLOBAL const int4* RESTRICT exceptionParticles, GLOBAL const float2* RESTRICT exceptionParams
 #ifdef USE_CUTOFF
         , int maxNeighborBlocks, GLOBAL int* RESTRICT neighbors, GLOBAL int* RESTRICT neighborIndex, GLOBAL int* RESTRICT neighborBlockCount,
-        real4 periodicBoxSize, real4 invPeriodicBoxSize, real4 periodicBoxVecX, real4 periodicBoxVecY, real4 periodicBoxVecZ
+        GLOBAL int* RESTRICT rebuildNeighborList, real4 periodicBoxSize, real4 invPeriodicBoxSize, real4 periodicBoxVecX, real4 periodicBoxVecY, real4 periodicBoxVecZ
 #endif
         ) {
     const unsigned int warp = GLOBAL_ID/TILE_SIZE;
@@ -353,6 +372,8 @@ KERNEL void computeForce(
     const int numBlocks = *neighborBlockCount;
     if (numBlocks > maxNeighborBlocks)
         return; // There wasn't enough memory for the neighbor list.
+    if (GLOBAL_ID == 0)
+        *rebuildNeighborList = 0;
     for (int block = GLOBAL_ID; block < numBlocks; block += GLOBAL_SIZE) {
         // Load parameters for atom1.
         
@@ -368,6 +389,17 @@ KERNEL void computeForce(
             int atom2 = neighbors[NEIGHBOR_BLOCK_SIZE*block+indexInBlock];
             if (atom2 == -1)
                 continue;
+
+            // The list is built with a padded cutoff, so check the distance before loading the
+            // rest of the data for atom2.
+
+            real3 delta = data1.pos-trimTo3(pos[atom2]);
+#ifdef USE_PERIODIC
+            APPLY_PERIODIC_TO_DELTA(delta)
+#endif
+            real r2 = delta.x*delta.x + delta.y*delta.y + delta.z*delta.z;
+            if (r2 >= CUTOFF_SQUARED)
+                continue;
             int index2 = sortedAtoms[atom2];
             AtomData data2;
             loadAtomData(&data2, atom2, index2, pos, sigParams, epsParams, aMatrix, bMatrix, gMatrix);
@@ -376,11 +408,6 @@ KERNEL void computeForce(
             
             // Compute the interaction.
             
-            real3 delta = data1.pos-data2.pos;
-#ifdef USE_PERIODIC
-            APPLY_PERIODIC_TO_DELTA(delta)
-#endif
-            real r2 = delta.x*delta.x + delta.y*delta.y + delta.z*delta.z;
             real sigma = data1.sig.x+data2.sig.x;
             real epsilon = data1.eps.x*data2.eps.x;
             computeOneInteraction(&data1, &data2, sigma, epsilon, delta, r2, &force1, &force2, &torque1, &torque2, &energy);
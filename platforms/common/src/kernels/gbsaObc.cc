@@ -231,7 +231,7 @@ KERNEL void computeBornSum(
             real charge1 = charge[atom1];
             float2 params1 = global_params[atom1];
 #ifdef USE_CUTOFF
-            unsigned int j = interactingAtoms[pos*TILE_SIZE+tgx];
+            unsigned int j = interactingAtoms[(mm_long) pos*TILE_SIZE+tgx];
 #else
             unsigned int j = y*TILE_SIZE + tgx;
 #endif
@@ -626,7 +626,7 @@ KERNEL void computeGBSAForce1(
             real charge1 = charge[atom1];
             real bornRadius1 = global_bornRadii[atom1];
 #ifdef USE_CUTOFF
-            unsigned int j = interactingAtoms[pos*TILE_SIZE+tgx];
+            unsigned int j = interactingAtoms[(mm_long) pos*TILE_SIZE+tgx];
 #else
             unsigned int j = y*TILE_SIZE + tgx;
 #endif
@@ -68,31 +68,6 @@ KERNEL void generateRandomNumbers(int numValues, GLOBAL float4* RESTRICT random,
     seed[GLOBAL_ID] = state;
 }
 
-/**
- * Load the position of a particle.
- */
-inline DEVICE mixed4 loadPos(GLOBAL const real4* RESTRICT posq, GLOBAL const real4* RESTRICT posqCorrection, int index) {
-#ifdef USE_MIXED_PRECISION
-    real4 pos1 = posq[index];
-    real4 pos2 = posqCorrection[index];
-    return make_mixed4(pos1.x+(mixed)pos2.x, pos1.y+(mixed)pos2.y, pos1.z+(mixed)pos2.z, pos1.w);
-#else
-    return posq[index];
-#endif
-}
-
-/**
- * Store the position of a particle.
- */
-inline DEVICE void storePos(GLOBAL real4* RESTRICT posq, GLOBAL real4* RESTRICT posqCorrection, int index, mixed4 pos) {
-#ifdef USE_MIXED_PRECISION
-    posq[index] = make_real4((real) pos.x, (real) pos.y, (real) pos.z, (real) pos.w);
-    posqCorrection[index] = make_real4(pos.x-(real) pos.x, pos.y-(real) pos.y, pos.z-(real) pos.z, 0);
-#else
-    posq[index] = pos;
-#endif
-}
-
 /**
  * Enforce constraints on SHAKE clusters
  */
@@ -353,126 +328,7 @@ KERNEL void applySettleToPositions(int numClusters, mixed tol, GLOBAL const real
 
         // Apply the SETTLE algorithm.
 
-        mixed xb0 = apos1.x-apos0.x;
-        mixed yb0 = apos1.y-apos0.y;
-        mixed zb0 = apos1.z-apos0.z;
-        mixed xc0 = apos2.x-apos0.x;
-        mixed yc0 = apos2.y-apos0.y;
-        mixed zc0 = apos2.z-apos0.z;
-
-        mixed invTotalMass = 1/(m0+m1+m2);
-        mixed xcom = (xp0.x*m0 + (xb0+xp1.x)*m1 + (xc0+xp2.x)*m2) * invTotalMass;
-        mixed ycom = (xp0.y*m0 + (yb0+xp1.y)*m1 + (yc0+xp2.y)*m2) * invTotalMass;
-        mixed zcom = (xp0.z*m0 + (zb0+xp1.z)*m1 + (zc0+xp2.z)*m2) * invTotalMass;
-
-        mixed xa1 = xp0.x - xcom;
-        mixed ya1 = xp0.y - ycom;
-        mixed za1 = xp0.z - zcom;
-        mixed xb1 = xb0 + xp1.x - xcom;
-        mixed yb1 = yb0 + xp1.y - ycom;
-        mixed zb1 = zb0 + xp1.z - zcom;
-        mixed xc1 = xc0 + xp2.x - xcom;
-        mixed yc1 = yc0 + xp2.y - ycom;
-        mixed zc1 = zc0 + xp2.z - zcom;
-
-        mixed xaksZd = yb0*zc0 - zb0*yc0;
-        mixed yaksZd = zb0*xc0 - xb0*zc0;
-        mixed zaksZd = xb0*yc0 - yb0*xc0;
-        mixed xaksXd = ya1*zaksZd - za1*yaksZd;
-        mixed yaksXd = za1*xaksZd - xa1*zaksZd;
-        mixed zaksXd = xa1*yaksZd - ya1*xaksZd;
-        mixed xaksYd = yaksZd*zaksXd - zaksZd*yaksXd;
-        mixed yaksYd = zaksZd*xaksXd - xaksZd*zaksXd;
-        mixed zaksYd = xaksZd*yaksXd - yaksZd*xaksXd;
-
-        mixed axlng = sqrt(xaksXd*xaksXd + yaksXd*yaksXd + zaksXd*zaksXd);
-        mixed aylng = sqrt(xaksYd*xaksYd + yaksYd*yaksYd + zaksYd*zaksYd);
-        mixed azlng = sqrt(xaksZd*xaksZd + yaksZd*yaksZd + zaksZd*zaksZd);
-        mixed trns11 = xaksXd / axlng;
-        mixed trns21 = yaksXd / axlng;
-        mixed trns31 = zaksXd / axlng;
-        mixed trns12 = xaksYd / aylng;
-        mixed trns22 = yaksYd / aylng;
-        mixed trns32 = zaksYd / aylng;
-        mixed trns13 = xaksZd / azlng;
-        mixed trns23 = yaksZd / azlng;
-        mixed trns33 = zaksZd / azlng;
-
-        mixed xb0d = trns11*xb0 + trns21*yb0 + trns31*zb0;
-        mixed yb0d = trns12*xb0 + trns22*yb0 + trns32*zb0;
-        mixed xc0d = trns11*xc0 + trns21*yc0 + trns31*zc0;
-        mixed yc0d = trns12*xc0 + trns22*yc0 + trns32*zc0;
-        mixed za1d = trns13*xa1 + trns23*ya1 + trns33*za1;
-        mixed xb1d = trns11*xb1 + trns21*yb1 + trns31*zb1;
-        mixed yb1d = trns12*xb1 + trns22*yb1 + trns32*zb1;
-        mixed zb1d = trns13*xb1 + trns23*yb1 + trns33*zb1;
-        mixed xc1d = trns11*xc1 + trns21*yc1 + trns31*zc1;
-        mixed yc1d = trns12*xc1 + trns22*yc1 + trns32*zc1;
-        mixed zc1d = trns13*xc1 + trns23*yc1 + trns33*zc1;
-
-        //                                        --- Step2  A2' ---
-
-        float rc = 0.5f*params.y;
-        mixed rb = sqrt(params.x*params.x-rc*rc);
-        mixed ra = rb*(m1+m2)*invTotalMass;
-        rb -= ra;
-        mixed sinphi = za1d/ra;
-        mixed cosphi = sqrt(1-sinphi*sinphi);
-        mixed sinpsi = (zb1d-zc1d) / (2*rc*cosphi);
-        mixed cospsi = sqrt(1-sinpsi*sinpsi);
-
-        mixed ya2d =   ra*cosphi;
-        mixed xb2d = - rc*cospsi;
-        mixed yb2d = - rb*cosphi - rc*sinpsi*sinphi;
-        mixed yc2d = - rb*cosphi + rc*sinpsi*sinphi;
-        mixed xb2d2 = xb2d*xb2d;
-        mixed hh2 = 4.0f*xb2d2 + (yb2d-yc2d)*(yb2d-yc2d) + (zb1d-zc1d)*(zb1d-zc1d);
-        mixed deltx = 2.0f*xb2d + sqrt(4.0f*xb2d2 - hh2 + params.y*params.y);
-        xb2d -= deltx*0.5f;
-
-        //                                        --- Step3  al,be,ga ---
-
-        mixed alpha = (xb2d*(xb0d-xc0d) + yb0d*yb2d + yc0d*yc2d);
-        mixed beta = (xb2d*(yc0d-yb0d) + xb0d*yb2d + xc0d*yc2d);
-        mixed gamma = xb0d*yb1d - xb1d*yb0d + xc0d*yc1d - xc1d*yc0d;
-
-        mixed al2be2 = alpha*alpha + beta*beta;
-        mixed sintheta = (alpha*gamma - beta*sqrt(al2be2 - gamma*gamma)) / al2be2;
-
-        //                                        --- Step4  A3' ---
-
-        mixed costheta = sqrt(1-sintheta*sintheta);
-        mixed xa3d = - ya2d*sintheta;
-        mixed ya3d =   ya2d*costheta;
-        mixed za3d = za1d;
-        mixed xb3d =   xb2d*costheta - yb2d*sintheta;
-        mixed yb3d =   xb2d*sintheta + yb2d*costheta;
-        mixed zb3d = zb1d;
-        mixed xc3d = - xb2d*costheta - yc2d*sintheta;
-        mixed yc3d = - xb2d*sintheta + yc2d*costheta;
-        mixed zc3d = zc1d;
-
-        //                                        --- Step5  A3 ---
-
-        mixed xa3 = trns11*xa3d + trns12*ya3d + trns13*za3d;
-        mixed ya3 = trns21*xa3d + trns22*ya3d + trns23*za3d;
-        mixed za3 = trns31*xa3d + trns32*ya3d + trns33*za3d;
-        mixed xb3 = trns11*xb3d + trns12*yb3d + trns13*zb3d;
-        mixed yb3 = trns21*xb3d + trns22*yb3d + trns23*zb3d;
-        mixed zb3 = trns31*xb3d + trns32*yb3d + trns33*zb3d;
-        mixed xc3 = trns11*xc3d + trns12*yc3d + trns13*zc3d;
-        mixed yc3 = trns21*xc3d + trns22*yc3d + trns23*zc3d;
-        mixed zc3 = trns31*xc3d + trns32*yc3d + trns33*zc3d;
-
-        xp0.x = xcom + xa3;
-        xp0.y = ycom + ya3;
-        xp0.z = zcom + za3;
-        xp1.x = xcom + xb3 - xb0;
-        xp1.y = ycom + yb3 - yb0;
-        xp1.z = zcom + zb3 - zb0;
-        xp2.x = xcom + xc3 - xc0;
-        xp2.y = ycom + yc3 - yc0;
-        xp2.z = zcom + zc3 - zc0;
+        applySettleToCluster(apos0, apos1, apos2, &xp0, &xp1, &xp2, m0, m1, m2, params);
 
         // Record the new positions.
 
@@ -636,7 +492,8 @@ KERNEL void computeCCMAPositionConstraintForceKernel(GLOBAL const int2* RESTRICT
     if (converged[1-iteration%2]) {
         if (GLOBAL_ID == 0) {
             converged[iteration%2] = 1;
-            hostConvergedFlag[0] = 1;
+            if (hostConvergedFlag[0] == 0)
+                hostConvergedFlag[0] = iteration;
         }
         return; // The constraint iteration has already converged.
     }
@@ -679,7 +536,8 @@ KERNEL void computeCCMAVelocityConstraintForceKernel(GLOBAL const int2* RESTRICT
     if (converged[1-iteration%2]) {
         if (GROUP_ID == 0 && LOCAL_ID == 0) {
             converged[iteration%2] = 1;
-            hostConvergedFlag[0] = 1;
+            if (hostConvergedFlag[0] == 0)
+                hostConvergedFlag[0] = iteration;
         }
         return; // The constraint iteration has already converged.
     }
@@ -800,7 +658,147 @@ KERNEL void runCCMA(int constrainVelocities, GLOBAL const int* RESTRICT atoms, G
 }
 
 /**
- * Compute the positions of virtual sites
+ * Compute the unit vector along each LINCS constraint, and the right hand side of the matrix
+ * equation for either the positions or the velocities.
+ */
+KERNEL void computeLincsDirections(int constrainVelocities, GLOBAL const int2* RESTRICT constraintAtoms, GLOBAL mixed4* RESTRICT constraintDistance,
+        GLOBAL const real4* RESTRICT atomPositions, GLOBAL const mixed4* RESTRICT posDelta, GLOBAL const mixed4* RESTRICT velm,
+        GLOBAL const mixed* RESTRICT sMatrix, GLOBAL mixed* RESTRICT rhs, GLOBAL mixed* RESTRICT solution
+#ifdef USE_MIXED_PRECISION
+        , GLOBAL const real4* RESTRICT posqCorrection
+#endif
+        ) {
+#ifndef USE_MIXED_PRECISION
+        GLOBAL real4* posqCorrection = 0;
+#endif
+    for (int index = GLOBAL_ID; index < NUM_CCMA_CONSTRAINTS; index += GLOBAL_SIZE) {
+        int2 atoms = constraintAtoms[index];
+        mixed4 dir = constraintDistance[index];
+        mixed4 oldPos1 = loadPos(atomPositions, posqCorrection, atoms.x);
+        mixed4 oldPos2 = loadPos(atomPositions, posqCorrection, atoms.y);
+        dir.x = oldPos1.x-oldPos2.x;
+        dir.y = oldPos1.y-oldPos2.y;
+        dir.z = oldPos1.z-oldPos2.z;
+        mixed length = SQRT(dir.x*dir.x + dir.y*dir.y + dir.z*dir.z);
+        mixed invLength = RECIP(length);
+        dir.x *= invLength;
+        dir.y *= invLength;
+        dir.z *= invLength;
+        constraintDistance[index] = dir;
+        mixed value;
+        if (constrainVelocities) {
+            mixed4 v1 = velm[atoms.x];
+            mixed4 v2 = velm[atoms.y];
+            value = dir.x*(v1.x-v2.x) + dir.y*(v1.y-v2.y) + dir.z*(v1.z-v2.z);
+        }
+        else {
+            mixed4 delta1 = posDelta[atoms.x];
+            mixed4 delta2 = posDelta[atoms.y];
+            value = length + dir.x*(delta1.x-delta2.x) + dir.y*(delta1.y-delta2.y) + dir.z*(delta1.z-delta2.z) - dir.w;
+        }
+        value *= sMatrix[index];
+        rhs[index] = value;
+        solution[index] = value;
+    }
+}
+
+/**
+ * Compute the coupling coefficients between linked LINCS constraints.
+ */
+KERNEL void computeLincsCoupling(GLOBAL const mixed4* RESTRICT constraintDistance, GLOBAL const int* RESTRICT constraintMatrixColumn,
+        GLOBAL const mixed* RESTRICT constraintMatrixValue, GLOBAL mixed* RESTRICT coupling) {
+    for (int index = GLOBAL_ID; index < NUM_CCMA_CONSTRAINTS; index += GLOBAL_SIZE) {
+        mixed4 dir1 = constraintDistance[index];
+        for (int i = 0; ; i++) {
+            int element = index+i*NUM_CCMA_CONSTRAINTS;
+            int column = constraintMatrixColumn[element];
+            if (column >= NUM_CCMA_CONSTRAINTS)
+                break;
+            mixed4 dir2 = constraintDistance[column];
+            coupling[element] = constraintMatrixValue[element]*(dir1.x*dir2.x + dir1.y*dir2.y + dir1.z*dir2.z);
+        }
+    }
+}
+
+/**
+ * Compute one term of the series expansion of the inverse LINCS matrix, and add it to the solution.
+ */
+KERNEL void multiplyByLincsMatrix(GLOBAL const mixed* RESTRICT rhs1, GLOBAL mixed* RESTRICT rhs2, GLOBAL mixed* RESTRICT solution,
+        GLOBAL const int* RESTRICT constraintMatrixColumn, GLOBAL const mixed* RESTRICT coupling) {
+    for (int index = GLOBAL_ID; index < NUM_CCMA_CONSTRAINTS; index += GLOBAL_SIZE) {
+        mixed sum = 0;
+        for (int i = 0; ; i++) {
+            int element = index+i*NUM_CCMA_CONSTRAINTS;
+            int column = constraintMatrixColumn[element];
+            if (column >= NUM_CCMA_CONSTRAINTS)
+                break;
+            sum += coupling[element]*rhs1[column];
+        }
+        rhs2[index] = sum;
+        solution[index] += sum;
+    }
+}
+
+/**
+ * Update the atom positions or velocities based on the solution to the LINCS matrix equation.
+ */
+KERNEL void updateLincsAtomPositions(GLOBAL const int* RESTRICT atoms, GLOBAL const int* RESTRICT numAtomConstraints, GLOBAL const int* RESTRICT atomConstraints,
+        GLOBAL const mixed4* RESTRICT constraintDistance, GLOBAL mixed4* RESTRICT atomPositions, GLOBAL const mixed4* RESTRICT velm,
+        GLOBAL const mixed* RESTRICT sMatrix, GLOBAL const mixed* RESTRICT solution) {
+    for (int i = GLOBAL_ID; i < NUM_CCMA_ATOMS; i += GLOBAL_SIZE) {
+        int index = atoms[i];
+        mixed4 atomPos = atomPositions[index];
+        mixed invMass = velm[index].w;
+        int num = numAtomConstraints[index];
+        for (int j = 0; j < num; j++) {
+            int constraint = atomConstraints[index+j*NUM_ATOMS];
+            bool forward = (constraint > 0);
+            constraint = (forward ? constraint-1 : -constraint-1);
+            mixed scale = invMass*sMatrix[constraint]*solution[constraint];
+            scale = (forward ? -scale : scale);
+            mixed4 dir = constraintDistance[constraint];
+            atomPos.x += scale*dir.x;
+            atomPos.y += scale*dir.y;
+            atomPos.z += scale*dir.z;
+        }
+        atomPositions[index] = atomPos;
+    }
+}
+
+/**
+ * Compute the right hand side of the LINCS matrix equation for correcting the lengthening of
+ * constraints caused by rotation.
+ */
+KERNEL void computeLincsRotationCorrection(GLOBAL const int2* RESTRICT constraintAtoms, GLOBAL const mixed4* RESTRICT constraintDistance,
+        GLOBAL const real4* RESTRICT atomPositions, GLOBAL const mixed4* RESTRICT posDelta, GLOBAL const mixed* RESTRICT sMatrix,
+        GLOBAL mixed* RESTRICT rhs, GLOBAL mixed* RESTRICT solution
+#ifdef USE_MIXED_PRECISION
+        , GLOBAL const real4* RESTRICT posqCorrection
+#endif
+        ) {
+#ifndef USE_MIXED_PRECISION
+        GLOBAL real4* posqCorrection = 0;
+#endif
+    for (int index = GLOBAL_ID; index < NUM_CCMA_CONSTRAINTS; index += GLOBAL_SIZE) {
+        int2 atoms = constraintAtoms[index];
+        mixed4 oldPos1 = loadPos(atomPositions, posqCorrection, atoms.x);
+        mixed4 oldPos2 = loadPos(atomPositions, posqCorrection, atoms.y);
+        mixed4 delta1 = posDelta[atoms.x];
+        mixed4 delta2 = posDelta[atoms.y];
+        mixed dx = oldPos1.x-oldPos2.x+delta1.x-delta2.x;
+        mixed dy = oldPos1.y-oldPos2.y+delta1.y-delta2.y;
+        mixed dz = oldPos1.z-oldPos2.z+delta1.z-delta2.z;
+        mixed distance = constraintDistance[index].w;
+        mixed p2 = 2*distance*distance - (dx*dx + dy*dy + dz*dz);
+        mixed value = sMatrix[index]*(distance-SQRT(max(p2, (mixed) 0)));
+        rhs[index] = value;
+        solution[index] = value;
+    }
+}
+
+/**
+ * Compute the positions of virtual sites.  Sites whose parents all belong to one SETTLE cluster come
+ * at the end of each list, and are skipped if skipSettleSites is nonzero.
  */
 KERNEL void computeVirtualSites(GLOBAL real4* RESTRICT posq, GLOBAL real4* RESTRICT posqCorrection,
         GLOBAL const int4* RESTRICT avg2Atoms, GLOBAL const real2* RESTRICT avg2Weights,
@@ -808,11 +806,14 @@ KERNEL void computeVirtualSites(GLOBAL real4* RESTRICT posq, GLOBAL real4* RESTR
         GLOBAL const int4* RESTRICT outOfPlaneAtoms, GLOBAL const real4* RESTRICT outOfPlaneWeights,
         GLOBAL const int* RESTRICT localCoordsIndex, GLOBAL const int* RESTRICT localCoordsAtoms,
         GLOBAL const real* RESTRICT localCoordsWeights, GLOBAL const real4* RESTRICT localCoordsPos,
-        GLOBAL const int* RESTRICT localCoordsStartIndex) {
+        GLOBAL const int* RESTRICT localCoordsStartIndex, int skipSettleSites) {
+    const int num2Avg = (skipSettleSites ? NUM_2_AVERAGE-NUM_SETTLE_2_AVERAGE : NUM_2_AVERAGE);
+    const int num3Avg = (skipSettleSites ? NUM_3_AVERAGE-NUM_SETTLE_3_AVERAGE : NUM_3_AVERAGE);
+    const int numOutOfPlane = (skipSettleSites ? NUM_OUT_OF_PLANE-NUM_SETTLE_OUT_OF_PLANE : NUM_OUT_OF_PLANE);
     
     // Two particle average sites.
     
-    for (int index = GLOBAL_ID; index < NUM_2_AVERAGE; index += GLOBAL_SIZE) {
+    for (int index = GLOBAL_ID; index < num2Avg; index += GLOBAL_SIZE) {
         int4 atoms = avg2Atoms[index];
         real2 weights = avg2Weights[index];
         mixed4 pos = loadPos(posq, posqCorrection, atoms.x);
@@ -826,7 +827,7 @@ KERNEL void computeVirtualSites(GLOBAL real4* RESTRICT posq, GLOBAL real4* RESTR
     
     // Three particle average sites.
     
-    for (int index = GLOBAL_ID; index < NUM_3_AVERAGE; index += GLOBAL_SIZE) {
+    for (int index = GLOBAL_ID; index < num3Avg; index += GLOBAL_SIZE) {
         int4 atoms = avg3Atoms[index];
         real4 weights = avg3Weights[index];
         mixed4 pos = loadPos(posq, posqCorrection, atoms.x);
@@ -841,7 +842,7 @@ KERNEL void computeVirtualSites(GLOBAL real4* RESTRICT posq, GLOBAL real4* RESTR
     
     // Out of plane sites.
     
-    for (int index = GLOBAL_ID; index < NUM_OUT_OF_PLANE; index += GLOBAL_SIZE) {
+    for (int index = GLOBAL_ID; index < numOutOfPlane; index += GLOBAL_SIZE) {
         int4 atoms = outOfPlaneAtoms[index];
         real4 weights = outOfPlaneWeights[index];
         mixed4 pos = loadPos(posq, posqCorrection, atoms.x);
@@ -893,7 +894,12 @@ inline DEVICE real3 loadForce(int index, GLOBAL const mm_long* RESTRICT force) {
     return make_real3(scale*force[index], scale*force[index+PADDED_NUM_ATOMS], scale*force[index+PADDED_NUM_ATOMS*2]);
 }
 
-inline DEVICE void addForce(int index, GLOBAL mm_long* RESTRICT force, real3 value) {
+/**
+ * Add a force to a particle.  If no two virtual sites share a parent, only one thread ever touches a
+ * particle, so the result can also be written to floatForce (if it is present) as soon as it is known.
+ * That avoids needing a separate pass over all atoms to copy the forces back.
+ */
+inline DEVICE void addForce(int index, GLOBAL mm_long* RESTRICT force, GLOBAL real4* RESTRICT floatForce, real3 value) {
     GLOBAL mm_ulong* f = (GLOBAL mm_ulong*) force;
 #ifdef HAS_OVERLAPPING_VSITES
     ATOMIC_ADD(&f[index], (mm_ulong) ((mm_long) (value.x*0x100000000)));
@@ -903,11 +909,16 @@ inline DEVICE void addForce(int index, GLOBAL mm_long* RESTRICT force, real3 val
     f[index] += (mm_ulong) ((mm_long) (value.x*0x100000000));
     f[index+PADDED_NUM_ATOMS] += (mm_ulong) ((mm_long) (value.y*0x100000000));
     f[index+PADDED_NUM_ATOMS*2] += (mm_ulong) ((mm_long) (value.z*0x100000000));
+    if (floatForce != 0) {
+        real3 total = loadForce(index, force);
+        floatForce[index] = make_real4(total.x, total.y, total.z, 0);
+    }
 #endif
 }
 
 /**
- * Distribute forces from virtual sites to the atoms they are based on.
+ * Distribute forces from virtual sites to the atoms they are based on.  floatForce is an optional
+ * floating point copy of the forces to keep up to date (see addForce()).
  */
 KERNEL void distributeVirtualSiteForces(GLOBAL const real4* RESTRICT posq, GLOBAL const real4* RESTRICT posqCorrection, GLOBAL mm_long* RESTRICT force,
         GLOBAL const int4* RESTRICT avg2Atoms, GLOBAL const real2* RESTRICT avg2Weights,
@@ -915,7 +926,7 @@ KERNEL void distributeVirtualSiteForces(GLOBAL const real4* RESTRICT posq, GLOBA
         GLOBAL const int4* RESTRICT outOfPlaneAtoms, GLOBAL const real4* RESTRICT outOfPlaneWeights,
         GLOBAL const int* RESTRICT localCoordsIndex, GLOBAL const int* RESTRICT localCoordsAtoms,
         GLOBAL const real* RESTRICT localCoordsWeights, GLOBAL const real4* RESTRICT localCoordsPos,
-        GLOBAL const int* RESTRICT localCoordsStartIndex) {
+        GLOBAL const int* RESTRICT localCoordsStartIndex, GLOBAL real4* RESTRICT floatForce) {
     
     // Two particle average sites.
     
@@ -923,8 +934,8 @@ KERNEL void distributeVirtualSiteForces(GLOBAL const real4* RESTRICT posq, GLOBA
         int4 atoms = avg2Atoms[index];
         real2 weights = avg2Weights[index];
         real3 f = loadForce(atoms.x, force);
-        addForce(atoms.y, force, f*weights.x);
-        addForce(atoms.z, force, f*weights.y);
+        addForce(atoms.y, force, floatForce, f*weights.x);
+        addForce(atoms.z, force, floatForce, f*weights.y);
     }
     
     // Three particle average sites.
@@ -933,9 +944,9 @@ KERNEL void distributeVirtualSiteForces(GLOBAL const real4* RESTRICT posq, GLOBA
         int4 atoms = avg3Atoms[index];
         real4 weights = avg3Weights[index];
         real3 f = loadForce(atoms.x, force);
-        addForce(atoms.y, force, f*weights.x);
-        addForce(atoms.z, force, f*weights.y);
-        addForce(atoms.w, force, f*weights.z);
+        addForce(atoms.y, force, floatForce, f*weights.x);
+        addForce(atoms.z, force, floatForce, f*weights.y);
+        addForce(atoms.w, force, floatForce, f*weights.z);
     }
     
     // Out of plane sites.
@@ -955,9 +966,9 @@ KERNEL void distributeVirtualSiteForces(GLOBAL const real4* RESTRICT posq, GLOBA
         real3 fp3 = make_real3((real) (weights.y*f.x + weights.z*v12.z*f.y - weights.z*v12.y*f.z),
                    (real) (-weights.z*v12.z*f.x + weights.y*f.y + weights.z*v12.x*f.z),
                    (real) (weights.z*v12.y*f.x - weights.z*v12.x*f.y + weights.y*f.z));
-        addForce(atoms.y, force, f-fp2-fp3);
-        addForce(atoms.z, force, fp2);
-        addForce(atoms.w, force, fp3);
+        addForce(atoms.y, force, floatForce, f-fp2-fp3);
+        addForce(atoms.z, force, floatForce, fp2);
+        addForce(atoms.w, force, floatForce, fp3);
     }
     
     // Local coordinates sites.
@@ -1011,7 +1022,7 @@ KERNEL void distributeVirtualSiteForces(GLOBAL const real4* RESTRICT posq, GLOBA
             fresult.x += fp3.x*wxScaled*( -dx.z*dx.x) + fp3.z*(dz.z*sx+t2) + fp3.y*((-dx.x*dy.z-dz.y)*wxScaled + dy.z*sx + dx.x*t3);
             fresult.y += fp3.x*wxScaled*( -dx.z*dx.y) + fp3.z*(dz.z*sy-t1) + fp3.y*((-dx.y*dy.z+dz.x)*wxScaled + dy.z*sy + dx.y*t3);
             fresult.z += fp3.x*wxScaled*(1-dx.z*dx.z) + fp3.z*(dz.z*sz   ) + fp3.y*((-dx.z*dy.z     )*wxScaled + dy.z*sz - dx.x*t1 - dx.y*t2) + f.z*originWeight;
-            addForce(localCoordsAtoms[j], force, fresult);
+            addForce(localCoordsAtoms[j], force, floatForce, fresult);
         }
     }
 }
@@ -1041,3 +1052,11 @@ KERNEL void timeShiftVelocities(GLOBAL mixed4* RESTRICT velm, GLOBAL const mm_lo
         }
     }
 }
+
+/**
+ * Set the step size to one of the values stored in a table on the device.
+ */
+KERNEL void selectStepSize(GLOBAL const mixed2* RESTRICT stepSizeTable, int index, GLOBAL mixed2* RESTRICT stepSize) {
+    if (GLOBAL_ID == 0)
+        stepSize[0] = stepSizeTable[index];
+}
@@ -10,6 +10,8 @@ KERNEL void integrateLangevinPart1(int numAtoms, int paddedNumAtoms, GLOBAL mixe
     mixed fscale = paramBuffer[ForceScale]/(mixed) 0x100000000;
     mixed noisescale = paramBuffer[NoiseScale];
     mixed stepSize = dt[0].y;
+    if (stepSize == 0.0f)
+        return; // A variable step size integrator has already reached its target time.
     int index = GLOBAL_ID;
     randomIndex += index;
     while (index < numAtoms) {
@@ -36,6 +38,8 @@ KERNEL void integrateLangevinPart2(int numAtoms, GLOBAL real4* RESTRICT posq, GL
         , GLOBAL real4* RESTRICT posqCorrection
 #endif
         ) {
+    if (dt[0].y == 0.0f)
+        return;
 #ifdef SUPPORTS_DOUBLE_PRECISION
     double invStepSize = 1.0/dt[0].y;
 #else
@@ -79,11 +83,12 @@ KERNEL void integrateLangevinPart2(int numAtoms, GLOBAL real4* RESTRICT posq, GL
 }
 
 /**
- * Select the step size to use for the next step.
+ * Select the step size to use for the next step.  stepState keeps track of the steps taken since the
+ * host last checked, in the same way as for selectVerletStepSize().
  */
 
-KERNEL void selectLangevinStepSize(int numAtoms, int paddedNumAtoms, mixed maxStepSize, mixed errorTol, mixed friction, mixed kT, GLOBAL mixed2* RESTRICT dt,
-        GLOBAL const mixed4* RESTRICT velm, GLOBAL const mm_long* RESTRICT force, GLOBAL mixed* RESTRICT paramBuffer) {
+KERNEL void selectLangevinStepSize(int numAtoms, int paddedNumAtoms, mixed maxStepSize, mixed remainingTime, mixed errorTol, mixed friction, mixed kT, GLOBAL mixed2* RESTRICT dt,
+        GLOBAL const mixed4* RESTRICT velm, GLOBAL const mm_long* RESTRICT force, GLOBAL mixed* RESTRICT paramBuffer, GLOBAL mixed4* RESTRICT stepState) {
     // Calculate the error.
 
     LOCAL mixed error[256];
@@ -108,16 +113,30 @@ KERNEL void selectLangevinStepSize(int numAtoms, int paddedNumAtoms, mixed maxSt
     if (GLOBAL_ID == 0) {
         // Select the new step size.
 
+        mixed4 state = stepState[0];
         mixed totalError = SQRT(error[0]/(numAtoms*3));
         mixed newStepSize = SQRT(errorTol/totalError);
-        mixed oldStepSize = dt[0].y;
+        mixed oldStepSize = (dt[0].y > 0.0f ? dt[0].y : state.w);
         if (oldStepSize > 0.0f)
             newStepSize = min(newStepSize, oldStepSize*2.0f); // For safety, limit how quickly dt can increase.
         if (newStepSize > oldStepSize && newStepSize < 1.1f*oldStepSize)
             newStepSize = oldStepSize; // Keeping dt constant between steps improves the behavior of the integrator.
         if (newStepSize > maxStepSize)
             newStepSize = maxStepSize;
+        mixed timeLeft = remainingTime-state.x;
+        if (state.z != 0.0f || timeLeft <= 0.0f)
+            newStepSize = 0.0f;
+        else if (newStepSize >= timeLeft) {
+            newStepSize = timeLeft;
+            state.z = 1.0f;
+        }
+        if (newStepSize > 0.0f) {
+            state.x += newStepSize;
+            state.y += 1.0f;
+            state.w = newStepSize;
+        }
         dt[0].y = newStepSize;
+        stepState[0] = state;
 
         // Recalculate the integration parameters.
 
@@ -18,73 +18,142 @@ KERNEL void integrateLangevinMiddlePart1(int numAtoms, int paddedNumAtoms, GLOBA
     }
 }
 
+/**
+ * Update the velocity of one atom and compute the change in its position for the second part
+ * of integration.
+ */
+DEVICE mixed4 integrateLangevinMiddleAtom(int index, GLOBAL mixed4* RESTRICT velm, mixed vscale, mixed noisescale, mixed halfdt,
+        GLOBAL const int* RESTRICT atomIndex, int2 randomKey, mm_long counter) {
+    mixed4 velocity = velm[index];
+    if (velocity.w == 0.0)
+        return make_mixed4(0, 0, 0, 0);
+    mixed4 delta = make_mixed4(halfdt*velocity.x, halfdt*velocity.y, halfdt*velocity.z, 0);
+    mixed sqrtInvMass = SQRT(velocity.w);
+    float4 random = philoxGaussian(randomKey, counter, atomIndex[index]);
+    velocity.x = vscale*velocity.x + noisescale*sqrtInvMass*random.x;
+    velocity.y = vscale*velocity.y + noisescale*sqrtInvMass*random.y;
+    velocity.z = vscale*velocity.z + noisescale*sqrtInvMass*random.z;
+    velm[index] = velocity;
+    delta += make_mixed4(halfdt*velocity.x, halfdt*velocity.y, halfdt*velocity.z, 0);
+    return delta;
+}
+
 /**
  * Perform the second part of integration: position half step, then interact with heat bath,
- * then another position half step.
+ * then another position half step.  If FUSE_SETTLE is defined, atoms in SETTLE clusters are
+ * processed one cluster at a time, and SETTLE is applied to their position deltas before they
+ * are written.  oldDelta still records the unconstrained deltas.
  */
 
 KERNEL void integrateLangevinMiddlePart2(int numAtoms, GLOBAL mixed4* RESTRICT velm, GLOBAL mixed4* RESTRICT posDelta,
-        GLOBAL mixed4* RESTRICT oldDelta, GLOBAL const mixed* RESTRICT paramBuffer, GLOBAL const mixed2* RESTRICT dt, GLOBAL const float4* RESTRICT random, unsigned int randomIndex
+        GLOBAL mixed4* RESTRICT oldDelta, GLOBAL const mixed* RESTRICT paramBuffer, GLOBAL const mixed2* RESTRICT dt, GLOBAL const int* RESTRICT atomIndex,
+        int2 randomKey, GLOBAL const mm_long* RESTRICT randomCounter
+#ifdef FUSE_SETTLE
+        , GLOBAL const real4* RESTRICT posq, GLOBAL const int* RESTRICT settleAtomFlags, GLOBAL const int4* RESTRICT settleAtoms,
+        GLOBAL const float2* RESTRICT settleParams
+#ifdef USE_MIXED_PRECISION
+        , GLOBAL const real4* RESTRICT posqCorrection
+#endif
+#endif
         ) {
     mixed vscale = paramBuffer[VelScale];
     mixed noisescale = paramBuffer[NoiseScale];
     mixed halfdt = 0.5f*dt[0].y;
-    int index = GLOBAL_ID;
-    randomIndex += index;
-    while (index < numAtoms) {
-        mixed4 velocity = velm[index];
-        if (velocity.w != 0.0) {
-            mixed4 delta = make_mixed4(halfdt*velocity.x, halfdt*velocity.y, halfdt*velocity.z, 0);
-            mixed sqrtInvMass = SQRT(velocity.w);
-            velocity.x = vscale*velocity.x + noisescale*sqrtInvMass*random[randomIndex].x;
-            velocity.y = vscale*velocity.y + noisescale*sqrtInvMass*random[randomIndex].y;
-            velocity.z = vscale*velocity.z + noisescale*sqrtInvMass*random[randomIndex].z;
-            velm[index] = velocity;
-            delta += make_mixed4(halfdt*velocity.x, halfdt*velocity.y, halfdt*velocity.z, 0);
+    mm_long counter = randomCounter[0];
+    for (int index = GLOBAL_ID; index < numAtoms; index += GLOBAL_SIZE) {
+#ifdef FUSE_SETTLE
+        if (settleAtomFlags[index])
+            continue;
+#endif
+        if (velm[index].w != 0.0) {
+            mixed4 delta = integrateLangevinMiddleAtom(index, velm, vscale, noisescale, halfdt, atomIndex, randomKey, counter);
             posDelta[index] = delta;
             oldDelta[index] = delta;
         }
-        randomIndex += GLOBAL_SIZE;
-        index += GLOBAL_SIZE;
     }
+#ifdef FUSE_SETTLE
+#ifndef USE_MIXED_PRECISION
+    GLOBAL real4* posqCorrection = 0;
+#endif
+    for (int index = GLOBAL_ID; index < NUM_SETTLE_CLUSTERS; index += GLOBAL_SIZE) {
+        int4 atoms = settleAtoms[index];
+        mixed4 delta0 = integrateLangevinMiddleAtom(atoms.x, velm, vscale, noisescale, halfdt, atomIndex, randomKey, counter);
+        mixed4 delta1 = integrateLangevinMiddleAtom(atoms.y, velm, vscale, noisescale, halfdt, atomIndex, randomKey, counter);
+        mixed4 delta2 = integrateLangevinMiddleAtom(atoms.z, velm, vscale, noisescale, halfdt, atomIndex, randomKey, counter);
+        oldDelta[atoms.x] = delta0;
+        oldDelta[atoms.y] = delta1;
+        oldDelta[atoms.z] = delta2;
+        applySettleToCluster(loadPos(posq, posqCorrection, atoms.x), loadPos(posq, posqCorrection, atoms.y), loadPos(posq, posqCorrection, atoms.z),
+                &delta0, &delta1, &delta2, 1/velm[atoms.x].w, 1/velm[atoms.y].w, 1/velm[atoms.z].w, settleParams[index]);
+        posDelta[atoms.x] = delta0;
+        posDelta[atoms.y] = delta1;
+        posDelta[atoms.z] = delta2;
+    }
+#endif
+}
+
+/**
+ * Apply the constraint forces to the velocity of one atom, and update its position.  This returns
+ * the new position.
+ */
+DEVICE mixed4 finishLangevinMiddleAtom(int index, GLOBAL real4* RESTRICT posq, GLOBAL real4* RESTRICT posqCorrection, GLOBAL mixed4* RESTRICT velm,
+        GLOBAL const mixed4* RESTRICT posDelta, GLOBAL const mixed4* RESTRICT oldDelta, mixed invDt) {
+    mixed4 pos = loadPos(posq, posqCorrection, index);
+    mixed4 velocity = velm[index];
+    if (velocity.w != 0.0) {
+        mixed4 delta = posDelta[index];
+        velocity.x += (delta.x-oldDelta[index].x)*invDt;
+        velocity.y += (delta.y-oldDelta[index].y)*invDt;
+        velocity.z += (delta.z-oldDelta[index].z)*invDt;
+        velm[index] = velocity;
+        pos.x += delta.x;
+        pos.y += delta.y;
+        pos.z += delta.z;
+        storePos(posq, posqCorrection, index, pos);
+    }
+    return pos;
 }
 
 /**
  * Perform the third part of integration: apply constraint forces to velocities, then record
- * the constrained positions.
+ * the constrained positions.  This also advances the random number counter, now that the
+ * second part is finished with it.  If FUSE_VIRTUAL_SITES is defined, atoms in SETTLE clusters
+ * are processed one cluster at a time, and the virtual sites that depend only on a cluster are
+ * computed from its new positions.
  */
 
 KERNEL void integrateLangevinMiddlePart3(int numAtoms, GLOBAL real4* RESTRICT posq, GLOBAL mixed4* RESTRICT velm,
-         GLOBAL mixed4* RESTRICT posDelta, GLOBAL mixed4* RESTRICT oldDelta, GLOBAL const mixed2* RESTRICT dt
+         GLOBAL mixed4* RESTRICT posDelta, GLOBAL mixed4* RESTRICT oldDelta, GLOBAL const mixed2* RESTRICT dt,
+         GLOBAL mm_long* RESTRICT randomCounter
 #ifdef USE_MIXED_PRECISION
         , GLOBAL real4* RESTRICT posqCorrection
+#endif
+#ifdef FUSE_VIRTUAL_SITES
+        , GLOBAL const int* RESTRICT settleAtomFlags, GLOBAL const int4* RESTRICT settleAtoms, GLOBAL const int* RESTRICT settleVsiteStart,
+        GLOBAL const int4* RESTRICT settleVsiteAtoms, GLOBAL const real4* RESTRICT settleVsiteWeights
 #endif
         ) {
+#ifndef USE_MIXED_PRECISION
+    GLOBAL real4* posqCorrection = 0;
+#endif
     mixed invDt = 1/dt[0].y;
+    if (GLOBAL_ID == 0)
+        randomCounter[0]++;
     for (int index = GLOBAL_ID; index < numAtoms; index += GLOBAL_SIZE) {
-        mixed4 velocity = velm[index];
-        if (velocity.w != 0.0) {
-            mixed4 delta = posDelta[index];
-            velocity.x += (delta.x-oldDelta[index].x)*invDt;
-            velocity.y += (delta.y-oldDelta[index].y)*invDt;
-            velocity.z += (delta.z-oldDelta[index].z)*invDt;
-            velm[index] = velocity;
-#ifdef USE_MIXED_PRECISION
-            real4 pos1 = posq[index];
-            real4 pos2 = posqCorrection[index];
-            mixed4 pos = make_mixed4(pos1.x+(mixed)pos2.x, pos1.y+(mixed)pos2.y, pos1.z+(mixed)pos2.z, pos1.w);
-#else
-            real4 pos = posq[index];
-#endif
-            pos.x += delta.x;
-            pos.y += delta.y;
-            pos.z += delta.z;
-#ifdef USE_MIXED_PRECISION
-            posq[index] = make_real4((real) pos.x, (real) pos.y, (real) pos.z, (real) pos.w);
-            posqCorrection[index] = make_real4(pos.x-(real) pos.x, pos.y-(real) pos.y, pos.z-(real) pos.z, 0);
-#else
-            posq[index] = pos;
+#ifdef FUSE_VIRTUAL_SITES
+        if (settleAtomFlags[index])
+            continue;
 #endif
-        }
+        if (velm[index].w != 0.0)
+            finishLangevinMiddleAtom(index, posq, posqCorrection, velm, posDelta, oldDelta, invDt);
+    }
+#ifdef FUSE_VIRTUAL_SITES
+    for (int index = GLOBAL_ID; index < NUM_SETTLE_CLUSTERS; index += GLOBAL_SIZE) {
+        int4 atoms = settleAtoms[index];
+        mixed4 pos0 = finishLangevinMiddleAtom(atoms.x, posq, posqCorrection, velm, posDelta, oldDelta, invDt);
+        mixed4 pos1 = finishLangevinMiddleAtom(atoms.y, posq, posqCorrection, velm, posDelta, oldDelta, invDt);
+        mixed4 pos2 = finishLangevinMiddleAtom(atoms.z, posq, posqCorrection, velm, posDelta, oldDelta, invDt);
+        computeSettleVirtualSites(index, pos0, pos1, pos2, posq, posqCorrection, settleVsiteStart, settleVsiteAtoms, settleVsiteWeights);
     }
+#endif
 }
@@ -0,0 +1,299 @@
+// This file contains kernels for the L-BFGS energy minimizer.  The search direction is computed with the two
+// loop recursion, but working in the basis formed by the correction vectors and the current gradient as described
+// in Chen et al, "Large-scale L-BFGS using MapReduce" (NIPS 2014).  This lets every step of the recursion be done
+// on a small matrix of dot products, so only the dot products and the final linear combination touch full length
+// vectors.
+//
+// Basis vectors are numbered with s_i at index i, y_i at index NUM_HISTORY+i, and the gradient at 2*NUM_HISTORY.
+
+#define GRADIENT_INDEX (2*NUM_HISTORY)
+#define NUM_VECTORS (2*NUM_HISTORY+1)
+#define NUM_DOTS (3*NUM_VECTORS+1)
+
+/**
+ * Sum a value over all threads.
+ */
+DEVICE mixed reduceValue(mixed value, LOCAL_ARG volatile mixed* temp) {
+    const int thread = LOCAL_ID;
+    SYNC_THREADS;
+    temp[thread] = value;
+    SYNC_THREADS;
+    for (int step = 1; step < 32; step *= 2) {
+        if (thread+step < LOCAL_SIZE && thread%(2*step) == 0)
+            temp[thread] = temp[thread] + temp[thread+step];
+        SYNC_WARPS;
+    }
+    for (int step = 32; step < LOCAL_SIZE; step *= 2) {
+        if (thread+step < LOCAL_SIZE && thread%(2*step) == 0)
+            temp[thread] = temp[thread] + temp[thread+step];
+        SYNC_THREADS;
+    }
+    return temp[0];
+}
+
+/**
+ * Find the maximum of a value over all threads.
+ */
+DEVICE mixed reduceMax(mixed value, LOCAL_ARG volatile mixed* temp) {
+    const int thread = LOCAL_ID;
+    SYNC_THREADS;
+    temp[thread] = value;
+    SYNC_THREADS;
+    for (int step = 1; step < 32; step *= 2) {
+        if (thread+step < LOCAL_SIZE && thread%(2*step) == 0)
+            temp[thread] = max(temp[thread], temp[thread+step]);
+        SYNC_WARPS;
+    }
+    for (int step = 32; step < LOCAL_SIZE; step *= 2) {
+        if (thread+step < LOCAL_SIZE && thread%(2*step) == 0)
+            temp[thread] = max(temp[thread], temp[thread+step]);
+        SYNC_THREADS;
+    }
+    return temp[0];
+}
+
+DEVICE mixed dot3(mixed4 a, mixed4 b) {
+    return a.x*b.x + a.y*b.y + a.z*b.z;
+}
+
+/**
+ * Record the current particle positions.
+ */
+KERNEL void recordPositions(GLOBAL const real4* RESTRICT posq, GLOBAL const real4* RESTRICT posqCorrection, GLOBAL mixed4* RESTRICT pos) {
+    for (int i = GLOBAL_ID; i < NUM_ATOMS; i += GLOBAL_SIZE) {
+#ifdef USE_MIXED_PRECISION
+        real4 pos1 = posq[i];
+        real4 pos2 = posqCorrection[i];
+        pos[i] = make_mixed4(pos1.x+(mixed)pos2.x, pos1.y+(mixed)pos2.y, pos1.z+(mixed)pos2.z, 0);
+#else
+        real4 p = posq[i];
+        pos[i] = make_mixed4(p.x, p.y, p.z, 0);
+#endif
+    }
+}
+
+/**
+ * Set the particle positions to basePos + step*dir.
+ */
+KERNEL void updatePositions(GLOBAL real4* RESTRICT posq, GLOBAL real4* RESTRICT posqCorrection, GLOBAL mixed4* RESTRICT pos,
+        GLOBAL const mixed4* RESTRICT basePos, GLOBAL const mixed4* RESTRICT dir, mixed step) {
+    for (int i = GLOBAL_ID; i < NUM_ATOMS; i += GLOBAL_SIZE) {
+        mixed4 p = basePos[i] + dir[i]*step;
+        pos[i] = p;
+#ifdef USE_MIXED_PRECISION
+        posq[i] = make_real4((real) p.x, (real) p.y, (real) p.z, posq[i].w);
+        posqCorrection[i] = make_real4(p.x-(real) p.x, p.y-(real) p.y, p.z-(real) p.z, 0);
+#else
+        posq[i] = make_real4(p.x, p.y, p.z, posq[i].w);
+#endif
+    }
+}
+
+/**
+ * Compute the gradient of the energy, including harmonic restraints for all constraints.  Each work group
+ * records its contribution to the restraint energy, and whether it found any forces too large to have been
+ * accumulated correctly in fixed point.
+ */
+KERNEL void computeGradient(GLOBAL const mm_long* RESTRICT force, GLOBAL const mixed4* RESTRICT velm, GLOBAL const mixed4* RESTRICT pos,
+        GLOBAL mixed4* RESTRICT grad, GLOBAL const int* RESTRICT constraintStart, GLOBAL const int* RESTRICT constraintPartner,
+        GLOBAL const mixed* RESTRICT constraintDistance, mixed k, GLOBAL mixed* RESTRICT partialSums) {
+    LOCAL volatile mixed temp[THREAD_BLOCK_SIZE];
+    const mixed forceScale = 1/(mixed) 0x100000000;
+    mixed energy = 0, invalid = 0;
+    for (int i = GLOBAL_ID; i < NUM_ATOMS; i += GLOBAL_SIZE) {
+        mixed4 f = make_mixed4(forceScale*force[i], forceScale*force[i+PADDED_NUM_ATOMS], forceScale*force[i+PADDED_NUM_ATOMS*2], 0);
+        if (!(fabs(f.x) < 2e9f && fabs(f.y) < 2e9f && fabs(f.z) < 2e9f))
+            invalid = 1;
+        mixed4 g = (velm[i].w == 0 ? make_mixed4(0, 0, 0, 0) : make_mixed4(-f.x, -f.y, -f.z, 0));
+        mixed4 p = pos[i];
+        for (int j = constraintStart[i]; j < constraintStart[i+1]; j++) {
+            mixed4 delta = pos[constraintPartner[j]]-p;
+            mixed r = SQRT(dot3(delta, delta));
+            mixed dr = r-constraintDistance[j];
+            mixed kdr = k*dr;
+            g.x -= kdr*delta.x/r;
+            g.y -= kdr*delta.y/r;
+            g.z -= kdr*delta.z/r;
+            energy += 0.25f*kdr*dr;
+        }
+        grad[i] = g;
+    }
+    energy = reduceValue(energy, temp);
+    invalid = reduceMax(invalid, temp);
+    if (LOCAL_ID == 0) {
+        partialSums[2*GROUP_ID] = energy;
+        partialSums[2*GROUP_ID+1] = invalid;
+    }
+}
+
+/**
+ * Find the largest error in any constraint.  Each work group records the maximum over the constraints it processed.
+ */
+KERNEL void computeConstraintErrors(GLOBAL const mixed4* RESTRICT pos, GLOBAL const int2* RESTRICT constraintAtoms,
+        GLOBAL const mixed* RESTRICT distance, int numConstraints, GLOBAL mixed* RESTRICT partialSums) {
+    LOCAL volatile mixed temp[THREAD_BLOCK_SIZE];
+    mixed maxError = 0;
+    for (int i = GLOBAL_ID; i < numConstraints; i += GLOBAL_SIZE) {
+        int2 atoms = constraintAtoms[i];
+        mixed4 delta = pos[atoms.y]-pos[atoms.x];
+        mixed r = SQRT(dot3(delta, delta));
+        maxError = max(maxError, fabs(r-distance[i]));
+    }
+    maxError = reduceMax(maxError, temp);
+    if (LOCAL_ID == 0)
+        partialSums[GROUP_ID] = maxError;
+}
+
+/**
+ * Accept the most recent line search step.  This records the new correction vectors in the specified
+ * slot of the history (unless slot is negative), then makes the current position and gradient the base
+ * for the next step.
+ */
+KERNEL void acceptStep(GLOBAL const mixed4* RESTRICT pos, GLOBAL const mixed4* RESTRICT grad, GLOBAL mixed4* RESTRICT basePos,
+        GLOBAL mixed4* RESTRICT baseGrad, GLOBAL mixed4* RESTRICT s, GLOBAL mixed4* RESTRICT y, int slot) {
+    for (int i = GLOBAL_ID; i < NUM_ATOMS; i += GLOBAL_SIZE) {
+        mixed4 p = pos[i];
+        mixed4 g = grad[i];
+        if (slot >= 0) {
+            s[slot*NUM_ATOMS+i] = p-basePos[i];
+            y[slot*NUM_ATOMS+i] = g-baseGrad[i];
+        }
+        basePos[i] = p;
+        baseGrad[i] = g;
+    }
+}
+
+/**
+ * Compute the dot products of s_slot, y_slot, and the gradient with every basis vector, along with the
+ * squared norm of the position.  Each work group records partial sums for the elements it processed.
+ */
+KERNEL void computeDotProducts(GLOBAL const mixed4* RESTRICT basePos, GLOBAL const mixed4* RESTRICT baseGrad,
+        GLOBAL const mixed4* RESTRICT s, GLOBAL const mixed4* RESTRICT y, int slot, GLOBAL mixed* RESTRICT partialSums) {
+    LOCAL volatile mixed temp[THREAD_BLOCK_SIZE];
+    GLOBAL const mixed4* newS = &s[slot*NUM_ATOMS];
+    GLOBAL const mixed4* newY = &y[slot*NUM_ATOMS];
+    for (int j = 0; j < NUM_VECTORS; j++) {
+        GLOBAL const mixed4* v = (j < NUM_HISTORY ? &s[j*NUM_ATOMS] : (j < GRADIENT_INDEX ? &y[(j-NUM_HISTORY)*NUM_ATOMS] : baseGrad));
+        mixed sumS = 0, sumY = 0, sumG = 0;
+        for (int i = GLOBAL_ID; i < NUM_ATOMS; i += GLOBAL_SIZE) {
+            mixed4 vi = v[i];
+            sumS += dot3(newS[i], vi);
+            sumY += dot3(newY[i], vi);
+            sumG += dot3(baseGrad[i], vi);
+        }
+        sumS = reduceValue(sumS, temp);
+        sumY = reduceValue(sumY, temp);
+        sumG = reduceValue(sumG, temp);
+        if (LOCAL_ID == 0) {
+            partialSums[GROUP_ID*NUM_DOTS+j] = sumS;
+            partialSums[GROUP_ID*NUM_DOTS+NUM_VECTORS+j] = sumY;
+            partialSums[GROUP_ID*NUM_DOTS+2*NUM_VECTORS+j] = sumG;
+        }
+    }
+    mixed sumX = 0;
+    for (int i = GLOBAL_ID; i < NUM_ATOMS; i += GLOBAL_SIZE) {
+        mixed4 p = basePos[i];
+        sumX += dot3(p, p);
+    }
+    sumX = reduceValue(sumX, temp);
+    if (LOCAL_ID == 0)
+        partialSums[GROUP_ID*NUM_DOTS+3*NUM_VECTORS] = sumX;
+}
+
+/**
+ * Combine the partial sums into the matrix of dot products, then perform the two loop recursion to find the
+ * coefficients of the search direction.  This is executed as a single work group.  The results array receives
+ * the squared norm of the gradient, the squared norm of the position, the directional derivative along the
+ * search direction, and whether any correction pair had positive curvature.
+ */
+KERNEL void computeSearchDirection(GLOBAL const mixed* RESTRICT partialSums, int numPartialSums, GLOBAL mixed* RESTRICT dotMatrix,
+        GLOBAL mixed* RESTRICT coefficients, GLOBAL mixed* RESTRICT results, int slot, int numHistory) {
+    for (int j = LOCAL_ID; j < NUM_DOTS; j += LOCAL_SIZE) {
+        mixed sum = 0;
+        for (int k = 0; k < numPartialSums; k++)
+            sum += partialSums[k*NUM_DOTS+j];
+        int row, col = j%NUM_VECTORS;
+        if (j < NUM_VECTORS)
+            row = slot;
+        else if (j < 2*NUM_VECTORS)
+            row = NUM_HISTORY+slot;
+        else if (j < 3*NUM_VECTORS)
+            row = GRADIENT_INDEX;
+        else {
+            results[1] = sum;
+            continue;
+        }
+        dotMatrix[row*NUM_VECTORS+col] = sum;
+        dotMatrix[col*NUM_VECTORS+row] = sum;
+    }
+    SYNC_THREADS;
+    if (LOCAL_ID == 0) {
+        mixed q[NUM_VECTORS], alpha[NUM_HISTORY];
+        for (int j = 0; j < NUM_VECTORS; j++)
+            q[j] = 0;
+        q[GRADIENT_INDEX] = 1;
+
+        // First loop, from the newest correction pair to the oldest.
+
+        mixed gamma = 1;
+        bool hasCurvature = false;
+        for (int k = 0; k < numHistory; k++) {
+            int i = (slot-k+NUM_HISTORY)%NUM_HISTORY;
+            mixed ys = dotMatrix[i*NUM_VECTORS+NUM_HISTORY+i];
+            mixed rho = (ys > 0 ? 1/ys : 0);
+            if (ys > 0 && !hasCurvature) {
+                gamma = ys/dotMatrix[(NUM_HISTORY+i)*NUM_VECTORS+NUM_HISTORY+i];
+                hasCurvature = true;
+            }
+            mixed sq = 0;
+            for (int j = 0; j < NUM_VECTORS; j++)
+                sq += dotMatrix[i*NUM_VECTORS+j]*q[j];
+            alpha[i] = rho*sq;
+            q[NUM_HISTORY+i] -= alpha[i];
+        }
+        for (int j = 0; j < NUM_VECTORS; j++)
+            q[j] *= gamma;
+
+        // Second loop, from the oldest correction pair to the newest.
+
+        for (int k = numHistory-1; k >= 0; k--) {
+            int i = (slot-k+NUM_HISTORY)%NUM_HISTORY;
+            mixed ys = dotMatrix[i*NUM_VECTORS+NUM_HISTORY+i];
+            mixed rho = (ys > 0 ? 1/ys : 0);
+            mixed yr = 0;
+            for (int j = 0; j < NUM_VECTORS; j++)
+                yr += dotMatrix[(NUM_HISTORY+i)*NUM_VECTORS+j]*q[j];
+            q[i] += alpha[i]-rho*yr;
+        }
+
+        // The search direction is the negative of the result.
+
+        mixed gd = 0;
+        for (int j = 0; j < NUM_VECTORS; j++) {
+            coefficients[j] = -q[j];
+            gd -= q[j]*dotMatrix[GRADIENT_INDEX*NUM_VECTORS+j];
+        }
+        results[0] = dotMatrix[GRADIENT_INDEX*NUM_VECTORS+GRADIENT_INDEX];
+        results[2] = gd;
+        results[3] = (hasCurvature ? 1 : 0);
+    }
+}
+
+/**
+ * Form the search direction as a linear combination of the basis vectors.
+ */
+KERNEL void updateSearchDirection(GLOBAL const mixed4* RESTRICT baseGrad, GLOBAL const mixed4* RESTRICT s, GLOBAL const mixed4* RESTRICT y,
+        GLOBAL const mixed* RESTRICT coefficients, GLOBAL mixed4* RESTRICT dir) {
+    for (int i = GLOBAL_ID; i < NUM_ATOMS; i += GLOBAL_SIZE) {
+        mixed4 d = baseGrad[i]*coefficients[GRADIENT_INDEX];
+        for (int j = 0; j < NUM_HISTORY; j++) {
+            mixed cs = coefficients[j];
+            mixed cy = coefficients[NUM_HISTORY+j];
+            if (cs != 0)
+                d += s[j*NUM_ATOMS+i]*cs;
+            if (cy != 0)
+                d += y[j*NUM_ATOMS+i]*cy;
+        }
+        dir[i] = d;
+    }
+}
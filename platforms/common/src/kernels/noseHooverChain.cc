@@ -1,43 +1,102 @@
-// Propagates a Nose Hoover chain a full timestep
-KERNEL void propagateNoseHooverChain(GLOBAL mixed2* RESTRICT chainData, GLOBAL const mixed2 * RESTRICT energySum, GLOBAL mixed2* RESTRICT scaleFactor,
-                                     GLOBAL mixed* RESTRICT chainMasses, GLOBAL mixed* RESTRICT chainForces, int chainType, int chainLength, int numMTS,
-                                     int numDOFs, float timeStep, mixed kT, float frequency){
-    const mixed kineticEnergy = chainType == 0 ? energySum[0].x : energySum[0].y;
+/**
+ * Propagate the state of a single Nose-Hoover chain by a full time step, and return the factor by which
+ * the velocities of the particles it is coupled to should be scaled.
+ */
+DEVICE mixed propagateChainState(GLOBAL mixed2* RESTRICT chainData, GLOBAL mixed* RESTRICT chainForces, mixed kineticEnergy,
+                                 int chainLength, int numMTS, int numYS, int numDOFs, float timeStep, mixed kT, float frequency) {
+    const real ys1[1] = {1.0};
+    const real ys3[3] = {0.828981543588751, -0.657963087177502, 0.828981543588751};
+    const real ys5[5] = {0.2967324292201065, 0.2967324292201065, -0.186929716880426, 0.2967324292201065, 0.2967324292201065};
+    const real ys7[7] = {0.784513610477560, 0.235573213359357, -1.17767998417887, 1.31518632068391,-1.17767998417887, 0.235573213359357, 0.784513610477560};
+    const real* weights = (numYS == 7 ? ys7 : numYS == 5 ? ys5 : numYS == 3 ? ys3 : ys1);
+    const mixed beadMass = kT / (frequency * frequency);
+    const mixed firstMass = numDOFs * beadMass;
     mixed scale = 1;
-    if(kineticEnergy < 1e-8) return;
-    for (int bead = 0; bead < chainLength; ++bead) chainMasses[bead] = kT / (frequency * frequency);
-    chainMasses[0] *= numDOFs;
     mixed KE2 = 2.0f * kineticEnergy;
     mixed timeOverMTS = timeStep / numMTS;
-    chainForces[0] = (KE2 - numDOFs * kT) / chainMasses[0];
+    chainForces[0] = (KE2 - numDOFs * kT) / firstMass;
     for (int bead = 0; bead < chainLength - 1; ++bead) {
-        chainForces[bead + 1] = (chainMasses[bead] * chainData[bead].y * chainData[bead].y - kT) / chainMasses[bead + 1];
+        mixed mass = (bead == 0 ? firstMass : beadMass);
+        chainForces[bead + 1] = (mass * chainData[bead].y * chainData[bead].y - kT) / beadMass;
     }
     for (int mts = 0; mts < numMTS; ++mts) {
-        BEGIN_YS_LOOP
-            mixed wdt = ys * timeOverMTS;
+        for (int i = 0; i < numYS; ++i) {
+            mixed wdt = weights[i] * timeOverMTS;
             chainData[chainLength-1].y += 0.5f * wdt * chainForces[chainLength-1];
             for (int bead = chainLength - 2; bead >= 0; --bead) {
                 mixed aa = exp(-0.25f * wdt * chainData[bead + 1].y);
                 chainData[bead].y = aa * (chainData[bead].y * aa + 0.5f * wdt * chainForces[bead]);
             }
             // update particle velocities
-            scale *= (mixed) exp(-wdt * chainData[0].y);;
+            scale *= (mixed) exp(-wdt * chainData[0].y);
             // update the thermostat positions
             for (int bead = 0; bead < chainLength; ++bead) {
                 chainData[bead].x += chainData[bead].y * wdt;
             }
             // update the forces
-            chainForces[0] = (scale * scale * KE2 - numDOFs * kT) / chainMasses[0];
+            chainForces[0] = (scale * scale * KE2 - numDOFs * kT) / firstMass;
             // update thermostat velocities
             for (int bead = 0; bead < chainLength - 1; ++bead) {
+                mixed mass = (bead == 0 ? firstMass : beadMass);
                 mixed aa = exp(-0.25f * wdt * chainData[bead + 1].y);
                 chainData[bead].y = aa * (aa * chainData[bead].y + 0.5f * wdt * chainForces[bead]);
-                chainForces[bead + 1] = (chainMasses[bead] * chainData[bead].y * chainData[bead].y - kT) / chainMasses[bead + 1];
+                chainForces[bead + 1] = (mass * chainData[bead].y * chainData[bead].y - kT) / beadMass;
             }
             chainData[chainLength-1].y += 0.5f * wdt * chainForces[chainLength-1];
-        END_YS_LOOP
+        }
     } // MTS loop
+    return scale;
+}
+
+/**
+ * Compute the center of mass and relative kinetic energies of a thermostated pair.
+ */
+DEVICE mixed2 pairKineticEnergy(mixed4 v1, mixed4 v2) {
+    mixed m1 = v1.w == 0 ? 0 : 1 / v1.w;
+    mixed m2 = v2.w == 0 ? 0 : 1 / v2.w;
+    mixed4 cv;
+    cv.x = (m1*v1.x + m2*v2.x) / (m1 + m2);
+    cv.y = (m1*v1.y + m2*v2.y) / (m1 + m2);
+    cv.z = (m1*v1.z + m2*v2.z) / (m1 + m2);
+    mixed4 rv;
+    rv.x = v2.x - v1.x;
+    rv.y = v2.y - v1.y;
+    rv.z = v2.z - v1.z;
+    return make_mixed2(0.5f * (m1 + m2) * (cv.x*cv.x + cv.y*cv.y + cv.z*cv.z),
+                       0.5f * (m1 * m2 / (m1 + m2)) * (rv.x*rv.x + rv.y*rv.y + rv.z*rv.z));
+}
+
+/**
+ * Scale the center of mass and relative velocities of a thermostated pair.
+ */
+DEVICE void scalePairVelocities(GLOBAL mixed4* RESTRICT velm, int2 pair, mixed comScale, mixed relScale) {
+    int atom1 = pair.x;
+    int atom2 = pair.y;
+    mixed m1 = velm[atom1].w == 0 ? 0 : 1 / velm[atom1].w;
+    mixed m2 = velm[atom2].w == 0 ? 0 : 1 / velm[atom2].w;
+    mixed4 cv;
+    cv.x = (m1*velm[atom1].x + m2*velm[atom2].x) / (m1 + m2);
+    cv.y = (m1*velm[atom1].y + m2*velm[atom2].y) / (m1 + m2);
+    cv.z = (m1*velm[atom1].z + m2*velm[atom2].z) / (m1 + m2);
+    mixed4 rv;
+    rv.x = velm[atom2].x - velm[atom1].x;
+    rv.y = velm[atom2].y - velm[atom1].y;
+    rv.z = velm[atom2].z - velm[atom1].z;
+    velm[atom1].x = comScale * cv.x - relScale * rv.x * m2 / (m1 + m2);
+    velm[atom1].y = comScale * cv.y - relScale * rv.y * m2 / (m1 + m2);
+    velm[atom1].z = comScale * cv.z - relScale * rv.z * m2 / (m1 + m2);
+    velm[atom2].x = comScale * cv.x + relScale * rv.x * m1 / (m1 + m2);
+    velm[atom2].y = comScale * cv.y + relScale * rv.y * m1 / (m1 + m2);
+    velm[atom2].z = comScale * cv.z + relScale * rv.z * m1 / (m1 + m2);
+}
+
+// Propagates a Nose Hoover chain a full timestep
+KERNEL void propagateNoseHooverChain(GLOBAL mixed2* RESTRICT chainData, GLOBAL const mixed2 * RESTRICT energySum, GLOBAL mixed2* RESTRICT scaleFactor,
+                                     GLOBAL mixed* RESTRICT chainForces, int chainType, int chainLength, int numMTS, int numYS,
+                                     int numDOFs, float timeStep, mixed kT, float frequency, int stateOffset){
+    const mixed kineticEnergy = chainType == 0 ? energySum[0].x : energySum[0].y;
+    if(kineticEnergy < 1e-8) return;
+    mixed scale = propagateChainState(chainData+stateOffset, chainForces+stateOffset, kineticEnergy, chainLength, numMTS, numYS, numDOFs, timeStep, kT, frequency);
     if (chainType == 0) {
         scaleFactor[0].x = scale;
     } else {
@@ -50,16 +109,16 @@ KERNEL void propagateNoseHooverChain(GLOBAL mixed2* RESTRICT chainData, GLOBAL c
  * Compute total (potential + kinetic) energy of the Nose-Hoover beads
  */
 KERNEL void computeHeatBathEnergy(GLOBAL mixed* RESTRICT heatBathEnergy, int chainLength, int numDOFs,
-                                  mixed kT, float frequency, GLOBAL const mixed2* RESTRICT chainData){
+                                  mixed kT, float frequency, GLOBAL const mixed2* RESTRICT chainData, int stateOffset){
     // Note that this is always incremented; make sure it's zeroed properly before the first call
     for(int i = 0; i < chainLength; ++i) {
         mixed prefac = i ? 1 : numDOFs;
         mixed mass = prefac * kT / (frequency * frequency);
-        mixed velocity = chainData[i].y; 
+        mixed velocity = chainData[stateOffset+i].y; 
         // The kinetic energy of this bead
         heatBathEnergy[0] += 0.5f * mass * velocity * velocity;
         // The potential energy of this bead
-        mixed position = chainData[i].x;
+        mixed position = chainData[stateOffset+i].x;
         heatBathEnergy[0] += prefac * kT * position;
     }
 }
@@ -84,22 +143,9 @@ KERNEL void computePairsKineticEnergy(GLOBAL mixed2 * RESTRICT energyBuffer, int
     int index = GLOBAL_ID;
     while (index < numPairs){
         int2 pair = pairs[index];
-        int atom1 = pair.x;
-        int atom2 = pair.y;
-        mixed4 v1 = velm[atom1];
-        mixed4 v2 = velm[atom2];
-        mixed m1 = v1.w == 0 ? 0 : 1 / v1.w;
-        mixed m2 = v2.w == 0 ? 0 : 1 / v2.w;
-        mixed4 cv;
-        cv.x = (m1*v1.x + m2*v2.x) / (m1 + m2);
-        cv.y = (m1*v1.y + m2*v2.y) / (m1 + m2);
-        cv.z = (m1*v1.z + m2*v2.z) / (m1 + m2);
-        mixed4 rv;
-        rv.x = v2.x - v1.x;
-        rv.y = v2.y - v1.y;
-        rv.z = v2.z - v1.z;
-        energy.x += 0.5f * (m1 + m2) * (cv.x*cv.x + cv.y*cv.y + cv.z*cv.z);
-        energy.y += 0.5f * (m1 * m2 / (m1 + m2)) * (rv.x*rv.x + rv.y*rv.y + rv.z*rv.z);
+        mixed2 pairEnergy = pairKineticEnergy(velm[pair.x], velm[pair.y]);
+        energy.x += pairEnergy.x;
+        energy.y += pairEnergy.y;
         index += GLOBAL_SIZE;
     }
     // The atoms version of this has been called already, so accumulate instead of assigning here
@@ -126,24 +172,7 @@ KERNEL void scalePairsVelocities(GLOBAL mixed2 * RESTRICT scaleFactor, int numPa
     mixed comScale = scaleFactor[0].x;
     mixed relScale = scaleFactor[0].y;
     while (index < numPairs){
-        int atom1 = pairs[index].x;
-        int atom2 = pairs[index].y;
-        mixed m1 = velm[atom1].w == 0 ? 0 : 1 / velm[atom1].w;
-        mixed m2 = velm[atom2].w == 0 ? 0 : 1 / velm[atom2].w;
-        mixed4 cv;
-        cv.x = (m1*velm[atom1].x + m2*velm[atom2].x) / (m1 + m2);
-        cv.y = (m1*velm[atom1].y + m2*velm[atom2].y) / (m1 + m2);
-        cv.z = (m1*velm[atom1].z + m2*velm[atom2].z) / (m1 + m2);
-        mixed4 rv;
-        rv.x = velm[atom2].x - velm[atom1].x;
-        rv.y = velm[atom2].y - velm[atom1].y;
-        rv.z = velm[atom2].z - velm[atom1].z;
-        velm[atom1].x = comScale * cv.x - relScale * rv.x * m2 / (m1 + m2);
-        velm[atom1].y = comScale * cv.y - relScale * rv.y * m2 / (m1 + m2);
-        velm[atom1].z = comScale * cv.z - relScale * rv.z * m2 / (m1 + m2);
-        velm[atom2].x = comScale * cv.x + relScale * rv.x * m1 / (m1 + m2);
-        velm[atom2].y = comScale * cv.y + relScale * rv.y * m1 / (m1 + m2);
-        velm[atom2].z = comScale * cv.z + relScale * rv.z * m1 / (m1 + m2);
+        scalePairVelocities(velm, pairs[index], comScale, relScale);
         index += GLOBAL_SIZE;
     }
 }
@@ -171,3 +200,91 @@ KERNEL void reduceEnergyPair(GLOBAL const mixed2* RESTRICT sumBuffer, GLOBAL mix
     if (thread == 0)
         *result = tempBuffer[0];
 }
+
+/**
+ * Compute the kinetic energies of every thermostat at once.  The atoms and pairs of all chains are stored
+ * contiguously, and chain i owns elements atomStart[i] to atomStart[i+1] (and likewise for pairs).  Each chain
+ * is processed by groupsPerChain consecutive work groups, each of which writes one partial sum to energyBuffer.
+ */
+KERNEL void computeChainKineticEnergies(GLOBAL mixed2* RESTRICT energyBuffer, int groupsPerChain, GLOBAL const mixed4* RESTRICT velm,
+                                        GLOBAL const int* RESTRICT atoms, GLOBAL const int* RESTRICT atomStart,
+                                        GLOBAL const int2* RESTRICT pairs, GLOBAL const int* RESTRICT pairStart) {
+    LOCAL mixed2 tempBuffer[WORK_GROUP_SIZE];
+    const unsigned int thread = LOCAL_ID;
+    const int chain = GROUP_ID/groupsPerChain;
+    const int first = (GROUP_ID%groupsPerChain)*LOCAL_SIZE+thread;
+    const int stride = groupsPerChain*LOCAL_SIZE;
+    mixed2 energy = make_mixed2(0,0);
+    for (int index = atomStart[chain]+first; index < atomStart[chain+1]; index += stride) {
+        mixed4 v = velm[atoms[index]];
+        mixed mass = v.w == 0 ? 0 : 1 / v.w;
+        energy.x += 0.5f * mass * (v.x*v.x + v.y*v.y + v.z*v.z);
+    }
+    for (int index = pairStart[chain]+first; index < pairStart[chain+1]; index += stride) {
+        int2 pair = pairs[index];
+        mixed2 pairEnergy = pairKineticEnergy(velm[pair.x], velm[pair.y]);
+        energy.x += pairEnergy.x;
+        energy.y += pairEnergy.y;
+    }
+    tempBuffer[thread].x = energy.x;
+    tempBuffer[thread].y = energy.y;
+    for (int i = 1; i < WORK_GROUP_SIZE; i *= 2) {
+        SYNC_THREADS;
+        if (thread%(i*2) == 0 && thread+i < WORK_GROUP_SIZE) {
+            tempBuffer[thread].x += tempBuffer[thread+i].x;
+            tempBuffer[thread].y += tempBuffer[thread+i].y;
+        }
+    }
+    if (thread == 0)
+        energyBuffer[GROUP_ID] = tempBuffer[0];
+}
+
+/**
+ * Propagate every chain by a full time step.  Element 2*i of chainInfo describes the absolute chain of
+ * thermostat i and element 2*i+1 its relative chain; each contains the offset of the chain's state
+ * (or -1 if it is not used), the chain length, the number of multi time steps, and the number of
+ * Yoshida-Suzuki steps.  The resulting scale factors are stored in the same order.
+ */
+KERNEL void propagateNoseHooverChains(GLOBAL mixed2* RESTRICT chainData, GLOBAL mixed* RESTRICT chainForces, GLOBAL const mixed2* RESTRICT energyBuffer,
+                                      GLOBAL mixed* RESTRICT scaleFactors, GLOBAL const int4* RESTRICT chainInfo, GLOBAL const int* RESTRICT chainDOFs,
+                                      GLOBAL const mixed2* RESTRICT chainParams, int numSubChains, int groupsPerChain, float timeStep) {
+    for (int i = GLOBAL_ID; i < numSubChains; i += GLOBAL_SIZE) {
+        int4 info = chainInfo[i];
+        mixed scale = 1;
+        if (info.x >= 0) {
+            mixed kineticEnergy = 0;
+            for (int j = 0; j < groupsPerChain; j++) {
+                mixed2 energy = energyBuffer[(i/2)*groupsPerChain+j];
+                kineticEnergy += (i%2 == 0 ? energy.x : energy.y);
+            }
+            if (kineticEnergy >= 1e-8) {
+                mixed2 params = chainParams[i];
+                scale = propagateChainState(chainData+info.x, chainForces+info.x, kineticEnergy, info.y, info.z, info.w,
+                                            chainDOFs[i], timeStep, params.x, (float) params.y);
+            }
+        }
+        scaleFactors[i] = scale;
+    }
+}
+
+/**
+ * Apply the scale factors computed by propagateNoseHooverChains() to every thermostated atom and pair.
+ */
+KERNEL void scaleChainVelocities(GLOBAL const mixed* RESTRICT scaleFactors, GLOBAL mixed4* RESTRICT velm,
+                                 GLOBAL const int* RESTRICT atoms, GLOBAL const int* RESTRICT atomChain, int numAtoms,
+                                 GLOBAL const int2* RESTRICT pairs, GLOBAL const int* RESTRICT pairChain, int numPairs) {
+    for (int index = GLOBAL_ID; index < numAtoms+numPairs; index += GLOBAL_SIZE) {
+        if (index < numAtoms) {
+            int atom = atoms[index];
+            const mixed scale = scaleFactors[2*atomChain[index]];
+            velm[atom].x *= scale;
+            velm[atom].y *= scale;
+            velm[atom].z *= scale;
+        }
+        else {
+            int pair = index-numAtoms;
+            int chain = pairChain[pair];
+            scalePairVelocities(velm, pairs[pair], scaleFactors[2*chain], scaleFactors[2*chain+1]);
+        }
+    }
+}
@@ -0,0 +1,43 @@
+/**
+ * Compute the inverse of an atom ordering, so invOrder[order[i]] == i.
+ */
+KERNEL void computeInverseOrder(GLOBAL const int* RESTRICT order, GLOBAL int* RESTRICT invOrder) {
+    for (int i = GLOBAL_ID; i < NUM_ATOMS; i += GLOBAL_SIZE)
+        invOrder[order[i]] = i;
+}
+
+/**
+ * Copy the positions of the particles in a subset into a compact array.  The index of the atom each one
+ * was stored in is also recorded, so the host can apply the periodic cell offsets.
+ */
+KERNEL void gatherPositions(int numParticles, GLOBAL const int* RESTRICT particles, GLOBAL const int* RESTRICT invOrder,
+        GLOBAL const real4* RESTRICT posq, GLOBAL const real4* RESTRICT posqCorrection, GLOBAL real4* RESTRICT subsetPosq,
+        GLOBAL real4* RESTRICT subsetCorrection, GLOBAL int* RESTRICT subsetAtoms) {
+    for (int i = GLOBAL_ID; i < numParticles; i += GLOBAL_SIZE) {
+        int atom = invOrder[particles[i]];
+        subsetPosq[i] = posq[atom];
+#ifdef USE_MIXED_PRECISION
+        subsetCorrection[i] = posqCorrection[atom];
+#endif
+        subsetAtoms[i] = atom;
+    }
+}
+
+/**
+ * Copy new positions for the particles in a subset into the full arrays.  The fourth component
+ * (the charge) is left unchanged.
+ */
+KERNEL void scatterPositions(int numParticles, GLOBAL const int* RESTRICT particles, GLOBAL const int* RESTRICT invOrder,
+        GLOBAL real4* RESTRICT posq, GLOBAL real4* RESTRICT posqCorrection, GLOBAL const real4* RESTRICT subsetPosq,
+        GLOBAL const real4* RESTRICT subsetCorrection, GLOBAL int* RESTRICT subsetAtoms) {
+    for (int i = GLOBAL_ID; i < numParticles; i += GLOBAL_SIZE) {
+        int atom = invOrder[particles[i]];
+        real4 pos = subsetPosq[i];
+        posq[atom] = make_real4(pos.x, pos.y, pos.z, posq[atom].w);
+#ifdef USE_MIXED_PRECISION
+        real4 correction = subsetCorrection[i];
+        posqCorrection[atom] = make_real4(correction.x, correction.y, correction.z, 0);
+#endif
+        subsetAtoms[i] = atom;
+    }
+}
@@ -1,5 +1,9 @@
-float4 torsionParams = PARAMS[index];
-real deltaAngle = torsionParams.z*theta-torsionParams.y;
-energy += torsionParams.x*(1.0f+COS(deltaAngle));
-real sinDeltaAngle = SIN(deltaAngle);
-real dEdAngle = -torsionParams.x*torsionParams.z*sinDeltaAngle;
+int2 torsionTerms = TERMS[index];
+real dEdAngle = 0;
+for (int term = torsionTerms.x; term < torsionTerms.y; term++) {
+    float4 torsionParams = PARAMS[term];
+    real deltaAngle = torsionParams.z*theta-torsionParams.y;
+    energy += torsionParams.x*(1.0f+COS(deltaAngle));
+    real sinDeltaAngle = SIN(deltaAngle);
+    dEdAngle -= torsionParams.x*torsionParams.z*sinDeltaAngle;
+}
@@ -0,0 +1,41 @@
+/**
+ * Generate four independent, normally distributed random numbers with mean 0 and variance 1
+ * using the Philox4x32-10 counter-based generator (Salmon et al., "Parallel Random Numbers: As
+ * Easy as 1, 2, 3", SC11).  The result depends only on the key, the counter, and the index, so
+ * kernels can compute values on the fly instead of reading them from a precomputed array, and
+ * the values do not depend on how work is divided between threads.
+ *
+ * @param key      the key returned by IntegrationUtilities::getRandomKey()
+ * @param counter  the value stored in IntegrationUtilities::getRandomCounter()
+ * @param index    identifies which set of values to generate, typically the atom index
+ */
+inline DEVICE float4 philoxGaussian(int2 key, mm_long counter, int index) {
+    unsigned int c0 = (unsigned int) index;
+    unsigned int c1 = (unsigned int) counter;
+    unsigned int c2 = (unsigned int) (counter>>32);
+    unsigned int c3 = 0;
+    unsigned int k0 = (unsigned int) key.x;
+    unsigned int k1 = (unsigned int) key.y;
+    for (int round = 0; round < 10; round++) {
+        mm_ulong product0 = ((mm_ulong) 0xD2511F53)*c0;
+        mm_ulong product1 = ((mm_ulong) 0xCD9E8D57)*c2;
+        c0 = ((unsigned int) (product1>>32))^c1^k0;
+        c1 = (unsigned int) product1;
+        c2 = ((unsigned int) (product0>>32))^c3^k1;
+        c3 = (unsigned int) product0;
+        k0 += 0x9E3779B9;
+        k1 += 0xBB67AE85;
+    }
+
+    // Convert to normally distributed values with the Box-Muller transform.  The first value
+    // of each pair is in (0, 1] so the logarithm is finite.
+
+    float u1 = ((c0>>8)+1)*(1.0f/16777216.0f);
+    float u2 = (c1>>8)*(1.0f/16777216.0f);
+    float u3 = ((c2>>8)+1)*(1.0f/16777216.0f);
+    float u4 = (c3>>8)*(1.0f/16777216.0f);
+    float r1 = SQRT(-2.0f*LOG(u1));
+    float r2 = SQRT(-2.0f*LOG(u3));
+    return make_float4(r1*COS(2.0f*3.14159265f*u2), r1*SIN(2.0f*3.14159265f*u2),
+                       r2*COS(2.0f*3.14159265f*u4), r2*SIN(2.0f*3.14159265f*u4));
+}
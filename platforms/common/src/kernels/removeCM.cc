@@ -1,24 +1,9 @@
 /**
- * Calculate the center of mass momentum.
+ * Sum a value over all threads in a work group of 64 threads.  The result is returned to every thread.
  */
-
-KERNEL void calcCenterOfMassMomentum(int numAtoms, GLOBAL const mixed4* RESTRICT velm, GLOBAL float3* RESTRICT cmMomentum) {
-    LOCAL float3 temp[64];
-    float3 cm = make_float3(0, 0, 0);
-    for (int index = GLOBAL_ID; index < numAtoms; index += GLOBAL_SIZE) {
-        mixed4 velocity = velm[index];
-        if (velocity.w != 0) {
-            mixed mass = RECIP(velocity.w);
-            cm.x += (float) (velocity.x*mass);
-            cm.y += (float) (velocity.y*mass);
-            cm.z += (float) (velocity.z*mass);
-        }
-    }
-
-    // Sum the threads in this group.
-
+DEVICE float3 sumOverGroup(LOCAL float3* temp, float3 value) {
     int thread = LOCAL_ID;
-    temp[thread] = cm;
+    temp[thread] = value;
     SYNC_THREADS;
     if (thread < 32)
         temp[thread] += temp[thread+32];
@@ -35,46 +20,69 @@ KERNEL void calcCenterOfMassMomentum(int numAtoms, GLOBAL const mixed4* RESTRICT
     if (thread < 2)
         temp[thread] += temp[thread+2];
     SYNC_THREADS;
-    if (thread == 0)
-        cmMomentum[GROUP_ID] = temp[thread]+temp[thread+1];
+    float3 sum = temp[0]+temp[1];
+    SYNC_THREADS;
+    return sum;
+}
+
+/**
+ * Calculate the center of mass momentum.
+ */
+
+KERNEL void calcCenterOfMassMomentum(int numAtoms, GLOBAL const mixed4* RESTRICT velm, GLOBAL float3* RESTRICT cmMomentum) {
+    LOCAL float3 temp[64];
+    float3 cm = make_float3(0, 0, 0);
+    for (int index = GLOBAL_ID; index < numAtoms; index += GLOBAL_SIZE) {
+        mixed4 velocity = velm[index];
+        if (velocity.w != 0) {
+            mixed mass = RECIP(velocity.w);
+            cm.x += (float) (velocity.x*mass);
+            cm.y += (float) (velocity.y*mass);
+            cm.z += (float) (velocity.z*mass);
+        }
+    }
+
+    // Sum the threads in this group.
+
+    cm = sumOverGroup(temp, cm);
+    if (LOCAL_ID == 0)
+        cmMomentum[GROUP_ID] = cm;
 }
 
 /**
- * Remove center of mass motion.
+ * Remove the center of mass momentum that was measured by the previous launch (which must have used the
+ * same number of work groups), then measure the momentum that remains so the next launch can remove it.
+ * This needs only a single pass over the atoms.
  */
 
-KERNEL void removeCenterOfMassMomentum(int numAtoms, GLOBAL mixed4* RESTRICT velm, GLOBAL const float3* RESTRICT cmMomentum) {
+KERNEL void removeCenterOfMassMomentum(int numAtoms, GLOBAL mixed4* RESTRICT velm, GLOBAL const float3* RESTRICT cmMomentum,
+        GLOBAL float3* RESTRICT remainingMomentum) {
     // First sum all of the momenta that were calculated by individual groups.
 
     LOCAL float3 temp[64];
     float3 cm = make_float3(0, 0, 0);
     for (int index = LOCAL_ID; index < NUM_GROUPS; index += LOCAL_SIZE)
         cm += cmMomentum[index];
-    int thread = LOCAL_ID;
-    temp[thread] = cm;
-    SYNC_THREADS;
-    if (thread < 32)
-        temp[thread] += temp[thread+32];
-    SYNC_THREADS;
-    if (thread < 16)
-        temp[thread] += temp[thread+16];
-    SYNC_THREADS;
-    if (thread < 8)
-        temp[thread] += temp[thread+8];
-    SYNC_THREADS;
-    if (thread < 4)
-        temp[thread] += temp[thread+4];
-    SYNC_THREADS;
-    if (thread < 2)
-        temp[thread] += temp[thread+2];
-    SYNC_THREADS;
-    cm = make_float3(INVERSE_TOTAL_MASS*(temp[0].x+temp[1].x), INVERSE_TOTAL_MASS*(temp[0].y+temp[1].y), INVERSE_TOTAL_MASS*(temp[0].z+temp[1].z));
+    cm = sumOverGroup(temp, cm);
+    cm = make_float3(INVERSE_TOTAL_MASS*cm.x, INVERSE_TOTAL_MASS*cm.y, INVERSE_TOTAL_MASS*cm.z);
 
-    // Now remove the center of mass velocity from each atom.
+    // Now remove the center of mass velocity from each atom, and record the momentum that is left.
 
+    float3 remaining = make_float3(0, 0, 0);
     for (int index = GLOBAL_ID; index < numAtoms; index += GLOBAL_SIZE) {
-        velm[index].x -= cm.x;
-        velm[index].y -= cm.y;
-        velm[index].z -= cm.z;
+        mixed4 velocity = velm[index];
+        velocity.x -= cm.x;
+        velocity.y -= cm.y;
+        velocity.z -= cm.z;
+        velm[index] = velocity;
+        if (velocity.w != 0) {
+            mixed mass = RECIP(velocity.w);
+            remaining.x += (float) (velocity.x*mass);
+            remaining.y += (float) (velocity.y*mass);
+            remaining.z += (float) (velocity.z*mass);
+        }
     }
+    remaining = sumOverGroup(temp, remaining);
+    if (LOCAL_ID == 0)
+        remainingMomentum[GROUP_ID] = remaining;
 }
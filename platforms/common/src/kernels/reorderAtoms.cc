@@ -0,0 +1,75 @@
+/**
+ * Compute the center of each molecule.  If periodic boundary conditions are used, also find
+ * the periodic cell shift that moves the center into the primary box.
+ */
+KERNEL void computeMoleculeCenters(int numMolecules, GLOBAL const real4* RESTRICT posq, GLOBAL const int* RESTRICT moleculeStart,
+        GLOBAL const int* RESTRICT moleculeAtoms, GLOBAL real4* RESTRICT moleculeCenters, GLOBAL int4* RESTRICT moleculeCellShifts,
+        int usePeriodic, real4 invPeriodicBoxSize, real4 periodicBoxVecX, real4 periodicBoxVecY, real4 periodicBoxVecZ) {
+    for (int mol = GLOBAL_ID; mol < numMolecules; mol += GLOBAL_SIZE) {
+        int first = moleculeStart[mol];
+        int last = moleculeStart[mol+1];
+        real4 center = make_real4(0, 0, 0, 0);
+        for (int i = first; i < last; i++) {
+            real4 pos = posq[moleculeAtoms[i]];
+            center.x += pos.x;
+            center.y += pos.y;
+            center.z += pos.z;
+        }
+        real invNumAtoms = RECIP((real) (last-first));
+        center.x *= invNumAtoms;
+        center.y *= invNumAtoms;
+        center.z *= invNumAtoms;
+        int4 shift = make_int4(0, 0, 0, 0);
+        if (usePeriodic) {
+            shift.z = (int) floor(center.z*invPeriodicBoxSize.z);
+            center.x -= shift.z*periodicBoxVecZ.x;
+            center.y -= shift.z*periodicBoxVecZ.y;
+            center.z -= shift.z*periodicBoxVecZ.z;
+            shift.y = (int) floor(center.y*invPeriodicBoxSize.y);
+            center.x -= shift.y*periodicBoxVecY.x;
+            center.y -= shift.y*periodicBoxVecY.y;
+            shift.x = (int) floor(center.x*invPeriodicBoxSize.x);
+            center.x -= shift.x*periodicBoxVecX.x;
+        }
+        moleculeCenters[mol] = center;
+        moleculeCellShifts[mol] = shift;
+    }
+}
+
+/**
+ * Copy the atoms into their new order.  Molecule sourceMolecule[m] is moved into the slot previously
+ * occupied by molecule m, and its atoms are translated by the molecule's periodic cell shift.
+ */
+KERNEL void applyAtomReordering(int numAtoms, int paddedNumAtoms, GLOBAL const int* RESTRICT moleculeStart, GLOBAL const int* RESTRICT moleculeAtoms,
+        GLOBAL const int* RESTRICT atomMolecule, GLOBAL const int* RESTRICT sourceMolecule, GLOBAL const int4* RESTRICT moleculeCellShifts,
+        GLOBAL const real4* RESTRICT posq, GLOBAL real4* RESTRICT newPosq, GLOBAL const mixed4* RESTRICT velm, GLOBAL mixed4* RESTRICT newVelm,
+        real4 periodicBoxVecX, real4 periodicBoxVecY, real4 periodicBoxVecZ
+#ifdef USE_MIXED_PRECISION
+        , GLOBAL const real4* RESTRICT posqCorrection, GLOBAL real4* RESTRICT newPosqCorrection
+#endif
+    ) {
+    for (int i = GLOBAL_ID; i < paddedNumAtoms; i += GLOBAL_SIZE) {
+        if (i >= numAtoms) {
+            newPosq[i] = make_real4(0, 0, 0, 0);
+            newVelm[i] = make_mixed4(0, 0, 0, 0);
+#ifdef USE_MIXED_PRECISION
+            newPosqCorrection[i] = make_real4(0, 0, 0, 0);
+#endif
+            continue;
+        }
+        int mol = atomMolecule[i];
+        int source = sourceMolecule[mol];
+        int dest = moleculeAtoms[i];
+        int src = moleculeAtoms[moleculeStart[source]+i-moleculeStart[mol]];
+        int4 shift = moleculeCellShifts[source];
+        real4 pos = posq[src];
+        pos.x -= shift.x*periodicBoxVecX.x + shift.y*periodicBoxVecY.x + shift.z*periodicBoxVecZ.x;
+        pos.y -= shift.y*periodicBoxVecY.y + shift.z*periodicBoxVecZ.y;
+        pos.z -= shift.z*periodicBoxVecZ.z;
+        newPosq[dest] = pos;
+        newVelm[dest] = velm[src];
+#ifdef USE_MIXED_PRECISION
+        newPosqCorrection[dest] = posqCorrection[src];
+#endif
+    }
+}
@@ -23,10 +23,65 @@ DEVICE real reduceValue(real value, LOCAL_ARG volatile real* temp) {
 }
 
 /**
- * Perform the first step of computing the RMSD.  This is executed as a single work group.
+ * Find the largest eigenvalue of a symmetric 4x4 matrix and the corresponding eigenvector, using
+ * the cyclic Jacobi method.  The matrix is overwritten.
+ */
+DEVICE mixed findLargestEigenvector(mixed F[4][4], mixed* q) {
+    mixed V[4][4] = {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1}};
+    for (int sweep = 0; sweep < 50; sweep++) {
+        mixed diagonal = 0, offDiagonal = 0;
+        for (int i = 0; i < 4; i++) {
+            diagonal += fabs(F[i][i]);
+            for (int j = i+1; j < 4; j++)
+                offDiagonal += fabs(F[i][j]);
+        }
+        if (offDiagonal <= (mixed) 1e-10*diagonal)
+            break;
+        for (int p = 0; p < 3; p++)
+            for (int r = p+1; r < 4; r++) {
+                if (F[p][r] == 0)
+                    continue;
+
+                // Apply a rotation that eliminates element (p, r).
+
+                mixed theta = (F[r][r]-F[p][p])/(2*F[p][r]);
+                mixed t = 1/(fabs(theta)+sqrt(theta*theta+1));
+                if (theta < 0)
+                    t = -t;
+                mixed c = 1/sqrt(t*t+1);
+                mixed s = t*c;
+                for (int k = 0; k < 4; k++) {
+                    mixed fkp = F[k][p], fkr = F[k][r];
+                    F[k][p] = c*fkp - s*fkr;
+                    F[k][r] = s*fkp + c*fkr;
+                }
+                for (int k = 0; k < 4; k++) {
+                    mixed fpk = F[p][k], frk = F[r][k];
+                    F[p][k] = c*fpk - s*frk;
+                    F[r][k] = s*fpk + c*frk;
+                }
+                for (int k = 0; k < 4; k++) {
+                    mixed vkp = V[k][p], vkr = V[k][r];
+                    V[k][p] = c*vkp - s*vkr;
+                    V[k][r] = s*vkp + c*vkr;
+                }
+            }
+    }
+    int largest = 0;
+    for (int i = 1; i < 4; i++)
+        if (F[i][i] > F[largest][largest])
+            largest = i;
+    for (int i = 0; i < 4; i++)
+        q[i] = V[i][largest];
+    return F[largest][largest];
+}
+
+/**
+ * Perform the first step of computing the RMSD.  This is executed as a single work group.  It computes
+ * the optimal rotation and the RMSD entirely on the device, so the host never needs to wait for it.
  */
 KERNEL void computeRMSDPart1(int numParticles, GLOBAL const real4* RESTRICT posq, GLOBAL const real4* RESTRICT referencePos,
-        GLOBAL const int* RESTRICT particles, GLOBAL real* buffer) {
+        GLOBAL const int* RESTRICT particles, GLOBAL real* buffer, real sumNormRef, GLOBAL mixed* RESTRICT energyBuffer) {
     LOCAL volatile real temp[THREAD_BLOCK_SIZE];
 
     // Compute the center of the particle positions.
@@ -62,13 +117,52 @@ KERNEL void computeRMSDPart1(int numParticles, GLOBAL const real4* RESTRICT posq
             R[i][j] = reduceValue(R[i][j], temp);
     sum = reduceValue(sum, temp);
 
-    // Copy everything into the output buffer to send back to the host.
-    
+    // Build the F matrix, and find its largest eigenvalue and the corresponding eigenvector.
+
     if (LOCAL_ID == 0) {
-        for (int i = 0; i < 3; i++)
-            for (int j = 0; j < 3; j++)
-                buffer[3*i+j] = R[i][j];
-        buffer[9] = sum;
+        mixed F[4][4];
+        F[0][0] =  R[0][0] + R[1][1] + R[2][2];
+        F[1][0] =  R[1][2] - R[2][1];
+        F[2][0] =  R[2][0] - R[0][2];
+        F[3][0] =  R[0][1] - R[1][0];
+        F[0][1] =  R[1][2] - R[2][1];
+        F[1][1] =  R[0][0] - R[1][1] - R[2][2];
+        F[2][1] =  R[0][1] + R[1][0];
+        F[3][1] =  R[0][2] + R[2][0];
+        F[0][2] =  R[2][0] - R[0][2];
+        F[1][2] =  R[0][1] + R[1][0];
+        F[2][2] = -R[0][0] + R[1][1] - R[2][2];
+        F[3][2] =  R[1][2] + R[2][1];
+        F[0][3] =  R[0][1] - R[1][0];
+        F[1][3] =  R[0][2] + R[2][0];
+        F[2][3] =  R[1][2] + R[2][1];
+        F[3][3] = -R[0][0] - R[1][1] + R[2][2];
+        mixed q[4];
+        mixed eigenvalue = findLargestEigenvector(F, q);
+
+        // Compute the RMSD.  If the particles are perfectly aligned, all the forces should be zero.
+        // Numerical error can lead to NaNs, so record an RMSD of 0 to tell the force kernel to skip them.
+
+        mixed msd = (sumNormRef+sum-2*eigenvalue)/numParticles;
+        mixed rmsd = (msd < (mixed) 1e-20 ? 0 : sqrt(msd));
+        energyBuffer[0] += rmsd;
+
+        // Record the rotation matrix and everything else needed to compute forces.
+
+        mixed q00 = q[0]*q[0], q01 = q[0]*q[1], q02 = q[0]*q[2], q03 = q[0]*q[3];
+        mixed q11 = q[1]*q[1], q12 = q[1]*q[2], q13 = q[1]*q[3];
+        mixed q22 = q[2]*q[2], q23 = q[2]*q[3];
+        mixed q33 = q[3]*q[3];
+        buffer[0] = q00+q11-q22-q33;
+        buffer[1] = 2*(q12-q03);
+        buffer[2] = 2*(q13+q02);
+        buffer[3] = 2*(q12+q03);
+        buffer[4] = q00-q11+q22-q33;
+        buffer[5] = 2*(q23-q01);
+        buffer[6] = 2*(q13-q02);
+        buffer[7] = 2*(q23+q01);
+        buffer[8] = q00-q11-q22+q33;
+        buffer[9] = rmsd;
         buffer[10] = center.x;
         buffer[11] = center.y;
         buffer[12] = center.z;
@@ -80,6 +174,8 @@ KERNEL void computeRMSDPart1(int numParticles, GLOBAL const real4* RESTRICT posq
  */
 KERNEL void computeRMSDForces(int numParticles, int paddedNumAtoms, GLOBAL const real4* RESTRICT posq, GLOBAL const real4* RESTRICT referencePos,
         GLOBAL const int* RESTRICT particles, GLOBAL const real* buffer, GLOBAL mm_long* RESTRICT forceBuffers) {
+    if (buffer[9] == 0)
+        return;
     real3 center = make_real3(buffer[10], buffer[11], buffer[12]);
     real scale = 1 / (real) (buffer[9]*numParticles);
     for (int i = GLOBAL_ID; i < numParticles; i += GLOBAL_SIZE) {
@@ -0,0 +1,10 @@
+/**
+ * Multiply all velocities by a constant factor.  The fourth component of each element is the
+ * inverse mass, so it is left unchanged.
+ */
+KERNEL void scaleVelocities(GLOBAL mixed4* RESTRICT velm, mixed scale) {
+    for (int i = GLOBAL_ID; i < NUM_ATOMS; i += GLOBAL_SIZE) {
+        mixed4 v = velm[i];
+        velm[i] = make_mixed4(v.x*scale, v.y*scale, v.z*scale, v.w);
+    }
+}
@@ -0,0 +1,198 @@
+/**
+ * Load the position of a particle.
+ */
+inline DEVICE mixed4 loadPos(GLOBAL const real4* RESTRICT posq, GLOBAL const real4* RESTRICT posqCorrection, int index) {
+#ifdef USE_MIXED_PRECISION
+    real4 pos1 = posq[index];
+    real4 pos2 = posqCorrection[index];
+    return make_mixed4(pos1.x+(mixed)pos2.x, pos1.y+(mixed)pos2.y, pos1.z+(mixed)pos2.z, pos1.w);
+#else
+    return posq[index];
+#endif
+}
+
+/**
+ * Store the position of a particle.
+ */
+inline DEVICE void storePos(GLOBAL real4* RESTRICT posq, GLOBAL real4* RESTRICT posqCorrection, int index, mixed4 pos) {
+#ifdef USE_MIXED_PRECISION
+    posq[index] = make_real4((real) pos.x, (real) pos.y, (real) pos.z, (real) pos.w);
+    posqCorrection[index] = make_real4(pos.x-(real) pos.x, pos.y-(real) pos.y, pos.z-(real) pos.z, 0);
+#else
+    posq[index] = pos;
+#endif
+}
+
+/**
+ * Apply the SETTLE algorithm to the position deltas of one cluster.  apos0, apos1, and apos2 are the
+ * positions of the three atoms at the start of the step, and the deltas are modified in place.
+ */
+DEVICE void applySettleToCluster(mixed4 apos0, mixed4 apos1, mixed4 apos2, mixed4* delta0, mixed4* delta1, mixed4* delta2,
+        mixed m0, mixed m1, mixed m2, float2 params) {
+    mixed4 xp0 = *delta0;
+    mixed4 xp1 = *delta1;
+    mixed4 xp2 = *delta2;
+
+    mixed xb0 = apos1.x-apos0.x;
+    mixed yb0 = apos1.y-apos0.y;
+    mixed zb0 = apos1.z-apos0.z;
+    mixed xc0 = apos2.x-apos0.x;
+    mixed yc0 = apos2.y-apos0.y;
+    mixed zc0 = apos2.z-apos0.z;
+
+    mixed invTotalMass = 1/(m0+m1+m2);
+    mixed xcom = (xp0.x*m0 + (xb0+xp1.x)*m1 + (xc0+xp2.x)*m2) * invTotalMass;
+    mixed ycom = (xp0.y*m0 + (yb0+xp1.y)*m1 + (yc0+xp2.y)*m2) * invTotalMass;
+    mixed zcom = (xp0.z*m0 + (zb0+xp1.z)*m1 + (zc0+xp2.z)*m2) * invTotalMass;
+
+    mixed xa1 = xp0.x - xcom;
+    mixed ya1 = xp0.y - ycom;
+    mixed za1 = xp0.z - zcom;
+    mixed xb1 = xb0 + xp1.x - xcom;
+    mixed yb1 = yb0 + xp1.y - ycom;
+    mixed zb1 = zb0 + xp1.z - zcom;
+    mixed xc1 = xc0 + xp2.x - xcom;
+    mixed yc1 = yc0 + xp2.y - ycom;
+    mixed zc1 = zc0 + xp2.z - zcom;
+
+    mixed xaksZd = yb0*zc0 - zb0*yc0;
+    mixed yaksZd = zb0*xc0 - xb0*zc0;
+    mixed zaksZd = xb0*yc0 - yb0*xc0;
+    mixed xaksXd = ya1*zaksZd - za1*yaksZd;
+    mixed yaksXd = za1*xaksZd - xa1*zaksZd;
+    mixed zaksXd = xa1*yaksZd - ya1*xaksZd;
+    mixed xaksYd = yaksZd*zaksXd - zaksZd*yaksXd;
+    mixed yaksYd = zaksZd*xaksXd - xaksZd*zaksXd;
+    mixed zaksYd = xaksZd*yaksXd - yaksZd*xaksXd;
+
+    mixed axlng = sqrt(xaksXd*xaksXd + yaksXd*yaksXd + zaksXd*zaksXd);
+    mixed aylng = sqrt(xaksYd*xaksYd + yaksYd*yaksYd + zaksYd*zaksYd);
+    mixed azlng = sqrt(xaksZd*xaksZd + yaksZd*yaksZd + zaksZd*zaksZd);
+    mixed trns11 = xaksXd / axlng;
+    mixed trns21 = yaksXd / axlng;
+    mixed trns31 = zaksXd / axlng;
+    mixed trns12 = xaksYd / aylng;
+    mixed trns22 = yaksYd / aylng;
+    mixed trns32 = zaksYd / aylng;
+    mixed trns13 = xaksZd / azlng;
+    mixed trns23 = yaksZd / azlng;
+    mixed trns33 = zaksZd / azlng;
+
+    mixed xb0d = trns11*xb0 + trns21*yb0 + trns31*zb0;
+    mixed yb0d = trns12*xb0 + trns22*yb0 + trns32*zb0;
+    mixed xc0d = trns11*xc0 + trns21*yc0 + trns31*zc0;
+    mixed yc0d = trns12*xc0 + trns22*yc0 + trns32*zc0;
+    mixed za1d = trns13*xa1 + trns23*ya1 + trns33*za1;
+    mixed xb1d = trns11*xb1 + trns21*yb1 + trns31*zb1;
+    mixed yb1d = trns12*xb1 + trns22*yb1 + trns32*zb1;
+    mixed zb1d = trns13*xb1 + trns23*yb1 + trns33*zb1;
+    mixed xc1d = trns11*xc1 + trns21*yc1 + trns31*zc1;
+    mixed yc1d = trns12*xc1 + trns22*yc1 + trns32*zc1;
+    mixed zc1d = trns13*xc1 + trns23*yc1 + trns33*zc1;
+
+    //                                        --- Step2  A2' ---
+
+    float rc = 0.5f*params.y;
+    mixed rb = sqrt(params.x*params.x-rc*rc);
+    mixed ra = rb*(m1+m2)*invTotalMass;
+    rb -= ra;
+    mixed sinphi = za1d/ra;
+    mixed cosphi = sqrt(1-sinphi*sinphi);
+    mixed sinpsi = (zb1d-zc1d) / (2*rc*cosphi);
+    mixed cospsi = sqrt(1-sinpsi*sinpsi);
+
+    mixed ya2d =   ra*cosphi;
+    mixed xb2d = - rc*cospsi;
+    mixed yb2d = - rb*cosphi - rc*sinpsi*sinphi;
+    mixed yc2d = - rb*cosphi + rc*sinpsi*sinphi;
+    mixed xb2d2 = xb2d*xb2d;
+    mixed hh2 = 4.0f*xb2d2 + (yb2d-yc2d)*(yb2d-yc2d) + (zb1d-zc1d)*(zb1d-zc1d);
+    mixed deltx = 2.0f*xb2d + sqrt(4.0f*xb2d2 - hh2 + params.y*params.y);
+    xb2d -= deltx*0.5f;
+
+    //                                        --- Step3  al,be,ga ---
+
+    mixed alpha = (xb2d*(xb0d-xc0d) + yb0d*yb2d + yc0d*yc2d);
+    mixed beta = (xb2d*(yc0d-yb0d) + xb0d*yb2d + xc0d*yc2d);
+    mixed gamma = xb0d*yb1d - xb1d*yb0d + xc0d*yc1d - xc1d*yc0d;
+
+    mixed al2be2 = alpha*alpha + beta*beta;
+    mixed sintheta = (alpha*gamma - beta*sqrt(al2be2 - gamma*gamma)) / al2be2;
+
+    //                                        --- Step4  A3' ---
+
+    mixed costheta = sqrt(1-sintheta*sintheta);
+    mixed xa3d = - ya2d*sintheta;
+    mixed ya3d =   ya2d*costheta;
+    mixed za3d = za1d;
+    mixed xb3d =   xb2d*costheta - yb2d*sintheta;
+    mixed yb3d =   xb2d*sintheta + yb2d*costheta;
+    mixed zb3d = zb1d;
+    mixed xc3d = - xb2d*costheta - yc2d*sintheta;
+    mixed yc3d = - xb2d*sintheta + yc2d*costheta;
+    mixed zc3d = zc1d;
+
+    //                                        --- Step5  A3 ---
+
+    mixed xa3 = trns11*xa3d + trns12*ya3d + trns13*za3d;
+    mixed ya3 = trns21*xa3d + trns22*ya3d + trns23*za3d;
+    mixed za3 = trns31*xa3d + trns32*ya3d + trns33*za3d;
+    mixed xb3 = trns11*xb3d + trns12*yb3d + trns13*zb3d;
+    mixed yb3 = trns21*xb3d + trns22*yb3d + trns23*zb3d;
+    mixed zb3 = trns31*xb3d + trns32*yb3d + trns33*zb3d;
+    mixed xc3 = trns11*xc3d + trns12*yc3d + trns13*zc3d;
+    mixed yc3 = trns21*xc3d + trns22*yc3d + trns23*zc3d;
+    mixed zc3 = trns31*xc3d + trns32*yc3d + trns33*zc3d;
+
+    xp0.x = xcom + xa3;
+    xp0.y = ycom + ya3;
+    xp0.z = zcom + za3;
+    xp1.x = xcom + xb3 - xb0;
+    xp1.y = ycom + yb3 - yb0;
+    xp1.z = zcom + zb3 - zb0;
+    xp2.x = xcom + xc3 - xc0;
+    xp2.y = ycom + yc3 - yc0;
+    xp2.z = zcom + zc3 - zc0;
+
+    *delta0 = xp0;
+    *delta1 = xp1;
+    *delta2 = xp2;
+}
+
+inline DEVICE mixed4 selectClusterPos(int slot, mixed4 pos0, mixed4 pos1, mixed4 pos2) {
+    return (slot == 0 ? pos0 : (slot == 1 ? pos1 : pos2));
+}
+
+/**
+ * Compute the positions of the virtual sites whose parent particles all belong to one SETTLE cluster.
+ * pos0, pos1, and pos2 are the new positions of the cluster's atoms, in the same order as in settleAtoms.
+ * Each site is described by an int4 containing the site's index, the slots of its parent particles within
+ * the cluster (two bits each), and its type (0 for an average of the parents, 1 for an out of plane site).
+ */
+DEVICE void computeSettleVirtualSites(int cluster, mixed4 pos0, mixed4 pos1, mixed4 pos2, GLOBAL real4* RESTRICT posq,
+        GLOBAL real4* RESTRICT posqCorrection, GLOBAL const int* RESTRICT siteStart, GLOBAL const int4* RESTRICT siteAtoms,
+        GLOBAL const real4* RESTRICT siteWeights) {
+    int end = siteStart[cluster+1];
+    for (int i = siteStart[cluster]; i < end; i++) {
+        int4 site = siteAtoms[i];
+        real4 weights = siteWeights[i];
+        mixed4 p1 = selectClusterPos(site.y&3, pos0, pos1, pos2);
+        mixed4 p2 = selectClusterPos((site.y>>2)&3, pos0, pos1, pos2);
+        mixed4 p3 = selectClusterPos((site.y>>4)&3, pos0, pos1, pos2);
+        mixed4 pos = loadPos(posq, posqCorrection, site.x);
+        if (site.z == 0) {
+            pos.x = p1.x*weights.x + p2.x*weights.y + p3.x*weights.z;
+            pos.y = p1.y*weights.x + p2.y*weights.y + p3.y*weights.z;
+            pos.z = p1.z*weights.x + p2.z*weights.y + p3.z*weights.z;
+        }
+        else {
+            mixed4 v12 = p2-p1;
+            mixed4 v13 = p3-p1;
+            mixed4 cr = cross(v12, v13);
+            pos.x = p1.x + v12.x*weights.x + v13.x*weights.y + cr.x*weights.z;
+            pos.y = p1.y + v12.y*weights.x + v13.y*weights.y + cr.y*weights.z;
+            pos.z = p1.z + v12.z*weights.x + v13.z*weights.y + cr.z*weights.z;
+        }
+        storePos(posq, posqCorrection, site.x, pos);
+    }
+}
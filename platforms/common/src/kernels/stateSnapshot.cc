@@ -0,0 +1,29 @@
+/**
+ * Compute the inverse of an atom ordering, so invOrder[order[i]] == i.
+ */
+KERNEL void computeInverseOrder(GLOBAL const int* RESTRICT order, GLOBAL int* RESTRICT invOrder) {
+    for (int i = GLOBAL_ID; i < NUM_ATOMS; i += GLOBAL_SIZE)
+        invOrder[order[i]] = i;
+}
+
+/**
+ * Copy saved positions and velocities back into the context.  The atoms may have been reordered since
+ * the snapshot was saved, so each one is looked up through the inverse of the saved order.  The fourth
+ * component of each element (the charge or inverse mass) belongs to the context rather than the
+ * configuration, so it is left unchanged.
+ */
+KERNEL void restoreSnapshot(GLOBAL real4* RESTRICT posq, GLOBAL real4* RESTRICT posqCorrection, GLOBAL mixed4* RESTRICT velm,
+        GLOBAL const int* RESTRICT order, GLOBAL const real4* RESTRICT savedPosq, GLOBAL const real4* RESTRICT savedPosqCorrection,
+        GLOBAL const mixed4* RESTRICT savedVelm, GLOBAL const int* RESTRICT savedInvOrder) {
+    for (int i = GLOBAL_ID; i < NUM_ATOMS; i += GLOBAL_SIZE) {
+        int j = savedInvOrder[order[i]];
+        real4 p = savedPosq[j];
+        posq[i] = make_real4(p.x, p.y, p.z, posq[i].w);
+#ifdef USE_MIXED_PRECISION
+        real4 c = savedPosqCorrection[j];
+        posqCorrection[i] = make_real4(c.x, c.y, c.z, posqCorrection[i].w);
+#endif
+        mixed4 v = savedVelm[j];
+        velm[i] = make_mixed4(v.x, v.y, v.z, velm[i].w);
+    }
+}
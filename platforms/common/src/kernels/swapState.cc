@@ -0,0 +1,36 @@
+/**
+ * Compute the inverse of an atom ordering, so invOrder[order[i]] == i.
+ */
+KERNEL void computeInverseOrder(GLOBAL const int* RESTRICT order, GLOBAL int* RESTRICT invOrder) {
+    for (int i = GLOBAL_ID; i < NUM_ATOMS; i += GLOBAL_SIZE)
+        invOrder[order[i]] = i;
+}
+
+/**
+ * Exchange the positions and velocities of two contexts whose atoms may be stored in different orders.
+ * Each thread swaps one pair of entries, so the exchange can be done in place.  The fourth component
+ * of each element (the charge or inverse mass) belongs to the context rather than the configuration,
+ * so it is left unchanged.
+ */
+KERNEL void swapState(GLOBAL real4* RESTRICT posq1, GLOBAL real4* RESTRICT posqCorrection1, GLOBAL mixed4* RESTRICT velm1,
+        GLOBAL const int* RESTRICT order1, GLOBAL real4* RESTRICT posq2, GLOBAL real4* RESTRICT posqCorrection2,
+        GLOBAL mixed4* RESTRICT velm2, GLOBAL const int* RESTRICT invOrder2, mixed velocityScale) {
+    for (int i = GLOBAL_ID; i < NUM_ATOMS; i += GLOBAL_SIZE) {
+        int j = invOrder2[order1[i]];
+        real4 p1 = posq1[i];
+        real4 p2 = posq2[j];
+        posq1[i] = make_real4(p2.x, p2.y, p2.z, p1.w);
+        posq2[j] = make_real4(p1.x, p1.y, p1.z, p2.w);
+#ifdef USE_MIXED_PRECISION
+        real4 c1 = posqCorrection1[i];
+        real4 c2 = posqCorrection2[j];
+        posqCorrection1[i] = make_real4(c2.x, c2.y, c2.z, c1.w);
+        posqCorrection2[j] = make_real4(c1.x, c1.y, c1.z, c2.w);
+#endif
+        mixed4 v1 = velm1[i];
+        mixed4 v2 = velm2[j];
+        mixed invScale = 1/velocityScale;
+        velm1[i] = make_mixed4(v2.x*velocityScale, v2.y*velocityScale, v2.z*velocityScale, v1.w);
+        velm2[j] = make_mixed4(v1.x*invScale, v1.y*invScale, v1.z*invScale, v2.w);
+    }
+}
@@ -1,95 +1,158 @@
 /**
- * Perform the first step of Verlet integration.
+ * Update the velocity of one atom and compute the change in its position for the first step
+ * of Verlet integration.
+ */
+DEVICE mixed4 integrateVerletAtom(int index, int paddedNumAtoms, GLOBAL mixed4* RESTRICT velm, GLOBAL const mm_long* RESTRICT force,
+        mixed scale, mixed dtPos) {
+    mixed4 velocity = velm[index];
+    if (velocity.w == 0.0)
+        return make_mixed4(0, 0, 0, 0);
+    velocity.x += scale*force[index]*velocity.w;
+    velocity.y += scale*force[index+paddedNumAtoms]*velocity.w;
+    velocity.z += scale*force[index+paddedNumAtoms*2]*velocity.w;
+    velm[index] = velocity;
+    return make_mixed4(velocity.x*dtPos, velocity.y*dtPos, velocity.z*dtPos, 0);
+}
+
+/**
+ * Perform the first step of Verlet integration.  If FUSE_SETTLE is defined, atoms in SETTLE clusters
+ * are processed one cluster at a time, and SETTLE is applied to their position deltas before they
+ * are written.
  */
 
 KERNEL void integrateVerletPart1(int numAtoms, int paddedNumAtoms, GLOBAL const mixed2* RESTRICT dt, GLOBAL const real4* RESTRICT posq,
         GLOBAL mixed4* RESTRICT velm, GLOBAL const mm_long* RESTRICT force, GLOBAL mixed4* RESTRICT posDelta
 #ifdef USE_MIXED_PRECISION
         , GLOBAL const real4* RESTRICT posqCorrection
+#endif
+#ifdef FUSE_SETTLE
+        , GLOBAL const int* RESTRICT settleAtomFlags, GLOBAL const int4* RESTRICT settleAtoms, GLOBAL const float2* RESTRICT settleParams
 #endif
     ) {
     const mixed2 stepSize = dt[0];
+    if (stepSize.y == 0.0f)
+        return; // A variable step size integrator has already reached its target time.
     const mixed dtPos = stepSize.y;
     const mixed dtVel = 0.5f*(stepSize.x+stepSize.y);
     const mixed scale = dtVel/(mixed) 0x100000000;
     for (int index = GLOBAL_ID; index < numAtoms; index += GLOBAL_SIZE) {
-        mixed4 velocity = velm[index];
-        if (velocity.w != 0.0) {
-#ifdef USE_MIXED_PRECISION
-            real4 pos1 = posq[index];
-            real4 pos2 = posqCorrection[index];
-            mixed4 pos = make_mixed4(pos1.x+(mixed)pos2.x, pos1.y+(mixed)pos2.y, pos1.z+(mixed)pos2.z, pos1.w);
+#ifdef FUSE_SETTLE
+        if (settleAtomFlags[index])
+            continue;
+#endif
+        if (velm[index].w != 0.0)
+            posDelta[index] = integrateVerletAtom(index, paddedNumAtoms, velm, force, scale, dtPos);
+    }
+#ifdef FUSE_SETTLE
+#ifndef USE_MIXED_PRECISION
+    GLOBAL real4* posqCorrection = 0;
+#endif
+    for (int index = GLOBAL_ID; index < NUM_SETTLE_CLUSTERS; index += GLOBAL_SIZE) {
+        int4 atoms = settleAtoms[index];
+        mixed4 delta0 = integrateVerletAtom(atoms.x, paddedNumAtoms, velm, force, scale, dtPos);
+        mixed4 delta1 = integrateVerletAtom(atoms.y, paddedNumAtoms, velm, force, scale, dtPos);
+        mixed4 delta2 = integrateVerletAtom(atoms.z, paddedNumAtoms, velm, force, scale, dtPos);
+        applySettleToCluster(loadPos(posq, posqCorrection, atoms.x), loadPos(posq, posqCorrection, atoms.y), loadPos(posq, posqCorrection, atoms.z),
+                &delta0, &delta1, &delta2, 1/velm[atoms.x].w, 1/velm[atoms.y].w, 1/velm[atoms.z].w, settleParams[index]);
+        posDelta[atoms.x] = delta0;
+        posDelta[atoms.y] = delta1;
+        posDelta[atoms.z] = delta2;
+    }
+#endif
+}
+
+/**
+ * Update the position and velocity of one atom for the second step of Verlet integration.  This
+ * returns the new position.
+ */
+DEVICE mixed4 finishVerletAtom(int index, GLOBAL real4* RESTRICT posq, GLOBAL real4* RESTRICT posqCorrection, GLOBAL mixed4* RESTRICT velm,
+        GLOBAL const mixed4* RESTRICT posDelta,
+#ifdef SUPPORTS_DOUBLE_PRECISION
+        double oneOverDt
 #else
-            real4 pos = posq[index];
+        float oneOverDt, float correction
 #endif
-            velocity.x += scale*force[index]*velocity.w;
-            velocity.y += scale*force[index+paddedNumAtoms]*velocity.w;
-            velocity.z += scale*force[index+paddedNumAtoms*2]*velocity.w;
-            pos.x = velocity.x*dtPos;
-            pos.y = velocity.y*dtPos;
-            pos.z = velocity.z*dtPos;
-            posDelta[index] = pos;
-            velm[index] = velocity;
-        }
+        ) {
+    mixed4 pos = loadPos(posq, posqCorrection, index);
+    mixed4 velocity = velm[index];
+    if (velocity.w != 0.0) {
+        mixed4 delta = posDelta[index];
+        pos.x += delta.x;
+        pos.y += delta.y;
+        pos.z += delta.z;
+#ifdef SUPPORTS_DOUBLE_PRECISION
+        velocity = make_mixed4((mixed) (delta.x*oneOverDt), (mixed) (delta.y*oneOverDt), (mixed) (delta.z*oneOverDt), velocity.w);
+#else
+        velocity = make_mixed4((mixed) (delta.x*oneOverDt+delta.x*correction), (mixed) (delta.y*oneOverDt+delta.y*correction), (mixed) (delta.z*oneOverDt+delta.z*correction), velocity.w);
+#endif
+        storePos(posq, posqCorrection, index, pos);
+        velm[index] = velocity;
     }
+    return pos;
 }
 
 /**
- * Perform the second step of Verlet integration.
+ * Perform the second step of Verlet integration.  If FUSE_VIRTUAL_SITES is defined, atoms in SETTLE
+ * clusters are processed one cluster at a time, and the virtual sites that depend only on a cluster
+ * are computed from its new positions.
  */
 
 KERNEL void integrateVerletPart2(int numAtoms, GLOBAL mixed2* RESTRICT dt, GLOBAL real4* RESTRICT posq,
         GLOBAL mixed4* RESTRICT velm, GLOBAL const mixed4* RESTRICT posDelta
 #ifdef USE_MIXED_PRECISION
         , GLOBAL real4* RESTRICT posqCorrection
+#endif
+#ifdef FUSE_VIRTUAL_SITES
+        , GLOBAL const int* RESTRICT settleAtomFlags, GLOBAL const int4* RESTRICT settleAtoms, GLOBAL const int* RESTRICT settleVsiteStart,
+        GLOBAL const int4* RESTRICT settleVsiteAtoms, GLOBAL const real4* RESTRICT settleVsiteWeights
 #endif
     ) {
+#ifndef USE_MIXED_PRECISION
+    GLOBAL real4* posqCorrection = 0;
+#endif
     mixed2 stepSize = dt[0];
+    if (stepSize.y == 0.0f)
+        return;
 #ifdef SUPPORTS_DOUBLE_PRECISION
     double oneOverDt = 1.0/stepSize.y;
+#define DT_ARGS oneOverDt
 #else
     float oneOverDt = 1.0f/stepSize.y;
     float correction = (1.0f-oneOverDt*stepSize.y)/stepSize.y;
+#define DT_ARGS oneOverDt, correction
 #endif
     if (GLOBAL_ID == 0)
         dt[0].x = stepSize.y;
     SYNC_THREADS;
-    int index = GLOBAL_ID;
-    for (; index < numAtoms; index += GLOBAL_SIZE) {
-        mixed4 velocity = velm[index];
-        if (velocity.w != 0.0) {
-#ifdef USE_MIXED_PRECISION
-            real4 pos1 = posq[index];
-            real4 pos2 = posqCorrection[index];
-            mixed4 pos = make_mixed4(pos1.x+(mixed)pos2.x, pos1.y+(mixed)pos2.y, pos1.z+(mixed)pos2.z, pos1.w);
-#else
-            real4 pos = posq[index];
-#endif
-            mixed4 delta = posDelta[index];
-            pos.x += delta.x;
-            pos.y += delta.y;
-            pos.z += delta.z;
-#ifdef SUPPORTS_DOUBLE_PRECISION
-            velocity = make_mixed4((mixed) (delta.x*oneOverDt), (mixed) (delta.y*oneOverDt), (mixed) (delta.z*oneOverDt), velocity.w);
-#else
-            velocity = make_mixed4((mixed) (delta.x*oneOverDt+delta.x*correction), (mixed) (delta.y*oneOverDt+delta.y*correction), (mixed) (delta.z*oneOverDt+delta.z*correction), velocity.w);
-#endif
-#ifdef USE_MIXED_PRECISION
-            posq[index] = make_real4((real) pos.x, (real) pos.y, (real) pos.z, (real) pos.w);
-            posqCorrection[index] = make_real4(pos.x-(real) pos.x, pos.y-(real) pos.y, pos.z-(real) pos.z, 0);
-#else
-            posq[index] = pos;
+    for (int index = GLOBAL_ID; index < numAtoms; index += GLOBAL_SIZE) {
+#ifdef FUSE_VIRTUAL_SITES
+        if (settleAtomFlags[index])
+            continue;
 #endif
-            velm[index] = velocity;
-        }
+        if (velm[index].w != 0.0)
+            finishVerletAtom(index, posq, posqCorrection, velm, posDelta, DT_ARGS);
     }
+#ifdef FUSE_VIRTUAL_SITES
+    for (int index = GLOBAL_ID; index < NUM_SETTLE_CLUSTERS; index += GLOBAL_SIZE) {
+        int4 atoms = settleAtoms[index];
+        mixed4 pos0 = finishVerletAtom(atoms.x, posq, posqCorrection, velm, posDelta, DT_ARGS);
+        mixed4 pos1 = finishVerletAtom(atoms.y, posq, posqCorrection, velm, posDelta, DT_ARGS);
+        mixed4 pos2 = finishVerletAtom(atoms.z, posq, posqCorrection, velm, posDelta, DT_ARGS);
+        computeSettleVirtualSites(index, pos0, pos1, pos2, posq, posqCorrection, settleVsiteStart, settleVsiteAtoms, settleVsiteWeights);
+    }
+#endif
+#undef DT_ARGS
 }
 
 /**
- * Select the step size to use for the next step.
+ * Select the step size to use for the next step.  stepState keeps track of the steps taken since the
+ * host last checked: x is the total time they covered, y is the number of steps, z is nonzero once
+ * remainingTime has been reached, and w is the size of the most recent step.  Once remainingTime has
+ * been reached, the step size is set to 0 and the integration kernels do nothing.
  */
 
-KERNEL void selectVerletStepSize(int numAtoms, int paddedNumAtoms, mixed maxStepSize, mixed errorTol, GLOBAL mixed2* RESTRICT dt, GLOBAL const mixed4* RESTRICT velm, GLOBAL const mm_long* RESTRICT force) {
+KERNEL void selectVerletStepSize(int numAtoms, int paddedNumAtoms, mixed maxStepSize, mixed remainingTime, mixed errorTol, GLOBAL mixed2* RESTRICT dt,
+        GLOBAL const mixed4* RESTRICT velm, GLOBAL const mm_long* RESTRICT force, GLOBAL mixed4* RESTRICT stepState) {
     // Calculate the error.
 
     LOCAL mixed error[256];
@@ -111,15 +174,29 @@ KERNEL void selectVerletStepSize(int numAtoms, int paddedNumAtoms, mixed maxStep
         SYNC_THREADS;
     }
     if (LOCAL_ID == 0) {
+        mixed4 state = stepState[0];
         mixed totalError = SQRT(error[0]/(numAtoms*3));
         mixed newStepSize = SQRT(errorTol/totalError);
-        mixed oldStepSize = dt[0].y;
+        mixed oldStepSize = (dt[0].y > 0.0f ? dt[0].y : state.w);
         if (oldStepSize > 0.0f)
             newStepSize = min(newStepSize, oldStepSize*2.0f); // For safety, limit how quickly dt can increase.
         if (newStepSize > oldStepSize && newStepSize < 1.1f*oldStepSize)
             newStepSize = oldStepSize; // Keeping dt constant between steps improves the behavior of the integrator.
         if (newStepSize > maxStepSize)
             newStepSize = maxStepSize;
+        mixed timeLeft = remainingTime-state.x;
+        if (state.z != 0.0f || timeLeft <= 0.0f)
+            newStepSize = 0.0f;
+        else if (newStepSize >= timeLeft) {
+            newStepSize = timeLeft;
+            state.z = 1.0f;
+        }
+        if (newStepSize > 0.0f) {
+            state.x += newStepSize;
+            state.y += 1.0f;
+            state.w = newStepSize;
+        }
         dt[0].y = newStepSize;
+        stepState[0] = state;
     }
 }
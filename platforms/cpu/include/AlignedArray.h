@@ -32,12 +32,21 @@
  * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
  * -------------------------------------------------------------------------- */
 
+#include <cstdlib>
+#ifdef __linux__
+    #include <sys/mman.h>
+#endif
+
 namespace OpenMM {
 
 /**
  * This class represents an array in memory whose starting point is guaranteed to
  * be aligned with a 16 byte boundary.  This can improve the performance of vectorized
  * code, since loads and stores are more efficient.
+ *
+ * Large arrays can optionally be backed by transparent huge pages, which reduces TLB
+ * misses when a loop streams through many megabytes of data.  This is only supported
+ * on Linux, and is ignored elsewhere.
  */
 template <class T>
 class AlignedArray {
@@ -45,17 +54,16 @@ public:
     /**
      * Default constructor, to allow AlignedArrays to be used inside collections.
      */
-    AlignedArray() : dataSize(0), baseData(0), data(0) {
+    AlignedArray() : dataSize(0), baseData(0), data(0), useHugePages(false), isHugePageAllocation(false) {
     }
     /**
      * Create an Aligned array that contains a specified number of elements.
      */
-    AlignedArray(int size) {
+    AlignedArray(int size) : useHugePages(false) {
         allocate(size);
     }
     ~AlignedArray() {
-        if (baseData != 0)
-            delete[] baseData;
+        release();
     }
     /**
      * Get the number of elements in the array.
@@ -69,10 +77,27 @@ public:
     void resize(int size) {
         if (dataSize == size)
             return;
-        if (baseData != 0)
-            delete[] baseData;
+        release();
         allocate(size);
     }
+    /**
+     * Set whether the array should request huge pages from the operating system.  This only
+     * affects arrays of at least HugePageSize bytes.  Changing it causes all contents to be lost.
+     */
+    void setUseHugePages(bool use) {
+        if (use == useHugePages)
+            return;
+        useHugePages = use;
+        int size = dataSize;
+        release();
+        allocate(size);
+    }
+    /**
+     * Get whether the array requests huge pages from the operating system.
+     */
+    bool getUseHugePages() const {
+        return useHugePages;
+    }
     /**
      * Get a reference to an element of the array.
      */
@@ -85,20 +110,53 @@ public:
     const T& operator[](int i) const {
         return data[i];
     }
+    /**
+     * The size of a huge page on x86 and most ARM systems.  Smaller arrays always use ordinary pages.
+     */
+    static const size_t HugePageSize = 2*1024*1024;
 private:
     void allocate(int size) {
         dataSize = size;
+        isHugePageAllocation = false;
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+        size_t bytes = size*sizeof(T);
+        if (useHugePages && bytes >= HugePageSize) {
+            // Align to a huge page boundary and round the length up to whole huge pages, so the kernel
+            // can back the entire array with them.  If it refuses, the memory is still valid and simply
+            // uses ordinary pages.
+
+            bytes = (bytes+HugePageSize-1)/HugePageSize*HugePageSize;
+            void* memory;
+            if (posix_memalign(&memory, HugePageSize, bytes) == 0) {
+                madvise(memory, bytes, MADV_HUGEPAGE);
+                baseData = (char*) memory;
+                data = (T*) memory;
+                isHugePageAllocation = true;
+                return;
+            }
+        }
+#endif
         baseData = new char[size*sizeof(T)+16];
         char* offsetData = baseData+15;
         offsetData -= (long long)offsetData&0xF;
         data = (T*) offsetData;
     }
+    void release() {
+        if (baseData == 0)
+            return;
+        if (isHugePageAllocation)
+            free(baseData);
+        else
+            delete[] baseData;
+        baseData = 0;
+        data = 0;
+    }
     int dataSize;
     char* baseData;
     T* data;
+    bool useHugePages, isHugePageAllocation;
 };
 
 } // namespace OpenMM
 
 #endif /*OPENMM_ALIGNEDARRAY_H_*/
-
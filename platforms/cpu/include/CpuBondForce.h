@@ -56,11 +56,20 @@ public:
      */
     void calculateForce(std::vector<OpenMM::Vec3>& atomCoordinates, std::vector<std::vector<double> >& parameters, std::vector<OpenMM::Vec3>& forces, 
             double* totalEnergy, ReferenceBondIxn& referenceBondIxn);
+    /**
+     * Compute the forces from all bonds, giving each thread its own ReferenceBondIxn.  This is needed when the
+     * ReferenceBondIxn is not thread safe, such as one that evaluates compiled expressions.
+     *
+     * @param threadBondIxn      the ReferenceBondIxn to use for each thread
+     * @param energyParamDerivs  derivatives of the energy with respect to global parameters are added to this
+     */
+    void calculateForce(std::vector<OpenMM::Vec3>& atomCoordinates, std::vector<std::vector<double> >& parameters, std::vector<OpenMM::Vec3>& forces, 
+            double* totalEnergy, std::vector<ReferenceBondIxn*>& threadBondIxn, std::vector<double>& energyParamDerivs);
     /**
      * This routine contains the code executed by each thread.
      */
     void threadComputeForce(ThreadPool& threads, int threadIndex, std::vector<OpenMM::Vec3>& atomCoordinates, std::vector<std::vector<double> >& parameters,
-            std::vector<OpenMM::Vec3>& forces, double* totalEnergy, ReferenceBondIxn& referenceBondIxn);
+            std::vector<OpenMM::Vec3>& forces, double* totalEnergy, ReferenceBondIxn& referenceBondIxn, double* energyParamDerivs=NULL);
 private:
     bool canAssignBond(int bond, int thread, std::vector<int>& atomThread);
     void assignBond(int bond, int thread, std::vector<int>& atomThread, std::vector<int>& bondThread, std::vector<std::set<int> >& atomBonds, std::list<int>& candidateBonds);
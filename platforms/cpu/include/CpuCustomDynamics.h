@@ -0,0 +1,73 @@
+
+/* Portions copyright (c) 2021 Stanford University and Simbios.
+ * Authors: Peter Eastman
+ * Contributors: 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __CPU_CUSTOM_DYNAMICS_H__
+#define __CPU_CUSTOM_DYNAMICS_H__
+
+#include "ReferenceCustomDynamics.h"
+#include "openmm/internal/ThreadPool.h"
+
+namespace OpenMM {
+
+/**
+ * This class extends ReferenceCustomDynamics to evaluate per-DOF computations in parallel.
+ * Each thread gets its own copy of every per-DOF expression, with its own storage for the
+ * per-DOF variables.  Computations that involve random numbers are still done on a single
+ * thread, since they draw from a single sequential random number generator.
+ */
+class CpuCustomDynamics : public ReferenceCustomDynamics {
+public:
+    /**
+     * Constructor.
+     *
+     * @param numberOfAtoms  number of atoms
+     * @param integrator     the integrator definition to use
+     * @param threads        thread pool for parallelizing computation
+     */
+    CpuCustomDynamics(int numberOfAtoms, const OpenMM::CustomIntegrator& integrator, OpenMM::ThreadPool& threads);
+
+    /**
+     * Destructor.
+     */
+    ~CpuCustomDynamics();
+
+private:
+    struct ThreadVariables {
+        double x, v, m, f, gaussian, uniform;
+        std::vector<double> perDofVariable;
+    };
+    void initialize(OpenMM::ContextImpl& context, std::vector<double>& masses, std::map<std::string, double>& globals);
+    void createThreadExpressions(const Lepton::CompiledExpression& expression);
+    void computePerDof(int numberOfAtoms, std::vector<OpenMM::Vec3>& results, const std::vector<OpenMM::Vec3>& atomCoordinates,
+                  const std::vector<OpenMM::Vec3>& velocities, const std::vector<OpenMM::Vec3>& forces, const std::vector<double>& masses,
+                  const std::vector<std::vector<OpenMM::Vec3> >& perDof, const Lepton::CompiledExpression& expression);
+    OpenMM::ThreadPool& threads;
+    std::vector<ThreadVariables> threadVariables;
+    std::map<const Lepton::CompiledExpression*, std::vector<Lepton::CompiledExpression> > threadExpressions;
+};
+
+} // namespace OpenMM
+
+#endif // __CPU_CUSTOM_DYNAMICS_H__
@@ -27,6 +27,8 @@
 
 #include "AlignedArray.h"
 #include "CpuNeighborList.h"
+#include "lepton/CompiledVectorExpression.h"
+#include "lepton/ParsedExpression.h"
 #include "openmm/internal/CompiledExpressionSet.h"
 #include "openmm/internal/ThreadPool.h"
 #include "openmm/internal/vectorize.h"
@@ -47,9 +49,9 @@ class CpuCustomNonbondedForce {
 
          --------------------------------------------------------------------------------------- */
 
-       CpuCustomNonbondedForce(const Lepton::CompiledExpression& energyExpression, const Lepton::CompiledExpression& forceExpression,
+       CpuCustomNonbondedForce(const Lepton::ParsedExpression& energyExpression, const Lepton::ParsedExpression& forceExpression,
                                const std::vector<std::string>& parameterNames, const std::vector<std::set<int> >& exclusions,
-                               const std::vector<Lepton::CompiledExpression> energyParamDerivExpressions, ThreadPool& threads);
+                               const std::vector<Lepton::ParsedExpression> energyParamDerivExpressions, ThreadPool& threads);
 
       /**---------------------------------------------------------------------------------------
 
@@ -129,6 +131,7 @@ private:
     bool periodic;
     bool triclinic;
     bool useInteractionGroups;
+    int vectorWidth;
     const CpuNeighborList* neighborList;
     float recipBoxSize[3];
     Vec3 periodicBoxVectors[3];
@@ -168,6 +171,21 @@ private:
      */
     void calculateOneIxn(int atom1, int atom2, ThreadData& data, float* forces, double& totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize);
 
+    /**
+     * Calculate the interactions between one atom and a set of vectorWidth atoms from a neighbor list block,
+     * evaluating the expressions for all of them at once.
+     * 
+     * @param atom1            the index of the first atom
+     * @param atoms            the indices of the other atoms
+     * @param exclusionMask    bit k is set if the interaction with atoms[k] should be skipped
+     * @param data             workspace for the current thread
+     * @param forces           force array (forces added)
+     * @param totalEnergy      total energy
+     * @param boxSize          the size of the periodic box
+     * @param boxSize          the inverse size of the periodic box
+     */
+    void calculateBlockIxn(int atom1, const int32_t* atoms, int exclusionMask, ThreadData& data, float* forces, double& totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize);
+
     /**
      * Compute the displacement and squared distance between two points, optionally using
      * periodic boundary conditions.
@@ -177,8 +195,8 @@ private:
 
 class CpuCustomNonbondedForce::ThreadData {
 public:
-    ThreadData(const Lepton::CompiledExpression& energyExpression, const Lepton::CompiledExpression& forceExpression, const std::vector<std::string>& parameterNames,
-            const std::vector<Lepton::CompiledExpression> energyParamDerivExpressions);
+    ThreadData(const Lepton::ParsedExpression& energyExpression, const Lepton::ParsedExpression& forceExpression, const std::vector<std::string>& parameterNames,
+            const std::vector<Lepton::ParsedExpression>& energyParamDerivExpressions, int vectorWidth);
     Lepton::CompiledExpression energyExpression;
     Lepton::CompiledExpression forceExpression;
     std::vector<Lepton::CompiledExpression> energyParamDerivExpressions;
@@ -186,6 +204,15 @@ public:
     std::vector<double> particleParam;
     double r;
     std::vector<double> energyParamDerivs; 
+    // The following are used for evaluating vectorWidth interactions at once.
+    int vectorWidth;
+    Lepton::CompiledVectorExpression vecEnergyExpression;
+    Lepton::CompiledVectorExpression vecForceExpression;
+    std::vector<Lepton::CompiledVectorExpression> vecEnergyParamDerivExpressions;
+    std::vector<float> vecR;
+    std::vector<float> vecParticleParam;
+    std::map<std::string, std::vector<float> > vecGlobalParams;
+    std::vector<const float*> vecEnergyParamDerivs;
 };
 
 } // namespace OpenMM
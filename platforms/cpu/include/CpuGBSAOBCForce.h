@@ -26,6 +26,7 @@
 #define OPENMM_CPU_GBSAOBC_FORCE_H__
 
 #include "AlignedArray.h"
+#include "CpuNeighborList.h"
 #include "openmm/internal/ThreadPool.h"
 #include "openmm/internal/vectorize.h"
 #include <atomic>
@@ -40,11 +41,14 @@ public:
     CpuGBSAOBCForce();
 
     /**
-     * Set the force to use a cutoff.
+     * Set the force to use a cutoff.  This must be called before every call to computeForce(), after
+     * the neighbor list has been built.
      * 
      * @param distance    the cutoff distance
+     * @param neighbors   the neighbor list to use.  It must have a block size of 4, and must include
+     *                    every pair within the cutoff, since GBSA interactions are never excluded.
      */
-    void setUseCutoff(float distance);
+    void setUseCutoff(float distance, const CpuNeighborList& neighbors);
 
     /**
      * 
@@ -106,6 +110,9 @@ private:
     AlignedArray<float> bornRadii;
     std::vector<AlignedArray<float> > threadBornForces;
     AlignedArray<float> obcChain;
+    const CpuNeighborList* neighborList;
+    std::vector<AlignedArray<float> > threadBornSums;
+    AlignedArray<float> bornForceChain;
     std::vector<double> threadEnergy;
     std::vector<float> logTable;
     float logDX, logDXInv;
@@ -119,6 +126,24 @@ private:
     static const float TABLE_MIN;
     static const float TABLE_MAX;
 
+    /**
+     * The code executed by each thread when a neighbor list is used.  Each pair in the list is visited
+     * once per pass, and its contributions to both atoms are computed together.
+     */
+    void threadComputeForceWithNeighborList(ThreadPool& threads, int threadIndex);
+
+    /**
+     * Compute the contribution of atom J to the Born radius sum of atom I.  Lanes that are not included
+     * are set to zero.
+     */
+    fvec4 computeBornRadiusTerm(const fvec4& r, const fvec4& rInverse, const fvec4& offsetRadiusI, const fvec4& radiusIInverse, const fvec4& scaledRadiusJ, ivec4 include);
+
+    /**
+     * Compute the derivative of the Born radius sum of atom I with respect to its distance from atom J,
+     * divided by the distance.  Lanes that are not included are set to zero.
+     */
+    fvec4 computeChainRuleTerm(const fvec4& r, const fvec4& rInverse, const fvec4& offsetRadiusI, const fvec4& scaledRadiusJ, ivec4 include);
+
     /**
      * Compute the displacement and squared distance between a collection of points, optionally using
      * periodic boundary conditions.
@@ -33,6 +33,7 @@
  * -------------------------------------------------------------------------- */
 
 #include "CpuBondForce.h"
+#include "CpuCustomDynamics.h"
 #include "CpuCustomGBForce.h"
 #include "CpuCustomManyParticleForce.h"
 #include "CpuCustomNonbondedForce.h"
@@ -43,7 +44,13 @@
 #include "CpuNeighborList.h"
 #include "CpuNonbondedForce.h"
 #include "CpuPlatform.h"
+#include "CpuVerletDynamics.h"
+#include "ReferenceKernels.h"
+#include "ReferenceCustomAngleIxn.h"
+#include "ReferenceCustomBondIxn.h"
+#include "ReferenceCustomTorsionIxn.h"
 #include "openmm/kernels.h"
+#include "openmm/internal/CustomNonbondedForceImpl.h"
 #include "openmm/System.h"
 #include <array>
 #include <tuple>
@@ -90,9 +97,58 @@ public:
      */
     double finishComputation(ContextImpl& context, bool includeForce, bool includeEnergy, int groups, bool& valid);
 private:
+    /**
+     * Choose the neighbor list padding to use for the next block of steps, based on the average
+     * cost of an evaluation since the last time it was changed.
+     */
+    void tunePadding();
     CpuPlatform::PlatformData& data;
     Kernel referenceKernel;
     std::vector<Vec3> lastPositions;
+    double computationStartTime, windowTime, lastWindowCost, paddingStep;
+    int windowEvaluations, windowRebuilds, convergedWindows;
+};
+
+/**
+ * This kernel reports statistics describing the neighbor list as part of a Context's performance report.
+ * The CPU platform does not record the time spent in individual kernels.
+ */
+class CpuProfileKernel : public ProfileKernel {
+public:
+    CpuProfileKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data) : ProfileKernel(name, platform), data(data) {
+    }
+    /**
+     * Initialize the kernel.
+     *
+     * @param system     the System this kernel will be applied to
+     */
+    void initialize(const System& system) {
+    }
+    /**
+     * Set whether to record the time spent executing each kernel.  This does nothing.
+     */
+    void setProfilingEnabled(ContextImpl& context, bool enabled) {
+    }
+    /**
+     * Set which force groups subsequently launched kernels should be attributed to while profiling.
+     * This does nothing.
+     */
+    void setProfiledForceGroups(ContextImpl& context, int groups) {
+    }
+    /**
+     * Set the owner that memory allocated from now on should be attributed to.  This does nothing.
+     */
+    void setMemoryOwner(ContextImpl& context, const std::string& owner) {
+    }
+    /**
+     * Get a report of statistics describing the neighbor list.
+     *
+     * @param context    the context in which to execute this kernel
+     * @param report     on exit, this contains the statistics
+     */
+    void getPerformanceReport(ContextImpl& context, std::map<std::string, double>& report);
+private:
+    CpuPlatform::PlatformData& data;
 };
 
 /**
@@ -215,6 +271,220 @@ private:
     bool usePeriodic;
 };
 
+/**
+ * This kernel is invoked by CustomBondForce to calculate the forces acting on the system and the energy of the system.
+ */
+class CpuCalcCustomBondForceKernel : public CalcCustomBondForceKernel {
+public:
+    CpuCalcCustomBondForceKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data) :
+            CalcCustomBondForceKernel(name, platform), data(data), usePeriodic(false) {
+    }
+    ~CpuCalcCustomBondForceKernel();
+    /**
+     * Initialize the kernel.
+     * 
+     * @param system     the System this kernel will be applied to
+     * @param force      the CustomBondForce this kernel will be used for
+     */
+    void initialize(const System& system, const CustomBondForce& force);
+    /**
+     * Execute the kernel to calculate the forces and/or energy.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param includeForces  true if forces should be calculated
+     * @param includeEnergy  true if the energy should be calculated
+     * @return the potential energy due to the force
+     */
+    double execute(ContextImpl& context, bool includeForces, bool includeEnergy);
+    /**
+     * Copy changed parameters over to a context.
+     *
+     * @param context    the context to copy parameters to
+     * @param force      the CustomBondForce to copy the parameters from
+     */
+    void copyParametersToContext(ContextImpl& context, const CustomBondForce& force);
+private:
+    CpuPlatform::PlatformData& data;
+    int numBonds;
+    std::vector<std::vector<int> > bondIndexArray;
+    std::vector<std::vector<double> > bondParamArray;
+    std::vector<ReferenceCustomBondIxn*> threadIxn;
+    std::vector<std::string> globalParameterNames, energyParamDerivNames;
+    CpuBondForce bondForce;
+    bool usePeriodic;
+};
+
+/**
+ * This kernel is invoked by CustomAngleForce to calculate the forces acting on the system and the energy of the system.
+ */
+class CpuCalcCustomAngleForceKernel : public CalcCustomAngleForceKernel {
+public:
+    CpuCalcCustomAngleForceKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data) :
+            CalcCustomAngleForceKernel(name, platform), data(data), usePeriodic(false) {
+    }
+    ~CpuCalcCustomAngleForceKernel();
+    /**
+     * Initialize the kernel.
+     * 
+     * @param system     the System this kernel will be applied to
+     * @param force      the CustomAngleForce this kernel will be used for
+     */
+    void initialize(const System& system, const CustomAngleForce& force);
+    /**
+     * Execute the kernel to calculate the forces and/or energy.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param includeForces  true if forces should be calculated
+     * @param includeEnergy  true if the energy should be calculated
+     * @return the potential energy due to the force
+     */
+    double execute(ContextImpl& context, bool includeForces, bool includeEnergy);
+    /**
+     * Copy changed parameters over to a context.
+     *
+     * @param context    the context to copy parameters to
+     * @param force      the CustomAngleForce to copy the parameters from
+     */
+    void copyParametersToContext(ContextImpl& context, const CustomAngleForce& force);
+private:
+    CpuPlatform::PlatformData& data;
+    int numAngles;
+    std::vector<std::vector<int> > angleIndexArray;
+    std::vector<std::vector<double> > angleParamArray;
+    std::vector<ReferenceCustomAngleIxn*> threadIxn;
+    std::vector<std::string> globalParameterNames, energyParamDerivNames;
+    CpuBondForce bondForce;
+    bool usePeriodic;
+};
+
+/**
+ * This kernel is invoked by CustomTorsionForce to calculate the forces acting on the system and the energy of the system.
+ */
+class CpuCalcCustomTorsionForceKernel : public CalcCustomTorsionForceKernel {
+public:
+    CpuCalcCustomTorsionForceKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data) :
+            CalcCustomTorsionForceKernel(name, platform), data(data), usePeriodic(false) {
+    }
+    ~CpuCalcCustomTorsionForceKernel();
+    /**
+     * Initialize the kernel.
+     * 
+     * @param system     the System this kernel will be applied to
+     * @param force      the CustomTorsionForce this kernel will be used for
+     */
+    void initialize(const System& system, const CustomTorsionForce& force);
+    /**
+     * Execute the kernel to calculate the forces and/or energy.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param includeForces  true if forces should be calculated
+     * @param includeEnergy  true if the energy should be calculated
+     * @return the potential energy due to the force
+     */
+    double execute(ContextImpl& context, bool includeForces, bool includeEnergy);
+    /**
+     * Copy changed parameters over to a context.
+     *
+     * @param context    the context to copy parameters to
+     * @param force      the CustomTorsionForce to copy the parameters from
+     */
+    void copyParametersToContext(ContextImpl& context, const CustomTorsionForce& force);
+private:
+    CpuPlatform::PlatformData& data;
+    int numTorsions;
+    std::vector<std::vector<int> > torsionIndexArray;
+    std::vector<std::vector<double> > torsionParamArray;
+    std::vector<ReferenceCustomTorsionIxn*> threadIxn;
+    std::vector<std::string> globalParameterNames, energyParamDerivNames;
+    CpuBondForce bondForce;
+    bool usePeriodic;
+};
+
+/**
+ * This kernel is invoked by CMAPTorsionForce to calculate the forces acting on the system and the energy of the system.
+ */
+class CpuCalcCMAPTorsionForceKernel : public CalcCMAPTorsionForceKernel {
+public:
+    CpuCalcCMAPTorsionForceKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data) :
+            CalcCMAPTorsionForceKernel(name, platform), data(data), usePeriodic(false) {
+    }
+    /**
+     * Initialize the kernel.
+     * 
+     * @param system     the System this kernel will be applied to
+     * @param force      the CMAPTorsionForce this kernel will be used for
+     */
+    void initialize(const System& system, const CMAPTorsionForce& force);
+    /**
+     * Execute the kernel to calculate the forces and/or energy.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param includeForces  true if forces should be calculated
+     * @param includeEnergy  true if the energy should be calculated
+     * @return the potential energy due to the force
+     */
+    double execute(ContextImpl& context, bool includeForces, bool includeEnergy);
+    /**
+     * Copy changed parameters over to a context.
+     *
+     * @param context    the context to copy parameters to
+     * @param force      the CMAPTorsionForce to copy the parameters from
+     */
+    void copyParametersToContext(ContextImpl& context, const CMAPTorsionForce& force);
+private:
+    CpuPlatform::PlatformData& data;
+    std::vector<std::vector<std::vector<double> > > coeff;
+    std::vector<int> torsionMaps;
+    std::vector<std::vector<int> > torsionIndices;
+    std::vector<std::vector<double> > torsionMapParams;
+    CpuBondForce bondForce;
+    bool usePeriodic;
+};
+
+/**
+ * This kernel is invoked by CustomExternalForce to calculate the forces acting on the system and the energy of the system.
+ */
+class CpuCalcCustomExternalForceKernel : public CalcCustomExternalForceKernel {
+public:
+    CpuCalcCustomExternalForceKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data) :
+            CalcCustomExternalForceKernel(name, platform), data(data) {
+    }
+    ~CpuCalcCustomExternalForceKernel();
+    /**
+     * Initialize the kernel.
+     * 
+     * @param system     the System this kernel will be applied to
+     * @param force      the CustomExternalForce this kernel will be used for
+     */
+    void initialize(const System& system, const CustomExternalForce& force);
+    /**
+     * Execute the kernel to calculate the forces and/or energy.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param includeForces  true if forces should be calculated
+     * @param includeEnergy  true if the energy should be calculated
+     * @return the potential energy due to the force
+     */
+    double execute(ContextImpl& context, bool includeForces, bool includeEnergy);
+    /**
+     * Copy changed parameters over to a context.
+     *
+     * @param context    the context to copy parameters to
+     * @param force      the CustomExternalForce to copy the parameters from
+     */
+    void copyParametersToContext(ContextImpl& context, const CustomExternalForce& force);
+private:
+    class ExternalIxn;
+    CpuPlatform::PlatformData& data;
+    int numParticles;
+    std::vector<std::vector<int> > particleIndexArray;
+    std::vector<std::vector<double> > particleParamArray;
+    std::vector<ExternalIxn*> threadIxn;
+    std::vector<std::string> globalParameterNames;
+    Vec3* boxVectors;
+    CpuBondForce bondForce;
+};
+
 /**
  * This kernel is invoked by NonbondedForce to calculate the forces acting on the system.
  */
@@ -269,16 +539,17 @@ private:
     class PmeIO;
     void computeParameters(ContextImpl& context, bool offsetsOnly);
     CpuPlatform::PlatformData& data;
-    int numParticles, num14, chargePosqIndex, ljPosqIndex;
+    int numParticles, num14, chargePosqIndex;
     std::vector<std::vector<int> > bonded14IndexArray;
     std::vector<std::vector<double> > bonded14ParamArray;
     double nonbondedCutoff, switchingDistance, rfDielectric, ewaldAlpha, ewaldDispersionAlpha, ewaldSelfEnergy, dispersionCoefficient;
-    int kmax[3], gridSize[3], dispersionGridSize[3];
+    int kmax[3], gridSize[3], dispersionGridSize[3], pmeOrder;
     bool useSwitchingFunction, exceptionsArePeriodic, useOptimizedPme, hasInitializedPme, hasInitializedDispersionPme, hasParticleOffsets, hasExceptionOffsets;
     std::vector<std::set<int> > exclusions;
     std::vector<std::pair<float, float> > particleParams;
     std::vector<float> C6params;
     std::vector<float> charges;
+    AlignedArray<float> dispersionPosq;
     std::vector<std::array<double, 3> > baseParticleParams, baseExceptionParams;
     std::vector<std::vector<std::tuple<double, double, double, int> > > particleParamOffsets, exceptionParamOffsets;
     std::vector<std::string> paramNames;
@@ -326,6 +597,7 @@ private:
     double nonbondedCutoff, switchingDistance, periodicBoxSize[3], longRangeCoefficient;
     bool useSwitchingFunction, hasInitializedLongRangeCorrection;
     CustomNonbondedForce* forceCopy;
+    CustomNonbondedForceImpl::LongRangeCorrectionData longRangeCorrectionData;
     std::map<std::string, double> globalParamValues;
     std::vector<std::set<int> > exclusions;
     std::vector<std::string> parameterNames, globalParameterNames, energyParamDerivNames;
@@ -341,7 +613,7 @@ private:
 class CpuCalcGBSAOBCForceKernel : public CalcGBSAOBCForceKernel {
 public:
     CpuCalcGBSAOBCForceKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data) : CalcGBSAOBCForceKernel(name, platform),
-            data(data) {
+            data(data), neighborList(NULL) {
     }
     ~CpuCalcGBSAOBCForceKernel();
     /**
@@ -373,6 +645,10 @@ private:
     std::vector<std::pair<float, float> > particleParams;
     std::vector<float> charges;
     CpuGBSAOBCForce obc;
+    CpuNeighborList* neighborList;
+    std::vector<std::set<int> > noExclusions;
+    std::vector<Vec3> lastPositions;
+    float cutoff;
 };
 
 /**
@@ -415,7 +691,8 @@ private:
     double nonbondedCutoff;
     CpuCustomGBForce* ixn;
     CpuNeighborList* neighborList;
-    std::vector<std::set<int> > exclusions;
+    std::vector<std::set<int> > exclusions, noExclusions;
+    std::vector<Vec3> lastPositions;
     std::vector<std::string> particleParameterNames, globalParameterNames, energyParamDerivNames, valueNames;
     std::vector<OpenMM::CustomGBForce::ComputationType> valueTypes;
     std::vector<OpenMM::CustomGBForce::ComputationType> energyTypes;
@@ -574,6 +851,118 @@ private:
     double prevTemp, prevFriction, prevStepSize;
 };
 
+/**
+ * This kernel is invoked by VerletIntegrator to take one time step.
+ */
+class CpuIntegrateVerletStepKernel : public IntegrateVerletStepKernel {
+public:
+    CpuIntegrateVerletStepKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data) : IntegrateVerletStepKernel(name, platform),
+        data(data), dynamics(0) {
+    }
+    ~CpuIntegrateVerletStepKernel();
+    /**
+     * Initialize the kernel.
+     * 
+     * @param system     the System this kernel will be applied to
+     * @param integrator the VerletIntegrator this kernel will be used for
+     */
+    void initialize(const System& system, const VerletIntegrator& integrator);
+    /**
+     * Execute the kernel.
+     * 
+     * @param context    the context in which to execute this kernel
+     * @param integrator the VerletIntegrator this kernel is being used for
+     */
+    void execute(ContextImpl& context, const VerletIntegrator& integrator);
+    /**
+     * Compute the kinetic energy.
+     * 
+     * @param context    the context in which to execute this kernel
+     * @param integrator the VerletIntegrator this kernel is being used for
+     */
+    double computeKineticEnergy(ContextImpl& context, const VerletIntegrator& integrator);
+private:
+    CpuPlatform::PlatformData& data;
+    CpuVerletDynamics* dynamics;
+    std::vector<double> masses;
+    double prevStepSize;
+};
+
+/**
+ * This kernel is invoked by CustomIntegrator to take one time step.
+ */
+class CpuIntegrateCustomStepKernel : public IntegrateCustomStepKernel {
+public:
+    CpuIntegrateCustomStepKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data) : IntegrateCustomStepKernel(name, platform),
+        data(data), dynamics(0) {
+    }
+    ~CpuIntegrateCustomStepKernel();
+    /**
+     * Initialize the kernel.
+     * 
+     * @param system     the System this kernel will be applied to
+     * @param integrator the CustomIntegrator this kernel will be used for
+     */
+    void initialize(const System& system, const CustomIntegrator& integrator);
+    /**
+     * Execute the kernel.
+     * 
+     * @param context    the context in which to execute this kernel
+     * @param integrator the CustomIntegrator this kernel is being used for
+     * @param forcesAreValid if the context has been modified since the last time step, this will be
+     *                       false to show that cached forces are invalid and must be recalculated.
+     *                       On exit, this should specify whether the cached forces are valid at the
+     *                       end of the step.
+     */
+    void execute(ContextImpl& context, CustomIntegrator& integrator, bool& forcesAreValid);
+    /**
+     * Compute the kinetic energy.
+     * 
+     * @param context    the context in which to execute this kernel
+     * @param integrator the CustomIntegrator this kernel is being used for
+     * @param forcesAreValid if the context has been modified since the last time step, this will be
+     *                       false to show that cached forces are invalid and must be recalculated.
+     *                       On exit, this should specify whether the cached forces are valid at the
+     *                       end of the step.
+     */
+    double computeKineticEnergy(ContextImpl& context, CustomIntegrator& integrator, bool& forcesAreValid);
+    /**
+     * Get the values of all global variables.
+     *
+     * @param context   the context in which to execute this kernel
+     * @param values    on exit, this contains the values
+     */
+    void getGlobalVariables(ContextImpl& context, std::vector<double>& values) const;
+    /**
+     * Set the values of all global variables.
+     *
+     * @param context   the context in which to execute this kernel
+     * @param values    a vector containing the values
+     */
+    void setGlobalVariables(ContextImpl& context, const std::vector<double>& values);
+    /**
+     * Get the values of a per-DOF variable.
+     *
+     * @param context   the context in which to execute this kernel
+     * @param variable  the index of the variable to get
+     * @param values    on exit, this contains the values
+     */
+    void getPerDofVariable(ContextImpl& context, int variable, std::vector<Vec3>& values) const;
+    /**
+     * Set the values of a per-DOF variable.
+     *
+     * @param context   the context in which to execute this kernel
+     * @param variable  the index of the variable to get
+     * @param values    a vector containing the values
+     */
+    void setPerDofVariable(ContextImpl& context, int variable, const std::vector<Vec3>& values);
+private:
+    CpuPlatform::PlatformData& data;
+    CpuCustomDynamics* dynamics;
+    std::vector<double> masses, globalValues;
+    std::vector<std::vector<OpenMM::Vec3> > perDofValues; 
+};
+
 } // namespace OpenMM
 
 #endif /*OPENMM_CPUKERNELS_H_*/
@@ -46,7 +46,71 @@ namespace OpenMM {
 class OPENMM_EXPORT_CPU CpuNeighborList {
 public:
     class Voxels;
+    class VoxelIndex;
+    /**
+     * Determines how the neighbors of each block are recorded.
+     */
+    enum ClusterPairMode {
+        /**
+         * Only atoms that are within the cutoff distance of the block are listed.
+         */
+        NoClusterPairs = 0,
+        /**
+         * Neighbors are listed in complete clusters of ClusterSize atoms that are consecutive in
+         * the sorted order.  A cluster is included if any of its atoms is within the cutoff
+         * distance of the block, so each cluster can be processed as a unit.
+         */
+        ClusterPairs = 1,
+        /**
+         * Use cluster pairs for large, dense systems where most atoms in a neighboring cluster
+         * interact with the block anyway.  This is decided each time the list is built.
+         */
+        AutoClusterPairs = 2
+    };
+    /**
+     * The number of atoms in each cluster when using cluster pairs.
+     */
+    static const int ClusterSize = 4;
     CpuNeighborList(int blockSize);
+    ~CpuNeighborList();
+    /**
+     * Set how the neighbors of each block are recorded.  This takes effect the next time
+     * computeNeighborList() is called.
+     */
+    void setClusterPairMode(ClusterPairMode mode);
+    /**
+     * Get whether the most recently computed list uses cluster pairs.  If so, the neighbors of every block
+     * consist of complete clusters: entries i*ClusterSize through (i+1)*ClusterSize-1 are atoms
+     * i*ClusterSize through (i+1)*ClusterSize-1 of a single cluster.  Padding atoms at the end of
+     * the last cluster are excluded from interacting with every atom in the block.
+     */
+    bool getUseClusterPairs() const;
+    /**
+     * Set whether the list may be updated incrementally.  In incremental mode, the atom order and voxel
+     * hash from the last full build are kept.  Atoms that have moved further than a small tolerance since
+     * then are treated as mobile.  A rebuild moves only the mobile atoms in the voxel hash, and recomputes
+     * the lists only for blocks that contain a mobile atom or are near one.  To make this safe, every list
+     * is built with a slightly larger distance than requested.  A full build is done instead when too
+     * many atoms are mobile, or when the box, the number of atoms, or the distance has changed.
+     */
+    void setUseIncrementalRebuild(bool incremental);
+    /**
+     * Get whether the most recent call to computeNeighborList() only updated the list incrementally.
+     */
+    bool getLastRebuildWasIncremental() const;
+    /**
+     * Get the number of times computeNeighborList() has built the list from scratch.
+     */
+    long long getNumFullBuilds() const;
+    /**
+     * Get the number of times computeNeighborList() has only updated the list incrementally.
+     */
+    long long getNumIncrementalUpdates() const;
+    /**
+     * Get the total number of neighbors of all blocks in the most recently computed list.  When cluster
+     * pairs are used, this includes the padding atoms at the end of the last cluster.
+     */
+    long long getNumNeighbors() const;
     void computeNeighborList(int numAtoms, const AlignedArray<float>& atomLocations, const std::vector<std::set<int> >& exclusions,
             const Vec3* periodicBoxVectors, bool usePeriodic, float maxDistance, ThreadPool& threads);
     int getNumBlocks() const;
@@ -66,9 +130,15 @@ public:
      * This routine contains the code executed by each thread.
      */
     void threadComputeNeighborList(ThreadPool& threads, int threadIndex);
+    /**
+     * This routine contains the code executed by each thread during an incremental update.
+     */
+    void threadUpdateNeighborList(ThreadPool& threads, int threadIndex);
     void runThread(int index);
 private:
     int blockSize;
+    ClusterPairMode clusterPairMode;
+    bool useClusterPairs;
     std::vector<int> sortedAtoms;
     std::vector<float> sortedPositions;
     std::vector<std::vector<int> > blockNeighbors;
@@ -84,6 +154,23 @@ private:
     bool usePeriodic;
     float maxDistance;
     std::atomic<int> atomicCounter;
+    // The following variables are used for incremental updates.
+    bool incremental, canUpdateIncrementally, lastRebuildWasIncremental;
+    long long numFullBuilds, numIncrementalUpdates;
+    float requestedMaxDistance, mobileTolerance;
+    std::vector<float> referencePositions, voxelPositions;
+    std::vector<char> isMobile, rebuildBlock;
+    std::vector<int> mobileAtoms, blocksToRebuild;
+
+    /**
+     * Try to update the list incrementally.  This returns false if a full build is needed instead.
+     */
+    bool updateNeighborList(const AlignedArray<float>& atomLocations, const Vec3* periodicBoxVectors, bool usePeriodic, float maxDistance, ThreadPool& threads);
+    /**
+     * Compute the neighbors and exclusions of a single block.  The vectors are scratch space for the calling thread.
+     */
+    void computeBlockNeighbors(int blockIndex, std::vector<int>& blockAtoms, std::vector<float>& blockAtomX, std::vector<float>& blockAtomY,
+            std::vector<float>& blockAtomZ, std::vector<VoxelIndex>& atomVoxelIndex, std::vector<int>& clusterBlock);
 };
 
 } // namespace OpenMM
@@ -109,10 +109,11 @@ class CpuNonbondedForce {
 
          @param alpha    the Ewald separation parameter
          @param gridSize the dimensions of the mesh
+         @param order    the B-spline interpolation order
 
          --------------------------------------------------------------------------------------- */
 
-      void setUsePME(float alpha, int meshSize[3]);
+      void setUsePME(float alpha, int meshSize[3], int order);
 
       /**---------------------------------------------------------------------------------------
 
@@ -120,10 +121,11 @@ class CpuNonbondedForce {
 
          @param alpha    the Ewald separation parameter
          @param gridSize the dimensions of the mesh
+         @param order    the B-spline interpolation order
 
          --------------------------------------------------------------------------------------- */
 
-      void setUseLJPME(float alpha, int meshSize[3]);
+      void setUseLJPME(float alpha, int meshSize[3], int order);
 
       /**---------------------------------------------------------------------------------------
 
@@ -166,11 +168,16 @@ class CpuNonbondedForce {
          @param forces           force array (forces added)
          @param totalEnergy      total energy
          @param threads          the thread pool to use
+         @param mixedForces      if this is not NULL, forces are accumulated in double precision and
+                                 added to this array.  Interactions are still computed in single
+                                 precision, and threadForce is only used as a scratch buffer, which
+                                 is flushed to double precision after every block and left zeroed.
       
          --------------------------------------------------------------------------------------- */
           
       void calculateDirectIxn(int numberOfAtoms, float* posq, const std::vector<Vec3>& atomCoordinates, const std::vector<std::pair<float, float> >& atomParameters,
-            const std::vector<float>& C6params, const std::vector<std::set<int> >& exclusions, std::vector<AlignedArray<float> >& threadForce, double* totalEnergy, ThreadPool& threads);
+            const std::vector<float>& C6params, const std::vector<std::set<int> >& exclusions, std::vector<AlignedArray<float> >& threadForce, double* totalEnergy, ThreadPool& threads,
+            std::vector<Vec3>* mixedForces=NULL);
 
     /**
      * This routine contains the code executed by each thread.
@@ -194,6 +201,7 @@ protected:
         float alphaEwald, alphaDispersionEwald;
         int numRx, numRy, numRz;
         int meshDim[3], dispersionMeshDim[3];
+        int pmeOrder, dispersionPmeOrder;
         std::vector<float> erfcTable, ewaldScaleTable;
         std::vector<float> exptermsTable, dExptermsTable;
         float ewaldDX, ewaldDXInv, erfcDXInv, exptermsDX, exptermsDXInv;
@@ -206,7 +214,8 @@ protected:
         float const *C6params;
         std::set<int> const* exclusions;
         std::vector<AlignedArray<float> >* threadForce;
-        bool includeEnergy;
+        std::vector<std::vector<double> > threadMixedForce;
+        bool includeEnergy, useMixedForces;
         float inverseRcut6;
         float inverseRcut6Expterm;
         std::atomic<int> atomicCounter;
@@ -226,6 +235,17 @@ protected:
          --------------------------------------------------------------------------------------- */
           
       void calculateOneIxn(int atom1, int atom2, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize);
+
+      /**
+       * When accumulating in mixed precision, move the single precision forces on a set of atoms into
+       * the thread's double precision buffer and clear them.
+       */
+      void flushMixedForces(int threadIndex, const int* atoms, int numAtoms);
+
+      /**
+       * When accumulating in mixed precision, flush the forces on all atoms touched by one neighbor list block.
+       */
+      void flushBlockForces(int threadIndex, int blockIndex);
             
       /**---------------------------------------------------------------------------------------
       
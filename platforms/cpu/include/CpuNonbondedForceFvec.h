@@ -216,25 +216,10 @@ void CpuNonbondedForceFvec<FVEC>::calculateBlockIxnImpl(int blockIndex, float* f
     const auto& exclusions = neighborList->getBlockExclusions(blockIndex);
     FVEC partialEnergy = {};
 
-    for (int i = 0; i < (int) neighbors.size(); i++) {
-        // Load the next neighbor.
-        
-        int atom = neighbors[i];
-        
-        // Compute the distances to the block atoms.
-        
-        FVEC dx, dy, dz, r2;
-        fvec4 atomPos(posq+4*atom);
-        if (PERIODIC_TYPE == PeriodicPerAtom)
-            atomPos -= floor((atomPos-blockCenter)*invBoxSize+0.5f)*boxSize;
-        getDeltaR<PERIODIC_TYPE>(atomPos, blockAtomX, blockAtomY, blockAtomZ, dx, dy, dz, r2, boxSize, invBoxSize);
-
-        const auto exclNotMask = FVEC::expandBitsToMask(~exclusions[i]);
-        const auto include = blendZero(r2 < cutoffDistanceSquared, exclNotMask);
-        if (!any(include))
-            continue; // No interactions to compute.
-
-        // Compute the interactions.
+    // Compute the interactions between the block and one neighbor, given the displacements to the block atoms.
+    // include marks which block atoms actually interact with it.
+    using Mask = decltype(blendZero(cutoffDistanceSquared < cutoffDistanceSquared, FVEC::expandBitsToMask(0)));
+    auto computeNeighborIxn = [&] (int atom, const FVEC& dx, const FVEC& dy, const FVEC& dz, const FVEC& r2, const Mask& include) {
         const auto inverseR = rsqrt(r2);
         const auto r = r2*inverseR;
         FVEC energy, dEdR;
@@ -312,8 +297,52 @@ void CpuNonbondedForceFvec<FVEC>::calculateBlockIxnImpl(int blockIndex, float* f
         float* const atomForce = forces+4*atom;
         const fvec4 newAtomForce = fvec4(atomForce) - reduceToVec3(fx, fy, fz);
         newAtomForce.store(atomForce);
+    };
+
+    // Compute the displacements from one neighbor to the block atoms, and which of them interact with it.
+    auto computeNeighborDeltaR = [&] (int i, FVEC& dx, FVEC& dy, FVEC& dz, FVEC& r2, Mask& include) {
+        fvec4 atomPos(posq+4*neighbors[i]);
+        if (PERIODIC_TYPE == PeriodicPerAtom)
+            atomPos -= floor((atomPos-blockCenter)*invBoxSize+0.5f)*boxSize;
+        getDeltaR<PERIODIC_TYPE>(atomPos, blockAtomX, blockAtomY, blockAtomZ, dx, dy, dz, r2, boxSize, invBoxSize);
+        const auto exclNotMask = FVEC::expandBitsToMask(~exclusions[i]);
+        include = blendZero(r2 < cutoffDistanceSquared, exclNotMask);
+        return any(include);
+    };
+
+    if (neighborList->getUseClusterPairs()) {
+        // The neighbors come in clusters of atoms that are close to each other.  Compute the distances to
+        // all atoms of a cluster first, so clusters that do not interact with the block can be skipped as a
+        // whole, then compute the interactions for the ones that do.
+        const int clusterSize = CpuNeighborList::ClusterSize;
+        FVEC dx[clusterSize], dy[clusterSize], dz[clusterSize], r2[clusterSize];
+        Mask include[clusterSize];
+        bool anyInclude[clusterSize];
+        for (int i = 0; i < (int) neighbors.size(); i += clusterSize) {
+            bool anyInCluster = false;
+            for (int j = 0; j < clusterSize; j++) {
+                anyInclude[j] = computeNeighborDeltaR(i+j, dx[j], dy[j], dz[j], r2[j], include[j]);
+                anyInCluster |= anyInclude[j];
+            }
+            if (!anyInCluster)
+                continue; // No interactions to compute.
+            for (int j = 0; j < clusterSize; j++)
+                if (anyInclude[j])
+                    computeNeighborIxn(neighbors[i+j], dx[j], dy[j], dz[j], r2[j], include[j]);
+        }
     }
-    
+    else {
+        for (int i = 0; i < (int) neighbors.size(); i++) {
+            // Compute the distances from the next neighbor to the block atoms.
+
+            FVEC dx, dy, dz, r2;
+            Mask include;
+            if (!computeNeighborDeltaR(i, dx, dy, dz, r2, include))
+                continue; // No interactions to compute.
+            computeNeighborIxn(neighbors[i], dx, dy, dz, r2, include);
+        }
+    }
+
     if (totalEnergy)
         *totalEnergy += reduceAdd(partialEnergy);
 
@@ -77,6 +77,58 @@ public:
         static const std::string key = "DeterministicForces";
         return key;
     }
+    /**
+     * This is the name of the parameter for selecting the padding (in nm) that is added to the cutoff distance
+     * when building the neighbor list.  By default each Force selects its own padding.  If it is set to "auto",
+     * the padding is tuned while the simulation runs to minimize the combined cost of computing interactions
+     * and rebuilding the list.
+     * Querying this property for a Context returns the padding currently in use.
+     */
+    static const std::string& CpuNeighborListPadding() {
+        static const std::string key = "NeighborListPadding";
+        return key;
+    }
+    /**
+     * This is the name of the parameter for selecting how threads are placed on the processor.  If it is
+     * "none" (the default), the operating system is free to move threads between cores.  If it is "pin",
+     * each worker thread is bound to its own core, so that the buffers it initializes stay on the local
+     * NUMA node.  This can help on multi-socket computers, but it should not be used when several
+     * simulations share the same cores.  Pinning is only supported on Linux, and is ignored elsewhere.
+     */
+    static const std::string& CpuNumaPolicy() {
+        static const std::string key = "NumaPolicy";
+        return key;
+    }
+    /**
+     * This is the name of the parameter for selecting the precision.  If it is "single" (the default),
+     * everything is computed and accumulated in single precision.  If it is "mixed", interactions are
+     * still computed in single precision, but the nonbonded forces and the sum over threads are
+     * accumulated in double precision.  This improves energy conservation at a modest cost in speed.
+     */
+    static const std::string& CpuPrecision() {
+        static const std::string key = "Precision";
+        return key;
+    }
+    /**
+     * This is the name of the parameter for selecting whether the neighbor list may be rebuilt incrementally.
+     * If it is "true", a rebuild only recomputes the lists near atoms that have moved since the last full
+     * build.  This can greatly reduce the cost of rebuilding for systems where most atoms are fixed or
+     * restrained, but makes the list slightly larger, so it is "false" by default.
+     */
+    static const std::string& CpuIncrementalNeighborList() {
+        static const std::string key = "IncrementalNeighborList";
+        return key;
+    }
+    /**
+     * This is the name of the parameter for selecting whether large per-particle buffers, such as the
+     * positions and each thread's force buffer, are backed by transparent huge pages.  For systems with
+     * hundreds of thousands of particles this can reduce TLB misses.  It is "false" by default, and is
+     * only supported on Linux.
+     */
+    static const std::string& CpuHugePages() {
+        static const std::string key = "HugePages";
+        return key;
+    }
     /**
      * We cannot use the standard mechanism for platform data, because that is already used by the superclass.
      * Instead, we maintain a table of ContextImpls to PlatformDatas.
@@ -89,20 +141,38 @@ private:
 
 class CpuPlatform::PlatformData {
 public:
-    PlatformData(int numParticles, int numThreads, bool deterministicForces);
+    /**
+     * Create a PlatformData.  If neighborListPadding is negative, the padding is tuned automatically.  If it
+     * is zero, the padding requested by each Force is used.
+     * If pinThreads is true, each worker thread is bound to its own core.  If mixedPrecision is true,
+     * forces are accumulated in double precision.  If incrementalNeighborList is true, the neighbor list
+     * is updated incrementally when possible.  If useHugePages is true, posq and threadForce request huge pages.
+     */
+    PlatformData(int numParticles, int numThreads, bool deterministicForces, double neighborListPadding, bool pinThreads=false, bool mixedPrecision=false,
+            bool incrementalNeighborList=false, bool useHugePages=false);
     ~PlatformData();
     void requestNeighborList(double cutoffDistance, double padding, bool useExclusions, const std::vector<std::set<int> >& exclusionList);
+    /**
+     * Set the padding to use the next time the neighbor list is built.
+     */
+    void setNeighborListPadding(double padding);
     int requestPosqIndex();
     AlignedArray<float> posq;
     std::vector<AlignedArray<float> > threadForce;
     ThreadPool threads;
     bool isPeriodic;
+    /**
+     * This is true if every element of threadForce is known to be zero.  If a computation is
+     * interrupted before the forces are summed, it stays false and the buffers are cleared again.
+     */
+    bool threadForceCleared;
     CpuRandom random;
     std::map<std::string, std::string> propertyValues;
     CpuNeighborList* neighborList;
-    double cutoff, paddedCutoff;
-    bool anyExclusions, deterministicForces;
+    double cutoff, paddedCutoff, fixedPadding;
+    bool anyExclusions, deterministicForces, tunePadding, mixedPrecision, incrementalNeighborList;
     int currentPosqIndex, nextPosqIndex;
+    long long numNeighborListEvaluations;
     std::vector<std::set<int> > exclusions;
 };
 
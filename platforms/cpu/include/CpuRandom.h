@@ -32,6 +32,7 @@
  * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
  * -------------------------------------------------------------------------- */
 
+#include "AlignedArray.h"
 #include "sfmt/SFMT.h"
 #include "windowsExportCpu.h"
 #include <vector>
@@ -39,21 +40,43 @@
 namespace OpenMM {
 
 /**
- * This class provides a multithreaded random number generator.
+ * This class provides a multithreaded random number generator.  Each thread has its own
+ * generator, which produces random numbers in blocks that are then handed out one at a time.
  */
 class OPENMM_EXPORT_CPU CpuRandom {
 public:
     CpuRandom();
     ~CpuRandom();
     void initialize(int seed, int numThreads);
-    float getGaussianRandom(int threadIndex);
+    /**
+     * Get a random number from a Gaussian distribution with mean 0 and variance 1.
+     */
+    float getGaussianRandom(int threadIndex) {
+        ThreadData& data = *threadData[threadIndex];
+        if (data.nextGaussian == data.gaussians.size())
+            generateGaussians(data);
+        return data.gaussians[data.nextGaussian++];
+    }
+    /**
+     * Get a random number uniformly distributed in [0, 1).
+     */
     float getUniformRandom(int threadIndex);
 private:
+    /**
+     * The state of the generator for one thread.  Each one is allocated separately and padded, so
+     * different threads never write to the same cache line.
+     */
+    struct ThreadData {
+        int nextGaussian, nextUniform;
+        OpenMM_SFMT::SFMT sfmt;
+        AlignedArray<uint32_t> gaussianBits, uniformBits;
+        AlignedArray<float> gaussians;
+        char padding[64];
+    };
+    void generateGaussians(ThreadData& data);
     bool hasInitialized;
     int randomSeed;
-    std::vector<OpenMM_SFMT::SFMT*> threadRandom;
-    std::vector<float> nextGaussian;
-    std::vector<int> nextGaussianIsValid;
+    std::vector<ThreadData*> threadData;
 };
 
 } // namespace OpenMM
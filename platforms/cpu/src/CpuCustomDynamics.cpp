@@ -0,0 +1,118 @@
+
+/* Portions copyright (c) 2021 Stanford University and Simbios.
+ * Authors: Peter Eastman
+ * Contributors: 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "CpuCustomDynamics.h"
+#include <sstream>
+
+using namespace OpenMM;
+using namespace std;
+using Lepton::CompiledExpression;
+
+CpuCustomDynamics::CpuCustomDynamics(int numberOfAtoms, const CustomIntegrator& integrator, ThreadPool& threads) : 
+           ReferenceCustomDynamics(numberOfAtoms, integrator), threads(threads) {
+    threadVariables.resize(threads.getNumThreads());
+    for (auto& vars : threadVariables)
+        vars.perDofVariable.resize(integrator.getNumPerDofVariables());
+}
+
+CpuCustomDynamics::~CpuCustomDynamics() {
+}
+
+void CpuCustomDynamics::initialize(ContextImpl& context, vector<double>& masses, map<string, double>& globals) {
+    ReferenceCustomDynamics::initialize(context, masses, globals);
+    for (int i = 0; i < stepType.size(); i++)
+        if ((stepType[i] == CustomIntegrator::ComputePerDof || stepType[i] == CustomIntegrator::ComputeSum) && stepVectorExpressions[i].size() == 0)
+            createThreadExpressions(stepExpressions[i][0]);
+    createThreadExpressions(kineticEnergyExpression);
+}
+
+void CpuCustomDynamics::createThreadExpressions(const CompiledExpression& expression) {
+    const set<string>& variables = expression.getVariables();
+    if (variables.find("uniform") != variables.end() || variables.find("gaussian") != variables.end())
+        return;
+    if (threadExpressions.find(&expression) != threadExpressions.end())
+        return;
+
+    // Create a copy of the expression for each thread.  The vector must not be resized after
+    // this, since the expression set keeps pointers into the copies.
+
+    int numThreads = threads.getNumThreads();
+    vector<CompiledExpression>& copies = threadExpressions[&expression];
+    copies.resize(numThreads);
+    for (int i = 0; i < numThreads; i++) {
+        ThreadVariables& vars = threadVariables[i];
+        map<string, double*> variableLocations;
+        variableLocations["x"] = &vars.x;
+        variableLocations["v"] = &vars.v;
+        variableLocations["m"] = &vars.m;
+        variableLocations["f"] = &vars.f;
+        variableLocations["energy"] = &energy;
+        variableLocations["gaussian"] = &vars.gaussian;
+        variableLocations["uniform"] = &vars.uniform;
+        for (int j = 0; j < integrator.getNumPerDofVariables(); j++)
+            variableLocations[integrator.getPerDofVariableName(j)] = &vars.perDofVariable[j];
+        for (int j = 0; j < 32; j++) {
+            stringstream fname;
+            fname << "f" << j;
+            variableLocations[fname.str()] = &vars.f;
+            stringstream ename;
+            ename << "energy" << j;
+            variableLocations[ename.str()] = &energy;
+        }
+        copies[i] = expression;
+        copies[i].setVariableLocations(variableLocations);
+        expressionSet.registerExpression(copies[i]);
+    }
+}
+
+void CpuCustomDynamics::computePerDof(int numberOfAtoms, vector<Vec3>& results, const vector<Vec3>& atomCoordinates,
+              const vector<Vec3>& velocities, const vector<Vec3>& forces, const vector<double>& masses,
+              const vector<vector<Vec3> >& perDof, const CompiledExpression& expression) {
+    auto copies = threadExpressions.find(&expression);
+    if (copies == threadExpressions.end()) {
+        // This expression uses random numbers, so compute it on a single thread.
+
+        ReferenceCustomDynamics::computePerDof(numberOfAtoms, results, atomCoordinates, velocities, forces, masses, perDof, expression);
+        return;
+    }
+    threads.execute(numberOfAtoms, 256, [&] (ThreadPool& threads, int threadIndex, int start, int end) {
+        ThreadVariables& vars = threadVariables[threadIndex];
+        const CompiledExpression& threadExpression = copies->second[threadIndex];
+        for (int i = start; i < end; i++) {
+            if (masses[i] != 0.0) {
+                vars.m = masses[i];
+                for (int j = 0; j < 3; j++) {
+                    vars.x = atomCoordinates[i][j];
+                    vars.v = velocities[i][j];
+                    vars.f = forces[i][j];
+                    for (int k = 0; k < (int) perDof.size(); k++)
+                        vars.perDofVariable[k] = perDof[k][i][j];
+                    results[i][j] = threadExpression.evaluate();
+                }
+            }
+        }
+    });
+    threads.waitForThreads();
+}
@@ -22,6 +22,7 @@
  * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <algorithm>
 #include <string.h>
 #include <sstream>
 
@@ -32,9 +33,11 @@
 using namespace OpenMM;
 using namespace std;
 
-CpuCustomNonbondedForce::ThreadData::ThreadData(const Lepton::CompiledExpression& energyExpression, const Lepton::CompiledExpression& forceExpression,
-            const vector<string>& parameterNames, const std::vector<Lepton::CompiledExpression> energyParamDerivExpressions) :
-            energyExpression(energyExpression), forceExpression(forceExpression), energyParamDerivExpressions(energyParamDerivExpressions) {
+CpuCustomNonbondedForce::ThreadData::ThreadData(const Lepton::ParsedExpression& energyExpression, const Lepton::ParsedExpression& forceExpression,
+            const vector<string>& parameterNames, const std::vector<Lepton::ParsedExpression>& energyParamDerivExpressions, int vectorWidth) :
+            energyExpression(energyExpression.createCompiledExpression()), forceExpression(forceExpression.createCompiledExpression()), vectorWidth(vectorWidth) {
+    for (auto& expression : energyParamDerivExpressions)
+        this->energyParamDerivExpressions.push_back(expression.createCompiledExpression());
     map<string, double*> variableLocations;
     variableLocations["r"] = &r;
     particleParam.resize(2*parameterNames.size());
@@ -54,14 +57,54 @@ CpuCustomNonbondedForce::ThreadData::ThreadData(const Lepton::CompiledExpression
         expression.setVariableLocations(variableLocations);
         expressionSet.registerExpression(expression);
     }
+    if (vectorWidth == 0)
+        return;
+
+    // Create the vectorized versions of the expressions.  Each variable holds one value
+    // for every element of the vector.
+
+    vecEnergyExpression = energyExpression.createCompiledVectorExpression(vectorWidth);
+    vecForceExpression = forceExpression.createCompiledVectorExpression(vectorWidth);
+    for (auto& expression : energyParamDerivExpressions)
+        vecEnergyParamDerivExpressions.push_back(expression.createCompiledVectorExpression(vectorWidth));
+    vecEnergyParamDerivs.resize(vecEnergyParamDerivExpressions.size());
+    map<string, float*> vecVariableLocations;
+    vecR.resize(vectorWidth);
+    vecVariableLocations["r"] = &vecR[0];
+    vecParticleParam.resize(2*parameterNames.size()*vectorWidth);
+    for (int i = 0; i < (int) parameterNames.size(); i++) {
+        for (int j = 0; j < 2; j++) {
+            stringstream name;
+            name << parameterNames[i] << (j+1);
+            vecVariableLocations[name.str()] = &vecParticleParam[(i*2+j)*vectorWidth];
+        }
+    }
+    vector<Lepton::CompiledVectorExpression*> vecExpressions = {&vecEnergyExpression, &vecForceExpression};
+    for (auto& expression : vecEnergyParamDerivExpressions)
+        vecExpressions.push_back(&expression);
+    for (auto expression : vecExpressions)
+        for (auto& name : expression->getVariables())
+            if (vecVariableLocations.find(name) == vecVariableLocations.end()) {
+                // This must be a global parameter.
+
+                vecGlobalParams[name].resize(vectorWidth);
+                vecVariableLocations[name] = &vecGlobalParams[name][0];
+            }
+    for (auto expression : vecExpressions)
+        expression->setVariableLocations(vecVariableLocations);
 }
 
-CpuCustomNonbondedForce::CpuCustomNonbondedForce(const Lepton::CompiledExpression& energyExpression,
-            const Lepton::CompiledExpression& forceExpression, const vector<string>& parameterNames, const vector<set<int> >& exclusions,
-            const std::vector<Lepton::CompiledExpression> energyParamDerivExpressions, ThreadPool& threads) :
+CpuCustomNonbondedForce::CpuCustomNonbondedForce(const Lepton::ParsedExpression& energyExpression,
+            const Lepton::ParsedExpression& forceExpression, const vector<string>& parameterNames, const vector<set<int> >& exclusions,
+            const std::vector<Lepton::ParsedExpression> energyParamDerivExpressions, ThreadPool& threads) :
             cutoff(false), useSwitch(false), periodic(false), useInteractionGroups(false), paramNames(parameterNames), exclusions(exclusions), threads(threads) {
+    // Neighbor list blocks are processed eight atoms at a time when the processor can evaluate
+    // expressions on vectors of that width.  Otherwise every interaction is computed separately.
+
+    const vector<int>& widths = Lepton::CompiledVectorExpression::getAllowedWidths();
+    vectorWidth = (find(widths.begin(), widths.end(), 8) == widths.end() ? 0 : 8);
     for (int i = 0; i < threads.getNumThreads(); i++)
-        threadData.push_back(new ThreadData(energyExpression, forceExpression, parameterNames, energyParamDerivExpressions));
+        threadData.push_back(new ThreadData(energyExpression, forceExpression, parameterNames, energyParamDerivExpressions, vectorWidth));
 }
 
 CpuCustomNonbondedForce::~CpuCustomNonbondedForce() {
@@ -159,13 +202,17 @@ void CpuCustomNonbondedForce::calculatePairIxn(int numberOfAtoms, float* posq, v
 void CpuCustomNonbondedForce::threadComputeForce(ThreadPool& threads, int threadIndex) {
     // Compute this thread's subset of interactions.
 
-    int numThreads = threads.getNumThreads();
     threadEnergy[threadIndex] = 0;
     double& energy = threadEnergy[threadIndex];
     float* forces = &(*threadForce)[threadIndex][0];
     ThreadData& data = *threadData[threadIndex];
-    for (auto& param : *globalParameters)
+    for (auto& param : *globalParameters) {
         data.expressionSet.setVariable(data.expressionSet.getVariableIndex(param.first), param.second);
+        auto vecParam = data.vecGlobalParams.find(param.first);
+        if (vecParam != data.vecGlobalParams.end())
+            for (float& value : vecParam->second)
+                value = (float) param.second;
+    }
     for (auto& deriv : data.energyParamDerivs)
         deriv = 0.0;
     fvec4 boxSize(periodicBoxVectors[0][0], periodicBoxVectors[1][1], periodicBoxVectors[2][2], 0);
@@ -173,16 +220,22 @@ void CpuCustomNonbondedForce::threadComputeForce(ThreadPool& threads, int thread
     if (useInteractionGroups) {
         // The user has specified interaction groups, so compute only the requested interactions.
         
-        int start = threadIndex*groupInteractions.size()/numThreads;
-        int end = (threadIndex+1)*groupInteractions.size()/numThreads;
-        for (int i = start; i < end; i++) {
-            int atom1 = groupInteractions[i].first;
-            int atom2 = groupInteractions[i].second;
-            for (int j = 0; j < (int) paramNames.size(); j++) {
-                data.particleParam[j*2] = atomParameters[atom1][j];
-                data.particleParam[j*2+1] = atomParameters[atom2][j];
+        const int chunkSize = 64;
+        const int numInteractions = groupInteractions.size();
+        while (true) {
+            int start = atomicCounter.fetch_add(chunkSize);
+            if (start >= numInteractions)
+                break;
+            int end = min(start+chunkSize, numInteractions);
+            for (int i = start; i < end; i++) {
+                int atom1 = groupInteractions[i].first;
+                int atom2 = groupInteractions[i].second;
+                for (int j = 0; j < (int) paramNames.size(); j++) {
+                    data.particleParam[j*2] = atomParameters[atom1][j];
+                    data.particleParam[j*2+1] = atomParameters[atom2][j];
+                }
+                calculateOneIxn(atom1, atom2, data, forces, energy, boxSize, invBoxSize);
             }
-            calculateOneIxn(atom1, atom2, data, forces, energy, boxSize, invBoxSize);
         }
     }
     else if (cutoff) {
@@ -196,6 +249,19 @@ void CpuCustomNonbondedForce::threadComputeForce(ThreadPool& threads, int thread
             const int32_t* blockAtom = &neighborList->getSortedAtoms()[blockSize*blockIndex];
             const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
             const auto& exclusions = neighborList->getBlockExclusions(blockIndex);
+            if (vectorWidth > 0 && blockSize%vectorWidth == 0) {
+                // Evaluate the interactions with vectorWidth atoms of the block at once.
+
+                for (int i = 0; i < (int) neighbors.size(); i++) {
+                    int first = neighbors[i];
+                    for (int j = 0; j < (int) paramNames.size(); j++)
+                        for (int k = 0; k < vectorWidth; k++)
+                            data.vecParticleParam[j*2*vectorWidth+k] = (float) atomParameters[first][j];
+                    for (int k = 0; k < blockSize; k += vectorWidth)
+                        calculateBlockIxn(first, &blockAtom[k], exclusions[i]>>k, data, forces, energy, boxSize, invBoxSize);
+                }
+                continue;
+            }
             for (int i = 0; i < (int) neighbors.size(); i++) {
                 int first = neighbors[i];
                 for (int j = 0; j < (int) paramNames.size(); j++)
@@ -275,6 +341,67 @@ void CpuCustomNonbondedForce::calculateOneIxn(int ii, int jj, ThreadData& data,
         data.energyParamDerivs[i] += switchValue*data.energyParamDerivExpressions[i].evaluate();
 }
 
+void CpuCustomNonbondedForce::calculateBlockIxn(int ii, const int32_t* atoms, int exclusionMask, ThreadData& data,
+        float* forces, double& totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize) {
+    // Compute the distance to each atom and record its parameters.  Excluded atoms and ones beyond
+    // the cutoff are still evaluated (with r set to the cutoff), but their results are discarded.
+
+    const int width = data.vectorWidth;
+    const int numParams = paramNames.size();
+    fvec4 posI(posq+4*ii);
+    fvec4 deltaR[8];
+    bool include[8];
+    bool anyIncluded = false;
+    for (int k = 0; k < width; k++) {
+        float r2;
+        getDeltaR(posI, fvec4(posq+4*atoms[k]), deltaR[k], r2, boxSize, invBoxSize);
+        include[k] = ((exclusionMask & (1<<k)) == 0 && r2 < cutoffDistance*cutoffDistance);
+        anyIncluded |= include[k];
+        data.vecR[k] = (include[k] ? sqrtf(r2) : (float) cutoffDistance);
+        for (int j = 0; j < numParams; j++)
+            data.vecParticleParam[(j*2+1)*width+k] = (float) atomParameters[atoms[k]][j];
+    }
+    if (!anyIncluded)
+        return;
+
+    // Evaluate the expressions.
+
+    const float* forceValues = (includeForce ? data.vecForceExpression.evaluate() : NULL);
+    const float* energyValues = (includeEnergy || useSwitch ? data.vecEnergyExpression.evaluate() : NULL);
+    for (int i = 0; i < data.vecEnergyParamDerivExpressions.size(); i++)
+        data.vecEnergyParamDerivs[i] = data.vecEnergyParamDerivExpressions[i].evaluate();
+
+    // Accumulate the forces, energies, and energy derivatives.
+
+    fvec4 forceI(0.0f);
+    for (int k = 0; k < width; k++) {
+        if (!include[k])
+            continue;
+        double r = data.vecR[k];
+        double dEdR = (includeForce ? forceValues[k]/r : 0.0);
+        double energy = 0.0;
+        if (includeEnergy || (useSwitch && r > switchingDistance))
+            energy = energyValues[k];
+        double switchValue = 1.0;
+        if (useSwitch) {
+            if (r > switchingDistance) {
+                double t = (r-switchingDistance)/(cutoffDistance-switchingDistance);
+                switchValue = 1+t*t*t*(-10+t*(15-t*6));
+                double switchDeriv = t*t*(-30+t*(60-t*30))/(cutoffDistance-switchingDistance);
+                dEdR = switchValue*dEdR + energy*switchDeriv/r;
+                energy *= switchValue;
+            }
+        }
+        fvec4 result = deltaR[k]*dEdR;
+        forceI += result;
+        (fvec4(forces+4*atoms[k])-result).store(forces+4*atoms[k]);
+        totalEnergy += energy;
+        for (int i = 0; i < data.vecEnergyParamDerivs.size(); i++)
+            data.energyParamDerivs[i] += switchValue*data.vecEnergyParamDerivs[i][k];
+    }
+    (fvec4(forces+4*ii)+forceI).store(forces+4*ii);
+}
+
 void CpuCustomNonbondedForce::getDeltaR(const fvec4& posI, const fvec4& posJ, fvec4& deltaR, float& r2, const fvec4& boxSize, const fvec4& invBoxSize) const {
     deltaR = posJ-posI;
     if (periodic) {
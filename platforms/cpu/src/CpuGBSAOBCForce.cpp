@@ -35,7 +35,7 @@ const int CpuGBSAOBCForce::NUM_TABLE_POINTS = 4096;
 const float CpuGBSAOBCForce::TABLE_MIN = 0.25f;
 const float CpuGBSAOBCForce::TABLE_MAX = 1.5f;
 
-CpuGBSAOBCForce::CpuGBSAOBCForce() : cutoff(false), periodic(false) {
+CpuGBSAOBCForce::CpuGBSAOBCForce() : cutoff(false), periodic(false), neighborList(NULL) {
     logDX = (TABLE_MAX-TABLE_MIN)/NUM_TABLE_POINTS;
     logDXInv = 1.0f/logDX;
     logTable.resize(NUM_TABLE_POINTS+4);
@@ -45,9 +45,10 @@ CpuGBSAOBCForce::CpuGBSAOBCForce() : cutoff(false), periodic(false) {
     }
 }
 
-void CpuGBSAOBCForce::setUseCutoff(float distance) {
+void CpuGBSAOBCForce::setUseCutoff(float distance, const CpuNeighborList& neighbors) {
     cutoff = true;
     cutoffDistance = distance;
+    neighborList = &neighbors;
 }
 
 void CpuGBSAOBCForce::setPeriodic(float* periodicBoxSize) {
@@ -77,9 +78,11 @@ void CpuGBSAOBCForce::setParticleParameters(const std::vector<std::pair<float, f
     particleParams = params;
     bornRadii.resize(params.size()+3);
     obcChain.resize(params.size()+3);
+    bornForceChain.resize(params.size()+3);
     for (int i = bornRadii.size()-3; i < bornRadii.size(); i++) {
         bornRadii[i] = 0;
         obcChain[i] = 0;
+        bornForceChain[i] = 0;
     }
 }
 
@@ -94,21 +97,44 @@ void CpuGBSAOBCForce::computeForce(const AlignedArray<float>& posq, vector<Align
     threadBornForces.resize(numThreads);
     for (int i = 0; i < numThreads; i++)
         threadBornForces[i].resize(particleParams.size()+3);
+    if (neighborList != NULL) {
+        threadBornSums.resize(numThreads);
+        for (int i = 0; i < numThreads; i++)
+            threadBornSums[i].resize(particleParams.size()+3);
+    }
     
     // Signal the threads to start running and wait for them to finish.
     
     atomicCounter = 0;
-    threads.execute([&] (ThreadPool& threads, int threadIndex) { threadComputeForce(threads, threadIndex); });
-    threads.waitForThreads(); // Compute Born radii
-    atomicCounter = 0;
-    threads.resumeThreads();
-    threads.waitForThreads(); // Compute surface area term
-    atomicCounter = 0;
-    threads.resumeThreads();
-    threads.waitForThreads(); // First loop
-    atomicCounter = 0;
-    threads.resumeThreads();
-    threads.waitForThreads(); // Second loop
+    if (neighborList == NULL) {
+        threads.execute([&] (ThreadPool& threads, int threadIndex) { threadComputeForce(threads, threadIndex); });
+        threads.waitForThreads(); // Compute Born radii
+        atomicCounter = 0;
+        threads.resumeThreads();
+        threads.waitForThreads(); // Compute surface area term
+        atomicCounter = 0;
+        threads.resumeThreads();
+        threads.waitForThreads(); // First loop
+        atomicCounter = 0;
+        threads.resumeThreads();
+        threads.waitForThreads(); // Second loop
+    }
+    else {
+        threads.execute([&] (ThreadPool& threads, int threadIndex) { threadComputeForceWithNeighborList(threads, threadIndex); });
+        threads.waitForThreads(); // Sum the Born radius terms over pairs
+        atomicCounter = 0;
+        threads.resumeThreads();
+        threads.waitForThreads(); // Compute Born radii, surface area and self terms
+        atomicCounter = 0;
+        threads.resumeThreads();
+        threads.waitForThreads(); // Born energy over pairs
+        atomicCounter = 0;
+        threads.resumeThreads();
+        threads.waitForThreads(); // Sum the Born forces
+        atomicCounter = 0;
+        threads.resumeThreads();
+        threads.waitForThreads(); // Chain rule forces over pairs
+    }
     
     // Combine the energies from all the threads.
     
@@ -392,6 +418,299 @@ void CpuGBSAOBCForce::threadComputeForce(ThreadPool& threads, int threadIndex) {
     threadEnergy[threadIndex] = energy;
 }
 
+void CpuGBSAOBCForce::threadComputeForceWithNeighborList(ThreadPool& threads, int threadIndex) {
+    int numParticles = particleParams.size();
+    int numThreads = threads.getNumThreads();
+    int numBlocks = neighborList->getNumBlocks();
+    const float dielectricOffset = 0.009;
+    const float alphaObc = 1.0f;
+    const float betaObc = 0.8f;
+    const float gammaObc = 4.85f;
+    const float cutoff2 = cutoffDistance*cutoffDistance;
+    const ivec4 blockBits(1, 2, 4, 8);
+    const fvec4 one(1.0f);
+    fvec4 boxSize(periodicBoxSize[0], periodicBoxSize[1], periodicBoxSize[2], 0);
+    fvec4 invBoxSize((1/periodicBoxSize[0]), (1/periodicBoxSize[1]), (1/periodicBoxSize[2]), 0);
+
+    // Blocks are groups of four consecutive atoms in the neighbor list's sorted order.  Unused slots in
+    // the last block are filled with the first atom of the block and masked out.
+
+    int blockAtoms[4];
+    int numInBlock;
+    ivec4 blockMask;
+    auto loadBlock = [&] (int block) {
+        const int32_t* sortedAtoms = &neighborList->getSortedAtoms()[4*block];
+        numInBlock = min(4, numParticles-4*block);
+        int mask[4] = {0, 0, 0, 0};
+        for (int i = 0; i < 4; i++) {
+            blockAtoms[i] = sortedAtoms[i < numInBlock ? i : 0];
+            if (i < numInBlock)
+                mask[i] = 0xFFFFFFFF;
+        }
+        blockMask = ivec4(mask);
+    };
+
+    // Sum the contributions of every pair to the Born radii of both atoms.
+
+    AlignedArray<float>& bornSums = threadBornSums[threadIndex];
+    for (int i = 0; i < numParticles; i++)
+        bornSums[i] = 0.0f;
+    while (true) {
+        int block = atomicCounter++;
+        if (block >= numBlocks)
+            break;
+        loadBlock(block);
+        float atomRadius[4], atomScaledRadius[4], atomx[4], atomy[4], atomz[4];
+        for (int i = 0; i < 4; i++) {
+            atomRadius[i] = particleParams[blockAtoms[i]].first;
+            atomScaledRadius[i] = particleParams[blockAtoms[i]].second;
+            atomx[i] = posq[4*blockAtoms[i]];
+            atomy[i] = posq[4*blockAtoms[i]+1];
+            atomz[i] = posq[4*blockAtoms[i]+2];
+        }
+        fvec4 offsetRadiusI(atomRadius);
+        fvec4 scaledRadiusI(atomScaledRadius);
+        fvec4 radiusIInverse = 1.0f/offsetRadiusI;
+        fvec4 x(atomx);
+        fvec4 y(atomy);
+        fvec4 z(atomz);
+        fvec4 blockSum(0.0f);
+        const vector<int>& neighbors = neighborList->getBlockNeighbors(block);
+        const auto& exclusions = neighborList->getBlockExclusions(block);
+        for (int n = 0; n < (int) neighbors.size(); n++) {
+            int atomJ = neighbors[n];
+            fvec4 posJ(posq+4*atomJ);
+            fvec4 dx, dy, dz, r2;
+            getDeltaR(posJ, x, y, z, dx, dy, dz, r2, periodic, boxSize, invBoxSize);
+            ivec4 include = blockMask & ((ivec4(exclusions[n]) & blockBits) == ivec4(0));
+            include = include & (r2 < cutoff2);
+            if (!any(include))
+                continue;
+            fvec4 r = sqrt(r2);
+            fvec4 rInverse = 1.0f/r;
+            float offsetRadiusJ = particleParams[atomJ].first;
+            float scaledRadiusJ = particleParams[atomJ].second;
+            blockSum += computeBornRadiusTerm(r, rInverse, offsetRadiusI, radiusIInverse, fvec4(scaledRadiusJ), include);
+            bornSums[atomJ] += dot4(computeBornRadiusTerm(r, rInverse, fvec4(offsetRadiusJ), fvec4(1.0f/offsetRadiusJ), scaledRadiusI, include), one);
+        }
+        for (int i = 0; i < numInBlock; i++)
+            bornSums[blockAtoms[i]] += blockSum[i];
+    }
+    threads.syncThreads();
+
+    // Compute the Born radii, the ACE surface area term, and the self interaction of each atom.
+
+    const float probeRadius = 0.14f;
+    float preFactor;
+    if (soluteDielectric != 0.0f && solventDielectric != 0.0f)
+        preFactor = ONE_4PI_EPS0*((1.0f/solventDielectric) - (1.0f/soluteDielectric));
+    else
+        preFactor = 0.0f;
+    double energy = 0.0;
+    AlignedArray<float>& bornForces = threadBornForces[threadIndex];
+    for (int i = 0; i < numParticles; i++)
+        bornForces[i] = 0.0f;
+    while (true) {
+        int atomI = atomicCounter++;
+        if (atomI >= numParticles)
+            break;
+        float offsetRadiusI = particleParams[atomI].first;
+        float radiusI = offsetRadiusI + dielectricOffset;
+        float sum = 0.0f;
+        for (int i = 0; i < numThreads; i++)
+            sum += threadBornSums[i][atomI];
+        sum *= 0.5f*offsetRadiusI;
+        float sum2 = sum*sum;
+        float sum3 = sum*sum2;
+        float tanhSum = tanh(alphaObc*sum - betaObc*sum2 + gammaObc*sum3);
+        bornRadii[atomI] = 1.0f/(1.0f/offsetRadiusI - tanhSum/radiusI);
+        obcChain[atomI] = offsetRadiusI*(alphaObc - 2.0f*betaObc*sum + 3.0f*gammaObc*sum2);
+        obcChain[atomI] = (1.0f - tanhSum*tanhSum)*obcChain[atomI]/radiusI;
+        if (bornRadii[atomI] > 0) {
+            float r = radiusI + probeRadius;
+            float ratio6 = powf(radiusI/bornRadii[atomI], 6.0f);
+            float saTerm = surfaceAreaFactor*r*r*ratio6;
+            energy += saTerm;
+            bornForces[atomI] = -6.0f*saTerm/bornRadii[atomI];
+        }
+        float chargeI = posq[4*atomI+3];
+        float selfEnergy = preFactor*chargeI*chargeI/bornRadii[atomI];
+        energy += 0.5f*selfEnergy;
+        bornForces[atomI] -= 0.5f*selfEnergy/bornRadii[atomI];
+    }
+    threads.syncThreads();
+
+    // Compute the Born energy of every pair, and its derivatives with respect to the positions and Born radii.
+
+    float* forces = &(*threadForce)[threadIndex][0];
+    while (true) {
+        int block = atomicCounter++;
+        if (block >= numBlocks)
+            break;
+        loadBlock(block);
+        float atomCharge[4], atomBornRadius[4], atomx[4], atomy[4], atomz[4];
+        for (int i = 0; i < 4; i++) {
+            atomCharge[i] = preFactor*posq[4*blockAtoms[i]+3];
+            atomBornRadius[i] = bornRadii[blockAtoms[i]];
+            atomx[i] = posq[4*blockAtoms[i]];
+            atomy[i] = posq[4*blockAtoms[i]+1];
+            atomz[i] = posq[4*blockAtoms[i]+2];
+        }
+        fvec4 partialChargeI(atomCharge);
+        fvec4 radii(atomBornRadius);
+        fvec4 x(atomx);
+        fvec4 y(atomy);
+        fvec4 z(atomz);
+        fvec4 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f), blockAtomBornForce(0.0f);
+        const vector<int>& neighbors = neighborList->getBlockNeighbors(block);
+        const auto& exclusions = neighborList->getBlockExclusions(block);
+        for (int n = 0; n < (int) neighbors.size(); n++) {
+            int atomJ = neighbors[n];
+            fvec4 posJ(posq+4*atomJ);
+            fvec4 dx, dy, dz, r2;
+            getDeltaR(posJ, x, y, z, dx, dy, dz, r2, periodic, boxSize, invBoxSize);
+            ivec4 include = blockMask & ((ivec4(exclusions[n]) & blockBits) == ivec4(0));
+            include = include & (r2 < cutoff2);
+            if (!any(include))
+                continue;
+            fvec4 alpha2_ij = radii*bornRadii[atomJ];
+            fvec4 D_ij = r2/(4.0f*alpha2_ij);
+            fvec4 expTerm = exp(-D_ij);
+            fvec4 denominator2 = r2 + alpha2_ij*expTerm;
+            fvec4 denominator = sqrt(denominator2);
+            fvec4 chargeProduct = partialChargeI*posJ[3];
+            fvec4 Gpol = chargeProduct/denominator;
+            fvec4 dGpol_dr = -Gpol*(1.0f - 0.25f*expTerm)/denominator2;
+            fvec4 dGpol_dalpha2_ij = -0.5f*Gpol*expTerm*(1.0f + D_ij)/denominator2;
+            dGpol_dr = blend(0.0f, dGpol_dr, include);
+            dGpol_dalpha2_ij = blend(0.0f, dGpol_dalpha2_ij, include);
+            fvec4 fx = dx*dGpol_dr;
+            fvec4 fy = dy*dGpol_dr;
+            fvec4 fz = dz*dGpol_dr;
+            blockAtomForceX -= fx;
+            blockAtomForceY -= fy;
+            blockAtomForceZ -= fz;
+            blockAtomBornForce += dGpol_dalpha2_ij*bornRadii[atomJ];
+            float* atomForce = forces+4*atomJ;
+            atomForce[0] += dot4(fx, one);
+            atomForce[1] += dot4(fy, one);
+            atomForce[2] += dot4(fz, one);
+            bornForces[atomJ] += dot4(dGpol_dalpha2_ij, radii);
+            energy += dot4(blend(0.0f, Gpol-chargeProduct/cutoffDistance, include), one);
+        }
+        fvec4 f[4] = {blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f};
+        transpose(f[0], f[1], f[2], f[3]);
+        for (int i = 0; i < numInBlock; i++) {
+            int atomIndex = blockAtoms[i];
+            (fvec4(forces+4*atomIndex)+f[i]).store(forces+4*atomIndex);
+            bornForces[atomIndex] += blockAtomBornForce[i];
+        }
+    }
+    threads.syncThreads();
+
+    // Sum the Born forces from all threads, and multiply by the derivative of each Born radius.
+
+    while (true) {
+        int blockStart = atomicCounter.fetch_add(4);
+        if (blockStart >= numParticles)
+            break;
+        fvec4 bornForce(0.0f);
+        for (int i = 0; i < numThreads; i++)
+            bornForce += fvec4(&threadBornForces[i][blockStart]);
+        fvec4 radii(&bornRadii[blockStart]);
+        bornForce *= radii*radii*fvec4(&obcChain[blockStart]);
+        bornForce.store(&bornForceChain[blockStart]);
+    }
+    threads.syncThreads();
+
+    // Apply the chain rule to compute the forces due to changes in the Born radii.  Each pair contributes
+    // through the Born radii of both atoms.
+
+    while (true) {
+        int block = atomicCounter++;
+        if (block >= numBlocks)
+            break;
+        loadBlock(block);
+        float atomRadius[4], atomScaledRadius[4], atomBornForce[4], atomx[4], atomy[4], atomz[4];
+        for (int i = 0; i < 4; i++) {
+            atomRadius[i] = particleParams[blockAtoms[i]].first;
+            atomScaledRadius[i] = particleParams[blockAtoms[i]].second;
+            atomBornForce[i] = bornForceChain[blockAtoms[i]];
+            atomx[i] = posq[4*blockAtoms[i]];
+            atomy[i] = posq[4*blockAtoms[i]+1];
+            atomz[i] = posq[4*blockAtoms[i]+2];
+        }
+        fvec4 offsetRadiusI(atomRadius);
+        fvec4 scaledRadiusI(atomScaledRadius);
+        fvec4 bornForceI(atomBornForce);
+        fvec4 x(atomx);
+        fvec4 y(atomy);
+        fvec4 z(atomz);
+        fvec4 blockAtomForceX(0.0f), blockAtomForceY(0.0f), blockAtomForceZ(0.0f);
+        const vector<int>& neighbors = neighborList->getBlockNeighbors(block);
+        const auto& exclusions = neighborList->getBlockExclusions(block);
+        for (int n = 0; n < (int) neighbors.size(); n++) {
+            int atomJ = neighbors[n];
+            fvec4 posJ(posq+4*atomJ);
+            fvec4 dx, dy, dz, r2;
+            getDeltaR(posJ, x, y, z, dx, dy, dz, r2, periodic, boxSize, invBoxSize);
+            ivec4 include = blockMask & ((ivec4(exclusions[n]) & blockBits) == ivec4(0));
+            include = include & (r2 < cutoff2);
+            if (!any(include))
+                continue;
+            fvec4 r = sqrt(r2);
+            fvec4 rInverse = 1.0f/r;
+            float offsetRadiusJ = particleParams[atomJ].first;
+            float scaledRadiusJ = particleParams[atomJ].second;
+            fvec4 de = bornForceI*computeChainRuleTerm(r, rInverse, offsetRadiusI, fvec4(scaledRadiusJ), include);
+            de += bornForceChain[atomJ]*computeChainRuleTerm(r, rInverse, fvec4(offsetRadiusJ), scaledRadiusI, include);
+            fvec4 fx = dx*de;
+            fvec4 fy = dy*de;
+            fvec4 fz = dz*de;
+            blockAtomForceX += fx;
+            blockAtomForceY += fy;
+            blockAtomForceZ += fz;
+            float* atomForce = forces+4*atomJ;
+            atomForce[0] -= dot4(fx, one);
+            atomForce[1] -= dot4(fy, one);
+            atomForce[2] -= dot4(fz, one);
+        }
+        fvec4 f[4] = {blockAtomForceX, blockAtomForceY, blockAtomForceZ, 0.0f};
+        transpose(f[0], f[1], f[2], f[3]);
+        for (int i = 0; i < numInBlock; i++) {
+            int atomIndex = blockAtoms[i];
+            (fvec4(forces+4*atomIndex)+f[i]).store(forces+4*atomIndex);
+        }
+    }
+    threadEnergy[threadIndex] = energy;
+}
+
+fvec4 CpuGBSAOBCForce::computeBornRadiusTerm(const fvec4& r, const fvec4& rInverse, const fvec4& offsetRadiusI, const fvec4& radiusIInverse, const fvec4& scaledRadiusJ, ivec4 include) {
+    fvec4 rScaledRadiusJ = r + scaledRadiusJ;
+    include = include & (offsetRadiusI < rScaledRadiusJ);
+    fvec4 l_ij = 1.0f/max(offsetRadiusI, abs(r-scaledRadiusJ));
+    fvec4 u_ij = 1.0f/rScaledRadiusJ;
+    fvec4 l_ij2 = l_ij*l_ij;
+    fvec4 u_ij2 = u_ij*u_ij;
+    fvec4 logRatio = fastLog(u_ij/l_ij);
+    fvec4 term = l_ij - u_ij + 0.25f*r*(u_ij2 - l_ij2) + (0.5f*rInverse*logRatio) + (0.25f*scaledRadiusJ*scaledRadiusJ*rInverse)*(l_ij2 - u_ij2);
+    term += blend(0.0f, 2.0f*(radiusIInverse-l_ij), offsetRadiusI < scaledRadiusJ-r);
+    return blend(0.0f, term, include);
+}
+
+fvec4 CpuGBSAOBCForce::computeChainRuleTerm(const fvec4& r, const fvec4& rInverse, const fvec4& offsetRadiusI, const fvec4& scaledRadiusJ, ivec4 include) {
+    fvec4 rScaledRadiusJ = r + scaledRadiusJ;
+    include = include & (offsetRadiusI < rScaledRadiusJ);
+    fvec4 l_ij = 1.0f/max(offsetRadiusI, abs(r-scaledRadiusJ));
+    fvec4 u_ij = 1.0f/rScaledRadiusJ;
+    fvec4 l_ij2 = l_ij*l_ij;
+    fvec4 u_ij2 = u_ij*u_ij;
+    fvec4 r2Inverse = rInverse*rInverse;
+    fvec4 logRatio = fastLog(u_ij/l_ij);
+    fvec4 t3 = 0.125f*(1.0f + scaledRadiusJ*scaledRadiusJ*r2Inverse)*(l_ij2 - u_ij2) + 0.25f*logRatio*r2Inverse;
+    return blend(0.0f, t3*rInverse, include);
+}
+
 void CpuGBSAOBCForce::getDeltaR(const fvec4& posI, const fvec4& x, const fvec4& y, const fvec4& z, fvec4& dx, fvec4& dy, fvec4& dz, fvec4& r2, bool periodic, const fvec4& boxSize, const fvec4& invBoxSize) const {
     dx = x-posI[0];
     dy = y-posI[1];
@@ -31,6 +31,8 @@
 
 #include "CpuKernels.h"
 #include "ReferenceAngleBondIxn.h"
+#include "ReferenceCMAPTorsionIxn.h"
+#include "ReferenceCustomExternalIxn.h"
 #include "ReferenceBondForce.h"
 #include "ReferenceConstraints.h"
 #include "ReferenceKernelFactory.h"
@@ -39,12 +41,15 @@
 #include "ReferenceProperDihedralBond.h"
 #include "ReferenceRbDihedralBond.h"
 #include "ReferenceTabulatedFunction.h"
+#include "SimTKOpenMMUtilities.h"
 #include "openmm/Context.h"
 #include "openmm/OpenMMException.h"
 #include "openmm/Vec3.h"
+#include "openmm/internal/CMAPTorsionForceImpl.h"
 #include "openmm/internal/ContextImpl.h"
 #include "openmm/internal/CustomNonbondedForceImpl.h"
 #include "openmm/internal/NonbondedForceImpl.h"
+#include "openmm/internal/timer.h"
 #include "openmm/internal/vectorize.h"
 #include "lepton/CompiledExpression.h"
 #include "lepton/CustomFunction.h"
@@ -151,8 +156,30 @@ static void copyChargesToPosq(ContextImpl& context, const vector<float>& charges
         posq[4*i+3] = charges[i];
 }
 
+/**
+ * Build a neighbor list that does not use exclusions, or reuse the existing one if no particle has moved
+ * more than half the padding since it was built.  The list includes all pairs within cutoff+padding,
+ * so the caller must still check the distance between each pair.
+ */
+static void updateUnexcludedNeighborList(ContextImpl& context, CpuNeighborList& neighborList, const vector<set<int> >& noExclusions,
+        vector<Vec3>& lastPositions, double cutoff, double padding) {
+    CpuPlatform::PlatformData& data = CpuPlatform::getPlatformData(context);
+    vector<Vec3>& posData = extractPositions(context);
+    bool needRecompute = (lastPositions.size() != posData.size());
+    double maxMove2 = 0.25*padding*padding;
+    for (int i = 0; i < posData.size() && !needRecompute; i++) {
+        Vec3 delta = posData[i]-lastPositions[i];
+        needRecompute = (delta.dot(delta) > maxMove2);
+    }
+    if (needRecompute) {
+        neighborList.computeNeighborList(noExclusions.size(), data.posq, noExclusions, extractBoxVectors(context), data.isPeriodic, cutoff+padding, data.threads);
+        lastPositions = posData;
+    }
+}
+
 CpuCalcForcesAndEnergyKernel::CpuCalcForcesAndEnergyKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data, ContextImpl& context) :
-        CalcForcesAndEnergyKernel(name, platform), data(data) {
+        CalcForcesAndEnergyKernel(name, platform), data(data), windowTime(0.0), lastWindowCost(0.0), paddingStep(0.2),
+        windowEvaluations(0), windowRebuilds(0), convergedWindows(0) {
     // Create a Reference platform version of this kernel.
     
     ReferenceKernelFactory referenceFactory;
@@ -165,12 +192,14 @@ void CpuCalcForcesAndEnergyKernel::initialize(const System& system) {
 }
 
 void CpuCalcForcesAndEnergyKernel::beginComputation(ContextImpl& context, bool includeForce, bool includeEnergy, int groups) {
+    computationStartTime = getCurrentTime();
     referenceKernel.getAs<ReferenceCalcForcesAndEnergyKernel>().beginComputation(context, includeForce, includeEnergy, groups);
     
     // Convert positions to single precision and clear the forces.
 
     int numParticles = context.getSystem().getNumParticles();
     bool positionsValid = true;
+    bool forcesCleared = data.threadForceCleared;
     data.threads.execute([&] (ThreadPool& threads, int threadIndex) {
         // Convert the positions to single precision and apply periodic boundary conditions
 
@@ -219,19 +248,23 @@ void CpuCalcForcesAndEnergyKernel::beginComputation(ContextImpl& context, bool i
             if (posq[i] != posq[i] || posq[i+1] != posq[i+1] || posq[i+2] != posq[i+2])
                 positionsValid = false;
 
-        // Clear the forces.
+        // Clear the forces, unless they were already cleared when the previous computation summed them.
 
-        fvec4 zero(0.0f);
-        for (int j = 0; j < numParticles; j++)
-            zero.store(&data.threadForce[threadIndex][j*4]);
+        if (!forcesCleared) {
+            fvec4 zero(0.0f);
+            for (int j = 0; j < numParticles; j++)
+                zero.store(&data.threadForce[threadIndex][j*4]);
+        }
     });
     data.threads.waitForThreads();
+    data.threadForceCleared = false;
     if (!positionsValid)
         throw OpenMMException("Particle coordinate is nan");
 
     // Determine whether we need to recompute the neighbor list.
         
     if (data.neighborList != NULL) {
+        data.numNeighborListEvaluations++;
         double padding = data.paddedCutoff-data.cutoff;;
         bool needRecompute = false;
         double closeCutoff2 = 0.25*padding*padding;
@@ -272,6 +305,8 @@ void CpuCalcForcesAndEnergyKernel::beginComputation(ContextImpl& context, bool i
                 }
         }
         if (needRecompute) {
+            if (data.tunePadding && ++windowRebuilds > 5 && windowEvaluations >= 50)
+                tunePadding();
             data.neighborList->computeNeighborList(numParticles, data.posq, data.exclusions, extractBoxVectors(context), data.isPeriodic, data.paddedCutoff, data.threads);
             lastPositions = posData;
         }
@@ -282,26 +317,84 @@ double CpuCalcForcesAndEnergyKernel::finishComputation(ContextImpl& context, boo
     // Sum the forces from all the threads.
     
     data.threads.execute([&] (ThreadPool& threads, int threadIndex) {
-        // Sum the contributions to forces that have been calculated by different threads.
+        // Sum the contributions to forces that have been calculated by different threads.  Each
+        // buffer is cleared as it is read, while its cache line is still loaded, so the next
+        // computation does not need to make another pass over all of them.
         
         int numParticles = context.getSystem().getNumParticles();
         int numThreads = threads.getNumThreads();
         int start = threadIndex*numParticles/numThreads;
         int end = (threadIndex+1)*numParticles/numThreads;
         vector<Vec3>& forceData = extractForces(context);
-        for (int i = start; i < end; i++) {
-            fvec4 f(0.0f);
-            for (int j = 0; j < numThreads; j++)
-                f += fvec4(&data.threadForce[j][4*i]);
-            forceData[i][0] += f[0];
-            forceData[i][1] += f[1];
-            forceData[i][2] += f[2];
+        fvec4 zero(0.0f);
+        if (data.mixedPrecision) {
+            for (int i = start; i < end; i++) {
+                for (int j = 0; j < numThreads; j++) {
+                    float* f = &data.threadForce[j][4*i];
+                    forceData[i] += Vec3(f[0], f[1], f[2]);
+                    zero.store(f);
+                }
+            }
+        }
+        else {
+            for (int i = start; i < end; i++) {
+                fvec4 f(0.0f);
+                for (int j = 0; j < numThreads; j++) {
+                    f += fvec4(&data.threadForce[j][4*i]);
+                    zero.store(&data.threadForce[j][4*i]);
+                }
+                forceData[i][0] += f[0];
+                forceData[i][1] += f[1];
+                forceData[i][2] += f[2];
+            }
         }
     });
     data.threads.waitForThreads();
+    data.threadForceCleared = true;
+    if (data.tunePadding && data.neighborList != NULL && includeForce) {
+        windowTime += getCurrentTime()-computationStartTime;
+        windowEvaluations++;
+    }
     return referenceKernel.getAs<ReferenceCalcForcesAndEnergyKernel>().finishComputation(context, includeForce, includeEnergy, groups, valid);
 }
 
+void CpuCalcForcesAndEnergyKernel::tunePadding() {
+    // A larger padding makes each evaluation more expensive but lets the neighbor list be reused for
+    // more steps.  Take a step in whichever direction last reduced the cost per evaluation, reversing
+    // and shrinking the step whenever the cost goes up.  Once the step becomes small, hold the padding
+    // fixed for a while, then start probing again in case the system has changed.
+
+    double cost = windowTime/windowEvaluations;
+    windowTime = 0.0;
+    windowEvaluations = 0;
+    windowRebuilds = 1;
+    if (fabs(paddingStep) < 0.02) {
+        if (++convergedWindows < 20)
+            return;
+        convergedWindows = 0;
+        paddingStep = (paddingStep < 0 ? -0.05 : 0.05);
+        lastWindowCost = 0.0;
+    }
+    else if (lastWindowCost > 0.0 && cost > lastWindowCost)
+        paddingStep *= -0.5;
+    lastWindowCost = cost;
+    double padding = (data.paddedCutoff-data.cutoff)*(1.0+paddingStep);
+    padding = max(0.02*data.cutoff, min(0.5*data.cutoff, padding));
+    data.setNeighborListPadding(padding);
+}
+
+void CpuProfileKernel::getPerformanceReport(ContextImpl& context, map<string, double>& report) {
+    if (data.neighborList == NULL)
+        return;
+    CpuNeighborList& neighborList = *data.neighborList;
+    report["neighborList:builds"] = (double) neighborList.getNumFullBuilds();
+    report["neighborList:incrementalUpdates"] = (double) neighborList.getNumIncrementalUpdates();
+    report["neighborList:evaluations"] = (double) data.numNeighborListEvaluations;
+    report["neighborList:blocks"] = neighborList.getNumBlocks();
+    report["neighborList:neighbors"] = (double) neighborList.getNumNeighbors();
+    report["neighborList:padding"] = data.paddedCutoff-data.cutoff;
+}
+
 void CpuCalcHarmonicAngleForceKernel::initialize(const System& system, const HarmonicAngleForce& force) {
     numAngles = force.getNumAngles();
     angleIndexArray.resize(numAngles, vector<int>(3));
@@ -452,6 +545,458 @@ void CpuCalcRBTorsionForceKernel::copyParametersToContext(ContextImpl& context,
     }
 }
 
+CpuCalcCustomBondForceKernel::~CpuCalcCustomBondForceKernel() {
+    for (auto ixn : threadIxn)
+        delete ixn;
+}
+
+void CpuCalcCustomBondForceKernel::initialize(const System& system, const CustomBondForce& force) {
+    numBonds = force.getNumBonds();
+    int numParameters = force.getNumPerBondParameters();
+    usePeriodic = force.usesPeriodicBoundaryConditions();
+
+    // Build the arrays.
+
+    bondIndexArray.resize(numBonds, vector<int>(2));
+    bondParamArray.resize(numBonds, vector<double>(numParameters));
+    vector<double> params;
+    for (int i = 0; i < numBonds; ++i) {
+        int particle1, particle2;
+        force.getBondParameters(i, particle1, particle2, params);
+        bondIndexArray[i][0] = particle1;
+        bondIndexArray[i][1] = particle2;
+        for (int j = 0; j < numParameters; j++)
+            bondParamArray[i][j] = params[j];
+    }
+    bondForce.initialize(system.getNumParticles(), numBonds, 2, bondIndexArray, data.threads);
+
+    // Parse the expression used to calculate the force.
+
+    Lepton::ParsedExpression expression = Lepton::Parser::parse(force.getEnergyFunction()).optimize();
+    Lepton::CompiledExpression energyExpression = expression.createCompiledExpression();
+    Lepton::CompiledExpression forceExpression = expression.differentiate("r").createCompiledExpression();
+    vector<string> parameterNames;
+    for (int i = 0; i < numParameters; i++)
+        parameterNames.push_back(force.getPerBondParameterName(i));
+    for (int i = 0; i < force.getNumGlobalParameters(); i++)
+        globalParameterNames.push_back(force.getGlobalParameterName(i));
+    vector<Lepton::CompiledExpression> energyParamDerivExpressions;
+    for (int i = 0; i < force.getNumEnergyParameterDerivatives(); i++) {
+        string param = force.getEnergyParameterDerivativeName(i);
+        energyParamDerivNames.push_back(param);
+        energyParamDerivExpressions.push_back(expression.differentiate(param).createCompiledExpression());
+    }
+    set<string> variables;
+    variables.insert("r");
+    variables.insert(parameterNames.begin(), parameterNames.end());
+    variables.insert(globalParameterNames.begin(), globalParameterNames.end());
+    validateVariables(expression.getRootNode(), variables);
+
+    // Each thread needs its own copy of the expressions.
+
+    for (int i = 0; i < data.threads.getNumThreads(); i++)
+        threadIxn.push_back(new ReferenceCustomBondIxn(energyExpression, forceExpression, parameterNames, energyParamDerivExpressions));
+}
+
+double CpuCalcCustomBondForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
+    vector<Vec3>& posData = extractPositions(context);
+    vector<Vec3>& forceData = extractForces(context);
+    double energy = 0;
+    map<string, double> globalParameters;
+    for (auto& name : globalParameterNames)
+        globalParameters[name] = context.getParameter(name);
+    for (auto ixn : threadIxn) {
+        ixn->setGlobalParameters(globalParameters);
+        if (usePeriodic)
+            ixn->setPeriodic(extractBoxVectors(context));
+    }
+    vector<ReferenceBondIxn*> bondIxn(threadIxn.begin(), threadIxn.end());
+    vector<double> energyParamDerivValues(energyParamDerivNames.size(), 0.0);
+    bondForce.calculateForce(posData, bondParamArray, forceData, includeEnergy ? &energy : NULL, bondIxn, energyParamDerivValues);
+    map<string, double>& energyParamDerivs = extractEnergyParameterDerivatives(context);
+    for (int i = 0; i < energyParamDerivNames.size(); i++)
+        energyParamDerivs[energyParamDerivNames[i]] += energyParamDerivValues[i];
+    return energy;
+}
+
+void CpuCalcCustomBondForceKernel::copyParametersToContext(ContextImpl& context, const CustomBondForce& force) {
+    if (numBonds != force.getNumBonds())
+        throw OpenMMException("updateParametersInContext: The number of bonds has changed");
+
+    // Record the values.
+
+    int numParameters = force.getNumPerBondParameters();
+    vector<double> params;
+    for (int i = 0; i < numBonds; ++i) {
+        int particle1, particle2;
+        force.getBondParameters(i, particle1, particle2, params);
+        if (particle1 != bondIndexArray[i][0] || particle2 != bondIndexArray[i][1])
+            throw OpenMMException("updateParametersInContext: The set of particles in a bond has changed");
+        for (int j = 0; j < numParameters; j++)
+            bondParamArray[i][j] = params[j];
+    }
+}
+
+CpuCalcCustomAngleForceKernel::~CpuCalcCustomAngleForceKernel() {
+    for (auto ixn : threadIxn)
+        delete ixn;
+}
+
+void CpuCalcCustomAngleForceKernel::initialize(const System& system, const CustomAngleForce& force) {
+    numAngles = force.getNumAngles();
+    int numParameters = force.getNumPerAngleParameters();
+    usePeriodic = force.usesPeriodicBoundaryConditions();
+
+    // Build the arrays.
+
+    angleIndexArray.resize(numAngles, vector<int>(3));
+    angleParamArray.resize(numAngles, vector<double>(numParameters));
+    vector<double> params;
+    for (int i = 0; i < numAngles; ++i) {
+        int particle1, particle2, particle3;
+        force.getAngleParameters(i, particle1, particle2, particle3, params);
+        angleIndexArray[i][0] = particle1;
+        angleIndexArray[i][1] = particle2;
+        angleIndexArray[i][2] = particle3;
+        for (int j = 0; j < numParameters; j++)
+            angleParamArray[i][j] = params[j];
+    }
+    bondForce.initialize(system.getNumParticles(), numAngles, 3, angleIndexArray, data.threads);
+
+    // Parse the expression used to calculate the force.
+
+    Lepton::ParsedExpression expression = Lepton::Parser::parse(force.getEnergyFunction()).optimize();
+    Lepton::CompiledExpression energyExpression = expression.createCompiledExpression();
+    Lepton::CompiledExpression forceExpression = expression.differentiate("theta").createCompiledExpression();
+    vector<string> parameterNames;
+    for (int i = 0; i < numParameters; i++)
+        parameterNames.push_back(force.getPerAngleParameterName(i));
+    for (int i = 0; i < force.getNumGlobalParameters(); i++)
+        globalParameterNames.push_back(force.getGlobalParameterName(i));
+    vector<Lepton::CompiledExpression> energyParamDerivExpressions;
+    for (int i = 0; i < force.getNumEnergyParameterDerivatives(); i++) {
+        string param = force.getEnergyParameterDerivativeName(i);
+        energyParamDerivNames.push_back(param);
+        energyParamDerivExpressions.push_back(expression.differentiate(param).createCompiledExpression());
+    }
+    set<string> variables;
+    variables.insert("theta");
+    variables.insert(parameterNames.begin(), parameterNames.end());
+    variables.insert(globalParameterNames.begin(), globalParameterNames.end());
+    validateVariables(expression.getRootNode(), variables);
+
+    // Each thread needs its own copy of the expressions.
+
+    for (int i = 0; i < data.threads.getNumThreads(); i++)
+        threadIxn.push_back(new ReferenceCustomAngleIxn(energyExpression, forceExpression, parameterNames, energyParamDerivExpressions));
+}
+
+double CpuCalcCustomAngleForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
+    vector<Vec3>& posData = extractPositions(context);
+    vector<Vec3>& forceData = extractForces(context);
+    double energy = 0;
+    map<string, double> globalParameters;
+    for (auto& name : globalParameterNames)
+        globalParameters[name] = context.getParameter(name);
+    for (auto ixn : threadIxn) {
+        ixn->setGlobalParameters(globalParameters);
+        if (usePeriodic)
+            ixn->setPeriodic(extractBoxVectors(context));
+    }
+    vector<ReferenceBondIxn*> bondIxn(threadIxn.begin(), threadIxn.end());
+    vector<double> energyParamDerivValues(energyParamDerivNames.size(), 0.0);
+    bondForce.calculateForce(posData, angleParamArray, forceData, includeEnergy ? &energy : NULL, bondIxn, energyParamDerivValues);
+    map<string, double>& energyParamDerivs = extractEnergyParameterDerivatives(context);
+    for (int i = 0; i < energyParamDerivNames.size(); i++)
+        energyParamDerivs[energyParamDerivNames[i]] += energyParamDerivValues[i];
+    return energy;
+}
+
+void CpuCalcCustomAngleForceKernel::copyParametersToContext(ContextImpl& context, const CustomAngleForce& force) {
+    if (numAngles != force.getNumAngles())
+        throw OpenMMException("updateParametersInContext: The number of angles has changed");
+
+    // Record the values.
+
+    int numParameters = force.getNumPerAngleParameters();
+    vector<double> params;
+    for (int i = 0; i < numAngles; ++i) {
+        int particle1, particle2, particle3;
+        force.getAngleParameters(i, particle1, particle2, particle3, params);
+        if (particle1 != angleIndexArray[i][0] || particle2 != angleIndexArray[i][1] || particle3 != angleIndexArray[i][2])
+            throw OpenMMException("updateParametersInContext: The set of particles in an angle has changed");
+        for (int j = 0; j < numParameters; j++)
+            angleParamArray[i][j] = params[j];
+    }
+}
+
+CpuCalcCustomTorsionForceKernel::~CpuCalcCustomTorsionForceKernel() {
+    for (auto ixn : threadIxn)
+        delete ixn;
+}
+
+void CpuCalcCustomTorsionForceKernel::initialize(const System& system, const CustomTorsionForce& force) {
+    numTorsions = force.getNumTorsions();
+    int numParameters = force.getNumPerTorsionParameters();
+    usePeriodic = force.usesPeriodicBoundaryConditions();
+
+    // Build the arrays.
+
+    torsionIndexArray.resize(numTorsions, vector<int>(4));
+    torsionParamArray.resize(numTorsions, vector<double>(numParameters));
+    vector<double> params;
+    for (int i = 0; i < numTorsions; ++i) {
+        int particle1, particle2, particle3, particle4;
+        force.getTorsionParameters(i, particle1, particle2, particle3, particle4, params);
+        torsionIndexArray[i][0] = particle1;
+        torsionIndexArray[i][1] = particle2;
+        torsionIndexArray[i][2] = particle3;
+        torsionIndexArray[i][3] = particle4;
+        for (int j = 0; j < numParameters; j++)
+            torsionParamArray[i][j] = params[j];
+    }
+    bondForce.initialize(system.getNumParticles(), numTorsions, 4, torsionIndexArray, data.threads);
+
+    // Parse the expression used to calculate the force.
+
+    Lepton::ParsedExpression expression = Lepton::Parser::parse(force.getEnergyFunction()).optimize();
+    Lepton::CompiledExpression energyExpression = expression.createCompiledExpression();
+    Lepton::CompiledExpression forceExpression = expression.differentiate("theta").createCompiledExpression();
+    vector<string> parameterNames;
+    for (int i = 0; i < numParameters; i++)
+        parameterNames.push_back(force.getPerTorsionParameterName(i));
+    for (int i = 0; i < force.getNumGlobalParameters(); i++)
+        globalParameterNames.push_back(force.getGlobalParameterName(i));
+    vector<Lepton::CompiledExpression> energyParamDerivExpressions;
+    for (int i = 0; i < force.getNumEnergyParameterDerivatives(); i++) {
+        string param = force.getEnergyParameterDerivativeName(i);
+        energyParamDerivNames.push_back(param);
+        energyParamDerivExpressions.push_back(expression.differentiate(param).createCompiledExpression());
+    }
+    set<string> variables;
+    variables.insert("theta");
+    variables.insert(parameterNames.begin(), parameterNames.end());
+    variables.insert(globalParameterNames.begin(), globalParameterNames.end());
+    validateVariables(expression.getRootNode(), variables);
+
+    // Each thread needs its own copy of the expressions.
+
+    for (int i = 0; i < data.threads.getNumThreads(); i++)
+        threadIxn.push_back(new ReferenceCustomTorsionIxn(energyExpression, forceExpression, parameterNames, energyParamDerivExpressions));
+}
+
+double CpuCalcCustomTorsionForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
+    vector<Vec3>& posData = extractPositions(context);
+    vector<Vec3>& forceData = extractForces(context);
+    double energy = 0;
+    map<string, double> globalParameters;
+    for (auto& name : globalParameterNames)
+        globalParameters[name] = context.getParameter(name);
+    for (auto ixn : threadIxn) {
+        ixn->setGlobalParameters(globalParameters);
+        if (usePeriodic)
+            ixn->setPeriodic(extractBoxVectors(context));
+    }
+    vector<ReferenceBondIxn*> bondIxn(threadIxn.begin(), threadIxn.end());
+    vector<double> energyParamDerivValues(energyParamDerivNames.size(), 0.0);
+    bondForce.calculateForce(posData, torsionParamArray, forceData, includeEnergy ? &energy : NULL, bondIxn, energyParamDerivValues);
+    map<string, double>& energyParamDerivs = extractEnergyParameterDerivatives(context);
+    for (int i = 0; i < energyParamDerivNames.size(); i++)
+        energyParamDerivs[energyParamDerivNames[i]] += energyParamDerivValues[i];
+    return energy;
+}
+
+void CpuCalcCustomTorsionForceKernel::copyParametersToContext(ContextImpl& context, const CustomTorsionForce& force) {
+    if (numTorsions != force.getNumTorsions())
+        throw OpenMMException("updateParametersInContext: The number of torsions has changed");
+
+    // Record the values.
+
+    int numParameters = force.getNumPerTorsionParameters();
+    vector<double> params;
+    for (int i = 0; i < numTorsions; ++i) {
+        int particle1, particle2, particle3, particle4;
+        force.getTorsionParameters(i, particle1, particle2, particle3, particle4, params);
+        if (particle1 != torsionIndexArray[i][0] || particle2 != torsionIndexArray[i][1] || particle3 != torsionIndexArray[i][2] || particle4 != torsionIndexArray[i][3])
+            throw OpenMMException("updateParametersInContext: The set of particles in a torsion has changed");
+        for (int j = 0; j < numParameters; j++)
+            torsionParamArray[i][j] = params[j];
+    }
+}
+
+void CpuCalcCMAPTorsionForceKernel::initialize(const System& system, const CMAPTorsionForce& force) {
+    int numMaps = force.getNumMaps();
+    int numTorsions = force.getNumTorsions();
+    coeff.resize(numMaps);
+    vector<double> energy;
+    vector<vector<double> > c;
+    for (int i = 0; i < numMaps; i++) {
+        int size;
+        force.getMapParameters(i, size, energy);
+        CMAPTorsionForceImpl::calcMapDerivatives(size, energy, c);
+        coeff[i].resize(size*size);
+        for (int j = 0; j < size*size; j++) {
+            coeff[i][j].resize(16);
+            for (int k = 0; k < 16; k++)
+                coeff[i][j][k] = c[j][k];
+        }
+    }
+    torsionMaps.resize(numTorsions);
+    torsionIndices.resize(numTorsions);
+    torsionMapParams.resize(numTorsions, vector<double>(1));
+    for (int i = 0; i < numTorsions; i++) {
+        torsionIndices[i].resize(8);
+        force.getTorsionParameters(i, torsionMaps[i], torsionIndices[i][0], torsionIndices[i][1], torsionIndices[i][2],
+            torsionIndices[i][3], torsionIndices[i][4], torsionIndices[i][5], torsionIndices[i][6], torsionIndices[i][7]);
+        torsionMapParams[i][0] = torsionMaps[i];
+    }
+    bondForce.initialize(system.getNumParticles(), numTorsions, 8, torsionIndices, data.threads);
+    usePeriodic = force.usesPeriodicBoundaryConditions();
+}
+
+double CpuCalcCMAPTorsionForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
+    vector<Vec3>& posData = extractPositions(context);
+    vector<Vec3>& forceData = extractForces(context);
+    double energy = 0;
+    ReferenceCMAPTorsionIxn torsion(coeff, torsionMaps, torsionIndices);
+    if (usePeriodic)
+        torsion.setPeriodic(extractBoxVectors(context));
+    bondForce.calculateForce(posData, torsionMapParams, forceData, includeEnergy ? &energy : NULL, torsion);
+    return energy;
+}
+
+void CpuCalcCMAPTorsionForceKernel::copyParametersToContext(ContextImpl& context, const CMAPTorsionForce& force) {
+    int numMaps = force.getNumMaps();
+    int numTorsions = force.getNumTorsions();
+    if (coeff.size() != numMaps)
+        throw OpenMMException("updateParametersInContext: The number of maps has changed");
+    if (torsionMaps.size() != numTorsions)
+        throw OpenMMException("updateParametersInContext: The number of CMAP torsions has changed");
+
+    // Update the maps.
+
+    vector<double> energy;
+    vector<vector<double> > c;
+    for (int i = 0; i < numMaps; i++) {
+        int size;
+        force.getMapParameters(i, size, energy);
+        if (coeff[i].size() != size*size)
+            throw OpenMMException("updateParametersInContext: The size of a map has changed");
+        CMAPTorsionForceImpl::calcMapDerivatives(size, energy, c);
+        for (int j = 0; j < size*size; j++)
+            for (int k = 0; k < 16; k++)
+                coeff[i][j][k] = c[j][k];
+    }
+
+    // Update the indices.
+
+    for (int i = 0; i < numTorsions; i++) {
+        int index[8];
+        force.getTorsionParameters(i, torsionMaps[i], index[0], index[1], index[2], index[3], index[4], index[5], index[6], index[7]);
+        for (int j = 0; j < 8; j++)
+            if (index[j] != torsionIndices[i][j])
+                throw OpenMMException("updateParametersInContext: The set of particles in a CMAP torsion has changed");
+        torsionMapParams[i][0] = torsionMaps[i];
+    }
+}
+
+/**
+ * This adapts ReferenceCustomExternalIxn to the ReferenceBondIxn interface, treating each particle
+ * as a one atom "bond" so the computation can be parallelized by CpuBondForce.
+ */
+class CpuCalcCustomExternalForceKernel::ExternalIxn : public ReferenceBondIxn {
+public:
+    ExternalIxn(const Lepton::CompiledExpression& energyExpression, const Lepton::CompiledExpression& forceExpressionX,
+            const Lepton::CompiledExpression& forceExpressionY, const Lepton::CompiledExpression& forceExpressionZ, const vector<string>& parameterNames) :
+            ixn(energyExpression, forceExpressionX, forceExpressionY, forceExpressionZ, parameterNames) {
+    }
+    void calculateBondIxn(vector<int>& atomIndices, vector<Vec3>& atomCoordinates, vector<double>& parameters,
+            vector<Vec3>& forces, double* totalEnergy, double* energyParamDerivs) {
+        ixn.calculateForce(atomIndices[0], atomCoordinates, parameters, forces, totalEnergy);
+    }
+    ReferenceCustomExternalIxn ixn;
+};
+
+CpuCalcCustomExternalForceKernel::~CpuCalcCustomExternalForceKernel() {
+    for (auto ixn : threadIxn)
+        delete ixn;
+}
+
+void CpuCalcCustomExternalForceKernel::initialize(const System& system, const CustomExternalForce& force) {
+    numParticles = force.getNumParticles();
+    int numParameters = force.getNumPerParticleParameters();
+
+    // Build the arrays.
+
+    particleIndexArray.resize(numParticles, vector<int>(1));
+    particleParamArray.resize(numParticles);
+    for (int i = 0; i < numParticles; ++i)
+        force.getParticleParameters(i, particleIndexArray[i][0], particleParamArray[i]);
+    bondForce.initialize(system.getNumParticles(), numParticles, 1, particleIndexArray, data.threads);
+
+    // Parse the expression used to calculate the force.
+
+    map<string, Lepton::CustomFunction*> functions;
+    ReferenceCustomExternalIxn::PeriodicDistanceFunction periodicDistance(&boxVectors);
+    functions["periodicdistance"] = &periodicDistance;
+    Lepton::ParsedExpression expression = Lepton::Parser::parse(force.getEnergyFunction(), functions).optimize();
+    Lepton::CompiledExpression energyExpression = expression.createCompiledExpression();
+    Lepton::CompiledExpression forceExpressionX = expression.differentiate("x").createCompiledExpression();
+    Lepton::CompiledExpression forceExpressionY = expression.differentiate("y").createCompiledExpression();
+    Lepton::CompiledExpression forceExpressionZ = expression.differentiate("z").createCompiledExpression();
+    vector<string> parameterNames;
+    for (int i = 0; i < numParameters; i++)
+        parameterNames.push_back(force.getPerParticleParameterName(i));
+    for (int i = 0; i < force.getNumGlobalParameters(); i++)
+        globalParameterNames.push_back(force.getGlobalParameterName(i));
+    set<string> variables;
+    variables.insert("x");
+    variables.insert("y");
+    variables.insert("z");
+    variables.insert(parameterNames.begin(), parameterNames.end());
+    variables.insert(globalParameterNames.begin(), globalParameterNames.end());
+    validateVariables(expression.getRootNode(), variables);
+
+    // Each thread needs its own copy of the expressions.
+
+    for (int i = 0; i < data.threads.getNumThreads(); i++)
+        threadIxn.push_back(new ExternalIxn(energyExpression, forceExpressionX, forceExpressionY, forceExpressionZ, parameterNames));
+}
+
+double CpuCalcCustomExternalForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
+    vector<Vec3>& posData = extractPositions(context);
+    vector<Vec3>& forceData = extractForces(context);
+    boxVectors = extractBoxVectors(context);
+    double energy = 0;
+    map<string, double> globalParameters;
+    for (auto& name : globalParameterNames)
+        globalParameters[name] = context.getParameter(name);
+    for (auto ixn : threadIxn)
+        ixn->ixn.setGlobalParameters(globalParameters);
+    vector<ReferenceBondIxn*> bondIxn(threadIxn.begin(), threadIxn.end());
+    vector<double> energyParamDerivValues;
+    bondForce.calculateForce(posData, particleParamArray, forceData, includeEnergy ? &energy : NULL, bondIxn, energyParamDerivValues);
+    return energy;
+}
+
+void CpuCalcCustomExternalForceKernel::copyParametersToContext(ContextImpl& context, const CustomExternalForce& force) {
+    if (numParticles != force.getNumParticles())
+        throw OpenMMException("updateParametersInContext: The number of particles has changed");
+
+    // Record the values.
+
+    int numParameters = force.getNumPerParticleParameters();
+    for (int i = 0; i < numParticles; ++i) {
+        int particle;
+        vector<double> parameters;
+        force.getParticleParameters(i, particle, parameters);
+        if (particle != particleIndexArray[i][0])
+            throw OpenMMException("updateParametersInContext: A particle index has changed");
+        for (int j = 0; j < numParameters; j++)
+            particleParamArray[i][j] = parameters[j];
+    }
+}
+
 class CpuCalcNonbondedForceKernel::PmeIO : public CalcPmeReciprocalForceKernel::IO {
 public:
     PmeIO(float* posq, float* force, int numParticles) : posq(posq), force(force), numParticles(numParticles) {
@@ -486,7 +1031,6 @@ CpuCalcNonbondedForceKernel::~CpuCalcNonbondedForceKernel() {
 
 void CpuCalcNonbondedForceKernel::initialize(const System& system, const NonbondedForce& force) {
     chargePosqIndex = data.requestPosqIndex();
-    ljPosqIndex = data.requestPosqIndex();
 
     // Identify which exceptions are 1-4 interactions.
 
@@ -586,6 +1130,7 @@ void CpuCalcNonbondedForceKernel::initialize(const System& system, const Nonbond
         useSwitchingFunction = force.getUseSwitchingFunction();
         switchingDistance = force.getSwitchingDistance();
     }
+    pmeOrder = force.getPMEInterpolationOrder();
     if (nonbondedMethod == Ewald) {
         double alpha;
         NonbondedForceImpl::calcEwaldParameters(system, force, alpha, kmax[0], kmax[1], kmax[2]);
@@ -621,8 +1166,8 @@ double CpuCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeFo
         hasInitializedPme = true;
         useOptimizedPme = false;
         computeParameters(context, false);
-        if (nonbondedMethod == PME) {
-            // If available, use the optimized PME implementation.
+        if (nonbondedMethod == PME && pmeOrder == 5) {
+            // If available, use the optimized PME implementation.  It only supports fifth order interpolation.
 
             vector<string> kernelNames;
             kernelNames.push_back("CalcPmeReciprocalForce");
@@ -632,8 +1177,8 @@ double CpuCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeFo
                 optimizedPme.getAs<CalcPmeReciprocalForceKernel>().initialize(gridSize[0], gridSize[1], gridSize[2], numParticles, ewaldAlpha, data.deterministicForces);
             }
         }
-        if (nonbondedMethod == LJPME) {
-            // If available, use the optimized PME implementation.
+        if (nonbondedMethod == LJPME && pmeOrder == 5) {
+            // If available, use the optimized PME implementation.  It only supports fifth order interpolation.
 
             vector<string> kernelNames;
             kernelNames.push_back("CalcPmeReciprocalForce");
@@ -645,6 +1190,7 @@ double CpuCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeFo
                 optimizedDispersionPme = getPlatform().createKernel(CalcDispersionPmeReciprocalForceKernel::Name(), context);
                 optimizedDispersionPme.getAs<CalcDispersionPmeReciprocalForceKernel>().initialize(dispersionGridSize[0], dispersionGridSize[1],
                                                                                                   dispersionGridSize[2], numParticles, ewaldDispersionAlpha, data.deterministicForces);
+                dispersionPosq.resize(4*numParticles);
             }
         }
     }
@@ -671,27 +1217,39 @@ double CpuCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeFo
     if (ewald)
         nonbonded->setUseEwald(ewaldAlpha, kmax[0], kmax[1], kmax[2]);
     if (pme)
-        nonbonded->setUsePME(ewaldAlpha, gridSize);
+        nonbonded->setUsePME(ewaldAlpha, gridSize, pmeOrder);
     if (useSwitchingFunction)
         nonbonded->setUseSwitchingFunction(switchingDistance);
     if (ljpme){
-        nonbonded->setUsePME(ewaldAlpha, gridSize);
-        nonbonded->setUseLJPME(ewaldDispersionAlpha, dispersionGridSize);
+        nonbonded->setUsePME(ewaldAlpha, gridSize, pmeOrder);
+        nonbonded->setUseLJPME(ewaldDispersionAlpha, dispersionGridSize, pmeOrder);
     }
     double nonbondedEnergy = 0;
     if (includeDirect)
-        nonbonded->calculateDirectIxn(numParticles, &posq[0], posData, particleParams, C6params, exclusions, data.threadForce, includeEnergy ? &nonbondedEnergy : NULL, data.threads);
+        nonbonded->calculateDirectIxn(numParticles, &posq[0], posData, particleParams, C6params, exclusions, data.threadForce, includeEnergy ? &nonbondedEnergy : NULL, data.threads,
+                data.mixedPrecision ? &forceData : NULL);
     if (includeReciprocal) {
         if (useOptimizedPme) {
             PmeIO io(&posq[0], &data.threadForce[0][0], numParticles);
+            PmeIO dispersionIO(nonbondedMethod == LJPME ? &dispersionPosq[0] : NULL, &data.threadForce[0][0], numParticles);
             Vec3 periodicBoxVectors[3] = {boxVectors[0], boxVectors[1], boxVectors[2]};
             optimizedPme.getAs<CalcPmeReciprocalForceKernel>().beginComputation(io, periodicBoxVectors, includeEnergy);
-            nonbondedEnergy += optimizedPme.getAs<CalcPmeReciprocalForceKernel>().finishComputation(io);
             if (nonbondedMethod == LJPME) {
-                copyChargesToPosq(context, C6params, ljPosqIndex);
-                optimizedDispersionPme.getAs<CalcDispersionPmeReciprocalForceKernel>().beginComputation(io, periodicBoxVectors, includeEnergy);
-                nonbondedEnergy += optimizedDispersionPme.getAs<CalcDispersionPmeReciprocalForceKernel>().finishComputation(io);
+                // The dispersion calculation reads its own copy of the positions with C6 in place of the charge.
+                // That lets it run at the same time as the electrostatic calculation, and means posq does not
+                // need to have the charges restored before the next step.
+
+                for (int i = 0; i < numParticles; i++) {
+                    dispersionPosq[4*i] = posq[4*i];
+                    dispersionPosq[4*i+1] = posq[4*i+1];
+                    dispersionPosq[4*i+2] = posq[4*i+2];
+                    dispersionPosq[4*i+3] = C6params[i];
+                }
+                optimizedDispersionPme.getAs<CalcDispersionPmeReciprocalForceKernel>().beginComputation(dispersionIO, periodicBoxVectors, includeEnergy);
             }
+            nonbondedEnergy += optimizedPme.getAs<CalcPmeReciprocalForceKernel>().finishComputation(io);
+            if (nonbondedMethod == LJPME)
+                nonbondedEnergy += optimizedDispersionPme.getAs<CalcDispersionPmeReciprocalForceKernel>().finishComputation(dispersionIO);
         }
         else
             nonbonded->calculateReciprocalIxn(numParticles, &posq[0], posData, particleParams, C6params, exclusions, forceData, includeEnergy ? &nonbondedEnergy : NULL);
@@ -820,7 +1378,6 @@ void CpuCalcNonbondedForceKernel::computeParameters(ContextImpl& context, bool o
         else
             ewaldSelfEnergy = 0.0;
         chargePosqIndex = data.requestPosqIndex();
-        ljPosqIndex = data.requestPosqIndex();
     }
 
     // Compute exception parameters.
@@ -892,19 +1449,18 @@ void CpuCalcCustomNonbondedForceKernel::initialize(const System& system, const C
     // Parse the various expressions used to calculate the force.
 
     Lepton::ParsedExpression expression = Lepton::Parser::parse(force.getEnergyFunction(), functions).optimize();
-    Lepton::CompiledExpression energyExpression = expression.createCompiledExpression();
-    Lepton::CompiledExpression forceExpression = expression.differentiate("r").createCompiledExpression();
+    Lepton::ParsedExpression forceExpression = expression.differentiate("r").optimize();
     for (int i = 0; i < numParameters; i++)
         parameterNames.push_back(force.getPerParticleParameterName(i));
     for (int i = 0; i < force.getNumGlobalParameters(); i++) {
         globalParameterNames.push_back(force.getGlobalParameterName(i));
         globalParamValues[force.getGlobalParameterName(i)] = force.getGlobalParameterDefaultValue(i);
     }
-    std::vector<Lepton::CompiledExpression> energyParamDerivExpressions;
+    std::vector<Lepton::ParsedExpression> energyParamDerivExpressions;
     for (int i = 0; i < force.getNumEnergyParameterDerivatives(); i++) {
         string param = force.getEnergyParameterDerivativeName(i);
         energyParamDerivNames.push_back(param);
-        energyParamDerivExpressions.push_back(expression.differentiate(param).createCompiledExpression());
+        energyParamDerivExpressions.push_back(expression.differentiate(param).optimize());
     }
     set<string> variables;
     variables.insert("r");
@@ -924,6 +1480,7 @@ void CpuCalcCustomNonbondedForceKernel::initialize(const System& system, const C
     
     if (force.getNonbondedMethod() == CustomNonbondedForce::CutoffPeriodic && force.getUseLongRangeCorrection()) {
         forceCopy = new CustomNonbondedForce(force);
+        longRangeCorrectionData = CustomNonbondedForceImpl::prepareLongRangeCorrection(force);
         hasInitializedLongRangeCorrection = false;
     }
     else {
@@ -939,7 +1496,7 @@ void CpuCalcCustomNonbondedForceKernel::initialize(const System& system, const C
         interactionGroups.push_back(make_pair(set1, set2));
     }
     data.isPeriodic |= (nonbondedMethod == CutoffPeriodic);
-    nonbonded = new CpuCustomNonbondedForce(energyExpression, forceExpression, parameterNames, exclusions, energyParamDerivExpressions, data.threads);
+    nonbonded = new CpuCustomNonbondedForce(expression, forceExpression, parameterNames, exclusions, energyParamDerivExpressions, data.threads);
     if (interactionGroups.size() > 0)
         nonbonded->setInteractionGroups(interactionGroups);
 }
@@ -976,7 +1533,7 @@ double CpuCalcCustomNonbondedForceKernel::execute(ContextImpl& context, bool inc
     // Add in the long range correction.
     
     if (!hasInitializedLongRangeCorrection || (globalParamsChanged && forceCopy != NULL)) {
-        CustomNonbondedForceImpl::calcLongRangeCorrection(*forceCopy, context.getOwner(), longRangeCoefficient, longRangeCoefficientDerivs);
+        CustomNonbondedForceImpl::calcLongRangeCorrection(*forceCopy, longRangeCorrectionData, context.getOwner(), longRangeCoefficient, longRangeCoefficientDerivs, &data.threads);
         hasInitializedLongRangeCorrection = true;
     }
     double volume = boxVectors[0][0]*boxVectors[1][1]*boxVectors[2][2];
@@ -1004,13 +1561,16 @@ void CpuCalcCustomNonbondedForceKernel::copyParametersToContext(ContextImpl& con
     // If necessary, recompute the long range correction.
     
     if (forceCopy != NULL) {
-        CustomNonbondedForceImpl::calcLongRangeCorrection(force, context.getOwner(), longRangeCoefficient, longRangeCoefficientDerivs);
+        longRangeCorrectionData = CustomNonbondedForceImpl::prepareLongRangeCorrection(force);
+        CustomNonbondedForceImpl::calcLongRangeCorrection(force, longRangeCorrectionData, context.getOwner(), longRangeCoefficient, longRangeCoefficientDerivs, &data.threads);
         hasInitializedLongRangeCorrection = true;
         *forceCopy = force;
     }
 }
 
 CpuCalcGBSAOBCForceKernel::~CpuCalcGBSAOBCForceKernel() {
+    if (neighborList != NULL)
+        delete neighborList;
 }
 
 void CpuCalcGBSAOBCForceKernel::initialize(const System& system, const GBSAOBCForce& force) {
@@ -1029,8 +1589,13 @@ void CpuCalcGBSAOBCForceKernel::initialize(const System& system, const GBSAOBCFo
     obc.setSolventDielectric((float) force.getSolventDielectric());
     obc.setSoluteDielectric((float) force.getSoluteDielectric());
     obc.setSurfaceAreaEnergy((float) force.getSurfaceAreaEnergy());
-    if (force.getNonbondedMethod() != GBSAOBCForce::NoCutoff)
-        obc.setUseCutoff((float) force.getCutoffDistance());
+    if (force.getNonbondedMethod() != GBSAOBCForce::NoCutoff) {
+        // GBSA interactions are never excluded, so this cannot use the shared neighbor list.
+
+        cutoff = (float) force.getCutoffDistance();
+        neighborList = new CpuNeighborList(4);
+        noExclusions.resize(numParticles);
+    }
     data.isPeriodic |= (force.getNonbondedMethod() == GBSAOBCForce::CutoffPeriodic);
 }
 
@@ -1041,6 +1606,10 @@ double CpuCalcGBSAOBCForceKernel::execute(ContextImpl& context, bool includeForc
         float floatBoxSize[3] = {(float) boxSize[0], (float) boxSize[1], (float) boxSize[2]};
         obc.setPeriodic(floatBoxSize);
     }
+    if (neighborList != NULL) {
+        updateUnexcludedNeighborList(context, *neighborList, noExclusions, lastPositions, cutoff, 0.1*cutoff);
+        obc.setUseCutoff(cutoff, *neighborList);
+    }
     double energy = 0.0;
     obc.computeForce(data.posq, data.threadForce, includeEnergy ? &energy : NULL, data.threads);
     return energy;
@@ -1108,8 +1677,10 @@ void CpuCalcCustomGBForceKernel::initialize(const System& system, const CustomGB
         globalParameterNames.push_back(force.getGlobalParameterName(i));
     nonbondedMethod = CalcCustomGBForceKernel::NonbondedMethod(force.getNonbondedMethod());
     nonbondedCutoff = force.getCutoffDistance();
-    if (nonbondedMethod != NoCutoff)
+    if (nonbondedMethod != NoCutoff) {
         neighborList = new CpuNeighborList(4);
+        noExclusions.resize(numParticles);
+    }
 
     // Create custom functions for the tabulated functions.
 
@@ -1211,12 +1782,10 @@ void CpuCalcCustomGBForceKernel::initialize(const System& system, const CustomGB
 double CpuCalcCustomGBForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
     vector<Vec3>& forceData = extractForces(context);
     double energy = 0;
-    Vec3* boxVectors = extractBoxVectors(context);
     if (data.isPeriodic)
         ixn->setPeriodic(extractBoxSize(context));
     if (nonbondedMethod != NoCutoff) {
-        vector<set<int> > noExclusions(numParticles);
-        neighborList->computeNeighborList(numParticles, data.posq, noExclusions, boxVectors, data.isPeriodic, nonbondedCutoff, data.threads);
+        updateUnexcludedNeighborList(context, *neighborList, noExclusions, lastPositions, nonbondedCutoff, 0.1*nonbondedCutoff);
         ixn->setUseCutoff(nonbondedCutoff, *neighborList);
     }
     map<string, double> globalParameters;
@@ -1406,3 +1975,123 @@ void CpuIntegrateLangevinMiddleStepKernel::execute(ContextImpl& context, const L
 double CpuIntegrateLangevinMiddleStepKernel::computeKineticEnergy(ContextImpl& context, const LangevinMiddleIntegrator& integrator) {
     return computeShiftedKineticEnergy(context, masses, 0.0);
 }
+
+CpuIntegrateVerletStepKernel::~CpuIntegrateVerletStepKernel() {
+    if (dynamics)
+        delete dynamics;
+}
+
+void CpuIntegrateVerletStepKernel::initialize(const System& system, const VerletIntegrator& integrator) {
+    int numParticles = system.getNumParticles();
+    masses.resize(numParticles);
+    for (int i = 0; i < numParticles; ++i)
+        masses[i] = system.getParticleMass(i);
+}
+
+void CpuIntegrateVerletStepKernel::execute(ContextImpl& context, const VerletIntegrator& integrator) {
+    double stepSize = integrator.getStepSize();
+    vector<Vec3>& posData = extractPositions(context);
+    vector<Vec3>& velData = extractVelocities(context);
+    vector<Vec3>& forceData = extractForces(context);
+    if (dynamics == 0 || stepSize != prevStepSize) {
+        // Recreate the computation objects with the new parameters.
+        
+        if (dynamics)
+            delete dynamics;
+        dynamics = new CpuVerletDynamics(context.getSystem().getNumParticles(), stepSize, data.threads);
+        dynamics->setReferenceConstraintAlgorithm(&extractConstraints(context));
+        prevStepSize = stepSize;
+    }
+    dynamics->update(context.getSystem(), posData, velData, forceData, masses, integrator.getConstraintTolerance());
+    ReferencePlatform::PlatformData* refData = reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData());
+    refData->time += stepSize;
+    refData->stepCount++;
+}
+
+double CpuIntegrateVerletStepKernel::computeKineticEnergy(ContextImpl& context, const VerletIntegrator& integrator) {
+    return computeShiftedKineticEnergy(context, masses, 0.5*integrator.getStepSize());
+}
+
+CpuIntegrateCustomStepKernel::~CpuIntegrateCustomStepKernel() {
+    if (dynamics)
+        delete dynamics;
+}
+
+void CpuIntegrateCustomStepKernel::initialize(const System& system, const CustomIntegrator& integrator) {
+    int numParticles = system.getNumParticles();
+    masses.resize(numParticles);
+    for (int i = 0; i < numParticles; ++i)
+        masses[i] = system.getParticleMass(i);
+    perDofValues.resize(integrator.getNumPerDofVariables());
+    for (auto& values : perDofValues)
+        values.resize(numParticles);
+
+    // Create the computation objects.
+
+    dynamics = new CpuCustomDynamics(system.getNumParticles(), integrator, data.threads);
+    SimTKOpenMMUtilities::setRandomNumberSeed((unsigned int) integrator.getRandomNumberSeed());
+}
+
+void CpuIntegrateCustomStepKernel::execute(ContextImpl& context, CustomIntegrator& integrator, bool& forcesAreValid) {
+    vector<Vec3>& posData = extractPositions(context);
+    vector<Vec3>& velData = extractVelocities(context);
+    vector<Vec3>& forceData = extractForces(context);
+    
+    // Record global variables.
+    
+    map<string, double> globals;
+    globals["dt"] = integrator.getStepSize();
+    for (int i = 0; i < integrator.getNumGlobalVariables(); i++)
+        globals[integrator.getGlobalVariableName(i)] = globalValues[i];
+    
+    // Execute the step.
+    
+    dynamics->setReferenceConstraintAlgorithm(&extractConstraints(context));
+    dynamics->update(context, context.getSystem().getNumParticles(), posData, velData, forceData, masses, globals, perDofValues, forcesAreValid, integrator.getConstraintTolerance());
+    
+    // Record changed global variables.
+    
+    integrator.setStepSize(globals["dt"]);
+    for (int i = 0; i < (int) globalValues.size(); i++)
+        globalValues[i] = globals[integrator.getGlobalVariableName(i)];
+    ReferencePlatform::PlatformData* refData = reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData());
+    refData->time += dynamics->getDeltaT();
+    refData->stepCount++;
+}
+
+double CpuIntegrateCustomStepKernel::computeKineticEnergy(ContextImpl& context, CustomIntegrator& integrator, bool& forcesAreValid) {
+    vector<Vec3>& posData = extractPositions(context);
+    vector<Vec3>& velData = extractVelocities(context);
+    vector<Vec3>& forceData = extractForces(context);
+    
+    // Record global variables.
+    
+    map<string, double> globals;
+    globals["dt"] = integrator.getStepSize();
+    for (int i = 0; i < integrator.getNumGlobalVariables(); i++)
+        globals[integrator.getGlobalVariableName(i)] = globalValues[i];
+    
+    // Compute the kinetic energy.
+    
+    return dynamics->computeKineticEnergy(context, context.getSystem().getNumParticles(), posData, velData, forceData, masses, globals, perDofValues, forcesAreValid);
+}
+
+void CpuIntegrateCustomStepKernel::getGlobalVariables(ContextImpl& context, vector<double>& values) const {
+    values = globalValues;
+}
+
+void CpuIntegrateCustomStepKernel::setGlobalVariables(ContextImpl& context, const vector<double>& values) {
+    globalValues = values;
+}
+
+void CpuIntegrateCustomStepKernel::getPerDofVariable(ContextImpl& context, int variable, vector<Vec3>& values) const {
+    values.resize(perDofValues[variable].size());
+    for (int i = 0; i < (int) values.size(); i++)
+        values[i] = perDofValues[variable][i];
+}
+
+void CpuIntegrateCustomStepKernel::setPerDofVariable(ContextImpl& context, int variable, const vector<Vec3>& values) {
+    perDofValues[variable].resize(values.size());
+    for (int i = 0; i < (int) values.size(); i++)
+        perDofValues[variable][i] = values[i];
+}
@@ -32,6 +32,7 @@
 #include "CpuNeighborList.h"
 #include "openmm/internal/hardware.h"
 #include "openmm/internal/vectorize.h"
+#include "SimTKOpenMMRealType.h"
 #include "hilbert.h"
 #include <algorithm>
 #include <set>
@@ -42,7 +43,7 @@ using namespace std;
 
 namespace OpenMM {
 
-class VoxelIndex 
+class CpuNeighborList::VoxelIndex 
 {
 public:
     VoxelIndex() : y(0), z(0) {
@@ -110,6 +111,37 @@ public:
         for (int i = 0; i < ny; i++)
             for (int j = 0; j < nz; j++)
                 sort(bins[i][j].begin(), bins[i][j].end());
+        modifiedBins.clear();
+    }
+
+    /**
+     * Move a particle that was inserted at one location to a new one.  If it stays in the same voxel,
+     * only its x coordinate is updated.
+     */
+    void update(int atom, const float* oldLocation, const float* newLocation) {
+        VoxelIndex oldIndex = getVoxelIndex(oldLocation);
+        VoxelIndex newIndex = getVoxelIndex(newLocation);
+        vector<pair<float, int> >& oldBin = bins[oldIndex.y][oldIndex.z];
+        for (int i = 0; i < (int) oldBin.size(); i++)
+            if (oldBin[i].second == atom) {
+                if (oldIndex.y == newIndex.y && oldIndex.z == newIndex.z)
+                    oldBin[i].first = newLocation[0];
+                else {
+                    oldBin.erase(oldBin.begin()+i);
+                    bins[newIndex.y][newIndex.z].push_back(make_pair(newLocation[0], atom));
+                }
+                break;
+            }
+        modifiedBins.push_back(newIndex);
+    }
+
+    /**
+     * Restore the sort order of any voxels that have been modified by update().
+     */
+    void sortModifiedItems() {
+        for (VoxelIndex& index : modifiedBins)
+            sort(bins[index.y][index.z].begin(), bins[index.y][index.z].end());
+        modifiedBins.clear();
     }
     
     /**
@@ -164,7 +196,7 @@ public:
         return VoxelIndex(y, z);
     }
         
-    void getNeighbors(vector<int>& neighbors, int blockIndex, const fvec4& blockCenter, const fvec4& blockWidth, const vector<int>& sortedAtoms, vector<CpuNeighborList::BlockExclusionMask>& exclusions, float maxDistance, const vector<int>& blockAtoms, const vector<float>& blockAtomX, const vector<float>& blockAtomY, const vector<float>& blockAtomZ, const vector<float>& sortedPositions, const vector<VoxelIndex>& atomVoxelIndex) const {
+    void getNeighbors(vector<int>& neighbors, vector<int>& clusterBlock, bool useClusterPairs, int numAtoms, int blockIndex, const fvec4& blockCenter, const fvec4& blockWidth, const vector<int>& sortedAtoms, vector<CpuNeighborList::BlockExclusionMask>& exclusions, float maxDistance, const vector<int>& blockAtoms, const vector<float>& blockAtomX, const vector<float>& blockAtomY, const vector<float>& blockAtomZ, const vector<float>& sortedPositions, const vector<VoxelIndex>& atomVoxelIndex) const {
         neighbors.resize(0);
         exclusions.resize(0);
         fvec4 boxSize(periodicBoxSize[0], periodicBoxSize[1], periodicBoxSize[2], 0);
@@ -332,6 +364,8 @@ public:
                         // Avoid duplicate entries.
                         if (sortedIndex >= lastSortedIndex)
                             continue;
+                        if (useClusterPairs && clusterBlock[sortedIndex/ClusterSize] == blockIndex)
+                            continue; // We have already added the cluster containing this atom.
                         
                         fvec4 atomPos(&sortedPositions[4*sortedIndex]);
                         fvec4 delta = atomPos-blockCenter;
@@ -382,15 +416,17 @@ public:
                                 continue;
                         }
                         
-                        // Add this atom to the list of neighbors.
+                        // Add this atom to the list of neighbors, or the whole cluster containing it if we
+                        // are using cluster pairs.
                         
-                        neighbors.push_back(sortedAtoms[sortedIndex]);
-                        if (sortedIndex < blockSize*blockIndex)
-                            exclusions.push_back(0);
-                        else {
-                            int mask = (1<<blockSize)-1;
-                            exclusions.push_back(mask & (mask<<(sortedIndex-blockSize*blockIndex)));
+                        if (useClusterPairs) {
+                            int cluster = sortedIndex/ClusterSize;
+                            clusterBlock[cluster] = blockIndex;
+                            for (int index = cluster*ClusterSize; index < (cluster+1)*ClusterSize; index++)
+                                addNeighbor(neighbors, exclusions, index, blockIndex, numAtoms, sortedAtoms);
                         }
+                        else
+                            addNeighbor(neighbors, exclusions, sortedIndex, blockIndex, numAtoms, sortedAtoms);
                     }
                 }
             }
@@ -398,6 +434,25 @@ public:
     }
 
 private:
+    /**
+     * Add an entry to the list of neighbors for a block, given its index in the sorted order.
+     * Indices of numAtoms or more are padding, which is excluded from all interactions.
+     */
+    void addNeighbor(vector<int>& neighbors, vector<CpuNeighborList::BlockExclusionMask>& exclusions, int sortedIndex, int blockIndex, int numAtoms, const vector<int>& sortedAtoms) const {
+        int mask = (1<<blockSize)-1;
+        if (sortedIndex >= numAtoms) {
+            neighbors.push_back(0);
+            exclusions.push_back(mask);
+        }
+        else {
+            neighbors.push_back(sortedAtoms[sortedIndex]);
+            if (sortedIndex < blockSize*blockIndex)
+                exclusions.push_back(0);
+            else
+                exclusions.push_back(mask & (mask<<(sortedIndex-blockSize*blockIndex)));
+        }
+    }
+
     int blockSize;
     float voxelSizeY, voxelSizeZ;
     float miny, maxy, minz, maxz;
@@ -407,13 +462,74 @@ private:
     float periodicBoxVectors[3][3];
     const bool usePeriodic;
     vector<vector<vector<pair<float, int> > > > bins;
+    vector<VoxelIndex> modifiedBins;
 };
 
-CpuNeighborList::CpuNeighborList(int blockSize) : blockSize(blockSize) {
+CpuNeighborList::CpuNeighborList(int blockSize) : blockSize(blockSize), clusterPairMode(NoClusterPairs), useClusterPairs(false), voxels(NULL),
+        incremental(false), canUpdateIncrementally(false), lastRebuildWasIncremental(false), numFullBuilds(0), numIncrementalUpdates(0) {
+}
+
+CpuNeighborList::~CpuNeighborList() {
+    if (voxels != NULL)
+        delete voxels;
+}
+
+void CpuNeighborList::setClusterPairMode(ClusterPairMode mode) {
+    clusterPairMode = mode;
+}
+
+bool CpuNeighborList::getUseClusterPairs() const {
+    return useClusterPairs;
+}
+
+void CpuNeighborList::setUseIncrementalRebuild(bool incremental) {
+    this->incremental = incremental;
+    canUpdateIncrementally = false;
+}
+
+bool CpuNeighborList::getLastRebuildWasIncremental() const {
+    return lastRebuildWasIncremental;
+}
+
+long long CpuNeighborList::getNumFullBuilds() const {
+    return numFullBuilds;
+}
+
+long long CpuNeighborList::getNumIncrementalUpdates() const {
+    return numIncrementalUpdates;
+}
+
+long long CpuNeighborList::getNumNeighbors() const {
+    long long count = 0;
+    for (auto& neighbors : blockNeighbors)
+        count += neighbors.size();
+    return count;
 }
 
 void CpuNeighborList::computeNeighborList(int numAtoms, const AlignedArray<float>& atomLocations, const vector<set<int> >& exclusions,
             const Vec3* periodicBoxVectors, bool usePeriodic, float maxDistance, ThreadPool& threads) {
+    // See whether we can just update the existing list.
+
+    if (incremental && canUpdateIncrementally && numAtoms == this->numAtoms && &exclusions == this->exclusions &&
+            usePeriodic == this->usePeriodic && maxDistance == requestedMaxDistance && periodicBoxVectors[0] == this->periodicBoxVectors[0] &&
+            periodicBoxVectors[1] == this->periodicBoxVectors[1] && periodicBoxVectors[2] == this->periodicBoxVectors[2]) {
+        if (updateNeighborList(atomLocations, periodicBoxVectors, usePeriodic, maxDistance, threads)) {
+            lastRebuildWasIncremental = true;
+            numIncrementalUpdates++;
+            return;
+        }
+    }
+    lastRebuildWasIncremental = false;
+    numFullBuilds++;
+    requestedMaxDistance = maxDistance;
+    if (incremental) {
+        // Pairs of atoms that are not mobile can each move by up to the tolerance between the time a list
+        // is built and the time it is used, and their positions in the voxel hash can be off by as much, so
+        // build the list with a larger distance to compensate.
+
+        mobileTolerance = 0.02f*maxDistance;
+        maxDistance += 5*mobileTolerance;
+    }
     int numBlocks = (numAtoms+blockSize-1)/blockSize;
     blockNeighbors.resize(numBlocks);
     blockExclusions.resize(numBlocks);
@@ -446,6 +562,23 @@ void CpuNeighborList::computeNeighborList(int numAtoms, const AlignedArray<float
     maxy = maxPos[1];
     minz = minPos[2];
     maxz = maxPos[2];
+
+    // Decide whether to use cluster pairs.  They only pay off when the system is large enough and
+    // dense enough that most atoms of a neighboring cluster are within the cutoff.
+
+    if (clusterPairMode == AutoClusterPairs) {
+        const int minAtoms = 4096;
+        const double minNeighborsPerAtom = 100.0;
+        double volume;
+        if (usePeriodic)
+            volume = periodicBoxVectors[0][0]*periodicBoxVectors[1][1]*periodicBoxVectors[2][2];
+        else
+            volume = (double) (maxx-minx)*(maxy-miny)*(maxz-minz);
+        double neighborsPerAtom = (volume > 0.0 ? numAtoms*(4.0/3.0)*M_PI*maxDistance*maxDistance*maxDistance/volume : 0.0);
+        useClusterPairs = (numAtoms >= minAtoms && neighborsPerAtom >= minNeighborsPerAtom);
+    }
+    else
+        useClusterPairs = (clusterPairMode == ClusterPairs);
     
     // Sort the atoms based on a Hilbert curve.
     
@@ -463,16 +596,17 @@ void CpuNeighborList::computeNeighborList(int numAtoms, const AlignedArray<float
         edgeSizeY = 0.6f*periodicBoxVectors[1][1]/floorf(periodicBoxVectors[1][1]/maxDistance);
         edgeSizeZ = 0.6f*periodicBoxVectors[2][2]/floorf(periodicBoxVectors[2][2]/maxDistance);
     }
-    Voxels voxels(blockSize, edgeSizeY, edgeSizeZ, miny, maxy, minz, maxz, periodicBoxVectors, usePeriodic);
+    if (voxels != NULL)
+        delete voxels;
+    voxels = new Voxels(blockSize, edgeSizeY, edgeSizeZ, miny, maxy, minz, maxz, periodicBoxVectors, usePeriodic);
     for (int i = 0; i < numAtoms; i++) {
         int atomIndex = atomBins[i].second;
         sortedAtoms[i] = atomIndex;
         fvec4 atomPos(&atomLocations[4*atomIndex]);
         atomPos.store(&sortedPositions[4*i]);
-        voxels.insert(i, &atomLocations[4*atomIndex]);
+        voxels->insert(i, &atomLocations[4*atomIndex]);
     }
-    voxels.sortItems();
-    this->voxels = &voxels;
+    voxels->sortItems();
 
     // Signal the threads to start running and wait for them to finish.
     
@@ -491,6 +625,132 @@ void CpuNeighborList::computeNeighborList(int numAtoms, const AlignedArray<float
         for (int i = 0; i < (int) exc.size(); i++)
             exc[i] |= mask;
     }
+
+    // Record the state needed for incremental updates.
+
+    canUpdateIncrementally = incremental;
+    if (incremental) {
+        referencePositions = sortedPositions;
+        voxelPositions = sortedPositions;
+        isMobile.assign(numAtoms, 0);
+    }
+}
+
+bool CpuNeighborList::updateNeighborList(const AlignedArray<float>& atomLocations, const Vec3* periodicBoxVectors, bool usePeriodic, float maxDistance, ThreadPool& threads) {
+    // Update the positions, and identify the atoms that have moved further than the tolerance since the last
+    // full build.  Once an atom becomes mobile it stays mobile until the next full build.
+
+    this->atomLocations = &atomLocations[0];
+    const float tolerance2 = mobileTolerance*mobileTolerance;
+    mobileAtoms.clear();
+    for (int i = 0; i < numAtoms; i++) {
+        fvec4 pos(&atomLocations[4*sortedAtoms[i]]);
+        pos.store(&sortedPositions[4*i]);
+        if (!isMobile[i]) {
+            fvec4 delta = pos-fvec4(&referencePositions[4*i]);
+            if (dot3(delta, delta) > tolerance2)
+                isMobile[i] = 1;
+        }
+        if (isMobile[i]) {
+            // Without periodic boundary conditions, the voxels only cover the region occupied
+            // by the atoms at the last full build.
+
+            if (!usePeriodic && (pos[1] < miny || pos[1] > maxy || pos[2] < minz || pos[2] > maxz))
+                return false;
+            mobileAtoms.push_back(i);
+        }
+    }
+    if (mobileAtoms.size() > numAtoms/20)
+        return false; // So many atoms are moving that a full build is cheaper.
+    if (mobileAtoms.size() == 0)
+        return true; // Nothing has moved far enough to change the list.
+
+    // Move the mobile atoms in the voxel hash.
+
+    for (int atom : mobileAtoms) {
+        voxels->update(atom, &voxelPositions[4*atom], &sortedPositions[4*atom]);
+        for (int j = 0; j < 3; j++)
+            voxelPositions[4*atom+j] = sortedPositions[4*atom+j];
+    }
+    voxels->sortModifiedItems();
+
+    // Identify the blocks that need to be rebuilt, then rebuild them.
+
+    int numBlocks = blockNeighbors.size();
+    rebuildBlock.assign(numBlocks, 0);
+    atomicCounter = 0;
+    threads.execute([&] (ThreadPool& threads, int threadIndex) {
+        fvec4 boxSize(periodicBoxVectors[0][0], periodicBoxVectors[1][1], periodicBoxVectors[2][2], 0);
+        fvec4 invBoxSize(1/periodicBoxVectors[0][0], 1/periodicBoxVectors[1][1], 1/periodicBoxVectors[2][2], 0);
+        bool triclinic = (periodicBoxVectors[0][1] != 0.0 || periodicBoxVectors[0][2] != 0.0 ||
+                          periodicBoxVectors[1][0] != 0.0 || periodicBoxVectors[1][2] != 0.0 ||
+                          periodicBoxVectors[2][0] != 0.0 || periodicBoxVectors[2][1] != 0.0);
+        fvec4 periodicBoxVec4[3];
+        for (int i = 0; i < 3; i++)
+            periodicBoxVec4[i] = fvec4(periodicBoxVectors[i][0], periodicBoxVectors[i][1], periodicBoxVectors[i][2], 0);
+        float maxDistanceSquared = this->maxDistance*this->maxDistance;
+        while (true) {
+            int i = atomicCounter++;
+            if (i >= numBlocks)
+                break;
+            int firstIndex = blockSize*i;
+            int atomsInBlock = min(blockSize, numAtoms-firstIndex);
+            fvec4 minPos(&sortedPositions[4*firstIndex]);
+            fvec4 maxPos = minPos;
+            for (int j = 1; j < atomsInBlock; j++) {
+                fvec4 pos(&sortedPositions[4*(firstIndex+j)]);
+                minPos = min(minPos, pos);
+                maxPos = max(maxPos, pos);
+            }
+            fvec4 blockCenter = (maxPos+minPos)*0.5f;
+            fvec4 blockWidth = (maxPos-minPos)*0.5f;
+
+            // Only atoms that come before the end of the block in the sorted order can appear in its list.
+
+            for (int atom : mobileAtoms) {
+                if (atom >= firstIndex+blockSize)
+                    break;
+                if (atom >= firstIndex) {
+                    rebuildBlock[i] = 1;
+                    break;
+                }
+                fvec4 delta = fvec4(&sortedPositions[4*atom])-blockCenter;
+                if (usePeriodic) {
+                    if (triclinic) {
+                        delta -= periodicBoxVec4[2]*floorf(delta[2]*invBoxSize[2]+0.5f);
+                        delta -= periodicBoxVec4[1]*floorf(delta[1]*invBoxSize[1]+0.5f);
+                        delta -= periodicBoxVec4[0]*floorf(delta[0]*invBoxSize[0]+0.5f);
+                    }
+                    else
+                        delta -= round(delta*invBoxSize)*boxSize;
+                }
+                delta = max(0.0f, abs(delta)-blockWidth);
+                if (dot3(delta, delta) < maxDistanceSquared) {
+                    rebuildBlock[i] = 1;
+                    break;
+                }
+            }
+        }
+    });
+    threads.waitForThreads();
+    blocksToRebuild.clear();
+    for (int i = 0; i < numBlocks; i++)
+        if (rebuildBlock[i])
+            blocksToRebuild.push_back(i);
+    atomicCounter = 0;
+    threads.execute([&] (ThreadPool& threads, int threadIndex) { threadUpdateNeighborList(threads, threadIndex); });
+    threads.waitForThreads();
+
+    // Restore the exclusions for padding atoms if the last block was rebuilt.
+
+    int numPadding = numBlocks*blockSize-numAtoms;
+    if (numPadding > 0 && rebuildBlock[numBlocks-1]) {
+        const BlockExclusionMask mask = (~0) << (blockSize - numPadding);
+        auto& exc = blockExclusions[numBlocks-1];
+        for (int i = 0; i < (int) exc.size(); i++)
+            exc[i] |= mask;
+    }
+    return true;
 }
 
 int CpuNeighborList::getNumBlocks() const {
@@ -537,62 +797,87 @@ void CpuNeighborList::threadComputeNeighborList(ThreadPool& threads, int threadI
     vector<int> blockAtoms;
     vector<float> blockAtomX(blockSize), blockAtomY(blockSize), blockAtomZ(blockSize);
     vector<VoxelIndex> atomVoxelIndex;
+    vector<int> clusterBlock;
+    if (useClusterPairs)
+        clusterBlock.resize((numAtoms+ClusterSize-1)/ClusterSize, -1);
+    while (true) {
+        int i = atomicCounter++;
+        if (i >= numBlocks)
+            break;
+        computeBlockNeighbors(i, blockAtoms, blockAtomX, blockAtomY, blockAtomZ, atomVoxelIndex, clusterBlock);
+    }
+}
+
+void CpuNeighborList::threadUpdateNeighborList(ThreadPool& threads, int threadIndex) {
+    // Recompute this thread's subset of the blocks that need to be rebuilt.
+
+    int numBlocks = blocksToRebuild.size();
+    vector<int> blockAtoms;
+    vector<float> blockAtomX(blockSize), blockAtomY(blockSize), blockAtomZ(blockSize);
+    vector<VoxelIndex> atomVoxelIndex;
+    vector<int> clusterBlock;
+    if (useClusterPairs)
+        clusterBlock.resize((numAtoms+ClusterSize-1)/ClusterSize, -1);
     while (true) {
         int i = atomicCounter++;
         if (i >= numBlocks)
             break;
+        computeBlockNeighbors(blocksToRebuild[i], blockAtoms, blockAtomX, blockAtomY, blockAtomZ, atomVoxelIndex, clusterBlock);
+    }
+}
 
-        // Find the atoms in this block and compute their bounding box.
-        
-        int firstIndex = blockSize*i;
-        int atomsInBlock = min(blockSize, numAtoms-firstIndex);
-        blockAtoms.resize(atomsInBlock);
-        atomVoxelIndex.resize(atomsInBlock);
-        for (int j = 0; j < atomsInBlock; j++) {
-            blockAtoms[j] = sortedAtoms[firstIndex+j];
-            atomVoxelIndex[j] = voxels->getVoxelIndex(&atomLocations[4*blockAtoms[j]]);
-        }
-        fvec4 minPos(&sortedPositions[4*firstIndex]);
-        fvec4 maxPos = minPos;
-        for (int j = 1; j < atomsInBlock; j++) {
-            fvec4 pos(&sortedPositions[4*(firstIndex+j)]);
-            minPos = min(minPos, pos);
-            maxPos = max(maxPos, pos);
-        }
-        for (int j = 0; j < atomsInBlock; j++) {
-            blockAtomX[j] = sortedPositions[4*(firstIndex+j)];
-            blockAtomY[j] = sortedPositions[4*(firstIndex+j)+1];
-            blockAtomZ[j] = sortedPositions[4*(firstIndex+j)+2];
-        }
-        for (int j = atomsInBlock; j < blockSize; j++) {
-            blockAtomX[j] = 1e10;
-            blockAtomY[j] = 1e10;
-            blockAtomZ[j] = 1e10;
-        }
-        voxels->getNeighbors(blockNeighbors[i], i, (maxPos+minPos)*0.5f, (maxPos-minPos)*0.5f, sortedAtoms, blockExclusions[i], maxDistance, blockAtoms, blockAtomX, blockAtomY, blockAtomZ, sortedPositions, atomVoxelIndex);
-
-        // Record the exclusions for this block.
-
-        map<int, BlockExclusionMask> atomFlags;
-        for (int j = 0; j < atomsInBlock; j++) {
-            const set<int>& atomExclusions = (*exclusions)[sortedAtoms[firstIndex+j]];
-            const BlockExclusionMask mask = 1<<j;
-            for (int exclusion : atomExclusions) {
-                const auto thisAtomFlags = atomFlags.find(exclusion);
-                if (thisAtomFlags == atomFlags.end())
-                    atomFlags[exclusion] = mask;
-                else
-                    thisAtomFlags->second |= mask;
-            }
-        }
-        int numNeighbors = blockNeighbors[i].size();
-        for (int k = 0; k < numNeighbors; k++) {
-            int atomIndex = blockNeighbors[i][k];
-            auto thisAtomFlags = atomFlags.find(atomIndex);
-            if (thisAtomFlags != atomFlags.end())
-                blockExclusions[i][k] |= thisAtomFlags->second;
+void CpuNeighborList::computeBlockNeighbors(int i, vector<int>& blockAtoms, vector<float>& blockAtomX, vector<float>& blockAtomY,
+            vector<float>& blockAtomZ, vector<VoxelIndex>& atomVoxelIndex, vector<int>& clusterBlock) {
+    // Find the atoms in this block and compute their bounding box.
+    
+    int firstIndex = blockSize*i;
+    int atomsInBlock = min(blockSize, numAtoms-firstIndex);
+    blockAtoms.resize(atomsInBlock);
+    atomVoxelIndex.resize(atomsInBlock);
+    for (int j = 0; j < atomsInBlock; j++) {
+        blockAtoms[j] = sortedAtoms[firstIndex+j];
+        atomVoxelIndex[j] = voxels->getVoxelIndex(&atomLocations[4*blockAtoms[j]]);
+    }
+    fvec4 minPos(&sortedPositions[4*firstIndex]);
+    fvec4 maxPos = minPos;
+    for (int j = 1; j < atomsInBlock; j++) {
+        fvec4 pos(&sortedPositions[4*(firstIndex+j)]);
+        minPos = min(minPos, pos);
+        maxPos = max(maxPos, pos);
+    }
+    for (int j = 0; j < atomsInBlock; j++) {
+        blockAtomX[j] = sortedPositions[4*(firstIndex+j)];
+        blockAtomY[j] = sortedPositions[4*(firstIndex+j)+1];
+        blockAtomZ[j] = sortedPositions[4*(firstIndex+j)+2];
+    }
+    for (int j = atomsInBlock; j < blockSize; j++) {
+        blockAtomX[j] = 1e10;
+        blockAtomY[j] = 1e10;
+        blockAtomZ[j] = 1e10;
+    }
+    voxels->getNeighbors(blockNeighbors[i], clusterBlock, useClusterPairs, numAtoms, i, (maxPos+minPos)*0.5f, (maxPos-minPos)*0.5f, sortedAtoms, blockExclusions[i], maxDistance, blockAtoms, blockAtomX, blockAtomY, blockAtomZ, sortedPositions, atomVoxelIndex);
+
+    // Record the exclusions for this block.
+
+    map<int, BlockExclusionMask> atomFlags;
+    for (int j = 0; j < atomsInBlock; j++) {
+        const set<int>& atomExclusions = (*exclusions)[sortedAtoms[firstIndex+j]];
+        const BlockExclusionMask mask = 1<<j;
+        for (int exclusion : atomExclusions) {
+            const auto thisAtomFlags = atomFlags.find(exclusion);
+            if (thisAtomFlags == atomFlags.end())
+                atomFlags[exclusion] = mask;
+            else
+                thisAtomFlags->second |= mask;
         }
     }
+    int numNeighbors = blockNeighbors[i].size();
+    for (int k = 0; k < numNeighbors; k++) {
+        int atomIndex = blockNeighbors[i][k];
+        auto thisAtomFlags = atomFlags.find(atomIndex);
+        if (thisAtomFlags != atomFlags.end())
+            blockExclusions[i][k] |= thisAtomFlags->second;
+    }
 }
 
 } // namespace OpenMM
@@ -48,7 +48,7 @@ const int CpuNonbondedForce::NUM_TABLE_POINTS = 2048;
    --------------------------------------------------------------------------------------- */
 
 CpuNonbondedForce::CpuNonbondedForce() : cutoff(false), useSwitch(false), periodic(false), periodicExceptions(false), ewald(false), pme(false), ljpme(false), tableIsValid(false), expTableIsValid(false),
-    cutoffDistance(0.0f), alphaDispersionEwald(0.0f), alphaEwald(0.0f) {
+    cutoffDistance(0.0f), alphaDispersionEwald(0.0f), alphaEwald(0.0f), useMixedForces(false) {
 }
 
 CpuNonbondedForce::~CpuNonbondedForce() {
@@ -158,16 +158,18 @@ void CpuNonbondedForce::setUseEwald(float alpha, int kmaxx, int kmaxy, int kmaxz
 
      @param alpha  the Ewald separation parameter
      @param gridSize the dimensions of the mesh
+     @param order  the B-spline interpolation order
 
      --------------------------------------------------------------------------------------- */
 
-void CpuNonbondedForce::setUsePME(float alpha, int meshSize[3]) {
+void CpuNonbondedForce::setUsePME(float alpha, int meshSize[3], int order) {
     if (alpha != alphaEwald)
         tableIsValid = false;
     alphaEwald = alpha;
     meshDim[0] = meshSize[0];
     meshDim[1] = meshSize[1];
     meshDim[2] = meshSize[2];
+    pmeOrder = order;
     pme = true;
     tabulateEwaldScaleFactor();
 }
@@ -179,16 +181,18 @@ void CpuNonbondedForce::setUsePME(float alpha, int meshSize[3]) {
 
      @param alpha  the Ewald separation parameter
      @param gridSize the dimensions of the mesh
+     @param order  the B-spline interpolation order
 
      --------------------------------------------------------------------------------------- */
 
-void CpuNonbondedForce::setUseLJPME(float alpha, int meshSize[3]) {
+void CpuNonbondedForce::setUseLJPME(float alpha, int meshSize[3], int order) {
     if (alpha != alphaDispersionEwald)
         expTableIsValid = false;
     alphaDispersionEwald = alpha;
     dispersionMeshDim[0] = meshSize[0];
     dispersionMeshDim[1] = meshSize[1];
     dispersionMeshDim[2] = meshSize[2];
+    dispersionPmeOrder = order;
     ljpme = true;
     tabulateExpTerms();
     if(cutoffDistance != 0.0f){
@@ -257,7 +261,7 @@ void CpuNonbondedForce::calculateReciprocalIxn(int numberOfAtoms, float* posq, c
 
     if (pme) {
         pme_t pmedata;
-        pme_init(&pmedata, alphaEwald, numberOfAtoms, meshDim, 5, 1);
+        pme_init(&pmedata, alphaEwald, numberOfAtoms, meshDim, pmeOrder, 1);
         vector<double> charges(numberOfAtoms);
         for (int i = 0; i < numberOfAtoms; i++)
             charges[i] = posq[4*i+3];
@@ -269,7 +273,7 @@ void CpuNonbondedForce::calculateReciprocalIxn(int numberOfAtoms, float* posq, c
 
         if (ljpme) {
             // Dispersion reciprocal space terms
-            pme_init(&pmedata,alphaDispersionEwald,numberOfAtoms,dispersionMeshDim,5,1);
+            pme_init(&pmedata,alphaDispersionEwald,numberOfAtoms,dispersionMeshDim,dispersionPmeOrder,1);
 
             std::vector<Vec3> dpmeforces;
             for (int i = 0; i < numberOfAtoms; i++){
@@ -379,7 +383,8 @@ void CpuNonbondedForce::calculateReciprocalIxn(int numberOfAtoms, float* posq, c
 
 
 void CpuNonbondedForce::calculateDirectIxn(int numberOfAtoms, float* posq, const vector<Vec3>& atomCoordinates, const vector<pair<float, float> >& atomParameters,
-                                           const vector<float>& C6params, const vector<set<int> >& exclusions, vector<AlignedArray<float> >& threadForce, double* totalEnergy, ThreadPool& threads) {
+                                           const vector<float>& C6params, const vector<set<int> >& exclusions, vector<AlignedArray<float> >& threadForce, double* totalEnergy, ThreadPool& threads,
+                                           vector<Vec3>* mixedForces) {
     // Record the parameters for the threads.
     
     this->numberOfAtoms = numberOfAtoms;
@@ -391,6 +396,13 @@ void CpuNonbondedForce::calculateDirectIxn(int numberOfAtoms, float* posq, const
     this->threadForce = &threadForce;
     includeEnergy = (totalEnergy != NULL);
     threadEnergy.resize(threads.getNumThreads());
+    useMixedForces = (mixedForces != NULL);
+    if (useMixedForces) {
+        threadMixedForce.resize(threads.getNumThreads());
+        for (auto& f : threadMixedForce)
+            if (f.size() != 3*numberOfAtoms)
+                f.resize(3*numberOfAtoms, 0.0);
+    }
     atomicCounter = 0;
     
     // Signal the threads to start running and wait for them to finish.
@@ -406,6 +418,23 @@ void CpuNonbondedForce::calculateDirectIxn(int numberOfAtoms, float* posq, const
         threads.waitForThreads();
     }
     
+    // Sum the double precision forces from all the threads, clearing the buffers for next time.
+
+    if (useMixedForces) {
+        threads.execute([&] (ThreadPool& threads, int threadIndex) {
+            int numThreads = threads.getNumThreads();
+            int start = threadIndex*numberOfAtoms/numThreads;
+            int end = (threadIndex+1)*numberOfAtoms/numThreads;
+            for (int i = start; i < end; i++)
+                for (int j = 0; j < numThreads; j++) {
+                    double* f = &threadMixedForce[j][3*i];
+                    (*mixedForces)[i] += Vec3(f[0], f[1], f[2]);
+                    f[0] = f[1] = f[2] = 0.0;
+                }
+        });
+        threads.waitForThreads();
+    }
+    
     // Combine the energies from all the threads.
     
     if (totalEnergy != NULL) {
@@ -433,6 +462,8 @@ void CpuNonbondedForce::threadComputeDirect(ThreadPool& threads, int threadIndex
             if (nextBlock >= neighborList->getNumBlocks())
                 break;
             calculateBlockEwaldIxn(nextBlock, forces, energyPtr, boxSize, invBoxSize);
+            if (useMixedForces)
+                flushBlockForces(threadIndex, nextBlock);
         }
 
         // Now subtract off the exclusions, since they were implicitly included in the reciprocal space sum.
@@ -483,6 +514,12 @@ void CpuNonbondedForce::threadComputeDirect(ThreadPool& threads, int threadIndex
                         }
                     }
                 }
+                if (useMixedForces) {
+                    flushMixedForces(threadIndex, &i, 1);
+                    for (int excluded : exclusions[i])
+                        if (excluded > i)
+                            flushMixedForces(threadIndex, &excluded, 1);
+                }
             }
         }
     }
@@ -494,6 +531,8 @@ void CpuNonbondedForce::threadComputeDirect(ThreadPool& threads, int threadIndex
             if (nextBlock >= neighborList->getNumBlocks())
                 break;
             calculateBlockIxn(nextBlock, forces, energyPtr, boxSize, invBoxSize);
+            if (useMixedForces)
+                flushBlockForces(threadIndex, nextBlock);
         }
     }
     else {
@@ -506,10 +545,35 @@ void CpuNonbondedForce::threadComputeDirect(ThreadPool& threads, int threadIndex
             for (int j = i+1; j < numberOfAtoms; j++)
                 if (exclusions[j].find(i) == exclusions[j].end())
                     calculateOneIxn(i, j, forces, energyPtr, boxSize, invBoxSize);
+            if (useMixedForces)
+                for (int j = i; j < numberOfAtoms; j++)
+                    flushMixedForces(threadIndex, &j, 1);
         }
     }
 }
 
+void CpuNonbondedForce::flushMixedForces(int threadIndex, const int* atoms, int numAtoms) {
+    float* forces = &(*threadForce)[threadIndex][0];
+    double* mixed = &threadMixedForce[threadIndex][0];
+    fvec4 zero(0.0f);
+    for (int i = 0; i < numAtoms; i++) {
+        int atom = atoms[i];
+        float* f = forces+4*atom;
+        mixed[3*atom] += f[0];
+        mixed[3*atom+1] += f[1];
+        mixed[3*atom+2] += f[2];
+        zero.store(f);
+    }
+}
+
+void CpuNonbondedForce::flushBlockForces(int threadIndex, int blockIndex) {
+    const int blockSize = neighborList->getBlockSize();
+    const vector<int>& neighbors = neighborList->getBlockNeighbors(blockIndex);
+    flushMixedForces(threadIndex, &neighborList->getSortedAtoms()[blockSize*blockIndex], blockSize);
+    if (neighbors.size() > 0)
+        flushMixedForces(threadIndex, &neighbors[0], neighbors.size());
+}
+
 void CpuNonbondedForce::calculateOneIxn(int ii, int jj, float* forces, double* totalEnergy, const fvec4& boxSize, const fvec4& invBoxSize) {
     // get deltaR, R2, and R between 2 atoms
 
@@ -0,0 +1,46 @@
+
+
+/* Portions copyright (c) 2006-2021 Stanford University and Simbios.
+ * Contributors:
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "CpuNonbondedForceFvec.h"
+#include "openmm/OpenMMException.h"
+
+#ifdef __AVX512F__
+
+#include "openmm/internal/vectorizeAvx512.h"
+OpenMM::CpuNonbondedForce* createCpuNonbondedForceAvx512() {
+    return new OpenMM::CpuNonbondedForceFvec<fvec16>();
+}
+
+#else
+
+bool isAvx512Supported() {
+    return false;
+}
+
+OpenMM::CpuNonbondedForce* createCpuNonbondedForceAvx512() {
+   throw OpenMM::OpenMMException("Internal error: OpenMM was compiled without AVX-512 support");
+}
+#endif
+
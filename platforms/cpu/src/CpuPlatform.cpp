@@ -33,11 +33,14 @@
 #include "CpuKernelFactory.h"
 #include "CpuKernels.h"
 #include "CpuSETTLE.h"
+#include "ReferenceCCMAAlgorithm.h"
 #include "ReferenceConstraints.h"
 #include "openmm/OpenMMException.h"
 #include "openmm/internal/hardware.h"
 #include "openmm/internal/vectorize.h"
 #include <algorithm>
+#include <cstring>
+#include <mutex>
 #include <sstream>
 #include <stdlib.h>
 
@@ -60,13 +63,24 @@ extern "C" OPENMM_EXPORT_CPU void registerPlatforms() {
 
 map<const ContextImpl*, CpuPlatform::PlatformData*> CpuPlatform::contextData;
 
+// Contexts may be created and destroyed on different threads at the same time, so all access to
+// contextData is protected by this lock.
+
+static mutex contextDataLock;
+
 CpuPlatform::CpuPlatform() {
     deprecatedPropertyReplacements["CpuThreads"] = CpuThreads();
     CpuKernelFactory* factory = new CpuKernelFactory();
     registerKernelFactory(CalcForcesAndEnergyKernel::Name(), factory);
+    registerKernelFactory(ProfileKernel::Name(), factory);
     registerKernelFactory(CalcHarmonicAngleForceKernel::Name(), factory);
     registerKernelFactory(CalcPeriodicTorsionForceKernel::Name(), factory);
     registerKernelFactory(CalcRBTorsionForceKernel::Name(), factory);
+    registerKernelFactory(CalcCustomBondForceKernel::Name(), factory);
+    registerKernelFactory(CalcCustomAngleForceKernel::Name(), factory);
+    registerKernelFactory(CalcCustomTorsionForceKernel::Name(), factory);
+    registerKernelFactory(CalcCMAPTorsionForceKernel::Name(), factory);
+    registerKernelFactory(CalcCustomExternalForceKernel::Name(), factory);
     registerKernelFactory(CalcNonbondedForceKernel::Name(), factory);
     registerKernelFactory(CalcCustomNonbondedForceKernel::Name(), factory);
     registerKernelFactory(CalcCustomManyParticleForceKernel::Name(), factory);
@@ -75,8 +89,14 @@ CpuPlatform::CpuPlatform() {
     registerKernelFactory(CalcGayBerneForceKernel::Name(), factory);
     registerKernelFactory(IntegrateLangevinStepKernel::Name(), factory);
     registerKernelFactory(IntegrateLangevinMiddleStepKernel::Name(), factory);
-    platformProperties.push_back(CpuThreads());
+    registerKernelFactory(IntegrateVerletStepKernel::Name(), factory);
+    registerKernelFactory(IntegrateCustomStepKernel::Name(), factory);
     platformProperties.push_back(CpuDeterministicForces());
+    platformProperties.push_back(CpuNeighborListPadding());
+    platformProperties.push_back(CpuNumaPolicy());
+    platformProperties.push_back(CpuPrecision());
+    platformProperties.push_back(CpuIncrementalNeighborList());
+    platformProperties.push_back(CpuHugePages());
     int threads = getNumProcessors();
     char* threadsEnv = getenv("OPENMM_CPU_THREADS");
     if (threadsEnv != NULL)
@@ -85,6 +105,11 @@ CpuPlatform::CpuPlatform() {
     defaultThreads << threads;
     setPropertyDefaultValue(CpuThreads(), defaultThreads.str());
     setPropertyDefaultValue(CpuDeterministicForces(), "false");
+    setPropertyDefaultValue(CpuNeighborListPadding(), "");
+    setPropertyDefaultValue(CpuNumaPolicy(), "none");
+    setPropertyDefaultValue(CpuPrecision(), "single");
+    setPropertyDefaultValue(CpuIncrementalNeighborList(), "false");
+    setPropertyDefaultValue(CpuHugePages(), "false");
 }
 
 const string& CpuPlatform::getPropertyValue(const Context& context, const string& property) const {
@@ -121,43 +146,127 @@ void CpuPlatform::contextCreated(ContextImpl& context, const map<string, string>
     stringstream(threadsPropValue) >> numThreads;
     transform(deterministicForcesValue.begin(), deterministicForcesValue.end(), deterministicForcesValue.begin(), ::tolower);
     bool deterministicForces = (deterministicForcesValue == "true");
-    PlatformData* data = new PlatformData(context.getSystem().getNumParticles(), numThreads, deterministicForces);
-    contextData[&context] = data;
-    ReferenceConstraints& constraints = *(ReferenceConstraints*) reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData())->constraints;
+    string paddingValue = (properties.find(CpuNeighborListPadding()) == properties.end() ?
+            getPropertyDefaultValue(CpuNeighborListPadding()) : properties.find(CpuNeighborListPadding())->second);
+    transform(paddingValue.begin(), paddingValue.end(), paddingValue.begin(), ::tolower);
+    double padding = 0.0;
+    if (paddingValue == "auto")
+        padding = -1.0;
+    else if (paddingValue != "") {
+        stringstream paddingStream(paddingValue);
+        paddingStream >> padding;
+        if (paddingStream.fail() || padding <= 0.0)
+            throw OpenMMException("Illegal value for NeighborListPadding: "+paddingValue);
+    }
+    string numaValue = (properties.find(CpuNumaPolicy()) == properties.end() ?
+            getPropertyDefaultValue(CpuNumaPolicy()) : properties.find(CpuNumaPolicy())->second);
+    transform(numaValue.begin(), numaValue.end(), numaValue.begin(), ::tolower);
+    if (numaValue != "none" && numaValue != "pin")
+        throw OpenMMException("Illegal value for NumaPolicy: "+numaValue);
+    string precisionValue = (properties.find(CpuPrecision()) == properties.end() ?
+            getPropertyDefaultValue(CpuPrecision()) : properties.find(CpuPrecision())->second);
+    transform(precisionValue.begin(), precisionValue.end(), precisionValue.begin(), ::tolower);
+    if (precisionValue != "single" && precisionValue != "mixed")
+        throw OpenMMException("Illegal value for Precision: "+precisionValue);
+    string incrementalValue = (properties.find(CpuIncrementalNeighborList()) == properties.end() ?
+            getPropertyDefaultValue(CpuIncrementalNeighborList()) : properties.find(CpuIncrementalNeighborList())->second);
+    transform(incrementalValue.begin(), incrementalValue.end(), incrementalValue.begin(), ::tolower);
+    if (incrementalValue != "true" && incrementalValue != "false")
+        throw OpenMMException("Illegal value for IncrementalNeighborList: "+incrementalValue);
+    string hugePagesValue = (properties.find(CpuHugePages()) == properties.end() ?
+            getPropertyDefaultValue(CpuHugePages()) : properties.find(CpuHugePages())->second);
+    transform(hugePagesValue.begin(), hugePagesValue.end(), hugePagesValue.begin(), ::tolower);
+    if (hugePagesValue != "true" && hugePagesValue != "false")
+        throw OpenMMException("Illegal value for HugePages: "+hugePagesValue);
+    PlatformData* data = new PlatformData(context.getSystem().getNumParticles(), numThreads, deterministicForces, padding, numaValue == "pin",
+            precisionValue == "mixed", incrementalValue == "true", hugePagesValue == "true");
+    {
+        lock_guard<mutex> lock(contextDataLock);
+        contextData[&context] = data;
+    }
+    ReferencePlatform::PlatformData* refData = reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData());
+    refData->setThreadPool(&data->threads);
+    ReferenceConstraints& constraints = *(ReferenceConstraints*) refData->constraints;
     if (constraints.settle != NULL) {
         CpuSETTLE* parallelSettle = new CpuSETTLE(context.getSystem(), *(ReferenceSETTLEAlgorithm*) constraints.settle, data->threads);
         delete constraints.settle;
         constraints.settle = parallelSettle;
     }
+    if (constraints.ccma != NULL)
+        ((ReferenceCCMAAlgorithm*) constraints.ccma)->setThreadPool(&data->threads);
 }
 
 void CpuPlatform::contextDestroyed(ContextImpl& context) const {
-    PlatformData* data = contextData[&context];
+    PlatformData* data;
+    {
+        lock_guard<mutex> lock(contextDataLock);
+        data = contextData[&context];
+        contextData.erase(&context);
+    }
     delete data;
-    contextData.erase(&context);
     ReferencePlatform::PlatformData* refPlatformData = reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData());
     delete refPlatformData;
 }
 
 CpuPlatform::PlatformData& CpuPlatform::getPlatformData(ContextImpl& context) {
+    lock_guard<mutex> lock(contextDataLock);
     return *contextData[&context];
 }
 
 const CpuPlatform::PlatformData& CpuPlatform::getPlatformData(const ContextImpl& context) {
+    lock_guard<mutex> lock(contextDataLock);
     return *contextData[&context];
 }
 
-CpuPlatform::PlatformData::PlatformData(int numParticles, int numThreads, bool deterministicForces) : posq(4*numParticles), threads(numThreads),
-        deterministicForces(deterministicForces), neighborList(NULL), cutoff(0.0), paddedCutoff(0.0), anyExclusions(false), currentPosqIndex(-1), nextPosqIndex(0) {
+CpuPlatform::PlatformData::PlatformData(int numParticles, int numThreads, bool deterministicForces, double neighborListPadding, bool pinThreads, bool mixedPrecision,
+        bool incrementalNeighborList, bool useHugePages) : posq(4*numParticles), threads(numThreads), deterministicForces(deterministicForces),
+        mixedPrecision(mixedPrecision), incrementalNeighborList(incrementalNeighborList), neighborList(NULL), cutoff(0.0), paddedCutoff(0.0),
+        fixedPadding(neighborListPadding),
+        anyExclusions(false), currentPosqIndex(-1), nextPosqIndex(0), numNeighborListEvaluations(0) {
     numThreads = threads.getNumThreads();
+    if (pinThreads)
+        threads.pinThreadsToCores();
+    posq.setUseHugePages(useHugePages);
+
+    // Each worker allocates and initializes its own force buffer, and the part of posq it fills in
+    // before every force computation.  Pages are placed on the NUMA node of the thread that first
+    // touches them, so this keeps each thread's working memory local.
+
     threadForce.resize(numThreads);
-    for (int i = 0; i < numThreads; i++)
-        threadForce[i].resize(4*numParticles);
+    threads.execute([&] (ThreadPool& threads, int threadIndex) {
+        threadForce[threadIndex].setUseHugePages(useHugePages);
+        threadForce[threadIndex].resize(4*numParticles);
+        memset(&threadForce[threadIndex][0], 0, 4*numParticles*sizeof(float));
+        int start = threadIndex*numParticles/numThreads;
+        int end = (threadIndex+1)*numParticles/numThreads;
+        if (end > start)
+            memset(&posq[4*start], 0, 4*(end-start)*sizeof(float));
+    });
+    threads.waitForThreads();
+    threadForceCleared = true;
     isPeriodic = false;
     stringstream threadsProperty;
     threadsProperty << numThreads;
     propertyValues[CpuThreads()] = threadsProperty.str();
     propertyValues[CpuDeterministicForces()] = deterministicForces ? "true" : "false";
+    propertyValues[CpuNumaPolicy()] = pinThreads ? "pin" : "none";
+    propertyValues[CpuPrecision()] = mixedPrecision ? "mixed" : "single";
+    propertyValues[CpuIncrementalNeighborList()] = incrementalNeighborList ? "true" : "false";
+    propertyValues[CpuHugePages()] = useHugePages ? "true" : "false";
+
+    // Tuning the padding changes which pairs are in the neighbor list, and hence the order in which
+    // forces are summed, so it is disabled when deterministic forces are requested.
+
+    tunePadding = (neighborListPadding < 0.0 && !deterministicForces);
+    if (neighborListPadding < 0.0)
+        propertyValues[CpuNeighborListPadding()] = "auto";
+    else if (neighborListPadding > 0.0) {
+        stringstream paddingProperty;
+        paddingProperty << neighborListPadding;
+        propertyValues[CpuNeighborListPadding()] = paddingProperty.str();
+    }
+    else
+        propertyValues[CpuNeighborListPadding()] = "";
 }
 
 CpuPlatform::PlatformData::~PlatformData() {
@@ -171,12 +280,17 @@ CpuPlatform::PlatformData::~PlatformData() {
 int getVecBlockSize();
 
 void CpuPlatform::PlatformData::requestNeighborList(double cutoffDistance, double padding, bool useExclusions, const vector<set<int> >& exclusionList) {
-    if (neighborList == NULL)
+    if (neighborList == NULL) {
         neighborList = new CpuNeighborList(getVecBlockSize());
+        neighborList->setClusterPairMode(CpuNeighborList::AutoClusterPairs);
+        neighborList->setUseIncrementalRebuild(incrementalNeighborList);
+    }
     if (cutoffDistance > cutoff)
         cutoff = cutoffDistance;
-    if (cutoffDistance+padding > paddedCutoff)
-        paddedCutoff = cutoffDistance+padding;
+    if (fixedPadding > 0.0)
+        setNeighborListPadding(fixedPadding);
+    else if (cutoffDistance+padding > paddedCutoff)
+        setNeighborListPadding(cutoffDistance+padding-cutoff);
     if (useExclusions) {
         if (anyExclusions && exclusions != exclusionList)
             throw OpenMMException("All Forces must have identical exclusions");
@@ -189,6 +303,13 @@ void CpuPlatform::PlatformData::requestNeighborList(double cutoffDistance, doubl
         exclusions = exclusionList;
 }
 
+void CpuPlatform::PlatformData::setNeighborListPadding(double padding) {
+    paddedCutoff = cutoff+padding;
+    stringstream paddingProperty;
+    paddingProperty << padding;
+    propertyValues[CpuNeighborListPadding()] = paddingProperty.str();
+}
+
 int CpuPlatform::PlatformData::requestPosqIndex() {
     return nextPosqIndex++;
 }
\ No newline at end of file
@@ -34,8 +34,8 @@ CpuRandom::CpuRandom() : hasInitialized(false) {
 }
 
 CpuRandom::~CpuRandom() {
-    for (auto random : threadRandom)
-        delete random;
+    for (auto data : threadData)
+        delete data;
 }
 
 void CpuRandom::initialize(int seed, int numThreads) {
@@ -46,9 +46,12 @@ void CpuRandom::initialize(int seed, int numThreads) {
     }
     randomSeed = seed;
     hasInitialized = true;
-    threadRandom.resize(numThreads);
-    nextGaussian.resize(numThreads);
-    nextGaussianIsValid.resize(numThreads, false);
+
+    // SFMT generates a whole block of values at once with SIMD instructions.  The block must be
+    // at least as large as its internal state and a multiple of four values.
+
+    int blockSize = 2*OpenMM_SFMT::get_min_array_size32();
+    threadData.resize(numThreads);
 
     /* Use a quick and dirty RNG to pick seeds for the real random number generator.
      * A random seed of 0 means pick a unique seed
@@ -59,31 +62,42 @@ void CpuRandom::initialize(int seed, int numThreads) {
         r = (unsigned int) osrngseed();
     for (int i = 0; i < numThreads; i++) {
         r = (1664525*r + 1013904223) & 0xFFFFFFFF;
-        threadRandom[i] = new OpenMM_SFMT::SFMT();
-        init_gen_rand(r, *threadRandom[i]);
+        ThreadData* data = new ThreadData();
+        init_gen_rand(r, data->sfmt);
+        data->gaussianBits.resize(blockSize);
+        data->uniformBits.resize(blockSize);
+        data->gaussians.resize(blockSize);
+        data->nextGaussian = blockSize;
+        data->nextUniform = blockSize;
+        threadData[i] = data;
     }
 }
 
-float CpuRandom::getGaussianRandom(int threadIndex) {
-    if (nextGaussianIsValid[threadIndex]) {
-        nextGaussianIsValid[threadIndex] = false;
-        return nextGaussian[threadIndex];
+void CpuRandom::generateGaussians(ThreadData& data) {
+    // Use the basic form of the Box-Muller transformation.  Unlike the polar form it has no rejection
+    // step, so every block of random bits produces a full block of Gaussian values in a loop with no
+    // data dependent branches.
+
+    fill_array32(&data.gaussianBits[0], data.gaussianBits.size(), data.sfmt);
+    const float scale = 1.0f/4294967296.0f;
+    const float twoPi = 6.283185307179586f;
+    int half = data.gaussians.size()/2;
+    for (int i = 0; i < half; i++) {
+        float u1 = ((float) data.gaussianBits[i]+0.5f)*scale;
+        float u2 = (float) data.gaussianBits[i+half]*scale;
+        float radius = sqrtf(-2.0f*logf(u1));
+        float theta = twoPi*u2;
+        data.gaussians[i] = radius*cosf(theta);
+        data.gaussians[i+half] = radius*sinf(theta);
     }
-    
-    // Use the polar form of the Box-Muller transformation to generate two Gaussian random numbers.
-    
-    float x, y, r2;
-    do {
-        x = 2.0f*(float) genrand_real2(*threadRandom[threadIndex])-1.0f;
-        y = 2.0f*(float) genrand_real2(*threadRandom[threadIndex])-1.0f;
-        r2 = x*x + y*y;
-    } while (r2 >= 1.0f || r2 == 0.0f);
-    float multiplier = sqrtf((-2.0f*logf(r2))/r2);
-    nextGaussian[threadIndex] = y*multiplier;
-    nextGaussianIsValid[threadIndex] = true;
-    return x*multiplier;
+    data.nextGaussian = 0;
 }
 
 float CpuRandom::getUniformRandom(int threadIndex) {
-    return genrand_real2(*threadRandom[threadIndex]);
+    ThreadData& data = *threadData[threadIndex];
+    if (data.nextUniform == data.uniformBits.size()) {
+        fill_array32(&data.uniformBits[0], data.uniformBits.size(), data.sfmt);
+        data.nextUniform = 0;
+    }
+    return (float) OpenMM_SFMT::to_real2(data.uniformBits[data.nextUniform++]);
 }
@@ -48,7 +48,49 @@
 using namespace OpenMM;
 using namespace std;
 
-void testNeighborList(bool periodic, bool triclinic) {
+void verifyNeighborList(const CpuNeighborList& neighborList, int numParticles, const AlignedArray<float>& positions, const vector<set<int> >& exclusions,
+        const Vec3* boxVectors, bool periodic, float cutoff) {
+    const int blockSize = neighborList.getBlockSize();
+    const float boxSize[3] = {(float) boxVectors[0][0], (float) boxVectors[1][1], (float) boxVectors[2][2]};
+
+    // Convert the neighbor list to a set for faster lookup.
+    
+    set<pair<int, int> > neighbors;
+    for (int i = 0; i < (int) neighborList.getSortedAtoms().size(); i++) {
+        int blockIndex = i/blockSize;
+        int indexInBlock = i-blockIndex*blockSize;
+        CpuNeighborList::BlockExclusionMask mask = 1<<indexInBlock;
+        for (int j = 0; j < (int) neighborList.getBlockExclusions(blockIndex).size(); j++) {
+            if ((neighborList.getBlockExclusions(blockIndex)[j] & mask) == 0) {
+                int atom1 = neighborList.getSortedAtoms()[i];
+                int atom2 = neighborList.getBlockNeighbors(blockIndex)[j];
+                pair<int, int> entry = make_pair(min(atom1, atom2), max(atom1, atom2));
+                ASSERT(neighbors.find(entry) == neighbors.end() && neighbors.find(make_pair(entry.second, entry.first)) == neighbors.end()); // No duplicates
+                neighbors.insert(entry);
+            }
+        }
+    }
+    
+    // Check each particle pair and figure out whether they should be in the neighbor list.
+
+    for (int i = 0; i < numParticles; i++)
+        for (int j = 0; j <= i; j++) {
+            bool shouldInclude = (exclusions[i].find(j) == exclusions[i].end());
+            Vec3 diff(positions[4*i]-positions[4*j], positions[4*i+1]-positions[4*j+1], positions[4*i+2]-positions[4*j+2]);
+            if (periodic) {
+                diff -= boxVectors[2]*floor(diff[2]/boxSize[2]+0.5);
+                diff -= boxVectors[1]*floor(diff[1]/boxSize[1]+0.5);
+                diff -= boxVectors[0]*floor(diff[0]/boxSize[0]+0.5);
+            }
+            if (diff.dot(diff) > cutoff*cutoff)
+                shouldInclude = false;
+            bool isIncluded = (neighbors.find(make_pair(i, j)) != neighbors.end() || neighbors.find(make_pair(j, i)) != neighbors.end());
+            if (shouldInclude)
+                ASSERT(isIncluded);
+        }
+}
+
+void testNeighborList(bool periodic, bool triclinic, bool clusterPairs, int blockSize) {
     const int numParticles = 500;
     const float cutoff = 2.0f;
     Vec3 boxVectors[3];
@@ -63,7 +105,6 @@ void testNeighborList(bool periodic, bool triclinic) {
         boxVectors[2] = Vec3(0, 0, 11);
     }
     const float boxSize[3] = {(float) boxVectors[0][0], (float) boxVectors[1][1], (float) boxVectors[2][2]};
-    const int blockSize = 8;
     OpenMM_SFMT::SFMT sfmt;
     init_gen_rand(0, sfmt);
     AlignedArray<float> positions(4*numParticles);
@@ -80,43 +121,99 @@ void testNeighborList(bool periodic, bool triclinic) {
     }
     ThreadPool threads;
     CpuNeighborList neighborList(blockSize);
+    if (clusterPairs)
+        neighborList.setClusterPairMode(CpuNeighborList::ClusterPairs);
     neighborList.computeNeighborList(numParticles, positions, exclusions, boxVectors, periodic, cutoff, threads);
-    
-    // Convert the neighbor list to a set for faster lookup.
-    
-    set<pair<int, int> > neighbors;
-    for (int i = 0; i < (int) neighborList.getSortedAtoms().size(); i++) {
-        int blockIndex = i/blockSize;
-        int indexInBlock = i-blockIndex*blockSize;
-        char mask = 1<<indexInBlock;
-        for (int j = 0; j < (int) neighborList.getBlockExclusions(blockIndex).size(); j++) {
-            if ((neighborList.getBlockExclusions(blockIndex)[j] & mask) == 0) {
-                int atom1 = neighborList.getSortedAtoms()[i];
-                int atom2 = neighborList.getBlockNeighbors(blockIndex)[j];
-                pair<int, int> entry = make_pair(min(atom1, atom2), max(atom1, atom2));
-                ASSERT(neighbors.find(entry) == neighbors.end() && neighbors.find(make_pair(entry.second, entry.first)) == neighbors.end()); // No duplicates
-                neighbors.insert(entry);
+    ASSERT_EQUAL(clusterPairs, neighborList.getUseClusterPairs());
+    if (clusterPairs) {
+        // Every block's neighbors should consist of complete clusters of consecutive sorted atoms.
+
+        const int clusterSize = CpuNeighborList::ClusterSize;
+        for (int blockIndex = 0; blockIndex < neighborList.getNumBlocks(); blockIndex++) {
+            const vector<int>& blockNeighbors = neighborList.getBlockNeighbors(blockIndex);
+            ASSERT_EQUAL(0, blockNeighbors.size()%clusterSize);
+            for (int j = 0; j < (int) blockNeighbors.size(); j += clusterSize) {
+                int first = find(neighborList.getSortedAtoms().begin(), neighborList.getSortedAtoms().end(), blockNeighbors[j])-neighborList.getSortedAtoms().begin();
+                ASSERT_EQUAL(0, first%clusterSize);
+                for (int k = 1; k < clusterSize; k++) {
+                    if (first+k < numParticles) {
+                        ASSERT_EQUAL(neighborList.getSortedAtoms()[first+k], blockNeighbors[j+k]);
+                    }
+                    else {
+                        ASSERT_EQUAL((1<<blockSize)-1, neighborList.getBlockExclusions(blockIndex)[j+k] & ((1<<blockSize)-1));
+                    }
+                }
             }
         }
     }
     
-    // Check each particle pair and figure out whether they should be in the neighbor list.
+    verifyNeighborList(neighborList, numParticles, positions, exclusions, boxVectors, periodic, cutoff);
+}
 
-    for (int i = 0; i < numParticles; i++)
-        for (int j = 0; j <= i; j++) {
-            bool shouldInclude = (exclusions[i].find(j) == exclusions[i].end());
-            Vec3 diff(positions[4*i]-positions[4*j], positions[4*i+1]-positions[4*j+1], positions[4*i+2]-positions[4*j+2]);
-            if (periodic) {
-                diff -= boxVectors[2]*floor(diff[2]/boxSize[2]+0.5);
-                diff -= boxVectors[1]*floor(diff[1]/boxSize[1]+0.5);
-                diff -= boxVectors[0]*floor(diff[0]/boxSize[0]+0.5);
+void testIncrementalRebuild(bool periodic) {
+    const int numParticles = 1000;
+    const float cutoff = 1.5f;
+    Vec3 boxVectors[3];
+    boxVectors[0] = Vec3(10, 0, 0);
+    boxVectors[1] = Vec3(0, 9, 0);
+    boxVectors[2] = Vec3(0, 0, 11);
+    const int blockSize = 8;
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    AlignedArray<float> positions(4*numParticles);
+    for (int i = 0; i < 4*numParticles; i++)
+        if (i%4 < 3)
+            positions[i] = (float) (boxVectors[i%4][i%4]*genrand_real2(sfmt));
+    vector<set<int> > exclusions(numParticles);
+    for (int i = 0; i < numParticles; i++) {
+        exclusions[i].insert(i);
+        if (i > 0) {
+            exclusions[i].insert(i-1);
+            exclusions[i-1].insert(i);
+        }
+    }
+    ThreadPool threads;
+    CpuNeighborList neighborList(blockSize);
+    neighborList.setUseIncrementalRebuild(true);
+    neighborList.computeNeighborList(numParticles, positions, exclusions, boxVectors, periodic, cutoff, threads);
+    ASSERT(!neighborList.getLastRebuildWasIncremental());
+    verifyNeighborList(neighborList, numParticles, positions, exclusions, boxVectors, periodic, cutoff);
+
+    // Move a few atoms a long way, and everything else by a tiny amount.  The list should be
+    // updated incrementally, and should still be correct.
+
+    for (int step = 0; step < 5; step++) {
+        for (int i = 0; i < numParticles; i++) {
+            if (i%100 == step) {
+                for (int j = 0; j < 3; j++)
+                    positions[4*i+j] += (float) (2.0*(genrand_real2(sfmt)-0.5));
+                if (!periodic)
+                    for (int j = 1; j < 3; j++)
+                        positions[4*i+j] = max(1.0f, min((float) boxVectors[j][j]-1.0f, positions[4*i+j]));
             }
-            if (diff.dot(diff) > cutoff*cutoff)
-                shouldInclude = false;
-            bool isIncluded = (neighbors.find(make_pair(i, j)) != neighbors.end() || neighbors.find(make_pair(j, i)) != neighbors.end());
-            if (shouldInclude)
-                ASSERT(isIncluded);
+            else
+                for (int j = 0; j < 3; j++)
+                    positions[4*i+j] += (float) (0.001*(genrand_real2(sfmt)-0.5));
         }
+        neighborList.computeNeighborList(numParticles, positions, exclusions, boxVectors, periodic, cutoff, threads);
+        ASSERT(neighborList.getLastRebuildWasIncremental());
+        verifyNeighborList(neighborList, numParticles, positions, exclusions, boxVectors, periodic, cutoff);
+    }
+
+    // Moving many atoms should trigger a full rebuild.
+
+    for (int i = 0; i < 4*numParticles; i++)
+        if (i%4 < 3)
+            positions[i] = (float) (boxVectors[i%4][i%4]*genrand_real2(sfmt));
+    neighborList.computeNeighborList(numParticles, positions, exclusions, boxVectors, periodic, cutoff, threads);
+    ASSERT(!neighborList.getLastRebuildWasIncremental());
+    verifyNeighborList(neighborList, numParticles, positions, exclusions, boxVectors, periodic, cutoff);
+    ASSERT_EQUAL(2, neighborList.getNumFullBuilds());
+    ASSERT_EQUAL(5, neighborList.getNumIncrementalUpdates());
+    long long numNeighbors = 0;
+    for (int i = 0; i < neighborList.getNumBlocks(); i++)
+        numNeighbors += neighborList.getBlockNeighbors(i).size();
+    ASSERT_EQUAL(numNeighbors, neighborList.getNumNeighbors());
 }
 
 int main() {
@@ -125,9 +222,16 @@ int main() {
             cout << "CPU is not supported.  Exiting." << endl;
             return 0;
         }
-        testNeighborList(false, false);
-        testNeighborList(true, false);
-        testNeighborList(true, true);
+        for (int blockSize : {8, 16}) {
+            testNeighborList(false, false, false, blockSize);
+            testNeighborList(true, false, false, blockSize);
+            testNeighborList(true, true, false, blockSize);
+            testNeighborList(false, false, true, blockSize);
+            testNeighborList(true, false, true, blockSize);
+            testNeighborList(true, true, true, blockSize);
+        }
+        testIncrementalRebuild(false);
+        testIncrementalRebuild(true);
     }
     catch(const exception& e) {
         cout << "exception: " << e.what() << endl;
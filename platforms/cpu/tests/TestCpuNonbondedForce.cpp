@@ -32,6 +32,275 @@
 #include "CpuTests.h"
 #include "TestNonbondedForce.h"
 
+void testNeighborListPadding() {
+    const int numParticles = 500;
+    const double cutoff = 1.0;
+    const double boxSize = 5.0;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    nonbonded->setCutoffDistance(cutoff);
+    vector<Vec3> positions(numParticles);
+    vector<Vec3> velocities(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle(0.0, 0.2, 0.1);
+        positions[i] = Vec3((i%8)+0.5*genrand_real2(sfmt), ((i/8)%8)+0.5*genrand_real2(sfmt), (i/64)+0.5*genrand_real2(sfmt))*(boxSize/8);
+        velocities[i] = Vec3(genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5)*20.0;
+    }
+    system.addForce(nonbonded);
+    ReferencePlatform reference;
+
+    // A fixed padding should be reported as given, and an invalid one should be rejected.
+
+    VerletIntegrator integrator1(0.001);
+    map<string, string> properties;
+    properties[CpuPlatform::CpuNeighborListPadding()] = "0.3";
+    Context context1(system, integrator1, platform, properties);
+    ASSERT_EQUAL(0.3, stod(platform.getPropertyValue(context1, CpuPlatform::CpuNeighborListPadding())));
+    properties[CpuPlatform::CpuNeighborListPadding()] = "bad";
+    VerletIntegrator integrator2(0.001);
+    bool threwException = false;
+    try {
+        Context context2(system, integrator2, platform, properties);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+
+    // Simulate a hot system so the neighbor list gets rebuilt often and the padding is tuned.  The
+    // padding should stay within bounds, and the forces should still be correct.
+
+    VerletIntegrator integrator3(0.001);
+    properties[CpuPlatform::CpuNeighborListPadding()] = "auto";
+    Context context3(system, integrator3, platform, properties);
+    context3.setPositions(positions);
+    context3.setVelocities(velocities);
+    integrator3.step(1000);
+    double padding = stod(platform.getPropertyValue(context3, CpuPlatform::CpuNeighborListPadding()));
+    ASSERT(padding >= 0.02*cutoff && padding <= 0.5*cutoff);
+    State state = context3.getState(State::Positions | State::Forces | State::Energy);
+    VerletIntegrator integrator4(0.001);
+    Context referenceContext(system, integrator4, reference);
+    referenceContext.setPositions(state.getPositions());
+    State referenceState = referenceContext.getState(State::Forces | State::Energy);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(referenceState.getForces()[i], state.getForces()[i], 1e-3);
+    ASSERT_EQUAL_TOL(referenceState.getPotentialEnergy(), state.getPotentialEnergy(), 1e-4);
+}
+
+void testNumaPolicy() {
+    const int numParticles = 200;
+    const double boxSize = 3.0;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    nonbonded->setCutoffDistance(1.0);
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle(i%2 == 0 ? 0.5 : -0.5, 0.2, 0.1);
+        positions[i] = Vec3((i%6)+0.5*genrand_real2(sfmt), ((i/6)%6)+0.5*genrand_real2(sfmt), (i/36)+0.5*genrand_real2(sfmt))*(boxSize/6);
+    }
+    system.addForce(nonbonded);
+
+    // Pinning threads should be reported, and should not change the results.
+
+    map<string, string> properties;
+    properties[CpuPlatform::CpuNumaPolicy()] = "pin";
+    VerletIntegrator integrator1(0.001);
+    Context context1(system, integrator1, platform, properties);
+    ASSERT_EQUAL("pin", platform.getPropertyValue(context1, CpuPlatform::CpuNumaPolicy()));
+    VerletIntegrator integrator2(0.001);
+    Context context2(system, integrator2, platform);
+    ASSERT_EQUAL("none", platform.getPropertyValue(context2, CpuPlatform::CpuNumaPolicy()));
+    context1.setPositions(positions);
+    context2.setPositions(positions);
+    State state1 = context1.getState(State::Forces | State::Energy);
+    State state2 = context2.getState(State::Forces | State::Energy);
+    ASSERT_EQUAL_TOL(state2.getPotentialEnergy(), state1.getPotentialEnergy(), 1e-5);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(state2.getForces()[i], state1.getForces()[i], 1e-4);
+
+    // An invalid value should be rejected.
+
+    properties[CpuPlatform::CpuNumaPolicy()] = "bad";
+    VerletIntegrator integrator3(0.001);
+    bool threwException = false;
+    try {
+        Context context3(system, integrator3, platform, properties);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
+void testMixedPrecision(NonbondedForce::NonbondedMethod method) {
+    const int numMolecules = 100;
+    const double boxSize = 3.0;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(method);
+    nonbonded->setCutoffDistance(1.0);
+    vector<Vec3> positions(2*numMolecules);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numMolecules; i++) {
+        system.addParticle(1.0);
+        system.addParticle(1.0);
+        nonbonded->addParticle(0.5, 0.2, 0.1);
+        nonbonded->addParticle(-0.5, 0.2, 0.1);
+        nonbonded->addException(2*i, 2*i+1, 0.0, 1.0, 0.0);
+        positions[2*i] = Vec3((i%5)+0.5*genrand_real2(sfmt), ((i/5)%5)+0.5*genrand_real2(sfmt), (i/25)+0.5*genrand_real2(sfmt))*(boxSize/5);
+        positions[2*i+1] = positions[2*i]+Vec3(0.1, 0, 0);
+    }
+    system.addForce(nonbonded);
+    map<string, string> properties;
+    properties[CpuPlatform::CpuPrecision()] = "mixed";
+    VerletIntegrator integrator1(0.001);
+    Context context(system, integrator1, platform, properties);
+    ASSERT_EQUAL("mixed", platform.getPropertyValue(context, CpuPlatform::CpuPrecision()));
+    ReferencePlatform reference;
+    VerletIntegrator integrator2(0.001);
+    Context referenceContext(system, integrator2, reference);
+    context.setPositions(positions);
+    referenceContext.setPositions(positions);
+
+    // Evaluate the forces twice, to make sure the accumulation buffers are correctly reset.
+
+    for (int repeat = 0; repeat < 2; repeat++) {
+        State state = context.getState(State::Forces | State::Energy);
+        State referenceState = referenceContext.getState(State::Forces | State::Energy);
+        ASSERT_EQUAL_TOL(referenceState.getPotentialEnergy(), state.getPotentialEnergy(), 1e-3);
+        for (int i = 0; i < system.getNumParticles(); i++)
+            ASSERT_EQUAL_VEC(referenceState.getForces()[i], state.getForces()[i], 1e-3);
+    }
+
+    // An invalid value should be rejected.
+
+    properties[CpuPlatform::CpuPrecision()] = "double";
+    VerletIntegrator integrator3(0.001);
+    bool threwException = false;
+    try {
+        Context context3(system, integrator3, platform, properties);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
+void testClusterPairs() {
+    // Build a system large and dense enough that the neighbor list switches to cluster pairs.
+
+    const int gridSize = 18;
+    const int numParticles = gridSize*gridSize*gridSize;
+    const double spacing = 0.22;
+    const double boxSize = gridSize*spacing;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    nonbonded->setCutoffDistance(1.0);
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle(i%2 == 0 ? 0.2 : -0.2, 0.15, 0.5);
+        positions[i] = Vec3((i%gridSize)+0.3*genrand_real2(sfmt), ((i/gridSize)%gridSize)+0.3*genrand_real2(sfmt), (i/(gridSize*gridSize))+0.3*genrand_real2(sfmt))*spacing;
+    }
+    for (int i = 0; i < numParticles; i += 10)
+        nonbonded->addException(i, i+1, 0.0, 1.0, 0.0);
+    system.addForce(nonbonded);
+
+    // The results should match the Reference platform.
+
+    VerletIntegrator integrator1(0.001);
+    Context context1(system, integrator1, platform);
+    context1.setPositions(positions);
+    State state1 = context1.getState(State::Forces | State::Energy);
+    VerletIntegrator integrator2(0.001);
+    ReferencePlatform reference;
+    Context context2(system, integrator2, reference);
+    context2.setPositions(positions);
+    State state2 = context2.getState(State::Forces | State::Energy);
+    ASSERT_EQUAL_TOL(state2.getPotentialEnergy(), state1.getPotentialEnergy(), 1e-4);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(state2.getForces()[i], state1.getForces()[i], 1e-3);
+}
+
+void testHugePages(int gridSize) {
+    const int numParticles = gridSize*gridSize*gridSize;
+    const double spacing = 0.3;
+    const double boxSize = gridSize*spacing;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    nonbonded->setCutoffDistance(0.6);
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle(i%2 == 0 ? 0.2 : -0.2, 0.2, 0.5);
+        positions[i] = Vec3((i%gridSize)+0.3*genrand_real2(sfmt), ((i/gridSize)%gridSize)+0.3*genrand_real2(sfmt), (i/(gridSize*gridSize))+0.3*genrand_real2(sfmt))*spacing;
+    }
+    system.addForce(nonbonded);
+
+    // Requesting huge pages should be reported, and should not change the results.  Small buffers
+    // fall back to ordinary pages, as do large ones if the kernel does not provide huge pages.
+
+    map<string, string> properties;
+    properties[CpuPlatform::CpuHugePages()] = "true";
+    VerletIntegrator integrator1(0.001);
+    Context context1(system, integrator1, platform, properties);
+    ASSERT_EQUAL("true", platform.getPropertyValue(context1, CpuPlatform::CpuHugePages()));
+    VerletIntegrator integrator2(0.001);
+    Context context2(system, integrator2, platform);
+    ASSERT_EQUAL("false", platform.getPropertyValue(context2, CpuPlatform::CpuHugePages()));
+    context1.setPositions(positions);
+    context2.setPositions(positions);
+    for (int repeat = 0; repeat < 2; repeat++) {
+        State state1 = context1.getState(State::Forces | State::Energy);
+        State state2 = context2.getState(State::Forces | State::Energy);
+        ASSERT_EQUAL(state2.getPotentialEnergy(), state1.getPotentialEnergy());
+        for (int i = 0; i < numParticles; i++)
+            ASSERT_EQUAL_VEC(state2.getForces()[i], state1.getForces()[i], 0.0);
+    }
+
+    // An invalid value should be rejected.
+
+    properties[CpuPlatform::CpuHugePages()] = "bad";
+    VerletIntegrator integrator3(0.001);
+    bool threwException = false;
+    try {
+        Context context3(system, integrator3, platform, properties);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
 void runPlatformTests() {
     testHugeSystem();
+    testNeighborListPadding();
+    testNumaPolicy();
+    testMixedPrecision(NonbondedForce::NoCutoff);
+    testMixedPrecision(NonbondedForce::CutoffPeriodic);
+    testMixedPrecision(NonbondedForce::Ewald);
+    testClusterPairs();
+    testHugePages(6);
+    testHugePages(52);
 }
@@ -0,0 +1,134 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2026 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+/**
+ * This tests the CPU implementation of random number generation.
+ */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/internal/ThreadPool.h"
+#include "CpuPlatform.h"
+#include "CpuRandom.h"
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+const int numValues = 10000;
+
+/**
+ * Generate Gaussian and uniform values for one thread, alternating between them.
+ */
+void generateValues(CpuRandom& random, int threadIndex, vector<float>& gaussians, vector<float>& uniforms) {
+    gaussians.resize(numValues);
+    uniforms.resize(numValues);
+    for (int i = 0; i < numValues; i++) {
+        gaussians[i] = random.getGaussianRandom(threadIndex);
+        uniforms[i] = random.getUniformRandom(threadIndex);
+    }
+}
+
+void testDistribution() {
+    CpuRandom random;
+    random.initialize(5, 1);
+    vector<float> gaussians, uniforms;
+    generateValues(random, 0, gaussians, uniforms);
+    double mean = 0, var = 0, uniformMean = 0;
+    for (int i = 0; i < numValues; i++) {
+        mean += gaussians[i];
+        var += gaussians[i]*gaussians[i];
+        uniformMean += uniforms[i];
+        ASSERT(uniforms[i] >= 0.0f && uniforms[i] < 1.0f);
+    }
+    mean /= numValues;
+    var = var/numValues-mean*mean;
+    uniformMean /= numValues;
+    ASSERT_EQUAL_TOL(0.0, mean, 0.05);
+    ASSERT_EQUAL_TOL(1.0, var, 0.05);
+    ASSERT_EQUAL_TOL(0.5, uniformMean, 0.05);
+}
+
+void testThreadsAreDeterministic() {
+    // Each thread's sequence depends only on the seed and the thread index, not on how many threads
+    // there are or whether they generate values at the same time.
+
+    const int numThreads = 4;
+    CpuRandom serialRandom;
+    serialRandom.initialize(5, 1);
+    vector<float> serialGaussians, serialUniforms;
+    generateValues(serialRandom, 0, serialGaussians, serialUniforms);
+    CpuRandom random;
+    random.initialize(5, numThreads);
+    vector<vector<float> > gaussians(numThreads), uniforms(numThreads);
+    ThreadPool threads(numThreads);
+    threads.execute([&] (ThreadPool& threads, int threadIndex) {
+        generateValues(random, threadIndex, gaussians[threadIndex], uniforms[threadIndex]);
+    });
+    threads.waitForThreads();
+    for (int i = 0; i < numValues; i++) {
+        ASSERT_EQUAL(serialGaussians[i], gaussians[0][i]);
+        ASSERT_EQUAL(serialUniforms[i], uniforms[0][i]);
+    }
+
+    // Generating the same values one thread at a time should give identical results.
+
+    CpuRandom random2;
+    random2.initialize(5, numThreads);
+    for (int i = 0; i < numThreads; i++) {
+        vector<float> gaussians2, uniforms2;
+        generateValues(random2, i, gaussians2, uniforms2);
+        for (int j = 0; j < numValues; j++) {
+            ASSERT_EQUAL(gaussians2[j], gaussians[i][j]);
+            ASSERT_EQUAL(uniforms2[j], uniforms[i][j]);
+        }
+        if (i > 0)
+            ASSERT(gaussians[i][0] != gaussians[0][0]);
+    }
+}
+
+int main() {
+    try {
+        if (!CpuPlatform::isProcessorSupported()) {
+            cout << "CPU is not supported.  Exiting." << endl;
+            return 0;
+        }
+        testDistribution();
+        testThreadsAreDeterministic();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
@@ -0,0 +1,78 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2021 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "CpuTests.h"
+#include "TestVerletIntegrator.h"
+
+void testCCMAThreadsGiveIdenticalResults() {
+    // Create a long chain of constrained particles, so CCMA is applied on multiple threads.
+
+    const int numParticles = 2000;
+    System system;
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        positions[i] = Vec3(i, 0, 0);
+        if (i > 0) {
+            system.addConstraint(i-1, i, 1.0);
+            Vec3 delta(genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5);
+            delta /= sqrt(delta.dot(delta));
+            positions[i] = positions[i-1]+delta;
+        }
+    }
+
+    // The positions and velocities should be bitwise identical for any number of threads.
+
+    map<string, string> properties1, properties4;
+    properties1["Threads"] = "1";
+    properties4["Threads"] = "4";
+    VerletIntegrator integrator1(0.001);
+    VerletIntegrator integrator4(0.001);
+    Context context1(system, integrator1, platform, properties1);
+    Context context4(system, integrator4, platform, properties4);
+    context1.setPositions(positions);
+    context1.setVelocitiesToTemperature(300.0, 1);
+    context4.setState(context1.getState(State::Positions | State::Velocities));
+    integrator1.step(10);
+    integrator4.step(10);
+    State state1 = context1.getState(State::Positions | State::Velocities);
+    State state4 = context4.getState(State::Positions | State::Velocities);
+    for (int i = 0; i < numParticles; i++) {
+        ASSERT(state1.getPositions()[i] == state4.getPositions()[i]);
+        ASSERT(state1.getVelocities()[i] == state4.getVelocities()[i]);
+    }
+}
+
+void runPlatformTests() {
+    testCCMAThreadsGiveIdenticalResults();
+}
@@ -153,6 +153,41 @@ public:
      *                 the source array  must be in page-locked memory.
      */
     void upload(const void* data, bool blocking=true);
+    /**
+     * Copy values from an array to a contiguous range of elements in the device memory.
+     * 
+     * @param data     the data to copy
+     * @param offset   the index of the first element to copy to
+     * @param elements the number of elements to copy
+     * @param blocking if true, this call will block until the transfer is complete.  If false,
+     *                 the source array  must be in page-locked memory.
+     */
+    void uploadSubArray(const void* data, int offset, int elements, bool blocking=true);
+    /**
+     * Copy the values in a vector to the device memory, and allow the memory to be shared with other
+     * arrays holding identical contents.
+     */
+    template <class T>
+    void uploadShared(const std::vector<T>& data) {
+        ArrayInterface::uploadShared(data);
+    }
+    /**
+     * Copy values from an array to the device memory, and allow the memory to be shared with other
+     * arrays on the same CUDA context that hold identical contents.  Contexts that use the same
+     * device with UseSharedContext enabled, or that are linked to each other, share a CUDA context.
+     * The shared memory is reference counted.  If this array is later modified with upload(),
+     * uploadSubArray(), or copyTo(), it first gets its own private copy.  This must only be used for
+     * arrays that kernels never write to.
+     *
+     * @param data     the data to copy
+     */
+    void uploadShared(const void* data);
+    /**
+     * Get whether this array currently uses memory that is shared with other arrays.
+     */
+    bool isShared() const {
+        return shared;
+    }
     /**
      * Copy the values in the device memory to an array.
      * 
@@ -168,10 +203,13 @@ public:
      */
     void copyTo(ArrayInterface& dest) const;
 private:
+    CUresult freeMemory();
+    void releaseMemory();
+    void makePrivate(bool preserveContents);
     CudaContext* context;
     CUdeviceptr pointer;
     int size, elementSize;
-    bool ownsMemory;
+    bool ownsMemory, shared;
     std::string name;
 };
 
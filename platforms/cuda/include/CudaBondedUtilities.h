@@ -83,6 +83,7 @@ class CudaContext;
 class OPENMM_EXPORT_COMMON CudaBondedUtilities : public BondedUtilities {
 public:
     CudaBondedUtilities(CudaContext& context);
+    ~CudaBondedUtilities();
     /**
      * Add a bonded interaction.
      *
@@ -136,10 +137,21 @@ public:
      * @param groups        a set of bit flags for which force groups to include
      */
     void computeInteractions(int groups);
+    /**
+     * Wait for the bonded interactions to finish.  When possible, computeInteractions() launches the kernel on
+     * a separate stream so it can run at the same time as the nonbonded interactions.  This makes the current
+     * stream wait for it, and adds its contribution to the energy.
+     *
+     * @param includeEnergy whether the energy is being computed
+     */
+    void finishInteractions(bool includeEnergy);
 private:
     std::string createForceSource(int forceIndex, int numBonds, int numAtoms, int group, const std::string& computeForce);
     CudaContext& context;
-    CUfunction kernel;
+    CUfunction kernel, addEnergyKernel;
+    CUstream stream;
+    CUevent startEvent, finishEvent;
+    CudaArray energyBuffer;
     std::vector<std::vector<std::vector<int> > > forceAtoms;
     std::vector<std::vector<int> > indexWidth;
     std::vector<std::string> forceSource;
@@ -150,8 +162,9 @@ private:
     std::vector<std::string> prefixCode;
     std::vector<std::string> energyParameterDerivatives;
     std::vector<void*> kernelArgs;
-    int numForceBuffers, maxBonds, allGroups;
-    bool hasInitializedKernels, hasInteractions;
+    std::vector<int> groupMaxBonds;
+    int numForceBuffers, allGroups;
+    bool hasInitializedKernels, hasInteractions, useSeparateStream, isRunning;
 };
 
 } // namespace OpenMM
@@ -28,6 +28,7 @@
  * -------------------------------------------------------------------------- */
 
 #include <map>
+#include <memory>
 #include <string>
 #include <utility>
 #define __CL_ENABLE_EXCEPTIONS
@@ -44,6 +45,7 @@
 #include "CudaBondedUtilities.h"
 #include "CudaExpressionUtilities.h"
 #include "CudaIntegrationUtilities.h"
+#include "CudaMemoryPool.h"
 #include "CudaNonbondedUtilities.h"
 #include "CudaPlatform.h"
 #include "openmm/OpenMMException.h"
@@ -72,9 +74,10 @@ public:
     class ReorderListener;
     class ForcePreComputation;
     class ForcePostComputation;
+    class DeferredModule;
     static const int ThreadBlockSize;
     static const int TileSize;
-    CudaContext(const System& system, int deviceIndex, bool useBlockingSync, const std::string& precision,
+    CudaContext(const System& system, int deviceIndex, bool useBlockingSync, bool useSharedContext, const std::string& precision,
             const std::string& compiler, const std::string& tempDir, const std::string& hostCompiler, CudaPlatform::PlatformData& platformData,
             CudaContext* originalContext);
     ~CudaContext();
@@ -95,6 +98,14 @@ public:
     bool getContextIsValid() const {
         return contextIsValid;
     }
+    /**
+     * Get the pool from which device memory for arrays is allocated.  This is shared by all
+     * CudaContexts that use the same CUcontext.  It is NULL if the CUcontext has not been
+     * created yet or has already been destroyed.
+     */
+    CudaMemoryPool* getMemoryPool() {
+        return memoryPool;
+    }
     /**
      * Set the CUcontext associated with this object to be the current context.  If the context is not
      * valid, this returns without doing anything.
@@ -138,6 +149,10 @@ public:
     int getContextIndex() const {
         return contextIndex;
     }
+    /**
+     * Get whether the kernels for each time step should be captured into CUDA graphs and replayed.
+     */
+    bool getUseCudaGraphs() const;
     /**
      * Get the stream currently being used for execution.
      */
@@ -147,7 +162,9 @@ public:
      */
     void setCurrentStream(CUstream stream);
     /**
-     * Reset the context to using the default stream for execution.
+     * Reset the context to using the default stream for execution.  Normally this is the null stream, but
+     * when the device's primary context is shared with other Contexts, each one has its own default stream
+     * so that work from independent Contexts can execute concurrently.
      */
     void restoreDefaultStream();
     /**
@@ -160,7 +177,9 @@ public:
      */
     ComputeEvent createEvent();
     /**
-     * Compile source code to create a ComputeProgram.
+     * Compile source code to create a ComputeProgram.  Compilation is deferred: the program is added
+     * to a list of pending programs, which are all compiled together (in parallel) the first time any
+     * of them is needed, or when compilePendingModules() is called.
      *
      * @param source             the source code of the program
      * @param defines            a set of preprocessor definitions (name, value) to define when compiling the program
@@ -269,6 +288,16 @@ public:
      * @param name      the name of the kernel to get
      */
     CUfunction getKernel(CUmodule& module, const std::string& name);
+    /**
+     * Get the CUDA module for a program created by compileProgram().  If it has not been compiled yet,
+     * this first compiles all pending programs.
+     */
+    CUmodule getModule(DeferredModule& module);
+    /**
+     * Compile and load every program that was created by compileProgram() but has not been compiled yet.
+     * The programs are independent of each other, so they are compiled in parallel on multiple threads.
+     */
+    void compilePendingModules();
     /**
      * Execute a kernel.
      *
@@ -518,20 +547,59 @@ public:
      * expense of reduced simulation performance.
      */
     void flushQueue();
+    /**
+     * Set whether to record the time spent executing each kernel.
+     */
+    void setProfilingEnabled(bool enabled);
+    /**
+     * Get the times that have been recorded since profiling was enabled.
+     */
+    void getPerformanceReport(std::map<std::string, double>& report);
 private:
+    /**
+     * This records a kernel launch whose execution time has not yet been retrieved.
+     */
+    struct ProfiledLaunch {
+        CUfunction kernel;
+        int groups;
+        CUevent start, end;
+    };
+    /**
+     * Wait for all kernels that have been timed to complete and record their times.
+     */
+    void processProfiledLaunches();
     /**
      * Compute a sorted list of device indices in decreasing order of desirability
      */
     std::vector<int> getDevicePrecedence();
+    /**
+     * Create the full source code for a module, including all the standard definitions.
+     */
+    std::string createModuleSource(const std::string& source, const std::map<std::string, std::string>& defines, const std::string& options);
+    /**
+     * Get the name of the file in which the PTX for a module is cached.
+     */
+    std::string getCacheFileName(const std::string& src);
+    /**
+     * Compile a module to PTX and try to save it in the cache.  This does not call the CUDA driver API,
+     * so it is safe to call from multiple threads at once as long as each one passes a different index.
+     *
+     * @param src        the full source code of the module
+     * @param options    the options to pass to the compiler
+     * @param cacheFile  the file in which to cache the PTX
+     * @param index      used to select unique names for temporary files
+     */
+    std::string compilePTX(const std::string& src, const std::string& options, const std::string& cacheFile, int index);
     static bool hasInitializedCuda;
     double computeCapability;
     CudaPlatform::PlatformData& platformData;
+    CudaMemoryPool* memoryPool;
     int deviceIndex;
     int contextIndex;
     int numAtomBlocks;
     int numThreadBlocks;
     bool useBlockingSync, useDoublePrecision, useMixedPrecision, contextIsValid, boxIsTriclinic, hasCompilerKernel, isNvccAvailable, hasAssignedPosqCharges;
-    bool isLinkedContext;
+    bool isLinkedContext, useSharedContext;
     std::string compiler, tempDir, cacheDir, gpuArchitecture;
     float4 periodicBoxVecXFloat, periodicBoxVecYFloat, periodicBoxVecZFloat, periodicBoxSizeFloat, invPeriodicBoxSizeFloat;
     double4 periodicBoxVecX, periodicBoxVecY, periodicBoxVecZ, periodicBoxSize, invPeriodicBoxSize;
@@ -539,7 +607,7 @@ private:
     std::map<std::string, std::string> compilationDefines;
     CUcontext context;
     CUdevice device;
-    CUstream currentStream;
+    CUstream currentStream, defaultStream;
     CUfunction clearBufferKernel;
     CUfunction clearTwoBuffersKernel;
     CUfunction clearThreeBuffersKernel;
@@ -567,6 +635,23 @@ private:
     CudaBondedUtilities* bonded;
     CudaNonbondedUtilities* nonbonded;
     Kernel compilerKernel;
+    std::vector<std::shared_ptr<DeferredModule> > pendingModules;
+    std::map<CUfunction, std::string> kernelNames;
+    std::vector<ProfiledLaunch> profiledLaunches;
+    std::vector<CUevent> profilingEvents;
+};
+
+/**
+ * This records a module created by compileProgram().  The source is compiled the first time the module
+ * is needed.
+ */
+class OPENMM_EXPORT_COMMON CudaContext::DeferredModule {
+public:
+    DeferredModule(const std::string& source, const std::string& options) : source(source), options(options), module(NULL), isLoaded(false) {
+    }
+    std::string source, options, error;
+    CUmodule module;
+    bool isLoaded;
 };
 
 /**
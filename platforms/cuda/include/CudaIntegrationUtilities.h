@@ -56,6 +56,10 @@ public:
      * are independent, normally distributed random numbers with mean 0 and variance 1.
      */
     CudaArray& getRandom();
+    /**
+     * Get the array which contains the counter for the counter-based random number generator.
+     */
+    CudaArray& getRandomCounter();
     /**
      * Get the array which contains the current step size.
      */
@@ -64,11 +68,17 @@ public:
      * Distribute forces from virtual sites to the atoms they are based on.
      */
     void distributeForcesFromVirtualSites();
+    /**
+     * Get whether the kernels launched to apply constraints can vary from step to step, which prevents
+     * them from being captured into a CUDA graph.
+     */
+    bool getConstraintsRequireSync() const;
 private:
-    void applyConstraintsImpl(bool constrainVelocities, double tol);
+    void applyConstraintsImpl(bool constrainVelocities, double tol, bool includeSettle);
     int* ccmaConvergedMemory;
     CUdeviceptr ccmaConvergedDeviceMemory;
-    CUevent ccmaEvent;
+    CUevent ccmaEvent[2];
+    bool ccmaResultPending[2];
 };
 
 } // namespace OpenMM
@@ -48,6 +48,15 @@ public:
      * @param name         the name of the kernel function
      */
     CudaKernel(CudaContext& context, CUfunction kernel, const std::string& name);
+    /**
+     * Create a new CudaKernel for a function in a module that may not have been compiled yet.
+     * The function is looked up the first time the kernel is executed.
+     * 
+     * @param context      the context this kernel belongs to
+     * @param module       the module containing the kernel
+     * @param name         the name of the kernel function
+     */
+    CudaKernel(CudaContext& context, std::shared_ptr<CudaContext::DeferredModule> module, const std::string& name);
     /**
      * Get the name of this kernel.
      */
@@ -98,6 +107,7 @@ protected:
     void setPrimitiveArg(int index, const void* value, int size);
 private:
     CudaContext& context;
+    std::shared_ptr<CudaContext::DeferredModule> module;
     CUfunction kernel;
     std::string name;
     std::vector<double4> primitiveArgs;
@@ -34,6 +34,7 @@
 #include "CudaParameterSet.h"
 #include "CudaSort.h"
 #include "openmm/kernels.h"
+#include "openmm/common/CommonKernels.h"
 #include "openmm/System.h"
 #include "openmm/internal/CompiledExpressionSet.h"
 #include "openmm/internal/CustomIntegratorUtilities.h"
@@ -114,8 +115,10 @@ private:
  */
 class CudaUpdateStateDataKernel : public UpdateStateDataKernel {
 public:
-    CudaUpdateStateDataKernel(std::string name, const Platform& platform, CudaContext& cu) : UpdateStateDataKernel(name, platform), cu(cu) {
+    CudaUpdateStateDataKernel(std::string name, const Platform& platform, CudaContext& cu) : UpdateStateDataKernel(name, platform), cu(cu),
+            copyMemory(NULL), copyPending(false) {
     }
+    ~CudaUpdateStateDataKernel();
     /**
      * Initialize the kernel.
      *
@@ -152,12 +155,39 @@ public:
      * @param velocities  on exit, this contains the particle velocities
      */
     void getVelocities(ContextImpl& context, std::vector<Vec3>& velocities);
+    /**
+     * Get the positions of all particles in single precision.
+     *
+     * @param positions  on exit, this contains the x, y, and z coordinates of each particle in turn
+     */
+    void getPositionsFloat(ContextImpl& context, std::vector<float>& positions);
+    /**
+     * Get the velocities of all particles in single precision.
+     *
+     * @param velocities  on exit, this contains the x, y, and z components of each particle's velocity in turn
+     */
+    void getVelocitiesFloat(ContextImpl& context, std::vector<float>& velocities);
     /**
      * Set the velocities of all particles.
      *
      * @param velocities  a vector containg the particle velocities
      */
     void setVelocities(ContextImpl& context, const std::vector<Vec3>& velocities);
+    /**
+     * Begin copying the positions and/or velocities of all particles so they can be retrieved later
+     * by finishStateCopy().
+     *
+     * @param positions   whether to copy the positions
+     * @param velocities  whether to copy the velocities
+     */
+    void beginStateCopy(ContextImpl& context, bool positions, bool velocities);
+    /**
+     * Wait for the copy started by beginStateCopy() to complete and retrieve the data.
+     *
+     * @param positions   on exit, this contains the particle positions, or is empty if they were not copied
+     * @param velocities  on exit, this contains the particle velocities, or is empty if they were not copied
+     */
+    void finishStateCopy(ContextImpl& context, std::vector<Vec3>& positions, std::vector<Vec3>& velocities);
     /**
      * Get the current forces on all particles.
      *
@@ -198,6 +228,58 @@ public:
      * @param stream    an input stream the checkpoint data should be read from
      */
     void loadCheckpoint(ContextImpl& context, std::istream& stream);
+private:
+    CudaContext& cu;
+    void* copyMemory;
+    CUevent copyEvent;
+    bool copyPending, copyPositions, copyVelocities;
+    std::vector<int> copyAtomOrder;
+    std::vector<mm_int4> copyCellOffsets;
+    Vec3 copyBoxVectors[3];
+};
+
+/**
+ * This kernel records the time spent executing kernels and other statistics about the performance of a Context.
+ */
+class CudaProfileKernel : public ProfileKernel {
+public:
+    CudaProfileKernel(std::string name, const Platform& platform, CudaContext& cu) : ProfileKernel(name, platform), cu(cu) {
+    }
+    /**
+     * Initialize the kernel.
+     *
+     * @param system     the System this kernel will be applied to
+     */
+    void initialize(const System& system);
+    /**
+     * Set whether to record the time spent executing each kernel.
+     *
+     * @param context    the context in which to execute this kernel
+     * @param enabled    whether profiling should be enabled
+     */
+    void setProfilingEnabled(ContextImpl& context, bool enabled);
+    /**
+     * Set which force groups subsequently launched kernels should be attributed to while profiling.
+     *
+     * @param context    the context in which to execute this kernel
+     * @param groups     a set of bit flags for the force groups being computed
+     */
+    void setProfiledForceGroups(ContextImpl& context, int groups);
+    /**
+     * Set the owner that device memory allocated from now on should be attributed to.
+     *
+     * @param context    the context in which to execute this kernel
+     * @param owner      the owner to attribute memory to
+     */
+    void setMemoryOwner(ContextImpl& context, const std::string& owner);
+    /**
+     * Get the times that have been recorded since profiling was enabled.
+     *
+     * @param context    the context in which to execute this kernel
+     * @param report     on exit, this maps each kernel and force group to the total time spent on it in milliseconds,
+     *                   and also contains statistics about the neighbor list and the device memory in use
+     */
+    void getPerformanceReport(ContextImpl& context, std::map<std::string, double>& report);
 private:
     CudaContext& cu;
 };
@@ -265,7 +347,7 @@ private:
 class CudaCalcNonbondedForceKernel : public CalcNonbondedForceKernel {
 public:
     CudaCalcNonbondedForceKernel(std::string name, const Platform& platform, CudaContext& cu, const System& system) : CalcNonbondedForceKernel(name, platform),
-            cu(cu), hasInitializedFFT(false), sort(NULL), dispersionFft(NULL), fft(NULL), pmeio(NULL), usePmeStream(false) {
+            cu(cu), hasInitializedFFT(false), sort(NULL), dispersionFft(NULL), fft(NULL), pmeio(NULL), usePmeStream(false), useBrickSpreading(false) {
     }
     ~CudaCalcNonbondedForceKernel();
     /**
@@ -293,6 +375,18 @@ public:
      * @param force      the NonbondedForce to copy the parameters from
      */
     void copyParametersToContext(ContextImpl& context, const NonbondedForce& force);
+    /**
+     * Copy changed parameters over to a context, when only a range of particles and exceptions
+     * may have changed.
+     *
+     * @param context         the context to copy parameters to
+     * @param force           the NonbondedForce to copy the parameters from
+     * @param firstParticle   the index of the first particle whose parameters might have changed
+     * @param lastParticle    the index of the last particle whose parameters might have changed
+     * @param firstException  the index of the first exception whose parameters might have changed
+     * @param lastException   the index of the last exception whose parameters might have changed
+     */
+    void copyParameterRangeToContext(ContextImpl& context, const NonbondedForce& force, int firstParticle, int lastParticle, int firstException, int lastException);
     /**
      * Get the parameters being used for PME.
      * 
@@ -381,15 +475,17 @@ private:
     CUfunction pmeInterpolateForceKernel;
     CUfunction pmeInterpolateDispersionForceKernel;
     std::vector<std::pair<int, int> > exceptionAtoms;
+    std::map<int, int> exceptionIndex;
+    std::vector<float4> hostParticleParams;
     std::vector<std::string> paramNames;
     std::vector<double> paramValues;
     double ewaldSelfEnergy, dispersionCoefficient, alpha, dispersionAlpha;
     int interpolateForceThreads;
-    int gridSizeX, gridSizeY, gridSizeZ;
+    int gridSizeX, gridSizeY, gridSizeZ, pmeOrder;
     int dispersionGridSizeX, dispersionGridSizeY, dispersionGridSizeZ;
-    bool hasCoulomb, hasLJ, usePmeStream, useCudaFFT, doLJPME, usePosqCharges, recomputeParams, hasOffsets;
+    bool hasCoulomb, hasLJ, usePmeStream, useCudaFFT, doLJPME, usePosqCharges, recomputeParams, hasOffsets, useBrickSpreading;
     NonbondedMethod nonbondedMethod;
-    static const int PmeOrder = 5;
+    static const int PmeBrickSize = 8;
 };
 
 /**
@@ -408,6 +504,14 @@ public:
      * @param innerContext   the context created by the CustomCVForce for computing collective variables
      */
     void initialize(const System& system, const CustomCVForce& force, ContextImpl& innerContext);
+    /**
+     * Initialize the kernel for a force whose collective variables are evaluated directly in the
+     * context it belongs to, rather than in an inner context.
+     *
+     * @param system     the System this kernel will be applied to
+     * @param force      the CustomCVForce this kernel will be used for
+     */
+    void initialize(const System& system, const CustomCVForce& force);
     /**
      * Execute the kernel to calculate the forces and/or energy.
      *
@@ -418,6 +522,26 @@ public:
      * @return the potential energy due to the force
      */
     double execute(ContextImpl& context, ContextImpl& innerContext, bool includeForces, bool includeEnergy);
+    /**
+     * Execute the kernel to calculate the forces and/or energy, given collective variables that were
+     * evaluated directly in the context.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param values         the values of the collective variables
+     * @param paramDerivs    the derivatives of each collective variable with respect to global parameters
+     * @param includeForces  true if forces should be calculated
+     * @param includeEnergy  true if the energy should be calculated
+     * @return the potential energy due to the force
+     */
+    double execute(ContextImpl& context, const std::vector<double>& values, const std::vector<std::map<std::string, double> >& paramDerivs, bool includeForces, bool includeEnergy);
+    /**
+     * Save the forces currently stored in the context as the forces for one collective variable.  This
+     * is called just after the variable's force group has been evaluated on its own.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param index          the index of the collective variable
+     */
+    void copyVariableForces(ContextImpl& context, int index);
     /**
      * Copy state information to the inner context.
      *
@@ -447,6 +571,35 @@ private:
     CUfunction copyStateKernel, copyForcesKernel, addForcesKernel;
 };
 
+/**
+ * This kernel is invoked by LangevinMiddleIntegrator to take one time step.  It extends the common
+ * implementation by optionally capturing the kernels for a step into CUDA graphs, which are then
+ * replayed on later steps to reduce launch overhead.
+ */
+class CudaIntegrateLangevinMiddleStepKernel : public CommonIntegrateLangevinMiddleStepKernel {
+public:
+    CudaIntegrateLangevinMiddleStepKernel(std::string name, const Platform& platform, CudaContext& cu) : CommonIntegrateLangevinMiddleStepKernel(name, platform, cu), cu(cu),
+            hasExecutedStep(false), graphTolerance(0.0) {
+#if CUDA_VERSION >= 10010
+        graph = NULL;
+#endif
+    }
+    ~CudaIntegrateLangevinMiddleStepKernel();
+protected:
+    /**
+     * Launch the sequence of kernels for one time step, replaying a captured graph if possible.
+     */
+    void integrate(double tolerance);
+private:
+    void clearGraphs();
+    CudaContext& cu;
+    bool hasExecutedStep;
+    double graphTolerance;
+#if CUDA_VERSION >= 10010
+    CUgraphExec graph;
+#endif
+};
+
 /**
  * This kernel is invoked by MonteCarloBarostat to adjust the periodic box volume
  */
@@ -494,6 +647,20 @@ private:
     std::vector<int> lastAtomOrder;
 };
 
+/**
+ * This kernel is invoked by ReplicaExchange to exchange the positions and velocities of two contexts.
+ * The exchange is done on the device when both contexts use the same CUDA context.
+ */
+class CudaSwapStateKernel : public CommonSwapStateKernel {
+public:
+    CudaSwapStateKernel(std::string name, const Platform& platform, CudaContext& cu) : CommonSwapStateKernel(name, platform, cu), cu(cu) {
+    }
+protected:
+    ComputeContext* getComputeContext(ContextImpl& other);
+private:
+    CudaContext& cu;
+};
+
 } // namespace OpenMM
 
 #endif /*OPENMM_CUDAKERNELS_H_*/
@@ -0,0 +1,136 @@
+#ifndef OPENMM_CUDAMEMORYPOOL_H_
+#define OPENMM_CUDAMEMORYPOOL_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2024 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * This program is free software: you can redistribute it and/or modify       *
+ * it under the terms of the GNU Lesser General Public License as published   *
+ * by the Free Software Foundation, either version 3 of the License, or       *
+ * (at your option) any later version.                                        *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU Lesser General Public License for more details.                        *
+ *                                                                            *
+ * You should have received a copy of the GNU Lesser General Public License   *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.      *
+ * -------------------------------------------------------------------------- */
+
+#include <cuda.h>
+#include <pthread.h>
+#include <map>
+#include <vector>
+#include "openmm/common/windowsExportCommon.h"
+
+namespace OpenMM {
+
+/**
+ * This class caches device memory so it can be reused by CudaArrays without calling cuMemAlloc()
+ * and cuMemFree() every time one is created, resized, or deleted.  A single pool is shared by all
+ * CudaContexts that use the same CUcontext.
+ *
+ * Allocations are rounded up to a set of size classes (powers of two and three intermediate steps
+ * between them), and freed blocks are kept in a separate list for each class.  When a block is freed,
+ * an event is recorded on the stream that was current at the time.  It can be reused immediately by
+ * another allocation on the same stream, since any work using it will already have been queued ahead
+ * of the new work.  Allocations on other streams can reuse it once the event has completed.
+ *
+ * If cuMemAlloc() runs out of memory, all cached blocks are released and the allocation is retried.
+ */
+
+class OPENMM_EXPORT_COMMON CudaMemoryPool {
+public:
+    /**
+     * Information about the memory managed by a pool.
+     */
+    struct Statistics {
+        /**
+         * The number of bytes currently allocated to arrays (rounded up to the size class).
+         */
+        size_t bytesInUse;
+        /**
+         * The number of bytes held in the cache waiting to be reused.
+         */
+        size_t bytesCached;
+        /**
+         * The largest value bytesInUse has reached.
+         */
+        size_t peakBytesInUse;
+        /**
+         * The number of times device memory has been allocated with cuMemAlloc().
+         */
+        long long numDeviceAllocations;
+        /**
+         * The number of allocations that were satisfied from the cache.
+         */
+        long long numReusedAllocations;
+    };
+    /**
+     * Get the pool for a CUcontext, creating it if necessary.  Every call to this must be balanced by
+     * a call to release().
+     */
+    static CudaMemoryPool* acquire(CUcontext context);
+    /**
+     * Indicate that a pool returned by acquire() is no longer needed.  When the last reference is
+     * released, all cached memory is freed.  The CUcontext must still be valid and current.
+     */
+    static void release(CudaMemoryPool* pool);
+    /**
+     * Allocate a block of device memory.
+     *
+     * @param pointer   on exit, the address of the block
+     * @param size      the number of bytes required
+     * @param stream    the stream the memory will be used on
+     * @return the result of the allocation
+     */
+    CUresult allocate(CUdeviceptr& pointer, size_t size, CUstream stream);
+    /**
+     * Return a block of memory to the pool.
+     *
+     * @param pointer   the address of the block, as returned by allocate()
+     * @param size      the size that was passed to allocate()
+     * @param stream    the stream on which the memory was last used
+     * @return the result of recording the event that guards reuse of the block
+     */
+    CUresult free(CUdeviceptr pointer, size_t size, CUstream stream);
+    /**
+     * Free all cached memory that is not currently in use.
+     */
+    void releaseCachedMemory();
+    /**
+     * Get statistics about the memory managed by this pool.
+     */
+    Statistics getStatistics();
+private:
+    struct Block {
+        CUdeviceptr pointer;
+        CUstream stream;
+        CUevent event;
+    };
+    CudaMemoryPool(CUcontext context);
+    ~CudaMemoryPool();
+    static size_t getSizeClass(size_t size);
+    void releaseCachedMemoryLocked();
+    static pthread_mutex_t poolsLock;
+    static std::map<CUcontext, CudaMemoryPool*> pools;
+    CUcontext context;
+    int referenceCount;
+    pthread_mutex_t lock;
+    std::map<size_t, std::vector<Block> > cache;
+    Statistics stats;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_CUDAMEMORYPOOL_H_*/
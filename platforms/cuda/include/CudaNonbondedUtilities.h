@@ -76,7 +76,8 @@ public:
      *
      * @param usesCutoff       specifies whether a cutoff should be applied to this interaction
      * @param usesPeriodic     specifies whether periodic boundary conditions should be applied to this interaction
-     * @param usesExclusions   specifies whether this interaction uses exclusions.  If this is true, it must have identical exclusions to every other interaction.
+     * @param usesExclusions   specifies whether this interaction uses exclusions.  Interactions with different exclusions can share the
+     *                         default kernel, but if kernel is empty the exclusions must be identical to the first ones that were requested.
      * @param cutoffDistance   the cutoff distance for this interaction (ignored if usesCutoff is false)
      * @param exclusionList    for each atom, specifies the list of other atoms whose interactions should be excluded
      * @param kernel           the code to evaluate the interaction
@@ -88,7 +89,8 @@ public:
      *
      * @param usesCutoff       specifies whether a cutoff should be applied to this interaction
      * @param usesPeriodic     specifies whether periodic boundary conditions should be applied to this interaction
-     * @param usesExclusions   specifies whether this interaction uses exclusions.  If this is true, it must have identical exclusions to every other interaction.
+     * @param usesExclusions   specifies whether this interaction uses exclusions.  Interactions with different exclusions can share the
+     *                         default kernel, but if kernel is empty the exclusions must be identical to the first ones that were requested.
      * @param cutoffDistance   the cutoff distance for this interaction (ignored if usesCutoff is false)
      * @param exclusionList    for each atom, specifies the list of other atoms whose interactions should be excluded
      * @param kernel           the code to evaluate the interaction
@@ -108,6 +110,9 @@ public:
     void addParameter(const ParameterInfo& parameter);
     /**
      * Add an array (other than a per-atom parameter) that should be passed as an argument to the default interaction kernel.
+     * If the array is constant and small enough (for example, the coefficients of most tabulated functions), the kernel
+     * copies it into shared memory before computing interactions, so the code you pass to addInteraction() can index it
+     * repeatedly without going to global memory.
      */
     void addArgument(ComputeParameterInfo parameter);
     /**
@@ -126,11 +131,13 @@ public:
      */
     std::string addEnergyParameterDerivative(const std::string& param);
     /**
-     * Specify the list of exclusions that an interaction outside the default kernel will depend on.
+     * Specify the list of exclusions that an interaction will depend on.  Each distinct list is stored as a separate
+     * exclusion set, with its own flags for every tile that contains exclusions.
      * 
      * @param exclusionList  for each atom, specifies the list of other atoms whose interactions should be excluded
+     * @return the index of the exclusion set holding this list
      */
-    void requestExclusions(const std::vector<std::vector<int> >& exclusionList);
+    int requestExclusions(const std::vector<std::vector<int> >& exclusionList);
     /**
      * Initialize this object in preparation for a simulation.
      */
@@ -194,10 +201,19 @@ public:
     void computeInteractions(int forceGroups, bool includeForces, bool includeEnergy);
     /**
      * Check to see if the neighbor list arrays are large enough, and make them bigger if necessary.
+     * They are also enlarged when they are nearly full, so they can usually grow before they overflow.
      *
-     * @return true if the neighbor list needed to be enlarged.
+     * @return true if the neighbor list overflowed, so the forces must be recomputed.
      */
     bool updateNeighborListSize();
+    /**
+     * Wait for the size of the most recently built neighbor list to become available, and enlarge
+     * the neighbor list if it was too small.  computeInteractions() does not wait for this itself, so
+     * the rest of the force computation can be queued first.  Call this once all of it has been queued.
+     *
+     * @return true if the neighbor list needed to be enlarged.
+     */
+    bool checkNeighborListSize();
     /**
      * Get the array containing the center of each atom block.
      */
@@ -212,30 +228,41 @@ public:
     }
     /**
      * Get the array whose first element contains the number of tiles with interactions.
+     * When the neighbor list is pruned, this and the other neighbor list arrays refer
+     * to the pruned list.
      */
     CudaArray& getInteractionCount() {
-        return interactionCount;
+        return (usePruning ? prunedInteractionCount : interactionCount);
     }
     /**
      * Get the array containing tiles with interactions.
      */
     CudaArray& getInteractingTiles() {
-        return interactingTiles;
+        return (usePruning ? prunedTiles : interactingTiles);
     }
     /**
-     * Get the array containing the atoms in each tile with interactions.
+     * Get the array containing the atoms in each tile with interactions.  Each element holds the TileSize atom
+     * indices for one tile, so kernels that index it as a flat array of ints should compute the offset in 64 bits.
      */
     CudaArray& getInteractingAtoms() {
-        return interactingAtoms;
+        return (usePruning ? prunedAtoms : interactingAtoms);
+    }
+    /**
+     * Get whether the neighbor list stores some interactions as a separate list of single atom pairs.
+     */
+    bool getUsePairList() {
+        return useCutoff && canUsePairList;
     }
     /**
      * Get the array containing single pairs in the neighbor list.
      */
     CudaArray& getSinglePairs() {
-        return singlePairs;
+        return (usePruning ? prunedSinglePairs : singlePairs);
     }
     /**
-     * Get the array containing exclusion flags.
+     * Get the array containing exclusion flags.  It begins with the flags for set 0 (the first exclusions that
+     * were requested), TileSize elements for each tile with exclusions.  Those are followed by any blocks of flags
+     * for other sets that do not duplicate an existing block.
      */
     CudaArray& getExclusions() {
         return exclusions;
@@ -246,6 +273,13 @@ public:
     CudaArray& getExclusionTiles() {
         return exclusionTiles;
     }
+    /**
+     * Get the array that identifies the block of exclusion flags to use for each tile in exclusion sets other
+     * than set 0.  Element (set-1)*numExclusionTiles+tile is the index of the block within the exclusion array.
+     */
+    CudaArray& getExclusionSetTiles() {
+        return exclusionSetTiles;
+    }
     /**
      * Get the array containing the index into the exclusion array for each tile.
      */
@@ -265,6 +299,10 @@ public:
     CudaArray& getRebuildNeighborList() {
         return rebuildNeighborList;
     }
+    /**
+     * Add statistics describing the neighbor list to a map, with keys of the form "neighborList:<name>".
+     */
+    void getNeighborListStatistics(std::map<std::string, double>& statistics);
     /**
      * Get the index of the first tile this context is responsible for processing.
      */
@@ -283,6 +321,10 @@ public:
      * but also means we don't need to rebuild it every time step.  The default value is true,
      * since usually this improves performance.  For very expensive interactions, however,
      * it may be better to set this to false.
+     *
+     * When padding is used, the neighbor list is built with a large padding so that it rarely
+     * needs to be rebuilt, and a cheaper kernel prunes it to a list with a much smaller padding
+     * every few steps.  The pruned list is what interactions are computed from.
      */
     void setUsePadding(bool padding);
     /**
@@ -322,6 +364,7 @@ private:
     std::map<int, KernelSet> groupKernels;
     CudaArray exclusionTiles;
     CudaArray exclusions;
+    CudaArray exclusionSetTiles;
     CudaArray exclusionIndices;
     CudaArray exclusionRowIndices;
     CudaArray interactingTiles;
@@ -335,21 +378,30 @@ private:
     CudaArray sortedBlockCenter;
     CudaArray sortedBlockBoundingBox;
     CudaArray oldPositions;
+    CudaArray oldBoxSize;
     CudaArray rebuildNeighborList;
+    CudaArray prunedTiles;
+    CudaArray prunedAtoms;
+    CudaArray prunedInteractionCount;
+    CudaArray prunedSinglePairs;
+    CudaArray prunePositions;
+    CudaArray pruneNeighborList;
     CudaSort* blockSorter;
     CUevent downloadCountEvent;
-    int* pinnedCountBuffer;
-    std::vector<void*> forceArgs, findBlockBoundsArgs, sortBoxDataArgs, findInteractingBlocksArgs;
-    std::vector<std::vector<int> > atomExclusions;
+    unsigned int* pinnedCountBuffer;
+    std::vector<void*> forceArgs, findBlockBoundsArgs, sortBoxDataArgs, findInteractingBlocksArgs, pruneInteractionsArgs;
+    std::vector<std::vector<std::vector<int> > > exclusionSets;
     std::vector<ParameterInfo> parameters;
     std::vector<ParameterInfo> arguments;
+    std::vector<int> argumentLengths;
     std::vector<std::string> energyParameterDerivatives;
     std::map<int, double> groupCutoff;
     std::map<int, std::string> groupKernelSource;
     double lastCutoff;
-    bool useCutoff, usePeriodic, anyExclusions, usePadding, forceRebuildNeighborList, canUsePairList;
-    int startTileIndex, startBlockIndex, numBlocks, maxTiles, maxSinglePairs, maxExclusions, numForceThreadBlocks, forceThreadBlockSize, numAtoms, groupFlags;
-    long long numTiles;
+    bool useCutoff, usePeriodic, usePadding, usePruning, forceRebuildNeighborList, canUsePairList, hasPendingCount;
+    int startTileIndex, startBlockIndex, numBlocks, maxTiles, maxSinglePairs, maxExclusions, numExclusionSets, numForceThreadBlocks, forceThreadBlockSize, numAtoms, groupFlags;
+    long long numTiles, numNeighborListEvaluations, numNeighborListBuilds;
+    int numNeighborListReallocations;
     std::string kernelSource;
 };
 
@@ -367,6 +419,7 @@ public:
     CUfunction sortBoxDataKernel;
     CUfunction findInteractingBlocksKernel;
     CUfunction findInteractionsWithinBlocksKernel;
+    CUfunction pruneInteractionsKernel;
 };
 
 /**
@@ -80,17 +80,21 @@ public:
 private:
     class BeginComputationTask;
     class FinishComputationTask;
+    void setAtomBlockRanges();
+    void reduceForcesOnDevices();
     CudaPlatform::PlatformData& data;
     std::vector<Kernel> kernels;
     std::vector<long long> completionTimes;
     std::vector<double> contextNonbondedFractions;
     int2* interactionCounts;
     CudaArray contextForces;
+    std::vector<CudaArray*> peerForces;
     void* pinnedPositionBuffer;
     long long* pinnedForceBuffer;
-    CUfunction sumKernel;
+    std::vector<CUfunction> sumKernels;
     CUevent event;
     CUstream peerCopyStream;
+    std::vector<CUevent> forceEvents;
 };
 
 /**
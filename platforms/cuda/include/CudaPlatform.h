@@ -125,20 +125,62 @@ public:
         static const std::string key = "DeterministicForces";
         return key;
     }
+    /**
+     * This is the name of the parameter for selecting whether to share the device's primary CUDA context
+     * with other Contexts, so that kernels from independent simulations on the same GPU can run concurrently.
+     */
+    static const std::string& CudaUseSharedContext() {
+        static const std::string key = "UseSharedContext";
+        return key;
+    }
+    /**
+     * This is the name of the parameter for selecting whether to capture the kernels of each time step
+     * into CUDA graphs and replay them, reducing the cost of launching kernels.
+     */
+    static const std::string& CudaUseCudaGraphs() {
+        static const std::string key = "UseCudaGraphs";
+        return key;
+    }
+    /**
+     * This is the name of the parameter for selecting whether to benchmark several PME grid sizes when
+     * a Context is created, and use whichever one is fastest.
+     */
+    static const std::string& CudaTunePme() {
+        static const std::string key = "TunePme";
+        return key;
+    }
+    /**
+     * This is the name of the parameter for selecting whether to compile the values of global parameters
+     * into kernels as constants, recompiling them whenever a value changes.
+     */
+    static const std::string& CudaSpecializeGlobalParameters() {
+        static const std::string key = "SpecializeGlobalParameters";
+        return key;
+    }
+    /**
+     * This is the name of the parameter for selecting the algorithm used for constraints that are not
+     * handled by SETTLE or SHAKE.  Allowed values are "CCMA" and "LINCS".
+     */
+    static const std::string& CudaConstraintAlgorithm() {
+        static const std::string key = "ConstraintAlgorithm";
+        return key;
+    }
 };
 
 class OPENMM_EXPORT_COMMON CudaPlatform::PlatformData {
 public:
     PlatformData(ContextImpl* context, const System& system, const std::string& deviceIndexProperty, const std::string& blockingProperty, const std::string& precisionProperty,
             const std::string& cpuPmeProperty, const std::string& compilerProperty, const std::string& tempProperty, const std::string& hostCompilerProperty,
-            const std::string& pmeStreamProperty, const std::string& deterministicForcesProperty, int numThreads, ContextImpl* originalContext);
+            const std::string& pmeStreamProperty, const std::string& deterministicForcesProperty, const std::string& sharedContextProperty,
+            const std::string& cudaGraphsProperty, const std::string& tunePmeProperty, const std::string& specializeGlobalsProperty, const std::string& constraintAlgorithmProperty,
+            int numThreads, ContextImpl* originalContext);
     ~PlatformData();
     void initializeContexts(const System& system);
     void syncContexts();
     ContextImpl* context;
     std::vector<CudaContext*> contexts;
     std::vector<double> contextEnergy;
-    bool hasInitializedContexts, removeCM, peerAccessSupported, useCpuPme, disablePmeStream, deterministicForces;
+    bool hasInitializedContexts, removeCM, peerAccessSupported, useCpuPme, disablePmeStream, deterministicForces, useSharedContext, useCudaGraphs, tunePme, specializeGlobalParameters, useLincs;
     int cmMotionFrequency;
     int stepCount, computeForceCount;
     double time;
@@ -42,9 +42,9 @@ public:
      * Create a new CudaProgram.
      * 
      * @param context      the context this kernel belongs to
-     * @param module       the compiled module
+     * @param module       the module, which may not have been compiled yet
      */
-    CudaProgram(CudaContext& context, CUmodule module);
+    CudaProgram(CudaContext& context, std::shared_ptr<CudaContext::DeferredModule> module);
     /**
      * Create a ComputeKernel for one of the kernels in this program.
      * 
@@ -53,7 +53,7 @@ public:
     ComputeKernel createKernel(const std::string& name);
 private:
     CudaContext& context;
-    CUmodule module;
+    std::shared_ptr<CudaContext::DeferredModule> module;
 };
 
 } // namespace OpenMM
@@ -88,12 +88,13 @@ private:
     CudaContext& context;
     SortTrait* trait;
     CudaArray dataRange;
+    CudaArray blockRange;
     CudaArray bucketOfElement;
     CudaArray offsetInBucket;
     CudaArray bucketOffset;
     CudaArray buckets;
-    CUfunction shortListKernel, shortList2Kernel, computeRangeKernel, assignElementsKernel, computeBucketPositionsKernel, copyToBucketsKernel, sortBucketsKernel;
-    unsigned int dataLength, rangeKernelSize, positionsKernelSize, sortKernelSize;
+    CUfunction shortListKernel, shortList2Kernel, computeBlockRangeKernel, computeRangeKernel, assignElementsKernel, computeBucketPositionsKernel, copyToBucketsKernel, sortBucketsKernel;
+    unsigned int dataLength, rangeKernelSize, numRangeBlocks, positionsKernelSize, sortKernelSize;
     bool isShortList;
 };
 
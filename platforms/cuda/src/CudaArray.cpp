@@ -26,23 +26,85 @@
 
 #include "CudaArray.h"
 #include "CudaContext.h"
+#include <cstring>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <sstream>
 #include <vector>
 
 using namespace OpenMM;
 
-CudaArray::CudaArray() : pointer(0), ownsMemory(false) {
+namespace {
+
+/**
+ * A block of device memory whose contents are shared by all CudaArrays on a CUDA context that
+ * were uploaded with identical data.  A copy of the contents is kept on the host so matches can
+ * be verified without reading back from the device.
+ */
+struct SharedBlock {
+    CUcontext context;
+    CUdeviceptr pointer;
+    unsigned long long hash;
+    std::vector<char> contents;
+    int refCount;
+};
+
+std::mutex sharedBlockLock;
+std::multimap<unsigned long long, SharedBlock*> blocksByHash;
+std::map<CUdeviceptr, SharedBlock*> blocksByPointer;
+
+unsigned long long hashContents(const char* data, size_t bytes) {
+    unsigned long long hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < bytes; i++) {
+        hash ^= (unsigned char) data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * Release one reference to a shared block.  The caller must hold sharedBlockLock.
+ */
+CUresult releaseSharedBlock(CUdeviceptr pointer, bool contextIsValid) {
+    auto entry = blocksByPointer.find(pointer);
+    if (entry == blocksByPointer.end())
+        return CUDA_SUCCESS;
+    SharedBlock* block = entry->second;
+    if (--block->refCount > 0)
+        return CUDA_SUCCESS;
+    blocksByPointer.erase(entry);
+    auto range = blocksByHash.equal_range(block->hash);
+    for (auto iter = range.first; iter != range.second; ++iter)
+        if (iter->second == block) {
+            blocksByHash.erase(iter);
+            break;
+        }
+    CUresult result = (contextIsValid ? cuMemFree(block->pointer) : CUDA_SUCCESS);
+    delete block;
+    return result;
+}
+
 }
 
-CudaArray::CudaArray(CudaContext& context, int size, int elementSize, const std::string& name) : pointer(0) {
+CudaArray::CudaArray() : pointer(0), ownsMemory(false), shared(false) {
+}
+
+CudaArray::CudaArray(CudaContext& context, int size, int elementSize, const std::string& name) : pointer(0), shared(false) {
     initialize(context, size, elementSize, name);
 }
 
 CudaArray::~CudaArray() {
-    if (pointer != 0 && ownsMemory && context->getContextIsValid()) {
+    if (pointer != 0 && ownsMemory)
+        context->recordArrayRelease(this);
+    if (pointer != 0 && ownsMemory && context->getContextIsValid())
         context->setAsCurrent();
-        CUresult result = cuMemFree(pointer);
+    if (pointer != 0 && shared) {
+        std::lock_guard<std::mutex> lock(sharedBlockLock);
+        releaseSharedBlock(pointer, context->getContextIsValid());
+    }
+    else if (pointer != 0 && ownsMemory && context->getContextIsValid()) {
+        CUresult result = freeMemory();
         if (result != CUDA_SUCCESS) {
             std::stringstream str;
             str<<"Error deleting array "<<name<<": "<<CudaContext::getErrorString(result)<<" ("<<result<<")";
@@ -59,12 +121,18 @@ void CudaArray::initialize(ComputeContext& context, int size, int elementSize, c
     this->elementSize = elementSize;
     this->name = name;
     ownsMemory = true;
-    CUresult result = cuMemAlloc(&pointer, size*elementSize);
+    CudaMemoryPool* pool = this->context->getMemoryPool();
+    CUresult result;
+    if (pool == NULL)
+        result = cuMemAlloc(&pointer, (size_t) size*elementSize);
+    else
+        result = pool->allocate(pointer, (size_t) size*elementSize, this->context->getCurrentStream());
     if (result != CUDA_SUCCESS) {
         std::stringstream str;
         str<<"Error creating array "<<name<<": "<<CudaContext::getErrorString(result)<<" ("<<result<<")";
         throw OpenMMException(str.str());
     }
+    this->context->recordArrayAllocation(this, name, (long long) size*elementSize);
 }
 
 void CudaArray::resize(int size) {
@@ -72,14 +140,61 @@ void CudaArray::resize(int size) {
         throw OpenMMException("CudaArray has not been initialized");
     if (!ownsMemory)
         throw OpenMMException("Cannot resize an array that does not own its storage");
-    CUresult result = cuMemFree(pointer);
+    releaseMemory();
+    initialize(*context, size, elementSize, name);
+}
+
+void CudaArray::releaseMemory() {
+    CUresult result;
+    if (shared) {
+        std::lock_guard<std::mutex> lock(sharedBlockLock);
+        result = releaseSharedBlock(pointer, true);
+        shared = false;
+    }
+    else {
+        context->recordArrayRelease(this);
+        result = freeMemory();
+    }
     if (result != CUDA_SUCCESS) {
         std::stringstream str;
         str<<"Error deleting array "<<name<<": "<<CudaContext::getErrorString(result)<<" ("<<result<<")";
         throw OpenMMException(str.str());
     }
     pointer = 0;
-    initialize(*context, size, elementSize, name);
+}
+
+void CudaArray::makePrivate(bool preserveContents) {
+    if (!shared)
+        return;
+    size_t bytes = (size_t) size*elementSize;
+    CUdeviceptr privatePointer;
+    CudaMemoryPool* pool = context->getMemoryPool();
+    CUresult result;
+    if (pool == NULL)
+        result = cuMemAlloc(&privatePointer, bytes);
+    else
+        result = pool->allocate(privatePointer, bytes, context->getCurrentStream());
+    if (result == CUDA_SUCCESS && preserveContents)
+        result = cuMemcpyDtoD(privatePointer, pointer, bytes);
+    if (result != CUDA_SUCCESS) {
+        std::stringstream str;
+        str<<"Error copying shared array "<<name<<": "<<CudaContext::getErrorString(result)<<" ("<<result<<")";
+        throw OpenMMException(str.str());
+    }
+    {
+        std::lock_guard<std::mutex> lock(sharedBlockLock);
+        releaseSharedBlock(pointer, true);
+    }
+    pointer = privatePointer;
+    shared = false;
+    context->recordArrayAllocation(this, name, (long long) bytes);
+}
+
+CUresult CudaArray::freeMemory() {
+    CudaMemoryPool* pool = context->getMemoryPool();
+    if (pool == NULL)
+        return cuMemFree(pointer);
+    return pool->free(pointer, (size_t) size*elementSize, context->getCurrentStream());
 }
 
 ComputeContext& CudaArray::getContext() {
@@ -89,11 +204,32 @@ ComputeContext& CudaArray::getContext() {
 void CudaArray::upload(const void* data, bool blocking) {
     if (pointer == 0)
         throw OpenMMException("CudaArray has not been initialized");
+    makePrivate(false);
     CUresult result;
     if (blocking)
-        result = cuMemcpyHtoD(pointer, data, size*elementSize);
+        result = cuMemcpyHtoD(pointer, data, (size_t) size*elementSize);
     else
-        result = cuMemcpyHtoDAsync(pointer, data, size*elementSize, context->getCurrentStream());
+        result = cuMemcpyHtoDAsync(pointer, data, (size_t) size*elementSize, context->getCurrentStream());
+    if (result != CUDA_SUCCESS) {
+        std::stringstream str;
+        str<<"Error uploading array "<<name<<": "<<CudaContext::getErrorString(result)<<" ("<<result<<")";
+        throw OpenMMException(str.str());
+    }
+}
+
+void CudaArray::uploadSubArray(const void* data, int offset, int elements, bool blocking) {
+    if (pointer == 0)
+        throw OpenMMException("CudaArray has not been initialized");
+    if (offset < 0 || elements < 0 || offset+elements > size)
+        throw OpenMMException("Error uploading array "+name+": The specified range exceeds the size of the array");
+    if (elements == 0)
+        return;
+    makePrivate(elements < size);
+    CUresult result;
+    if (blocking)
+        result = cuMemcpyHtoD(pointer+(size_t) offset*elementSize, data, (size_t) elements*elementSize);
+    else
+        result = cuMemcpyHtoDAsync(pointer+(size_t) offset*elementSize, data, (size_t) elements*elementSize, context->getCurrentStream());
     if (result != CUDA_SUCCESS) {
         std::stringstream str;
         str<<"Error uploading array "<<name<<": "<<CudaContext::getErrorString(result)<<" ("<<result<<")";
@@ -106,9 +242,9 @@ void CudaArray::download(void* data, bool blocking) const {
         throw OpenMMException("CudaArray has not been initialized");
     CUresult result;
     if (blocking)
-        result = cuMemcpyDtoH(data, pointer, size*elementSize);
+        result = cuMemcpyDtoH(data, pointer, (size_t) size*elementSize);
     else
-        result = cuMemcpyDtoHAsync(data, pointer, size*elementSize, context->getCurrentStream());
+        result = cuMemcpyDtoHAsync(data, pointer, (size_t) size*elementSize, context->getCurrentStream());
     if (result != CUDA_SUCCESS) {
         std::stringstream str;
         str<<"Error downloading array "<<name<<": "<<CudaContext::getErrorString(result)<<" ("<<result<<")";
@@ -122,10 +258,81 @@ void CudaArray::copyTo(ArrayInterface& dest) const {
     if (dest.getSize() != size || dest.getElementSize() != elementSize)
         throw OpenMMException("Error copying array "+name+" to "+dest.getName()+": The destination array does not match the size of the array");
     CudaArray& cuDest = context->unwrap(dest);
-    CUresult result = cuMemcpyDtoDAsync(cuDest.getDevicePointer(), pointer, size*elementSize, context->getCurrentStream());
+    cuDest.makePrivate(false);
+    CUresult result = cuMemcpyDtoDAsync(cuDest.getDevicePointer(), pointer, (size_t) size*elementSize, context->getCurrentStream());
     if (result != CUDA_SUCCESS) {
         std::stringstream str;
         str<<"Error copying array "<<name<<" to "<<dest.getName()<<": "<<CudaContext::getErrorString(result)<<" ("<<result<<")";
         throw OpenMMException(str.str());
     }
 }
+
+void CudaArray::uploadShared(const void* data) {
+    if (pointer == 0)
+        throw OpenMMException("CudaArray has not been initialized");
+    if (!ownsMemory || size == 0) {
+        upload(data, true);
+        return;
+    }
+    size_t bytes = (size_t) size*elementSize;
+    const char* contents = (const char*) data;
+    unsigned long long hash = hashContents(contents, bytes);
+    CUcontext cuContext = context->getContext();
+    std::lock_guard<std::mutex> lock(sharedBlockLock);
+
+    // Look for an existing block with the same contents.
+
+    SharedBlock* block = NULL;
+    auto range = blocksByHash.equal_range(hash);
+    for (auto iter = range.first; iter != range.second; ++iter) {
+        SharedBlock* candidate = iter->second;
+        if (candidate->context == cuContext && candidate->contents.size() == bytes && memcmp(&candidate->contents[0], contents, bytes) == 0) {
+            block = candidate;
+            break;
+        }
+    }
+    if (block != NULL && shared && block->pointer == pointer)
+        return;
+    if (block == NULL) {
+        // Create a new block.  It is allocated directly rather than from the memory pool, since it may
+        // outlive the context that created it.
+
+        block = new SharedBlock();
+        block->context = cuContext;
+        block->hash = hash;
+        block->contents.assign(contents, contents+bytes);
+        block->refCount = 0;
+        CUresult result = cuMemAlloc(&block->pointer, bytes);
+        if (result == CUDA_SUCCESS) {
+            result = cuMemcpyHtoD(block->pointer, data, bytes);
+            if (result != CUDA_SUCCESS)
+                cuMemFree(block->pointer);
+        }
+        if (result != CUDA_SUCCESS) {
+            delete block;
+            std::stringstream str;
+            str<<"Error uploading array "<<name<<": "<<CudaContext::getErrorString(result)<<" ("<<result<<")";
+            throw OpenMMException(str.str());
+        }
+        blocksByHash.insert(std::make_pair(hash, block));
+        blocksByPointer[block->pointer] = block;
+    }
+    block->refCount++;
+
+    // Release the memory this array was using before.
+
+    CUresult result;
+    if (shared)
+        result = releaseSharedBlock(pointer, true);
+    else {
+        context->recordArrayRelease(this);
+        result = freeMemory();
+    }
+    if (result != CUDA_SUCCESS) {
+        std::stringstream str;
+        str<<"Error deleting array "<<name<<": "<<CudaContext::getErrorString(result)<<" ("<<result<<")";
+        throw OpenMMException(str.str());
+    }
+    pointer = block->pointer;
+    shared = true;
+}
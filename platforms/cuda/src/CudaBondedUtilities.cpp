@@ -29,13 +29,31 @@
 #include "CudaExpressionUtilities.h"
 #include "CudaKernelSources.h"
 #include "openmm/OpenMMException.h"
+#include "openmm/internal/TraceRange.h"
 #include "CudaNonbondedUtilities.h"
 #include <iostream>
+#include <sstream>
 
 using namespace OpenMM;
 using namespace std;
 
-CudaBondedUtilities::CudaBondedUtilities(CudaContext& context) : context(context), numForceBuffers(0), maxBonds(0), allGroups(0), hasInitializedKernels(false) {
+#define CHECK_RESULT(result, prefix) \
+    if (result != CUDA_SUCCESS) { \
+        std::stringstream m; \
+        m<<prefix<<": "<<CudaContext::getErrorString(result)<<" ("<<result<<")"<<" at "<<__FILE__<<":"<<__LINE__; \
+        throw OpenMMException(m.str());\
+    }
+
+CudaBondedUtilities::CudaBondedUtilities(CudaContext& context) : context(context), groupMaxBonds(32, 0), numForceBuffers(0), allGroups(0), hasInitializedKernels(false),
+        hasInteractions(false), useSeparateStream(false), isRunning(false) {
+}
+
+CudaBondedUtilities::~CudaBondedUtilities() {
+    if (useSeparateStream) {
+        cuStreamDestroy(stream);
+        cuEventDestroy(startEvent);
+        cuEventDestroy(finishEvent);
+    }
 }
 
 void CudaBondedUtilities::addInteraction(const vector<vector<int> >& atoms, const string& source, int group) {
@@ -101,7 +119,7 @@ void CudaBondedUtilities::initialize(const System& system) {
                     indexVec[bond*paddedWidth+atom] = forceAtoms[i][bond][startAtom+atom];
             }
             atomIndices[i][j].initialize(context, numBonds, 4*paddedWidth, "bondedIndices");
-            atomIndices[i][j].upload(&indexVec[0]);
+            atomIndices[i][j].uploadShared(&indexVec[0]);
             startAtom += width;
         }
     }
@@ -121,7 +139,7 @@ void CudaBondedUtilities::initialize(const System& system) {
         }
     }
     for (int i = 0; i < (int) arguments.size(); i++)
-        s<<", "<<argTypes[i]<<"* customArg"<<(i+1);
+        s<<", "<<argTypes[i]<<(argTypes[i].rfind("const ", 0) == 0 ? "* __restrict__" : "*")<<" customArg"<<(i+1);
     if (energyParameterDerivatives.size() > 0)
         s<<", mixed* __restrict__ energyParamDerivs";
     s<<") {\n";
@@ -138,16 +156,36 @@ void CudaBondedUtilities::initialize(const System& system) {
             if (allParamDerivNames[index] == energyParameterDerivatives[i])
                 s<<"energyParamDerivs[(blockIdx.x*blockDim.x+threadIdx.x)*"<<numDerivs<<"+"<<index<<"] += energyParamDeriv"<<i<<";\n";
     s<<"}\n";
+    s<<"extern \"C\" __global__ void addBondedEnergy(const mixed* __restrict__ bondedEnergyBuffer, mixed* __restrict__ energyBuffer, int bufferSize) {\n";
+    s<<"for (int i = blockIdx.x*blockDim.x+threadIdx.x; i < bufferSize; i += blockDim.x*gridDim.x)\n";
+    s<<"    energyBuffer[i] += bondedEnergyBuffer[i];\n";
+    s<<"}\n";
     map<string, string> defines;
     defines["PADDED_NUM_ATOMS"] = context.intToString(context.getPaddedNumAtoms());
     CUmodule module = context.createModule(s.str(), defines);
     kernel = context.getKernel(module, "computeBondedForces");
+    addEnergyKernel = context.getKernel(module, "addBondedEnergy");
+
+    // The bonded and nonbonded kernels both accumulate forces with atomic operations, so the bonded kernel can
+    // run on its own stream, overlapping with the nonbonded kernel.  Energies and parameter derivatives are
+    // accumulated without atomics, so the energy goes to a separate buffer.  If there are parameter derivatives,
+    // just use the main stream.
+
+    useSeparateStream = (energyParameterDerivatives.size() == 0);
+    if (useSeparateStream) {
+        CudaArray& contextEnergy = context.getEnergyBuffer();
+        energyBuffer.initialize(context, contextEnergy.getSize(), contextEnergy.getElementSize(), "bondedEnergyBuffer");
+        context.addAutoclearBuffer(energyBuffer);
+        CHECK_RESULT(cuStreamCreate(&stream, CU_STREAM_NON_BLOCKING), "Error creating stream for bonded interactions");
+        CHECK_RESULT(cuEventCreate(&startEvent, CU_EVENT_DISABLE_TIMING), "Error creating event for bonded interactions");
+        CHECK_RESULT(cuEventCreate(&finishEvent, CU_EVENT_DISABLE_TIMING), "Error creating event for bonded interactions");
+    }
     forceAtoms.clear();
     forceSource.clear();
 }
 
 string CudaBondedUtilities::createForceSource(int forceIndex, int numBonds, int numAtoms, int group, const string& computeForce) {
-    maxBonds = max(maxBonds, numBonds);
+    groupMaxBonds[group] = max(groupMaxBonds[group], numBonds);
     string suffix[] = {".x", ".y", ".z", ".w"};
     stringstream s;
     s<<"if ((groups&"<<(1<<group)<<") != 0)\n";
@@ -178,10 +216,11 @@ string CudaBondedUtilities::createForceSource(int forceIndex, int numBonds, int
 void CudaBondedUtilities::computeInteractions(int groups) {
     if ((groups&allGroups) == 0)
         return;
+    OPENMM_TRACE_RANGE("Bonded interactions");
     if (!hasInitializedKernels) {
         hasInitializedKernels = true;
         kernelArgs.push_back(&context.getForce().getDevicePointer());
-        kernelArgs.push_back(&context.getEnergyBuffer().getDevicePointer());
+        kernelArgs.push_back(useSeparateStream ? &energyBuffer.getDevicePointer() : &context.getEnergyBuffer().getDevicePointer());
         kernelArgs.push_back(&context.getPosq().getDevicePointer());
         kernelArgs.push_back(NULL);
         kernelArgs.push_back(context.getPeriodicBoxSizePointer());
@@ -200,5 +239,35 @@ void CudaBondedUtilities::computeInteractions(int groups) {
     if (!hasInteractions)
         return;
     kernelArgs[3] = &groups;
-    context.executeKernel(kernel, &kernelArgs[0], maxBonds);
+
+    // Only launch as many threads as are needed for the force groups being computed.
+
+    int numBonds = 0;
+    for (int i = 0; i < 32; i++)
+        if ((groups&(1<<i)) != 0)
+            numBonds = max(numBonds, groupMaxBonds[i]);
+    if (!useSeparateStream) {
+        context.executeKernel(kernel, &kernelArgs[0], numBonds);
+        return;
+    }
+    CUstream mainStream = context.getCurrentStream();
+    cuEventRecord(startEvent, mainStream);
+    cuStreamWaitEvent(stream, startEvent, 0);
+    context.setCurrentStream(stream);
+    context.executeKernel(kernel, &kernelArgs[0], numBonds);
+    context.setCurrentStream(mainStream);
+    cuEventRecord(finishEvent, stream);
+    isRunning = true;
+}
+
+void CudaBondedUtilities::finishInteractions(bool includeEnergy) {
+    if (!isRunning)
+        return;
+    isRunning = false;
+    cuStreamWaitEvent(context.getCurrentStream(), finishEvent, 0);
+    if (includeEnergy) {
+        int bufferSize = energyBuffer.getSize();
+        void* args[] = {&energyBuffer.getDevicePointer(), &context.getEnergyBuffer().getDevicePointer(), &bufferSize};
+        context.executeKernel(addEnergyKernel, args, bufferSize);
+    }
 }
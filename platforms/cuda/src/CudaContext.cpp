@@ -44,11 +44,14 @@
 #include "openmm/VirtualSite.h"
 #include "CudaExpressionUtilities.h"
 #include "openmm/internal/ContextImpl.h"
+#include "openmm/internal/hardware.h"
 #include <algorithm>
 #include <cstdlib>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <mutex>
 #include <set>
 #include <sstream>
 #include <typeinfo>
@@ -73,6 +76,7 @@ using namespace std;
 const int CudaContext::ThreadBlockSize = 64;
 const int CudaContext::TileSize = sizeof(tileflags)*8;
 bool CudaContext::hasInitializedCuda = false;
+static mutex cudaInitializationLock;
 
 #ifdef WIN32
 #include <Windows.h>
@@ -105,9 +109,10 @@ static int executeInWindows(const string &command) {
 }
 #endif
 
-CudaContext::CudaContext(const System& system, int deviceIndex, bool useBlockingSync, const string& precision, const string& compiler,
-        const string& tempDir, const std::string& hostCompiler, CudaPlatform::PlatformData& platformData, CudaContext* originalContext) : ComputeContext(system), currentStream(0),
-        platformData(platformData), contextIsValid(false), hasAssignedPosqCharges(false),
+CudaContext::CudaContext(const System& system, int deviceIndex, bool useBlockingSync, bool useSharedContext, const string& precision, const string& compiler,
+        const string& tempDir, const std::string& hostCompiler, CudaPlatform::PlatformData& platformData, CudaContext* originalContext) : ComputeContext(system),
+        currentStream(0), defaultStream(0), useSharedContext(useSharedContext),
+        platformData(platformData), memoryPool(NULL), contextIsValid(false), hasAssignedPosqCharges(false),
         hasCompilerKernel(false), isNvccAvailable(false), pinnedBuffer(NULL), integration(NULL), expression(NULL), bonded(NULL), nonbonded(NULL) {
     // Determine what compiler to use.
     
@@ -134,9 +139,12 @@ CudaContext::CudaContext(const System& system, int deviceIndex, bool useBlocking
     cuDriverGetVersion(&cudaDriverVersion);
     if (hostCompiler.size() > 0)
         this->compiler = compiler+" --compiler-bindir "+hostCompiler;
-    if (!hasInitializedCuda) {
-        CHECK_RESULT2(cuInit(0), "Error initializing CUDA");
-        hasInitializedCuda = true;
+    {
+        lock_guard<mutex> lock(cudaInitializationLock);
+        if (!hasInitializedCuda) {
+            CHECK_RESULT2(cuInit(0), "Error initializing CUDA");
+            hasInitializedCuda = true;
+        }
     }
     if (precision == "single") {
         useDoublePrecision = false;
@@ -188,7 +196,20 @@ CudaContext::CudaContext(const System& system, int deviceIndex, bool useBlocking
             else
                 flags += CU_CTX_SCHED_SPIN;
 
-            if (cuCtxCreate(&context, flags, device) == CUDA_SUCCESS) {
+            if (useSharedContext) {
+                // The flags can only be set before the primary context becomes active.  If another Context
+                // is already using it, this fails harmlessly and the existing flags are kept.
+
+                cuDevicePrimaryCtxSetFlags(device, flags);
+                if (cuDevicePrimaryCtxRetain(&context, device) == CUDA_SUCCESS) {
+                    if (cuCtxSetCurrent(context) == CUDA_SUCCESS) {
+                        this->deviceIndex = trialDeviceIndex;
+                        break;
+                    }
+                    cuDevicePrimaryCtxRelease(device);
+                }
+            }
+            else if (cuCtxCreate(&context, flags, device) == CUDA_SUCCESS) {
                 this->deviceIndex = trialDeviceIndex;
                 break;
             }
@@ -199,12 +220,24 @@ CudaContext::CudaContext(const System& system, int deviceIndex, bool useBlocking
             else
                 throw OpenMMException("No compatible CUDA device is available");
         }
+
+        // Other Contexts may be running on the same CUDA context, and graphs cannot be captured from the
+        // null stream, so in either case give this one its own stream.  It is a blocking stream, so anything
+        // that still executes on the null stream is correctly ordered with it.
+
+        if (useSharedContext || platformData.useCudaGraphs) {
+            CHECK_RESULT(cuStreamCreate(&defaultStream, CU_STREAM_DEFAULT));
+            currentStream = defaultStream;
+        }
     }
     else {
         isLinkedContext = true;
         context = originalContext->context;
         this->deviceIndex = originalContext->deviceIndex;
         this->device = originalContext->device;
+        this->useSharedContext = originalContext->useSharedContext;
+        defaultStream = originalContext->defaultStream;
+        currentStream = defaultStream;
     }
 
     int major, minor;
@@ -231,6 +264,7 @@ CudaContext::CudaContext(const System& system, int deviceIndex, bool useBlocking
     computeCapability = major+0.1*minor;
 
     contextIsValid = true;
+    memoryPool = CudaMemoryPool::acquire(context);
     CHECK_RESULT(cuCtxSetCacheConfig(CU_FUNC_CACHE_PREFER_SHARED));
     if (contextIndex > 0) {
         int canAccess;
@@ -417,9 +451,24 @@ CudaContext::~CudaContext() {
     if (nonbonded != NULL)
         delete nonbonded;
     string errorMessage = "Error deleting Context";
+    if (memoryPool != NULL) {
+        CudaMemoryPool::release(memoryPool);
+        memoryPool = NULL;
+    }
+    for (auto& launch : profiledLaunches) {
+        cuEventDestroy(launch.start);
+        cuEventDestroy(launch.end);
+    }
+    for (CUevent event : profilingEvents)
+        cuEventDestroy(event);
     if (contextIsValid && !isLinkedContext) {
         cuProfilerStop();
-        CHECK_RESULT(cuCtxDestroy(context));
+        if (defaultStream != 0)
+            CHECK_RESULT(cuStreamDestroy(defaultStream));
+        if (useSharedContext)
+            CHECK_RESULT(cuDevicePrimaryCtxRelease(device));
+        else
+            CHECK_RESULT(cuCtxDestroy(context));
     }
     contextIsValid = false;
 }
@@ -467,6 +516,11 @@ void CudaContext::initialize() {
     }
     findMoleculeGroups();
     nonbonded->initialize(system);
+
+    // Compile the programs the forces have created so far, so they get built in parallel and any
+    // errors are reported when the Context is created.
+
+    compilePendingModules();
 }
 
 void CudaContext::initializeContexts() {
@@ -483,8 +537,24 @@ CUmodule CudaContext::createModule(const string source, const char* optimization
 }
 
 CUmodule CudaContext::createModule(const string source, const map<string, string>& defines, const char* optimizationFlags) {
-    string bits = intToString(8*sizeof(void*));
     string options = (optimizationFlags == NULL ? defaultOptimizationOptions : string(optimizationFlags));
+    string src = createModuleSource(source, defines, options);
+
+    // See whether we already have PTX for this kernel cached.
+
+    string cacheFile = getCacheFileName(src);
+    CUmodule module;
+    if (cuModuleLoad(&module, cacheFile.c_str()) == CUDA_SUCCESS)
+        return module;
+
+    // Compile it.
+
+    string ptx = compilePTX(src, options, cacheFile, 0);
+    CHECK_RESULT2(cuModuleLoadDataEx(&module, &ptx[0], 0, NULL, NULL), "Error loading CUDA module");
+    return module;
+}
+
+string CudaContext::createModuleSource(const string& source, const map<string, string>& defines, const string& options) {
     stringstream src;
     if (!options.empty())
         src << "// Compilation Options: " << options << endl << endl;
@@ -531,11 +601,12 @@ CUmodule CudaContext::createModule(const string source, const map<string, string
     if (!defines.empty())
         src << endl;
     src << source << endl;
+    return src.str();
+}
 
-    // See whether we already have PTX for this kernel cached.
-
+string CudaContext::getCacheFileName(const string& src) {
     CSHA1 sha1;
-    sha1.Update((const UINT_8*) src.str().c_str(), src.str().size());
+    sha1.Update((const UINT_8*) src.c_str(), src.size());
     sha1.Final();
     UINT_8 hash[20];
     sha1.GetHash(hash);
@@ -544,15 +615,18 @@ CUmodule CudaContext::createModule(const string source, const map<string, string
     cacheFile.flags(ios::hex);
     for (int i = 0; i < 20; i++)
         cacheFile << setw(2) << setfill('0') << (int) hash[i];
-    cacheFile << '_' << gpuArchitecture << '_' << bits;
-    CUmodule module;
-    if (cuModuleLoad(&module, cacheFile.str().c_str()) == CUDA_SUCCESS)
-        return module;
+    cacheFile << '_' << gpuArchitecture << '_' << intToString(8*sizeof(void*));
+    return cacheFile.str();
+}
+
+string CudaContext::compilePTX(const string& src, const string& options, const string& cacheFile, int index) {
+    string bits = intToString(8*sizeof(void*));
 
     // Select names for the various temporary files.
 
     stringstream tempFileName;
     tempFileName << "openmmTempKernel" << this; // Include a pointer to this context as part of the filename to avoid collisions.
+    tempFileName << "_" << index;
 #ifdef WIN32
     tempFileName << "_" << GetCurrentProcessId();
 #else
@@ -561,51 +635,44 @@ CUmodule CudaContext::createModule(const string source, const map<string, string
     string inputFile = (tempDir+tempFileName.str()+".cu");
     string outputFile = (tempDir+tempFileName.str()+".ptx");
     string logFile = (tempDir+tempFileName.str()+".log");
-    int res = 0;
 
     // If the runtime compiler plugin is available, use it.
 
     if (hasCompilerKernel) {
-        string ptx = compilerKernel.getAs<CudaCompilerKernel>().createModule(src.str(), "-arch=compute_"+gpuArchitecture+" "+options, *this);
+        string ptx = compilerKernel.getAs<CudaCompilerKernel>().createModule(src, "-arch=compute_"+gpuArchitecture+" "+options, *this);
 
-        // If possible, write the PTX out to a temporary file so we can cache it for later use.
+        // If possible, write the PTX out to the cache for later use.  If an error occurs (possibly we don't
+        // have permission to write to the cache directory), just return it without caching it.
 
-        bool wroteCache = false;
         try {
             ofstream out(outputFile.c_str());
             out << ptx;
             out.close();
-            if (!out.fail())
-                wroteCache = true;
+            if (out.fail() || rename(outputFile.c_str(), cacheFile.c_str()) != 0)
+                remove(outputFile.c_str());
         }
         catch (...) {
             // Ignore.
         }
-        if (!wroteCache) {
-            // An error occurred.  Possibly we don't have permission to write to the temp directory.  Just try to load the module directly.
-
-            CHECK_RESULT2(cuModuleLoadDataEx(&module, &ptx[0], 0, NULL, NULL), "Error loading CUDA module");
-            return module;
-        }
+        return ptx;
     }
-    else {
-        // Write out the source to a temporary file.
 
-        ofstream out(inputFile.c_str());
-        out << src.str();
-        out.close();
+    // Write out the source to a temporary file.
+
+    ofstream out(inputFile.c_str());
+    out << src;
+    out.close();
 #ifdef WIN32
 #ifdef _DEBUG
-        string command = compiler+" --ptx -G -g --machine "+bits+" -arch=sm_"+gpuArchitecture+" -o "+outputFile+" "+options+" "+inputFile+" 2> "+logFile;
+    string command = compiler+" --ptx -G -g --machine "+bits+" -arch=sm_"+gpuArchitecture+" -o "+outputFile+" "+options+" "+inputFile+" 2> "+logFile;
 #else
-        string command = compiler+" --ptx -lineinfo --machine "+bits+" -arch=sm_"+gpuArchitecture+" -o "+outputFile+" "+options+" "+inputFile+" 2> "+logFile;
+    string command = compiler+" --ptx -lineinfo --machine "+bits+" -arch=sm_"+gpuArchitecture+" -o "+outputFile+" "+options+" "+inputFile+" 2> "+logFile;
 #endif
-        res = executeInWindows(command);
+    int res = executeInWindows(command);
 #else
-        string command = compiler+" --ptx --machine "+bits+" -arch=sm_"+gpuArchitecture+" -o \""+outputFile+"\" "+options+" \""+inputFile+"\" 2> \""+logFile+"\"";
-        res = std::system(command.c_str());
+    string command = compiler+" --ptx --machine "+bits+" -arch=sm_"+gpuArchitecture+" -o \""+outputFile+"\" "+options+" \""+inputFile+"\" 2> \""+logFile+"\"";
+    int res = std::system(command.c_str());
 #endif
-    }
     try {
         if (res != 0) {
             // Load the error log.
@@ -623,17 +690,16 @@ CUmodule CudaContext::createModule(const string source, const map<string, string
             }
             throw OpenMMException(error.str());
         }
-        CUresult result = cuModuleLoad(&module, outputFile.c_str());
-        if (result != CUDA_SUCCESS) {
-            std::stringstream m;
-            m<<"Error loading CUDA module: "<<getErrorString(result)<<" ("<<result<<")";
-            throw OpenMMException(m.str());
-        }
+        ifstream ptxFile(outputFile.c_str());
+        string ptx((istreambuf_iterator<char>(ptxFile)), istreambuf_iterator<char>());
+        ptxFile.close();
+        if (ptx.empty())
+            throw OpenMMException("Error reading CUDA compiler output: "+outputFile);
         remove(inputFile.c_str());
-        if (rename(outputFile.c_str(), cacheFile.str().c_str()) != 0)
+        if (rename(outputFile.c_str(), cacheFile.c_str()) != 0)
             remove(outputFile.c_str());
         remove(logFile.c_str());
-        return module;
+        return ptx;
     }
     catch (...) {
         remove(inputFile.c_str());
@@ -651,9 +717,14 @@ CUfunction CudaContext::getKernel(CUmodule& module, const string& name) {
         m<<"Error creating kernel "<<name<<": "<<getErrorString(result)<<" ("<<result<<")";
         throw OpenMMException(m.str());
     }
+    kernelNames[function] = name;
     return function;
 }
 
+bool CudaContext::getUseCudaGraphs() const {
+    return platformData.useCudaGraphs;
+}
+
 CUstream CudaContext::getCurrentStream() {
     return currentStream;
 }
@@ -663,7 +734,7 @@ void CudaContext::setCurrentStream(CUstream stream) {
 }
 
 void CudaContext::restoreDefaultStream() {
-    setCurrentStream(0);
+    setCurrentStream(defaultStream);
 }
 
 CudaArray* CudaContext::createArray() {
@@ -675,10 +746,77 @@ ComputeEvent CudaContext::createEvent() {
 }
 
 ComputeProgram CudaContext::compileProgram(const std::string source, const std::map<std::string, std::string>& defines) {
-    CUmodule module = createModule(CudaKernelSources::vectorOps+source, defines);
+    string src = createModuleSource(CudaKernelSources::vectorOps+source, defines, defaultOptimizationOptions);
+    shared_ptr<DeferredModule> module(new DeferredModule(src, defaultOptimizationOptions));
+    pendingModules.push_back(module);
     return shared_ptr<ComputeProgramImpl>(new CudaProgram(*this, module));
 }
 
+CUmodule CudaContext::getModule(DeferredModule& module) {
+    if (!module.isLoaded && module.error.empty())
+        compilePendingModules();
+    if (!module.error.empty())
+        throw OpenMMException(module.error);
+    return module.module;
+}
+
+void CudaContext::compilePendingModules() {
+    if (pendingModules.empty())
+        return;
+    vector<shared_ptr<DeferredModule> > modules;
+    modules.swap(pendingModules);
+
+    // Load any modules that are already in the cache.
+
+    vector<string> cacheFiles;
+    vector<shared_ptr<DeferredModule> > toCompile;
+    for (auto module : modules) {
+        string cacheFile = getCacheFileName(module->source);
+        if (cuModuleLoad(&module->module, cacheFile.c_str()) == CUDA_SUCCESS)
+            module->isLoaded = true;
+        else {
+            toCompile.push_back(module);
+            cacheFiles.push_back(cacheFile);
+        }
+    }
+    if (toCompile.empty())
+        return;
+
+    // Compile the rest in parallel.  The compilation itself doesn't touch the CUDA driver, so it can
+    // happen on worker threads.  Use a separate thread pool, since this may be invoked while the
+    // platform's thread pool is busy.
+
+    int numModules = toCompile.size();
+    vector<string> ptx(numModules);
+    ThreadPool threads(min(numModules, getNumProcessors()));
+    threads.execute(numModules, 1, [&] (ThreadPool& pool, int threadIndex, int start, int end) {
+        for (int i = start; i < end; i++) {
+            try {
+                ptx[i] = compilePTX(toCompile[i]->source, toCompile[i]->options, cacheFiles[i], i);
+            }
+            catch (exception& ex) {
+                toCompile[i]->error = ex.what();
+            }
+        }
+    });
+    threads.waitForThreads();
+
+    // Load the modules, then report the first error if any occurred.
+
+    string firstError;
+    for (int i = 0; i < numModules; i++) {
+        if (!toCompile[i]->error.empty()) {
+            if (firstError.empty())
+                firstError = toCompile[i]->error;
+            continue;
+        }
+        CHECK_RESULT2(cuModuleLoadDataEx(&toCompile[i]->module, &ptx[i][0], 0, NULL, NULL), "Error loading CUDA module");
+        toCompile[i]->isLoaded = true;
+    }
+    if (!firstError.empty())
+        throw OpenMMException(firstError);
+}
+
 CudaArray& CudaContext::unwrap(ArrayInterface& array) const {
     CudaArray* cuarray;
     ComputeArray* wrapper = dynamic_cast<ComputeArray*>(&array);
@@ -702,12 +840,61 @@ void CudaContext::executeKernel(CUfunction kernel, void** arguments, int threads
     if (blockSize == -1)
         blockSize = ThreadBlockSize;
     int gridSize = std::min((threads+blockSize-1)/blockSize, numThreadBlocks);
+    ProfiledLaunch launch = {kernel, profiledForceGroups, NULL, NULL};
+    if (profilingEnabled) {
+        // Bracket the kernel with a pair of events.  Their times are only retrieved later, so
+        // this does not force the host to wait for the kernel.
+
+        for (CUevent* event : {&launch.start, &launch.end}) {
+            if (profilingEvents.size() > 0) {
+                *event = profilingEvents.back();
+                profilingEvents.pop_back();
+            }
+            else
+                CHECK_RESULT2(cuEventCreate(event, CU_EVENT_DEFAULT), "Error creating event for profiling");
+        }
+        CHECK_RESULT2(cuEventRecord(launch.start, currentStream), "Error recording event for profiling");
+    }
     CUresult result = cuLaunchKernel(kernel, gridSize, 1, 1, blockSize, 1, 1, sharedSize, currentStream, arguments, NULL);
     if (result != CUDA_SUCCESS) {
+        if (profilingEnabled) {
+            profilingEvents.push_back(launch.start);
+            profilingEvents.push_back(launch.end);
+        }
         stringstream str;
         str<<"Error invoking kernel: "<<getErrorString(result)<<" ("<<result<<")";
         throw OpenMMException(str.str());
     }
+    if (profilingEnabled) {
+        CHECK_RESULT2(cuEventRecord(launch.end, currentStream), "Error recording event for profiling");
+        profiledLaunches.push_back(launch);
+        if (profiledLaunches.size() >= 1000)
+            processProfiledLaunches();
+    }
+}
+
+void CudaContext::setProfilingEnabled(bool enabled) {
+    setAsCurrent();
+    processProfiledLaunches();
+    ComputeContext::setProfilingEnabled(enabled);
+}
+
+void CudaContext::getPerformanceReport(map<string, double>& report) {
+    setAsCurrent();
+    processProfiledLaunches();
+    ComputeContext::getPerformanceReport(report);
+}
+
+void CudaContext::processProfiledLaunches() {
+    for (auto& launch : profiledLaunches) {
+        CHECK_RESULT2(cuEventSynchronize(launch.end), "Error waiting for event");
+        float time;
+        CHECK_RESULT2(cuEventElapsedTime(&time, launch.start, launch.end), "Error getting elapsed time");
+        recordKernelTime(kernelNames[launch.kernel], launch.groups, time);
+        profilingEvents.push_back(launch.start);
+        profilingEvents.push_back(launch.end);
+    }
+    profiledLaunches.clear();
 }
 
 int CudaContext::computeThreadBlockSize(double memory, bool preferShared) const {
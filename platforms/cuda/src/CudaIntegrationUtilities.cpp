@@ -38,18 +38,27 @@ using namespace std;
         throw OpenMMException(m.str());\
     }
 
-CudaIntegrationUtilities::CudaIntegrationUtilities(CudaContext& context, const System& system) : IntegrationUtilities(context, system),
+CudaIntegrationUtilities::CudaIntegrationUtilities(CudaContext& context, const System& system) : IntegrationUtilities(context, system, context.getPlatformData().useLincs),
         ccmaConvergedMemory(NULL) {
-        CHECK_RESULT2(cuEventCreate(&ccmaEvent, CU_EVENT_DISABLE_TIMING), "Error creating event for CCMA");
-        CHECK_RESULT2(cuMemHostAlloc((void**) &ccmaConvergedMemory, sizeof(int), CU_MEMHOSTALLOC_DEVICEMAP), "Error allocating pinned memory");
+        // The pinned memory holds one flag for position constraints and one for velocity constraints,
+        // followed by a second pair that is written on steps whose result will never be read.
+
+        for (int i = 0; i < 2; i++) {
+            CHECK_RESULT2(cuEventCreate(&ccmaEvent[i], CU_EVENT_DISABLE_TIMING), "Error creating event for CCMA");
+            ccmaResultPending[i] = false;
+        }
+        CHECK_RESULT2(cuMemHostAlloc((void**) &ccmaConvergedMemory, 4*sizeof(int), CU_MEMHOSTALLOC_DEVICEMAP), "Error allocating pinned memory");
         CHECK_RESULT2(cuMemHostGetDevicePointer(&ccmaConvergedDeviceMemory, ccmaConvergedMemory, 0), "Error getting device address for pinned memory");
+        for (int i = 0; i < 4; i++)
+            ccmaConvergedMemory[i] = 0;
 }
 
 CudaIntegrationUtilities::~CudaIntegrationUtilities() {
     context.setAsCurrent();
     if (ccmaConvergedMemory != NULL) {
         cuMemFreeHost(ccmaConvergedMemory);
-        cuEventDestroy(ccmaEvent);
+        for (int i = 0; i < 2; i++)
+            cuEventDestroy(ccmaEvent[i]);
     }
 }
 
@@ -58,14 +67,19 @@ CudaArray& CudaIntegrationUtilities::getPosDelta() {
 }
 
 CudaArray& CudaIntegrationUtilities::getRandom() {
+    initRandomArrays();
     return dynamic_cast<CudaContext&>(context).unwrap(random);
 }
 
+CudaArray& CudaIntegrationUtilities::getRandomCounter() {
+    return dynamic_cast<CudaContext&>(context).unwrap(randomCounter);
+}
+
 CudaArray& CudaIntegrationUtilities::getStepSize() {
     return dynamic_cast<CudaContext&>(context).unwrap(stepSize);
 }
 
-void CudaIntegrationUtilities::applyConstraintsImpl(bool constrainVelocities, double tol) {
+void CudaIntegrationUtilities::applyConstraintsImpl(bool constrainVelocities, double tol, bool includeSettle) {
     ComputeKernel settleKernel, shakeKernel, ccmaForceKernel;
     if (constrainVelocities) {
         settleKernel = settleVelKernel;
@@ -77,7 +91,7 @@ void CudaIntegrationUtilities::applyConstraintsImpl(bool constrainVelocities, do
         shakeKernel = shakePosKernel;
         ccmaForceKernel = ccmaPosForceKernel;
     }
-    if (settleAtoms.isInitialized()) {
+    if (settleAtoms.isInitialized() && includeSettle) {
         if (context.getUseDoublePrecision() || context.getUseMixedPrecision())
             settleKernel->setArg(1, tol);
         else
@@ -92,7 +106,9 @@ void CudaIntegrationUtilities::applyConstraintsImpl(bool constrainVelocities, do
         shakeKernel->execute(shakeAtoms.getSize());
     }
     if (ccmaConstraintAtoms.isInitialized()) {
-        if (ccmaConstraintAtoms.getSize() <= 1024) {
+        if (useLincs)
+            applyLincs(constrainVelocities);
+        else if (ccmaConstraintAtoms.getSize() <= 1024) {
             // Use the version of CCMA that runs in a single kernel with one workgroup.
             ccmaFullKernel->setArg(0, (int) constrainVelocities);
             if (context.getUseDoublePrecision() || context.getUseMixedPrecision())
@@ -102,29 +118,44 @@ void CudaIntegrationUtilities::applyConstraintsImpl(bool constrainVelocities, do
             ccmaFullKernel->execute(128, 128);
         }
         else {
-            ccmaForceKernel->setArg(6, ccmaConvergedDeviceMemory);
+            // Use the version of CCMA that uses multiple kernels.  Convergence is detected on the device,
+            // and the kernels for later iterations return immediately.  Rather than waiting to find out
+            // when it converged, launch a number of iterations based on what recent steps needed.  Each
+            // step's iteration count is read back once it has finished, without ever blocking on it.
+
+            int kind = (constrainVelocities ? 1 : 0);
+            if (ccmaResultPending[kind] && cuEventQuery(ccmaEvent[kind]) == CUDA_SUCCESS) {
+                recordCCMAIterations(constrainVelocities, ccmaConvergedMemory[kind]);
+                ccmaResultPending[kind] = false;
+            }
+            int numIterations = getCCMAIterationBudget(constrainVelocities, tol);
+            bool recordResult = !ccmaResultPending[kind];
+            if (recordResult)
+                ccmaConvergedMemory[kind] = 0;
+            int flagIndex = (recordResult ? kind : 2+kind);
+            ccmaForceKernel->setArg(6, ccmaConvergedDeviceMemory+flagIndex*sizeof(int));
             if (context.getUseDoublePrecision() || context.getUseMixedPrecision())
                 ccmaForceKernel->setArg(7, tol);
             else
                 ccmaForceKernel->setArg(7, (float) tol);
             ccmaDirectionsKernel->execute(ccmaConstraintAtoms.getSize());
-            const int checkInterval = 4;
-            ccmaConvergedMemory[0] = 0;
             ccmaUpdateKernel->setArg(4, constrainVelocities ? context.getVelm() : posDelta);
-            for (int i = 0; i < 150; i++) {
+            for (int i = 0; i < numIterations; i++) {
                 ccmaForceKernel->setArg(8, i);
                 ccmaForceKernel->execute(ccmaConstraintAtoms.getSize());
-                if ((i+1)%checkInterval == 0)
-                    CHECK_RESULT2(cuEventRecord(ccmaEvent, 0), "Error recording event for CCMA");
                 ccmaMultiplyKernel->setArg(5, i);
                 ccmaMultiplyKernel->execute(ccmaConstraintAtoms.getSize());
                 ccmaUpdateKernel->setArg(9, i);
                 ccmaUpdateKernel->execute(context.getNumAtoms());
-                if ((i+1)%checkInterval == 0) {
-                    CHECK_RESULT2(cuEventSynchronize(ccmaEvent), "Error synchronizing on event for CCMA");
-                    if (ccmaConvergedMemory[0])
-                        break;
-                }
+            }
+
+            // One extra force kernel lets the device report convergence on the final iteration.
+
+            ccmaForceKernel->setArg(8, numIterations);
+            ccmaForceKernel->execute(ccmaConstraintAtoms.getSize());
+            if (recordResult) {
+                CHECK_RESULT2(cuEventRecord(ccmaEvent[kind], dynamic_cast<CudaContext&>(context).getCurrentStream()), "Error recording event for CCMA");
+                ccmaResultPending[kind] = true;
             }
         }
     }
@@ -136,3 +167,7 @@ void CudaIntegrationUtilities::distributeForcesFromVirtualSites() {
         vsiteForceKernel->execute(numVsites);
     }
 }
+
+bool CudaIntegrationUtilities::getConstraintsRequireSync() const {
+    return (ccmaConstraintAtoms.isInitialized() && ccmaConstraintAtoms.getSize() > 1024 && !useLincs);
+}
@@ -35,11 +35,17 @@ using namespace std;
 CudaKernel::CudaKernel(CudaContext& context, CUfunction kernel, const string& name) : context(context), kernel(kernel), name(name) {
 }
 
+CudaKernel::CudaKernel(CudaContext& context, shared_ptr<CudaContext::DeferredModule> module, const string& name) : context(context),
+        module(module), kernel(NULL), name(name) {
+}
+
 string CudaKernel::getName() const {
     return name;
 }
 
 void CudaKernel::execute(int threads, int blockSize) {
+    if (kernel == NULL)
+        kernel = context.getKernel(context.getModule(*module), name);
     int numArgs = arrayArgs.size();
     argPointers.resize(numArgs);
     for (int i = 0; i < numArgs; i++) {
@@ -73,6 +73,8 @@ KernelImpl* CudaKernelFactory::createKernelImpl(std::string name, const Platform
         return new CudaCalcForcesAndEnergyKernel(name, platform, cu);
     if (name == UpdateStateDataKernel::Name())
         return new CudaUpdateStateDataKernel(name, platform, cu);
+    if (name == ProfileKernel::Name())
+        return new CudaProfileKernel(name, platform, cu);
     if (name == ApplyConstraintsKernel::Name())
         return new CudaApplyConstraintsKernel(name, platform, cu);
     if (name == VirtualSitesKernel::Name())
@@ -122,7 +124,9 @@ KernelImpl* CudaKernelFactory::createKernelImpl(std::string name, const Platform
     if (name == IntegrateLangevinStepKernel::Name())
         return new CommonIntegrateLangevinStepKernel(name, platform, cu);
     if (name == IntegrateLangevinMiddleStepKernel::Name())
-        return new CommonIntegrateLangevinMiddleStepKernel(name, platform, cu);
+        return new CudaIntegrateLangevinMiddleStepKernel(name, platform, cu);
+    if (name == IntegrateMTSLangevinStepKernel::Name())
+        return new CommonIntegrateMTSLangevinStepKernel(name, platform, cu);
     if (name == IntegrateBrownianStepKernel::Name())
         return new CommonIntegrateBrownianStepKernel(name, platform, cu);
     if (name == IntegrateVariableVerletStepKernel::Name())
@@ -139,5 +143,15 @@ KernelImpl* CudaKernelFactory::createKernelImpl(std::string name, const Platform
         return new CudaApplyMonteCarloBarostatKernel(name, platform, cu);
     if (name == RemoveCMMotionKernel::Name())
         return new CommonRemoveCMMotionKernel(name, platform, cu);
+    if (name == MinimizeKernel::Name())
+        return new CommonMinimizeKernel(name, platform, cu);
+    if (name == SwapStateKernel::Name())
+        return new CudaSwapStateKernel(name, platform, cu);
+    if (name == ParticleSubsetKernel::Name())
+        return new CommonParticleSubsetKernel(name, platform, cu);
+    if (name == StateSnapshotKernel::Name())
+        return new CommonStateSnapshotKernel(name, platform, cu);
+    if (name == ScaleVelocitiesKernel::Name())
+        return new CommonScaleVelocitiesKernel(name, platform, cu);
     throw OpenMMException((std::string("Tried to create kernel with illegal kernel name '")+name+"'").c_str());
 }
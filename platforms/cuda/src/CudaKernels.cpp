@@ -33,6 +33,7 @@
 #include "openmm/internal/CustomHbondForceImpl.h"
 #include "openmm/internal/NonbondedForceImpl.h"
 #include "openmm/internal/OSRngSeed.h"
+#include "openmm/internal/TraceRange.h"
 #include "CudaBondedUtilities.h"
 #include "CudaExpressionUtilities.h"
 #include "CudaIntegrationUtilities.h"
@@ -97,6 +98,78 @@ static void replaceFunctionsInExpression(map<string, CustomFunction*>& functions
     }
 }
 
+/**
+ * Select the PME grid dimensions to use when the TunePme property is set.  Any legal
+ * size at least as large as the minimum gives at least the requested accuracy, so this
+ * times a forward and backward FFT for the minimum size and the next two legal sizes
+ * along each axis, and returns the fastest combination in the input arguments.
+ */
+static void tunePmeGridSize(CudaContext& cu, int& xsize, int& ysize, int& zsize) {
+    int cufftVersion;
+    cufftGetVersion(&cufftVersion);
+    if (cufftVersion < 7050)
+        return;
+    vector<int> candidates[3];
+    int minSize[3] = {xsize, ysize, zsize};
+    for (int axis = 0; axis < 3; axis++) {
+        int size = minSize[axis];
+        for (int i = 0; i < 3; i++) {
+            candidates[axis].push_back(size);
+            size = CudaFFT3D::findLegalDimension(size+1);
+        }
+    }
+    bool useDouble = cu.getUseDoublePrecision();
+    int realSize = (useDouble ? sizeof(double) : sizeof(float));
+    int maxElements = candidates[0].back()*candidates[1].back()*candidates[2].back();
+    CudaArray realGrid(cu, maxElements, realSize, "tunePmeRealGrid");
+    CudaArray complexGrid(cu, maxElements, 2*realSize, "tunePmeComplexGrid");
+    cu.clearBuffer(realGrid);
+    CUevent start, end;
+    CHECK_RESULT(cuEventCreate(&start, CU_EVENT_DEFAULT), "Error creating event for tuning PME");
+    CHECK_RESULT(cuEventCreate(&end, CU_EVENT_DEFAULT), "Error creating event for tuning PME");
+    const int numIterations = 10;
+    float bestTime = -1;
+    for (int x : candidates[0])
+        for (int y : candidates[1])
+            for (int z : candidates[2]) {
+                cufftHandle forward, backward;
+                if (cufftPlan3d(&forward, x, y, z, useDouble ? CUFFT_D2Z : CUFFT_R2C) != CUFFT_SUCCESS)
+                    continue;
+                if (cufftPlan3d(&backward, x, y, z, useDouble ? CUFFT_Z2D : CUFFT_C2R) != CUFFT_SUCCESS) {
+                    cufftDestroy(forward);
+                    continue;
+                }
+                for (int i = -1; i < numIterations; i++) {
+                    // The first iteration is a warmup and is not timed.
+
+                    if (i == 0)
+                        cuEventRecord(start, 0);
+                    if (useDouble) {
+                        cufftExecD2Z(forward, (double*) realGrid.getDevicePointer(), (double2*) complexGrid.getDevicePointer());
+                        cufftExecZ2D(backward, (double2*) complexGrid.getDevicePointer(), (double*) realGrid.getDevicePointer());
+                    }
+                    else {
+                        cufftExecR2C(forward, (float*) realGrid.getDevicePointer(), (float2*) complexGrid.getDevicePointer());
+                        cufftExecC2R(backward, (float2*) complexGrid.getDevicePointer(), (float*) realGrid.getDevicePointer());
+                    }
+                }
+                cuEventRecord(end, 0);
+                cuEventSynchronize(end);
+                float time;
+                cuEventElapsedTime(&time, start, end);
+                if (bestTime < 0 || time < bestTime) {
+                    bestTime = time;
+                    xsize = x;
+                    ysize = y;
+                    zsize = z;
+                }
+                cufftDestroy(forward);
+                cufftDestroy(backward);
+            }
+    cuEventDestroy(start);
+    cuEventDestroy(end);
+}
+
 void CudaCalcForcesAndEnergyKernel::initialize(const System& system) {
 }
 
@@ -118,17 +191,27 @@ double CudaCalcForcesAndEnergyKernel::finishComputation(ContextImpl& context, bo
     cu.setAsCurrent();
     cu.getBondedUtilities().computeInteractions(groups);
     cu.getNonbondedUtilities().computeInteractions(groups, includeForces, includeEnergy);
+    cu.getBondedUtilities().finishInteractions(includeEnergy);
     double sum = 0.0;
     for (auto computation : cu.getPostComputations())
         sum += computation->computeForceAndEnergy(includeForces, includeEnergy, groups);
     cu.getIntegrationUtilities().distributeForcesFromVirtualSites();
     if (includeEnergy)
         sum += cu.reduceEnergy();
+    cu.getNonbondedUtilities().checkNeighborListSize();
     if (!cu.getForcesValid())
         valid = false;
     return sum;
 }
 
+CudaUpdateStateDataKernel::~CudaUpdateStateDataKernel() {
+    if (copyMemory != NULL) {
+        cu.setAsCurrent();
+        cuMemFreeHost(copyMemory);
+        cuEventDestroy(copyEvent);
+    }
+}
+
 void CudaUpdateStateDataKernel::initialize(const System& system) {
 }
 
@@ -279,6 +362,67 @@ void CudaUpdateStateDataKernel::getVelocities(ContextImpl& context, vector<Vec3>
     }
 }
 
+void CudaUpdateStateDataKernel::getPositionsFloat(ContextImpl& context, vector<float>& positions) {
+    if (cu.getUseDoublePrecision()) {
+        UpdateStateDataKernel::getPositionsFloat(context, positions);
+        return;
+    }
+    cu.setAsCurrent();
+    int numParticles = context.getSystem().getNumParticles();
+    positions.resize(3*numParticles);
+
+    // In mixed precision mode, posq holds each position rounded to single precision, so the correction
+    // is not needed.
+
+    float4* posq = (float4*) cu.getPinnedBuffer();
+    cu.getPosq().download(posq);
+    cu.getPlatformData().threads.execute([&] (ThreadPool& threads, int threadIndex) {
+        const vector<int>& order = cu.getAtomIndex();
+        Vec3 boxVectors[3];
+        cu.getPeriodicBoxVectors(boxVectors[0], boxVectors[1], boxVectors[2]);
+        int numThreads = threads.getNumThreads();
+        int start = threadIndex*numParticles/numThreads;
+        int end = (threadIndex+1)*numParticles/numThreads;
+        for (int i = start; i < end; ++i) {
+            float4 pos = posq[i];
+            mm_int4 offset = cu.getPosCellOffsets()[i];
+            float* p = &positions[3*order[i]];
+            if (offset.x == 0 && offset.y == 0 && offset.z == 0) {
+                p[0] = pos.x;
+                p[1] = pos.y;
+                p[2] = pos.z;
+            }
+            else {
+                Vec3 shift = boxVectors[0]*offset.x+boxVectors[1]*offset.y+boxVectors[2]*offset.z;
+                p[0] = (float) (pos.x-shift[0]);
+                p[1] = (float) (pos.y-shift[1]);
+                p[2] = (float) (pos.z-shift[2]);
+            }
+        }
+    });
+    cu.getPlatformData().threads.waitForThreads();
+}
+
+void CudaUpdateStateDataKernel::getVelocitiesFloat(ContextImpl& context, vector<float>& velocities) {
+    if (cu.getUseDoublePrecision() || cu.getUseMixedPrecision()) {
+        UpdateStateDataKernel::getVelocitiesFloat(context, velocities);
+        return;
+    }
+    cu.setAsCurrent();
+    const vector<int>& order = cu.getAtomIndex();
+    int numParticles = context.getSystem().getNumParticles();
+    velocities.resize(3*numParticles);
+    float4* velm = (float4*) cu.getPinnedBuffer();
+    cu.getVelm().download(velm);
+    for (int i = 0; i < numParticles; ++i) {
+        float4 vel = velm[i];
+        float* v = &velocities[3*order[i]];
+        v[0] = vel.x;
+        v[1] = vel.y;
+        v[2] = vel.z;
+    }
+}
+
 void CudaUpdateStateDataKernel::setVelocities(ContextImpl& context, const vector<Vec3>& velocities) {
     cu.setAsCurrent();
     const vector<int>& order = cu.getAtomIndex();
@@ -313,6 +457,93 @@ void CudaUpdateStateDataKernel::setVelocities(ContextImpl& context, const vector
     }
 }
 
+void CudaUpdateStateDataKernel::beginStateCopy(ContextImpl& context, bool positions, bool velocities) {
+    cu.setAsCurrent();
+    int posqBytes = cu.getPosq().getSize()*cu.getPosq().getElementSize();
+    int correctionBytes = (cu.getUseMixedPrecision() ? cu.getPosqCorrection().getSize()*cu.getPosqCorrection().getElementSize() : 0);
+    int velmBytes = cu.getVelm().getSize()*cu.getVelm().getElementSize();
+    if (copyMemory == NULL) {
+        // Allocate pinned memory of its own, so other calls that use the context's pinned buffer
+        // cannot overwrite the data before it is retrieved.
+
+        CHECK_RESULT(cuMemHostAlloc(&copyMemory, posqBytes+correctionBytes+velmBytes, 0), "Error allocating pinned memory");
+        CHECK_RESULT(cuEventCreate(&copyEvent, CU_EVENT_DISABLE_TIMING), "Error creating event for copying state");
+    }
+    if (copyPending)
+        CHECK_RESULT(cuEventSynchronize(copyEvent), "Error waiting for state copy");
+
+    // Record the information needed to interpret the data, since it may change before the copy is retrieved.
+
+    copyPositions = positions;
+    copyVelocities = velocities;
+    copyAtomOrder = cu.getAtomIndex();
+    copyCellOffsets = cu.getPosCellOffsets();
+    cu.getPeriodicBoxVectors(copyBoxVectors[0], copyBoxVectors[1], copyBoxVectors[2]);
+
+    // Queue the downloads without waiting for them.  They are ordered before any kernels that are
+    // launched later, so the simulation can continue immediately.
+
+    char* memory = (char*) copyMemory;
+    if (positions) {
+        cu.getPosq().download(memory, false);
+        if (cu.getUseMixedPrecision())
+            cu.getPosqCorrection().download(memory+posqBytes, false);
+    }
+    if (velocities)
+        cu.getVelm().download(memory+posqBytes+correctionBytes, false);
+    CHECK_RESULT(cuEventRecord(copyEvent, cu.getCurrentStream()), "Error recording event for copying state");
+    copyPending = true;
+}
+
+void CudaUpdateStateDataKernel::finishStateCopy(ContextImpl& context, vector<Vec3>& positions, vector<Vec3>& velocities) {
+    if (!copyPending)
+        throw OpenMMException("finishStateCopy() was called without calling beginStateCopy()");
+    cu.setAsCurrent();
+    CHECK_RESULT(cuEventSynchronize(copyEvent), "Error waiting for state copy");
+    copyPending = false;
+    int numParticles = context.getSystem().getNumParticles();
+    int posqBytes = cu.getPosq().getSize()*cu.getPosq().getElementSize();
+    int correctionBytes = (cu.getUseMixedPrecision() ? cu.getPosqCorrection().getSize()*cu.getPosqCorrection().getElementSize() : 0);
+    char* memory = (char*) copyMemory;
+    positions.clear();
+    velocities.clear();
+    if (copyPositions) {
+        positions.resize(numParticles);
+        for (int i = 0; i < numParticles; ++i) {
+            Vec3 pos;
+            if (cu.getUseDoublePrecision()) {
+                double4 p = ((double4*) memory)[i];
+                pos = Vec3(p.x, p.y, p.z);
+            }
+            else if (cu.getUseMixedPrecision()) {
+                float4 p1 = ((float4*) memory)[i];
+                float4 p2 = ((float4*) (memory+posqBytes))[i];
+                pos = Vec3((double)p1.x+(double)p2.x, (double)p1.y+(double)p2.y, (double)p1.z+(double)p2.z);
+            }
+            else {
+                float4 p = ((float4*) memory)[i];
+                pos = Vec3(p.x, p.y, p.z);
+            }
+            mm_int4 offset = copyCellOffsets[i];
+            positions[copyAtomOrder[i]] = pos-copyBoxVectors[0]*offset.x-copyBoxVectors[1]*offset.y-copyBoxVectors[2]*offset.z;
+        }
+    }
+    if (copyVelocities) {
+        velocities.resize(numParticles);
+        char* velm = memory+posqBytes+correctionBytes;
+        for (int i = 0; i < numParticles; ++i) {
+            if (cu.getUseDoublePrecision() || cu.getUseMixedPrecision()) {
+                double4 v = ((double4*) velm)[i];
+                velocities[copyAtomOrder[i]] = Vec3(v.x, v.y, v.z);
+            }
+            else {
+                float4 v = ((float4*) velm)[i];
+                velocities[copyAtomOrder[i]] = Vec3(v.x, v.y, v.z);
+            }
+        }
+    }
+}
+
 void CudaUpdateStateDataKernel::getForces(ContextImpl& context, vector<Vec3>& forces) {
     cu.setAsCurrent();
     long long* force = (long long*) cu.getPinnedBuffer();
@@ -453,6 +684,29 @@ void CudaUpdateStateDataKernel::loadCheckpoint(ContextImpl& context, istream& st
         listener->execute();
 }
 
+void CudaProfileKernel::initialize(const System& system) {
+}
+
+void CudaProfileKernel::setProfilingEnabled(ContextImpl& context, bool enabled) {
+    cu.setProfilingEnabled(enabled);
+}
+
+void CudaProfileKernel::setProfiledForceGroups(ContextImpl& context, int groups) {
+    cu.setProfiledForceGroups(groups);
+}
+
+void CudaProfileKernel::setMemoryOwner(ContextImpl& context, const string& owner) {
+    for (auto ctx : cu.getPlatformData().contexts)
+        ctx->setMemoryOwner(owner);
+}
+
+void CudaProfileKernel::getPerformanceReport(ContextImpl& context, map<string, double>& report) {
+    cu.getPerformanceReport(report);
+    vector<CudaContext*>& contexts = cu.getPlatformData().contexts;
+    for (int i = 1; i < (int) contexts.size(); i++)
+        contexts[i]->getMemoryUsage(report);
+}
+
 void CudaApplyConstraintsKernel::initialize(const System& system) {
 }
 
@@ -652,7 +906,7 @@ void CudaCalcNonbondedForceKernel::initialize(const System& system, const Nonbon
     }
     vector<pair<int, int> > exclusions;
     vector<int> exceptions;
-    map<int, int> exceptionIndex;
+    exceptionIndex.clear();
     for (int i = 0; i < force.getNumExceptions(); i++) {
         int particle1, particle2;
         double chargeProd, sigma, epsilon;
@@ -664,6 +918,23 @@ void CudaCalcNonbondedForceKernel::initialize(const System& system, const Nonbon
         }
     }
 
+    // Sort the exceptions by the atoms they involve.  Consecutive threads then load positions
+    // and accumulate forces for atoms in the same or neighboring blocks, which gives much better
+    // memory coalescing than the arbitrary order in which they were added to the force.
+
+    vector<pair<pair<int, int>, int> > sortedExceptions(exceptions.size());
+    for (int i = 0; i < exceptions.size(); i++) {
+        int particle1, particle2;
+        double chargeProd, sigma, epsilon;
+        force.getExceptionParameters(exceptions[i], particle1, particle2, chargeProd, sigma, epsilon);
+        sortedExceptions[i] = make_pair(make_pair(min(particle1, particle2), max(particle1, particle2)), exceptions[i]);
+    }
+    sort(sortedExceptions.begin(), sortedExceptions.end());
+    for (int i = 0; i < exceptions.size(); i++) {
+        exceptions[i] = sortedExceptions[i].second;
+        exceptionIndex[exceptions[i]] = i;
+    }
+
     // Initialize nonbonded interactions.
 
     int numParticles = force.getNumParticles();
@@ -770,6 +1041,7 @@ void CudaCalcNonbondedForceKernel::initialize(const System& system, const Nonbon
     else if (((nonbondedMethod == PME || nonbondedMethod == LJPME) && hasCoulomb) || doLJPME) {
         // Compute the PME parameters.
 
+        pmeOrder = force.getPMEInterpolationOrder();
         NonbondedForceImpl::calcPMEParameters(system, force, alpha, gridSizeX, gridSizeY, gridSizeZ, false);
         gridSizeX = CudaFFT3D::findLegalDimension(gridSizeX);
         gridSizeY = CudaFFT3D::findLegalDimension(gridSizeY);
@@ -781,6 +1053,11 @@ void CudaCalcNonbondedForceKernel::initialize(const System& system, const Nonbon
             dispersionGridSizeY = CudaFFT3D::findLegalDimension(dispersionGridSizeY);
             dispersionGridSizeZ = CudaFFT3D::findLegalDimension(dispersionGridSizeZ);
         }
+        if (cu.getContextIndex() == 0 && cu.getPlatformData().tunePme) {
+            tunePmeGridSize(cu, gridSizeX, gridSizeY, gridSizeZ);
+            if (doLJPME)
+                tunePmeGridSize(cu, dispersionGridSizeX, dispersionGridSizeY, dispersionGridSizeZ);
+        }
 
         defines["EWALD_ALPHA"] = cu.doubleToString(alpha);
         defines["TWO_OVER_SQRT_PI"] = cu.doubleToString(2.0/sqrt(M_PI));
@@ -803,7 +1080,8 @@ void CudaCalcNonbondedForceKernel::initialize(const System& system, const Nonbon
             cuDeviceGetName(deviceName, 100, cu.getDevice());
             usePmeStream = (!cu.getPlatformData().disablePmeStream && string(deviceName) != "GeForce GTX 980"); // Using a separate stream is slower on GTX 980
             map<string, string> pmeDefines;
-            pmeDefines["PME_ORDER"] = cu.intToString(PmeOrder);
+            pmeDefines["PME_ORDER"] = cu.intToString(pmeOrder);
+            pmeDefines["PME_BRICK_SIZE"] = cu.intToString(PmeBrickSize);
             pmeDefines["NUM_ATOMS"] = cu.intToString(numParticles);
             pmeDefines["PADDED_NUM_ATOMS"] = cu.intToString(cu.getPaddedNumAtoms());
             pmeDefines["RECIP_EXP_FACTOR"] = cu.doubleToString(M_PI*M_PI/(alpha*alpha));
@@ -821,7 +1099,7 @@ void CudaCalcNonbondedForceKernel::initialize(const System& system, const Nonbon
             map<string, string> replacements;
             replacements["CHARGE"] = (usePosqCharges ? "pos.w" : "charges[atom]");
             CUmodule module = cu.createModule(CudaKernelSources::vectorOps+cu.replaceStrings(CudaKernelSources::pme, replacements), pmeDefines);
-            if (cu.getPlatformData().useCpuPme && !doLJPME && usePosqCharges) {
+            if (cu.getPlatformData().useCpuPme && !doLJPME && usePosqCharges && pmeOrder == 5) {
                 // Create the CPU PME kernel.
 
                 try {
@@ -837,8 +1115,12 @@ void CudaCalcNonbondedForceKernel::initialize(const System& system, const Nonbon
                 }
             }
             if (pmeio == NULL) {
-                pmeGridIndexKernel = cu.getKernel(module, "findAtomGridIndex");
-                pmeSpreadChargeKernel = cu.getKernel(module, "gridSpreadCharge");
+                // For large systems, spread the charges one brick of the grid at a time, accumulating
+                // in shared memory.  For small systems there are too few bricks to keep the GPU busy.
+
+                useBrickSpreading = (numParticles >= 100000);
+                pmeGridIndexKernel = cu.getKernel(module, useBrickSpreading ? "findAtomBrickIndex" : "findAtomGridIndex");
+                pmeSpreadChargeKernel = cu.getKernel(module, useBrickSpreading ? "gridSpreadChargeBricks" : "gridSpreadCharge");
                 pmeConvolutionKernel = cu.getKernel(module, "reciprocalConvolution");
                 pmeInterpolateForceKernel = cu.getKernel(module, "gridInterpolateForce");
                 pmeEvalEnergyKernel = cu.getKernel(module, "gridEvaluateEnergy");
@@ -873,10 +1155,10 @@ void CudaCalcNonbondedForceKernel::initialize(const System& system, const Nonbon
                 // Create required data structures.
 
                 int elementSize = (cu.getUseDoublePrecision() ? sizeof(double) : sizeof(float));
-                int roundedZSize = PmeOrder*(int) ceil(gridSizeZ/(double) PmeOrder);
+                int roundedZSize = pmeOrder*(int) ceil(gridSizeZ/(double) pmeOrder);
                 int gridElements = gridSizeX*gridSizeY*roundedZSize;
                 if (doLJPME) {
-                    roundedZSize = PmeOrder*(int) ceil(dispersionGridSizeZ/(double) PmeOrder);
+                    roundedZSize = pmeOrder*(int) ceil(dispersionGridSizeZ/(double) pmeOrder);
                     gridElements = max(gridElements, dispersionGridSizeX*dispersionGridSizeY*roundedZSize);
                 }
                 pmeGrid1.initialize(cu, gridElements, 2*elementSize, "pmeGrid1");
@@ -942,6 +1224,14 @@ void CudaCalcNonbondedForceKernel::initialize(const System& system, const Nonbon
                     cu.addPreComputation(new SyncStreamPreComputation(cu, pmeStream, pmeSyncEvent, recipForceGroup));
                     cu.addPostComputation(new SyncStreamPostComputation(cu, pmeSyncEvent, cu.getKernel(module, "addEnergy"), pmeEnergyBuffer, recipForceGroup));
                 }
+                else if (useCudaFFT) {
+                    cufftSetStream(fftForward, cu.getCurrentStream());
+                    cufftSetStream(fftBackward, cu.getCurrentStream());
+                    if (doLJPME) {
+                        cufftSetStream(dispersionFftForward, cu.getCurrentStream());
+                        cufftSetStream(dispersionFftBackward, cu.getCurrentStream());
+                    }
+                }
                 hasInitializedFFT = true;
 
                 // Initialize the b-spline moduli.
@@ -968,13 +1258,13 @@ void CudaCalcNonbondedForceKernel::initialize(const System& system, const Nonbon
                         zmoduli = &pmeDispersionBsplineModuliZ;
                     }
                     int maxSize = max(max(xsize, ysize), zsize);
-                    vector<double> data(PmeOrder);
-                    vector<double> ddata(PmeOrder);
+                    vector<double> data(pmeOrder);
+                    vector<double> ddata(pmeOrder);
                     vector<double> bsplines_data(maxSize);
-                    data[PmeOrder-1] = 0.0;
+                    data[pmeOrder-1] = 0.0;
                     data[1] = 0.0;
                     data[0] = 1.0;
-                    for (int i = 3; i < PmeOrder; i++) {
+                    for (int i = 3; i < pmeOrder; i++) {
                         double div = 1.0/(i-1.0);
                         data[i-1] = 0.0;
                         for (int j = 1; j < (i-1); j++)
@@ -985,16 +1275,16 @@ void CudaCalcNonbondedForceKernel::initialize(const System& system, const Nonbon
                     // Differentiate.
 
                     ddata[0] = -data[0];
-                    for (int i = 1; i < PmeOrder; i++)
+                    for (int i = 1; i < pmeOrder; i++)
                         ddata[i] = data[i-1]-data[i];
-                    double div = 1.0/(PmeOrder-1);
-                    data[PmeOrder-1] = 0.0;
-                    for (int i = 1; i < (PmeOrder-1); i++)
-                        data[PmeOrder-i-1] = div*(i*data[PmeOrder-i-2]+(PmeOrder-i)*data[PmeOrder-i-1]);
+                    double div = 1.0/(pmeOrder-1);
+                    data[pmeOrder-1] = 0.0;
+                    for (int i = 1; i < (pmeOrder-1); i++)
+                        data[pmeOrder-i-1] = div*(i*data[pmeOrder-i-2]+(pmeOrder-i)*data[pmeOrder-i-1]);
                     data[0] = div*data[0];
                     for (int i = 0; i < maxSize; i++)
                         bsplines_data[i] = 0.0;
-                    for (int i = 1; i <= PmeOrder; i++)
+                    for (int i = 1; i <= pmeOrder; i++)
                         bsplines_data[i] = data[i-1];
 
                     // Evaluate the actual bspline moduli for X/Y/Z.
@@ -1065,6 +1355,7 @@ void CudaCalcNonbondedForceKernel::initialize(const System& system, const Nonbon
     charges.initialize(cu, cu.getPaddedNumAtoms(), cu.getUseDoublePrecision() ? sizeof(double) : sizeof(float), "charges");
     baseParticleParams.initialize<float4>(cu, cu.getPaddedNumAtoms(), "baseParticleParams");
     baseParticleParams.upload(baseParticleParamVec);
+    hostParticleParams = baseParticleParamVec;
     map<string, string> replacements;
     replacements["ONE_4PI_EPS0"] = cu.doubleToString(ONE_4PI_EPS0);
     if (usePosqCharges) {
@@ -1238,12 +1529,16 @@ double CudaCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeF
     // Do reciprocal space calculations.
     
     if (cosSinSums.isInitialized() && includeReciprocal) {
+        OPENMM_TRACE_RANGE("Ewald reciprocal space");
         void* sumsArgs[] = {&cu.getEnergyBuffer().getDevicePointer(), &cu.getPosq().getDevicePointer(), &cosSinSums.getDevicePointer(), cu.getPeriodicBoxSizePointer()};
         cu.executeKernel(ewaldSumsKernel, sumsArgs, cosSinSums.getSize());
-        void* forcesArgs[] = {&cu.getForce().getDevicePointer(), &cu.getPosq().getDevicePointer(), &cosSinSums.getDevicePointer(), cu.getPeriodicBoxSizePointer()};
-        cu.executeKernel(ewaldForcesKernel, forcesArgs, cu.getNumAtoms());
+        if (includeForces) {
+            void* forcesArgs[] = {&cu.getForce().getDevicePointer(), &cu.getPosq().getDevicePointer(), &cosSinSums.getDevicePointer(), cu.getPeriodicBoxSizePointer()};
+            cu.executeKernel(ewaldForcesKernel, forcesArgs, cu.getNumAtoms());
+        }
     }
     if (pmeGrid1.isInitialized() && includeReciprocal) {
+        OPENMM_TRACE_RANGE("PME");
         if (usePmeStream)
             cu.setCurrentStream(pmeStream);
 
@@ -1276,6 +1571,7 @@ double CudaCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeF
         // Execute the reciprocal space kernels.
 
         if (hasCoulomb) {
+            OPENMM_TRACE_RANGE("PME electrostatics");
             void* gridIndexArgs[] = {&cu.getPosq().getDevicePointer(), &pmeAtomGridIndex.getDevicePointer(), cu.getPeriodicBoxSizePointer(),
                     cu.getInvPeriodicBoxSizePointer(), cu.getPeriodicBoxVecXPointer(), cu.getPeriodicBoxVecYPointer(), cu.getPeriodicBoxVecZPointer(),
                     recipBoxVectorPointer[0], recipBoxVectorPointer[1], recipBoxVectorPointer[2]};
@@ -1287,7 +1583,12 @@ double CudaCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeF
                     cu.getInvPeriodicBoxSizePointer(), cu.getPeriodicBoxVecXPointer(), cu.getPeriodicBoxVecYPointer(), cu.getPeriodicBoxVecZPointer(),
                     recipBoxVectorPointer[0], recipBoxVectorPointer[1], recipBoxVectorPointer[2], &pmeAtomGridIndex.getDevicePointer(),
                     &charges.getDevicePointer()};
-            cu.executeKernel(pmeSpreadChargeKernel, spreadArgs, cu.getNumAtoms(), 128);
+            if (useBrickSpreading) {
+                int numBricks = ((gridSizeX+PmeBrickSize-1)/PmeBrickSize)*((gridSizeY+PmeBrickSize-1)/PmeBrickSize)*((gridSizeZ+PmeBrickSize-1)/PmeBrickSize);
+                cu.executeKernel(pmeSpreadChargeKernel, spreadArgs, numBricks*128, 128);
+            }
+            else
+                cu.executeKernel(pmeSpreadChargeKernel, spreadArgs, cu.getNumAtoms(), 128);
 
             void* finishSpreadArgs[] = {&pmeGrid2.getDevicePointer(), &pmeGrid1.getDevicePointer()};
             cu.executeKernel(pmeFinishSpreadChargeKernel, finishSpreadArgs, gridSizeX*gridSizeY*gridSizeZ, 256);
@@ -1314,34 +1615,38 @@ double CudaCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeF
                 cu.executeKernel(pmeEvalEnergyKernel, computeEnergyArgs, gridSizeX*gridSizeY*gridSizeZ);
             }
 
-            void* convolutionArgs[] = {&pmeGrid2.getDevicePointer(), &cu.getEnergyBuffer().getDevicePointer(),
-                    &pmeBsplineModuliX.getDevicePointer(), &pmeBsplineModuliY.getDevicePointer(), &pmeBsplineModuliZ.getDevicePointer(),
-                    cu.getPeriodicBoxSizePointer(), recipBoxVectorPointer[0], recipBoxVectorPointer[1], recipBoxVectorPointer[2]};
-            cu.executeKernel(pmeConvolutionKernel, convolutionArgs, gridSizeX*gridSizeY*gridSizeZ, 256);
+            if (includeForces) {
+                OPENMM_TRACE_RANGE("PME electrostatic forces");
+                void* convolutionArgs[] = {&pmeGrid2.getDevicePointer(), &cu.getEnergyBuffer().getDevicePointer(),
+                        &pmeBsplineModuliX.getDevicePointer(), &pmeBsplineModuliY.getDevicePointer(), &pmeBsplineModuliZ.getDevicePointer(),
+                        cu.getPeriodicBoxSizePointer(), recipBoxVectorPointer[0], recipBoxVectorPointer[1], recipBoxVectorPointer[2]};
+                cu.executeKernel(pmeConvolutionKernel, convolutionArgs, gridSizeX*gridSizeY*gridSizeZ, 256);
 
-            if (useCudaFFT) {
-                if (cu.getUseDoublePrecision()) {
-                    cufftResult result = cufftExecZ2D(fftBackward, (double2*) pmeGrid2.getDevicePointer(), (double*) pmeGrid1.getDevicePointer());
-                    if (result != CUFFT_SUCCESS)
-                        throw OpenMMException("Error executing FFT: "+cu.intToString(result));
-                } else {
-                    cufftResult result = cufftExecC2R(fftBackward, (float2*) pmeGrid2.getDevicePointer(), (float*)  pmeGrid1.getDevicePointer());
-                    if (result != CUFFT_SUCCESS)
-                        throw OpenMMException("Error executing FFT: "+cu.intToString(result));
+                if (useCudaFFT) {
+                    if (cu.getUseDoublePrecision()) {
+                        cufftResult result = cufftExecZ2D(fftBackward, (double2*) pmeGrid2.getDevicePointer(), (double*) pmeGrid1.getDevicePointer());
+                        if (result != CUFFT_SUCCESS)
+                            throw OpenMMException("Error executing FFT: "+cu.intToString(result));
+                    } else {
+                        cufftResult result = cufftExecC2R(fftBackward, (float2*) pmeGrid2.getDevicePointer(), (float*)  pmeGrid1.getDevicePointer());
+                        if (result != CUFFT_SUCCESS)
+                            throw OpenMMException("Error executing FFT: "+cu.intToString(result));
+                    }
+                }
+                else {
+                    fft->execFFT(pmeGrid2, pmeGrid1, false);
                 }
-            }
-            else {
-                fft->execFFT(pmeGrid2, pmeGrid1, false);
-            }
 
-            void* interpolateArgs[] = {&cu.getPosq().getDevicePointer(), &cu.getForce().getDevicePointer(), &pmeGrid1.getDevicePointer(), cu.getPeriodicBoxSizePointer(),
-                    cu.getInvPeriodicBoxSizePointer(), cu.getPeriodicBoxVecXPointer(), cu.getPeriodicBoxVecYPointer(), cu.getPeriodicBoxVecZPointer(),
-                    recipBoxVectorPointer[0], recipBoxVectorPointer[1], recipBoxVectorPointer[2], &pmeAtomGridIndex.getDevicePointer(),
-                    &charges.getDevicePointer()};
-            cu.executeKernel(pmeInterpolateForceKernel, interpolateArgs, cu.getNumAtoms(), 128);
+                void* interpolateArgs[] = {&cu.getPosq().getDevicePointer(), &cu.getForce().getDevicePointer(), &pmeGrid1.getDevicePointer(), cu.getPeriodicBoxSizePointer(),
+                        cu.getInvPeriodicBoxSizePointer(), cu.getPeriodicBoxVecXPointer(), cu.getPeriodicBoxVecYPointer(), cu.getPeriodicBoxVecZPointer(),
+                        recipBoxVectorPointer[0], recipBoxVectorPointer[1], recipBoxVectorPointer[2], &pmeAtomGridIndex.getDevicePointer(),
+                        &charges.getDevicePointer()};
+                cu.executeKernel(pmeInterpolateForceKernel, interpolateArgs, cu.getNumAtoms(), 128);
+            }
         }
 
         if (doLJPME && hasLJ) {
+            OPENMM_TRACE_RANGE("PME dispersion");
             if (!hasCoulomb) {
                 void* gridIndexArgs[] = {&cu.getPosq().getDevicePointer(), &pmeAtomGridIndex.getDevicePointer(), cu.getPeriodicBoxSizePointer(),
                         cu.getInvPeriodicBoxSizePointer(), cu.getPeriodicBoxVecXPointer(), cu.getPeriodicBoxVecYPointer(), cu.getPeriodicBoxVecZPointer(),
@@ -1384,31 +1689,34 @@ double CudaCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeF
                 cu.executeKernel(pmeEvalDispersionEnergyKernel, computeEnergyArgs, dispersionGridSizeX*dispersionGridSizeY*dispersionGridSizeZ);
             }
 
-            void* convolutionArgs[] = {&pmeGrid2.getDevicePointer(), &cu.getEnergyBuffer().getDevicePointer(),
-                    &pmeDispersionBsplineModuliX.getDevicePointer(), &pmeDispersionBsplineModuliY.getDevicePointer(), &pmeDispersionBsplineModuliZ.getDevicePointer(),
-                    cu.getPeriodicBoxSizePointer(), recipBoxVectorPointer[0], recipBoxVectorPointer[1], recipBoxVectorPointer[2]};
-            cu.executeKernel(pmeDispersionConvolutionKernel, convolutionArgs, dispersionGridSizeX*dispersionGridSizeY*dispersionGridSizeZ, 256);
+            if (includeForces) {
+                OPENMM_TRACE_RANGE("PME dispersion forces");
+                void* convolutionArgs[] = {&pmeGrid2.getDevicePointer(), &cu.getEnergyBuffer().getDevicePointer(),
+                        &pmeDispersionBsplineModuliX.getDevicePointer(), &pmeDispersionBsplineModuliY.getDevicePointer(), &pmeDispersionBsplineModuliZ.getDevicePointer(),
+                        cu.getPeriodicBoxSizePointer(), recipBoxVectorPointer[0], recipBoxVectorPointer[1], recipBoxVectorPointer[2]};
+                cu.executeKernel(pmeDispersionConvolutionKernel, convolutionArgs, dispersionGridSizeX*dispersionGridSizeY*dispersionGridSizeZ, 256);
 
-            if (useCudaFFT) {
-                if (cu.getUseDoublePrecision()) {
-                    cufftResult result = cufftExecZ2D(dispersionFftBackward, (double2*) pmeGrid2.getDevicePointer(), (double*) pmeGrid1.getDevicePointer());
-                    if (result != CUFFT_SUCCESS)
-                        throw OpenMMException("Error executing FFT: "+cu.intToString(result));
-                } else {
-                    cufftResult result = cufftExecC2R(dispersionFftBackward, (float2*) pmeGrid2.getDevicePointer(), (float*)  pmeGrid1.getDevicePointer());
-                    if (result != CUFFT_SUCCESS)
-                        throw OpenMMException("Error executing FFT: "+cu.intToString(result));
+                if (useCudaFFT) {
+                    if (cu.getUseDoublePrecision()) {
+                        cufftResult result = cufftExecZ2D(dispersionFftBackward, (double2*) pmeGrid2.getDevicePointer(), (double*) pmeGrid1.getDevicePointer());
+                        if (result != CUFFT_SUCCESS)
+                            throw OpenMMException("Error executing FFT: "+cu.intToString(result));
+                    } else {
+                        cufftResult result = cufftExecC2R(dispersionFftBackward, (float2*) pmeGrid2.getDevicePointer(), (float*)  pmeGrid1.getDevicePointer());
+                        if (result != CUFFT_SUCCESS)
+                            throw OpenMMException("Error executing FFT: "+cu.intToString(result));
+                    }
+                }
+                else {
+                    dispersionFft->execFFT(pmeGrid2, pmeGrid1, false);
                 }
-            }
-            else {
-                dispersionFft->execFFT(pmeGrid2, pmeGrid1, false);
-            }
 
-            void* interpolateArgs[] = {&cu.getPosq().getDevicePointer(), &cu.getForce().getDevicePointer(), &pmeGrid1.getDevicePointer(), cu.getPeriodicBoxSizePointer(),
-                    cu.getInvPeriodicBoxSizePointer(), cu.getPeriodicBoxVecXPointer(), cu.getPeriodicBoxVecYPointer(), cu.getPeriodicBoxVecZPointer(),
-                    recipBoxVectorPointer[0], recipBoxVectorPointer[1], recipBoxVectorPointer[2], &pmeAtomGridIndex.getDevicePointer(),
-                    &sigmaEpsilon.getDevicePointer()};
-            cu.executeKernel(pmeInterpolateDispersionForceKernel, interpolateArgs, cu.getNumAtoms(), 128);
+                void* interpolateArgs[] = {&cu.getPosq().getDevicePointer(), &cu.getForce().getDevicePointer(), &pmeGrid1.getDevicePointer(), cu.getPeriodicBoxSizePointer(),
+                        cu.getInvPeriodicBoxSizePointer(), cu.getPeriodicBoxVecXPointer(), cu.getPeriodicBoxVecYPointer(), cu.getPeriodicBoxVecZPointer(),
+                        recipBoxVectorPointer[0], recipBoxVectorPointer[1], recipBoxVectorPointer[2], &pmeAtomGridIndex.getDevicePointer(),
+                        &sigmaEpsilon.getDevicePointer()};
+                cu.executeKernel(pmeInterpolateDispersionForceKernel, interpolateArgs, cu.getNumAtoms(), 128);
+            }
         }
         if (usePmeStream) {
             cuEventRecord(pmeSyncEvent, pmeStream);
@@ -1439,20 +1747,27 @@ void CudaCalcNonbondedForceKernel::copyParametersToContext(ContextImpl& context,
                 throw OpenMMException("updateParametersInContext: The nonbonded force kernel does not include Lennard-Jones interactions, because all epsilons were originally 0");
         }
     }
-    vector<int> exceptions;
+    int numContexts = cu.getPlatformData().contexts.size();
+    int startIndex = cu.getContextIndex()*exceptionIndex.size()/numContexts;
+    int endIndex = (cu.getContextIndex()+1)*exceptionIndex.size()/numContexts;
+    int numExceptions = endIndex-startIndex;
+    vector<int> exceptions(numExceptions);
     for (int i = 0; i < force.getNumExceptions(); i++) {
         int particle1, particle2;
         double chargeProd, sigma, epsilon;
         force.getExceptionParameters(i, particle1, particle2, chargeProd, sigma, epsilon);
-        if (exceptionAtoms.size() > exceptions.size() && make_pair(particle1, particle2) == exceptionAtoms[exceptions.size()])
-            exceptions.push_back(i);
-        else if (chargeProd != 0.0 || epsilon != 0.0)
-            throw OpenMMException("updateParametersInContext: The set of non-excluded exceptions has changed");
+        auto index = exceptionIndex.find(i);
+        if (index == exceptionIndex.end()) {
+            if (chargeProd != 0.0 || epsilon != 0.0)
+                throw OpenMMException("updateParametersInContext: The set of non-excluded exceptions has changed");
+        }
+        else if (index->second >= startIndex && index->second < endIndex) {
+            int local = index->second-startIndex;
+            if (make_pair(particle1, particle2) != exceptionAtoms[local])
+                throw OpenMMException("updateParametersInContext: The set of non-excluded exceptions has changed");
+            exceptions[local] = i;
+        }
     }
-    int numContexts = cu.getPlatformData().contexts.size();
-    int startIndex = cu.getContextIndex()*exceptions.size()/numContexts;
-    int endIndex = (cu.getContextIndex()+1)*exceptions.size()/numContexts;
-    int numExceptions = endIndex-startIndex;
     
     // Record the per-particle parameters.
     
@@ -1464,6 +1779,7 @@ void CudaCalcNonbondedForceKernel::copyParametersToContext(ContextImpl& context,
         baseParticleParamVec[i] = make_float4(charge, sigma, epsilon, 0);
     }
     baseParticleParams.upload(baseParticleParamVec);
+    hostParticleParams = baseParticleParamVec;
     
     // Record the exceptions.
     
@@ -1472,7 +1788,7 @@ void CudaCalcNonbondedForceKernel::copyParametersToContext(ContextImpl& context,
         vector<float4> baseExceptionParamsVec(numExceptions);
         for (int i = 0; i < numExceptions; i++) {
             double chargeProd, sigma, epsilon;
-            force.getExceptionParameters(exceptions[startIndex+i], atoms[i][0], atoms[i][1], chargeProd, sigma, epsilon);
+            force.getExceptionParameters(exceptions[i], atoms[i][0], atoms[i][1], chargeProd, sigma, epsilon);
             baseExceptionParamsVec[i] = make_float4(chargeProd, sigma, epsilon, 0);
         }
         baseExceptionParams.upload(baseExceptionParamsVec);
@@ -1496,10 +1812,94 @@ void CudaCalcNonbondedForceKernel::copyParametersToContext(ContextImpl& context,
     recomputeParams = true;
 }
 
+void CudaCalcNonbondedForceKernel::copyParameterRangeToContext(ContextImpl& context, const NonbondedForce& force, int firstParticle, int lastParticle, int firstException, int lastException) {
+    // Make sure the new parameters are acceptable.
+    
+    cu.setAsCurrent();
+    if (force.getNumParticles() != cu.getNumAtoms())
+        throw OpenMMException("updateParametersInContext: The number of particles has changed");
+    int numContexts = cu.getPlatformData().contexts.size();
+    int startIndex = cu.getContextIndex()*exceptionIndex.size()/numContexts;
+    int endIndex = (cu.getContextIndex()+1)*exceptionIndex.size()/numContexts;
+    int firstLocalException = -1, lastLocalException = -1;
+    for (int i = firstException; i <= lastException; i++) {
+        int particle1, particle2;
+        double chargeProd, sigma, epsilon;
+        force.getExceptionParameters(i, particle1, particle2, chargeProd, sigma, epsilon);
+        auto index = exceptionIndex.find(i);
+        if (index == exceptionIndex.end()) {
+            if (chargeProd != 0.0 || epsilon != 0.0)
+                throw OpenMMException("updateParametersInContext: The set of non-excluded exceptions has changed");
+        }
+        else if (index->second >= startIndex && index->second < endIndex) {
+            int local = index->second-startIndex;
+            if (make_pair(particle1, particle2) != exceptionAtoms[local])
+                throw OpenMMException("updateParametersInContext: The set of non-excluded exceptions has changed");
+            if (firstLocalException == -1)
+                firstLocalException = local;
+            lastLocalException = local;
+        }
+    }
+    
+    // Record the per-particle parameters.  Only the changed range is uploaded, and the self energy
+    // is updated based on the difference from the old values.
+    
+    bool sigmaEpsilonChanged = false;
+    if (lastParticle >= firstParticle) {
+        vector<float4> baseParticleParamVec(lastParticle-firstParticle+1);
+        for (int i = firstParticle; i <= lastParticle; i++) {
+            double charge, sigma, epsilon;
+            force.getParticleParameters(i, charge, sigma, epsilon);
+            if (!hasCoulomb && charge != 0.0)
+                throw OpenMMException("updateParametersInContext: The nonbonded force kernel does not include Coulomb interactions, because all charges were originally 0");
+            if (!hasLJ && epsilon != 0.0)
+                throw OpenMMException("updateParametersInContext: The nonbonded force kernel does not include Lennard-Jones interactions, because all epsilons were originally 0");
+            baseParticleParamVec[i-firstParticle] = make_float4(charge, sigma, epsilon, 0);
+        }
+        for (int i = firstParticle; i <= lastParticle; i++) {
+            float4 oldParams = hostParticleParams[i];
+            float4 newParams = baseParticleParamVec[i-firstParticle];
+            if (oldParams.y != newParams.y || oldParams.z != newParams.z)
+                sigmaEpsilonChanged = true;
+            if ((nonbondedMethod == Ewald || nonbondedMethod == PME || nonbondedMethod == LJPME) && cu.getContextIndex() == 0) {
+                ewaldSelfEnergy -= (newParams.x*newParams.x-oldParams.x*oldParams.x)*ONE_4PI_EPS0*alpha/sqrt(M_PI);
+                if (doLJPME)
+                    ewaldSelfEnergy += (newParams.z*pow(newParams.y*dispersionAlpha, 6)-oldParams.z*pow(oldParams.y*dispersionAlpha, 6))/3.0;
+            }
+            hostParticleParams[i] = newParams;
+        }
+        baseParticleParams.uploadSubArray(baseParticleParamVec.data(), firstParticle, baseParticleParamVec.size());
+    }
+    
+    // Record the exceptions.
+    
+    if (firstLocalException != -1) {
+        int numExceptions = lastLocalException-firstLocalException+1;
+        vector<float4> baseExceptionParamsVec(numExceptions);
+        for (auto& index : exceptionIndex) {
+            int local = index.second-startIndex;
+            if (local >= firstLocalException && local <= lastLocalException) {
+                int particle1, particle2;
+                double chargeProd, sigma, epsilon;
+                force.getExceptionParameters(index.first, particle1, particle2, chargeProd, sigma, epsilon);
+                baseExceptionParamsVec[local-firstLocalException] = make_float4(chargeProd, sigma, epsilon, 0);
+            }
+        }
+        baseExceptionParams.uploadSubArray(baseExceptionParamsVec.data(), firstLocalException, numExceptions);
+    }
+    
+    // Compute other values.
+    
+    if (sigmaEpsilonChanged && force.getUseDispersionCorrection() && cu.getContextIndex() == 0 && (nonbondedMethod == CutoffPeriodic || nonbondedMethod == Ewald || nonbondedMethod == PME))
+        dispersionCoefficient = NonbondedForceImpl::calcDispersionCorrection(context.getSystem(), force);
+    cu.invalidateMolecules();
+    recomputeParams = true;
+}
+
 void CudaCalcNonbondedForceKernel::getPMEParameters(double& alpha, int& nx, int& ny, int& nz) const {
     if (nonbondedMethod != PME)
         throw OpenMMException("getPMEParametersInContext: This Context is not using PME");
-    if (cu.getPlatformData().useCpuPme)
+    if (pmeio != NULL)
         cpuPme.getAs<CalcPmeReciprocalForceKernel>().getPMEParameters(alpha, nx, ny, nz);
     else {
         alpha = this->alpha;
@@ -1559,7 +1959,7 @@ private:
     CudaArray& invAtomOrder;
 };
 
-void CudaCalcCustomCVForceKernel::initialize(const System& system, const CustomCVForce& force, ContextImpl& innerContext) {
+void CudaCalcCustomCVForceKernel::initialize(const System& system, const CustomCVForce& force) {
     int numCVs = force.getNumCollectiveVariables();
     for (int i = 0; i < force.getNumGlobalParameters(); i++)
         globalParameterNames.push_back(force.getGlobalParameterName(i));
@@ -1592,20 +1992,12 @@ void CudaCalcCustomCVForceKernel::initialize(const System& system, const CustomC
 
     for (auto& function : functions)
         delete function.second;
-
-    // Copy parameter derivatives from the inner context.
-
-    CudaContext& cu2 = *reinterpret_cast<CudaPlatform::PlatformData*>(innerContext.getPlatformData())->contexts[0];
-    for (auto& param : cu2.getEnergyParamDerivNames())
-        cu.addEnergyParameterDerivative(param);
     
     // Create arrays for storing information.
     
     cvForces.resize(numCVs);
     for (int i = 0; i < numCVs; i++)
         cvForces[i].initialize<long long>(cu, 3*cu.getPaddedNumAtoms(), "cvForce");
-    invAtomOrder.initialize<int>(cu, cu.getPaddedNumAtoms(), "invAtomOrder");
-    innerInvAtomOrder.initialize<int>(cu, cu.getPaddedNumAtoms(), "innerInvAtomOrder");
     
     // Create the kernels.
     
@@ -1621,6 +2013,18 @@ void CudaCalcCustomCVForceKernel::initialize(const System& system, const CustomC
     copyStateKernel = cu.getKernel(module, "copyState");
     copyForcesKernel = cu.getKernel(module, "copyForces");
     addForcesKernel = cu.getKernel(module, "addForces");
+}
+
+void CudaCalcCustomCVForceKernel::initialize(const System& system, const CustomCVForce& force, ContextImpl& innerContext) {
+    initialize(system, force);
+
+    // Copy parameter derivatives from the inner context.
+
+    CudaContext& cu2 = *reinterpret_cast<CudaPlatform::PlatformData*>(innerContext.getPlatformData())->contexts[0];
+    for (auto& param : cu2.getEnergyParamDerivNames())
+        cu.addEnergyParameterDerivative(param);
+    invAtomOrder.initialize<int>(cu, cu.getPaddedNumAtoms(), "invAtomOrder");
+    innerInvAtomOrder.initialize<int>(cu, cu.getPaddedNumAtoms(), "innerInvAtomOrder");
 
     // This context needs to respect all forces in the inner context when reordering atoms.
 
@@ -1643,6 +2047,16 @@ double CudaCalcCustomCVForceKernel::execute(ContextImpl& context, ContextImpl& i
         cu.executeKernel(copyForcesKernel, copyForcesArgs, numAtoms);
         innerContext.getEnergyParameterDerivatives(cvDerivs[i]);
     }
+    return execute(context, cvValues, cvDerivs, true, includeEnergy);
+}
+
+void CudaCalcCustomCVForceKernel::copyVariableForces(ContextImpl& context, int index) {
+    cu.getForce().copyTo(cvForces[index]);
+}
+
+double CudaCalcCustomCVForceKernel::execute(ContextImpl& context, const vector<double>& cvValues, const vector<map<string, double> >& cvDerivs, bool includeForces, bool includeEnergy) {
+    int numCVs = variableNames.size();
+    int numAtoms = cu.getNumAtoms();
     
     // Compute the energy and forces.
     
@@ -1667,7 +2081,8 @@ double CudaCalcCustomCVForceKernel::execute(ContextImpl& context, ContextImpl& i
         else
             addForcesArgs.push_back(&dEdVFloat[i]);
     }
-    cu.executeKernel(addForcesKernel, &addForcesArgs[0], numAtoms);
+    if (includeForces)
+        cu.executeKernel(addForcesKernel, &addForcesArgs[0], numAtoms);
     
     // Compute the energy parameter derivatives.
     
@@ -1732,6 +2147,66 @@ void CudaCalcCustomCVForceKernel::copyParametersToContext(ContextImpl& context,
         delete function.second;
 }
 
+CudaIntegrateLangevinMiddleStepKernel::~CudaIntegrateLangevinMiddleStepKernel() {
+    cu.setAsCurrent();
+    clearGraphs();
+}
+
+void CudaIntegrateLangevinMiddleStepKernel::clearGraphs() {
+#if CUDA_VERSION >= 10010
+    if (graph != NULL)
+        cuGraphExecDestroy(graph);
+    graph = NULL;
+#endif
+}
+
+void CudaIntegrateLangevinMiddleStepKernel::integrate(double tolerance) {
+#if CUDA_VERSION >= 10010
+    CUstream stream = cu.getCurrentStream();
+    bool canUseGraphs = (cu.getUseCudaGraphs() && stream != 0 && !cu.getIntegrationUtilities().getConstraintsRequireSync() && !cu.getProfilingEnabled());
+    if (canUseGraphs && tolerance != graphTolerance) {
+        // Something the captured kernels depend on has changed, so run one step normally and then
+        // capture them again.
+
+        clearGraphs();
+        graphTolerance = tolerance;
+        hasExecutedStep = false;
+    }
+    if (canUseGraphs && hasExecutedStep) {
+        if (graph == NULL) {
+            // Random numbers are generated from a counter stored on the device, so the same graph
+            // can be replayed on every step.
+
+            CUgraph capturedGraph = NULL;
+            CHECK_RESULT(cuStreamBeginCapture(stream, CU_STREAM_CAPTURE_MODE_THREAD_LOCAL), "Error beginning graph capture");
+            try {
+                CommonIntegrateLangevinMiddleStepKernel::integrate(tolerance);
+            }
+            catch (...) {
+                cuStreamEndCapture(stream, &capturedGraph);
+                if (capturedGraph != NULL)
+                    cuGraphDestroy(capturedGraph);
+                throw;
+            }
+            CHECK_RESULT(cuStreamEndCapture(stream, &capturedGraph), "Error ending graph capture");
+            CUgraphExec graphExec;
+#if CUDA_VERSION >= 11040
+            CUresult result = cuGraphInstantiateWithFlags(&graphExec, capturedGraph, 0);
+#else
+            CUresult result = cuGraphInstantiate(&graphExec, capturedGraph, NULL, NULL, 0);
+#endif
+            cuGraphDestroy(capturedGraph);
+            CHECK_RESULT(result, "Error instantiating graph");
+            graph = graphExec;
+        }
+        CHECK_RESULT(cuGraphLaunch(graph, stream), "Error launching graph");
+        return;
+    }
+#endif
+    CommonIntegrateLangevinMiddleStepKernel::integrate(tolerance);
+    hasExecutedStep = true;
+}
+
 void CudaApplyMonteCarloBarostatKernel::initialize(const System& system, const Force& thermostat) {
     cu.setAsCurrent();
     savedPositions.initialize(cu, cu.getPaddedNumAtoms(), cu.getUseDoublePrecision() ? sizeof(double4) : sizeof(float4), "savedPositions");
@@ -1807,3 +2282,13 @@ void CudaApplyMonteCarloBarostatKernel::restoreCoordinates(ContextImpl& context)
         throw OpenMMException(m.str());
     }
 }
+
+ComputeContext* CudaSwapStateKernel::getComputeContext(ContextImpl& other) {
+    CudaPlatform::PlatformData& data = *reinterpret_cast<CudaPlatform::PlatformData*>(other.getPlatformData());
+    if (data.contexts.size() != 1 || cu.getPlatformData().contexts.size() != 1)
+        return NULL;
+    CudaContext& cu2 = *data.contexts[0];
+    if (cu2.getContext() != cu.getContext())
+        return NULL;
+    return &cu2;
+}
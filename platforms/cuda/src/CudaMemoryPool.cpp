@@ -0,0 +1,175 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2024 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * This program is free software: you can redistribute it and/or modify       *
+ * it under the terms of the GNU Lesser General Public License as published   *
+ * by the Free Software Foundation, either version 3 of the License, or       *
+ * (at your option) any later version.                                        *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU Lesser General Public License for more details.                        *
+ *                                                                            *
+ * You should have received a copy of the GNU Lesser General Public License   *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.      *
+ * -------------------------------------------------------------------------- */
+
+#include "CudaMemoryPool.h"
+
+using namespace OpenMM;
+using namespace std;
+
+pthread_mutex_t CudaMemoryPool::poolsLock = PTHREAD_MUTEX_INITIALIZER;
+map<CUcontext, CudaMemoryPool*> CudaMemoryPool::pools;
+
+CudaMemoryPool* CudaMemoryPool::acquire(CUcontext context) {
+    pthread_mutex_lock(&poolsLock);
+    CudaMemoryPool* pool;
+    auto existing = pools.find(context);
+    if (existing == pools.end()) {
+        pool = new CudaMemoryPool(context);
+        pools[context] = pool;
+    }
+    else
+        pool = existing->second;
+    pool->referenceCount++;
+    pthread_mutex_unlock(&poolsLock);
+    return pool;
+}
+
+void CudaMemoryPool::release(CudaMemoryPool* pool) {
+    pthread_mutex_lock(&poolsLock);
+    if (--pool->referenceCount == 0) {
+        pools.erase(pool->context);
+        delete pool;
+    }
+    pthread_mutex_unlock(&poolsLock);
+}
+
+CudaMemoryPool::CudaMemoryPool(CUcontext context) : context(context), referenceCount(0) {
+    pthread_mutex_init(&lock, NULL);
+    stats.bytesInUse = 0;
+    stats.bytesCached = 0;
+    stats.peakBytesInUse = 0;
+    stats.numDeviceAllocations = 0;
+    stats.numReusedAllocations = 0;
+}
+
+CudaMemoryPool::~CudaMemoryPool() {
+    releaseCachedMemoryLocked();
+    pthread_mutex_destroy(&lock);
+}
+
+size_t CudaMemoryPool::getSizeClass(size_t size) {
+    // Round up to a multiple of 256 bytes for small blocks.  Larger ones are rounded up to
+    // 1, 1.25, 1.5, or 1.75 times a power of two, so at most 25% of a block is wasted.
+
+    const size_t minSize = 256;
+    if (size <= 4*minSize)
+        return max(minSize, (size+minSize-1)/minSize*minSize);
+    size_t power = 4*minSize;
+    while (2*power < size)
+        power *= 2;
+    size_t step = power/4;
+    return (size+step-1)/step*step;
+}
+
+CUresult CudaMemoryPool::allocate(CUdeviceptr& pointer, size_t size, CUstream stream) {
+    size_t sizeClass = getSizeClass(size);
+    pthread_mutex_lock(&lock);
+
+    // Look for a cached block that is safe to use on this stream.
+
+    vector<Block>& blocks = cache[sizeClass];
+    for (int i = blocks.size()-1; i >= 0; i--) {
+        Block& block = blocks[i];
+        if (block.stream == stream || cuEventQuery(block.event) == CUDA_SUCCESS) {
+            pointer = block.pointer;
+            cuEventDestroy(block.event);
+            blocks.erase(blocks.begin()+i);
+            stats.bytesCached -= sizeClass;
+            stats.bytesInUse += sizeClass;
+            stats.peakBytesInUse = max(stats.peakBytesInUse, stats.bytesInUse);
+            stats.numReusedAllocations++;
+            pthread_mutex_unlock(&lock);
+            return CUDA_SUCCESS;
+        }
+    }
+
+    // Allocate new memory.  If there isn't enough, free the cache and try again.
+
+    CUresult result = cuMemAlloc(&pointer, sizeClass);
+    if (result == CUDA_ERROR_OUT_OF_MEMORY && stats.bytesCached > 0) {
+        releaseCachedMemoryLocked();
+        result = cuMemAlloc(&pointer, sizeClass);
+    }
+    if (result == CUDA_SUCCESS) {
+        stats.bytesInUse += sizeClass;
+        stats.peakBytesInUse = max(stats.peakBytesInUse, stats.bytesInUse);
+        stats.numDeviceAllocations++;
+    }
+    pthread_mutex_unlock(&lock);
+    return result;
+}
+
+CUresult CudaMemoryPool::free(CUdeviceptr pointer, size_t size, CUstream stream) {
+    size_t sizeClass = getSizeClass(size);
+    Block block;
+    block.pointer = pointer;
+    block.stream = stream;
+    CUresult result = cuEventCreate(&block.event, CU_EVENT_DISABLE_TIMING);
+    if (result == CUDA_SUCCESS) {
+        result = cuEventRecord(block.event, stream);
+        if (result != CUDA_SUCCESS)
+            cuEventDestroy(block.event);
+    }
+    pthread_mutex_lock(&lock);
+    stats.bytesInUse -= sizeClass;
+    if (result == CUDA_SUCCESS) {
+        cache[sizeClass].push_back(block);
+        stats.bytesCached += sizeClass;
+    }
+    pthread_mutex_unlock(&lock);
+    if (result != CUDA_SUCCESS) {
+        // We can't track when the block will be safe to reuse, so just free it.
+
+        result = cuMemFree(pointer);
+    }
+    return result;
+}
+
+void CudaMemoryPool::releaseCachedMemory() {
+    pthread_mutex_lock(&lock);
+    releaseCachedMemoryLocked();
+    pthread_mutex_unlock(&lock);
+}
+
+void CudaMemoryPool::releaseCachedMemoryLocked() {
+    // cuMemFree() waits for any work that is still using the memory.
+
+    for (auto& entry : cache) {
+        for (Block& block : entry.second) {
+            cuEventDestroy(block.event);
+            cuMemFree(block.pointer);
+        }
+    }
+    cache.clear();
+    stats.bytesCached = 0;
+}
+
+CudaMemoryPool::Statistics CudaMemoryPool::getStatistics() {
+    pthread_mutex_lock(&lock);
+    Statistics result = stats;
+    pthread_mutex_unlock(&lock);
+    return result;
+}
@@ -25,6 +25,7 @@
  * -------------------------------------------------------------------------- */
 
 #include "openmm/OpenMMException.h"
+#include "openmm/internal/TraceRange.h"
 #include "CudaNonbondedUtilities.h"
 #include "CudaArray.h"
 #include "CudaContext.h"
@@ -32,6 +33,7 @@
 #include "CudaExpressionUtilities.h"
 #include "CudaSort.h"
 #include <algorithm>
+#include <climits>
 #include <map>
 #include <set>
 #include <utility>
@@ -63,17 +65,27 @@ private:
     bool useDouble;
 };
 
-CudaNonbondedUtilities::CudaNonbondedUtilities(CudaContext& context) : context(context), useCutoff(false), usePeriodic(false), anyExclusions(false), usePadding(true),
-        blockSorter(NULL), pinnedCountBuffer(NULL), forceRebuildNeighborList(true), lastCutoff(0.0), groupFlags(0), canUsePairList(true) {
+CudaNonbondedUtilities::CudaNonbondedUtilities(CudaContext& context) : context(context), useCutoff(false), usePeriodic(false), usePadding(true),
+        usePruning(false), blockSorter(NULL), pinnedCountBuffer(NULL), forceRebuildNeighborList(true), hasPendingCount(false), lastCutoff(0.0), groupFlags(0), canUsePairList(true),
+        numNeighborListEvaluations(0), numNeighborListBuilds(0), numNeighborListReallocations(0) {
     // Decide how many thread blocks to use.
 
     string errorMessage = "Error initializing nonbonded utilities";
     int multiprocessors;
     CHECK_RESULT(cuDeviceGetAttribute(&multiprocessors, CU_DEVICE_ATTRIBUTE_MULTIPROCESSOR_COUNT, context.getDevice()));
     CHECK_RESULT(cuEventCreate(&downloadCountEvent, 0));
-    CHECK_RESULT(cuMemHostAlloc((void**) &pinnedCountBuffer, 2*sizeof(int), CU_MEMHOSTALLOC_PORTABLE));
+    CHECK_RESULT(cuMemHostAlloc((void**) &pinnedCountBuffer, 3*sizeof(unsigned int), CU_MEMHOSTALLOC_PORTABLE));
     numForceThreadBlocks = 4*multiprocessors;
     forceThreadBlockSize = (context.getComputeCapability() < 2.0 ? 128 : 256);
+
+    // Each warp processes whole tiles, so for a small system there may be far fewer tiles than warps.
+    // Launching only as many blocks as can have work (but at least one per multiprocessor) avoids
+    // the cost of scheduling blocks that would exit immediately.
+
+    long long totalTiles = context.getNumAtomBlocks()*((long long) context.getNumAtomBlocks()+1)/2;
+    long long blocksWithWork = (totalTiles*CudaContext::TileSize+forceThreadBlockSize-1)/forceThreadBlockSize;
+    if (blocksWithWork < numForceThreadBlocks)
+        numForceThreadBlocks = max(multiprocessors, (int) blocksWithWork);
     setKernelSource(CudaKernelSources::nonbonded);
 }
 
@@ -98,8 +110,12 @@ void CudaNonbondedUtilities::addInteraction(bool usesCutoff, bool usesPeriodic,
         if (usesCutoff && groupCutoff.find(forceGroup) != groupCutoff.end() && groupCutoff[forceGroup] != cutoffDistance)
             throw OpenMMException("All Forces in a single force group must use the same cutoff distance");
     }
-    if (usesExclusions)
-        requestExclusions(exclusionList);
+    int exclusionSet = 0;
+    if (usesExclusions) {
+        exclusionSet = requestExclusions(exclusionList);
+        if (exclusionSet != 0 && kernel.size() == 0)
+            throw OpenMMException("All Forces must have identical exceptions");
+    }
     useCutoff = usesCutoff;
     usePeriodic = usesPeriodic;
     groupCutoff[forceGroup] = cutoffDistance;
@@ -111,7 +127,14 @@ void CudaNonbondedUtilities::addInteraction(bool usesCutoff, bool usesPeriodic,
         map<string, string> replacements;
         replacements["CUTOFF"] = "CUTOFF_"+context.intToString(forceGroup);
         replacements["CUTOFF_SQUARED"] = "CUTOFF_"+context.intToString(forceGroup)+"_SQUARED";
-        groupKernelSource[forceGroup] += context.replaceStrings(kernel, replacements)+"\n";
+        if (exclusionSet == 0)
+            groupKernelSource[forceGroup] += context.replaceStrings(kernel, replacements)+"\n";
+        else {
+            // Evaluate the interaction with the exclusion flags from its own set.
+
+            string setIndex = context.intToString(exclusionSet);
+            groupKernelSource[forceGroup] += "{\nbool isExcluded = isExcluded"+setIndex+";\n"+context.replaceStrings(kernel, replacements)+"\n}\n";
+        }
     }
 }
 
@@ -126,11 +149,13 @@ void CudaNonbondedUtilities::addParameter(const ParameterInfo& parameter) {
 
 void CudaNonbondedUtilities::addArgument(ComputeParameterInfo parameter) {
     arguments.push_back(ParameterInfo(parameter.getName(), parameter.getComponentType(), parameter.getNumComponents(),
-            parameter.getSize(), context.unwrap(parameter.getArray()).getDevicePointer()));
+            parameter.getSize(), context.unwrap(parameter.getArray()).getDevicePointer(), parameter.isConstant()));
+    argumentLengths.push_back(parameter.getArray().getSize());
 }
 
 void CudaNonbondedUtilities::addArgument(const ParameterInfo& parameter) {
     arguments.push_back(parameter);
+    argumentLengths.push_back(0);
 }
 
 string CudaNonbondedUtilities::addEnergyParameterDerivative(const string& param) {
@@ -146,8 +171,9 @@ string CudaNonbondedUtilities::addEnergyParameterDerivative(const string& param)
     return string("energyParamDeriv")+context.intToString(index);
 }
 
-void CudaNonbondedUtilities::requestExclusions(const vector<vector<int> >& exclusionList) {
-    if (anyExclusions) {
+int CudaNonbondedUtilities::requestExclusions(const vector<vector<int> >& exclusionList) {
+    for (int index = 0; index < (int) exclusionSets.size(); index++) {
+        const vector<vector<int> >& atomExclusions = exclusionSets[index];
         bool sameExclusions = (exclusionList.size() == atomExclusions.size());
         for (int i = 0; i < (int) exclusionList.size() && sameExclusions; i++) {
              if (exclusionList[i].size() != atomExclusions[i].size())
@@ -158,13 +184,11 @@ void CudaNonbondedUtilities::requestExclusions(const vector<vector<int> >& exclu
                 if (expectedExclusions.find(exclusionList[i][j]) == expectedExclusions.end())
                      sameExclusions = false;
         }
-        if (!sameExclusions)
-            throw OpenMMException("All Forces must have identical exceptions");
-    }
-    else {
-        atomExclusions = exclusionList;
-        anyExclusions = true;
+        if (sameExclusions)
+            return index;
     }
+    exclusionSets.push_back(exclusionList);
+    return exclusionSets.size()-1;
 }
 
 static bool compareInt2(int2 a, int2 b) {
@@ -173,13 +197,15 @@ static bool compareInt2(int2 a, int2 b) {
 
 void CudaNonbondedUtilities::initialize(const System& system) {
     string errorMessage = "Error initializing nonbonded utilities";    
-    if (atomExclusions.size() == 0) {
+    if (exclusionSets.size() == 0) {
         // No exclusions were specifically requested, so just mark every atom as not interacting with itself.
         
-        atomExclusions.resize(context.getNumAtoms());
-        for (int i = 0; i < (int) atomExclusions.size(); i++)
-            atomExclusions[i].push_back(i);
+        exclusionSets.resize(1);
+        exclusionSets[0].resize(context.getNumAtoms());
+        for (int i = 0; i < (int) exclusionSets[0].size(); i++)
+            exclusionSets[0][i].push_back(i);
     }
+    numExclusionSets = exclusionSets.size();
 
     // Create the list of tiles.
 
@@ -188,23 +214,24 @@ void CudaNonbondedUtilities::initialize(const System& system) {
     int numContexts = context.getPlatformData().contexts.size();
     setAtomBlockRange(context.getContextIndex()/(double) numContexts, (context.getContextIndex()+1)/(double) numContexts);
 
-    // Build a list of tiles that contain exclusions.
+    // Build a list of tiles that contain exclusions in any exclusion set.
 
     set<pair<int, int> > tilesWithExclusions;
-    for (int atom1 = 0; atom1 < (int) atomExclusions.size(); ++atom1) {
-        int x = atom1/CudaContext::TileSize;
-        for (int j = 0; j < (int) atomExclusions[atom1].size(); ++j) {
-            int atom2 = atomExclusions[atom1][j];
-            int y = atom2/CudaContext::TileSize;
-            tilesWithExclusions.insert(make_pair(max(x, y), min(x, y)));
+    for (auto& atomExclusions : exclusionSets)
+        for (int atom1 = 0; atom1 < (int) atomExclusions.size(); ++atom1) {
+            int x = atom1/CudaContext::TileSize;
+            for (int j = 0; j < (int) atomExclusions[atom1].size(); ++j) {
+                int atom2 = atomExclusions[atom1][j];
+                int y = atom2/CudaContext::TileSize;
+                tilesWithExclusions.insert(make_pair(max(x, y), min(x, y)));
+            }
         }
-    }
     vector<int2> exclusionTilesVec;
     for (set<pair<int, int> >::const_iterator iter = tilesWithExclusions.begin(); iter != tilesWithExclusions.end(); ++iter)
         exclusionTilesVec.push_back(make_int2(iter->first, iter->second));
     sort(exclusionTilesVec.begin(), exclusionTilesVec.end(), compareInt2);
     exclusionTiles.initialize<int2>(context, exclusionTilesVec.size(), "exclusionTiles");
-    exclusionTiles.upload(exclusionTilesVec);
+    exclusionTiles.uploadShared(exclusionTilesVec);
     map<pair<int, int>, int> exclusionTileMap;
     for (int i = 0; i < (int) exclusionTilesVec.size(); i++) {
         int2 tile = exclusionTilesVec[i];
@@ -227,33 +254,67 @@ void CudaNonbondedUtilities::initialize(const System& system) {
         maxExclusions = (maxExclusions > exclusionBlocksForBlock[i].size() ? maxExclusions : exclusionBlocksForBlock[i].size());
     exclusionIndices.initialize<unsigned int>(context, exclusionIndicesVec.size(), "exclusionIndices");
     exclusionRowIndices.initialize<unsigned int>(context, exclusionRowIndicesVec.size(), "exclusionRowIndices");
-    exclusionIndices.upload(exclusionIndicesVec);
-    exclusionRowIndices.upload(exclusionRowIndicesVec);
+    exclusionIndices.uploadShared(exclusionIndicesVec);
+    exclusionRowIndices.uploadShared(exclusionRowIndicesVec);
 
-    // Record the exclusion data.
+    // Record the exclusion data.  The first exclusion set has a block of flags for every tile in the list.  Other
+    // sets usually match it in most tiles, and in highly bonded systems many tiles repeat the same few patterns, so
+    // for those sets we only store an index for each tile.  It identifies a block of flags, and a new block is added
+    // only when the flags do not match any block that is already stored.
 
-    exclusions.initialize<tileflags>(context, tilesWithExclusions.size()*CudaContext::TileSize, "exclusions");
+    int numExclusionTiles = exclusionTilesVec.size();
+    int exclusionSetSize = numExclusionTiles*CudaContext::TileSize;
     tileflags allFlags = (tileflags) -1;
-    vector<tileflags> exclusionVec(exclusions.getSize(), allFlags);
-    for (int atom1 = 0; atom1 < (int) atomExclusions.size(); ++atom1) {
-        int x = atom1/CudaContext::TileSize;
-        int offset1 = atom1-x*CudaContext::TileSize;
-        for (int j = 0; j < (int) atomExclusions[atom1].size(); ++j) {
-            int atom2 = atomExclusions[atom1][j];
-            int y = atom2/CudaContext::TileSize;
-            int offset2 = atom2-y*CudaContext::TileSize;
-            if (x > y) {
-                int index = exclusionTileMap[make_pair(x, y)]*CudaContext::TileSize;
-                exclusionVec[index+offset1] &= allFlags-(1<<offset2);
+    vector<tileflags> exclusionVec;
+    vector<int> exclusionSetTilesVec;
+    map<vector<tileflags>, int> blockIndex;
+    for (int setIndex = 0; setIndex < numExclusionSets; setIndex++) {
+        vector<tileflags> setFlags(exclusionSetSize, allFlags);
+        const vector<vector<int> >& atomExclusions = exclusionSets[setIndex];
+        for (int atom1 = 0; atom1 < (int) atomExclusions.size(); ++atom1) {
+            int x = atom1/CudaContext::TileSize;
+            int offset1 = atom1-x*CudaContext::TileSize;
+            for (int j = 0; j < (int) atomExclusions[atom1].size(); ++j) {
+                int atom2 = atomExclusions[atom1][j];
+                int y = atom2/CudaContext::TileSize;
+                int offset2 = atom2-y*CudaContext::TileSize;
+                if (x > y) {
+                    int index = exclusionTileMap[make_pair(x, y)]*CudaContext::TileSize;
+                    setFlags[index+offset1] &= allFlags-(1<<offset2);
+                }
+                else {
+                    int index = exclusionTileMap[make_pair(y, x)]*CudaContext::TileSize;
+                    setFlags[index+offset2] &= allFlags-(1<<offset1);
+                }
             }
-            else {
-                int index = exclusionTileMap[make_pair(y, x)]*CudaContext::TileSize;
-                exclusionVec[index+offset2] &= allFlags-(1<<offset1);
+        }
+        for (int tile = 0; tile < numExclusionTiles; tile++) {
+            auto start = setFlags.begin()+tile*CudaContext::TileSize;
+            if (setIndex > 0 && equal(start, start+CudaContext::TileSize, exclusionVec.begin()+tile*CudaContext::TileSize)) {
+                exclusionSetTilesVec.push_back(tile);
+                continue;
+            }
+            vector<tileflags> block(start, start+CudaContext::TileSize);
+            auto existing = blockIndex.find(block);
+            if (setIndex > 0 && existing != blockIndex.end()) {
+                exclusionSetTilesVec.push_back(existing->second);
+                continue;
             }
+            int index = exclusionVec.size()/CudaContext::TileSize;
+            if (existing == blockIndex.end())
+                blockIndex[block] = index;
+            exclusionVec.insert(exclusionVec.end(), block.begin(), block.end());
+            if (setIndex > 0)
+                exclusionSetTilesVec.push_back(index);
         }
     }
-    atomExclusions.clear(); // We won't use this again, so free the memory it used
-    exclusions.upload(exclusionVec);
+    exclusionSets.clear(); // We won't use this again, so free the memory it used
+    exclusions.initialize<tileflags>(context, exclusionVec.size(), "exclusions");
+    exclusions.uploadShared(exclusionVec);
+    if (exclusionSetTilesVec.size() == 0)
+        exclusionSetTilesVec.push_back(0);
+    exclusionSetTiles.initialize<int>(context, exclusionSetTilesVec.size(), "exclusionSetTiles");
+    exclusionSetTiles.uploadShared(exclusionSetTilesVec);
 
     // Create data structures for the neighbor list.
 
@@ -268,7 +329,7 @@ void CudaNonbondedUtilities::initialize(const System& system) {
             maxTiles = 1;
         maxSinglePairs = 5*numAtoms;
         interactingTiles.initialize<int>(context, maxTiles, "interactingTiles");
-        interactingAtoms.initialize<int>(context, CudaContext::TileSize*maxTiles, "interactingAtoms");
+        interactingAtoms.initialize(context, maxTiles, CudaContext::TileSize*sizeof(int), "interactingAtoms");
         interactionCount.initialize<unsigned int>(context, 2, "interactionCount");
         singlePairs.initialize<int2>(context, maxSinglePairs, "singlePairs");
         int elementSize = (context.getUseDoublePrecision() ? sizeof(double) : sizeof(float));
@@ -279,10 +340,30 @@ void CudaNonbondedUtilities::initialize(const System& system) {
         sortedBlockBoundingBox.initialize(context, numAtomBlocks+1, 4*elementSize, "sortedBlockBoundingBox");
         oldPositions.initialize(context, numAtoms, 4*elementSize, "oldPositions");
         rebuildNeighborList.initialize<int>(context, 1, "rebuildNeighborList");
+        oldBoxSize.initialize(context, 2, 4*elementSize, "oldBoxSize");
         blockSorter = new CudaSort(context, new BlockSortTrait(context.getUseDoublePrecision()), numAtomBlocks);
         vector<unsigned int> count(2, 0);
         interactionCount.upload(count);
         rebuildNeighborList.upload(&count[0]);
+        if (context.getUseDoublePrecision()) {
+            vector<double4> box(2, make_double4(1, 1, 1, 0));
+            oldBoxSize.upload(box);
+        }
+        else {
+            vector<float4> box(2, make_float4(1, 1, 1, 0));
+            oldBoxSize.upload(box);
+        }
+        usePruning = usePadding;
+        if (usePruning) {
+            prunedTiles.initialize<int>(context, maxTiles, "prunedTiles");
+            prunedAtoms.initialize(context, maxTiles, CudaContext::TileSize*sizeof(int), "prunedAtoms");
+            prunedInteractionCount.initialize<unsigned int>(context, 2, "prunedInteractionCount");
+            prunedSinglePairs.initialize<int2>(context, maxSinglePairs, "prunedSinglePairs");
+            prunePositions.initialize(context, numAtoms, 4*elementSize, "prunePositions");
+            pruneNeighborList.initialize<int>(context, 1, "pruneNeighborList");
+            prunedInteractionCount.upload(count);
+            pruneNeighborList.upload(&count[0]);
+        }
     }
 
     // Record arguments for kernels.
@@ -292,11 +373,12 @@ void CudaNonbondedUtilities::initialize(const System& system) {
     forceArgs.push_back(&context.getPosq().getDevicePointer());
     forceArgs.push_back(&exclusions.getDevicePointer());
     forceArgs.push_back(&exclusionTiles.getDevicePointer());
+    forceArgs.push_back(&exclusionSetTiles.getDevicePointer());
     forceArgs.push_back(&startTileIndex);
     forceArgs.push_back(&numTiles);
     if (useCutoff) {
-        forceArgs.push_back(&interactingTiles.getDevicePointer());
-        forceArgs.push_back(&interactionCount.getDevicePointer());
+        forceArgs.push_back(&getInteractingTiles().getDevicePointer());
+        forceArgs.push_back(&getInteractionCount().getDevicePointer());
         forceArgs.push_back(context.getPeriodicBoxSizePointer());
         forceArgs.push_back(context.getInvPeriodicBoxSizePointer());
         forceArgs.push_back(context.getPeriodicBoxVecXPointer());
@@ -305,9 +387,9 @@ void CudaNonbondedUtilities::initialize(const System& system) {
         forceArgs.push_back(&maxTiles);
         forceArgs.push_back(&blockCenter.getDevicePointer());
         forceArgs.push_back(&blockBoundingBox.getDevicePointer());
-        forceArgs.push_back(&interactingAtoms.getDevicePointer());
+        forceArgs.push_back(&getInteractingAtoms().getDevicePointer());
         forceArgs.push_back(&maxSinglePairs);
-        forceArgs.push_back(&singlePairs.getDevicePointer());
+        forceArgs.push_back(&getSinglePairs().getDevicePointer());
     }
     for (int i = 0; i < (int) parameters.size(); i++)
         forceArgs.push_back(&parameters[i].getMemory());
@@ -327,6 +409,8 @@ void CudaNonbondedUtilities::initialize(const System& system) {
         findBlockBoundsArgs.push_back(&blockBoundingBox.getDevicePointer());
         findBlockBoundsArgs.push_back(&rebuildNeighborList.getDevicePointer());
         findBlockBoundsArgs.push_back(&sortedBlocks.getDevicePointer());
+        if (usePruning)
+            findBlockBoundsArgs.push_back(&pruneNeighborList.getDevicePointer());
         sortBoxDataArgs.push_back(&sortedBlocks.getDevicePointer());
         sortBoxDataArgs.push_back(&blockCenter.getDevicePointer());
         sortBoxDataArgs.push_back(&blockBoundingBox.getDevicePointer());
@@ -337,6 +421,13 @@ void CudaNonbondedUtilities::initialize(const System& system) {
         sortBoxDataArgs.push_back(&interactionCount.getDevicePointer());
         sortBoxDataArgs.push_back(&rebuildNeighborList.getDevicePointer());
         sortBoxDataArgs.push_back(&forceRebuildNeighborList);
+        sortBoxDataArgs.push_back(context.getPeriodicBoxSizePointer());
+        sortBoxDataArgs.push_back(&oldBoxSize.getDevicePointer());
+        if (usePruning) {
+            sortBoxDataArgs.push_back(&prunePositions.getDevicePointer());
+            sortBoxDataArgs.push_back(&prunedInteractionCount.getDevicePointer());
+            sortBoxDataArgs.push_back(&pruneNeighborList.getDevicePointer());
+        }
         findInteractingBlocksArgs.push_back(context.getPeriodicBoxSizePointer());
         findInteractingBlocksArgs.push_back(context.getInvPeriodicBoxSizePointer());
         findInteractingBlocksArgs.push_back(context.getPeriodicBoxVecXPointer());
@@ -358,6 +449,30 @@ void CudaNonbondedUtilities::initialize(const System& system) {
         findInteractingBlocksArgs.push_back(&exclusionRowIndices.getDevicePointer());
         findInteractingBlocksArgs.push_back(&oldPositions.getDevicePointer());
         findInteractingBlocksArgs.push_back(&rebuildNeighborList.getDevicePointer());
+        findInteractingBlocksArgs.push_back(&oldBoxSize.getDevicePointer());
+        if (usePruning) {
+            pruneInteractionsArgs.push_back(context.getPeriodicBoxSizePointer());
+            pruneInteractionsArgs.push_back(context.getInvPeriodicBoxSizePointer());
+            pruneInteractionsArgs.push_back(context.getPeriodicBoxVecXPointer());
+            pruneInteractionsArgs.push_back(context.getPeriodicBoxVecYPointer());
+            pruneInteractionsArgs.push_back(context.getPeriodicBoxVecZPointer());
+            pruneInteractionsArgs.push_back(&interactionCount.getDevicePointer());
+            pruneInteractionsArgs.push_back(&interactingTiles.getDevicePointer());
+            pruneInteractionsArgs.push_back(&interactingAtoms.getDevicePointer());
+            pruneInteractionsArgs.push_back(&singlePairs.getDevicePointer());
+            pruneInteractionsArgs.push_back(&prunedInteractionCount.getDevicePointer());
+            pruneInteractionsArgs.push_back(&prunedTiles.getDevicePointer());
+            pruneInteractionsArgs.push_back(&prunedAtoms.getDevicePointer());
+            pruneInteractionsArgs.push_back(&prunedSinglePairs.getDevicePointer());
+            pruneInteractionsArgs.push_back(&context.getPosq().getDevicePointer());
+            pruneInteractionsArgs.push_back(&maxTiles);
+            pruneInteractionsArgs.push_back(&maxSinglePairs);
+            pruneInteractionsArgs.push_back(&blockCenter.getDevicePointer());
+            pruneInteractionsArgs.push_back(&blockBoundingBox.getDevicePointer());
+            pruneInteractionsArgs.push_back(&prunePositions.getDevicePointer());
+            pruneInteractionsArgs.push_back(&pruneNeighborList.getDevicePointer());
+            pruneInteractionsArgs.push_back(&oldBoxSize.getDevicePointer());
+        }
     }
 }
 
@@ -369,7 +484,8 @@ double CudaNonbondedUtilities::getMaxCutoffDistance() {
 }
 
 double CudaNonbondedUtilities::padCutoff(double cutoff) {
-    double padding = (usePadding ? 0.1*cutoff : 0.0);
+    // The full neighbor list is pruned every few steps, so it can afford a larger padding.
+    double padding = (usePadding ? 0.2*cutoff : 0.0);
     return cutoff+padding;
 }
 
@@ -382,6 +498,8 @@ void CudaNonbondedUtilities::prepareInteractions(int forceGroups) {
         return;
     if (numTiles == 0)
         return;
+    OPENMM_TRACE_RANGE("Neighbor list");
+    numNeighborListEvaluations++;
     KernelSet& kernels = groupKernels[forceGroups];
     if (usePeriodic) {
         double4 box = context.getPeriodicBoxSize();
@@ -398,15 +516,20 @@ void CudaNonbondedUtilities::prepareInteractions(int forceGroups) {
     blockSorter->sort(sortedBlocks);
     context.executeKernel(kernels.sortBoxDataKernel, &sortBoxDataArgs[0], context.getNumAtoms());
     context.executeKernel(kernels.findInteractingBlocksKernel, &findInteractingBlocksArgs[0], context.getNumAtoms(), 256);
+    if (usePruning)
+        context.executeKernel(kernels.pruneInteractionsKernel, &pruneInteractionsArgs[0], min(maxTiles, 8*context.getNumThreadBlocks())*CudaContext::TileSize, 256);
     forceRebuildNeighborList = false;
     lastCutoff = kernels.cutoffDistance;
     interactionCount.download(pinnedCountBuffer, false);
+    rebuildNeighborList.download(pinnedCountBuffer+2, false);
     cuEventRecord(downloadCountEvent, context.getCurrentStream());
+    hasPendingCount = true;
 }
 
 void CudaNonbondedUtilities::computeInteractions(int forceGroups, bool includeForces, bool includeEnergy) {
     if ((forceGroups&groupFlags) == 0)
         return;
+    OPENMM_TRACE_RANGE("Nonbonded interactions");
     KernelSet& kernels = groupKernels[forceGroups];
     if (kernels.hasForces) {
         CUfunction& kernel = (includeForces ? (includeEnergy ? kernels.forceEnergyKernel : kernels.forceKernel) : kernels.energyKernel);
@@ -414,47 +537,109 @@ void CudaNonbondedUtilities::computeInteractions(int forceGroups, bool includeFo
             kernel = createInteractionKernel(kernels.source, parameters, arguments, true, true, forceGroups, includeForces, includeEnergy);
         context.executeKernel(kernel, &forceArgs[0], numForceThreadBlocks*forceThreadBlockSize, forceThreadBlockSize);
     }
-    if (useCutoff && numTiles > 0) {
-        cuEventSynchronize(downloadCountEvent);
-        updateNeighborListSize();
-    }
+}
+
+bool CudaNonbondedUtilities::checkNeighborListSize() {
+    if (!hasPendingCount)
+        return false;
+    hasPendingCount = false;
+    cuEventSynchronize(downloadCountEvent);
+    if (pinnedCountBuffer[2] != 0)
+        numNeighborListBuilds++;
+    return updateNeighborListSize();
 }
 
 bool CudaNonbondedUtilities::updateNeighborListSize() {
     if (!useCutoff)
         return false;
-    if (pinnedCountBuffer[0] <= maxTiles && pinnedCountBuffer[1] <= maxSinglePairs)
+    unsigned int numInteractingTiles = pinnedCountBuffer[0];
+    unsigned int numSinglePairs = pinnedCountBuffer[1];
+    bool overflowed = (numInteractingTiles > (unsigned int) maxTiles || numSinglePairs > (unsigned int) maxSinglePairs);
+
+    // Enlarge the arrays before they actually overflow.  An overflow means the whole force computation must
+    // be repeated, while enlarging them early only costs an extra neighbor list build.  When a system is
+    // being compressed, as during equilibration with a barostat, the list grows steadily, and this usually
+    // lets it be enlarged without ever overflowing.
+
+    const double growThreshold = 0.9;
+    bool growTiles = (numInteractingTiles > growThreshold*maxTiles);
+    bool growSinglePairs = (numSinglePairs > growThreshold*maxSinglePairs);
+    if (!growTiles && !growSinglePairs)
         return false;
-
-    // The most recent timestep had too many interactions to fit in the arrays.  Make the arrays bigger to prevent
-    // this from happening in the future.
-
-    if (pinnedCountBuffer[0] > maxTiles) {
-        maxTiles = (int) (1.2*pinnedCountBuffer[0]);
-        int totalTiles = context.getNumAtomBlocks()*(context.getNumAtomBlocks()+1)/2;
-        if (maxTiles > totalTiles)
-            maxTiles = totalTiles;
-        interactingTiles.resize(maxTiles);
-        interactingAtoms.resize(CudaContext::TileSize*maxTiles);
-        if (forceArgs.size() > 0)
-            forceArgs[7] = &interactingTiles.getDevicePointer();
-        findInteractingBlocksArgs[6] = &interactingTiles.getDevicePointer();
-        if (forceArgs.size() > 0)
-            forceArgs[17] = &interactingAtoms.getDevicePointer();
-        findInteractingBlocksArgs[7] = &interactingAtoms.getDevicePointer();
-    }
-    if (pinnedCountBuffer[1] > maxSinglePairs) {
-        maxSinglePairs = (int) (1.2*pinnedCountBuffer[1]);
-        singlePairs.resize(maxSinglePairs);
-        if (forceArgs.size() > 0)
-            forceArgs[19] = &singlePairs.getDevicePointer();
-        findInteractingBlocksArgs[8] = &singlePairs.getDevicePointer();
+    bool resized = false;
+    if (growTiles) {
+        // Tile indices are 32 bit, so that is the most tiles the list can ever hold.  Each element of the
+        // atom arrays holds a whole tile, so their size in bytes is not limited.
+
+        long long totalTiles = context.getNumAtomBlocks()*((long long) context.getNumAtomBlocks()+1)/2;
+        long long newMaxTiles = min((long long) (1.2*numInteractingTiles), min(totalTiles, (long long) INT_MAX));
+        if (newMaxTiles < numInteractingTiles)
+            throw OpenMMException("The neighbor list contains too many tiles.  Try reducing the cutoff distance or splitting the system between multiple devices.");
+        if (newMaxTiles > maxTiles) {
+            maxTiles = (int) newMaxTiles;
+            interactingTiles.resize(maxTiles);
+            interactingAtoms.resize(maxTiles);
+            if (usePruning) {
+                prunedTiles.resize(maxTiles);
+                prunedAtoms.resize(maxTiles);
+                pruneInteractionsArgs[6] = &interactingTiles.getDevicePointer();
+                pruneInteractionsArgs[7] = &interactingAtoms.getDevicePointer();
+                pruneInteractionsArgs[10] = &prunedTiles.getDevicePointer();
+                pruneInteractionsArgs[11] = &prunedAtoms.getDevicePointer();
+            }
+            if (forceArgs.size() > 0)
+                forceArgs[8] = &getInteractingTiles().getDevicePointer();
+            findInteractingBlocksArgs[6] = &interactingTiles.getDevicePointer();
+            if (forceArgs.size() > 0)
+                forceArgs[18] = &getInteractingAtoms().getDevicePointer();
+            findInteractingBlocksArgs[7] = &interactingAtoms.getDevicePointer();
+            resized = true;
+        }
+    }
+    if (growSinglePairs) {
+        int newMaxSinglePairs = (int) min((long long) (1.2*numSinglePairs), (long long) INT_MAX);
+        if (newMaxSinglePairs > maxSinglePairs) {
+            maxSinglePairs = newMaxSinglePairs;
+            singlePairs.resize(maxSinglePairs);
+            if (usePruning) {
+                prunedSinglePairs.resize(maxSinglePairs);
+                pruneInteractionsArgs[8] = &singlePairs.getDevicePointer();
+                pruneInteractionsArgs[12] = &prunedSinglePairs.getDevicePointer();
+            }
+            if (forceArgs.size() > 0)
+                forceArgs[20] = &getSinglePairs().getDevicePointer();
+            findInteractingBlocksArgs[8] = &singlePairs.getDevicePointer();
+            resized = true;
+        }
     }
+    if (!resized)
+        return false;
+
+    // The new arrays are empty, so the list must be rebuilt.  If the old arrays overflowed, the forces that
+    // were just computed are also missing interactions and must be recomputed.
+
+    numNeighborListReallocations++;
     forceRebuildNeighborList = true;
+    if (!overflowed)
+        return false;
     context.setForcesValid(false);
     return true;
 }
 
+void CudaNonbondedUtilities::getNeighborListStatistics(map<string, double>& statistics) {
+    if (!useCutoff || numTiles == 0 || numNeighborListEvaluations == 0)
+        return;
+    statistics["neighborList:interactingTiles"] = pinnedCountBuffer[0];
+    statistics["neighborList:maxTiles"] = maxTiles;
+    statistics["neighborList:tileListOccupancy"] = min(pinnedCountBuffer[0], (unsigned int) maxTiles)/(double) maxTiles;
+    statistics["neighborList:singlePairs"] = pinnedCountBuffer[1];
+    statistics["neighborList:maxSinglePairs"] = maxSinglePairs;
+    statistics["neighborList:singlePairListOccupancy"] = min(pinnedCountBuffer[1], (unsigned int) maxSinglePairs)/(double) maxSinglePairs;
+    statistics["neighborList:builds"] = (double) numNeighborListBuilds;
+    statistics["neighborList:evaluations"] = (double) numNeighborListEvaluations;
+    statistics["neighborList:reallocations"] = numNeighborListReallocations;
+}
+
 void CudaNonbondedUtilities::setUsePadding(bool padding) {
     usePadding = padding;
 }
@@ -492,6 +677,13 @@ void CudaNonbondedUtilities::createKernelsForGroups(int groups) {
         defines["PADDING"] = context.doubleToString(paddedCutoff-cutoff);
         defines["PADDED_CUTOFF"] = context.doubleToString(paddedCutoff);
         defines["PADDED_CUTOFF_SQUARED"] = context.doubleToString(paddedCutoff*paddedCutoff);
+        if (usePruning) {
+            double prunedPadding = 0.05*cutoff;
+            defines["USE_PRUNING"] = "1";
+            defines["PRUNED_PADDING"] = context.doubleToString(prunedPadding);
+            defines["PRUNED_CUTOFF"] = context.doubleToString(cutoff+prunedPadding);
+            defines["PRUNED_CUTOFF_SQUARED"] = context.doubleToString((cutoff+prunedPadding)*(cutoff+prunedPadding));
+        }
         defines["NUM_TILES_WITH_EXCLUSIONS"] = context.intToString(exclusionTiles.getSize());
         if (usePeriodic)
             defines["USE_PERIODIC"] = "1";
@@ -503,6 +695,8 @@ void CudaNonbondedUtilities::createKernelsForGroups(int groups) {
         kernels.findBlockBoundsKernel = context.getKernel(interactingBlocksProgram, "findBlockBounds");
         kernels.sortBoxDataKernel = context.getKernel(interactingBlocksProgram, "sortBoxData");
         kernels.findInteractingBlocksKernel = context.getKernel(interactingBlocksProgram, "findBlocksWithInteractions");
+        if (usePruning)
+            kernels.pruneInteractionsKernel = context.getKernel(interactingBlocksProgram, "pruneInteractions");
     }
     groupKernels[groups] = kernels;
 }
@@ -532,17 +726,37 @@ CUfunction CudaNonbondedUtilities::createInteractionKernel(const string& source,
         args << "* __restrict__ global_";
         args << params[i].getName();
     }
+    // Small constant arrays, such as the coefficients of tabulated functions, are staged in shared memory
+    // since the interaction code may look them up many times for every pair.  The kernel argument gets a
+    // different name, so the interaction code transparently uses the shared copy.  This is only done if
+    // the kernel source has a place to load them.
+
+    const int maxSharedArgumentBytes = (kernelSource.find("LOAD_SHARED_ARGUMENTS") == string::npos ? 0 : 8192);
+    int sharedArgumentBytes = 0;
+    stringstream loadSharedArgs;
     for (int i = 0; i < (int) arguments.size(); i++) {
         args << ", ";
         if (arguments[i].isConstant())
             args << "const ";
         args << arguments[i].getType();
         args << "* __restrict__ ";
+        int length = (i < argumentLengths.size() ? argumentLengths[i] : 0);
+        int bytes = length*arguments[i].getSize();
+        if (arguments[i].isConstant() && length > 0 && sharedArgumentBytes+bytes <= maxSharedArgumentBytes) {
+            sharedArgumentBytes += bytes;
+            args << "global_";
+            loadSharedArgs << "__shared__ " << arguments[i].getType() << " " << arguments[i].getName() << "[" << length << "];\n";
+            loadSharedArgs << "for (int i = threadIdx.x; i < " << length << "; i += blockDim.x)\n";
+            loadSharedArgs << arguments[i].getName() << "[i] = global_" << arguments[i].getName() << "[i];\n";
+        }
         args << arguments[i].getName();
     }
+    if (sharedArgumentBytes > 0)
+        loadSharedArgs << "__syncthreads();\n";
     if (energyParameterDerivatives.size() > 0)
         args << ", mixed* __restrict__ energyParamDerivs";
     replacements["PARAMETER_ARGUMENTS"] = args.str();
+    replacements["LOAD_SHARED_ARGUMENTS"] = loadSharedArgs.str();
 
     stringstream load1;
     for (int i = 0; i < (int) params.size(); i++) {
@@ -705,6 +919,24 @@ CUfunction CudaNonbondedUtilities::createInteractionKernel(const string& source,
     }
     replacements["SHUFFLE_WARP_DATA"] = shuffleWarpData.str();
 
+    // Interactions whose exclusions differ from the first set load their own flags for each tile.
+
+    stringstream loadExclusionSets, rotateExclusionSets, shiftExclusionSets, checkExclusionSets, copyExclusionSets;
+    int numExclusionTiles = exclusionTiles.getSize();
+    for (int setIndex = 1; setIndex < numExclusionSets; setIndex++) {
+        string excl = "excl"+context.intToString(setIndex);
+        loadExclusionSets<<"tileflags "<<excl<<" = exclusions[exclusionSetTiles["<<(setIndex-1)*numExclusionTiles<<"+pos]*TILE_SIZE+tgx];\n";
+        rotateExclusionSets<<excl<<" = ("<<excl<<" >> tgx) | ("<<excl<<" << (TILE_SIZE - tgx));\n";
+        shiftExclusionSets<<excl<<" >>= 1;\n";
+        checkExclusionSets<<"bool isExcluded"<<setIndex<<" = (atom1 >= NUM_ATOMS || atom2 >= NUM_ATOMS || !("<<excl<<" & 0x1));\n";
+        copyExclusionSets<<"bool isExcluded"<<setIndex<<" = isExcluded;\n";
+    }
+    replacements["LOAD_EXCLUSION_SETS"] = loadExclusionSets.str();
+    replacements["ROTATE_EXCLUSION_SETS"] = rotateExclusionSets.str();
+    replacements["SHIFT_EXCLUSION_SETS"] = shiftExclusionSets.str();
+    replacements["CHECK_EXCLUSION_SETS"] = checkExclusionSets.str();
+    replacements["COPY_EXCLUSION_SETS"] = copyExclusionSets.str();
+
     map<string, string> defines;
     if (useCutoff)
         defines["USE_CUTOFF"] = "1";
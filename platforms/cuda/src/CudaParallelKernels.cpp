@@ -26,6 +26,7 @@
 
 #include "CudaParallelKernels.h"
 #include "CudaKernelSources.h"
+#include "openmm/NonbondedForce.h"
 
 using namespace OpenMM;
 using namespace std;
@@ -93,9 +94,10 @@ private:
 class CudaParallelCalcForcesAndEnergyKernel::FinishComputationTask : public CudaContext::WorkTask {
 public:
     FinishComputationTask(ContextImpl& context, CudaContext& cu, CudaCalcForcesAndEnergyKernel& kernel,
-            bool includeForce, bool includeEnergy, int groups, double& energy, long long& completionTime, long long* pinnedMemory, CudaArray& contextForces, bool& valid, int2& interactionCount) :
-            context(context), cu(cu), kernel(kernel), includeForce(includeForce), includeEnergy(includeEnergy), groups(groups), energy(energy),
-            completionTime(completionTime), pinnedMemory(pinnedMemory), contextForces(contextForces), valid(valid), interactionCount(interactionCount) {
+            bool includeForce, bool includeEnergy, int groups, double& energy, long long& completionTime, long long* pinnedMemory,
+            bool& valid, int2& interactionCount) : context(context), cu(cu), kernel(kernel), includeForce(includeForce),
+            includeEnergy(includeEnergy), groups(groups), energy(energy), completionTime(completionTime), pinnedMemory(pinnedMemory),
+            valid(valid), interactionCount(interactionCount) {
     }
     void execute() {
         // Execute the kernel, then download forces.
@@ -107,18 +109,12 @@ public:
             CHECK_RESULT(cuCtxSynchronize(), "Error synchronizing CUDA context");
             completionTime = getTime();
         }
-        if (includeForce) {
-            if (cu.getContextIndex() > 0) {
-                int numAtoms = cu.getPaddedNumAtoms();
-                if (cu.getPlatformData().peerAccessSupported) {
-                    int numBytes = numAtoms*3*sizeof(long long);
-                    int offset = (cu.getContextIndex()-1)*numBytes;
-                    CudaContext& context0 = *cu.getPlatformData().contexts[0];
-                    CHECK_RESULT(cuMemcpy(contextForces.getDevicePointer()+offset, cu.getForce().getDevicePointer(), numBytes), "Error copying forces");
-                }
-                else
-                    cu.getForce().download(&pinnedMemory[(cu.getContextIndex()-1)*numAtoms*3]);
-            }
+        if (includeForce && cu.getContextIndex() > 0 && !cu.getPlatformData().peerAccessSupported) {
+            // Without peer access, the forces are summed on the main device after passing through the host.
+            // With peer access, they are reduced directly between devices by finishComputation().
+
+            int numAtoms = cu.getPaddedNumAtoms();
+            cu.getForce().download(&pinnedMemory[(cu.getContextIndex()-1)*numAtoms*3]);
         }
         if (cu.getNonbondedUtilities().getUsePeriodic() && (interactionCount.x > cu.getNonbondedUtilities().getInteractingTiles().getSize() ||
                 interactionCount.y > cu.getNonbondedUtilities().getSinglePairs().getSize())) {
@@ -135,7 +131,6 @@ private:
     double& energy;
     long long& completionTime;
     long long* pinnedMemory;
-    CudaArray& contextForces;
     bool& valid;
     int2& interactionCount;
 };
@@ -155,6 +150,15 @@ CudaParallelCalcForcesAndEnergyKernel::~CudaParallelCalcForcesAndEnergyKernel()
         cuMemFreeHost(pinnedForceBuffer);
     cuEventDestroy(event);
     cuStreamDestroy(peerCopyStream);
+    for (int i = 0; i < (int) forceEvents.size(); i++) {
+        data.contexts[i]->setAsCurrent();
+        cuEventDestroy(forceEvents[i]);
+    }
+    for (int i = 0; i < (int) peerForces.size(); i++) {
+        data.contexts[i]->setAsCurrent();
+        if (peerForces[i] != NULL)
+            delete peerForces[i];
+    }
     if (interactionCounts != NULL)
         cuMemFreeHost(interactionCounts);
 }
@@ -162,25 +166,63 @@ CudaParallelCalcForcesAndEnergyKernel::~CudaParallelCalcForcesAndEnergyKernel()
 void CudaParallelCalcForcesAndEnergyKernel::initialize(const System& system) {
     CudaContext& cu = *data.contexts[0];
     cu.setAsCurrent();
-    CUmodule module = cu.createModule(CudaKernelSources::parallel);
-    sumKernel = cu.getKernel(module, "sumForces");
     int numContexts = data.contexts.size();
+    for (int i = 0; i < numContexts; i++) {
+        data.contexts[i]->setAsCurrent();
+        CUmodule module = data.contexts[i]->createModule(CudaKernelSources::parallel);
+        sumKernels.push_back(data.contexts[i]->getKernel(module, "sumForces"));
+    }
+    cu.setAsCurrent();
     for (int i = 0; i < numContexts; i++)
         getKernel(i).initialize(system);
+
+    // The first context computes reciprocal space by itself, so start it with a smaller share of the
+    // direct space work.  Load balancing refines the division during the first steps.
+
+    bool hasReciprocalSpace = false;
+    for (int i = 0; i < system.getNumForces(); i++) {
+        const NonbondedForce* nonbonded = dynamic_cast<const NonbondedForce*>(&system.getForce(i));
+        if (nonbonded != NULL && (nonbonded->getNonbondedMethod() == NonbondedForce::Ewald ||
+                nonbonded->getNonbondedMethod() == NonbondedForce::PME || nonbonded->getNonbondedMethod() == NonbondedForce::LJPME))
+            hasReciprocalSpace = true;
+    }
+    double firstWeight = (hasReciprocalSpace && numContexts > 1 ? 0.5 : 1.0);
     for (int i = 0; i < numContexts; i++)
-        contextNonbondedFractions[i] = 1/(double) numContexts;
+        contextNonbondedFractions[i] = (i == 0 ? firstWeight : 1.0)/(numContexts-1+firstWeight);
     CHECK_RESULT(cuEventCreate(&event, 0), "Error creating event");
     CHECK_RESULT(cuStreamCreate(&peerCopyStream, CU_STREAM_NON_BLOCKING), "Error creating stream");
     CHECK_RESULT(cuMemHostAlloc((void**) &interactionCounts, numContexts*sizeof(int2), 0), "Error creating interaction counts buffer");
+    forceEvents.resize(numContexts);
+    for (int i = 0; i < numContexts; i++) {
+        data.contexts[i]->setAsCurrent();
+        CHECK_RESULT(cuEventCreate(&forceEvents[i], CU_EVENT_DISABLE_TIMING), "Error creating event");
+    }
+    cu.setAsCurrent();
 }
 
 void CudaParallelCalcForcesAndEnergyKernel::beginComputation(ContextImpl& context, bool includeForce, bool includeEnergy, int groups) {
     CudaContext& cu = *data.contexts[0];
     cu.setAsCurrent();
-    if (!contextForces.isInitialized()) {
-        contextForces.initialize<long long>(cu, 3*(data.contexts.size()-1)*cu.getPaddedNumAtoms(), "contextForces");
-        CHECK_RESULT(cuMemHostAlloc((void**) &pinnedForceBuffer, 3*(data.contexts.size()-1)*cu.getPaddedNumAtoms()*sizeof(long long), CU_MEMHOSTALLOC_PORTABLE), "Error allocating pinned memory");
+    if (pinnedPositionBuffer == NULL) {
+        int numContexts = data.contexts.size();
+        if (cu.getPlatformData().peerAccessSupported) {
+            // Each device that receives forces during the reduction needs a buffer to receive them in.
+
+            peerForces.resize(numContexts, NULL);
+            for (int stride = 1; stride < numContexts; stride *= 2)
+                for (int receiver = 0; receiver+stride < numContexts; receiver += 2*stride)
+                    if (peerForces[receiver] == NULL) {
+                        data.contexts[receiver]->setAsCurrent();
+                        peerForces[receiver] = CudaArray::create<long long>(*data.contexts[receiver], 3*cu.getPaddedNumAtoms(), "peerForces");
+                    }
+            cu.setAsCurrent();
+        }
+        else {
+            contextForces.initialize<long long>(cu, 3*(numContexts-1)*cu.getPaddedNumAtoms(), "contextForces");
+            CHECK_RESULT(cuMemHostAlloc((void**) &pinnedForceBuffer, 3*(numContexts-1)*cu.getPaddedNumAtoms()*sizeof(long long), CU_MEMHOSTALLOC_PORTABLE), "Error allocating pinned memory");
+        }
         CHECK_RESULT(cuMemHostAlloc(&pinnedPositionBuffer, cu.getPaddedNumAtoms()*(cu.getUseDoublePrecision() ? sizeof(double4) : sizeof(float4)), CU_MEMHOSTALLOC_PORTABLE), "Error allocating pinned memory");
+        setAtomBlockRanges();
     }
 
     // Copy coordinates over to each device and execute the kernel.
@@ -209,7 +251,7 @@ double CudaParallelCalcForcesAndEnergyKernel::finishComputation(ContextImpl& con
     for (int i = 0; i < (int) data.contexts.size(); i++) {
         CudaContext& cu = *data.contexts[i];
         ComputeContext::WorkThread& thread = cu.getWorkThread();
-        thread.addTask(new FinishComputationTask(context, cu, getKernel(i), includeForce, includeEnergy, groups, data.contextEnergy[i], completionTimes[i], pinnedForceBuffer, contextForces, valid, interactionCounts[i]));
+        thread.addTask(new FinishComputationTask(context, cu, getKernel(i), includeForce, includeEnergy, groups, data.contextEnergy[i], completionTimes[i], pinnedForceBuffer, valid, interactionCounts[i]));
     }
     data.syncContexts();
     double energy = 0.0;
@@ -219,12 +261,15 @@ double CudaParallelCalcForcesAndEnergyKernel::finishComputation(ContextImpl& con
         // Sum the forces from all devices.
         
         CudaContext& cu = *data.contexts[0];
-        if (!cu.getPlatformData().peerAccessSupported)
+        if (cu.getPlatformData().peerAccessSupported)
+            reduceForcesOnDevices();
+        else {
             contextForces.upload(pinnedForceBuffer, false);
-        int bufferSize = 3*cu.getPaddedNumAtoms();
-        int numBuffers = data.contexts.size()-1;
-        void* args[] = {&cu.getForce().getDevicePointer(), &contextForces.getDevicePointer(), &bufferSize, &numBuffers};
-        cu.executeKernel(sumKernel, args, bufferSize);
+            int bufferSize = 3*cu.getPaddedNumAtoms();
+            int numBuffers = data.contexts.size()-1;
+            void* args[] = {&cu.getForce().getDevicePointer(), &contextForces.getDevicePointer(), &bufferSize, &numBuffers};
+            cu.executeKernel(sumKernels[0], args, bufferSize);
+        }
         
         // Balance work between the contexts by transferring a little nonbonded work from the context that
         // finished last to the one that finished first.
@@ -240,19 +285,56 @@ double CudaParallelCalcForcesAndEnergyKernel::finishComputation(ContextImpl& con
             double fractionToTransfer = min(0.01, contextNonbondedFractions[lastIndex]);
             contextNonbondedFractions[firstIndex] += fractionToTransfer;
             contextNonbondedFractions[lastIndex] -= fractionToTransfer;
-            double startFraction = 0.0;
-            for (int i = 0; i < (int) contextNonbondedFractions.size(); i++) {
-                double endFraction = startFraction+contextNonbondedFractions[i];
-                if (i == contextNonbondedFractions.size()-1)
-                    endFraction = 1.0; // Avoid roundoff error
-                data.contexts[i]->getNonbondedUtilities().setAtomBlockRange(startFraction, endFraction);
-                startFraction = endFraction;
-            }
+            setAtomBlockRanges();
 	}
     }
     return energy;
 }
 
+void CudaParallelCalcForcesAndEnergyKernel::reduceForcesOnDevices() {
+    // Sum the forces with a tree reduction.  At each level, every device that still holds a partial sum sends
+    // it to a partner, which adds it to its own.  This takes log2(n) levels, and the main device receives
+    // log2(n) arrays rather than n-1.  Copies are queued on the sending device's stream so its force buffer
+    // cannot be overwritten by the next step before the copy completes.  Events order the copy after the
+    // receiver has finished using its buffer, and the sum after the copy.  All work threads have finished
+    // queueing their work before this is called.
+
+    int numContexts = data.contexts.size();
+    int bufferSize = 3*data.contexts[0]->getPaddedNumAtoms();
+    int numBuffers = 1;
+    for (int i = 0; i < numContexts; i++) {
+        data.contexts[i]->setAsCurrent();
+        CHECK_RESULT(cuEventRecord(forceEvents[i], data.contexts[i]->getCurrentStream()), "Error recording event");
+    }
+    for (int stride = 1; stride < numContexts; stride *= 2)
+        for (int receiver = 0; receiver+stride < numContexts; receiver += 2*stride) {
+            int sender = receiver+stride;
+            CudaContext& src = *data.contexts[sender];
+            CudaContext& dest = *data.contexts[receiver];
+            src.setAsCurrent();
+            CHECK_RESULT(cuStreamWaitEvent(src.getCurrentStream(), forceEvents[receiver], 0), "Error waiting for force reduction");
+            CHECK_RESULT(cuMemcpyAsync(peerForces[receiver]->getDevicePointer(), src.getForce().getDevicePointer(), bufferSize*sizeof(long long), src.getCurrentStream()), "Error copying forces");
+            CHECK_RESULT(cuEventRecord(forceEvents[sender], src.getCurrentStream()), "Error recording event");
+            dest.setAsCurrent();
+            CHECK_RESULT(cuStreamWaitEvent(dest.getCurrentStream(), forceEvents[sender], 0), "Error waiting for force copy");
+            void* args[] = {&dest.getForce().getDevicePointer(), &peerForces[receiver]->getDevicePointer(), &bufferSize, &numBuffers};
+            dest.executeKernel(sumKernels[receiver], args, bufferSize);
+            CHECK_RESULT(cuEventRecord(forceEvents[receiver], dest.getCurrentStream()), "Error recording event");
+        }
+    data.contexts[0]->setAsCurrent();
+}
+
+void CudaParallelCalcForcesAndEnergyKernel::setAtomBlockRanges() {
+    double startFraction = 0.0;
+    for (int i = 0; i < (int) contextNonbondedFractions.size(); i++) {
+        double endFraction = startFraction+contextNonbondedFractions[i];
+        if (i == contextNonbondedFractions.size()-1)
+            endFraction = 1.0; // Avoid roundoff error
+        data.contexts[i]->getNonbondedUtilities().setAtomBlockRange(startFraction, endFraction);
+        startFraction = endFraction;
+    }
+}
+
 class CudaParallelCalcHarmonicBondForceKernel::Task : public CudaContext::WorkTask {
 public:
     Task(ContextImpl& context, CommonCalcHarmonicBondForceKernel& kernel, bool includeForce,
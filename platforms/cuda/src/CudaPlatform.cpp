@@ -99,6 +99,7 @@ CudaPlatform::CudaPlatform() {
     registerKernelFactory(IntegrateNoseHooverStepKernel::Name(), factory);
     registerKernelFactory(IntegrateLangevinStepKernel::Name(), factory);
     registerKernelFactory(IntegrateLangevinMiddleStepKernel::Name(), factory);
+    registerKernelFactory(IntegrateMTSLangevinStepKernel::Name(), factory);
     registerKernelFactory(IntegrateBrownianStepKernel::Name(), factory);
     registerKernelFactory(IntegrateVariableVerletStepKernel::Name(), factory);
     registerKernelFactory(IntegrateVariableLangevinStepKernel::Name(), factory);
@@ -106,6 +107,12 @@ CudaPlatform::CudaPlatform() {
     registerKernelFactory(ApplyAndersenThermostatKernel::Name(), factory);
     registerKernelFactory(ApplyMonteCarloBarostatKernel::Name(), factory);
     registerKernelFactory(RemoveCMMotionKernel::Name(), factory);
+    registerKernelFactory(MinimizeKernel::Name(), factory);
+    registerKernelFactory(SwapStateKernel::Name(), factory);
+    registerKernelFactory(ParticleSubsetKernel::Name(), factory);
+    registerKernelFactory(StateSnapshotKernel::Name(), factory);
+    registerKernelFactory(ScaleVelocitiesKernel::Name(), factory);
+    registerKernelFactory(ProfileKernel::Name(), factory);
     platformProperties.push_back(CudaDeviceIndex());
     platformProperties.push_back(CudaDeviceName());
     platformProperties.push_back(CudaUseBlockingSync());
@@ -116,6 +123,11 @@ CudaPlatform::CudaPlatform() {
     platformProperties.push_back(CudaHostCompiler());
     platformProperties.push_back(CudaDisablePmeStream());
     platformProperties.push_back(CudaDeterministicForces());
+    platformProperties.push_back(CudaUseSharedContext());
+    platformProperties.push_back(CudaUseCudaGraphs());
+    platformProperties.push_back(CudaTunePme());
+    platformProperties.push_back(CudaSpecializeGlobalParameters());
+    platformProperties.push_back(CudaConstraintAlgorithm());
     setPropertyDefaultValue(CudaDeviceIndex(), "");
     setPropertyDefaultValue(CudaDeviceName(), "");
     setPropertyDefaultValue(CudaUseBlockingSync(), "true");
@@ -123,6 +135,11 @@ CudaPlatform::CudaPlatform() {
     setPropertyDefaultValue(CudaUseCpuPme(), "false");
     setPropertyDefaultValue(CudaDisablePmeStream(), "false");
     setPropertyDefaultValue(CudaDeterministicForces(), "false");
+    setPropertyDefaultValue(CudaUseSharedContext(), "false");
+    setPropertyDefaultValue(CudaUseCudaGraphs(), "false");
+    setPropertyDefaultValue(CudaTunePme(), "false");
+    setPropertyDefaultValue(CudaSpecializeGlobalParameters(), "false");
+    setPropertyDefaultValue(CudaConstraintAlgorithm(), "CCMA");
 #ifdef _MSC_VER
     char* bindir = getenv("CUDA_BIN_PATH");
     string nvcc = (bindir == NULL ? "nvcc.exe" : string(bindir)+"\\nvcc.exe");
@@ -188,11 +205,26 @@ void CudaPlatform::contextCreated(ContextImpl& context, const map<string, string
             getPropertyDefaultValue(CudaDisablePmeStream()) : properties.find(CudaDisablePmeStream())->second);
     string deterministicForcesValue = (properties.find(CudaDeterministicForces()) == properties.end() ?
             getPropertyDefaultValue(CudaDeterministicForces()) : properties.find(CudaDeterministicForces())->second);
+    string sharedContextValue = (properties.find(CudaUseSharedContext()) == properties.end() ?
+            getPropertyDefaultValue(CudaUseSharedContext()) : properties.find(CudaUseSharedContext())->second);
+    string cudaGraphsValue = (properties.find(CudaUseCudaGraphs()) == properties.end() ?
+            getPropertyDefaultValue(CudaUseCudaGraphs()) : properties.find(CudaUseCudaGraphs())->second);
+    string tunePmeValue = (properties.find(CudaTunePme()) == properties.end() ?
+            getPropertyDefaultValue(CudaTunePme()) : properties.find(CudaTunePme())->second);
+    string specializeGlobalsValue = (properties.find(CudaSpecializeGlobalParameters()) == properties.end() ?
+            getPropertyDefaultValue(CudaSpecializeGlobalParameters()) : properties.find(CudaSpecializeGlobalParameters())->second);
+    string constraintAlgorithmValue = (properties.find(CudaConstraintAlgorithm()) == properties.end() ?
+            getPropertyDefaultValue(CudaConstraintAlgorithm()) : properties.find(CudaConstraintAlgorithm())->second);
     transform(blockingPropValue.begin(), blockingPropValue.end(), blockingPropValue.begin(), ::tolower);
     transform(precisionPropValue.begin(), precisionPropValue.end(), precisionPropValue.begin(), ::tolower);
     transform(cpuPmePropValue.begin(), cpuPmePropValue.end(), cpuPmePropValue.begin(), ::tolower);
     transform(pmeStreamPropValue.begin(), pmeStreamPropValue.end(), pmeStreamPropValue.begin(), ::tolower);
     transform(deterministicForcesValue.begin(), deterministicForcesValue.end(), deterministicForcesValue.begin(), ::tolower);
+    transform(sharedContextValue.begin(), sharedContextValue.end(), sharedContextValue.begin(), ::tolower);
+    transform(cudaGraphsValue.begin(), cudaGraphsValue.end(), cudaGraphsValue.begin(), ::tolower);
+    transform(tunePmeValue.begin(), tunePmeValue.end(), tunePmeValue.begin(), ::tolower);
+    transform(specializeGlobalsValue.begin(), specializeGlobalsValue.end(), specializeGlobalsValue.begin(), ::tolower);
+    transform(constraintAlgorithmValue.begin(), constraintAlgorithmValue.end(), constraintAlgorithmValue.begin(), ::toupper);
     vector<string> pmeKernelName;
     pmeKernelName.push_back(CalcPmeReciprocalForceKernel::Name());
     if (!supportsKernels(pmeKernelName))
@@ -202,7 +234,7 @@ void CudaPlatform::contextCreated(ContextImpl& context, const map<string, string
     if (threadsEnv != NULL)
         stringstream(threadsEnv) >> threads;
     context.setPlatformData(new PlatformData(&context, context.getSystem(), devicePropValue, blockingPropValue, precisionPropValue, cpuPmePropValue, compilerPropValue, tempPropValue,
-            hostCompilerPropValue, pmeStreamPropValue, deterministicForcesValue, threads, NULL));
+            hostCompilerPropValue, pmeStreamPropValue, deterministicForcesValue, sharedContextValue, cudaGraphsValue, tunePmeValue, specializeGlobalsValue, constraintAlgorithmValue, threads, NULL));
 }
 
 void CudaPlatform::linkedContextCreated(ContextImpl& context, ContextImpl& originalContext) const {
@@ -216,9 +248,14 @@ void CudaPlatform::linkedContextCreated(ContextImpl& context, ContextImpl& origi
     string hostCompilerPropValue = platform.getPropertyValue(originalContext.getOwner(), CudaHostCompiler());
     string pmeStreamPropValue = platform.getPropertyValue(originalContext.getOwner(), CudaDisablePmeStream());
     string deterministicForcesValue = platform.getPropertyValue(originalContext.getOwner(), CudaDeterministicForces());
+    string sharedContextValue = platform.getPropertyValue(originalContext.getOwner(), CudaUseSharedContext());
+    string cudaGraphsValue = platform.getPropertyValue(originalContext.getOwner(), CudaUseCudaGraphs());
+    string tunePmeValue = platform.getPropertyValue(originalContext.getOwner(), CudaTunePme());
+    string specializeGlobalsValue = platform.getPropertyValue(originalContext.getOwner(), CudaSpecializeGlobalParameters());
+    string constraintAlgorithmValue = platform.getPropertyValue(originalContext.getOwner(), CudaConstraintAlgorithm());
     int threads = reinterpret_cast<PlatformData*>(originalContext.getPlatformData())->threads.getNumThreads();
     context.setPlatformData(new PlatformData(&context, context.getSystem(), devicePropValue, blockingPropValue, precisionPropValue, cpuPmePropValue, compilerPropValue, tempPropValue,
-            hostCompilerPropValue, pmeStreamPropValue, deterministicForcesValue, threads, &originalContext));
+            hostCompilerPropValue, pmeStreamPropValue, deterministicForcesValue, sharedContextValue, cudaGraphsValue, tunePmeValue, specializeGlobalsValue, constraintAlgorithmValue, threads, &originalContext));
 }
 
 void CudaPlatform::contextDestroyed(ContextImpl& context) const {
@@ -228,9 +265,16 @@ void CudaPlatform::contextDestroyed(ContextImpl& context) const {
 
 CudaPlatform::PlatformData::PlatformData(ContextImpl* context, const System& system, const string& deviceIndexProperty, const string& blockingProperty, const string& precisionProperty,
             const string& cpuPmeProperty, const string& compilerProperty, const string& tempProperty, const string& hostCompilerProperty, const string& pmeStreamProperty,
-            const string& deterministicForcesProperty, int numThreads, ContextImpl* originalContext) :
+            const string& deterministicForcesProperty, const string& sharedContextProperty,
+            const string& cudaGraphsProperty, const string& tunePmeProperty, const string& specializeGlobalsProperty, const string& constraintAlgorithmProperty,
+            int numThreads, ContextImpl* originalContext) :
                 context(context), removeCM(false), stepCount(0), computeForceCount(0), time(0.0), hasInitializedContexts(false), threads(numThreads) {
     bool blocking = (blockingProperty == "true");
+    useSharedContext = (sharedContextProperty == "true");
+    useCudaGraphs = (cudaGraphsProperty == "true");
+    if (constraintAlgorithmProperty != "CCMA" && constraintAlgorithmProperty != "LINCS")
+        throw OpenMMException("Illegal value for ConstraintAlgorithm: "+constraintAlgorithmProperty);
+    useLincs = (constraintAlgorithmProperty == "LINCS");
     vector<string> devices;
     size_t searchPos = 0, nextPos;
     while ((nextPos = deviceIndexProperty.find_first_of(", ", searchPos)) != string::npos) {
@@ -246,11 +290,11 @@ CudaPlatform::PlatformData::PlatformData(ContextImpl* context, const System& sys
             if (devices[i].length() > 0) {
                 int deviceIndex;
                 stringstream(devices[i]) >> deviceIndex;
-                contexts.push_back(new CudaContext(system, deviceIndex, blocking, precisionProperty, compilerProperty, tempProperty, hostCompilerProperty, *this, (originalData == NULL ? NULL : originalData->contexts[i])));
+                contexts.push_back(new CudaContext(system, deviceIndex, blocking, useSharedContext, precisionProperty, compilerProperty, tempProperty, hostCompilerProperty, *this, (originalData == NULL ? NULL : originalData->contexts[i])));
             }
         }
         if (contexts.size() == 0)
-            contexts.push_back(new CudaContext(system, -1, blocking, precisionProperty, compilerProperty, tempProperty, hostCompilerProperty, *this, (originalData == NULL ? NULL : originalData->contexts[0])));
+            contexts.push_back(new CudaContext(system, -1, blocking, useSharedContext, precisionProperty, compilerProperty, tempProperty, hostCompilerProperty, *this, (originalData == NULL ? NULL : originalData->contexts[0])));
     }
     catch (...) {
         // If an exception was thrown, do our best to clean up memory.
@@ -277,6 +321,10 @@ CudaPlatform::PlatformData::PlatformData(ContextImpl* context, const System& sys
     useCpuPme = (cpuPmeProperty == "true" && !contexts[0]->getUseDoublePrecision());
     disablePmeStream = (pmeStreamProperty == "true");
     deterministicForces = (deterministicForcesProperty == "true");
+    tunePme = (tunePmeProperty == "true");
+    specializeGlobalParameters = (specializeGlobalsProperty == "true");
+    for (int i = 0; i < (int) contexts.size(); i++)
+        contexts[i]->setSpecializeGlobalParameters(specializeGlobalParameters);
     propertyValues[CudaPlatform::CudaDeviceIndex()] = deviceIndex.str();
     propertyValues[CudaPlatform::CudaDeviceName()] = deviceName.str();
     propertyValues[CudaPlatform::CudaUseBlockingSync()] = blocking ? "true" : "false";
@@ -287,6 +335,11 @@ CudaPlatform::PlatformData::PlatformData(ContextImpl* context, const System& sys
     propertyValues[CudaPlatform::CudaHostCompiler()] = hostCompilerProperty;
     propertyValues[CudaPlatform::CudaDisablePmeStream()] = disablePmeStream ? "true" : "false";
     propertyValues[CudaPlatform::CudaDeterministicForces()] = deterministicForces ? "true" : "false";
+    propertyValues[CudaPlatform::CudaUseSharedContext()] = useSharedContext ? "true" : "false";
+    propertyValues[CudaPlatform::CudaUseCudaGraphs()] = useCudaGraphs ? "true" : "false";
+    propertyValues[CudaPlatform::CudaTunePme()] = tunePme ? "true" : "false";
+    propertyValues[CudaPlatform::CudaSpecializeGlobalParameters()] = specializeGlobalParameters ? "true" : "false";
+    propertyValues[CudaPlatform::CudaConstraintAlgorithm()] = useLincs ? "LINCS" : "CCMA";
     contextEnergy.resize(contexts.size());
     
     // Determine whether peer-to-peer copying is supported, and enable it if so.
@@ -30,10 +30,9 @@
 using namespace OpenMM;
 using namespace std;
 
-CudaProgram::CudaProgram(CudaContext& context, CUmodule module) : context(context), module(module) {
+CudaProgram::CudaProgram(CudaContext& context, shared_ptr<CudaContext::DeferredModule> module) : context(context), module(module) {
 }
 
 ComputeKernel CudaProgram::createKernel(const string& name) {
-    CUfunction kernel = context.getKernel(module, name.c_str());
-    return shared_ptr<ComputeKernelImpl>(new CudaKernel(context, kernel, name));
+    return shared_ptr<ComputeKernelImpl>(new CudaKernel(context, module, name));
 }
\ No newline at end of file
@@ -45,6 +45,7 @@ CudaSort::CudaSort(CudaContext& context, SortTrait* trait, unsigned int length)
     CUmodule module = context.createModule(context.replaceStrings(CudaKernelSources::sort, replacements));
     shortListKernel = context.getKernel(module, "sortShortList");
     shortList2Kernel = context.getKernel(module, "sortShortList2");
+    computeBlockRangeKernel = context.getKernel(module, "computeBlockRange");
     computeRangeKernel = context.getKernel(module, "computeRange");
     assignElementsKernel = context.getKernel(module, "assignElementsToBuckets");
     computeBucketPositionsKernel = context.getKernel(module, "computeBucketPositions");
@@ -66,6 +67,7 @@ CudaSort::CudaSort(CudaContext& context, SortTrait* trait, unsigned int length)
     sortKernelSize = (isShortList ? rangeKernelSize/2 : rangeKernelSize/4);
     if (rangeKernelSize > length)
         rangeKernelSize = length;
+    numRangeBlocks = min((length+rangeKernelSize-1)/rangeKernelSize, (unsigned int) context.getNumThreadBlocks());
     if (sortKernelSize > maxLocalBuffer)
         sortKernelSize = maxLocalBuffer;
     unsigned int targetBucketSize = sortKernelSize/2;
@@ -79,6 +81,7 @@ CudaSort::CudaSort(CudaContext& context, SortTrait* trait, unsigned int length)
 
     if (!isShortList) {
         dataRange.initialize(context, 2, trait->getKeySize(), "sortDataRange");
+        blockRange.initialize(context, 2*numRangeBlocks, trait->getKeySize(), "sortBlockRange");
         bucketOffset.initialize<uint1>(context, numBuckets, "bucketOffset");
         bucketOfElement.initialize<uint1>(context, length, "bucketOfElement");
         offsetInBucket.initialize<uint1>(context, length, "offsetInBucket");
@@ -109,10 +112,13 @@ void CudaSort::sort(CudaArray& data) {
         }
     }
     else {
-        // Compute the range of data values.
+        // Compute the range of data values.  Each thread block finds the range of part of the array,
+        // and then a single block combines them.
 
         unsigned int numBuckets = bucketOffset.getSize();
-        void* rangeArgs[] = {&data.getDevicePointer(), &dataLength, &dataRange.getDevicePointer(), &numBuckets, &bucketOffset.getDevicePointer()};
+        void* blockRangeArgs[] = {&data.getDevicePointer(), &dataLength, &blockRange.getDevicePointer()};
+        context.executeKernel(computeBlockRangeKernel, blockRangeArgs, numRangeBlocks*rangeKernelSize, rangeKernelSize, 2*rangeKernelSize*trait->getKeySize());
+        void* rangeArgs[] = {&blockRange.getDevicePointer(), &numRangeBlocks, &dataRange.getDevicePointer(), &numBuckets, &bucketOffset.getDevicePointer()};
         context.executeKernel(computeRangeKernel, rangeArgs, rangeKernelSize, rangeKernelSize, 2*rangeKernelSize*trait->getKeySize());
 
         // Assign array elements to buckets.
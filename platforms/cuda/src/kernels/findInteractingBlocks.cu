@@ -6,7 +6,11 @@
  */
 extern "C" __global__ void findBlockBounds(int numAtoms, real4 periodicBoxSize, real4 invPeriodicBoxSize, real4 periodicBoxVecX, real4 periodicBoxVecY, real4 periodicBoxVecZ,
         const real4* __restrict__ posq, real4* __restrict__ blockCenter, real4* __restrict__ blockBoundingBox, int* __restrict__ rebuildNeighborList,
-        real2* __restrict__ sortedBlocks) {
+        real2* __restrict__ sortedBlocks
+#ifdef USE_PRUNING
+        , int* __restrict__ pruneNeighborList
+#endif
+        ) {
     int index = blockIdx.x*blockDim.x+threadIdx.x;
     int base = index*TILE_SIZE;
     while (base < numAtoms) {
@@ -44,8 +48,27 @@ extern "C" __global__ void findBlockBounds(int numAtoms, real4 periodicBoxSize,
         index += blockDim.x*gridDim.x;
         base = index*TILE_SIZE;
     }
-    if (blockIdx.x == 0 && threadIdx.x == 0)
+    if (blockIdx.x == 0 && threadIdx.x == 0) {
         rebuildNeighborList[0] = 0;
+#ifdef USE_PRUNING
+        pruneNeighborList[0] = 0;
+#endif
+    }
+}
+
+/**
+ * Compute how much the periodic box has been scaled along each axis since a neighbor list was built.
+ * The w component holds the smallest of the three factors.  Triclinic and non-periodic boxes are
+ * treated as unscaled, so the usual displacement test applies to them unchanged.
+ */
+__device__ real4 boxScaleFactor(real4 periodicBoxSize, real4 oldBoxSize) {
+#if defined(USE_PERIODIC) && !defined(TRICLINIC)
+    real4 scale = make_real4(periodicBoxSize.x/oldBoxSize.x, periodicBoxSize.y/oldBoxSize.y, periodicBoxSize.z/oldBoxSize.z, 0);
+    scale.w = min(scale.x, min(scale.y, scale.z));
+    return scale;
+#else
+    return make_real4(1, 1, 1, 1);
+#endif
 }
 
 /**
@@ -54,7 +77,12 @@ extern "C" __global__ void findBlockBounds(int numAtoms, real4 periodicBoxSize,
 extern "C" __global__ void sortBoxData(const real2* __restrict__ sortedBlock, const real4* __restrict__ blockCenter,
         const real4* __restrict__ blockBoundingBox, real4* __restrict__ sortedBlockCenter,
         real4* __restrict__ sortedBlockBoundingBox, const real4* __restrict__ posq, const real4* __restrict__ oldPositions,
-        unsigned int* __restrict__ interactionCount, int* __restrict__ rebuildNeighborList, bool forceRebuild) {
+        unsigned int* __restrict__ interactionCount, int* __restrict__ rebuildNeighborList, bool forceRebuild,
+        real4 periodicBoxSize, const real4* __restrict__ oldBoxSize
+#ifdef USE_PRUNING
+        , const real4* __restrict__ prunePositions, unsigned int* __restrict__ prunedInteractionCount, int* __restrict__ pruneNeighborList
+#endif
+        ) {
     for (int i = threadIdx.x+blockIdx.x*blockDim.x; i < NUM_BLOCKS; i += blockDim.x*gridDim.x) {
         int index = (int) sortedBlock[i].y;
         sortedBlockCenter[i] = blockCenter[index];
@@ -62,18 +90,47 @@ extern "C" __global__ void sortBoxData(const real2* __restrict__ sortedBlock, co
     }
     
     // Also check whether any atom has moved enough so that we really need to rebuild the neighbor list.
+    // If the box has been rescaled since the list was built (for example by a barostat), compare each
+    // atom to its old position scaled by the same factor, and shrink the allowed displacement by however
+    // much a compression could have brought excluded pairs closer together.
 
     bool rebuild = forceRebuild;
+    real4 scale = boxScaleFactor(periodicBoxSize, oldBoxSize[0]);
+    real maxDist = 0.5f*(PADDING-max((real) 0, 1-scale.w)*PADDED_CUTOFF);
+    if (maxDist <= 0)
+        rebuild = true;
+#ifdef USE_PRUNING
+    bool prune = false;
+    real4 pruneScale = boxScaleFactor(periodicBoxSize, oldBoxSize[1]);
+    real maxPruneDist = 0.5f*(PRUNED_PADDING-max((real) 0, 1-pruneScale.w)*PRUNED_CUTOFF);
+    if (maxPruneDist <= 0)
+        prune = true;
+#endif
     for (int i = threadIdx.x+blockIdx.x*blockDim.x; i < NUM_ATOMS; i += blockDim.x*gridDim.x) {
-        real4 delta = oldPositions[i]-posq[i];
-        if (delta.x*delta.x + delta.y*delta.y + delta.z*delta.z > 0.25f*PADDING*PADDING)
+        real4 pos = posq[i];
+        real4 old = oldPositions[i];
+        real3 delta = make_real3(old.x*scale.x-pos.x, old.y*scale.y-pos.y, old.z*scale.z-pos.z);
+        if (delta.x*delta.x + delta.y*delta.y + delta.z*delta.z > maxDist*maxDist)
             rebuild = true;
+#ifdef USE_PRUNING
+        old = prunePositions[i];
+        delta = make_real3(old.x*pruneScale.x-pos.x, old.y*pruneScale.y-pos.y, old.z*pruneScale.z-pos.z);
+        if (delta.x*delta.x + delta.y*delta.y + delta.z*delta.z > maxPruneDist*maxPruneDist)
+            prune = true;
+#endif
     }
     if (rebuild) {
         rebuildNeighborList[0] = 1;
         interactionCount[0] = 0;
         interactionCount[1] = 0;
     }
+#ifdef USE_PRUNING
+    if (rebuild || prune) {
+        pruneNeighborList[0] = 1;
+        prunedInteractionCount[0] = 0;
+        prunedInteractionCount[1] = 0;
+    }
+#endif
 }
 
 __device__ int saveSinglePairs(int x, int* atoms, int* flags, int length, unsigned int maxSinglePairs, unsigned int* singlePairCount, int2* singlePairs, int* sumBuffer, volatile int& pairStartIndex) {
@@ -174,6 +231,7 @@ __device__ int saveSinglePairs(int x, int* atoms, int* flags, int length, unsign
  * [out] oldPos                - stores the positions of the atoms in which this neighbourlist was built on
  *                             - this is used to decide when to rebuild a neighbourlist
  * [in] rebuildNeighbourList   - whether or not to execute this kernel
+ * [out] oldBoxSize            - stores the periodic box size the neighbourlist was built with
  *
  */
 extern "C" __global__ __launch_bounds__(GROUP_SIZE,1) void findBlocksWithInteractions(real4 periodicBoxSize, real4 invPeriodicBoxSize, real4 periodicBoxVecX, real4 periodicBoxVecY, real4 periodicBoxVecZ,
@@ -181,7 +239,7 @@ extern "C" __global__ __launch_bounds__(GROUP_SIZE,1) void findBlocksWithInterac
         int2* __restrict__ singlePairs, const real4* __restrict__ posq, unsigned int maxTiles, unsigned int maxSinglePairs,
         unsigned int startBlockIndex, unsigned int numBlocks, real2* __restrict__ sortedBlocks, const real4* __restrict__ sortedBlockCenter,
         const real4* __restrict__ sortedBlockBoundingBox, const unsigned int* __restrict__ exclusionIndices, const unsigned int* __restrict__ exclusionRowIndices,
-        real4* __restrict__ oldPositions, const int* __restrict__ rebuildNeighborList) {
+        real4* __restrict__ oldPositions, const int* __restrict__ rebuildNeighborList, real4* __restrict__ oldBoxSize) {
 
     if (rebuildNeighborList[0] == 0)
         return; // The neighbor list doesn't need to be rebuilt.
@@ -343,7 +401,7 @@ extern "C" __global__ __launch_bounds__(GROUP_SIZE,1) void findBlocksWithInterac
                             if (indexInWarp < tilesToStore)
                                 interactingTiles[newTileStartIndex+indexInWarp] = x;
                             for (int j = 0; j < tilesToStore; j++)
-                                interactingAtoms[(newTileStartIndex+j)*TILE_SIZE+indexInWarp] = buffer[indexInWarp+j*TILE_SIZE];
+                                interactingAtoms[((long long) newTileStartIndex+j)*TILE_SIZE+indexInWarp] = buffer[indexInWarp+j*TILE_SIZE];
                         }
                         if (indexInWarp+TILE_SIZE*tilesToStore < BUFFER_SIZE)
                             buffer[indexInWarp] = buffer[indexInWarp+TILE_SIZE*tilesToStore];
@@ -368,13 +426,200 @@ extern "C" __global__ __launch_bounds__(GROUP_SIZE,1) void findBlocksWithInterac
                 if (indexInWarp < tilesToStore)
                     interactingTiles[newTileStartIndex+indexInWarp] = x;
                 for (int j = 0; j < tilesToStore; j++)
-                    interactingAtoms[(newTileStartIndex+j)*TILE_SIZE+indexInWarp] = (indexInWarp+j*TILE_SIZE < neighborsInBuffer ? buffer[indexInWarp+j*TILE_SIZE] : NUM_ATOMS);
+                    interactingAtoms[((long long) newTileStartIndex+j)*TILE_SIZE+indexInWarp] = (indexInWarp+j*TILE_SIZE < neighborsInBuffer ? buffer[indexInWarp+j*TILE_SIZE] : NUM_ATOMS);
             }
         }
     }
     
-    // Record the positions the neighbor list is based on.
+    // Record the positions and box size the neighbor list is based on.
     
     for (int i = threadIdx.x+blockIdx.x*blockDim.x; i < NUM_ATOMS; i += blockDim.x*gridDim.x)
         oldPositions[i] = posq[i];
+    if (blockIdx.x == 0 && threadIdx.x == 0)
+        oldBoxSize[0] = periodicBoxSize;
+}
+
+#ifdef USE_PRUNING
+/**
+ * Build the pruned neighbor list that is used for computing interactions.  The full list is built with a
+ * large padding so it can be reused for many steps.  This kernel removes every atom that is further than
+ * PRUNED_CUTOFF from all atoms of the tile's block, then packs the remaining atoms for each block into as
+ * few tiles as possible.  It only does anything if some atom has moved more than half of PRUNED_PADDING
+ * since the last time it was run.
+ *
+ * [in] interactionCount        - number of tiles and single pairs in the full neighbor list
+ * [in] interactingTiles        - the block for each tile in the full neighbor list
+ * [in] interactingAtoms        - the atoms in each tile of the full neighbor list
+ * [in] singlePairs             - single pairs in the full neighbor list
+ * [out] prunedInteractionCount - number of tiles and single pairs in the pruned neighbor list
+ * [out] prunedTiles            - the block for each tile in the pruned neighbor list
+ * [out] prunedAtoms            - the atoms in each tile of the pruned neighbor list
+ * [out] prunedSinglePairs      - single pairs in the pruned neighbor list
+ * [out] prunePositions         - the positions the pruned list was built from
+ * [in] pruneNeighborList       - whether or not to execute this kernel
+ * [out] oldBoxSize             - element 1 stores the box size the pruned list was built with
+ */
+extern "C" __global__ __launch_bounds__(GROUP_SIZE,1) void pruneInteractions(real4 periodicBoxSize, real4 invPeriodicBoxSize, real4 periodicBoxVecX, real4 periodicBoxVecY, real4 periodicBoxVecZ,
+        const unsigned int* __restrict__ interactionCount, const int* __restrict__ interactingTiles, const unsigned int* __restrict__ interactingAtoms,
+        const int2* __restrict__ singlePairs, unsigned int* __restrict__ prunedInteractionCount, int* __restrict__ prunedTiles,
+        unsigned int* __restrict__ prunedAtoms, int2* __restrict__ prunedSinglePairs, const real4* __restrict__ posq, unsigned int maxTiles,
+        unsigned int maxSinglePairs, const real4* __restrict__ blockCenter, const real4* __restrict__ blockBoundingBox, real4* __restrict__ prunePositions,
+        const int* __restrict__ pruneNeighborList, real4* __restrict__ oldBoxSize) {
+
+    if (pruneNeighborList[0] == 0)
+        return; // The pruned list is still valid.
+    const unsigned int numTiles = interactionCount[0];
+    const unsigned int numPairs = interactionCount[1];
+    if (numTiles > maxTiles || numPairs > maxSinglePairs) {
+        // The full list didn't fit in memory and will be rebuilt.  Copy the counts so that
+        // kernels using the pruned list will also skip it.
+
+        if (blockIdx.x == 0 && threadIdx.x == 0) {
+            prunedInteractionCount[0] = numTiles;
+            prunedInteractionCount[1] = numPairs;
+        }
+        return;
+    }
+    const int indexInWarp = threadIdx.x%32;
+    const int warpStart = threadIdx.x-indexInWarp;
+    const int totalWarps = blockDim.x*gridDim.x/32;
+    const int warpIndex = (blockIdx.x*blockDim.x+threadIdx.x)/32;
+    const int warpMask = (1<<indexInWarp)-1;
+    __shared__ real3 posBuffer[GROUP_SIZE];
+    __shared__ unsigned int workgroupBuffer[2*TILE_SIZE*(GROUP_SIZE/32)];
+    __shared__ volatile int workgroupTileIndex[GROUP_SIZE/32];
+    unsigned int* buffer = workgroupBuffer+2*TILE_SIZE*(warpStart/32);
+    volatile int& tileStartIndex = workgroupTileIndex[warpStart/32];
+
+    // Each warp processes a contiguous range of tiles.  Tiles for the same block are usually adjacent
+    // in the full list, so the atoms that survive from them can be merged into full tiles.
+
+    int pos = (int) (warpIndex*(long long) numTiles/totalWarps);
+    int end = (int) ((warpIndex+1)*(long long) numTiles/totalWarps);
+    int currentX = -1;
+    int neighborsInBuffer = 0;
+    bool singlePeriodicCopy = false;
+    for (; pos < end; pos++) {
+        int x = interactingTiles[pos];
+        if (x != currentX) {
+            // Store any partially filled tile for the previous block, then load the new block.
+
+            if (neighborsInBuffer > 0) {
+                if (indexInWarp == 0)
+                    tileStartIndex = atomicAdd(&prunedInteractionCount[0], 1);
+                SYNC_WARPS;
+                int tileIndex = tileStartIndex;
+                if (indexInWarp == 0)
+                    prunedTiles[tileIndex] = currentX;
+                prunedAtoms[(long long) tileIndex*TILE_SIZE+indexInWarp] = (indexInWarp < neighborsInBuffer ? buffer[indexInWarp] : NUM_ATOMS);
+                neighborsInBuffer = 0;
+            }
+            currentX = x;
+            real3 pos1 = trimTo3(posq[x*TILE_SIZE+indexInWarp]);
+#ifdef USE_PERIODIC
+            real4 blockSizeX = blockBoundingBox[x];
+            singlePeriodicCopy = (0.5f*periodicBoxSize.x-blockSizeX.x >= PRUNED_CUTOFF &&
+                                  0.5f*periodicBoxSize.y-blockSizeX.y >= PRUNED_CUTOFF &&
+                                  0.5f*periodicBoxSize.z-blockSizeX.z >= PRUNED_CUTOFF);
+            if (singlePeriodicCopy) {
+                real4 blockCenterX = blockCenter[x];
+                APPLY_PERIODIC_TO_POS_WITH_CENTER(pos1, blockCenterX)
+            }
+#endif
+            SYNC_WARPS;
+            posBuffer[threadIdx.x] = pos1;
+            SYNC_WARPS;
+        }
+
+        // Check whether this thread's atom is close enough to any atom in the block.
+
+        unsigned int atom2 = interactingAtoms[(long long) pos*TILE_SIZE+indexInWarp];
+        bool include = false;
+        if (atom2 < NUM_ATOMS) {
+            real3 pos2 = trimTo3(posq[atom2]);
+#ifdef USE_PERIODIC
+            if (singlePeriodicCopy) {
+                real4 blockCenterX = blockCenter[x];
+                APPLY_PERIODIC_TO_POS_WITH_CENTER(pos2, blockCenterX)
+            }
+#ifdef TRICLINIC
+            // The nonbonded kernel may find a closer periodic copy than the one we would check here, so keep the atom.
+
+            include = !singlePeriodicCopy;
+#endif
+#endif
+            for (int j = 0; j < TILE_SIZE && !include; j++) {
+                real3 delta = pos2-posBuffer[warpStart+j];
+#ifdef USE_PERIODIC
+                if (!singlePeriodicCopy) {
+                    APPLY_PERIODIC_TO_DELTA(delta)
+                }
+#endif
+                include = (delta.x*delta.x+delta.y*delta.y+delta.z*delta.z < PRUNED_CUTOFF_SQUARED);
+            }
+        }
+
+        // Add it to the buffer, and store a tile whenever one is full.
+
+        int includeFlags = BALLOT(include);
+        if (include)
+            buffer[neighborsInBuffer+__popc(includeFlags&warpMask)] = atom2;
+        neighborsInBuffer += __popc(includeFlags);
+        SYNC_WARPS;
+        if (neighborsInBuffer >= TILE_SIZE) {
+            if (indexInWarp == 0)
+                tileStartIndex = atomicAdd(&prunedInteractionCount[0], 1);
+            SYNC_WARPS;
+            int tileIndex = tileStartIndex;
+            if (indexInWarp == 0)
+                prunedTiles[tileIndex] = x;
+            prunedAtoms[(long long) tileIndex*TILE_SIZE+indexInWarp] = buffer[indexInWarp];
+            neighborsInBuffer -= TILE_SIZE;
+            unsigned int next = buffer[indexInWarp+TILE_SIZE];
+            SYNC_WARPS;
+            if (indexInWarp < neighborsInBuffer)
+                buffer[indexInWarp] = next;
+            SYNC_WARPS;
+        }
+    }
+    if (neighborsInBuffer > 0) {
+        if (indexInWarp == 0)
+            tileStartIndex = atomicAdd(&prunedInteractionCount[0], 1);
+        SYNC_WARPS;
+        int tileIndex = tileStartIndex;
+        if (indexInWarp == 0)
+            prunedTiles[tileIndex] = currentX;
+        prunedAtoms[(long long) tileIndex*TILE_SIZE+indexInWarp] = (indexInWarp < neighborsInBuffer ? buffer[indexInWarp] : NUM_ATOMS);
+    }
+
+    // Prune the single pairs.
+
+    for (int base = warpIndex*32; base < numPairs; base += totalWarps*32) {
+        int i = base+indexInWarp;
+        bool include = false;
+        int2 pair;
+        if (i < numPairs) {
+            pair = singlePairs[i];
+            real3 delta = trimTo3(posq[pair.y])-trimTo3(posq[pair.x]);
+#ifdef USE_PERIODIC
+            APPLY_PERIODIC_TO_DELTA(delta)
+#endif
+            include = (delta.x*delta.x+delta.y*delta.y+delta.z*delta.z < PRUNED_CUTOFF_SQUARED);
+        }
+        int includeFlags = BALLOT(include);
+        if (indexInWarp == 0)
+            tileStartIndex = atomicAdd(&prunedInteractionCount[1], __popc(includeFlags));
+        SYNC_WARPS;
+        if (include)
+            prunedSinglePairs[tileStartIndex+__popc(includeFlags&warpMask)] = pair;
+        SYNC_WARPS;
+    }
+
+    // Record the positions and box size the pruned list is based on.
+
+    for (int i = threadIdx.x+blockIdx.x*blockDim.x; i < NUM_ATOMS; i += blockDim.x*gridDim.x)
+        prunePositions[i] = posq[i];
+    if (blockIdx.x == 0 && threadIdx.x == 0)
+        oldBoxSize[1] = periodicBoxSize;
 }
+#endif
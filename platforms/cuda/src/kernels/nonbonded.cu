@@ -84,8 +84,9 @@ static __inline__ __device__ long long real_shfl(long long var, int srcLane) {
  * [out]forceBuffers    - forces on each atom to eventually be accumulated
  * [out]energyBuffer    - energyBuffer to eventually be accumulated
  * [in]posq             - x,y,z,charge 
- * [in]exclusions       - 1024-bit flags denoting atom-atom exclusions for each tile
+ * [in]exclusions       - 1024-bit flags denoting atom-atom exclusions for each tile, followed by extra blocks for other exclusion sets
  * [in]exclusionTiles   - x,y denotes the indices of tiles that have an exclusion
+ * [in]exclusionSetTiles - for exclusion sets after the first, the block of exclusions to use for each tile
  * [in]startTileIndex   - index into first tile to be processed
  * [in]numTileIndices   - number of tiles this context is responsible for processing
  * [in]int tiles        - the atom block for each tile
@@ -105,7 +106,7 @@ static __inline__ __device__ long long real_shfl(long long var, int srcLane) {
  */
 extern "C" __global__ void computeNonbonded(
         unsigned long long* __restrict__ forceBuffers, mixed* __restrict__ energyBuffer, const real4* __restrict__ posq, const tileflags* __restrict__ exclusions,
-        const int2* __restrict__ exclusionTiles, unsigned int startTileIndex, unsigned long long numTileIndices
+        const int2* __restrict__ exclusionTiles, const int* __restrict__ exclusionSetTiles, unsigned int startTileIndex, unsigned long long numTileIndices
 #ifdef USE_CUTOFF
         , const int* __restrict__ tiles, const unsigned int* __restrict__ interactionCount, real4 periodicBoxSize, real4 invPeriodicBoxSize, 
         real4 periodicBoxVecX, real4 periodicBoxVecY, real4 periodicBoxVecZ, unsigned int maxTiles, const real4* __restrict__ blockCenter,
@@ -123,6 +124,7 @@ extern "C" __global__ void computeNonbonded(
 #ifndef ENABLE_SHUFFLE
     __shared__ AtomData localData[THREAD_BLOCK_SIZE];
 #endif
+    LOAD_SHARED_ARGUMENTS
 
     // First loop: process tiles that contain exclusions.
 
@@ -138,6 +140,7 @@ extern "C" __global__ void computeNonbonded(
         LOAD_ATOM1_PARAMETERS
 #ifdef USE_EXCLUSIONS
         tileflags excl = exclusions[pos*TILE_SIZE+tgx];
+        LOAD_EXCLUSION_SETS
 #endif
         const bool hasExclusions = true;
         if (x == y) {
@@ -179,6 +182,7 @@ extern "C" __global__ void computeNonbonded(
 #endif
 #ifdef USE_EXCLUSIONS
                 bool isExcluded = (atom1 >= NUM_ATOMS || atom2 >= NUM_ATOMS || !(excl & 0x1));
+                CHECK_EXCLUSION_SETS
 #endif
                 real tempEnergy = 0.0f;
                 const real interactionScale = 0.5f;
@@ -197,6 +201,7 @@ extern "C" __global__ void computeNonbonded(
 #endif
 #ifdef USE_EXCLUSIONS
                 excl >>= 1;
+                SHIFT_EXCLUSION_SETS
 #endif
             }
         }
@@ -222,6 +227,7 @@ extern "C" __global__ void computeNonbonded(
             LOAD_LOCAL_PARAMETERS_FROM_GLOBAL
 #ifdef USE_EXCLUSIONS
             excl = (excl >> tgx) | (excl << (TILE_SIZE - tgx));
+            ROTATE_EXCLUSION_SETS
 #endif
             unsigned int tj = tgx;
             for (j = 0; j < TILE_SIZE; j++) {
@@ -248,6 +254,7 @@ extern "C" __global__ void computeNonbonded(
 #endif
 #ifdef USE_EXCLUSIONS
                 bool isExcluded = (atom1 >= NUM_ATOMS || atom2 >= NUM_ATOMS || !(excl & 0x1));
+                CHECK_EXCLUSION_SETS
 #endif
                 real tempEnergy = 0.0f;
                 const real interactionScale = 1.0f;
@@ -289,6 +296,7 @@ extern "C" __global__ void computeNonbonded(
 #endif
 #ifdef USE_EXCLUSIONS
                 excl >>= 1;
+                SHIFT_EXCLUSION_SETS
 #endif
                 // cycles the indices
                 // 0 1 2 3 4 5 6 7 -> 1 2 3 4 5 6 7 0
@@ -383,7 +391,7 @@ extern "C" __global__ void computeNonbonded(
             LOAD_ATOM1_PARAMETERS
             //const unsigned int localAtomIndex = threadIdx.x;
 #ifdef USE_CUTOFF
-            unsigned int j = interactingAtoms[pos*TILE_SIZE+tgx];
+            unsigned int j = interactingAtoms[(long long) pos*TILE_SIZE+tgx];
 #else
             unsigned int j = y*TILE_SIZE + tgx;
 #endif
@@ -454,6 +462,7 @@ extern "C" __global__ void computeNonbonded(
 #endif
 #ifdef USE_EXCLUSIONS
                     bool isExcluded = (atom1 >= NUM_ATOMS || atom2 >= NUM_ATOMS);
+                    COPY_EXCLUSION_SETS
 #endif
                     real tempEnergy = 0.0f;
                     const real interactionScale = 1.0f;
@@ -525,6 +534,7 @@ extern "C" __global__ void computeNonbonded(
 #endif
 #ifdef USE_EXCLUSIONS
                     bool isExcluded = (atom1 >= NUM_ATOMS || atom2 >= NUM_ATOMS);
+                    COPY_EXCLUSION_SETS
 #endif
                     real tempEnergy = 0.0f;
                     const real interactionScale = 1.0f;
@@ -628,6 +638,9 @@ extern "C" __global__ void computeNonbonded(
 #endif
         bool hasExclusions = false;
         bool isExcluded = false;
+#ifdef USE_EXCLUSIONS
+        COPY_EXCLUSION_SETS
+#endif
         real tempEnergy = 0.0f;
         const real interactionScale = 1.0f;
         COMPUTE_INTERACTION
@@ -118,6 +118,168 @@ extern "C" __global__ void gridSpreadCharge(const real4* __restrict__ posq, real
     }
 }
 
+/**
+ * The brick based spreading kernels divide the grid into cubic bricks of PME_BRICK_SIZE points
+ * along each side.  Atoms are sorted by the brick containing their grid index, and each thread
+ * block accumulates the charge for one brick (plus the PME_ORDER-1 points it spills over into)
+ * in shared memory, then adds it to the global grid.  That greatly reduces the number of atomic
+ * operations on global memory compared to gridSpreadCharge().
+ */
+#define PME_BRICKS_X ((GRID_SIZE_X+PME_BRICK_SIZE-1)/PME_BRICK_SIZE)
+#define PME_BRICKS_Y ((GRID_SIZE_Y+PME_BRICK_SIZE-1)/PME_BRICK_SIZE)
+#define PME_BRICKS_Z ((GRID_SIZE_Z+PME_BRICK_SIZE-1)/PME_BRICK_SIZE)
+#define PME_BRICK_POINTS (PME_BRICK_SIZE*PME_BRICK_SIZE*PME_BRICK_SIZE)
+#define PME_BRICK_HALO_SIZE (PME_BRICK_SIZE+PME_ORDER-1)
+
+extern "C" __global__ void findAtomBrickIndex(const real4* __restrict__ posq, int2* __restrict__ pmeAtomGridIndex,
+            real4 periodicBoxSize, real4 invPeriodicBoxSize, real4 periodicBoxVecX, real4 periodicBoxVecY, real4 periodicBoxVecZ,
+            real3 recipBoxVecX, real3 recipBoxVecY, real3 recipBoxVecZ) {
+    // Compute a sort key for each atom that orders them first by brick, then by grid point within the brick.
+    
+    for (int atom = blockIdx.x*blockDim.x+threadIdx.x; atom < NUM_ATOMS; atom += blockDim.x*gridDim.x) {
+        real4 pos = posq[atom];
+        APPLY_PERIODIC_TO_POS(pos)
+        real3 t = make_real3(pos.x*recipBoxVecX.x+pos.y*recipBoxVecY.x+pos.z*recipBoxVecZ.x,
+                             pos.y*recipBoxVecY.y+pos.z*recipBoxVecZ.y,
+                             pos.z*recipBoxVecZ.z);
+        t.x = (t.x-floor(t.x))*GRID_SIZE_X;
+        t.y = (t.y-floor(t.y))*GRID_SIZE_Y;
+        t.z = (t.z-floor(t.z))*GRID_SIZE_Z;
+        int3 gridIndex = make_int3(((int) t.x) % GRID_SIZE_X,
+                                   ((int) t.y) % GRID_SIZE_Y,
+                                   ((int) t.z) % GRID_SIZE_Z);
+        int brick = ((gridIndex.x/PME_BRICK_SIZE)*PME_BRICKS_Y + gridIndex.y/PME_BRICK_SIZE)*PME_BRICKS_Z + gridIndex.z/PME_BRICK_SIZE;
+        int local = ((gridIndex.x%PME_BRICK_SIZE)*PME_BRICK_SIZE + gridIndex.y%PME_BRICK_SIZE)*PME_BRICK_SIZE + gridIndex.z%PME_BRICK_SIZE;
+        pmeAtomGridIndex[atom] = make_int2(atom, brick*PME_BRICK_POINTS+local);
+    }
+}
+
+/**
+ * Find the first position in the sorted atom list whose key is at least the specified value.
+ */
+__device__ int findFirstAtomWithKey(const int2* __restrict__ pmeAtomGridIndex, int key) {
+    int lower = 0, upper = NUM_ATOMS;
+    while (lower < upper) {
+        int middle = (lower+upper)/2;
+        if (pmeAtomGridIndex[middle].y < key)
+            lower = middle+1;
+        else
+            upper = middle;
+    }
+    return lower;
+}
+
+extern "C" __global__ void gridSpreadChargeBricks(const real4* __restrict__ posq, real* __restrict__ originalPmeGrid,
+        real4 periodicBoxSize, real4 invPeriodicBoxSize, real4 periodicBoxVecX, real4 periodicBoxVecY, real4 periodicBoxVecZ,
+        real3 recipBoxVecX, real3 recipBoxVecY, real3 recipBoxVecZ, const int2* __restrict__ pmeAtomGridIndex
+#ifdef CHARGE_FROM_SIGEPS
+        , const float2* __restrict__ sigmaEpsilon
+#else
+        , const real* __restrict__ charges
+#endif
+        ) {
+#if defined(USE_DOUBLE_PRECISION) || defined(USE_DETERMINISTIC_FORCES)
+    __shared__ unsigned long long brickGrid[PME_BRICK_HALO_SIZE*PME_BRICK_HALO_SIZE*PME_BRICK_HALO_SIZE];
+#else
+    __shared__ real brickGrid[PME_BRICK_HALO_SIZE*PME_BRICK_HALO_SIZE*PME_BRICK_HALO_SIZE];
+#endif
+    __shared__ int zindexTable[GRID_SIZE_Z];
+    __shared__ int atomRange[2];
+    int blockSize = (int) ceil(GRID_SIZE_Z/(real) PME_ORDER);
+    for (int i = threadIdx.x; i < GRID_SIZE_Z; i += blockDim.x) {
+	int block = i % PME_ORDER;
+        zindexTable[i] = i/PME_ORDER + block*GRID_SIZE_X*GRID_SIZE_Y*blockSize;
+    }
+    real3 data[PME_ORDER];
+    const real scale = RECIP(PME_ORDER-1);
+    for (int brick = blockIdx.x; brick < PME_BRICKS_X*PME_BRICKS_Y*PME_BRICKS_Z; brick += gridDim.x) {
+        const int3 brickOrigin = make_int3(PME_BRICK_SIZE*(brick/(PME_BRICKS_Y*PME_BRICKS_Z)),
+                                           PME_BRICK_SIZE*((brick/PME_BRICKS_Z)%PME_BRICKS_Y),
+                                           PME_BRICK_SIZE*(brick%PME_BRICKS_Z));
+        for (int i = threadIdx.x; i < PME_BRICK_HALO_SIZE*PME_BRICK_HALO_SIZE*PME_BRICK_HALO_SIZE; i += blockDim.x)
+            brickGrid[i] = 0;
+        if (threadIdx.x == 0)
+            atomRange[0] = findFirstAtomWithKey(pmeAtomGridIndex, brick*PME_BRICK_POINTS);
+        if (threadIdx.x == 1)
+            atomRange[1] = findFirstAtomWithKey(pmeAtomGridIndex, (brick+1)*PME_BRICK_POINTS);
+        __syncthreads();
+
+        // Accumulate the charge from every atom in this brick.
+
+        for (int i = atomRange[0]+threadIdx.x; i < atomRange[1]; i += blockDim.x) {
+            int atom = pmeAtomGridIndex[i].x;
+            real4 pos = posq[atom];
+#ifdef CHARGE_FROM_SIGEPS
+            const float2 sigEps = sigmaEpsilon[atom];
+            const real charge = 8*sigEps.x*sigEps.x*sigEps.x*sigEps.y;
+#else
+            const real charge = (CHARGE)*EPSILON_FACTOR;
+#endif
+            if (charge == 0)
+                continue;
+            APPLY_PERIODIC_TO_POS(pos)
+            real3 t = make_real3(pos.x*recipBoxVecX.x+pos.y*recipBoxVecY.x+pos.z*recipBoxVecZ.x,
+                                 pos.y*recipBoxVecY.y+pos.z*recipBoxVecZ.y,
+                                 pos.z*recipBoxVecZ.z);
+            t.x = (t.x-floor(t.x))*GRID_SIZE_X;
+            t.y = (t.y-floor(t.y))*GRID_SIZE_Y;
+            t.z = (t.z-floor(t.z))*GRID_SIZE_Z;
+            int3 localIndex = make_int3((((int) t.x) % GRID_SIZE_X)-brickOrigin.x,
+                                        (((int) t.y) % GRID_SIZE_Y)-brickOrigin.y,
+                                        (((int) t.z) % GRID_SIZE_Z)-brickOrigin.z);
+            real3 dr = make_real3(t.x-(int) t.x, t.y-(int) t.y, t.z-(int) t.z);
+            data[PME_ORDER-1] = make_real3(0);
+            data[1] = dr;
+            data[0] = make_real3(1)-dr;
+            for (int j = 3; j < PME_ORDER; j++) {
+                real div = RECIP(j-1);
+                data[j-1] = div*dr*data[j-2];
+                for (int k = 1; k < (j-1); k++)
+                    data[j-k-1] = div*((dr+make_real3(k))*data[j-k-2] + (make_real3(j-k)-dr)*data[j-k-1]);
+                data[0] = div*(make_real3(1)-dr)*data[0];
+            }
+            data[PME_ORDER-1] = scale*dr*data[PME_ORDER-2];
+            for (int j = 1; j < (PME_ORDER-1); j++)
+                data[PME_ORDER-j-1] = scale*((dr+make_real3(j))*data[PME_ORDER-j-2] + (make_real3(PME_ORDER-j)-dr)*data[PME_ORDER-j-1]);
+            data[0] = scale*(make_real3(1)-dr)*data[0];
+            for (int ix = 0; ix < PME_ORDER; ix++) {
+                real dx = charge*data[ix].x;
+                for (int iy = 0; iy < PME_ORDER; iy++) {
+                    real dxdy = dx*data[iy].y;
+                    int base = ((localIndex.x+ix)*PME_BRICK_HALO_SIZE + localIndex.y+iy)*PME_BRICK_HALO_SIZE + localIndex.z;
+                    for (int iz = 0; iz < PME_ORDER; iz++) {
+                        real add = dxdy*data[iz].z;
+#if defined(USE_DOUBLE_PRECISION) || defined(USE_DETERMINISTIC_FORCES)
+                        atomicAdd(&brickGrid[base+iz], static_cast<unsigned long long>((long long) (add*0x100000000)));
+#else
+                        atomicAdd(&brickGrid[base+iz], add);
+#endif
+                    }
+                }
+            }
+        }
+        __syncthreads();
+
+        // Add the brick to the global grid.
+
+        for (int i = threadIdx.x; i < PME_BRICK_HALO_SIZE*PME_BRICK_HALO_SIZE*PME_BRICK_HALO_SIZE; i += blockDim.x) {
+            if (brickGrid[i] == 0)
+                continue;
+            int x = (brickOrigin.x + i/(PME_BRICK_HALO_SIZE*PME_BRICK_HALO_SIZE)) % GRID_SIZE_X;
+            int y = (brickOrigin.y + (i/PME_BRICK_HALO_SIZE)%PME_BRICK_HALO_SIZE) % GRID_SIZE_Y;
+            int z = (brickOrigin.z + i%PME_BRICK_HALO_SIZE) % GRID_SIZE_Z;
+            int index = (x*GRID_SIZE_Y+y)*blockSize + zindexTable[z];
+#if defined(USE_DOUBLE_PRECISION) || defined(USE_DETERMINISTIC_FORCES)
+            unsigned long long * ulonglong_p = (unsigned long long *) originalPmeGrid;
+            atomicAdd(&ulonglong_p[index], brickGrid[i]);
+#else
+            atomicAdd(&originalPmeGrid[index], brickGrid[i]);
+#endif
+        }
+        __syncthreads();
+    }
+}
+
 extern "C" __global__ void finishSpreadCharge(
 #if defined(USE_DOUBLE_PRECISION) || defined(USE_DETERMINISTIC_FORCES)
         const long long* __restrict__ grid1,
@@ -74,11 +74,10 @@ __global__ void sortShortList2(const DATA_TYPE* __restrict__ dataIn, DATA_TYPE*
 }
 
 /**
- * Calculate the minimum and maximum value in the array to be sorted.  This kernel
- * is executed as a single work group.
+ * Calculate the minimum and maximum value in a subset of the array to be sorted.  Each
+ * thread block processes a different subset and records the range it found.
  */
-__global__ void computeRange(const DATA_TYPE* __restrict__ data, unsigned int length, KEY_TYPE* __restrict__ range,
-        unsigned int numBuckets, unsigned int* __restrict__ bucketOffset) {
+__global__ void computeBlockRange(const DATA_TYPE* __restrict__ data, unsigned int length, KEY_TYPE* __restrict__ blockRange) {
     extern __shared__ KEY_TYPE minBuffer[];
     KEY_TYPE* maxBuffer = minBuffer+blockDim.x;
     KEY_TYPE minimum = MAX_KEY;
@@ -86,7 +85,7 @@ __global__ void computeRange(const DATA_TYPE* __restrict__ data, unsigned int le
 
     // Each thread calculates the range of a subset of values.
 
-    for (unsigned int index = threadIdx.x; index < length; index += blockDim.x) {
+    for (unsigned int index = blockIdx.x*blockDim.x+threadIdx.x; index < length; index += blockDim.x*gridDim.x) {
         KEY_TYPE value = getValue(data[index]);
         minimum = min(minimum, value);
         maximum = max(maximum, value);
@@ -94,6 +93,42 @@ __global__ void computeRange(const DATA_TYPE* __restrict__ data, unsigned int le
 
     // Now reduce them.
 
+    minBuffer[threadIdx.x] = minimum;
+    maxBuffer[threadIdx.x] = maximum;
+    __syncthreads();
+    for (unsigned int step = 1; step < blockDim.x; step *= 2) {
+        if (threadIdx.x+step < blockDim.x && threadIdx.x%(2*step) == 0) {
+            minBuffer[threadIdx.x] = min(minBuffer[threadIdx.x], minBuffer[threadIdx.x+step]);
+            maxBuffer[threadIdx.x] = max(maxBuffer[threadIdx.x], maxBuffer[threadIdx.x+step]);
+        }
+        __syncthreads();
+    }
+    if (threadIdx.x == 0) {
+        blockRange[2*blockIdx.x] = minBuffer[0];
+        blockRange[2*blockIdx.x+1] = maxBuffer[0];
+    }
+}
+
+/**
+ * Combine the ranges found by computeBlockRange() to get the minimum and maximum value in
+ * the whole array.  This kernel is executed as a single work group.
+ */
+__global__ void computeRange(const KEY_TYPE* __restrict__ blockRange, unsigned int numBlocks, KEY_TYPE* __restrict__ range,
+        unsigned int numBuckets, unsigned int* __restrict__ bucketOffset) {
+    extern __shared__ KEY_TYPE minBuffer[];
+    KEY_TYPE* maxBuffer = minBuffer+blockDim.x;
+    KEY_TYPE minimum = MAX_KEY;
+    KEY_TYPE maximum = MIN_KEY;
+
+    // Each thread combines the ranges from a subset of blocks.
+
+    for (unsigned int index = threadIdx.x; index < numBlocks; index += blockDim.x) {
+        minimum = min(minimum, blockRange[2*index]);
+        maximum = max(maximum, blockRange[2*index+1]);
+    }
+
+    // Now reduce them.
+
     minBuffer[threadIdx.x] = minimum;
     maxBuffer[threadIdx.x] = maximum;
     __syncthreads();
@@ -69,6 +69,54 @@ void testParallelComputation() {
         ASSERT_EQUAL_VEC(state1.getForces()[i], state2.getForces()[i], 1e-5);
 }
 
+void testDifferentExclusions() {
+    // Two forces with different exclusions should share the nonbonded kernel and still give the
+    // same results as evaluating each one on its own.
+
+    const int numParticles = 200;
+    System system1, system2, combinedSystem;
+    for (int i = 0; i < numParticles; i++) {
+        system1.addParticle(1.0);
+        system2.addParticle(1.0);
+        combinedSystem.addParticle(1.0);
+    }
+    CustomNonbondedForce* force1 = new CustomNonbondedForce("4*eps*((sigma/r)^12-(sigma/r)^6); sigma=0.3; eps=1");
+    CustomNonbondedForce* force2 = new CustomNonbondedForce("q/r; q=0.5");
+    vector<double> params;
+    for (int i = 0; i < numParticles; i++) {
+        force1->addParticle(params);
+        force2->addParticle(params);
+    }
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    vector<Vec3> positions(numParticles);
+    for (int i = 0; i < numParticles; i++)
+        positions[i] = Vec3(3*genrand_real2(sfmt), 3*genrand_real2(sfmt), 3*genrand_real2(sfmt));
+    for (int i = 1; i < numParticles; i++) {
+        force1->addExclusion(i-1, i);
+        if (i%3 == 0)
+            force2->addExclusion(i/3, i);
+    }
+    system1.addForce(new CustomNonbondedForce(*force1));
+    system2.addForce(new CustomNonbondedForce(*force2));
+    combinedSystem.addForce(force1);
+    combinedSystem.addForce(force2);
+    VerletIntegrator integrator1(0.01), integrator2(0.01), integrator3(0.01);
+    Context context1(system1, integrator1, platform);
+    Context context2(system2, integrator2, platform);
+    Context context3(combinedSystem, integrator3, platform);
+    context1.setPositions(positions);
+    context2.setPositions(positions);
+    context3.setPositions(positions);
+    State state1 = context1.getState(State::Forces | State::Energy);
+    State state2 = context2.getState(State::Forces | State::Energy);
+    State state3 = context3.getState(State::Forces | State::Energy);
+    ASSERT_EQUAL_TOL(state1.getPotentialEnergy()+state2.getPotentialEnergy(), state3.getPotentialEnergy(), 1e-5);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(state1.getForces()[i]+state2.getForces()[i], state3.getForces()[i], 1e-5);
+}
+
 void runPlatformTests() {
     testParallelComputation();
+    testDifferentExclusions();
 }
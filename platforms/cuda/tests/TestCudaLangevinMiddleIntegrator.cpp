@@ -32,5 +32,56 @@
 #include "CudaTests.h"
 #include "TestLangevinMiddleIntegrator.h"
 
+void testCudaGraphs() {
+    // Two Contexts with the same random number seed should produce the same trajectory whether
+    // or not the integration kernels are replayed from CUDA graphs.
+
+    const int numParticles = 20;
+    System system;
+    NonbondedForce* nonbonded = new NonbondedForce();
+    system.addForce(nonbonded);
+    vector<Vec3> positions(numParticles);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(i%4 == 0 ? 0.0 : 2.0);
+        nonbonded->addParticle(i%2 == 0 ? 0.2 : -0.2, 0.2, 1.0);
+        positions[i] = Vec3(0.5*(i%3), 0.5*((i/3)%3), 0.5*(i/9));
+    }
+    for (int i = 1; i < numParticles; i += 4)
+        system.addConstraint(i, i+1, 0.5);
+    LangevinMiddleIntegrator integrator1(300.0, 1.0, 0.002);
+    LangevinMiddleIntegrator integrator2(300.0, 1.0, 0.002);
+    integrator1.setRandomNumberSeed(5);
+    integrator2.setRandomNumberSeed(5);
+    Context context1(system, integrator1, platform);
+    map<string, string> properties;
+    properties[CudaPlatform::CudaUseCudaGraphs()] = "true";
+    Context context2(system, integrator2, platform, properties);
+    ASSERT_EQUAL("true", platform.getPropertyValue(context2, CudaPlatform::CudaUseCudaGraphs()));
+    context1.setPositions(positions);
+    context2.setPositions(positions);
+    for (int i = 0; i < 20; i++) {
+        integrator1.step(5);
+        integrator2.step(5);
+        State state1 = context1.getState(State::Positions | State::Velocities);
+        State state2 = context2.getState(State::Positions | State::Velocities);
+        for (int j = 0; j < numParticles; j++) {
+            ASSERT_EQUAL_VEC(state1.getPositions()[j], state2.getPositions()[j], 1e-4);
+            ASSERT_EQUAL_VEC(state1.getVelocities()[j], state2.getVelocities()[j], 1e-3);
+        }
+    }
+
+    // Changing the constraint tolerance should cause the graphs to be captured again.
+
+    integrator1.setConstraintTolerance(1e-6);
+    integrator2.setConstraintTolerance(1e-6);
+    integrator1.step(10);
+    integrator2.step(10);
+    State state1 = context1.getState(State::Positions);
+    State state2 = context2.getState(State::Positions);
+    for (int j = 0; j < numParticles; j++)
+        ASSERT_EQUAL_VEC(state1.getPositions()[j], state2.getPositions()[j], 1e-4);
+}
+
 void runPlatformTests() {
+    testCudaGraphs();
 }
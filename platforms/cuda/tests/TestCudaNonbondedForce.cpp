@@ -154,6 +154,91 @@ void testDeterministicForces() {
     }
 }
 
+void testPrunedNeighborList() {
+    // Run a hot system so the neighbor list is pruned many times between rebuilds.  Forces computed
+    // from the pruned list should match the Reference platform, which considers every pair.
+
+    const int numParticles = 1000;
+    const double boxSize = 4.0;
+    const double cutoff = 1.0;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    nonbonded->setCutoffDistance(cutoff);
+    system.addForce(nonbonded);
+    vector<Vec3> positions(numParticles);
+    vector<Vec3> velocities(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle(i%2 == 0 ? 0.5 : -0.5, 1.0, 0.0);
+        positions[i] = Vec3((i%10)+0.5*genrand_real2(sfmt), ((i/10)%10)+0.5*genrand_real2(sfmt), (i/100)+0.5*genrand_real2(sfmt))*(boxSize/10);
+        velocities[i] = Vec3(genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5)*10.0;
+    }
+    VerletIntegrator integrator(0.002);
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    context.setVelocities(velocities);
+    VerletIntegrator referenceIntegrator(0.002);
+    ReferencePlatform reference;
+    Context referenceContext(system, referenceIntegrator, reference);
+    for (int i = 0; i < 20; i++) {
+        integrator.step(3);
+        State state = context.getState(State::Positions | State::Forces | State::Energy);
+        referenceContext.setPositions(state.getPositions());
+        State referenceState = referenceContext.getState(State::Forces | State::Energy);
+        for (int j = 0; j < numParticles; j++)
+            ASSERT_EQUAL_VEC(referenceState.getForces()[j], state.getForces()[j], 1e-4);
+        ASSERT_EQUAL_TOL(referenceState.getPotentialEnergy(), state.getPotentialEnergy(), 1e-4);
+    }
+}
+
+void testSharedContext() {
+    // Check that several Contexts sharing the device's primary context each produce the same forces
+    // as a Context with its own CUDA context.
+
+    const int numParticles = 500;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(5, 0, 0), Vec3(0, 5, 0), Vec3(0, 0, 5));
+    NonbondedForce *nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::PME);
+    system.addForce(nonbonded);
+    vector<Vec3> positions;
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle(i%2 == 0 ? 1 : -1, 0.2, 0.5);
+        positions.push_back(Vec3(genrand_real2(sfmt), genrand_real2(sfmt), genrand_real2(sfmt))*5);
+    }
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    State state = context.getState(State::Forces | State::Energy);
+    map<string, string> properties;
+    properties[CudaPlatform::CudaUseSharedContext()] = "true";
+    VerletIntegrator integrator1(0.001), integrator2(0.001);
+    Context context1(system, integrator1, platform, properties);
+    Context context2(system, integrator2, platform, properties);
+    ASSERT_EQUAL("true", platform.getPropertyValue(context1, CudaPlatform::CudaUseSharedContext()));
+    context1.setPositions(positions);
+    context2.setPositions(positions);
+    integrator1.step(5);
+    integrator2.step(5);
+    context1.setPositions(positions);
+    context2.setPositions(positions);
+    State state1 = context1.getState(State::Forces | State::Energy);
+    State state2 = context2.getState(State::Forces | State::Energy);
+    ASSERT_EQUAL_TOL(state.getPotentialEnergy(), state1.getPotentialEnergy(), 1e-5);
+    ASSERT_EQUAL_TOL(state.getPotentialEnergy(), state2.getPotentialEnergy(), 1e-5);
+    for (int i = 0; i < numParticles; i++) {
+        ASSERT_EQUAL_VEC(state.getForces()[i], state1.getForces()[i], 1e-5);
+        ASSERT_EQUAL_VEC(state.getForces()[i], state2.getForces()[i], 1e-5);
+    }
+}
+
 bool canRunHugeTest() {
     // Create a minimal context just to see which device is being used.
 
@@ -181,6 +266,8 @@ void runPlatformTests() {
     testParallelComputation(NonbondedForce::PME);
     testReordering();
     testDeterministicForces();
+    testPrunedNeighborList();
+    testSharedContext();
     if (canRunHugeTest())
         testHugeSystem();
 }
@@ -213,6 +213,15 @@ public:
      * @param blocking if true, this call will block until the transfer is complete.
      */
     void upload(const void* data, bool blocking=true);
+    /**
+     * Copy values from an array to a contiguous range of elements in the Buffer.
+     * 
+     * @param data     the data to copy
+     * @param offset   the index of the first element to copy to
+     * @param elements the number of elements to copy
+     * @param blocking if true, this call will block until the transfer is complete.
+     */
+    void uploadSubArray(const void* data, int offset, int elements, bool blocking=true);
     /**
      * Copy the values in the Buffer to an array.
      * 
@@ -227,6 +236,7 @@ public:
      */
     void copyTo(ArrayInterface& dest) const;
 private:
+    void freeBuffer();
     OpenCLContext* context;
     cl::Buffer* buffer;
     int size, elementSize;
@@ -157,7 +157,8 @@ private:
     std::vector<OpenCLArray> bufferIndices;
     std::vector<std::string> prefixCode;
     std::vector<std::string> energyParameterDerivatives;
-    int numForceBuffers, maxBonds, allGroups;
+    std::vector<std::vector<int> > setGroupMaxBonds;
+    int numForceBuffers, allGroups;
     bool hasInitializedKernels;
 };
 
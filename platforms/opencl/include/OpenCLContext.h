@@ -54,6 +54,7 @@
 #include "OpenCLBondedUtilities.h"
 #include "OpenCLExpressionUtilities.h"
 #include "OpenCLIntegrationUtilities.h"
+#include "OpenCLMemoryPool.h"
 #include "OpenCLNonbondedUtilities.h"
 #include "OpenCLPlatform.h"
 #include "openmm/common/ComputeContext.h"
@@ -152,6 +153,14 @@ public:
     cl::Context& getContext() {
         return context;
     }
+    /**
+     * Get the pool from which device memory for arrays is allocated.  This is shared by all
+     * OpenCLContexts that use the same cl::Context.  It is NULL if the cl::Context has not been
+     * created yet or this OpenCLContext is being deleted.
+     */
+    OpenCLMemoryPool* getMemoryPool() {
+        return memoryPool;
+    }
     /**
      * Get the cl::Device associated with this object.
      */
@@ -650,9 +659,10 @@ private:
     bool supports64BitGlobalAtomics, supportsDoublePrecision, useDoublePrecision, useMixedPrecision, boxIsTriclinic, hasAssignedPosqCharges;
     mm_float4 periodicBoxSize, invPeriodicBoxSize, periodicBoxVecX, periodicBoxVecY, periodicBoxVecZ;
     mm_double4 periodicBoxSizeDouble, invPeriodicBoxSizeDouble, periodicBoxVecXDouble, periodicBoxVecYDouble, periodicBoxVecZDouble;
-    std::string defaultOptimizationOptions;
+    std::string defaultOptimizationOptions, cacheDir;
     std::map<std::string, std::string> compilationDefines;
     cl::Context context;
+    OpenCLMemoryPool* memoryPool;
     cl::Device device;
     cl::CommandQueue defaultQueue, currentQueue;
     cl::Kernel clearBufferKernel;
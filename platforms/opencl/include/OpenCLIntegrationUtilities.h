@@ -44,6 +44,7 @@ class OpenCLContext;
 class OPENMM_EXPORT_COMMON OpenCLIntegrationUtilities : public IntegrationUtilities {
 public:
     OpenCLIntegrationUtilities(OpenCLContext& context, const System& system);
+    ~OpenCLIntegrationUtilities();
     /**
      * Get the array which contains position deltas.
      */
@@ -53,6 +54,10 @@ public:
      * are independent, normally distributed random numbers with mean 0 and variance 1.
      */
     OpenCLArray& getRandom();
+    /**
+     * Get the array which contains the counter for the counter-based random number generator.
+     */
+    OpenCLArray& getRandomCounter();
     /**
      * Get the array which contains the current step size.
      */
@@ -62,9 +67,13 @@ public:
      */
     void distributeForcesFromVirtualSites();
 private:
-    void applyConstraintsImpl(bool constrainVelocities, double tol);
-    OpenCLArray ccmaConvergedHostBuffer;
-    bool ccmaUseDirectBuffer;
+    void applyConstraintsImpl(bool constrainVelocities, double tol, bool includeSettle);
+    OpenCLArray ccmaConvergedHostBuffer[2];
+    OpenCLArray ccmaConvergedScratchBuffer;
+    cl::Event ccmaEvent[2];
+    int* ccmaMappedResult[2];
+    bool ccmaResultPending[2];
+    cl_int ccmaZero;
 };
 
 } // namespace OpenMM
@@ -33,6 +33,7 @@
 #include "OpenCLFFT3D.h"
 #include "OpenCLParameterSet.h"
 #include "OpenCLSort.h"
+#include "openmm/common/CommonKernels.h"
 #include "openmm/kernels.h"
 #include "openmm/internal/CompiledExpressionSet.h"
 #include "openmm/internal/CustomIntegratorUtilities.h"
@@ -92,8 +93,10 @@ private:
  */
 class OpenCLUpdateStateDataKernel : public UpdateStateDataKernel {
 public:
-    OpenCLUpdateStateDataKernel(std::string name, const Platform& platform, OpenCLContext& cl) : UpdateStateDataKernel(name, platform), cl(cl) {
+    OpenCLUpdateStateDataKernel(std::string name, const Platform& platform, OpenCLContext& cl) : UpdateStateDataKernel(name, platform), cl(cl),
+            copyBuffer(NULL), copyPending(false) {
     }
+    ~OpenCLUpdateStateDataKernel();
     /**
      * Initialize the kernel.
      *
@@ -130,12 +133,39 @@ public:
      * @param velocities  on exit, this contains the particle velocities
      */
     void getVelocities(ContextImpl& context, std::vector<Vec3>& velocities);
+    /**
+     * Get the positions of all particles in single precision.
+     *
+     * @param positions  on exit, this contains the x, y, and z coordinates of each particle in turn
+     */
+    void getPositionsFloat(ContextImpl& context, std::vector<float>& positions);
+    /**
+     * Get the velocities of all particles in single precision.
+     *
+     * @param velocities  on exit, this contains the x, y, and z components of each particle's velocity in turn
+     */
+    void getVelocitiesFloat(ContextImpl& context, std::vector<float>& velocities);
     /**
      * Set the velocities of all particles.
      *
      * @param velocities  a vector containg the particle velocities
      */
     void setVelocities(ContextImpl& context, const std::vector<Vec3>& velocities);
+    /**
+     * Begin copying the positions and/or velocities of all particles so they can be retrieved later
+     * by finishStateCopy().
+     *
+     * @param positions   whether to copy the positions
+     * @param velocities  whether to copy the velocities
+     */
+    void beginStateCopy(ContextImpl& context, bool positions, bool velocities);
+    /**
+     * Wait for the copy started by beginStateCopy() to complete and retrieve the data.
+     *
+     * @param positions   on exit, this contains the particle positions, or is empty if they were not copied
+     * @param velocities  on exit, this contains the particle velocities, or is empty if they were not copied
+     */
+    void finishStateCopy(ContextImpl& context, std::vector<Vec3>& positions, std::vector<Vec3>& velocities);
     /**
      * Get the current forces on all particles.
      *
@@ -176,6 +206,59 @@ public:
      * @param stream    an input stream the checkpoint data should be read from
      */
     void loadCheckpoint(ContextImpl& context, std::istream& stream);
+private:
+    OpenCLContext& cl;
+    cl::Buffer* copyBuffer;
+    void* copyMemory;
+    cl::Event copyEvent;
+    bool copyPending, copyPositions, copyVelocities;
+    std::vector<cl_int> copyAtomOrder;
+    std::vector<mm_int4> copyCellOffsets;
+    Vec3 copyBoxVectors[3];
+};
+
+/**
+ * This kernel records the time spent executing kernels and other statistics about the performance of a Context.
+ */
+class OpenCLProfileKernel : public ProfileKernel {
+public:
+    OpenCLProfileKernel(std::string name, const Platform& platform, OpenCLContext& cl) : ProfileKernel(name, platform), cl(cl) {
+    }
+    /**
+     * Initialize the kernel.
+     *
+     * @param system     the System this kernel will be applied to
+     */
+    void initialize(const System& system);
+    /**
+     * Set whether to record the time spent executing each kernel.
+     *
+     * @param context    the context in which to execute this kernel
+     * @param enabled    whether profiling should be enabled
+     */
+    void setProfilingEnabled(ContextImpl& context, bool enabled);
+    /**
+     * Set which force groups subsequently launched kernels should be attributed to while profiling.
+     *
+     * @param context    the context in which to execute this kernel
+     * @param groups     a set of bit flags for the force groups being computed
+     */
+    void setProfiledForceGroups(ContextImpl& context, int groups);
+    /**
+     * Set the owner that device memory allocated from now on should be attributed to.
+     *
+     * @param context    the context in which to execute this kernel
+     * @param owner      the owner to attribute memory to
+     */
+    void setMemoryOwner(ContextImpl& context, const std::string& owner);
+    /**
+     * Get the times that have been recorded since profiling was enabled.
+     *
+     * @param context    the context in which to execute this kernel
+     * @param report     on exit, this maps each kernel and force group to the total time spent on it in milliseconds,
+     *                   and also contains statistics about the neighbor list and the device memory in use
+     */
+    void getPerformanceReport(ContextImpl& context, std::map<std::string, double>& report);
 private:
     OpenCLContext& cl;
 };
@@ -271,6 +354,18 @@ public:
      * @param force      the NonbondedForce to copy the parameters from
      */
     void copyParametersToContext(ContextImpl& context, const NonbondedForce& force);
+    /**
+     * Copy changed parameters over to a context, when only a range of particles and exceptions
+     * may have changed.
+     *
+     * @param context         the context to copy parameters to
+     * @param force           the NonbondedForce to copy the parameters from
+     * @param firstParticle   the index of the first particle whose parameters might have changed
+     * @param lastParticle    the index of the last particle whose parameters might have changed
+     * @param firstException  the index of the first exception whose parameters might have changed
+     * @param lastException   the index of the last exception whose parameters might have changed
+     */
+    void copyParameterRangeToContext(ContextImpl& context, const NonbondedForce& force, int firstParticle, int lastParticle, int firstException, int lastException);
     /**
      * Get the parameters being used for PME.
      *
@@ -363,14 +458,15 @@ private:
     cl::Kernel pmeDispersionInterpolateForceKernel;
     std::map<std::string, std::string> pmeDefines;
     std::vector<std::pair<int, int> > exceptionAtoms;
+    std::map<int, int> exceptionIndex;
+    std::vector<mm_float4> hostParticleParams;
     std::vector<std::string> paramNames;
     std::vector<double> paramValues;
     double ewaldSelfEnergy, dispersionCoefficient, alpha, dispersionAlpha;
-    int gridSizeX, gridSizeY, gridSizeZ;
+    int gridSizeX, gridSizeY, gridSizeZ, pmeOrder;
     int dispersionGridSizeX, dispersionGridSizeY, dispersionGridSizeZ;
     bool hasCoulomb, hasLJ, usePmeQueue, doLJPME, usePosqCharges, recomputeParams, hasOffsets;
     NonbondedMethod nonbondedMethod;
-    static const int PmeOrder = 5;
 };
 
 /**
@@ -379,7 +475,7 @@ private:
 class OpenCLCalcCustomCVForceKernel : public CalcCustomCVForceKernel {
 public:
     OpenCLCalcCustomCVForceKernel(std::string name, const Platform& platform, OpenCLContext& cl) : CalcCustomCVForceKernel(name, platform),
-            cl(cl), hasInitializedKernels(false) {
+            cl(cl), hasInitializedKernels(false), hasInitializedAddForces(false) {
     }
     /**
      * Initialize the kernel.
@@ -389,6 +485,14 @@ public:
      * @param innerContext   the context created by the CustomCVForce for computing collective variables
      */
     void initialize(const System& system, const CustomCVForce& force, ContextImpl& innerContext);
+    /**
+     * Initialize the kernel for a force whose collective variables are evaluated directly in the
+     * context it belongs to, rather than in an inner context.
+     *
+     * @param system     the System this kernel will be applied to
+     * @param force      the CustomCVForce this kernel will be used for
+     */
+    void initialize(const System& system, const CustomCVForce& force);
     /**
      * Execute the kernel to calculate the forces and/or energy.
      *
@@ -399,6 +503,26 @@ public:
      * @return the potential energy due to the force
      */
     double execute(ContextImpl& context, ContextImpl& innerContext, bool includeForces, bool includeEnergy);
+    /**
+     * Execute the kernel to calculate the forces and/or energy, given collective variables that were
+     * evaluated directly in the context.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param values         the values of the collective variables
+     * @param paramDerivs    the derivatives of each collective variable with respect to global parameters
+     * @param includeForces  true if forces should be calculated
+     * @param includeEnergy  true if the energy should be calculated
+     * @return the potential energy due to the force
+     */
+    double execute(ContextImpl& context, const std::vector<double>& values, const std::vector<std::map<std::string, double> >& paramDerivs, bool includeForces, bool includeEnergy);
+    /**
+     * Save the forces currently stored in the context as the forces for one collective variable.  This
+     * is called just after the variable's force group has been evaluated on its own.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param index          the index of the collective variable
+     */
+    void copyVariableForces(ContextImpl& context, int index);
     /**
      * Copy state information to the inner context.
      *
@@ -417,7 +541,7 @@ private:
     class ForceInfo;
     class ReorderListener;
     OpenCLContext& cl;
-    bool hasInitializedKernels;
+    bool hasInitializedKernels, hasInitializedAddForces;
     Lepton::ExpressionProgram energyExpression;
     std::vector<std::string> variableNames, paramDerivNames, globalParameterNames;
     std::vector<Lepton::ExpressionProgram> variableDerivExpressions;
@@ -475,6 +599,20 @@ private:
     std::vector<int> lastAtomOrder;
 };
 
+/**
+ * This kernel is invoked by ReplicaExchange to exchange the positions and velocities of two contexts.
+ * The exchange is done on the device when both contexts use the same OpenCL context.
+ */
+class OpenCLSwapStateKernel : public CommonSwapStateKernel {
+public:
+    OpenCLSwapStateKernel(std::string name, const Platform& platform, OpenCLContext& cl) : CommonSwapStateKernel(name, platform, cl), cl(cl) {
+    }
+protected:
+    ComputeContext* getComputeContext(ContextImpl& other);
+private:
+    OpenCLContext& cl;
+};
+
 } // namespace OpenMM
 
 #endif /*OPENMM_OPENCLKERNELS_H_*/
@@ -0,0 +1,135 @@
+#ifndef OPENMM_OPENCLMEMORYPOOL_H_
+#define OPENMM_OPENCLMEMORYPOOL_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2024 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * This program is free software: you can redistribute it and/or modify       *
+ * it under the terms of the GNU Lesser General Public License as published   *
+ * by the Free Software Foundation, either version 3 of the License, or       *
+ * (at your option) any later version.                                        *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU Lesser General Public License for more details.                        *
+ *                                                                            *
+ * You should have received a copy of the GNU Lesser General Public License   *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.      *
+ * -------------------------------------------------------------------------- */
+
+#include <cl.hpp>
+#include <pthread.h>
+#include <map>
+#include <utility>
+#include <vector>
+#include "openmm/common/windowsExportCommon.h"
+
+namespace OpenMM {
+
+/**
+ * This class caches device memory so it can be reused by OpenCLArrays without creating a new
+ * cl::Buffer every time one is created, resized, or deleted.  A single pool is shared by all
+ * OpenCLContexts that use the same cl::Context.
+ *
+ * Allocations are rounded up to a set of size classes (powers of two and three intermediate steps
+ * between them), and freed buffers are kept in a separate list for each combination of size class
+ * and memory flags.  A freed buffer is only reused by an allocation on the same queue it was last
+ * used on, so commands that still reference it are guaranteed to execute first.
+ *
+ * If creating a buffer fails, all cached buffers are released and the allocation is retried.
+ */
+
+class OPENMM_EXPORT_COMMON OpenCLMemoryPool {
+public:
+    /**
+     * Information about the memory managed by a pool.
+     */
+    struct Statistics {
+        /**
+         * The number of bytes currently allocated to arrays (rounded up to the size class).
+         */
+        size_t bytesInUse;
+        /**
+         * The number of bytes held in the cache waiting to be reused.
+         */
+        size_t bytesCached;
+        /**
+         * The largest value bytesInUse has reached.
+         */
+        size_t peakBytesInUse;
+        /**
+         * The number of cl::Buffers that have been created.
+         */
+        long long numDeviceAllocations;
+        /**
+         * The number of allocations that were satisfied from the cache.
+         */
+        long long numReusedAllocations;
+    };
+    /**
+     * Get the pool for a cl::Context, creating it if necessary.  Every call to this must be balanced
+     * by a call to release().
+     */
+    static OpenCLMemoryPool* acquire(cl::Context& context);
+    /**
+     * Indicate that a pool returned by acquire() is no longer needed.  When the last reference is
+     * released, all cached memory is freed.
+     */
+    static void release(OpenCLMemoryPool* pool);
+    /**
+     * Allocate a buffer.  This throws a cl::Error if the allocation fails.
+     *
+     * @param size      the number of bytes required
+     * @param flags     the memory flags to create the buffer with
+     * @param queue     the queue the memory will be used on
+     * @return the newly allocated buffer
+     */
+    cl::Buffer* allocate(size_t size, cl_mem_flags flags, cl::CommandQueue& queue);
+    /**
+     * Return a buffer to the pool.
+     *
+     * @param buffer    the buffer, as returned by allocate()
+     * @param size      the size that was passed to allocate()
+     * @param flags     the flags that were passed to allocate()
+     * @param queue     the queue on which the buffer was last used
+     */
+    void free(cl::Buffer* buffer, size_t size, cl_mem_flags flags, cl::CommandQueue& queue);
+    /**
+     * Free all cached memory that is not currently in use.
+     */
+    void releaseCachedMemory();
+    /**
+     * Get statistics about the memory managed by this pool.
+     */
+    Statistics getStatistics();
+private:
+    struct Block {
+        cl::Buffer* buffer;
+        cl_command_queue queue;
+    };
+    OpenCLMemoryPool(cl::Context& context);
+    ~OpenCLMemoryPool();
+    static size_t getSizeClass(size_t size);
+    void releaseCachedMemoryLocked();
+    static pthread_mutex_t poolsLock;
+    static std::map<cl_context, OpenCLMemoryPool*> pools;
+    cl::Context context;
+    int referenceCount;
+    pthread_mutex_t lock;
+    std::map<std::pair<cl_mem_flags, size_t>, std::vector<Block> > cache;
+    Statistics stats;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_OPENCLMEMORYPOOL_H_*/
@@ -83,6 +83,20 @@ public:
      * @param forceGroup     the force group in which the interaction should be calculated
      */
     void addInteraction(bool usesCutoff, bool usesPeriodic, bool usesExclusions, double cutoffDistance, const std::vector<std::vector<int> >& exclusionList, const std::string& kernel, int forceGroup);
+    /**
+     * Add a nonbonded interaction to be evaluated by the default interaction kernel.  This platform never
+     * uses a separate pair list, so supportsPairList is ignored.
+     *
+     * @param usesCutoff       specifies whether a cutoff should be applied to this interaction
+     * @param usesPeriodic     specifies whether periodic boundary conditions should be applied to this interaction
+     * @param usesExclusions   specifies whether this interaction uses exclusions.  If this is true, it must have identical exclusions to every other interaction.
+     * @param cutoffDistance   the cutoff distance for this interaction (ignored if usesCutoff is false)
+     * @param exclusionList    for each atom, specifies the list of other atoms whose interactions should be excluded
+     * @param kernel           the code to evaluate the interaction
+     * @param forceGroup       the force group in which the interaction should be calculated
+     * @param supportsPairList specifies whether this interaction can work with a neighbor list that uses a separate pair list
+     */
+    void addInteraction(bool usesCutoff, bool usesPeriodic, bool usesExclusions, double cutoffDistance, const std::vector<std::vector<int> >& exclusionList, const std::string& kernel, int forceGroup, bool supportsPairList);
     /**
      * Add a per-atom parameter that the default interaction kernel may depend on.
      */
@@ -187,10 +201,19 @@ public:
     void computeInteractions(int forceGroups, bool includeForces, bool includeEnergy);
     /**
      * Check to see if the neighbor list arrays are large enough, and make them bigger if necessary.
+     * They are also enlarged when they are nearly full, so they can usually grow before they overflow.
      *
-     * @return true if the neighbor list needed to be enlarged.
+     * @return true if the neighbor list overflowed, so the forces must be recomputed.
      */
     bool updateNeighborListSize();
+    /**
+     * Wait for the size of the most recently built neighbor list to become available, and enlarge
+     * the neighbor list if it was too small.  computeInteractions() does not wait for this itself, so
+     * the rest of the force computation can be queued first.  Call this once all of it has been queued.
+     *
+     * @return true if the neighbor list needed to be enlarged.
+     */
+    bool checkNeighborListSize();
     /**
      * Get the array containing the center of each atom block.
      */
@@ -221,6 +244,18 @@ public:
     OpenCLArray& getInteractingAtoms() {
         return interactingAtoms;
     }
+    /**
+     * Get whether the neighbor list stores some interactions as a separate list of single atom pairs.
+     * This is always false on this platform.
+     */
+    bool getUsePairList() {
+        return false;
+    }
+    /**
+     * Get the array containing single pairs in the neighbor list.  Since this platform never uses a
+     * pair list, this throws an exception.
+     */
+    OpenCLArray& getSinglePairs();
     /**
      * Get the array containing exclusion flags.
      */
@@ -252,6 +287,10 @@ public:
     OpenCLArray& getRebuildNeighborList() {
         return rebuildNeighborList;
     }
+    /**
+     * Add statistics describing the neighbor list to a map, with keys of the form "neighborList:<name>".
+     */
+    void getNeighborListStatistics(std::map<std::string, double>& statistics);
     /**
      * Get the index of the first tile this context is responsible for processing.
      */
@@ -315,6 +354,7 @@ private:
     OpenCLArray sortedBlockCenter;
     OpenCLArray sortedBlockBoundingBox;
     OpenCLArray oldPositions;
+    OpenCLArray oldBoxSize;
     OpenCLArray rebuildNeighborList;
     OpenCLSort* blockSorter;
     cl::Event downloadCountEvent;
@@ -327,10 +367,11 @@ private:
     std::map<int, double> groupCutoff;
     std::map<int, std::string> groupKernelSource;
     double lastCutoff;
-    bool useCutoff, usePeriodic, deviceIsCpu, anyExclusions, usePadding, forceRebuildNeighborList;
+    bool useCutoff, usePeriodic, deviceIsCpu, useShuffle, anyExclusions, usePadding, forceRebuildNeighborList, hasPendingCount;
     int numForceBuffers, startTileIndex, startBlockIndex, numBlocks, maxExclusions, numForceThreadBlocks;
     int forceThreadBlockSize, interactingBlocksThreadBlockSize, groupFlags;
-    long long numTiles;
+    long long numTiles, numNeighborListEvaluations, numNeighborListBuilds;
+    int numNeighborListReallocations;
 };
 
 /**
@@ -104,19 +104,47 @@ public:
         static const std::string key = "DisablePmeStream";
         return key;
     }
+    /**
+     * This is the name of the parameter for selecting whether to benchmark several PME grid sizes when
+     * a Context is created, and use whichever one is fastest.
+     */
+    static const std::string& OpenCLTunePme() {
+        static const std::string key = "TunePme";
+        return key;
+    }
+    /**
+     * This is the name of the parameter for selecting whether to compile the values of global parameters
+     * into kernels as constants, recompiling them whenever a value changes.
+     */
+    static const std::string& OpenCLSpecializeGlobalParameters() {
+        static const std::string key = "SpecializeGlobalParameters";
+        return key;
+    }
+    /**
+     * This is the name of the parameter for selecting the algorithm used for constraints that are not
+     * handled by SETTLE or SHAKE.  Allowed values are "CCMA" and "LINCS".
+     */
+    static const std::string& OpenCLConstraintAlgorithm() {
+        static const std::string key = "ConstraintAlgorithm";
+        return key;
+    }
+private:
+    bool hasGpuDevice;
 };
 
 class OPENMM_EXPORT_COMMON OpenCLPlatform::PlatformData {
 public:
     PlatformData(const System& system, const std::string& platformPropValue, const std::string& deviceIndexProperty, const std::string& precisionProperty,
-            const std::string& cpuPmeProperty, const std::string& pmeStreamProperty, int numThreads, ContextImpl* originalContext);
+            const std::string& cpuPmeProperty, const std::string& pmeStreamProperty, const std::string& tunePmeProperty, const std::string& specializeGlobalsProperty,
+            const std::string& constraintAlgorithmProperty,
+            int numThreads, ContextImpl* originalContext);
     ~PlatformData();
     void initializeContexts(const System& system);
     void syncContexts();
     ContextImpl* context;
     std::vector<OpenCLContext*> contexts;
     std::vector<double> contextEnergy;
-    bool hasInitializedContexts, removeCM, useCpuPme, disablePmeStream;
+    bool hasInitializedContexts, removeCM, useCpuPme, disablePmeStream, tunePme, specializeGlobalParameters, useLincs;
     int cmMotionFrequency;
     int stepCount, computeForceCount;
     double time;
@@ -88,12 +88,13 @@ private:
     OpenCLContext& context;
     SortTrait* trait;
     OpenCLArray dataRange;
+    OpenCLArray blockRange;
     OpenCLArray bucketOfElement;
     OpenCLArray offsetInBucket;
     OpenCLArray bucketOffset;
     OpenCLArray buckets;
-    cl::Kernel shortListKernel, shortList2Kernel, computeRangeKernel, assignElementsKernel, computeBucketPositionsKernel, copyToBucketsKernel, sortBucketsKernel;
-    unsigned int dataLength, rangeKernelSize, positionsKernelSize, sortKernelSize;
+    cl::Kernel shortListKernel, shortList2Kernel, computeBlockRangeKernel, computeRangeKernel, assignElementsKernel, computeBucketPositionsKernel, copyToBucketsKernel, sortBucketsKernel;
+    unsigned int dataLength, rangeKernelSize, numRangeBlocks, positionsKernelSize, sortKernelSize;
     bool isShortList, useShortList2;
 };
 
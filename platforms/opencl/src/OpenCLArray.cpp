@@ -44,8 +44,10 @@ OpenCLArray::OpenCLArray(OpenCLContext& context, cl::Buffer* buffer, int size, i
 }
 
 OpenCLArray::~OpenCLArray() {
-    if (buffer != NULL && ownsBuffer)
-        delete buffer;
+    if (buffer != NULL && ownsBuffer) {
+        context->recordArrayRelease(this);
+        freeBuffer();
+    }
 }
 
 void OpenCLArray::initialize(ComputeContext& context, int size, int elementSize, const std::string& name) {
@@ -62,13 +64,18 @@ void OpenCLArray::initialize(OpenCLContext& context, int size, int elementSize,
     this->flags = flags;
     ownsBuffer = true;
     try {
-        buffer = new cl::Buffer(context.getContext(), flags, size*elementSize);
+        OpenCLMemoryPool* pool = context.getMemoryPool();
+        if (pool == NULL)
+            buffer = new cl::Buffer(context.getContext(), flags, size*elementSize);
+        else
+            buffer = pool->allocate(size*elementSize, flags, context.getQueue());
     }
     catch (cl::Error err) {
         std::stringstream str;
         str<<"Error creating array "<<name<<": "<<err.what()<<" ("<<err.err()<<")";
         throw OpenMMException(str.str());
     }
+    context.recordArrayAllocation(this, name, (long long) size*elementSize);
 }
 
 void OpenCLArray::initialize(OpenCLContext& context, cl::Buffer* buffer, int size, int elementSize, const std::string& name) {
@@ -87,11 +94,19 @@ void OpenCLArray::resize(int size) {
         throw OpenMMException("OpenCLArray has not been initialized");
     if (!ownsBuffer)
         throw OpenMMException("Cannot resize an array that does not own its storage");
-    delete buffer;
+    freeBuffer();
     buffer = NULL;
     initialize(*context, size, elementSize, name, flags);
 }
 
+void OpenCLArray::freeBuffer() {
+    OpenCLMemoryPool* pool = context->getMemoryPool();
+    if (pool == NULL)
+        delete buffer;
+    else
+        pool->free(buffer, size*elementSize, flags, context->getQueue());
+}
+
 ComputeContext& OpenCLArray::getContext() {
     return *context;
 }
@@ -109,6 +124,23 @@ void OpenCLArray::upload(const void* data, bool blocking) {
     }
 }
 
+void OpenCLArray::uploadSubArray(const void* data, int offset, int elements, bool blocking) {
+    if (buffer == NULL)
+        throw OpenMMException("OpenCLArray has not been initialized");
+    if (offset < 0 || elements < 0 || offset+elements > size)
+        throw OpenMMException("Error uploading array "+name+": The specified range exceeds the size of the array");
+    if (elements == 0)
+        return;
+    try {
+        context->getQueue().enqueueWriteBuffer(*buffer, blocking ? CL_TRUE : CL_FALSE, offset*elementSize, elements*elementSize, data);
+    }
+    catch (cl::Error err) {
+        std::stringstream str;
+        str<<"Error uploading array "<<name<<": "<<err.what()<<" ("<<err.err()<<")";
+        throw OpenMMException(str.str());
+    }
+}
+
 void OpenCLArray::download(void* data, bool blocking) const {
     if (buffer == NULL)
         throw OpenMMException("OpenCLArray has not been initialized");
@@ -28,13 +28,14 @@
 #include "OpenCLContext.h"
 #include "OpenCLExpressionUtilities.h"
 #include "openmm/OpenMMException.h"
+#include "openmm/internal/TraceRange.h"
 #include "OpenCLNonbondedUtilities.h"
 #include <iostream>
 
 using namespace OpenMM;
 using namespace std;
 
-OpenCLBondedUtilities::OpenCLBondedUtilities(OpenCLContext& context) : context(context), numForceBuffers(0), maxBonds(0), allGroups(0), hasInitializedKernels(false) {
+OpenCLBondedUtilities::OpenCLBondedUtilities(OpenCLContext& context) : context(context), numForceBuffers(0), allGroups(0), hasInitializedKernels(false) {
 }
 
 void OpenCLBondedUtilities::addInteraction(const vector<vector<int> >& atoms, const string& source, int group) {
@@ -198,16 +199,19 @@ void OpenCLBondedUtilities::initialize(const System& system) {
             s<<", __global const "<<indexType<<"* restrict bufferIndices"<<i;
         }
         for (int i = 0; i < (int) arguments.size(); i++)
-            s<<", __global "<<argTypes[i]<<"* customArg"<<(i+1);
+            s<<", __global "<<argTypes[i]<<(argTypes[i].rfind("const ", 0) == 0 ? "* restrict" : "*")<<" customArg"<<(i+1);
         if (energyParameterDerivatives.size() > 0)
             s<<", __global mixed* restrict energyParamDerivs";
         s<<") {\n";
         s<<"mixed energy = 0;\n";
         for (int i = 0; i < energyParameterDerivatives.size(); i++)
             s<<"mixed energyParamDeriv"<<i<<" = 0;\n";
+        setGroupMaxBonds.push_back(vector<int>(32, 0));
         for (int i = 0; i < setSize; i++) {
             int force = set[i];
-            s<<createForceSource(i, forceAtoms[force].size(), forceAtoms[force][0].size(), forceGroup[force], forceSource[force]);
+            int numBonds = forceAtoms[force].size();
+            setGroupMaxBonds.back()[forceGroup[force]] = max(setGroupMaxBonds.back()[forceGroup[force]], numBonds);
+            s<<createForceSource(i, numBonds, forceAtoms[force][0].size(), forceGroup[force], forceSource[force]);
         }
         s<<"energyBuffer[get_global_id(0)] += energy;\n";
         const vector<string>& allParamDerivNames = context.getEnergyParamDerivNames();
@@ -227,7 +231,6 @@ void OpenCLBondedUtilities::initialize(const System& system) {
 }
 
 string OpenCLBondedUtilities::createForceSource(int forceIndex, int numBonds, int numAtoms, int group, const string& computeForce) {
-    maxBonds = max(maxBonds, numBonds);
     int width = 1;
     while (width < numAtoms)
         width *= 2;
@@ -275,6 +278,7 @@ string OpenCLBondedUtilities::createForceSource(int forceIndex, int numBonds, in
 void OpenCLBondedUtilities::computeInteractions(int groups) {
     if ((groups&allGroups) == 0)
         return;
+    OPENMM_TRACE_RANGE("Bonded interactions");
     if (!hasInitializedKernels) {
         hasInitializedKernels = true;
         for (int i = 0; i < (int) forceSets.size(); i++) {
@@ -298,6 +302,15 @@ void OpenCLBondedUtilities::computeInteractions(int groups) {
         }
     }
     for (int i = 0; i < (int) kernels.size(); i++) {
+        // Skip kernels that contain no forces in the groups being computed, and only launch as many
+        // threads as are needed for the ones that are.
+
+        int numBonds = 0;
+        for (int j = 0; j < 32; j++)
+            if ((groups&(1<<j)) != 0)
+                numBonds = max(numBonds, setGroupMaxBonds[i][j]);
+        if (numBonds == 0)
+            continue;
         cl::Kernel& kernel = kernels[i];
         kernel.setArg<cl_int>(3, groups);
         if (context.getUseDoublePrecision()) {
@@ -314,6 +327,6 @@ void OpenCLBondedUtilities::computeInteractions(int groups) {
             kernel.setArg<mm_float4>(7, context.getPeriodicBoxVecY());
             kernel.setArg<mm_float4>(8, context.getPeriodicBoxVecZ());
         }
-        context.executeKernel(kernels[i], maxBonds);
+        context.executeKernel(kernels[i], numBonds);
     }
 }
@@ -38,16 +38,27 @@
 #include "OpenCLNonbondedUtilities.h"
 #include "OpenCLProgram.h"
 #include "openmm/common/ComputeArray.h"
+#include "SHA1.h"
 #include "openmm/Platform.h"
 #include "openmm/System.h"
 #include "openmm/VirtualSite.h"
 #include "openmm/internal/ContextImpl.h"
 #include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
 #include <set>
 #include <sstream>
 #include <typeinfo>
+#ifdef WIN32
+  #include <Windows.h>
+#else
+  #include <unistd.h>
+#endif
 
 using namespace OpenMM;
 using namespace std;
@@ -79,7 +90,7 @@ static bool isSupported(cl::Platform platform) {
 
 OpenCLContext::OpenCLContext(const System& system, int platformIndex, int deviceIndex, const string& precision, OpenCLPlatform::PlatformData& platformData, OpenCLContext* originalContext) :
         ComputeContext(system), platformData(platformData), numForceBuffers(0), hasAssignedPosqCharges(false),
-        integration(NULL), expression(NULL), bonded(NULL), nonbonded(NULL) {
+        memoryPool(NULL), integration(NULL), expression(NULL), bonded(NULL), nonbonded(NULL) {
     if (precision == "single") {
         useDoublePrecision = false;
         useMixedPrecision = false;
@@ -94,6 +105,13 @@ OpenCLContext::OpenCLContext(const System& system, int platformIndex, int device
     }
     else
         throw OpenMMException("Illegal value for Precision: "+precision);
+    char* cacheVariable = getenv("OPENMM_CACHE_DIR");
+#ifdef WIN32
+    cacheDir = (cacheVariable == NULL ? string(getenv("TEMP")) : string(cacheVariable))+"\\";
+#else
+    char* tmpdir = getenv("TMPDIR");
+    cacheDir = (cacheVariable != NULL ? string(cacheVariable) : tmpdir != NULL ? string(tmpdir) : string(P_tmpdir))+"/";
+#endif
     try {
         contextIndex = platformData.contexts.size();
         std::vector<cl::Platform> platforms;
@@ -296,6 +314,7 @@ OpenCLContext::OpenCLContext(const System& system, int platformIndex, int device
             defaultQueue = originalContext->defaultQueue;
         }
         currentQueue = defaultQueue;
+        memoryPool = OpenCLMemoryPool::acquire(context);
         numAtoms = system.getNumParticles();
         paddedNumAtoms = TileSize*((numAtoms+TileSize-1)/TileSize);
         numAtomBlocks = (paddedNumAtoms+(TileSize-1))/TileSize;
@@ -489,6 +508,14 @@ OpenCLContext::~OpenCLContext() {
         delete bonded;
     if (nonbonded != NULL)
         delete nonbonded;
+
+    // Arrays that are members of this object get deleted after the pool has been released,
+    // so they must free their buffers directly.
+
+    if (memoryPool != NULL) {
+        OpenCLMemoryPool::release(memoryPool);
+        memoryPool = NULL;
+    }
 }
 
 void OpenCLContext::initialize() {
@@ -617,6 +644,39 @@ cl::Program OpenCLContext::createProgram(const string source, const map<string,
     // Get length before using c_str() to avoid length() call invalidating the c_str() value.
     string src_string = src.str();
     ::size_t src_length = src_string.length();
+
+    // See whether we already have a binary for this program cached.  The hash includes the device
+    // and driver, since binaries cannot be moved between them.
+
+    string deviceDescription = device.getInfo<CL_DEVICE_NAME>()+"\n"+device.getInfo<CL_DEVICE_VERSION>()+"\n"+device.getInfo<CL_DRIVER_VERSION>()+"\n";
+    CSHA1 sha1;
+    sha1.Update((const UINT_8*) deviceDescription.c_str(), deviceDescription.size());
+    sha1.Update((const UINT_8*) src_string.c_str(), src_length);
+    sha1.Final();
+    UINT_8 hash[20];
+    sha1.GetHash(hash);
+    stringstream cacheFile;
+    cacheFile << cacheDir;
+    cacheFile.flags(ios::hex);
+    for (int i = 0; i < 20; i++)
+        cacheFile << setw(2) << setfill('0') << (int) hash[i];
+    cacheFile << "_opencl";
+    ifstream cached(cacheFile.str().c_str(), ios::binary);
+    if (cached.is_open()) {
+        vector<char> binary((istreambuf_iterator<char>(cached)), istreambuf_iterator<char>());
+        cached.close();
+        if (binary.size() > 0) {
+            try {
+                cl::Program::Binaries binaries(1, make_pair((const void*) &binary[0], binary.size()));
+                cl::Program program(context, vector<cl::Device>(1, device), binaries);
+                program.build(vector<cl::Device>(1, device), options.c_str());
+                return program;
+            }
+            catch (cl::Error err) {
+                // The cached binary could not be used, so compile the program from source.
+            }
+        }
+    }
     cl::Program::Sources sources(1, make_pair(src_string.c_str(), src_length));
     cl::Program program(context, sources);
     try {
@@ -624,6 +684,33 @@ cl::Program OpenCLContext::createProgram(const string source, const map<string,
     } catch (cl::Error err) {
         throw OpenMMException("Error compiling kernel: "+program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device));
     }
+
+    // Try to save the binary to the cache.  Write it to a temporary file first, so another process
+    // can never load a partially written binary.
+
+    try {
+        vector<char*> binaries = program.getInfo<CL_PROGRAM_BINARIES>();
+        vector< ::size_t> sizes = program.getInfo<CL_PROGRAM_BINARY_SIZES>();
+        if (binaries.size() == 1 && sizes[0] > 0) {
+            stringstream tempFile;
+            tempFile << cacheFile.str() << "_" << this;
+#ifdef WIN32
+            tempFile << "_" << GetCurrentProcessId();
+#else
+            tempFile << "_" << getpid();
+#endif
+            ofstream out(tempFile.str().c_str(), ios::binary);
+            out.write(binaries[0], sizes[0]);
+            out.close();
+            if (out.fail() || rename(tempFile.str().c_str(), cacheFile.str().c_str()) != 0)
+                remove(tempFile.str().c_str());
+        }
+        for (char* binary : binaries)
+            delete[] binary;
+    }
+    catch (...) {
+        // Ignore errors.  The program can still be used even if it could not be cached.
+    }
     return program;
 }
 
@@ -668,6 +755,14 @@ void OpenCLContext::executeKernel(cl::Kernel& kernel, int workUnits, int blockSi
     if (blockSize == -1)
         blockSize = ThreadBlockSize;
     int size = std::min((workUnits+blockSize-1)/blockSize, numThreadBlocks)*blockSize;
+    chrono::steady_clock::time_point startTime;
+    if (profilingEnabled) {
+        // Profiling information is only available from queues that were created with it enabled,
+        // so instead wait for all prior work and time the kernel on the host.
+
+        currentQueue.finish();
+        startTime = chrono::steady_clock::now();
+    }
     try {
         currentQueue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(size), cl::NDRange(blockSize));
     }
@@ -676,6 +771,11 @@ void OpenCLContext::executeKernel(cl::Kernel& kernel, int workUnits, int blockSi
         str<<"Error invoking kernel "<<kernel.getInfo<CL_KERNEL_FUNCTION_NAME>()<<": "<<err.what()<<" ("<<err.err()<<")";
         throw OpenMMException(str.str());
     }
+    if (profilingEnabled) {
+        currentQueue.finish();
+        double time = chrono::duration<double, milli>(chrono::steady_clock::now()-startTime).count();
+        recordKernelTime(kernel.getInfo<CL_KERNEL_FUNCTION_NAME>(), profiledForceGroups, time);
+    }
 }
 
 void OpenCLContext::clearBuffer(ArrayInterface& array) {
@@ -784,16 +884,11 @@ double OpenCLContext::reduceEnergy() {
     reduceEnergyKernel.setArg<cl_int>(3, workGroupSize);
     reduceEnergyKernel.setArg(4, workGroupSize*energyBuffer.getElementSize(), NULL);
     executeKernel(reduceEnergyKernel, workGroupSize, workGroupSize);
-    if (getUseDoublePrecision() || getUseMixedPrecision()) {
-        double energy;
-        energySum.download(&energy);
-        return energy;
-    }
-    else {
-        float energy;
-        energySum.download(&energy);
-        return energy;
-    }
+    energySum.download(pinnedMemory);
+    if (getUseDoublePrecision() || getUseMixedPrecision())
+        return *((double*) pinnedMemory);
+    else
+        return *((float*) pinnedMemory);
 }
 
 void OpenCLContext::setCharges(const vector<double>& charges) {
@@ -31,11 +31,26 @@
 using namespace OpenMM;
 using namespace std;
 
-OpenCLIntegrationUtilities::OpenCLIntegrationUtilities(OpenCLContext& context, const System& system) : IntegrationUtilities(context, system) {
-        ccmaConvergedHostBuffer.initialize<cl_int>(context, 1, "CcmaConvergedHostBuffer", CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR);
-        // Different communication mechanisms give optimal performance on AMD and on NVIDIA.
-        string vendor = context.getDevice().getInfo<CL_DEVICE_VENDOR>();
-        ccmaUseDirectBuffer = (vendor.size() >= 28 && vendor.substr(0, 28) == "Advanced Micro Devices, Inc.");
+OpenCLIntegrationUtilities::OpenCLIntegrationUtilities(OpenCLContext& context, const System& system) : IntegrationUtilities(context, system, context.getPlatformData().useLincs) {
+        // There is one buffer for position constraints and one for velocity constraints, plus one that
+        // is written on steps whose result will never be read.
+
+        vector<cl_int> zero(1, 0);
+        for (int i = 0; i < 2; i++) {
+            ccmaConvergedHostBuffer[i].initialize<cl_int>(context, 1, "CcmaConvergedHostBuffer", CL_MEM_ALLOC_HOST_PTR);
+            ccmaConvergedHostBuffer[i].upload(zero);
+            ccmaResultPending[i] = false;
+        }
+        ccmaConvergedScratchBuffer.initialize<cl_int>(context, 1, "CcmaConvergedScratchBuffer");
+        ccmaConvergedScratchBuffer.upload(zero);
+        ccmaZero = 0;
+}
+
+OpenCLIntegrationUtilities::~OpenCLIntegrationUtilities() {
+    cl::CommandQueue queue = dynamic_cast<OpenCLContext&>(context).getQueue();
+    for (int i = 0; i < 2; i++)
+        if (ccmaResultPending[i])
+            queue.enqueueUnmapMemObject(ccmaConvergedHostBuffer[i].getDeviceBuffer(), ccmaMappedResult[i]);
 }
 
 OpenCLArray& OpenCLIntegrationUtilities::getPosDelta() {
@@ -43,14 +58,19 @@ OpenCLArray& OpenCLIntegrationUtilities::getPosDelta() {
 }
 
 OpenCLArray& OpenCLIntegrationUtilities::getRandom() {
+    initRandomArrays();
     return dynamic_cast<OpenCLContext&>(context).unwrap(random);
 }
 
+OpenCLArray& OpenCLIntegrationUtilities::getRandomCounter() {
+    return dynamic_cast<OpenCLContext&>(context).unwrap(randomCounter);
+}
+
 OpenCLArray& OpenCLIntegrationUtilities::getStepSize() {
     return dynamic_cast<OpenCLContext&>(context).unwrap(stepSize);
 }
 
-void OpenCLIntegrationUtilities::applyConstraintsImpl(bool constrainVelocities, double tol) {
+void OpenCLIntegrationUtilities::applyConstraintsImpl(bool constrainVelocities, double tol, bool includeSettle) {
     ComputeKernel settleKernel, shakeKernel, ccmaForceKernel;
     if (constrainVelocities) {
         settleKernel = settleVelKernel;
@@ -62,7 +82,7 @@ void OpenCLIntegrationUtilities::applyConstraintsImpl(bool constrainVelocities,
         shakeKernel = shakePosKernel;
         ccmaForceKernel = ccmaPosForceKernel;
     }
-    if (settleAtoms.isInitialized()) {
+    if (settleAtoms.isInitialized() && includeSettle) {
         if (context.getUseDoublePrecision() || context.getUseMixedPrecision())
             settleKernel->setArg(1, tol);
         else
@@ -77,7 +97,9 @@ void OpenCLIntegrationUtilities::applyConstraintsImpl(bool constrainVelocities,
         shakeKernel->execute(shakeAtoms.getSize());
     }
     if (ccmaConstraintAtoms.isInitialized()) {
-        if (ccmaConstraintAtoms.getSize() <= 1024) {
+        if (useLincs)
+            applyLincs(constrainVelocities);
+        else if (ccmaConstraintAtoms.getSize() <= 1024) {
             // Use the version of CCMA that runs in a single kernel with one workgroup.
             ccmaFullKernel->setArg(0, (int) constrainVelocities);
             if (context.getUseDoublePrecision() || context.getUseMixedPrecision())
@@ -87,45 +109,49 @@ void OpenCLIntegrationUtilities::applyConstraintsImpl(bool constrainVelocities,
             ccmaFullKernel->execute(128, 128);
         }
         else {
-            // Use the version of CCMA that uses multiple kernels.
-            ccmaForceKernel->setArg(6, ccmaConvergedHostBuffer);
+            // Use the version of CCMA that uses multiple kernels.  Convergence is detected on the device,
+            // and the kernels for later iterations return immediately.  Rather than waiting to find out
+            // when it converged, launch a number of iterations based on what recent steps needed.  Each
+            // step's iteration count is read back once it has finished, without ever blocking on it.
+
+            OpenCLContext& cl = dynamic_cast<OpenCLContext&>(context);
+            cl::CommandQueue queue = cl.getQueue();
+            int kind = (constrainVelocities ? 1 : 0);
+            if (ccmaResultPending[kind] && ccmaEvent[kind].getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>() == CL_COMPLETE) {
+                recordCCMAIterations(constrainVelocities, ccmaMappedResult[kind][0]);
+                queue.enqueueUnmapMemObject(ccmaConvergedHostBuffer[kind].getDeviceBuffer(), ccmaMappedResult[kind]);
+                ccmaResultPending[kind] = false;
+            }
+            int numIterations = getCCMAIterationBudget(constrainVelocities, tol);
+            bool recordResult = !ccmaResultPending[kind];
+            if (recordResult) {
+                queue.enqueueWriteBuffer(ccmaConvergedHostBuffer[kind].getDeviceBuffer(), CL_FALSE, 0, sizeof(cl_int), &ccmaZero);
+                ccmaForceKernel->setArg(6, ccmaConvergedHostBuffer[kind]);
+            }
+            else
+                ccmaForceKernel->setArg(6, ccmaConvergedScratchBuffer);
             if (context.getUseDoublePrecision() || context.getUseMixedPrecision())
                 ccmaForceKernel->setArg(7, tol);
             else
                 ccmaForceKernel->setArg(7, (float) tol);
             ccmaDirectionsKernel->execute(ccmaConstraintAtoms.getSize());
-            const int checkInterval = 4;
-            OpenCLContext& cl = dynamic_cast<OpenCLContext&>(context);
-            cl::CommandQueue queue = cl.getQueue();
-            int* converged = (int*) context.getPinnedBuffer();
-            int* ccmaConvergedHostMemory = (int*) queue.enqueueMapBuffer(ccmaConvergedHostBuffer.getDeviceBuffer(), CL_TRUE, CL_MAP_WRITE, 0, sizeof(cl_int));
-            ccmaConvergedHostMemory[0] = 0;
-            queue.enqueueUnmapMemObject(ccmaConvergedHostBuffer.getDeviceBuffer(), ccmaConvergedHostMemory);
             ccmaUpdateKernel->setArg(4, constrainVelocities ? context.getVelm() : posDelta);
-            for (int i = 0; i < 150; i++) {
+            for (int i = 0; i < numIterations; i++) {
                 ccmaForceKernel->setArg(8, i);
                 ccmaForceKernel->execute(ccmaConstraintAtoms.getSize());
-                cl::Event event;
-                if ((i+1)%checkInterval == 0 && !ccmaUseDirectBuffer)
-                    queue.enqueueReadBuffer(cl.unwrap(ccmaConverged).getDeviceBuffer(), CL_FALSE, 0, 2*sizeof(int), converged, NULL, &event);
                 ccmaMultiplyKernel->setArg(5, i);
                 ccmaMultiplyKernel->execute(ccmaConstraintAtoms.getSize());
                 ccmaUpdateKernel->setArg(9, i);
                 ccmaUpdateKernel->execute(context.getNumAtoms());
-                if ((i+1)%checkInterval == 0) {
-                    if (ccmaUseDirectBuffer) {
-                        ccmaConvergedHostMemory = (int*) queue.enqueueMapBuffer(ccmaConvergedHostBuffer.getDeviceBuffer(), CL_FALSE, CL_MAP_READ, 0, sizeof(cl_int), NULL, &event);
-                        queue.flush();
-                        while (event.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>() != CL_COMPLETE)
-                            ;
-                        converged[i%2] = ccmaConvergedHostMemory[0];
-                        queue.enqueueUnmapMemObject(ccmaConvergedHostBuffer.getDeviceBuffer(), ccmaConvergedHostMemory);
-                    }
-                    else
-                        event.wait();
-                    if (converged[i%2])
-                        break;
-                }
+            }
+
+            // One extra force kernel lets the device report convergence on the final iteration.
+
+            ccmaForceKernel->setArg(8, numIterations);
+            ccmaForceKernel->execute(ccmaConstraintAtoms.getSize());
+            if (recordResult) {
+                ccmaMappedResult[kind] = (int*) queue.enqueueMapBuffer(ccmaConvergedHostBuffer[kind].getDeviceBuffer(), CL_FALSE, CL_MAP_READ, 0, sizeof(cl_int), NULL, &ccmaEvent[kind]);
+                ccmaResultPending[kind] = true;
             }
         }
     }
@@ -133,10 +159,17 @@ void OpenCLIntegrationUtilities::applyConstraintsImpl(bool constrainVelocities,
 
 void OpenCLIntegrationUtilities::distributeForcesFromVirtualSites() {
     if (numVsites > 0) {
+        // If no two sites share a parent, the distribution kernel can update the floating point
+        // buffer itself.  Otherwise we need a separate pass to copy the forces back to it.
+
         vsiteForceKernel->setArg(2, context.getLongForceBuffer());
+        if (!hasOverlappingVsites)
+            vsiteForceKernel->setArg(14, context.getForceBuffers());
         vsiteForceKernel->execute(numVsites);
-        vsiteSaveForcesKernel->setArg(0, context.getLongForceBuffer());
-        vsiteSaveForcesKernel->setArg(1, context.getForceBuffers());
-        vsiteSaveForcesKernel->execute(context.getNumAtoms());
+        if (hasOverlappingVsites) {
+            vsiteSaveForcesKernel->setArg(0, context.getLongForceBuffer());
+            vsiteSaveForcesKernel->setArg(1, context.getForceBuffers());
+            vsiteSaveForcesKernel->execute(context.getNumAtoms());
+        }
    }
 }
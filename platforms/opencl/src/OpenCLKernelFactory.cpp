@@ -71,6 +71,8 @@ KernelImpl* OpenCLKernelFactory::createKernelImpl(std::string name, const Platfo
         return new OpenCLCalcForcesAndEnergyKernel(name, platform, cl);
     if (name == UpdateStateDataKernel::Name())
         return new OpenCLUpdateStateDataKernel(name, platform, cl);
+    if (name == ProfileKernel::Name())
+        return new OpenCLProfileKernel(name, platform, cl);
     if (name == ApplyConstraintsKernel::Name())
         return new OpenCLApplyConstraintsKernel(name, platform, cl);
     if (name == VirtualSitesKernel::Name())
@@ -121,6 +123,8 @@ KernelImpl* OpenCLKernelFactory::createKernelImpl(std::string name, const Platfo
         return new CommonIntegrateLangevinStepKernel(name, platform, cl);
     if (name == IntegrateLangevinMiddleStepKernel::Name())
         return new CommonIntegrateLangevinMiddleStepKernel(name, platform, cl);
+    if (name == IntegrateMTSLangevinStepKernel::Name())
+        return new CommonIntegrateMTSLangevinStepKernel(name, platform, cl);
     if (name == IntegrateBrownianStepKernel::Name())
         return new CommonIntegrateBrownianStepKernel(name, platform, cl);
     if (name == IntegrateVariableVerletStepKernel::Name())
@@ -137,5 +141,15 @@ KernelImpl* OpenCLKernelFactory::createKernelImpl(std::string name, const Platfo
         return new OpenCLApplyMonteCarloBarostatKernel(name, platform, cl);
     if (name == RemoveCMMotionKernel::Name())
         return new CommonRemoveCMMotionKernel(name, platform, cl);
+    if (name == MinimizeKernel::Name())
+        return new CommonMinimizeKernel(name, platform, cl);
+    if (name == SwapStateKernel::Name())
+        return new OpenCLSwapStateKernel(name, platform, cl);
+    if (name == ParticleSubsetKernel::Name())
+        return new CommonParticleSubsetKernel(name, platform, cl);
+    if (name == StateSnapshotKernel::Name())
+        return new CommonStateSnapshotKernel(name, platform, cl);
+    if (name == ScaleVelocitiesKernel::Name())
+        return new CommonScaleVelocitiesKernel(name, platform, cl);
     throw OpenMMException((std::string("Tried to create kernel with illegal kernel name '")+name+"'").c_str());
 }
@@ -33,6 +33,7 @@
 #include "openmm/internal/CustomHbondForceImpl.h"
 #include "openmm/internal/NonbondedForceImpl.h"
 #include "openmm/internal/OSRngSeed.h"
+#include "openmm/internal/TraceRange.h"
 #include "OpenCLBondedUtilities.h"
 #include "OpenCLExpressionUtilities.h"
 #include "OpenCLIntegrationUtilities.h"
@@ -48,6 +49,7 @@
 #include "SimTKOpenMMUtilities.h"
 #include <algorithm>
 #include <assert.h>
+#include <chrono>
 #include <cmath>
 #include <iterator>
 #include <set>
@@ -108,6 +110,64 @@ static bool usesVariable(const Lepton::ParsedExpression& expression, const strin
     return usesVariable(expression.getRootNode(), variable);
 }
 
+/**
+ * Select the PME grid dimensions to use when the TunePme property is set.  Any legal
+ * size at least as large as the minimum gives at least the requested accuracy, so this
+ * times a forward and backward FFT for the minimum size and the next two legal sizes
+ * along each axis, and returns the fastest combination in the input arguments.
+ */
+static void tunePmeGridSize(OpenCLContext& cl, int& xsize, int& ysize, int& zsize) {
+    vector<int> candidates[3];
+    int minSize[3] = {xsize, ysize, zsize};
+    for (int axis = 0; axis < 3; axis++) {
+        int size = minSize[axis];
+        for (int i = 0; i < 3; i++) {
+            candidates[axis].push_back(size);
+            size = OpenCLFFT3D::findLegalDimension(size+1);
+        }
+    }
+    int elementSize = (cl.getUseDoublePrecision() ? sizeof(mm_double2) : sizeof(mm_float2));
+    int maxElements = candidates[0].back()*candidates[1].back()*candidates[2].back();
+    OpenCLArray grid1(cl, maxElements, elementSize, "tunePmeGrid1");
+    OpenCLArray grid2(cl, maxElements, elementSize, "tunePmeGrid2");
+    cl.clearBuffer(grid1);
+    const int numIterations = 10;
+    double bestTime = -1;
+    for (int x : candidates[0])
+        for (int y : candidates[1])
+            for (int z : candidates[2]) {
+                // Some sizes may be too large to transform in local memory on this device.
+
+                OpenCLFFT3D* fft;
+                try {
+                    fft = new OpenCLFFT3D(cl, x, y, z, true);
+                }
+                catch (OpenMMException&) {
+                    continue;
+                }
+                chrono::steady_clock::time_point start;
+                for (int i = -1; i < numIterations; i++) {
+                    // The first iteration is a warmup and is not timed.
+
+                    if (i == 0) {
+                        cl.getQueue().finish();
+                        start = chrono::steady_clock::now();
+                    }
+                    fft->execFFT(grid1, grid2, true);
+                    fft->execFFT(grid2, grid1, false);
+                }
+                cl.getQueue().finish();
+                double time = chrono::duration<double>(chrono::steady_clock::now()-start).count();
+                if (bestTime < 0 || time < bestTime) {
+                    bestTime = time;
+                    xsize = x;
+                    ysize = y;
+                    zsize = z;
+                }
+                delete fft;
+            }
+}
+
 static pair<ExpressionTreeNode, string> makeVariable(const string& name, const string& value) {
     return make_pair(ExpressionTreeNode(new Operation::Variable(name)), value);
 }
@@ -147,11 +207,17 @@ double OpenCLCalcForcesAndEnergyKernel::finishComputation(ContextImpl& context,
     cl.getIntegrationUtilities().distributeForcesFromVirtualSites();
     if (includeEnergy)
         sum += cl.reduceEnergy();
+    cl.getNonbondedUtilities().checkNeighborListSize();
     if (!cl.getForcesValid())
         valid = false;
     return sum;
 }
 
+OpenCLUpdateStateDataKernel::~OpenCLUpdateStateDataKernel() {
+    if (copyBuffer != NULL)
+        delete copyBuffer;
+}
+
 void OpenCLUpdateStateDataKernel::initialize(const System& system) {
 }
 
@@ -168,15 +234,19 @@ void OpenCLUpdateStateDataKernel::setTime(ContextImpl& context, double time) {
 void OpenCLUpdateStateDataKernel::getPositions(ContextImpl& context, vector<Vec3>& positions) {
     int numParticles = context.getSystem().getNumParticles();
     positions.resize(numParticles);
-    vector<mm_float4> posCorrection;
+    mm_float4* posCorrection = NULL;
     if (cl.getUseDoublePrecision()) {
         mm_double4* posq = (mm_double4*) cl.getPinnedBuffer();
         cl.getPosq().download(posq);
     }
     else if (cl.getUseMixedPrecision()) {
+        // The pinned buffer is big enough to hold velm, which in mixed precision mode is exactly the
+        // size of posq and posqCorrection together.  Downloading both into it avoids a transfer to
+        // pageable memory, which many OpenCL implementations stage through an extra copy.
+
         mm_float4* posq = (mm_float4*) cl.getPinnedBuffer();
+        posCorrection = posq+cl.getPosq().getSize();
         cl.getPosq().download(posq, false);
-        posCorrection.resize(numParticles);
         cl.getPosqCorrection().download(posCorrection);
     }
     else {
@@ -299,6 +369,65 @@ void OpenCLUpdateStateDataKernel::getVelocities(ContextImpl& context, vector<Vec
     }
 }
 
+void OpenCLUpdateStateDataKernel::getPositionsFloat(ContextImpl& context, vector<float>& positions) {
+    if (cl.getUseDoublePrecision()) {
+        UpdateStateDataKernel::getPositionsFloat(context, positions);
+        return;
+    }
+    int numParticles = context.getSystem().getNumParticles();
+    positions.resize(3*numParticles);
+
+    // In mixed precision mode, posq holds each position rounded to single precision, so the correction
+    // is not needed.
+
+    mm_float4* posq = (mm_float4*) cl.getPinnedBuffer();
+    cl.getPosq().download(posq);
+    cl.getPlatformData().threads.execute([&] (ThreadPool& threads, int threadIndex) {
+        const vector<cl_int>& order = cl.getAtomIndex();
+        Vec3 boxVectors[3];
+        cl.getPeriodicBoxVectors(boxVectors[0], boxVectors[1], boxVectors[2]);
+        int numThreads = threads.getNumThreads();
+        int start = threadIndex*numParticles/numThreads;
+        int end = (threadIndex+1)*numParticles/numThreads;
+        for (int i = start; i < end; ++i) {
+            mm_float4 pos = posq[i];
+            mm_int4 offset = cl.getPosCellOffsets()[i];
+            float* p = &positions[3*order[i]];
+            if (offset.x == 0 && offset.y == 0 && offset.z == 0) {
+                p[0] = pos.x;
+                p[1] = pos.y;
+                p[2] = pos.z;
+            }
+            else {
+                Vec3 shift = boxVectors[0]*offset.x+boxVectors[1]*offset.y+boxVectors[2]*offset.z;
+                p[0] = (float) (pos.x-shift[0]);
+                p[1] = (float) (pos.y-shift[1]);
+                p[2] = (float) (pos.z-shift[2]);
+            }
+        }
+    });
+    cl.getPlatformData().threads.waitForThreads();
+}
+
+void OpenCLUpdateStateDataKernel::getVelocitiesFloat(ContextImpl& context, vector<float>& velocities) {
+    if (cl.getUseDoublePrecision() || cl.getUseMixedPrecision()) {
+        UpdateStateDataKernel::getVelocitiesFloat(context, velocities);
+        return;
+    }
+    const vector<cl_int>& order = cl.getAtomIndex();
+    int numParticles = context.getSystem().getNumParticles();
+    velocities.resize(3*numParticles);
+    mm_float4* velm = (mm_float4*) cl.getPinnedBuffer();
+    cl.getVelm().download(velm);
+    for (int i = 0; i < numParticles; ++i) {
+        mm_float4 vel = velm[i];
+        float* v = &velocities[3*order[i]];
+        v[0] = vel.x;
+        v[1] = vel.y;
+        v[2] = vel.z;
+    }
+}
+
 void OpenCLUpdateStateDataKernel::setVelocities(ContextImpl& context, const vector<Vec3>& velocities) {
     const vector<cl_int>& order = cl.getAtomIndex();
     int numParticles = context.getSystem().getNumParticles();
@@ -332,6 +461,92 @@ void OpenCLUpdateStateDataKernel::setVelocities(ContextImpl& context, const vect
     }
 }
 
+void OpenCLUpdateStateDataKernel::beginStateCopy(ContextImpl& context, bool positions, bool velocities) {
+    int posqBytes = cl.getPosq().getSize()*cl.getPosq().getElementSize();
+    int correctionBytes = (cl.getUseMixedPrecision() ? cl.getPosqCorrection().getSize()*cl.getPosqCorrection().getElementSize() : 0);
+    int velmBytes = cl.getVelm().getSize()*cl.getVelm().getElementSize();
+    if (copyBuffer == NULL) {
+        // Create a pinned buffer of its own, so other calls that use the context's pinned buffer
+        // cannot overwrite the data before it is retrieved.
+
+        int bufferBytes = posqBytes+correctionBytes+velmBytes;
+        copyBuffer = new cl::Buffer(cl.getContext(), CL_MEM_ALLOC_HOST_PTR, bufferBytes);
+        copyMemory = cl.getQueue().enqueueMapBuffer(*copyBuffer, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, bufferBytes);
+    }
+    if (copyPending)
+        copyEvent.wait();
+
+    // Record the information needed to interpret the data, since it may change before the copy is retrieved.
+
+    copyPositions = positions;
+    copyVelocities = velocities;
+    copyAtomOrder = cl.getAtomIndex();
+    copyCellOffsets = cl.getPosCellOffsets();
+    cl.getPeriodicBoxVectors(copyBoxVectors[0], copyBoxVectors[1], copyBoxVectors[2]);
+
+    // Enqueue the downloads without waiting for them.  They are ordered before any kernels that are
+    // launched later, so the simulation can continue immediately.
+
+    char* memory = (char*) copyMemory;
+    if (positions) {
+        cl.getPosq().download(memory, false);
+        if (cl.getUseMixedPrecision())
+            cl.getPosqCorrection().download(memory+posqBytes, false);
+    }
+    if (velocities)
+        cl.getVelm().download(memory+posqBytes+correctionBytes, false);
+    cl.getQueue().enqueueMarker(&copyEvent);
+    copyPending = true;
+}
+
+void OpenCLUpdateStateDataKernel::finishStateCopy(ContextImpl& context, vector<Vec3>& positions, vector<Vec3>& velocities) {
+    if (!copyPending)
+        throw OpenMMException("finishStateCopy() was called without calling beginStateCopy()");
+    copyEvent.wait();
+    copyPending = false;
+    int numParticles = context.getSystem().getNumParticles();
+    int posqBytes = cl.getPosq().getSize()*cl.getPosq().getElementSize();
+    int correctionBytes = (cl.getUseMixedPrecision() ? cl.getPosqCorrection().getSize()*cl.getPosqCorrection().getElementSize() : 0);
+    char* memory = (char*) copyMemory;
+    positions.clear();
+    velocities.clear();
+    if (copyPositions) {
+        positions.resize(numParticles);
+        for (int i = 0; i < numParticles; ++i) {
+            Vec3 pos;
+            if (cl.getUseDoublePrecision()) {
+                mm_double4 p = ((mm_double4*) memory)[i];
+                pos = Vec3(p.x, p.y, p.z);
+            }
+            else if (cl.getUseMixedPrecision()) {
+                mm_float4 p1 = ((mm_float4*) memory)[i];
+                mm_float4 p2 = ((mm_float4*) (memory+posqBytes))[i];
+                pos = Vec3((double)p1.x+(double)p2.x, (double)p1.y+(double)p2.y, (double)p1.z+(double)p2.z);
+            }
+            else {
+                mm_float4 p = ((mm_float4*) memory)[i];
+                pos = Vec3(p.x, p.y, p.z);
+            }
+            mm_int4 offset = copyCellOffsets[i];
+            positions[copyAtomOrder[i]] = pos-copyBoxVectors[0]*offset.x-copyBoxVectors[1]*offset.y-copyBoxVectors[2]*offset.z;
+        }
+    }
+    if (copyVelocities) {
+        velocities.resize(numParticles);
+        char* velm = memory+posqBytes+correctionBytes;
+        for (int i = 0; i < numParticles; ++i) {
+            if (cl.getUseDoublePrecision() || cl.getUseMixedPrecision()) {
+                mm_double4 v = ((mm_double4*) velm)[i];
+                velocities[copyAtomOrder[i]] = Vec3(v.x, v.y, v.z);
+            }
+            else {
+                mm_float4 v = ((mm_float4*) velm)[i];
+                velocities[copyAtomOrder[i]] = Vec3(v.x, v.y, v.z);
+            }
+        }
+    }
+}
+
 void OpenCLUpdateStateDataKernel::getForces(ContextImpl& context, vector<Vec3>& forces) {
     const vector<cl_int>& order = cl.getAtomIndex();
     int numParticles = context.getSystem().getNumParticles();
@@ -479,6 +694,29 @@ void OpenCLUpdateStateDataKernel::loadCheckpoint(ContextImpl& context, istream&
         listener->execute();
 }
 
+void OpenCLProfileKernel::initialize(const System& system) {
+}
+
+void OpenCLProfileKernel::setProfilingEnabled(ContextImpl& context, bool enabled) {
+    cl.setProfilingEnabled(enabled);
+}
+
+void OpenCLProfileKernel::setProfiledForceGroups(ContextImpl& context, int groups) {
+    cl.setProfiledForceGroups(groups);
+}
+
+void OpenCLProfileKernel::setMemoryOwner(ContextImpl& context, const string& owner) {
+    for (auto ctx : cl.getPlatformData().contexts)
+        ctx->setMemoryOwner(owner);
+}
+
+void OpenCLProfileKernel::getPerformanceReport(ContextImpl& context, map<string, double>& report) {
+    cl.getPerformanceReport(report);
+    vector<OpenCLContext*>& contexts = cl.getPlatformData().contexts;
+    for (int i = 1; i < (int) contexts.size(); i++)
+        contexts[i]->getMemoryUsage(report);
+}
+
 void OpenCLApplyConstraintsKernel::initialize(const System& system) {
 }
 
@@ -667,7 +905,7 @@ void OpenCLCalcNonbondedForceKernel::initialize(const System& system, const Nonb
     }
     vector<pair<int, int> > exclusions;
     vector<int> exceptions;
-    map<int, int> exceptionIndex;
+    exceptionIndex.clear();
     for (int i = 0; i < force.getNumExceptions(); i++) {
         int particle1, particle2;
         double chargeProd, sigma, epsilon;
@@ -679,6 +917,23 @@ void OpenCLCalcNonbondedForceKernel::initialize(const System& system, const Nonb
         }
     }
 
+    // Sort the exceptions by the atoms they involve.  Consecutive threads then load positions
+    // and accumulate forces for atoms in the same or neighboring blocks, which gives much better
+    // memory coalescing than the arbitrary order in which they were added to the force.
+
+    vector<pair<pair<int, int>, int> > sortedExceptions(exceptions.size());
+    for (int i = 0; i < exceptions.size(); i++) {
+        int particle1, particle2;
+        double chargeProd, sigma, epsilon;
+        force.getExceptionParameters(exceptions[i], particle1, particle2, chargeProd, sigma, epsilon);
+        sortedExceptions[i] = make_pair(make_pair(min(particle1, particle2), max(particle1, particle2)), exceptions[i]);
+    }
+    sort(sortedExceptions.begin(), sortedExceptions.end());
+    for (int i = 0; i < exceptions.size(); i++) {
+        exceptions[i] = sortedExceptions[i].second;
+        exceptionIndex[exceptions[i]] = i;
+    }
+
     // Initialize nonbonded interactions.
 
     int numParticles = force.getNumParticles();
@@ -781,6 +1036,7 @@ void OpenCLCalcNonbondedForceKernel::initialize(const System& system, const Nonb
     else if (((nonbondedMethod == PME || nonbondedMethod == LJPME) && hasCoulomb) || doLJPME) {
         // Compute the PME parameters.
 
+        pmeOrder = force.getPMEInterpolationOrder();
         NonbondedForceImpl::calcPMEParameters(system, force, alpha, gridSizeX, gridSizeY, gridSizeZ, false);
         gridSizeX = OpenCLFFT3D::findLegalDimension(gridSizeX);
         gridSizeY = OpenCLFFT3D::findLegalDimension(gridSizeY);
@@ -792,6 +1048,11 @@ void OpenCLCalcNonbondedForceKernel::initialize(const System& system, const Nonb
             dispersionGridSizeY = OpenCLFFT3D::findLegalDimension(dispersionGridSizeY);
             dispersionGridSizeZ = OpenCLFFT3D::findLegalDimension(dispersionGridSizeZ);
         }
+        if (cl.getContextIndex() == 0 && cl.getPlatformData().tunePme) {
+            tunePmeGridSize(cl, gridSizeX, gridSizeY, gridSizeZ);
+            if (doLJPME)
+                tunePmeGridSize(cl, dispersionGridSizeX, dispersionGridSizeY, dispersionGridSizeZ);
+        }
         defines["EWALD_ALPHA"] = cl.doubleToString(alpha);
         defines["TWO_OVER_SQRT_PI"] = cl.doubleToString(2.0/sqrt(M_PI));
         defines["USE_EWALD"] = "1";
@@ -809,7 +1070,7 @@ void OpenCLCalcNonbondedForceKernel::initialize(const System& system, const Nonb
                 for (int i = 0; i < numParticles; i++)
                     ewaldSelfEnergy += baseParticleParamVec[i].z*pow(baseParticleParamVec[i].y*dispersionAlpha, 6)/3.0;
             }
-            pmeDefines["PME_ORDER"] = cl.intToString(PmeOrder);
+            pmeDefines["PME_ORDER"] = cl.intToString(pmeOrder);
             pmeDefines["NUM_ATOMS"] = cl.intToString(numParticles);
             pmeDefines["RECIP_EXP_FACTOR"] = cl.doubleToString(M_PI*M_PI/(alpha*alpha));
             pmeDefines["GRID_SIZE_X"] = cl.intToString(gridSizeX);
@@ -820,7 +1081,7 @@ void OpenCLCalcNonbondedForceKernel::initialize(const System& system, const Nonb
             bool deviceIsCpu = (cl.getDevice().getInfo<CL_DEVICE_TYPE>() == CL_DEVICE_TYPE_CPU);
             if (deviceIsCpu)
                 pmeDefines["DEVICE_IS_CPU"] = "1";
-            if (cl.getPlatformData().useCpuPme && !doLJPME && usePosqCharges) {
+            if (cl.getPlatformData().useCpuPme && !doLJPME && usePosqCharges && pmeOrder == 5) {
                 // Create the CPU PME kernel.
 
                 try {
@@ -849,10 +1110,10 @@ void OpenCLCalcNonbondedForceKernel::initialize(const System& system, const Nonb
                     defines["MULTSHIFT6"] = cl.doubleToString(multShift6);
                 }
                 int elementSize = (cl.getUseDoublePrecision() ? sizeof(double) : sizeof(float));
-                int roundedZSize = PmeOrder*(int) ceil(gridSizeZ/(double) PmeOrder);
+                int roundedZSize = pmeOrder*(int) ceil(gridSizeZ/(double) pmeOrder);
                 int gridElements = gridSizeX*gridSizeY*roundedZSize;
                 if (doLJPME) {
-                    roundedZSize = PmeOrder*(int) ceil(dispersionGridSizeZ/(double) PmeOrder);
+                    roundedZSize = pmeOrder*(int) ceil(dispersionGridSizeZ/(double) pmeOrder);
                     gridElements = max(gridElements, dispersionGridSizeX*dispersionGridSizeY*roundedZSize);
                 }
                 pmeGrid1.initialize(cl, gridElements, 2*elementSize, "pmeGrid1");
@@ -869,7 +1130,7 @@ void OpenCLCalcNonbondedForceKernel::initialize(const System& system, const Nonb
                     pmeDispersionBsplineModuliY.initialize(cl, dispersionGridSizeY, elementSize, "pmeDispersionBsplineModuliY");
                     pmeDispersionBsplineModuliZ.initialize(cl, dispersionGridSizeZ, elementSize, "pmeDispersionBsplineModuliZ");
                 }
-                pmeBsplineTheta.initialize(cl, PmeOrder*numParticles, 4*elementSize, "pmeBsplineTheta");
+                pmeBsplineTheta.initialize(cl, pmeOrder*numParticles, 4*elementSize, "pmeBsplineTheta");
                 pmeAtomRange.initialize<cl_int>(cl, gridSizeX*gridSizeY*gridSizeZ+1, "pmeAtomRange");
                 pmeAtomGridIndex.initialize<mm_int2>(cl, numParticles, "pmeAtomGridIndex");
                 int energyElementSize = (cl.getUseDoublePrecision() || cl.getUseMixedPrecision() ? sizeof(double) : sizeof(float));
@@ -916,13 +1177,13 @@ void OpenCLCalcNonbondedForceKernel::initialize(const System& system, const Nonb
                         zmoduli = &pmeDispersionBsplineModuliZ;
                     }
                     int maxSize = max(max(xsize, ysize), zsize);
-                    vector<double> data(PmeOrder);
-                    vector<double> ddata(PmeOrder);
+                    vector<double> data(pmeOrder);
+                    vector<double> ddata(pmeOrder);
                     vector<double> bsplines_data(maxSize);
-                    data[PmeOrder-1] = 0.0;
+                    data[pmeOrder-1] = 0.0;
                     data[1] = 0.0;
                     data[0] = 1.0;
-                    for (int i = 3; i < PmeOrder; i++) {
+                    for (int i = 3; i < pmeOrder; i++) {
                         double div = 1.0/(i-1.0);
                         data[i-1] = 0.0;
                         for (int j = 1; j < (i-1); j++)
@@ -933,16 +1194,16 @@ void OpenCLCalcNonbondedForceKernel::initialize(const System& system, const Nonb
                     // Differentiate.
 
                     ddata[0] = -data[0];
-                    for (int i = 1; i < PmeOrder; i++)
+                    for (int i = 1; i < pmeOrder; i++)
                         ddata[i] = data[i-1]-data[i];
-                    double div = 1.0/(PmeOrder-1);
-                    data[PmeOrder-1] = 0.0;
-                    for (int i = 1; i < (PmeOrder-1); i++)
-                        data[PmeOrder-i-1] = div*(i*data[PmeOrder-i-2]+(PmeOrder-i)*data[PmeOrder-i-1]);
+                    double div = 1.0/(pmeOrder-1);
+                    data[pmeOrder-1] = 0.0;
+                    for (int i = 1; i < (pmeOrder-1); i++)
+                        data[pmeOrder-i-1] = div*(i*data[pmeOrder-i-2]+(pmeOrder-i)*data[pmeOrder-i-1]);
                     data[0] = div*data[0];
                     for (int i = 0; i < maxSize; i++)
                         bsplines_data[i] = 0.0;
-                    for (int i = 1; i <= PmeOrder; i++)
+                    for (int i = 1; i <= pmeOrder; i++)
                         bsplines_data[i] = data[i-1];
 
                     // Evaluate the actual bspline moduli for X/Y/Z.
@@ -1015,6 +1276,7 @@ void OpenCLCalcNonbondedForceKernel::initialize(const System& system, const Nonb
     charges.initialize(cl, cl.getPaddedNumAtoms(), cl.getUseDoublePrecision() ? sizeof(double) : sizeof(float), "charges");
     baseParticleParams.initialize<mm_float4>(cl, cl.getPaddedNumAtoms(), "baseParticleParams");
     baseParticleParams.upload(baseParticleParamVec);
+    hostParticleParams = baseParticleParamVec;
     map<string, string> replacements;
     replacements["ONE_4PI_EPS0"] = cl.doubleToString(ONE_4PI_EPS0);
     if (usePosqCharges) {
@@ -1192,7 +1454,7 @@ double OpenCLCalcNonbondedForceKernel::execute(ContextImpl& context, bool includ
             int elementSize = (cl.getUseDoublePrecision() ? sizeof(mm_double4) : sizeof(mm_float4));
             pmeUpdateBsplinesKernel.setArg<cl::Buffer>(0, cl.getPosq().getDeviceBuffer());
             pmeUpdateBsplinesKernel.setArg<cl::Buffer>(1, pmeBsplineTheta.getDeviceBuffer());
-            pmeUpdateBsplinesKernel.setArg(2, OpenCLContext::ThreadBlockSize*PmeOrder*elementSize, NULL);
+            pmeUpdateBsplinesKernel.setArg(2, OpenCLContext::ThreadBlockSize*pmeOrder*elementSize, NULL);
             pmeUpdateBsplinesKernel.setArg<cl::Buffer>(3, pmeAtomGridIndex.getDeviceBuffer());
             pmeUpdateBsplinesKernel.setArg<cl::Buffer>(12, charges.getDeviceBuffer());
             pmeAtomRangeKernel.setArg<cl::Buffer>(0, pmeAtomGridIndex.getDeviceBuffer());
@@ -1255,7 +1517,7 @@ double OpenCLCalcNonbondedForceKernel::execute(ContextImpl& context, bool includ
                 int elementSize = (cl.getUseDoublePrecision() ? sizeof(mm_double4) : sizeof(mm_float4));
                 pmeDispersionUpdateBsplinesKernel.setArg<cl::Buffer>(0, cl.getPosq().getDeviceBuffer());
                 pmeDispersionUpdateBsplinesKernel.setArg<cl::Buffer>(1, pmeBsplineTheta.getDeviceBuffer());
-                pmeDispersionUpdateBsplinesKernel.setArg(2, OpenCLContext::ThreadBlockSize*PmeOrder*elementSize, NULL);
+                pmeDispersionUpdateBsplinesKernel.setArg(2, OpenCLContext::ThreadBlockSize*pmeOrder*elementSize, NULL);
                 pmeDispersionUpdateBsplinesKernel.setArg<cl::Buffer>(3, pmeAtomGridIndex.getDeviceBuffer());
                 pmeDispersionUpdateBsplinesKernel.setArg<cl::Buffer>(12, sigmaEpsilon.getDeviceBuffer());
                 pmeDispersionAtomRangeKernel.setArg<cl::Buffer>(0, pmeAtomGridIndex.getDeviceBuffer());
@@ -1331,6 +1593,7 @@ double OpenCLCalcNonbondedForceKernel::execute(ContextImpl& context, bool includ
     // Do reciprocal space calculations.
     
     if (cosSinSums.isInitialized() && includeReciprocal) {
+        OPENMM_TRACE_RANGE("Ewald reciprocal space");
         mm_double4 boxSize = cl.getPeriodicBoxSizeDouble();
         mm_double4 recipBoxSize = mm_double4(2*M_PI/boxSize.x, 2*M_PI/boxSize.y, 2*M_PI/boxSize.z, 0.0);
         double recipCoefficient = ONE_4PI_EPS0*4*M_PI/(boxSize.x*boxSize.y*boxSize.z);
@@ -1347,9 +1610,11 @@ double OpenCLCalcNonbondedForceKernel::execute(ContextImpl& context, bool includ
             ewaldForcesKernel.setArg<cl_float>(4, (cl_float) recipCoefficient);
         }
         cl.executeKernel(ewaldSumsKernel, cosSinSums.getSize());
-        cl.executeKernel(ewaldForcesKernel, cl.getNumAtoms());
+        if (includeForces)
+            cl.executeKernel(ewaldForcesKernel, cl.getNumAtoms());
     }
     if (pmeGrid1.isInitialized() && includeReciprocal) {
+        OPENMM_TRACE_RANGE("PME");
         if (usePmeQueue && !includeEnergy)
             cl.setQueue(pmeQueue);
         
@@ -1370,6 +1635,7 @@ double OpenCLCalcNonbondedForceKernel::execute(ContextImpl& context, bool includ
         // Execute the reciprocal space kernels.
 
         if (hasCoulomb) {
+            OPENMM_TRACE_RANGE("PME electrostatics");
             setPeriodicBoxArgs(cl, pmeUpdateBsplinesKernel, 4);
             if (cl.getUseDoublePrecision()) {
                 pmeUpdateBsplinesKernel.setArg<mm_double4>(9, recipBoxVectors[0]);
@@ -1444,26 +1710,30 @@ double OpenCLCalcNonbondedForceKernel::execute(ContextImpl& context, bool includ
             }
             if (includeEnergy)
                 cl.executeKernel(pmeEvalEnergyKernel, gridSizeX*gridSizeY*gridSizeZ);
-            cl.executeKernel(pmeConvolutionKernel, gridSizeX*gridSizeY*gridSizeZ);
-            fft->execFFT(pmeGrid2, pmeGrid1, false);
-            setPeriodicBoxArgs(cl, pmeInterpolateForceKernel, 3);
-            if (cl.getUseDoublePrecision()) {
-                pmeInterpolateForceKernel.setArg<mm_double4>(8, recipBoxVectors[0]);
-                pmeInterpolateForceKernel.setArg<mm_double4>(9, recipBoxVectors[1]);
-                pmeInterpolateForceKernel.setArg<mm_double4>(10, recipBoxVectors[2]);
-            }
-            else {
-                pmeInterpolateForceKernel.setArg<mm_float4>(8, recipBoxVectorsFloat[0]);
-                pmeInterpolateForceKernel.setArg<mm_float4>(9, recipBoxVectorsFloat[1]);
-                pmeInterpolateForceKernel.setArg<mm_float4>(10, recipBoxVectorsFloat[2]);
+            if (includeForces) {
+                OPENMM_TRACE_RANGE("PME electrostatic forces");
+                cl.executeKernel(pmeConvolutionKernel, gridSizeX*gridSizeY*gridSizeZ);
+                fft->execFFT(pmeGrid2, pmeGrid1, false);
+                setPeriodicBoxArgs(cl, pmeInterpolateForceKernel, 3);
+                if (cl.getUseDoublePrecision()) {
+                    pmeInterpolateForceKernel.setArg<mm_double4>(8, recipBoxVectors[0]);
+                    pmeInterpolateForceKernel.setArg<mm_double4>(9, recipBoxVectors[1]);
+                    pmeInterpolateForceKernel.setArg<mm_double4>(10, recipBoxVectors[2]);
+                }
+                else {
+                    pmeInterpolateForceKernel.setArg<mm_float4>(8, recipBoxVectorsFloat[0]);
+                    pmeInterpolateForceKernel.setArg<mm_float4>(9, recipBoxVectorsFloat[1]);
+                    pmeInterpolateForceKernel.setArg<mm_float4>(10, recipBoxVectorsFloat[2]);
+                }
+                if (deviceIsCpu)
+                    cl.executeKernel(pmeInterpolateForceKernel, 2*cl.getDevice().getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>(), 1);
+                else
+                    cl.executeKernel(pmeInterpolateForceKernel, cl.getNumAtoms());
             }
-            if (deviceIsCpu)
-                cl.executeKernel(pmeInterpolateForceKernel, 2*cl.getDevice().getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>(), 1);
-            else
-                cl.executeKernel(pmeInterpolateForceKernel, cl.getNumAtoms());
         }
         
         if (doLJPME && hasLJ) {
+            OPENMM_TRACE_RANGE("PME dispersion");
             setPeriodicBoxArgs(cl, pmeDispersionUpdateBsplinesKernel, 4);
             if (cl.getUseDoublePrecision()) {
                 pmeDispersionUpdateBsplinesKernel.setArg<mm_double4>(9, recipBoxVectors[0]);
@@ -1544,23 +1814,26 @@ double OpenCLCalcNonbondedForceKernel::execute(ContextImpl& context, bool includ
             if (!hasCoulomb) cl.clearBuffer(pmeEnergyBuffer);
             if (includeEnergy)
                 cl.executeKernel(pmeDispersionEvalEnergyKernel, gridSizeX*gridSizeY*gridSizeZ);
-            cl.executeKernel(pmeDispersionConvolutionKernel, gridSizeX*gridSizeY*gridSizeZ);
-            dispersionFft->execFFT(pmeGrid2, pmeGrid1, false);
-            setPeriodicBoxArgs(cl, pmeDispersionInterpolateForceKernel, 3);
-            if (cl.getUseDoublePrecision()) {
-                pmeDispersionInterpolateForceKernel.setArg<mm_double4>(8, recipBoxVectors[0]);
-                pmeDispersionInterpolateForceKernel.setArg<mm_double4>(9, recipBoxVectors[1]);
-                pmeDispersionInterpolateForceKernel.setArg<mm_double4>(10, recipBoxVectors[2]);
-            }
-            else {
-                pmeDispersionInterpolateForceKernel.setArg<mm_float4>(8, recipBoxVectorsFloat[0]);
-                pmeDispersionInterpolateForceKernel.setArg<mm_float4>(9, recipBoxVectorsFloat[1]);
-                pmeDispersionInterpolateForceKernel.setArg<mm_float4>(10, recipBoxVectorsFloat[2]);
+            if (includeForces) {
+                OPENMM_TRACE_RANGE("PME dispersion forces");
+                cl.executeKernel(pmeDispersionConvolutionKernel, gridSizeX*gridSizeY*gridSizeZ);
+                dispersionFft->execFFT(pmeGrid2, pmeGrid1, false);
+                setPeriodicBoxArgs(cl, pmeDispersionInterpolateForceKernel, 3);
+                if (cl.getUseDoublePrecision()) {
+                    pmeDispersionInterpolateForceKernel.setArg<mm_double4>(8, recipBoxVectors[0]);
+                    pmeDispersionInterpolateForceKernel.setArg<mm_double4>(9, recipBoxVectors[1]);
+                    pmeDispersionInterpolateForceKernel.setArg<mm_double4>(10, recipBoxVectors[2]);
+                }
+                else {
+                    pmeDispersionInterpolateForceKernel.setArg<mm_float4>(8, recipBoxVectorsFloat[0]);
+                    pmeDispersionInterpolateForceKernel.setArg<mm_float4>(9, recipBoxVectorsFloat[1]);
+                    pmeDispersionInterpolateForceKernel.setArg<mm_float4>(10, recipBoxVectorsFloat[2]);
+                }
+                if (deviceIsCpu)
+                    cl.executeKernel(pmeDispersionInterpolateForceKernel, 2*cl.getDevice().getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>(), 1);
+                else
+                    cl.executeKernel(pmeDispersionInterpolateForceKernel, cl.getNumAtoms());
             }
-            if (deviceIsCpu)
-                cl.executeKernel(pmeDispersionInterpolateForceKernel, 2*cl.getDevice().getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>(), 1);
-            else
-                cl.executeKernel(pmeDispersionInterpolateForceKernel, cl.getNumAtoms());
         }
         if (usePmeQueue) {
             pmeQueue.enqueueMarker(&pmeSyncEvent);
@@ -1589,20 +1862,27 @@ void OpenCLCalcNonbondedForceKernel::copyParametersToContext(ContextImpl& contex
                 throw OpenMMException("updateParametersInContext: The nonbonded force kernel does not include Lennard-Jones interactions, because all epsilons were originally 0");
         }
     }
-    vector<int> exceptions;
+    int numContexts = cl.getPlatformData().contexts.size();
+    int startIndex = cl.getContextIndex()*exceptionIndex.size()/numContexts;
+    int endIndex = (cl.getContextIndex()+1)*exceptionIndex.size()/numContexts;
+    int numExceptions = endIndex-startIndex;
+    vector<int> exceptions(numExceptions);
     for (int i = 0; i < force.getNumExceptions(); i++) {
         int particle1, particle2;
         double chargeProd, sigma, epsilon;
         force.getExceptionParameters(i, particle1, particle2, chargeProd, sigma, epsilon);
-        if (exceptionAtoms.size() > exceptions.size() && make_pair(particle1, particle2) == exceptionAtoms[exceptions.size()])
-            exceptions.push_back(i);
-        else if (chargeProd != 0.0 || epsilon != 0.0)
-            throw OpenMMException("updateParametersInContext: The set of non-excluded exceptions has changed");
+        auto index = exceptionIndex.find(i);
+        if (index == exceptionIndex.end()) {
+            if (chargeProd != 0.0 || epsilon != 0.0)
+                throw OpenMMException("updateParametersInContext: The set of non-excluded exceptions has changed");
+        }
+        else if (index->second >= startIndex && index->second < endIndex) {
+            int local = index->second-startIndex;
+            if (make_pair(particle1, particle2) != exceptionAtoms[local])
+                throw OpenMMException("updateParametersInContext: The set of non-excluded exceptions has changed");
+            exceptions[local] = i;
+        }
     }
-    int numContexts = cl.getPlatformData().contexts.size();
-    int startIndex = cl.getContextIndex()*exceptions.size()/numContexts;
-    int endIndex = (cl.getContextIndex()+1)*exceptions.size()/numContexts;
-    int numExceptions = endIndex-startIndex;
     
     // Record the per-particle parameters.
     
@@ -1613,6 +1893,7 @@ void OpenCLCalcNonbondedForceKernel::copyParametersToContext(ContextImpl& contex
         baseParticleParamVec[i] = mm_float4(charge, sigma, epsilon, 0);
     }
     baseParticleParams.upload(baseParticleParamVec);
+    hostParticleParams = baseParticleParamVec;
     
     // Record the exceptions.
     
@@ -1621,7 +1902,7 @@ void OpenCLCalcNonbondedForceKernel::copyParametersToContext(ContextImpl& contex
         vector<mm_float4> baseExceptionParamsVec(numExceptions);
         for (int i = 0; i < numExceptions; i++) {
             double chargeProd, sigma, epsilon;
-            force.getExceptionParameters(exceptions[startIndex+i], atoms[i][0], atoms[i][1], chargeProd, sigma, epsilon);
+            force.getExceptionParameters(exceptions[i], atoms[i][0], atoms[i][1], chargeProd, sigma, epsilon);
             baseExceptionParamsVec[i] = mm_float4(chargeProd, sigma, epsilon, 0);
         }
         baseExceptionParams.upload(baseExceptionParamsVec);
@@ -1645,10 +1926,93 @@ void OpenCLCalcNonbondedForceKernel::copyParametersToContext(ContextImpl& contex
     recomputeParams = true;
 }
 
+void OpenCLCalcNonbondedForceKernel::copyParameterRangeToContext(ContextImpl& context, const NonbondedForce& force, int firstParticle, int lastParticle, int firstException, int lastException) {
+    // Make sure the new parameters are acceptable.
+    
+    if (force.getNumParticles() != cl.getNumAtoms())
+        throw OpenMMException("updateParametersInContext: The number of particles has changed");
+    int numContexts = cl.getPlatformData().contexts.size();
+    int startIndex = cl.getContextIndex()*exceptionIndex.size()/numContexts;
+    int endIndex = (cl.getContextIndex()+1)*exceptionIndex.size()/numContexts;
+    int firstLocalException = -1, lastLocalException = -1;
+    for (int i = firstException; i <= lastException; i++) {
+        int particle1, particle2;
+        double chargeProd, sigma, epsilon;
+        force.getExceptionParameters(i, particle1, particle2, chargeProd, sigma, epsilon);
+        auto index = exceptionIndex.find(i);
+        if (index == exceptionIndex.end()) {
+            if (chargeProd != 0.0 || epsilon != 0.0)
+                throw OpenMMException("updateParametersInContext: The set of non-excluded exceptions has changed");
+        }
+        else if (index->second >= startIndex && index->second < endIndex) {
+            int local = index->second-startIndex;
+            if (make_pair(particle1, particle2) != exceptionAtoms[local])
+                throw OpenMMException("updateParametersInContext: The set of non-excluded exceptions has changed");
+            if (firstLocalException == -1)
+                firstLocalException = local;
+            lastLocalException = local;
+        }
+    }
+    
+    // Record the per-particle parameters.  Only the changed range is uploaded, and the self energy
+    // is updated based on the difference from the old values.
+    
+    bool sigmaEpsilonChanged = false;
+    if (lastParticle >= firstParticle) {
+        vector<mm_float4> baseParticleParamVec(lastParticle-firstParticle+1);
+        for (int i = firstParticle; i <= lastParticle; i++) {
+            double charge, sigma, epsilon;
+            force.getParticleParameters(i, charge, sigma, epsilon);
+            if (!hasCoulomb && charge != 0.0)
+                throw OpenMMException("updateParametersInContext: The nonbonded force kernel does not include Coulomb interactions, because all charges were originally 0");
+            if (!hasLJ && epsilon != 0.0)
+                throw OpenMMException("updateParametersInContext: The nonbonded force kernel does not include Lennard-Jones interactions, because all epsilons were originally 0");
+            baseParticleParamVec[i-firstParticle] = mm_float4(charge, sigma, epsilon, 0);
+        }
+        for (int i = firstParticle; i <= lastParticle; i++) {
+            mm_float4 oldParams = hostParticleParams[i];
+            mm_float4 newParams = baseParticleParamVec[i-firstParticle];
+            if (oldParams.y != newParams.y || oldParams.z != newParams.z)
+                sigmaEpsilonChanged = true;
+            if ((nonbondedMethod == Ewald || nonbondedMethod == PME || nonbondedMethod == LJPME) && cl.getContextIndex() == 0) {
+                ewaldSelfEnergy -= (newParams.x*newParams.x-oldParams.x*oldParams.x)*ONE_4PI_EPS0*alpha/sqrt(M_PI);
+                if (doLJPME)
+                    ewaldSelfEnergy += (newParams.z*pow(newParams.y*dispersionAlpha, 6)-oldParams.z*pow(oldParams.y*dispersionAlpha, 6))/3.0;
+            }
+            hostParticleParams[i] = newParams;
+        }
+        baseParticleParams.uploadSubArray(baseParticleParamVec.data(), firstParticle, baseParticleParamVec.size());
+    }
+    
+    // Record the exceptions.
+    
+    if (firstLocalException != -1) {
+        int numExceptions = lastLocalException-firstLocalException+1;
+        vector<mm_float4> baseExceptionParamsVec(numExceptions);
+        for (auto& index : exceptionIndex) {
+            int local = index.second-startIndex;
+            if (local >= firstLocalException && local <= lastLocalException) {
+                int particle1, particle2;
+                double chargeProd, sigma, epsilon;
+                force.getExceptionParameters(index.first, particle1, particle2, chargeProd, sigma, epsilon);
+                baseExceptionParamsVec[local-firstLocalException] = mm_float4(chargeProd, sigma, epsilon, 0);
+            }
+        }
+        baseExceptionParams.uploadSubArray(baseExceptionParamsVec.data(), firstLocalException, numExceptions);
+    }
+    
+    // Compute other values.
+    
+    if (sigmaEpsilonChanged && force.getUseDispersionCorrection() && cl.getContextIndex() == 0 && (nonbondedMethod == CutoffPeriodic || nonbondedMethod == Ewald || nonbondedMethod == PME))
+        dispersionCoefficient = NonbondedForceImpl::calcDispersionCorrection(context.getSystem(), force);
+    cl.invalidateMolecules(info);
+    recomputeParams = true;
+}
+
 void OpenCLCalcNonbondedForceKernel::getPMEParameters(double& alpha, int& nx, int& ny, int& nz) const {
     if (nonbondedMethod != PME)
         throw OpenMMException("getPMEParametersInContext: This Context is not using PME");
-    if (cl.getPlatformData().useCpuPme)
+    if (pmeio != NULL)
         cpuPme.getAs<CalcPmeReciprocalForceKernel>().getPMEParameters(alpha, nx, ny, nz);
     else {
         alpha = this->alpha;
@@ -1708,7 +2072,7 @@ private:
     OpenCLArray& invAtomOrder;
 };
 
-void OpenCLCalcCustomCVForceKernel::initialize(const System& system, const CustomCVForce& force, ContextImpl& innerContext) {
+void OpenCLCalcCustomCVForceKernel::initialize(const System& system, const CustomCVForce& force) {
     int numCVs = force.getNumCollectiveVariables();
     cl.addForce(new OpenCLForceInfo(1));
     for (int i = 0; i < force.getNumGlobalParameters(); i++)
@@ -1742,21 +2106,13 @@ void OpenCLCalcCustomCVForceKernel::initialize(const System& system, const Custo
 
     for (auto& function : functions)
         delete function.second;
-
-    // Copy parameter derivatives from the inner context.
-
-    OpenCLContext& cl2 = *reinterpret_cast<OpenCLPlatform::PlatformData*>(innerContext.getPlatformData())->contexts[0];
-    for (auto& param : cl2.getEnergyParamDerivNames())
-        cl.addEnergyParameterDerivative(param);
     
-    // Create arrays for storing information.
+    // Create arrays for storing information.  These match the context's force array, so forces
+    // computed in this context can be copied into them directly.
     
-    int elementSize = (cl.getUseDoublePrecision() || cl.getUseMixedPrecision() ? sizeof(double) : sizeof(float));
     cvForces.resize(numCVs);
     for (int i = 0; i < numCVs; i++)
-        cvForces[i].initialize(cl, cl.getNumAtoms(), 4*elementSize, "cvForce");
-    invAtomOrder.initialize<cl_int>(cl, cl.getPaddedNumAtoms(), "invAtomOrder");
-    innerInvAtomOrder.initialize<cl_int>(cl, cl.getPaddedNumAtoms(), "innerInvAtomOrder");
+        cvForces[i].initialize(cl, cl.getForce().getSize(), cl.getForce().getElementSize(), "cvForce");
     
     // Create the kernels.
     
@@ -1772,6 +2128,18 @@ void OpenCLCalcCustomCVForceKernel::initialize(const System& system, const Custo
     copyStateKernel = cl::Kernel(program, "copyState");
     copyForcesKernel = cl::Kernel(program, "copyForces");
     addForcesKernel = cl::Kernel(program, "addForces");
+}
+
+void OpenCLCalcCustomCVForceKernel::initialize(const System& system, const CustomCVForce& force, ContextImpl& innerContext) {
+    initialize(system, force);
+
+    // Copy parameter derivatives from the inner context.
+
+    OpenCLContext& cl2 = *reinterpret_cast<OpenCLPlatform::PlatformData*>(innerContext.getPlatformData())->contexts[0];
+    for (auto& param : cl2.getEnergyParamDerivNames())
+        cl.addEnergyParameterDerivative(param);
+    invAtomOrder.initialize<cl_int>(cl, cl.getPaddedNumAtoms(), "invAtomOrder");
+    innerInvAtomOrder.initialize<cl_int>(cl, cl.getPaddedNumAtoms(), "innerInvAtomOrder");
 
     // This context needs to respect all forces in the inner context when reordering atoms.
 
@@ -1792,6 +2160,23 @@ double OpenCLCalcCustomCVForceKernel::execute(ContextImpl& context, ContextImpl&
         cl.executeKernel(copyForcesKernel, numAtoms);
         innerContext.getEnergyParameterDerivatives(cvDerivs[i]);
     }
+    return execute(context, cvValues, cvDerivs, true, includeEnergy);
+}
+
+void OpenCLCalcCustomCVForceKernel::copyVariableForces(ContextImpl& context, int index) {
+    cl.getForce().copyTo(cvForces[index]);
+}
+
+double OpenCLCalcCustomCVForceKernel::execute(ContextImpl& context, const vector<double>& cvValues, const vector<map<string, double> >& cvDerivs, bool includeForces, bool includeEnergy) {
+    int numCVs = variableNames.size();
+    int numAtoms = cl.getNumAtoms();
+    if (!hasInitializedAddForces) {
+        hasInitializedAddForces = true;
+        addForcesKernel.setArg<cl::Buffer>(0, cl.getForce().getDeviceBuffer());
+        addForcesKernel.setArg<cl_int>(1, numAtoms);
+        for (int i = 0; i < cvForces.size(); i++)
+            addForcesKernel.setArg<cl::Buffer>(2*i+2, cvForces[i].getDeviceBuffer());
+    }
     
     // Compute the energy and forces.
     
@@ -1808,7 +2193,8 @@ double OpenCLCalcCustomCVForceKernel::execute(ContextImpl& context, ContextImpl&
         else
             addForcesKernel.setArg<cl_float>(2*i+3, dEdV);
     }
-    cl.executeKernel(addForcesKernel, numAtoms);
+    if (includeForces)
+        cl.executeKernel(addForcesKernel, numAtoms);
     
     // Compute the energy parameter derivatives.
     
@@ -1860,11 +2246,6 @@ void OpenCLCalcCustomCVForceKernel::copyState(ContextImpl& context, ContextImpl&
         copyForcesKernel.setArg<cl::Buffer>(2, cl2.getForce().getDeviceBuffer());
         copyForcesKernel.setArg<cl::Buffer>(3, cl2.getAtomIndexArray().getDeviceBuffer());
         copyForcesKernel.setArg<cl_int>(4, numAtoms);
-
-        addForcesKernel.setArg<cl::Buffer>(0, cl.getForce().getDeviceBuffer());
-        addForcesKernel.setArg<cl_int>(1, numAtoms);
-        for (int i = 0; i < cvForces.size(); i++)
-            addForcesKernel.setArg<cl::Buffer>(2*i+2, cvForces[i].getDeviceBuffer());
     }
     cl.executeKernel(copyStateKernel, numAtoms);
     Vec3 a, b, c;
@@ -1951,3 +2332,13 @@ void OpenCLApplyMonteCarloBarostatKernel::restoreCoordinates(ContextImpl& contex
     cl.getQueue().enqueueCopyBuffer(savedPositions.getDeviceBuffer(), cl.getPosq().getDeviceBuffer(), 0, 0, bytesToCopy);
     cl.getQueue().enqueueCopyBuffer(savedForces.getDeviceBuffer(), cl.getForce().getDeviceBuffer(), 0, 0, bytesToCopy);
 }
+
+ComputeContext* OpenCLSwapStateKernel::getComputeContext(ContextImpl& other) {
+    OpenCLPlatform::PlatformData& data = *reinterpret_cast<OpenCLPlatform::PlatformData*>(other.getPlatformData());
+    if (data.contexts.size() != 1 || cl.getPlatformData().contexts.size() != 1)
+        return NULL;
+    OpenCLContext& cl2 = *data.contexts[0];
+    if (cl2.getContext()() != cl.getContext()())
+        return NULL;
+    return &cl2;
+}
@@ -0,0 +1,166 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2024 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * This program is free software: you can redistribute it and/or modify       *
+ * it under the terms of the GNU Lesser General Public License as published   *
+ * by the Free Software Foundation, either version 3 of the License, or       *
+ * (at your option) any later version.                                        *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU Lesser General Public License for more details.                        *
+ *                                                                            *
+ * You should have received a copy of the GNU Lesser General Public License   *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.      *
+ * -------------------------------------------------------------------------- */
+
+#include "OpenCLMemoryPool.h"
+#include <algorithm>
+
+using namespace OpenMM;
+using namespace std;
+
+pthread_mutex_t OpenCLMemoryPool::poolsLock = PTHREAD_MUTEX_INITIALIZER;
+map<cl_context, OpenCLMemoryPool*> OpenCLMemoryPool::pools;
+
+OpenCLMemoryPool* OpenCLMemoryPool::acquire(cl::Context& context) {
+    pthread_mutex_lock(&poolsLock);
+    OpenCLMemoryPool* pool;
+    auto existing = pools.find(context());
+    if (existing == pools.end()) {
+        pool = new OpenCLMemoryPool(context);
+        pools[context()] = pool;
+    }
+    else
+        pool = existing->second;
+    pool->referenceCount++;
+    pthread_mutex_unlock(&poolsLock);
+    return pool;
+}
+
+void OpenCLMemoryPool::release(OpenCLMemoryPool* pool) {
+    pthread_mutex_lock(&poolsLock);
+    if (--pool->referenceCount == 0) {
+        pools.erase(pool->context());
+        delete pool;
+    }
+    pthread_mutex_unlock(&poolsLock);
+}
+
+OpenCLMemoryPool::OpenCLMemoryPool(cl::Context& context) : context(context), referenceCount(0) {
+    pthread_mutex_init(&lock, NULL);
+    stats.bytesInUse = 0;
+    stats.bytesCached = 0;
+    stats.peakBytesInUse = 0;
+    stats.numDeviceAllocations = 0;
+    stats.numReusedAllocations = 0;
+}
+
+OpenCLMemoryPool::~OpenCLMemoryPool() {
+    releaseCachedMemoryLocked();
+    pthread_mutex_destroy(&lock);
+}
+
+size_t OpenCLMemoryPool::getSizeClass(size_t size) {
+    // Round up to a multiple of 256 bytes for small blocks.  Larger ones are rounded up to
+    // 1, 1.25, 1.5, or 1.75 times a power of two, so at most 25% of a block is wasted.
+
+    const size_t minSize = 256;
+    if (size <= 4*minSize)
+        return max(minSize, (size+minSize-1)/minSize*minSize);
+    size_t power = 4*minSize;
+    while (2*power < size)
+        power *= 2;
+    size_t step = power/4;
+    return (size+step-1)/step*step;
+}
+
+cl::Buffer* OpenCLMemoryPool::allocate(size_t size, cl_mem_flags flags, cl::CommandQueue& queue) {
+    size_t sizeClass = getSizeClass(size);
+    pthread_mutex_lock(&lock);
+
+    // Look for a cached buffer that was last used on this queue.
+
+    vector<Block>& blocks = cache[make_pair(flags, sizeClass)];
+    for (int i = blocks.size()-1; i >= 0; i--) {
+        if (blocks[i].queue == queue()) {
+            cl::Buffer* buffer = blocks[i].buffer;
+            blocks.erase(blocks.begin()+i);
+            stats.bytesCached -= sizeClass;
+            stats.bytesInUse += sizeClass;
+            stats.peakBytesInUse = max(stats.peakBytesInUse, stats.bytesInUse);
+            stats.numReusedAllocations++;
+            pthread_mutex_unlock(&lock);
+            return buffer;
+        }
+    }
+
+    // Create a new buffer.  If that fails, free the cache and try again.
+
+    cl::Buffer* buffer;
+    try {
+        try {
+            buffer = new cl::Buffer(context, flags, sizeClass);
+        }
+        catch (cl::Error err) {
+            if (stats.bytesCached == 0)
+                throw;
+            releaseCachedMemoryLocked();
+            buffer = new cl::Buffer(context, flags, sizeClass);
+        }
+    }
+    catch (...) {
+        pthread_mutex_unlock(&lock);
+        throw;
+    }
+    stats.bytesInUse += sizeClass;
+    stats.peakBytesInUse = max(stats.peakBytesInUse, stats.bytesInUse);
+    stats.numDeviceAllocations++;
+    pthread_mutex_unlock(&lock);
+    return buffer;
+}
+
+void OpenCLMemoryPool::free(cl::Buffer* buffer, size_t size, cl_mem_flags flags, cl::CommandQueue& queue) {
+    size_t sizeClass = getSizeClass(size);
+    Block block;
+    block.buffer = buffer;
+    block.queue = queue();
+    pthread_mutex_lock(&lock);
+    cache[make_pair(flags, sizeClass)].push_back(block);
+    stats.bytesInUse -= sizeClass;
+    stats.bytesCached += sizeClass;
+    pthread_mutex_unlock(&lock);
+}
+
+void OpenCLMemoryPool::releaseCachedMemory() {
+    pthread_mutex_lock(&lock);
+    releaseCachedMemoryLocked();
+    pthread_mutex_unlock(&lock);
+}
+
+void OpenCLMemoryPool::releaseCachedMemoryLocked() {
+    // OpenCL defers releasing the memory until all commands using it have completed.
+
+    for (auto& entry : cache)
+        for (Block& block : entry.second)
+            delete block.buffer;
+    cache.clear();
+    stats.bytesCached = 0;
+}
+
+OpenCLMemoryPool::Statistics OpenCLMemoryPool::getStatistics() {
+    pthread_mutex_lock(&lock);
+    Statistics result = stats;
+    pthread_mutex_unlock(&lock);
+    return result;
+}
@@ -25,6 +25,7 @@
  * -------------------------------------------------------------------------- */
 
 #include "openmm/OpenMMException.h"
+#include "openmm/internal/TraceRange.h"
 #include "OpenCLNonbondedUtilities.h"
 #include "OpenCLArray.h"
 #include "OpenCLContext.h"
@@ -56,7 +57,8 @@ private:
 };
 
 OpenCLNonbondedUtilities::OpenCLNonbondedUtilities(OpenCLContext& context) : context(context), useCutoff(false), usePeriodic(false), anyExclusions(false), usePadding(true),
-        numForceBuffers(0), blockSorter(NULL), pinnedCountBuffer(NULL), pinnedCountMemory(NULL), forceRebuildNeighborList(true), lastCutoff(0.0), groupFlags(0) {
+        numForceBuffers(0), blockSorter(NULL), pinnedCountBuffer(NULL), pinnedCountMemory(NULL), forceRebuildNeighborList(true), hasPendingCount(false), lastCutoff(0.0), groupFlags(0),
+        numNeighborListEvaluations(0), numNeighborListBuilds(0), numNeighborListReallocations(0) {
     // Decide how many thread blocks and force buffers to use.
 
     deviceIsCpu = (context.getDevice().getInfo<CL_DEVICE_TYPE>() == CL_DEVICE_TYPE_CPU);
@@ -89,8 +91,16 @@ OpenCLNonbondedUtilities::OpenCLNonbondedUtilities(OpenCLContext& context) : con
             numForceBuffers = numForceThreadBlocks*forceThreadBlockSize/OpenCLContext::TileSize;
         }
     }
-    pinnedCountBuffer = new cl::Buffer(context.getContext(), CL_MEM_ALLOC_HOST_PTR, sizeof(int));
-    pinnedCountMemory = (int*) context.getQueue().enqueueMapBuffer(*pinnedCountBuffer, CL_TRUE, CL_MAP_READ, 0, sizeof(int));
+
+    // Sub-group shuffles let threads exchange the j atoms of a tile in registers instead of local memory.  That
+    // requires every tile to be one sub-group, since the exchange would otherwise cross tiles whose control flow
+    // may diverge.
+
+    string extensions = context.getDevice().getInfo<CL_DEVICE_EXTENSIONS>();
+    useShuffle = (!deviceIsCpu && context.getSIMDWidth() == OpenCLContext::TileSize &&
+            extensions.find("cl_khr_subgroups") != string::npos && extensions.find("cl_khr_subgroup_shuffle") != string::npos);
+    pinnedCountBuffer = new cl::Buffer(context.getContext(), CL_MEM_ALLOC_HOST_PTR, 2*sizeof(int));
+    pinnedCountMemory = (int*) context.getQueue().enqueueMapBuffer(*pinnedCountBuffer, CL_TRUE, CL_MAP_READ, 0, 2*sizeof(int));
 }
 
 OpenCLNonbondedUtilities::~OpenCLNonbondedUtilities() {
@@ -100,6 +110,10 @@ OpenCLNonbondedUtilities::~OpenCLNonbondedUtilities() {
         delete pinnedCountBuffer;
 }
 
+void OpenCLNonbondedUtilities::addInteraction(bool usesCutoff, bool usesPeriodic, bool usesExclusions, double cutoffDistance, const vector<vector<int> >& exclusionList, const string& kernel, int forceGroup, bool supportsPairList) {
+    addInteraction(usesCutoff, usesPeriodic, usesExclusions, cutoffDistance, exclusionList, kernel, forceGroup);
+}
+
 void OpenCLNonbondedUtilities::addInteraction(bool usesCutoff, bool usesPeriodic, bool usesExclusions, double cutoffDistance, const vector<vector<int> >& exclusionList, const string& kernel, int forceGroup) {
     if (groupCutoff.size() > 0) {
         if (usesCutoff != useCutoff)
@@ -304,10 +318,19 @@ void OpenCLNonbondedUtilities::initialize(const System& system) {
         sortedBlockBoundingBox.initialize(context, numAtomBlocks+1, 4*elementSize, "sortedBlockBoundingBox");
         oldPositions.initialize(context, numAtoms, 4*elementSize, "oldPositions");
         rebuildNeighborList.initialize<int>(context, 1, "rebuildNeighborList");
+        oldBoxSize.initialize(context, 1, 4*elementSize, "oldBoxSize");
         blockSorter = new OpenCLSort(context, new BlockSortTrait(context.getUseDoublePrecision()), numAtomBlocks);
         vector<cl_uint> count(1, 0);
         interactionCount.upload(count);
         rebuildNeighborList.upload(count);
+        if (context.getUseDoublePrecision()) {
+            vector<mm_double4> box(1, mm_double4(1, 1, 1, 0));
+            oldBoxSize.upload(box);
+        }
+        else {
+            vector<mm_float4> box(1, mm_float4(1, 1, 1, 0));
+            oldBoxSize.upload(box);
+        }
     }
 }
 
@@ -335,6 +358,10 @@ double OpenCLNonbondedUtilities::getMaxCutoffDistance() {
     return cutoff;
 }
 
+OpenCLArray& OpenCLNonbondedUtilities::getSinglePairs() {
+    throw OpenMMException("The OpenCL platform does not use a separate pair list");
+}
+
 double OpenCLNonbondedUtilities::padCutoff(double cutoff) {
     double padding = (usePadding ? 0.1*cutoff : 0.0);
     return cutoff+padding;
@@ -349,6 +376,8 @@ void OpenCLNonbondedUtilities::prepareInteractions(int forceGroups) {
         return;
     if (numTiles == 0)
         return;
+    OPENMM_TRACE_RANGE("Neighbor list");
+    numNeighborListEvaluations++;
     KernelSet& kernels = groupKernels[forceGroups];
     if (usePeriodic) {
         mm_float4 box = context.getPeriodicBoxSize();
@@ -365,17 +394,24 @@ void OpenCLNonbondedUtilities::prepareInteractions(int forceGroups) {
     context.executeKernel(kernels.findBlockBoundsKernel, context.getNumAtoms());
     blockSorter->sort(sortedBlocks);
     kernels.sortBoxDataKernel.setArg<cl_int>(9, forceRebuildNeighborList);
+    if (context.getUseDoublePrecision())
+        kernels.sortBoxDataKernel.setArg<mm_double4>(10, context.getPeriodicBoxSizeDouble());
+    else
+        kernels.sortBoxDataKernel.setArg<mm_float4>(10, context.getPeriodicBoxSize());
     context.executeKernel(kernels.sortBoxDataKernel, context.getNumAtoms());
     setPeriodicBoxArgs(context, kernels.findInteractingBlocksKernel, 0);
     context.executeKernel(kernels.findInteractingBlocksKernel, context.getNumAtoms(), interactingBlocksThreadBlockSize);
     forceRebuildNeighborList = false;
     lastCutoff = kernels.cutoffDistance;
-    context.getQueue().enqueueReadBuffer(interactionCount.getDeviceBuffer(), CL_FALSE, 0, sizeof(int), pinnedCountMemory, NULL, &downloadCountEvent); 
+    context.getQueue().enqueueReadBuffer(interactionCount.getDeviceBuffer(), CL_FALSE, 0, sizeof(int), pinnedCountMemory);
+    context.getQueue().enqueueReadBuffer(rebuildNeighborList.getDeviceBuffer(), CL_FALSE, 0, sizeof(int), pinnedCountMemory+1, NULL, &downloadCountEvent);
+    hasPendingCount = true;
 }
 
 void OpenCLNonbondedUtilities::computeInteractions(int forceGroups, bool includeForces, bool includeEnergy) {
     if ((forceGroups&groupFlags) == 0)
         return;
+    OPENMM_TRACE_RANGE("Nonbonded interactions");
     KernelSet& kernels = groupKernels[forceGroups];
     if (kernels.hasForces) {
         cl::Kernel& kernel = (includeForces ? (includeEnergy ? kernels.forceEnergyKernel : kernels.forceKernel) : kernels.energyKernel);
@@ -385,25 +421,36 @@ void OpenCLNonbondedUtilities::computeInteractions(int forceGroups, bool include
             setPeriodicBoxArgs(context, kernel, 9);
         context.executeKernel(kernel, numForceThreadBlocks*forceThreadBlockSize, forceThreadBlockSize);
     }
-    if (useCutoff && numTiles > 0) {
-        downloadCountEvent.wait();
-        updateNeighborListSize();
-    }
+}
+
+bool OpenCLNonbondedUtilities::checkNeighborListSize() {
+    if (!hasPendingCount)
+        return false;
+    hasPendingCount = false;
+    downloadCountEvent.wait();
+    if (pinnedCountMemory[1] != 0)
+        numNeighborListBuilds++;
+    return updateNeighborListSize();
 }
 
 bool OpenCLNonbondedUtilities::updateNeighborListSize() {
     if (!useCutoff)
         return false;
-    if (pinnedCountMemory[0] <= (unsigned int) interactingTiles.getSize())
-        return false;
+    unsigned int numInteractingTiles = pinnedCountMemory[0];
+    bool overflowed = (numInteractingTiles > (unsigned int) interactingTiles.getSize());
 
-    // The most recent timestep had too many interactions to fit in the arrays.  Make the arrays bigger to prevent
-    // this from happening in the future.
+    // Enlarge the arrays before they actually overflow.  An overflow means the whole force computation must
+    // be repeated, while enlarging them early only costs an extra neighbor list build.
 
-    int maxTiles = (int) (1.2*pinnedCountMemory[0]);
+    if (numInteractingTiles <= 0.9*interactingTiles.getSize())
+        return false;
+    int maxTiles = (int) (1.2*numInteractingTiles);
     int totalTiles = context.getNumAtomBlocks()*(context.getNumAtomBlocks()+1)/2;
     if (maxTiles > totalTiles)
         maxTiles = totalTiles;
+    if (maxTiles <= interactingTiles.getSize())
+        return false;
+    numNeighborListReallocations++;
     interactingTiles.resize(maxTiles);
     interactingAtoms.resize(OpenCLContext::TileSize*maxTiles);
     for (map<int, KernelSet>::iterator iter = groupKernels.begin(); iter != groupKernels.end(); ++iter) {
@@ -427,11 +474,29 @@ bool OpenCLNonbondedUtilities::updateNeighborListSize() {
         kernels.findInteractingBlocksKernel.setArg<cl::Buffer>(7, interactingAtoms.getDeviceBuffer());
         kernels.findInteractingBlocksKernel.setArg<cl_uint>(9, maxTiles);
     }
+
+    // The new arrays are empty, so the list must be rebuilt.  If the old arrays overflowed, the forces that
+    // were just computed are also missing interactions and must be recomputed.
+
     forceRebuildNeighborList = true;
+    if (!overflowed)
+        return false;
     context.setForcesValid(false);
     return true;
 }
 
+void OpenCLNonbondedUtilities::getNeighborListStatistics(map<string, double>& statistics) {
+    if (!useCutoff || numTiles == 0 || numNeighborListEvaluations == 0)
+        return;
+    int maxTiles = interactingTiles.getSize();
+    statistics["neighborList:interactingTiles"] = pinnedCountMemory[0];
+    statistics["neighborList:maxTiles"] = maxTiles;
+    statistics["neighborList:tileListOccupancy"] = min(pinnedCountMemory[0], maxTiles)/(double) maxTiles;
+    statistics["neighborList:builds"] = (double) numNeighborListBuilds;
+    statistics["neighborList:evaluations"] = (double) numNeighborListEvaluations;
+    statistics["neighborList:reallocations"] = numNeighborListReallocations;
+}
+
 void OpenCLNonbondedUtilities::setUsePadding(bool padding) {
     usePadding = padding;
 }
@@ -520,6 +585,7 @@ void OpenCLNonbondedUtilities::createKernelsForGroups(int groups) {
             kernels.sortBoxDataKernel.setArg<cl::Buffer>(7, interactionCount.getDeviceBuffer());
             kernels.sortBoxDataKernel.setArg<cl::Buffer>(8, rebuildNeighborList.getDeviceBuffer());
             kernels.sortBoxDataKernel.setArg<cl_int>(9, true);
+            kernels.sortBoxDataKernel.setArg<cl::Buffer>(11, oldBoxSize.getDeviceBuffer());
             kernels.findInteractingBlocksKernel = cl::Kernel(interactingBlocksProgram, "findBlocksWithInteractions");
             kernels.findInteractingBlocksKernel.setArg<cl::Buffer>(5, interactionCount.getDeviceBuffer());
             kernels.findInteractingBlocksKernel.setArg<cl::Buffer>(6, interactingTiles.getDeviceBuffer());
@@ -535,6 +601,7 @@ void OpenCLNonbondedUtilities::createKernelsForGroups(int groups) {
             kernels.findInteractingBlocksKernel.setArg<cl::Buffer>(16, exclusionRowIndices.getDeviceBuffer());
             kernels.findInteractingBlocksKernel.setArg<cl::Buffer>(17, oldPositions.getDeviceBuffer());
             kernels.findInteractingBlocksKernel.setArg<cl::Buffer>(18, rebuildNeighborList.getDeviceBuffer());
+            kernels.findInteractingBlocksKernel.setArg<cl::Buffer>(19, oldBoxSize.getDeviceBuffer());
             if (kernels.findInteractingBlocksKernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(context.getDevice()) < groupSize) {
                 // The device can't handle this block size, so reduce it.
 
@@ -676,6 +743,8 @@ cl::Kernel OpenCLNonbondedUtilities::createInteractionKernel(const string& sourc
         defines["INCLUDE_FORCES"] = "1";
     if (includeEnergy)
         defines["INCLUDE_ENERGY"] = "1";
+    if (useShuffle)
+        defines["ENABLE_SHUFFLE"] = "1";
     defines["FORCE_WORK_GROUP_SIZE"] = context.intToString(forceThreadBlockSize);
     double maxCutoff = 0.0;
     for (int i = 0; i < 32; i++) {
@@ -29,6 +29,7 @@
 #include "OpenCLKernelFactory.h"
 #include "OpenCLKernels.h"
 #include "openmm/Context.h"
+#include "openmm/OpenMMException.h"
 #include "openmm/System.h"
 #include "openmm/internal/ContextImpl.h"
 #include "openmm/internal/hardware.h"
@@ -90,6 +91,7 @@ OpenCLPlatform::OpenCLPlatform() {
     registerKernelFactory(IntegrateNoseHooverStepKernel::Name(), factory);
     registerKernelFactory(IntegrateLangevinStepKernel::Name(), factory);
     registerKernelFactory(IntegrateLangevinMiddleStepKernel::Name(), factory);
+    registerKernelFactory(IntegrateMTSLangevinStepKernel::Name(), factory);
     registerKernelFactory(IntegrateBrownianStepKernel::Name(), factory);
     registerKernelFactory(IntegrateVariableVerletStepKernel::Name(), factory);
     registerKernelFactory(IntegrateVariableLangevinStepKernel::Name(), factory);
@@ -97,6 +99,12 @@ OpenCLPlatform::OpenCLPlatform() {
     registerKernelFactory(ApplyAndersenThermostatKernel::Name(), factory);
     registerKernelFactory(ApplyMonteCarloBarostatKernel::Name(), factory);
     registerKernelFactory(RemoveCMMotionKernel::Name(), factory);
+    registerKernelFactory(MinimizeKernel::Name(), factory);
+    registerKernelFactory(SwapStateKernel::Name(), factory);
+    registerKernelFactory(ParticleSubsetKernel::Name(), factory);
+    registerKernelFactory(StateSnapshotKernel::Name(), factory);
+    registerKernelFactory(ScaleVelocitiesKernel::Name(), factory);
+    registerKernelFactory(ProfileKernel::Name(), factory);
     platformProperties.push_back(OpenCLDeviceIndex());
     platformProperties.push_back(OpenCLDeviceName());
     platformProperties.push_back(OpenCLPlatformIndex());
@@ -104,6 +112,9 @@ OpenCLPlatform::OpenCLPlatform() {
     platformProperties.push_back(OpenCLPrecision());
     platformProperties.push_back(OpenCLUseCpuPme());
     platformProperties.push_back(OpenCLDisablePmeStream());
+    platformProperties.push_back(OpenCLTunePme());
+    platformProperties.push_back(OpenCLSpecializeGlobalParameters());
+    platformProperties.push_back(OpenCLConstraintAlgorithm());
     setPropertyDefaultValue(OpenCLDeviceIndex(), "");
     setPropertyDefaultValue(OpenCLDeviceName(), "");
     setPropertyDefaultValue(OpenCLPlatformIndex(), "");
@@ -111,10 +122,35 @@ OpenCLPlatform::OpenCLPlatform() {
     setPropertyDefaultValue(OpenCLPrecision(), "single");
     setPropertyDefaultValue(OpenCLUseCpuPme(), "false");
     setPropertyDefaultValue(OpenCLDisablePmeStream(), "false");
+    setPropertyDefaultValue(OpenCLTunePme(), "false");
+    setPropertyDefaultValue(OpenCLSpecializeGlobalParameters(), "false");
+    setPropertyDefaultValue(OpenCLConstraintAlgorithm(), "CCMA");
+
+    // When the only OpenCL devices are CPUs, this platform is much slower than the CPU platform, so rank it
+    // below that one to keep it from being selected by default.
+
+    hasGpuDevice = false;
+    try {
+        vector<cl::Platform> platforms;
+        cl::Platform::get(&platforms);
+        for (auto& platform : platforms) {
+            vector<cl::Device> devices;
+            try {
+                platform.getDevices(CL_DEVICE_TYPE_GPU | CL_DEVICE_TYPE_ACCELERATOR, &devices);
+            }
+            catch (...) {
+                // This platform has no devices of the requested types.
+            }
+            if (devices.size() > 0)
+                hasGpuDevice = true;
+        }
+    }
+    catch (...) {
+    }
 }
 
 double OpenCLPlatform::getSpeed() const {
-    return 50;
+    return (hasGpuDevice ? 50 : 5);
 }
 
 bool OpenCLPlatform::supportsDoublePrecision() const {
@@ -183,9 +219,18 @@ void OpenCLPlatform::contextCreated(ContextImpl& context, const map<string, stri
             getPropertyDefaultValue(OpenCLUseCpuPme()) : properties.find(OpenCLUseCpuPme())->second);
     string pmeStreamPropValue = (properties.find(OpenCLDisablePmeStream()) == properties.end() ?
             getPropertyDefaultValue(OpenCLDisablePmeStream()) : properties.find(OpenCLDisablePmeStream())->second);
+    string tunePmeValue = (properties.find(OpenCLTunePme()) == properties.end() ?
+            getPropertyDefaultValue(OpenCLTunePme()) : properties.find(OpenCLTunePme())->second);
+    string specializeGlobalsValue = (properties.find(OpenCLSpecializeGlobalParameters()) == properties.end() ?
+            getPropertyDefaultValue(OpenCLSpecializeGlobalParameters()) : properties.find(OpenCLSpecializeGlobalParameters())->second);
+    string constraintAlgorithmValue = (properties.find(OpenCLConstraintAlgorithm()) == properties.end() ?
+            getPropertyDefaultValue(OpenCLConstraintAlgorithm()) : properties.find(OpenCLConstraintAlgorithm())->second);
     transform(precisionPropValue.begin(), precisionPropValue.end(), precisionPropValue.begin(), ::tolower);
     transform(cpuPmePropValue.begin(), cpuPmePropValue.end(), cpuPmePropValue.begin(), ::tolower);
     transform(pmeStreamPropValue.begin(), pmeStreamPropValue.end(), pmeStreamPropValue.begin(), ::tolower);
+    transform(tunePmeValue.begin(), tunePmeValue.end(), tunePmeValue.begin(), ::tolower);
+    transform(specializeGlobalsValue.begin(), specializeGlobalsValue.end(), specializeGlobalsValue.begin(), ::tolower);
+    transform(constraintAlgorithmValue.begin(), constraintAlgorithmValue.end(), constraintAlgorithmValue.begin(), ::toupper);
     vector<string> pmeKernelName;
     pmeKernelName.push_back(CalcPmeReciprocalForceKernel::Name());
     if (!supportsKernels(pmeKernelName))
@@ -195,7 +240,7 @@ void OpenCLPlatform::contextCreated(ContextImpl& context, const map<string, stri
     if (threadsEnv != NULL)
         stringstream(threadsEnv) >> threads;
     context.setPlatformData(new PlatformData(context.getSystem(), platformPropValue, devicePropValue, precisionPropValue, cpuPmePropValue,
-            pmeStreamPropValue, threads, NULL));
+            pmeStreamPropValue, tunePmeValue, specializeGlobalsValue, constraintAlgorithmValue, threads, NULL));
 }
 
 void OpenCLPlatform::linkedContextCreated(ContextImpl& context, ContextImpl& originalContext) const {
@@ -205,9 +250,12 @@ void OpenCLPlatform::linkedContextCreated(ContextImpl& context, ContextImpl& ori
     string precisionPropValue = platform.getPropertyValue(originalContext.getOwner(), OpenCLPrecision());
     string cpuPmePropValue = platform.getPropertyValue(originalContext.getOwner(), OpenCLUseCpuPme());
     string pmeStreamPropValue = platform.getPropertyValue(originalContext.getOwner(), OpenCLDisablePmeStream());
+    string tunePmeValue = platform.getPropertyValue(originalContext.getOwner(), OpenCLTunePme());
+    string specializeGlobalsValue = platform.getPropertyValue(originalContext.getOwner(), OpenCLSpecializeGlobalParameters());
+    string constraintAlgorithmValue = platform.getPropertyValue(originalContext.getOwner(), OpenCLConstraintAlgorithm());
     int threads = reinterpret_cast<PlatformData*>(originalContext.getPlatformData())->threads.getNumThreads();
     context.setPlatformData(new PlatformData(context.getSystem(), platformPropValue, devicePropValue, precisionPropValue, cpuPmePropValue,
-            pmeStreamPropValue, threads, &originalContext));
+            pmeStreamPropValue, tunePmeValue, specializeGlobalsValue, constraintAlgorithmValue, threads, &originalContext));
 }
 
 void OpenCLPlatform::contextDestroyed(ContextImpl& context) const {
@@ -216,8 +264,12 @@ void OpenCLPlatform::contextDestroyed(ContextImpl& context) const {
 }
 
 OpenCLPlatform::PlatformData::PlatformData(const System& system, const string& platformPropValue, const string& deviceIndexProperty,
-        const string& precisionProperty, const string& cpuPmeProperty, const string& pmeStreamProperty, int numThreads, ContextImpl* originalContext) :
+        const string& precisionProperty, const string& cpuPmeProperty, const string& pmeStreamProperty, const string& tunePmeProperty, const string& specializeGlobalsProperty,
+        const string& constraintAlgorithmProperty, int numThreads, ContextImpl* originalContext) :
             removeCM(false), stepCount(0), computeForceCount(0), time(0.0), hasInitializedContexts(false), threads(numThreads)  {
+    if (constraintAlgorithmProperty != "CCMA" && constraintAlgorithmProperty != "LINCS")
+        throw OpenMMException("Illegal value for ConstraintAlgorithm: "+constraintAlgorithmProperty);
+    useLincs = (constraintAlgorithmProperty == "LINCS");
     int platformIndex = -1;
     if (platformPropValue.length() > 0)
         stringstream(platformPropValue) >> platformIndex;
@@ -262,6 +314,10 @@ OpenCLPlatform::PlatformData::PlatformData(const System& system, const string& p
 
     useCpuPme = (cpuPmeProperty == "true" && !contexts[0]->getUseDoublePrecision());
     disablePmeStream = (pmeStreamProperty == "true");
+    tunePme = (tunePmeProperty == "true");
+    specializeGlobalParameters = (specializeGlobalsProperty == "true");
+    for (int i = 0; i < (int) contexts.size(); i++)
+        contexts[i]->setSpecializeGlobalParameters(specializeGlobalParameters);
     propertyValues[OpenCLPlatform::OpenCLDeviceIndex()] = deviceIndex.str();
     propertyValues[OpenCLPlatform::OpenCLDeviceName()] = deviceName.str();
     propertyValues[OpenCLPlatform::OpenCLPlatformIndex()] = contexts[0]->intToString(platformIndex);
@@ -271,6 +327,9 @@ OpenCLPlatform::PlatformData::PlatformData(const System& system, const string& p
     propertyValues[OpenCLPlatform::OpenCLPrecision()] = precisionProperty;
     propertyValues[OpenCLPlatform::OpenCLUseCpuPme()] = useCpuPme ? "true" : "false";
     propertyValues[OpenCLPlatform::OpenCLDisablePmeStream()] = disablePmeStream ? "true" : "false";
+    propertyValues[OpenCLPlatform::OpenCLTunePme()] = tunePme ? "true" : "false";
+    propertyValues[OpenCLPlatform::OpenCLSpecializeGlobalParameters()] = specializeGlobalParameters ? "true" : "false";
+    propertyValues[OpenCLPlatform::OpenCLConstraintAlgorithm()] = useLincs ? "LINCS" : "CCMA";
     contextEnergy.resize(contexts.size());
 }
 
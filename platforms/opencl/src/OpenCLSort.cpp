@@ -50,6 +50,7 @@ OpenCLSort::OpenCLSort(OpenCLContext& context, SortTrait* trait, unsigned int le
     cl::Program program = context.createProgram(context.replaceStrings(OpenCLKernelSources::sort, replacements));
     shortListKernel = cl::Kernel(program, "sortShortList");
     shortList2Kernel = cl::Kernel(program, "sortShortList2");
+    computeBlockRangeKernel = cl::Kernel(program, "computeBlockRange");
     computeRangeKernel = cl::Kernel(program, "computeRange");
     assignElementsKernel = cl::Kernel(program, "assignElementsToBuckets");
     computeBucketPositionsKernel = cl::Kernel(program, "computeBucketPositions");
@@ -61,6 +62,7 @@ OpenCLSort::OpenCLSort(OpenCLContext& context, SortTrait* trait, unsigned int le
     unsigned int maxGroupSize = std::min(256, (int) context.getDevice().getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>());
     int maxSharedMem = context.getDevice().getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
     unsigned int maxRangeSize = std::min(maxGroupSize, (unsigned int) computeRangeKernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(context.getDevice()));
+    maxRangeSize = std::min(maxRangeSize, (unsigned int) computeBlockRangeKernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(context.getDevice()));
     unsigned int maxPositionsSize = std::min(maxGroupSize, (unsigned int) computeBucketPositionsKernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(context.getDevice()));
     int maxLocalBuffer = (maxSharedMem/trait->getDataSize())/2;
     int maxShortList = max(maxLocalBuffer, (int) OpenCLContext::ThreadBlockSize*context.getNumThreadBlocks());
@@ -80,6 +82,7 @@ OpenCLSort::OpenCLSort(OpenCLContext& context, SortTrait* trait, unsigned int le
     sortKernelSize = (isShortList ? rangeKernelSize : rangeKernelSize/2);
     if (rangeKernelSize > length)
         rangeKernelSize = length;
+    numRangeBlocks = std::min((length+rangeKernelSize-1)/rangeKernelSize, (unsigned int) context.getNumThreadBlocks());
     if (sortKernelSize > maxLocalBuffer)
         sortKernelSize = maxLocalBuffer;
     unsigned int targetBucketSize = sortKernelSize/2;
@@ -92,6 +95,7 @@ OpenCLSort::OpenCLSort(OpenCLContext& context, SortTrait* trait, unsigned int le
     // Create workspace arrays.
 
     dataRange.initialize(context, 2, trait->getKeySize(), "sortDataRange");
+    blockRange.initialize(context, 2*numRangeBlocks, trait->getKeySize(), "sortBlockRange");
     bucketOffset.initialize<cl_uint>(context, numBuckets, "bucketOffset");
     bucketOfElement.initialize<cl_uint>(context, length, "bucketOfElement");
     offsetInBucket.initialize<cl_uint>(context, length, "offsetInBucket");
@@ -137,8 +141,14 @@ void OpenCLSort::sort(OpenCLArray& data) {
     // Compute the range of data values.
 
     unsigned int numBuckets = bucketOffset.getSize();
-    computeRangeKernel.setArg<cl::Buffer>(0, data.getDeviceBuffer());
-    computeRangeKernel.setArg<cl_uint>(1, data.getSize());
+    computeBlockRangeKernel.setArg<cl::Buffer>(0, data.getDeviceBuffer());
+    computeBlockRangeKernel.setArg<cl_uint>(1, data.getSize());
+    computeBlockRangeKernel.setArg<cl::Buffer>(2, blockRange.getDeviceBuffer());
+    computeBlockRangeKernel.setArg(3, rangeKernelSize*trait->getKeySize(), NULL);
+    computeBlockRangeKernel.setArg(4, rangeKernelSize*trait->getKeySize(), NULL);
+    context.executeKernel(computeBlockRangeKernel, numRangeBlocks*rangeKernelSize, rangeKernelSize);
+    computeRangeKernel.setArg<cl::Buffer>(0, blockRange.getDeviceBuffer());
+    computeRangeKernel.setArg<cl_uint>(1, numRangeBlocks);
     computeRangeKernel.setArg<cl::Buffer>(2, dataRange.getDeviceBuffer());
     computeRangeKernel.setArg(3, rangeKernelSize*trait->getKeySize(), NULL);
     computeRangeKernel.setArg(4, rangeKernelSize*trait->getKeySize(), NULL);
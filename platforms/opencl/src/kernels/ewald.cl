@@ -3,7 +3,8 @@ real2 multofReal2(real2 a, real2 b) {
 }
 
 /**
- * Precompute the cosine and sine sums which appear in each force term.
+ * Precompute the cosine and sine sums which appear in each force term, multiplied by the weight
+ * of each wave vector.
  */
 
 __kernel void calculateEwaldCosSinSums(__global mixed* restrict energyBuffer, __global const real4* restrict posq, __global real2* restrict cosSinSum, real4 reciprocalPeriodicBoxSize, real reciprocalCoefficient) {
@@ -40,13 +41,14 @@ __kernel void calculateEwaldCosSinSums(__global mixed* restrict energyBuffer, __
             structureFactor = multofReal2(structureFactor, (real2) (cos(phase), sin(phase)));
             sum += apos.w*structureFactor;
         }
-        cosSinSum[index] = sum;
 
-        // Compute the contribution to the energy.
+        // Compute the contribution to the energy.  The force kernel only needs the sum multiplied by the
+        // wave vector's weight, so store that to avoid recomputing it for every atom.
 
         real k2 = kx*kx + ky*ky + kz*kz;
         real ak = EXP(k2*EXP_COEFFICIENT) / k2;
         energy += reciprocalCoefficient*ak*(sum.x*sum.x + sum.y*sum.y);
+        cosSinSum[index] = 2*reciprocalCoefficient*ak*sum;
         index += get_global_size(0);
     }
     energyBuffer[get_global_id(0)] += energy;
@@ -63,37 +65,50 @@ __kernel void calculateEwaldForces(__global real4* restrict forceBuffers, __glob
         real4 force = forceBuffers[atom];
         real4 apos = posq[atom];
 
+        // Compute the phase factors for a single step along each axis of the reciprocal lattice, and for
+        // the most negative wave vectors.  The factors for all other wave vectors are found by recursion,
+        // so the inner loop needs no sines or cosines.
+
+        real phase = apos.x*reciprocalPeriodicBoxSize.x;
+        real2 stepX = (real2) (cos(phase), sin(phase));
+        phase = apos.y*reciprocalPeriodicBoxSize.y;
+        real2 stepY = (real2) (cos(phase), sin(phase));
+        phase = apos.z*reciprocalPeriodicBoxSize.z;
+        real2 stepZ = (real2) (cos(phase), sin(phase));
+        phase = apos.y*reciprocalPeriodicBoxSize.y*(1-KMAX_Y);
+        real2 startY = (real2) (cos(phase), sin(phase));
+        phase = apos.z*reciprocalPeriodicBoxSize.z*(1-KMAX_Z);
+        real2 startZ = (real2) (cos(phase), sin(phase));
+
         // Loop over all wave vectors.
 
         int lowry = 0;
         int lowrz = 1;
+        real2 tab_x = (real2) (1, 0);
         for (int rx = 0; rx < KMAX_X; rx++) {
             real kx = rx*reciprocalPeriodicBoxSize.x;
+            real2 tab_xy = (lowry == 0 ? tab_x : multofReal2(tab_x, startY));
             for (int ry = lowry; ry < KMAX_Y; ry++) {
                 real ky = ry*reciprocalPeriodicBoxSize.y;
-                real phase = apos.x*kx;
-                real2 tab_xy = (real2) (cos(phase), sin(phase));
-                phase = apos.y*ky;
-                tab_xy = multofReal2(tab_xy, (real2) (cos(phase), sin(phase)));
+                real2 structureFactor = multofReal2(tab_xy, lowrz == 1 ? stepZ : startZ);
                 for (int rz = lowrz; rz < KMAX_Z; rz++) {
                     real kz = rz*reciprocalPeriodicBoxSize.z;
 
                     // Compute the force contribution of this wave vector.
 
                     int index = rx*(KMAX_Y*2-1)*(KMAX_Z*2-1) + (ry+KMAX_Y-1)*(KMAX_Z*2-1) + (rz+KMAX_Z-1);
-                    real k2 = kx*kx + ky*ky + kz*kz;
-                    real ak = EXP(k2*EXP_COEFFICIENT)/k2;
-                    phase = apos.z*kz;
-                    real2 structureFactor = multofReal2(tab_xy, (real2) (cos(phase), sin(phase)));
                     real2 sum = cosSinSum[index];
-                    real dEdR = 2*reciprocalCoefficient*ak*apos.w*(sum.x*structureFactor.y - sum.y*structureFactor.x);
+                    real dEdR = apos.w*(sum.x*structureFactor.y - sum.y*structureFactor.x);
                     force.x += dEdR*kx;
                     force.y += dEdR*ky;
                     force.z += dEdR*kz;
+                    structureFactor = multofReal2(structureFactor, stepZ);
                     lowrz = 1 - KMAX_Z;
                 }
+                tab_xy = multofReal2(tab_xy, stepY);
                 lowry = 1 - KMAX_Y;
             }
+            tab_x = multofReal2(tab_x, stepX);
         }
 
         // Record the force on the atom.
@@ -38,13 +38,29 @@ __kernel void findBlockBounds(int numAtoms, real4 periodicBoxSize, real4 invPeri
         rebuildNeighborList[0] = 0;
 }
 
+/**
+ * Compute how much the periodic box has been scaled along each axis since the neighbor list was built.
+ * The w component holds the smallest of the three factors.  Triclinic and non-periodic boxes are
+ * treated as unscaled, so the usual displacement test applies to them unchanged.
+ */
+real4 boxScaleFactor(real4 periodicBoxSize, real4 oldBoxSize) {
+#if defined(USE_PERIODIC) && !defined(TRICLINIC)
+    real4 scale = (real4) (periodicBoxSize.x/oldBoxSize.x, periodicBoxSize.y/oldBoxSize.y, periodicBoxSize.z/oldBoxSize.z, 0);
+    scale.w = min(scale.x, min(scale.y, scale.z));
+    return scale;
+#else
+    return (real4) (1, 1, 1, 1);
+#endif
+}
+
 /**
  * Sort the data about bounding boxes so it can be accessed more efficiently in the next kernel.
  */
 __kernel void sortBoxData(__global const real2* restrict sortedBlock, __global const real4* restrict blockCenter,
         __global const real4* restrict blockBoundingBox, __global real4* restrict sortedBlockCenter,
         __global real4* restrict sortedBlockBoundingBox, __global const real4* restrict posq, __global const real4* restrict oldPositions,
-        __global unsigned int* restrict interactionCount, __global int* restrict rebuildNeighborList, int forceRebuild) {
+        __global unsigned int* restrict interactionCount, __global int* restrict rebuildNeighborList, int forceRebuild,
+        real4 periodicBoxSize, __global const real4* restrict oldBoxSize) {
     for (int i = get_global_id(0); i < NUM_BLOCKS; i += get_global_size(0)) {
         int index = (int) sortedBlock[i].y;
         sortedBlockCenter[i] = blockCenter[index];
@@ -52,11 +68,18 @@ __kernel void sortBoxData(__global const real2* restrict sortedBlock, __global c
     }
     
     // Also check whether any atom has moved enough so that we really need to rebuild the neighbor list.
+    // If the box has been rescaled since the list was built (for example by a barostat), compare each
+    // atom to its old position scaled by the same factor, and shrink the allowed displacement by however
+    // much a compression could have brought excluded pairs closer together.
 
     bool rebuild = forceRebuild;
+    real4 scale = boxScaleFactor(periodicBoxSize, oldBoxSize[0]);
+    real maxDist = 0.5f*(PADDING-max((real) 0, 1-scale.w)*PADDED_CUTOFF);
+    if (maxDist <= 0)
+        rebuild = true;
     for (int i = get_global_id(0); i < NUM_ATOMS; i += get_global_size(0)) {
-        real4 delta = oldPositions[i]-posq[i];
-        if (delta.x*delta.x + delta.y*delta.y + delta.z*delta.z > 0.25f*PADDING*PADDING)
+        real4 delta = oldPositions[i]*scale-posq[i];
+        if (delta.x*delta.x + delta.y*delta.y + delta.z*delta.z > maxDist*maxDist)
             rebuild = true;
     }
     if (rebuild) {
@@ -164,7 +187,7 @@ __kernel void findBlocksWithInteractions(real4 periodicBoxSize, real4 invPeriodi
         __global const real4* restrict posq, unsigned int maxTiles, unsigned int startBlockIndex, unsigned int numBlocks, __global real2* restrict sortedBlocks,
         __global const real4* restrict sortedBlockCenter, __global const real4* restrict sortedBlockBoundingBox,
         __global const unsigned int* restrict exclusionIndices, __global const unsigned int* restrict exclusionRowIndices, __global real4* restrict oldPositions,
-        __global const int* restrict rebuildNeighborList) {
+        __global const int* restrict rebuildNeighborList, __global real4* restrict oldBoxSize) {
     if (rebuildNeighborList[0] == 0)
         return; // The neighbor list doesn't need to be rebuilt.
     int buffer[BUFFER_SIZE];
@@ -223,8 +246,10 @@ __kernel void findBlocksWithInteractions(real4 periodicBoxSize, real4 invPeriodi
         storeInteractionData(x, buffer, atoms, &numAtoms, valuesInBuffer, interactionCount, interactingTiles, interactingAtoms, periodicBoxSize, invPeriodicBoxSize, periodicBoxVecX, periodicBoxVecY, periodicBoxVecZ, posq, blockCenterX, blockSizeX, maxTiles, true);
     }
     
-    // Record the positions the neighbor list is based on.
+    // Record the positions and box size the neighbor list is based on.
     
     for (int i = get_global_id(0); i < NUM_ATOMS; i += get_global_size(0))
         oldPositions[i] = posq[i];
+    if (get_global_id(0) == 0)
+        oldBoxSize[0] = periodicBoxSize;
 }
@@ -1,6 +1,10 @@
 #ifdef SUPPORTS_64_BIT_ATOMICS
 #pragma OPENCL EXTENSION cl_khr_int64_base_atomics : enable
 #endif
+#ifdef ENABLE_SHUFFLE
+#pragma OPENCL EXTENSION cl_khr_subgroups : enable
+#pragma OPENCL EXTENSION cl_khr_subgroup_shuffle : enable
+#endif
 #define WARPS_PER_GROUP (FORCE_WORK_GROUP_SIZE/TILE_SIZE)
 
 typedef struct {
@@ -13,6 +17,18 @@ typedef struct {
 #endif
 } AtomData;
 
+#ifdef ENABLE_SHUFFLE
+/**
+ * Each tile is a single sub-group.  Return the value held by the next thread in the tile,
+ * wrapping around at the end.
+ */
+real4 shuffleFromNextThread(real4 value) {
+    const unsigned int srcLane = (get_sub_group_local_id()+1) & (TILE_SIZE-1);
+    return (real4) (sub_group_shuffle(value.x, srcLane), sub_group_shuffle(value.y, srcLane),
+                    sub_group_shuffle(value.z, srcLane), sub_group_shuffle(value.w, srcLane));
+}
+#endif
+
 /**
  * Compute nonbonded interactions.
  */
@@ -119,11 +135,19 @@ __kernel void computeNonbonded(
             SYNC_WARPS;
 #ifdef USE_EXCLUSIONS
             excl = (excl >> tgx) | (excl << (TILE_SIZE - tgx));
+#endif
+#ifdef ENABLE_SHUFFLE
+            real4 shflPosq = tempPosq;
+            real4 shflForce = (real4) 0;
 #endif
             unsigned int tj = tgx;
             for (j = 0; j < TILE_SIZE; j++) {
                 int atom2 = tbx+tj;
+#ifdef ENABLE_SHUFFLE
+                real4 posq2 = shflPosq;
+#else
                 real4 posq2 = (real4) (localData[atom2].x, localData[atom2].y, localData[atom2].z, localData[atom2].q);
+#endif
                 real4 delta = (real4) (posq2.xyz - posq1.xyz, 0);
 #ifdef USE_PERIODIC
                 APPLY_PERIODIC_TO_DELTA(delta)
@@ -153,16 +177,24 @@ __kernel void computeNonbonded(
 #ifdef USE_SYMMETRIC
                     delta.xyz *= dEdR;
                     force.xyz -= delta.xyz;
+#ifdef ENABLE_SHUFFLE
+                    shflForce.xyz += delta.xyz;
+#else
                     localData[tbx+tj].fx += delta.x;
                     localData[tbx+tj].fy += delta.y;
                     localData[tbx+tj].fz += delta.z;
+#endif
 #else
                     force.xyz -= dEdR1.xyz;
+#ifdef ENABLE_SHUFFLE
+                    shflForce.xyz += dEdR2.xyz;
+#else
                     localData[tbx+tj].fx += dEdR2.x;
                     localData[tbx+tj].fy += dEdR2.y;
                     localData[tbx+tj].fz += dEdR2.z;
 #endif
 #endif
+#endif
 #ifdef PRUNE_BY_CUTOFF
                 }
 #endif
@@ -170,8 +202,18 @@ __kernel void computeNonbonded(
                 excl >>= 1;
 #endif
                 tj = (tj + 1) & (TILE_SIZE - 1);
+#ifdef ENABLE_SHUFFLE
+                shflPosq = shuffleFromNextThread(shflPosq);
+                shflForce = shuffleFromNextThread(shflForce);
+#else
                 SYNC_WARPS;
+#endif
             }
+#ifdef ENABLE_SHUFFLE
+            localData[localAtomIndex].fx = shflForce.x;
+            localData[localAtomIndex].fy = shflForce.y;
+            localData[localAtomIndex].fz = shflForce.z;
+#endif
         }
 
         // Write results.
@@ -300,10 +342,18 @@ __kernel void computeNonbonded(
                 APPLY_PERIODIC_TO_POS_WITH_CENTER(posq1, blockCenterX)
                 APPLY_PERIODIC_TO_POS_WITH_CENTER(localData[localAtomIndex], blockCenterX)
                 SYNC_WARPS;
+#ifdef ENABLE_SHUFFLE
+                real4 shflPosq = (real4) (localData[localAtomIndex].x, localData[localAtomIndex].y, localData[localAtomIndex].z, localData[localAtomIndex].q);
+                real4 shflForce = (real4) 0;
+#endif
                 unsigned int tj = tgx;
                 for (j = 0; j < TILE_SIZE; j++) {
                     int atom2 = tbx+tj;
+#ifdef ENABLE_SHUFFLE
+                    real4 posq2 = shflPosq;
+#else
                     real4 posq2 = (real4) (localData[atom2].x, localData[atom2].y, localData[atom2].z, localData[atom2].q);
+#endif
                     real4 delta = (real4) (posq2.xyz - posq1.xyz, 0);
                     real r2 = delta.x*delta.x + delta.y*delta.y + delta.z*delta.z;
 #ifdef PRUNE_BY_CUTOFF
@@ -330,32 +380,58 @@ __kernel void computeNonbonded(
 #ifdef USE_SYMMETRIC
                         delta.xyz *= dEdR;
                         force.xyz -= delta.xyz;
+#ifdef ENABLE_SHUFFLE
+                        shflForce.xyz += delta.xyz;
+#else
                         localData[tbx+tj].fx += delta.x;
                         localData[tbx+tj].fy += delta.y;
                         localData[tbx+tj].fz += delta.z;
+#endif
 #else
                         force.xyz -= dEdR1.xyz;
+#ifdef ENABLE_SHUFFLE
+                        shflForce.xyz += dEdR2.xyz;
+#else
                         localData[tbx+tj].fx += dEdR2.x;
                         localData[tbx+tj].fy += dEdR2.y;
                         localData[tbx+tj].fz += dEdR2.z;
 #endif
 #endif
+#endif
 #ifdef PRUNE_BY_CUTOFF
                     }
 #endif
                     tj = (tj + 1) & (TILE_SIZE - 1);
+#ifdef ENABLE_SHUFFLE
+                    shflPosq = shuffleFromNextThread(shflPosq);
+                    shflForce = shuffleFromNextThread(shflForce);
+#else
                     SYNC_WARPS;
+#endif
                 }
+#ifdef ENABLE_SHUFFLE
+                localData[localAtomIndex].fx = shflForce.x;
+                localData[localAtomIndex].fy = shflForce.y;
+                localData[localAtomIndex].fz = shflForce.z;
+#endif
             }
             else
 #endif
             {
                 // We need to apply periodic boundary conditions separately for each interaction.
 
+#ifdef ENABLE_SHUFFLE
+                real4 shflPosq = (real4) (localData[localAtomIndex].x, localData[localAtomIndex].y, localData[localAtomIndex].z, localData[localAtomIndex].q);
+                real4 shflForce = (real4) 0;
+#endif
                 unsigned int tj = tgx;
                 for (j = 0; j < TILE_SIZE; j++) {
                     int atom2 = tbx+tj;
+#ifdef ENABLE_SHUFFLE
+                    real4 posq2 = shflPosq;
+#else
                     real4 posq2 = (real4) (localData[atom2].x, localData[atom2].y, localData[atom2].z, localData[atom2].q);
+#endif
                     real4 delta = (real4) (posq2.xyz - posq1.xyz, 0);
 #ifdef USE_PERIODIC
                     APPLY_PERIODIC_TO_DELTA(delta)
@@ -385,22 +461,40 @@ __kernel void computeNonbonded(
 #ifdef USE_SYMMETRIC
                         delta.xyz *= dEdR;
                         force.xyz -= delta.xyz;
+#ifdef ENABLE_SHUFFLE
+                        shflForce.xyz += delta.xyz;
+#else
                         localData[tbx+tj].fx += delta.x;
                         localData[tbx+tj].fy += delta.y;
                         localData[tbx+tj].fz += delta.z;
+#endif
 #else
                         force.xyz -= dEdR1.xyz;
+#ifdef ENABLE_SHUFFLE
+                        shflForce.xyz += dEdR2.xyz;
+#else
                         localData[tbx+tj].fx += dEdR2.x;
                         localData[tbx+tj].fy += dEdR2.y;
                         localData[tbx+tj].fz += dEdR2.z;
 #endif
 #endif
+#endif
 #ifdef PRUNE_BY_CUTOFF
                     }
 #endif
                     tj = (tj + 1) & (TILE_SIZE - 1);
+#ifdef ENABLE_SHUFFLE
+                    shflPosq = shuffleFromNextThread(shflPosq);
+                    shflForce = shuffleFromNextThread(shflForce);
+#else
                     SYNC_WARPS;
+#endif
                 }
+#ifdef ENABLE_SHUFFLE
+                localData[localAtomIndex].fx = shflForce.x;
+                localData[localAtomIndex].fy = shflForce.y;
+                localData[localAtomIndex].fz = shflForce.z;
+#endif
             }
 
             // Write results.
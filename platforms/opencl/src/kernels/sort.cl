@@ -72,17 +72,17 @@ __kernel void sortShortList2(__global const DATA_TYPE* restrict dataIn, __global
 }
 
 /**
- * Calculate the minimum and maximum value in the array to be sorted.  This kernel
- * is executed as a single work group.
+ * Calculate the minimum and maximum value in a subset of the array to be sorted.  Each
+ * work group processes a different subset and records the range it found.
  */
-__kernel void computeRange(__global const DATA_TYPE* restrict data, uint length, __global KEY_TYPE* restrict range, __local KEY_TYPE* restrict minBuffer,
-        __local KEY_TYPE* restrict maxBuffer, uint numBuckets, __global uint* restrict bucketOffset) {
+__kernel void computeBlockRange(__global const DATA_TYPE* restrict data, uint length, __global KEY_TYPE* restrict blockRange, __local KEY_TYPE* restrict minBuffer,
+        __local KEY_TYPE* restrict maxBuffer) {
     KEY_TYPE minimum = MAX_KEY;
     KEY_TYPE maximum = MIN_KEY;
 
     // Each thread calculates the range of a subset of values.
 
-    for (uint index = get_local_id(0); index < length; index += get_local_size(0)) {
+    for (uint index = get_global_id(0); index < length; index += get_global_size(0)) {
         KEY_TYPE value = getValue(data[index]);
         minimum = min(minimum, value);
         maximum = max(maximum, value);
@@ -90,6 +90,40 @@ __kernel void computeRange(__global const DATA_TYPE* restrict data, uint length,
 
     // Now reduce them.
 
+    minBuffer[get_local_id(0)] = minimum;
+    maxBuffer[get_local_id(0)] = maximum;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (uint step = 1; step < get_local_size(0); step *= 2) {
+        if (get_local_id(0)+step < get_local_size(0) && get_local_id(0)%(2*step) == 0) {
+            minBuffer[get_local_id(0)] = min(minBuffer[get_local_id(0)], minBuffer[get_local_id(0)+step]);
+            maxBuffer[get_local_id(0)] = max(maxBuffer[get_local_id(0)], maxBuffer[get_local_id(0)+step]);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    if (get_local_id(0) == 0) {
+        blockRange[2*get_group_id(0)] = minBuffer[0];
+        blockRange[2*get_group_id(0)+1] = maxBuffer[0];
+    }
+}
+
+/**
+ * Combine the ranges found by computeBlockRange() to get the minimum and maximum value in
+ * the whole array.  This kernel is executed as a single work group.
+ */
+__kernel void computeRange(__global const KEY_TYPE* restrict blockRange, uint numBlocks, __global KEY_TYPE* restrict range, __local KEY_TYPE* restrict minBuffer,
+        __local KEY_TYPE* restrict maxBuffer, uint numBuckets, __global uint* restrict bucketOffset) {
+    KEY_TYPE minimum = MAX_KEY;
+    KEY_TYPE maximum = MIN_KEY;
+
+    // Each thread combines the ranges from a subset of work groups.
+
+    for (uint index = get_local_id(0); index < numBlocks; index += get_local_size(0)) {
+        minimum = min(minimum, blockRange[2*index]);
+        maximum = max(maximum, blockRange[2*index+1]);
+    }
+
+    // Now reduce them.
+
     minBuffer[get_local_id(0)] = minimum;
     maxBuffer[get_local_id(0)] = maximum;
     barrier(CLK_LOCAL_MEM_FENCE);
@@ -32,5 +32,71 @@
 #include "OpenCLTests.h"
 #include "TestVerletIntegrator.h"
 
+void testLincs() {
+    // Simulate a set of branched molecules with the LINCS constraint algorithm.
+
+    const int numMolecules = 4;
+    const int numParticles = 5*numMolecules;
+    System system;
+    VerletIntegrator integrator(0.001);
+    NonbondedForce* forceField = new NonbondedForce();
+    for (int i = 0; i < numMolecules; i++) {
+        int first = 5*i;
+        system.addParticle(12.0);
+        forceField->addParticle(0.2, 0.5, 1.0);
+        for (int j = 1; j < 5; j++) {
+            system.addParticle(j == 4 ? 12.0 : 1.0);
+            forceField->addParticle(-0.05, 0.5, 1.0);
+        }
+        system.addConstraint(first, first+1, 0.1);
+        system.addConstraint(first, first+2, 0.1);
+        system.addConstraint(first, first+3, 0.1);
+        system.addConstraint(first, first+4, 0.15);
+    }
+    system.addForce(forceField);
+    map<string, string> properties;
+    properties[OpenCLPlatform::OpenCLConstraintAlgorithm()] = "LINCS";
+    Context context(system, integrator, platform, properties);
+    ASSERT_EQUAL("LINCS", platform.getPropertyValue(context, OpenCLPlatform::OpenCLConstraintAlgorithm()));
+    vector<Vec3> positions(numParticles);
+    vector<Vec3> velocities(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numMolecules; i++) {
+        Vec3 center(i, 0.5*(i%2), 0);
+        positions[5*i] = center;
+        positions[5*i+1] = center+Vec3(0.1, 0, 0);
+        positions[5*i+2] = center+Vec3(0, 0.1, 0);
+        positions[5*i+3] = center+Vec3(0, 0, 0.1);
+        positions[5*i+4] = center+Vec3(-0.15, 0, 0);
+    }
+    for (int i = 0; i < numParticles; i++)
+        velocities[i] = Vec3(genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5);
+    context.setPositions(positions);
+    context.setVelocities(velocities);
+    context.applyConstraints(1e-5);
+
+    // Simulate it and see whether the constraints remain satisfied and energy is conserved.
+
+    double initialEnergy = 0.0;
+    for (int i = 0; i < 1000; i++) {
+        State state = context.getState(State::Positions | State::Energy);
+        for (int j = 0; j < system.getNumConstraints(); j++) {
+            int particle1, particle2;
+            double distance;
+            system.getConstraintParameters(j, particle1, particle2, distance);
+            Vec3 delta = state.getPositions()[particle1]-state.getPositions()[particle2];
+            ASSERT_EQUAL_TOL(distance, sqrt(delta.dot(delta)), 1e-3);
+        }
+        double energy = state.getPotentialEnergy()+state.getKineticEnergy();
+        if (i == 1)
+            initialEnergy = energy;
+        else if (i > 1)
+            ASSERT_EQUAL_TOL(initialEnergy, energy, 0.05);
+        integrator.step(1);
+    }
+}
+
 void runPlatformTests() {
+    testLincs();
 }
@@ -26,6 +26,7 @@
 #define __ReferenceCCMAAlgorithm_H__
 
 #include "ReferenceConstraintAlgorithm.h"
+#include "openmm/internal/ThreadPool.h"
 #include <utility>
 #include <vector>
 #include <set>
@@ -49,6 +50,9 @@ protected:
     double* _reducedMasses;
     bool _hasInitializedMasses;
     std::vector<std::vector<std::pair<int, double> > > _matrix;
+    std::vector<int> _constrainedAtoms;
+    std::vector<std::vector<int> > _atomConstraints;
+    OpenMM::ThreadPool* _threads;
 
 private:
 
@@ -88,6 +92,12 @@ public:
      */
     void setMaximumNumberOfIterations(int maximumNumberOfIterations);
 
+    /**
+     * Set a ThreadPool to use for applying constraints.  If this is NULL (the default), they
+     * are applied on a single thread.  The results are identical either way.
+     */
+    void setThreadPool(OpenMM::ThreadPool* threads);
+
     /**
      * Apply the constraint algorithm.
      * 
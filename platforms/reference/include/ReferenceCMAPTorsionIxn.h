@@ -31,7 +31,7 @@
 
 namespace OpenMM {
 
-class ReferenceCMAPTorsionIxn : public ReferenceBondIxn {
+class OPENMM_EXPORT ReferenceCMAPTorsionIxn : public ReferenceBondIxn {
 
 private:
 
@@ -45,14 +45,15 @@ private:
 
        Calculate the interaction due to a single torsion pair
 
-       @param index            the index of the torsion
+       @param map              the index of the map to use
+       @param atoms            the indices of the eight atoms forming the two torsions
        @param atomCoordinates  atom coordinates
        @param forces           force array (forces added)
        @param totalEnergy      total energy
 
          --------------------------------------------------------------------------------------- */
 
-    void calculateOneIxn(int index, std::vector<OpenMM::Vec3>& atomCoordinates, std::vector<OpenMM::Vec3>& forces,
+    void calculateOneIxn(int map, const std::vector<int>& atoms, std::vector<OpenMM::Vec3>& atomCoordinates, std::vector<OpenMM::Vec3>& forces,
                          double* totalEnergy) const;
 
 public:
@@ -91,7 +92,15 @@ public:
 
     /**---------------------------------------------------------------------------------------
 
-       This is present only because we must define it to subclass ReferenceBondIxn.  It is never called.
+       Calculate the interaction due to a single torsion pair.  This allows the torsions to be
+       processed in parallel by code that works with any ReferenceBondIxn.
+
+       @param atomIndices      the indices of the eight atoms forming the two torsions
+       @param atomCoordinates  atom coordinates
+       @param parameters       parameters[0] is the index of the map to use
+       @param forces           force array (forces added)
+       @param totalEnergy      total energy
+       @param energyParamDerivs  ignored, since CMAPTorsionForce has no global parameters
 
        --------------------------------------------------------------------------------------- */
 
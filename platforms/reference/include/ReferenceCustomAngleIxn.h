@@ -29,7 +29,7 @@
 
 namespace OpenMM {
 
-class ReferenceCustomAngleIxn : public ReferenceBondIxn {
+class OPENMM_EXPORT ReferenceCustomAngleIxn : public ReferenceBondIxn {
 
    private:
       Lepton::CompiledExpression energyExpression;
@@ -71,6 +71,21 @@ public:
    void calculateIxn(ContextImpl& innerContext, std::vector<OpenMM::Vec3>& atomCoordinates,
                      const std::map<std::string, double>& globalParameters,
                      std::vector<OpenMM::Vec3>& forces, double* totalEnergy, std::map<std::string, double>& energyParamDerivs) const;
+
+    /**
+     * Calculate the interaction from collective variables that have already been evaluated.
+     * 
+     * @param cvValues           the value of each collective variable
+     * @param cvForces           the forces computed by each collective variable, or NULL if forces should not be computed
+     * @param cvDerivs           the energy parameter derivatives computed by each collective variable
+     * @param globalParameters   the values of global parameters
+     * @param forces             the forces are added to this
+     * @param totalEnergy        the energy is added to this
+     * @param energyParamDerivs  parameter derivatives are added to this
+     */
+   void calculateIxn(const std::vector<double>& cvValues, const std::vector<std::vector<OpenMM::Vec3> >* cvForces,
+                     const std::vector<std::map<std::string, double> >& cvDerivs, const std::map<std::string, double>& globalParameters,
+                     std::vector<OpenMM::Vec3>& forces, double* totalEnergy, std::map<std::string, double>& energyParamDerivs) const;
 };
 
 } // namespace OpenMM
@@ -139,9 +139,9 @@ class ReferenceCustomCompoundBondIxn::ParticleTermInfo {
 public:
     std::string name;
     int atom, component, index;
-    Lepton::CompiledExpression forceExpression;
-    ParticleTermInfo(const std::string& name, int atom, int component, const Lepton::CompiledExpression& forceExpression) :
-            name(name), atom(atom), component(component), forceExpression(forceExpression) {
+    int forceIndex;
+    ParticleTermInfo(const std::string& name, int atom, int component, int forceIndex) :
+            name(name), atom(atom), component(component), forceIndex(forceIndex) {
     }
 };
 
@@ -149,10 +149,10 @@ class ReferenceCustomCompoundBondIxn::DistanceTermInfo {
 public:
     std::string name;
     int p1, p2, index;
-    Lepton::CompiledExpression forceExpression;
+    int forceIndex;
     mutable double delta[ReferenceForce::LastDeltaRIndex];
-    DistanceTermInfo(const std::string& name, const std::vector<int>& atoms, const Lepton::CompiledExpression& forceExpression) :
-            name(name), p1(atoms[0]), p2(atoms[1]), forceExpression(forceExpression) {
+    DistanceTermInfo(const std::string& name, const std::vector<int>& atoms, int forceIndex) :
+            name(name), p1(atoms[0]), p2(atoms[1]), forceIndex(forceIndex) {
     }
 };
 
@@ -160,11 +160,11 @@ class ReferenceCustomCompoundBondIxn::AngleTermInfo {
 public:
     std::string name;
     int p1, p2, p3, index;
-    Lepton::CompiledExpression forceExpression;
+    int forceIndex;
     mutable double delta1[ReferenceForce::LastDeltaRIndex];
     mutable double delta2[ReferenceForce::LastDeltaRIndex];
-    AngleTermInfo(const std::string& name, const std::vector<int>& atoms, const Lepton::CompiledExpression& forceExpression) :
-            name(name), p1(atoms[0]), p2(atoms[1]), p3(atoms[2]), forceExpression(forceExpression) {
+    AngleTermInfo(const std::string& name, const std::vector<int>& atoms, int forceIndex) :
+            name(name), p1(atoms[0]), p2(atoms[1]), p3(atoms[2]), forceIndex(forceIndex) {
     }
 };
 
@@ -172,14 +172,14 @@ class ReferenceCustomCompoundBondIxn::DihedralTermInfo {
 public:
     std::string name;
     int p1, p2, p3, p4, index;
-    Lepton::CompiledExpression forceExpression;
+    int forceIndex;
     mutable double delta1[ReferenceForce::LastDeltaRIndex];
     mutable double delta2[ReferenceForce::LastDeltaRIndex];
     mutable double delta3[ReferenceForce::LastDeltaRIndex];
     mutable double cross1[3];
     mutable double cross2[3];
-    DihedralTermInfo(const std::string& name, const std::vector<int>& atoms, const Lepton::CompiledExpression& forceExpression) :
-            name(name), p1(atoms[0]), p2(atoms[1]), p3(atoms[2]), p4(atoms[3]), forceExpression(forceExpression) {
+    DihedralTermInfo(const std::string& name, const std::vector<int>& atoms, int forceIndex) :
+            name(name), p1(atoms[0]), p2(atoms[1]), p3(atoms[2]), p4(atoms[3]), forceIndex(forceIndex) {
     }
 };
 
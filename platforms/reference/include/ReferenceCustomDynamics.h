@@ -39,8 +39,8 @@
 
 namespace OpenMM {
 
-class ReferenceCustomDynamics : public ReferenceDynamics {
-private:
+class OPENMM_EXPORT ReferenceCustomDynamics : public ReferenceDynamics {
+protected:
 
     class DerivFunction;
     const OpenMM::CustomIntegrator& integrator;
@@ -62,11 +62,11 @@ private:
     std::vector<int> perDofVariableIndex, stepVariableIndex;
     std::vector<double> perDofVariable;
 
-    void initialize(OpenMM::ContextImpl& context, std::vector<double>& masses, std::map<std::string, double>& globals);
+    virtual void initialize(OpenMM::ContextImpl& context, std::vector<double>& masses, std::map<std::string, double>& globals);
     
     Lepton::ExpressionTreeNode replaceDerivFunctions(const Lepton::ExpressionTreeNode& node, OpenMM::ContextImpl& context);
     
-    void computePerDof(int numberOfAtoms, std::vector<OpenMM::Vec3>& results, const std::vector<OpenMM::Vec3>& atomCoordinates,
+    virtual void computePerDof(int numberOfAtoms, std::vector<OpenMM::Vec3>& results, const std::vector<OpenMM::Vec3>& atomCoordinates,
                   const std::vector<OpenMM::Vec3>& velocities, const std::vector<OpenMM::Vec3>& forces, const std::vector<double>& masses,
                   const std::vector<std::vector<OpenMM::Vec3> >& perDof, const Lepton::CompiledExpression& expression);
     
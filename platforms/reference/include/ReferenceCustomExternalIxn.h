@@ -28,10 +28,12 @@
 #include "ReferenceCustomExternalIxn.h"
 #include "openmm/Vec3.h"
 #include "lepton/CompiledExpression.h"
+#include "lepton/CustomFunction.h"
+#include "openmm/internal/windowsExport.h"
 
 namespace OpenMM {
 
-class ReferenceCustomExternalIxn {
+class OPENMM_EXPORT ReferenceCustomExternalIxn {
 
    private:
       Lepton::CompiledExpression energyExpression;
@@ -50,6 +52,8 @@ class ReferenceCustomExternalIxn {
 
    public:
 
+      class PeriodicDistanceFunction;
+
       /**---------------------------------------------------------------------------------------
 
          Constructor
@@ -94,6 +98,19 @@ class ReferenceCustomExternalIxn {
 
 };
 
+/**
+ * This is the implementation of the periodicdistance() function that may appear in the energy expression.
+ */
+class OPENMM_EXPORT ReferenceCustomExternalIxn::PeriodicDistanceFunction : public Lepton::CustomFunction {
+public:
+    Vec3** boxVectorHandle;
+    PeriodicDistanceFunction(Vec3** boxVectorHandle);
+    int getNumArguments() const;
+    double evaluate(const double* arguments) const;
+    double evaluateDerivative(const double* arguments, const int* derivOrder) const;
+    Lepton::CustomFunction* clone() const;
+};
+
 } // namespace OpenMM
 
 #endif // _ReferenceCustomBondIxn___
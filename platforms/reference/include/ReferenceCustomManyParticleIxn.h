@@ -60,7 +60,7 @@ class ReferenceCustomManyParticleIxn {
 
       void loopOverInteractions(std::vector<int>& particles, int loopIndex, std::vector<OpenMM::Vec3>& atomCoordinates,
                                 std::vector<std::vector<double> >& particleParameters, std::map<std::string, double>& variables,
-                                std::vector<OpenMM::Vec3>& forces, double* totalEnergy) const;
+                                std::vector<OpenMM::Vec3>& forces, double* totalEnergy, const std::vector<std::vector<int> >* neighbors) const;
 
       /**---------------------------------------------------------------------------------------
 
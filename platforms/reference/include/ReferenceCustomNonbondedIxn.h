@@ -28,7 +28,9 @@
 #include "ReferencePairIxn.h"
 #include "ReferenceNeighborList.h"
 #include "openmm/internal/CompiledExpressionSet.h"
+#include "openmm/internal/ThreadPool.h"
 #include <map>
+#include <memory>
 #include <set>
 #include <utility>
 #include <vector>
@@ -53,6 +55,15 @@ class ReferenceCustomNonbondedIxn {
       std::vector<int> particleParamIndex;
       int rIndex;
       std::vector<std::pair<std::set<int>, std::set<int> > > interactionGroups;
+      OpenMM::ThreadPool* threads;
+      std::vector<std::unique_ptr<ReferenceCustomNonbondedIxn> > threadIxns;
+
+      struct PairResult {
+          bool include;
+          double force[3];
+          double energy;
+          std::vector<double> energyParamDerivs;
+      };
 
       /**---------------------------------------------------------------------------------------
 
@@ -61,13 +72,29 @@ class ReferenceCustomNonbondedIxn {
          @param atom1            the index of the first atom
          @param atom2            the index of the second atom
          @param atomCoordinates  atom coordinates
+         @param atomParameters   atom parameters                             atomParameters[atomIndex][paramterIndex]
+         @param result           on exit, the force on atom1 and the contributions to the energy and
+                                 its derivatives.  result.include is false if the atoms are beyond the cutoff.
+
+         --------------------------------------------------------------------------------------- */
+
+      void calculateOneIxn(int atom1, int atom2, const std::vector<OpenMM::Vec3>& atomCoordinates,
+                           const std::vector<std::vector<double> >& atomParameters, PairResult& result);
+
+      /**---------------------------------------------------------------------------------------
+
+         Add the result computed by calculateOneIxn() to the forces and energy
+
+         @param atom1            the index of the first atom
+         @param atom2            the index of the second atom
+         @param result           the result of calculateOneIxn()
          @param forces           force array (forces added)
          @param totalEnergy      total energy
 
          --------------------------------------------------------------------------------------- */
 
-      void calculateOneIxn(int atom1, int atom2, std::vector<OpenMM::Vec3>& atomCoordinates, std::vector<OpenMM::Vec3>& forces,
-                           double* totalEnergy, double* energyParamDerivs);
+      void accumulateOneIxn(int atom1, int atom2, const PairResult& result, std::vector<OpenMM::Vec3>& forces,
+                            double* totalEnergy, double* energyParamDerivs) const;
 
 
    public:
@@ -133,6 +160,17 @@ class ReferenceCustomNonbondedIxn {
 
       void setPeriodic(OpenMM::Vec3* vectors);
 
+      /**---------------------------------------------------------------------------------------
+
+         Set the ThreadPool to use for evaluating pair interactions.  The results are identical
+         for any number of threads.  Interaction groups are always evaluated serially.
+
+         @param pool   the ThreadPool to use, or NULL to evaluate them serially
+
+         --------------------------------------------------------------------------------------- */
+
+      void setThreadPool(OpenMM::ThreadPool* pool);
+
       /**---------------------------------------------------------------------------------------
 
          Calculate custom pair ixn
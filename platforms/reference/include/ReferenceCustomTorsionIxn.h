@@ -29,7 +29,7 @@
 
 namespace OpenMM {
 
-class ReferenceCustomTorsionIxn : public ReferenceBondIxn {
+class OPENMM_EXPORT ReferenceCustomTorsionIxn : public ReferenceBondIxn {
 
    private:
       Lepton::CompiledExpression energyExpression;
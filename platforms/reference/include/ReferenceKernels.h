@@ -34,6 +34,7 @@
 
 #include "ReferencePlatform.h"
 #include "openmm/kernels.h"
+#include "openmm/internal/CustomNonbondedForceImpl.h"
 #include "SimTKOpenMMRealType.h"
 #include "ReferenceNeighborList.h"
 #include "lepton/CompiledExpression.h"
@@ -161,6 +162,21 @@ public:
      * @param velocities  a vector containg the particle velocities
      */
     void setVelocities(ContextImpl& context, const std::vector<Vec3>& velocities);
+    /**
+     * Begin copying the positions and/or velocities of all particles so they can be retrieved later
+     * by finishStateCopy().
+     *
+     * @param positions   whether to copy the positions
+     * @param velocities  whether to copy the velocities
+     */
+    void beginStateCopy(ContextImpl& context, bool positions, bool velocities);
+    /**
+     * Wait for the copy started by beginStateCopy() to complete and retrieve the data.
+     *
+     * @param positions   on exit, this contains the particle positions, or is empty if they were not copied
+     * @param velocities  on exit, this contains the particle velocities, or is empty if they were not copied
+     */
+    void finishStateCopy(ContextImpl& context, std::vector<Vec3>& positions, std::vector<Vec3>& velocities);
     /**
      * Get the current forces on all particles.
      *
@@ -203,6 +219,7 @@ public:
     void loadCheckpoint(ContextImpl& context, std::istream& stream);
 private:
     ReferencePlatform::PlatformData& data;
+    std::vector<Vec3> copiedPositions, copiedVelocities;
 };
 
 /**
@@ -630,7 +647,7 @@ private:
     std::vector<std::array<double, 3> > baseParticleParams, baseExceptionParams;
     std::map<std::pair<std::string, int>, std::array<double, 3> > particleParamOffsets, exceptionParamOffsets;
     double nonbondedCutoff, switchingDistance, rfDielectric, ewaldAlpha, ewaldDispersionAlpha, dispersionCoefficient;
-    int kmax[3], gridSize[3], dispersionGridSize[3];
+    int kmax[3], gridSize[3], dispersionGridSize[3], pmeOrder;
     bool useSwitchingFunction, exceptionsArePeriodic;
     std::vector<std::set<int> > exclusions;
     NonbondedMethod nonbondedMethod;
@@ -674,6 +691,7 @@ private:
     double nonbondedCutoff, switchingDistance, periodicBoxSize[3], longRangeCoefficient;
     bool useSwitchingFunction, hasInitializedLongRangeCorrection;
     CustomNonbondedForce* forceCopy;
+    CustomNonbondedForceImpl::LongRangeCorrectionData longRangeCorrectionData;
     std::map<std::string, double> globalParamValues;
     std::vector<std::set<int> > exclusions;
     Lepton::CompiledExpression energyExpression, forceExpression;
@@ -806,7 +824,6 @@ public:
      */
     void copyParametersToContext(ContextImpl& context, const CustomExternalForce& force);
 private:
-    class PeriodicDistanceFunction;
     int numParticles;
     ReferenceCustomExternalIxn* ixn;
     std::vector<int> particles;
@@ -816,16 +833,6 @@ private:
     Vec3* boxVectors;
 };
 
-class ReferenceCalcCustomExternalForceKernel::PeriodicDistanceFunction : public Lepton::CustomFunction {
-public:
-    Vec3** boxVectorHandle;
-    PeriodicDistanceFunction(Vec3** boxVectorHandle);
-    int getNumArguments() const;
-    double evaluate(const double* arguments) const;
-    double evaluateDerivative(const double* arguments, const int* derivOrder) const;
-    Lepton::CustomFunction* clone() const;
-};
-
 /**
  * This kernel is invoked by CustomHbondForce to calculate the forces acting on the system.
  */
@@ -1035,6 +1042,14 @@ public:
      * @param innerContext   the context created by the CustomCVForce for computing collective variables
      */
     void initialize(const System& system, const CustomCVForce& force, ContextImpl& innerContext);
+    /**
+     * Initialize the kernel for a force whose collective variables are evaluated directly in the
+     * context it belongs to, rather than in an inner context.
+     *
+     * @param system     the System this kernel will be applied to
+     * @param force      the CustomCVForce this kernel will be used for
+     */
+    void initialize(const System& system, const CustomCVForce& force);
     /**
      * Execute the kernel to calculate the forces and/or energy.
      *
@@ -1045,6 +1060,26 @@ public:
      * @return the potential energy due to the force
      */
     double execute(ContextImpl& context, ContextImpl& innerContext, bool includeForces, bool includeEnergy);
+    /**
+     * Execute the kernel to calculate the forces and/or energy, given collective variables that were
+     * evaluated directly in the context.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param values         the values of the collective variables
+     * @param paramDerivs    the derivatives of each collective variable with respect to global parameters
+     * @param includeForces  true if forces should be calculated
+     * @param includeEnergy  true if the energy should be calculated
+     * @return the potential energy due to the force
+     */
+    double execute(ContextImpl& context, const std::vector<double>& values, const std::vector<std::map<std::string, double> >& paramDerivs, bool includeForces, bool includeEnergy);
+    /**
+     * Save the forces currently stored in the context as the forces for one collective variable.  This
+     * is called just after the variable's force group has been evaluated on its own.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param index          the index of the collective variable
+     */
+    void copyVariableForces(ContextImpl& context, int index);
     /**
      * Copy state information to the inner context.
      *
@@ -1062,6 +1097,7 @@ public:
 private:
     ReferenceCustomCVForce* ixn;
     std::vector<std::string> globalParameterNames, energyParamDerivNames;
+    std::vector<std::vector<Vec3> > cvForces;
 };
 
 /**
@@ -1311,6 +1347,61 @@ private:
     double prevTemp, prevFriction, prevStepSize;
 };
 
+/**
+ * This kernel is invoked by MTSLangevinIntegrator to take one time step.
+ */
+class ReferenceIntegrateMTSLangevinStepKernel : public IntegrateMTSLangevinStepKernel {
+public:
+    ReferenceIntegrateMTSLangevinStepKernel(std::string name, const Platform& platform, ReferencePlatform::PlatformData& data) : IntegrateMTSLangevinStepKernel(name, platform),
+        data(data) {
+    }
+    /**
+     * Initialize the kernel, setting up the particle masses.
+     * 
+     * @param system     the System this kernel will be applied to
+     * @param integrator the MTSLangevinIntegrator this kernel will be used for
+     */
+    void initialize(const System& system, const MTSLangevinIntegrator& integrator);
+    /**
+     * Update the velocities based on the forces currently stored in the context, then apply
+     * velocity constraints.
+     * 
+     * @param context    the context in which to execute this kernel
+     * @param integrator the MTSLangevinIntegrator this kernel is being used for
+     * @param dt         the time interval over which to apply the forces
+     */
+    void kick(ContextImpl& context, const MTSLangevinIntegrator& integrator, double dt);
+    /**
+     * Perform the innermost substep: a position half step, interaction with the heat bath,
+     * and another position half step, followed by applying constraints.
+     * 
+     * @param context    the context in which to execute this kernel
+     * @param integrator the MTSLangevinIntegrator this kernel is being used for
+     * @param dt         the size of the innermost substep
+     */
+    void drift(ContextImpl& context, const MTSLangevinIntegrator& integrator, double dt);
+    /**
+     * Finish a time step after all substeps have been performed.
+     * 
+     * @param context        the context in which to execute this kernel
+     * @param integrator     the MTSLangevinIntegrator this kernel is being used for
+     * @param forcesAreValid this will be set to false if the forces currently stored in the
+     *                       context can no longer be used
+     */
+    void finishStep(ContextImpl& context, const MTSLangevinIntegrator& integrator, bool& forcesAreValid);
+    /**
+     * Compute the kinetic energy.
+     * 
+     * @param context    the context in which to execute this kernel
+     * @param integrator the MTSLangevinIntegrator this kernel is being used for
+     */
+    double computeKineticEnergy(ContextImpl& context, const MTSLangevinIntegrator& integrator);
+private:
+    ReferencePlatform::PlatformData& data;
+    std::vector<double> masses, inverseMasses;
+    std::vector<Vec3> xPrime, oldx;
+};
+
 /**
  * This kernel is invoked by BrownianIntegrator to take one time step.
  */
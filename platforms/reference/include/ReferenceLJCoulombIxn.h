@@ -27,6 +27,7 @@
 
 #include "ReferencePairIxn.h"
 #include "ReferenceNeighborList.h"
+#include "openmm/internal/ThreadPool.h"
 
 namespace OpenMM {
 
@@ -40,12 +41,14 @@ class ReferenceLJCoulombIxn {
       bool ewald;
       bool pme, ljpme;
       const OpenMM::NeighborList* neighborList;
+      OpenMM::ThreadPool* threads;
       OpenMM::Vec3 periodicBoxVectors[3];
       double cutoffDistance, switchingDistance;
       double krf, crf;
       double alphaEwald, alphaDispersionEwald;
       int numRx, numRy, numRz;
       int meshDim[3], dispersionMeshDim[3];
+      int pmeOrder, dispersionPmeOrder;
 
       // parameter indices
 
@@ -61,14 +64,14 @@ class ReferenceLJCoulombIxn {
          @param atom2            the index of the second atom
          @param atomCoordinates  atom coordinates
          @param atomParameters   atom parameters (charges, c6, c12, ...)     atomParameters[atomIndex][paramterIndex]
-         @param forces           force array (forces added)
-         @param totalEnergy      total energy
+         @param force            on exit, the force on atom1 (the force on atom2 is its negative)
+         @param energy           on exit, the interaction energy
             
          --------------------------------------------------------------------------------------- */
           
-      void calculateOneIxn(int atom1, int atom2, std::vector<OpenMM::Vec3>& atomCoordinates,
-                           std::vector<std::vector<double> >& atomParameters, std::vector<OpenMM::Vec3>& forces,
-                           double* totalEnergy) const;
+      void calculateOneIxn(int atom1, int atom2, const std::vector<OpenMM::Vec3>& atomCoordinates,
+                           const std::vector<std::vector<double> >& atomParameters, double* force,
+                           double& energy) const;
 
 
    public:
@@ -143,10 +146,11 @@ class ReferenceLJCoulombIxn {
 
          @param alpha    the Ewald separation parameter
          @param gridSize the dimensions of the mesh
+         @param order    the B-spline interpolation order
 
          --------------------------------------------------------------------------------------- */
       
-      void setUsePME(double alpha, int meshSize[3]);
+      void setUsePME(double alpha, int meshSize[3], int order);
       
       /**---------------------------------------------------------------------------------------
 
@@ -154,10 +158,11 @@ class ReferenceLJCoulombIxn {
 
          @param dalpha    the dispersion Ewald separation parameter
          @param dgridSize the dimensions of the dispersion mesh
+         @param order     the B-spline interpolation order
 
          --------------------------------------------------------------------------------------- */
 
-      void setUseLJPME(double dalpha, int dmeshSize[3]);
+      void setUseLJPME(double dalpha, int dmeshSize[3], int order);
       
       /**---------------------------------------------------------------------------------------
 
@@ -167,6 +172,17 @@ class ReferenceLJCoulombIxn {
 
       void setPeriodicExceptions(bool periodic);
 
+      /**---------------------------------------------------------------------------------------
+
+         Set the ThreadPool to use for evaluating direct space pair interactions.  The results
+         are identical for any number of threads.
+
+         @param pool   the ThreadPool to use, or NULL to evaluate them serially
+
+         --------------------------------------------------------------------------------------- */
+
+      void setThreadPool(OpenMM::ThreadPool* pool);
+
       /**---------------------------------------------------------------------------------------
       
          Calculate LJ Coulomb pair ixn
@@ -26,11 +26,12 @@
 
 #include "ReferenceConstraintAlgorithm.h"
 #include "SimTKOpenMMRealType.h"
+#include <utility>
 #include <vector>
 
 namespace OpenMM {
 
-class ReferenceLincsAlgorithm : public ReferenceConstraintAlgorithm {
+class OPENMM_EXPORT ReferenceLincsAlgorithm : public ReferenceConstraintAlgorithm {
 
    protected:
 
@@ -94,6 +95,20 @@ class ReferenceLincsAlgorithm : public ReferenceConstraintAlgorithm {
 
       ReferenceLincsAlgorithm(int numberOfConstraints, int** atomIndices, double* distance);
 
+      /**---------------------------------------------------------------------------------------
+
+         Find which constraints are coupled to each other by sharing an atom.  This is the
+         sparsity pattern of the LINCS coupling matrix.
+
+         @param numberOfAtoms    number of atoms
+         @param atomIndices      the two atoms involved in each constraint
+
+         @return for each constraint, the indices of all other constraints that share an atom with it
+
+         --------------------------------------------------------------------------------------- */
+
+      static std::vector<std::vector<int> > findLinkedConstraints(int numberOfAtoms, const std::vector<std::pair<int, int> >& atomIndices);
+
       /**---------------------------------------------------------------------------------------
 
          Get number of constraints
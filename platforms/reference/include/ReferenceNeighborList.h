@@ -44,6 +44,19 @@ void OPENMM_EXPORT computeNeighborListVoxelHash(
                               bool reportSymmetricPairs = false
                             );
 
+// Find the neighbors of every atom using the voxel hash method.  On exit,
+// neighbors[i] holds the indices of all atoms within maxDistance of atom i
+// (excluding i itself and its exclusions), sorted in increasing order.
+void OPENMM_EXPORT computeNeighborsByAtom(
+                              std::vector<std::vector<int> >& neighbors,
+                              int nAtoms,
+                              const AtomLocationList& atomLocations,
+                              const std::vector<std::set<int> >& exclusions,
+                              const Vec3* periodicBoxVectors,
+                              bool usePeriodic,
+                              double maxDistance
+                            );
+
 } // namespace OpenMM
 
 #endif // OPENMM_REFERENCE_NEIGHBORLIST_H_
@@ -0,0 +1,84 @@
+#ifndef OPENMM_REFERENCEPAIRLOOP_H_
+#define OPENMM_REFERENCEPAIRLOOP_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2026 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "openmm/internal/ThreadPool.h"
+#include <algorithm>
+#include <vector>
+
+namespace OpenMM {
+
+/**
+ * Evaluate a list of pair interactions, optionally using a ThreadPool, so that the results are
+ * bitwise identical regardless of how many threads are used.
+ *
+ * Each pair is processed in two stages.  compute(threadIndex, pairIndex, result) evaluates the
+ * interaction and stores it in result without modifying any shared state, so it can be called
+ * from any thread.  accumulate(pairIndex, result) then adds the result into the forces and energy.
+ * Pairs are computed in parallel in fixed size batches, but every call to accumulate() happens on
+ * the calling thread in order of increasing pairIndex.  All floating point sums are therefore
+ * formed in exactly the same order as in a serial loop.
+ *
+ * @param threads     the ThreadPool to use.  If this is NULL or has only one thread, the pairs are
+ *                    processed serially.
+ * @param numPairs    the number of pairs to process
+ * @param compute     evaluates a single pair
+ * @param accumulate  adds a single pair's result into the totals
+ */
+template <class Result, class Compute, class Accumulate>
+void computePairsInOrder(ThreadPool* threads, int numPairs, Compute compute, Accumulate accumulate) {
+    if (threads == NULL || threads->getNumThreads() < 2) {
+        Result result;
+        for (int i = 0; i < numPairs; i++) {
+            compute(0, i, result);
+            accumulate(i, result);
+        }
+        return;
+    }
+    const int batchSize = 16384;
+    std::vector<Result> results(std::min(batchSize, numPairs));
+    for (int start = 0; start < numPairs; start += batchSize) {
+        int count = std::min(batchSize, numPairs-start);
+        threads->execute(count, 256, [&] (ThreadPool& pool, int threadIndex, int first, int last) {
+            for (int i = first; i < last; i++)
+                compute(threadIndex, start+i, results[i]);
+        });
+        threads->waitForThreads();
+        for (int i = 0; i < count; i++)
+            accumulate(start+i, results[i]);
+    }
+}
+
+} // namespace OpenMM
+
+#endif /*OPENMM_REFERENCEPAIRLOOP_H_*/
@@ -37,10 +37,13 @@
 #include "openmm/internal/windowsExport.h"
 #include "ReferenceConstraints.h"
 #include <map>
+#include <string>
 #include <vector>
 
 namespace OpenMM {
 
+class ThreadPool;
+
 /**
  * This Platform subclass uses the reference implementations of all the OpenMM kernels.
  */
@@ -55,15 +58,36 @@ public:
     }
     double getSpeed() const;
     bool supportsDoublePrecision() const;
+    const std::string& getPropertyValue(const Context& context, const std::string& property) const;
     void contextCreated(ContextImpl& context, const std::map<std::string, std::string>& properties) const;
     void contextDestroyed(ContextImpl& context) const;
+    /**
+     * This is the name of the parameter for selecting the number of threads used to compute
+     * nonbonded interactions.  Results are identical for any number of threads.
+     */
+    static const std::string& ReferenceThreads() {
+        static const std::string key = "Threads";
+        return key;
+    }
 };
 
 class OPENMM_EXPORT ReferencePlatform::PlatformData {
 public:
-    PlatformData(const System& system);
+    PlatformData(const System& system, int numThreads=1);
     ~PlatformData();
-    int numParticles, stepCount;
+    /**
+     * Get the ThreadPool that kernels should use to divide their work between threads, such as for
+     * nonbonded and bonded forces or constraints.  It is created the first time this is called.  If
+     * only one thread should be used, this returns NULL.
+     */
+    ThreadPool* getThreadPool();
+    /**
+     * Use an existing ThreadPool instead of creating a new one.  This lets a platform built on top of
+     * this one share its own worker threads with the Reference kernels.  The PlatformData does not
+     * take ownership of the pool.
+     */
+    void setThreadPool(ThreadPool* pool);
+    int numParticles, stepCount, numThreads;
     double time;
     std::vector<Vec3>* positions;
     std::vector<Vec3>* velocities;
@@ -72,6 +96,10 @@ public:
     Vec3* periodicBoxVectors;
     ReferenceConstraints* constraints;
     std::map<std::string, double>* energyParameterDerivatives;
+    std::map<std::string, std::string> propertyValues;
+private:
+    ThreadPool* threads;
+    bool ownsThreads;
 };
 } // namespace OpenMM
 
@@ -26,12 +26,13 @@
 #define __ReferenceVerletDynamics_H__
 
 #include "ReferenceDynamics.h"
+#include "openmm/internal/windowsExport.h"
 
 namespace OpenMM {
 
-class ReferenceVerletDynamics : public ReferenceDynamics {
+class OPENMM_EXPORT ReferenceVerletDynamics : public ReferenceDynamics {
 
-   private:
+   protected:
 
       std::vector<OpenMM::Vec3> xPrime;
       std::vector<double> inverseMasses;
@@ -74,6 +75,37 @@ class ReferenceVerletDynamics : public ReferenceDynamics {
      
       void update(const OpenMM::System& system, std::vector<OpenMM::Vec3>& atomCoordinates,
                   std::vector<OpenMM::Vec3>& velocities, std::vector<OpenMM::Vec3>& forces, std::vector<double>& masses, double tolerance);
+
+      /**---------------------------------------------------------------------------------------
+      
+         First update: compute new velocities and unconstrained positions
+      
+         @param numberOfAtoms       number of atoms
+         @param atomCoordinates     atom coordinates
+         @param velocities          velocities
+         @param forces              forces
+         @param inverseMasses       inverse atom masses
+         @param xPrime              xPrime
+      
+         --------------------------------------------------------------------------------------- */
+      
+      virtual void updatePart1(int numberOfAtoms, std::vector<OpenMM::Vec3>& atomCoordinates, std::vector<OpenMM::Vec3>& velocities,
+                               std::vector<OpenMM::Vec3>& forces, std::vector<double>& inverseMasses, std::vector<OpenMM::Vec3>& xPrime);
+
+      /**---------------------------------------------------------------------------------------
+      
+         Second update: compute velocities from the constrained positions
+      
+         @param numberOfAtoms       number of atoms
+         @param atomCoordinates     atom coordinates
+         @param velocities          velocities
+         @param inverseMasses       inverse atom masses
+         @param xPrime              xPrime
+      
+         --------------------------------------------------------------------------------------- */
+      
+      virtual void updatePart2(int numberOfAtoms, std::vector<OpenMM::Vec3>& atomCoordinates, std::vector<OpenMM::Vec3>& velocities,
+                               std::vector<double>& inverseMasses, std::vector<OpenMM::Vec3>& xPrime);
       
 };
 
@@ -127,6 +127,11 @@ static map<string, double>& extractEnergyParameterDerivatives(ContextImpl& conte
     return *data->energyParameterDerivatives;
 }
 
+static ThreadPool* extractThreadPool(ContextImpl& context) {
+    ReferencePlatform::PlatformData* data = reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData());
+    return data->getThreadPool();
+}
+
 /**
  * Make sure an expression doesn't use any undefined variables.
  */
@@ -248,6 +253,22 @@ void ReferenceUpdateStateDataKernel::setVelocities(ContextImpl& context, const s
     }
 }
 
+void ReferenceUpdateStateDataKernel::beginStateCopy(ContextImpl& context, bool positions, bool velocities) {
+    copiedPositions.clear();
+    copiedVelocities.clear();
+    if (positions)
+        getPositions(context, copiedPositions);
+    if (velocities)
+        getVelocities(context, copiedVelocities);
+}
+
+void ReferenceUpdateStateDataKernel::finishStateCopy(ContextImpl& context, std::vector<Vec3>& positions, std::vector<Vec3>& velocities) {
+    positions.swap(copiedPositions);
+    velocities.swap(copiedVelocities);
+    copiedPositions.clear();
+    copiedVelocities.clear();
+}
+
 void ReferenceUpdateStateDataKernel::getForces(ContextImpl& context, std::vector<Vec3>& forces) {
     int numParticles = context.getSystem().getNumParticles();
     vector<Vec3>& forceData = extractForces(context);
@@ -926,6 +947,7 @@ void ReferenceCalcNonbondedForceKernel::initialize(const System& system, const N
     }
     nonbondedMethod = CalcNonbondedForceKernel::NonbondedMethod(force.getNonbondedMethod());
     nonbondedCutoff = force.getCutoffDistance();
+    pmeOrder = force.getPMEInterpolationOrder();
     if (nonbondedMethod == NoCutoff) {
         neighborList = NULL;
         useSwitchingFunction = false;
@@ -989,13 +1011,14 @@ double ReferenceCalcNonbondedForceKernel::execute(ContextImpl& context, bool inc
     if (ewald)
         clj.setUseEwald(ewaldAlpha, kmax[0], kmax[1], kmax[2]);
     if (pme)
-        clj.setUsePME(ewaldAlpha, gridSize);
+        clj.setUsePME(ewaldAlpha, gridSize, pmeOrder);
     if (ljpme){
-        clj.setUsePME(ewaldAlpha, gridSize);
-        clj.setUseLJPME(ewaldDispersionAlpha, dispersionGridSize);
+        clj.setUsePME(ewaldAlpha, gridSize, pmeOrder);
+        clj.setUseLJPME(ewaldDispersionAlpha, dispersionGridSize, pmeOrder);
     }
     if (useSwitchingFunction)
         clj.setUseSwitchingFunction(switchingDistance);
+    clj.setThreadPool(extractThreadPool(context));
     clj.calculatePairIxn(numParticles, posData, particleParamArray, exclusions, forceData, includeEnergy ? &energy : NULL, includeDirect, includeReciprocal);
     if (includeDirect) {
         ReferenceBondForce refBondForce;
@@ -1198,6 +1221,7 @@ void ReferenceCalcCustomNonbondedForceKernel::initialize(const System& system, c
     
     if (force.getNonbondedMethod() == CustomNonbondedForce::CutoffPeriodic && force.getUseLongRangeCorrection()) {
         forceCopy = new CustomNonbondedForce(force);
+        longRangeCorrectionData = CustomNonbondedForceImpl::prepareLongRangeCorrection(force);
         hasInitializedLongRangeCorrection = false;
     }
     else {
@@ -1242,6 +1266,7 @@ double ReferenceCalcCustomNonbondedForceKernel::execute(ContextImpl& context, bo
     }
     if (useSwitchingFunction)
         ixn.setUseSwitchingFunction(switchingDistance);
+    ixn.setThreadPool(extractThreadPool(context));
     vector<double> energyParamDerivValues(energyParamDerivNames.size()+1, 0.0);
     ixn.calculatePairIxn(numParticles, posData, particleParamArray, exclusions, globalParamValues, forceData, includeEnergy ? &energy : NULL, &energyParamDerivValues[0]);
     map<string, double>& energyParamDerivs = extractEnergyParameterDerivatives(context);
@@ -1251,7 +1276,7 @@ double ReferenceCalcCustomNonbondedForceKernel::execute(ContextImpl& context, bo
     // Add in the long range correction.
     
     if (!hasInitializedLongRangeCorrection || (globalParamsChanged && forceCopy != NULL)) {
-        CustomNonbondedForceImpl::calcLongRangeCorrection(*forceCopy, context.getOwner(), longRangeCoefficient, longRangeCoefficientDerivs);
+        CustomNonbondedForceImpl::calcLongRangeCorrection(*forceCopy, longRangeCorrectionData, context.getOwner(), longRangeCoefficient, longRangeCoefficientDerivs);
         hasInitializedLongRangeCorrection = true;
     }
     double volume = boxVectors[0][0]*boxVectors[1][1]*boxVectors[2][2];
@@ -1279,7 +1304,8 @@ void ReferenceCalcCustomNonbondedForceKernel::copyParametersToContext(ContextImp
     // If necessary, recompute the long range correction.
     
     if (forceCopy != NULL) {
-        CustomNonbondedForceImpl::calcLongRangeCorrection(force, context.getOwner(), longRangeCoefficient, longRangeCoefficientDerivs);
+        longRangeCorrectionData = CustomNonbondedForceImpl::prepareLongRangeCorrection(force);
+        CustomNonbondedForceImpl::calcLongRangeCorrection(force, longRangeCorrectionData, context.getOwner(), longRangeCoefficient, longRangeCoefficientDerivs);
         hasInitializedLongRangeCorrection = true;
         *forceCopy = force;
     }
@@ -1525,48 +1551,6 @@ void ReferenceCalcCustomGBForceKernel::copyParametersToContext(ContextImpl& cont
     }
 }
 
-ReferenceCalcCustomExternalForceKernel::PeriodicDistanceFunction::PeriodicDistanceFunction(Vec3** boxVectorHandle) : boxVectorHandle(boxVectorHandle) {
-}
-
-int ReferenceCalcCustomExternalForceKernel::PeriodicDistanceFunction::getNumArguments() const {
-    return 6;
-}
-
-double ReferenceCalcCustomExternalForceKernel::PeriodicDistanceFunction::evaluate(const double* arguments) const {
-    Vec3* boxVectors = *boxVectorHandle;
-    Vec3 delta = Vec3(arguments[0], arguments[1], arguments[2])-Vec3(arguments[3], arguments[4], arguments[5]);
-    delta -= boxVectors[2]*floor(delta[2]/boxVectors[2][2]+0.5);
-    delta -= boxVectors[1]*floor(delta[1]/boxVectors[1][1]+0.5);
-    delta -= boxVectors[0]*floor(delta[0]/boxVectors[0][0]+0.5);
-    return sqrt(delta.dot(delta));
-}
-
-double ReferenceCalcCustomExternalForceKernel::PeriodicDistanceFunction::evaluateDerivative(const double* arguments, const int* derivOrder) const {
-    int argIndex = -1;
-    for (int i = 0; i < 6; i++) {
-        if (derivOrder[i] > 0) {
-            if (derivOrder[i] > 1 || argIndex != -1)
-                throw OpenMMException("Unsupported derivative of periodicdistance"); // Should be impossible for this to happen.
-            argIndex = i;
-        }
-    }
-    Vec3* boxVectors = *boxVectorHandle;
-    Vec3 delta = Vec3(arguments[0], arguments[1], arguments[2])-Vec3(arguments[3], arguments[4], arguments[5]);
-    delta -= boxVectors[2]*floor(delta[2]/boxVectors[2][2]+0.5);
-    delta -= boxVectors[1]*floor(delta[1]/boxVectors[1][1]+0.5);
-    delta -= boxVectors[0]*floor(delta[0]/boxVectors[0][0]+0.5);
-    double r = sqrt(delta.dot(delta));
-    if (r == 0)
-        return 0.0;    
-    if (argIndex < 3)
-        return delta[argIndex]/r;
-    return -delta[argIndex-3]/r;
-}
-
-Lepton::CustomFunction* ReferenceCalcCustomExternalForceKernel::PeriodicDistanceFunction::clone() const {
-    return new PeriodicDistanceFunction(boxVectorHandle);
-}
-
 ReferenceCalcCustomExternalForceKernel::~ReferenceCalcCustomExternalForceKernel() {
     if (ixn != NULL)
         delete ixn;
@@ -1586,7 +1570,7 @@ void ReferenceCalcCustomExternalForceKernel::initialize(const System& system, co
     // Parse the expression used to calculate the force.
 
     map<string, Lepton::CustomFunction*> functions;
-    PeriodicDistanceFunction periodicDistance(&boxVectors);
+    ReferenceCustomExternalIxn::PeriodicDistanceFunction periodicDistance(&boxVectors);
     functions["periodicdistance"] = &periodicDistance;
     Lepton::ParsedExpression expression = Lepton::Parser::parse(force.getEnergyFunction(), functions).optimize();
     energyExpression = expression.createCompiledExpression();
@@ -2026,6 +2010,30 @@ void ReferenceCalcCustomCVForceKernel::initialize(const System& system, const Cu
     ixn = new ReferenceCustomCVForce(force);
 }
 
+void ReferenceCalcCustomCVForceKernel::initialize(const System& system, const CustomCVForce& force) {
+    for (int i = 0; i < force.getNumGlobalParameters(); i++)
+        globalParameterNames.push_back(force.getGlobalParameterName(i));
+    for (int i = 0; i < force.getNumEnergyParameterDerivatives(); i++)
+        energyParamDerivNames.push_back(force.getEnergyParameterDerivativeName(i));
+    cvForces.resize(force.getNumCollectiveVariables());
+    ixn = new ReferenceCustomCVForce(force);
+}
+
+double ReferenceCalcCustomCVForceKernel::execute(ContextImpl& context, const vector<double>& values, const vector<map<string, double> >& paramDerivs, bool includeForces, bool includeEnergy) {
+    vector<Vec3>& forceData = extractForces(context);
+    double energy = 0;
+    map<string, double> globalParameters;
+    for (auto& name : globalParameterNames)
+        globalParameters[name] = context.getParameter(name);
+    map<string, double>& energyParamDerivs = extractEnergyParameterDerivatives(context);
+    ixn->calculateIxn(values, includeForces ? &cvForces : NULL, paramDerivs, globalParameters, forceData, includeEnergy ? &energy : NULL, energyParamDerivs);
+    return energy;
+}
+
+void ReferenceCalcCustomCVForceKernel::copyVariableForces(ContextImpl& context, int index) {
+    cvForces[index] = extractForces(context);
+}
+
 double ReferenceCalcCustomCVForceKernel::execute(ContextImpl& context, ContextImpl& innerContext, bool includeForces, bool includeEnergy) {
     copyState(context, innerContext);
     vector<Vec3>& posData = extractPositions(context);
@@ -2476,6 +2484,68 @@ double ReferenceIntegrateLangevinMiddleStepKernel::computeKineticEnergy(ContextI
     return computeShiftedKineticEnergy(context, masses, 0.0);
 }
 
+void ReferenceIntegrateMTSLangevinStepKernel::initialize(const System& system, const MTSLangevinIntegrator& integrator) {
+    int numParticles = system.getNumParticles();
+    masses.resize(numParticles);
+    inverseMasses.resize(numParticles);
+    xPrime.resize(numParticles);
+    oldx.resize(numParticles);
+    for (int i = 0; i < numParticles; ++i) {
+        masses[i] = system.getParticleMass(i);
+        inverseMasses[i] = (masses[i] == 0.0 ? 0.0 : 1.0/masses[i]);
+    }
+    SimTKOpenMMUtilities::setRandomNumberSeed((unsigned int) integrator.getRandomNumberSeed());
+}
+
+void ReferenceIntegrateMTSLangevinStepKernel::kick(ContextImpl& context, const MTSLangevinIntegrator& integrator, double dt) {
+    vector<Vec3>& posData = extractPositions(context);
+    vector<Vec3>& velData = extractVelocities(context);
+    vector<Vec3>& forceData = extractForces(context);
+    int numParticles = masses.size();
+    for (int i = 0; i < numParticles; i++)
+        if (inverseMasses[i] != 0.0)
+            velData[i] += (dt*inverseMasses[i])*forceData[i];
+    extractConstraints(context).applyToVelocities(posData, velData, inverseMasses, integrator.getConstraintTolerance());
+}
+
+void ReferenceIntegrateMTSLangevinStepKernel::drift(ContextImpl& context, const MTSLangevinIntegrator& integrator, double dt) {
+    vector<Vec3>& posData = extractPositions(context);
+    vector<Vec3>& velData = extractVelocities(context);
+    int numParticles = masses.size();
+    const double halfdt = 0.5*dt;
+    const double kT = BOLTZ*integrator.getTemperature();
+    const double vscale = exp(-dt*integrator.getFriction());
+    const double noisescale = sqrt(1-vscale*vscale);
+    for (int i = 0; i < numParticles; i++) {
+        if (inverseMasses[i] != 0.0) {
+            xPrime[i] = posData[i] + velData[i]*halfdt;
+            velData[i] = vscale*velData[i] + noisescale*sqrt(kT*inverseMasses[i])*Vec3(
+                    SimTKOpenMMUtilities::getNormallyDistributedRandomNumber(),
+                    SimTKOpenMMUtilities::getNormallyDistributedRandomNumber(),
+                    SimTKOpenMMUtilities::getNormallyDistributedRandomNumber());
+            xPrime[i] = xPrime[i] + velData[i]*halfdt;
+            oldx[i] = xPrime[i];
+        }
+    }
+    extractConstraints(context).apply(posData, xPrime, inverseMasses, integrator.getConstraintTolerance());
+    for (int i = 0; i < numParticles; i++) {
+        if (inverseMasses[i] != 0.0) {
+            velData[i] += (xPrime[i]-oldx[i])/dt;
+            posData[i] = xPrime[i];
+        }
+    }
+    ReferenceVirtualSites::computePositions(context.getSystem(), posData);
+}
+
+void ReferenceIntegrateMTSLangevinStepKernel::finishStep(ContextImpl& context, const MTSLangevinIntegrator& integrator, bool& forcesAreValid) {
+    data.time += integrator.getStepSize();
+    data.stepCount++;
+}
+
+double ReferenceIntegrateMTSLangevinStepKernel::computeKineticEnergy(ContextImpl& context, const MTSLangevinIntegrator& integrator) {
+    return computeShiftedKineticEnergy(context, masses, 0.0);
+}
+
 ReferenceIntegrateBrownianStepKernel::~ReferenceIntegrateBrownianStepKernel() {
     if (dynamics)
         delete dynamics;
@@ -32,9 +32,12 @@
 #include "ReferencePlatform.h"
 #include "ReferenceKernelFactory.h"
 #include "ReferenceKernels.h"
+#include "openmm/OpenMMException.h"
 #include "openmm/internal/ContextImpl.h"
+#include "openmm/internal/ThreadPool.h"
 #include "SimTKOpenMMRealType.h"
 #include "openmm/Vec3.h"
+#include <sstream>
 
 using namespace OpenMM;
 using namespace std;
@@ -69,6 +72,7 @@ ReferencePlatform::ReferencePlatform() {
     registerKernelFactory(IntegrateNoseHooverStepKernel::Name(), factory);
     registerKernelFactory(IntegrateLangevinStepKernel::Name(), factory);
     registerKernelFactory(IntegrateLangevinMiddleStepKernel::Name(), factory);
+    registerKernelFactory(IntegrateMTSLangevinStepKernel::Name(), factory);
     registerKernelFactory(IntegrateBrownianStepKernel::Name(), factory);
     registerKernelFactory(IntegrateVariableLangevinStepKernel::Name(), factory);
     registerKernelFactory(IntegrateVariableVerletStepKernel::Name(), factory);
@@ -76,6 +80,8 @@ ReferencePlatform::ReferencePlatform() {
     registerKernelFactory(ApplyAndersenThermostatKernel::Name(), factory);
     registerKernelFactory(ApplyMonteCarloBarostatKernel::Name(), factory);
     registerKernelFactory(RemoveCMMotionKernel::Name(), factory);
+    platformProperties.push_back(ReferenceThreads());
+    setPropertyDefaultValue(ReferenceThreads(), "1");
 }
 
 double ReferencePlatform::getSpeed() const {
@@ -86,8 +92,27 @@ bool ReferencePlatform::supportsDoublePrecision() const {
     return true;
 }
 
+const string& ReferencePlatform::getPropertyValue(const Context& context, const string& property) const {
+    const ContextImpl& impl = getContextImpl(context);
+    const PlatformData* data = reinterpret_cast<const PlatformData*>(impl.getPlatformData());
+    string propertyName = property;
+    if (deprecatedPropertyReplacements.find(property) != deprecatedPropertyReplacements.end())
+        propertyName = deprecatedPropertyReplacements.find(property)->second;
+    map<string, string>::const_iterator value = data->propertyValues.find(propertyName);
+    if (value != data->propertyValues.end())
+        return value->second;
+    return Platform::getPropertyValue(context, property);
+}
+
 void ReferencePlatform::contextCreated(ContextImpl& context, const map<string, string>& properties) const {
-    context.setPlatformData(new PlatformData(context.getSystem()));
+    const string& threadsPropValue = (properties.find(ReferenceThreads()) == properties.end() ?
+            getPropertyDefaultValue(ReferenceThreads()) : properties.find(ReferenceThreads())->second);
+    int numThreads;
+    stringstream threadsStream(threadsPropValue);
+    threadsStream >> numThreads;
+    if (threadsStream.fail() || numThreads < 1)
+        throw OpenMMException("Illegal value for Threads: "+threadsPropValue);
+    context.setPlatformData(new PlatformData(context.getSystem(), numThreads));
 }
 
 void ReferencePlatform::contextDestroyed(ContextImpl& context) const {
@@ -95,7 +120,8 @@ void ReferencePlatform::contextDestroyed(ContextImpl& context) const {
     delete data;
 }
 
-ReferencePlatform::PlatformData::PlatformData(const System& system) : time(0.0), stepCount(0), numParticles(system.getNumParticles()) {
+ReferencePlatform::PlatformData::PlatformData(const System& system, int numThreads) : time(0.0), stepCount(0), numParticles(system.getNumParticles()),
+        numThreads(numThreads), threads(NULL), ownsThreads(false) {
     positions = new vector<Vec3>(numParticles);
     velocities = new vector<Vec3>(numParticles);
     forces = new vector<Vec3>(numParticles);
@@ -103,6 +129,9 @@ ReferencePlatform::PlatformData::PlatformData(const System& system) : time(0.0),
     periodicBoxVectors = new Vec3[3];
     constraints = new ReferenceConstraints(system);
     energyParameterDerivatives = new map<string, double>();
+    stringstream threadsString;
+    threadsString << numThreads;
+    propertyValues[ReferencePlatform::ReferenceThreads()] = threadsString.str();
 }
 
 ReferencePlatform::PlatformData::~PlatformData() {
@@ -113,4 +142,24 @@ ReferencePlatform::PlatformData::~PlatformData() {
     delete[] periodicBoxVectors;
     delete constraints;
     delete energyParameterDerivatives;
+    if (ownsThreads)
+        delete threads;
+}
+
+ThreadPool* ReferencePlatform::PlatformData::getThreadPool() {
+    if (numThreads < 2)
+        return NULL;
+    if (threads == NULL) {
+        threads = new ThreadPool(numThreads);
+        ownsThreads = true;
+    }
+    return threads;
+}
+
+void ReferencePlatform::PlatformData::setThreadPool(ThreadPool* pool) {
+    if (ownsThreads)
+        delete threads;
+    threads = pool;
+    ownsThreads = false;
+    numThreads = pool->getNumThreads();
 }
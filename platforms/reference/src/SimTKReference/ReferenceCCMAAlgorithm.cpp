@@ -31,7 +31,10 @@
 #include "quern.h"
 #include "openmm/OpenMMException.h"
 #include "openmm/Vec3.h"
+#include "openmm/internal/ContextImpl.h"
 #include "openmm/internal/ThreadPool.h"
+#include <algorithm>
+#include <atomic>
 #include <map>
 #include <set>
 #include <utility>
@@ -39,6 +42,22 @@
 using namespace OpenMM;
 using namespace std;
 
+/**
+ * Execute a loop over the range [0, numIndices), dividing it between threads if a ThreadPool
+ * is provided.  body(threadIndex, first, last) processes one block of indices.
+ */
+template <class Body>
+static void executeLoop(ThreadPool* threads, int numIndices, Body body) {
+    if (threads == NULL)
+        body(0, 0, numIndices);
+    else {
+        threads->execute(numIndices, 256, [&] (ThreadPool& pool, int threadIndex, int first, int last) {
+            body(threadIndex, first, last);
+        });
+        threads->waitForThreads();
+    }
+}
+
 ReferenceCCMAAlgorithm::ReferenceCCMAAlgorithm(int numberOfAtoms,
                                                int numberOfConstraints,
                                                const vector<pair<int, int> >& atomIndices,
@@ -53,6 +72,7 @@ ReferenceCCMAAlgorithm::ReferenceCCMAAlgorithm(int numberOfAtoms,
 
     _maximumNumberOfIterations = 150;
     _hasInitializedMasses = false;
+    _threads = NULL;
 
     // work arrays
 
@@ -75,6 +95,11 @@ ReferenceCCMAAlgorithm::ReferenceCCMAAlgorithm(int numberOfAtoms,
             atomConstraints[_atomIndices[j].first].insert(j);
             atomConstraints[_atomIndices[j].second].insert(j);
         }
+        for (int i = 0; i < numberOfAtoms; i++)
+            if (atomConstraints[i].size() > 0) {
+                _constrainedAtoms.push_back(i);
+                _atomConstraints.push_back(vector<int>(atomConstraints[i].begin(), atomConstraints[i].end()));
+            }
         for (int j = 0; j < numberOfConstraints; j++) {
             int atomj0 = _atomIndices[j].first;
             int atomj1 = _atomIndices[j].second;
@@ -146,44 +171,70 @@ ReferenceCCMAAlgorithm::ReferenceCCMAAlgorithm(int numberOfAtoms,
             }
         }
 
-        // Invert it using QR.
-
-        vector<int> matrixRowStart;
-        vector<int> matrixColIndex;
-        vector<double> matrixValue;
-        for (int i = 0; i < numberOfConstraints; i++) {
-            matrixRowStart.push_back(matrixValue.size());
-            for (auto& element : matrix[i]) {
-                matrixColIndex.push_back(element.first);
-                matrixValue.push_back(element.second);
-            }
-        }
-        matrixRowStart.push_back(matrixValue.size());
-        int *qRowStart, *qColIndex, *rRowStart, *rColIndex;
-        double *qValue, *rValue;
-        QUERN_compute_qr(numberOfConstraints, numberOfConstraints, &matrixRowStart[0], &matrixColIndex[0], &matrixValue[0], NULL,
-                &qRowStart, &qColIndex, &qValue, &rRowStart, &rColIndex, &rValue);
+        // The matrix is block diagonal, with one block for each set of constraints that are coupled
+        // to each other.  Inverting each block separately is far faster than inverting the whole
+        // matrix at once, since the cost grows quadratically with the size of the matrix.
+
+        vector<pair<int, int> > couplings;
+        for (int i = 0; i < numberOfConstraints; i++)
+            for (auto& element : matrix[i])
+                if (element.first != i)
+                    couplings.push_back(make_pair(i, element.first));
+        vector<vector<int> > blocks = ContextImpl::findMolecules(numberOfConstraints, couplings);
+        sort(blocks.begin(), blocks.end(), [] (const vector<int>& a, const vector<int>& b) { return a.size() > b.size(); });
+        vector<int> indexInBlock(numberOfConstraints);
+        for (auto& block : blocks)
+            for (int i = 0; i < block.size(); i++)
+                indexInBlock[block[i]] = i;
         vector<vector<pair<int, double> > > transposedMatrix(numberOfConstraints);
         _matrix.resize(numberOfConstraints);
 
-        // Extract columns from the inverse matrix one at a time.  It is done in parallel,
-        // since this can be very slow.
-        
+        // Invert the blocks in parallel, starting with the largest ones so the work is balanced
+        // between threads.  Each one is inverted using QR, extracting columns from the inverse one
+        // at a time.
+
+        atomic<int> nextBlock(0);
         ThreadPool threads;
         threads.execute([&] (ThreadPool& pool, int threadIndex) {
-            vector<double> rhs(numberOfConstraints);
-            for (int i = threadIndex; i < numberOfConstraints; i += pool.getNumThreads()) {
-                // Extract column i of the inverse matrix.
-
-                for (int j = 0; j < numberOfConstraints; j++)
-                    rhs[j] = (i == j ? 1.0 : 0.0);
-                QUERN_multiply_with_q_transpose(numberOfConstraints, qRowStart, qColIndex, qValue, &rhs[0]);
-                QUERN_solve_with_r(numberOfConstraints, rRowStart, rColIndex, rValue, &rhs[0], &rhs[0]);
-                for (int j = 0; j < numberOfConstraints; j++) {
-                    double value = rhs[j]*distance[i]/distance[j];
-                    if (fabs(value) > elementCutoff)
-                        transposedMatrix[i].push_back(pair<int, double>(j, value));
+            while (true) {
+                int blockIndex = nextBlock++;
+                if (blockIndex >= blocks.size())
+                    break;
+                const vector<int>& block = blocks[blockIndex];
+                int blockSize = block.size();
+                vector<int> matrixRowStart;
+                vector<int> matrixColIndex;
+                vector<double> matrixValue;
+                for (int i : block) {
+                    matrixRowStart.push_back(matrixValue.size());
+                    for (auto& element : matrix[i]) {
+                        matrixColIndex.push_back(indexInBlock[element.first]);
+                        matrixValue.push_back(element.second);
+                    }
                 }
+                matrixRowStart.push_back(matrixValue.size());
+                int *qRowStart, *qColIndex, *rRowStart, *rColIndex;
+                double *qValue, *rValue;
+                QUERN_compute_qr(blockSize, blockSize, &matrixRowStart[0], &matrixColIndex[0], &matrixValue[0], NULL,
+                        &qRowStart, &qColIndex, &qValue, &rRowStart, &rColIndex, &rValue);
+                vector<double> rhs(blockSize);
+                for (int i = 0; i < blockSize; i++) {
+                    // Extract column i of the inverse matrix.
+
+                    for (int j = 0; j < blockSize; j++)
+                        rhs[j] = (i == j ? 1.0 : 0.0);
+                    QUERN_multiply_with_q_transpose(blockSize, qRowStart, qColIndex, qValue, &rhs[0]);
+                    QUERN_solve_with_r(blockSize, rRowStart, rColIndex, rValue, &rhs[0], &rhs[0]);
+                    int column = block[i];
+                    for (int j = 0; j < blockSize; j++) {
+                        int row = block[j];
+                        double value = rhs[j]*distance[column]/distance[row];
+                        if (fabs(value) > elementCutoff)
+                            transposedMatrix[column].push_back(pair<int, double>(row, value));
+                    }
+                }
+                QUERN_free_result(qRowStart, qColIndex, qValue);
+                QUERN_free_result(rRowStart, rColIndex, rValue);
             }
         });
         threads.waitForThreads();
@@ -196,8 +247,6 @@ ReferenceCCMAAlgorithm::ReferenceCCMAAlgorithm(int numberOfAtoms,
                 _matrix[value.first].push_back(make_pair(i, value.second));
             }
         }
-        QUERN_free_result(qRowStart, qColIndex, qValue);
-        QUERN_free_result(rRowStart, rColIndex, rValue);
     }
 }
 
@@ -221,6 +270,10 @@ void ReferenceCCMAAlgorithm::setMaximumNumberOfIterations(int maximumNumberOfIte
     _maximumNumberOfIterations = maximumNumberOfIterations;
 }
 
+void ReferenceCCMAAlgorithm::setThreadPool(ThreadPool* threads) {
+    _threads = threads;
+}
+
 void ReferenceCCMAAlgorithm::apply(vector<Vec3>& atomCoordinates,
                                          vector<Vec3>& atomCoordinatesP,
                                          vector<double>& inverseMasses, double tolerance) {
@@ -252,66 +305,92 @@ void ReferenceCCMAAlgorithm::applyConstraints(vector<Vec3>& atomCoordinates,
         }
     }
 
+    // Small sets of constraints are faster to process on a single thread.  Every loop below computes
+    // each value the same way whether or not it is split between threads, so the results do not
+    // depend on the number of threads.
+
+    ThreadPool* threads = (_threads != NULL && _threads->getNumThreads() > 1 && _numberOfConstraints >= 1000 ? _threads : NULL);
+    int numThreads = (threads == NULL ? 1 : threads->getNumThreads());
+
     // setup: r_ij for each (i,j) constraint
 
-    for (int ii = 0; ii < _numberOfConstraints; ii++) {
-        int atomI = _atomIndices[ii].first;
-        int atomJ = _atomIndices[ii].second;
-        r_ij[ii] = atomCoordinates[atomI] - atomCoordinates[atomJ];
-        d_ij2[ii] = r_ij[ii].dot(r_ij[ii]);
-    }
+    executeLoop(threads, _numberOfConstraints, [&] (int threadIndex, int first, int last) {
+        for (int ii = first; ii < last; ii++) {
+            int atomI = _atomIndices[ii].first;
+            int atomJ = _atomIndices[ii].second;
+            r_ij[ii] = atomCoordinates[atomI] - atomCoordinates[atomJ];
+            d_ij2[ii] = r_ij[ii].dot(r_ij[ii]);
+        }
+    });
     double lowerTol = 1-2*tolerance+tolerance*tolerance;
     double upperTol = 1+2*tolerance+tolerance*tolerance;
 
     // main loop
 
     int iterations = 0;
-    int numberConverged = 0;
+    vector<int> threadConverged(numThreads);
     vector<double> constraintDelta(_numberOfConstraints);
     vector<double> tempDelta(_numberOfConstraints);
     while (iterations < getMaximumNumberOfIterations()) {
-        numberConverged  = 0;
-        for (int ii = 0; ii < _numberOfConstraints; ii++) {
-            int atomI = _atomIndices[ii].first;
-            int atomJ = _atomIndices[ii].second;
-            Vec3 rp_ij = atomCoordinatesP[atomI] - atomCoordinatesP[atomJ];
-            if (constrainingVelocities) {
-                double rrpr = rp_ij.dot(r_ij[ii]);
-                constraintDelta[ii] = -2*reducedMasses[ii]*rrpr/d_ij2[ii];
-                if (fabs(constraintDelta[ii]) <= tolerance)
-                    numberConverged++;
-            }
-            else {
-                double rp2  = rp_ij.dot(rp_ij);
-                double dist2 = _distance[ii]*_distance[ii];
-                double diff = dist2 - rp2;
-                constraintDelta[ii] = 0;
-                double rrpr = DOT3(rp_ij, r_ij[ii]);
-                constraintDelta[ii] = reducedMasses[ii]*diff/rrpr;
-                if (rp2 >= lowerTol*dist2 && rp2 <= upperTol*dist2)
-                    numberConverged++;
+        fill(threadConverged.begin(), threadConverged.end(), 0);
+        executeLoop(threads, _numberOfConstraints, [&] (int threadIndex, int first, int last) {
+            int numberConverged = 0;
+            for (int ii = first; ii < last; ii++) {
+                int atomI = _atomIndices[ii].first;
+                int atomJ = _atomIndices[ii].second;
+                Vec3 rp_ij = atomCoordinatesP[atomI] - atomCoordinatesP[atomJ];
+                if (constrainingVelocities) {
+                    double rrpr = rp_ij.dot(r_ij[ii]);
+                    constraintDelta[ii] = -2*reducedMasses[ii]*rrpr/d_ij2[ii];
+                    if (fabs(constraintDelta[ii]) <= tolerance)
+                        numberConverged++;
+                }
+                else {
+                    double rp2  = rp_ij.dot(rp_ij);
+                    double dist2 = _distance[ii]*_distance[ii];
+                    double diff = dist2 - rp2;
+                    double rrpr = DOT3(rp_ij, r_ij[ii]);
+                    constraintDelta[ii] = reducedMasses[ii]*diff/rrpr;
+                    if (rp2 >= lowerTol*dist2 && rp2 <= upperTol*dist2)
+                        numberConverged++;
+                }
             }
-        }
+            threadConverged[threadIndex] += numberConverged;
+        });
+        int numberConverged = 0;
+        for (int count : threadConverged)
+            numberConverged += count;
         if (numberConverged == _numberOfConstraints)
             break;
         iterations++;
 
         if (_matrix.size() > 0) {
-            for (int i = 0; i < _numberOfConstraints; i++) {
-                double sum = 0.0;
-                for (auto& element : _matrix[i])
-                    sum += element.second*constraintDelta[element.first];
-                tempDelta[i] = sum;
-            }
-            constraintDelta = tempDelta;
-        }
-        for (int ii = 0; ii < _numberOfConstraints; ii++) {
-            int atomI = _atomIndices[ii].first;
-            int atomJ = _atomIndices[ii].second;
-            Vec3 dr = r_ij[ii]*constraintDelta[ii];
-            atomCoordinatesP[atomI] += dr*inverseMasses[atomI];
-            atomCoordinatesP[atomJ] -= dr*inverseMasses[atomJ];
+            executeLoop(threads, _numberOfConstraints, [&] (int threadIndex, int first, int last) {
+                for (int i = first; i < last; i++) {
+                    double sum = 0.0;
+                    for (auto& element : _matrix[i])
+                        sum += element.second*constraintDelta[element.first];
+                    tempDelta[i] = sum;
+                }
+            });
+            constraintDelta.swap(tempDelta);
         }
+
+        // Loop over atoms rather than constraints, so each atom is only modified by one thread.  Its
+        // constraints are applied in increasing order, the same order a loop over constraints would use.
+
+        executeLoop(threads, _constrainedAtoms.size(), [&] (int threadIndex, int first, int last) {
+            for (int i = first; i < last; i++) {
+                int atom = _constrainedAtoms[i];
+                for (int ii : _atomConstraints[i]) {
+                    Vec3 dr = r_ij[ii]*constraintDelta[ii];
+                    if (_atomIndices[ii].first == atom)
+                        atomCoordinatesP[atom] += dr*inverseMasses[atom];
+                    else
+                        atomCoordinatesP[atom] -= dr*inverseMasses[atom];
+                }
+            }
+        });
     }
 }
 
@@ -61,31 +61,31 @@ void ReferenceCMAPTorsionIxn::setPeriodic(OpenMM::Vec3* vectors) {
 
 void ReferenceCMAPTorsionIxn::calculateIxn(vector<Vec3>& atomCoordinates, vector<Vec3>& forces, double* totalEnergy) const {
     for (unsigned int i = 0; i < torsionMaps.size(); i++)
-        calculateOneIxn(i, atomCoordinates, forces, totalEnergy);
+        calculateOneIxn(torsionMaps[i], torsionIndices[i], atomCoordinates, forces, totalEnergy);
 }
 
 /**---------------------------------------------------------------------------------------
 
    Calculate the interaction due to a single torsion pair
 
-   @param index            the index of the torsion
+   @param map              the index of the map to use
+   @param atoms            the indices of the eight atoms forming the two torsions
    @param atomCoordinates  atom coordinates
    @param forces           force array (forces added)
    @param totalEnergy      total energy
 
      --------------------------------------------------------------------------------------- */
 
-void ReferenceCMAPTorsionIxn::calculateOneIxn(int index, vector<Vec3>& atomCoordinates, vector<Vec3>& forces,
+void ReferenceCMAPTorsionIxn::calculateOneIxn(int map, const vector<int>& atoms, vector<Vec3>& atomCoordinates, vector<Vec3>& forces,
                      double* totalEnergy) const {
-    int map = torsionMaps[index];
-    int a1 = torsionIndices[index][0];
-    int a2 = torsionIndices[index][1];
-    int a3 = torsionIndices[index][2];
-    int a4 = torsionIndices[index][3];
-    int b1 = torsionIndices[index][4];
-    int b2 = torsionIndices[index][5];
-    int b3 = torsionIndices[index][6];
-    int b4 = torsionIndices[index][7];
+    int a1 = atoms[0];
+    int a2 = atoms[1];
+    int a3 = atoms[2];
+    int a4 = atoms[3];
+    int b1 = atoms[4];
+    int b2 = atoms[5];
+    int b3 = atoms[6];
+    int b4 = atoms[7];
 
     // Compute deltas between the various atoms involved.
 
@@ -202,10 +202,17 @@ void ReferenceCMAPTorsionIxn::calculateOneIxn(int index, vector<Vec3>& atomCoord
 
 /**---------------------------------------------------------------------------------------
 
-   This is present only because we must define it to subclass ReferenceBondIxn.  It is never called.
+   Calculate the interaction due to a single torsion pair
+
+   @param atomIndices      the indices of the eight atoms forming the two torsions
+   @param atomCoordinates  atom coordinates
+   @param parameters       parameters[0] is the index of the map to use
+   @param forces           force array (forces added)
+   @param totalEnergy      total energy
 
    --------------------------------------------------------------------------------------- */
 
 void ReferenceCMAPTorsionIxn::calculateBondIxn(vector<int>& atomIndices, vector<Vec3>& atomCoordinates,
         vector<double>& parameters, vector<Vec3>& forces, double* totalEnergy, double* energyParamDerivs) {
+    calculateOneIxn((int) parameters[0], atomIndices, atomCoordinates, forces, totalEnergy);
 }
@@ -113,19 +113,27 @@ void ReferenceCustomCVForce::calculateIxn(ContextImpl& innerContext, vector<Vec3
         cvForces.push_back(innerForces);
         cvDerivs.push_back(innerDerivs);
     }
-    
+    calculateIxn(cvValues, &cvForces, cvDerivs, globalParameters, forces, totalEnergy, energyParamDerivs);
+}
+
+void ReferenceCustomCVForce::calculateIxn(const vector<double>& cvValues, const vector<vector<Vec3> >* cvForces,
+                                          const vector<map<string, double> >& cvDerivs, const map<string, double>& globalParameters,
+                                          vector<Vec3>& forces, double* totalEnergy, map<string, double>& energyParamDerivs) const {
     // Compute the energy and forces.
     
-    int numParticles = atomCoordinates.size();
+    int numCVs = variableNames.size();
+    int numParticles = forces.size();
     map<string, double> variables = globalParameters;
     for (int i = 0; i < numCVs; i++)
         variables[variableNames[i]] = cvValues[i];
     if (totalEnergy != NULL)
         *totalEnergy += energyExpression.evaluate(variables);
-    for (int i = 0; i < numCVs; i++) {
-        double dEdV = variableDerivExpressions[i].evaluate(variables);
-        for (int j = 0; j < numParticles; j++)
-            forces[j] += cvForces[i][j]*dEdV;
+    if (cvForces != NULL) {
+        for (int i = 0; i < numCVs; i++) {
+            double dEdV = variableDerivExpressions[i].evaluate(variables);
+            for (int j = 0; j < numParticles; j++)
+                forces[j] += (*cvForces)[i][j]*dEdV;
+        }
     }
     
     // Compute the energy parameter derivatives.
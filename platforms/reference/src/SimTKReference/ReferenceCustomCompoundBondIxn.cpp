@@ -47,42 +47,48 @@ ReferenceCustomCompoundBondIxn::ReferenceCustomCompoundBondIxn(int numParticlesP
             const Lepton::ParsedExpression& energyExpression, const vector<string>& bondParameterNames,
             const map<string, vector<int> >& distances, const map<string, vector<int> >& angles, const map<string, vector<int> >& dihedrals,
             const std::vector<Lepton::CompiledExpression> energyParamDerivExpressions) :
-            bondAtoms(bondAtoms), energyExpression(energyExpression.createCompiledExpression()), usePeriodic(false),
-            energyParamDerivExpressions(energyParamDerivExpressions) {
-    expressionSet.registerExpression(this->energyExpression);
-    for (int i = 0; i < this->energyParamDerivExpressions.size(); i++)
-        expressionSet.registerExpression(this->energyParamDerivExpressions[i]);
+            bondAtoms(bondAtoms), usePeriodic(false), energyParamDerivExpressions(energyParamDerivExpressions) {
+    // The energy and all the derivatives needed for forces are compiled together, so subexpressions
+    // they have in common only get evaluated once per bond.
+
+    vector<Lepton::ParsedExpression> expressions;
+    expressions.push_back(energyExpression);
     for (int i = 0; i < numParticlesPerBond; i++) {
         stringstream xname, yname, zname;
         xname << 'x' << (i+1);
         yname << 'y' << (i+1);
         zname << 'z' << (i+1);
-        particleTerms.push_back(ReferenceCustomCompoundBondIxn::ParticleTermInfo(xname.str(), i, 0, energyExpression.differentiate(xname.str()).createCompiledExpression()));
-        particleTerms.push_back(ReferenceCustomCompoundBondIxn::ParticleTermInfo(yname.str(), i, 1, energyExpression.differentiate(yname.str()).createCompiledExpression()));
-        particleTerms.push_back(ReferenceCustomCompoundBondIxn::ParticleTermInfo(zname.str(), i, 2, energyExpression.differentiate(zname.str()).createCompiledExpression()));
+        particleTerms.push_back(ReferenceCustomCompoundBondIxn::ParticleTermInfo(xname.str(), i, 0, expressions.size()));
+        expressions.push_back(energyExpression.differentiate(xname.str()));
+        particleTerms.push_back(ReferenceCustomCompoundBondIxn::ParticleTermInfo(yname.str(), i, 1, expressions.size()));
+        expressions.push_back(energyExpression.differentiate(yname.str()));
+        particleTerms.push_back(ReferenceCustomCompoundBondIxn::ParticleTermInfo(zname.str(), i, 2, expressions.size()));
+        expressions.push_back(energyExpression.differentiate(zname.str()));
     }
-    for (auto& term : distances)
-        distanceTerms.push_back(ReferenceCustomCompoundBondIxn::DistanceTermInfo(term.first, term.second, energyExpression.differentiate(term.first).createCompiledExpression()));
-    for (auto& term : angles)
-        angleTerms.push_back(ReferenceCustomCompoundBondIxn::AngleTermInfo(term.first, term.second, energyExpression.differentiate(term.first).createCompiledExpression()));
-    for (auto& term : dihedrals)
-        dihedralTerms.push_back(ReferenceCustomCompoundBondIxn::DihedralTermInfo(term.first, term.second, energyExpression.differentiate(term.first).createCompiledExpression()));
-    for (int i = 0; i < particleTerms.size(); i++) {
-        expressionSet.registerExpression(particleTerms[i].forceExpression);
-        particleTerms[i].index = expressionSet.getVariableIndex(particleTerms[i].name);
+    for (auto& term : distances) {
+        distanceTerms.push_back(ReferenceCustomCompoundBondIxn::DistanceTermInfo(term.first, term.second, expressions.size()));
+        expressions.push_back(energyExpression.differentiate(term.first));
     }
-    for (int i = 0; i < distanceTerms.size(); i++) {
-        expressionSet.registerExpression(distanceTerms[i].forceExpression);
-        distanceTerms[i].index = expressionSet.getVariableIndex(distanceTerms[i].name);
+    for (auto& term : angles) {
+        angleTerms.push_back(ReferenceCustomCompoundBondIxn::AngleTermInfo(term.first, term.second, expressions.size()));
+        expressions.push_back(energyExpression.differentiate(term.first));
     }
-    for (int i = 0; i < angleTerms.size(); i++) {
-        expressionSet.registerExpression(angleTerms[i].forceExpression);
-        angleTerms[i].index = expressionSet.getVariableIndex(angleTerms[i].name);
+    for (auto& term : dihedrals) {
+        dihedralTerms.push_back(ReferenceCustomCompoundBondIxn::DihedralTermInfo(term.first, term.second, expressions.size()));
+        expressions.push_back(energyExpression.differentiate(term.first));
     }
-    for (int i = 0; i < dihedralTerms.size(); i++) {
-        expressionSet.registerExpression(dihedralTerms[i].forceExpression);
+    this->energyExpression = Lepton::CompiledExpression(expressions);
+    expressionSet.registerExpression(this->energyExpression);
+    for (int i = 0; i < this->energyParamDerivExpressions.size(); i++)
+        expressionSet.registerExpression(this->energyParamDerivExpressions[i]);
+    for (int i = 0; i < particleTerms.size(); i++)
+        particleTerms[i].index = expressionSet.getVariableIndex(particleTerms[i].name);
+    for (int i = 0; i < distanceTerms.size(); i++)
+        distanceTerms[i].index = expressionSet.getVariableIndex(distanceTerms[i].name);
+    for (int i = 0; i < angleTerms.size(); i++)
+        angleTerms[i].index = expressionSet.getVariableIndex(angleTerms[i].name);
+    for (int i = 0; i < dihedralTerms.size(); i++)
         dihedralTerms[i].index = expressionSet.getVariableIndex(dihedralTerms[i].name);
-    }
     numParameters = bondParameterNames.size();
     for (int i = 0; i < numParameters; i++)
         bondParamIndex.push_back(expressionSet.getVariableIndex(bondParameterNames[i]));
@@ -166,15 +172,19 @@ void ReferenceCustomCompoundBondIxn::calculateOneIxn(int bond, vector<Vec3>& ato
         expressionSet.setVariable(term.index,getDihedralAngleBetweenThreeVectors(term.delta1, term.delta2, term.delta3, crossProduct, &dotDihedral, term.delta1, &signOfDihedral, 1));
     }
     
+    // Evaluate the energy and all its derivatives.
+
+    double energy = energyExpression.evaluate();
+
     // Apply forces based on individual particle coordinates.
     
     for (auto& term : particleTerms)
-        forces[atoms[term.atom]][term.component] -= term.forceExpression.evaluate();
+        forces[atoms[term.atom]][term.component] -= energyExpression.getResult(term.forceIndex);
 
     // Apply forces based on distances.
 
     for (auto& term : distanceTerms) {
-        double dEdR = term.forceExpression.evaluate()/(term.delta[ReferenceForce::RIndex]);
+        double dEdR = energyExpression.getResult(term.forceIndex)/(term.delta[ReferenceForce::RIndex]);
         for (int i = 0; i < 3; i++) {
            double force  = -dEdR*term.delta[i];
            forces[atoms[term.p1]][i] -= force;
@@ -185,7 +195,7 @@ void ReferenceCustomCompoundBondIxn::calculateOneIxn(int bond, vector<Vec3>& ato
     // Apply forces based on angles.
 
     for (auto& term : angleTerms) {
-        double dEdTheta = term.forceExpression.evaluate();
+        double dEdTheta = energyExpression.getResult(term.forceIndex);
         double thetaCross[ReferenceForce::LastDeltaRIndex];
         SimTKOpenMMUtilities::crossProductVector3(term.delta1, term.delta2, thetaCross);
         double lengthThetaCross = sqrt(DOT3(thetaCross, thetaCross));
@@ -211,7 +221,7 @@ void ReferenceCustomCompoundBondIxn::calculateOneIxn(int bond, vector<Vec3>& ato
     // Apply forces based on dihedrals.
 
     for (auto& term : dihedralTerms) {
-        double dEdTheta = term.forceExpression.evaluate();
+        double dEdTheta = energyExpression.getResult(term.forceIndex);
         double internalF[4][3];
         double forceFactors[4];
         double normCross1 = DOT3(term.cross1, term.cross1);
@@ -241,7 +251,7 @@ void ReferenceCustomCompoundBondIxn::calculateOneIxn(int bond, vector<Vec3>& ato
     // Add the energy
 
     if (totalEnergy)
-        *totalEnergy += energyExpression.evaluate();
+        *totalEnergy += energy;
     
     // Compute derivatives of the energy.
     
@@ -47,7 +47,10 @@ public:
         return 0;
     }
     double evaluate(const double* arguments) const {
-        return energyParamDerivs[param];
+        // Use find() rather than operator[] so this can safely be called from multiple threads.
+
+        auto value = energyParamDerivs.find(param);
+        return (value == energyParamDerivs.end() ? 0.0 : value->second);
     }
     double evaluateDerivative(const double* arguments, const int* derivOrder) const {
         return 0;
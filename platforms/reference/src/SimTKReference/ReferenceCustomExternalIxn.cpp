@@ -28,6 +28,8 @@
 #include "SimTKOpenMMUtilities.h"
 #include "ReferenceCustomExternalIxn.h"
 #include "ReferenceForce.h"
+#include "openmm/OpenMMException.h"
+#include <cmath>
 
 using namespace std;
 using namespace OpenMM;
@@ -128,3 +130,45 @@ void ReferenceCustomExternalIxn::calculateForce(int atomIndex,
    if (energy != NULL)
        *energy += energyExpression.evaluate();
 }
+
+ReferenceCustomExternalIxn::PeriodicDistanceFunction::PeriodicDistanceFunction(Vec3** boxVectorHandle) : boxVectorHandle(boxVectorHandle) {
+}
+
+int ReferenceCustomExternalIxn::PeriodicDistanceFunction::getNumArguments() const {
+    return 6;
+}
+
+double ReferenceCustomExternalIxn::PeriodicDistanceFunction::evaluate(const double* arguments) const {
+    Vec3* boxVectors = *boxVectorHandle;
+    Vec3 delta = Vec3(arguments[0], arguments[1], arguments[2])-Vec3(arguments[3], arguments[4], arguments[5]);
+    delta -= boxVectors[2]*floor(delta[2]/boxVectors[2][2]+0.5);
+    delta -= boxVectors[1]*floor(delta[1]/boxVectors[1][1]+0.5);
+    delta -= boxVectors[0]*floor(delta[0]/boxVectors[0][0]+0.5);
+    return sqrt(delta.dot(delta));
+}
+
+double ReferenceCustomExternalIxn::PeriodicDistanceFunction::evaluateDerivative(const double* arguments, const int* derivOrder) const {
+    int argIndex = -1;
+    for (int i = 0; i < 6; i++) {
+        if (derivOrder[i] > 0) {
+            if (derivOrder[i] > 1 || argIndex != -1)
+                throw OpenMMException("Unsupported derivative of periodicdistance"); // Should be impossible for this to happen.
+            argIndex = i;
+        }
+    }
+    Vec3* boxVectors = *boxVectorHandle;
+    Vec3 delta = Vec3(arguments[0], arguments[1], arguments[2])-Vec3(arguments[3], arguments[4], arguments[5]);
+    delta -= boxVectors[2]*floor(delta[2]/boxVectors[2][2]+0.5);
+    delta -= boxVectors[1]*floor(delta[1]/boxVectors[1][1]+0.5);
+    delta -= boxVectors[0]*floor(delta[0]/boxVectors[0][0]+0.5);
+    double r = sqrt(delta.dot(delta));
+    if (r == 0)
+        return 0.0;    
+    if (argIndex < 3)
+        return delta[argIndex]/r;
+    return -delta[argIndex-3]/r;
+}
+
+Lepton::CustomFunction* ReferenceCustomExternalIxn::PeriodicDistanceFunction::clone() const {
+    return new PeriodicDistanceFunction(boxVectorHandle);
+}
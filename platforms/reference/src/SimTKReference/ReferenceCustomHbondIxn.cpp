@@ -29,6 +29,7 @@
 #include "SimTKOpenMMUtilities.h"
 #include "ReferenceForce.h"
 #include "ReferenceCustomHbondIxn.h"
+#include "ReferenceNeighborList.h"
 
 using std::map;
 using std::pair;
@@ -127,6 +128,20 @@ void ReferenceCustomHbondIxn::calculatePairIxn(vector<Vec3>& atomCoordinates, ve
    int numDonors = donorAtoms.size();
    int numAcceptors = acceptorAtoms.size();
 
+   // If there is a cutoff, find the acceptors near each donor.  The first numDonors points are the
+   // primary donor atoms, and the rest are the primary acceptor atoms.
+
+   vector<vector<int> > neighbors;
+   if (cutoff) {
+      vector<Vec3> points;
+      for (int donor = 0; donor < numDonors; donor++)
+         points.push_back(atomCoordinates[donorAtoms[donor][0]]);
+      for (int acceptor = 0; acceptor < numAcceptors; acceptor++)
+         points.push_back(atomCoordinates[acceptorAtoms[acceptor][0]]);
+      vector<set<int> > noExclusions(points.size());
+      computeNeighborsByAtom(neighbors, points.size(), points, noExclusions, periodicBoxVectors, periodic, cutoffDistance);
+   }
+
    for (int donor = 0; donor < numDonors; donor++) {
       // Initialize per-donor parameters.
 
@@ -135,7 +150,16 @@ void ReferenceCustomHbondIxn::calculatePairIxn(vector<Vec3>& atomCoordinates, ve
 
       // loop over atom pairs
 
-      for (int acceptor = 0; acceptor < numAcceptors; acceptor++) {
+      vector<int> acceptors;
+      if (cutoff) {
+         for (int neighbor : neighbors[donor])
+            if (neighbor >= numDonors)
+               acceptors.push_back(neighbor-numDonors);
+      }
+      else
+         for (int acceptor = 0; acceptor < numAcceptors; acceptor++)
+            acceptors.push_back(acceptor);
+      for (int acceptor : acceptors) {
          if (exclusions[donor].find(acceptor) == exclusions[donor].end()) {
              for (int j = 0; j < (int) acceptorParamNames.size(); j++)
                  variables[acceptorParamNames[j]] = acceptorParameters[acceptor][j];
@@ -29,6 +29,7 @@
 #include "SimTKOpenMMUtilities.h"
 #include "ReferenceForce.h"
 #include "ReferenceCustomManyParticleIxn.h"
+#include "ReferenceNeighborList.h"
 #include "ReferenceTabulatedFunction.h"
 #include "openmm/internal/CustomManyParticleForceImpl.h"
 #include "lepton/CustomFunction.h"
@@ -110,7 +111,16 @@ void ReferenceCustomManyParticleIxn::calculateIxn(vector<Vec3>& atomCoordinates,
                                                   double* totalEnergy) const {
     map<string, double> variables = globalParameters;
     vector<int> particles(numParticlesPerSet);
-    loopOverInteractions(particles, 0, atomCoordinates, particleParameters, variables, forces, totalEnergy);
+    if (useCutoff) {
+        // Every particle in an interaction must be within the cutoff of the first one, so we only
+        // need to consider its neighbors.
+
+        vector<vector<int> > neighbors;
+        computeNeighborsByAtom(neighbors, atomCoordinates.size(), atomCoordinates, exclusions, periodicBoxVectors, usePeriodic, cutoffDistance);
+        loopOverInteractions(particles, 0, atomCoordinates, particleParameters, variables, forces, totalEnergy, &neighbors);
+    }
+    else
+        loopOverInteractions(particles, 0, atomCoordinates, particleParameters, variables, forces, totalEnergy, NULL);
 }
 
 void ReferenceCustomManyParticleIxn::setUseCutoff(double distance) {
@@ -131,10 +141,22 @@ void ReferenceCustomManyParticleIxn::setPeriodic(Vec3* vectors) {
 
 void ReferenceCustomManyParticleIxn::loopOverInteractions(vector<int>& particles, int loopIndex, vector<OpenMM::Vec3>& atomCoordinates,
                                                           vector<vector<double> >& particleParameters, map<string, double>& variables, vector<OpenMM::Vec3>& forces,
-                                                          double* totalEnergy) const {
+                                                          double* totalEnergy, const vector<vector<int> >* neighbors) const {
     int numParticles = atomCoordinates.size();
     int firstPartialLoop = (centralParticleMode ? 2 : 1);
     int start = (loopIndex < firstPartialLoop ? 0 : particles[loopIndex-1]+1);
+    if (neighbors != NULL && loopIndex > 0) {
+        for (int i : (*neighbors)[particles[0]]) {
+            if (i < start)
+                continue;
+            particles[loopIndex] = i;
+            if (loopIndex == numParticlesPerSet-1)
+                calculateOneIxn(particles, atomCoordinates, particleParameters, variables, forces, totalEnergy);
+            else
+                loopOverInteractions(particles, loopIndex+1, atomCoordinates, particleParameters, variables, forces, totalEnergy, neighbors);
+        }
+        return;
+    }
     for (int i = start; i < numParticles; i++) {
         if (loopIndex > 0 && i == particles[0])
             continue;
@@ -142,7 +164,7 @@ void ReferenceCustomManyParticleIxn::loopOverInteractions(vector<int>& particles
         if (loopIndex == numParticlesPerSet-1)
             calculateOneIxn(particles, atomCoordinates, particleParameters, variables, forces, totalEnergy);
         else
-            loopOverInteractions(particles, loopIndex+1, atomCoordinates, particleParameters, variables, forces, totalEnergy);
+            loopOverInteractions(particles, loopIndex+1, atomCoordinates, particleParameters, variables, forces, totalEnergy, neighbors);
     }
 }
 
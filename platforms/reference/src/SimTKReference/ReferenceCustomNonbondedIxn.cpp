@@ -28,6 +28,7 @@
 #include "SimTKOpenMMUtilities.h"
 #include "ReferenceForce.h"
 #include "ReferenceCustomNonbondedIxn.h"
+#include "ReferencePairLoop.h"
 
 using std::map;
 using std::pair;
@@ -47,7 +48,7 @@ ReferenceCustomNonbondedIxn::ReferenceCustomNonbondedIxn(const Lepton::CompiledE
         const Lepton::CompiledExpression& forceExpression, const vector<string>& parameterNames,
         const vector<Lepton::CompiledExpression> energyParamDerivExpressions) :
             cutoff(false), useSwitch(false), periodic(false), energyExpression(energyExpression), forceExpression(forceExpression),
-            paramNames(parameterNames), energyParamDerivExpressions(energyParamDerivExpressions) {
+            paramNames(parameterNames), energyParamDerivExpressions(energyParamDerivExpressions), threads(NULL) {
     expressionSet.registerExpression(this->energyExpression);
     expressionSet.registerExpression(this->forceExpression);
     for (int i = 0; i < this->energyParamDerivExpressions.size(); i++)
@@ -136,6 +137,10 @@ void ReferenceCustomNonbondedIxn::setUseSwitchingFunction(double distance) {
 
   }
 
+void ReferenceCustomNonbondedIxn::setThreadPool(ThreadPool* pool) {
+    threads = pool;
+}
+
 
 /**---------------------------------------------------------------------------------------
 
@@ -157,11 +162,39 @@ void ReferenceCustomNonbondedIxn::calculatePairIxn(int numberOfAtoms, vector<Vec
                                              const map<string, double>& globalParameters, vector<Vec3>& forces,
                                              double* totalEnergy, double* energyParamDerivs) {
 
-    for (auto& param : globalParameters)
-        expressionSet.setVariable(expressionSet.getVariableIndex(param.first), param.second);
+    // Each thread needs its own copy of the expressions, since evaluating them modifies the variables.
+
+    int numThreads = (threads == NULL ? 1 : threads->getNumThreads());
+    if (interactionGroups.size() > 0)
+        numThreads = 1;
+    if (numThreads > 1 && threadIxns.size() != numThreads) {
+        threadIxns.clear();
+        for (int i = 0; i < numThreads; i++)
+            threadIxns.push_back(std::unique_ptr<ReferenceCustomNonbondedIxn>(new ReferenceCustomNonbondedIxn(energyExpression, forceExpression, paramNames, energyParamDerivExpressions)));
+    }
+    vector<ReferenceCustomNonbondedIxn*> ixns;
+    if (numThreads > 1) {
+        for (auto& ixn : threadIxns) {
+            ixn->cutoff = cutoff;
+            ixn->useSwitch = useSwitch;
+            ixn->periodic = periodic;
+            ixn->cutoffDistance = cutoffDistance;
+            ixn->switchingDistance = switchingDistance;
+            for (int i = 0; i < 3; i++)
+                ixn->periodicBoxVectors[i] = periodicBoxVectors[i];
+            ixns.push_back(ixn.get());
+        }
+    }
+    else
+        ixns.push_back(this);
+    for (ReferenceCustomNonbondedIxn* ixn : ixns)
+        for (auto& param : globalParameters)
+            ixn->expressionSet.setVariable(ixn->expressionSet.getVariableIndex(param.first), param.second);
+    ThreadPool* pool = (numThreads > 1 ? threads : NULL);
     if (interactionGroups.size() > 0) { 
         // The user has specified interaction groups, so compute only the requested interactions.
         
+        PairResult result;
         for (auto& group : interactionGroups) {
             const set<int>& set1 = group.first;
             const set<int>& set2 = group.second;
@@ -171,11 +204,8 @@ void ReferenceCustomNonbondedIxn::calculatePairIxn(int numberOfAtoms, vector<Vec
                         continue; // This is an excluded interaction.
                     if (*atom1 > *atom2 && set1.find(*atom2) != set1.end() && set2.find(*atom1) != set2.end())
                         continue; // Both atoms are in both sets, so skip duplicate interactions.
-                    for (int j = 0; j < (int) paramNames.size(); j++) {
-                        expressionSet.setVariable(particleParamIndex[j*2], atomParameters[*atom1][j]);
-                        expressionSet.setVariable(particleParamIndex[j*2+1], atomParameters[*atom2][j]);
-                    }
-                    calculateOneIxn(*atom1, *atom2, atomCoordinates, forces, totalEnergy, energyParamDerivs);
+                    calculateOneIxn(*atom1, *atom2, atomCoordinates, atomParameters, result);
+                    accumulateOneIxn(*atom1, *atom2, result, forces, totalEnergy, energyParamDerivs);
                 }
             }
         }
@@ -183,27 +213,26 @@ void ReferenceCustomNonbondedIxn::calculatePairIxn(int numberOfAtoms, vector<Vec
     else if (cutoff) {
         // We are using a cutoff, so get the interactions from the neighbor list.
         
-        for (auto& pair : *neighborList) {
-            for (int j = 0; j < (int) paramNames.size(); j++) {
-                expressionSet.setVariable(particleParamIndex[j*2], atomParameters[pair.first][j]);
-                expressionSet.setVariable(particleParamIndex[j*2+1], atomParameters[pair.second][j]);
-            }
-            calculateOneIxn(pair.first, pair.second, atomCoordinates, forces, totalEnergy, energyParamDerivs);
-        }
+        const NeighborList& pairs = *neighborList;
+        computePairsInOrder<PairResult>(pool, pairs.size(), [&] (int threadIndex, int pairIndex, PairResult& result) {
+            ixns[threadIndex]->calculateOneIxn(pairs[pairIndex].first, pairs[pairIndex].second, atomCoordinates, atomParameters, result);
+        }, [&] (int pairIndex, PairResult& result) {
+            accumulateOneIxn(pairs[pairIndex].first, pairs[pairIndex].second, result, forces, totalEnergy, energyParamDerivs);
+        });
     }
     else {
         // Every particle interacts with every other one.
         
         for (int ii = 0; ii < numberOfAtoms; ii++) {
-            for (int jj = ii+1; jj < numberOfAtoms; jj++) {
-                if (exclusions[jj].find(ii) == exclusions[jj].end()) {
-                    for (int j = 0; j < (int) paramNames.size(); j++) {
-                        expressionSet.setVariable(particleParamIndex[j*2], atomParameters[ii][j]);
-                        expressionSet.setVariable(particleParamIndex[j*2+1], atomParameters[jj][j]);
-                    }
-                    calculateOneIxn(ii, jj, atomCoordinates, forces, totalEnergy, energyParamDerivs);
-                }
-            }
+            computePairsInOrder<PairResult>(pool, numberOfAtoms-ii-1, [&] (int threadIndex, int index, PairResult& result) {
+                int jj = ii+1+index;
+                if (exclusions[jj].find(ii) == exclusions[jj].end())
+                    ixns[threadIndex]->calculateOneIxn(ii, jj, atomCoordinates, atomParameters, result);
+                else
+                    result.include = false;
+            }, [&] (int index, PairResult& result) {
+                accumulateOneIxn(ii, ii+1+index, result, forces, totalEnergy, energyParamDerivs);
+            });
         }
     }
 }
@@ -215,13 +244,14 @@ void ReferenceCustomNonbondedIxn::calculatePairIxn(int numberOfAtoms, vector<Vec
      @param ii               the index of the first atom
      @param jj               the index of the second atom
      @param atomCoordinates  atom coordinates
-     @param forces           force array (forces added)
-     @param totalEnergy      total energy
+     @param atomParameters   atom parameters
+     @param result           on exit, the force on atom ii and the contributions to the energy
+                             and its derivatives
 
      --------------------------------------------------------------------------------------- */
 
-void ReferenceCustomNonbondedIxn::calculateOneIxn(int ii, int jj, vector<Vec3>& atomCoordinates, vector<Vec3>& forces,
-                        double* totalEnergy, double* energyParamDerivs) {
+void ReferenceCustomNonbondedIxn::calculateOneIxn(int ii, int jj, const vector<Vec3>& atomCoordinates,
+                        const vector<vector<double> >& atomParameters, PairResult& result) {
     // get deltaR, R2, and R between 2 atoms
 
     double deltaR[ReferenceForce::LastDeltaRIndex];
@@ -230,10 +260,15 @@ void ReferenceCustomNonbondedIxn::calculateOneIxn(int ii, int jj, vector<Vec3>&
     else
         ReferenceForce::getDeltaR(atomCoordinates[jj], atomCoordinates[ii], deltaR);
     double r = deltaR[ReferenceForce::RIndex];
-    if (cutoff && r >= cutoffDistance)
+    result.include = !(cutoff && r >= cutoffDistance);
+    if (!result.include)
         return;
+    for (int j = 0; j < (int) paramNames.size(); j++) {
+        expressionSet.setVariable(particleParamIndex[j*2], atomParameters[ii][j]);
+        expressionSet.setVariable(particleParamIndex[j*2+1], atomParameters[jj][j]);
+    }
 
-    // accumulate forces
+    // compute forces
 
     expressionSet.setVariable(rIndex, r);
     double dEdR = forceExpression.evaluate()/(deltaR[ReferenceForce::RIndex]);
@@ -248,18 +283,30 @@ void ReferenceCustomNonbondedIxn::calculateOneIxn(int ii, int jj, vector<Vec3>&
             energy *= switchValue;
         }
     }
+    for (int kk = 0; kk < 3; kk++)
+       result.force[kk] = -dEdR*deltaR[kk];
+    result.energyParamDerivs.resize(energyParamDerivExpressions.size());
+    for (int i = 0; i < energyParamDerivExpressions.size(); i++)
+        result.energyParamDerivs[i] = switchValue*energyParamDerivExpressions[i].evaluate();
+    result.energy = energy;
+}
+
+void ReferenceCustomNonbondedIxn::accumulateOneIxn(int ii, int jj, const PairResult& result, vector<Vec3>& forces,
+                        double* totalEnergy, double* energyParamDerivs) const {
+    if (!result.include)
+        return;
+
+    // accumulate forces
+
     for (int kk = 0; kk < 3; kk++) {
-       double force = -dEdR*deltaR[kk];
-       forces[ii][kk] += force;
-       forces[jj][kk] -= force;
+       forces[ii][kk] += result.force[kk];
+       forces[jj][kk] -= result.force[kk];
     }
     for (int i = 0; i < energyParamDerivExpressions.size(); i++)
-        energyParamDerivs[i] += switchValue*energyParamDerivExpressions[i].evaluate();
+        energyParamDerivs[i] += result.energyParamDerivs[i];
 
     // accumulate energies
 
     if (totalEnergy)
-        *totalEnergy += energy;
-  }
-
-
+        *totalEnergy += result.energy;
+}
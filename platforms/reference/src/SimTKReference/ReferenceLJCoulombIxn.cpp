@@ -31,6 +31,7 @@
 #include "SimTKOpenMMUtilities.h"
 #include "ReferenceLJCoulombIxn.h"
 #include "ReferenceForce.h"
+#include "ReferencePairLoop.h"
 #include "ReferencePME.h"
 #include "openmm/OpenMMException.h"
 
@@ -48,7 +49,7 @@ using namespace OpenMM;
 
    --------------------------------------------------------------------------------------- */
 
-ReferenceLJCoulombIxn::ReferenceLJCoulombIxn() : cutoff(false), useSwitch(false), periodic(false), periodicExceptions(false), ewald(false), pme(false), ljpme(false) {
+ReferenceLJCoulombIxn::ReferenceLJCoulombIxn() : cutoff(false), useSwitch(false), periodic(false), periodicExceptions(false), ewald(false), pme(false), ljpme(false), threads(NULL) {
 }
 
 /**---------------------------------------------------------------------------------------
@@ -139,14 +140,16 @@ void ReferenceLJCoulombIxn::setUseEwald(double alpha, int kmaxx, int kmaxy, int
 
      @param alpha  the Ewald separation parameter
      @param gridSize the dimensions of the mesh
+     @param order  the B-spline interpolation order
 
      --------------------------------------------------------------------------------------- */
 
-void ReferenceLJCoulombIxn::setUsePME(double alpha, int meshSize[3]) {
+void ReferenceLJCoulombIxn::setUsePME(double alpha, int meshSize[3], int order) {
     alphaEwald = alpha;
     meshDim[0] = meshSize[0];
     meshDim[1] = meshSize[1];
     meshDim[2] = meshSize[2];
+    pmeOrder = order;
     pme = true;
 }
 
@@ -156,14 +159,16 @@ void ReferenceLJCoulombIxn::setUsePME(double alpha, int meshSize[3]) {
 
      @param alpha  the dispersion Ewald separation parameter
      @param gridSize the dimensions of the dispersion mesh
+     @param order  the B-spline interpolation order
 
      --------------------------------------------------------------------------------------- */
 
-void ReferenceLJCoulombIxn::setUseLJPME(double alpha, int meshSize[3]) {
+void ReferenceLJCoulombIxn::setUseLJPME(double alpha, int meshSize[3], int order) {
     alphaDispersionEwald = alpha;
     dispersionMeshDim[0] = meshSize[0];
     dispersionMeshDim[1] = meshSize[1];
     dispersionMeshDim[2] = meshSize[2];
+    dispersionPmeOrder = order;
     ljpme = true;
 }
 
@@ -171,6 +176,10 @@ void ReferenceLJCoulombIxn::setPeriodicExceptions(bool periodic) {
     periodicExceptions = periodic;
 }
 
+void ReferenceLJCoulombIxn::setThreadPool(ThreadPool* pool) {
+    threads = pool;
+}
+
 /**---------------------------------------------------------------------------------------
 
    Calculate Ewald ixn
@@ -205,7 +214,6 @@ void ReferenceLJCoulombIxn::calculateEwaldIxn(int numberOfAtoms, vector<Vec3>& a
     double recipEnergy              = 0.0;
     double recipDispersionEnergy    = 0.0;
     double totalRecipEnergy         = 0.0;
-    double vdwEnergy                = 0.0;
 
     // A couple of sanity checks for
     if(ljpme && useSwitch)
@@ -240,7 +248,7 @@ void ReferenceLJCoulombIxn::calculateEwaldIxn(int numberOfAtoms, vector<Vec3>& a
     if (pme && includeReciprocal) {
         pme_t          pmedata; /* abstract handle for PME data */
 
-        pme_init(&pmedata,alphaEwald,numberOfAtoms,meshDim,5,1);
+        pme_init(&pmedata,alphaEwald,numberOfAtoms,meshDim,pmeOrder,1);
 
         vector<double> charges(numberOfAtoms);
         for (int i = 0; i < numberOfAtoms; i++)
@@ -254,7 +262,7 @@ void ReferenceLJCoulombIxn::calculateEwaldIxn(int numberOfAtoms, vector<Vec3>& a
 
         if (ljpme) {
             // Dispersion reciprocal space terms
-            pme_init(&pmedata,alphaDispersionEwald,numberOfAtoms,dispersionMeshDim,5,1);
+            pme_init(&pmedata,alphaDispersionEwald,numberOfAtoms,dispersionMeshDim,dispersionPmeOrder,1);
 
             std::vector<Vec3> dpmeforces(numberOfAtoms);
             for (int i = 0; i < numberOfAtoms; i++)
@@ -375,10 +383,17 @@ void ReferenceLJCoulombIxn::calculateEwaldIxn(int numberOfAtoms, vector<Vec3>& a
     double totalVdwEnergy            = 0.0f;
     double totalRealSpaceEwaldEnergy = 0.0f;
 
+    // Each pair is evaluated independently (possibly on a worker thread), then the results are added
+    // into the forces and energy in neighbor list order.
 
-    for (auto& pair : *neighborList) {
-        int ii = pair.first;
-        int jj = pair.second;
+    struct PairResult {
+        double force[3];
+        double vdwEnergy, realSpaceEwaldEnergy;
+    };
+    const NeighborList& pairs = *neighborList;
+    computePairsInOrder<PairResult>(threads, pairs.size(), [&] (int threadIndex, int pairIndex, PairResult& result) {
+        int ii = pairs[pairIndex].first;
+        int jj = pairs[pairIndex].second;
 
         double deltaR[2][ReferenceForce::LastDeltaRIndex];
         ReferenceForce::getDeltaRPeriodic(atomCoordinates[jj], atomCoordinates[ii], periodicBoxVectors, deltaR[0]);
@@ -402,7 +417,7 @@ void ReferenceLJCoulombIxn::calculateEwaldIxn(int numberOfAtoms, vector<Vec3>& a
         double sig6 = sig2*sig2*sig2;
         double eps = atomParameters[ii][EpsIndex]*atomParameters[jj][EpsIndex];
         dEdR += switchValue*eps*(12.0*sig6 - 6.0)*sig6*inverseR*inverseR;
-        vdwEnergy = eps*(sig6-1.0)*sig6;
+        double vdwEnergy = eps*(sig6-1.0)*sig6;
 
         if (ljpme) {
             double dalphaR   = alphaDispersionEwald * r;
@@ -438,23 +453,26 @@ void ReferenceLJCoulombIxn::calculateEwaldIxn(int numberOfAtoms, vector<Vec3>& a
             dEdR -= vdwEnergy*switchDeriv*inverseR;
             vdwEnergy *= switchValue;
         }
+        for (int kk = 0; kk < 3; kk++)
+            result.force[kk] = dEdR*deltaR[0][kk];
+        result.vdwEnergy = vdwEnergy;
+        result.realSpaceEwaldEnergy = ONE_4PI_EPS0*atomParameters[ii][QIndex]*atomParameters[jj][QIndex]*inverseR*erfc(alphaR);
+    }, [&] (int pairIndex, PairResult& result) {
+        int ii = pairs[pairIndex].first;
+        int jj = pairs[pairIndex].second;
 
         // accumulate forces
 
         for (int kk = 0; kk < 3; kk++) {
-            double force  = dEdR*deltaR[0][kk];
-            forces[ii][kk]   += force;
-            forces[jj][kk]   -= force;
+            forces[ii][kk]   += result.force[kk];
+            forces[jj][kk]   -= result.force[kk];
         }
 
         // accumulate energies
 
-        realSpaceEwaldEnergy        = ONE_4PI_EPS0*atomParameters[ii][QIndex]*atomParameters[jj][QIndex]*inverseR*erfc(alphaR);
-
-        totalVdwEnergy             += vdwEnergy;
-        totalRealSpaceEwaldEnergy  += realSpaceEwaldEnergy;
-
-    }
+        totalVdwEnergy             += result.vdwEnergy;
+        totalRealSpaceEwaldEnergy  += result.realSpaceEwaldEnergy;
+    });
 
     if (totalEnergy)
         *totalEnergy += totalRealSpaceEwaldEnergy + totalVdwEnergy;
@@ -551,17 +569,40 @@ void ReferenceLJCoulombIxn::calculatePairIxn(int numberOfAtoms, vector<Vec3>& at
     }
     if (!includeDirect)
         return;
+    struct PairResult {
+        bool include;
+        double force[3];
+        double energy;
+    };
+    auto accumulate = [&] (int ii, int jj, const PairResult& result) {
+        for (int kk = 0; kk < 3; kk++) {
+            forces[ii][kk]   += result.force[kk];
+            forces[jj][kk]   -= result.force[kk];
+        }
+        if (totalEnergy)
+            *totalEnergy += result.energy;
+    };
     if (cutoff) {
-        for (auto& pair : *neighborList)
-            calculateOneIxn(pair.first, pair.second, atomCoordinates, atomParameters, forces, totalEnergy);
+        const NeighborList& pairs = *neighborList;
+        computePairsInOrder<PairResult>(threads, pairs.size(), [&] (int threadIndex, int pairIndex, PairResult& result) {
+            calculateOneIxn(pairs[pairIndex].first, pairs[pairIndex].second, atomCoordinates, atomParameters, result.force, result.energy);
+        }, [&] (int pairIndex, PairResult& result) {
+            accumulate(pairs[pairIndex].first, pairs[pairIndex].second, result);
+        });
     }
     else {
         for (int ii = 0; ii < numberOfAtoms; ii++) {
             // loop over atom pairs
 
-            for (int jj = ii+1; jj < numberOfAtoms; jj++)
-                if (exclusions[jj].find(ii) == exclusions[jj].end())
-                    calculateOneIxn(ii, jj, atomCoordinates, atomParameters, forces, totalEnergy);
+            computePairsInOrder<PairResult>(threads, numberOfAtoms-ii-1, [&] (int threadIndex, int index, PairResult& result) {
+                int jj = ii+1+index;
+                result.include = (exclusions[jj].find(ii) == exclusions[jj].end());
+                if (result.include)
+                    calculateOneIxn(ii, jj, atomCoordinates, atomParameters, result.force, result.energy);
+            }, [&] (int index, PairResult& result) {
+                if (result.include)
+                    accumulate(ii, ii+1+index, result);
+            });
         }
     }
 }
@@ -574,14 +615,14 @@ void ReferenceLJCoulombIxn::calculatePairIxn(int numberOfAtoms, vector<Vec3>& at
      @param jj               the index of the second atom
      @param atomCoordinates  atom coordinates
      @param atomParameters   atom parameters (charges, c6, c12, ...)     atomParameters[atomIndex][paramterIndex]
-     @param forces           force array (forces added)
-     @param totalEnergy      total energy
+     @param force            on exit, the force on atom ii (the force on atom jj is its negative)
+     @param energy           on exit, the interaction energy
 
      --------------------------------------------------------------------------------------- */
 
-void ReferenceLJCoulombIxn::calculateOneIxn(int ii, int jj, vector<Vec3>& atomCoordinates,
-                                            vector<vector<double> >& atomParameters, vector<Vec3>& forces,
-                                            double* totalEnergy) const {
+void ReferenceLJCoulombIxn::calculateOneIxn(int ii, int jj, const vector<Vec3>& atomCoordinates,
+                                            const vector<vector<double> >& atomParameters, double* force,
+                                            double& energy) const {
     double deltaR[2][ReferenceForce::LastDeltaRIndex];
 
     // get deltaR, R2, and R between 2 atoms
@@ -614,7 +655,7 @@ void ReferenceLJCoulombIxn::calculateOneIxn(int ii, int jj, vector<Vec3>& atomCo
     else
         dEdR += ONE_4PI_EPS0*atomParameters[ii][QIndex]*atomParameters[jj][QIndex]*inverseR;
     dEdR     *= inverseR*inverseR;
-    double energy = eps*(sig6-1.0)*sig6;
+    energy = eps*(sig6-1.0)*sig6;
     if (useSwitch) {
         dEdR -= energy*switchDeriv*inverseR;
         energy *= switchValue;
@@ -624,17 +665,6 @@ void ReferenceLJCoulombIxn::calculateOneIxn(int ii, int jj, vector<Vec3>& atomCo
     else
         energy += ONE_4PI_EPS0*atomParameters[ii][QIndex]*atomParameters[jj][QIndex]*inverseR;
 
-    // accumulate forces
-
-    for (int kk = 0; kk < 3; kk++) {
-        double force  = dEdR*deltaR[0][kk];
-        forces[ii][kk]   += force;
-        forces[jj][kk]   -= force;
-    }
-
-    // accumulate energies
-
-    if (totalEnergy)
-        *totalEnergy += energy;
+    for (int kk = 0; kk < 3; kk++)
+        force[kk] = dEdR*deltaR[0][kk];
 }
-
@@ -29,6 +29,7 @@
 #include "ReferenceDynamics.h"
 #include "openmm/OpenMMException.h"
 
+using std::pair;
 using std::vector;
 using namespace OpenMM;
 
@@ -91,30 +92,50 @@ void ReferenceLincsAlgorithm::setNumTerms(int terms) {
 
 /**---------------------------------------------------------------------------------------
 
-   Initialize internal data structures.
+   Find which constraints are coupled to each other by sharing an atom.
 
    @param numberOfAtoms    number of atoms
-   @param inverseMasses    1/mass
+   @param atomIndices      the two atoms involved in each constraint
+
+   @return for each constraint, the indices of all other constraints that share an atom with it
 
    --------------------------------------------------------------------------------------- */
 
-void ReferenceLincsAlgorithm::initialize(int numberOfAtoms, vector<double>& inverseMasses) {
-    _hasInitialized = true;
+vector<vector<int> > ReferenceLincsAlgorithm::findLinkedConstraints(int numberOfAtoms, const vector<pair<int, int> >& atomIndices) {
+    int numberOfConstraints = atomIndices.size();
     vector<vector<int> > atomConstraints(numberOfAtoms);
-    for (int constraint = 0; constraint < _numberOfConstraints; constraint++) {
-        atomConstraints[_atomIndices[constraint][0]].push_back(constraint);
-        atomConstraints[_atomIndices[constraint][1]].push_back(constraint);
+    for (int constraint = 0; constraint < numberOfConstraints; constraint++) {
+        atomConstraints[atomIndices[constraint].first].push_back(constraint);
+        atomConstraints[atomIndices[constraint].second].push_back(constraint);
     }
-    _linkedConstraints.resize(_numberOfConstraints);
+    vector<vector<int> > linkedConstraints(numberOfConstraints);
     for (int atom = 0; atom < numberOfAtoms; atom++) {
         for (int i = 0; i < (int)atomConstraints[atom].size(); i++)
             for (int j = 0; j < i; j++) {
                 int c1 = atomConstraints[atom][i];
                 int c2 = atomConstraints[atom][j];
-                _linkedConstraints[c1].push_back(c2);
-                _linkedConstraints[c2].push_back(c1);
+                linkedConstraints[c1].push_back(c2);
+                linkedConstraints[c2].push_back(c1);
             }
     }
+    return linkedConstraints;
+}
+
+/**---------------------------------------------------------------------------------------
+
+   Initialize internal data structures.
+
+   @param numberOfAtoms    number of atoms
+   @param inverseMasses    1/mass
+
+   --------------------------------------------------------------------------------------- */
+
+void ReferenceLincsAlgorithm::initialize(int numberOfAtoms, vector<double>& inverseMasses) {
+    _hasInitialized = true;
+    vector<pair<int, int> > atomIndices(_numberOfConstraints);
+    for (int constraint = 0; constraint < _numberOfConstraints; constraint++)
+        atomIndices[constraint] = std::make_pair(_atomIndices[constraint][0], _atomIndices[constraint][1]);
+    _linkedConstraints = findLinkedConstraints(numberOfAtoms, atomIndices);
     _sMatrix.resize(_numberOfConstraints);
     for (int constraint = 0; constraint < _numberOfConstraints; constraint++)
         _sMatrix[constraint] = 1.0/sqrt(inverseMasses[_atomIndices[constraint][0]]+inverseMasses[_atomIndices[constraint][1]]);
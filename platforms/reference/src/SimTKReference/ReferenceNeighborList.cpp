@@ -258,4 +258,28 @@ void OPENMM_EXPORT computeNeighborListVoxelHash(
     }
 }
 
+// Find the neighbors of every atom using a voxel hash, and return them as one sorted list per atom
+void OPENMM_EXPORT computeNeighborsByAtom(
+                              vector<vector<int> >& neighbors,
+                              int nAtoms,
+                              const AtomLocationList& atomLocations,
+                              const vector<set<int> >& exclusions,
+                              const Vec3* periodicBoxVectors,
+                              bool usePeriodic,
+                              double maxDistance
+                            )
+{
+    NeighborList neighborList;
+    computeNeighborListVoxelHash(neighborList, nAtoms, atomLocations, exclusions, periodicBoxVectors, usePeriodic, maxDistance);
+    neighbors.resize(nAtoms);
+    for (auto& list : neighbors)
+        list.clear();
+    for (auto& pair : neighborList) {
+        neighbors[pair.first].push_back(pair.second);
+        neighbors[pair.second].push_back(pair.first);
+    }
+    for (auto& list : neighbors)
+        sort(list.begin(), list.end());
+}
+
 } // namespace OpenMM
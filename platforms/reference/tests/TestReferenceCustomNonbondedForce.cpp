@@ -32,5 +32,54 @@
 #include "ReferenceTests.h"
 #include "TestCustomNonbondedForce.h"
 
+void testThreadsGiveIdenticalResults(CustomNonbondedForce::NonbondedMethod method) {
+    const int numParticles = 600;
+    const double boxSize = 3.5;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    CustomNonbondedForce* custom = new CustomNonbondedForce("scale*4*eps*((sigma/r)^12-(sigma/r)^6); sigma=0.5*(sigma1+sigma2); eps=sqrt(eps1*eps2)");
+    custom->addPerParticleParameter("sigma");
+    custom->addPerParticleParameter("eps");
+    custom->addGlobalParameter("scale", 1.5);
+    custom->addEnergyParameterDerivative("scale");
+    custom->setNonbondedMethod(method);
+    custom->setCutoffDistance(1.0);
+    custom->setUseSwitchingFunction(true);
+    custom->setSwitchingDistance(0.9);
+    vector<Vec3> positions(numParticles);
+    vector<double> params(2);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        params[0] = (i%2 == 0 ? 0.2 : 0.22);
+        params[1] = (i%3 == 0 ? 0.1 : 0.15);
+        custom->addParticle(params);
+        positions[i] = Vec3(genrand_real2(sfmt), genrand_real2(sfmt), genrand_real2(sfmt))*boxSize;
+    }
+    for (int i = 0; i < numParticles-1; i += 2)
+        custom->addExclusion(i, i+1);
+    system.addForce(custom);
+
+    // The forces, energy, and parameter derivatives should be bitwise identical for any number of threads.
+
+    VerletIntegrator integrator1(0.001);
+    Context context1(system, integrator1, platform);
+    context1.setPositions(positions);
+    State state1 = context1.getState(State::Forces | State::Energy | State::ParameterDerivatives);
+    map<string, string> properties;
+    properties[ReferencePlatform::ReferenceThreads()] = "4";
+    VerletIntegrator integrator2(0.001);
+    Context context2(system, integrator2, platform, properties);
+    context2.setPositions(positions);
+    State state2 = context2.getState(State::Forces | State::Energy | State::ParameterDerivatives);
+    ASSERT(state1.getPotentialEnergy() == state2.getPotentialEnergy());
+    ASSERT(state1.getEnergyParameterDerivatives().at("scale") == state2.getEnergyParameterDerivatives().at("scale"));
+    for (int i = 0; i < numParticles; i++)
+        ASSERT(state1.getForces()[i] == state2.getForces()[i]);
+}
+
 void runPlatformTests() {
+    testThreadsGiveIdenticalResults(CustomNonbondedForce::NoCutoff);
+    testThreadsGiveIdenticalResults(CustomNonbondedForce::CutoffPeriodic);
 }
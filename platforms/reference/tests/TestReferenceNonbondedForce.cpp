@@ -32,5 +32,49 @@
 #include "ReferenceTests.h"
 #include "TestNonbondedForce.h"
 
+void testThreadsGiveIdenticalResults(NonbondedForce::NonbondedMethod method) {
+    const int numParticles = 600;
+    const double boxSize = 3.5;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(method);
+    nonbonded->setCutoffDistance(1.0);
+    nonbonded->setUseSwitchingFunction(true);
+    nonbonded->setSwitchingDistance(0.9);
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle(i%2 == 0 ? 0.5 : -0.5, 0.2, 0.1);
+        positions[i] = Vec3(genrand_real2(sfmt), genrand_real2(sfmt), genrand_real2(sfmt))*boxSize;
+    }
+    for (int i = 0; i < numParticles-1; i += 2)
+        nonbonded->addException(i, i+1, 0.0, 1.0, 0.0);
+    system.addForce(nonbonded);
+
+    // The forces and energy should be bitwise identical for any number of threads.
+
+    VerletIntegrator integrator1(0.001);
+    Context context1(system, integrator1, platform);
+    ASSERT_EQUAL("1", platform.getPropertyValue(context1, ReferencePlatform::ReferenceThreads()));
+    context1.setPositions(positions);
+    State state1 = context1.getState(State::Forces | State::Energy);
+    map<string, string> properties;
+    properties[ReferencePlatform::ReferenceThreads()] = "4";
+    VerletIntegrator integrator2(0.001);
+    Context context2(system, integrator2, platform, properties);
+    ASSERT_EQUAL("4", platform.getPropertyValue(context2, ReferencePlatform::ReferenceThreads()));
+    context2.setPositions(positions);
+    State state2 = context2.getState(State::Forces | State::Energy);
+    ASSERT(state1.getPotentialEnergy() == state2.getPotentialEnergy());
+    for (int i = 0; i < numParticles; i++)
+        ASSERT(state1.getForces()[i] == state2.getForces()[i]);
+}
+
 void runPlatformTests() {
+    testThreadsGiveIdenticalResults(NonbondedForce::NoCutoff);
+    testThreadsGiveIdenticalResults(NonbondedForce::CutoffPeriodic);
+    testThreadsGiveIdenticalResults(NonbondedForce::PME);
 }
@@ -45,6 +45,10 @@ namespace OpenMM {
  * To use it, create an AmoebaWcaDispersionForce object then call addParticle() once for each particle.  After
  * a particle has been added, you can modify its force field parameters by calling setParticleParameters().
  * This will have no effect on Contexts that already exist unless you call updateParametersInContext().
+ *
+ * By default every pair of particles interacts.  The pair interactions decay as 1/r^6, so for large systems
+ * you can call setUseCutoff() to ignore pairs farther apart than the cutoff distance.  A switching function
+ * is applied between the switching distance and the cutoff to make the energy go smoothly to zero.
  */
 
 class OPENMM_EXPORT_AMOEBA AmoebaWcaDispersionForce : public Force {
@@ -121,6 +125,36 @@ public:
     void setShctd(double inputValue);
     void setDispoff(double inputValue);
     void setSlevy(double inputValue);
+    /**
+     * Get whether pair interactions are ignored beyond the cutoff distance.
+     */
+    bool getUseCutoff() const;
+    /**
+     * Set whether pair interactions are ignored beyond the cutoff distance.
+     */
+    void setUseCutoff(bool use);
+    /**
+     * Get the cutoff distance (in nm) being used for pair interactions.  This is only used
+     * if getUseCutoff() returns true.
+     */
+    double getCutoffDistance() const;
+    /**
+     * Set the cutoff distance (in nm) being used for pair interactions.  This is only used
+     * if getUseCutoff() returns true.
+     */
+    void setCutoffDistance(double distance);
+    /**
+     * Get the distance (in nm) at which the switching function begins to reduce the pair interactions.
+     * It must be less than or equal to the cutoff distance.  If it equals the cutoff, the interactions
+     * are truncated without switching.
+     */
+    double getSwitchingDistance() const;
+    /**
+     * Set the distance (in nm) at which the switching function begins to reduce the pair interactions.
+     * It must be less than or equal to the cutoff distance.  If it equals the cutoff, the interactions
+     * are truncated without switching.
+     */
+    void setSwitchingDistance(double distance);
     /**
      * Returns whether or not this force makes use of periodic boundary
      * conditions.
@@ -142,6 +176,8 @@ private:
     double slevy;
     double shctd;
     double dispoff;
+    bool useCutoff;
+    double cutoffDistance, switchingDistance;
     std::vector<WcaDispersionInfo> parameters;
 };
 
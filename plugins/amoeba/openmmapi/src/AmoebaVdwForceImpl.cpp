@@ -337,6 +337,7 @@ std::vector<std::string> AmoebaVdwForceImpl::getKernelNames() {
 
 void AmoebaVdwForceImpl::updateParametersInContext(ContextImpl& context) {
     kernel.getAs<CalcAmoebaVdwForceKernel>().copyParametersToContext(context, owner);
+    context.systemChanged();
 }
 
 
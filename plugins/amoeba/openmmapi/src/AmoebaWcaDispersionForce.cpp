@@ -46,6 +46,9 @@ AmoebaWcaDispersionForce::AmoebaWcaDispersionForce() {
     slevy     = 1.0;
     shctd     = 0.81;
     dispoff   = 0.26;
+    useCutoff = false;
+    cutoffDistance    = 1.0;
+    switchingDistance = 0.9;
 }
 
 int AmoebaWcaDispersionForce::addParticle(double radius, double epsilon) {
@@ -127,6 +130,30 @@ void AmoebaWcaDispersionForce::setSlevy(double inputSlevy) {
     slevy = inputSlevy;
 }
 
+bool AmoebaWcaDispersionForce::getUseCutoff() const {
+    return useCutoff;
+}
+
+void AmoebaWcaDispersionForce::setUseCutoff(bool use) {
+    useCutoff = use;
+}
+
+double AmoebaWcaDispersionForce::getCutoffDistance() const {
+    return cutoffDistance;
+}
+
+void AmoebaWcaDispersionForce::setCutoffDistance(double distance) {
+    cutoffDistance = distance;
+}
+
+double AmoebaWcaDispersionForce::getSwitchingDistance() const {
+    return switchingDistance;
+}
+
+void AmoebaWcaDispersionForce::setSwitchingDistance(double distance) {
+    switchingDistance = distance;
+}
+
 ForceImpl* AmoebaWcaDispersionForce::createImpl() const {
     return new AmoebaWcaDispersionForceImpl(*this);
 }
@@ -51,6 +51,12 @@ void AmoebaWcaDispersionForceImpl::initialize(ContextImpl& context) {
     const System& system = context.getSystem();
     if (owner.getNumParticles() != system.getNumParticles())
         throw OpenMMException("AmoebaWcaDispersionForce must have exactly as many particles as the System it belongs to.");
+    if (owner.getUseCutoff()) {
+        if (owner.getCutoffDistance() <= 0)
+            throw OpenMMException("AmoebaWcaDispersionForce: The cutoff distance must be positive");
+        if (owner.getSwitchingDistance() < 0 || owner.getSwitchingDistance() > owner.getCutoffDistance())
+            throw OpenMMException("AmoebaWcaDispersionForce: Switching distance must satisfy 0 <= r_switch <= r_cutoff");
+    }
 
     kernel = context.getPlatform().createKernel(CalcAmoebaWcaDispersionForceKernel::Name(), context);
     kernel.getAs<CalcAmoebaWcaDispersionForceKernel>().initialize(context.getSystem(), owner);
@@ -138,4 +144,5 @@ std::vector<std::string> AmoebaWcaDispersionForceImpl::getKernelNames() {
 
 void AmoebaWcaDispersionForceImpl::updateParametersInContext(ContextImpl& context) {
     kernel.getAs<CalcAmoebaWcaDispersionForceKernel>().copyParametersToContext(context, owner);
+    context.systemChanged();
 }
@@ -107,8 +107,11 @@ KernelImpl* AmoebaCudaKernelFactory::createKernelImpl(std::string name, const Pl
     if (name == CalcAmoebaGeneralizedKirkwoodForceKernel::Name())
         return new CudaCalcAmoebaGeneralizedKirkwoodForceKernel(name, platform, cu, context.getSystem());
 
-    if (name == CalcAmoebaVdwForceKernel::Name())
+    if (name == CalcAmoebaVdwForceKernel::Name()) {
+        if (data.contexts.size() > 1)
+            return new CudaParallelCalcAmoebaVdwForceKernel(name, platform, data, context.getSystem());
         return new CudaCalcAmoebaVdwForceKernel(name, platform, cu, context.getSystem());
+    }
 
     if (name == CalcAmoebaWcaDispersionForceKernel::Name())
         return new CudaCalcAmoebaWcaDispersionForceKernel(name, platform, cu, context.getSystem());
@@ -764,9 +764,22 @@ private:
     const AmoebaMultipoleForce& force;
 };
 
+class CudaCalcAmoebaMultipoleForceKernel::ReorderListener : public CudaContext::ReorderListener {
+public:
+    ReorderListener(int& numStepDipoles) : numStepDipoles(numStepDipoles) {
+    }
+    void execute() {
+        // The stored dipoles from previous steps no longer correspond to the right atoms, so discard them.
+
+        numStepDipoles = 0;
+    }
+private:
+    int& numStepDipoles;
+};
+
 CudaCalcAmoebaMultipoleForceKernel::CudaCalcAmoebaMultipoleForceKernel(const std::string& name, const Platform& platform, CudaContext& cu, const System& system) :
         CalcAmoebaMultipoleForceKernel(name, platform), cu(cu), system(system), hasInitializedScaleFactors(false), hasInitializedFFT(false), multipolesAreValid(false), hasCreatedEvent(false),
-        gkKernel(NULL) {
+        numStepDipoles(0), gkKernel(NULL) {
 }
 
 CudaCalcAmoebaMultipoleForceKernel::~CudaCalcAmoebaMultipoleForceKernel() {
@@ -861,6 +874,9 @@ void CudaCalcAmoebaMultipoleForceKernel::initialize(const System& system, const
         prevErrors.initialize(cu, 3*numMultipoles*MaxPrevDIISDipoles, elementSize, "prevErrors");
         diisMatrix.initialize(cu, MaxPrevDIISDipoles*MaxPrevDIISDipoles, elementSize, "diisMatrix");
         diisCoefficients.initialize(cu, MaxPrevDIISDipoles+1, sizeof(float), "diisMatrix");
+        stepDipoles.initialize(cu, 3*numMultipoles*MaxPredictorDipoles, elementSize, "stepDipoles");
+        stepDipolesPolar.initialize(cu, 3*numMultipoles*MaxPredictorDipoles, elementSize, "stepDipolesPolar");
+        cu.addReorderListener(new ReorderListener(numStepDipoles));
         CHECK_RESULT(cuEventCreate(&syncEvent, CU_EVENT_DISABLE_TIMING), "Error creating event for AmoebaMultipoleForce");
         hasCreatedEvent = true;
     }
@@ -1048,12 +1064,15 @@ void CudaCalcAmoebaMultipoleForceKernel::initialize(const System& system, const
     if (polarizationType != AmoebaMultipoleForce::Direct) {
         defines["THREAD_BLOCK_SIZE"] = cu.intToString(inducedFieldThreads);
         defines["MAX_PREV_DIIS_DIPOLES"] = cu.intToString(MaxPrevDIISDipoles);
+        defines["MAX_PREDICTOR_DIPOLES"] = cu.intToString(MaxPredictorDipoles);
         module = cu.createModule(CudaKernelSources::vectorOps+CudaAmoebaKernelSources::multipoleInducedField, defines);
         computeInducedFieldKernel = cu.getKernel(module, "computeInducedField");
         updateInducedFieldKernel = cu.getKernel(module, "updateInducedFieldByDIIS");
         recordDIISDipolesKernel = cu.getKernel(module, "recordInducedDipolesForDIIS");
         buildMatrixKernel = cu.getKernel(module, "computeDIISMatrix");
         solveMatrixKernel = cu.getKernel(module, "solveDIISMatrix");
+        recordConvergedDipolesKernel = cu.getKernel(module, "recordConvergedDipoles");
+        predictDipolesKernel = cu.getKernel(module, "predictInducedDipoles");
         initExtrapolatedKernel = cu.getKernel(module, "initExtrapolatedDipoles");
         iterateExtrapolatedKernel = cu.getKernel(module, "iterateExtrapolatedDipoles");
         computeExtrapolatedKernel = cu.getKernel(module, "computeExtrapolatedDipoles");
@@ -1088,6 +1107,8 @@ void CudaCalcAmoebaMultipoleForceKernel::initialize(const System& system, const
         pmeDefines["GRID_SIZE_Z"] = cu.intToString(gridSizeZ);
         pmeDefines["M_PI"] = cu.doubleToString(M_PI);
         pmeDefines["SQRT_PI"] = cu.doubleToString(sqrt(M_PI));
+        if (cu.getPlatformData().deterministicForces)
+            pmeDefines["USE_DETERMINISTIC_FORCES"] = "1";
         if (polarizationType == AmoebaMultipoleForce::Direct)
             pmeDefines["DIRECT_POLARIZATION"] = "";
         else if (polarizationType == AmoebaMultipoleForce::Mutual)
@@ -1116,6 +1137,12 @@ void CudaCalcAmoebaMultipoleForceKernel::initialize(const System& system, const
         int elementSize = (cu.getUseDoublePrecision() ? sizeof(double) : sizeof(float));
         pmeGrid.initialize(cu, gridSizeX*gridSizeY*gridSizeZ, 2*elementSize, "pmeGrid");
         cu.addAutoclearBuffer(pmeGrid);
+        if (cu.getPlatformData().deterministicForces && !cu.getUseDoublePrecision()) {
+            // Fixed point values are larger than floats, so they need their own grid.
+
+            pmeFixedPointGrid.initialize(cu, gridSizeX*gridSizeY*gridSizeZ, 2*sizeof(long long), "pmeFixedPointGrid");
+            cu.addAutoclearBuffer(pmeFixedPointGrid);
+        }
         pmeBsplineModuliX.initialize(cu, gridSizeX, elementSize, "pmeBsplineModuliX");
         pmeBsplineModuliY.initialize(cu, gridSizeY, elementSize, "pmeBsplineModuliY");
         pmeBsplineModuliZ.initialize(cu, gridSizeZ, elementSize, "pmeBsplineModuliZ");
@@ -1360,12 +1387,8 @@ double CudaCalcAmoebaMultipoleForceKernel::execute(ContextImpl& context, bool in
         
         if (polarizationType == AmoebaMultipoleForce::Extrapolated)
             computeExtrapolatedDipoles(NULL);
-        for (int i = 0; i < maxInducedIterations; i++) {
-            computeInducedField(NULL);
-            bool converged = iterateDipolesByDIIS(i);
-            if (converged)
-                break;
-        }
+        else
+            solveInducedDipoles(NULL);
         
         // Compute electrostatic force.
         
@@ -1411,15 +1434,16 @@ double CudaCalcAmoebaMultipoleForceKernel::execute(ContextImpl& context, bool in
         void* pmeTransformMultipolesArgs[] = {&labFrameDipoles.getDevicePointer(), &labFrameQuadrupoles.getDevicePointer(),
             &fracDipoles.getDevicePointer(), &fracQuadrupoles.getDevicePointer(), recipBoxVectorPointer[0], recipBoxVectorPointer[1], recipBoxVectorPointer[2]};
         cu.executeKernel(pmeTransformMultipolesKernel, pmeTransformMultipolesArgs, cu.getNumAtoms());
+        CudaArray& spreadGrid = getPmeSpreadGrid();
         void* pmeSpreadFixedMultipolesArgs[] = {&cu.getPosq().getDevicePointer(), &fracDipoles.getDevicePointer(), &fracQuadrupoles.getDevicePointer(),
-            &pmeGrid.getDevicePointer(), cu.getPeriodicBoxVecXPointer(), cu.getPeriodicBoxVecYPointer(), cu.getPeriodicBoxVecZPointer(),
+            &spreadGrid.getDevicePointer(), cu.getPeriodicBoxVecXPointer(), cu.getPeriodicBoxVecYPointer(), cu.getPeriodicBoxVecZPointer(),
             recipBoxVectorPointer[0], recipBoxVectorPointer[1], recipBoxVectorPointer[2]};
         cu.executeKernel(pmeSpreadFixedMultipolesKernel, pmeSpreadFixedMultipolesArgs, cu.getNumAtoms());
-        void* finishSpreadArgs[] = {&pmeGrid.getDevicePointer()};
-        if (cu.getUseDoublePrecision()) {
+        void* finishSpreadArgs[] = {&spreadGrid.getDevicePointer(), &pmeGrid.getDevicePointer()};
+        if (cu.getUseDoublePrecision() || pmeFixedPointGrid.isInitialized())
             cu.executeKernel(pmeFinishSpreadChargeKernel, finishSpreadArgs, pmeGrid.getSize());
+        if (cu.getUseDoublePrecision())
             cufftExecZ2Z(fft, (double2*) pmeGrid.getDevicePointer(), (double2*) pmeGrid.getDevicePointer(), CUFFT_FORWARD);
-        }
         else
             cufftExecC2C(fft, (float2*) pmeGrid.getDevicePointer(), (float2*) pmeGrid.getDevicePointer(), CUFFT_FORWARD);
         void* pmeConvolutionArgs[] = {&pmeGrid.getDevicePointer(), &pmeBsplineModuliX.getDevicePointer(), &pmeBsplineModuliY.getDevicePointer(),
@@ -1457,15 +1481,15 @@ double CudaCalcAmoebaMultipoleForceKernel::execute(ContextImpl& context, bool in
 
         // Reciprocal space calculation for the induced dipoles.
 
-        cu.clearBuffer(pmeGrid);
+        cu.clearBuffer(spreadGrid);
         void* pmeSpreadInducedDipolesArgs[] = {&cu.getPosq().getDevicePointer(), &inducedDipole.getDevicePointer(), &inducedDipolePolar.getDevicePointer(),
-            &pmeGrid.getDevicePointer(), cu.getPeriodicBoxVecXPointer(), cu.getPeriodicBoxVecYPointer(), cu.getPeriodicBoxVecZPointer(),
+            &spreadGrid.getDevicePointer(), cu.getPeriodicBoxVecXPointer(), cu.getPeriodicBoxVecYPointer(), cu.getPeriodicBoxVecZPointer(),
             recipBoxVectorPointer[0], recipBoxVectorPointer[1], recipBoxVectorPointer[2]};
         cu.executeKernel(pmeSpreadInducedDipolesKernel, pmeSpreadInducedDipolesArgs, cu.getNumAtoms());
-        if (cu.getUseDoublePrecision()) {
+        if (cu.getUseDoublePrecision() || pmeFixedPointGrid.isInitialized())
             cu.executeKernel(pmeFinishSpreadChargeKernel, finishSpreadArgs, pmeGrid.getSize());
+        if (cu.getUseDoublePrecision())
             cufftExecZ2Z(fft, (double2*) pmeGrid.getDevicePointer(), (double2*) pmeGrid.getDevicePointer(), CUFFT_FORWARD);
-        }
         else
             cufftExecC2C(fft, (float2*) pmeGrid.getDevicePointer(), (float2*) pmeGrid.getDevicePointer(), CUFFT_FORWARD);
         cu.executeKernel(pmeConvolutionKernel, pmeConvolutionArgs, gridSizeX*gridSizeY*gridSizeZ, 256);
@@ -1482,12 +1506,8 @@ double CudaCalcAmoebaMultipoleForceKernel::execute(ContextImpl& context, bool in
         
         if (polarizationType == AmoebaMultipoleForce::Extrapolated)
             computeExtrapolatedDipoles(recipBoxVectorPointer);
-        for (int i = 0; i < maxInducedIterations; i++) {
-            computeInducedField(recipBoxVectorPointer);
-            bool converged = iterateDipolesByDIIS(i);
-            if (converged)
-                break;
-        }
+        else
+            solveInducedDipoles(recipBoxVectorPointer);
         
         // Compute electrostatic force.
         
@@ -1540,6 +1560,10 @@ double CudaCalcAmoebaMultipoleForceKernel::execute(ContextImpl& context, bool in
     return 0.0;
 }
 
+CudaArray& CudaCalcAmoebaMultipoleForceKernel::getPmeSpreadGrid() {
+    return (pmeFixedPointGrid.isInitialized() ? pmeFixedPointGrid : pmeGrid);
+}
+
 void CudaCalcAmoebaMultipoleForceKernel::computeInducedField(void** recipBoxVectorPointer) {
     CudaNonbondedUtilities& nb = cu.getNonbondedUtilities();
     int startTileIndex = nb.getStartTileIndex();
@@ -1602,16 +1626,18 @@ void CudaCalcAmoebaMultipoleForceKernel::computeInducedField(void** recipBoxVect
     else {
         maxTiles = nb.getInteractingTiles().getSize();
         cu.executeKernel(computeInducedFieldKernel, &computeInducedFieldArgs[0], numForceThreadBlocks*inducedFieldThreads, inducedFieldThreads);
-        cu.clearBuffer(pmeGrid);
+        CudaArray& spreadGrid = getPmeSpreadGrid();
+        cu.clearBuffer(spreadGrid);
         void* pmeSpreadInducedDipolesArgs[] = {&cu.getPosq().getDevicePointer(), &inducedDipole.getDevicePointer(), &inducedDipolePolar.getDevicePointer(),
-            &pmeGrid.getDevicePointer(), cu.getPeriodicBoxVecXPointer(), cu.getPeriodicBoxVecYPointer(), cu.getPeriodicBoxVecZPointer(),
+            &spreadGrid.getDevicePointer(), cu.getPeriodicBoxVecXPointer(), cu.getPeriodicBoxVecYPointer(), cu.getPeriodicBoxVecZPointer(),
             recipBoxVectorPointer[0], recipBoxVectorPointer[1], recipBoxVectorPointer[2]};
         cu.executeKernel(pmeSpreadInducedDipolesKernel, pmeSpreadInducedDipolesArgs, cu.getNumAtoms());
-        if (cu.getUseDoublePrecision()) {
-            void* finishSpreadArgs[] = {&pmeGrid.getDevicePointer()};
+        if (cu.getUseDoublePrecision() || pmeFixedPointGrid.isInitialized()) {
+            void* finishSpreadArgs[] = {&spreadGrid.getDevicePointer(), &pmeGrid.getDevicePointer()};
             cu.executeKernel(pmeFinishSpreadChargeKernel, finishSpreadArgs, pmeGrid.getSize());
-            cufftExecZ2Z(fft, (double2*) pmeGrid.getDevicePointer(), (double2*) pmeGrid.getDevicePointer(), CUFFT_FORWARD);
         }
+        if (cu.getUseDoublePrecision())
+            cufftExecZ2Z(fft, (double2*) pmeGrid.getDevicePointer(), (double2*) pmeGrid.getDevicePointer(), CUFFT_FORWARD);
         else
             cufftExecC2C(fft, (float2*) pmeGrid.getDevicePointer(), (float2*) pmeGrid.getDevicePointer(), CUFFT_FORWARD);
         void* pmeConvolutionArgs[] = {&pmeGrid.getDevicePointer(), &pmeBsplineModuliX.getDevicePointer(), &pmeBsplineModuliY.getDevicePointer(),
@@ -1641,6 +1667,38 @@ void CudaCalcAmoebaMultipoleForceKernel::computeInducedField(void** recipBoxVect
     }
 }
 
+void CudaCalcAmoebaMultipoleForceKernel::solveInducedDipoles(void** recipBoxVectorPointer) {
+    // Start from dipoles extrapolated from previous steps, if we have them.  This is only an initial guess,
+    // so it does not affect the converged result, but it greatly reduces the number of iterations.
+    // The guess is not used with Generalized Kirkwood, which has its own set of dipoles to solve for.
+
+    bool usePredictor = (polarizationType == AmoebaMultipoleForce::Mutual && gkKernel == NULL);
+    if (usePredictor && numStepDipoles > 0) {
+        void* predictArgs[] = {&inducedDipole.getDevicePointer(), &inducedDipolePolar.getDevicePointer(),
+            &stepDipoles.getDevicePointer(), &stepDipolesPolar.getDevicePointer(), &numStepDipoles};
+        cu.executeKernel(predictDipolesKernel, predictArgs, 3*cu.getNumAtoms(), 256);
+    }
+    bool converged = false;
+    for (int i = 0; i < maxInducedIterations && !converged; i++) {
+        computeInducedField(recipBoxVectorPointer);
+        converged = iterateDipolesByDIIS(i);
+    }
+
+    // Record the dipoles for use on later steps.  If the iteration failed to converge, they are not a
+    // reliable basis for extrapolation.
+
+    if (usePredictor) {
+        if (converged) {
+            void* recordArgs[] = {&inducedDipole.getDevicePointer(), &inducedDipolePolar.getDevicePointer(),
+                &stepDipoles.getDevicePointer(), &stepDipolesPolar.getDevicePointer()};
+            cu.executeKernel(recordConvergedDipolesKernel, recordArgs, 3*cu.getNumAtoms(), 256);
+            numStepDipoles = min(numStepDipoles+1, (int) MaxPredictorDipoles);
+        }
+        else
+            numStepDipoles = 0;
+    }
+}
+
 bool CudaCalcAmoebaMultipoleForceKernel::iterateDipolesByDIIS(int iteration) {
     void* npt = NULL;
     bool trueValue = true, falseValue = false;
@@ -2493,6 +2551,11 @@ double CudaCalcAmoebaVdwForceKernel::execute(ContextImpl& context, bool includeF
     cu.executeKernel(spreadKernel, spreadArgs, cu.getPaddedNumAtoms());
     tempPosq.copyTo(cu.getPosq());
     tempForces.copyTo(cu.getForce());
+
+    // When running on multiple devices, only the first one adds the dispersion correction.
+
+    if (cu.getContextIndex() > 0)
+        return 0.0;
     double4 box = cu.getPeriodicBoxSize();
     return dispersionCoefficient/(box.x*box.y*box.z);
 }
@@ -2541,6 +2604,51 @@ void CudaCalcAmoebaVdwForceKernel::copyParametersToContext(ContextImpl& context,
     cu.invalidateMolecules();
 }
 
+class CudaParallelCalcAmoebaVdwForceKernel::Task : public CudaContext::WorkTask {
+public:
+    Task(ContextImpl& context, CudaCalcAmoebaVdwForceKernel& kernel, bool includeForce,
+            bool includeEnergy, double& energy) : context(context), kernel(kernel),
+            includeForce(includeForce), includeEnergy(includeEnergy), energy(energy) {
+    }
+    void execute() {
+        energy += kernel.execute(context, includeForce, includeEnergy);
+    }
+private:
+    ContextImpl& context;
+    CudaCalcAmoebaVdwForceKernel& kernel;
+    bool includeForce, includeEnergy;
+    double& energy;
+};
+
+CudaParallelCalcAmoebaVdwForceKernel::CudaParallelCalcAmoebaVdwForceKernel(const std::string& name, const Platform& platform, CudaPlatform::PlatformData& data, const System& system) :
+        CalcAmoebaVdwForceKernel(name, platform), data(data) {
+    for (int i = 0; i < (int) data.contexts.size(); i++)
+        kernels.push_back(Kernel(new CudaCalcAmoebaVdwForceKernel(name, platform, *data.contexts[i], system)));
+}
+
+void CudaParallelCalcAmoebaVdwForceKernel::initialize(const System& system, const AmoebaVdwForce& force) {
+    for (int i = 0; i < (int) kernels.size(); i++)
+        getKernel(i).initialize(system, force);
+}
+
+double CudaParallelCalcAmoebaVdwForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
+    // Each device has its own neighbor list covering a different range of tiles, so each one computes
+    // a different subset of the interactions.  The forces and energies are summed over devices at the
+    // end of the force computation.
+
+    for (int i = 0; i < (int) data.contexts.size(); i++) {
+        CudaContext& cu = *data.contexts[i];
+        ComputeContext::WorkThread& thread = cu.getWorkThread();
+        thread.addTask(new Task(context, getKernel(i), includeForces, includeEnergy, data.contextEnergy[i]));
+    }
+    return 0.0;
+}
+
+void CudaParallelCalcAmoebaVdwForceKernel::copyParametersToContext(ContextImpl& context, const AmoebaVdwForce& force) {
+    for (int i = 0; i < (int) kernels.size(); i++)
+        getKernel(i).copyParametersToContext(context, force);
+}
+
 /* -------------------------------------------------------------------------- *
  *                           AmoebaWcaDispersion                              *
  * -------------------------------------------------------------------------- */
@@ -2592,6 +2700,22 @@ void CudaCalcAmoebaWcaDispersionForceKernel::initialize(const System& system, co
     defines["AWATER"] = cu.doubleToString(force.getAwater());
     defines["SHCTD"] = cu.doubleToString(force.getShctd());
     defines["M_PI"] = cu.doubleToString(M_PI);
+    if (force.getUseCutoff()) {
+        // The tiles come from the shared nonbonded list, which has no cutoff when this is used together
+        // with AmoebaGeneralizedKirkwoodForce, so pairs beyond the cutoff are skipped inside the kernel.
+
+        double cutoff = force.getCutoffDistance();
+        double switchingDistance = force.getSwitchingDistance();
+        defines["USE_CUTOFF"] = "1";
+        defines["CUTOFF_SQUARED"] = cu.doubleToString(cutoff*cutoff);
+        if (switchingDistance < cutoff) {
+            defines["USE_SWITCH"] = "1";
+            defines["SWITCH_CUTOFF"] = cu.doubleToString(switchingDistance);
+            defines["SWITCH_C3"] = cu.doubleToString(10/pow(switchingDistance-cutoff, 3.0));
+            defines["SWITCH_C4"] = cu.doubleToString(15/pow(switchingDistance-cutoff, 4.0));
+            defines["SWITCH_C5"] = cu.doubleToString(6/pow(switchingDistance-cutoff, 5.0));
+        }
+    }
     CUmodule module = cu.createModule(CudaKernelSources::vectorOps+CudaAmoebaKernelSources::amoebaWcaForce, defines);
     forceKernel = cu.getKernel(module, "computeWCAForce");
     totalMaximumDispersionEnergy = AmoebaWcaDispersionForceImpl::getTotalMaximumDispersionEnergy(force);
@@ -2943,6 +3067,8 @@ void CudaCalcHippoNonbondedForceKernel::initialize(const System& system, const H
         pmeDefines["SQRT_PI"] = cu.doubleToString(sqrt(M_PI));
         pmeDefines["EXTRAPOLATION_COEFFICIENTS_SUM"] = coefficients.str();
         pmeDefines["MAX_EXTRAPOLATION_ORDER"] = cu.intToString(maxExtrapolationOrder);
+        if (cu.getPlatformData().deterministicForces)
+            pmeDefines["USE_DETERMINISTIC_FORCES"] = "1";
         CUmodule module = cu.createModule(CudaKernelSources::vectorOps+CudaAmoebaKernelSources::multipolePme, pmeDefines);
         pmeTransformMultipolesKernel = cu.getKernel(module, "transformMultipolesToFractionalCoordinates");
         pmeTransformPotentialKernel = cu.getKernel(module, "transformPotentialToCartesianCoordinates");
@@ -3420,16 +3546,20 @@ double CudaCalcHippoNonbondedForceKernel::execute(ContextImpl& context, bool inc
             &fracDipoles.getDevicePointer(), &fracQuadrupoles.getDevicePointer(),
             recipBoxVectorPointer[0], recipBoxVectorPointer[1], recipBoxVectorPointer[2]};
         cu.executeKernel(pmeTransformMultipolesKernel, pmeTransformMultipolesArgs, cu.getNumAtoms());
+        CudaArray& spreadGrid = getPmeSpreadGrid();
+        if (&spreadGrid != &pmeGrid1)
+            cu.clearBuffer(spreadGrid);
         void* pmeSpreadFixedMultipolesArgs[] = {&cu.getPosq().getDevicePointer(), &fracDipoles.getDevicePointer(), &fracQuadrupoles.getDevicePointer(),
-            &pmeGrid1.getDevicePointer(), &coreCharge.getDevicePointer(), &valenceCharge.getDevicePointer(),
+            &spreadGrid.getDevicePointer(), &coreCharge.getDevicePointer(), &valenceCharge.getDevicePointer(),
             cu.getPeriodicBoxVecXPointer(), cu.getPeriodicBoxVecYPointer(), cu.getPeriodicBoxVecZPointer(),
             recipBoxVectorPointer[0], recipBoxVectorPointer[1], recipBoxVectorPointer[2]};
         cu.executeKernel(pmeSpreadFixedMultipolesKernel, pmeSpreadFixedMultipolesArgs, cu.getNumAtoms());
-        if (cu.getUseDoublePrecision()) {
-            void* finishSpreadArgs[] = {&pmeGrid1.getDevicePointer()};
+        if (cu.getUseDoublePrecision() || cu.getPlatformData().deterministicForces) {
+            void* finishSpreadArgs[] = {&spreadGrid.getDevicePointer(), &pmeGrid1.getDevicePointer()};
             cu.executeKernel(pmeFinishSpreadChargeKernel, finishSpreadArgs, pmeGrid1.getSize());
-            cufftExecD2Z(fftForward, (double*) pmeGrid1.getDevicePointer(), (double2*) pmeGrid2.getDevicePointer());
         }
+        if (cu.getUseDoublePrecision())
+            cufftExecD2Z(fftForward, (double*) pmeGrid1.getDevicePointer(), (double2*) pmeGrid2.getDevicePointer());
         else
             cufftExecR2C(fftForward, (float*) pmeGrid1.getDevicePointer(), (float2*) pmeGrid2.getDevicePointer());
         void* pmeConvolutionArgs[] = {&pmeGrid2.getDevicePointer(), &pmeBsplineModuliX.getDevicePointer(), &pmeBsplineModuliY.getDevicePointer(),
@@ -3544,6 +3674,15 @@ double CudaCalcHippoNonbondedForceKernel::execute(ContextImpl& context, bool inc
     return 0.0;
 }
 
+CudaArray& CudaCalcHippoNonbondedForceKernel::getPmeSpreadGrid() {
+    // With deterministic forces in single precision, the fixed point values do not fit in pmeGrid1.  pmeGrid2 is
+    // not needed until the forward FFT, and it has room for them.
+
+    if (cu.getPlatformData().deterministicForces && !cu.getUseDoublePrecision())
+        return pmeGrid2;
+    return pmeGrid1;
+}
+
 void CudaCalcHippoNonbondedForceKernel::computeInducedField(void** recipBoxVectorPointer, int optOrder) {
     CudaNonbondedUtilities& nb = cu.getNonbondedUtilities();
     cu.clearBuffer(inducedField);
@@ -3551,16 +3690,18 @@ void CudaCalcHippoNonbondedForceKernel::computeInducedField(void** recipBoxVecto
     if (mutualFieldExceptionArgs.size() > 0)
         cu.executeKernel(mutualFieldExceptionKernel, &mutualFieldExceptionArgs[0], exceptionAtoms.getSize());
     if (usePME) {
-        cu.clearBuffer(pmeGrid1);
+        CudaArray& spreadGrid = getPmeSpreadGrid();
+        cu.clearBuffer(spreadGrid);
         void* pmeSpreadInducedDipolesArgs[] = {&cu.getPosq().getDevicePointer(), &inducedDipole.getDevicePointer(),
-            &pmeGrid1.getDevicePointer(), cu.getPeriodicBoxVecXPointer(), cu.getPeriodicBoxVecYPointer(), cu.getPeriodicBoxVecZPointer(),
+            &spreadGrid.getDevicePointer(), cu.getPeriodicBoxVecXPointer(), cu.getPeriodicBoxVecYPointer(), cu.getPeriodicBoxVecZPointer(),
             recipBoxVectorPointer[0], recipBoxVectorPointer[1], recipBoxVectorPointer[2]};
         cu.executeKernel(pmeSpreadInducedDipolesKernel, pmeSpreadInducedDipolesArgs, cu.getNumAtoms());
-        if (cu.getUseDoublePrecision()) {
-            void* finishSpreadArgs[] = {&pmeGrid1.getDevicePointer()};
+        if (cu.getUseDoublePrecision() || cu.getPlatformData().deterministicForces) {
+            void* finishSpreadArgs[] = {&spreadGrid.getDevicePointer(), &pmeGrid1.getDevicePointer()};
             cu.executeKernel(pmeFinishSpreadChargeKernel, finishSpreadArgs, pmeGrid1.getSize());
-            cufftExecD2Z(fftForward, (double*) pmeGrid1.getDevicePointer(), (double2*) pmeGrid2.getDevicePointer());
         }
+        if (cu.getUseDoublePrecision())
+            cufftExecD2Z(fftForward, (double*) pmeGrid1.getDevicePointer(), (double2*) pmeGrid2.getDevicePointer());
         else
             cufftExecR2C(fftForward, (float*) pmeGrid1.getDevicePointer(), (float2*) pmeGrid2.getDevicePointer());
         void* pmeConvolutionArgs[] = {&pmeGrid2.getDevicePointer(), &pmeBsplineModuliX.getDevicePointer(), &pmeBsplineModuliY.getDevicePointer(),
@@ -382,13 +382,21 @@ public:
     void getPMEParameters(double& alpha, int& nx, int& ny, int& nz) const;
 private:
     class ForceInfo;
+    class ReorderListener;
     void initializeScaleFactors();
+    /**
+     * Get the grid that PME values are spread onto.  This is normally pmeGrid, but with deterministic forces in
+     * single precision the values are accumulated as fixed point in a separate grid.
+     */
+    CudaArray& getPmeSpreadGrid();
     void computeInducedField(void** recipBoxVectorPointer);
+    void predictInducedDipoles();
+    void solveInducedDipoles(void** recipBoxVectorPointer);
     bool iterateDipolesByDIIS(int iteration);
     void computeExtrapolatedDipoles(void** recipBoxVectorPointer);
     void ensureMultipolesValid(ContextImpl& context);
     template <class T, class T4, class M4> void computeSystemMultipoleMoments(ContextImpl& context, std::vector<double>& outputMultipoleMoments);
-    int numMultipoles, maxInducedIterations, maxExtrapolationOrder;
+    int numMultipoles, maxInducedIterations, maxExtrapolationOrder, numStepDipoles;
     int fixedFieldThreads, inducedFieldThreads, electrostaticsThreads;
     int gridSizeX, gridSizeY, gridSizeZ;
     double alpha, inducedEpsilon;
@@ -423,6 +431,8 @@ private:
     CudaArray prevErrors;
     CudaArray diisMatrix;
     CudaArray diisCoefficients;
+    CudaArray stepDipoles;
+    CudaArray stepDipolesPolar;
     CudaArray extrapolatedDipole;
     CudaArray extrapolatedDipolePolar;
     CudaArray extrapolatedDipoleGk;
@@ -439,6 +449,7 @@ private:
     CudaArray covalentFlags;
     CudaArray polarizationGroupFlags;
     CudaArray pmeGrid;
+    CudaArray pmeFixedPointGrid;
     CudaArray pmeBsplineModuliX;
     CudaArray pmeBsplineModuliY;
     CudaArray pmeBsplineModuliZ;
@@ -452,13 +463,14 @@ private:
     CUfunction computeMomentsKernel, recordInducedDipolesKernel, computeFixedFieldKernel, computeInducedFieldKernel, updateInducedFieldKernel, electrostaticsKernel, mapTorqueKernel;
     CUfunction pmeSpreadFixedMultipolesKernel, pmeSpreadInducedDipolesKernel, pmeFinishSpreadChargeKernel, pmeConvolutionKernel;
     CUfunction pmeFixedPotentialKernel, pmeInducedPotentialKernel, pmeFixedForceKernel, pmeInducedForceKernel, pmeRecordInducedFieldDipolesKernel, computePotentialKernel;
-    CUfunction recordDIISDipolesKernel, buildMatrixKernel, solveMatrixKernel;
+    CUfunction recordDIISDipolesKernel, buildMatrixKernel, solveMatrixKernel, recordConvergedDipolesKernel, predictDipolesKernel;
     CUfunction initExtrapolatedKernel, iterateExtrapolatedKernel, computeExtrapolatedKernel, addExtrapolatedGradientKernel;
     CUfunction pmeTransformMultipolesKernel, pmeTransformPotentialKernel;
     CUevent syncEvent;
     CudaCalcAmoebaGeneralizedKirkwoodForceKernel* gkKernel;
     static const int PmeOrder = 5;
     static const int MaxPrevDIISDipoles = 20;
+    static const int MaxPredictorDipoles = 4;
 };
 
 /**
@@ -593,6 +605,45 @@ private:
     CUfunction prepareKernel, spreadKernel;
 };
 
+/**
+ * This kernel is invoked to calculate the vdw forces acting on the system when the Context contains multiple
+ * devices.  Each device computes a subset of the interactions.
+ */
+class CudaParallelCalcAmoebaVdwForceKernel : public CalcAmoebaVdwForceKernel {
+public:
+    CudaParallelCalcAmoebaVdwForceKernel(const std::string& name, const Platform& platform, CudaPlatform::PlatformData& data, const System& system);
+    CudaCalcAmoebaVdwForceKernel& getKernel(int index) {
+        return dynamic_cast<CudaCalcAmoebaVdwForceKernel&>(kernels[index].getImpl());
+    }
+    /**
+     * Initialize the kernel.
+     * 
+     * @param system     the System this kernel will be applied to
+     * @param force      the AmoebaVdwForce this kernel will be used for
+     */
+    void initialize(const System& system, const AmoebaVdwForce& force);
+    /**
+     * Execute the kernel to calculate the forces and/or energy.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param includeForces  true if forces should be calculated
+     * @param includeEnergy  true if the energy should be calculated
+     * @return the potential energy due to the force
+     */
+    double execute(ContextImpl& context, bool includeForces, bool includeEnergy);
+    /**
+     * Copy changed parameters over to a context.
+     *
+     * @param context    the context to copy parameters to
+     * @param force      the AmoebaVdwForce to copy the parameters from
+     */
+    void copyParametersToContext(ContextImpl& context, const AmoebaVdwForce& force);
+private:
+    class Task;
+    CudaPlatform::PlatformData& data;
+    std::vector<Kernel> kernels;
+};
+
 /**
  * This kernel is invoked to calculate the WCA dispersion forces acting on the system and the energy of the system.
  */
@@ -715,6 +766,11 @@ private:
         const char* getMaxValue() const {return "make_int2(2147483647, 2147483647)";}
         const char* getSortKey() const {return "value.y";}
     };
+    /**
+     * Get the grid that PME values are spread onto.  This is normally pmeGrid1, but with deterministic forces in
+     * single precision the values are accumulated as fixed point in pmeGrid2.
+     */
+    CudaArray& getPmeSpreadGrid();
     void computeInducedField(void** recipBoxVectorPointer, int optOrder);
     void computeExtrapolatedDipoles(void** recipBoxVectorPointer);
     void ensureMultipolesValid(ContextImpl& context);
@@ -188,6 +188,23 @@ __device__ void computeOneInteraction(AtomData& atom1, AtomData& atom2, real rmi
     force *= de;
 }
 
+#ifdef USE_SWITCH
+/**
+ * Apply the switching function to an interaction computed by computeOneInteraction().  delta is the
+ * vector from the first atom to the second.
+ */
+__device__ void applySwitchingFunction(real3 delta, real r2, real3& force, real& energy) {
+    real r = SQRT(r2);
+    if (r > SWITCH_CUTOFF) {
+        real x = r-SWITCH_CUTOFF;
+        real switchValue = 1+x*x*x*(SWITCH_C3+x*(SWITCH_C4+x*SWITCH_C5));
+        real switchDeriv = x*x*(3*SWITCH_C3+x*(4*SWITCH_C4+x*5*SWITCH_C5));
+        force = force*switchValue - delta*(AWATER*energy*switchDeriv/r);
+        energy *= switchValue;
+    }
+}
+#endif
+
 /**
  * Compute WCA interaction.
  */
@@ -229,16 +246,28 @@ extern "C" __global__ void computeWCAForce(unsigned long long* __restrict__ forc
             unsigned int tj = tgx;
             for (unsigned int j = 0; j < TILE_SIZE; j++) {
                 int atom2 = y*TILE_SIZE+tj;
-                if (atom1 != atom2 && atom1 < NUM_ATOMS && atom2 < NUM_ATOMS) {
+                bool includeInteraction = (atom1 != atom2 && atom1 < NUM_ATOMS && atom2 < NUM_ATOMS);
+#ifdef USE_CUTOFF
+                real3 delta = localData[tbx+tj].pos-data.pos;
+                real r2 = dot(delta, delta);
+                includeInteraction &= (r2 < CUTOFF_SQUARED);
+#endif
+                if (includeInteraction) {
                     real3 tempForce;
                     real tempEnergy;
                     computeOneInteraction(data, localData[tbx+tj], rmixo, rmixh, emixo, emixh, tempForce, tempEnergy);
+#ifdef USE_SWITCH
+                    applySwitchingFunction(delta, r2, tempForce, tempEnergy);
+#endif
                     data.force += tempForce;
                     localData[tbx+tj].force -= tempForce;
                     energy += (x == y ? 0.5f*tempEnergy : tempEnergy);
                     real emjxo, emjxh, rmjxo, rmjxh;
                     initParticleParameters(localData[tbx+tj].radius, localData[tbx+tj].epsilon, rmjxo, rmjxh, emjxo, emjxh);
                     computeOneInteraction(localData[tbx+tj], data, rmjxo, rmjxh, emjxo, emjxh, tempForce, tempEnergy);
+#ifdef USE_SWITCH
+                    applySwitchingFunction(-delta, r2, tempForce, tempEnergy);
+#endif
                     data.force -= tempForce;
                     localData[tbx+tj].force += tempForce;
                     energy += (x == y ? 0.5f*tempEnergy : tempEnergy);
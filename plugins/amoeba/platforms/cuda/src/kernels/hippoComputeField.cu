@@ -239,7 +239,7 @@ extern "C" __global__ void computeField(const real4* __restrict__ posq, const un
             LOAD_ATOM1_PARAMETERS
             const unsigned int localAtomIndex = threadIdx.x;
 #ifdef USE_CUTOFF
-            unsigned int j = interactingAtoms[tile*TILE_SIZE+tgx];
+            unsigned int j = interactingAtoms[(long long) tile*TILE_SIZE+tgx];
 #else
             unsigned int j = y*TILE_SIZE + tgx;
 #endif
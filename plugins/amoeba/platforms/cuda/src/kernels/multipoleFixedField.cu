@@ -655,7 +655,7 @@ extern "C" __global__ void computeFixedField(
             data.bornRadius = bornRadii[atom1];
 #endif
 #ifdef USE_CUTOFF
-            unsigned int j = interactingAtoms[pos*TILE_SIZE+tgx];
+            unsigned int j = interactingAtoms[(long long) pos*TILE_SIZE+tgx];
 #else
             unsigned int j = y*TILE_SIZE + tgx;
 #endif
@@ -515,7 +515,7 @@ extern "C" __global__ void computeInducedField(
             loadAtomData(data, atom1, posq, inducedDipole, inducedDipolePolar, dampingAndThole);
 #endif
 #ifdef USE_CUTOFF
-            unsigned int j = interactingAtoms[pos*TILE_SIZE+tgx];
+            unsigned int j = interactingAtoms[(long long) pos*TILE_SIZE+tgx];
 #else
             unsigned int j = y*TILE_SIZE + tgx;
 #endif
@@ -828,6 +828,45 @@ extern "C" __global__ void updateInducedFieldByDIIS(real* __restrict__ inducedDi
         inducedDipolePolar[index] = sumPolar;
     }
 }
+
+/**
+ * Store the converged dipoles from this step, shifting the dipoles from earlier steps down by one.
+ */
+extern "C" __global__ void recordConvergedDipoles(const real* __restrict__ inducedDipole, const real* __restrict__ inducedDipolePolar,
+        real* __restrict__ stepDipoles, real* __restrict__ stepDipolesPolar) {
+    for (int index = blockIdx.x*blockDim.x + threadIdx.x; index < 3*NUM_ATOMS; index += blockDim.x*gridDim.x) {
+        for (int i = MAX_PREDICTOR_DIPOLES-1; i > 0; i--) {
+            stepDipoles[i*3*NUM_ATOMS+index] = stepDipoles[(i-1)*3*NUM_ATOMS+index];
+            stepDipolesPolar[i*3*NUM_ATOMS+index] = stepDipolesPolar[(i-1)*3*NUM_ATOMS+index];
+        }
+        stepDipoles[index] = inducedDipole[index];
+        stepDipolesPolar[index] = inducedDipolePolar[index];
+    }
+}
+
+/**
+ * Form an initial guess for the induced dipoles by extrapolating from the converged dipoles of previous
+ * steps, using the predictor of the always stable predictor-corrector (ASPC) method.
+ */
+extern "C" __global__ void predictInducedDipoles(real* __restrict__ inducedDipole, real* __restrict__ inducedDipolePolar,
+        const real* __restrict__ stepDipoles, const real* __restrict__ stepDipolesPolar, int numPrev) {
+    const real coefficients[MAX_PREDICTOR_DIPOLES][MAX_PREDICTOR_DIPOLES] = {
+        {1, 0, 0, 0},
+        {2, -1, 0, 0},
+        {(real) 2.5, -2, (real) 0.5, 0},
+        {(real) 2.8, (real) -2.8, (real) 1.2, (real) -0.2}
+    };
+    for (int index = blockIdx.x*blockDim.x + threadIdx.x; index < 3*NUM_ATOMS; index += blockDim.x*gridDim.x) {
+        real sum = 0;
+        real sumPolar = 0;
+        for (int i = 0; i < numPrev; i++) {
+            sum += coefficients[numPrev-1][i]*stepDipoles[i*3*NUM_ATOMS+index];
+            sumPolar += coefficients[numPrev-1][i]*stepDipolesPolar[i*3*NUM_ATOMS+index];
+        }
+        inducedDipole[index] = sum;
+        inducedDipolePolar[index] = sumPolar;
+    }
+}
 #endif // not HIPPO
 
 extern "C" __global__ void initExtrapolatedDipoles(real* __restrict__ inducedDipole, real* __restrict__ extrapolatedDipole
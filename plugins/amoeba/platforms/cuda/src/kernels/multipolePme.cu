@@ -269,14 +269,14 @@ extern "C" __global__ void gridSpreadFixedMultipoles(const real4* __restrict__ p
                     real4 v = theta3[iz];
                     real add = term0*v.x + term1*v.y + term2*v.z;
 #ifdef HIPPO
-    #ifdef USE_DOUBLE_PRECISION
+    #if defined(USE_DOUBLE_PRECISION) || defined(USE_DETERMINISTIC_FORCES)
                 unsigned long long * ulonglong_p = (unsigned long long *) pmeGrid;
                 atomicAdd(&ulonglong_p[index],  static_cast<unsigned long long>((long long) (add*0x100000000)));
     #else
                 atomicAdd(&pmeGrid[index], add);
     #endif
 #else
-    #ifdef USE_DOUBLE_PRECISION
+    #if defined(USE_DOUBLE_PRECISION) || defined(USE_DETERMINISTIC_FORCES)
                 unsigned long long * ulonglong_p = (unsigned long long *) pmeGrid;
                 atomicAdd(&ulonglong_p[2*index],  static_cast<unsigned long long>((long long) (add*0x100000000)));
     #else
@@ -388,7 +388,7 @@ extern "C" __global__ void gridSpreadInducedDipoles(const real4* __restrict__ po
 
                     real add1 = term01*v.x + term11*v.y;
 #ifdef HIPPO
-    #ifdef USE_DOUBLE_PRECISION
+    #if defined(USE_DOUBLE_PRECISION) || defined(USE_DETERMINISTIC_FORCES)
                     unsigned long long * ulonglong_p = (unsigned long long *) pmeGrid;
                     atomicAdd(&ulonglong_p[index],  static_cast<unsigned long long>((long long) (add1*0x100000000)));
     #else
@@ -396,7 +396,7 @@ extern "C" __global__ void gridSpreadInducedDipoles(const real4* __restrict__ po
     #endif
 #else
                     real add2 = term02*v.x + term12*v.y;
-    #ifdef USE_DOUBLE_PRECISION
+    #if defined(USE_DOUBLE_PRECISION) || defined(USE_DETERMINISTIC_FORCES)
                     unsigned long long * ulonglong_p = (unsigned long long *) pmeGrid;
                     atomicAdd(&ulonglong_p[2*index],  static_cast<unsigned long long>((long long) (add1*0x100000000)));
                     atomicAdd(&ulonglong_p[2*index+1],  static_cast<unsigned long long>((long long) (add2*0x100000000)));
@@ -412,10 +412,12 @@ extern "C" __global__ void gridSpreadInducedDipoles(const real4* __restrict__ po
 }
 
 /**
- * In double precision, we have to use fixed point to accumulate the grid values, so convert them to floating point.
+ * In double precision or with deterministic forces, we use fixed point to accumulate the grid values, so convert
+ * them to floating point.  In double precision the values are converted in place, so fixedGrid and pmeGrid are the
+ * same array.  In single precision the fixed point values are twice as large as the floating point ones, so they
+ * are accumulated in a separate array.
  */
-extern "C" __global__ void finishSpreadCharge(long long* __restrict__ pmeGrid) {
-    real* floatGrid = (real*) pmeGrid;
+extern "C" __global__ void finishSpreadCharge(const long long* fixedGrid, real* floatGrid) {
 #ifdef HIPPO
     const unsigned int gridSize = GRID_SIZE_X*GRID_SIZE_Y*GRID_SIZE_Z;
 #else
@@ -423,7 +425,7 @@ extern "C" __global__ void finishSpreadCharge(long long* __restrict__ pmeGrid) {
 #endif
     real scale = 1/(real) 0x100000000;
     for (int index = blockIdx.x*blockDim.x+threadIdx.x; index < gridSize; index += blockDim.x*gridDim.x)
-        floatGrid[index] = scale*pmeGrid[index];
+        floatGrid[index] = scale*fixedGrid[index];
 }
 
 extern "C" __global__ void reciprocalConvolution(real2* __restrict__ pmeGrid, const real* __restrict__ pmeBsplineModuliX,
@@ -612,7 +612,7 @@ extern "C" __global__ void computeElectrostatics(
             data.force = make_real3(0);
             data.torque = make_real3(0);
 #ifdef USE_CUTOFF
-            unsigned int j = interactingAtoms[pos*TILE_SIZE+tgx];
+            unsigned int j = interactingAtoms[(long long) pos*TILE_SIZE+tgx];
 #else
             unsigned int j = y*TILE_SIZE + tgx;
 #endif
@@ -0,0 +1,102 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2026 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+/**
+ * This measures the performance of the CUDA implementation of the AMOEBA forces.  It is
+ * only built when OPENMM_BUILD_PERFORMANCE_TESTS is enabled.
+ */
+
+#include "OpenMMAmoeba.h"
+#include "openmm/Context.h"
+#include "openmm/System.h"
+#include "openmm/VerletIntegrator.h"
+#include "PerformanceUtilities.h"
+#include "sfmt/SFMT.h"
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+extern "C" void registerAmoebaCudaKernelFactories();
+
+void benchmarkAmoeba(int numParticles, int steps) {
+    // A fluid of polarizable particles on a randomly perturbed lattice, with mutual polarization and PME.
+
+    const double spacing = 0.31;
+    int gridSize = (int) ceil(pow((double) numParticles, 1.0/3.0));
+    double boxSize = gridSize*spacing;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    AmoebaMultipoleForce* multipoles = new AmoebaMultipoleForce();
+    multipoles->setNonbondedMethod(AmoebaMultipoleForce::PME);
+    multipoles->setPolarizationType(AmoebaMultipoleForce::Mutual);
+    multipoles->setCutoffDistance(0.7);
+    multipoles->setEwaldErrorTolerance(5e-4);
+    AmoebaVdwForce* vdw = new AmoebaVdwForce();
+    vdw->setNonbondedMethod(AmoebaVdwForce::CutoffPeriodic);
+    vdw->setCutoffDistance(0.9);
+    vector<double> dipole(3, 0.0), quadrupole(9, 0.0);
+    vector<Vec3> positions;
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(16.0);
+        double polarity = 0.001;
+        multipoles->addMultipole(i%2 == 0 ? 0.3 : -0.3, dipole, quadrupole, AmoebaMultipoleForce::NoAxisType, -1, -1, -1, 0.39, pow(polarity, 1.0/6.0), polarity);
+        vdw->addParticle(i, 0.3, 0.4, 0.0);
+        Vec3 offset(genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5);
+        Vec3 site(i%gridSize, (i/gridSize)%gridSize, i/(gridSize*gridSize));
+        positions.push_back((site+offset*0.2)*spacing);
+    }
+    system.addForce(multipoles);
+    system.addForce(vdw);
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, Platform::getPlatformByName("CUDA"));
+    context.setPositions(positions);
+    checkStepPerformance(context, integrator, "AMOEBA", steps);
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        registerAmoebaCudaKernelFactories();
+        if (argc > 1)
+            Platform::getPlatformByName("CUDA").setPropertyDefaultValue("Precision", std::string(argv[1]));
+        benchmarkAmoeba(10000, 20);
+    }
+    catch(const std::exception& e) {
+        std::cout << "exception: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "Done" << std::endl;
+    return 0;
+}
@@ -70,6 +70,11 @@ static vector<Vec3>& extractForces(ContextImpl& context) {
     return *data->forces;
 }
 
+static ThreadPool* extractThreadPool(ContextImpl& context) {
+    ReferencePlatform::PlatformData* data = reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData());
+    return data->getThreadPool();
+}
+
 static Vec3& extractBoxSize(ContextImpl& context) {
     ReferencePlatform::PlatformData* data = reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData());
     return *data->periodicBoxSize;
@@ -114,6 +119,7 @@ double ReferenceCalcAmoebaBondForceKernel::execute(ContextImpl& context, bool in
     AmoebaReferenceBondForce amoebaReferenceBondForce;
     if (usePeriodic)
         amoebaReferenceBondForce.setPeriodic(extractBoxVectors(context));
+    amoebaReferenceBondForce.setThreadPool(extractThreadPool(context));
     double energy = amoebaReferenceBondForce.calculateForceAndEnergy(numBonds, posData, particle1, particle2, length, kQuadratic,
                                                                      globalBondCubic, globalBondQuartic,
                                                                      forceData);
@@ -173,6 +179,7 @@ double ReferenceCalcAmoebaAngleForceKernel::execute(ContextImpl& context, bool i
     AmoebaReferenceAngleForce amoebaReferenceAngleForce;
     if (usePeriodic)
         amoebaReferenceAngleForce.setPeriodic(extractBoxVectors(context));
+    amoebaReferenceAngleForce.setThreadPool(extractThreadPool(context));
     double energy = amoebaReferenceAngleForce.calculateForceAndEnergy(numAngles, 
                                        posData, particle1, particle2, particle3, angle, kQuadratic, globalAngleCubic, globalAngleQuartic, globalAnglePentic, globalAngleSextic, forceData);
     return static_cast<double>(energy);
@@ -230,6 +237,7 @@ double ReferenceCalcAmoebaInPlaneAngleForceKernel::execute(ContextImpl& context,
     AmoebaReferenceInPlaneAngleForce amoebaReferenceInPlaneAngleForce;
     if (usePeriodic)
         amoebaReferenceInPlaneAngleForce.setPeriodic(extractBoxVectors(context));
+    amoebaReferenceInPlaneAngleForce.setThreadPool(extractThreadPool(context));
     double energy = amoebaReferenceInPlaneAngleForce.calculateForceAndEnergy(numAngles, posData, particle1, particle2, particle3, particle4, 
                                                                              angle, kQuadratic, globalInPlaneAngleCubic, globalInPlaneAngleQuartic,
                                                                              globalInPlaneAnglePentic, globalInPlaneAngleSextic, forceData);
@@ -285,6 +293,7 @@ double ReferenceCalcAmoebaPiTorsionForceKernel::execute(ContextImpl& context, bo
     AmoebaReferencePiTorsionForce amoebaReferencePiTorsionForce;
     if (usePeriodic)
         amoebaReferencePiTorsionForce.setPeriodic(extractBoxVectors(context));
+    amoebaReferencePiTorsionForce.setThreadPool(extractThreadPool(context));
     double energy = amoebaReferencePiTorsionForce.calculateForceAndEnergy(numPiTorsions, posData, particle1, particle2,
                                                                                     particle3, particle4, particle5, particle6,
                                                                                     kTorsion, forceData);
@@ -340,6 +349,7 @@ double ReferenceCalcAmoebaStretchBendForceKernel::execute(ContextImpl& context,
     AmoebaReferenceStretchBendForce amoebaReferenceStretchBendForce;
     if (usePeriodic)
         amoebaReferenceStretchBendForce.setPeriodic(extractBoxVectors(context));
+    amoebaReferenceStretchBendForce.setThreadPool(extractThreadPool(context));
     double energy = amoebaReferenceStretchBendForce.calculateForceAndEnergy(numStretchBends, posData, particle1, particle2, particle3,
                                                                                       lengthABParameters, lengthCBParameters, angleParameters, k1Parameters,
                                                                                       k2Parameters, forceData);
@@ -401,6 +411,7 @@ double ReferenceCalcAmoebaOutOfPlaneBendForceKernel::execute(ContextImpl& contex
     AmoebaReferenceOutOfPlaneBendForce amoebaReferenceOutOfPlaneBendForce;
     if (usePeriodic)
         amoebaReferenceOutOfPlaneBendForce.setPeriodic(extractBoxVectors(context));
+    amoebaReferenceOutOfPlaneBendForce.setThreadPool(extractThreadPool(context));
     double energy = amoebaReferenceOutOfPlaneBendForce.calculateForceAndEnergy(numOutOfPlaneBends, posData,
                                                                                particle1, particle2, particle3, particle4,
                                                                                kParameters, 
@@ -499,6 +510,7 @@ double ReferenceCalcAmoebaTorsionTorsionForceKernel::execute(ContextImpl& contex
     AmoebaReferenceTorsionTorsionForce amoebaReferenceTorsionTorsionForce;
     if (usePeriodic)
         amoebaReferenceTorsionTorsionForce.setPeriodic(extractBoxVectors(context));
+    amoebaReferenceTorsionTorsionForce.setThreadPool(extractThreadPool(context));
     double energy = amoebaReferenceTorsionTorsionForce.calculateForceAndEnergy(numTorsionTorsions, posData,
                                                                                          particle1, particle2, particle3, particle4, particle5,
                                                                                          chiralCheckAtom, gridIndices, torsionTorsionGrids, forceData);
@@ -1023,6 +1035,7 @@ double ReferenceCalcAmoebaVdwForceKernel::execute(ContextImpl& context, bool inc
     vector<Vec3>& forceData = extractForces(context);
     double energy;
     double lambda = context.getParameter(AmoebaVdwForce::Lambda());
+    vdwForce.setThreadPool(extractThreadPool(context));
     if (useCutoff) {
         computeNeighborListVoxelHash(*neighborList, numParticles, posData, vdwForce.getExclusions(), extractBoxVectors(context), usePBC, cutoff, 0.0);
         if (usePBC) {
@@ -1083,12 +1096,17 @@ void ReferenceCalcAmoebaWcaDispersionForceKernel::initialize(const System& syste
     shctd   = force.getShctd();
     dispoff = force.getDispoff();
     slevy   = force.getSlevy();
+    useCutoff = force.getUseCutoff();
+    cutoff    = force.getCutoffDistance();
+    switchingDistance = force.getSwitchingDistance();
 }
 
 double ReferenceCalcAmoebaWcaDispersionForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
     vector<Vec3>& posData = extractPositions(context);
     vector<Vec3>& forceData = extractForces(context);
     AmoebaReferenceWcaDispersionForce amoebaReferenceWcaDispersionForce(epso, epsh, rmino, rminh, awater, shctd, dispoff, slevy);
+    if (useCutoff)
+        amoebaReferenceWcaDispersionForce.setCutoff(cutoff, switchingDistance);
     double energy = amoebaReferenceWcaDispersionForce.calculateForceAndEnergy(numParticles, posData, radii, epsilons, totalMaximumDispersionEnergy, forceData);
     return static_cast<double>(energy);
 }
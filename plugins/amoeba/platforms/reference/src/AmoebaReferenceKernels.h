@@ -550,6 +550,8 @@ private:
     double shctd; 
     double dispoff;
     double slevy;
+    bool useCutoff;
+    double cutoff, switchingDistance;
     double totalMaximumDispersionEnergy;
     const System& system;
 };
@@ -24,6 +24,7 @@
 
 #include "AmoebaReferenceForce.h"
 #include "AmoebaReferenceAngleForce.h"
+#include "ReferencePairLoop.h"
 #include "SimTKOpenMMRealType.h"
 
 using std::vector;
@@ -36,6 +37,10 @@ void AmoebaReferenceAngleForce::setPeriodic(OpenMM::Vec3* vectors) {
     boxVectors[2] = vectors[2];
 }
 
+void AmoebaReferenceAngleForce::setThreadPool(ThreadPool* threads) {
+    this->threads = threads;
+}
+
 /**---------------------------------------------------------------------------------------
 
    Get dEdT and energy prefactor given cosine of angle :: the calculation for different
@@ -183,22 +188,21 @@ double AmoebaReferenceAngleForce::calculateForceAndEnergy(int numAngles, vector<
                                                           double anglePentic,
                                                           double angleSextic,
                                                           vector<Vec3>& forceData) const {
-    double energy = 0.0; 
-    for (unsigned int ii = 0; ii < static_cast<unsigned int>(numAngles); ii++) {
-        int particle1Index = particle1[ii];
-        int particle2Index = particle2[ii];
-        int particle3Index = particle3[ii];
-        double idealAngle = angle[ii];
-        double angleK = kQuadratic[ii];
+    struct TermResult {
+        double energy;
         Vec3 forces[3];
-        energy += calculateAngleIxn(posData[particle1Index], posData[particle2Index], posData[particle3Index],
-                                    idealAngle, angleK, angleCubic, angleQuartic, anglePentic, angleSextic, forces);
-
-        for (unsigned int jj = 0; jj < 3; jj++) {
-            forceData[particle1Index][jj] += forces[0][jj];
-            forceData[particle2Index][jj] += forces[1][jj];
-            forceData[particle3Index][jj] += forces[2][jj];
-        }
-    }   
+    };
+    double energy = 0.0;
+    computePairsInOrder<TermResult>(threads, numAngles,
+        [&] (int threadIndex, int ii, TermResult& result) {
+            result.energy = calculateAngleIxn(posData[particle1[ii]], posData[particle2[ii]], posData[particle3[ii]],
+                                              angle[ii], kQuadratic[ii], angleCubic, angleQuartic, anglePentic, angleSextic, result.forces);
+        },
+        [&] (int ii, TermResult& result) {
+            energy += result.energy;
+            forceData[particle1[ii]] += result.forces[0];
+            forceData[particle2[ii]] += result.forces[1];
+            forceData[particle3[ii]] += result.forces[2];
+        });
     return energy;
 }
@@ -23,6 +23,7 @@
  */
 
 #include "AmoebaReferenceBondForce.h"
+#include "ReferencePairLoop.h"
 #include "AmoebaReferenceForce.h"
 
 using std::vector;
@@ -35,6 +36,10 @@ void AmoebaReferenceBondForce::setPeriodic(OpenMM::Vec3* vectors) {
     boxVectors[2] = vectors[2];
 }
 
+void AmoebaReferenceBondForce::setThreadPool(ThreadPool* threads) {
+    this->threads = threads;
+}
+
 /**---------------------------------------------------------------------------------------
 
    Calculate Amoeba bond ixn (force and energy)
@@ -95,23 +100,21 @@ double AmoebaReferenceBondForce::calculateForceAndEnergy(int numBonds,
                                                          double globalBondCubic,
                                                          double globalBondQuartic,
                                                          vector<Vec3>& forceData) const {
-    double energy = 0.0; 
-    for (int ii = 0; ii < numBonds; ii++) {
-        int particle1Index = particle1[ii];
-        int particle2Index = particle2[ii];
-        double bondLength = length[ii];
-        double bondK = kQuadratic[ii];
+    struct TermResult {
+        double energy;
         Vec3 forces[2];
-
-        energy += calculateBondIxn(particlePositions[particle1Index], particlePositions[particle2Index],
-                                   bondLength, bondK, globalBondCubic, globalBondQuartic,
-                                   forces);
-
-        for (int jj = 0; jj < 3; jj++) {
-            forceData[particle1Index][jj] += forces[0][jj];
-            forceData[particle2Index][jj] += forces[1][jj];
-        }
-
-    }   
+    };
+    double energy = 0.0;
+    computePairsInOrder<TermResult>(threads, numBonds,
+        [&] (int threadIndex, int ii, TermResult& result) {
+            result.energy = calculateBondIxn(particlePositions[particle1[ii]], particlePositions[particle2[ii]],
+                                             length[ii], kQuadratic[ii], globalBondCubic, globalBondQuartic,
+                                             result.forces);
+        },
+        [&] (int ii, TermResult& result) {
+            energy += result.energy;
+            forceData[particle1[ii]] += result.forces[0];
+            forceData[particle2[ii]] += result.forces[1];
+        });
     return energy;
 }
@@ -24,6 +24,7 @@
 
 #include "AmoebaReferenceForce.h"
 #include "AmoebaReferenceInPlaneAngleForce.h"
+#include "ReferencePairLoop.h"
 #include "ReferenceForce.h"
 #include "SimTKOpenMMRealType.h"
 
@@ -37,6 +38,10 @@ void AmoebaReferenceInPlaneAngleForce::setPeriodic(OpenMM::Vec3* vectors) {
     boxVectors[2] = vectors[2];
 }
 
+void AmoebaReferenceInPlaneAngleForce::setThreadPool(ThreadPool* threads) {
+    this->threads = threads;
+}
+
 /**---------------------------------------------------------------------------------------
 
    Get dEdT and energy prefactor given cosine of angle :: the calculation for different
@@ -230,28 +235,23 @@ double AmoebaReferenceInPlaneAngleForce::calculateForceAndEnergy(int numAngles,
                                                                  double anglePentic,
                                                                  double angleSextic,
                                                                  vector<Vec3>& forceData) const {
-    double energy      = 0.0; 
-    for (unsigned int ii = 0; ii < static_cast<unsigned int>(numAngles); ii++) {
-        int particle1Index = particle1[ii];
-        int particle2Index = particle2[ii];
-        int particle3Index = particle3[ii];
-        int particle4Index = particle4[ii];
-        double idealAngle  = angle[ii];
-        double angleK      = kQuadratic[ii];
+    struct TermResult {
+        double energy;
         Vec3 forces[4];
-        energy            += calculateAngleIxn(posData[particle1Index], posData[particle2Index], posData[particle3Index], posData[particle4Index],
-                                               idealAngle, angleK, angleCubic, angleQuartic, anglePentic, angleSextic, forces);
-
-        // accumulate forces
-     
-        for (int jj = 0; jj < 3; jj++) {
-            forceData[particle1Index][jj] -= forces[0][jj];
-            forceData[particle2Index][jj] -= forces[1][jj];
-            forceData[particle3Index][jj] -= forces[2][jj];
-            forceData[particle4Index][jj] -= forces[3][jj];
-        }
- 
-    }   
+    };
+    double energy = 0.0;
+    computePairsInOrder<TermResult>(threads, numAngles,
+        [&] (int threadIndex, int ii, TermResult& result) {
+            result.energy = calculateAngleIxn(posData[particle1[ii]], posData[particle2[ii]], posData[particle3[ii]], posData[particle4[ii]],
+                                              angle[ii], kQuadratic[ii], angleCubic, angleQuartic, anglePentic, angleSextic, result.forces);
+        },
+        [&] (int ii, TermResult& result) {
+            energy += result.energy;
+            forceData[particle1[ii]] -= result.forces[0];
+            forceData[particle2[ii]] -= result.forces[1];
+            forceData[particle3[ii]] -= result.forces[2];
+            forceData[particle4[ii]] -= result.forces[3];
+        });
     return energy;
 }
 
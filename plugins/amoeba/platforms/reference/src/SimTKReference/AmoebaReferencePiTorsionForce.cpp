@@ -23,6 +23,7 @@
 
 #include "AmoebaReferenceForce.h"
 #include "AmoebaReferencePiTorsionForce.h"
+#include "ReferencePairLoop.h"
 #include <cmath>
 #include <vector>
 
@@ -36,6 +37,10 @@ void AmoebaReferencePiTorsionForce::setPeriodic(OpenMM::Vec3* vectors) {
     boxVectors[2] = vectors[2];
 }
 
+void AmoebaReferencePiTorsionForce::setThreadPool(ThreadPool* threads) {
+    this->threads = threads;
+}
+
 /**---------------------------------------------------------------------------------------
 
    Calculate Amoeba pi-torsion ixn (force and energy)
@@ -200,32 +205,26 @@ double AmoebaReferencePiTorsionForce::calculateForceAndEnergy(int numPiTorsions,
                                                               const std::vector<int>&  particle6,
                                                               const std::vector<double>& kTorsion,
                                                               vector<Vec3>& forceData) const {
-    double energy  = 0.0; 
-    for (unsigned int ii = 0; ii < static_cast<unsigned int>(numPiTorsions); ii++) {
-
-        int particle1Index      = particle1[ii];
-        int particle2Index      = particle2[ii];
-        int particle3Index      = particle3[ii];
-        int particle4Index      = particle4[ii];
-        int particle5Index      = particle5[ii];
-        int particle6Index      = particle6[ii];
-
+    struct TermResult {
+        double energy;
         Vec3 forces[6];
-        energy                 += calculatePiTorsionIxn(posData[particle1Index], posData[particle2Index],
-                                                        posData[particle3Index], posData[particle4Index],
-                                                        posData[particle5Index], posData[particle6Index],
-                                                        kTorsion[ii], forces);
-        // accumulate forces
-     
-        for (int jj = 0; jj < 3; jj++) {
-            forceData[particle1Index][jj] -= forces[0][jj];
-            forceData[particle2Index][jj] -= forces[1][jj];
-            forceData[particle3Index][jj] -= forces[2][jj];
-            forceData[particle4Index][jj] -= forces[3][jj];
-            forceData[particle5Index][jj] -= forces[4][jj];
-            forceData[particle6Index][jj] -= forces[5][jj];
-        }   
-
-    }   
+    };
+    double energy = 0.0;
+    computePairsInOrder<TermResult>(threads, numPiTorsions,
+        [&] (int threadIndex, int ii, TermResult& result) {
+            result.energy = calculatePiTorsionIxn(posData[particle1[ii]], posData[particle2[ii]],
+                                                  posData[particle3[ii]], posData[particle4[ii]],
+                                                  posData[particle5[ii]], posData[particle6[ii]],
+                                                  kTorsion[ii], result.forces);
+        },
+        [&] (int ii, TermResult& result) {
+            energy += result.energy;
+            forceData[particle1[ii]] -= result.forces[0];
+            forceData[particle2[ii]] -= result.forces[1];
+            forceData[particle3[ii]] -= result.forces[2];
+            forceData[particle4[ii]] -= result.forces[3];
+            forceData[particle5[ii]] -= result.forces[4];
+            forceData[particle6[ii]] -= result.forces[5];
+        });
     return energy;
 }
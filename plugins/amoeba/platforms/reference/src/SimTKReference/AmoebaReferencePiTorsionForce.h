@@ -26,6 +26,7 @@
 #define __AmoebaReferencePiTorsionForce_H__
 
 #include "openmm/Vec3.h"
+#include "openmm/internal/ThreadPool.h"
 #include <vector>
 
 namespace OpenMM {
@@ -40,7 +41,7 @@ public:
        
        --------------------------------------------------------------------------------------- */
  
-    AmoebaReferencePiTorsionForce() : usePeriodic(false) {};
+    AmoebaReferencePiTorsionForce() : usePeriodic(false), threads(NULL) {};
  
     /**---------------------------------------------------------------------------------------
        
@@ -60,6 +61,18 @@ public:
       
     void setPeriodic(OpenMM::Vec3* vectors);
 
+    /**---------------------------------------------------------------------------------------
+
+       Set a thread pool to divide the interactions between.  If this is NULL (the default)
+       or the pool has only one thread, all interactions are computed on the calling thread.
+       The results are identical in either case.
+
+       @param threads    the thread pool to use
+
+       --------------------------------------------------------------------------------------- */
+
+    void setThreadPool(ThreadPool* threads);
+ 
      /**---------------------------------------------------------------------------------------
      
         Calculate Amoeba torsion ixns (force and energy)
@@ -97,6 +110,7 @@ private:
 
     bool usePeriodic;
     Vec3 boxVectors[3];
+    ThreadPool* threads;
 
     /**---------------------------------------------------------------------------------------
     
@@ -24,6 +24,7 @@
 
 #include "AmoebaReferenceForce.h"
 #include "AmoebaReferenceStretchBendForce.h"
+#include "ReferencePairLoop.h"
 #include "SimTKOpenMMRealType.h"
 #include <vector>
 
@@ -37,6 +38,10 @@ void AmoebaReferenceStretchBendForce::setPeriodic(OpenMM::Vec3* vectors) {
     boxVectors[2] = vectors[2];
 }
 
+void AmoebaReferenceStretchBendForce::setThreadPool(ThreadPool* threads) {
+    this->threads = threads;
+}
+
 /**---------------------------------------------------------------------------------------
 
    Calculate Amoeba stretch bend angle ixn (force and energy)
@@ -164,28 +169,23 @@ double AmoebaReferenceStretchBendForce::calculateForceAndEnergy(int numStretchBe
                                                                 const std::vector<double>&  k1Quadratic,
                                                                 const std::vector<double>&  k2Quadratic,
                                                                 vector<Vec3>& forceData) const {
-    double energy = 0.0; 
-    for (unsigned int ii = 0; ii < static_cast<unsigned int>(numStretchBends); ii++) {
-        int particle1Index  = particle1[ii];
-        int particle2Index  = particle2[ii];
-        int particle3Index  = particle3[ii];
-        double abLength     = lengthABParameters[ii];
-        double cbLength     = lengthCBParameters[ii];
-        double idealAngle   = angle[ii];
-        double angleK1      = k1Quadratic[ii];
-        double angleK2      = k2Quadratic[ii];
+    struct TermResult {
+        double energy;
         Vec3 forces[3];
-        energy             += calculateStretchBendIxn(posData[particle1Index], posData[particle2Index], posData[particle3Index],
-                                                      abLength, cbLength, idealAngle, angleK1, angleK2, forces);
-        // accumulate forces
-    
-        for (int jj = 0; jj < 3; jj++) {
-            forceData[particle1Index][jj] -= forces[0][jj];
-            forceData[particle2Index][jj] -= forces[1][jj];
-            forceData[particle3Index][jj] -= forces[2][jj];
-        }
-
-    }   
+    };
+    double energy = 0.0;
+    computePairsInOrder<TermResult>(threads, numStretchBends,
+        [&] (int threadIndex, int ii, TermResult& result) {
+            result.energy = calculateStretchBendIxn(posData[particle1[ii]], posData[particle2[ii]], posData[particle3[ii]],
+                                                    lengthABParameters[ii], lengthCBParameters[ii], angle[ii], k1Quadratic[ii], k2Quadratic[ii],
+                                                    result.forces);
+        },
+        [&] (int ii, TermResult& result) {
+            energy += result.energy;
+            forceData[particle1[ii]] -= result.forces[0];
+            forceData[particle2[ii]] -= result.forces[1];
+            forceData[particle3[ii]] -= result.forces[2];
+        });
     return energy;
 }
 
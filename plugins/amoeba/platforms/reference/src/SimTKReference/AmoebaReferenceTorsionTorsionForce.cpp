@@ -23,6 +23,7 @@
 
 #include "AmoebaReferenceForce.h"
 #include "AmoebaReferenceTorsionTorsionForce.h"
+#include "ReferencePairLoop.h"
 #include "SimTKOpenMMRealType.h"
 
 using std::vector;
@@ -35,6 +36,10 @@ void AmoebaReferenceTorsionTorsionForce::setPeriodic(OpenMM::Vec3* vectors) {
     boxVectors[2] = vectors[2];
 }
 
+void AmoebaReferenceTorsionTorsionForce::setThreadPool(ThreadPool* threads) {
+    this->threads = threads;
+}
+
 /**---------------------------------------------------------------------------------------
 
    Load grid values from rectenclosing angles
@@ -538,41 +543,27 @@ double AmoebaReferenceTorsionTorsionForce::calculateForceAndEnergy(int numTorsio
                                                                    const std::vector<int>&  gridIndices,
                                                                    const std::vector< std::vector< std::vector< std::vector<double> > > >& torsionTorsionGrids,
                                                                    vector<Vec3>& forceData) const {
-    double energy  = 0.0; 
-    for (unsigned int ii = 0; ii < static_cast<unsigned int>(numTorsionTorsions); ii++) {
-
-        int particle1Index       = particle1[ii];
-        int particle2Index       = particle2[ii];
-        int particle3Index       = particle3[ii];
-        int particle4Index       = particle4[ii];
-        int particle5Index       = particle5[ii];
-
-        int chiralCheckAtomIndex = chiralCheckAtom[ii];
-
-        int gridIndex            = gridIndices[ii];
-
+    struct TermResult {
+        double energy;
         Vec3 forces[5];
-        Vec3* chiralCheckAtom;
-        if (chiralCheckAtomIndex > -1) {
-            chiralCheckAtom = &posData[chiralCheckAtomIndex];
-        } else {
-            chiralCheckAtom = NULL;
-        }
-        energy                 += calculateTorsionTorsionIxn(posData[particle1Index], posData[particle2Index],
-                                                             posData[particle3Index], posData[particle4Index],
-                                                             posData[particle5Index], chiralCheckAtom, torsionTorsionGrids[gridIndex],
-                                                             forces);
-
-        // accumulate forces
-    
-        for (int jj = 0; jj < 3; jj++) {
-            forceData[particle1Index][jj] -= forces[0][jj];
-            forceData[particle2Index][jj] -= forces[1][jj];
-            forceData[particle3Index][jj] -= forces[2][jj];
-            forceData[particle4Index][jj] -= forces[3][jj];
-            forceData[particle5Index][jj] -= forces[4][jj];
-        }
-
-    }   
+    };
+    double energy = 0.0;
+    computePairsInOrder<TermResult>(threads, numTorsionTorsions,
+        [&] (int threadIndex, int ii, TermResult& result) {
+            int chiralCheckAtomIndex = chiralCheckAtom[ii];
+            Vec3* chiralCheckPosition = (chiralCheckAtomIndex > -1 ? &posData[chiralCheckAtomIndex] : NULL);
+            result.energy = calculateTorsionTorsionIxn(posData[particle1[ii]], posData[particle2[ii]],
+                                                       posData[particle3[ii]], posData[particle4[ii]],
+                                                       posData[particle5[ii]], chiralCheckPosition, torsionTorsionGrids[gridIndices[ii]],
+                                                       result.forces);
+        },
+        [&] (int ii, TermResult& result) {
+            energy += result.energy;
+            forceData[particle1[ii]] -= result.forces[0];
+            forceData[particle2[ii]] -= result.forces[1];
+            forceData[particle3[ii]] -= result.forces[2];
+            forceData[particle4[ii]] -= result.forces[3];
+            forceData[particle5[ii]] -= result.forces[4];
+        });
     return energy;
 }
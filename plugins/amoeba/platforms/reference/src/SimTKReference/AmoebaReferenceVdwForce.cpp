@@ -33,7 +33,7 @@
 using std::vector;
 using namespace OpenMM;
 
-AmoebaReferenceVdwForce::AmoebaReferenceVdwForce() : _nonbondedMethod(AmoebaVdwForce::NoCutoff), _cutoff(1.0e+10), _taperCutoffFactor(0.9), _n(5), _alpha(0.7), _alchemicalMethod(AmoebaVdwForce::None) {
+AmoebaReferenceVdwForce::AmoebaReferenceVdwForce() : _nonbondedMethod(AmoebaVdwForce::NoCutoff), _cutoff(1.0e+10), _taperCutoffFactor(0.9), _n(5), _alpha(0.7), _alchemicalMethod(AmoebaVdwForce::None), threads(NULL) {
     setTaperCoefficients(_cutoff);
 }
 
@@ -93,6 +93,10 @@ std::vector<std::set<int> >& AmoebaReferenceVdwForce::getExclusions() {
     return allExclusions;
 }
 
+void AmoebaReferenceVdwForce::setThreadPool(ThreadPool* threads) {
+    this->threads = threads;
+}
+
 void AmoebaReferenceVdwForce::addReducedForce(unsigned int particleI, unsigned int particleIV,
                                               double reduction, double sign,
                                               Vec3& force, vector<Vec3>& forces) const {
@@ -192,6 +196,45 @@ void AmoebaReferenceVdwForce::setReducedPositions(int numParticles,
     }
 }
 
+double AmoebaReferenceVdwForce::calculateSitePairIxn(int siteI, int siteJ, double lambda, const vector<Vec3>& reducedPositions,
+                                                     vector<Vec3>& forces) const {
+
+    double combinedSigma = sigmaMatrix[particleType[siteI]][particleType[siteJ]];
+    double combinedEpsilon = epsilonMatrix[particleType[siteI]][particleType[siteJ]];
+
+    double softcore        = 0.0;
+    int isAlchemicalI      = isAlchemical[siteI];
+    int isAlchemicalJ      = isAlchemical[siteJ];
+
+    if (this->_alchemicalMethod == AmoebaVdwForce::Decouple && (isAlchemicalI != isAlchemicalJ)) {
+       combinedEpsilon *= pow(lambda, this->_n);
+       softcore = this->_alpha * pow(1.0 - lambda, 2);
+    } else if (this->_alchemicalMethod == AmoebaVdwForce::Annihilate && (isAlchemicalI || isAlchemicalJ)) {
+       combinedEpsilon *= pow(lambda, this->_n);
+       softcore = this->_alpha * pow(1.0 - lambda, 2);
+    }
+
+    Vec3 force;
+    double energy = calculatePairIxn(combinedSigma, combinedEpsilon, softcore,
+                                     reducedPositions[siteI], reducedPositions[siteJ], force);
+
+    if (indexIVs[siteI] == siteI) {
+        forces[siteI][0] -= force[0];
+        forces[siteI][1] -= force[1];
+        forces[siteI][2] -= force[2];
+    } else {
+        addReducedForce(siteI, indexIVs[siteI], reductions[siteI], -1.0, force, forces);
+    }
+    if (indexIVs[siteJ] == siteJ) {
+        forces[siteJ][0] += force[0];
+        forces[siteJ][1] += force[1];
+        forces[siteJ][2] += force[2];
+    } else {
+        addReducedForce(siteJ, indexIVs[siteJ], reductions[siteJ], 1.0, force, forces);
+    }
+    return energy;
+}
+
 double AmoebaReferenceVdwForce::calculateForceAndEnergy(int numParticles, double lambda,
                                                         const vector<Vec3>& particlePositions,
                                                         vector<Vec3>& forces) const {
@@ -209,55 +252,38 @@ double AmoebaReferenceVdwForce::calculateForceAndEnergy(int numParticles, double
     //        then call addReducedForce() to apportion force to particle and its covalent partner
     //        based on reduction factor
     //    (4) reset exclusion vector
-
-    double energy = 0.0;
-    std::vector<unsigned int> exclusions(numParticles, 0);
-    for (unsigned int ii = 0; ii < static_cast<unsigned int>(numParticles); ii++) {
-
-        bool isAlchemicalI = isAlchemical[ii];
-        for (int jj : allExclusions[ii])
-            exclusions[jj] = 1;
-
-        for (unsigned int jj = ii+1; jj < static_cast<unsigned int>(numParticles); jj++) {
-            if (exclusions[jj] == 0) {
-                double combinedSigma = sigmaMatrix[particleType[ii]][particleType[jj]];
-                double combinedEpsilon = epsilonMatrix[particleType[ii]][particleType[jj]];
-                double softcore = 0.0;
-
-                if (this->_alchemicalMethod == AmoebaVdwForce::Decouple && (isAlchemicalI != isAlchemical[jj])) {
-                   combinedEpsilon *= pow(lambda, this->_n);
-                   softcore = this->_alpha * pow(1.0 - lambda, 2);
-                } else if (this->_alchemicalMethod == AmoebaVdwForce::Annihilate && (isAlchemicalI || isAlchemical[jj])) {
-                   combinedEpsilon *= pow(lambda, this->_n);
-                   softcore = this->_alpha * pow(1.0 - lambda, 2);
-                }
-
-                Vec3 force;
-                energy += calculatePairIxn(combinedSigma, combinedEpsilon, softcore,
-                                           reducedPositions[ii], reducedPositions[jj], force);
-
-                if (indexIVs[ii] == ii) {
-                    forces[ii][0] -= force[0];
-                    forces[ii][1] -= force[1];
-                    forces[ii][2] -= force[2];
-                } else {
-                    addReducedForce(ii, indexIVs[ii], reductions[ii], -1.0, force, forces);
-                }
-                if (indexIVs[jj] == jj) {
-                    forces[jj][0] += force[0];
-                    forces[jj][1] += force[1];
-                    forces[jj][2] += force[2];
-                } else {
-                    addReducedForce(jj, indexIVs[jj], reductions[jj], 1.0, force, forces);
-                }
-
-            }
+    //
+    // When a thread pool is available, rows are divided between threads and each one accumulates
+    // into its own force vector, which are summed at the end.
+
+    int numThreads = (threads == NULL ? 1 : threads->getNumThreads());
+    vector<double> threadEnergy(numThreads, 0.0);
+    vector<vector<Vec3> > threadForces(numThreads-1, vector<Vec3>(forces.size()));
+    auto computeRows = [&] (int threadIndex) {
+        vector<Vec3>& f = (threadIndex == 0 ? forces : threadForces[threadIndex-1]);
+        std::vector<unsigned int> exclusions(numParticles, 0);
+        for (int ii = threadIndex; ii < numParticles; ii += numThreads) {
+            for (int jj : allExclusions[ii])
+                exclusions[jj] = 1;
+            for (int jj = ii+1; jj < numParticles; jj++)
+                if (exclusions[jj] == 0)
+                    threadEnergy[threadIndex] += calculateSitePairIxn(ii, jj, lambda, reducedPositions, f);
+            for (int jj : allExclusions[ii])
+                exclusions[jj] = 0;
         }
-
-        for (int jj : allExclusions[ii])
-            exclusions[jj] = 0;
+    };
+    if (numThreads == 1)
+        computeRows(0);
+    else {
+        threads->execute([&] (ThreadPool& pool, int threadIndex) { computeRows(threadIndex); });
+        threads->waitForThreads();
     }
-
+    double energy = 0.0;
+    for (int i = 0; i < numThreads; i++)
+        energy += threadEnergy[i];
+    for (int i = 0; i < numThreads-1; i++)
+        for (int j = 0; j < forces.size(); j++)
+            forces[j] += threadForces[i][j];
     return energy;
 }
 
@@ -276,48 +302,31 @@ double AmoebaReferenceVdwForce::calculateForceAndEnergy(int numParticles, double
     //    (2) accumulate forces: if particle is a site where interaction position != particle position,
     //        then call addReducedForce() to apportion force to particle and its covalent partner
     //        based on reduction factor
-
-    double energy = 0.0;
-    for (unsigned int ii = 0; ii < neighborList.size(); ii++) {
-
-        OpenMM::AtomPair pair       = neighborList[ii];
-        int siteI                   = pair.first;
-        int siteJ                   = pair.second;
-
-        double combinedSigma = sigmaMatrix[particleType[siteI]][particleType[siteJ]];
-        double combinedEpsilon = epsilonMatrix[particleType[siteI]][particleType[siteJ]];
-
-        double softcore        = 0.0;
-        int isAlchemicalI      = isAlchemical[siteI];
-        int isAlchemicalJ      = isAlchemical[siteJ];
-
-        if (this->_alchemicalMethod == AmoebaVdwForce::Decouple && (isAlchemicalI != isAlchemicalJ)) {
-           combinedEpsilon *= pow(lambda, this->_n);
-           softcore = this->_alpha * pow(1.0 - lambda, 2);
-        } else if (this->_alchemicalMethod == AmoebaVdwForce::Annihilate && (isAlchemicalI || isAlchemicalJ)) {
-           combinedEpsilon *= pow(lambda, this->_n);
-           softcore = this->_alpha * pow(1.0 - lambda, 2);
-        }
-
-        Vec3 force;
-        energy += calculatePairIxn(combinedSigma, combinedEpsilon, softcore,
-                                   reducedPositions[siteI], reducedPositions[siteJ], force);
-                
-        if (indexIVs[siteI] == siteI) {
-            forces[siteI][0] -= force[0];
-            forces[siteI][1] -= force[1];
-            forces[siteI][2] -= force[2];
-        } else {
-            addReducedForce(siteI, indexIVs[siteI], reductions[siteI], -1.0, force, forces);
-        }
-        if (indexIVs[siteJ] == siteJ) {
-            forces[siteJ][0] += force[0];
-            forces[siteJ][1] += force[1];
-            forces[siteJ][2] += force[2];
-        } else {
-            addReducedForce(siteJ, indexIVs[siteJ], reductions[siteJ], 1.0, force, forces);
-        }
+    //
+    // When a thread pool is available, the list is divided into contiguous blocks, one per thread.
+
+    int numThreads = (threads == NULL ? 1 : threads->getNumThreads());
+    int numPairs = neighborList.size();
+    vector<double> threadEnergy(numThreads, 0.0);
+    vector<vector<Vec3> > threadForces(numThreads-1, vector<Vec3>(forces.size()));
+    auto computePairs = [&] (int threadIndex) {
+        vector<Vec3>& f = (threadIndex == 0 ? forces : threadForces[threadIndex-1]);
+        int start = (int) ((threadIndex*(long long) numPairs)/numThreads);
+        int end = (int) (((threadIndex+1)*(long long) numPairs)/numThreads);
+        for (int ii = start; ii < end; ii++)
+            threadEnergy[threadIndex] += calculateSitePairIxn(neighborList[ii].first, neighborList[ii].second, lambda, reducedPositions, f);
+    };
+    if (numThreads == 1)
+        computePairs(0);
+    else {
+        threads->execute([&] (ThreadPool& pool, int threadIndex) { computePairs(threadIndex); });
+        threads->waitForThreads();
     }
-
+    double energy = 0.0;
+    for (int i = 0; i < numThreads; i++)
+        energy += threadEnergy[i];
+    for (int i = 0; i < numThreads-1; i++)
+        for (int j = 0; j < forces.size(); j++)
+            forces[j] += threadForces[i][j];
     return energy;
 }
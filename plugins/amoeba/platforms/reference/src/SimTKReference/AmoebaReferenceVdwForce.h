@@ -28,6 +28,7 @@
 #include "openmm/Vec3.h"
 #include "openmm/AmoebaVdwForce.h"
 #include "ReferenceNeighborList.h"
+#include "openmm/internal/ThreadPool.h"
 #include <set>
 #include <string>
 #include <vector>
@@ -82,6 +83,17 @@ public:
     
     std::vector<std::set<int> >& getExclusions();
 
+    /**---------------------------------------------------------------------------------------
+    
+       Set a thread pool to divide the interactions between.  If this is NULL (the default)
+       or the pool has only one thread, all interactions are computed on the calling thread.
+    
+       @param threads    the thread pool to use
+    
+       --------------------------------------------------------------------------------------- */
+    
+    void setThreadPool(ThreadPool* threads);
+
     /**---------------------------------------------------------------------------------------
     
        Calculate Amoeba Hal vdw ixns
@@ -138,6 +150,7 @@ private:
     std::vector<bool> isAlchemical;
     std::vector<std::set<int> > allExclusions;
     Vec3 _periodicBoxVectors[3];
+    ThreadPool* threads;
 
     /**---------------------------------------------------------------------------------------
     
@@ -206,6 +219,23 @@ private:
                             const Vec3& particleIPosition, const Vec3& particleJPosition,
                             Vec3& force) const;
 
+    /**---------------------------------------------------------------------------------------
+    
+       Calculate the interaction between two sites and apply the force to the particles
+    
+       @param  siteI                index of the first site
+       @param  siteJ                index of the second site
+       @param  lambda               lambda value
+       @param  reducedPositions     reduced positions of all sites
+       @param  forces               force vector for particles
+    
+       @return energy for ixn
+
+       --------------------------------------------------------------------------------------- */
+    
+    double calculateSitePairIxn(int siteI, int siteJ, double lambda, const std::vector<Vec3>& reducedPositions,
+                                std::vector<OpenMM::Vec3>& forces) const;
+
 };
 
 }
@@ -34,9 +34,15 @@ using namespace OpenMM;
 
 AmoebaReferenceWcaDispersionForce::AmoebaReferenceWcaDispersionForce(double epso, double epsh, double rmino, double rminh, 
                                                                      double awater, double shctd, double dispoff, double slevy) :
-                               _epso(epso), _epsh(epsh), _rmino(rmino), _rminh(rminh), _awater(awater), _shctd(shctd), _dispoff(dispoff), _slevy(slevy) {
+                               _epso(epso), _epsh(epsh), _rmino(rmino), _rminh(rminh), _awater(awater), _shctd(shctd), _dispoff(dispoff), _slevy(slevy), _useCutoff(false) {
 }   
 
+void AmoebaReferenceWcaDispersionForce::setCutoff(double cutoff, double switchingDistance) {
+    _useCutoff         = true;
+    _cutoff            = cutoff;
+    _switchingDistance = switchingDistance;
+}
+
 
 double AmoebaReferenceWcaDispersionForce::calculatePairIxn(double radiusI, double radiusK, 
                                                            const Vec3& particleIPosition,
@@ -301,10 +307,26 @@ double AmoebaReferenceWcaDispersionForce::calculateForceAndEnergy(int numParticl
 
             if (ii == jj)continue;
 
+            Vec3 deltaR = particlePositions[ii] - particlePositions[jj];
+            double r    = sqrt(deltaR.dot(deltaR));
+            if (_useCutoff && r >= _cutoff)
+                continue;
+
             Vec3 force;
-            energy += calculatePairIxn(rmini, radii[jj],
-                                       particlePositions[ii], particlePositions[jj],
-                                       intermediateValues, force);
+            double pairEnergy = calculatePairIxn(rmini, radii[jj],
+                                                 particlePositions[ii], particlePositions[jj],
+                                                 intermediateValues, force);
+
+            // apply the switching function; pairEnergy has the opposite sign from the energy
+
+            if (_useCutoff && r > _switchingDistance) {
+                double t      = (r - _switchingDistance)/(_cutoff - _switchingDistance);
+                double switchValue = 1.0 + t*t*t*(-10.0 + t*(15.0 - t*6.0));
+                double switchDeriv = t*t*(-30.0 + t*(60.0 - t*30.0))/(_cutoff - _switchingDistance);
+                force       = force*switchValue + deltaR*(_slevy*_awater*pairEnergy*switchDeriv/r);
+                pairEnergy *= switchValue;
+            }
+            energy += pairEnergy;
             
             forces[ii][0] += force[0];
             forces[ii][1] += force[1];
@@ -61,6 +61,17 @@ public:
  
     ~AmoebaReferenceWcaDispersionForce() {};
  
+    /**---------------------------------------------------------------------------------------
+    
+       Ignore pairs beyond a cutoff, switching the interaction off smoothly
+    
+       @param cutoff            cutoff distance
+       @param switchingDistance distance at which the switching function begins
+    
+       --------------------------------------------------------------------------------------- */
+    
+    void setCutoff(double cutoff, double switchingDistance);
+ 
     /**---------------------------------------------------------------------------------------
     
        Calculate WcaDispersion ixns
@@ -90,6 +101,9 @@ private:
     double _shctd; 
     double _dispoff;
     double _slevy;
+    bool _useCutoff;
+    double _cutoff;
+    double _switchingDistance;
 
     enum { EMIXO, RMIXO, RMIXO7, AO, EMIXH, RMIXH, RMIXH7, AH, LastIntermediateValueIndex }; 
 
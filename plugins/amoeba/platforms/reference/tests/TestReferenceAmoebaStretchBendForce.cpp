@@ -41,6 +41,8 @@
 #include "openmm/LangevinIntegrator.h"
 #include "SimTKOpenMMRealType.h"
 #include <iostream>
+#include <map>
+#include <string>
 #include <vector>
 
 using namespace OpenMM;
@@ -304,6 +306,39 @@ void testPeriodic() {
         ASSERT_EQUAL_VEC(s1.getForces()[i], s2.getForces()[i], 1e-5);
 }
 
+void testThreadsGiveIdenticalResults() {
+    // Build a long zigzag chain with a stretch-bend at every atom.
+
+    System system;
+    AmoebaStretchBendForce* amoebaStretchBendForce = new AmoebaStretchBendForce();
+    int numberOfParticles = 2000;
+    std::vector<Vec3> positions(numberOfParticles);
+    for (int ii = 0; ii < numberOfParticles; ii++) {
+        system.addParticle(1.0);
+        positions[ii] = Vec3(0.1*ii, 0.08*(ii%2)+0.01*sin(0.1*ii), 0.02*cos(0.3*ii));
+        if (ii > 1)
+            amoebaStretchBendForce->addStretchBend(ii-2, ii-1, ii, 0.12, 0.13, 100.0*DegreesToRadians, 5.0+ii%7, 4.0-ii%3);
+    }
+    system.addForce(amoebaStretchBendForce);
+
+    // The forces and energy should be bitwise identical for any number of threads.
+
+    LangevinIntegrator integrator1(0.0, 0.1, 0.01);
+    Context context1(system, integrator1, Platform::getPlatformByName("Reference"));
+    context1.setPositions(positions);
+    State state1 = context1.getState(State::Forces | State::Energy);
+    std::map<std::string, std::string> properties;
+    properties["Threads"] = "4";
+    LangevinIntegrator integrator2(0.0, 0.1, 0.01);
+    Context context2(system, integrator2, Platform::getPlatformByName("Reference"), properties);
+    context2.setPositions(positions);
+    State state2 = context2.getState(State::Forces | State::Energy);
+    ASSERT(state1.getPotentialEnergy() != 0.0);
+    ASSERT(state1.getPotentialEnergy() == state2.getPotentialEnergy());
+    for (int i = 0; i < numberOfParticles; i++)
+        ASSERT(state1.getForces()[i] == state2.getForces()[i]);
+}
+
 int main(int numberOfArguments, char* argv[]) {
 
     try {
@@ -311,6 +346,7 @@ int main(int numberOfArguments, char* argv[]) {
         registerAmoebaReferenceKernelFactories();
         testOneStretchBend();
         testPeriodic();
+        testThreadsGiveIdenticalResults();
     }
     catch(const std::exception& e) {
         std::cout << "exception: " << e.what() << std::endl;
@@ -40,6 +40,7 @@
 #include "openmm/System.h"
 #include "openmm/AmoebaVdwForce.h"
 #include "openmm/LangevinIntegrator.h"
+#include "openmm/VerletIntegrator.h"
 #include "sfmt/SFMT.h"
 #include <iostream>
 #include <vector>
@@ -2205,6 +2206,37 @@ void testParticleTypes() {
     ASSERT_EQUAL_TOL(expectedEnergy, state.getPotentialEnergy(), 1e-5);
 }
 
+void testUpdateParametersAfterEnergy() {
+    // Computing the energy lets the integrator reuse the forces on its next step.  Make sure
+    // updateParametersInContext() causes them to be computed again with the new parameters.
+
+    System system;
+    for (int i = 0; i < 2; i++)
+        system.addParticle(1.0);
+    AmoebaVdwForce* vdw = new AmoebaVdwForce();
+    system.addForce(vdw);
+    vdw->addParticle(0, 0.3, 1.0, 1.0);
+    vdw->addParticle(1, 0.3, 1.0, 1.0);
+    vector<Vec3> positions;
+    positions.push_back(Vec3(0, 0, 0));
+    positions.push_back(Vec3(0.35, 0, 0));
+    VerletIntegrator integrator1(0.001);
+    Context context1(system, integrator1, Platform::getPlatformByName("Reference"));
+    context1.setPositions(positions);
+    context1.getState(State::Energy);
+    vdw->setParticleParameters(1, 1, 0.4, 2.0, 1.0);
+    vdw->updateParametersInContext(context1);
+    integrator1.step(1);
+    VerletIntegrator integrator2(0.001);
+    Context context2(system, integrator2, Platform::getPlatformByName("Reference"));
+    context2.setPositions(positions);
+    integrator2.step(1);
+    State state1 = context1.getState(State::Positions);
+    State state2 = context2.getState(State::Positions);
+    for (int i = 0; i < 2; i++)
+        ASSERT_EQUAL_VEC(state2.getPositions()[i], state1.getPositions()[i], 1e-10);
+}
+
 int main(int numberOfArguments, char* argv[]) {
 
     try {
@@ -2268,6 +2300,10 @@ int main(int numberOfArguments, char* argv[]) {
         
         testParticleTypes();
 
+        // Test updating parameters after the Context has computed forces.
+
+        testUpdateParametersAfterEnergy();
+
         // Set lambda and the softcore power (n) to any values (softcore alpha set to 0). 
         // The energy and forces are equal to scaling testVdwAmmoniaCubicMeanHhg by lambda^n;
         int n = 5;
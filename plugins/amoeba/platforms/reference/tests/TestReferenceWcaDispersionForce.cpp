@@ -172,6 +172,80 @@ void testWcaDispersionAmmonia(FILE* log) {
     compareForcesEnergy(testName, state1.getPotentialEnergy(), state2.getPotentialEnergy(), state1.getForces(), state2.getForces(), tolerance, log);
 }
 
+// test that the cutoff and switching function give forces consistent with the energy
+
+void testWcaDispersionCutoff(FILE* log) {
+
+    std::string testName      = "testWcaDispersionCutoff";
+    int numberOfParticles     = 8;
+
+    System system;
+    AmoebaWcaDispersionForce* amoebaWcaDispersionForce = new AmoebaWcaDispersionForce();
+    amoebaWcaDispersionForce->setEpso(4.6024000e-01);
+    amoebaWcaDispersionForce->setEpsh(5.6484000e-02);
+    amoebaWcaDispersionForce->setRmino(1.7025000e-01);
+    amoebaWcaDispersionForce->setRminh(1.3275000e-01);
+    amoebaWcaDispersionForce->setDispoff(2.6000000e-02);
+    amoebaWcaDispersionForce->setAwater(3.3428000e+01);
+    for (unsigned int ii = 0; ii < 2; ii++) {
+        system.addParticle(1.4007000e+01);
+        amoebaWcaDispersionForce->addParticle(1.8550000e-01, 4.3932000e-01);
+        for (unsigned int jj = 0; jj < 3; jj++) {
+            system.addParticle(1.0080000e+00);
+            amoebaWcaDispersionForce->addParticle(1.3500000e-01, 8.3680000e-02);
+        }
+    }
+    std::vector<Vec3> positions(numberOfParticles);
+    positions[0] = Vec3( 1.5927280e-01,  1.7000000e-06,  1.6491000e-03);
+    positions[1] = Vec3( 2.0805540e-01, -8.1258800e-02,  3.7282500e-02);
+    positions[2] = Vec3( 2.0843610e-01,  8.0953200e-02,  3.7462200e-02);
+    positions[3] = Vec3( 1.7280780e-01,  2.0730000e-04, -9.8741700e-02);
+    positions[4] = Vec3(-1.6743680e-01,  1.5900000e-05, -6.6149000e-03);
+    positions[5] = Vec3(-2.0428260e-01,  8.1071500e-02,  4.1343900e-02);
+    positions[6] = Vec3(-6.7308300e-02,  1.2800000e-05,  1.0623300e-02);
+    positions[7] = Vec3(-2.0426290e-01, -8.1231400e-02,  4.1033500e-02);
+    system.addForce(amoebaWcaDispersionForce);
+
+    // A cutoff longer than any distance should have no effect.
+
+    LangevinIntegrator integrator(0.0, 0.1, 0.01);
+    Context context(system, integrator, Platform::getPlatformByName("Reference"));
+    context.setPositions(positions);
+    State state1 = context.getState(State::Forces | State::Energy);
+    amoebaWcaDispersionForce->setUseCutoff(true);
+    amoebaWcaDispersionForce->setCutoffDistance(3.0);
+    amoebaWcaDispersionForce->setSwitchingDistance(2.0);
+    context.reinitialize(true);
+    State state2 = context.getState(State::Forces | State::Energy);
+    double tolerance          = 1.0e-04;
+    compareForcesEnergy(testName, state1.getPotentialEnergy(), state2.getPotentialEnergy(), state1.getForces(), state2.getForces(), tolerance, log);
+
+    // Use a cutoff that places many pairs in the switching region or beyond the cutoff.  Take a small
+    // step in the direction of the energy gradient and see whether the energy changes by the expected amount.
+
+    amoebaWcaDispersionForce->setCutoffDistance(0.25);
+    amoebaWcaDispersionForce->setSwitchingDistance(0.15);
+    context.reinitialize(true);
+    State state = context.getState(State::Forces | State::Energy);
+    ASSERT(std::abs(state.getPotentialEnergy()-state1.getPotentialEnergy()) > 0.1);
+    double norm = 0.0;
+    for (int i = 0; i < numberOfParticles; i++)
+        norm += state.getForces()[i].dot(state.getForces()[i]);
+    norm = std::sqrt(norm);
+    const double stepSize = 1e-3;
+    double step = 0.5*stepSize/norm;
+    std::vector<Vec3> positions2(numberOfParticles), positions3(numberOfParticles);
+    for (int i = 0; i < numberOfParticles; i++) {
+        positions2[i] = positions[i]-state.getForces()[i]*step;
+        positions3[i] = positions[i]+state.getForces()[i]*step;
+    }
+    context.setPositions(positions2);
+    state2 = context.getState(State::Energy);
+    context.setPositions(positions3);
+    State state3 = context.getState(State::Energy);
+    ASSERT_EQUAL_TOL_MOD(norm, (state2.getPotentialEnergy()-state3.getPotentialEnergy())/stepSize, 1e-3, testName);
+}
+
 int main(int numberOfArguments, char* argv[]) {
 
     try {
@@ -183,6 +257,7 @@ int main(int numberOfArguments, char* argv[]) {
         // test Wca dispersion force using two ammonia molecules
 
         testWcaDispersionAmmonia(log);
+        testWcaDispersionCutoff(log);
 
 
     }
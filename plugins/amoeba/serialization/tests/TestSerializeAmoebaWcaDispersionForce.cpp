@@ -54,6 +54,9 @@ void testSerialization() {
     force1.setShctd(  1.5);
     force1.setDispoff(1.6);
     force1.setSlevy(  1.7);
+    force1.setUseCutoff(true);
+    force1.setCutoffDistance(1.8);
+    force1.setSwitchingDistance(1.5);
 
     force1.addParticle(1.0, 2.0);
     force1.addParticle(1.1, 2.1);
@@ -78,6 +81,9 @@ void testSerialization() {
     ASSERT_EQUAL(force1.getShctd(),   force2.getShctd());
     ASSERT_EQUAL(force1.getDispoff(), force2.getDispoff());
     ASSERT_EQUAL(force1.getSlevy(),   force2.getSlevy());
+    ASSERT_EQUAL(force1.getUseCutoff(), force2.getUseCutoff());
+    ASSERT_EQUAL(force1.getCutoffDistance(), force2.getCutoffDistance());
+    ASSERT_EQUAL(force1.getSwitchingDistance(), force2.getSwitchingDistance());
 
     ASSERT_EQUAL(force1.getNumParticles(), force2.getNumParticles());
     for (unsigned int ii = 0; ii < static_cast<unsigned int>(force1.getNumParticles()); ii++) {
@@ -40,17 +40,109 @@
 #include <cmath>
 #include <algorithm>
 #include <cstring>
+#include <map>
 #include <sstream>
+#include <cstdio>
 #include <cstdlib>
+#include <tuple>
+#ifdef WIN32
+  #include <process.h>
+  #define getpid _getpid
+#else
+  #include <unistd.h>
+#endif
 
 using namespace OpenMM;
 using namespace std;
 
 static const int PME_ORDER = 5;
 
+bool isAvx512Supported();
+void spreadChargeAvx512(float* grid, int gridx, int gridy, int gridz, int gridIndexX, int gridIndexY, int gridIndexZ, float charge, const fvec4* data);
+
 bool CpuCalcDispersionPmeReciprocalForceKernel::hasInitializedThreads = false;
 int CpuCalcDispersionPmeReciprocalForceKernel::numThreads = 0;
 
+static pthread_mutex_t fftwPlannerLock = PTHREAD_MUTEX_INITIALIZER;
+static bool hasLoadedWisdom = false;
+
+/**
+ * A pair of FFT plans that is shared by every kernel using the same grid size and number of threads.
+ * The plans are always executed with the new-array interface on each kernel's own grids, so they are
+ * never tied to the arrays they were created with.
+ */
+struct SharedFFTPlans {
+    fftwf_plan forward, backward;
+    int refCount;
+};
+static map<tuple<int, int, int, int>, SharedFFTPlans> sharedFFTPlans;
+
+/**
+ * Get the forward and backward FFT plans for a grid.  Plans are cached and shared between kernels,
+ * so creating many Contexts for the same System only pays for planning once.  Each call must be
+ * matched by a call to releaseFFTPlans().  The FFTW planner is not thread safe, so this is
+ * serialized between kernels.  If the environment variable OPENMM_CPU_FFTW_WISDOM is set, it is the path
+ * to a file of FFTW wisdom.  The file is read before the first plan is created, and if planning
+ * produced new wisdom it is written back, so later processes using the same grid sizes skip the
+ * measurements.  The file is replaced atomically so that several jobs can share it.
+ */
+static void acquireFFTPlans(int gridx, int gridy, int gridz, int numThreads, float* realGrid, fftwf_complex* complexGrid, fftwf_plan& forwardFFT, fftwf_plan& backwardFFT) {
+    pthread_mutex_lock(&fftwPlannerLock);
+    auto key = make_tuple(gridx, gridy, gridz, numThreads);
+    auto cached = sharedFFTPlans.find(key);
+    if (cached != sharedFFTPlans.end()) {
+        cached->second.refCount++;
+        forwardFFT = cached->second.forward;
+        backwardFFT = cached->second.backward;
+        pthread_mutex_unlock(&fftwPlannerLock);
+        return;
+    }
+    char* wisdomFile = getenv("OPENMM_CPU_FFTW_WISDOM");
+    if (wisdomFile != NULL && !hasLoadedWisdom) {
+        fftwf_import_wisdom_from_filename(wisdomFile);
+        hasLoadedWisdom = true;
+    }
+    char* oldWisdom = (wisdomFile == NULL ? NULL : fftwf_export_wisdom_to_string());
+    fftwf_plan_with_nthreads(numThreads);
+    forwardFFT = fftwf_plan_dft_r2c_3d(gridx, gridy, gridz, realGrid, complexGrid, FFTW_MEASURE);
+    backwardFFT = fftwf_plan_dft_c2r_3d(gridx, gridy, gridz, complexGrid, realGrid, FFTW_MEASURE);
+    if (wisdomFile != NULL) {
+        char* newWisdom = fftwf_export_wisdom_to_string();
+        if (oldWisdom == NULL || newWisdom == NULL || strcmp(oldWisdom, newWisdom) != 0) {
+            stringstream tempFile;
+            tempFile << wisdomFile << ".tmp" << getpid();
+            if (fftwf_export_wisdom_to_filename(tempFile.str().c_str())) {
+#ifdef WIN32
+                remove(wisdomFile);
+#endif
+                if (rename(tempFile.str().c_str(), wisdomFile) != 0)
+                    remove(tempFile.str().c_str());
+            }
+        }
+        free(oldWisdom);
+        free(newWisdom);
+    }
+    SharedFFTPlans& plans = sharedFFTPlans[key];
+    plans.forward = forwardFFT;
+    plans.backward = backwardFFT;
+    plans.refCount = 1;
+    pthread_mutex_unlock(&fftwPlannerLock);
+}
+
+/**
+ * Release plans obtained from acquireFFTPlans(), destroying them once no kernel is using them.
+ */
+static void releaseFFTPlans(int gridx, int gridy, int gridz, int numThreads) {
+    pthread_mutex_lock(&fftwPlannerLock);
+    auto cached = sharedFFTPlans.find(make_tuple(gridx, gridy, gridz, numThreads));
+    if (cached != sharedFFTPlans.end() && --cached->second.refCount == 0) {
+        fftwf_destroy_plan(cached->second.forward);
+        fftwf_destroy_plan(cached->second.backward);
+        sharedFFTPlans.erase(cached);
+    }
+    pthread_mutex_unlock(&fftwPlannerLock);
+}
+
 static void spreadCharge(float* posq, float* grid, int gridx, int gridy, int gridz, int numParticles, Vec3* periodicBoxVectors, Vec3* recipBoxVectors,
         atomic<int>& atomicCounter, const float epsilonFactor, int threadIndex, int numThreads, bool deterministic) {
     float temp[4];
@@ -64,6 +156,7 @@ static void spreadCharge(float* posq, float* grid, int gridx, int gridy, int gri
     fvec4 one(1);
     fvec4 scale(1.0f/(PME_ORDER-1));
     float posInBox[4] = {0,0,0,0};
+    static const bool useAvx512 = isAvx512Supported();
     memset(grid, 0, sizeof(float)*gridx*gridy*gridz);
 
     const int groupSize = max(1, numParticles / (10 * numThreads));
@@ -112,12 +205,16 @@ static void spreadCharge(float* posq, float* grid, int gridx, int gridy, int gri
             int gridIndexZ = gridIndex[2];
             if (gridIndexX < 0)
                 return; // This happens when a simulation blows up and coordinates become NaN.
+            float charge = epsilonFactor*posq[4*i+3];
+            if (useAvx512 && gridz >= PME_ORDER) {
+                spreadChargeAvx512(grid, gridx, gridy, gridz, gridIndexX, gridIndexY, gridIndexZ, charge, data);
+                continue;
+            }
             int zindex[PME_ORDER];
             for (int j = 0; j < PME_ORDER; j++) {
                 zindex[j] = gridIndexZ+j;
                 zindex[j] -= (zindex[j] >= gridz ? gridz : 0);
             }
-            float charge = epsilonFactor*posq[4*i+3];
             fvec4 zdata0to3(data[0][2], data[1][2], data[2][2], data[3][2]);
             float zdata4 = data[4][2];
             if (gridIndexZ+4 < gridz) {
@@ -424,6 +521,7 @@ static void* threadBody(void* args) {
 }
 
 void CpuCalcPmeReciprocalForceKernel::initialize(int xsize, int ysize, int zsize, int numParticles, double alpha, bool deterministic) {
+    pthread_mutex_lock(&fftwPlannerLock);
     if (!hasInitializedThreads) {
         numThreads = getNumProcessors();
         char* threadsEnv = getenv("OPENMM_CPU_THREADS");
@@ -432,6 +530,7 @@ void CpuCalcPmeReciprocalForceKernel::initialize(int xsize, int ysize, int zsize
         fftwf_init_threads();
         hasInitializedThreads = true;
     }
+    pthread_mutex_unlock(&fftwPlannerLock);
     threadEnergy.resize(numThreads);
     gridx = findFFTDimension(xsize, false);
     gridy = findFFTDimension(ysize, false);
@@ -463,9 +562,7 @@ void CpuCalcPmeReciprocalForceKernel::initialize(int xsize, int ysize, int zsize
         tempGrid.push_back((float*) fftwf_malloc(sizeof(float)*(gridx*gridy*gridz+3)));
     realGrid = tempGrid[0];
     complexGrid = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex)*gridx*gridy*(gridz/2+1));
-    fftwf_plan_with_nthreads(numThreads);
-    forwardFFT = fftwf_plan_dft_r2c_3d(gridx, gridy, gridz, realGrid, complexGrid, FFTW_MEASURE);
-    backwardFFT = fftwf_plan_dft_c2r_3d(gridx, gridy, gridz, complexGrid, realGrid, FFTW_MEASURE);
+    acquireFFTPlans(gridx, gridy, gridz, numThreads, realGrid, complexGrid, forwardFFT, backwardFFT);
     hasCreatedPlan = true;
     
     // Initialize the b-spline moduli.
@@ -537,10 +634,8 @@ CpuCalcPmeReciprocalForceKernel::~CpuCalcPmeReciprocalForceKernel() {
         fftwf_free(grid);
     if (complexGrid != NULL)
         fftwf_free(complexGrid);
-    if (hasCreatedPlan) {
-        fftwf_destroy_plan(forwardFFT);
-        fftwf_destroy_plan(backwardFFT);
-    }
+    if (hasCreatedPlan)
+        releaseFFTPlans(gridx, gridy, gridz, numThreads);
 }
 
 void CpuCalcPmeReciprocalForceKernel::runMainThread() {
@@ -715,6 +810,7 @@ static void* dispersionThreadBody(void* args) {
 }
 
 void CpuCalcDispersionPmeReciprocalForceKernel::initialize(int xsize, int ysize, int zsize, int numParticles, double alpha, bool deterministic) {
+    pthread_mutex_lock(&fftwPlannerLock);
     if (!hasInitializedThreads) {
         numThreads = getNumProcessors();
         char* threadsEnv = getenv("OPENMM_CPU_THREADS");
@@ -723,6 +819,7 @@ void CpuCalcDispersionPmeReciprocalForceKernel::initialize(int xsize, int ysize,
         fftwf_init_threads();
         hasInitializedThreads = true;
     }
+    pthread_mutex_unlock(&fftwPlannerLock);
     threadEnergy.resize(numThreads);
     gridx = findFFTDimension(xsize, false);
     gridy = findFFTDimension(ysize, false);
@@ -754,9 +851,7 @@ void CpuCalcDispersionPmeReciprocalForceKernel::initialize(int xsize, int ysize,
         tempGrid.push_back((float*) fftwf_malloc(sizeof(float)*(gridx*gridy*gridz+3)));
     realGrid = tempGrid[0];
     complexGrid = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex)*gridx*gridy*(gridz/2+1));
-    fftwf_plan_with_nthreads(numThreads);
-    forwardFFT = fftwf_plan_dft_r2c_3d(gridx, gridy, gridz, realGrid, complexGrid, FFTW_MEASURE);
-    backwardFFT = fftwf_plan_dft_c2r_3d(gridx, gridy, gridz, complexGrid, realGrid, FFTW_MEASURE);
+    acquireFFTPlans(gridx, gridy, gridz, numThreads, realGrid, complexGrid, forwardFFT, backwardFFT);
     hasCreatedPlan = true;
     
     // Initialize the b-spline moduli.
@@ -828,10 +923,8 @@ CpuCalcDispersionPmeReciprocalForceKernel::~CpuCalcDispersionPmeReciprocalForceK
         fftwf_free(grid);
     if (complexGrid != NULL)
         fftwf_free(complexGrid);
-    if (hasCreatedPlan) {
-        fftwf_destroy_plan(forwardFFT);
-        fftwf_destroy_plan(backwardFFT);
-    }
+    if (hasCreatedPlan)
+        releaseFFTPlans(gridx, gridy, gridz, numThreads);
 }
 
 void CpuCalcDispersionPmeReciprocalForceKernel::runMainThread() {
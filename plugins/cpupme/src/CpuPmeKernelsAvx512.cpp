@@ -0,0 +1,94 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2021 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+
+#include "openmm/internal/vectorize.h"
+
+static const int PME_ORDER = 5;
+
+#ifdef __AVX512F__
+
+#include "openmm/internal/vectorizeAvx512.h"
+
+/**
+ * Spread the charge of one atom onto the grid.  Each row of PME_ORDER points along the
+ * z axis is updated with a single masked load, multiply-add, and store, or with a
+ * gather and scatter if the row wraps around the edge of the grid.
+ */
+void spreadChargeAvx512(float* grid, int gridx, int gridy, int gridz, int gridIndexX, int gridIndexY, int gridIndexZ, float charge, const fvec4* data) {
+    const __mmask16 mask = (1<<PME_ORDER)-1;
+    float zvalues[PME_ORDER];
+    int zindex[PME_ORDER];
+    for (int j = 0; j < PME_ORDER; j++) {
+        zvalues[j] = data[j][2];
+        zindex[j] = gridIndexZ+j;
+        zindex[j] -= (zindex[j] >= gridz ? gridz : 0);
+    }
+    const __m512 zdata = _mm512_maskz_loadu_ps(mask, zvalues);
+    const __m512i zoffset = _mm512_maskz_loadu_epi32(mask, zindex);
+    const bool wrapped = (gridIndexZ+PME_ORDER > gridz);
+    for (int ix = 0; ix < PME_ORDER; ix++) {
+        int xbase = gridIndexX+ix;
+        xbase -= (xbase >= gridx ? gridx : 0);
+        xbase = xbase*gridy*gridz;
+        float xdata = charge*data[ix][0];
+        for (int iy = 0; iy < PME_ORDER; iy++) {
+            int ybase = gridIndexY+iy;
+            ybase -= (ybase >= gridy ? gridy : 0);
+            float* row = &grid[xbase + ybase*gridz];
+            const __m512 multiplier = _mm512_set1_ps(xdata*data[iy][1]);
+            if (wrapped) {
+                __m512 values = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), mask, zoffset, row, 4);
+                values = _mm512_fmadd_ps(zdata, multiplier, values);
+                _mm512_mask_i32scatter_ps(row, mask, zoffset, values, 4);
+            }
+            else {
+                __m512 values = _mm512_maskz_loadu_ps(mask, row+gridIndexZ);
+                values = _mm512_fmadd_ps(zdata, multiplier, values);
+                _mm512_mask_storeu_ps(row+gridIndexZ, mask, values);
+            }
+        }
+    }
+}
+
+#else
+
+#include "openmm/OpenMMException.h"
+
+bool isAvx512Supported() {
+    return false;
+}
+
+void spreadChargeAvx512(float* grid, int gridx, int gridy, int gridz, int gridIndexX, int gridIndexY, int gridIndexZ, float charge, const fvec4* data) {
+    throw OpenMM::OpenMMException("Internal error: OpenMM was compiled without AVX-512 support");
+}
+
+#endif
@@ -44,7 +44,11 @@
 #include "../src/CpuPmeKernels.h"
 #include "SimTKOpenMMRealType.h"
 #include "sfmt/SFMT.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <vector>
 
 using namespace OpenMM;
@@ -706,12 +710,69 @@ void testLJPME(bool triclinic) {
         ASSERT_EQUAL_VEC(refState.getForces()[i], Vec3(io.force[4*i], io.force[4*i+1], io.force[4*i+2]), 1e-3);
 }
 
+string readFile(const string& filename) {
+    ifstream in(filename.c_str());
+    stringstream contents;
+    contents << in.rdbuf();
+    return contents.str();
+}
+
+void testWisdomFile() {
+    // Create some wisdom for a plan the kernel will never use and save it to a file.
+
+    const string wisdomFile = "TestCpuPmeWisdom.txt";
+    remove(wisdomFile.c_str());
+    fftwf_complex* data = fftwf_alloc_complex(97);
+    fftwf_plan plan = fftwf_plan_dft_1d(97, data, data, FFTW_FORWARD, FFTW_MEASURE);
+    fftwf_destroy_plan(plan);
+    ASSERT(fftwf_export_wisdom_to_filename(wisdomFile.c_str()));
+    string initialWisdom = readFile(wisdomFile);
+    fftwf_forget_wisdom();
+
+    // Create a kernel with the file specified.  It should load the wisdom, then write it back along
+    // with the wisdom for its own plans.  The grid size is not used by any other test, so the plans
+    // cannot come from the cache.
+
+#ifdef WIN32
+    _putenv_s("OPENMM_CPU_FFTW_WISDOM", wisdomFile.c_str());
+#else
+    setenv("OPENMM_CPU_FFTW_WISDOM", wisdomFile.c_str(), 1);
+#endif
+    Platform& platform = Platform::getPlatformByName("Reference");
+    {
+        CpuCalcPmeReciprocalForceKernel pme(CalcPmeReciprocalForceKernel::Name(), platform);
+        pme.initialize(27, 25, 24, 1, 3.0, true);
+    }
+    string finalWisdom = readFile(wisdomFile);
+    ASSERT(finalWisdom.size() > initialWisdom.size());
+    char* currentWisdom = fftwf_export_wisdom_to_string();
+    ASSERT_EQUAL(string(currentWisdom), finalWisdom);
+    free(currentWisdom);
+
+    // Load the file into an empty planner and make sure the original wisdom survived the round trip.
+
+    fftwf_forget_wisdom();
+    ASSERT(fftwf_import_wisdom_from_filename(wisdomFile.c_str()));
+    fftwf_plan_with_nthreads(1);
+    plan = fftwf_plan_dft_1d(97, data, data, FFTW_FORWARD, FFTW_MEASURE | FFTW_WISDOM_ONLY);
+    ASSERT(plan != NULL);
+    fftwf_destroy_plan(plan);
+    fftwf_free(data);
+#ifdef WIN32
+    _putenv_s("OPENMM_CPU_FFTW_WISDOM", "");
+#else
+    unsetenv("OPENMM_CPU_FFTW_WISDOM");
+#endif
+    remove(wisdomFile.c_str());
+}
+
 int main(int argc, char* argv[]) {
     try {
         if (!CpuCalcPmeReciprocalForceKernel::isProcessorSupported()) {
             cout << "CPU is not supported.  Exiting." << endl;
             return 0;
         }
+        testWisdomFile();
         testPME(false);
         testPME(true);
         testLJPME(false);
@@ -102,9 +102,13 @@ private:
 
 void CommonCalcDrudeForceKernel::initialize(const System& system, const DrudeForce& force) {
     cc.setAsCurrent();
-    if (cc.getContextIndex() != 0)
-        return; // This is run entirely on one device
-    int numParticles = force.getNumParticles();
+
+    // When the context spans multiple devices, each one computes a subset of the particles and pairs.
+
+    int numContexts = cc.getNumContexts();
+    int startParticle = cc.getContextIndex()*force.getNumParticles()/numContexts;
+    int endParticle = (cc.getContextIndex()+1)*force.getNumParticles()/numContexts;
+    int numParticles = endParticle-startParticle;
     if (numParticles > 0) {
         // Create the harmonic interaction .
         
@@ -113,7 +117,7 @@ void CommonCalcDrudeForceKernel::initialize(const System& system, const DrudeFor
         vector<mm_float4> paramVector(numParticles);
         for (int i = 0; i < numParticles; i++) {
             double charge, polarizability, aniso12, aniso34;
-            force.getParticleParameters(i, atoms[i][0], atoms[i][1], atoms[i][2], atoms[i][3], atoms[i][4], charge, polarizability, aniso12, aniso34);
+            force.getParticleParameters(startParticle+i, atoms[i][0], atoms[i][1], atoms[i][2], atoms[i][3], atoms[i][4], charge, polarizability, aniso12, aniso34);
             double a1 = (atoms[i][2] == -1 ? 1 : aniso12);
             double a2 = (atoms[i][3] == -1 || atoms[i][4] == -1 ? 1 : aniso34);
             double a3 = 3-a1-a2;
@@ -136,7 +140,9 @@ void CommonCalcDrudeForceKernel::initialize(const System& system, const DrudeFor
         replacements["PARAMS"] = cc.getBondedUtilities().addArgument(particleParams, "float4");
         cc.getBondedUtilities().addInteraction(atoms, cc.replaceStrings(CommonDrudeKernelSources::drudeParticleForce, replacements), force.getForceGroup());
     }
-    int numPairs = force.getNumScreenedPairs();
+    int startPair = cc.getContextIndex()*force.getNumScreenedPairs()/numContexts;
+    int endPair = (cc.getContextIndex()+1)*force.getNumScreenedPairs()/numContexts;
+    int numPairs = endPair-startPair;
     if (numPairs > 0) {
         // Create the screened interaction between dipole pairs.
         
@@ -146,7 +152,7 @@ void CommonCalcDrudeForceKernel::initialize(const System& system, const DrudeFor
         for (int i = 0; i < numPairs; i++) {
             int drude1, drude2;
             double thole;
-            force.getScreenedPairParameters(i, drude1, drude2, thole);
+            force.getScreenedPairParameters(startPair+i, drude1, drude2, thole);
             int p2, p3, p4;
             double charge1, charge2, polarizability1, polarizability2, aniso12, aniso34;
             force.getParticleParameters(drude1, atoms[i][0], atoms[i][1], p2, p3, p4, charge1, polarizability1, aniso12, aniso34);
@@ -168,20 +174,22 @@ double CommonCalcDrudeForceKernel::execute(ContextImpl& context, bool includeFor
 }
 
 void CommonCalcDrudeForceKernel::copyParametersToContext(ContextImpl& context, const DrudeForce& force) {
-    if (cc.getContextIndex() != 0)
-        return; // This is run entirely on one device
+    cc.setAsCurrent();
+    int numContexts = cc.getNumContexts();
     
     // Set the particle parameters.
     
-    int numParticles = force.getNumParticles();
+    int startParticle = cc.getContextIndex()*force.getNumParticles()/numContexts;
+    int endParticle = (cc.getContextIndex()+1)*force.getNumParticles()/numContexts;
+    int numParticles = endParticle-startParticle;
+    if (numParticles != (particleParams.isInitialized() ? particleParams.getSize() : 0))
+        throw OpenMMException("updateParametersInContext: The number of Drude particles has changed");
     if (numParticles > 0) {
-        if (!particleParams.isInitialized() || numParticles != particleParams.getSize())
-            throw OpenMMException("updateParametersInContext: The number of Drude particles has changed");
         vector<mm_float4> paramVector(numParticles);
         for (int i = 0; i < numParticles; i++) {
             int p, p1, p2, p3, p4;
             double charge, polarizability, aniso12, aniso34;
-            force.getParticleParameters(i, p, p1, p2, p3, p4, charge, polarizability, aniso12, aniso34);
+            force.getParticleParameters(startParticle+i, p, p1, p2, p3, p4, charge, polarizability, aniso12, aniso34);
             double a1 = (p2 == -1 ? 1 : aniso12);
             double a2 = (p3 == -1 || p4 == -1 ? 1 : aniso34);
             double a3 = 3-a1-a2;
@@ -199,15 +207,17 @@ void CommonCalcDrudeForceKernel::copyParametersToContext(ContextImpl& context, c
     
     // Set the pair parameters.
     
-    int numPairs = force.getNumScreenedPairs();
+    int startPair = cc.getContextIndex()*force.getNumScreenedPairs()/numContexts;
+    int endPair = (cc.getContextIndex()+1)*force.getNumScreenedPairs()/numContexts;
+    int numPairs = endPair-startPair;
+    if (numPairs != (pairParams.isInitialized() ? pairParams.getSize() : 0))
+        throw OpenMMException("updateParametersInContext: The number of screened pairs has changed");
     if (numPairs > 0) {
-        if (!pairParams.isInitialized() || numPairs != pairParams.getSize())
-            throw OpenMMException("updateParametersInContext: The number of screened pairs has changed");
         vector<mm_float2> paramVector(numPairs);
         for (int i = 0; i < numPairs; i++) {
             int drude1, drude2;
             double thole;
-            force.getScreenedPairParameters(i, drude1, drude2, thole);
+            force.getScreenedPairParameters(startPair+i, drude1, drude2, thole);
             int p, p1, p2, p3, p4;
             double charge1, charge2, polarizability1, polarizability2, aniso12, aniso34;
             force.getParticleParameters(drude1, p, p1, p2, p3, p4, charge1, polarizability1, aniso12, aniso34);
@@ -220,6 +230,46 @@ void CommonCalcDrudeForceKernel::copyParametersToContext(ContextImpl& context, c
     }
 }
 
+class CommonParallelCalcDrudeForceKernel::Task : public ComputeContext::WorkTask {
+public:
+    Task(ContextImpl& context, CommonCalcDrudeForceKernel& kernel, bool includeForce,
+            bool includeEnergy, double& energy) : context(context), kernel(kernel),
+            includeForce(includeForce), includeEnergy(includeEnergy), energy(energy) {
+    }
+    void execute() {
+        energy += kernel.execute(context, includeForce, includeEnergy);
+    }
+private:
+    ContextImpl& context;
+    CommonCalcDrudeForceKernel& kernel;
+    bool includeForce, includeEnergy;
+    double& energy;
+};
+
+CommonParallelCalcDrudeForceKernel::CommonParallelCalcDrudeForceKernel(const string& name, const Platform& platform, const vector<ComputeContext*>& contexts,
+        vector<double>& contextEnergy) : CalcDrudeForceKernel(name, platform), contexts(contexts), contextEnergy(contextEnergy) {
+    for (int i = 0; i < (int) contexts.size(); i++)
+        kernels.push_back(Kernel(new CommonCalcDrudeForceKernel(name, platform, *contexts[i])));
+}
+
+void CommonParallelCalcDrudeForceKernel::initialize(const System& system, const DrudeForce& force) {
+    for (int i = 0; i < (int) kernels.size(); i++)
+        getKernel(i).initialize(system, force);
+}
+
+double CommonParallelCalcDrudeForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
+    for (int i = 0; i < (int) contexts.size(); i++) {
+        ComputeContext::WorkThread& thread = contexts[i]->getWorkThread();
+        thread.addTask(new Task(context, getKernel(i), includeForces, includeEnergy, contextEnergy[i]));
+    }
+    return 0.0;
+}
+
+void CommonParallelCalcDrudeForceKernel::copyParametersToContext(ContextImpl& context, const DrudeForce& force) {
+    for (int i = 0; i < (int) kernels.size(); i++)
+        getKernel(i).copyParametersToContext(context, force);
+}
+
 void CommonIntegrateDrudeLangevinStepKernel::initialize(const System& system, const DrudeLangevinIntegrator& integrator, const DrudeForce& force) {
     cc.initializeContexts();
     cc.getIntegrationUtilities().initRandomNumberGenerator((unsigned int) integrator.getRandomNumberSeed());
@@ -258,7 +308,6 @@ void CommonIntegrateDrudeLangevinStepKernel::initialize(const System& system, co
     ComputeProgram program = cc.compileProgram(CommonDrudeKernelSources::drudeLangevin, defines);
     kernel1 = program->createKernel("integrateDrudeLangevinPart1");
     kernel2 = program->createKernel("integrateDrudeLangevinPart2");
-    hardwallKernel = program->createKernel("applyHardWallConstraints");
     prevStepSize = -1.0;
 }
 
@@ -285,17 +334,11 @@ void CommonIntegrateDrudeLangevinStepKernel::execute(ContextImpl& context, const
             kernel2->addArg(nullptr);
         kernel2->addArg(integration.getPosDelta());
         kernel2->addArg(cc.getVelm());
+        kernel2->addArg(normalParticles);
+        kernel2->addArg(pairParticles);
         kernel2->addArg(integration.getStepSize());
-        hardwallKernel->addArg(cc.getPosq());
-        if (cc.getUseMixedPrecision())
-            hardwallKernel->addArg(cc.getPosqCorrection());
-        else
-            hardwallKernel->addArg(nullptr);
-        hardwallKernel->addArg(cc.getVelm());
-        hardwallKernel->addArg(pairParticles);
-        hardwallKernel->addArg(integration.getStepSize());
-        hardwallKernel->addArg();
-        hardwallKernel->addArg();
+        kernel2->addArg();
+        kernel2->addArg();
     }
     
     // Compute integrator coefficients.
@@ -327,8 +370,8 @@ void CommonIntegrateDrudeLangevinStepKernel::execute(ContextImpl& context, const
             kernel1->setArg(9, vscaleDrude);
             kernel1->setArg(10, fscaleDrude);
             kernel1->setArg(11, noisescaleDrude);
-            hardwallKernel->setArg(5, maxDrudeDistance);
-            hardwallKernel->setArg(6, hardwallscaleDrude);
+            kernel2->setArg(7, maxDrudeDistance);
+            kernel2->setArg(8, hardwallscaleDrude);
     }
     else {
             kernel1->setArg(6, (float) vscale);
@@ -337,8 +380,8 @@ void CommonIntegrateDrudeLangevinStepKernel::execute(ContextImpl& context, const
             kernel1->setArg(9, (float) vscaleDrude);
             kernel1->setArg(10, (float) fscaleDrude);
             kernel1->setArg(11, (float) noisescaleDrude);
-            hardwallKernel->setArg(5, (float) maxDrudeDistance);
-            hardwallKernel->setArg(6, (float) hardwallscaleDrude);
+            kernel2->setArg(7, (float) maxDrudeDistance);
+            kernel2->setArg(8, (float) hardwallscaleDrude);
     }
 
     // Call the first integration kernel.
@@ -350,14 +393,9 @@ void CommonIntegrateDrudeLangevinStepKernel::execute(ContextImpl& context, const
 
     integration.applyConstraints(integrator.getConstraintTolerance());
 
-    // Call the second integration kernel.
+    // Call the second integration kernel.  This also applies the hard wall constraints.
 
     kernel2->execute(numAtoms);
-    
-    // Apply hard wall constraints.
-    
-    if (maxDrudeDistance > 0)
-        hardwallKernel->execute(pairParticles.getSize());
     integration.computeVirtualSites();
 
     // Update the time and step count.
@@ -371,37 +409,73 @@ double CommonIntegrateDrudeLangevinStepKernel::computeKineticEnergy(ContextImpl&
     return cc.getIntegrationUtilities().computeKineticEnergy(0.5*integrator.getStepSize());
 }
 
-CommonIntegrateDrudeSCFStepKernel::~CommonIntegrateDrudeSCFStepKernel() {
-    if (minimizerPos != NULL)
-        lbfgs_free(minimizerPos);
-}
-
 void CommonIntegrateDrudeSCFStepKernel::initialize(const System& system, const DrudeSCFIntegrator& integrator, const DrudeForce& force) {
     cc.initializeContexts();
     cc.setAsCurrent();
 
-    // Identify Drude particles.
+    // Identify Drude particles.  Each one is given a fictitious mass equal to the force
+    // constant of its spring.
     
-    for (int i = 0; i < force.getNumParticles(); i++) {
+    numDrudeParticles = force.getNumParticles();
+    vector<int> drudeParticleVec;
+    vector<mm_double4> velocityVec;
+    for (int i = 0; i < numDrudeParticles; i++) {
         int p, p1, p2, p3, p4;
         double charge, polarizability, aniso12, aniso34;
         force.getParticleParameters(i, p, p1, p2, p3, p4, charge, polarizability, aniso12, aniso34);
-        drudeParticles.push_back(p);
+        drudeParticleVec.push_back(p);
+        double k = (polarizability > 0 ? ONE_4PI_EPS0*charge*charge/polarizability : 0.0);
+        velocityVec.push_back(mm_double4(0, 0, 0, k > 0 ? 1.0/k : 1.0));
     }
     
     // Initialize the energy minimizer.
     
-    minimizerPos = lbfgs_malloc(drudeParticles.size()*3);
-    if (minimizerPos == NULL)
-        throw OpenMMException("DrudeSCFIntegrator: Failed to allocate memory");
-    lbfgs_parameter_init(&minimizerParams);
-    minimizerParams.linesearch = LBFGS_LINESEARCH_BACKTRACKING_STRONG_WOLFE;    
+    bool useDouble = cc.getUseDoublePrecision() || cc.getUseMixedPrecision();
+    int elementSize = (useDouble ? sizeof(double) : sizeof(float));
+    drudeParticles.initialize<int>(cc, max(numDrudeParticles, 1), "drudeParticles");
+    minimizerVelocity.initialize(cc, max(numDrudeParticles, 1), 4*elementSize, "drudeMinimizerVelocity");
+    minimizerState.initialize(cc, 3, elementSize, "drudeMinimizerState");
+    minimizerConverged.initialize<int>(cc, 1, "drudeMinimizerConverged");
+    if (numDrudeParticles > 0) {
+        drudeParticles.upload(drudeParticleVec);
+        minimizerVelocity.upload(velocityVec, true);
+    }
+    iterationsBeforeCheck = 1;
 
     // Create the kernels.
     
     ComputeProgram program = cc.compileProgram(CommonKernelSources::verlet);
     kernel1 = program->createKernel("integrateVerletPart1");
     kernel2 = program->createKernel("integrateVerletPart2");
+    minimizerBlockSize = min(256, cc.getMaxThreadBlockSize());
+    map<string, string> defines;
+    defines["NUM_DRUDE_PARTICLES"] = cc.intToString(numDrudeParticles);
+    defines["PADDED_NUM_ATOMS"] = cc.intToString(cc.getPaddedNumAtoms());
+    defines["THREAD_BLOCK_SIZE"] = cc.intToString(minimizerBlockSize);
+    defines["FIRE_N_MIN"] = "5";
+    defines["FIRE_F_INC"] = cc.doubleToString(1.1);
+    defines["FIRE_F_DEC"] = cc.doubleToString(0.5);
+    defines["FIRE_ALPHA_START"] = cc.doubleToString(0.1);
+    defines["FIRE_F_ALPHA"] = cc.doubleToString(0.99);
+    defines["FIRE_DT_START"] = cc.doubleToString(0.1);
+    defines["FIRE_DT_MAX"] = cc.doubleToString(1.0);
+    ComputeProgram minimizerProgram = cc.compileProgram(CommonDrudeKernelSources::drudeSCF, defines);
+    initMinimizerKernel = minimizerProgram->createKernel("initializeDrudeMinimizer");
+    minimizerKernel = minimizerProgram->createKernel("minimizeDrudePositions");
+    initMinimizerKernel->addArg(minimizerVelocity);
+    initMinimizerKernel->addArg(minimizerState);
+    initMinimizerKernel->addArg(minimizerConverged);
+    minimizerKernel->addArg(cc.getPosq());
+    if (cc.getUseMixedPrecision())
+        minimizerKernel->addArg(cc.getPosqCorrection());
+    else
+        minimizerKernel->addArg(nullptr);
+    minimizerKernel->addArg(cc.getLongForceBuffer());
+    minimizerKernel->addArg(minimizerVelocity);
+    minimizerKernel->addArg(drudeParticles);
+    minimizerKernel->addArg(minimizerState);
+    minimizerKernel->addArg(minimizerConverged);
+    minimizerKernel->addArg();
     prevStepSize = -1.0;
 }
 
@@ -477,96 +551,32 @@ double CommonIntegrateDrudeSCFStepKernel::computeKineticEnergy(ContextImpl& cont
     return cc.getIntegrationUtilities().computeKineticEnergy(0.5*integrator.getStepSize());
 }
 
-struct MinimizerData {
-    ContextImpl& context;
-    ComputeContext& cc;
-    vector<int>& drudeParticles;
-    MinimizerData(ContextImpl& context, ComputeContext& cc, vector<int>& drudeParticles) : context(context), cc(cc), drudeParticles(drudeParticles) {}
-};
-
-static lbfgsfloatval_t evaluate(void *instance, const lbfgsfloatval_t *x, lbfgsfloatval_t *g, const int n, const lbfgsfloatval_t step) {
-    MinimizerData* data = reinterpret_cast<MinimizerData*>(instance);
-    ContextImpl& context = data->context;
-    ComputeContext& cc = data->cc;
-    vector<int>& drudeParticles = data->drudeParticles;
-    int numDrudeParticles = drudeParticles.size();
-
-    // Set the particle positions.
-    
-    cc.getPosq().download(cc.getPinnedBuffer());
-    if (cc.getUseDoublePrecision()) {
-        mm_double4* posq = (mm_double4*) cc.getPinnedBuffer();
-        for (int i = 0; i < numDrudeParticles; ++i) {
-            mm_double4& p = posq[drudeParticles[i]];
-            p.x = x[3*i];
-            p.y = x[3*i+1];
-            p.z = x[3*i+2];
-        }
-    }
-    else {
-        mm_float4* posq = (mm_float4*) cc.getPinnedBuffer();
-        for (int i = 0; i < numDrudeParticles; ++i) {
-            mm_float4& p = posq[drudeParticles[i]];
-            p.x = x[3*i];
-            p.y = x[3*i+1];
-            p.z = x[3*i+2];
-        }
-    }
-    cc.getPosq().upload(cc.getPinnedBuffer());
-
-    // Compute the forces and energy for this configuration.
-
-    double energy = context.calcForcesAndEnergy(true, true, context.getIntegrator().getIntegrationForceGroups());
-    long long* force = (long long*) cc.getPinnedBuffer();
-    cc.getLongForceBuffer().download(force);
-    double forceScale = -1.0/0x100000000;
-    int paddedNumAtoms = cc.getPaddedNumAtoms();
-    for (int i = 0; i < numDrudeParticles; ++i) {
-        int index = drudeParticles[i];
-        g[3*i] = forceScale*force[index];
-        g[3*i+1] = forceScale*force[index+paddedNumAtoms];
-        g[3*i+2] = forceScale*force[index+paddedNumAtoms*2];
-    }
-    return energy;
-}
-
 void CommonIntegrateDrudeSCFStepKernel::minimize(ContextImpl& context, double tolerance) {
-    // Record the initial positions.
-
-    int numDrudeParticles = drudeParticles.size();
-    cc.getPosq().download(cc.getPinnedBuffer());
-    if (cc.getUseDoublePrecision()) {
-        mm_double4* posq = (mm_double4*) cc.getPinnedBuffer();
-        for (int i = 0; i < numDrudeParticles; ++i) {
-            mm_double4 p = posq[drudeParticles[i]];
-            minimizerPos[3*i] = p.x;
-            minimizerPos[3*i+1] = p.y;
-            minimizerPos[3*i+2] = p.z;
+    if (numDrudeParticles == 0)
+        return;
+
+    // The minimization is done entirely on the device.  Checking for convergence requires
+    // synchronizing with the host, so skip the check for half as many iterations as the previous
+    // minimization needed.  Once converged, further iterations leave the positions unchanged.
+    // Halving lets the count recover within a few steps after one that needed many iterations.
+
+    const int maxIterations = 1000;
+    if (cc.getUseDoublePrecision() || cc.getUseMixedPrecision())
+        minimizerKernel->setArg(7, tolerance);
+    else
+        minimizerKernel->setArg(7, (float) tolerance);
+    initMinimizerKernel->execute(numDrudeParticles);
+    int iteration = 0;
+    while (iteration < maxIterations) {
+        context.calcForcesAndEnergy(true, false, context.getIntegrator().getIntegrationForceGroups());
+        minimizerKernel->execute(minimizerBlockSize, minimizerBlockSize);
+        iteration++;
+        if (iteration >= iterationsBeforeCheck) {
+            int converged;
+            minimizerConverged.download(&converged);
+            if (converged)
+                break;
         }
     }
-    else {
-        mm_float4* posq = (mm_float4*) cc.getPinnedBuffer();
-        for (int i = 0; i < numDrudeParticles; ++i) {
-            mm_float4 p = posq[drudeParticles[i]];
-            minimizerPos[3*i] = p.x;
-            minimizerPos[3*i+1] = p.y;
-            minimizerPos[3*i+2] = p.z;
-        }
-        minimizerParams.xtol = 1e-7;
-    }
-    
-    // Determine a normalization constant for scaling the tolerance.
-    
-    double norm = 0.0;
-    for (int i = 0; i < 3*numDrudeParticles; i++)
-        norm += minimizerPos[i]*minimizerPos[i];
-    norm /= numDrudeParticles;
-    norm = (norm < 1 ? 1 : sqrt(norm));
-    minimizerParams.epsilon = tolerance/norm;
-    
-    // Perform the minimization.
-
-    lbfgsfloatval_t fx;
-    MinimizerData data(context, cc, drudeParticles);
-    lbfgs(numDrudeParticles*3, minimizerPos, &fx, evaluate, NULL, &data, &minimizerParams);
-}
\ No newline at end of file
+    iterationsBeforeCheck = max(1, iteration/2);
+}
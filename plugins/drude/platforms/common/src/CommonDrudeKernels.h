@@ -35,7 +35,6 @@
 #include "openmm/DrudeKernels.h"
 #include "openmm/common/ComputeContext.h"
 #include "openmm/common/ComputeArray.h"
-#include "lbfgs.h"
 
 namespace OpenMM {
 
@@ -76,6 +75,47 @@ private:
     ComputeArray pairParams;
 };
 
+/**
+ * This kernel is invoked by DrudeForce when the Context contains multiple devices.  Each device computes
+ * a subset of the Drude particles and screened pairs.
+ */
+class CommonParallelCalcDrudeForceKernel : public CalcDrudeForceKernel {
+public:
+    CommonParallelCalcDrudeForceKernel(const std::string& name, const Platform& platform, const std::vector<ComputeContext*>& contexts,
+            std::vector<double>& contextEnergy);
+    CommonCalcDrudeForceKernel& getKernel(int index) {
+        return dynamic_cast<CommonCalcDrudeForceKernel&>(kernels[index].getImpl());
+    }
+    /**
+     * Initialize the kernel.
+     * 
+     * @param system     the System this kernel will be applied to
+     * @param force      the DrudeForce this kernel will be used for
+     */
+    void initialize(const System& system, const DrudeForce& force);
+    /**
+     * Execute the kernel to calculate the forces and/or energy.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param includeForces  true if forces should be calculated
+     * @param includeEnergy  true if the energy should be calculated
+     * @return the potential energy due to the force
+     */
+    double execute(ContextImpl& context, bool includeForces, bool includeEnergy);
+    /**
+     * Copy changed parameters over to a context.
+     *
+     * @param context    the context to copy parameters to
+     * @param force      the DrudeForce to copy the parameters from
+     */
+    void copyParametersToContext(ContextImpl& context, const DrudeForce& force);
+private:
+    class Task;
+    std::vector<ComputeContext*> contexts;
+    std::vector<double>& contextEnergy;
+    std::vector<Kernel> kernels;
+};
+
 /**
  * This kernel is invoked by DrudeLangevinIntegrator to take one time step
  */
@@ -112,7 +152,7 @@ private:
     bool hasInitializedKernels;
     ComputeArray normalParticles;
     ComputeArray pairParticles;
-    ComputeKernel kernel1, kernel2, hardwallKernel;
+    ComputeKernel kernel1, kernel2;
 };
 
 /**
@@ -121,9 +161,8 @@ private:
 class CommonIntegrateDrudeSCFStepKernel : public IntegrateDrudeSCFStepKernel {
 public:
     CommonIntegrateDrudeSCFStepKernel(const std::string& name, const Platform& platform, ComputeContext& cc) :
-            IntegrateDrudeSCFStepKernel(name, platform), cc(cc), minimizerPos(NULL), hasInitializedKernels(false) {
+            IntegrateDrudeSCFStepKernel(name, platform), cc(cc), hasInitializedKernels(false) {
     }
-    ~CommonIntegrateDrudeSCFStepKernel();
     /**
      * Initialize the kernel.
      *
@@ -151,10 +190,12 @@ private:
     ComputeContext& cc;
     double prevStepSize;
     bool hasInitializedKernels;
-    std::vector<int> drudeParticles;
-    lbfgsfloatval_t *minimizerPos;
-    lbfgs_parameter_t minimizerParams;
-    ComputeKernel kernel1, kernel2;
+    int numDrudeParticles, minimizerBlockSize, iterationsBeforeCheck;
+    ComputeArray drudeParticles;
+    ComputeArray minimizerVelocity;
+    ComputeArray minimizerState;
+    ComputeArray minimizerConverged;
+    ComputeKernel kernel1, kernel2, initMinimizerKernel, minimizerKernel;
 };
 
 } // namespace OpenMM
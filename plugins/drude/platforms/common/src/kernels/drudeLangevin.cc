@@ -66,26 +66,52 @@ KERNEL void integrateDrudeLangevinPart1(GLOBAL mixed4* RESTRICT velm, GLOBAL con
 }
 
 /**
- * Perform the second step of Langevin integration.
+ * Load the position of a particle, including the correction term in mixed precision mode.
+ */
+DEVICE mixed4 loadPosition(GLOBAL const real4* RESTRICT posq, GLOBAL const real4* RESTRICT posqCorrection, int index) {
+#ifdef USE_MIXED_PRECISION
+    real4 pos1 = posq[index];
+    real4 pos2 = posqCorrection[index];
+    return make_mixed4(pos1.x+(mixed)pos2.x, pos1.y+(mixed)pos2.y, pos1.z+(mixed)pos2.z, pos1.w);
+#else
+    return posq[index];
+#endif
+}
+
+/**
+ * Store the position of a particle, including the correction term in mixed precision mode.
+ */
+DEVICE void storePosition(GLOBAL real4* RESTRICT posq, GLOBAL real4* RESTRICT posqCorrection, int index, mixed4 pos) {
+#ifdef USE_MIXED_PRECISION
+    posq[index] = make_real4((real) pos.x, (real) pos.y, (real) pos.z, (real) pos.w);
+    posqCorrection[index] = make_real4(pos.x-(real) pos.x, pos.y-(real) pos.y, pos.z-(real) pos.z, 0);
+#else
+    posq[index] = pos;
+#endif
+}
+
+/**
+ * Perform the second step of Langevin integration.  Drude pairs are handled together, so the hard wall
+ * constraint can be applied to the new positions and velocities without another pass through memory.
  */
 
-KERNEL void integrateDrudeLangevinPart2(GLOBAL real4* RESTRICT posq, GLOBAL real4* RESTRICT posqCorrection, GLOBAL const mixed4* RESTRICT posDelta, GLOBAL mixed4* RESTRICT velm, GLOBAL const mixed2* RESTRICT dt) {
+KERNEL void integrateDrudeLangevinPart2(GLOBAL real4* RESTRICT posq, GLOBAL real4* RESTRICT posqCorrection, GLOBAL const mixed4* RESTRICT posDelta,
+        GLOBAL mixed4* RESTRICT velm, GLOBAL const int* RESTRICT normalParticles, GLOBAL const int2* RESTRICT pairParticles, GLOBAL const mixed2* RESTRICT dt,
+        mixed maxDrudeDistance, mixed hardwallscaleDrude) {
+    mixed stepSize = dt[0].y;
 #ifdef SUPPORTS_DOUBLE_PRECISION
     double invStepSize = 1.0/dt[0].y;
 #else
     float invStepSize = 1.0f/dt[0].y;
 #endif
-    int index = GLOBAL_ID;
-    while (index < NUM_ATOMS) {
+
+    // Update normal particles.
+
+    for (int i = GLOBAL_ID; i < NUM_NORMAL_PARTICLES; i += GLOBAL_SIZE) {
+        int index = normalParticles[i];
         mixed4 vel = velm[index];
         if (vel.w != 0) {
-#ifdef USE_MIXED_PRECISION
-            real4 pos1 = posq[index];
-            real4 pos2 = posqCorrection[index];
-            mixed4 pos = make_mixed4(pos1.x+(mixed)pos2.x, pos1.y+(mixed)pos2.y, pos1.z+(mixed)pos2.z, pos1.w);
-#else
-            real4 pos = posq[index];
-#endif
+            mixed4 pos = loadPosition(posq, posqCorrection, index);
             mixed4 delta = posDelta[index];
             pos.x += delta.x;
             pos.y += delta.y;
@@ -93,47 +119,48 @@ KERNEL void integrateDrudeLangevinPart2(GLOBAL real4* RESTRICT posq, GLOBAL real
             vel.x = (mixed) (invStepSize*delta.x);
             vel.y = (mixed) (invStepSize*delta.y);
             vel.z = (mixed) (invStepSize*delta.z);
-#ifdef USE_MIXED_PRECISION
-            posq[index] = make_real4((real) pos.x, (real) pos.y, (real) pos.z, (real) pos.w);
-            posqCorrection[index] = make_real4(pos.x-(real) pos.x, pos.y-(real) pos.y, pos.z-(real) pos.z, 0);
-#else
-            posq[index] = pos;
-#endif
+            storePosition(posq, posqCorrection, index, pos);
             velm[index] = vel;
         }
-        index += GLOBAL_SIZE;
     }
-}
 
-/**
- * Apply hard wall constraints
- */
-KERNEL void applyHardWallConstraints(GLOBAL real4* RESTRICT posq, GLOBAL real4* RESTRICT posqCorrection, GLOBAL mixed4* RESTRICT velm,
-        GLOBAL const int2* RESTRICT pairParticles, GLOBAL const mixed2* RESTRICT dt, mixed maxDrudeDistance, mixed hardwallscaleDrude) {
-    mixed stepSize = dt[0].y;
+    // Update Drude particle pairs.
+
     for (int i = GLOBAL_ID; i < NUM_PAIRS; i += GLOBAL_SIZE) {
         int2 particles = pairParticles[i];
-#ifdef USE_MIXED_PRECISION
-        real4 posReal1 = posq[particles.x];
-        real4 posReal2 = posq[particles.y];
-        real4 posCorr1 = posqCorrection[particles.x];
-        real4 posCorr2 = posqCorrection[particles.y];
-        mixed4 pos1 = make_mixed4(posReal1.x+(mixed)posCorr1.x, posReal1.y+(mixed)posCorr1.y, posReal1.z+(mixed)posCorr1.z, posReal1.w);
-        mixed4 pos2 = make_mixed4(posReal2.x+(mixed)posCorr2.x, posReal2.y+(mixed)posCorr2.y, posReal2.z+(mixed)posCorr2.z, posReal2.w);
-#else
-        mixed4 pos1 = posq[particles.x];
-        mixed4 pos2 = posq[particles.y];
-#endif
+        mixed4 vel1 = velm[particles.x];
+        mixed4 vel2 = velm[particles.y];
+        mixed4 pos1 = loadPosition(posq, posqCorrection, particles.x);
+        mixed4 pos2 = loadPosition(posq, posqCorrection, particles.y);
+        if (vel1.w != 0) {
+            mixed4 delta = posDelta[particles.x];
+            pos1.x += delta.x;
+            pos1.y += delta.y;
+            pos1.z += delta.z;
+            vel1.x = (mixed) (invStepSize*delta.x);
+            vel1.y = (mixed) (invStepSize*delta.y);
+            vel1.z = (mixed) (invStepSize*delta.z);
+        }
+        if (vel2.w != 0) {
+            mixed4 delta = posDelta[particles.y];
+            pos2.x += delta.x;
+            pos2.y += delta.y;
+            pos2.z += delta.z;
+            vel2.x = (mixed) (invStepSize*delta.x);
+            vel2.y = (mixed) (invStepSize*delta.y);
+            vel2.z = (mixed) (invStepSize*delta.z);
+        }
+
+        // Apply the hard wall constraint.
+
         mixed4 delta = pos1-pos2;
         mixed r = SQRT(delta.x*delta.x + delta.y*delta.y + delta.z*delta.z);
         mixed rInv = RECIP(r);
-        if (rInv*maxDrudeDistance < 1) {
+        if (maxDrudeDistance > 0 && rInv*maxDrudeDistance < 1) {
             // The constraint has been violated, so make the inter-particle distance "bounce"
             // off the hard wall.
 
             mixed4 bondDir = delta*rInv;
-            mixed4 vel1 = velm[particles.x];
-            mixed4 vel2 = velm[particles.y];
             mixed mass1 = RECIP(vel1.w);
             mixed mass2 = RECIP(vel2.w);
             mixed deltaR = r-maxDrudeDistance;
@@ -153,16 +180,9 @@ KERNEL void applyHardWallConstraints(GLOBAL real4* RESTRICT posq, GLOBAL real4*
                 pos1.x += bondDir.x*dr;
                 pos1.y += bondDir.y*dr;
                 pos1.z += bondDir.z*dr;
-#ifdef USE_MIXED_PRECISION
-                posq[particles.x] = make_real4((real) pos1.x, (real) pos1.y, (real) pos1.z, (real) pos1.w);
-                posqCorrection[particles.x] = make_real4(pos1.x-(real) pos1.x, pos1.y-(real) pos1.y, pos1.z-(real) pos1.z, 0);
-#else
-                posq[particles.x] = pos1;
-#endif
                 vel1.x = vp1.x + bondDir.x*dotvr1;
                 vel1.y = vp1.y + bondDir.y*dotvr1;
                 vel1.z = vp1.z + bondDir.z*dotvr1;
-                velm[particles.x] = vel1;
             }
             else {
                 // Move both particles.
@@ -191,24 +211,21 @@ KERNEL void applyHardWallConstraints(GLOBAL real4* RESTRICT posq, GLOBAL real4*
                 pos2.x += bondDir.x*dr2;
                 pos2.y += bondDir.y*dr2;
                 pos2.z += bondDir.z*dr2;
-#ifdef USE_MIXED_PRECISION
-                posq[particles.x] = make_real4((real) pos1.x, (real) pos1.y, (real) pos1.z, (real) pos1.w);
-                posq[particles.y] = make_real4((real) pos2.x, (real) pos2.y, (real) pos2.z, (real) pos2.w);
-                posqCorrection[particles.x] = make_real4(pos1.x-(real) pos1.x, pos1.y-(real) pos1.y, pos1.z-(real) pos1.z, 0);
-                posqCorrection[particles.y] = make_real4(pos2.x-(real) pos2.x, pos2.y-(real) pos2.y, pos2.z-(real) pos2.z, 0);
-#else
-                posq[particles.x] = pos1;
-                posq[particles.y] = pos2;
-#endif
                 vel1.x = vp1.x + bondDir.x*dotvr1;
                 vel1.y = vp1.y + bondDir.y*dotvr1;
                 vel1.z = vp1.z + bondDir.z*dotvr1;
                 vel2.x = vp2.x + bondDir.x*dotvr2;
                 vel2.y = vp2.y + bondDir.y*dotvr2;
                 vel2.z = vp2.z + bondDir.z*dotvr2;
-                velm[particles.x] = vel1;
-                velm[particles.y] = vel2;
             }
         }
+        if (vel1.w != 0) {
+            storePosition(posq, posqCorrection, particles.x, pos1);
+            velm[particles.x] = vel1;
+        }
+        if (vel2.w != 0) {
+            storePosition(posq, posqCorrection, particles.y, pos2);
+            velm[particles.y] = vel2;
+        }
     }
 }
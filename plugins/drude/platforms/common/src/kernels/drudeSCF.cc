@@ -0,0 +1,135 @@
+// This file contains kernels for relaxing the Drude particle positions with the FIRE algorithm described in
+// Bitzek et al, "Structural Relaxation Made Simple" (doi: 10.1103/PhysRevLett.97.170201).  Each Drude particle's
+// fictitious mass is set to the force constant of its spring, so every isolated Drude oscillator has unit
+// frequency and the same time step is appropriate for all of them.
+
+/**
+ * Sum a value over all threads.
+ */
+DEVICE mixed reduceValue(mixed value, LOCAL_ARG volatile mixed* temp) {
+    const int thread = LOCAL_ID;
+    SYNC_THREADS;
+    temp[thread] = value;
+    SYNC_THREADS;
+    for (int step = 1; step < 32; step *= 2) {
+        if (thread+step < LOCAL_SIZE && thread%(2*step) == 0)
+            temp[thread] = temp[thread] + temp[thread+step];
+        SYNC_WARPS;
+    }
+    for (int step = 32; step < LOCAL_SIZE; step *= 2) {
+        if (thread+step < LOCAL_SIZE && thread%(2*step) == 0)
+            temp[thread] = temp[thread] + temp[thread+step];
+        SYNC_THREADS;
+    }
+    return temp[0];
+}
+
+/**
+ * Reset the minimizer state at the start of a minimization.
+ */
+KERNEL void initializeDrudeMinimizer(GLOBAL mixed4* RESTRICT velocity, GLOBAL mixed* RESTRICT state, GLOBAL int* RESTRICT converged) {
+    for (int i = GLOBAL_ID; i < NUM_DRUDE_PARTICLES; i += GLOBAL_SIZE) {
+        mixed4 v = velocity[i];
+        velocity[i] = make_mixed4(0, 0, 0, v.w);
+    }
+    if (GLOBAL_ID == 0) {
+        state[0] = FIRE_DT_START;
+        state[1] = FIRE_ALPHA_START;
+        state[2] = 0;
+        converged[0] = 0;
+    }
+}
+
+/**
+ * Perform one iteration of the minimization.  This is executed as a single work group.  Once the RMS force
+ * on the Drude particles falls below the tolerance, the converged flag is set and later calls do nothing.
+ */
+KERNEL void minimizeDrudePositions(GLOBAL real4* RESTRICT posq, GLOBAL real4* RESTRICT posqCorrection, GLOBAL const mm_long* RESTRICT force,
+        GLOBAL mixed4* RESTRICT velocity, GLOBAL const int* RESTRICT drudeParticles, GLOBAL mixed* RESTRICT state,
+        GLOBAL int* RESTRICT converged, mixed tolerance) {
+    LOCAL volatile mixed temp[THREAD_BLOCK_SIZE];
+    if (converged[0])
+        return;
+    mixed dt = state[0];
+    mixed alpha = state[1];
+    mixed numPositive = state[2];
+    const mixed forceScale = 1/(mixed) 0x100000000;
+
+    // Compute the quantities that control the step.
+
+    mixed power = 0, forceNorm2 = 0, accelNorm2 = 0, velNorm2 = 0;
+    for (int i = LOCAL_ID; i < NUM_DRUDE_PARTICLES; i += LOCAL_SIZE) {
+        int index = drudeParticles[i];
+        mixed4 v = velocity[i];
+        mixed fx = forceScale*force[index];
+        mixed fy = forceScale*force[index+PADDED_NUM_ATOMS];
+        mixed fz = forceScale*force[index+PADDED_NUM_ATOMS*2];
+        mixed f2 = fx*fx + fy*fy + fz*fz;
+        power += fx*v.x + fy*v.y + fz*v.z;
+        forceNorm2 += f2;
+        accelNorm2 += f2*v.w*v.w;
+        velNorm2 += v.x*v.x + v.y*v.y + v.z*v.z;
+    }
+    power = reduceValue(power, temp);
+    forceNorm2 = reduceValue(forceNorm2, temp);
+    accelNorm2 = reduceValue(accelNorm2, temp);
+    velNorm2 = reduceValue(velNorm2, temp);
+    if (forceNorm2 <= tolerance*tolerance*NUM_DRUDE_PARTICLES) {
+        if (LOCAL_ID == 0)
+            converged[0] = 1;
+        return;
+    }
+
+    // Update the time step and mixing parameter.
+
+    mixed velScale, accelScale;
+    if (power > 0) {
+        velScale = 1-alpha;
+        accelScale = (accelNorm2 > 0 ? alpha*SQRT(velNorm2/accelNorm2) : 0);
+        if (numPositive > FIRE_N_MIN) {
+            dt = min(dt*FIRE_F_INC, (mixed) FIRE_DT_MAX);
+            alpha *= FIRE_F_ALPHA;
+        }
+        numPositive += 1;
+    }
+    else {
+        velScale = 0;
+        accelScale = 0;
+        dt *= FIRE_F_DEC;
+        alpha = FIRE_ALPHA_START;
+        numPositive = 0;
+    }
+    if (LOCAL_ID == 0) {
+        state[0] = dt;
+        state[1] = alpha;
+        state[2] = numPositive;
+    }
+
+    // Update the velocities and positions.
+
+    for (int i = LOCAL_ID; i < NUM_DRUDE_PARTICLES; i += LOCAL_SIZE) {
+        int index = drudeParticles[i];
+        mixed4 v = velocity[i];
+        mixed3 a = make_mixed3(forceScale*force[index], forceScale*force[index+PADDED_NUM_ATOMS], forceScale*force[index+PADDED_NUM_ATOMS*2])*v.w;
+        v.x = velScale*v.x + accelScale*a.x + dt*a.x;
+        v.y = velScale*v.y + accelScale*a.y + dt*a.y;
+        v.z = velScale*v.z + accelScale*a.z + dt*a.z;
+        velocity[i] = v;
+#ifdef USE_MIXED_PRECISION
+        real4 pos1 = posq[index];
+        real4 pos2 = posqCorrection[index];
+        mixed4 pos = make_mixed4(pos1.x+(mixed)pos2.x, pos1.y+(mixed)pos2.y, pos1.z+(mixed)pos2.z, pos1.w);
+#else
+        real4 pos = posq[index];
+#endif
+        pos.x += dt*v.x;
+        pos.y += dt*v.y;
+        pos.z += dt*v.z;
+#ifdef USE_MIXED_PRECISION
+        posq[index] = make_real4((real) pos.x, (real) pos.y, (real) pos.z, (real) pos.w);
+        posqCorrection[index] = make_real4(pos.x-(real) pos.x, pos.y-(real) pos.y, pos.z-(real) pos.z, 0);
+#else
+        posq[index] = pos;
+#endif
+    }
+}
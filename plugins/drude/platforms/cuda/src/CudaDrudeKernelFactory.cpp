@@ -62,9 +62,15 @@ extern "C" OPENMM_EXPORT void registerDrudeCudaKernelFactories() {
 }
 
 KernelImpl* CudaDrudeKernelFactory::createKernelImpl(std::string name, const Platform& platform, ContextImpl& context) const {
-    CudaContext& cu = *static_cast<CudaPlatform::PlatformData*>(context.getPlatformData())->contexts[0];
-    if (name == CalcDrudeForceKernel::Name())
+    CudaPlatform::PlatformData& data = *static_cast<CudaPlatform::PlatformData*>(context.getPlatformData());
+    CudaContext& cu = *data.contexts[0];
+    if (name == CalcDrudeForceKernel::Name()) {
+        if (data.contexts.size() > 1) {
+            std::vector<ComputeContext*> contexts(data.contexts.begin(), data.contexts.end());
+            return new CommonParallelCalcDrudeForceKernel(name, platform, contexts, data.contextEnergy);
+        }
         return new CommonCalcDrudeForceKernel(name, platform, cu);
+    }
     if (name == IntegrateDrudeLangevinStepKernel::Name())
         return new CommonIntegrateDrudeLangevinStepKernel(name, platform, cu);
     if (name == IntegrateDrudeSCFStepKernel::Name())
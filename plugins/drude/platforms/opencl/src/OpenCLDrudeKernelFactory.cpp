@@ -62,9 +62,15 @@ extern "C" OPENMM_EXPORT void registerDrudeOpenCLKernelFactories() {
 }
 
 KernelImpl* OpenCLDrudeKernelFactory::createKernelImpl(std::string name, const Platform& platform, ContextImpl& context) const {
-    OpenCLContext& cl = *static_cast<OpenCLPlatform::PlatformData*>(context.getPlatformData())->contexts[0];
-    if (name == CalcDrudeForceKernel::Name())
+    OpenCLPlatform::PlatformData& data = *static_cast<OpenCLPlatform::PlatformData*>(context.getPlatformData());
+    OpenCLContext& cl = *data.contexts[0];
+    if (name == CalcDrudeForceKernel::Name()) {
+        if (data.contexts.size() > 1) {
+            std::vector<ComputeContext*> contexts(data.contexts.begin(), data.contexts.end());
+            return new CommonParallelCalcDrudeForceKernel(name, platform, contexts, data.contextEnergy);
+        }
         return new CommonCalcDrudeForceKernel(name, platform, cl);
+    }
     if (name == IntegrateDrudeLangevinStepKernel::Name())
         return new CommonIntegrateDrudeLangevinStepKernel(name, platform, cl);
     if (name == IntegrateDrudeSCFStepKernel::Name())
@@ -35,6 +35,7 @@
 #include "openmm/internal/ContextImpl.h"
 #include "SimTKOpenMMUtilities.h"
 #include "ReferenceConstraints.h"
+#include "ReferencePairLoop.h"
 #include "ReferenceVirtualSites.h"
 #include <set>
 
@@ -56,6 +57,11 @@ static vector<Vec3>& extractForces(ContextImpl& context) {
     return *data->forces;
 }
 
+static ThreadPool* extractThreadPool(ContextImpl& context) {
+    ReferencePlatform::PlatformData* data = reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData());
+    return data->getThreadPool();
+}
+
 static ReferenceConstraints& extractConstraints(ContextImpl& context) {
     ReferencePlatform::PlatformData* data = reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData());
     return *data->constraints;
@@ -121,12 +127,18 @@ void ReferenceCalcDrudeForceKernel::initialize(const System& system, const Drude
 double ReferenceCalcDrudeForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
     vector<Vec3>& pos = extractPositions(context);
     vector<Vec3>& force = extractForces(context);
+    ThreadPool* threads = extractThreadPool(context);
     int numParticles = particle.size();
     double energy = 0;
     
-    // Compute the interactions from the harmonic springs.
+    // Compute the interactions from the harmonic springs.  Each term is evaluated independently
+    // (possibly in parallel), then added to the forces in order.
     
-    for (int i = 0; i < numParticles; i++) {
+    struct SpringResult {
+        double energy;
+        Vec3 forces[5];
+    };
+    computePairsInOrder<SpringResult>(threads, numParticles, [&] (int threadIndex, int i, SpringResult& result) {
         int p = particle[i];
         int p1 = particle1[i];
         int p2 = particle2[i];
@@ -144,9 +156,10 @@ double ReferenceCalcDrudeForceKernel::execute(ContextImpl& context, bool include
         
         Vec3 delta = pos[p]-pos[p1];
         double r2 = delta.dot(delta);
-        energy += 0.5*k3*r2;
-        force[p] -= delta*k3;
-        force[p1] += delta*k3;
+        result.energy = 0.5*k3*r2;
+        result.forces[0] = -delta*k3;
+        result.forces[1] = delta*k3;
+        result.forces[2] = result.forces[3] = result.forces[4] = Vec3();
         
         // Compute the first anisotropic force.
         
@@ -155,12 +168,12 @@ double ReferenceCalcDrudeForceKernel::execute(ContextImpl& context, bool include
             double invDist = 1.0/sqrt(dir.dot(dir));
             dir *= invDist;
             double rprime = dir.dot(delta);
-            energy += 0.5*k1*rprime*rprime;
+            result.energy += 0.5*k1*rprime*rprime;
             Vec3 f1 = dir*(k1*rprime); 
             Vec3 f2 = (delta-dir*rprime)*(k1*rprime*invDist);
-            force[p] -= f1;
-            force[p1] += f1-f2;
-            force[p2] += f2;
+            result.forces[0] -= f1;
+            result.forces[1] += f1-f2;
+            result.forces[2] += f2;
         }
         
         // Compute the second anisotropic force.
@@ -170,25 +183,42 @@ double ReferenceCalcDrudeForceKernel::execute(ContextImpl& context, bool include
             double invDist = 1.0/sqrt(dir.dot(dir));
             dir *= invDist;
             double rprime = dir.dot(delta);
-            energy += 0.5*k2*rprime*rprime;
+            result.energy += 0.5*k2*rprime*rprime;
             Vec3 f1 = dir*(k2*rprime);
             Vec3 f2 = (delta-dir*rprime)*(k2*rprime*invDist);
-            force[p] -= f1;
-            force[p1] += f1;
-            force[p3] -= f2;
-            force[p4] += f2;
+            result.forces[0] -= f1;
+            result.forces[1] += f1;
+            result.forces[3] -= f2;
+            result.forces[4] += f2;
         }
-    }
+    },
+    [&] (int i, SpringResult& result) {
+        energy += result.energy;
+        force[particle[i]] += result.forces[0];
+        force[particle1[i]] += result.forces[1];
+        if (particle2[i] != -1)
+            force[particle2[i]] += result.forces[2];
+        if (particle3[i] != -1 && particle4[i] != -1) {
+            force[particle3[i]] += result.forces[3];
+            force[particle4[i]] += result.forces[4];
+        }
+    });
     
     // Compute the screened interaction between bonded dipoles.
     
+    struct PairResult {
+        double energy;
+        Vec3 forces[2][2];
+    };
     int numPairs = pair1.size();
-    for (int i = 0; i < numPairs; i++) {
+    computePairsInOrder<PairResult>(threads, numPairs, [&] (int threadIndex, int i, PairResult& result) {
         int dipole1 = pair1[i];
         int dipole2 = pair2[i];
         int dipole1Particles[] = {particle[dipole1], particle1[dipole1]};
         int dipole2Particles[] = {particle[dipole2], particle1[dipole2]};
         double uscale = pairThole[i]/pow(polarizability[dipole1]*polarizability[dipole2], 1.0/6.0);
+        result.energy = 0;
+        result.forces[0][0] = result.forces[0][1] = result.forces[1][0] = result.forces[1][1] = Vec3();
         for (int j = 0; j < 2; j++)
             for (int k = 0; k < 2; k++) {
                 int p1 = dipole1Particles[j];
@@ -198,12 +228,19 @@ double ReferenceCalcDrudeForceKernel::execute(ContextImpl& context, bool include
                 double r = sqrt(delta.dot(delta));
                 double u = r*uscale;
                 double screening = 1.0 - (1.0+0.5*u)*exp(-u);
-                energy += ONE_4PI_EPS0*chargeProduct*screening/r;
+                result.energy += ONE_4PI_EPS0*chargeProduct*screening/r;
                 Vec3 f = delta*(ONE_4PI_EPS0*chargeProduct/(r*r))*(screening/r-0.5*(1+u)*exp(-u)*uscale);
-                force[p1] += f;
-                force[p2] -= f;
+                result.forces[0][j] += f;
+                result.forces[1][k] -= f;
             }
-    }
+    },
+    [&] (int i, PairResult& result) {
+        energy += result.energy;
+        force[particle[pair1[i]]] += result.forces[0][0];
+        force[particle1[pair1[i]]] += result.forces[0][1];
+        force[particle[pair2[i]]] += result.forces[1][0];
+        force[particle1[pair2[i]]] += result.forces[1][1];
+    });
     return energy;
 }
 
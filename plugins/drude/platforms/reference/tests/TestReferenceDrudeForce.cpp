@@ -32,4 +32,45 @@
 #include "ReferenceDrudeTests.h"
 #include "TestDrudeForce.h"
 
-void runPlatformTests() {}
+void testThreadsGiveIdenticalResults() {
+    // Build a chain of polarizable atoms, with anisotropic springs and screened pairs between neighbors.
+
+    const int numAtoms = 2000;
+    System system;
+    DrudeForce* drude = new DrudeForce();
+    vector<Vec3> positions;
+    for (int i = 0; i < numAtoms; i++) {
+        system.addParticle(1.0);
+        system.addParticle(1.0);
+        positions.push_back(Vec3(0.15*i, 0.05*sin(0.7*i), 0.05*cos(0.3*i)));
+        positions.push_back(positions.back()+Vec3(0.01*sin(1.3*i), 0.01*cos(0.9*i), 0.005));
+        int p2 = (i > 0 ? 2*(i-1) : -1);
+        int p3 = (i > 1 ? 2*(i-1) : -1);
+        int p4 = (i > 1 ? 2*(i-2) : -1);
+        drude->addParticle(2*i+1, 2*i, p2, p3, p4, -1.0-0.1*(i%3), 0.001+0.0001*(i%5), 0.9, 1.1);
+        if (i > 0)
+            drude->addScreenedPair(i-1, i, 2.6);
+    }
+    system.addForce(drude);
+
+    // The forces and energy should be bitwise identical for any number of threads.
+
+    VerletIntegrator integrator1(0.001);
+    Context context1(system, integrator1, platform);
+    context1.setPositions(positions);
+    State state1 = context1.getState(State::Forces | State::Energy);
+    map<string, string> properties;
+    properties["Threads"] = "4";
+    VerletIntegrator integrator2(0.001);
+    Context context2(system, integrator2, platform, properties);
+    context2.setPositions(positions);
+    State state2 = context2.getState(State::Forces | State::Energy);
+    ASSERT(state1.getPotentialEnergy() != 0.0);
+    ASSERT(state1.getPotentialEnergy() == state2.getPotentialEnergy());
+    for (int i = 0; i < system.getNumParticles(); i++)
+        ASSERT(state1.getForces()[i] == state2.getForces()[i]);
+}
+
+void runPlatformTests() {
+    testThreadsGiveIdenticalResults();
+}
@@ -42,6 +42,7 @@
 #include "openmm/VirtualSite.h"
 #include "openmm/DrudeForce.h"
 #include "openmm/DrudeSCFIntegrator.h"
+#include "openmm/internal/ForceImpl.h"
 #include "SimTKOpenMMUtilities.h"
 #include <iostream>
 #include <vector>
@@ -187,6 +188,92 @@ void testInitialTemperature() {
     ASSERT_USUALLY_EQUAL_TOL(drudeTemperature, relTemperature, 0.01);
 }
 
+/**
+ * A Force that adds nothing, but counts how many times forces are computed.
+ */
+class CountingForce : public Force {
+public:
+    CountingForce(int& count) : count(count) {
+    }
+    int& getCount() const {
+        return count;
+    }
+protected:
+    ForceImpl* createImpl() const;
+private:
+    int& count;
+};
+
+class CountingForceImpl : public ForceImpl {
+public:
+    CountingForceImpl(const CountingForce& owner) : owner(owner) {
+    }
+    void initialize(ContextImpl& context) {
+    }
+    const CountingForce& getOwner() const {
+        return owner;
+    }
+    void updateContextState(ContextImpl& context, bool& forcesInvalid) {
+    }
+    double calcForcesAndEnergy(ContextImpl& context, bool includeForces, bool includeEnergy, int groups) {
+        if (includeForces)
+            owner.getCount()++;
+        return 0.0;
+    }
+    map<string, double> getDefaultParameters() {
+        return map<string, double>();
+    }
+    vector<string> getKernelNames() {
+        return vector<string>();
+    }
+private:
+    const CountingForce& owner;
+};
+
+ForceImpl* CountingForce::createImpl() const {
+    return new CountingForceImpl(*this);
+}
+
+void testForceEvaluationsAfterHardStep() {
+    // Start with the Drude particles far from their minimum, so the first step needs many iterations.
+    // Later steps start close to the minimum, so within a few steps they should need at most half as
+    // many force evaluations, or a small number if the first step was already easy.
+
+    const int numMolecules = 20;
+    System system;
+    NonbondedForce* nonbonded = new NonbondedForce();
+    DrudeForce* drude = new DrudeForce();
+    system.addForce(nonbonded);
+    system.addForce(drude);
+    int count = 0;
+    system.addForce(new CountingForce(count));
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    vector<Vec3> positions;
+    for (int i = 0; i < numMolecules; i++) {
+        system.addParticle(10.0);
+        system.addParticle(0.4);
+        nonbonded->addParticle(1.0, 0.3, 0.5);
+        nonbonded->addParticle(-1.0, 1, 0);
+        nonbonded->addException(2*i, 2*i+1, 0, 1, 0);
+        drude->addParticle(2*i+1, 2*i, -1, -1, -1, -1.0, 0.001, 1, 1);
+        Vec3 pos(0.5*(i%4), 0.5*((i/4)%4), 0.5*(i/16));
+        positions.push_back(pos);
+        positions.push_back(pos+Vec3(genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5)*0.1);
+    }
+    DrudeSCFIntegrator integ(0.0005);
+    Context context(system, integ, platform);
+    context.setPositions(positions);
+    const int numSteps = 20;
+    vector<int> evaluations(numSteps);
+    for (int i = 0; i < numSteps; i++) {
+        count = 0;
+        integ.step(1);
+        evaluations[i] = count;
+    }
+    ASSERT(evaluations[numSteps-1] <= max(evaluations[0]/2, 20));
+}
+
 void setupKernels(int argc, char* argv[]);
 void runPlatformTests();
 
@@ -194,6 +281,7 @@ int main(int argc, char* argv[]) {
     try {
         setupKernels(argc, argv);
         testWater();
+        testForceEvaluationsAfterHardStep();
         runPlatformTests();
         testInitialTemperature();
     }
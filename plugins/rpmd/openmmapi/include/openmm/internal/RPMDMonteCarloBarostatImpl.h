@@ -57,6 +57,9 @@ public:
     void updateContextState(ContextImpl& context) {
         // This is unused, since the updating is done in updateRPMDState().
     }
+    bool updatesContextState() const {
+        return false;
+    }
     double calcForcesAndEnergy(ContextImpl& context, bool includeForces, bool includeEnergy, int groups) {
         // This force doesn't apply forces to particles.
         return 0.0;
@@ -150,6 +150,7 @@ void CudaIntegrateRPMDStepKernel::initialize(const System& system, const RPMDInt
     velocitiesKernel = cu.getKernel(module, "advanceVelocities");
     copyToContextKernel = cu.getKernel(module, "copyDataToContext");
     copyFromContextKernel = cu.getKernel(module, "copyDataFromContext");
+    swapContextKernel = cu.getKernel(module, "swapDataInContext");
     translateKernel = cu.getKernel(module, "applyCellTranslations");
     
     // Create kernels for doing contractions.
@@ -235,10 +236,13 @@ void CudaIntegrateRPMDStepKernel::execute(ContextImpl& context, const RPMDIntegr
 void CudaIntegrateRPMDStepKernel::computeForces(ContextImpl& context) {
     // Compute forces from all groups that didn't have a specified contraction.
 
+    // Each copy's results are retrieved by the same kernel that loads the next copy into the context.
+
+    int first = 0;
+    void* copyToContextArgs[] = {&velocities.getDevicePointer(), &cu.getVelm().getDevicePointer(), &positions.getDevicePointer(),
+            &cu.getPosq().getDevicePointer(), &cu.getAtomIndexArray().getDevicePointer(), &first};
+    cu.executeKernel(copyToContextKernel, copyToContextArgs, cu.getNumAtoms());
     for (int i = 0; i < numCopies; i++) {
-        void* copyToContextArgs[] = {&velocities.getDevicePointer(), &cu.getVelm().getDevicePointer(), &positions.getDevicePointer(),
-                &cu.getPosq().getDevicePointer(), &cu.getAtomIndexArray().getDevicePointer(), &i};
-        cu.executeKernel(copyToContextKernel, copyToContextArgs, cu.getNumAtoms());
         context.computeVirtualSites();
         Vec3 initialBox[3];
         context.getPeriodicBoxVectors(initialBox[0], initialBox[1], initialBox[2]);
@@ -250,7 +254,7 @@ void CudaIntegrateRPMDStepKernel::computeForces(ContextImpl& context) {
         context.calcForcesAndEnergy(true, false, groupsNotContracted);
         void* copyFromContextArgs[] = {&cu.getForce().getDevicePointer(), &forces.getDevicePointer(), &cu.getVelm().getDevicePointer(),
                 &velocities.getDevicePointer(), &cu.getPosq().getDevicePointer(), &positions.getDevicePointer(), &cu.getAtomIndexArray().getDevicePointer(), &i};
-        cu.executeKernel(copyFromContextKernel, copyFromContextArgs, cu.getNumAtoms());
+        cu.executeKernel(i < numCopies-1 ? swapContextKernel : copyFromContextKernel, copyFromContextArgs, cu.getNumAtoms());
     }
     
     // Now loop over contractions and compute forces from them.
@@ -266,15 +270,15 @@ void CudaIntegrateRPMDStepKernel::computeForces(ContextImpl& context) {
 
         // Compute forces.
 
+        void* copyToContextArgs[] = {&velocities.getDevicePointer(), &cu.getVelm().getDevicePointer(), &contractedPositions.getDevicePointer(),
+                &cu.getPosq().getDevicePointer(), &cu.getAtomIndexArray().getDevicePointer(), &first};
+        cu.executeKernel(copyToContextKernel, copyToContextArgs, cu.getNumAtoms());
         for (int i = 0; i < copies; i++) {
-            void* copyToContextArgs[] = {&velocities.getDevicePointer(), &cu.getVelm().getDevicePointer(), &contractedPositions.getDevicePointer(),
-                    &cu.getPosq().getDevicePointer(), &cu.getAtomIndexArray().getDevicePointer(), &i};
-            cu.executeKernel(copyToContextKernel, copyToContextArgs, cu.getNumAtoms());
             context.computeVirtualSites();
             context.calcForcesAndEnergy(true, false, groupFlags);
             void* copyFromContextArgs[] = {&cu.getForce().getDevicePointer(), &contractedForces.getDevicePointer(), &cu.getVelm().getDevicePointer(),
                    &velocities.getDevicePointer(), &cu.getPosq().getDevicePointer(), &contractedPositions.getDevicePointer(), &cu.getAtomIndexArray().getDevicePointer(), &i};
-            cu.executeKernel(copyFromContextKernel, copyFromContextArgs, cu.getNumAtoms());
+            cu.executeKernel(i < copies-1 ? swapContextKernel : copyFromContextKernel, copyFromContextArgs, cu.getNumAtoms());
         }
         
         // Apply the forces to the original copies.
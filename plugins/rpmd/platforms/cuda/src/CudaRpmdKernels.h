@@ -95,7 +95,7 @@ private:
     CudaArray velocities;
     CudaArray contractedForces;
     CudaArray contractedPositions;
-    CUfunction pileKernel, stepKernel, velocitiesKernel, copyToContextKernel, copyFromContextKernel, translateKernel;
+    CUfunction pileKernel, stepKernel, velocitiesKernel, copyToContextKernel, copyFromContextKernel, swapContextKernel, translateKernel;
     std::map<int, CUfunction> positionContractionKernels;
     std::map<int, CUfunction> forceContractionKernels;
 };
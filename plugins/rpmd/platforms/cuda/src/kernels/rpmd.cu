@@ -220,6 +220,34 @@ extern "C" __global__ void copyDataFromContext(long long* srcForce, long long* d
     }
 }
 
+/**
+ * Copy the positions, velocities, and forces of one copy from the context to the integrator's arrays, and
+ * then load the positions and velocities of the next copy into the context.  This is equivalent to calling
+ * copyDataFromContext() followed by copyDataToContext(), but saves a kernel launch between force evaluations.
+ */
+extern "C" __global__ void swapDataInContext(long long* contextForce, long long* dstForce, mixed4* contextVel, mixed4* vel,
+        real4* contextPos, mixed4* pos, int* order, int copy) {
+    const int base = copy*PADDED_NUM_ATOMS;
+    const int nextBase = base+PADDED_NUM_ATOMS;
+    for (int particle = blockIdx.x*blockDim.x+threadIdx.x; particle < NUM_ATOMS; particle += blockDim.x*gridDim.x) {
+        int index = order[particle];
+        dstForce[base*3+index] = contextForce[particle];
+        dstForce[base*3+index+PADDED_NUM_ATOMS] = contextForce[particle+PADDED_NUM_ATOMS];
+        dstForce[base*3+index+PADDED_NUM_ATOMS*2] = contextForce[particle+PADDED_NUM_ATOMS*2];
+        vel[base+index] = contextVel[particle];
+        real4 posq = contextPos[particle];
+        pos[base+index].x = posq.x;
+        pos[base+index].y = posq.y;
+        pos[base+index].z = posq.z;
+        contextVel[particle] = vel[nextBase+index];
+        mixed4 nextPos = pos[nextBase+index];
+        posq.x = nextPos.x;
+        posq.y = nextPos.y;
+        posq.z = nextPos.z;
+        contextPos[particle] = posq;
+    }
+}
+
 /**
  * Atom positions in one copy have been modified.  Apply the same offsets to all the other copies.
  */
@@ -130,6 +130,7 @@ void OpenCLIntegrateRPMDStepKernel::initialize(const System& system, const RPMDI
     velocitiesKernel = cl::Kernel(program, "advanceVelocities");
     copyToContextKernel = cl::Kernel(program, "copyDataToContext");
     copyFromContextKernel = cl::Kernel(program, "copyDataFromContext");
+    swapContextKernel = cl::Kernel(program, "swapDataInContext");
     translateKernel = cl::Kernel(program, "applyCellTranslations");
     
     // Create kernels for doing contractions.
@@ -170,6 +171,11 @@ void OpenCLIntegrateRPMDStepKernel::initializeKernels(ContextImpl& context) {
     copyFromContextKernel.setArg<cl::Buffer>(3, velocities.getDeviceBuffer());
     copyFromContextKernel.setArg<cl::Buffer>(4, cl.getPosq().getDeviceBuffer());
     copyFromContextKernel.setArg<cl::Buffer>(6, cl.getAtomIndexArray().getDeviceBuffer());
+    swapContextKernel.setArg<cl::Buffer>(0, cl.getForce().getDeviceBuffer());
+    swapContextKernel.setArg<cl::Buffer>(2, cl.getVelm().getDeviceBuffer());
+    swapContextKernel.setArg<cl::Buffer>(3, velocities.getDeviceBuffer());
+    swapContextKernel.setArg<cl::Buffer>(4, cl.getPosq().getDeviceBuffer());
+    swapContextKernel.setArg<cl::Buffer>(6, cl.getAtomIndexArray().getDeviceBuffer());
     for (auto& g : groupsByCopies) {
         int copies = g.first;
         positionContractionKernels[copies].setArg<cl::Buffer>(0, positions.getDeviceBuffer());
@@ -252,9 +258,14 @@ void OpenCLIntegrateRPMDStepKernel::computeForces(ContextImpl& context) {
     copyToContextKernel.setArg<cl::Buffer>(2, positions.getDeviceBuffer());
     copyFromContextKernel.setArg<cl::Buffer>(1, forces.getDeviceBuffer());
     copyFromContextKernel.setArg<cl::Buffer>(5, positions.getDeviceBuffer());
+    swapContextKernel.setArg<cl::Buffer>(1, forces.getDeviceBuffer());
+    swapContextKernel.setArg<cl::Buffer>(5, positions.getDeviceBuffer());
+
+    // Each copy's results are retrieved by the same kernel that loads the next copy into the context.
+
+    copyToContextKernel.setArg<cl_int>(5, 0);
+    cl.executeKernel(copyToContextKernel, cl.getNumAtoms());
     for (int i = 0; i < numCopies; i++) {
-        copyToContextKernel.setArg<cl_int>(5, i);
-        cl.executeKernel(copyToContextKernel, cl.getNumAtoms());
         context.computeVirtualSites();
         Vec3 initialBox[3];
         context.getPeriodicBoxVectors(initialBox[0], initialBox[1], initialBox[2]);
@@ -264,8 +275,9 @@ void OpenCLIntegrateRPMDStepKernel::computeForces(ContextImpl& context) {
         if (initialBox[0] != finalBox[0] || initialBox[1] != finalBox[1] || initialBox[2] != finalBox[2])
             throw OpenMMException("Standard barostats cannot be used with RPMDIntegrator.  Use RPMDMonteCarloBarostat instead.");
         context.calcForcesAndEnergy(true, false, groupsNotContracted);
-        copyFromContextKernel.setArg<cl_int>(7, i);
-        cl.executeKernel(copyFromContextKernel, cl.getNumAtoms());
+        cl::Kernel& kernel = (i < numCopies-1 ? swapContextKernel : copyFromContextKernel);
+        kernel.setArg<cl_int>(7, i);
+        cl.executeKernel(kernel, cl.getNumAtoms());
     }
     
     // Now loop over contractions and compute forces from them.
@@ -274,6 +286,8 @@ void OpenCLIntegrateRPMDStepKernel::computeForces(ContextImpl& context) {
         copyToContextKernel.setArg<cl::Buffer>(2, contractedPositions.getDeviceBuffer());
         copyFromContextKernel.setArg<cl::Buffer>(1, contractedForces.getDeviceBuffer());
         copyFromContextKernel.setArg<cl::Buffer>(5, contractedPositions.getDeviceBuffer());
+        swapContextKernel.setArg<cl::Buffer>(1, contractedForces.getDeviceBuffer());
+        swapContextKernel.setArg<cl::Buffer>(5, contractedPositions.getDeviceBuffer());
         for (auto& g : groupsByCopies) {
             int copies = g.first;
             int groupFlags = g.second;
@@ -284,13 +298,14 @@ void OpenCLIntegrateRPMDStepKernel::computeForces(ContextImpl& context) {
 
             // Compute forces.
 
+            copyToContextKernel.setArg<cl_int>(5, 0);
+            cl.executeKernel(copyToContextKernel, cl.getNumAtoms());
             for (int i = 0; i < copies; i++) {
-                copyToContextKernel.setArg<cl_int>(5, i);
-                cl.executeKernel(copyToContextKernel, cl.getNumAtoms());
                 context.computeVirtualSites();
                 context.calcForcesAndEnergy(true, false, groupFlags);
-                copyFromContextKernel.setArg<cl_int>(7, i);
-                cl.executeKernel(copyFromContextKernel, cl.getNumAtoms());
+                cl::Kernel& kernel = (i < copies-1 ? swapContextKernel : copyFromContextKernel);
+                kernel.setArg<cl_int>(7, i);
+                cl.executeKernel(kernel, cl.getNumAtoms());
             }
 
             // Apply the forces to the original copies.
@@ -96,7 +96,7 @@ private:
     OpenCLArray velocities;
     OpenCLArray contractedForces;
     OpenCLArray contractedPositions;
-    cl::Kernel pileKernel, stepKernel, velocitiesKernel, copyToContextKernel, copyFromContextKernel, translateKernel;
+    cl::Kernel pileKernel, stepKernel, velocitiesKernel, copyToContextKernel, copyFromContextKernel, swapContextKernel, translateKernel;
     std::map<int, cl::Kernel> positionContractionKernels;
     std::map<int, cl::Kernel> forceContractionKernels;
 };
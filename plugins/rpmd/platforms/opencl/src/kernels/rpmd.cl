@@ -203,6 +203,27 @@ __kernel void copyDataFromContext(__global real4* srcForce, __global real4* dstF
     }
 }
 
+/**
+ * Copy the positions, velocities, and forces of one copy from the context to the integrator's arrays, and
+ * then load the positions and velocities of the next copy into the context.  This is equivalent to calling
+ * copyDataFromContext() followed by copyDataToContext(), but saves a kernel launch between force evaluations.
+ */
+__kernel void swapDataInContext(__global real4* contextForce, __global real4* dstForce, __global mixed4* contextVel,
+        __global mixed4* vel, __global real4* contextPos, __global mixed4* pos, __global int* order, int copy) {
+    const int base = copy*PADDED_NUM_ATOMS;
+    const int nextBase = base+PADDED_NUM_ATOMS;
+    for (int particle = get_global_id(0); particle < NUM_ATOMS; particle += get_global_size(0)) {
+        int index = order[particle];
+        dstForce[base+index] = contextForce[particle];
+        vel[base+index] = contextVel[particle];
+        real4 posq = contextPos[particle];
+        pos[base+index].xyz = convert_mixed4(posq).xyz;
+        contextVel[particle] = vel[nextBase+index];
+        posq.xyz = convert_real4(pos[nextBase+index]).xyz;
+        contextPos[particle] = posq;
+    }
+}
+
 /**
  * Atom positions in one copy have been modified.  Apply the same offsets to all the other copies.
  */
@@ -32,6 +32,7 @@
 #include "ReferenceRpmdKernels.h"
 #include "openmm/OpenMMException.h"
 #include "openmm/internal/ContextImpl.h"
+#include "openmm/internal/ThreadPool.h"
 #include "SimTKOpenMMUtilities.h"
 
 using namespace OpenMM;
@@ -52,12 +53,19 @@ static vector<Vec3>& extractForces(ContextImpl& context) {
     return *data->forces;
 }
 
+static ThreadPool* extractThreadPool(ContextImpl& context) {
+    ReferencePlatform::PlatformData* data = reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData());
+    return data->getThreadPool();
+}
+
 ReferenceIntegrateRPMDStepKernel::~ReferenceIntegrateRPMDStepKernel() {
     if (fft != NULL)
         fftpack_destroy(fft);
     for (auto& c : contractionFFT)
         if (c.second != NULL)
             fftpack_destroy(c.second);
+    for (fftpack* f : threadFFT)
+        fftpack_destroy(f);
 }
 
 void ReferenceIntegrateRPMDStepKernel::initialize(const System& system, const RPMDIntegrator& integrator) {
@@ -178,36 +186,21 @@ void ReferenceIntegrateRPMDStepKernel::execute(ContextImpl& context, const RPMDI
             if (system.getParticleMass(j) != 0.0)
                 velocities[i][j] += forces[i][j]*(halfdt/system.getParticleMass(j));
     
-    // Evolve the free ring polymer by transforming to the frequency domain.
+    // Evolve the free ring polymer by transforming to the frequency domain.  Each particle is
+    // independent, so they can be divided between threads.
 
-    for (int particle = 0; particle < numParticles; particle++) {
-        if (system.getParticleMass(particle) == 0.0)
-            continue;
-        for (int component = 0; component < 3; component++) {
-            for (int k = 0; k < numCopies; k++) {
-                q[k] = t_complex(scale*positions[k][particle][component], 0.0);
-                v[k] = t_complex(scale*velocities[k][particle][component], 0.0);
-            }
-            fftpack_exec_1d(fft, FFTPACK_FORWARD, &q[0], &q[0]);
-            fftpack_exec_1d(fft, FFTPACK_FORWARD, &v[0], &v[0]);
-            q[0] += v[0]*dt;
-            for (int k = 1; k < numCopies; k++) {
-                const double wk = twown*sin(k*M_PI/numCopies);
-                const double wt = wk*dt;
-                const double coswt = cos(wt);
-                const double sinwt = sin(wt);
-                const double wm = wk*system.getParticleMass(particle);
-                const t_complex vprime = v[k]*coswt - q[k]*(wk*sinwt); // Advance velocity from t to t+dt
-                q[k] = v[k]*(sinwt/wk) + q[k]*coswt; // Advance position from t to t+dt
-                v[k] = vprime;
-            }
-            fftpack_exec_1d(fft, FFTPACK_BACKWARD, &q[0], &q[0]);
-            fftpack_exec_1d(fft, FFTPACK_BACKWARD, &v[0], &v[0]);
-            for (int k = 0; k < numCopies; k++) {
-                positions[k][particle][component] = scale*q[k].re;
-                velocities[k][particle][component] = scale*v[k].re;
-            }
+    ThreadPool* threads = extractThreadPool(context);
+    if (threads == NULL)
+        evolveFreeRingPolymer(system, dt, twown, 0, numParticles, fft);
+    else {
+        while ((int) threadFFT.size() < threads->getNumThreads()) {
+            threadFFT.push_back(NULL);
+            fftpack_init_1d(&threadFFT.back(), numCopies);
         }
+        threads->execute(numParticles, 64, [&] (ThreadPool& pool, int threadIndex, int first, int last) {
+            evolveFreeRingPolymer(system, dt, twown, first, last, threadFFT[threadIndex]);
+        });
+        threads->waitForThreads();
     }
     
     // Calculate forces based on the updated positions.
@@ -263,6 +256,41 @@ void ReferenceIntegrateRPMDStepKernel::execute(ContextImpl& context, const RPMDI
     context.setTime(context.getTime()+dt);
 }
 
+void ReferenceIntegrateRPMDStepKernel::evolveFreeRingPolymer(const System& system, double dt, double twown, int firstParticle, int lastParticle, fftpack* fft) {
+    const int numCopies = positions.size();
+    vector<t_complex> v(numCopies);
+    vector<t_complex> q(numCopies);
+    const double scale = 1.0/sqrt((double) numCopies);
+    for (int particle = firstParticle; particle < lastParticle; particle++) {
+        if (system.getParticleMass(particle) == 0.0)
+            continue;
+        for (int component = 0; component < 3; component++) {
+            for (int k = 0; k < numCopies; k++) {
+                q[k] = t_complex(scale*positions[k][particle][component], 0.0);
+                v[k] = t_complex(scale*velocities[k][particle][component], 0.0);
+            }
+            fftpack_exec_1d(fft, FFTPACK_FORWARD, &q[0], &q[0]);
+            fftpack_exec_1d(fft, FFTPACK_FORWARD, &v[0], &v[0]);
+            q[0] += v[0]*dt;
+            for (int k = 1; k < numCopies; k++) {
+                const double wk = twown*sin(k*M_PI/numCopies);
+                const double wt = wk*dt;
+                const double coswt = cos(wt);
+                const double sinwt = sin(wt);
+                const t_complex vprime = v[k]*coswt - q[k]*(wk*sinwt); // Advance velocity from t to t+dt
+                q[k] = v[k]*(sinwt/wk) + q[k]*coswt; // Advance position from t to t+dt
+                v[k] = vprime;
+            }
+            fftpack_exec_1d(fft, FFTPACK_BACKWARD, &q[0], &q[0]);
+            fftpack_exec_1d(fft, FFTPACK_BACKWARD, &v[0], &v[0]);
+            for (int k = 0; k < numCopies; k++) {
+                positions[k][particle][component] = scale*q[k].re;
+                velocities[k][particle][component] = scale*v[k].re;
+            }
+        }
+    }
+}
+
 void ReferenceIntegrateRPMDStepKernel::computeForces(ContextImpl& context, const RPMDIntegrator& integrator) {
     const int totalCopies = positions.size();
     const int numParticles = positions[0].size();
@@ -86,6 +86,11 @@ public:
     void copyToContext(int copy, ContextImpl& context);
 private:
     void computeForces(ContextImpl& context, const RPMDIntegrator& integrator);
+    /**
+     * Advance the positions and velocities of a range of particles under the free ring polymer
+     * Hamiltonian, using the normal mode representation.
+     */
+    void evolveFreeRingPolymer(const System& system, double dt, double twown, int firstParticle, int lastParticle, fftpack* fft);
     std::vector<std::vector<Vec3> > positions;
     std::vector<std::vector<Vec3> > velocities;
     std::vector<std::vector<Vec3> > forces;
@@ -95,6 +100,7 @@ private:
     int groupsNotContracted;
     fftpack* fft;
     std::map<int, fftpack*> contractionFFT;
+    std::vector<fftpack*> threadFFT;
 };
 
 } // namespace OpenMM
@@ -434,6 +434,56 @@ void testWithBarostat() {
     ASSERT_USUALLY_EQUAL_TOL(expectedKE, meanKE, 1e-2);
 }
 
+void testThreadsGiveIdenticalResults() {
+    const int numParticles = 500;
+    const int numCopies = 8;
+    
+    // Create a chain of particles.
+    
+    System system;
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    system.addForce(bonds);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(2.0);
+        if (i > 0)
+            bonds->addBond(i-1, i, 1.0, 1000.0);
+    }
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    vector<vector<Vec3> > positions(numCopies);
+    for (int i = 0; i < numCopies; i++) {
+        positions[i].resize(numParticles);
+        for (int j = 0; j < numParticles; j++)
+            positions[i][j] = Vec3(0.95*j, 0.01*genrand_real2(sfmt), 0.01*genrand_real2(sfmt));
+    }
+    
+    // Simulate it with one thread and with several, and make sure the results are identical.
+    
+    Platform& platform = Platform::getPlatformByName("Reference");
+    RPMDIntegrator integ1(numCopies, 300.0, 1.0, 0.001);
+    RPMDIntegrator integ2(numCopies, 300.0, 1.0, 0.001);
+    integ1.setApplyThermostat(false);
+    integ2.setApplyThermostat(false);
+    Context context1(system, integ1, platform);
+    map<string, string> properties;
+    properties["Threads"] = "4";
+    Context context2(system, integ2, platform, properties);
+    for (int i = 0; i < numCopies; i++) {
+        integ1.setPositions(i, positions[i]);
+        integ2.setPositions(i, positions[i]);
+    }
+    integ1.step(10);
+    integ2.step(10);
+    for (int i = 0; i < numCopies; i++) {
+        State state1 = integ1.getState(i, State::Positions | State::Velocities);
+        State state2 = integ2.getState(i, State::Positions | State::Velocities);
+        for (int j = 0; j < numParticles; j++) {
+            ASSERT(state1.getPositions()[j] == state2.getPositions()[j]);
+            ASSERT(state1.getVelocities()[j] == state2.getVelocities()[j]);
+        }
+    }
+}
+
 int main() {
     try {
         registerRpmdReferenceKernelFactories();
@@ -443,6 +493,7 @@ int main() {
         testContractions();
         testWithoutThermostat();
         testWithBarostat();
+        testThreadsGiveIdenticalResults();
     }
     catch(const std::exception& e) {
         std::cout << "exception: " << e.what() << std::endl;
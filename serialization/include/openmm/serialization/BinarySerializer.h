@@ -0,0 +1,113 @@
+#ifndef OPENMM_BINARY_SERIALIZER_H_
+#define OPENMM_BINARY_SERIALIZER_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2024 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "openmm/serialization/SerializationNode.h"
+#include "openmm/serialization/SerializationProxy.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/internal/windowsExport.h"
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace OpenMM {
+
+/**
+ * BinarySerializer is used for serializing objects in a compact binary format, and for reconstructing them
+ * again.  It uses the same SerializationProxy classes as XmlSerializer, so any object that can be serialized
+ * as XML can also be serialized in binary.  Node names and property names are stored once in a string table
+ * and referred to by index, and no text needs to be escaped or parsed.  For large Systems this makes files
+ * considerably smaller and much faster to load than the equivalent XML.
+ *
+ * The format begins with a header identifying it and giving its version.  Files written by one version of
+ * OpenMM can be read by later versions.
+ */
+
+class OPENMM_EXPORT BinarySerializer {
+public:
+    /**
+     * Serialize an object in binary format.
+     *
+     * @param object    the object to serialize
+     * @param rootName  the name to use for the root node
+     * @param stream    an output stream to write the data to.  It should be opened in binary mode.
+     */
+    template <class T>
+    static void serialize(const T* object, const std::string& rootName, std::ostream& stream) {
+        const SerializationProxy& proxy = SerializationProxy::getProxy(typeid(*object));
+        SerializationNode node;
+        node.setName(rootName);
+        proxy.serialize(object, node);
+        if (node.hasProperty("type"))
+            throw OpenMMException(proxy.getTypeName()+" created node with reserved property 'type'");
+        node.setStringProperty("type", proxy.getTypeName());
+        serialize(node, stream);
+    }
+    /**
+     * Reconstruct an object that has been serialized in binary format.
+     *
+     * @param stream    an input stream to read the data from.  It should be opened in binary mode.
+     * @return a pointer to the newly created object.  The caller assumes ownership of the object.
+     */
+    template <class T>
+    static T* deserialize(std::istream& stream) {
+        return reinterpret_cast<T*>(deserializeStream(stream));
+    }
+    /**
+     * Reconstruct an object from a file containing data in binary format.  Where the operating system
+     * supports it, the file is memory mapped and decoded in place rather than first being copied into memory.
+     * When many processes load the same file at once, they then all share a single copy of it in the
+     * operating system's page cache.
+     *
+     * @param filename  the path to the file to read
+     * @return a pointer to the newly created object.  The caller assumes ownership of the object.
+     */
+    template <class T>
+    static T* deserializeFile(const std::string& filename) {
+        return reinterpret_cast<T*>(deserializeFileData(filename));
+    }
+private:
+    class Reader;
+    static void serialize(const SerializationNode& node, std::ostream& stream);
+    static void* deserializeStream(std::istream& stream);
+    static void* deserializeFileData(const std::string& filename);
+    static void* deserializeData(const char* data, size_t size);
+    static void findNames(const SerializationNode& node, std::map<std::string, int>& names, std::vector<std::string>& nameList);
+    static void encodeNode(const SerializationNode& node, const std::map<std::string, int>& names, std::string& buffer);
+    static void decodeNode(SerializationNode& node, Reader& reader, const std::vector<std::string>& names, int depth);
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_BINARY_SERIALIZER_H_*/
@@ -0,0 +1,245 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2024 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "openmm/serialization/BinarySerializer.h"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+using namespace OpenMM;
+using namespace std;
+
+static const char magicNumber[] = {'O', 'M', 'M', 'B', 'I', 'N', '\r', '\n'};
+static const int formatVersion = 1;
+
+// Real objects are never nested more than a few levels deep.  This limit keeps corrupted or malicious
+// data from exhausting the stack.
+static const int maxNodeDepth = 1000;
+
+/**
+ * Append an unsigned integer to a buffer, using a variable length encoding in which small values take
+ * fewer bytes.
+ */
+static void writeInt(string& buffer, unsigned long long value) {
+    while (value >= 0x80) {
+        buffer.push_back((char) ((value&0x7F) | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back((char) value);
+}
+
+/**
+ * Append a length prefixed string to a buffer.
+ */
+static void writeString(string& buffer, const string& value) {
+    writeInt(buffer, value.size());
+    buffer.append(value);
+}
+
+/**
+ * This class reads values from the serialized data, checking that it does not go past the end.
+ */
+class BinarySerializer::Reader {
+public:
+    Reader(const char* data, size_t size) : data(data), size(size), position(0) {
+    }
+    unsigned long long readInt() {
+        unsigned long long value = 0;
+        for (int shift = 0; ; shift += 7) {
+            if (position >= size || shift > 63)
+                throw OpenMMException("BinarySerializer: The data is corrupted or truncated");
+            unsigned char c = (unsigned char) data[position++];
+            value |= ((unsigned long long) (c&0x7F)) << shift;
+            if ((c&0x80) == 0)
+                return value;
+        }
+    }
+    void readString(string& value) {
+        unsigned long long length = readInt();
+        if (length > size-position)
+            throw OpenMMException("BinarySerializer: The data is corrupted or truncated");
+        value.assign(data+position, length);
+        position += length;
+    }
+    size_t getRemainingBytes() const {
+        return size-position;
+    }
+    bool readBytes(const char* expected, int length) {
+        if (size-position < length)
+            return false;
+        bool matches = (memcmp(data+position, expected, length) == 0);
+        position += length;
+        return matches;
+    }
+private:
+    const char* data;
+    size_t size, position;
+};
+
+void BinarySerializer::serialize(const SerializationNode& node, ostream& stream) {
+    // Build the table of node and property names.
+
+    map<string, int> names;
+    vector<string> nameList;
+    findNames(node, names, nameList);
+
+    // Encode everything into a buffer, then write it in a single call.
+
+    string buffer(magicNumber, sizeof(magicNumber));
+    writeInt(buffer, formatVersion);
+    writeInt(buffer, nameList.size());
+    for (const string& name : nameList)
+        writeString(buffer, name);
+    encodeNode(node, names, buffer);
+    stream.write(buffer.data(), buffer.size());
+}
+
+void BinarySerializer::findNames(const SerializationNode& node, map<string, int>& names, vector<string>& nameList) {
+    if (names.find(node.getName()) == names.end()) {
+        names[node.getName()] = nameList.size();
+        nameList.push_back(node.getName());
+    }
+    for (auto& prop : node.getProperties()) {
+        if (names.find(prop.first) == names.end()) {
+            names[prop.first] = nameList.size();
+            nameList.push_back(prop.first);
+        }
+    }
+    for (auto& child : node.getChildren())
+        findNames(child, names, nameList);
+}
+
+void BinarySerializer::encodeNode(const SerializationNode& node, const map<string, int>& names, string& buffer) {
+    writeInt(buffer, names.find(node.getName())->second);
+    const map<string, string>& properties = node.getProperties();
+    writeInt(buffer, properties.size());
+    for (auto& prop : properties) {
+        writeInt(buffer, names.find(prop.first)->second);
+        writeString(buffer, prop.second);
+    }
+    const vector<SerializationNode>& children = node.getChildren();
+    writeInt(buffer, children.size());
+    for (auto& child : children)
+        encodeNode(child, names, buffer);
+}
+
+void BinarySerializer::decodeNode(SerializationNode& node, Reader& reader, const vector<string>& names, int depth) {
+    if (depth > maxNodeDepth)
+        throw OpenMMException("BinarySerializer: The data is nested too deeply");
+    unsigned long long nameIndex = reader.readInt();
+    if (nameIndex >= names.size())
+        throw OpenMMException("BinarySerializer: The data is corrupted or truncated");
+    node.setName(names[nameIndex]);
+    unsigned long long numProperties = reader.readInt();
+    string value;
+    for (unsigned long long i = 0; i < numProperties; i++) {
+        unsigned long long keyIndex = reader.readInt();
+        if (keyIndex >= names.size())
+            throw OpenMMException("BinarySerializer: The data is corrupted or truncated");
+        reader.readString(value);
+        node.setStringProperty(names[keyIndex], value);
+    }
+    unsigned long long numChildren = reader.readInt();
+
+    // Every child takes at least three bytes (name, number of properties, and number of children),
+    // so a larger count than that can only come from corrupted data.
+
+    if (numChildren > reader.getRemainingBytes()/3)
+        throw OpenMMException("BinarySerializer: The data is corrupted or truncated");
+    vector<SerializationNode>& children = node.getChildren();
+    children.resize(numChildren);
+    for (auto& child : children)
+        decodeNode(child, reader, names, depth+1);
+}
+
+void* BinarySerializer::deserializeStream(istream& stream) {
+    string data((istreambuf_iterator<char>(stream)), istreambuf_iterator<char>());
+    return deserializeData(data.data(), data.size());
+}
+
+void* BinarySerializer::deserializeFileData(const string& filename) {
+#ifndef _WIN32
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        throw OpenMMException("BinarySerializer: Could not open file "+filename);
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        throw OpenMMException("BinarySerializer: Could not read file "+filename);
+    }
+    size_t size = info.st_size;
+    void* data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        throw OpenMMException("BinarySerializer: Could not map file "+filename);
+    madvise(data, size, MADV_SEQUENTIAL);
+    try {
+        void* result = deserializeData((const char*) data, size);
+        munmap(data, size);
+        return result;
+    }
+    catch (...) {
+        munmap(data, size);
+        throw;
+    }
+#else
+    ifstream stream(filename.c_str(), ios::in | ios::binary);
+    if (!stream.is_open())
+        throw OpenMMException("BinarySerializer: Could not open file "+filename);
+    return deserializeStream(stream);
+#endif
+}
+
+void* BinarySerializer::deserializeData(const char* data, size_t size) {
+    Reader reader(data, size);
+    if (!reader.readBytes(magicNumber, sizeof(magicNumber)))
+        throw OpenMMException("BinarySerializer: The data is not in OpenMM's binary serialization format");
+    unsigned long long version = reader.readInt();
+    if (version > formatVersion)
+        throw OpenMMException("BinarySerializer: The data was written by a newer version of OpenMM");
+    unsigned long long numNames = reader.readInt();
+    if (numNames > reader.getRemainingBytes())
+        throw OpenMMException("BinarySerializer: The data is corrupted or truncated");
+    vector<string> names(numNames);
+    for (string& name : names)
+        reader.readString(name);
+    SerializationNode root;
+    decodeNode(root, reader, names, 0);
+    const SerializationProxy& proxy = SerializationProxy::getProxy(root.getStringProperty("type"));
+    return proxy.deserialize(root);
+}
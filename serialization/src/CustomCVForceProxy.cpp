@@ -42,10 +42,11 @@ CustomCVForceProxy::CustomCVForceProxy() : SerializationProxy("CustomCVForce") {
 }
 
 void CustomCVForceProxy::serialize(const void* object, SerializationNode& node) const {
-    node.setIntProperty("version", 0);
+    node.setIntProperty("version", 1);
     const CustomCVForce& force = *reinterpret_cast<const CustomCVForce*>(object);
     node.setIntProperty("forceGroup", force.getForceGroup());
     node.setStringProperty("energy", force.getEnergyFunction());
+    node.setBoolProperty("useInnerContext", force.getUseInnerContext());
     SerializationNode& globalParams = node.createChildNode("GlobalParameters");
     for (int i = 0; i < force.getNumGlobalParameters(); i++) {
         globalParams.createChildNode("Parameter").setStringProperty("name", force.getGlobalParameterName(i)).setDoubleProperty("default", force.getGlobalParameterDefaultValue(i));
@@ -66,12 +67,13 @@ void CustomCVForceProxy::serialize(const void* object, SerializationNode& node)
 
 void* CustomCVForceProxy::deserialize(const SerializationNode& node) const {
     int version = node.getIntProperty("version");
-    if (version != 0)
+    if (version > 1)
         throw OpenMMException("Unsupported version number");
     CustomCVForce* force = NULL;
     try {
         CustomCVForce* force = new CustomCVForce(node.getStringProperty("energy"));
         force->setForceGroup(node.getIntProperty("forceGroup", 0));
+        force->setUseInnerContext(node.getBoolProperty("useInnerContext", true));
         const SerializationNode& globalParams = node.getChildNode("GlobalParameters");
         for (auto& parameter : globalParams.getChildren())
             force->addGlobalParameter(parameter.getStringProperty("name"), parameter.getDoubleProperty("default"));
@@ -30,14 +30,94 @@
  * -------------------------------------------------------------------------- */
 
 #include "openmm/serialization/StateProxy.h"
+#include "openmm/OpenMMException.h"
 #include "openmm/Platform.h"
 #include "openmm/State.h"
 #include "openmm/Vec3.h"
+#include "openmm/internal/ThreadPool.h"
 #include <map>
+#include <mutex>
 
 using namespace std;
 using namespace OpenMM;
 
+/**
+ * Arrays with at least this many elements are converted to and from text in parallel.
+ */
+static const int MIN_PARALLEL_SIZE = 10000;
+
+/**
+ * Get the ThreadPool used for converting large arrays.  It is created the first time it is needed and then
+ * reused, so serializing many States does not keep starting and stopping threads.  The caller must hold
+ * the lock returned by getThreadPoolLock() while using it.
+ */
+static ThreadPool& getThreadPool() {
+    static ThreadPool threads;
+    return threads;
+}
+
+static mutex& getThreadPoolLock() {
+    static mutex lock;
+    return lock;
+}
+
+/**
+ * Add a child node for each element of a per-particle array.
+ */
+static void serializeVectors(SerializationNode& node, const string& childName, const vector<Vec3>& values) {
+    vector<SerializationNode>& children = node.getChildren();
+    int numValues = values.size();
+    children.resize(numValues);
+    auto encode = [&] (int start, int end) {
+        for (int i = start; i < end; i++) {
+            children[i].setName(childName);
+            children[i].setDoubleProperty("x", values[i][0]).setDoubleProperty("y", values[i][1]).setDoubleProperty("z", values[i][2]);
+        }
+    };
+    if (numValues < MIN_PARALLEL_SIZE)
+        encode(0, numValues);
+    else {
+        lock_guard<mutex> lock(getThreadPoolLock());
+        ThreadPool& threads = getThreadPool();
+        threads.execute(numValues, 1000, [&] (ThreadPool& threads, int threadIndex, int start, int end) { encode(start, end); });
+        threads.waitForThreads();
+    }
+}
+
+/**
+ * Read a per-particle array from the children of a node.
+ */
+static void deserializeVectors(const SerializationNode& node, vector<Vec3>& values) {
+    const vector<SerializationNode>& children = node.getChildren();
+    int numValues = children.size();
+    values.resize(numValues);
+    auto decode = [&] (int start, int end) {
+        for (int i = start; i < end; i++)
+            values[i] = Vec3(children[i].getDoubleProperty("x"), children[i].getDoubleProperty("y"), children[i].getDoubleProperty("z"));
+    };
+    if (numValues < MIN_PARALLEL_SIZE)
+        decode(0, numValues);
+    else {
+        // An exception must not escape from a worker thread, so record it and throw it again afterward.
+
+        lock_guard<mutex> lock(getThreadPoolLock());
+        ThreadPool& threads = getThreadPool();
+        vector<string> errors(threads.getNumThreads());
+        threads.execute(numValues, 1000, [&] (ThreadPool& threads, int threadIndex, int start, int end) {
+            try {
+                decode(start, end);
+            }
+            catch (const exception& ex) {
+                errors[threadIndex] = ex.what();
+            }
+        });
+        threads.waitForThreads();
+        for (const string& error : errors)
+            if (error.size() > 0)
+                throw OpenMMException(error);
+    }
+}
+
 StateProxy::StateProxy() : SerializationProxy("State") {
 
 }
@@ -67,27 +147,15 @@ void StateProxy::serialize(const void* object, SerializationNode& node) const {
     }
     if ((s.getDataTypes()&State::Positions) != 0) {
         s.getPositions();
-        SerializationNode& positionsNode = node.createChildNode("Positions");
-        vector<Vec3> statePositions = s.getPositions();
-        for (int i=0; i<statePositions.size();i++) {
-           positionsNode.createChildNode("Position").setDoubleProperty("x", statePositions[i][0]).setDoubleProperty("y", statePositions[i][1]).setDoubleProperty("z", statePositions[i][2]);
-        }
+        serializeVectors(node.createChildNode("Positions"), "Position", s.getPositions());
     }
     if ((s.getDataTypes()&State::Velocities) != 0) {
         s.getVelocities();
-        SerializationNode& velocitiesNode = node.createChildNode("Velocities");
-        vector<Vec3> stateVelocities = s.getVelocities();
-        for (int i=0; i<stateVelocities.size();i++) {
-           velocitiesNode.createChildNode("Velocity").setDoubleProperty("x", stateVelocities[i][0]).setDoubleProperty("y", stateVelocities[i][1]).setDoubleProperty("z", stateVelocities[i][2]);
-        }
+        serializeVectors(node.createChildNode("Velocities"), "Velocity", s.getVelocities());
     }
     if ((s.getDataTypes()&State::Forces) != 0) {
         s.getForces();
-        SerializationNode& forcesNode = node.createChildNode("Forces");
-        vector<Vec3> stateForces = s.getForces();
-        for (int i=0; i<stateForces.size();i++) {
-            forcesNode.createChildNode("Force").setDoubleProperty("x", stateForces[i][0]).setDoubleProperty("y", stateForces[i][1]).setDoubleProperty("z", stateForces[i][2]);
-        }
+        serializeVectors(node.createChildNode("Forces"), "Force", s.getForces());
     }
     if ((s.getDataTypes()&State::IntegratorParameters) != 0) {
         node.getChildren().push_back(s.getIntegratorParameters());
@@ -122,22 +190,19 @@ void* StateProxy::deserialize(const SerializationNode& node) const {
         }
         else if (child.getName() == "Positions") {
             vector<Vec3> outPositions;
-            for (auto& particle : child.getChildren())
-                outPositions.push_back(Vec3(particle.getDoubleProperty("x"),particle.getDoubleProperty("y"),particle.getDoubleProperty("z")));
+            deserializeVectors(child, outPositions);
             builder.setPositions(outPositions);
             arraySizes.push_back(outPositions.size());
         }
         else if (child.getName() == "Velocities") {
             vector<Vec3> outVelocities;
-            for (auto& particle : child.getChildren())
-                outVelocities.push_back(Vec3(particle.getDoubleProperty("x"),particle.getDoubleProperty("y"),particle.getDoubleProperty("z")));
+            deserializeVectors(child, outVelocities);
             builder.setVelocities(outVelocities);
             arraySizes.push_back(outVelocities.size());
         }
         else if (child.getName() == "Forces") {
             vector<Vec3> outForces;
-            for (auto& particle : child.getChildren())
-                outForces.push_back(Vec3(particle.getDoubleProperty("x"),particle.getDoubleProperty("y"),particle.getDoubleProperty("z")));
+            deserializeVectors(child, outForces);
             builder.setForces(outForces);
             arraySizes.push_back(outForces.size());
         }
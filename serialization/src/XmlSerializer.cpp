@@ -30,6 +30,8 @@
  * -------------------------------------------------------------------------- */
 
 #include "openmm/serialization/XmlSerializer.h"
+#include "openmm/Force.h"
+#include "openmm/System.h"
 #include "irrXML.h"
 #include <cstring>
 #include <iostream>
@@ -158,8 +160,12 @@ private:
 
 /**
  * Process an XML node, storing its content into a SerializationNode.
+ *
+ * If forces is not NULL, the node is the root of a System.  Each of its Forces is then deserialized as soon
+ * as its element has been read, and the SerializationNodes for it are discarded.  Forces usually account
+ * for most of a System, so this greatly reduces the peak memory needed to load one.
  */
-static void decodeNode(SerializationNode& node, IrrXMLReader& xml) {
+static void decodeNode(SerializationNode& node, IrrXMLReader& xml, vector<Force*>* forces=NULL) {
     for (int i = 0; i < xml.getAttributeCount(); i++)
         node.setStringProperty(xml.getAttributeName(i), xml.getAttributeValue(i));
     if (xml.isEmptyElement())
@@ -169,7 +175,22 @@ static void decodeNode(SerializationNode& node, IrrXMLReader& xml) {
             case EXN_ELEMENT:
             {
                 SerializationNode& childNode = node.createChildNode(xml.getNodeName());
-                decodeNode(childNode, xml);
+                if (forces != NULL && childNode.getName() == "Forces") {
+                    for (int i = 0; i < xml.getAttributeCount(); i++)
+                        childNode.setStringProperty(xml.getAttributeName(i), xml.getAttributeValue(i));
+                    if (xml.isEmptyElement())
+                        break;
+                    while (xml.read() && xml.getNodeType() != EXN_ELEMENT_END) {
+                        if (xml.getNodeType() == EXN_ELEMENT) {
+                            SerializationNode forceNode;
+                            forceNode.setName(xml.getNodeName());
+                            decodeNode(forceNode, xml);
+                            forces->push_back(forceNode.decodeObject<Force>());
+                        }
+                    }
+                }
+                else
+                    decodeNode(childNode, xml);
                 break;
             }
             case EXN_ELEMENT_END:
@@ -182,16 +203,36 @@ void* XmlSerializer::deserializeStream(std::istream& stream) {
     SerializationNode root;
     StreamReader reader(stream);
     IrrXMLReader* xml = createIrrXMLReader(&reader);
-    
-    // Find the root node in the file.
-    
-    while (xml->read() && xml->getNodeType() != EXN_ELEMENT)
-        ;
-    decodeNode(root, *xml);
-    delete xml;
-    
-    // Process the SerializationNodes.
-    
-    const SerializationProxy& proxy = SerializationProxy::getProxy(root.getStringProperty("type"));
-    return proxy.deserialize(root);
+    vector<Force*> forces;
+    try {
+        // Find the root node in the file.
+
+        while (xml->read() && xml->getNodeType() != EXN_ELEMENT)
+            ;
+        const char* type = xml->getAttributeValue("type");
+        bool isSystem = (type != NULL && string(type) == "System");
+        decodeNode(root, *xml, isSystem ? &forces : NULL);
+        delete xml;
+        xml = NULL;
+
+        // Process the SerializationNodes.
+
+        const SerializationProxy& proxy = SerializationProxy::getProxy(root.getStringProperty("type"));
+        void* object = proxy.deserialize(root);
+        if (isSystem) {
+            // SystemProxy adds the Forces after everything else, so appending them preserves the order.
+
+            System* system = reinterpret_cast<System*>(object);
+            for (Force* force : forces)
+                system->addForce(force);
+        }
+        return object;
+    }
+    catch (...) {
+        if (xml != NULL)
+            delete xml;
+        for (Force* force : forces)
+            delete force;
+        throw;
+    }
 }
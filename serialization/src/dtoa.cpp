@@ -214,6 +214,10 @@ extern void *MALLOC(size_t);
 #define MALLOC malloc
 #endif
 
+/* OpenMM: freed Bigints are kept in per-thread lists (see DtoaThreadCache), which cannot */
+/* share a single static memory pool, so every Bigint is allocated with MALLOC. */
+#define Omit_Private_Memory
+
 #ifndef Omit_Private_Memory
 #ifndef PRIVATE_MEM
 #define PRIVATE_MEM 2304
@@ -504,10 +508,11 @@ BCinfo { int dp0, dp1, dplen, dsign, e0, inexact, nd, nd0, rounding, scale, uflc
 #endif
 #endif /* NO_LONG_LONG */
 
-#ifndef MULTIPLE_THREADS
+/* OpenMM: these functions may be called from multiple threads at once.  Every cache */
+/* is kept per thread (see DtoaThreadCache), so no locks are needed. */
+#define MULTIPLE_THREADS
 #define ACQUIRE_DTOA_LOCK(n)	/*nothing*/
 #define FREE_DTOA_LOCK(n)	/*nothing*/
-#endif
 
 #define Kmax 7
 
@@ -526,7 +531,40 @@ Bigint {
 
  typedef struct Bigint Bigint;
 
- static Bigint *freelist[Kmax+1];
+ /* OpenMM: the cached Bigints for one thread: the free lists used by Balloc() and Bfree(), */
+ /* and the powers of 5 used by pow5mult().  Their memory is released when the thread exits. */
+
+ static void
+Bfree_memory(Bigint *v)
+{
+#ifdef FREE
+	FREE((void*)v);
+#else
+	free((void*)v);
+#endif
+	}
+
+ struct
+DtoaThreadCache {
+	Bigint *freelist[Kmax+1];
+	Bigint *p5s;
+	DtoaThreadCache() : p5s(0) {
+		memset(freelist, 0, sizeof(freelist));
+		}
+	~DtoaThreadCache() {
+		for (int k = 0; k <= Kmax; k++)
+			while (Bigint *v = freelist[k]) {
+				freelist[k] = v->next;
+				Bfree_memory(v);
+				}
+		while (Bigint *v = p5s) {
+			p5s = v->next;
+			Bfree_memory(v);
+			}
+		}
+	};
+
+ static thread_local DtoaThreadCache dtoa_thread_cache;
 
  static Bigint *
 Balloc
@@ -538,13 +576,11 @@ Balloc
 {
 	int x;
 	Bigint *rv;
+	Bigint **freelist = dtoa_thread_cache.freelist;
 #ifndef Omit_Private_Memory
 	unsigned int len;
 #endif
 
-	ACQUIRE_DTOA_LOCK(0);
-	/* The k > Kmax case does not need ACQUIRE_DTOA_LOCK(0), */
-	/* but this case seems very unlikely. */
 	if (k <= Kmax && (rv = freelist[k]))
 		freelist[k] = rv->next;
 	else {
@@ -564,7 +600,6 @@ Balloc
 		rv->k = k;
 		rv->maxwds = x;
 		}
-	FREE_DTOA_LOCK(0);
 	rv->sign = rv->wds = 0;
 	return rv;
 	}
@@ -579,16 +614,11 @@ Bfree
 {
 	if (v) {
 		if (v->k > Kmax)
-#ifdef FREE
-			FREE((void*)v);
-#else
-			free((void*)v);
-#endif
+			Bfree_memory(v);
 		else {
-			ACQUIRE_DTOA_LOCK(0);
+			Bigint **freelist = dtoa_thread_cache.freelist;
 			v->next = freelist[v->k];
 			freelist[v->k] = v;
-			FREE_DTOA_LOCK(0);
 			}
 		}
 	}
@@ -899,8 +929,6 @@ mult
 	return c;
 	}
 
- static Bigint *p5s;
-
  static Bigint *
 pow5mult
 #ifdef KR_headers
@@ -910,6 +938,7 @@ pow5mult
 #endif
 {
 	Bigint *b1, *p5, *p51;
+	Bigint *&p5s = dtoa_thread_cache.p5s;
 	int i;
 	static int p05[3] = { 5, 25, 125 };
 
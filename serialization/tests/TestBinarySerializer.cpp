@@ -0,0 +1,191 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2024 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/HarmonicBondForce.h"
+#include "openmm/NonbondedForce.h"
+#include "openmm/System.h"
+#include "openmm/serialization/BinarySerializer.h"
+#include "openmm/serialization/XmlSerializer.h"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace OpenMM;
+using namespace std;
+
+void testSerializeSystem() {
+    // Create a System.
+
+    System system;
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    NonbondedForce* nonbonded = new NonbondedForce();
+    system.addForce(bonds);
+    system.addForce(nonbonded);
+    nonbonded->setNonbondedMethod(NonbondedForce::PME);
+    nonbonded->setCutoffDistance(0.9);
+    nonbonded->addGlobalParameter("lambda", 0.5);
+    for (int i = 0; i < 100; i++) {
+        system.addParticle(1.0+0.01*i);
+        nonbonded->addParticle(0.1*(i%3-1), 0.3+0.001*i, 0.5/(i+1));
+        if (i > 0) {
+            bonds->addBond(i-1, i, 0.1+0.0001*i, 1000.0/(i+1));
+            nonbonded->addException(i-1, i, 0.0, 1.0, 0.0);
+        }
+    }
+    nonbonded->addParticleParameterOffset("lambda", 5, 0.5, 0.1, 0.0);
+    system.setDefaultPeriodicBoxVectors(Vec3(3, 0, 0), Vec3(0, 3.5, 0), Vec3(0, 0, 4));
+    system.addConstraint(0, 1, 0.1);
+
+    // Serialize it and read it back in, and check that it matches what we get from XML.
+
+    stringstream binary;
+    BinarySerializer::serialize<System>(&system, "System", binary);
+    System* copy = BinarySerializer::deserialize<System>(binary);
+    stringstream xml1, xml2;
+    XmlSerializer::serialize<System>(&system, "System", xml1);
+    XmlSerializer::serialize<System>(copy, "System", xml2);
+    ASSERT_EQUAL(xml1.str(), xml2.str());
+    ASSERT(binary.str().size() < xml1.str().size());
+    ASSERT_EQUAL(system.getNumParticles(), copy->getNumParticles());
+    const NonbondedForce& nonbonded2 = dynamic_cast<const NonbondedForce&>(copy->getForce(1));
+    for (int i = 0; i < system.getNumParticles(); i++) {
+        double charge1, sigma1, epsilon1, charge2, sigma2, epsilon2;
+        nonbonded->getParticleParameters(i, charge1, sigma1, epsilon1);
+        nonbonded2.getParticleParameters(i, charge2, sigma2, epsilon2);
+        ASSERT_EQUAL(charge1, charge2);
+        ASSERT_EQUAL(sigma1, sigma2);
+        ASSERT_EQUAL(epsilon1, epsilon2);
+    }
+    delete copy;
+}
+
+void testDeserializeFile() {
+    System system;
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    system.addForce(bonds);
+    for (int i = 0; i < 10; i++) {
+        system.addParticle(1.0+i);
+        if (i > 0)
+            bonds->addBond(i-1, i, 0.1*i, 100.0*i);
+    }
+    string filename = "TestBinarySerializer.bin";
+    {
+        ofstream stream(filename.c_str(), ios::out | ios::binary);
+        BinarySerializer::serialize<System>(&system, "System", stream);
+    }
+    System* copy = BinarySerializer::deserializeFile<System>(filename);
+    remove(filename.c_str());
+    stringstream xml1, xml2;
+    XmlSerializer::serialize<System>(&system, "System", xml1);
+    XmlSerializer::serialize<System>(copy, "System", xml2);
+    ASSERT_EQUAL(xml1.str(), xml2.str());
+    delete copy;
+}
+
+void testInvalidData() {
+    // Data that does not start with the right header should be rejected.
+
+    stringstream xml;
+    System system;
+    system.addParticle(1.0);
+    XmlSerializer::serialize<System>(&system, "System", xml);
+    bool threwException = false;
+    try {
+        BinarySerializer::deserialize<System>(xml);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+
+    // So should truncated data.
+
+    stringstream binary;
+    BinarySerializer::serialize<System>(&system, "System", binary);
+    string data = binary.str();
+    stringstream truncated(data.substr(0, data.size()-3));
+    threwException = false;
+    try {
+        BinarySerializer::deserialize<System>(truncated);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+
+    // A node that claims to have far more children than the data could hold should be rejected
+    // before any memory is allocated for them.
+
+    const char corruptedNode[] = {1, 1, 6, 'S', 'y', 's', 't', 'e', 'm', 0, 0, '\xff', '\xff', '\xff', '\xff', '\xff', '\xff', '\xff', '\x7f'};
+    stringstream corrupted(data.substr(0, 8)+string(corruptedNode, sizeof(corruptedNode)));
+    threwException = false;
+    try {
+        BinarySerializer::deserialize<System>(corrupted);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+
+    // Nodes nested far too deeply should be rejected instead of overflowing the stack.
+
+    string nested = data.substr(0, 8)+string(corruptedNode, 9);
+    const char nestedNode[] = {0, 0, 1};
+    for (int i = 0; i < 1000000; i++)
+        nested += string(nestedNode, sizeof(nestedNode));
+    nested += string(nestedNode, 2)+string(1, 0);
+    stringstream deep(nested);
+    threwException = false;
+    try {
+        BinarySerializer::deserialize<System>(deep);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
+int main() {
+    try {
+        testSerializeSystem();
+        testDeserializeFile();
+        testInvalidData();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
@@ -36,6 +36,7 @@
 #include "openmm/CustomIntegrator.h"
 #include "openmm/LangevinIntegrator.h"
 #include "openmm/LangevinMiddleIntegrator.h"
+#include "openmm/MTSLangevinIntegrator.h"
 #include "openmm/VariableLangevinIntegrator.h"
 #include "openmm/VariableVerletIntegrator.h"
 #include "openmm/VerletIntegrator.h"
@@ -89,6 +90,25 @@ void testSerializeLangevinMiddleIntegrator() {
     delete intg2;
 }
 
+void testSerializeMTSLangevinIntegrator() {
+    vector<pair<int, int> > groups;
+    groups.push_back(make_pair(0, 4));
+    groups.push_back(make_pair(2, 1));
+    MTSLangevinIntegrator *intg = new MTSLangevinIntegrator(301.5, 2.5, 0.004, groups);
+    intg->setRandomNumberSeed(17);
+    stringstream ss;
+    XmlSerializer::serialize<Integrator>(intg, "MTSLangevinIntegrator", ss);
+    MTSLangevinIntegrator *intg2 = dynamic_cast<MTSLangevinIntegrator*>(XmlSerializer::deserialize<Integrator>(ss));
+    ASSERT_EQUAL(intg->getConstraintTolerance(), intg2->getConstraintTolerance());
+    ASSERT_EQUAL(intg->getStepSize(), intg2->getStepSize());
+    ASSERT_EQUAL(intg->getTemperature(), intg2->getTemperature());
+    ASSERT_EQUAL(intg->getFriction(), intg2->getFriction());
+    ASSERT_EQUAL(intg->getRandomNumberSeed(), intg2->getRandomNumberSeed());
+    ASSERT(intg->getGroups() == intg2->getGroups());
+    delete intg;
+    delete intg2;
+}
+
 void testSerializeBrownianIntegrator() {
     BrownianIntegrator *intg = new BrownianIntegrator(243.1, 3.234, 0.0021);
     stringstream ss;
@@ -260,6 +280,7 @@ int main() {
         testSerializeVariableVerletIntegrator();
         testSerializeLangevinIntegrator();
         testSerializeLangevinMiddleIntegrator();
+        testSerializeMTSLangevinIntegrator();
         testSerializeCompoundIntegrator();
     }
     catch(const exception& e) {
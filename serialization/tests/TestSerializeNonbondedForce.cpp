@@ -57,6 +57,7 @@ void testSerialization() {
     double dalpha = 0.8;
     int dnx = 4, dny = 6, dnz = 7;
     force.setLJPMEParameters(dalpha, dnx, dny, dnz);
+    force.setPMEInterpolationOrder(6);
     force.addParticle(1, 0.1, 0.01);
     force.addParticle(0.5, 0.2, 0.02);
     force.addParticle(-0.5, 0.3, 0.03);
@@ -104,6 +105,7 @@ void testSerialization() {
     ASSERT_EQUAL(dnx, dnx2);
     ASSERT_EQUAL(dny, dny2);
     ASSERT_EQUAL(dnz, dnz2);
+    ASSERT_EQUAL(force.getPMEInterpolationOrder(), force2.getPMEInterpolationOrder());
     for (int i = 0; i < force.getNumGlobalParameters(); i++) {
         ASSERT_EQUAL(force.getGlobalParameterName(i), force2.getGlobalParameterName(i));
         ASSERT_EQUAL(force.getGlobalParameterDefaultValue(i), force2.getGlobalParameterDefaultValue(i));
@@ -38,6 +38,7 @@
 #include "openmm/LangevinIntegrator.h"
 #include "openmm/AndersenThermostat.h"
 #include "openmm/MonteCarloBarostat.h"
+#include "openmm/VerletIntegrator.h"
 #include "openmm/serialization/XmlSerializer.h"
 #include <iostream>
 #include <sstream>
@@ -216,10 +217,39 @@ void testIntegratorParameters() {
     ASSERT_EQUAL_VEC(Vec3(1.0, 2.0, 3.0), values[0], 1e-6);
 }
 
+void testLargeState() {
+    // Large arrays are converted in parallel.  Make sure every value survives exactly.
+
+    const int numParticles = 25000;
+    System system;
+    for (int i = 0; i < numParticles; i++)
+        system.addParticle(1.0);
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, Platform::getPlatformByName("Reference"));
+    vector<Vec3> positions(numParticles), velocities(numParticles);
+    for (int i = 0; i < numParticles; i++) {
+        positions[i] = Vec3(rand()/(double) RAND_MAX, -rand()/(double) RAND_MAX, 1e5*rand()/(double) RAND_MAX);
+        velocities[i] = Vec3(1e-8*rand()/(double) RAND_MAX, i, -1.0/(i+1));
+    }
+    context.setPositions(positions);
+    context.setVelocities(velocities);
+    State s1 = context.getState(State::Positions | State::Velocities);
+    stringstream buffer;
+    XmlSerializer::serialize<State>(&s1, "State", buffer);
+    State* s2 = XmlSerializer::deserialize<State>(buffer);
+    for (int i = 0; i < numParticles; i++)
+        for (int j = 0; j < 3; j++) {
+            ASSERT_EQUAL(s1.getPositions()[i][j], s2->getPositions()[i][j]);
+            ASSERT_EQUAL(s1.getVelocities()[i][j], s2->getVelocities()[i][j]);
+        }
+    delete s2;
+}
+
 int main() {
     try {
         testSerialization();
         testIntegratorParameters();
+        testLargeState();
     }
     catch(const exception& e) {
         cout << "exception: " << e.what() << endl;  
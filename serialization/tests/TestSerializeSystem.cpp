@@ -30,7 +30,11 @@
  * -------------------------------------------------------------------------- */
 
 #include "openmm/internal/AssertionUtilities.h"
+#include "openmm/CustomExternalForce.h"
+#include "openmm/HarmonicAngleForce.h"
 #include "openmm/HarmonicBondForce.h"
+#include "openmm/NonbondedForce.h"
+#include "openmm/OpenMMException.h"
 #include "openmm/System.h"
 #include "openmm/VirtualSite.h"
 #include "openmm/serialization/XmlSerializer.h"
@@ -137,9 +141,81 @@ void testSerialization() {
     delete copy;
 }
 
+void testMultipleForces() {
+    // Forces are decoded while the XML is being read.  Make sure they all come back in the right order
+    // with their contents intact.
+
+    System system;
+    for (int i = 0; i < 4; i++)
+        system.addParticle(1.0);
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    bonds->addBond(0, 1, 0.1, 100.0);
+    bonds->addBond(2, 3, 0.2, 200.0);
+    bonds->setForceGroup(1);
+    system.addForce(bonds);
+    NonbondedForce* nonbonded = new NonbondedForce();
+    for (int i = 0; i < 4; i++)
+        nonbonded->addParticle(0.1*i, 0.3, 0.5);
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffNonPeriodic);
+    system.addForce(nonbonded);
+    HarmonicAngleForce* angles = new HarmonicAngleForce();
+    angles->addAngle(0, 1, 2, 1.5, 50.0);
+    angles->setForceGroup(2);
+    system.addForce(angles);
+    CustomExternalForce* external = new CustomExternalForce("k*x^2");
+    external->addGlobalParameter("k", 3.0);
+    external->addParticle(3);
+    system.addForce(external);
+    stringstream buffer;
+    XmlSerializer::serialize<System>(&system, "System", buffer);
+    string xml = buffer.str();
+    System* copy = XmlSerializer::deserialize<System>(buffer);
+    ASSERT_EQUAL(4, copy->getNumParticles());
+    ASSERT_EQUAL(4, copy->getNumForces());
+    HarmonicBondForce& bonds2 = dynamic_cast<HarmonicBondForce&>(copy->getForce(0));
+    ASSERT_EQUAL(2, bonds2.getNumBonds());
+    ASSERT_EQUAL(1, bonds2.getForceGroup());
+    int p1, p2;
+    double length, k;
+    bonds2.getBondParameters(1, p1, p2, length, k);
+    ASSERT_EQUAL(2, p1);
+    ASSERT_EQUAL(3, p2);
+    ASSERT_EQUAL(0.2, length);
+    ASSERT_EQUAL(200.0, k);
+    NonbondedForce& nonbonded2 = dynamic_cast<NonbondedForce&>(copy->getForce(1));
+    ASSERT_EQUAL(4, nonbonded2.getNumParticles());
+    ASSERT_EQUAL(NonbondedForce::CutoffNonPeriodic, nonbonded2.getNonbondedMethod());
+    HarmonicAngleForce& angles2 = dynamic_cast<HarmonicAngleForce&>(copy->getForce(2));
+    ASSERT_EQUAL(1, angles2.getNumAngles());
+    ASSERT_EQUAL(2, angles2.getForceGroup());
+    CustomExternalForce& external2 = dynamic_cast<CustomExternalForce&>(copy->getForce(3));
+    ASSERT_EQUAL("k*x^2", external2.getEnergyFunction());
+    ASSERT_EQUAL(3.0, external2.getGlobalParameterDefaultValue(0));
+    delete copy;
+
+    // If one Force cannot be decoded, the ones that were already decoded are discarded and the
+    // exception is passed on.
+
+    string target = "type=\"HarmonicAngleForce\"";
+    size_t pos = xml.find(target);
+    ASSERT(pos != string::npos);
+    xml.replace(pos, target.size(), "type=\"NoSuchForce\"");
+    stringstream corrupted(xml);
+    bool threwException = false;
+    try {
+        copy = XmlSerializer::deserialize<System>(corrupted);
+        delete copy;
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
 int main() {
     try {
         testSerialization();
+        testMultipleForces();
     }
     catch(const exception& e) {
         cout << "exception: " << e.what() << endl;
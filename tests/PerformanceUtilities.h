@@ -0,0 +1,154 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2026 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+/**
+ * Utilities shared by the performance regression tests.  A benchmark is timed, and the time is compared
+ * to a baseline read from the file named by the OPENMM_PERFORMANCE_BASELINES environment variable.  Each
+ * non-comment line of that file has the form
+ *
+ *     <platform>/<precision>/<benchmark> <milliseconds per step> <tolerance>
+ *
+ * where the tolerance is the fractional slowdown that is allowed, for example 0.2 to fail if the benchmark
+ * becomes more than 20% slower.  The precision is "default" for platforms that do not have a Precision
+ * property.  Benchmarks without a baseline are timed and reported, but cannot fail.  If the
+ * OPENMM_PERFORMANCE_OUTPUT environment variable is set, a line in the same format is appended to the file
+ * it names for every benchmark, which makes it easy to record new baselines.
+ */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/Context.h"
+#include "openmm/Integrator.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/Platform.h"
+#include "openmm/State.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Load the baselines from the file named by OPENMM_PERFORMANCE_BASELINES.  This maps each
+ * benchmark key to the expected time and the allowed tolerance.
+ */
+static std::map<std::string, std::pair<double, double> > loadPerformanceBaselines() {
+    std::map<std::string, std::pair<double, double> > baselines;
+    const char* filename = getenv("OPENMM_PERFORMANCE_BASELINES");
+    if (filename == NULL)
+        return baselines;
+    std::ifstream file(filename);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.size() == 0 || line[0] == '#')
+            continue;
+        std::stringstream fields(line);
+        std::string key;
+        double time, tolerance;
+        if (fields >> key >> time >> tolerance)
+            baselines[key] = std::make_pair(time, tolerance);
+    }
+    return baselines;
+}
+
+/**
+ * Get the key identifying a benchmark run on a particular platform and precision.
+ */
+static std::string getPerformanceKey(OpenMM::Context& context, const std::string& benchmark) {
+    OpenMM::Platform& platform = context.getPlatform();
+    const std::vector<std::string>& properties = platform.getPropertyNames();
+    std::string precision = "default";
+    if (std::find(properties.begin(), properties.end(), "Precision") != properties.end())
+        precision = platform.getPropertyValue(context, "Precision");
+    return platform.getName()+"/"+precision+"/"+benchmark;
+}
+
+/**
+ * Measure the time taken by a piece of work, and compare it to the baseline.
+ *
+ * @param context      the Context the work is done in.  It is used to identify the platform, and to wait
+ *                     for the work to finish before the clock is stopped.
+ * @param benchmark    the name of the benchmark
+ * @param work         executes the work being timed.  It is called once before timing begins, so that
+ *                     kernels are compiled and buffers allocated, and then several more times.
+ * @param steps        the number of steps performed by each call to work.  The reported time is per step.
+ */
+static void checkPerformance(OpenMM::Context& context, const std::string& benchmark, std::function<void()> work, int steps) {
+    static std::map<std::string, std::pair<double, double> > baselines = loadPerformanceBaselines();
+    const int repetitions = 5;
+    work();
+    context.getState(OpenMM::State::Positions);
+    std::vector<double> times;
+    for (int i = 0; i < repetitions; i++) {
+        auto start = std::chrono::steady_clock::now();
+        work();
+        context.getState(OpenMM::State::Positions);
+        auto end = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double, std::milli>(end-start).count()/steps);
+    }
+
+    // Use the median, since occasional runs can be slowed down by other activity on the computer.
+
+    std::sort(times.begin(), times.end());
+    double time = times[repetitions/2];
+    std::string key = getPerformanceKey(context, benchmark);
+    std::cout << key << ": " << time << " ms/step";
+    const char* output = getenv("OPENMM_PERFORMANCE_OUTPUT");
+    if (output != NULL) {
+        std::ofstream file(output, std::ios::app);
+        file << key << " " << time << " 0.2" << std::endl;
+    }
+    auto baseline = baselines.find(key);
+    if (baseline == baselines.end()) {
+        std::cout << " (no baseline)" << std::endl;
+        return;
+    }
+    double expected = baseline->second.first;
+    double tolerance = baseline->second.second;
+    std::cout << " (baseline " << expected << ")" << std::endl;
+    if (time > expected*(1.0+tolerance)) {
+        std::stringstream details;
+        details << key << " took " << time << " ms/step, which is more than " << (int) (100*tolerance+0.5) << "% slower than the baseline of " << expected << " ms/step";
+        throw OpenMM::OpenMMException(details.str());
+    }
+}
+
+/**
+ * Time a number of integration steps and compare the time to the baseline.
+ */
+static void checkStepPerformance(OpenMM::Context& context, OpenMM::Integrator& integrator, const std::string& benchmark, int steps) {
+    checkPerformance(context, benchmark, [&] () {integrator.step(steps);}, steps);
+}
@@ -209,6 +209,38 @@ void testDifferentStepSizes() {
     }
 }
 
+void testAlternatingStepSizes() {
+    // Switch integrators on every step, so the step size changes each time.
+
+    System system;
+    system.addParticle(2.0);
+    system.addParticle(2.0);
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    bonds->addBond(0, 1, 1.5, 1);
+    system.addForce(bonds);
+    CompoundIntegrator integrator;
+    integrator.addIntegrator(new VerletIntegrator(0.005));
+    integrator.addIntegrator(new VerletIntegrator(0.01));
+    Context context(system, integrator, platform);
+    vector<Vec3> positions(2);
+    positions[0] = Vec3(-1, 0, 0);
+    positions[1] = Vec3(1, 0, 0);
+    context.setPositions(positions);
+    const double freq = 1.0;
+    double expectedTime = 0;
+    for (int i = 0; i < 300; ++i) {
+        State state = context.getState(State::Positions);
+        double time = state.getTime();
+        ASSERT_EQUAL_TOL(expectedTime, time, 1e-5);
+        double expectedDist = 1.5+0.5*std::cos(freq*time);
+        ASSERT_EQUAL_VEC(Vec3(-0.5*expectedDist, 0, 0), state.getPositions()[0], 0.02);
+        ASSERT_EQUAL_VEC(Vec3(0.5*expectedDist, 0, 0), state.getPositions()[1], 0.02);
+        integrator.setCurrentIntegrator(i%2);
+        integrator.step(1);
+        expectedTime += (i%2 == 0 ? 0.005 : 0.01);
+    }
+}
+
 void testCheckpoint() {
     // Test that member integrators get loaded correctly from checkpoints.
     System system;
@@ -276,6 +308,7 @@ int main(int argc, char* argv[]) {
         testChangingIntegrator();
         testChangingParameters();
         testDifferentStepSizes();
+        testAlternatingStepSizes();
         testCheckpoint();
         testSaveParameters();
         runPlatformTests();
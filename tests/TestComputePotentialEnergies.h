@@ -0,0 +1,202 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2026 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/Context.h"
+#include "openmm/CustomExternalForce.h"
+#include "openmm/HarmonicBondForce.h"
+#include "openmm/NonbondedForce.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/System.h"
+#include "openmm/VerletIntegrator.h"
+#include "sfmt/SFMT.h"
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+const double TOL = 1e-5;
+
+void testComputePotentialEnergies() {
+    const int numParticles = 10;
+    const int numConformations = 4;
+    const double boxSize = 3.0;
+    System system;
+    NonbondedForce* nonbonded = new NonbondedForce();
+    system.addForce(nonbonded);
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    system.addForce(bonds);
+    bonds->setForceGroup(2);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle(i%2 == 0 ? 0.1 : -0.1, 0.2, 0.1);
+        if (i > 0)
+            bonds->addBond(i-1, i, 0.15, 1000.0);
+    }
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    vector<Vec3> allPositions;
+    for (int i = 0; i < numParticles*numConformations; i++)
+        allPositions.push_back(Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt)));
+    vector<Vec3> positions(allPositions.begin(), allPositions.begin()+numParticles);
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+
+    // Compare the energies to ones computed one conformation at a time.
+
+    vector<double> energies = context.computePotentialEnergies(allPositions);
+    vector<vector<double> > groupEnergies = context.computePotentialEnergiesByGroup(allPositions);
+    vector<double> bondEnergies = context.computePotentialEnergies(allPositions, 1<<2);
+    ASSERT_EQUAL(numConformations, energies.size());
+    ASSERT_EQUAL(numConformations, groupEnergies.size());
+    for (int i = 0; i < numConformations; i++) {
+        ASSERT_EQUAL(32, groupEnergies[i].size());
+        VerletIntegrator integrator2(0.001);
+        Context context2(system, integrator2, platform);
+        context2.setPositions(vector<Vec3>(allPositions.begin()+i*numParticles, allPositions.begin()+(i+1)*numParticles));
+        double expected = context2.getState(State::Energy).getPotentialEnergy();
+        double expected0 = context2.getState(State::Energy, false, 1<<0).getPotentialEnergy();
+        double expected2 = context2.getState(State::Energy, false, 1<<2).getPotentialEnergy();
+        ASSERT_EQUAL_TOL(expected, energies[i], TOL);
+        ASSERT_EQUAL_TOL(expected2, bondEnergies[i], TOL);
+        ASSERT_EQUAL_TOL(expected0, groupEnergies[i][0], TOL);
+        ASSERT_EQUAL_TOL(expected2, groupEnergies[i][2], TOL);
+        for (int j = 0; j < 32; j++)
+            if (j != 0 && j != 2)
+                ASSERT_EQUAL(0.0, groupEnergies[i][j]);
+    }
+
+    // The positions in the Context should be unchanged.
+
+    State state = context.getState(State::Positions);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(positions[i], state.getPositions()[i], TOL);
+
+    // The number of positions must be a multiple of the number of particles.
+
+    bool threwException = false;
+    try {
+        context.computePotentialEnergies(vector<Vec3>(numParticles+1));
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
+void testComputePotentialEnergiesAtParameters() {
+    const int numParticles = 5;
+    System system;
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    system.addForce(bonds);
+    CustomExternalForce* external1 = new CustomExternalForce("a*x^2+b*y");
+    external1->addGlobalParameter("a", 1.0);
+    external1->addGlobalParameter("b", 2.0);
+    external1->setForceGroup(1);
+    system.addForce(external1);
+    CustomExternalForce* external2 = new CustomExternalForce("c*z");
+    external2->addGlobalParameter("c", 3.0);
+    external2->setForceGroup(2);
+    system.addForce(external2);
+    vector<Vec3> positions;
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        external1->addParticle(i);
+        external2->addParticle(i);
+        if (i > 0)
+            bonds->addBond(i-1, i, 0.15, 1000.0);
+        positions.push_back(Vec3(0.1*i, 0.2*i+0.1, 0.3-0.1*i));
+    }
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    vector<map<string, double> > parameterValues(4);
+    parameterValues[0]["a"] = 0.5;
+    parameterValues[1]["a"] = 2.0;
+    parameterValues[1]["b"] = -1.0;
+    parameterValues[2]["c"] = 0.0;
+    vector<double> energies = context.computePotentialEnergiesAtParameters(parameterValues);
+    vector<double> energies1 = context.computePotentialEnergiesAtParameters(parameterValues, 1<<1);
+    ASSERT_EQUAL(parameterValues.size(), energies.size());
+
+    // The parameters should be unchanged.
+
+    ASSERT_EQUAL(1.0, context.getParameter("a"));
+    ASSERT_EQUAL(2.0, context.getParameter("b"));
+    ASSERT_EQUAL(3.0, context.getParameter("c"));
+
+    // Compare the energies to ones computed by setting the parameters.
+
+    for (int i = 0; i < parameterValues.size(); i++) {
+        for (auto& param : parameterValues[i])
+            context.setParameter(param.first, param.second);
+        ASSERT_EQUAL_TOL(context.getState(State::Energy).getPotentialEnergy(), energies[i], TOL);
+        ASSERT_EQUAL_TOL(context.getState(State::Energy, false, 1<<1).getPotentialEnergy(), energies1[i], TOL);
+        context.setParameter("a", 1.0);
+        context.setParameter("b", 2.0);
+        context.setParameter("c", 3.0);
+    }
+
+    // An invalid parameter name should throw an exception.
+
+    parameterValues[0]["x"] = 1.0;
+    bool threwException = false;
+    try {
+        context.computePotentialEnergiesAtParameters(parameterValues);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
+void runPlatformTests();
+
+int main(int argc, char* argv[]) {
+    try {
+        initializeTests(argc, argv);
+        testComputePotentialEnergies();
+        testComputePotentialEnergiesAtParameters();
+        runPlatformTests();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
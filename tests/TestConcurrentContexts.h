@@ -0,0 +1,133 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2026 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/internal/ThreadPool.h"
+#include "openmm/Context.h"
+#include "openmm/CustomBondForce.h"
+#include "openmm/CustomNonbondedForce.h"
+#include "openmm/HarmonicAngleForce.h"
+#include "openmm/NonbondedForce.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/System.h"
+#include "openmm/VerletIntegrator.h"
+#include "sfmt/SFMT.h"
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+void testConcurrentContextCreation() {
+    // Build a System containing several kinds of forces, including custom forces whose expressions
+    // are parsed while the Context is being created.
+
+    const int numParticles = 60;
+    System system;
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffNonPeriodic);
+    nonbonded->setCutoffDistance(1.5);
+    CustomNonbondedForce* custom = new CustomNonbondedForce("eps*exp(-r/sigma)+sqrt(r)*step(r-0.2); eps=0.5; sigma=0.3");
+    custom->setNonbondedMethod(CustomNonbondedForce::CutoffNonPeriodic);
+    custom->setCutoffDistance(1.5);
+    CustomBondForce* bonds = new CustomBondForce("k*(r-r0)^2+cos(r)");
+    bonds->addPerBondParameter("k");
+    bonds->addPerBondParameter("r0");
+    HarmonicAngleForce* angles = new HarmonicAngleForce();
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    vector<Vec3> positions;
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(10.0);
+        nonbonded->addParticle(i%2 == 0 ? 0.2 : -0.2, 0.3, 0.5);
+        custom->addParticle();
+        positions.push_back(Vec3(genrand_real2(sfmt), genrand_real2(sfmt), genrand_real2(sfmt))*2.0);
+        if (i > 0)
+            bonds->addBond(i-1, i, {100.0, 0.15});
+        if (i > 1)
+            angles->addAngle(i-2, i-1, i, 2.0, 50.0);
+    }
+    system.addForce(nonbonded);
+    system.addForce(custom);
+    system.addForce(bonds);
+    system.addForce(angles);
+
+    // Compute the energy with a single Context for comparison.
+
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    double expectedEnergy = context.getState(State::Energy).getPotentialEnergy();
+
+    // Create Contexts from several threads at once and make sure they all work.
+
+    const int numThreads = 4;
+    const int contextsPerThread = 3;
+    ThreadPool threads(numThreads);
+    vector<double> energy(numThreads*contextsPerThread, 0.0);
+    vector<string> errors(numThreads);
+    threads.execute([&] (ThreadPool& pool, int threadIndex) {
+        try {
+            for (int i = 0; i < contextsPerThread; i++) {
+                VerletIntegrator threadIntegrator(0.001);
+                Context threadContext(system, threadIntegrator, platform);
+                threadContext.setPositions(positions);
+                energy[threadIndex*contextsPerThread+i] = threadContext.getState(State::Energy).getPotentialEnergy();
+            }
+        }
+        catch (const exception& e) {
+            errors[threadIndex] = e.what();
+        }
+    });
+    threads.waitForThreads();
+    for (auto& error : errors)
+        if (error.size() > 0)
+            throw OpenMMException(error);
+    for (double e : energy)
+        ASSERT_EQUAL_TOL(expectedEnergy, e, 1e-5);
+}
+
+void runPlatformTests();
+
+int main(int argc, char* argv[]) {
+    try {
+        initializeTests(argc, argv);
+        testConcurrentContextCreation();
+        runPlatformTests();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
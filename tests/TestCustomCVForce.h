@@ -233,6 +233,75 @@ void testReordering() {
     ASSERT_EQUAL_VEC(-delta*2/r, state.getForces()[5], 1e-5);
     ASSERT_EQUAL_VEC(delta*2/r, state.getForces()[10], 1e-5);
 }
+void testWithoutInnerContext() {
+    // Create a System with a CustomCVForce whose energy is a nonlinear function of its
+    // variables, plus an unrelated force in another group.
+
+    System system;
+    for (int i = 0; i < 4; i++)
+        system.addParticle(1.0);
+    CustomBondForce* other = new CustomBondForce("0.5*r^2");
+    other->addBond(2, 3);
+    system.addForce(other);
+    CustomCVForce* cv = new CustomCVForce("v1*v2+g1*v1");
+    cv->setForceGroup(1);
+    cv->addGlobalParameter("g1", 1.5);
+    cv->addEnergyParameterDerivative("g1");
+    system.addForce(cv);
+    CustomBondForce* v1 = new CustomBondForce("r*g2");
+    v1->addGlobalParameter("g2", 2.0);
+    v1->addEnergyParameterDerivative("g2");
+    v1->addBond(0, 1);
+    cv->addCollectiveVariable("v1", v1);
+    CustomExternalForce* v2 = new CustomExternalForce("x+y^2");
+    v2->addParticle(0);
+    v2->addParticle(2);
+    cv->addCollectiveVariable("v2", v2);
+    vector<Vec3> positions(4);
+    positions[0] = Vec3(0.1, 0.2, 0.3);
+    positions[1] = Vec3(1.5, -0.5, 0.2);
+    positions[2] = Vec3(-0.4, 0.8, 1.0);
+    positions[3] = Vec3(0.3, 1.1, -0.6);
+
+    // Evaluate it with and without an inner context, and make sure the results agree.
+
+    VerletIntegrator integrator1(1.0);
+    Context context1(system, integrator1, platform);
+    context1.setPositions(positions);
+    State state1 = context1.getState(State::Energy | State::Forces | State::ParameterDerivatives);
+    vector<double> values1;
+    cv->getCollectiveVariableValues(context1, values1);
+    cv->setUseInnerContext(false);
+    VerletIntegrator integrator2(1.0);
+    Context context2(system, integrator2, platform);
+    context2.setPositions(positions);
+    State state2 = context2.getState(State::Energy | State::Forces | State::ParameterDerivatives);
+    vector<double> values2;
+    cv->getCollectiveVariableValues(context2, values2);
+    ASSERT_EQUAL_TOL(state1.getPotentialEnergy(), state2.getPotentialEnergy(), 1e-5);
+    for (int i = 0; i < 4; i++)
+        ASSERT_EQUAL_VEC(state1.getForces()[i], state2.getForces()[i], 1e-5);
+    for (int i = 0; i < 2; i++)
+        ASSERT_EQUAL_TOL(values1[i], values2[i], 1e-5);
+    map<string, double> derivs1 = state1.getEnergyParameterDerivatives();
+    map<string, double> derivs2 = state2.getEnergyParameterDerivatives();
+    ASSERT_EQUAL_TOL(derivs1["g1"], derivs2["g1"], 1e-5);
+    ASSERT_EQUAL_TOL(derivs1["g2"], derivs2["g2"], 1e-5);
+
+    // Force groups should only include the CustomCVForce when its own group is requested.
+
+    ASSERT_EQUAL_TOL(context1.getState(State::Energy, false, 1<<1).getPotentialEnergy(), context2.getState(State::Energy, false, 1<<1).getPotentialEnergy(), 1e-5);
+    ASSERT_EQUAL_TOL(context1.getState(State::Energy, false, 1<<0).getPotentialEnergy(), context2.getState(State::Energy, false, 1<<0).getPotentialEnergy(), 1e-5);
+    ASSERT_EQUAL_TOL(0.0, context2.getState(State::Energy, false, ~3).getPotentialEnergy(), 1e-5);
+    bool threwException = false;
+    try {
+        cv->getInnerContext(context2);
+    }
+    catch (OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
 
 void runPlatformTests();
 
@@ -243,6 +312,7 @@ int main(int argc, char* argv[]) {
         testEnergyParameterDerivatives();
         testTabulatedFunction();
         testReordering();
+        testWithoutInnerContext();
         runPlatformTests();
     }
     catch(const exception& e) {
@@ -130,6 +130,19 @@ void testParameters() {
     ASSERT_EQUAL_VEC(Vec3(-force, 0, 0), forces[0], TOL);
     ASSERT_EQUAL_VEC(Vec3(force, 0, 0), forces[1], TOL);
     ASSERT_EQUAL_TOL(1.5*1.6*1.9*(11.8*11.8*11.8), state.getPotentialEnergy(), TOL);
+    
+    // Change a single particle and update only that one.
+    
+    params[0] = 2.0;
+    params[1] = 3.0;
+    forceField->setParticleParameters(1, params);
+    forceField->updateParametersInContext(context, 1, 1);
+    state = context.getState(State::Forces | State::Energy);
+    forces = state.getForces();
+    force = -1.5*1.6*2.0*3*6.1*(12.2*12.2);
+    ASSERT_EQUAL_VEC(Vec3(-force, 0, 0), forces[0], TOL);
+    ASSERT_EQUAL_VEC(Vec3(force, 0, 0), forces[1], TOL);
+    ASSERT_EQUAL_TOL(1.5*1.6*2.0*(12.2*12.2*12.2), state.getPotentialEnergy(), TOL);
 }
 
 void testManyParameters() {
@@ -903,6 +916,42 @@ void testLongRangeCorrection() {
     ASSERT_EQUAL_TOL(standardEnergy1-standardEnergy2, customEnergy1-customEnergy2, 1e-4);
 }
 
+void testLongRangeCorrectionWithGlobalParameter() {
+    // The energy, including the long range correction, is proportional to a global parameter.  Make sure
+    // the correction is updated when it changes, including when it returns to a previous value.
+
+    int numParticles = 60;
+    double boxSize = 3.0;
+    System system;
+    CustomNonbondedForce* nonbonded = new CustomNonbondedForce("scale*4*eps*((sigma/r)^12-(sigma/r)^6); sigma=0.5*(sigma1+sigma2); eps=sqrt(eps1*eps2)");
+    nonbonded->addPerParticleParameter("sigma");
+    nonbonded->addPerParticleParameter("eps");
+    nonbonded->addGlobalParameter("scale", 1.0);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    vector<Vec3> positions(numParticles);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle({0.2+0.02*(i%5), 0.5+0.1*(i%3)});
+        positions[i] = Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+    }
+    nonbonded->setNonbondedMethod(CustomNonbondedForce::CutoffPeriodic);
+    nonbonded->setCutoffDistance(1.0);
+    nonbonded->setUseLongRangeCorrection(true);
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    system.addForce(nonbonded);
+    VerletIntegrator integrator(0.01);
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    double energy1 = context.getState(State::Energy).getPotentialEnergy();
+    context.setParameter("scale", 2.0);
+    double energy2 = context.getState(State::Energy).getPotentialEnergy();
+    context.setParameter("scale", 1.0);
+    double energy3 = context.getState(State::Energy).getPotentialEnergy();
+    ASSERT_EQUAL_TOL(2*energy1, energy2, 1e-5);
+    ASSERT_EQUAL_TOL(energy1, energy3, 1e-5);
+}
+
 void testInteractionGroups() {
     const int numParticles = 6;
     System system;
@@ -939,6 +988,40 @@ void testInteractionGroups() {
     ASSERT_EQUAL_TOL(expectedEnergy, state.getPotentialEnergy(), TOL);
 }
 
+void testInteractionGroupWithAllParticles() {
+    // A single interaction group containing every particle should give the same result as no groups.
+
+    const int numParticles = 50;
+    System system;
+    CustomNonbondedForce* nonbonded = new CustomNonbondedForce("a1*a2/r");
+    nonbonded->addPerParticleParameter("a");
+    set<int> allParticles;
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    vector<Vec3> positions(numParticles);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle({genrand_real2(sfmt)});
+        allParticles.insert(i);
+        positions[i] = Vec3(2*genrand_real2(sfmt), 2*genrand_real2(sfmt), 2*genrand_real2(sfmt));
+    }
+    for (int i = 1; i < numParticles; i += 2)
+        nonbonded->addExclusion(i-1, i);
+    system.addForce(nonbonded);
+    VerletIntegrator integrator1(0.01);
+    Context context1(system, integrator1, platform);
+    context1.setPositions(positions);
+    State state1 = context1.getState(State::Forces | State::Energy);
+    nonbonded->addInteractionGroup(allParticles, allParticles);
+    VerletIntegrator integrator2(0.01);
+    Context context2(system, integrator2, platform);
+    context2.setPositions(positions);
+    State state2 = context2.getState(State::Forces | State::Energy);
+    ASSERT_EQUAL_TOL(state1.getPotentialEnergy(), state2.getPotentialEnergy(), 1e-5);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(state1.getForces()[i], state2.getForces()[i], 1e-5);
+}
+
 void testLargeInteractionGroup() {
     const int numMolecules = 300;
     const int numParticles = numMolecules*2;
@@ -1453,7 +1536,9 @@ int main(int argc, char* argv[]) {
         testCoulombLennardJones();
         testSwitchingFunction();
         testLongRangeCorrection();
+        testLongRangeCorrectionWithGlobalParameter();
         testInteractionGroups();
+        testInteractionGroupWithAllParticles();
         testLargeInteractionGroup();
         testInteractionGroupLongRangeCorrection();
         testInteractionGroupTabulatedFunction();
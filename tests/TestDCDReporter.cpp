@@ -0,0 +1,180 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2008-2020 Stanford University and the Authors.      *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/Context.h"
+#include "openmm/DCDReporter.h"
+#include "openmm/HarmonicBondForce.h"
+#include "openmm/Platform.h"
+#include "openmm/VerletIntegrator.h"
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+template <class T>
+T readValue(FILE* file, long offset) {
+    T value;
+    fseek(file, offset, SEEK_SET);
+    ASSERT(fread(&value, sizeof(T), 1, file) == 1);
+    return value;
+}
+
+void testWriteFrames() {
+    const int numParticles = 10;
+    const int interval = 3;
+    const int numSteps = 20;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(3, 0, 0), Vec3(0, 4, 0), Vec3(0, 0, 5));
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    bonds->setUsesPeriodicBoundaryConditions(true);
+    vector<Vec3> positions(numParticles);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        positions[i] = Vec3(0.3*i, 0.1*(i%3), 0.2*(i%2));
+        if (i > 0)
+            bonds->addBond(i-1, i, 0.3, 100.0);
+    }
+    system.addForce(bonds);
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, Platform::getPlatformByName("Reference"));
+    context.setPositions(positions);
+    string filename = "TestDCDReporter.dcd";
+    {
+        DCDReporter reporter(filename, context, interval);
+        ASSERT_EQUAL(interval, reporter.getReportInterval());
+        reporter.step(numSteps);
+        reporter.flush();
+        ASSERT_EQUAL(numSteps/interval, reporter.getNumFrames());
+    }
+    State state = context.getState(State::Positions);
+
+    // Check the header.
+
+    const int numFrames = numSteps/interval;
+    FILE* file = fopen(filename.c_str(), "rb");
+    ASSERT(file != NULL);
+    ASSERT_EQUAL(84, readValue<int>(file, 0));
+    char magic[4];
+    ASSERT(fread(magic, 1, 4, file) == 4);
+    ASSERT(magic[0] == 'C' && magic[1] == 'O' && magic[2] == 'R' && magic[3] == 'D');
+    ASSERT_EQUAL(numFrames, readValue<int>(file, 8));
+    ASSERT_EQUAL(interval, readValue<int>(file, 16));
+    ASSERT_EQUAL(numFrames*interval, readValue<int>(file, 20));
+    ASSERT_EQUAL(1, readValue<int>(file, 48));
+    ASSERT_EQUAL(numParticles, readValue<int>(file, 268));
+
+    // Check the size of the file and the contents of the last frame.  The reporter
+    // stops at the last multiple of the interval, so a few steps came after it.
+
+    const long headerSize = 276;
+    const long frameSize = 56+3*(8+4*numParticles);
+    fseek(file, 0, SEEK_END);
+    ASSERT_EQUAL(headerSize+numFrames*frameSize, ftell(file));
+    long lastFrame = headerSize+(numFrames-1)*frameSize;
+    ASSERT_EQUAL(48, readValue<int>(file, lastFrame));
+    ASSERT_EQUAL_TOL(30.0, readValue<double>(file, lastFrame+4), 1e-6);
+    ASSERT_EQUAL_TOL(0.0, readValue<double>(file, lastFrame+12), 1e-6);
+    ASSERT_EQUAL_TOL(40.0, readValue<double>(file, lastFrame+20), 1e-6);
+    ASSERT_EQUAL_TOL(50.0, readValue<double>(file, lastFrame+44), 1e-6);
+    ASSERT_EQUAL(4*numParticles, readValue<int>(file, lastFrame+56));
+    fclose(file);
+    remove(filename.c_str());
+}
+
+void testFinalPositions() {
+    // When the number of steps is a multiple of the interval, the last frame should
+    // match the final positions of the Context.
+
+    const int numParticles = 5;
+    System system;
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    vector<Vec3> positions(numParticles);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        positions[i] = Vec3(0.32*i, 0.05*i, -0.1*i);
+        if (i > 0)
+            bonds->addBond(i-1, i, 0.3, 100.0);
+    }
+    system.addForce(bonds);
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, Platform::getPlatformByName("Reference"));
+    context.setPositions(positions);
+    string filename = "TestDCDReporterFinal.dcd";
+    {
+        DCDReporter reporter(filename, context, 5);
+        reporter.step(20);
+    }
+    State state = context.getState(State::Positions);
+    FILE* file = fopen(filename.c_str(), "rb");
+    ASSERT(file != NULL);
+    ASSERT_EQUAL(4, readValue<int>(file, 8));
+    ASSERT_EQUAL(0, readValue<int>(file, 48));
+    const long frameSize = 3*(8+4*numParticles);
+    long lastFrame = 276+3*frameSize;
+    for (int axis = 0; axis < 3; axis++)
+        for (int i = 0; i < numParticles; i++)
+            ASSERT_EQUAL_TOL(10*state.getPositions()[i][axis], readValue<float>(file, lastFrame+axis*(8+4*numParticles)+4+4*i), 1e-5);
+    fclose(file);
+    remove(filename.c_str());
+}
+
+void testInvalidInterval() {
+    System system;
+    system.addParticle(1.0);
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, Platform::getPlatformByName("Reference"));
+    bool threwException = false;
+    try {
+        DCDReporter reporter("TestDCDReporterInvalid.dcd", context, 0);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        testWriteFrames();
+        testFinalPositions();
+        testInvalidInterval();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
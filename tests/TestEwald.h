@@ -33,6 +33,7 @@
 #include "openmm/Context.h"
 #include "ReferencePlatform.h"
 #include "openmm/NonbondedForce.h"
+#include "openmm/HarmonicBondForce.h"
 #include "openmm/System.h"
 #include "openmm/LangevinIntegrator.h"
 #include "openmm/VerletIntegrator.h"
@@ -425,6 +426,106 @@ void testPMEParameters() {
     ASSERT(fabs((energy1-energy2)/energy1) > 1e-5);
 }
 
+void testPMEInterpolationOrder() {
+    // Create a cloud of random point charges.
+
+    const int numParticles = 51;
+    const double boxWidth = 4.7;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxWidth, 0, 0), Vec3(0, boxWidth, 0), Vec3(0, 0, boxWidth));
+    NonbondedForce* force = new NonbondedForce();
+    system.addForce(force);
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        force->addParticle(-1.0+i*2.0/(numParticles-1), 1.0, 0.0);
+        positions[i] = Vec3(boxWidth*genrand_real2(sfmt), boxWidth*genrand_real2(sfmt), boxWidth*genrand_real2(sfmt));
+    }
+    force->setNonbondedMethod(NonbondedForce::PME);
+
+    // Compute reference forces with a tight error tolerance.
+
+    force->setEwaldErrorTolerance(1e-6);
+    vector<Vec3> refForces;
+    {
+        VerletIntegrator integrator(0.01);
+        Context context(system, integrator, platform);
+        context.setPositions(positions);
+        refForces = context.getState(State::Forces).getForces();
+    }
+    double norm = 0.0;
+    for (int i = 0; i < numParticles; i++)
+        norm += refForces[i].dot(refForces[i]);
+    norm = sqrt(norm);
+
+    // Every interpolation order should reach the requested accuracy, and lower orders
+    // should use finer grids.
+
+    const double tol = 5e-4;
+    force->setEwaldErrorTolerance(tol);
+    int lastSize = 0;
+    for (int order = 6; order >= 4; order--) {
+        force->setPMEInterpolationOrder(order);
+        VerletIntegrator integrator(0.01);
+        Context context(system, integrator, platform);
+        context.setPositions(positions);
+        State state = context.getState(State::Forces);
+        double diff = 0.0;
+        for (int i = 0; i < numParticles; i++) {
+            Vec3 delta = refForces[i]-state.getForces()[i];
+            diff += delta.dot(delta);
+        }
+        diff = sqrt(diff)/norm;
+        ASSERT(diff < 2*tol);
+        double alpha;
+        int size[3];
+        NonbondedForceImpl::calcPMEParameters(system, *force, alpha, size[0], size[1], size[2], false);
+        ASSERT(size[0] > lastSize);
+        lastSize = size[0];
+    }
+}
+
+void testComputePotentialEnergy(NonbondedForce::NonbondedMethod method) {
+    // Create a cloud of random point charges, with a bond in a separate force group.
+
+    const int numParticles = 51;
+    const double boxWidth = 4.7;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxWidth, 0, 0), Vec3(0, boxWidth, 0), Vec3(0, 0, boxWidth));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    system.addForce(nonbonded);
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    bonds->setForceGroup(1);
+    system.addForce(bonds);
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle(-1.0+i*2.0/(numParticles-1), 0.2, 0.1);
+        positions[i] = Vec3(boxWidth*genrand_real2(sfmt), boxWidth*genrand_real2(sfmt), boxWidth*genrand_real2(sfmt));
+    }
+    bonds->addBond(0, 1, 0.5, 100.0);
+    nonbonded->addException(0, 1, 0.0, 1.0, 0.0);
+    nonbonded->setNonbondedMethod(method);
+    VerletIntegrator integrator(0.01);
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+
+    // The energy-only calculation should match getState(), and should not change the forces.
+
+    State state = context.getState(State::Energy | State::Forces);
+    ASSERT_EQUAL_TOL(state.getPotentialEnergy(), context.computePotentialEnergy(), 1e-5);
+    ASSERT_EQUAL_TOL(context.getState(State::Energy, false, 1).getPotentialEnergy(), context.computePotentialEnergy(1), 1e-5);
+    ASSERT_EQUAL_TOL(context.getState(State::Energy, false, 2).getPotentialEnergy(), context.computePotentialEnergy(2), 1e-5);
+    State state2 = context.getState(State::Forces);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(state.getForces()[i], state2.getForces()[i], 1e-5);
+}
+
 void runPlatformTests();
 
 int main(int argc, char* argv[]) {
@@ -438,6 +539,10 @@ int main(int argc, char* argv[]) {
         testErrorTolerance(NonbondedForce::Ewald);
         testErrorTolerance(NonbondedForce::PME);
         testPMEParameters();
+        testPMEInterpolationOrder();
+        testComputePotentialEnergy(NonbondedForce::Ewald);
+        testComputePotentialEnergy(NonbondedForce::PME);
+        testComputePotentialEnergy(NonbondedForce::LJPME);
         runPlatformTests();
     }
     catch(const exception& e) {
@@ -68,9 +68,33 @@ void testFindMolecules() {
     }
 }
 
+void testInterleavedMolecules() {
+    // Particles alternate between two molecules, and the bonds are listed in an arbitrary order.
+
+    const int numParticles = 20;
+    vector<pair<int, int> > bonds;
+    for (int i = numParticles-1; i >= 2; i--)
+        bonds.push_back(make_pair(i, i-2));
+    bonds.push_back(make_pair(5, 5));
+    vector<vector<int> > particleBonds(numParticles);
+    for (auto& bond : bonds) {
+        particleBonds[bond.first].push_back(bond.second);
+        particleBonds[bond.second].push_back(bond.first);
+    }
+    vector<vector<int> > molecules = ContextImpl::findMolecules(numParticles, bonds);
+    ASSERT_EQUAL(2, molecules.size());
+    for (int i = 0; i < 2; i++) {
+        ASSERT_EQUAL(numParticles/2, molecules[i].size());
+        for (int j = 0; j < numParticles/2; j++)
+            ASSERT_EQUAL(2*j+i, molecules[i][j]);
+    }
+    ASSERT(molecules == ContextImpl::findMolecules(numParticles, particleBonds));
+}
+
 int main() {
     try {
         testFindMolecules();
+        testInterleavedMolecules();
     }
     catch(const exception& e) {
         cout << "exception: " << e.what() << endl;
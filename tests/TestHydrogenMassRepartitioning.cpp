@@ -0,0 +1,165 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2020      Stanford University and the Authors.      *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/HarmonicAngleForce.h"
+#include "openmm/HarmonicBondForce.h"
+#include "openmm/HydrogenMassRepartitioning.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/System.h"
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+using namespace OpenMM;
+using namespace std;
+
+/**
+ * Create a System with a CH2 group whose C-H bonds are constrained, bonded to an unconstrained O-H.
+ */
+System* createSystem() {
+    System* system = new System();
+    system->addParticle(12.0); // C
+    system->addParticle(1.0);  // H
+    system->addParticle(1.0);  // H
+    system->addParticle(16.0); // O
+    system->addParticle(1.0);  // H
+    system->addConstraint(0, 1, 0.11);
+    system->addConstraint(0, 2, 0.11);
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    bonds->addBond(0, 3, 0.14, 250000.0);
+    bonds->addBond(3, 4, 0.1, 400000.0);
+    system->addForce(bonds);
+    HarmonicAngleForce* angles = new HarmonicAngleForce();
+    angles->addAngle(1, 0, 2, 1.9, 300.0);
+    angles->addAngle(0, 3, 4, 1.9, 400.0);
+    system->addForce(angles);
+    return system;
+}
+
+void testRepartitionMass() {
+    System* system = createSystem();
+    ASSERT_EQUAL(3, HydrogenMassRepartitioning::repartitionHydrogenMass(*system, 3.0));
+    ASSERT_EQUAL_TOL(8.0, system->getParticleMass(0), 1e-10);
+    ASSERT_EQUAL_TOL(3.0, system->getParticleMass(1), 1e-10);
+    ASSERT_EQUAL_TOL(3.0, system->getParticleMass(2), 1e-10);
+    ASSERT_EQUAL_TOL(14.0, system->getParticleMass(3), 1e-10);
+    ASSERT_EQUAL_TOL(3.0, system->getParticleMass(4), 1e-10);
+
+    // The hydrogens are no longer recognized, so doing it again should have no effect.
+
+    ASSERT_EQUAL(0, HydrogenMassRepartitioning::repartitionHydrogenMass(*system, 3.0));
+    ASSERT_EQUAL_TOL(8.0, system->getParticleMass(0), 1e-10);
+    delete system;
+
+    // Taking too much mass from the heavy atom should throw an exception.
+
+    system = createSystem();
+    bool threwException = false;
+    try {
+        HydrogenMassRepartitioning::repartitionHydrogenMass(*system, 7.0);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+    ASSERT_EQUAL_TOL(12.0, system->getParticleMass(0), 1e-10);
+    delete system;
+}
+
+void testConstrainAngles() {
+    // Only the H-C-H angle has constrained bonds to hydrogen on both sides.
+
+    System* system = createSystem();
+    ASSERT_EQUAL(1, HydrogenMassRepartitioning::constrainHydrogenAngles(*system));
+    ASSERT_EQUAL(3, system->getNumConstraints());
+    int p1, p2;
+    double distance;
+    system->getConstraintParameters(2, p1, p2, distance);
+    ASSERT_EQUAL(1, p1);
+    ASSERT_EQUAL(2, p2);
+    ASSERT_EQUAL_TOL(2*0.11*sin(0.95), distance, 1e-10);
+
+    // Calling it again should not add a duplicate.
+
+    ASSERT_EQUAL(0, HydrogenMassRepartitioning::constrainHydrogenAngles(*system));
+    ASSERT_EQUAL(3, system->getNumConstraints());
+    delete system;
+}
+
+void testMaxStepSize() {
+    // A single bond.
+
+    System system;
+    system.addParticle(12.0);
+    system.addParticle(16.0);
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    bonds->addBond(0, 1, 0.12, 500000.0);
+    system.addForce(bonds);
+    double frequency = sqrt(500000.0*(1/12.0+1/16.0));
+    ASSERT_EQUAL_TOL(2*M_PI/frequency/5, HydrogenMassRepartitioning::findMaxStepSize(system), 1e-10);
+    ASSERT_EQUAL_TOL(2*M_PI/frequency/10, HydrogenMassRepartitioning::findMaxStepSize(system, 10.0), 1e-10);
+
+    // Constraining it leaves nothing to limit the step size.
+
+    system.addConstraint(0, 1, 0.12);
+    ASSERT(HydrogenMassRepartitioning::findMaxStepSize(system) == numeric_limits<double>::infinity());
+
+    // In the full test system the O-H stretch is fastest.  Repartitioning slows it down, and
+    // constraining the remaining bonds to hydrogen leaves the C-O stretch as the limit.
+
+    System* full = createSystem();
+    double original = HydrogenMassRepartitioning::findMaxStepSize(*full);
+    ASSERT_EQUAL_TOL(2*M_PI/sqrt(400000.0*(1/16.0+1/1.0))/5, original, 1e-10);
+    HydrogenMassRepartitioning::repartitionHydrogenMass(*full, 3.0);
+    double repartitioned = HydrogenMassRepartitioning::findMaxStepSize(*full);
+    ASSERT_EQUAL_TOL(2*M_PI/sqrt(400000.0*(1/14.0+1/3.0))/5, repartitioned, 1e-10);
+    ASSERT(repartitioned > original);
+    full->addConstraint(3, 4, 0.1);
+    double constrained = HydrogenMassRepartitioning::findMaxStepSize(*full);
+    ASSERT_EQUAL_TOL(2*M_PI/sqrt(250000.0*(1/8.0+1/14.0))/5, constrained, 1e-10);
+    delete full;
+}
+
+int main() {
+    try {
+        testRepartitionMass();
+        testConstrainAngles();
+        testMaxStepSize();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
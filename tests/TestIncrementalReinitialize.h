@@ -0,0 +1,115 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2026 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/Context.h"
+#include "openmm/HarmonicBondForce.h"
+#include "openmm/NonbondedForce.h"
+#include "openmm/System.h"
+#include "openmm/VerletIntegrator.h"
+#include <iostream>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+const double TOL = 1e-5;
+
+void testIncrementalReinitialize() {
+    const int numParticles = 6;
+    System system;
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    system.addForce(bonds);
+    NonbondedForce* nonbonded = new NonbondedForce();
+    system.addForce(nonbonded);
+    vector<Vec3> positions;
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle(i%2 == 0 ? 0.5 : -0.5, 0.2, 0.5);
+        if (i > 0)
+            bonds->addBond(i-1, i, 0.15, 1000.0);
+        positions.push_back(Vec3(0.3*i, 0.2*(i%3), 0.1*(i%2)));
+    }
+    nonbonded->addException(0, 1, 0.1, 0.2, 0.3);
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    context.setTime(2.5);
+    context.reinitialize(true);
+
+    // Change only parameters that updateParametersInContext() can handle.  The result should match
+    // a newly created Context, and the state should be preserved.
+
+    for (int iteration = 0; iteration < 3; iteration++) {
+        double scale = 1.0+0.5*iteration;
+        nonbonded->setParticleParameters(2, 0.3*scale, 0.25, 0.4);
+        nonbonded->setExceptionParameters(0, 0, 1, 0.2*scale, 0.2, 0.1);
+        bonds->setBondParameters(3, 3, 4, 0.12, 500.0*scale);
+        context.reinitialize(true);
+        ASSERT_EQUAL(2.5, context.getState(0).getTime());
+        VerletIntegrator integrator2(0.001);
+        Context context2(system, integrator2, platform);
+        context2.setPositions(positions);
+        State state1 = context.getState(State::Energy | State::Forces);
+        State state2 = context2.getState(State::Energy | State::Forces);
+        ASSERT_EQUAL_TOL(state2.getPotentialEnergy(), state1.getPotentialEnergy(), TOL);
+        for (int i = 0; i < numParticles; i++)
+            ASSERT_EQUAL_VEC(state2.getForces()[i], state1.getForces()[i], TOL);
+    }
+
+    // Make changes that require a full reinitialization.
+
+    bonds->setBondParameters(3, 2, 4, 0.12, 500.0);
+    nonbonded->addException(2, 3, 0.0, 1.0, 0.0);
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffNonPeriodic);
+    context.reinitialize(true);
+    ASSERT_EQUAL(2.5, context.getState(0).getTime());
+    VerletIntegrator integrator2(0.001);
+    Context context2(system, integrator2, platform);
+    context2.setPositions(positions);
+    ASSERT_EQUAL_TOL(context2.getState(State::Energy).getPotentialEnergy(), context.getState(State::Energy).getPotentialEnergy(), TOL);
+}
+
+void runPlatformTests();
+
+int main(int argc, char* argv[]) {
+    try {
+        initializeTests(argc, argv);
+        testIncrementalReinitialize();
+        runPlatformTests();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
@@ -315,6 +315,55 @@ void testForceGroups() {
     ASSERT(pos[2] == 0);
 }
 
+void testReuseForcesAfterGetState() {
+    // Querying the energy computes forces that the next step can reuse.  Make sure this gives the
+    // same trajectory, and that the forces are recomputed when something changes in between.
+
+    System system;
+    system.addParticle(1.0);
+    system.addParticle(1.0);
+    CustomExternalForce* force = new CustomExternalForce("k*(x^2+y^2+z^2)");
+    force->addGlobalParameter("k", 1.0);
+    force->addParticle(0);
+    force->addParticle(1);
+    system.addForce(force);
+    vector<Vec3> positions = {Vec3(1, 0, 0), Vec3(0, 1, 0)};
+    vector<Vec3> positions2 = {Vec3(0, 0, 2), Vec3(-1, 0, 0)};
+    LangevinMiddleIntegrator integrator1(0.0, 1.0, 0.01);
+    LangevinMiddleIntegrator integrator2(0.0, 1.0, 0.01);
+    Context context1(system, integrator1, platform);
+    Context context2(system, integrator2, platform);
+    context1.setPositions(positions);
+    context2.setPositions(positions);
+    for (int i = 0; i < 10; i++) {
+        context1.getState(State::Energy);
+        integrator1.step(1);
+    }
+    integrator2.step(10);
+    for (int i = 0; i < 2; i++)
+        ASSERT_EQUAL_VEC(context2.getState(State::Positions).getPositions()[i], context1.getState(State::Positions).getPositions()[i], TOL);
+
+    // Change the positions after computing the energy.
+
+    context1.getState(State::Energy);
+    context1.setPositions(positions2);
+    context2.setPositions(positions2);
+    integrator1.step(1);
+    integrator2.step(1);
+    for (int i = 0; i < 2; i++)
+        ASSERT_EQUAL_VEC(context2.getState(State::Positions).getPositions()[i], context1.getState(State::Positions).getPositions()[i], TOL);
+
+    // Change a parameter after computing the energy.
+
+    context1.getState(State::Energy);
+    context1.setParameter("k", 3.0);
+    context2.setParameter("k", 3.0);
+    integrator1.step(1);
+    integrator2.step(1);
+    for (int i = 0; i < 2; i++)
+        ASSERT_EQUAL_VEC(context2.getState(State::Positions).getPositions()[i], context1.getState(State::Positions).getPositions()[i], TOL);
+}
+
 void runPlatformTests();
 
 int main(int argc, char* argv[]) {
@@ -327,6 +376,7 @@ int main(int argc, char* argv[]) {
         testRandomSeed();
         testInitialTemperature();
         testForceGroups();
+        testReuseForcesAfterGetState();
         runPlatformTests();
     }
     catch(const exception& e) {
@@ -32,6 +32,7 @@
 
 #include "openmm/internal/AssertionUtilities.h"
 #include "openmm/Context.h"
+#include "openmm/CustomExternalForce.h"
 #include "openmm/HarmonicBondForce.h"
 #include "openmm/LocalEnergyMinimizer.h"
 #include "openmm/NonbondedForce.h"
@@ -259,6 +260,36 @@ void testForceGroups() {
     ASSERT_EQUAL_TOL(2.0, sqrt(delta.dot(delta)), 1e-4);
 }
 
+void testStepAfterMinimize() {
+    // The energy has a barrier the minimizer cannot see in the forces, so the line search fails
+    // while trying to cross it.  The step that follows must compute forces for the positions the
+    // minimizer ended at, not for the last trial positions it evaluated.
+
+    System system;
+    system.addParticle(1.0);
+    system.addParticle(1.0);
+    CustomExternalForce* force = new CustomExternalForce("x^2+y^2+z^2-10*step(x-0.5)");
+    force->addParticle(0);
+    force->addParticle(1);
+    system.addForce(force);
+    vector<Vec3> positions = {Vec3(2, 0.5, 0), Vec3(1.5, 0, 1)};
+    VerletIntegrator integrator1(0.01);
+    Context context1(system, integrator1, platform);
+    context1.setPositions(positions);
+    LocalEnergyMinimizer::minimize(context1, 1e-10);
+    VerletIntegrator integrator2(0.01);
+    Context context2(system, integrator2, platform);
+    context2.setPositions(context1.getState(State::Positions).getPositions());
+    integrator1.step(1);
+    integrator2.step(1);
+    State state1 = context1.getState(State::Positions | State::Velocities);
+    State state2 = context2.getState(State::Positions | State::Velocities);
+    for (int i = 0; i < 2; i++) {
+        ASSERT_EQUAL_VEC(state2.getPositions()[i], state1.getPositions()[i], 1e-5);
+        ASSERT_EQUAL_VEC(state2.getVelocities()[i], state1.getVelocities()[i], 1e-5);
+    }
+}
+
 void runPlatformTests();
 
 int main(int argc, char* argv[]) {
@@ -269,6 +300,7 @@ int main(int argc, char* argv[]) {
         testVirtualSites();
         testLargeForces();
         testForceGroups();
+        testStepAfterMinimize();
         runPlatformTests();
     }
     catch(const exception& e) {
@@ -0,0 +1,291 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2008-2020 Stanford University and the Authors.      *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/Context.h"
+#include "openmm/CustomExternalForce.h"
+#include "openmm/CustomIntegrator.h"
+#include "openmm/HarmonicBondForce.h"
+#include "openmm/NonbondedForce.h"
+#include "openmm/System.h"
+#include "openmm/MTSLangevinIntegrator.h"
+#include "SimTKOpenMMRealType.h"
+#include "sfmt/SFMT.h"
+#include <iostream>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+void testSingleBond() {
+    System system;
+    system.addParticle(2.0);
+    system.addParticle(2.0);
+    vector<pair<int, int> > groups;
+    groups.push_back(make_pair(0, 1));
+    MTSLangevinIntegrator integrator(0, 0.1, 0.01, groups);
+    HarmonicBondForce* forceField = new HarmonicBondForce();
+    forceField->addBond(0, 1, 1.5, 1);
+    system.addForce(forceField);
+    Context context(system, integrator, platform);
+    vector<Vec3> positions(2);
+    positions[0] = Vec3(-1, 0, 0);
+    positions[1] = Vec3(1, 0, 0);
+    context.setPositions(positions);
+    
+    // This is simply a damped harmonic oscillator, so compare it to the analytical solution.
+    
+    double freq = std::sqrt(1-0.05*0.05);
+    for (int i = 0; i < 1000; ++i) {
+        State state = context.getState(State::Positions | State::Velocities);
+        double time = state.getTime();
+        double expectedDist = 1.5+0.5*std::exp(-0.05*time)*std::cos(freq*time);
+        ASSERT_EQUAL_VEC(Vec3(-0.5*expectedDist, 0, 0), state.getPositions()[0], 0.02);
+        ASSERT_EQUAL_VEC(Vec3(0.5*expectedDist, 0, 0), state.getPositions()[1], 0.02);
+        double expectedSpeed = -0.5*std::exp(-0.05*time)*(0.05*std::cos(freq*time)+freq*std::sin(freq*time));
+        ASSERT_EQUAL_VEC(Vec3(-0.5*expectedSpeed, 0, 0), state.getVelocities()[0], 0.02);
+        ASSERT_EQUAL_VEC(Vec3(0.5*expectedSpeed, 0, 0), state.getVelocities()[1], 0.02);
+        integrator.step(1);
+    }
+    
+    // Now set the friction to 0 and see if it conserves energy.
+    
+    integrator.setFriction(0.0);
+    context.setPositions(positions);
+    State state = context.getState(State::Energy);
+    double initialEnergy = state.getKineticEnergy()+state.getPotentialEnergy();
+    for (int i = 0; i < 1000; ++i) {
+        state = context.getState(State::Energy);
+        double energy = state.getKineticEnergy()+state.getPotentialEnergy();
+        ASSERT_EQUAL_TOL(initialEnergy, energy, 0.01);
+        integrator.step(1);
+    }
+}
+
+void testCompareToCustomIntegrator() {
+    // Build a system with a fast bonded force in group 0 and a slowly varying force in group 1.
+
+    const int numParticles = 4;
+    System system;
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    CustomExternalForce* external = new CustomExternalForce("0.5*(x^2+y^2+z^2)");
+    external->setForceGroup(1);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0+i);
+        external->addParticle(i);
+        if (i > 0)
+            bonds->addBond(i-1, i, 1.0, 200.0);
+    }
+    system.addForce(bonds);
+    system.addForce(external);
+    vector<Vec3> positions(numParticles), velocities(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        positions[i] = Vec3(i+0.1*genrand_real2(sfmt), 0.1*genrand_real2(sfmt), 0.1*genrand_real2(sfmt));
+        velocities[i] = Vec3(genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5);
+    }
+
+    // Without friction the algorithm is deterministic, so it should exactly match
+    // the equivalent r-RESPA scheme written as a CustomIntegrator.
+
+    const double dt = 0.004;
+    vector<pair<int, int> > groups;
+    groups.push_back(make_pair(0, 4));
+    groups.push_back(make_pair(1, 1));
+    MTSLangevinIntegrator integrator1(300.0, 0.0, dt, groups);
+    CustomIntegrator integrator2(dt);
+    integrator2.addComputePerDof("v", "v+0.5*dt*f1/m");
+    for (int i = 0; i < 4; i++) {
+        integrator2.addComputePerDof("v", "v+0.5*(dt/4)*f0/m");
+        integrator2.addComputePerDof("x", "x+(dt/4)*v");
+        integrator2.addComputePerDof("v", "v+0.5*(dt/4)*f0/m");
+    }
+    integrator2.addComputePerDof("v", "v+0.5*dt*f1/m");
+    Context context1(system, integrator1, platform);
+    Context context2(system, integrator2, platform);
+    context1.setPositions(positions);
+    context1.setVelocities(velocities);
+    context2.setPositions(positions);
+    context2.setVelocities(velocities);
+    for (int i = 0; i < 20; i++) {
+        integrator1.step(5);
+        integrator2.step(5);
+        State state1 = context1.getState(State::Positions | State::Velocities | State::Energy);
+        State state2 = context2.getState(State::Positions | State::Velocities);
+        for (int j = 0; j < numParticles; j++) {
+            ASSERT_EQUAL_VEC(state2.getPositions()[j], state1.getPositions()[j], 1e-4);
+            ASSERT_EQUAL_VEC(state2.getVelocities()[j], state1.getVelocities()[j], 1e-4);
+        }
+        ASSERT_EQUAL_TOL(5*(i+1)*dt, state1.getTime(), 1e-6);
+    }
+}
+
+void testTemperature() {
+    const int numParticles = 8;
+    const double temp = 100.0;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(5, 0, 0), Vec3(0, 5, 0), Vec3(0, 0, 5));
+    vector<pair<int, int> > groups;
+    groups.push_back(make_pair(0, 2));
+    groups.push_back(make_pair(1, 1));
+    MTSLangevinIntegrator integrator(temp, 3.0, 0.01, groups);
+    NonbondedForce* forceField = new NonbondedForce();
+    forceField->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    for (int i = 0; i < numParticles; ++i) {
+        system.addParticle(2.0);
+        forceField->addParticle((i%2 == 0 ? 1.0 : -1.0), 1.0, 5.0);
+    }
+    system.addForce(forceField);
+    CustomExternalForce* external = new CustomExternalForce("0.1*(x^2+y^2+z^2)");
+    external->setForceGroup(1);
+    for (int i = 0; i < numParticles; ++i)
+        external->addParticle(i);
+    system.addForce(external);
+    Context context(system, integrator, platform);
+    vector<Vec3> positions(numParticles);
+    for (int i = 0; i < numParticles; ++i)
+        positions[i] = Vec3((i%2 == 0 ? 2 : -2), (i%4 < 2 ? 2 : -2), (i < 4 ? 2 : -2));
+    context.setPositions(positions);
+    
+    // Let it equilibrate.
+    
+    integrator.step(5000);
+    
+    // Now run it for a while and see if the temperature is correct.
+    
+    double ke = 0.0;
+    int steps = 10000;
+    for (int i = 0; i < steps; ++i) {
+        State state = context.getState(State::Energy);
+        ke += state.getKineticEnergy();
+        integrator.step(1);
+    }
+    ke /= steps;
+    double expected = 0.5*numParticles*3*BOLTZ*temp;
+    ASSERT_USUALLY_EQUAL_TOL(expected, ke, 6/std::sqrt((double) steps));
+}
+
+void testConstraints() {
+    const int numParticles = 8;
+    const int numConstraints = 5;
+    const double temp = 100.0;
+    System system;
+    vector<pair<int, int> > groups;
+    groups.push_back(make_pair(0, 2));
+    groups.push_back(make_pair(1, 1));
+    MTSLangevinIntegrator integrator(temp, 2.0, 0.01, groups);
+    integrator.setConstraintTolerance(1e-5);
+    NonbondedForce* forceField = new NonbondedForce();
+    forceField->setReciprocalSpaceForceGroup(1);
+    for (int i = 0; i < numParticles; ++i) {
+        system.addParticle(10.0);
+        forceField->addParticle((i%2 == 0 ? 0.2 : -0.2), 0.5, 5.0);
+    }
+    system.addConstraint(0, 1, 1.0);
+    system.addConstraint(1, 2, 1.0);
+    system.addConstraint(2, 3, 1.0);
+    system.addConstraint(4, 5, 1.0);
+    system.addConstraint(6, 7, 1.0);
+    system.addForce(forceField);
+    Context context(system, integrator, platform);
+    vector<Vec3> positions(numParticles);
+    vector<Vec3> velocities(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+
+    for (int i = 0; i < numParticles; ++i) {
+        positions[i] = Vec3(i/2, (i+1)/2, 0);
+        velocities[i] = Vec3(genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5);
+    }
+    context.setPositions(positions);
+    context.setVelocities(velocities);
+
+    // Simulate it and see whether the constraints remain satisfied.
+
+    for (int i = 0; i < 1000; ++i) {
+        State state = context.getState(State::Positions);
+        for (int j = 0; j < numConstraints; ++j) {
+            int particle1, particle2;
+            double distance;
+            system.getConstraintParameters(j, particle1, particle2, distance);
+            Vec3 p1 = state.getPositions()[particle1];
+            Vec3 p2 = state.getPositions()[particle2];
+            double dist = std::sqrt((p1[0]-p2[0])*(p1[0]-p2[0])+(p1[1]-p2[1])*(p1[1]-p2[1])+(p1[2]-p2[2])*(p1[2]-p2[2]));
+            ASSERT_EQUAL_TOL(distance, dist, 1e-4);
+        }
+        integrator.step(1);
+    }
+}
+
+void testInvalidGroups() {
+    // The number of substeps for each group must be a multiple of the next slower one.
+
+    vector<pair<int, int> > groups;
+    groups.push_back(make_pair(0, 3));
+    groups.push_back(make_pair(1, 2));
+    bool failed = false;
+    try {
+        MTSLangevinIntegrator integrator(300.0, 1.0, 0.004, groups);
+    }
+    catch (exception& ex) {
+        failed = true;
+    }
+    ASSERT(failed);
+
+    // Groups should be sorted from slowest to fastest.
+
+    groups[0] = make_pair(0, 4);
+    MTSLangevinIntegrator integrator(300.0, 1.0, 0.004, groups);
+    ASSERT_EQUAL(1, integrator.getGroups()[0].first);
+    ASSERT_EQUAL(0, integrator.getGroups()[1].first);
+}
+
+void runPlatformTests();
+
+int main(int argc, char* argv[]) {
+    try {
+        initializeTests(argc, argv);
+        testSingleBond();
+        testCompareToCustomIntegrator();
+        testTemperature();
+        testConstraints();
+        testInvalidGroups();
+        runPlatformTests();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
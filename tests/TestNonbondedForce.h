@@ -724,6 +724,83 @@ void testChangingParameters() {
     ASSERT_EQUAL_TOL(state.getPotentialEnergy(), referenceState.getPotentialEnergy(), tol);
 }
 
+void testChangingParameterRange() {
+    const int numMolecules = 200;
+    const int numParticles = numMolecules*2;
+    const double cutoff = 2.0;
+    const double boxSize = 10.0;
+    const double tol = 2e-3;
+    ReferencePlatform reference;
+    System system;
+    for (int i = 0; i < numParticles; i++)
+        system.addParticle(1.0);
+    NonbondedForce* nonbonded = new NonbondedForce();
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numMolecules; i++) {
+        nonbonded->addParticle(-1.0, 0.2, 0.1);
+        nonbonded->addParticle(1.0, 0.1, 0.1);
+        positions[2*i] = Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+        positions[2*i+1] = Vec3(positions[2*i][0]+0.3, positions[2*i][1], positions[2*i][2]);
+        if (i%2 == 0)
+            nonbonded->addException(2*i, 2*i+1, -0.5, 0.15, 0.05);
+        else
+            nonbonded->addException(2*i, 2*i+1, 0.0, 0.15, 0.0);
+    }
+    nonbonded->setNonbondedMethod(NonbondedForce::PME);
+    nonbonded->setCutoffDistance(cutoff);
+    nonbonded->setUseDispersionCorrection(true);
+    system.addForce(nonbonded);
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    VerletIntegrator integrator1(0.01);
+    VerletIntegrator integrator2(0.01);
+    Context context(system, integrator1, platform);
+    Context referenceContext(system, integrator2, reference);
+    context.setPositions(positions);
+    referenceContext.setPositions(positions);
+
+    // Modify a range of particles and exceptions, update only those in one context and everything
+    // in the other, and see if they agree.
+
+    for (int i = 50; i < 60; i++) {
+        double charge, sigma, epsilon;
+        nonbonded->getParticleParameters(i, charge, sigma, epsilon);
+        nonbonded->setParticleParameters(i, 1.5*charge, 1.1*sigma, 1.7*epsilon);
+    }
+    for (int i = 20; i < 30; i += 2)
+        nonbonded->setExceptionParameters(i, 2*i, 2*i+1, -0.8, 0.15, 0.1);
+    nonbonded->updateParametersInContext(context, 50, 59, 20, 29);
+    nonbonded->updateParametersInContext(referenceContext);
+    State state = context.getState(State::Forces | State::Energy);
+    State referenceState = referenceContext.getState(State::Forces | State::Energy);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(state.getForces()[i], referenceState.getForces()[i], tol);
+    ASSERT_EQUAL_TOL(state.getPotentialEnergy(), referenceState.getPotentialEnergy(), tol);
+
+    // Update only particles, with no exceptions.
+
+    nonbonded->setParticleParameters(3, 0.2, 0.3, 0.4);
+    nonbonded->updateParametersInContext(context, 3, 3);
+    nonbonded->updateParametersInContext(referenceContext);
+    state = context.getState(State::Forces | State::Energy);
+    referenceState = referenceContext.getState(State::Forces | State::Energy);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(state.getForces()[i], referenceState.getForces()[i], tol);
+    ASSERT_EQUAL_TOL(state.getPotentialEnergy(), referenceState.getPotentialEnergy(), tol);
+
+    // An index out of range should throw an exception.
+
+    bool threwException = false;
+    try {
+        nonbonded->updateParametersInContext(context, 0, numParticles);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
 void testSwitchingFunction(NonbondedForce::NonbondedMethod method) {
     System system;
     system.setDefaultPeriodicBoxVectors(Vec3(6, 0, 0), Vec3(0, 6, 0), Vec3(0, 0, 6));
@@ -949,6 +1026,7 @@ int main(int argc, char* argv[]) {
         testLargeSystem();
         testDispersionCorrection();
         testChangingParameters();
+        testChangingParameterRange();
         testSwitchingFunction(NonbondedForce::CutoffNonPeriodic);
         testSwitchingFunction(NonbondedForce::PME);
         testTwoForces();
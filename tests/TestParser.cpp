@@ -114,6 +114,21 @@ void verifyEvaluation(const string& expression, double x, double y, double expec
     ASSERT_EQUAL(&x, &compiled2.getVariableReference("x"));
     ASSERT_EQUAL(&y, &compiled2.getVariableReference("y"));
 
+    // Create CompiledVectorExpressions and see if they also give the same result.
+
+    for (int width : CompiledVectorExpression::getAllowedWidths()) {
+        CompiledVectorExpression vectorExpression = parsed.createCompiledVectorExpression(width);
+        for (int i = 0; i < width; i++) {
+            if (vectorExpression.getVariables().find("x") != vectorExpression.getVariables().end())
+                vectorExpression.getVariablePointer("x")[i] = x;
+            if (vectorExpression.getVariables().find("y") != vectorExpression.getVariables().end())
+                vectorExpression.getVariablePointer("y")[i] = y;
+        }
+        const float* result = vectorExpression.evaluate();
+        for (int i = 0; i < width; i++)
+            ASSERT_EQUAL_TOL(expectedValue, result[i], 1e-5);
+    }
+
     // Make sure that variable renaming works.
 
     variables.clear();
@@ -125,6 +140,70 @@ void verifyEvaluation(const string& expression, double x, double y, double expec
     ASSERT_EQUAL_TOL(expectedValue, value, 1e-10);
 }
 
+/**
+ * Verify that a CompiledVectorExpression gives the same result as a CompiledExpression for each element
+ * of the vector.
+ */
+void verifyVectorEvaluation(const string& expression) {
+    ParsedExpression parsed = Parser::parse(expression);
+    CompiledExpression compiled = parsed.createCompiledExpression();
+    for (int width : CompiledVectorExpression::getAllowedWidths()) {
+        // Evaluate it with variable values stored in external arrays.
+
+        vector<float> x(width), y(width);
+        for (int i = 0; i < width; i++) {
+            x[i] = -1.5+0.4*i;
+            y[i] = 0.3+0.7*i;
+        }
+        map<string, float*> variablePointers;
+        variablePointers["x"] = &x[0];
+        variablePointers["y"] = &y[0];
+        CompiledVectorExpression vectorExpression = parsed.createCompiledVectorExpression(width);
+        vectorExpression.setVariableLocations(variablePointers);
+        const float* result = vectorExpression.evaluate();
+        for (int i = 0; i < width; i++) {
+            if (compiled.getVariables().find("x") != compiled.getVariables().end())
+                compiled.getVariableReference("x") = x[i];
+            if (compiled.getVariables().find("y") != compiled.getVariables().end())
+                compiled.getVariableReference("y") = y[i];
+            ASSERT_EQUAL_TOL(compiled.evaluate(), result[i], 1e-5);
+        }
+
+        // Changing the values should be reflected the next time it is evaluated.
+
+        for (int i = 0; i < width; i++)
+            x[i] = 2.0-0.3*i;
+        result = vectorExpression.evaluate();
+        for (int i = 0; i < width; i++) {
+            if (compiled.getVariables().find("x") != compiled.getVariables().end())
+                compiled.getVariableReference("x") = x[i];
+            if (compiled.getVariables().find("y") != compiled.getVariables().end())
+                compiled.getVariableReference("y") = y[i];
+            ASSERT_EQUAL_TOL(compiled.evaluate(), result[i], 1e-5);
+        }
+
+        // Evaluate it on arrays whose length is not a multiple of the width.
+
+        int numPoints = 2*width+1;
+        vector<float> xArray(numPoints), yArray(numPoints), results(numPoints);
+        for (int i = 0; i < numPoints; i++) {
+            xArray[i] = -1.1+0.3*i;
+            yArray[i] = 0.2+0.5*i;
+        }
+        map<string, const float*> inputs;
+        inputs["x"] = &xArray[0];
+        inputs["y"] = &yArray[0];
+        vectorExpression.evaluate(numPoints, inputs, &results[0]);
+        for (int i = 0; i < numPoints; i++) {
+            if (compiled.getVariables().find("x") != compiled.getVariables().end())
+                compiled.getVariableReference("x") = xArray[i];
+            if (compiled.getVariables().find("y") != compiled.getVariables().end())
+                compiled.getVariableReference("y") = yArray[i];
+            ASSERT_EQUAL_TOL(compiled.evaluate(), results[i], 1e-5);
+        }
+    }
+}
+
 /**
  * Confirm that a parse error gets thrown.
  */
@@ -194,6 +273,33 @@ void verifyDerivative(const string& expression, const string& expectedDeriv) {
     verifySameValue(computed, expected, 2.0, 0.0);
 }
 
+/**
+ * Verify that compiling several expressions together gives the same results as compiling them separately.
+ */
+
+void verifyMultipleExpressions(const vector<string>& expressions) {
+    vector<ParsedExpression> parsed;
+    for (const string& expression : expressions)
+        parsed.push_back(Parser::parse(expression).optimize());
+    CompiledExpression combined(parsed);
+    ASSERT_EQUAL((int) expressions.size(), combined.getNumResults());
+    for (int trial = 0; trial < 2; trial++) {
+        double x = (trial == 0 ? 1.5 : -0.7);
+        double y = (trial == 0 ? 2.0 : 0.4);
+        if (combined.getVariables().count("x") > 0)
+            combined.getVariableReference("x") = x;
+        if (combined.getVariables().count("y") > 0)
+            combined.getVariableReference("y") = y;
+        double first = combined.evaluate();
+        map<string, double> variables;
+        variables["x"] = x;
+        variables["y"] = y;
+        ASSERT_EQUAL_TOL(parsed[0].evaluate(variables), first, 1e-10);
+        for (int i = 0; i < parsed.size(); i++)
+            ASSERT_EQUAL_TOL(parsed[i].evaluate(variables), combined.getResult(i), 1e-10);
+    }
+}
+
 /**
  * Test the use of a custom function.
  */
@@ -222,6 +328,25 @@ void testCustomFunction(const string& expression, const string& equivalent) {
     verifySameValue(deriv3, deriv4, 2.0, -3.0);
 }
 
+/**
+ * Results of differentiate() and optimize() are cached.  Make sure expressions that differ only slightly
+ * never share results.
+ */
+
+void testCachedResults() {
+    ParsedExpression exp1 = Parser::parse("3*x^2*y");
+    ParsedExpression exp2 = Parser::parse("3.0000000000000004*x^2*y");
+    for (int i = 0; i < 2; i++) {
+        verifySameValue(exp1.differentiate("x"), Parser::parse("6*x*y"), 2.0, 3.0);
+        verifySameValue(exp1.differentiate("y"), Parser::parse("3*x^2"), 2.0, 3.0);
+        ASSERT_EQUAL(exp1.differentiate("x").optimize().evaluate({{"x", 2.0}, {"y", 3.0}}), 36.0);
+        ASSERT(exp2.differentiate("x").optimize().evaluate({{"x", 2.0}, {"y", 3.0}}) != 36.0);
+        ASSERT_EQUAL(exp1.optimize({{"x", 2.0}}).evaluate({{"y", 3.0}}), 36.0);
+        ASSERT_EQUAL(exp1.optimize({{"x", 1.0}}).evaluate({{"y", 3.0}}), 9.0);
+        ASSERT_EQUAL(exp1.optimize({{"y", 2.0}}).evaluate({{"x", 3.0}}), 54.0);
+    }
+}
+
 int main() {
     try {
         verifyEvaluation("5", 5.0);
@@ -268,6 +393,13 @@ int main() {
         verifyEvaluation("atan2(x, y)", 3.0, 1.5, std::atan(2.0));
         verifyEvaluation("sqrt(x^2)", -2.2, 0.0, 2.2);
         verifyEvaluation("sqrt(x)^2", 2.2, 0.0, 2.2);
+        verifyVectorEvaluation("x*y+3*x-y/2");
+        verifyVectorEvaluation("x^3+y^-2+x^4-y^0.5");
+        verifyVectorEvaluation("step(x)*sqrt(y)+delta(x)+abs(x)");
+        verifyVectorEvaluation("select(step(x), min(x, y), max(x, y))+floor(x)*ceil(y)");
+        verifyVectorEvaluation("exp(-x)*sin(y)+erfc(abs(x))+atan2(x, y)");
+        verifyMultipleExpressions({"exp(-x/y)*x^2", "exp(-x/y)*(2*x-x^2/y)", "x"});
+        verifyMultipleExpressions({"sin(x)*cos(y)", "cos(x)*cos(y)", "sin(x)*cos(y)", "5"});
         verifyInvalidExpression("1..2");
         verifyInvalidExpression("1*(2+3");
         verifyInvalidExpression("5++4");
@@ -305,6 +437,7 @@ int main() {
         verifyDerivative("select(x, x^2, 3*x)", "select(x, 2*x, 3)");
         testCustomFunction("custom(x, y)/2", "x*y");
         testCustomFunction("custom(x^2, 1)+custom(2, y-1)", "2*x^2+4*(y-1)");
+        testCachedResults();
         cout << Parser::parse("x*x").optimize() << endl;
         cout << Parser::parse("x*(x*x)").optimize() << endl;
         cout << Parser::parse("(x*x)*x").optimize() << endl;
@@ -0,0 +1,135 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2026 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/Context.h"
+#include "openmm/NonbondedForce.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/System.h"
+#include "openmm/VerletIntegrator.h"
+#include "sfmt/SFMT.h"
+#include <iostream>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+const double TOL = 1e-5;
+
+void testParticleSubset() {
+    const int numParticles = 20;
+    const double boxSize = 3.0;
+    System system;
+    NonbondedForce* nonbonded = new NonbondedForce();
+    system.addForce(nonbonded);
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle(i%2 == 0 ? 0.1 : -0.1, 0.2, 0.1);
+        positions[i] = Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+    }
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    context.setPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    integrator.step(10);
+    vector<int> particles = {15, 3, 8, 0};
+    int subset = context.createParticleSubset(particles);
+    int empty = context.createParticleSubset(vector<int>());
+
+    // Getting the positions of the subset should match the full State.
+
+    State s1 = context.getState(State::Positions);
+    vector<Vec3> subsetPositions;
+    context.getSubsetPositions(subset, subsetPositions);
+    ASSERT_EQUAL(particles.size(), subsetPositions.size());
+    for (int i = 0; i < particles.size(); i++)
+        ASSERT_EQUAL_VEC(s1.getPositions()[particles[i]], subsetPositions[i], TOL);
+    context.getSubsetPositions(empty, subsetPositions);
+    ASSERT_EQUAL(0, subsetPositions.size());
+
+    // Setting the positions of the subset should modify only those particles.
+
+    for (int i = 0; i < particles.size(); i++)
+        subsetPositions.push_back(Vec3(i, 0.5*i, -0.1*i));
+    context.setSubsetPositions(subset, subsetPositions);
+    State s2 = context.getState(State::Positions);
+    vector<Vec3> expected = s1.getPositions();
+    for (int i = 0; i < particles.size(); i++)
+        expected[particles[i]] = subsetPositions[i];
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(expected[i], s2.getPositions()[i], TOL);
+
+    // Subsets should survive reinitializing the Context.
+
+    context.reinitialize(true);
+    context.getSubsetPositions(subset, subsetPositions);
+    for (int i = 0; i < particles.size(); i++)
+        ASSERT_EQUAL_VEC(expected[particles[i]], subsetPositions[i], TOL);
+
+    // Invalid subsets should be rejected.
+
+    bool threwException = false;
+    try {
+        context.createParticleSubset({1, 2, 1});
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+    threwException = false;
+    try {
+        context.setSubsetPositions(subset, vector<Vec3>(2));
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
+void runPlatformTests();
+
+int main(int argc, char* argv[]) {
+    try {
+        initializeTests(argc, argv);
+        testParticleSubset();
+        runPlatformTests();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
@@ -0,0 +1,184 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2026 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "PerformanceUtilities.h"
+#include "openmm/CustomNonbondedForce.h"
+#include "openmm/NonbondedForce.h"
+#include "openmm/System.h"
+#include "openmm/VerletIntegrator.h"
+#include "sfmt/SFMT.h"
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+/**
+ * Create a periodic system containing a fluid of particles at roughly the density of water, and
+ * place the particles on a randomly perturbed lattice so that none of them overlap.
+ */
+void createFluid(System& system, vector<Vec3>& positions, int numParticles) {
+    const double spacing = 0.31;
+    int gridSize = (int) ceil(pow((double) numParticles, 1.0/3.0));
+    double boxSize = gridSize*spacing;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    positions.clear();
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(16.0);
+        Vec3 offset(genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5);
+        Vec3 site(i%gridSize, (i/gridSize)%gridSize, i/(gridSize*gridSize));
+        positions.push_back((site+offset*0.2)*spacing);
+    }
+}
+
+void benchmarkPME(int numParticles, int steps) {
+    System system;
+    vector<Vec3> positions;
+    createFluid(system, positions, numParticles);
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::PME);
+    nonbonded->setCutoffDistance(0.9);
+    for (int i = 0; i < numParticles; i++)
+        nonbonded->addParticle(i%2 == 0 ? 0.5 : -0.5, 0.3, 0.5);
+    system.addForce(nonbonded);
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    checkStepPerformance(context, integrator, "PME", steps);
+}
+
+void benchmarkNeighborList(int numParticles, int steps) {
+    // Alternate between two sets of positions that differ by more than the padding, so the neighbor
+    // list must be rebuilt for every evaluation.
+
+    System system;
+    vector<Vec3> positions;
+    createFluid(system, positions, numParticles);
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    nonbonded->setCutoffDistance(1.0);
+    for (int i = 0; i < numParticles; i++)
+        nonbonded->addParticle(0.0, 0.3, 0.5);
+    system.addForce(nonbonded);
+    vector<Vec3> shiftedPositions = positions;
+    for (int i = 0; i < numParticles; i++)
+        shiftedPositions[i] += Vec3(i%2 == 0 ? 0.2 : -0.2, 0.0, 0.0);
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, platform);
+    checkPerformance(context, "NeighborList", [&] () {
+        for (int i = 0; i < steps; i++) {
+            context.setPositions(i%2 == 0 ? positions : shiftedPositions);
+            context.getState(State::Forces);
+        }
+    }, steps);
+}
+
+void benchmarkCCMA(int numParticles, int steps) {
+    // Chains of five particles joined by constraints.  The constraints are coupled, so they are handled
+    // by CCMA rather than SETTLE or SHAKE.  There are no forces, so the time is dominated by integration
+    // and constraints.
+
+    const int chainLength = 5;
+    const double bondLength = 0.1;
+    System system;
+    vector<Vec3> chainStarts;
+    int numChains = numParticles/chainLength;
+    createFluid(system, chainStarts, numChains);
+    vector<Vec3> positions;
+    for (int i = 0; i < numChains; i++)
+        for (int j = 0; j < chainLength; j++) {
+            if (j > 0) {
+                system.addParticle(16.0);
+                system.addConstraint(i*chainLength+j-1, i*chainLength+j, bondLength);
+            }
+            positions.push_back(chainStarts[i]+Vec3(bondLength*j, 0.0, 0.0));
+        }
+    VerletIntegrator integrator(0.001);
+    integrator.setConstraintTolerance(1e-6);
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    context.setVelocitiesToTemperature(300.0);
+    checkStepPerformance(context, integrator, "CCMA", steps);
+}
+
+void benchmarkCustomNonbonded(int numParticles, int steps) {
+    System system;
+    vector<Vec3> positions;
+    createFluid(system, positions, numParticles);
+    CustomNonbondedForce* custom = new CustomNonbondedForce("4*epsilon*((sigma/r)^12-(sigma/r)^6); sigma=0.5*(sigma1+sigma2); epsilon=sqrt(epsilon1*epsilon2)");
+    custom->addPerParticleParameter("sigma");
+    custom->addPerParticleParameter("epsilon");
+    custom->setNonbondedMethod(CustomNonbondedForce::CutoffPeriodic);
+    custom->setCutoffDistance(1.0);
+    vector<double> params(2);
+    for (int i = 0; i < numParticles; i++) {
+        params[0] = (i%2 == 0 ? 0.3 : 0.32);
+        params[1] = (i%2 == 0 ? 0.5 : 0.6);
+        custom->addParticle(params);
+    }
+    system.addForce(custom);
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    checkStepPerformance(context, integrator, "CustomNonbonded", steps);
+}
+
+void runPlatformTests();
+
+/**
+ * Run all the standard benchmarks.
+ *
+ * @param numParticles   the number of particles in each system.  Platforms choose this so each benchmark
+ *                       takes a reasonable amount of time.
+ * @param steps          the number of steps to time in each repetition
+ */
+void runPerformanceTests(int numParticles, int steps) {
+    benchmarkPME(numParticles, steps);
+    benchmarkNeighborList(numParticles, steps);
+    benchmarkCCMA(numParticles, steps);
+    benchmarkCustomNonbonded(numParticles, steps);
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        initializeTests(argc, argv);
+        runPlatformTests();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
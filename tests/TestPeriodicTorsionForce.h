@@ -118,6 +118,54 @@ void testPeriodic() {
     ASSERT_EQUAL_TOL(1.1*(1+std::cos(2*PI_M/3)), state.getPotentialEnergy(), TOL);
 }
 
+void testMultipleTerms() {
+    // Several terms are applied to the same torsion, interleaved with terms for a different torsion.
+    // Compare to a System in which every term is in its own force.
+
+    System system1, system2;
+    for (int i = 0; i < 5; i++) {
+        system1.addParticle(1.0);
+        system2.addParticle(1.0);
+    }
+    PeriodicTorsionForce* combined = new PeriodicTorsionForce();
+    system1.addForce(combined);
+    vector<vector<int> > atoms = {{0, 1, 2, 3}, {1, 2, 3, 4}, {0, 1, 2, 3}, {0, 1, 2, 3}, {1, 2, 3, 4}};
+    for (int i = 0; i < atoms.size(); i++) {
+        combined->addTorsion(atoms[i][0], atoms[i][1], atoms[i][2], atoms[i][3], i+1, 0.3*i, 1.0+0.2*i);
+        PeriodicTorsionForce* separate = new PeriodicTorsionForce();
+        separate->addTorsion(atoms[i][0], atoms[i][1], atoms[i][2], atoms[i][3], i+1, 0.3*i, 1.0+0.2*i);
+        system2.addForce(separate);
+    }
+    vector<Vec3> positions(5);
+    positions[0] = Vec3(0, 1, 0);
+    positions[1] = Vec3(0, 0, 0);
+    positions[2] = Vec3(1, 0, 0);
+    positions[3] = Vec3(1, 0.3, 1.5);
+    positions[4] = Vec3(2, 1, 1.2);
+    VerletIntegrator integrator1(0.01), integrator2(0.01);
+    Context context1(system1, integrator1, platform);
+    Context context2(system2, integrator2, platform);
+    context1.setPositions(positions);
+    context2.setPositions(positions);
+    for (int iteration = 0; iteration < 2; iteration++) {
+        State state1 = context1.getState(State::Forces | State::Energy);
+        State state2 = context2.getState(State::Forces | State::Energy);
+        ASSERT_EQUAL_TOL(state2.getPotentialEnergy(), state1.getPotentialEnergy(), TOL);
+        for (int i = 0; i < 5; i++)
+            ASSERT_EQUAL_VEC(state2.getForces()[i], state1.getForces()[i], TOL);
+
+        // Change the parameters and make sure they are still matched up with the right torsions.
+
+        for (int i = 0; i < atoms.size(); i++) {
+            combined->setTorsionParameters(i, atoms[i][0], atoms[i][1], atoms[i][2], atoms[i][3], 5-i, 0.1*i, 2.0-0.3*i);
+            PeriodicTorsionForce& separate = dynamic_cast<PeriodicTorsionForce&>(system2.getForce(i));
+            separate.setTorsionParameters(0, atoms[i][0], atoms[i][1], atoms[i][2], atoms[i][3], 5-i, 0.1*i, 2.0-0.3*i);
+            separate.updateParametersInContext(context2);
+        }
+        combined->updateParametersInContext(context1);
+    }
+}
+
 void runPlatformTests();
 
 int main(int argc, char* argv[]) {
@@ -125,6 +173,7 @@ int main(int argc, char* argv[]) {
         initializeTests(argc, argv);
         testPeriodicTorsions();
         testPeriodic();
+        testMultipleTerms();
         runPlatformTests();
     }
     catch(const exception& e) {
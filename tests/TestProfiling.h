@@ -0,0 +1,155 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2026 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/Context.h"
+#include "openmm/HarmonicBondForce.h"
+#include "openmm/NonbondedForce.h"
+#include "openmm/System.h"
+#include "openmm/VerletIntegrator.h"
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+/**
+ * Count the entries in a performance report that record time spent in kernels or force groups.
+ */
+int countProfiledTimes(const map<string, double>& report) {
+    int count = 0;
+    for (auto& entry : report)
+        if (entry.first.find("kernel:") == 0 || entry.first.find("group:") == 0)
+            count++;
+    return count;
+}
+
+void testPerformanceReport() {
+    const int numParticles = 6;
+    System system;
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    bonds->setForceGroup(1);
+    system.addForce(bonds);
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setForceGroup(2);
+    system.addForce(nonbonded);
+    vector<Vec3> positions;
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle(i%2 == 0 ? 0.5 : -0.5, 0.2, 0.5);
+        if (i > 0)
+            bonds->addBond(i-1, i, 0.15, 1000.0);
+        positions.push_back(Vec3(0.3*i, 0.2*(i%3), 0.1*(i%2)));
+    }
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    ASSERT_EQUAL(0, countProfiledTimes(context.getPerformanceReport()));
+
+    // Platforms that do not support profiling do not report any times.  Otherwise every kernel time
+    // should be valid, and the force computations should be attributed to the groups being computed.
+
+    context.setProfilingEnabled(true);
+    integrator.step(10);
+    map<string, double> report = context.getPerformanceReport();
+    if (countProfiledTimes(report) == 0)
+        return;
+    bool hasKernel = false, hasGroup = false;
+    for (auto& entry : report) {
+        ASSERT(entry.second >= 0.0);
+        hasKernel |= (entry.first.find("kernel:") == 0);
+        hasGroup |= (entry.first.find("group:") == 0);
+    }
+    ASSERT(hasKernel);
+    ASSERT(hasGroup);
+
+    // Once profiling is disabled, nothing more should be recorded.  Enabling it again discards the old times.
+
+    context.setProfilingEnabled(false);
+    integrator.step(10);
+    map<string, double> report2 = context.getPerformanceReport();
+    ASSERT_EQUAL(report.size(), report2.size());
+    for (auto& entry : report)
+        ASSERT_EQUAL(entry.second, report2[entry.first]);
+    context.setProfilingEnabled(true);
+    ASSERT_EQUAL(0, countProfiledTimes(context.getPerformanceReport()));
+}
+
+void testMemoryReport() {
+    const int numParticles = 6;
+    System system;
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    system.addForce(bonds);
+    NonbondedForce* nonbonded = new NonbondedForce();
+    system.addForce(nonbonded);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle(0.0, 0.2, 0.5);
+        if (i > 0)
+            bonds->addBond(i-1, i, 0.15, 1000.0);
+    }
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, platform);
+    map<string, double> report = context.getPerformanceReport();
+    if (report.find("memory:total") == report.end())
+        return;
+
+    // The memory used by each owner should add up to the total, and each force should own some memory.
+
+    double total = 0.0;
+    for (auto& entry : report)
+        if (entry.first.find("memory:") == 0 && entry.first != "memory:total" && entry.first.find(':', 7) == string::npos) {
+            ASSERT(entry.second >= 0.0);
+            total += entry.second;
+        }
+    ASSERT_EQUAL(report["memory:total"], total);
+    ASSERT(report["memory:force0"] > 0.0);
+    ASSERT(report["memory:force1"] > 0.0);
+}
+
+void runPlatformTests();
+
+int main(int argc, char* argv[]) {
+    try {
+        initializeTests(argc, argv);
+        testPerformanceReport();
+        testMemoryReport();
+        runPlatformTests();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
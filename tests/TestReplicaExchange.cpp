@@ -0,0 +1,186 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2010-2020 Stanford University and the Authors.      *
+ * Authors: Peter Eastman                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/Context.h"
+#include "openmm/CustomExternalForce.h"
+#include "openmm/Platform.h"
+#include "openmm/ReplicaExchange.h"
+#include "openmm/System.h"
+#include "openmm/VerletIntegrator.h"
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+void testTemperatureExchange() {
+    // With no forces, every exchange should be accepted and the velocities rescaled.
+
+    const int numParticles = 4;
+    System system;
+    for (int i = 0; i < numParticles; i++)
+        system.addParticle(1.0);
+    system.setDefaultPeriodicBoxVectors(Vec3(2, 0, 0), Vec3(0, 2, 0), Vec3(0, 0, 2));
+    Platform& platform = Platform::getPlatformByName("Reference");
+    VerletIntegrator integrator1(0.001), integrator2(0.001);
+    Context context1(system, integrator1, platform);
+    Context context2(system, integrator2, platform);
+    vector<Vec3> pos1, pos2, vel1, vel2;
+    for (int i = 0; i < numParticles; i++) {
+        pos1.push_back(Vec3(i, 0, 0));
+        pos2.push_back(Vec3(0, i, 0));
+        vel1.push_back(Vec3(1, 0, i));
+        vel2.push_back(Vec3(0, 1, -i));
+    }
+    context1.setPositions(pos1);
+    context1.setVelocities(vel1);
+    context2.setPositions(pos2);
+    context2.setVelocities(vel2);
+    context2.setPeriodicBoxVectors(Vec3(3, 0, 0), Vec3(0, 3, 0), Vec3(0, 0, 3));
+    vector<Context*> contexts;
+    contexts.push_back(&context1);
+    contexts.push_back(&context2);
+    vector<double> temperatures;
+    temperatures.push_back(300.0);
+    temperatures.push_back(400.0);
+    ReplicaExchange exchange(contexts, temperatures);
+    ASSERT_EQUAL(2, exchange.getNumReplicas());
+    ASSERT_EQUAL(1, exchange.attemptExchanges());
+    ASSERT_EQUAL(1, exchange.getReplicaInState(0));
+    ASSERT_EQUAL(0, exchange.getReplicaInState(1));
+    ASSERT_EQUAL(1, exchange.getNumAttempted(0));
+    ASSERT_EQUAL(1, exchange.getNumAccepted(0));
+    double scale = sqrt(300.0/400.0);
+    State state1 = context1.getState(State::Positions | State::Velocities);
+    State state2 = context2.getState(State::Positions | State::Velocities);
+    for (int i = 0; i < numParticles; i++) {
+        ASSERT_EQUAL_VEC(pos2[i], state1.getPositions()[i], 1e-10);
+        ASSERT_EQUAL_VEC(pos1[i], state2.getPositions()[i], 1e-10);
+        ASSERT_EQUAL_VEC(vel2[i]*scale, state1.getVelocities()[i], 1e-10);
+        ASSERT_EQUAL_VEC(vel1[i]/scale, state2.getVelocities()[i], 1e-10);
+    }
+    Vec3 a, b, c;
+    state1.getPeriodicBoxVectors(a, b, c);
+    ASSERT_EQUAL_VEC(Vec3(3, 0, 0), a, 0);
+    state2.getPeriodicBoxVectors(a, b, c);
+    ASSERT_EQUAL_VEC(Vec3(2, 0, 0), a, 0);
+
+    // With two replicas, the next call has no pairs to try.
+
+    ASSERT_EQUAL(0, exchange.attemptExchanges());
+    ASSERT_EQUAL(1, exchange.getNumAttempted(0));
+}
+
+void testHamiltonianExchange() {
+    // Each state restrains the particles near a different point, so exchanging them
+    // is extremely unfavorable and should be rejected.
+
+    const int numParticles = 4;
+    System system;
+    CustomExternalForce* force = new CustomExternalForce("k*(x-x0)^2");
+    force->addGlobalParameter("k", 1000.0);
+    force->addGlobalParameter("x0", 0.0);
+    system.addForce(force);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        force->addParticle(i);
+    }
+    Platform& platform = Platform::getPlatformByName("Reference");
+    VerletIntegrator integrator1(0.001), integrator2(0.001);
+    Context context1(system, integrator1, platform);
+    Context context2(system, integrator2, platform);
+    context2.setParameter("x0", 5.0);
+    vector<Vec3> pos1(numParticles), pos2(numParticles, Vec3(5, 0, 0));
+    context1.setPositions(pos1);
+    context2.setPositions(pos2);
+    vector<Context*> contexts;
+    contexts.push_back(&context1);
+    contexts.push_back(&context2);
+    ReplicaExchange exchange(contexts, vector<double>(2, 300.0));
+    ASSERT_EQUAL(0, exchange.attemptExchanges());
+    ASSERT_EQUAL(0, exchange.getReplicaInState(0));
+    ASSERT_EQUAL(1, exchange.getNumAttempted(0));
+    ASSERT_EQUAL(0, exchange.getNumAccepted(0));
+    State state1 = context1.getState(State::Positions | State::Energy);
+    State state2 = context2.getState(State::Positions | State::Energy);
+    for (int i = 0; i < numParticles; i++) {
+        ASSERT_EQUAL_VEC(pos1[i], state1.getPositions()[i], 1e-10);
+        ASSERT_EQUAL_VEC(pos2[i], state2.getPositions()[i], 1e-10);
+    }
+    ASSERT_EQUAL_TOL(0.0, state1.getPotentialEnergy(), 1e-10);
+    ASSERT_EQUAL_TOL(0.0, state2.getPotentialEnergy(), 1e-10);
+
+    // Once the states are identical, the exchange should be accepted.
+
+    context2.setParameter("x0", 0.0);
+    ASSERT_EQUAL(1, exchange.attemptExchanges()+exchange.attemptExchanges());
+    ASSERT_EQUAL(1, exchange.getReplicaInState(0));
+    ASSERT_EQUAL_VEC(pos2[0], context1.getState(State::Positions).getPositions()[0], 1e-10);
+}
+
+void testInvalidArguments() {
+    System system1, system2;
+    system1.addParticle(1.0);
+    system2.addParticle(1.0);
+    system2.addParticle(1.0);
+    Platform& platform = Platform::getPlatformByName("Reference");
+    VerletIntegrator integrator1(0.001), integrator2(0.001);
+    Context context1(system1, integrator1, platform);
+    Context context2(system2, integrator2, platform);
+    vector<Context*> contexts;
+    contexts.push_back(&context1);
+    contexts.push_back(&context2);
+    bool threwException = false;
+    try {
+        ReplicaExchange exchange(contexts, vector<double>(2, 300.0));
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        testTemperatureExchange();
+        testHamiltonianExchange();
+        testInvalidArguments();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
@@ -0,0 +1,222 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2020 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/Context.h"
+#include "openmm/HarmonicBondForce.h"
+#include "openmm/Platform.h"
+#include "openmm/SharedMemoryReporter.h"
+#include "openmm/VerletIntegrator.h"
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+string getUniqueName(const string& base) {
+    stringstream name;
+    name << "/" << base << "_" << getpid();
+    return name.str();
+}
+
+void createSystem(System& system, vector<Vec3>& positions, int numParticles) {
+    system.setDefaultPeriodicBoxVectors(Vec3(3, 0, 0), Vec3(0, 4, 0), Vec3(0, 0, 5));
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    positions.resize(numParticles);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        positions[i] = Vec3(0.3*i, 0.1*(i%3), 0.2*(i%2));
+        if (i > 0)
+            bonds->addBond(i-1, i, 0.3, 100.0);
+    }
+    system.addForce(bonds);
+}
+
+void testPublishFrames() {
+    const int numParticles = 10;
+    const int interval = 3;
+    const int numSlots = 4;
+    System system;
+    vector<Vec3> positions;
+    createSystem(system, positions, numParticles);
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, Platform::getPlatformByName("Reference"));
+    context.setPositions(positions);
+    string name = getUniqueName("TestSharedMemoryReporter");
+    SharedMemoryReporter reporter(name, context, interval, numSlots);
+    ASSERT_EQUAL(interval, reporter.getReportInterval());
+    ASSERT_EQUAL(numParticles, reporter.getNumParticles());
+    SharedMemoryReader reader(name);
+    ASSERT_EQUAL(numParticles, reader.getNumParticles());
+    ASSERT_EQUAL(numSlots, reader.getNumSlots());
+    ASSERT_EQUAL(0, reader.getNumFrames());
+    vector<Vec3> framePositions;
+    Vec3 box[3];
+    long long step;
+    double time;
+    ASSERT_EQUAL(-1, reader.readLatestFrame(framePositions, box, step, time));
+
+    // Take steps and check that the frames are published.
+
+    reporter.step(30);
+    ASSERT_EQUAL(10, reporter.getNumFrames());
+    ASSERT_EQUAL(10, reader.getNumFrames());
+    State state = context.getState(State::Positions);
+    ASSERT_EQUAL(9, reader.readLatestFrame(framePositions, box, step, time));
+    ASSERT_EQUAL(30, step);
+    ASSERT_EQUAL_TOL(0.03, time, 1e-10);
+    ASSERT_EQUAL_VEC(Vec3(3, 0, 0), box[0], 0);
+    ASSERT_EQUAL_VEC(Vec3(0, 4, 0), box[1], 0);
+    ASSERT_EQUAL_VEC(Vec3(0, 0, 5), box[2], 0);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(state.getPositions()[i], framePositions[i], 0);
+
+    // Older frames are available until they are overwritten.
+
+    ASSERT(reader.readFrame(6, framePositions, box, step, time));
+    ASSERT_EQUAL(21, step);
+    ASSERT(!reader.readFrame(5, framePositions, box, step, time));
+    ASSERT(!reader.readFrame(10, framePositions, box, step, time));
+
+    // report() publishes a frame immediately.
+
+    reporter.report();
+    ASSERT_EQUAL(10, reader.readLatestFrame(framePositions, box, step, time));
+    ASSERT_EQUAL(30, step);
+}
+
+void testSubset() {
+    const int numParticles = 10;
+    System system;
+    vector<Vec3> positions;
+    createSystem(system, positions, numParticles);
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, Platform::getPlatformByName("Reference"));
+    context.setPositions(positions);
+    string name = getUniqueName("TestSharedMemoryReporterSubset");
+    vector<int> particles = {7, 2, 5};
+    SharedMemoryReporter reporter(name, context, 5, 2, particles);
+    ASSERT_EQUAL(3, reporter.getNumParticles());
+    reporter.step(20);
+    SharedMemoryReader reader(name);
+    ASSERT_EQUAL(3, reader.getNumParticles());
+    vector<Vec3> framePositions;
+    Vec3 box[3];
+    long long step;
+    double time;
+    ASSERT_EQUAL(3, reader.readLatestFrame(framePositions, box, step, time));
+    ASSERT_EQUAL(20, step);
+    State state = context.getState(State::Positions);
+    for (int i = 0; i < particles.size(); i++)
+        ASSERT_EQUAL_VEC(state.getPositions()[particles[i]], framePositions[i], 0);
+}
+
+void testRemoveOnDelete() {
+    System system;
+    system.addParticle(1.0);
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, Platform::getPlatformByName("Reference"));
+    string name = getUniqueName("TestSharedMemoryReporterRemove");
+    {
+        SharedMemoryReporter reporter(name, context, 1);
+    }
+    bool threwException = false;
+    try {
+        SharedMemoryReader reader(name);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
+void testExistingName() {
+    // Creating a second reporter with the same name should fail without disturbing the first one.
+
+    System system;
+    system.addParticle(1.0);
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, Platform::getPlatformByName("Reference"));
+    string name = getUniqueName("TestSharedMemoryReporterExisting");
+    SharedMemoryReporter reporter(name, context, 1);
+    bool threwException = false;
+    try {
+        SharedMemoryReporter reporter2(name, context, 1);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+    SharedMemoryReader reader(name);
+    ASSERT_EQUAL(1, reader.getNumParticles());
+}
+
+void testInvalidArguments() {
+    System system;
+    system.addParticle(1.0);
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, Platform::getPlatformByName("Reference"));
+    string name = getUniqueName("TestSharedMemoryReporterInvalid");
+    bool threwException = false;
+    try {
+        SharedMemoryReporter reporter(name, context, 0);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+    threwException = false;
+    try {
+        SharedMemoryReporter reporter(name, context, 1, 0);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        testPublishFrames();
+        testSubset();
+        testExistingName();
+        testRemoveOnDelete();
+        testInvalidArguments();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
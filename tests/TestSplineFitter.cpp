@@ -34,6 +34,7 @@
 #endif
 #include "openmm/internal/AssertionUtilities.h"
 #include "openmm/internal/SplineFitter.h"
+#include "openmm/OpenMMException.h"
 #include <cmath>
 #include <iostream>
 #include <vector>
@@ -258,6 +259,60 @@ void testPeriodic3DSpline() {
     }
 }
 
+void testLarge3DSpline() {
+    // This grid is large enough that the fit is divided between threads.  Compare it to fitting the
+    // same function with a 1D spline along each axis.
+
+    const int xsize = 41;
+    const int ysize = 35;
+    const int zsize = 33;
+    vector<double> x(xsize);
+    vector<double> y(ysize);
+    vector<double> z(zsize);
+    vector<double> f(xsize*ysize*zsize);
+    for (int i = 0; i < xsize; i++)
+        x[i] = 0.1*i;
+    for (int i = 0; i < ysize; i++)
+        y[i] = 0.1*i+0.01*sin(double(i));
+    for (int i = 0; i < zsize; i++)
+        z[i] = 0.1*i;
+    for (int i = 0; i < xsize; i++)
+        for (int j = 0; j < ysize; j++)
+            for (int k = 0; k < zsize; k++)
+                f[i+j*xsize+k*xsize*ysize] = sin(x[i])+cos(y[j])*z[k];
+    vector<vector<double> > c;
+    SplineFitter::create3DNaturalSpline(x, y, z, f, c);
+    for (int i = 0; i < xsize; i += 5)
+        for (int j = 0; j < ysize; j += 5)
+            for (int k = 0; k < zsize; k += 5) {
+                double value = SplineFitter::evaluate3DSpline(x, y, z, f, c, x[i], y[j], z[k]);
+                ASSERT_EQUAL_TOL(f[i+j*xsize+k*xsize*ysize], value, 1e-6);
+            }
+    vector<double> line(xsize), deriv;
+    for (int i = 0; i < xsize; i++)
+        line[i] = sin(x[i]);
+    SplineFitter::createNaturalSpline(x, line, deriv);
+    for (int i = 0; i < 20; i++) {
+        double s = x[0]+(i+0.5)*(x[xsize-1]-x[0])/20.0;
+        double t = y[7];
+        double u = z[11];
+        double value = SplineFitter::evaluate3DSpline(x, y, z, f, c, s, t, u);
+        double expected = SplineFitter::evaluateSpline(x, line, deriv, s)+cos(t)*u;
+        ASSERT_EQUAL_TOL(expected, value, 1e-4);
+    }
+
+    // An error in the input should be reported on the calling thread.
+
+    bool threwException = false;
+    try {
+        SplineFitter::create3DSpline(x, y, z, f, true, c);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
 int main() {
     try {
         testNaturalSpline();
@@ -266,6 +321,7 @@ int main() {
         testPeriodic2DSpline();
         test3DSpline();
         testPeriodic3DSpline();
+        testLarge3DSpline();
     }
     catch(const exception& e) {
         cout << "exception: " << e.what() << endl;
@@ -0,0 +1,136 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2026 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/Context.h"
+#include "openmm/CustomExternalForce.h"
+#include "openmm/NonbondedForce.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/System.h"
+#include "openmm/VerletIntegrator.h"
+#include "sfmt/SFMT.h"
+#include <iostream>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+const double TOL = 1e-5;
+
+void testStateSnapshots() {
+    const int numParticles = 20;
+    const double boxSize = 3.0;
+    System system;
+    NonbondedForce* nonbonded = new NonbondedForce();
+    system.addForce(nonbonded);
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    CustomExternalForce* external = new CustomExternalForce("k*x^2");
+    external->addGlobalParameter("k", 1.0);
+    system.addForce(external);
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle(i%2 == 0 ? 0.1 : -0.1, 0.2, 0.1);
+        external->addParticle(i);
+        positions[i] = Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+    }
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    context.setPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    context.setVelocitiesToTemperature(300.0);
+    integrator.step(10);
+    int types = State::Positions | State::Velocities | State::Parameters | State::Energy;
+    State s1 = context.getState(types);
+    context.saveSnapshot(0);
+
+    // Change everything a snapshot records, then save a second one.
+
+    integrator.step(50);
+    context.setParameter("k", 2.0);
+    context.setPeriodicBoxVectors(Vec3(boxSize+0.1, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    State s2 = context.getState(types);
+    context.saveSnapshot(5);
+    integrator.step(10);
+
+    // Restoring each snapshot should reproduce the state when it was saved.  Restoring one does
+    // not remove it.
+
+    for (int i = 0; i < 2; i++) {
+        for (int slot : {0, 5, 0}) {
+            context.restoreSnapshot(slot);
+            State expected = (slot == 0 ? s1 : s2);
+            State s = context.getState(types);
+            ASSERT_EQUAL(expected.getTime(), s.getTime());
+            ASSERT_EQUAL(expected.getParameters().at("k"), s.getParameters().at("k"));
+            Vec3 box1[3], box2[3];
+            expected.getPeriodicBoxVectors(box1[0], box1[1], box1[2]);
+            s.getPeriodicBoxVectors(box2[0], box2[1], box2[2]);
+            for (int j = 0; j < 3; j++)
+                ASSERT_EQUAL_VEC(box1[j], box2[j], 0);
+            for (int j = 0; j < numParticles; j++) {
+                ASSERT_EQUAL_VEC(expected.getPositions()[j], s.getPositions()[j], TOL);
+                ASSERT_EQUAL_VEC(expected.getVelocities()[j], s.getVelocities()[j], TOL);
+            }
+            ASSERT_EQUAL_TOL(expected.getPotentialEnergy(), s.getPotentialEnergy(), TOL);
+        }
+        integrator.step(10);
+    }
+
+    // Restoring a slot that was never saved should fail.
+
+    bool threwException = false;
+    try {
+        context.restoreSnapshot(1);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
+void runPlatformTests();
+
+int main(int argc, char* argv[]) {
+    try {
+        initializeTests(argc, argv);
+        testStateSnapshots();
+        runPlatformTests();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
@@ -0,0 +1,117 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2020 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/internal/ThreadPool.h"
+#include <atomic>
+#include <iostream>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+void testExecuteChunks() {
+    ThreadPool threads(4);
+    for (int chunkSize : {1, 7, 64, 1000}) {
+        const int numIndices = 997;
+        vector<int> count(numIndices, 0);
+        vector<int> threadForIndex(numIndices, -1);
+        atomic<bool> badRange(false);
+        threads.execute(numIndices, chunkSize, [&] (ThreadPool& pool, int threadIndex, int start, int end) {
+            if (start < 0 || end > numIndices || end-start > chunkSize)
+                badRange = true;
+            for (int i = start; i < end; i++) {
+                count[i]++;
+                threadForIndex[i] = threadIndex;
+            }
+        });
+        threads.waitForThreads();
+
+        ASSERT(!badRange);
+
+        // Every index should have been processed exactly once, by a valid thread.
+
+        for (int i = 0; i < numIndices; i++) {
+            ASSERT_EQUAL(1, count[i]);
+            ASSERT(threadForIndex[i] >= 0 && threadForIndex[i] < threads.getNumThreads());
+        }
+    }
+}
+
+void testUnevenWork() {
+    // Make a few indices much more expensive than the others, and check that the
+    // results are still correct when the pool is reused for several launches.
+
+    ThreadPool threads(3);
+    const int numIndices = 200;
+    vector<double> result(numIndices, 0.0);
+    for (int iteration = 0; iteration < 5; iteration++) {
+        atomic<int> processed(0);
+        threads.execute(numIndices, 4, [&] (ThreadPool& pool, int threadIndex, int start, int end) {
+            for (int i = start; i < end; i++) {
+                int steps = (i%50 == 0 ? 100000 : 10);
+                double sum = 0.0;
+                for (int j = 0; j < steps; j++)
+                    sum += 1.0;
+                result[i] = sum+iteration;
+                processed++;
+            }
+        });
+        threads.waitForThreads();
+        ASSERT_EQUAL(numIndices, processed);
+        for (int i = 0; i < numIndices; i++)
+            ASSERT_EQUAL((i%50 == 0 ? 100000.0 : 10.0)+iteration, result[i]);
+    }
+}
+
+void testEmptyRange() {
+    ThreadPool threads(2);
+    atomic<int> calls(0);
+    threads.execute(0, 10, [&] (ThreadPool& pool, int threadIndex, int start, int end) {
+        calls++;
+    });
+    threads.waitForThreads();
+    ASSERT_EQUAL(0, calls);
+}
+
+int main() {
+    try {
+        testExecuteChunks();
+        testUnevenWork();
+        testEmptyRange();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
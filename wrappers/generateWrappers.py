@@ -70,8 +70,12 @@ class WrapperGenerator:
         self.skipClasses = ['OpenMM::Vec3', 'OpenMM::XmlSerializer', 'OpenMM::Kernel', 'OpenMM::KernelImpl', 'OpenMM::KernelFactory', 'OpenMM::ContextImpl', 'OpenMM::SerializationNode', 'OpenMM::SerializationProxy']
         self.skipMethods = ['State OpenMM::Context::getState',
                             'void OpenMM::Context::createCheckpoint',
+                            'void OpenMM::Context::createCheckpointAsync',
+                            'void OpenMM::Context::getPositionsFloat',
+                            'void OpenMM::Context::getVelocitiesFloat',
                             'void OpenMM::Context::loadCheckpoint',
                             'const std::vector<std::vector<int> >& OpenMM::Context::getMolecules',
+                            'std::map<std::string, double> OpenMM::Context::getPerformanceReport',
                             'static std::vector<std::string> OpenMM::Platform::getPluginLoadFailures',
                             'static std::vector<std::string> OpenMM::Platform::loadPluginsFromDirectory',
                             'Vec3 OpenMM::LocalCoordinatesSite::getOriginWeights',
@@ -1346,6 +1346,11 @@ class ForceField(object):
         """Return a list of which template matches each residue in the topology, and assign atom types."""
         templateForResidue = [None]*topology.getNumResidues()
         unmatchedResidues = []
+
+        # Large systems contain many copies of the same residues (especially water), so remember the result of matching
+        # each distinct residue structure and reuse it for later copies.
+
+        matchesForStructure = {}
         for chain in topology.chains():
             for res in chain.residues():
                 if res in residueTemplates:
@@ -1356,7 +1361,12 @@ class ForceField(object):
                         raise Exception('User-supplied template %s does not match the residue %d (%s)' % (tname, res.index+1, res.name))
                 else:
                     # Attempt to match one of the existing templates.
-                    [template, matches] = self._getResidueTemplateMatches(res, data.bondedToAtom, ignoreExternalBonds=ignoreExternalBonds, ignoreExtraParticles=ignoreExtraParticles)
+                    structure = _createResidueStructureKey(res, data.bondedToAtom)
+                    if structure in matchesForStructure:
+                        [template, matches] = matchesForStructure[structure]
+                    else:
+                        [template, matches] = self._getResidueTemplateMatches(res, data.bondedToAtom, ignoreExternalBonds=ignoreExternalBonds, ignoreExtraParticles=ignoreExtraParticles)
+                        matchesForStructure[structure] = [template, matches]
                 if matches is None:
                     unmatchedResidues.append(res)
                 else:
@@ -1517,6 +1527,20 @@ def _createResidueSignature(elements):
     return s
 
 
+def _createResidueStructureKey(res, bondedToAtom):
+    """Create a key that identifies everything about a residue that affects which template it matches: the element and
+    name of each atom, the bonds between atoms, and the number of external bonds to each one.  Two residues with the same
+    key match the same template, with the same correspondence between atoms."""
+    atoms = list(res.atoms())
+    localIndex = dict((atom.index, i) for i, atom in enumerate(atoms))
+    key = []
+    for atom in atoms:
+        bonded = bondedToAtom[atom.index]
+        internal = tuple(sorted(localIndex[i] for i in bonded if i in localIndex))
+        key.append((atom.element, atom.name, internal, len(bonded)-len(internal)))
+    return tuple(key)
+
+
 def _applyPatchesToMatchResidues(forcefield, data, residues, templateForResidue, bondedToAtom, ignoreExternalBonds, ignoreExtraParticles):
     """Try to apply patches to find matches for residues."""
     # Start by creating all templates than can be created by applying a combination of one-residue patches
@@ -42,6 +42,9 @@ import warnings
 import sys
 import math
 
+# Computing a derived unit is slow, so create this once rather than for every atom.
+_angstroms_squared = unit.angstroms**2
+
 class PdbStructure(object):
     """
     PdbStructure object holds a parsed Protein Data Bank format file.
@@ -533,8 +536,8 @@ class Residue(object):
         if (atom.name_with_spaces in self.atoms_by_name):
             old_atom = self.atoms_by_name[atom.name_with_spaces]
             # Unless this is a duplicated atom (warn about file error)
-            if atom.alternate_location_indicator in old_atom.locations:
-                warnings.warn("WARNING: duplicate atom (%s, %s)" % (atom, old_atom._pdb_string(old_atom.serial_number, atom.alternate_location_indicator)))
+            if alt_loc in old_atom.locations:
+                warnings.warn("WARNING: duplicate atom (%s, %s)" % (atom, old_atom._pdb_string(old_atom.serial_number, alt_loc)))
             else:
                 for alt_loc, position in atom.locations.items():
                     old_atom.locations[alt_loc] = position
@@ -625,16 +628,15 @@ class Residue(object):
         else:
             locs = list(alt_loc)
         # If an atom has any location in alt_loc, emit the atom
-        for atom in self.atoms:
-            use_atom = False # start pessimistic
-            for loc2 in atom.locations.keys():
-                # print "#%s#%s" % (loc2,locs)
-                if locs is None: # means all locations
-                    use_atom = True
-                elif loc2 in locs:
-                    use_atom = True
-            if use_atom:
+        if locs is None: # means all locations
+            for atom in self.atoms:
                 yield atom
+            return
+        for atom in self.atoms:
+            for loc2 in atom.locations:
+                if loc2 in locs:
+                    yield atom
+                    break
 
     def iter_positions(self, include_alt_loc=False):
         """
@@ -786,9 +788,9 @@ class Atom(object):
         except:
             occupancy = 1.0
         try:
-            temperature_factor = unit.Quantity(float(pdb_line[60:66]), unit.angstroms**2)
+            temperature_factor = unit.Quantity(float(pdb_line[60:66]), _angstroms_squared)
         except:
-            temperature_factor = unit.Quantity(0.0, unit.angstroms**2)
+            temperature_factor = unit.Quantity(0.0, _angstroms_squared)
         self.locations = {}
         loc = Atom.Location(alternate_location_indicator, unit.Quantity(Vec3(x,y,z), unit.angstroms), occupancy, temperature_factor, self.residue_name_with_spaces)
         self.locations[alternate_location_indicator] = loc
@@ -32,6 +32,7 @@ from __future__ import print_function, division, absolute_import
 __author__ = "Peter Eastman"
 __version__ = "1.0"
 
+import gc
 import os
 import sys
 import math
@@ -74,7 +75,18 @@ class PDBFile(object):
         extraParticleIdentifier : string='EP'
             if this value appears in the element column for an ATOM record, the Atom's element will be set to None to mark it as an extra particle
         """
-        
+        # Loading a large file creates millions of objects, which makes Python run the cyclic garbage collector over
+        # and over.  None of those objects are garbage, so disable it while loading.
+
+        gcEnabled = gc.isenabled()
+        gc.disable()
+        try:
+            self._loadFile(file, extraParticleIdentifier)
+        finally:
+            if gcEnabled:
+                gc.enable()
+
+    def _loadFile(self, file, extraParticleIdentifier):
         metalElements = ['Al','As','Ba','Ca','Cd','Ce','Co','Cs','Cu','Dy','Fe','Gd','Hg','Ho','In','Ir','K','Li','Mg',
         'Mn','Mo','Na','Ni','Pb','Pd','Pt','Rb','Rh','Sm','Sr','Te','Tl','V','W','Yb','Zn']
         
@@ -156,8 +168,15 @@ class PDBFile(object):
             for chain in model.iter_chains():
                 for residue in chain.iter_residues():
                     for atom in residue.iter_atoms():
-                        pos = atom.get_position().value_in_unit(nanometers)
-                        coords.append(Vec3(pos[0], pos[1], pos[2]))
+                        pos = atom.get_position()
+                        if pos.unit is angstroms:
+                            # This is always true for positions read from the file, and is much faster than
+                            # doing a general unit conversion for every atom.
+                            pos = pos._value
+                            coords.append(Vec3(pos[0]*0.1, pos[1]*0.1, pos[2]*0.1))
+                        else:
+                            pos = pos.value_in_unit(nanometers)
+                            coords.append(Vec3(pos[0], pos[1], pos[2]))
             self._positions.append(coords*nanometers)
         ## The atom positions read from the PDB file.  If the file contains multiple frames, these are the positions in the first frame.
         self.positions = self._positions[0]
@@ -33,6 +33,7 @@ from __future__ import division, absolute_import, print_function
 __author__ = "Peter Eastman"
 __version__ = "2.0"
 
+import gc
 import sys
 import math
 from simtk.openmm import Vec3, Platform
@@ -62,6 +63,18 @@ class PDBxFile(object):
             the name of the file to load.  Alternatively you can pass an open
             file object.
         """
+        # Loading a large file creates millions of objects, which makes Python run the cyclic garbage collector over
+        # and over.  None of those objects are garbage, so disable it while loading.
+
+        gcEnabled = gc.isenabled()
+        gc.disable()
+        try:
+            self._loadFile(file)
+        finally:
+            if gcEnabled:
+                gc.enable()
+
+    def _loadFile(self, file):
         top = Topology()
         ## The Topology read from the PDBx/mmCIF file
         self.topology = top
@@ -173,7 +186,7 @@ class PDBxFile(object):
                     raise ValueError('Unknown atom %s in residue %s %s for model %s' % (row[atomNameCol], row[resNameCol], row[resNumCol], model))
                 if atom.index != len(self._positions[modelIndex]):
                     raise ValueError('Atom %s for model %s does not match the order of atoms for model %s' % (row[atomIdCol], model, models[0]))
-            self._positions[modelIndex].append(Vec3(float(row[xCol]), float(row[yCol]), float(row[zCol]))*0.1)
+            self._positions[modelIndex].append(Vec3(float(row[xCol])*0.1, float(row[yCol])*0.1, float(row[zCol])*0.1))
         for i in range(len(self._positions)):
             self._positions[i] = self._positions[i]*nanometers
         ## The atom positions read from the PDBx/mmCIF file.  If the file contains multiple frames, these are the positions in the first frame.
@@ -48,11 +48,6 @@ try:
     have_gzip = True
 except: have_gzip = False
 
-try:
-    import numpy
-    have_numpy = True
-except: have_numpy = False
-
 class SimulatedTempering(object):
     """SimulatedTempering implements the simulated tempering algorithm for accelerated sampling.
     
@@ -173,7 +168,7 @@ class SimulatedTempering(object):
                 steps2 = st.reportInterval - simulation.currentStep%st.reportInterval
                 steps = min(steps1, steps2)
                 isUpdateAttempt = (steps1 == steps)
-                return (steps, False, isUpdateAttempt, False, isUpdateAttempt)
+                return (steps, False, False, False, isUpdateAttempt)
 
             def report(self, simulation, state):
                 st = self.st
@@ -219,11 +214,7 @@ class SimulatedTempering(object):
                     # Rescale the velocities.
                     
                     scale = math.sqrt(self.temperatures[j]/self.temperatures[self.currentTemperature])
-                    if have_numpy:
-                        velocities = scale*state.getVelocities(asNumpy=True).value_in_unit(unit.nanometers/unit.picoseconds)
-                    else:
-                        velocities = [v*scale for v in state.getVelocities().value_in_unit(unit.nanometers/unit.picoseconds)]
-                    self.simulation.context.setVelocities(velocities)
+                    self.simulation.context.scaleVelocities(scale)
 
                     # Select this temperature.
                     
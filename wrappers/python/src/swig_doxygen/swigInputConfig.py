@@ -57,6 +57,10 @@ SKIP_METHODS = [('State', 'getPositions'),
                 ('ConstraintInfo',),
                 ('CudaKernelFactory',),
                 ('CudaStreamFactory',),
+                ('DCDReporter',),
+                ('SharedMemoryReporter',),
+                ('SharedMemoryReader',),
+                ('ReplicaExchange',),
                 ('ExceptionInfo',),
                 ('ExclusionInfo',),
                 ('FunctionInfo',),
@@ -94,6 +98,9 @@ SKIP_METHODS = [('State', 'getPositions'),
                 ('WcaDispersionInfo',),
                 ('Context',  'getIntegrator'),
                 ('Context',  'createCheckpoint'),
+                ('Context',  'createCheckpointAsync'),
+                ('Context',  'getPositionsFloat'),
+                ('Context',  'getVelocitiesFloat'),
                 ('Context',  'loadCheckpoint'),
                 ('CudaPlatform',),
                 ('Force',    'Force'),
@@ -121,6 +128,8 @@ SKIP_METHODS = [('State', 'getPositions'),
 # The build script assumes method args that are non-const references are
 # used to output values. This list gives excpetions to this rule.
 NO_OUTPUT_ARGS = [('LocalEnergyMinimizer', 'minimize', 'context'),
+                  ('HydrogenMassRepartitioning', 'repartitionHydrogenMass', 'system'),
+                  ('HydrogenMassRepartitioning', 'constrainHydrogenAngles', 'system'),
                   ('Platform', 'setPropertyValue', 'context'),
                   ('AmoebaTorsionTorsionForce', 'setTorsionTorsionGrid', 'grid'),
                   ('AmoebaVdwForce', 'setParticleExclusions', 'exclusions'),
@@ -213,6 +222,7 @@ UNITS = {
 ("*", "getSoluteDielectric") : (None, ()),
 ("*", "getSolventDielectric") : (None, ()),
 ("*", "getStepSize") : ("unit.picosecond", ()),
+("HydrogenMassRepartitioning", "findMaxStepSize") : ("unit.picosecond", ()),
 ("*", "getMaximumStepSize") : ("unit.picosecond", ()),
 ("*", "getSystem") : (None, ()),
 ("*", "getTabulatedFunction") : (None, ()),
@@ -342,6 +352,9 @@ UNITS = {
 ("AmoebaWcaDispersionForce",              "getEpsh")                                       :  ( 'unit.kilojoule_per_mole',()),
 ("AmoebaWcaDispersionForce",              "getSlevy")                                      :  ( None, ()),
 ("AmoebaWcaDispersionForce",              "getShctd")                                      :  ( None, ()),
+("AmoebaWcaDispersionForce",              "getUseCutoff")                                  :  ( None, ()),
+("AmoebaWcaDispersionForce",              "getCutoffDistance")                             :  ( 'unit.nanometer',()),
+("AmoebaWcaDispersionForce",              "getSwitchingDistance")                          :  ( 'unit.nanometer',()),
 
 ("HippoNonbondedForce",                 "getExtrapolationCoefficients")                  :  ( None, ()),
 ("HippoNonbondedForce",                 "getParticleParameters")                         :  ( None, ('unit.elementary_charge', 'unit.elementary_charge*unit.nanometer',
@@ -354,7 +367,9 @@ UNITS = {
 ("Context", "getParameter") : (None, ()),
 ("Context", "getParameters") : (None, ()),
 ("Context", "getMolecules") : (None, ()),
+("Context", "getSubsetPositions") : (None, ('unit.nanometer',)),
 ("Context", "getState") : (None, (None, None, None)),
+("Context", "getRequestedState") : (None, ()),
 ("CMAPTorsionForce", "getMapParameters") : (None, (None, 'unit.kilojoule_per_mole')),
 ("CMAPTorsionForce", "getTorsionParameters") : (None, ()),
 ("CMMotionRemover", "getFrequency") : (None, ()),
@@ -72,6 +72,23 @@
         state = _openmm.Context_getState(self, types, enforcePeriodicBox, groups_mask)
         return state
 
+    def getPositionsFloat(self):
+        """Get the positions of all particles in single precision, as a Numpy array of
+        shape (N, 3) and type float32.  This avoids creating a State, and on platforms that
+        store positions in single precision, avoids converting them to double precision.
+        """
+        positions = numpy.empty([self.getSystem().getNumParticles(), 3], numpy.float32)
+        self._getVectorFloat(True, positions)
+        return positions*unit.nanometers
+
+    def getVelocitiesFloat(self):
+        """Get the velocities of all particles in single precision, as a Numpy array of
+        shape (N, 3) and type float32.
+        """
+        velocities = numpy.empty([self.getSystem().getNumParticles(), 3], numpy.float32)
+        self._getVectorFloat(False, velocities)
+        return velocities*unit.nanometers/unit.picosecond
+
   %}
 
   %feature("docstring") createCheckpoint "Create a checkpoint recording the current state of the Context.
@@ -109,6 +126,16 @@ Parameters:
     stream << checkpoint;
     self->loadCheckpoint(stream);
   }
+
+  void _getVectorFloat(bool positions, PyObject* output) {
+    std::vector<float> values;
+    if (positions)
+        self->getPositionsFloat(values);
+    else
+        self->getVelocitiesFloat(values);
+    void* data = PyArray_DATA((PyArrayObject*) output);
+    memcpy(data, &values[0], sizeof(float)*values.size());
+  }
 }
 
 %extend OpenMM::Integrator {
@@ -233,40 +233,20 @@ int Py_SequenceToVecDouble(PyObject* obj, std::vector<double>& out) {
 int Py_SequenceToVecVec3(PyObject* obj, std::vector<Vec3>& out) {
     PyObject* stripped = Py_StripOpenMMUnits(obj);      // new reference
     if (isNumpyAvailable()) {
-        if (PyArray_Check(stripped) && PyArray_ISCARRAY_RO(stripped) && PyArray_NDIM(stripped) == 2 && PyArray_DIM(stripped, 1) == 3) {
-            int type = PyArray_TYPE(stripped);
-            int length = PyArray_DIM(stripped, 0);
-            void* data = PyArray_DATA((PyArrayObject*) stripped);
-            if (type == NPY_DOUBLE) {
-                out.resize(length);
-                memcpy(&out[0][0], data, 3*sizeof(double)*length);
-                Py_DECREF(stripped);
-                return SWIG_OK;
-            }
-            if (type == NPY_FLOAT) {
-                out.resize(length);
-                float* floatData = (float*) data;
-                for (int i = 0; i < length; i++)
-                    out[i] = Vec3(floatData[3*i], floatData[3*i+1], floatData[3*i+2]);
-                Py_DECREF(stripped);
-                return SWIG_OK;
-            }
-            if (type == NPY_INT32) {
-                out.resize(length);
-                int* intData = (int*) data;
-                for (int i = 0; i < length; i++)
-                    out[i] = Vec3(intData[3*i], intData[3*i+1], intData[3*i+2]);
-                Py_DECREF(stripped);
-                return SWIG_OK;
-            }
-            if (type == NPY_INT64) {
+        if (PyArray_Check(stripped) && PyArray_NDIM((PyArrayObject*) stripped) == 2 && PyArray_DIM((PyArrayObject*) stripped, 1) == 3) {
+            // Let NumPy convert the array to contiguous doubles if it is not already, then copy it all at once.
+
+            PyObject* array = PyArray_FROMANY(stripped, NPY_DOUBLE, 2, 2, NPY_ARRAY_CARRAY_RO | NPY_ARRAY_FORCECAST);   // new reference
+            if (array != NULL) {
+                int length = PyArray_DIM((PyArrayObject*) array, 0);
                 out.resize(length);
-                long long* longData = (long long*) data;
-                for (int i = 0; i < length; i++)
-                    out[i] = Vec3(longData[3*i], longData[3*i+1], longData[3*i+2]);
+                if (length > 0)
+                    memcpy(&out[0][0], PyArray_DATA((PyArrayObject*) array), 3*sizeof(double)*length);
+                Py_DECREF(array);
                 Py_DECREF(stripped);
                 return SWIG_OK;
             }
+            PyErr_Clear();
         }
     }
     int ret = 0;
@@ -1019,6 +1019,24 @@ END"""))
         # If the check is not done correctly, this will throw an exception.
         ff.createSystem(pdb.topology)
 
+    def test_RepeatedResidues(self):
+        """Test that template matches reused for identical residues give the same results as matching each one."""
+        ff = ForceField('tip3p.xml')
+        top = Topology()
+        chain = top.addChain()
+        for names in [('O', 'H1', 'H2'), ('O', 'H1', 'H2'), ('H1', 'O', 'H2'), ('O', 'H1', 'H2')]:
+            res = top.addResidue('HOH', chain)
+            atoms = {}
+            for name in names:
+                atoms[name] = top.addAtom(name, elem.oxygen if name == 'O' else elem.hydrogen, res)
+            top.addBond(atoms['O'], atoms['H1'])
+            top.addBond(atoms['O'], atoms['H2'])
+        system = ff.createSystem(top)
+        nonbonded = [f for f in system.getForces() if isinstance(f, NonbondedForce)][0]
+        for atom in top.atoms():
+            charge = nonbonded.getParticleParameters(atom.index)[0].value_in_unit(elementary_charge)
+            self.assertEqual(-0.834 if atom.element == elem.oxygen else 0.417, charge)
+
     def test_CharmmPolar(self):
         """Test the CHARMM polarizable force field."""
         pdb = PDBFile('systems/ala_ala_ala_drude.pdb')
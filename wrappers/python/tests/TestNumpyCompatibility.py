@@ -59,6 +59,34 @@ class TestNumpyCompatibility(unittest.TestCase):
         np.testing.assert_array_almost_equal(input.value_in_unit(unit.angstroms / unit.femtoseconds),
                                              output.value_in_unit(unit.angstroms / unit.femtoseconds))
 
+    def test_setPositions_noncontiguous(self):
+        n_particles = self.simulation.context.getSystem().getNumParticles()
+        input = np.random.randn(3, n_particles).T
+        self.simulation.context.setPositions(input)
+        output = self.simulation.context.getState(getPositions=True).getPositions(asNumpy=True)
+
+        np.testing.assert_array_almost_equal(input, output)
+        input = np.random.randn(n_particles, 3).astype(np.float32)
+        self.simulation.context.setPositions(input)
+        output = self.simulation.context.getState(getPositions=True).getPositions(asNumpy=True)
+
+        np.testing.assert_array_almost_equal(input, output)
+
+    def test_stateArrayIsWritable(self):
+        n_particles = self.simulation.context.getSystem().getNumParticles()
+        input = np.random.randn(n_particles, 3)
+        self.simulation.context.setPositions(input)
+        state = self.simulation.context.getState(getPositions=True)
+        output = state.getPositions(asNumpy=True)
+        self.assertTrue(output._value.flags.writeable)
+
+        # The array must remain valid after the State is released.
+
+        del state
+        np.testing.assert_array_almost_equal(input, output)
+        output._value[0] = [1, 2, 3]
+        np.testing.assert_array_almost_equal([1, 2, 3], output._value[0])
+
     def test_periodicBoxVectors(self):
         output = self.simulation.context.getState(getVelocities=True).getPeriodicBoxVectors(asNumpy=True)
         systemBox = self.simulation.system.getDefaultPeriodicBoxVectors()